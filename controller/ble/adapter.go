@@ -0,0 +1,113 @@
+package ble
+
+import (
+	"fmt"
+	"github.com/paypal/gatt"
+	"time"
+)
+
+// Each HCI adapter holds only so many connections, so a controller can
+// run several. All of them scan; a brick heard by more than one is
+// connected from whichever hears it best, counting each connection an
+// adapter already holds against it, so bricks spread out as they come
+// and go. The writer, schedules and everything else above still treat
+// the bricks as one set.
+type adapter struct {
+	d gatt.Device
+	// HCI device number, -1 for the first found
+	hci int
+	// Serial port of a connectivity dongle (sddevice.go) instead
+	port string
+	// Connections it holds, adapterMaxConnections if 0
+	maxConnections int
+	powered        bool
+	scanning       bool
+	// Radio time in use through it, see airtime.go
+	air *airLedger
+}
+
+func (a *adapter) String() string {
+	if a.port != "" {
+		return a.port
+	}
+	return fmt.Sprintf("hci%d", a.hci)
+}
+
+const (
+	adapterMaxConnections = 10
+	// Signal an adapter gives up per connection it already holds, dB
+	adapterLoadDB = 6
+	// Only adapters that heard a brick this recently can take it
+	sightingTimeout = 10 * time.Second
+)
+
+// A brick's last advertisement through one adapter
+type sighting struct {
+	rssi int
+	at   time.Time
+}
+
+// pickAdapter is the adapter to connect a brick from, given what each
+// heard of it and the connections each holds, or -1 if none can
+func pickAdapter(seen []sighting, loads []int, now time.Time) int {
+	best, bestScore := -1, 0
+	for i, s := range seen {
+		if s.at.IsZero() || now.Sub(s.at) > sightingTimeout || loads[i] >= adapterMaxConnections {
+			continue
+		}
+		score := s.rssi - adapterLoadDB*loads[i]
+		if best < 0 || score > bestScore {
+			best, bestScore = i, score
+		}
+	}
+	return best
+}
+
+func adapterOptions(hci int) []gatt.Option {
+	return []gatt.Option{
+		gatt.LnxMaxConnections(adapterMaxConnections),
+		gatt.LnxDeviceID(hci, true),
+	}
+}
+
+// adapterOf is the index of the adapter d is. Called with ble.lock
+// held.
+func (ble *bleChannel) adapterOf(d gatt.Device) int {
+	for i, a := range ble.adapters {
+		if a.d == d {
+			return i
+		}
+	}
+	return 0
+}
+
+// adapterLoads is the connections each adapter holds or is making.
+// Called with ble.lock held.
+func (ble *bleChannel) adapterLoads() []int {
+	loads := make([]int, len(ble.adapters))
+	for _, l := range ble.links {
+		if l.state != LinkDiscovered {
+			loads[l.adapter]++
+		}
+	}
+	return loads
+}
+
+// sighted records id heard through adapter a, and gives whether a is
+// the one to connect it from. Called with ble.lock held.
+func (ble *bleChannel) sighted(id string, a, rssi int, now time.Time) bool {
+	seen := ble.sightings[id]
+	if seen == nil {
+		seen = make([]sighting, len(ble.adapters))
+		ble.sightings[id] = seen
+	}
+	seen[a] = sighting{rssi: rssi, at: now}
+	loads := ble.adapterLoads()
+	for i, ad := range ble.adapters {
+		if ad.maxConnections > 0 && loads[i] >= ad.maxConnections {
+			// Full, as pickAdapter has it
+			loads[i] = adapterMaxConnections
+		}
+	}
+	return pickAdapter(seen, loads, now) == a
+}
@@ -0,0 +1,42 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestPickAdapter(t *testing.T) {
+	now := time.Now()
+	seen := []sighting{{rssi: -70, at: now}, {rssi: -60, at: now}, {}}
+	if a := pickAdapter(seen, []int{0, 0, 0}, now); a != 1 {
+		t.Errorf("strongest idle adapter not picked, got %d", a)
+	}
+	// Two connections on adapter 1 outweigh its 10 dB
+	if a := pickAdapter(seen, []int{0, 2, 0}, now); a != 0 {
+		t.Errorf("loaded adapter picked, got %d", a)
+	}
+	if a := pickAdapter(seen, []int{adapterMaxConnections, adapterMaxConnections, 0}, now); a != -1 {
+		t.Errorf("full or deaf adapter picked, got %d", a)
+	}
+	if a := pickAdapter(seen, []int{0, 0, 0}, now.Add(sightingTimeout+time.Second)); a != -1 {
+		t.Errorf("stale sighting picked, got %d", a)
+	}
+
+	ble := &bleChannel{adapters: []*adapter{{}, {maxConnections: 3}},
+		links: map[string]*brickLink{
+			"a": {state: LinkLive, adapter: 1},
+			"b": {state: LinkConnecting, adapter: 1},
+			"c": {state: LinkDiscovered, adapter: 0},
+		},
+		sightings: make(map[string][]sighting),
+	}
+	if loads := ble.adapterLoads(); loads[0] != 0 || loads[1] != 2 {
+		t.Errorf("loads %v", loads)
+	}
+	if !ble.sighted("c", 0, -80, now) {
+		t.Error("only adapter hearing the brick not picked")
+	}
+	if ble.sighted("c", 1, -75, now) {
+		t.Error("loaded adapter took the brick for 5 dB")
+	}
+}
@@ -0,0 +1,271 @@
+package ble
+
+import (
+	"fmt"
+	"io"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+// Every brick on an adapter shares its radio time: frames and commands,
+// connecting and discovery, scanning, firmware transfers and bulk
+// transfers. Each operation is costed as the link layer packets it puts
+// on air at the 1M PHY, acknowledgements and frame spaces included, and
+// added up by adapter over the last airtimeWindow. Keeping each
+// connection's events going costs an empty exchange every interval, and
+// scanning takes airScanShare while it's on; both are worked out each
+// tick from the links as they are.
+//
+// Live traffic (frames, safety and interactive commands) always goes.
+// Bulk work only starts, and bulk runs already going only take their
+// next turn, while what's left of airBudget after everything else
+// covers it, so an adapter full of bricks is never pushed into making
+// them miss frames. A run held past airMaxPause goes anyway, so a
+// transfer the brick is waiting on doesn't time out.
+const (
+	airtimeWindow = 10 * time.Second
+	// Share of its time an adapter is let fill; past this connection
+	// events start slipping on a busy band
+	airBudget = 0.6
+	// Listening between connection events, as gatt scans continuously
+	airScanShare = 0.1
+	airMaxPause  = 2 * time.Second
+	airPause     = 50 * time.Millisecond
+
+	// Preamble, access address, header and CRC around each packet
+	airPacketOverhead = 10
+	// Largest link layer payload, without data length extension
+	airMaxPayload = 27
+	// L2CAP header, and ATT opcode and handle
+	airL2capHeader = 4
+	airAttHeader   = 3
+	// Services, characteristics and descriptors read finding a brick's
+	// table without the cache
+	airDiscoveryReads = 40
+	// A command record with its header, about
+	airCommandLen = 20
+	// Notifications and packets carry this much of a bulk transfer each
+	airChunk = 20
+)
+
+type airUse int
+
+const (
+	airLive airUse = iota
+	airBulk
+	airUses
+)
+
+var airUseNames = [...]string{"live", "bulk", "upkeep", "scan"}
+
+// airPacket is the radio time of a link layer packet with n bytes of
+// payload, answered by an empty one, on the 1M PHY at a microsecond a bit
+func airPacket(n int) time.Duration {
+	const ifs = 150 * time.Microsecond
+	bits := func(n int) time.Duration { return time.Duration((airPacketOverhead+n)*8) * time.Microsecond }
+	return bits(n) + ifs + bits(0) + ifs
+}
+
+// airPDUs is n bytes over as many packets as they take
+func airPDUs(n int) time.Duration {
+	d := time.Duration(0)
+	for ; n > airMaxPayload; n -= airMaxPayload {
+		d += airPacket(airMaxPayload)
+	}
+	return d + airPacket(n)
+}
+
+// airWrite is an ATT write of n bytes, and its response when rsp
+func airWrite(n int, rsp bool) time.Duration {
+	d := airPDUs(airL2capHeader + airAttHeader + n)
+	if rsp {
+		d += airPDUs(airL2capHeader + 1)
+	}
+	return d
+}
+
+// airRead is an ATT read answered with n bytes
+func airRead(n int) time.Duration {
+	return airPDUs(airL2capHeader+airAttHeader) + airPDUs(airL2capHeader+1+n)
+}
+
+// airTransfer is n bytes of a bulk transfer, a chunk a packet
+func airTransfer(n int) time.Duration {
+	chunks := (n + airChunk - 1) / airChunk
+	return time.Duration(chunks) * airWrite(airChunk, false)
+}
+
+// airLedger is one adapter's radio time
+type airLedger struct {
+	clock clock.Clock
+	// Each second of the window by use, a ring on the clock's seconds
+	slots  [airtimeWindow / time.Second][airUses]time.Duration
+	newest int64
+	// Shares for connection upkeep and scanning, as of the last tick
+	upkeep, scan float64
+	// Bulk work held back, each time it's checked
+	held int64
+
+	lock sync.Mutex
+}
+
+func newAirLedger(c clock.Clock) *airLedger {
+	return &airLedger{clock: c, newest: c.Now().Unix()}
+}
+
+// advance moves the ring on to the second now, clearing the ones passed.
+// Called with l.lock held.
+func (l *airLedger) advance() int {
+	sec := l.clock.Now().Unix()
+	n := int64(len(l.slots))
+	for s := l.newest + 1; s <= sec && s <= l.newest+n; s++ {
+		l.slots[s%n] = [airUses]time.Duration{}
+	}
+	if sec > l.newest {
+		l.newest = sec
+	}
+	return int(l.newest % n)
+}
+
+// charge counts d of radio time for use. A nil ledger, for links on no
+// adapter of ours, counts nothing.
+func (l *airLedger) charge(use airUse, d time.Duration) {
+	if l == nil {
+		return
+	}
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	l.slots[l.advance()][use] += d
+}
+
+// shares is each use's share of the window, upkeep and scanning after
+// those charged. Called with l.lock held.
+func (l *airLedger) shares() [len(airUseNames)]float64 {
+	l.advance()
+	var s [len(airUseNames)]float64
+	for _, slot := range l.slots {
+		for use, d := range slot {
+			s[use] += d.Seconds() / airtimeWindow.Seconds()
+		}
+	}
+	s[airUses], s[airUses+1] = l.upkeep, l.scan
+	return s
+}
+
+// Share of airBudget not taken. Called with l.lock held.
+func (l *airLedger) room() float64 {
+	room := airBudget
+	for _, s := range l.shares() {
+		room -= s
+	}
+	return room
+}
+
+// admits is whether bulk work taking share of the adapter's time while
+// it runs fits now
+func (l *airLedger) admits(share float64) bool {
+	if l == nil {
+		return true
+	}
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	if l.room() >= share {
+		return true
+	}
+	l.held++
+	return false
+}
+
+// pace waits for room on the adapter for a bulk run's next turn, up to
+// airMaxPause
+func (l *airLedger) pace() {
+	if l == nil {
+		return
+	}
+	for waited := time.Duration(0); waited < airMaxPause; waited += airPause {
+		if l.admits(0) {
+			return
+		}
+		time.Sleep(airPause)
+	}
+}
+
+// setFixed takes the shares for connection upkeep and scanning
+func (l *airLedger) setFixed(upkeep, scan float64) {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	l.upkeep, l.scan = upkeep, scan
+}
+
+// useOf is the use writes at prio count as
+func useOf(prio writePriority) airUse {
+	if prio == prioBulk {
+		return airBulk
+	}
+	return airLive
+}
+
+// airOf is adapter's ledger, nil for none. Called with ble.lock held.
+func (ble *bleChannel) airOf(adapter int) *airLedger {
+	if adapter < 0 || adapter >= len(ble.adapters) {
+		return nil
+	}
+	return ble.adapters[adapter].air
+}
+
+// noteAirtime works out each adapter's connection upkeep and scanning
+// from the links now. Called with ble.lock held.
+func (ble *bleChannel) noteAirtime() {
+	upkeep := make([]float64, len(ble.adapters))
+	for id, p := range ble.connectedPeriph {
+		a := ble.link(id).adapter
+		if a >= len(upkeep) {
+			continue
+		}
+		interval := time.Duration(atomic.LoadInt64(&p.metrics.connInterval))
+		if interval == 0 {
+			// Unknown on gatt's links, so taken as the shortest the
+			// bricks run
+			interval = connProfiles[connBurst].interval()
+		}
+		upkeep[a] += airPacket(0).Seconds() / interval.Seconds()
+	}
+	for i, a := range ble.adapters {
+		scan := 0.0
+		if a.scanning {
+			scan = airScanShare
+		}
+		a.air.setFixed(upkeep[i], scan)
+	}
+}
+
+// writeAirtime writes each adapter's radio time by use, and the bulk
+// work held back for it
+func (ble *bleChannel) writeAirtime(w io.Writer) {
+	ble.lock.Lock()
+	adapters := append([]*adapter(nil), ble.adapters...)
+	ble.lock.Unlock()
+
+	name := "ledbrick_adapter_airtime_ratio"
+	fmt.Fprintf(w, "# HELP %s Share of the adapter's radio time in use over the last %v\n# TYPE %s gauge\n",
+		name, airtimeWindow, name)
+	for _, a := range adapters {
+		a.air.lock.Lock()
+		shares := a.air.shares()
+		a.air.lock.Unlock()
+		for use, s := range shares {
+			fmt.Fprintf(w, "%s{adapter=%q,use=%q} %g\n", name, a.String(), airUseNames[use], s)
+		}
+	}
+	name = "ledbrick_adapter_bulk_held_total"
+	fmt.Fprintf(w, "# HELP %s Bulk work held back for airtime, each time it was checked\n# TYPE %s counter\n", name, name)
+	for _, a := range adapters {
+		a.air.lock.Lock()
+		held := a.air.held
+		a.air.lock.Unlock()
+		fmt.Fprintf(w, "%s{adapter=%q} %d\n", name, a.String(), held)
+	}
+}
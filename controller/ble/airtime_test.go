@@ -0,0 +1,97 @@
+package ble
+
+import (
+	"bytes"
+	"strings"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+func TestAirtimeCosts(t *testing.T) {
+	// 37 bytes on air and the empty answer, two frame spaces
+	if d := airPacket(airMaxPayload); d != 676*time.Microsecond {
+		t.Errorf("full packet %v", d)
+	}
+	// A 20 byte write fills one packet, a response takes another
+	if airWrite(20, false) != airPacket(27) || airWrite(20, true) != airPacket(27)+airPacket(5) {
+		t.Errorf("write %v, with response %v", airWrite(20, false), airWrite(20, true))
+	}
+	if airWrite(21, false) != airPacket(27)+airPacket(1) {
+		t.Errorf("write spilling into a second packet %v", airWrite(21, false))
+	}
+	if airTransfer(100) != 5*airWrite(airChunk, false) {
+		t.Errorf("transfer %v", airTransfer(100))
+	}
+}
+
+func TestAirLedger(t *testing.T) {
+	sim := clock.NewSim(time.Date(2016, 1, 1, 0, 0, 0, 0, time.UTC))
+	l := newAirLedger(sim)
+	if !l.admits(airBudget) {
+		t.Fatal("idle adapter held bulk work")
+	}
+	// Live traffic filling 40% of the window leaves bulk what's left of
+	// the budget after upkeep and scanning
+	l.charge(airLive, 4*time.Second)
+	l.setFixed(0.05, airScanShare)
+	if l.admits(0.1) || l.held != 1 {
+		t.Errorf("bulk admitted past the budget, %d held", l.held)
+	}
+	if !l.admits(0) {
+		t.Error("bulk held within the budget")
+	}
+	l.lock.Lock()
+	s := l.shares()
+	l.lock.Unlock()
+	if s[airLive] != 0.4 || s[airBulk] != 0 || s[airUses] != 0.05 || s[airUses+1] != airScanShare {
+		t.Errorf("shares %v", s)
+	}
+	// Out of the window, it's forgotten
+	sim.Advance(airtimeWindow)
+	if !l.admits(0.4) {
+		t.Error("old traffic still counted")
+	}
+
+	var nilLedger *airLedger
+	nilLedger.charge(airBulk, time.Second)
+	if !nilLedger.admits(1) {
+		t.Error("link on no adapter held")
+	}
+}
+
+func TestAirtimeAdmission(t *testing.T) {
+	sim := clock.NewSim(time.Date(2020, 1, 1, 12, 0, 0, 0, time.UTC))
+	ble := newBleChannel([]*adapter{{hci: 0}}, sim)
+	ble.maint = newMaintenance(DefaultMaintenanceWindow)
+	air := ble.adapters[0].air
+	backfill := &maintJob{kind: maintBackfill, id: "a", length: maintBackfillTime, air: time.Second, queued: sim.Now()}
+	if !ble.maintOpen(backfill, 0, &ledState{}, sim.Now()) {
+		t.Fatal("backfill held on an idle adapter")
+	}
+	air.charge(airLive, time.Duration(airBudget*float64(airtimeWindow)))
+	if ble.maintOpen(backfill, 0, &ledState{}, sim.Now()) {
+		t.Error("backfill went on a full adapter")
+	}
+	// Each brick on the shortest interval keeps its connection events going
+	ble.connectedPeriph["a"] = &blePeriph{metrics: ble.metrics.brick("a")}
+	ble.link("a").adapter = 0
+	ble.adapters[0].scanning = true
+	ble.noteAirtime()
+	if want := airPacket(0).Seconds() / connProfiles[connBurst].interval().Seconds(); air.upkeep != want || air.scan != airScanShare {
+		t.Errorf("upkeep %g, scan %g", air.upkeep, air.scan)
+	}
+
+	var w bytes.Buffer
+	ble.writeAirtime(&w)
+	for _, want := range []string{
+		`ledbrick_adapter_airtime_ratio{adapter="hci0",use="live"} 0.6`,
+		`ledbrick_adapter_airtime_ratio{adapter="hci0",use="scan"} 0.1`,
+		`ledbrick_adapter_bulk_held_total{adapter="hci0"} 1`,
+	} {
+		if !strings.Contains(w.String(), want) {
+			t.Errorf("metrics missing %s:\n%s", want, w.String())
+		}
+	}
+}
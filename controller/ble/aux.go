@@ -0,0 +1,107 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"math"
+)
+
+// Auxiliary output records, laid out in the firmware's aux.h. Duties are
+// on the PCA9685's 0-4095 scale.
+const (
+	auxRecord  = 9
+	auxMaxDuty = 4095
+	// Past any brick's emitter strings, so 8-15 on a board wiring eight
+	auxChannels = 16
+)
+
+var auxModes = [...]string{"off", "fixed", "fan", "wave"}
+
+// AuxOutput drives a spare PCA9685 output, one past the brick's
+// emitter strings, on its own: a pump or moonlight at High, a fan from
+// Low to High as the brick's fan loop asks (off when it's off), or a
+// wavemaker at High for the first half of each Period seconds and Low
+// for the second, Phase percent into it. Duties are percent. They still
+// go dark with the LEDs' output enable.
+type AuxOutput struct {
+	Channel int     `json:"channel"`
+	Mode    string  `json:"mode"`
+	Low     float64 `json:"low,omitempty"`
+	High    float64 `json:"high,omitempty"`
+	Period  int     `json:"period,omitempty"`
+	Phase   int     `json:"phase,omitempty"`
+}
+
+func auxDuty(percent float64) uint16 {
+	return uint16(math.Round(percent * auxMaxDuty / 100))
+}
+
+// auxBody packs outputs into one bulk command body
+func auxBody(as []AuxOutput) ([]byte, error) {
+	var body []byte
+	for _, a := range as {
+		if a.Channel < 0 || a.Channel >= auxChannels {
+			return nil, fmt.Errorf("aux channel must be 0-%d, got %d", auxChannels-1, a.Channel)
+		}
+		mode := -1
+		for i, name := range auxModes {
+			if a.Mode == name {
+				mode = i
+			}
+		}
+		if mode < 0 {
+			return nil, fmt.Errorf("aux %d: unknown mode %q", a.Channel, a.Mode)
+		}
+		if a.Low < 0 || a.High > 100 || a.Low > a.High {
+			return nil, fmt.Errorf("aux %d: duties must rise within 0-100%%, got %g-%g", a.Channel, a.Low, a.High)
+		}
+		if a.Period < 0 || a.Period > math.MaxUint16 || (a.Mode == "wave" && a.Period == 0) {
+			return nil, fmt.Errorf("aux %d: period must be 1-%d s, got %d", a.Channel, math.MaxUint16, a.Period)
+		}
+		if a.Phase < 0 || a.Phase > 100 {
+			return nil, fmt.Errorf("aux %d: phase must be 0-100%%, got %d", a.Channel, a.Phase)
+		}
+		r := make([]byte, auxRecord)
+		r[0] = byte(a.Channel)
+		r[1] = byte(mode)
+		binary.LittleEndian.PutUint16(r[2:], auxDuty(a.Low))
+		binary.LittleEndian.PutUint16(r[4:], auxDuty(a.High))
+		binary.LittleEndian.PutUint16(r[6:], uint16(a.Period))
+		r[8] = byte(a.Phase)
+		body = append(body, r...)
+	}
+	return body, nil
+}
+
+func (p *blePeriph) storeAux(body []byte) {
+	if p.caps == nil || !p.caps.has(capAux) {
+		return
+	}
+	p.linkBusy()
+	if _, err := p.bulk.request(bulkCmdAux, body, bulkReplyTimeout); err != nil {
+		log.Printf("%s: storing aux outputs: %s", p.gp.ID(), err)
+	}
+}
+
+func (ble *bleChannel) SetAux(as []AuxOutput) error {
+	body, err := auxBody(as)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	ble.aux = body
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.bulk != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, p := range periphs {
+		go p.storeAux(body)
+	}
+	return nil
+}
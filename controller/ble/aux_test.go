@@ -0,0 +1,36 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestAuxBody(t *testing.T) {
+	b, err := auxBody([]AuxOutput{
+		{Channel: 8, Mode: "fixed", High: 50},
+		{Channel: 9, Mode: "wave", Low: 10, High: 100, Period: 30, Phase: 50},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := []byte{
+		8, 1, 0, 0, 0x00, 0x08, 0, 0, 0,
+		9, 3, 0x9a, 0x01, 0xff, 0x0f, 30, 0, 50,
+	}
+	if !bytes.Equal(b, want) {
+		t.Errorf("body % x", b)
+	}
+
+	for _, a := range []AuxOutput{
+		{Channel: 16, Mode: "off"},
+		{Channel: 8, Mode: "pump"},
+		{Channel: 8, Mode: "fan", Low: 60, High: 40},
+		{Channel: 8, Mode: "fixed", High: 101},
+		{Channel: 8, Mode: "wave", High: 100},
+		{Channel: 8, Mode: "wave", High: 100, Period: 10, Phase: 101},
+	} {
+		if _, err := auxBody([]AuxOutput{a}); err == nil {
+			t.Errorf("accepted %+v", a)
+		}
+	}
+}
@@ -0,0 +1,203 @@
+package ble
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"math"
+	"time"
+)
+
+// Bricks keep their own temperature and fan history while no controller
+// is listening, laid out in the firmware's history.h. On each connect
+// the blocks since the last download are read over the bulk channel and
+// the samples falling in the gap before the connection go into the
+// brick's history as though they had come live.
+const (
+	historyBlockLen   = 64
+	historyReplyLen   = 6
+	historySamplesOff = 18
+	historyCrcOff     = historyBlockLen - 2
+
+	historyTempNone      = math.MinInt16
+	historyTempEscape    = -16
+	historyFanChanged    = 1 << 5
+	historyDerateChanged = 1 << 6
+
+	// Frames asked for on one connect, each seven blocks, about two
+	// hours of samples
+	backfillMaxRounds  = 32
+	historyFrameBlocks = 7
+)
+
+type historySample struct {
+	// 1/16 degree C, historyTempNone without a reading
+	temperature16 int
+	rpm           int
+	derate        int
+}
+
+type historyBlock struct {
+	seq uint32
+	// Local wall time of the first sample on the brick's clock, 0 if it
+	// wasn't set
+	time    uint32
+	uptime  uint32
+	samples []historySample
+}
+
+type historyLog struct {
+	// The block the brick is filling, always the last one sent
+	open     uint32
+	interval time.Duration
+	blocks   []historyBlock
+}
+
+// Where a download carries on from: the block, and how many of its
+// samples were taken while it was still being filled
+type historyCursor struct {
+	seq   uint32
+	taken int
+}
+
+func getZigzag(b []byte) (int, []byte, error) {
+	v, n := binary.Uvarint(b)
+	if n <= 0 {
+		return 0, nil, errors.New("truncated history sample")
+	}
+	return int(int64(v>>1) ^ -int64(v&1)), b[n:], nil
+}
+
+func parseHistoryBlock(b []byte, open bool) (historyBlock, error) {
+	blk := historyBlock{
+		seq:    binary.LittleEndian.Uint32(b[0:]),
+		time:   binary.LittleEndian.Uint32(b[4:]),
+		uptime: binary.LittleEndian.Uint32(b[8:]),
+	}
+	if !open && crc16(0xffff, b[:historyCrcOff]) != binary.LittleEndian.Uint16(b[historyCrcOff:]) {
+		return blk, fmt.Errorf("history block %d: bad CRC", blk.seq)
+	}
+	s := historySample{
+		temperature16: int(int16(binary.LittleEndian.Uint16(b[12:]))),
+		rpm:           int(binary.LittleEndian.Uint16(b[14:])),
+		derate:        int(b[16]),
+	}
+	count := int(b[17])
+	blk.samples = make([]historySample, 0, count)
+	blk.samples = append(blk.samples, s)
+	rest := b[historySamplesOff:historyCrcOff]
+	for len(blk.samples) < count {
+		if len(rest) == 0 {
+			return blk, fmt.Errorf("history block %d: %d of %d samples", blk.seq, len(blk.samples), count)
+		}
+		h := rest[0]
+		rest = rest[1:]
+		// Five bit signed change, or the escape and a varint
+		dt := int(int8(h<<3) >> 3)
+		var err error
+		if dt == historyTempEscape {
+			if dt, rest, err = getZigzag(rest); err != nil {
+				return blk, err
+			}
+		}
+		s.temperature16 += dt
+		if h&historyFanChanged != 0 {
+			var d int
+			if d, rest, err = getZigzag(rest); err != nil {
+				return blk, err
+			}
+			s.rpm += d
+		}
+		if h&historyDerateChanged != 0 {
+			if len(rest) == 0 {
+				return blk, errors.New("truncated history sample")
+			}
+			s.derate, rest = int(rest[0]), rest[1:]
+		}
+		blk.samples = append(blk.samples, s)
+	}
+	return blk, nil
+}
+
+func parseHistory(b []byte) (historyLog, error) {
+	if len(b) < historyReplyLen || (len(b)-historyReplyLen)%historyBlockLen != 0 {
+		return historyLog{}, fmt.Errorf("bad history length %d", len(b))
+	}
+	l := historyLog{
+		open:     binary.LittleEndian.Uint32(b[0:]),
+		interval: time.Duration(binary.LittleEndian.Uint16(b[4:])) * time.Second,
+	}
+	for off := historyReplyLen; off < len(b); off += historyBlockLen {
+		raw := b[off : off+historyBlockLen]
+		blk, err := parseHistoryBlock(raw, binary.LittleEndian.Uint32(raw) == l.open)
+		if err != nil {
+			return l, err
+		}
+		l.blocks = append(l.blocks, blk)
+	}
+	return l, nil
+}
+
+// backfillHistory downloads the brick's history from where the last
+// download stopped, adding the samples after since and before until.
+// Samples are placed on the brick's clock in loc, and those from before
+// it was set are dropped.
+func (p *blePeriph) backfillHistory(since, until time.Time, loc *time.Location) error {
+	p.linkBusy()
+	p.history.lock.Lock()
+	cur := p.history.cursor
+	p.history.lock.Unlock()
+
+	added, unplaced := 0, 0
+	for round := 0; round < backfillMaxRounds; round++ {
+		var body [4]byte
+		binary.LittleEndian.PutUint32(body[:], cur.seq)
+		b, err := p.bulk.request(bulkCmdHistory, body[:], bulkReplyTimeout)
+		if err != nil {
+			return err
+		}
+		l, err := parseHistory(b)
+		if err != nil {
+			return err
+		}
+		for _, blk := range l.blocks {
+			skip := 0
+			if blk.seq == cur.seq {
+				skip = cur.taken
+			}
+			if skip > len(blk.samples) {
+				// The brick started its log over
+				skip = 0
+			}
+			for i, s := range blk.samples[skip:] {
+				if blk.time == 0 {
+					unplaced++
+					continue
+				}
+				wall := time.Unix(int64(blk.time)+int64(skip+i)*int64(l.interval/time.Second), 0).UTC()
+				at := time.Date(wall.Year(), wall.Month(), wall.Day(), wall.Hour(), wall.Minute(), wall.Second(), 0, loc)
+				if s.temperature16 == historyTempNone || !at.After(since) || !at.Before(until) {
+					continue
+				}
+				p.history.add(at, s.temperature16, s.rpm)
+				added++
+			}
+			cur = historyCursor{seq: blk.seq + 1}
+			if blk.seq == l.open {
+				cur = historyCursor{seq: blk.seq, taken: len(blk.samples)}
+			}
+		}
+		if len(l.blocks) == 0 || l.blocks[len(l.blocks)-1].seq == l.open {
+			break
+		}
+	}
+
+	p.history.lock.Lock()
+	p.history.cursor = cur
+	p.history.lock.Unlock()
+	if added > 0 || unplaced > 0 {
+		log.Printf("%s: %d samples backfilled from the brick, %d from before its clock was set", p.gp.ID(), added, unplaced)
+	}
+	return nil
+}
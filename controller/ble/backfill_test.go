@@ -0,0 +1,69 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+	"time"
+)
+
+// historyTestBlock lays a block out as the firmware does, the first
+// sample absolute and the rest as encoded changes
+func historyTestBlock(seq, wall uint32, open bool, count int, samples []byte) []byte {
+	b := make([]byte, historyBlockLen)
+	for i := range b {
+		b[i] = 0xff
+	}
+	binary.LittleEndian.PutUint32(b[0:], seq)
+	binary.LittleEndian.PutUint32(b[4:], wall)
+	binary.LittleEndian.PutUint32(b[8:], 600)
+	binary.LittleEndian.PutUint16(b[12:], 25*16)
+	binary.LittleEndian.PutUint16(b[14:], 1200)
+	b[16] = 100
+	b[17] = byte(count)
+	copy(b[historySamplesOff:], samples)
+	if !open {
+		binary.LittleEndian.PutUint16(b[historyCrcOff:], crc16(0xffff, b[:historyCrcOff]))
+	}
+	return b
+}
+
+func TestParseHistory(t *testing.T) {
+	samples := []byte{
+		0x1f,                             // -1/16 C
+		0x10 | historyFanChanged, 100, 5, // escape, +50/16 C, fan -3
+		0x00 | historyDerateChanged, 80,
+	}
+	b := []byte{3, 0, 0, 0, 60, 0}
+	b = append(b, historyTestBlock(2, 1466424000, false, 4, samples)...)
+	b = append(b, historyTestBlock(3, 0, true, 2, samples[:1])...)
+	l, err := parseHistory(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if l.open != 3 || l.interval != time.Minute || len(l.blocks) != 2 {
+		t.Fatalf("open %d, interval %v, %d blocks", l.open, l.interval, len(l.blocks))
+	}
+	want := []historySample{{400, 1200, 100}, {399, 1200, 100}, {399 + 50, 1197, 100}, {449, 1197, 80}}
+	got := l.blocks[0].samples
+	if len(got) != len(want) {
+		t.Fatalf("samples %v", got)
+	}
+	for i := range want {
+		if got[i] != want[i] {
+			t.Errorf("sample %d: %+v, want %+v", i, got[i], want[i])
+		}
+	}
+	// Still being filled, so no CRC and only the samples so far
+	if blk := l.blocks[1]; blk.time != 0 || len(blk.samples) != 2 {
+		t.Errorf("open block %+v", blk)
+	}
+
+	bad := append([]byte(nil), b...)
+	bad[historyReplyLen+20] ^= 1
+	if _, err := parseHistory(bad); err == nil {
+		t.Error("corrupt block parsed")
+	}
+	if _, err := parseHistory(b[:len(b)-1]); err == nil {
+		t.Error("short reply parsed")
+	}
+}
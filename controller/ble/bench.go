@@ -0,0 +1,156 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"sort"
+	"time"
+)
+
+// Self benchmark (the firmware's bench.h): PCA9685 frames a second for
+// one output and every output, bulk notifications a second, and flash
+// erase and write times, measured on the brick and returned in one
+// reply once the run is done.
+const (
+	benchLen     = 12
+	benchSkipped = 0xffff
+	// The run takes about a second and a half, the reply waiting for it
+	benchTimeout = bulkReplyTimeout + 3*time.Second
+	// A brick is degraded when a rate falls under this share of the
+	// fleet's median, or its slowest flash write takes this many times
+	// the median's
+	benchDegraded = 2
+)
+
+// BenchResult is how one brick did, its flash times -1 when it skipped
+// them for pstorage or the link being busy. Degraded names what fell
+// well short of the rest of the fleet.
+type BenchResult struct {
+	TwiSingle   int      `json:"twi_single_per_s"`
+	TwiFull     int      `json:"twi_full_per_s"`
+	Notify      int      `json:"notify_per_s"`
+	EraseUs     int      `json:"erase_us"`
+	WriteMeanUs int      `json:"write_mean_us"`
+	WriteMaxUs  int      `json:"write_max_us"`
+	Degraded    []string `json:"degraded,omitempty"`
+}
+
+func benchUs(v uint16) int {
+	if v == benchSkipped {
+		return -1
+	}
+	return int(v)
+}
+
+func parseBench(b []byte) (BenchResult, error) {
+	if len(b) < benchLen {
+		return BenchResult{}, fmt.Errorf("short benchmark (%d bytes)", len(b))
+	}
+	u := func(i int) uint16 { return binary.LittleEndian.Uint16(b[2*i:]) }
+	return BenchResult{
+		TwiSingle:   int(u(0)),
+		TwiFull:     int(u(1)),
+		Notify:      int(u(2)),
+		EraseUs:     benchUs(u(3)),
+		WriteMeanUs: benchUs(u(4)),
+		WriteMaxUs:  benchUs(u(5)),
+	}, nil
+}
+
+func (r BenchResult) String() string {
+	s := fmt.Sprintf("bus %d frames/s one output, %d all outputs, link %d notifications/s",
+		r.TwiSingle, r.TwiFull, r.Notify)
+	if r.EraseUs < 0 {
+		s += ", flash skipped"
+	} else {
+		s += fmt.Sprintf(", flash erase %d us, write %d us (longest %d)", r.EraseUs, r.WriteMeanUs, r.WriteMaxUs)
+	}
+	return s
+}
+
+func medianInt(v []int) int {
+	if len(v) == 0 {
+		return 0
+	}
+	sort.Ints(v)
+	return v[len(v)/2]
+}
+
+// flagDegraded marks the results that fell short of the fleet's median,
+// which needs a fleet: with fewer than 3 bricks there's no telling which
+// is off
+func flagDegraded(results map[string]*BenchResult) {
+	if len(results) < 3 {
+		return
+	}
+	var single, full, notify, write []int
+	for _, r := range results {
+		single = append(single, r.TwiSingle)
+		full = append(full, r.TwiFull)
+		notify = append(notify, r.Notify)
+		if r.WriteMaxUs >= 0 {
+			write = append(write, r.WriteMaxUs)
+		}
+	}
+	ms, mf, mn, mw := medianInt(single), medianInt(full), medianInt(notify), medianInt(write)
+	for _, r := range results {
+		r.Degraded = nil
+		if r.TwiSingle*benchDegraded < ms || r.TwiFull*benchDegraded < mf {
+			r.Degraded = append(r.Degraded, "bus")
+		}
+		if r.Notify*benchDegraded < mn {
+			r.Degraded = append(r.Degraded, "link")
+		}
+		if len(write) >= 3 && r.WriteMaxUs > mw*benchDegraded {
+			r.Degraded = append(r.Degraded, "flash")
+		}
+	}
+}
+
+func (p *blePeriph) runBench() (BenchResult, error) {
+	b, err := p.bulk.request(bulkCmdBench, nil, benchTimeout)
+	if err != nil {
+		return BenchResult{}, err
+	}
+	return parseBench(b)
+}
+
+// Benchmark runs the self benchmark on every connected brick, one at a
+// time so their notifications don't share the adapters' airtime, and
+// logs each, flagging those well short of the rest
+func (ble *bleChannel) Benchmark() map[string]BenchResult {
+	ble.lock.Lock()
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.bulk != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	results := make(map[string]*BenchResult)
+	for _, p := range periphs {
+		r, err := p.runBench()
+		if err == bulkError(bulkStatusUnknown) {
+			continue
+		}
+		if err != nil {
+			log.Printf("%s: benchmark: %s", p.gp.ID(), err)
+			continue
+		}
+		results[p.gp.ID()] = &r
+	}
+	flagDegraded(results)
+
+	out := make(map[string]BenchResult)
+	for id, r := range results {
+		if len(r.Degraded) > 0 {
+			log.Printf("%s: benchmark: %s, degraded %v", id, r, r.Degraded)
+		} else {
+			log.Printf("%s: benchmark: %s", id, r)
+		}
+		out[id] = *r
+	}
+	return out
+}
@@ -0,0 +1,55 @@
+package ble
+
+import (
+	"encoding/binary"
+	"strings"
+	"testing"
+)
+
+func TestParseBench(t *testing.T) {
+	b := make([]byte, benchLen)
+	for i, v := range []uint16{1400, 180, 620, 21000, 46, 51} {
+		binary.LittleEndian.PutUint16(b[2*i:], v)
+	}
+	r, err := parseBench(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := BenchResult{TwiSingle: 1400, TwiFull: 180, Notify: 620, EraseUs: 21000, WriteMeanUs: 46, WriteMaxUs: 51}
+	if r.String() != want.String() || r.WriteMaxUs != 51 {
+		t.Errorf("%+v", r)
+	}
+	for i := 3; i < 6; i++ {
+		binary.LittleEndian.PutUint16(b[2*i:], benchSkipped)
+	}
+	if r, _ = parseBench(b); r.EraseUs != -1 || r.WriteMaxUs != -1 || !strings.Contains(r.String(), "flash skipped") {
+		t.Errorf("skipped flash read as %+v", r)
+	}
+	if _, err := parseBench(b[:benchLen-1]); err == nil {
+		t.Error("parsed a short benchmark")
+	}
+}
+
+func TestFlagDegraded(t *testing.T) {
+	good := func() *BenchResult {
+		return &BenchResult{TwiSingle: 1400, TwiFull: 180, Notify: 620, EraseUs: 21000, WriteMeanUs: 46, WriteMaxUs: 51}
+	}
+	results := map[string]*BenchResult{"a": good(), "b": good(), "c": good(), "d": good()}
+	results["b"].TwiFull = 60
+	results["c"].Notify = 200
+	results["d"].WriteMaxUs = 400
+	flagDegraded(results)
+	for id, want := range map[string]string{"a": "", "b": "bus", "c": "link", "d": "flash"} {
+		if got := strings.Join(results[id].Degraded, " "); got != want {
+			t.Errorf("%s degraded %q, want %q", id, got, want)
+		}
+	}
+
+	// Two bricks can't say which of them is off
+	two := map[string]*BenchResult{"a": good(), "b": good()}
+	two["b"].Notify = 10
+	flagDegraded(two)
+	if len(two["b"].Degraded) != 0 {
+		t.Errorf("flagged %v out of two", two["b"].Degraded)
+	}
+}
@@ -2,140 +2,1462 @@ package ble
 
 import (
 	"errors"
+	"fmt"
 	"github.com/paypal/gatt"
+	"github.com/theatrus/ledbrick/controller/clock"
+	"github.com/theatrus/ledbrick/controller/logging"
 	"log"
+	"net/http"
 	"sync"
+	"sync/atomic"
 	"time"
-	"fmt"
 )
 
 const (
-	pwmService  = "000015231212efde1523785feabcd123"
-	pwmLedChar  = "000015251212efde1523785feabcd123"
-	pwmTempChar = "000015261212efde1523785feabcd123"
-	pwmFanChar  = "000015241212efde1523785feabcd123"
+	pwmService        = "000015231212efde1523785feabcd123"
+	pwmLedChar        = "000015251212efde1523785feabcd123"
+	pwmTempChar       = "000015261212efde1523785feabcd123"
+	pwmFanChar        = "000015241212efde1523785feabcd123"
+	pwmFadeChar       = "000015271212efde1523785feabcd123"
+	pwmFrameChar      = "000015281212efde1523785feabcd123"
+	pwmStatusChar     = "000015291212efde1523785feabcd123"
+	pwmTelemetryChar  = "0000152a1212efde1523785feabcd123"
+	pwmLinkChar       = "0000152b1212efde1523785feabcd123"
+	pwmScheduleChar   = "0000152c1212efde1523785feabcd123"
+	pwmTimeChar       = "0000152d1212efde1523785feabcd123"
+	pwmCrashChar      = "0000152e1212efde1523785feabcd123"
+	pwmEventsChar     = "0000152f1212efde1523785feabcd123"
+	pwmLatencyChar    = "000015351212efde1523785feabcd123"
+	pwmBootChar       = "000015361212efde1523785feabcd123"
+	pwmCommandChar    = "000015371212efde1523785feabcd123"
+	pwmSyncChar       = "000015381212efde1523785feabcd123"
+	pwmSupplyChar     = "000015391212efde1523785feabcd123"
+	pwmSchemaChar     = "0000153a1212efde1523785feabcd123"
+	pwmOutputChar     = "0000153b1212efde1523785feabcd123"
+	pwmCapabilityChar = "0000153c1212efde1523785feabcd123"
+
+	// How often the channel state is pushed to each peripheral
+	writeInterval = 1000 * time.Millisecond
+	// Only channels that moved are written, with every channel written
+	// this often regardless
+	fullRefreshInterval = 60 * time.Second
+	// Channel, level (uint16 LE), duration in ms (uint16 LE)
+	fadeRecordLen = 5
+	// Records per write, bounded by the default 20 byte ATT payload
+	fadeRecordsPerWrite = 4
+
+	// Max intensity limit is about 0xfa on the legacy 8 bit scale,
+	// 0xfa0 at the firmware's 12 bit resolution
+	legacyMaxLevel = 250
+	ledMaxLevel    = 4000
 )
 
-var DefaultClientOptions = []gatt.Option{
-	gatt.LnxMaxConnections(10),
-	gatt.LnxDeviceID(-1, true),
-}
+// LevelStep is the smallest change to a channel a brick can show, in
+// percent
+const LevelStep = 100.0 / ledMaxLevel
+
+var DefaultClientOptions = adapterOptions(-1)
+
+// Telemetry comes every few seconds from every brick; a line a minute
+// each is plenty
+var (
+	temperatureLog = logging.NewSampler(logging.Info, time.Minute)
+	fanLog         = logging.NewSampler(logging.Info, time.Minute)
+	advertisedLog  = logging.NewSampler(logging.Info, time.Minute)
+	behindLog      = logging.NewSampler(logging.Warn, time.Minute)
+	// Percentiles move slowly, and they're in the metrics
+	traceLog = logging.NewSampler(logging.Info, 10*time.Minute)
+)
 
 type bleChannel struct {
-	device           gatt.Device
-	connectedPeriph  map[string]*blePeriph
-	knownPeriph      map[string]bool
-	ignoredPeriph    map[string]bool
-	connectingPeriph map[string]gatt.Peripheral
-	idleTicker       *time.Ticker
+	// The first adapter, which also sends the broadcasts
+	device gatt.Device
+	// Every adapter, see adapter.go
+	adapters []*adapter
+	// Recent advertisements of each brick through each adapter
+	sightings       map[string][]sighting
+	connectedPeriph map[string]*blePeriph
+	// Cuts down advertising reports, see scan.go
+	scan *scanFilter
+	// Only taking advertised telemetry, see monitor.go
+	monitor bool
+	// Bricks that need to be live before scanning stops, 0 to never stop
+	expected int
+	scanning bool
+	// Peripherals seen advertising as a brick, their directed reconnect
+	// advertising carries no name
+	brickPeriph map[string]bool
+	// Output bricks had when the last controller stopped, taken on
+	// their first connection (state.go)
+	warm map[string]*outputSnapshot
+	// Every brick's connection state, by peripheral ID
+	links      map[string]*brickLink
+	liveLinks  int
+	idleTicker clock.Ticker
+	// Time as the links, schedules and writers see it, see clock
+	clock clock.Clock
+	// Since the expected bricks weren't all live, zero while they are
+	fleetSince time.Time
 
-	channelSetting map[int]float64
+	// Settings for bricks in no zone
+	settings frameCell
+	// Named sets of bricks on their own settings, see zone.go
+	zones map[string]*zone
+	// Set once broadcast control is enabled
+	broadcast *broadcaster
+	// Signs command writes where set, see cmdmac.go
+	cmdKey []byte
+	// Sending its advertisements, see transmit.go
+	tx *transmitter
+	// Broadcast frames also go out over ESB, when a dongle is attached
+	dongle *dongle
+	// Latest advertised telemetry by peripheral ID
+	advTelemetry map[string]advTelemetry
+	// Handed to every peripheral that can run it itself
+	schedule *schedule
+	// What each brick last took, so edits send only what changed
+	heldSchedules *heldSchedules
+	// Peripheral clocks are set to local time here
+	loc *time.Location
+	// Set while a firmware update is rolling out
+	dfu *dfuUpdate
+	// Scenes programmed into every brick that can keep them, by slot
+	scenes map[int]*scene
+	// Frames hold off until a recalled scene's fade has landed
+	sceneUntil time.Time
+	// Changes made before this fade out to it on the bricks
+	fadeUntil time.Time
+	// PWM frequency set on every brick, 0 leaves the firmware default
+	pwmHz int
+	// Channels dithered between duty codes on every brick
+	ditherMask uint16
+	// Master dimmer percent on every brick, 0 until set
+	dimPercent int
+	// Every brick's outputs held off (AllOff)
+	outputsOff bool
+	// Supply shared by every brick, nil for no limit, see power.go
+	budget *powerBudget
+	// Slew limit on every brick's channels, levels per second, 0 for none
+	slewLimit int
+	// Sensor simulation run on every brick, nil for real sensors
+	sim *cmdRecord
+	// Heartbeat renewing every brick's control lease, nil for none
+	lease *leaseConfig
+	// Leaving bricks leased elsewhere alone, nil when not standing by
+	standby *standbyState
+	// Burn-in started on each brick once, by peripheral ID, for
+	// burnInFor
+	burnIn     *cmdRecord
+	burnInFor  time.Duration
+	burnInSent map[string]bool
+	// Bulk jobs held for quiet stretches of the schedule, nil to run
+	// them as soon as they come, see maint.go
+	maint *maintenance
+	// Cool bricks making up for derating neighbours, nil for none, and
+	// set when a derate changes (thermal.go)
+	thermal      *thermalShare
+	thermalDirty int32
+	// What a brick blends from its old schedule to a new one over
+	crossfade time.Duration
+	// Each zone's rise over the fan lead, from the tables (fanlead.go)
+	fanLeads map[string]float64
+	// Frames streamed in place of the channels' writes, nil for none
+	// (stream.go)
+	stream *frameStream
+	// Bulk body programming every brick's channel calibration
+	calib []byte
+	// Bulk body programming every brick's auxiliary outputs
+	aux []byte
+	// Bulk body setting every brick's rated LED life, nil to leave it
+	ratedLife []byte
+	// Writing to every brick, those running the schedule included
+	manual bool
+	// Handles from earlier connections, for quick reconnects
+	gattCache *gattCache
+	metrics   *metrics
+	history   *history
 
 	lock sync.Mutex
 }
 
 type blePeriph struct {
-	active   bool
-	gp       gatt.Peripheral
-	ledChar  *gatt.Characteristic
-	fanChar  *gatt.Characteristic
-	tempChar *gatt.Characteristic
+	active     bool
+	gp         gatt.Peripheral
+	ledChar    *gatt.Characteristic
+	fanChar    *gatt.Characteristic
+	tempChar   *gatt.Characteristic
+	fadeChar   *gatt.Characteristic
+	frameChar  *gatt.Characteristic
+	statusChar *gatt.Characteristic
+	// Packed fan, temperature and status, replaces those notifications
+	telemetryChar *gatt.Characteristic
+	scheduleChar  *gatt.Characteristic
+	timeChar      *gatt.Characteristic
+	crashChar     *gatt.Characteristic
+	eventsChar    *gatt.Characteristic
+	latencyChar   *gatt.Characteristic
+	dfuCtrlChar   *gatt.Characteristic
+	bootChar      *gatt.Characteristic
+	supplyChar    *gatt.Characteristic
+	schemaChar    *gatt.Characteristic
+	// What the brick is driving, read back before a full refresh
+	outputChar *gatt.Characteristic
+	// Channels wired, 0 until the capability or output state says
+	// (output.go)
+	channels int
+	// What the firmware takes, nil on firmware that doesn't say, and
+	// the path levels go by (caps.go)
+	capabilityChar *gatt.Characteristic
+	caps           *capability
+	path           writePath
+	// Connection parameters in use, for links the controller can't move
+	linkChar *gatt.Characteristic
+	// Following what the brick is doing, on links it can (connparams.go)
+	connProfile *connProfile
+	// Frames waiting for this brick's writer
+	states *stateQueue
+	// Write deadlines and the slow lane, see lane.go
+	lane *writeLane
+	// How well the link takes writes, setting how often they go
+	quality   *linkQuality
+	lastWrite time.Time
+	// Levels last sent, so unchanged channels are skipped
+	sentLevels *levelCache
+	metrics    *brickMetrics
+	history    *brickHistory
+	// Versioned command protocol, acked by sequence number
+	commandChar *gatt.Characteristic
+	acks        *cmdAcks
+	// When each went, for the traces some acks carry
+	traces *cmdTraces
+	// Round trips placing the brick's clock, for frames applied at once
+	syncChar *gatt.Characteristic
+	sync     *brickSync
+	// Framed commands over the UART service, when the firmware has it
+	bulk *bulkClient
+	// Next debug log record to read
+	dlogNext uint32
 
-	temperature int
-	fanRpm      int
-	lastUpdate  time.Time
+	// Running the schedule on-device, so the levels aren't written
+	scheduled bool
+	// A crossfade into the schedule runs until, on the brick
+	blendUntil time.Time
+	// Last told of its output rising, for its fan (fanlead.go)
+	fanLead fanLeadSent
+	// Clock as read back after the last sync
+	clock      clockState
+	clockLoc   *time.Location
+	timeSynced time.Time
+	// Last time the error event log was drained
+	eventsDrained time.Time
+
+	cmds *cmdTracker
+
+	// Values from the notifications, see notify.go
+	readings   *brickReadings
+	outputHash uint16
+	txDrops    int
+	// The channel's time, see now
+	timeSource clock.Clock
+	// Told when the derate changes, or the brick takes up its schedule,
+	// so the zone's thermal shares are worked out again
+	shareChanged func()
+}
+
+// now is the channel's time, the real time for a brick made without
+// one
+func (p *blePeriph) now() time.Time {
+	if p.timeSource == nil {
+		return time.Now()
+	}
+	return p.timeSource.Now()
 }
 
 type BLEPeripheral interface {
+	ID() string
 	Active() bool
 	Temperature() int
+	TemperatureC() float64
 	FanRPM() int
+	LostCommands() int
+	Derate() int
+	FanDuty() int
+	Errors() uint8
+	Uptime() time.Duration
+	// Peripheral clock as of the last telemetry, zero until it is set
+	Clock() time.Time
+	FrameCommits() uint32
+}
+
+func (p *blePeriph) ID() string   { return p.gp.ID() }
+func (p *blePeriph) Active() bool { return p.active }
+
+// Temperature is in whole degrees, rounded down
+func (p *blePeriph) Temperature() int {
+	return int(atomic.LoadInt32(&p.readings.temperature16) >> 4)
+}
+func (p *blePeriph) TemperatureC() float64 {
+	return float64(atomic.LoadInt32(&p.readings.temperature16)) / 16.0
+}
+func (p *blePeriph) FanRPM() int       { return int(atomic.LoadInt32(&p.readings.fanRpm)) }
+func (p *blePeriph) LostCommands() int { return p.cmds.Lost() + p.acks.Lost() }
+func (p *blePeriph) Derate() int       { return int(atomic.LoadInt32(&p.readings.derate)) }
+func (p *blePeriph) FanDuty() int      { return int(atomic.LoadInt32(&p.readings.fanDuty)) }
+func (p *blePeriph) Errors() uint8     { return uint8(atomic.LoadUint32(&p.readings.errors)) }
+func (p *blePeriph) Uptime() time.Duration {
+	return time.Duration(atomic.LoadUint32(&p.readings.uptime)) * time.Second
+}
+
+func (p *blePeriph) Clock() time.Time {
+	at := atomic.LoadInt64(&p.readings.clockAt)
+	if at == 0 {
+		return time.Time{}
+	}
+	return time.Unix(0, at).In(p.clockLoc)
+}
+
+func (p *blePeriph) FrameCommits() uint32 { return atomic.LoadUint32(&p.readings.frameCommits) }
+
+func (p *blePeriph) onTelemetry(id string, b []byte) {
+	t, err := parseTelemetry(b)
+	if err != nil {
+		log.Printf("%s: %s", id, err)
+		return
+	}
+	r := p.readings
+	if t.flags&telemetryTempValid != 0 {
+		atomic.StoreInt32(&r.temperature16, int32(t.temperature16))
+		p.metrics.setTemperature16(t.temperature16)
+		p.history.add(p.now(), t.temperature16, t.fanRpm)
+	}
+	atomic.StoreInt32(&r.fanRpm, int32(t.fanRpm))
+	p.metrics.setFanRpm(t.fanRpm)
+	atomic.StoreInt32(&r.fanDuty, int32(t.fanDuty))
+	atomic.StoreUint32(&r.uptime, t.uptime)
+	if p.clock.set {
+		atomic.StoreInt64(&r.clockAt, p.clock.at(t.uptime, p.clockLoc).UnixNano())
+	}
+	if atomic.SwapUint32(&r.errors, uint32(t.errors)) != uint32(t.errors) {
+		log.Printf("%s: error bits %02x", id, t.errors)
+	}
+	if atomic.SwapInt32(&r.derate, int32(t.derate)) != int32(t.derate) {
+		log.Printf("%s: thermal derate: %d%%", id, t.derate)
+		p.thermalChanged()
+	}
+	p.metrics.setDerate(t.derate)
+	if t.flags&telemetryTripped != 0 {
+		log.Printf("%s: outputs held off by thermal shutdown", id)
+	}
+	if t.flags&telemetryNoOutput != 0 {
+		log.Printf("%s: PWM controller missing, outputs not driven", id)
+	}
+	if t.flags&telemetrySupplyShed != 0 {
+		log.Printf("%s: outputs held off, supply failing", id)
+	}
+	if t.flags&telemetryLeaseLapsed != 0 {
+		log.Printf("%s: lease lapsed, failed over to its schedule", id)
+	}
+	p.outputHash = t.outputHash
+	if t.txDrops > p.txDrops {
+		log.Printf("%s: %d notifications dropped", id, t.txDrops-p.txDrops)
+	}
+	p.txDrops = t.txDrops
+	if lost := p.cmds.check(t.cmdCount, t.cmdCrc); lost > 0 {
+		p.sentLevels.invalidate()
+		p.metrics.addLost(lost)
+		log.Printf("%s: %d commands lost (%d total)", id, lost, p.cmds.Lost())
+	}
+}
+
+// Hand the schedule to the peripheral, skipping the upload when it
+// already has it stored. When it still holds prev, the schedule it last
+// confirmed, only the points that changed are sent, falling back to a
+// whole upload if the firmware doesn't take edits.
+func (p *blePeriph) uploadSchedule(s, prev *schedule, crossfade time.Duration) error {
+	status := func() (scheduleStatus, error) {
+		b, err := p.gp.ReadCharacteristic(p.scheduleChar)
+		if err != nil {
+			return scheduleStatus{}, err
+		}
+		return parseScheduleStatus(b)
+	}
+	st, err := status()
+	if err != nil {
+		return err
+	}
+	if !s.matches(st) {
+		p.linkBusy()
+	}
+	if !s.matches(st) && prev != nil && prev.matches(st) {
+		if ws, ok := s.editWrites(prev); ok {
+			for _, w := range p.crossfaded(ws, crossfade) {
+				if err := p.gp.WriteCharacteristic(p.scheduleChar, w, false); err != nil {
+					return err
+				}
+			}
+			if st, err = status(); err != nil {
+				return err
+			}
+			if s.matches(st) {
+				log.Printf("%s: schedule edited in %d writes", p.gp.ID(), len(ws))
+			}
+		}
+	}
+	if !s.matches(st) && p.bulk != nil {
+		body := s.bulk
+		if p.crossfades(crossfade) {
+			body = append(body[:len(body):len(body)], crossfadeBytes(crossfade)...)
+		}
+		if _, err := p.bulk.request(bulkCmdSchedule, body, bulkReplyTimeout); err != nil {
+			return err
+		}
+	} else if !s.matches(st) {
+		for _, w := range p.crossfaded(s.writes, crossfade) {
+			if err := p.gp.WriteCharacteristic(p.scheduleChar, w, false); err != nil {
+				return err
+			}
+		}
+	}
+	if st, err = status(); err != nil {
+		return err
+	}
+	if !s.matches(st) {
+		return errors.New("schedule rejected")
+	}
+	p.scheduled = true
+	p.thermalChanged()
+	return nil
+}
+
+func (p *blePeriph) thermalChanged() {
+	if p.shareChanged != nil {
+		p.shareChanged()
+	}
+}
+
+func (p *blePeriph) readLog(c *gatt.Characteristic, cmd uint8) ([]byte, error) {
+	if p.bulk != nil {
+		b, err := p.bulk.request(cmd, nil, bulkReplyTimeout)
+		if err == nil {
+			return b, nil
+		}
+		log.Printf("%s: bulk read: %s, falling back", p.gp.ID(), err)
+	}
+	return p.gp.ReadLongCharacteristic(c)
+}
+
+func (p *blePeriph) storeScene(sc *scene) {
+	p.linkBusy()
+	if _, err := p.bulk.request(bulkCmdScene, sc.body, bulkReplyTimeout); err != nil {
+		log.Printf("%s: storing scene %d: %s", p.gp.ID(), sc.slot, err)
+	}
+}
+
+func (p *blePeriph) storeCalibration(body []byte) {
+	p.linkBusy()
+	if _, err := p.bulk.request(bulkCmdCalib, body, bulkReplyTimeout); err != nil {
+		log.Printf("%s: storing calibration: %s", p.gp.ID(), err)
+	}
+}
+
+// Log and clear anything the peripheral kept from crashes before this
+// connection
+func (p *blePeriph) drainCrashLog() error {
+	b, err := p.readLog(p.crashChar, bulkCmdCrash)
+	if err != nil {
+		return err
+	}
+	total, recs, err := parseCrashLog(b)
+	if err != nil || total == 0 {
+		return err
+	}
+	log.Printf("%s: %d crashes since power on", p.gp.ID(), total)
+	for _, r := range recs {
+		log.Printf("%s:   %s", p.gp.ID(), r)
+	}
+	return p.gp.WriteCharacteristic(p.crashChar, []byte{0}, false)
+}
+
+// Log how long the peripheral took to come up last time it started
+func (p *blePeriph) logBootTrace() error {
+	b, err := p.gp.ReadLongCharacteristic(p.bootChar)
+	if err != nil {
+		return err
+	}
+	t, err := parseBootTrace(b)
+	if err != nil {
+		return err
+	}
+	log.Printf("%s: boot: %s", p.gp.ID(), t)
+	return nil
+}
+
+// Log the peripheral's error events since the last drain, then let it
+// drop them
+func (p *blePeriph) drainErrorLog() error {
+	p.eventsDrained = p.now()
+	b, err := p.readLog(p.eventsChar, bulkCmdEvents)
+	if err != nil {
+		return err
+	}
+	l, err := parseErrorLog(b)
+	if err != nil || len(l.events) == 0 {
+		return err
+	}
+	for _, e := range l.events {
+		at := ""
+		if p.clockLoc != nil {
+			at = p.clock.at(e.uptime, p.clockLoc).Format(" (2006-01-02 15:04:05)")
+		}
+		log.Printf("%s: event %d at %ds%s: %s", p.gp.ID(), e.seq, e.uptime, at, e)
+	}
+	log.Printf("%s: error onsets since boot %v", p.gp.ID(), l.onsets)
+	return p.gp.WriteCharacteristic(p.eventsChar, errorLogAck(l.next), false)
+}
+
+// Log the peripheral's hot path latencies, only there in firmware built
+// with them
+func (p *blePeriph) logLatency() error {
+	b, err := p.gp.ReadLongCharacteristic(p.latencyChar)
+	if err != nil {
+		return err
+	}
+	hs, err := parseLatency(b)
+	if err != nil {
+		return err
+	}
+	for i, h := range hs {
+		name := fmt.Sprintf("point %d", i)
+		if i < len(latencyNames) {
+			name = latencyNames[i]
+		}
+		log.Printf("%s: %s latency: %s", p.gp.ID(), name, h)
+	}
+	return nil
+}
+
+// Log the peripheral's supply voltage over its last poll
+func (p *blePeriph) logSupply() error {
+	b, err := p.gp.ReadCharacteristic(p.supplyChar)
+	if err != nil {
+		return err
+	}
+	s, err := parseSupply(b)
+	if err != nil {
+		return err
+	}
+	log.Printf("%s: supply: %s", p.gp.ID(), s)
+	return nil
+}
+
+// Log what the peripheral's TWI bus has carried since boot
+func (p *blePeriph) logBusStats() error {
+	b, err := p.bulk.request(bulkCmdBusStats, nil, bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	s, err := parseBusStats(b)
+	if err != nil {
+		return err
+	}
+	log.Printf("%s: bus: %s", p.gp.ID(), s)
+	return nil
+}
+
+func (ble *bleChannel) collectDiagnostics(p *blePeriph) {
+	if err := p.drainErrorLog(); err != nil {
+		log.Printf("%s: error log: %s", p.gp.ID(), err)
+	}
+	if p.latencyChar != nil {
+		if err := p.logLatency(); err != nil {
+			log.Printf("%s: latency: %s", p.gp.ID(), err)
+		}
+	}
+	if p.supplyChar != nil {
+		if err := p.logSupply(); err != nil {
+			log.Printf("%s: supply: %s", p.gp.ID(), err)
+		}
+	}
+	if p.bulk != nil {
+		if err := p.logBusStats(); err != nil {
+			log.Printf("%s: bus: %s", p.gp.ID(), err)
+		}
+		if err := p.logRunHours(nil); err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: run hours: %s", p.gp.ID(), err)
+		}
+		if err := p.logLinkStats(); err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: link: %s", p.gp.ID(), err)
+		}
+		if err := p.logDebugLog(); err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: debug: %s", p.gp.ID(), err)
+		}
+		if err := p.logBurnIn(); err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: burn-in: %s", p.gp.ID(), err)
+		}
+		if err := p.logMemory(); err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: memory: %s", p.gp.ID(), err)
+		}
+	}
+}
+
+// Set the peripheral's clock, then read it back for placing telemetry
+func (p *blePeriph) syncClock(loc *time.Location) error {
+	p.timeSynced = p.now()
+	if err := p.gp.WriteCharacteristic(p.timeChar, clockWrite(p.timeSynced, loc), false); err != nil {
+		return err
+	}
+	b, err := p.gp.ReadCharacteristic(p.timeChar)
+	if err != nil {
+		return err
+	}
+	c, err := parseClock(b)
+	if err != nil {
+		return err
+	}
+	if c.driftPpm != p.clock.driftPpm {
+		log.Printf("%s: clock rate trimmed by %d ppm", p.gp.ID(), c.driftPpm)
+	}
+	p.clock = c
+	p.clockLoc = loc
+	return nil
+}
+
+// Commands go out as write without response so several can share a
+// connection event; the status characteristic catches any that drop.
+func (p *blePeriph) writeCommand(c *gatt.Characteristic, b []byte) error {
+	err := p.write(prioInteractive, c, b, true)
+	if err == nil {
+		p.cmds.sent(b)
+	}
+	return err
+}
+
+// writeCommands is writeCommand for several, all in flight together, at
+// the writer's priority
+func (p *blePeriph) writeCommands(c *gatt.Characteristic, bs [][]byte) error {
+	err := p.writeAll(prioSchedule, c, bs)
+	if err == nil {
+		for _, b := range bs {
+			p.cmds.sent(b)
+		}
+	}
+	return err
+}
+
+// Commands on the versioned protocol go out as write without response
+// too, the acks settle them.
+func (p *blePeriph) sendCommands(records ...cmdRecord) error {
+	return p.sendAt(prioInteractive, records...)
+}
+
+// sendAt is sendCommands in prio's turn (lane.go)
+func (p *blePeriph) sendAt(prio writePriority, records ...cmdRecord) error {
+	ws, err := p.acks.writes(records)
+	if err == errSignedTooLong && p.bulk != nil {
+		// A packed frame leaves no room for the MAC, the bulk channel has it
+		_, err = p.bulk.requestAt(prio, bulkCmdCommands, p.acks.batch(records), bulkReplyTimeout)
+		return err
+	}
+	if err != nil {
+		return err
+	}
+	if len(ws) == 0 {
+		return nil
+	}
+	p.traces.sent(ws, p.now())
+	return p.writeAll(prio, p.commandChar, ws)
 }
 
-func (p *blePeriph) Active() bool     { return p.active }
-func (p *blePeriph) Temperature() int { return p.temperature }
-func (p *blePeriph) FanRPM() int      { return p.fanRpm }
+func (p *blePeriph) probeSync() {
+	if err := p.write(prioSchedule, p.syncChar, p.sync.probe(p.now()), true); err != nil {
+		log.Printf("%s: sync probe: %s", p.gp.ID(), err)
+	}
+}
+
+// Too long for a write, so it goes over the bulk channel, at the
+// writer's priority
+func (p *blePeriph) sendCommandsAt(at uint32, records ...cmdRecord) error {
+	_, err := p.bulk.requestAt(prioSchedule, bulkCmdCommands, p.acks.batch(commandAt(at, records)), bulkReplyTimeout)
+	return err
+}
+
+func (p *blePeriph) onCommandAck(id string, b []byte) {
+	k, err := parseCmdAck(b)
+	if err != nil {
+		log.Printf("%s: %s", id, err)
+		return
+	}
+	lost, rejected := p.acks.ack(k)
+	if lost > 0 || rejected > 0 {
+		p.sentLevels.invalidate()
+	}
+	if lost > 0 {
+		p.metrics.addLost(lost)
+		log.Printf("%s: %d command writes lost (%d total)", id, lost, p.acks.Lost())
+	}
+	if rejected > 0 {
+		log.Printf("%s: %d command writes rejected", id, rejected)
+	}
+	if k.trace != nil && p.traces.observe(*k.trace, p.sync, p.now()) {
+		p.metrics.setTraces(p.traces)
+		traceLog.Log(id, "command latency", logging.Str("brick", id), logging.Str("traces", p.traces.String()))
+	}
+}
 
 type BLEChannel interface {
 	Perhipherals() []BLEPeripheral
+	// Every brick seen and where its connection stands, by peripheral ID
+	Links() map[string]LinkState
+	// Prometheus metrics for every brick seen and the channel levels
+	MetricsHandler() http.Handler
+	// A brick's temperature and fan history from since, raw (step 0),
+	// by the minute or by the hour
+	History(brick string, step time.Duration, since time.Time) ([]HistoryPoint, error)
+	HistoryHandler() http.Handler
+	// Write the levels to every brick while hold is set, holding off
+	// those running the schedule themselves, for manual control
+	HoldSchedule(hold bool)
+	// Push the channel levels out now rather than at the next write
+	Flush() error
 	SetChannel(channel int, percent float64) error
+	// Run bricks as their own zone, on its own settings and schedule.
+	// channels maps each of the zone's channels to the bricks' own, nil
+	// for the same ones.
+	SetZone(name string, bricks []string, channels []int) error
+	// Replace every zone at once, keeping the settings and schedules of
+	// those that stay, so bricks can move between them
+	SetZones(zones map[string]ZoneMap) error
+	// SetChannel and SetSchedule for one zone, "" for bricks in none
+	SetZoneChannel(zone string, channel int, percent float64) error
+	SetZoneSchedule(zone string, loc *time.Location, points []SchedulePoint) error
+	// Have the zone's bricks spin their fans up for their output rising
+	// by percent of full within FanLeadTime (fanlead.go)
+	SetZoneFanLead(zone string, percent float64) error
+	// Stop scanning while n bricks are live, as scanning slows every
+	// link. 0 always scans.
+	ExpectBricks(n int)
+	// Also advertise every update to bricks following the group
+	EnableBroadcast(group uint8, key []byte) error
+	// Sign command writes with key, the fleet's broadcast key, to every
+	// brick that takes them
+	SignCommands(key []byte) error
+	// Broadcast a zone's levels as well, to the bricks following group
+	BroadcastZone(zone string, group uint8) error
+	SetBroadcastTiming(t BroadcastTiming) error
+	EnableDongle(path string) error
+	// Run a daily schedule on every peripheral that supports it,
+	// SetChannel then only drives the others
+	// Peripheral clocks are kept on loc's local time
+	SetSchedule(loc *time.Location, points []SchedulePoint) error
+	// Update every brick to the firmware package at path (nrfutil zip),
+	// a few at a time
+	UpdateFirmware(path string, r FirmwareRollout) error
+	// Hold history backfill, burn-ins and firmware updates to where
+	// each brick's schedule is flat, and dark for those that take its
+	// lights, a few at a time through each adapter (maint.go)
+	SetMaintenance(w MaintenanceWindow) error
+	// Have bricks that aren't derating for heat raise their output by
+	// up to percent, to make up for neighbours in their zone that are
+	// (thermal.go). 0 turns it off.
+	SetThermalShare(percent float64) error
+	// Have bricks that take it blend from the schedule they run to the
+	// next one uploaded over d, up to MaxScheduleCrossfade. 0 swaps at
+	// once.
+	SetScheduleCrossfade(d time.Duration) error
+	// Program a scene slot (0-7) into every brick that keeps scenes
+	StoreScene(slot int, fade time.Duration, percents []float64) error
+	// Have every brick fade to a programmed scene, SetChannel follows
+	// the scene once its fade has landed
+	RecallScene(slot int) error
+	// Run every brick's PWM at hz: higher doesn't flicker on camera,
+	// lower switches less
+	SetPWMFrequency(hz int) error
+	// Dither these channels between neighbouring duty codes, for
+	// smooth moonlight levels below one step
+	SetDither(channels []int) error
+	// Scale every channel on every brick together, on the output enable
+	// line rather than the levels. 100 is full.
+	SetMasterDim(percent int) error
+	// Turn every brick's outputs off on the output enable line, ahead of
+	// anything else waiting to go to it, or back on. Bricks connecting
+	// later are turned off too.
+	AllOff(off bool) error
+	// Hold every brick together under a supply of watts, scaling the
+	// frames down alike, given each channel's watts at full output. 0
+	// lifts the budget.
+	SetPowerBudget(watts float64, channelWatts []float64) error
+	// Hold every brick's channels to at most percent of full scale per
+	// second, however fast they are asked to move. 0 lifts the limit.
+	SetSlewLimit(percentPerSecond float64) error
+	// Replace every brick's temperature and fan readings with a
+	// simulated kind ("ramp", "step", "stall" or "off") swinging between
+	// low and high degrees C once a period, for soaking the thermal
+	// handling. Only firmware built with the simulation takes it.
+	Simulate(kind string, lowC, highC float64, period time.Duration) error
+	// Burn in every brick as it's next seen, sweeping its channels flat
+	// out for d, and log how each did: failed if it heated more than
+	// maxRiseC, took too long to bring its fan up, folded back or lost
+	// bus jobs. 0 stops them.
+	BurnIn(d time.Duration, maxRiseC int) error
+	// Benchmark every connected brick's bus, link and flash in turn,
+	// logging each and flagging those well short of the fleet's median
+	// (bench.go). Firmware without it is left out.
+	Benchmark() map[string]BenchResult
+	// Run scripted scenarios on the bricks, once they're connected or
+	// wait has passed, and report how long their ops took (fleetbench.go)
+	RunFleetBench(b FleetBench, wait time.Duration) (FleetBenchReport, error)
+	// Hold a control lease of length (up to a minute) on every brick,
+	// renewed while this runs, so a brick that stops hearing from it
+	// goes back to its schedule, or else the fallback scene slot (-1 for
+	// none). 0 gives the leases up.
+	SetLease(length time.Duration, fallbackScene int) error
+	// Only connect bricks no other controller holds the lease on, with
+	// a lease of its own set, see standby.go
+	SetStandby(standby bool)
+	// Keep the GATT handles found in path too, shared by controllers
+	// standing by for one another so a takeover skips discovery
+	SetGattCacheFile(path string) error
+	// Never connect, only take the telemetry bricks advertise
+	SetMonitor(on bool)
+	// Keep what a restarted controller would have to learn again, the
+	// bricks known, their handles, outputs and history (state.go)
+	SaveState(path string) error
+	RestoreState(path string) error
+	// Program per channel calibration into every brick that keeps it
+	SetCalibration(cs []Calibration) error
+	// Program the spare outputs of every brick that has them
+	SetAux(as []AuxOutput) error
+	// Give every brick each channel's rated LED life, hours to 70% of
+	// new output from channel 0, so it raises the channel's duty as it
+	// ages. 0 leaves a channel uncompensated.
+	SetRatedLife(hours []int) error
+	// Hold the next frame on every brick, from channel 0, without
+	// changing the outputs. Staging again adds to it.
+	StageFrame(percents []float64, fade time.Duration) error
+	// Apply the staged frame, at the same moment on every brick whose
+	// clock is known
+	CommitFrame() error
+	// Start weather on every brick, together on those whose clock is
+	// known, over whatever levels they're set to
+	StartWeather(w Weather) error
+	// Have the bricks fade every change made over the next d (up to
+	// MaxWriteFade) out to the same moment, each in a write or two,
+	// rather than over a write interval at a time. Bricks taking only
+	// levels step.
+	FadeOver(d time.Duration) error
+	// Stream frames of the first channels to every brick in place of
+	// the channel writes, one played each period on all of them
+	// together, held in a buffer on those that take it (stream.go)
+	StartStream(period time.Duration, channels int) error
+	StreamFrame(percents []float64) error
+	StopStream() error
+	// What each brick taking streams counted of the frames it was sent
+	StreamStats() map[string]StreamStats
 }
 
+// MaxWriteFade is the longest fade one write carries
+const MaxWriteFade = 0xffff * time.Millisecond
+
 func NewBLEChannel() BLEChannel {
-	d, err := gatt.NewDevice(DefaultClientOptions...)
-	if err != nil {
-		log.Fatalf("Failed to open the bluetooth HCI device: %s\n", err)
-		return nil
+	return NewBLEChannelOn(nil)
+}
+
+// NewBLEChannelOn runs bricks from every HCI adapter listed by device
+// number, the first found if none are
+func NewBLEChannelOn(hcis []int) BLEChannel {
+	return newBLEChannelOn(hcis, nil)
+}
+
+// newBLEChannelOn runs bricks from hcis, recorded to r if there is one
+func newBLEChannelOn(hcis []int, r *recorder) BLEChannel {
+	if len(hcis) == 0 {
+		hcis = []int{-1}
+	}
+	var adapters []*adapter
+	for _, hci := range hcis {
+		d, err := gatt.NewDevice(adapterOptions(hci)...)
+		if err != nil {
+			log.Fatalf("Failed to open the bluetooth HCI device %d: %s\n", hci, err)
+			return nil
+		}
+		if r != nil {
+			d = &recDevice{Device: d, r: r}
+		}
+		adapters = append(adapters, &adapter{d: d, hci: hci})
 	}
 
-	ble := &bleChannel{device: d,
-		connectedPeriph:  make(map[string]*blePeriph),
-		knownPeriph:      make(map[string]bool),
-		ignoredPeriph:    make(map[string]bool),
-		connectingPeriph: make(map[string]gatt.Peripheral),
-		idleTicker:       time.NewTicker(1000 * time.Millisecond),
-		channelSetting:   make(map[int]float64),
+	ble := newBleChannel(adapters, clock.Real)
+	for _, a := range adapters {
+		discovered, connected, disconnected := ble.onPeriphDiscovered, ble.onPeriphConnected, ble.onPeriphDisconnected
+		if rd, ok := a.d.(*recDevice); ok {
+			discovered = rd.discovered(discovered)
+			connected = rd.connection(recConnected, connected)
+			disconnected = rd.connection(recDisconnected, disconnected)
+		}
+		a.d.Handle(
+			gatt.PeripheralDiscovered(discovered),
+			gatt.PeripheralConnected(connected),
+			gatt.PeripheralDisconnected(disconnected),
+		)
+		a.d.Init(ble.onStateChanged)
 	}
+	go ble.run()
+	return ble
+}
 
-	d.Handle(
-		gatt.PeripheralDiscovered(ble.onPeriphDiscovered),
-		gatt.PeripheralConnected(ble.onPeriphConnected),
-		gatt.PeripheralDisconnected(ble.onPeriphDisconnected),
-	)
+// NewBLEChannelVia runs bricks from the connectivity dongles
+// (sddevice.go) at each serial port listed, in place of HCI adapters
+func NewBLEChannelVia(ports []string) (BLEChannel, error) {
+	var adapters []*adapter
+	var devs []*sdDevice
+	for _, port := range ports {
+		d, err := openSdDevice(port)
+		if err != nil {
+			return nil, err
+		}
+		devs = append(devs, d)
+		adapters = append(adapters, &adapter{d: d, hci: -1, port: port, maxConnections: sdMaxConnections})
+	}
 
-	d.Init(ble.onStateChanged)
+	ble := newBleChannel(adapters, clock.Real)
+	for _, d := range devs {
+		d.discovered, d.connected, d.disconnected = ble.onPeriphDiscovered, ble.onPeriphConnected, ble.onPeriphDisconnected
+		if err := d.Init(ble.onStateChanged); err != nil {
+			return nil, fmt.Errorf("%s: %v", d.path, err)
+		}
+	}
+	go ble.run()
+	return ble, nil
+}
+
+// newBleChannel is a channel on adapters, which may be none, running on
+// c, with the initial levels set
+func newBleChannel(adapters []*adapter, c clock.Clock) *bleChannel {
+	ble := &bleChannel{
+		adapters:        adapters,
+		sightings:       make(map[string][]sighting),
+		connectedPeriph: make(map[string]*blePeriph),
+		scan:            newScanFilter(),
+		brickPeriph:     make(map[string]bool),
+		warm:            make(map[string]*outputSnapshot),
+		links:           make(map[string]*brickLink),
+		idleTicker:      c.NewTicker(writeInterval),
+		clock:           c,
+		fleetSince:      c.Now(),
+		zones:           make(map[string]*zone),
+		loc:             time.Local,
+		advTelemetry:    make(map[string]advTelemetry),
+		scenes:          make(map[int]*scene),
+		gattCache:       newGattCache(),
+		heldSchedules:   newHeldSchedules(),
+		metrics:         newMetrics(),
+		history:         newHistory(),
+	}
+	if len(adapters) > 0 {
+		ble.device = adapters[0].d
+	}
+	for _, a := range adapters {
+		a.air = newAirLedger(c)
+	}
 
 	// Green CYan PCAmber Blue Red DeepBlue White UV
 	// Percents
 	initPower := []int{10, 30, 10, 40, 10, 40, 30, 40}
-	for i, v := range initPower {
-		ble.channelSetting[i] = float64(v)
+	ble.settings.update(func(percents *[frameChannels]float64) {
+		for i, v := range initPower {
+			percents[i] = float64(v)
+		}
+	})
+	return ble
+}
+
+// run checks the links and writes the levels every write interval
+func (ble *bleChannel) run() {
+	for range ble.idleTicker.C() {
+		now := ble.clock.Now()
+		ble.checkLinks(now)
+		ble.renewLeases(now)
+		_ = ble.writeLedState()
 	}
+}
 
-	go func() {
-		startTime := time.Now()
-		for _ = range ble.idleTicker.C {
-			// Check for four units (hack)
-			if startTime.Add(5 * time.Minute).Before(time.Now()) {
-				if len(ble.connectedPeriph) < 4 {
-					panic(fmt.Sprintf("PANIC: Not four lights connected"))
-				}
-			}
-			// Check for active units
-			for _, bp := range ble.connectedPeriph {
-				if bp.lastUpdate.Add(5 * time.Minute).Before(time.Now()) {
-					// Uhoh, no update
-					panic(fmt.Sprintf("PANIC: No updates from %v", bp.gp))
-				}
+func (ble *bleChannel) EnableBroadcast(group uint8, key []byte) error {
+	b, err := newBroadcaster(group, key)
+	if err != nil {
+		return err
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.broadcast = b
+	ble.tx = newTransmitter(b, DefaultBroadcastTiming)
+	go ble.transmit(ble.tx)
+	return nil
+}
+
+// EnableDongle sends the broadcast frames over ESB as well, through the
+// dongle's serial port at path. Needs broadcast enabled for the group
+// and key.
+func (ble *bleChannel) EnableDongle(path string) error {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if ble.broadcast == nil {
+		return errors.New("the ESB dongle needs broadcast enabled")
+	}
+	d, err := openDongle(path)
+	if err != nil {
+		return err
+	}
+	ble.dongle = d
+	return nil
+}
+
+func (ble *bleChannel) sendDongle(frames [][]byte) {
+	if err := ble.dongle.send(frames); err != nil {
+		log.Printf("ESB dongle error: %s", err)
+	}
+}
+
+func (ble *bleChannel) StoreScene(slot int, fade time.Duration, percents []float64) error {
+	sc, err := newScene(slot, fade, percents)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	ble.scenes[slot] = sc
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.bulk != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, p := range periphs {
+		go p.storeScene(sc)
+	}
+	return nil
+}
+
+func (ble *bleChannel) SetPWMFrequency(hz int) error {
+	if hz < pwmMinHz || hz > pwmMaxHz {
+		return fmt.Errorf("PWM frequency must be %d-%d Hz, got %d", pwmMinHz, pwmMaxHz, hz)
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.pwmHz = hz
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(pwmFreqRecord(hz)); err != nil {
+			log.Printf("%s: PWM frequency: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) SetRatedLife(hours []int) error {
+	body, err := runHoursBody(hours)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	ble.ratedLife = body
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.bulk != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, p := range periphs {
+		go func(p *blePeriph) {
+			if err := p.logRunHours(body); err != nil {
+				log.Printf("%s: rated life: %s", p.gp.ID(), err)
 			}
-			_ = ble.writeLedState()
+		}(p)
+	}
+	return nil
+}
+
+func (ble *bleChannel) SetCalibration(cs []Calibration) error {
+	body, err := calibBody(cs)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	ble.calib = body
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.bulk != nil {
+			periphs = append(periphs, p)
 		}
-	}()
+	}
+	ble.lock.Unlock()
 
-	return ble
+	for _, p := range periphs {
+		go p.storeCalibration(body)
+	}
+	return nil
 }
 
-func (ble *bleChannel) writeLedState() error {
+func (ble *bleChannel) SetDither(channels []int) error {
+	var mask uint16
+	for _, ch := range channels {
+		if ch < 0 || ch > 15 {
+			return fmt.Errorf("dither channel must be 0-15, got %d", ch)
+		}
+		mask |= 1 << uint(ch)
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.ditherMask = mask
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(ditherRecord(mask)); err != nil {
+			log.Printf("%s: dither: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) StageFrame(percents []float64, fade time.Duration) error {
+	if len(percents) > 16 {
+		return fmt.Errorf("at most 16 channels, got %d", len(percents))
+	}
+	levels := make([]int, len(percents))
+	for ch, pct := range percents {
+		levels[ch] = int((pct / 100.0) * ledMaxLevel)
+	}
+	records := stageRecords(int(fade/time.Millisecond), levels)
 
 	ble.lock.Lock()
 	defer ble.lock.Unlock()
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(records...); err != nil {
+			log.Printf("%s: stage: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
 
+func (ble *bleChannel) CommitFrame() error {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	now := ble.clock.Now()
+	syncAt := now.Add(syncLead)
 	for _, p := range ble.connectedPeriph {
-		for channel := 0; channel <= 7; channel++ {
-			// Max intensity limit is about 0xfa
-			value := int((ble.channelSetting[channel] / 100.0) * 250.0)
-			err := p.gp.WriteCharacteristic(p.ledChar,
-				[]byte{byte(channel), byte(value)}, true)
-			if err != nil {
-				log.Println("Command send error: %s", err)
+		if p.commandChar == nil {
+			continue
+		}
+		records := []cmdRecord{commitRecord()}
+		if at, ok := p.sync.at(syncAt, now); ok {
+			records = commandAt(at, records)
+		}
+		if err := p.sendCommands(records...); err != nil {
+			log.Printf("%s: commit: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) SetMasterDim(percent int) error {
+	if percent < 0 || percent > 100 {
+		return fmt.Errorf("master dim must be 0-100%%, got %d", percent)
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.dimPercent = percent
+	ble.sendSafety("master dim", dimRecord(percent))
+	return nil
+}
+
+func (ble *bleChannel) AllOff(off bool) error {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.outputsOff = off
+	ble.sendSafety("outputs off", outputEnableRecord(!off))
+	return nil
+}
+
+// sendSafety sends records to every brick at once at safety priority,
+// so none waits on another's link. Called with ble.lock held.
+func (ble *bleChannel) sendSafety(what string, records ...cmdRecord) {
+	var wg sync.WaitGroup
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		p := p
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			if err := p.sendAt(prioSafety, records...); err != nil {
+				log.Printf("%s: %s: %s", p.gp.ID(), what, err)
 			}
+		}()
+	}
+	wg.Wait()
+}
+
+func (ble *bleChannel) SetSlewLimit(percentPerSecond float64) error {
+	perSecond := int(percentPerSecond / 100.0 * ledMaxLevel)
+	if percentPerSecond < 0 || perSecond > 0xffff {
+		return fmt.Errorf("slew limit must be 0-%.0f%% per second, got %g", 0xffff*100.0/ledMaxLevel, percentPerSecond)
+	}
+	if percentPerSecond > 0 && perSecond == 0 {
+		perSecond = 1
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.slewLimit = perSecond
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
 		}
+		if err := p.sendCommands(slewRecord(0xffff, perSecond)); err != nil {
+			log.Printf("%s: slew limit: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) Simulate(kind string, lowC, highC float64, period time.Duration) error {
+	k, ok := simKinds[kind]
+	if !ok {
+		return fmt.Errorf("unknown simulation %q", kind)
+	}
+	low, high := int(lowC*16), int(highC*16)
+	periodMin := int(period / time.Minute)
+	if k != 0 && (low < 0 || high <= low || high > 0x7fff || periodMin < 1 || periodMin > 0xffff) {
+		return fmt.Errorf("simulation needs 0 <= low < high and a period of at least a minute")
+	}
+	r := simRecord(k, low, high, periodMin)
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.sim = &r
+	if k == 0 {
+		ble.sim = nil
+	}
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(r); err != nil {
+			log.Printf("%s: simulation: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) RecallScene(slot int) error {
+	if slot < 0 || slot >= sceneSlots {
+		return fmt.Errorf("scene slot must be 0-%d, got %d", sceneSlots-1, slot)
+	}
 
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	// Carry on from the scene's levels afterwards, rather than fading
+	// straight back to the old ones
+	if sc := ble.scenes[slot]; sc != nil {
+		ble.settings.update(func(percents *[frameChannels]float64) {
+			copy(percents[:], sc.percents)
+		})
+		ble.sceneUntil = ble.clock.Now().Add(sc.fade)
+	}
+	if ble.broadcast != nil {
+		ble.tx.scene(slot)
+		if ble.dongle != nil {
+			go ble.sendDongle([][]byte{ble.broadcast.scene(slot)})
+		}
+	}
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(sceneRecallRecord(slot)); err != nil {
+			log.Printf("%s: scene recall: %s", p.gp.ID(), err)
+		}
 	}
 	return nil
 }
 
+func (ble *bleChannel) FadeOver(d time.Duration) error {
+	if d < 0 || d > MaxWriteFade {
+		return fmt.Errorf("fade must be 0-%v, got %v", MaxWriteFade, d)
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.fadeUntil = ble.clock.Now().Add(d)
+	return nil
+}
+
+func (ble *bleChannel) SetSchedule(loc *time.Location, points []SchedulePoint) error {
+	s, err := newSchedule(points)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	ble.schedule = s
+	ble.loc = loc
+	var periphs []*blePeriph
+	for id, p := range ble.connectedPeriph {
+		if _, z := ble.zoneOf(id); z == nil && p.scheduleChar != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, p := range periphs {
+		go ble.startSchedule(p, s)
+	}
+	return nil
+}
+
+func (ble *bleChannel) syncClock(p *blePeriph, loc *time.Location) {
+	if err := p.syncClock(loc); err != nil {
+		log.Printf("%s: clock sync failed: %s", p.gp.ID(), err)
+	}
+}
+
+func (ble *bleChannel) startSchedule(p *blePeriph, s *schedule) {
+	ble.lock.Lock()
+	crossfade := ble.crossfade
+	ble.lock.Unlock()
+	if err := p.uploadSchedule(s, ble.heldSchedules.get(p.gp.ID()), crossfade); err != nil {
+		log.Printf("%s: schedule upload failed, driving it directly: %s", p.gp.ID(), err)
+		return
+	}
+	ble.heldSchedules.set(p.gp.ID(), s)
+	if p.crossfades(crossfade) {
+		ble.lock.Lock()
+		p.blendUntil = ble.clock.Now().Add(crossfade)
+		ble.lock.Unlock()
+	}
+	log.Printf("%s: running the schedule on-device", p.gp.ID())
+}
+
+func (ble *bleChannel) writeLedState() error {
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+
+	now := ble.clock.Now()
+	if now.Before(ble.sceneUntil) || ble.stream != nil {
+		return nil
+	}
+
+	// Bricks that can hold a frame all apply it at the same moment
+	state := newLedState(ble.settings.load(), now.Add(syncLead))
+	state.fadeUntil = ble.fadeUntil
+	zoneStates := make(map[string]*ledState, len(ble.zones))
+	for name, z := range ble.zones {
+		zoneStates[name] = newLedState(z.physical(), state.syncAt)
+		zoneStates[name].fadeUntil = ble.fadeUntil
+	}
+	ble.shareThermal()
+	ble.governPower(state, zoneStates)
+
+	if ble.broadcast != nil {
+		duration := int(writeInterval / time.Millisecond)
+		levels := state.sharedLevels(ledMaxLevel, frameChannels)
+		ble.tx.update("", levels, duration)
+		for name, s := range zoneStates {
+			ble.tx.update(name, s.sharedLevels(ledMaxLevel, frameChannels), duration)
+		}
+		if ble.dongle != nil {
+			go ble.sendDongle(ble.broadcast.pack(levels, duration, esbMaxChannels))
+		}
+	}
+
+	if ble.dfu != nil {
+		ble.dfu.advance(now, ble.dfuHealth)
+	}
+	ble.noteAirtime()
+	if ble.maint != nil {
+		ble.runMaintenance(now, state, zoneStates)
+	}
+	for id, p := range ble.connectedPeriph {
+		s := state
+		if name, z := ble.zoneOf(id); z != nil {
+			s = zoneStates[name]
+		}
+		if p.syncChar != nil && p.sync.due(now) {
+			go p.probeSync()
+		}
+		if p.timeChar != nil && now.Sub(p.timeSynced) > clockSyncInterval {
+			go ble.syncClock(p, ble.loc)
+		}
+		if p.eventsChar != nil && now.Sub(p.eventsDrained) > eventDrainInterval {
+			go ble.collectDiagnostics(p)
+		}
+		if ble.dfu != nil && p.dfuCtrlChar != nil && ble.dfu.quiet(s) && ble.firmwareWindow(id, s, now) &&
+			ble.dfu.claim(id, ble.link(id).adapter, now) {
+			go ble.startUpdate(p)
+			continue
+		}
+		if p.scheduled && !ble.manual {
+			continue
+		}
+		if p.sentLevels.current(s.gen, now) {
+			continue
+		}
+		if b := ble.thermalBoost(id); b != 1 {
+			s = s.boosted(b)
+		}
+		if p.states.put(s) {
+			behindLog.Log(id, "behind, skipped a frame", logging.Str("brick", id))
+		}
+	}
+	return nil
+}
+
+func (ble *bleChannel) HoldSchedule(hold bool) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if hold && !ble.manual {
+		// Their own schedule has moved the outputs since the last write,
+		// to where it can be worked out unless crossfading
+		now := ble.clock.Now()
+		for id, p := range ble.connectedPeriph {
+			if !p.scheduled {
+				continue
+			}
+			if s := ble.heldSchedules.get(id); s != nil && !now.Before(p.blendUntil) {
+				p.sentLevels.predict(s.outputAt(now, ble.loc), p.width(), now)
+			} else {
+				p.sentLevels.invalidate()
+			}
+		}
+	}
+	if hold != ble.manual {
+		ble.thermalChanged()
+	}
+	ble.manual = hold
+}
+
+func (ble *bleChannel) Flush() error {
+	return ble.writeLedState()
+}
+
 func (ble *bleChannel) Perhipherals() []BLEPeripheral {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
 	p := make([]BLEPeripheral, 0)
 	for _, periph := range ble.connectedPeriph {
 		p = append(p, periph)
@@ -147,180 +1469,419 @@ func (ble *bleChannel) SetChannel(channel int, percent float64) error {
 	if percent < 0 || percent > 100 {
 		return errors.New("Out of range percent (0-100)")
 	}
-	ble.channelSetting[channel] = percent
+	if channel < 0 || channel >= frameChannels {
+		return fmt.Errorf("channel must be 0-%d, got %d", frameChannels-1, channel)
+	}
+	ble.settings.update(func(percents *[frameChannels]float64) {
+		percents[channel] = percent
+	})
 	return nil
 }
 
-// Force Gatt to enter scanning mode
+// Scan once an adapter is up, unless every brick is already live
 func (ble *bleChannel) onStateChanged(d gatt.Device, s gatt.State) {
 	log.Println("State:", s)
-	switch s {
-	case gatt.StatePoweredOn:
-		log.Println("Scanning...")
-		d.Scan([]gatt.UUID{}, true)
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	a := ble.adapters[ble.adapterOf(d)]
+	a.powered = s == gatt.StatePoweredOn
+	if !a.powered {
+		if a.scanning {
+			log.Println("Stop scanning")
+			d.StopScanning()
+		}
+		a.scanning = false
 		return
-	default:
-		log.Println("Stop scanning")
-		d.StopScanning()
 	}
+	ble.scanning = false
+	ble.setScanning(ble.expected == 0 || ble.liveLinks < ble.expected)
 }
 
 func (ble *bleChannel) onPeriphConnected(p gatt.Peripheral, err error) {
 
 	log.Println("Connected, starting interrogation of ", p.ID())
+	ble.lock.Lock()
+	link := ble.link(p.ID())
+	link.p = p
+	link.set(LinkDiscovering, ble.clock.Now())
+	air := ble.airOf(link.adapter)
+	// The next brick connects while this one is discovered
+	ble.planConnections(ble.clock.Now())
+	ble.lock.Unlock()
 	bp := blePeriph{gp: p,
-		active: true,
-		lastUpdate: time.Now(),
-	}
-
-	// Discovery services
-	ss, err := p.DiscoverServices(nil)
-	if err != nil {
-		log.Printf("Failed to discover services, err: %s\n", err)
-		return
+		active:       true,
+		readings:     newBrickReadings(ble.clock.Now()),
+		timeSource:   ble.clock,
+		cmds:         newCmdTracker(),
+		shareChanged: ble.thermalChanged,
+		acks:         newCmdAcks(),
+		traces:       newCmdTraces(),
+		sync:         newBrickSync(),
+		states:       newStateQueue(),
+		lane:         newWriteLane(),
+		quality:      &linkQuality{},
+		sentLevels:   &levelCache{},
+		metrics:      ble.metrics.brick(p.ID()),
+		history:      ble.history.brick(p.ID()),
 	}
+	var dfuPacket *gatt.Characteristic
+	// The gap the brick's own history fills, before anything live
+	historySince, historyUntil := bp.history.newest(), ble.clock.Now()
 
-	for _, s := range ss {
-		msg := "Service: " + s.UUID().String()
-		if len(s.Name()) > 0 {
-			msg += " (" + s.Name() + ")"
-		}
-		log.Println(msg)
-
-		// Discovery characteristics
-		cs, err := p.DiscoverCharacteristics(nil, s)
+	cs, capBytes, cached := ble.cachedCharacteristics(p)
+	bp.lane.air = air
+	if !cached {
+		air.charge(airLive, airDiscoveryReads*airRead(airChunk))
+		cs, err = discoverCharacteristics(p)
 		if err != nil {
-			log.Printf("Failed to discover characteristics, err: %s\n", err)
+			log.Printf("%s: %s", p.ID(), err)
+			ble.linkFailed(p)
 			return
 		}
+	}
 
-		for _, c := range cs {
-			msg := "  Characteristic  " + c.UUID().String()
+	if rp, ok := p.(*recPeriph); ok {
+		rp.d.r.characteristics(p.ID(), cs)
+	}
 
-			// Grab and store the three characteristics we
-			// case about by matching by UUID
-			switch c.UUID().String() {
-			case pwmLedChar:
-				bp.ledChar = c
-			case pwmTempChar:
-				bp.tempChar = c
-			case pwmFanChar:
-				bp.fanChar = c
-			}
+	// Firmware with the packed telemetry characteristic sends the
+	// same values there, so skip subscribing the separate ones
+	packed := false
+	for _, c := range cs {
+		if c.UUID().String() == pwmTelemetryChar {
+			packed = true
+		}
+	}
 
-			if len(c.Name()) > 0 {
-				msg += " (" + c.Name() + ")"
-			}
-			msg += "\n    properties    " + c.Properties().String()
-			log.Println(msg)
-
-			// Read the characteristic, if possible.
-			if (c.Properties() & gatt.CharRead) != 0 {
-				b, err := p.ReadCharacteristic(c)
-				if err != nil {
-					log.Printf("Failed to read characteristic, err: %s\n", err)
-					return
-				}
-				log.Printf("    value         %x | %q\n", b, b)
-			}
+	id := p.ID()
+	for _, c := range cs {
+		// Grab and store the characteristics we care about by
+		// matching by UUID
+		switch c.UUID().String() {
+		case pwmLedChar:
+			bp.ledChar = c
+		case pwmTempChar:
+			bp.tempChar = c
+		case pwmFanChar:
+			bp.fanChar = c
+		case pwmFadeChar:
+			bp.fadeChar = c
+		case pwmFrameChar:
+			bp.frameChar = c
+		case pwmStatusChar:
+			bp.statusChar = c
+		case pwmTelemetryChar:
+			bp.telemetryChar = c
+		case pwmScheduleChar:
+			bp.scheduleChar = c
+		case pwmTimeChar:
+			bp.timeChar = c
+		case pwmCrashChar:
+			bp.crashChar = c
+		case pwmEventsChar:
+			bp.eventsChar = c
+		case pwmLatencyChar:
+			bp.latencyChar = c
+		case pwmBootChar:
+			bp.bootChar = c
+		case pwmSupplyChar:
+			bp.supplyChar = c
+		case pwmCommandChar:
+			bp.commandChar = c
+		case pwmSyncChar:
+			bp.syncChar = c
+		case dfuControlChar:
+			bp.dfuCtrlChar = c
+		case dfuPacketChar:
+			dfuPacket = c
+		case nusWriteChar:
+			bp.bulk = newBulkClient(p, c, bp.lane)
+		case pwmSchemaChar:
+			bp.schemaChar = c
+		case pwmOutputChar:
+			bp.outputChar = c
+		case pwmCapabilityChar:
+			bp.capabilityChar = c
+		case pwmLinkChar:
+			bp.linkChar = c
+		}
 
-			// Discovery descriptors
-			ds, err := p.DiscoverDescriptors(nil, c)
-			if err != nil {
-				log.Printf("Failed to discover descriptors, err: %s\n", err)
-				return
-			}
+		// Subscribe the characteristic, if possible.
+		superseded := false
+		switch c.UUID().String() {
+		case pwmTempChar, pwmFanChar, pwmStatusChar:
+			superseded = packed
+		case pwmLinkChar:
+			// Subscribing opts in to connection parameter update
+			// requests, which gatt doesn't answer; the peripheral
+			// would be dropped when the first one timed out.
+			superseded = true
+		case dfuControlChar:
+			// Only subscribed for an update
+			superseded = true
+		}
+		if (c.Properties()&(gatt.CharNotify|gatt.CharIndicate)) == 0 || superseded {
+			continue
+		}
+		notify := bp.notifier(id, c.UUID().String())
+		if notify == nil {
+			log.Printf("%s: not taking notifications from %s", id, c.UUID())
+			continue
+		}
+		if err := p.SetNotifyValue(c, notify); err != nil {
+			log.Printf("Failed to subscribe characteristic, err: %s\n", err)
+			ble.linkFailed(p)
+			return
+		}
+	}
+	capBytes = bp.negotiate(id, capBytes)
+	ble.lock.Lock()
+	cmdKey := ble.cmdKey
+	ble.lock.Unlock()
+	bp.signCommands(id, cmdKey)
+	if !cached && bp.schemaChar != nil {
+		ble.cacheCharacteristics(p, bp.schemaChar, cs, capBytes)
+	}
 
-			for _, d := range ds {
-				msg := "  Descriptor      " + d.UUID().String()
-				if len(d.Name()) > 0 {
-					msg += " (" + d.Name() + ")"
-				}
-				log.Println(msg)
+	// The bootloader has the DFU service on its own
+	if dfuPacket != nil && bp.ledChar == nil {
+		ble.lock.Lock()
+		// Live in the bootloader, dropped once it's done
+		ble.link(p.ID()).set(LinkLive, ble.clock.Now())
+		ble.lock.Unlock()
+		ble.updatePeriph(p, bp.dfuCtrlChar, dfuPacket)
+		return
+	}
 
-				// Read descriptor (could fail, if it's not readable)
-				b, err := p.ReadDescriptor(d)
-				if err != nil {
-					log.Printf("Failed to read descriptor, err: %s\n", err)
-					return
-				}
-				log.Printf("    value         %x | %q\n", b, b)
-			}
+	// Setting up is busy, scenes and schedules go over next
+	if u, ok := p.(connUpdater); ok {
+		bp.connProfile = newConnProfile(u)
+		bp.linkBusy()
+	} else if bp.linkChar != nil {
+		if b, err := p.ReadCharacteristic(bp.linkChar); err != nil {
+			log.Printf("%s: link status: %s", p.ID(), err)
+		} else if params, err := parseLinkStatus(b); err == nil {
+			bp.metrics.setConnParams(params)
+		}
+	}
 
-			// Subscribe the characteristic, if possible.
-			if (c.Properties() & (gatt.CharNotify | gatt.CharIndicate)) != 0 {
-				f := func(c *gatt.Characteristic, b []byte, err error) {
-					//log.Printf("%s: % X | %q\n", p.ID(), b, b)
-					bp.lastUpdate = time.Now()
-					switch c.UUID().String() {
-					case pwmTempChar:
-						bp.temperature = int(b[0])
-						log.Printf("%s: temperature: %d C", p.ID(), bp.temperature)
-					case pwmFanChar:
-						bp.fanRpm = int(b[0]) | (int(b[1]) << 8)
-						log.Printf("%s: fan speed: %d rpm", p.ID(), bp.fanRpm)
-					default:
-						log.Printf("unknown notification from %s", p.ID())
-					}
-				}
-				if err := p.SetNotifyValue(c, f); err != nil {
-					log.Printf("Failed to subscribe characteristic, err: %s\n", err)
-					return
-				}
+	ble.lock.Lock()
+	s := ble.scheduleFor(p.ID())
+	loc := ble.loc
+	pwmHz := ble.pwmHz
+	ditherMask := ble.ditherMask
+	dimPercent := ble.dimPercent
+	outputsOff := ble.outputsOff
+	slewLimit := ble.slewLimit
+	sim := ble.sim
+	var lease *cmdRecord
+	if ble.lease != nil {
+		lease = &ble.lease.record
+	}
+	// Held for a window instead, once connected
+	maint := ble.maint != nil
+	var burnIn *cmdRecord
+	if ble.burnIn != nil && !ble.burnInSent[p.ID()] && !maint {
+		burnIn = ble.burnIn
+		ble.burnInSent[p.ID()] = true
+	}
+	calib := ble.calib
+	aux := ble.aux
+	warm := ble.warm[p.ID()]
+	delete(ble.warm, p.ID())
+	ratedLife := ble.ratedLife
+	var scenes []*scene
+	for _, sc := range ble.scenes {
+		scenes = append(scenes, sc)
+	}
+	if ble.dfu != nil {
+		// Finished, or fell back to the old firmware
+		ble.dfu.release(p.ID())
+	}
+	ble.lock.Unlock()
+	if bp.bootChar != nil {
+		if err := bp.logBootTrace(); err != nil {
+			log.Printf("%s: boot trace: %s", p.ID(), err)
+		}
+	}
+	if bp.crashChar != nil {
+		if err := bp.drainCrashLog(); err != nil {
+			log.Printf("%s: crash log: %s", p.ID(), err)
+		}
+	}
+	// The schedule needs the clock
+	if bp.timeChar != nil {
+		ble.syncClock(&bp, loc)
+	}
+	if s != nil && bp.scheduleChar != nil {
+		ble.startSchedule(&bp, s)
+	}
+	// Bricks skip the flash write for slots they already hold
+	if bp.bulk != nil {
+		for _, sc := range scenes {
+			bp.storeScene(sc)
+		}
+		if calib != nil {
+			bp.storeCalibration(calib)
+		}
+		if aux != nil {
+			bp.storeAux(aux)
+		}
+		if ratedLife != nil {
+			if err := bp.logRunHours(ratedLife); err != nil {
+				log.Printf("%s: rated life: %s", p.ID(), err)
 			}
-
+		}
+	}
+	// Not kept across a brick restart
+	if pwmHz != 0 && bp.commandChar != nil {
+		if err := bp.sendCommands(pwmFreqRecord(pwmHz)); err != nil {
+			log.Printf("%s: PWM frequency: %s", p.ID(), err)
+		}
+	}
+	if ditherMask != 0 && bp.commandChar != nil {
+		if err := bp.sendCommands(ditherRecord(ditherMask)); err != nil {
+			log.Printf("%s: dither: %s", p.ID(), err)
+		}
+	}
+	if outputsOff && bp.commandChar != nil {
+		if err := bp.sendAt(prioSafety, outputEnableRecord(false)); err != nil {
+			log.Printf("%s: outputs off: %s", p.ID(), err)
+		}
+	}
+	if dimPercent != 0 && bp.commandChar != nil {
+		if err := bp.sendAt(prioSafety, dimRecord(dimPercent)); err != nil {
+			log.Printf("%s: master dim: %s", p.ID(), err)
+		}
+	}
+	if slewLimit != 0 && bp.commandChar != nil {
+		if err := bp.sendCommands(slewRecord(0xffff, slewLimit)); err != nil {
+			log.Printf("%s: slew limit: %s", p.ID(), err)
+		}
+	}
+	if sim != nil && bp.commandChar != nil {
+		if err := bp.sendCommands(*sim); err != nil {
+			log.Printf("%s: simulation: %s", p.ID(), err)
+		}
+	}
+	if burnIn != nil && bp.commandChar != nil {
+		if err := bp.sendCommands(*burnIn); err != nil {
+			log.Printf("%s: burn-in: %s", p.ID(), err)
+		}
+	}
+	// Taken at once, so a standby controller sees it held
+	if lease != nil && bp.commandChar != nil {
+		if err := bp.sendCommands(*lease); err != nil {
+			log.Printf("%s: lease: %s", p.ID(), err)
+		} else {
+			ble.lock.Lock()
+			ble.leased(p.ID(), ble.clock.Now())
+			ble.lock.Unlock()
+		}
+	}
+	// After the clock too, so its samples can be placed
+	if bp.bulk != nil && !maint {
+		// Firmware without the history doesn't know the command
+		err := bp.backfillHistory(historySince, historyUntil, loc)
+		if err != nil && err != bulkError(bulkStatusUnknown) {
+			log.Printf("%s: history backfill: %s", p.ID(), err)
+		}
+	}
+	// After the clock, so events can be placed
+	if bp.eventsChar != nil {
+		ble.collectDiagnostics(&bp)
+	}
+	// A brick that kept running through the reconnect isn't written
+	// what it already has
+	if warm != nil && bp.outputChar != nil && bp.warmOutput(warm, ble.clock.Now()) {
+		log.Printf("%s: output as at the last shutdown, generation %d", p.ID(), warm.Gen)
+	} else if bp.outputChar != nil {
+		if o, err := bp.readOutput(); err != nil {
+			log.Printf("%s: output state: %s", p.ID(), err)
+		} else {
+			log.Printf("%s: output: %s", p.ID(), o)
+			bp.channels = o.channels
+			bp.sentLevels.confirm(o.levels[:bp.width()], o.gen, ble.clock.Now())
 		}
 	}
 
 	ble.lock.Lock()
 	defer ble.lock.Unlock()
 
-	// Remove from the connecting pool
-	delete(ble.connectingPeriph, p.ID())
-
+	now := ble.clock.Now()
+	ble.link(p.ID()).set(LinkLive, now)
+	ble.fleetLive(now)
 	ble.connectedPeriph[p.ID()] = &bp
+	atomic.AddInt64(&bp.metrics.connects, 1)
+	ble.thermalChanged()
+	if maint {
+		ble.queueMaintenance(&bp, historySince, historyUntil, loc)
+	}
+	go bp.runWriter()
 	log.Printf("Peripheral connection complete: %s", p.ID())
 }
 
 func (ble *bleChannel) onPeriphDiscovered(p gatt.Peripheral, a *gatt.Advertisement, rssi int) {
+	now := ble.clock.Now()
+	if !ble.scan.pass(p.ID(), a, now) {
+		return
+	}
 	ble.lock.Lock()
 	defer ble.lock.Unlock()
 
-	if _, ok := ble.ignoredPeriph[p.ID()]; ok {
+	if t, ok := parseAdvTelemetry(a.ManufacturerData); ok {
+		if ble.takeAdvTelemetry(p.ID(), t, rssi, now) {
+			advertisedLog.Log(p.ID(), "advertised telemetry", logging.Str("brick", p.ID()),
+				logging.Float("c", float64(t.temperature16)/16.0), logging.Int("rpm", t.fanRpm),
+				logging.Int("derate", t.derate), logging.Int("errors", int(t.errors)))
+		}
+	}
+	if ble.monitor {
+		// Never connected, see monitor.go
 		return
 	}
 
-	ble.knownPeriph[p.ID()] = true
-	if _, ok := ble.connectingPeriph[p.ID()]; ok {
-		log.Printf("Peripheral is in connecting state: %s", p.ID())
+	if ble.brickPeriph[p.ID()] {
+		ble.metrics.brick(p.ID()).setRssi(rssi)
+	}
+	link := ble.link(p.ID())
+	if !link.canConnect(now) {
+		// Connected or on the way, or backing off after a failure
 		return
 	}
-
-	log.Printf("Peripheral ID:%s, NAME:(%s)\n", p.ID(), p.Name())
-	log.Println("  Local Name        =", a.LocalName)
-	log.Println("  TX Power Level    =", a.TxPowerLevel)
-	log.Println("  Manufacturer Data =", a.ManufacturerData)
-	log.Println("  Service Data      =", a.ServiceData)
-	log.Println("")
-
-	if p.Name() != "LEDBrick-PWM" {
-		ble.ignoredPeriph[p.ID()] = true
-		log.Println("Ignoring this device.")
+	if p.Name() != dfuTargetName && !ble.mayConnect(p.ID(), now) {
+		// Another controller holds its lease
+		return
+	}
+	via := ble.adapterOf(p.Device())
+	if len(ble.adapters) > 1 && !ble.sighted(p.ID(), via, rssi, now) {
+		// Another adapter hears it better or has more room
 		return
 	}
 
-	log.Printf("Connecting to %s", p.ID())
-	ble.connectingPeriph[p.ID()] = p
-	go func() {
-		time.Sleep(30 * time.Second)
-		if _, ok := ble.connectedPeriph[p.ID()]; ok {
+	if p.Name() == dfuTargetName && ble.brickPeriph[p.ID()] {
+		// Only one of ours sent over for an update
+		if ble.dfu == nil || !ble.dfu.wants(p.ID()) {
 			return
-		} else {
-			delete(ble.connectingPeriph, p.ID())
-			log.Printf("Haven't heard back about connection to %s, removing from pending pool", p.ID())
 		}
-	}()
-	p.Device().Connect(p)
+	} else if p.Name() != brickName && !(p.Name() == "" && ble.brickPeriph[p.ID()]) {
+		// Telemetry broadcast by a brick we haven't connected yet comes
+		// with its name, so this is only ever someone else's
+		ble.scan.ignore(p.ID(), now)
+		delete(ble.links, p.ID())
+		delete(ble.sightings, p.ID())
+		log.Printf("Ignoring %s (%s)", p.ID(), p.Name())
+		return
+	}
+	ble.brickPeriph[p.ID()] = true
+	ble.scan.brick(p.ID())
+
+	// Waits its turn, see plan.go
+	link.p = p
+	link.adapter = via
+	link.rssi = rssi
+	link.heard = now
+	ble.planConnections(link.heard)
 }
 
 func (ble *bleChannel) onPeriphDisconnected(p gatt.Peripheral, err error) {
@@ -335,9 +1896,22 @@ func (ble *bleChannel) onPeriphDisconnected(p gatt.Peripheral, err error) {
 	// boolean suffices.
 	if localPeriph != nil {
 		localPeriph.active = false
+		localPeriph.states.close()
+		atomic.AddInt64(&localPeriph.metrics.disconnects, 1)
 	}
 
 	delete(ble.connectedPeriph, p.ID())
+	ble.thermalChanged()
+	if l := ble.links[p.ID()]; l != nil && l.state != LinkDiscovered {
+		if l.state == LinkLive {
+			// Worked until now, so come straight back
+			l.failures = 0
+		}
+		now := ble.clock.Now()
+		wait := l.fail(now)
+		log.Printf("%s: reconnecting in %v", p.ID(), wait.Truncate(time.Second))
+		ble.planConnections(now)
+	}
 	// We re-cancel the connection here, which will free any associated
 	// channels if this disconnect is due to the peripheral initiating the disconnect
 	p.Device().CancelConnection(p)
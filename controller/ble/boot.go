@@ -0,0 +1,70 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"strings"
+	"time"
+)
+
+// The firmware's boot trace (boot_trace.h): microseconds per startup
+// phase, then a mask of the phases that ran over budget. The bootloader's
+// share, from reset to the application's main(), comes last, on firmware
+// that reports it.
+var bootPhaseNames = []string{"core", "light", "stack", "sensors", "services", "advertising", "bootloader"}
+
+const bootPhaseBootloader = 6
+
+type bootTrace struct {
+	phases []time.Duration
+	over   uint8
+}
+
+func (t bootTrace) total() time.Duration {
+	var d time.Duration
+	for _, p := range t.phases {
+		d += p
+	}
+	return d
+}
+
+// Time from reset until the restored frame was on its way to the PCA9685
+func (t bootTrace) toLight() time.Duration {
+	n := len(t.phases)
+	if n > 2 {
+		n = 2
+	}
+	d := bootTrace{phases: t.phases[:n]}.total()
+	if len(t.phases) > bootPhaseBootloader {
+		d += t.phases[bootPhaseBootloader]
+	}
+	return d
+}
+
+func (t bootTrace) String() string {
+	parts := make([]string, len(t.phases))
+	for i, p := range t.phases {
+		name := fmt.Sprintf("phase %d", i)
+		if i < len(bootPhaseNames) {
+			name = bootPhaseNames[i]
+		}
+		parts[i] = fmt.Sprintf("%s %v", name, p)
+		if t.over&(1<<uint(i)) != 0 {
+			parts[i] += " (over budget)"
+		}
+	}
+	return fmt.Sprintf("%v to light, %v to advertising: %s",
+		t.toLight(), t.total(), strings.Join(parts, ", "))
+}
+
+func parseBootTrace(b []byte) (bootTrace, error) {
+	var t bootTrace
+	if len(b) < 5 || len(b)%4 != 1 {
+		return t, fmt.Errorf("bad boot trace length %d", len(b))
+	}
+	for r := b; len(r) > 1; r = r[4:] {
+		t.phases = append(t.phases, time.Duration(binary.LittleEndian.Uint32(r))*time.Microsecond)
+	}
+	t.over = b[len(b)-1]
+	return t, nil
+}
@@ -0,0 +1,46 @@
+package ble
+
+import (
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestParseBootTrace(t *testing.T) {
+	b := []byte{
+		0xE8, 0x03, 0, 0,
+		0xB8, 0x0B, 0, 0,
+		0x20, 0x4E, 0, 0,
+		0, 0, 0, 0,
+		0, 0, 0, 0,
+		0x10, 0x27, 0, 0,
+		0x04,
+	}
+	tr, err := parseBootTrace(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(tr.phases) != 6 || tr.phases[1] != 3*time.Millisecond || tr.over != 0x04 {
+		t.Fatalf("got %+v", tr)
+	}
+	if tr.toLight() != 4*time.Millisecond || tr.total() != 34*time.Millisecond {
+		t.Errorf("to light %v, total %v", tr.toLight(), tr.total())
+	}
+
+	// With the bootloader's phase, counted to light
+	b = append(append(b[:24:24], 0xC8, 0, 0, 0), 0x04)
+	tr, err = parseBootTrace(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if tr.toLight() != 4200*time.Microsecond || tr.total() != 34200*time.Microsecond {
+		t.Errorf("to light %v, total %v", tr.toLight(), tr.total())
+	}
+	if !strings.Contains(tr.String(), "bootloader 200") {
+		t.Errorf("trace %s", tr)
+	}
+
+	if _, err := parseBootTrace(b[:8]); err == nil {
+		t.Error("truncated trace accepted")
+	}
+}
@@ -0,0 +1,122 @@
+package ble
+
+import (
+	"crypto/aes"
+	"crypto/cipher"
+	"encoding/binary"
+	"fmt"
+	"sync"
+)
+
+// Connectionless control, matching the firmware's broadcast.h. Every
+// brick in a group applies the same advertised frame at once, so there's
+// no per-connection write loop and no connection limit.
+const (
+	broadcastCompanyID   = 0xffff
+	broadcastMagic       = 0x4c
+	broadcastSceneMagic  = 0x53
+	broadcastSceneLen    = 7
+	broadcastGroupAll    = 0xff
+	broadcastHeaderLen   = 10
+	broadcastMacLen      = 4
+	broadcastMaxChannels = 6
+)
+
+type broadcaster struct {
+	group uint8
+	block cipher.Block
+	seq   uint32
+
+	lock sync.Mutex
+}
+
+func newBroadcaster(group uint8, key []byte) (*broadcaster, error) {
+	if len(key) != 16 {
+		return nil, fmt.Errorf("broadcast key must be 16 bytes, got %d", len(key))
+	}
+	block, err := aes.NewCipher(key)
+	if err != nil {
+		return nil, err
+	}
+	return &broadcaster{group: group, block: block}, nil
+}
+
+// mac is the truncated CBC-MAC the firmware checks
+func (b *broadcaster) mac(msg []byte) []byte {
+	return cbcMac(b.block, msg)[:broadcastMacLen]
+}
+
+// cbcMac is a length byte, then the message, zero padded to whole
+// blocks, CBC encrypted to the last block
+func cbcMac(block cipher.Block, msg []byte) []byte {
+	data := append([]byte{byte(len(msg))}, msg...)
+	if pad := len(data) % aes.BlockSize; pad != 0 {
+		data = append(data, make([]byte, aes.BlockSize-pad)...)
+	}
+	state := make([]byte, aes.BlockSize)
+	for i := 0; i < len(data); i += aes.BlockSize {
+		for j := range state {
+			state[j] ^= data[i+j]
+		}
+		block.Encrypt(state, state)
+	}
+	return state
+}
+
+// scene is the advertisement payload recalling a scene slot
+func (b *broadcaster) scene(slot int) []byte {
+	return b.sceneFor(b.group, slot)
+}
+
+// sceneFor and packFor address group instead. The sequence number is
+// shared, as a brick checks it across its group and the all-groups one.
+func (b *broadcaster) sceneFor(group uint8, slot int) []byte {
+	b.lock.Lock()
+	defer b.lock.Unlock()
+
+	b.seq++
+	buf := make([]byte, broadcastSceneLen, broadcastSceneLen+broadcastMacLen)
+	buf[0] = broadcastSceneMagic
+	buf[1] = group
+	binary.LittleEndian.PutUint32(buf[2:], b.seq)
+	buf[6] = byte(slot)
+	return append(buf, b.mac(buf)...)
+}
+
+// frames packs levels (indexed by channel) into as many advertisement
+// payloads as needed, each with its own sequence number.
+func (b *broadcaster) frames(levels []int, durationMs int) [][]byte {
+	return b.pack(levels, durationMs, broadcastMaxChannels)
+}
+
+func (b *broadcaster) pack(levels []int, durationMs int, perFrame int) [][]byte {
+	return b.packFor(b.group, levels, durationMs, perFrame)
+}
+
+func (b *broadcaster) packFor(group uint8, levels []int, durationMs int, perFrame int) [][]byte {
+	b.lock.Lock()
+	defer b.lock.Unlock()
+
+	var out [][]byte
+	for first := 0; first < len(levels); first += perFrame {
+		last := first + perFrame
+		if last > len(levels) {
+			last = len(levels)
+		}
+		b.seq++
+		var mask uint16
+		buf := make([]byte, broadcastHeaderLen, broadcastHeaderLen+2*perFrame+broadcastMacLen)
+		buf[0] = broadcastMagic
+		buf[1] = group
+		binary.LittleEndian.PutUint32(buf[2:], b.seq)
+		binary.LittleEndian.PutUint16(buf[8:], uint16(durationMs))
+		for ch := first; ch < last; ch++ {
+			mask |= 1 << uint(ch)
+			buf = append(buf, byte(levels[ch]), byte(levels[ch]>>8))
+		}
+		binary.LittleEndian.PutUint16(buf[6:], mask)
+		buf = append(buf, b.mac(buf)...)
+		out = append(out, buf)
+	}
+	return out
+}
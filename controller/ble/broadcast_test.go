@@ -0,0 +1,54 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"testing"
+)
+
+func TestBroadcastFrames(t *testing.T) {
+	b, err := newBroadcaster(3, bytes.Repeat([]byte{0x11}, 16))
+	if err != nil {
+		t.Fatal(err)
+	}
+	levels := []int{0, 100, 200, 300, 400, 500, 600, 4000}
+	frames := b.frames(levels, 1000)
+	if len(frames) != 2 {
+		t.Fatalf("%d frames for 8 channels", len(frames))
+	}
+
+	for i, f := range frames {
+		if len(f) > 27 {
+			t.Errorf("frame %d is %d bytes, doesn't fit an advertisement", i, len(f))
+		}
+		if f[0] != broadcastMagic || f[1] != 3 {
+			t.Errorf("frame %d header % x", i, f[:2])
+		}
+		if seq := binary.LittleEndian.Uint32(f[2:]); seq != uint32(i+1) {
+			t.Errorf("frame %d seq %d", i, seq)
+		}
+		body := f[:len(f)-broadcastMacLen]
+		if !bytes.Equal(b.mac(body), f[len(body):]) {
+			t.Errorf("frame %d MAC mismatch", i)
+		}
+	}
+
+	if mask := binary.LittleEndian.Uint16(frames[0][6:]); mask != 0x3f {
+		t.Errorf("first mask %x", mask)
+	}
+	if mask := binary.LittleEndian.Uint16(frames[1][6:]); mask != 0xc0 {
+		t.Errorf("second mask %x", mask)
+	}
+	if level := binary.LittleEndian.Uint16(frames[1][broadcastHeaderLen+2:]); level != 4000 {
+		t.Errorf("channel 7 level %d", level)
+	}
+
+	// Messages of different lengths must not share a MAC
+	if bytes.Equal(b.mac([]byte{1}), b.mac([]byte{1, 0})) {
+		t.Error("MAC ignores length")
+	}
+
+	if _, err := newBroadcaster(1, []byte{1, 2, 3}); err == nil {
+		t.Error("short key accepted")
+	}
+}
@@ -0,0 +1,235 @@
+package ble
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/paypal/gatt"
+)
+
+// Framed transfers over the Nordic UART Service, laid out in the
+// firmware's bulk.h. Commands go out as writes without response and
+// replies come back as notifications, several per connection event.
+const (
+	// Written by the controller, and notified by the peripheral
+	nusWriteChar  = "6e400002b5a3f393e0a9e50e24dcca9e"
+	nusNotifyChar = "6e400003b5a3f393e0a9e50e24dcca9e"
+
+	// Header byte, then this much of the frame
+	bulkPacketData = 20 - 1
+	bulkSeqMask    = 0x3f
+	bulkFirst      = 1 << 6
+	bulkLast       = 1 << 7
+	bulkReply      = 0x80
+	bulkMaxFrame   = 512
+
+	bulkCmdSchedule  = 1
+	bulkCmdEvents    = 2
+	bulkCmdCrash     = 3
+	bulkCmdCommands  = 4
+	bulkCmdScene     = 5
+	bulkCmdCalib     = 6
+	bulkCmdBusStats  = 7
+	bulkCmdHistory   = 8
+	bulkCmdRunHours  = 9
+	bulkCmdLinkStats = 10
+	bulkCmdDebugLog  = 11
+	bulkCmdBurnIn    = 12
+	bulkCmdMemory    = 13
+	bulkCmdAux       = 14
+	bulkCmdBench     = 15
+	bulkCmdStream    = 16
+
+	bulkStatusOK       = 0
+	bulkStatusBadFrame = 1
+	bulkStatusUnknown  = 2
+	bulkStatusRejected = 3
+
+	bulkReplyTimeout = 5 * time.Second
+)
+
+var bulkStatusNames = []string{"ok", "bad frame", "unknown command", "rejected"}
+
+type bulkError uint8
+
+func (e bulkError) Error() string {
+	if int(e) < len(bulkStatusNames) {
+		return "bulk command " + bulkStatusNames[e]
+	}
+	return fmt.Sprintf("bulk command failed with status %d", uint8(e))
+}
+
+// bulkFrame is cmd and body with their CRC appended.
+func bulkFrame(cmd uint8, body []byte) []byte {
+	f := append([]byte{cmd}, body...)
+	crc := crc16(0xffff, f)
+	return append(f, byte(crc), byte(crc>>8))
+}
+
+// bulkPackets splits a frame into packets numbered from seq, returning
+// the next sequence number.
+func bulkPackets(frame []byte, seq uint8) ([][]byte, uint8) {
+	var ps [][]byte
+	for off := 0; off < len(frame); off += bulkPacketData {
+		end := off + bulkPacketData
+		if end > len(frame) {
+			end = len(frame)
+		}
+		h := seq & bulkSeqMask
+		if off == 0 {
+			h |= bulkFirst
+		}
+		if end == len(frame) {
+			h |= bulkLast
+		}
+		ps = append(ps, append([]byte{h}, frame[off:end]...))
+		seq++
+	}
+	return ps, seq & bulkSeqMask
+}
+
+type bulkReassembler struct {
+	buf  []byte
+	seq  uint8
+	open bool
+	bad  bool
+}
+
+// add takes one packet, returning the frame once its last packet is in.
+// Frames with a sequence gap or over bulkMaxFrame come back as an error.
+func (r *bulkReassembler) add(p []byte) ([]byte, error) {
+	if len(p) == 0 {
+		return nil, nil
+	}
+	h := p[0]
+	if h&bulkFirst != 0 {
+		*r = bulkReassembler{open: true}
+	} else if !r.open {
+		return nil, nil
+	} else if h&bulkSeqMask != r.seq {
+		r.bad = true
+	}
+	r.seq = (h + 1) & bulkSeqMask
+	if len(r.buf)+len(p)-1 > bulkMaxFrame {
+		r.bad = true
+	} else if !r.bad {
+		r.buf = append(r.buf, p[1:]...)
+	}
+	if h&bulkLast == 0 {
+		return nil, nil
+	}
+	f, bad := r.buf, r.bad
+	*r = bulkReassembler{seq: r.seq}
+	if bad {
+		return nil, errors.New("bulk reply lost packets")
+	}
+	return f, nil
+}
+
+// parseBulkReply checks a reply frame answers cmd and returns its body.
+func parseBulkReply(cmd uint8, f []byte) ([]byte, error) {
+	if len(f) < 4 {
+		return nil, fmt.Errorf("short bulk reply (%d bytes)", len(f))
+	}
+	n := len(f) - 2
+	if crc16(0xffff, f[:n]) != binary.LittleEndian.Uint16(f[n:]) {
+		return nil, errors.New("bulk reply CRC mismatch")
+	}
+	if f[0] != cmd|bulkReply {
+		return nil, fmt.Errorf("bulk reply to command %d, expected %d", f[0]&^bulkReply, cmd)
+	}
+	if f[1] != bulkStatusOK {
+		return nil, bulkError(f[1])
+	}
+	return f[2:n], nil
+}
+
+type bulkResult struct {
+	frame []byte
+	err   error
+}
+
+type bulkClient struct {
+	p      gatt.Peripheral
+	write  *gatt.Characteristic
+	frames chan bulkResult
+	// The brick's writes, which bulk packets take turns with (lane.go)
+	lane *writeLane
+	// Requests in hand, waiting included
+	pending int32
+
+	// One request at a time, the peripheral holds one frame each way
+	lock sync.Mutex
+	seq  uint8
+	rx   bulkReassembler
+}
+
+func newBulkClient(p gatt.Peripheral, write *gatt.Characteristic, lane *writeLane) *bulkClient {
+	return &bulkClient{p: p, write: write, frames: make(chan bulkResult, 1), lane: lane}
+}
+
+// busy is whether a request would wait on another
+func (c *bulkClient) busy() bool {
+	return atomic.LoadInt32(&c.pending) > 0
+}
+
+// onNotify takes packets from the notify characteristic
+func (c *bulkClient) onNotify(b []byte) {
+	f, err := c.rx.add(b)
+	if f == nil && err == nil {
+		return
+	}
+	select {
+	case c.frames <- bulkResult{f, err}:
+	default:
+	}
+}
+
+// request sends a command at bulk priority and waits for its reply body
+func (c *bulkClient) request(cmd uint8, body []byte, timeout time.Duration) ([]byte, error) {
+	return c.requestAt(prioBulk, cmd, body, timeout)
+}
+
+// requestAt is request with the packets sent at prio, together when it
+// outranks bulk
+func (c *bulkClient) requestAt(prio writePriority, cmd uint8, body []byte, timeout time.Duration) ([]byte, error) {
+	atomic.AddInt32(&c.pending, 1)
+	defer atomic.AddInt32(&c.pending, -1)
+	c.lock.Lock()
+	defer c.lock.Unlock()
+
+	// Anything left over from a request that timed out
+	select {
+	case <-c.frames:
+	default:
+	}
+
+	var ps [][]byte
+	ps, c.seq = bulkPackets(bulkFrame(cmd, body), c.seq)
+	var err error
+	if prio == prioBulk {
+		err = c.lane.runBulk(c.p, c.write, ps)
+	} else {
+		for _, b := range ps {
+			c.lane.air.charge(useOf(prio), airWrite(len(b), false))
+		}
+		err = c.lane.run(prio, func() error { _, err := pipeline(c.p, c.write, ps); return err })
+	}
+	if err != nil {
+		return nil, err
+	}
+	select {
+	case r := <-c.frames:
+		if r.err != nil {
+			return nil, r.err
+		}
+		c.lane.air.charge(useOf(prio), airTransfer(len(r.frame)))
+		return parseBulkReply(cmd, r.frame)
+	case <-time.After(timeout):
+		return nil, errors.New("bulk reply timed out")
+	}
+}
@@ -0,0 +1,67 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestBulkPackets(t *testing.T) {
+	frame := bulkFrame(bulkCmdSchedule, make([]byte, 40))
+	ps, next := bulkPackets(frame, 62)
+	if len(ps) != 3 || next != 1 {
+		t.Fatalf("%d packets, next %d", len(ps), next)
+	}
+	if ps[0][0] != 62|bulkFirst || ps[1][0] != 63 || ps[2][0] != 0|bulkLast {
+		t.Errorf("headers %x %x %x", ps[0][0], ps[1][0], ps[2][0])
+	}
+
+	var r bulkReassembler
+	for i, p := range ps {
+		f, err := r.add(p)
+		if err != nil || (f != nil) != (i == len(ps)-1) {
+			t.Fatalf("packet %d: %x, %v", i, f, err)
+		}
+		if f != nil && !bytes.Equal(f, frame) {
+			t.Errorf("reassembled %x", f)
+		}
+	}
+
+	// A gap drops the frame, the next one resyncs
+	r.add(ps[0])
+	if f, err := r.add(ps[2]); err == nil || f != nil {
+		t.Error("gap accepted")
+	}
+	single, _ := bulkPackets(bulkFrame(bulkCmdEvents, nil), 9)
+	if f, err := r.add(single[0]); err != nil || len(f) != 3 {
+		t.Errorf("after gap %x, %v", f, err)
+	}
+}
+
+func TestParseBulkReply(t *testing.T) {
+	b, err := parseBulkReply(bulkCmdEvents, bulkFrame(bulkCmdEvents|bulkReply, []byte{bulkStatusOK, 1, 2}))
+	if err != nil || !bytes.Equal(b, []byte{1, 2}) {
+		t.Errorf("reply %x, %v", b, err)
+	}
+	if _, err := parseBulkReply(bulkCmdEvents, bulkFrame(bulkCmdCrash|bulkReply, []byte{bulkStatusOK})); err == nil {
+		t.Error("reply to another command accepted")
+	}
+	_, err = parseBulkReply(bulkCmdSchedule, bulkFrame(bulkCmdSchedule|bulkReply, []byte{bulkStatusRejected}))
+	if err != bulkError(bulkStatusRejected) {
+		t.Errorf("status %v", err)
+	}
+	f := bulkFrame(bulkCmdEvents|bulkReply, []byte{bulkStatusOK})
+	f[1] ^= 1
+	if _, err := parseBulkReply(bulkCmdEvents, f); err == nil {
+		t.Error("bad CRC accepted")
+	}
+}
+
+func TestScheduleBulk(t *testing.T) {
+	s, err := newSchedule([]SchedulePoint{{Minute: 600, Percents: []float64{100, 0}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(s.bulk, []byte{1, 2, byte(s.crc), byte(s.crc >> 8), 0x58, 0x02, 0xa0, 0x0f, 0, 0}) {
+		t.Errorf("bulk body %x", s.bulk)
+	}
+}
@@ -0,0 +1,154 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"math"
+	"strings"
+	"time"
+)
+
+// Burn-in qualifying a new brick (the firmware's burnin.h): every
+// channel swept through duty patterns with a frame a tick, the
+// temperature curve going into the history log, and a pass or fail
+// against the thresholds at the end.
+const (
+	burnInLen       = 34
+	burnInFanNever  = 0xffff
+	burnInMaxRiseC  = 100
+	burnInMaxMinute = 0xffff
+)
+
+var burnInStates = []string{"not run", "running", "passed", "failed"}
+
+var burnInFailures = []string{"temperature rise", "bus errors", "foldback", "fan response", "fan or temperature error", "stopped early"}
+
+type burnIn struct {
+	state, failures     uint8
+	elapsed, duration   time.Duration
+	tempStart, tempPeak float64 // C, NaN without a reading
+	maxRise             int
+	rpmStart, rpmMax    int
+	fanResponse         time.Duration // -1 if it hasn't picked up
+	jobs, failed        uint32
+	derateLow           int
+	frames              uint32
+}
+
+func burnInRecord(d time.Duration, maxRiseC int) (cmdRecord, error) {
+	minutes := int(d / time.Minute)
+	if minutes < 0 || minutes > burnInMaxMinute || (minutes == 0 && d != 0) {
+		return cmdRecord{}, fmt.Errorf("burn-in must run whole minutes up to 65535, got %v", d)
+	}
+	if minutes != 0 && (maxRiseC < 1 || maxRiseC > burnInMaxRiseC) {
+		return cmdRecord{}, fmt.Errorf("burn-in rise must be 1-%d C, got %d", burnInMaxRiseC, maxRiseC)
+	}
+	return cmdRecord{op: cmdOpBurnIn, value: []byte{byte(minutes), byte(minutes >> 8), byte(maxRiseC)}}, nil
+}
+
+// 1/16 degree C, NaN for no reading
+func burnInTemp(v uint16) float64 {
+	if int16(v) == math.MinInt16 {
+		return math.NaN()
+	}
+	return float64(int16(v)) / 16
+}
+
+func parseBurnIn(b []byte) (burnIn, error) {
+	if len(b) < burnInLen {
+		return burnIn{}, fmt.Errorf("short burn-in summary (%d bytes)", len(b))
+	}
+	s := burnIn{
+		state:     b[0],
+		failures:  b[1],
+		elapsed:   time.Duration(binary.LittleEndian.Uint32(b[2:])) * time.Second,
+		duration:  time.Duration(binary.LittleEndian.Uint32(b[6:])) * time.Second,
+		tempStart: burnInTemp(binary.LittleEndian.Uint16(b[10:])),
+		tempPeak:  burnInTemp(binary.LittleEndian.Uint16(b[12:])),
+		maxRise:   int(b[14]),
+		rpmStart:  int(binary.LittleEndian.Uint16(b[15:])),
+		rpmMax:    int(binary.LittleEndian.Uint16(b[17:])),
+		jobs:      binary.LittleEndian.Uint32(b[21:]),
+		failed:    binary.LittleEndian.Uint32(b[25:]),
+		derateLow: int(b[29]),
+		frames:    binary.LittleEndian.Uint32(b[30:]),
+	}
+	s.fanResponse = -1
+	if r := binary.LittleEndian.Uint16(b[19:]); r != burnInFanNever {
+		s.fanResponse = time.Duration(r) * time.Second
+	}
+	return s, nil
+}
+
+func (s burnIn) String() string {
+	state := fmt.Sprintf("state %d", s.state)
+	if int(s.state) < len(burnInStates) {
+		state = burnInStates[s.state]
+	}
+	r := fmt.Sprintf("%s, %v of %v, %.1f to %.1f C (rise allowed %d C), fan %d to %d rpm",
+		state, s.elapsed, s.duration, s.tempStart, s.tempPeak, s.maxRise, s.rpmStart, s.rpmMax)
+	if s.fanResponse >= 0 {
+		r += fmt.Sprintf(" picking up after %v", s.fanResponse)
+	}
+	r += fmt.Sprintf(", %d frames, %d of %d bus jobs failed, derate down to %d%%", s.frames, s.failed, s.jobs, s.derateLow)
+	var fails []string
+	for i, name := range burnInFailures {
+		if s.failures&(1<<uint(i)) != 0 {
+			fails = append(fails, name)
+		}
+	}
+	if len(fails) > 0 {
+		r += ", failing on " + strings.Join(fails, ", ")
+	}
+	return r
+}
+
+// BurnIn starts a burn-in of d on every brick as it's next seen, once
+// each, failing any that heat more than maxRiseC. 0 stops them.
+func (ble *bleChannel) BurnIn(d time.Duration, maxRiseC int) error {
+	r, err := burnInRecord(d, maxRiseC)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.burnIn = &r
+	ble.burnInFor = d
+	ble.burnInSent = make(map[string]bool)
+	if ble.maint != nil {
+		ble.maint.cancel(maintBurnIn)
+	}
+	for id, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if ble.maint != nil && d != 0 {
+			ble.queueBurnIn(p, r, d, ble.clock.Now())
+			continue
+		}
+		if err := p.sendCommands(r); err != nil {
+			log.Printf("%s: burn-in: %s", p.gp.ID(), err)
+			continue
+		}
+		ble.burnInSent[id] = true
+	}
+	return nil
+}
+
+// The summary from the brick's last burn-in, when it has run one
+func (p *blePeriph) logBurnIn() error {
+	b, err := p.bulk.request(bulkCmdBurnIn, nil, bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	s, err := parseBurnIn(b)
+	if err != nil {
+		return err
+	}
+	if s.state != 0 {
+		log.Printf("%s: burn-in: %s", p.gp.ID(), s)
+	}
+	return nil
+}
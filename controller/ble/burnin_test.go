@@ -0,0 +1,63 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"math"
+	"testing"
+	"time"
+)
+
+func TestBurnInRecord(t *testing.T) {
+	r, err := burnInRecord(4*time.Hour, 25)
+	if err != nil || r.op != cmdOpBurnIn || !bytes.Equal(r.value, []byte{0xf0, 0, 25}) {
+		t.Errorf("%+v, %v", r, err)
+	}
+	if r, err := burnInRecord(0, 0); err != nil || !bytes.Equal(r.value, []byte{0, 0, 0}) {
+		t.Errorf("stop %+v, %v", r, err)
+	}
+	for _, d := range []time.Duration{30 * time.Second, -time.Minute, 0x10000 * time.Minute} {
+		if _, err := burnInRecord(d, 25); err == nil {
+			t.Errorf("%v accepted", d)
+		}
+	}
+	if _, err := burnInRecord(time.Hour, 0); err == nil {
+		t.Error("no rise accepted")
+	}
+}
+
+func TestParseBurnIn(t *testing.T) {
+	b := make([]byte, burnInLen)
+	b[0], b[1] = 3, 1<<0|1<<3
+	binary.LittleEndian.PutUint32(b[2:], 3600)
+	binary.LittleEndian.PutUint32(b[6:], 3600)
+	binary.LittleEndian.PutUint16(b[10:], 25*16)
+	binary.LittleEndian.PutUint16(b[12:], 52*16+8)
+	b[14] = 25
+	binary.LittleEndian.PutUint16(b[15:], 900)
+	binary.LittleEndian.PutUint16(b[17:], 2400)
+	binary.LittleEndian.PutUint16(b[19:], burnInFanNever)
+	binary.LittleEndian.PutUint32(b[21:], 180000)
+	binary.LittleEndian.PutUint32(b[25:], 2)
+	b[29] = 100
+	binary.LittleEndian.PutUint32(b[30:], 180000)
+	s, err := parseBurnIn(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if s.state != 3 || s.elapsed != time.Hour || s.tempStart != 25 || s.tempPeak != 52.5 || s.fanResponse != -1 ||
+		s.rpmMax != 2400 || s.failed != 2 || s.frames != 180000 {
+		t.Errorf("%+v", s)
+	}
+	if got := s.String(); !bytes.Contains([]byte(got), []byte("failing on temperature rise, fan response")) {
+		t.Errorf("summary %q", got)
+	}
+
+	binary.LittleEndian.PutUint16(b[10:], 0x8000)
+	if s, _ := parseBurnIn(b); !math.IsNaN(s.tempStart) {
+		t.Errorf("no reading as %g", s.tempStart)
+	}
+	if _, err := parseBurnIn(b[:burnInLen-1]); err == nil {
+		t.Error("short summary accepted")
+	}
+}
@@ -0,0 +1,91 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// The firmware's TWI counters (bulk.h): jobs, failed jobs and bytes on
+// the wire per class since boot, then the PCA9685 bursts. Firmware with
+// bus recovery follows with the recoveries and each device's errors.
+const (
+	busClasses    = 3
+	busClassLen   = 12
+	busStatsLen   = busClasses*busClassLen + 4
+	busClassFrame = 1
+	busDeviceLen  = 9
+)
+
+var busClassNames = []string{"config", "frame", "sensor"}
+
+type busClassStats struct {
+	jobs, failed, bytes uint32
+}
+
+type busDeviceStats struct {
+	address                                 uint8
+	addressNack, dataNack, overrun, timeout uint16
+}
+
+type busStats struct {
+	classes    [busClasses]busClassStats
+	commits    uint32
+	recoveries uint32
+	devices    []busDeviceStats
+}
+
+// frameBytes is the bus cost of one frame, what regressions in the
+// frame encoding show up in
+func (s busStats) frameBytes() float64 {
+	if s.commits == 0 {
+		return 0
+	}
+	return float64(s.classes[busClassFrame].bytes) / float64(s.commits)
+}
+
+func (s busStats) String() string {
+	r := fmt.Sprintf("%.1f bytes per frame", s.frameBytes())
+	for i, c := range s.classes {
+		r += fmt.Sprintf(", %s %d jobs (%d failed) %d bytes", busClassNames[i], c.jobs, c.failed, c.bytes)
+	}
+	if s.recoveries > 0 {
+		r += fmt.Sprintf(", %d recoveries", s.recoveries)
+	}
+	for _, d := range s.devices {
+		if d.addressNack+d.dataNack+d.overrun+d.timeout > 0 {
+			r += fmt.Sprintf(", 0x%02x %d address NACKs %d data NACKs %d overruns %d timeouts",
+				d.address, d.addressNack, d.dataNack, d.overrun, d.timeout)
+		}
+	}
+	return r
+}
+
+func parseBusStats(b []byte) (busStats, error) {
+	if len(b) < busStatsLen {
+		return busStats{}, fmt.Errorf("short bus stats (%d bytes)", len(b))
+	}
+	var s busStats
+	for i := range s.classes {
+		c := b[i*busClassLen:]
+		s.classes[i] = busClassStats{
+			jobs:   binary.LittleEndian.Uint32(c[0:]),
+			failed: binary.LittleEndian.Uint32(c[4:]),
+			bytes:  binary.LittleEndian.Uint32(c[8:]),
+		}
+	}
+	s.commits = binary.LittleEndian.Uint32(b[busClasses*busClassLen:])
+	b = b[busStatsLen:]
+	if len(b) < 4 {
+		return s, nil
+	}
+	s.recoveries = binary.LittleEndian.Uint32(b)
+	for b = b[4:]; len(b) >= busDeviceLen; b = b[busDeviceLen:] {
+		s.devices = append(s.devices, busDeviceStats{address: b[0],
+			addressNack: binary.LittleEndian.Uint16(b[1:]),
+			dataNack:    binary.LittleEndian.Uint16(b[3:]),
+			overrun:     binary.LittleEndian.Uint16(b[5:]),
+			timeout:     binary.LittleEndian.Uint16(b[7:]),
+		})
+	}
+	return s, nil
+}
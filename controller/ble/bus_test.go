@@ -0,0 +1,44 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+)
+
+func TestParseBusStats(t *testing.T) {
+	b := make([]byte, busStatsLen)
+	// Frame class: 10 bursts of a 16 channel flush, 66 bytes each
+	binary.LittleEndian.PutUint32(b[busClassLen:], 10)
+	binary.LittleEndian.PutUint32(b[busClassLen+4:], 1)
+	binary.LittleEndian.PutUint32(b[busClassLen+8:], 660)
+	binary.LittleEndian.PutUint32(b[busClasses*busClassLen:], 10)
+	s, err := parseBusStats(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c := s.classes[busClassFrame]; c.jobs != 10 || c.failed != 1 || c.bytes != 660 {
+		t.Errorf("frame class %+v", c)
+	}
+	if f := s.frameBytes(); f != 66 {
+		t.Errorf("%v bytes per frame", f)
+	}
+	if _, err := parseBusStats(b[:busStatsLen-1]); err == nil {
+		t.Error("short stats accepted")
+	}
+	if s.recoveries != 0 || s.devices != nil {
+		t.Errorf("older firmware's stats gave %d recoveries, devices %v", s.recoveries, s.devices)
+	}
+
+	// Then two recoveries, the driver timing out and the sensor NACKing
+	b = append(b, 2, 0, 0, 0,
+		0x7f, 0, 0, 1, 0, 0, 0, 2, 0,
+		0x1f, 5, 0, 0, 0, 0, 0, 0, 0)
+	s, err = parseBusStats(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := []busDeviceStats{{address: 0x7f, dataNack: 1, timeout: 2}, {address: 0x1f, addressNack: 5}}
+	if s.recoveries != 2 || len(s.devices) != 2 || s.devices[0] != want[0] || s.devices[1] != want[1] {
+		t.Errorf("%d recoveries, devices %+v", s.recoveries, s.devices)
+	}
+}
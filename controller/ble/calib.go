@@ -0,0 +1,63 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// Per channel output calibration, laid out in the firmware's calib.h.
+// Duties are on the PCA9685's 0-4096 scale.
+const (
+	calibChannels = 16
+	calibPoints   = 9
+	calibFull     = 4096
+	calibRecord   = 1 + 4 + 2*calibPoints
+)
+
+// Calibration corrects one channel's output: Curve linearizes it through
+// evenly spaced points (nil for straight), then the result is mapped
+// onto MinDuty-MaxDuty so the lowest level still lights and the top is
+// held to the string's current limit.
+type Calibration struct {
+	Channel int   `json:"channel"`
+	MinDuty int   `json:"min_duty"`
+	MaxDuty int   `json:"max_duty"`
+	Curve   []int `json:"curve,omitempty"`
+}
+
+// calibBody packs calibrations into one bulk command body
+func calibBody(cs []Calibration) ([]byte, error) {
+	var body []byte
+	for _, c := range cs {
+		if c.Channel < 0 || c.Channel >= calibChannels {
+			return nil, fmt.Errorf("calibration channel must be 0-%d, got %d", calibChannels-1, c.Channel)
+		}
+		if c.MinDuty < 0 || c.MaxDuty > calibFull || c.MinDuty >= c.MaxDuty {
+			return nil, fmt.Errorf("channel %d: duties must rise within 0-%d, got %d-%d",
+				c.Channel, calibFull, c.MinDuty, c.MaxDuty)
+		}
+		curve := c.Curve
+		if curve == nil {
+			for i := 0; i < calibPoints; i++ {
+				curve = append(curve, i*calibFull/(calibPoints-1))
+			}
+		}
+		if len(curve) != calibPoints {
+			return nil, fmt.Errorf("channel %d: curve needs %d points, got %d", c.Channel, calibPoints, len(curve))
+		}
+		r := make([]byte, calibRecord)
+		r[0] = byte(c.Channel)
+		binary.LittleEndian.PutUint16(r[1:], uint16(c.MinDuty))
+		binary.LittleEndian.PutUint16(r[3:], uint16(c.MaxDuty))
+		last := 0
+		for i, pt := range curve {
+			if pt < last || pt > calibFull {
+				return nil, fmt.Errorf("channel %d: curve must rise within 0-%d", c.Channel, calibFull)
+			}
+			last = pt
+			binary.LittleEndian.PutUint16(r[5+2*i:], uint16(pt))
+		}
+		body = append(body, r...)
+	}
+	return body, nil
+}
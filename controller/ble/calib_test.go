@@ -0,0 +1,28 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestCalibBody(t *testing.T) {
+	b, err := calibBody([]Calibration{{Channel: 3, MinDuty: 8, MaxDuty: 3000}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := []byte{3, 8, 0, 0xb8, 0x0b, 0, 0, 0, 2, 0, 4, 0, 6, 0, 8, 0, 10, 0, 12, 0, 14, 0, 16}
+	if !bytes.Equal(b, want) {
+		t.Errorf("body % x", b)
+	}
+
+	for _, c := range []Calibration{
+		{Channel: 16, MaxDuty: calibFull},
+		{MinDuty: 100, MaxDuty: 100},
+		{MaxDuty: calibFull, Curve: []int{0, 1}},
+		{MaxDuty: calibFull, Curve: []int{0, 600, 500, 1536, 2048, 2560, 3072, 3584, 4096}},
+	} {
+		if _, err := calibBody([]Calibration{c}); err == nil {
+			t.Errorf("accepted %+v", c)
+		}
+	}
+}
@@ -0,0 +1,179 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"strings"
+	"sync/atomic"
+)
+
+// Capability characteristic, laid out in the firmware's ble_lbs.h
+const (
+	capabilityLen   = 7
+	protocolVersion = 1
+)
+
+// LBS_CAP_* bits
+const (
+	capLevel12Bit = 1 << iota
+	capFade
+	capFrame
+	capCommand
+	capBulk
+	capSync
+	capSchedule
+	capScenes
+	capBroadcast
+	capEsb
+	capEffect
+	capLease
+	capOutput
+	capDfu
+	capSim
+	capLatency
+	capDlog
+	capAux
+	capTrace
+	capCmdMac
+	capCmdMacRequired
+	capCrossfade
+	capFanLead
+	capLongWrite
+	capStream
+)
+
+var capNames = [...]string{"level12", "fade", "frame", "command", "bulk", "sync",
+	"schedule", "scenes", "broadcast", "esb", "effect", "lease", "output", "dfu",
+	"sim", "latency", "dlog", "aux", "trace", "cmdmac", "cmdmac-required", "crossfade", "fanlead", "longwrite", "stream"}
+
+// capability is what a brick's firmware says it takes, read once per
+// connection, or not at all when the GATT cache holds it with the
+// handles. Firmware from before it has none, and is judged by the
+// characteristics it has.
+type capability struct {
+	version    uint8
+	cmdVersion uint8
+	channels   uint8
+	bits       uint32
+}
+
+func parseCapability(b []byte) (capability, error) {
+	if len(b) < capabilityLen {
+		return capability{}, fmt.Errorf("short capability (%d bytes)", len(b))
+	}
+	c := capability{version: b[0], cmdVersion: b[1], channels: b[2],
+		bits: binary.LittleEndian.Uint32(b[3:])}
+	if c.channels < 1 || int(c.channels) > frameChannels {
+		return capability{}, fmt.Errorf("capability with %d channels", c.channels)
+	}
+	return c, nil
+}
+
+func (c capability) has(bit uint32) bool {
+	return c.bits&bit != 0
+}
+
+func (c capability) String() string {
+	var names []string
+	for i, name := range capNames {
+		if c.bits&(1<<uint(i)) != 0 {
+			names = append(names, name)
+		}
+	}
+	return fmt.Sprintf("protocol %d, commands %d, %d channels, %s",
+		c.version, c.cmdVersion, c.channels, strings.Join(names, " "))
+}
+
+// writePath is how a brick's levels go out, the fastest it takes
+type writePath int
+
+const (
+	// A write per channel to the LED characteristic, 8 bit on the
+	// oldest firmware
+	pathLevels writePath = iota
+	pathFades
+	pathFrames
+	// Packed frame commands, acked per write
+	pathPacked
+	// Packed frames applied at brick time, packed when the clock isn't
+	// placed yet
+	pathSynced
+)
+
+var pathNames = [...]string{"levels", "fades", "frames", "packed", "synced"}
+
+func (w writePath) String() string {
+	return pathNames[w]
+}
+
+// choosePath picks the fastest path both ends take. A brick that told
+// its capabilities gets the paths it named that this controller speaks;
+// one that didn't gets whatever its characteristics allow.
+func (p *blePeriph) choosePath() writePath {
+	if p.caps == nil {
+		switch {
+		case p.commandChar != nil && p.bulk != nil:
+			return pathSynced
+		case p.commandChar != nil:
+			return pathPacked
+		case p.frameChar != nil:
+			return pathFrames
+		case p.fadeChar != nil:
+			return pathFades
+		}
+		return pathLevels
+	}
+	c := p.caps
+	command := c.has(capCommand) && c.cmdVersion == cmdVersion && p.commandChar != nil
+	switch {
+	case command && c.has(capSync) && c.has(capBulk) && p.bulk != nil && p.syncChar != nil:
+		return pathSynced
+	case command:
+		return pathPacked
+	case c.has(capFrame) && p.frameChar != nil:
+		return pathFrames
+	case c.has(capFade) && p.fadeChar != nil:
+		return pathFades
+	}
+	return pathLevels
+}
+
+// negotiate settles what the brick takes from its capability, capBytes
+// when the cache held it, and the path its levels go by
+func (p *blePeriph) negotiate(id string, capBytes []byte) []byte {
+	if capBytes == nil && p.capabilityChar != nil {
+		b, err := p.gp.ReadCharacteristic(p.capabilityChar)
+		if err != nil {
+			log.Printf("%s: capability: %s", id, err)
+		} else {
+			capBytes = b
+		}
+	}
+	if capBytes != nil {
+		if c, err := parseCapability(capBytes); err != nil {
+			log.Printf("%s: %s", id, err)
+			capBytes = nil
+		} else {
+			p.caps = &c
+			p.channels = int(c.channels)
+			if c.version > protocolVersion {
+				log.Printf("%s: protocol %d is newer than this controller's %d, using what both take",
+					id, c.version, protocolVersion)
+			}
+			log.Printf("%s: %s", id, c)
+		}
+	}
+	p.path = p.choosePath()
+	if p.caps != nil {
+		atomic.StoreInt64(&p.metrics.protocol, int64(p.caps.version))
+	}
+	atomic.StoreInt64(&p.metrics.writePath, int64(p.path))
+	log.Printf("%s: writing levels by %s", id, p.path)
+	return capBytes
+}
+
+// levels12Bit is whether the LED characteristic takes full levels
+func (p *blePeriph) levels12Bit() bool {
+	return p.caps != nil && p.caps.has(capLevel12Bit)
+}
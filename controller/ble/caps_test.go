@@ -0,0 +1,65 @@
+package ble
+
+import (
+	"testing"
+
+	"github.com/paypal/gatt"
+)
+
+func TestParseCapability(t *testing.T) {
+	c, err := parseCapability([]byte{1, cmdVersion, 16, 0x0f, 0x10, 0, 0})
+	if err != nil || c.version != 1 || c.channels != 16 || !c.has(capCommand) || !c.has(capOutput) || c.has(capSync) {
+		t.Errorf("%+v, %v", c, err)
+	}
+	if _, err := parseCapability([]byte{1, cmdVersion, 8}); err == nil {
+		t.Error("short capability parsed")
+	}
+	if _, err := parseCapability([]byte{1, cmdVersion, 0, 0, 0, 0, 0}); err == nil {
+		t.Error("no channels parsed")
+	}
+}
+
+func TestChoosePath(t *testing.T) {
+	svc := gatt.NewService(gatt.MustParseUUID(pwmService))
+	char := func(uuid string) *gatt.Characteristic {
+		return gatt.NewCharacteristic(gatt.MustParseUUID(uuid), svc, gatt.CharWriteNR, 0, 0)
+	}
+	full := func() *blePeriph {
+		return &blePeriph{commandChar: char(pwmCommandChar), syncChar: char(pwmSyncChar),
+			frameChar: char(pwmFrameChar), fadeChar: char(pwmFadeChar), bulk: &bulkClient{},
+			metrics: newMetrics().brick("brick")}
+	}
+
+	// Without a capability, the characteristics decide
+	if p := full(); p.choosePath() != pathSynced {
+		t.Errorf("old firmware on %s", p.choosePath())
+	}
+	p := &blePeriph{fadeChar: char(pwmFadeChar)}
+	if p.choosePath() != pathFades {
+		t.Errorf("fades only on %s", p.choosePath())
+	}
+
+	for _, c := range []struct {
+		bits       uint32
+		cmdVersion uint8
+		want       writePath
+	}{
+		{capCommand | capBulk | capSync | capFrame, cmdVersion, pathSynced},
+		{capCommand | capFrame, cmdVersion, pathPacked},
+		// A command protocol this controller doesn't speak
+		{capCommand | capFrame, cmdVersion + 1, pathFrames},
+		{capFade, cmdVersion, pathFades},
+		{capLevel12Bit, cmdVersion, pathLevels},
+	} {
+		p := full()
+		b := []byte{protocolVersion, c.cmdVersion, 12, byte(c.bits), byte(c.bits >> 8), 0, 0}
+		if got := p.negotiate("brick", b); got == nil || p.path != c.want || p.width() != 12 {
+			t.Errorf("%#x on %s, want %s, %d wide", c.bits, p.path, c.want, p.width())
+		}
+	}
+
+	p = full()
+	if p.negotiate("brick", []byte{1}) != nil || p.caps != nil || p.path != pathSynced {
+		t.Errorf("bad capability kept, on %s", p.path)
+	}
+}
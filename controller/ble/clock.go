@@ -0,0 +1,55 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"time"
+)
+
+// The firmware's clock (clock.h) counts local wall time as seconds since
+// 1970 with no zone applied.
+const (
+	clockLen     = 11
+	clockFlagSet = 1 << 0
+
+	// How often a peripheral's clock is corrected. It trims its own rate
+	// from syncs at least an hour apart.
+	clockSyncInterval = time.Hour
+)
+
+// clockWrite sets a peripheral's clock to t as seen in loc, including
+// the 1/256 s fraction.
+func clockWrite(t time.Time, loc *time.Location) []byte {
+	lt := t.In(loc)
+	wall := time.Date(lt.Year(), lt.Month(), lt.Day(), lt.Hour(), lt.Minute(), lt.Second(), 0, time.UTC)
+	b := make([]byte, 5)
+	binary.LittleEndian.PutUint32(b, uint32(wall.Unix()))
+	b[4] = byte(lt.Nanosecond() * 256 / int(time.Second))
+	return b
+}
+
+type clockState struct {
+	time     uint32
+	uptime   uint32
+	driftPpm int
+	set      bool
+}
+
+func parseClock(b []byte) (clockState, error) {
+	if len(b) < clockLen {
+		return clockState{}, fmt.Errorf("short clock (%d bytes)", len(b))
+	}
+	return clockState{
+		time:     binary.LittleEndian.Uint32(b[0:]),
+		uptime:   binary.LittleEndian.Uint32(b[4:]),
+		driftPpm: int(int16(binary.LittleEndian.Uint16(b[8:]))),
+		set:      b[10]&clockFlagSet != 0,
+	}, nil
+}
+
+// at places an uptime, as sent with telemetry, on the peripheral's
+// clock in loc.
+func (c clockState) at(uptime uint32, loc *time.Location) time.Time {
+	wall := time.Unix(int64(c.time)+int64(int32(uptime-c.uptime)), 0).UTC()
+	return time.Date(wall.Year(), wall.Month(), wall.Day(), wall.Hour(), wall.Minute(), wall.Second(), 0, loc)
+}
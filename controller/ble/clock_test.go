@@ -0,0 +1,33 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestClockWrite(t *testing.T) {
+	loc := time.FixedZone("test", -8*3600)
+	b := clockWrite(time.Date(2016, 1, 2, 18, 30, 15, int(time.Second/2), time.UTC), loc)
+	// 10:30:15 local, as if UTC
+	want := uint32(time.Date(2016, 1, 2, 10, 30, 15, 0, time.UTC).Unix())
+	if got := uint32(b[0]) | uint32(b[1])<<8 | uint32(b[2])<<16 | uint32(b[3])<<24; got != want || b[4] != 128 {
+		t.Errorf("clock write %x", b)
+	}
+}
+
+func TestClockAt(t *testing.T) {
+	loc := time.FixedZone("test", -8*3600)
+	base := time.Date(2016, 1, 2, 10, 30, 0, 0, time.UTC).Unix()
+	b := []byte{0, 0, 0, 0, 100, 0, 0, 0, 0xfb, 0xff, clockFlagSet}
+	b[0], b[1], b[2], b[3] = byte(base), byte(base>>8), byte(base>>16), byte(base>>24)
+	c, err := parseClock(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !c.set || c.driftPpm != -5 {
+		t.Errorf("parsed %+v", c)
+	}
+	if at := c.at(160, loc); !at.Equal(time.Date(2016, 1, 2, 10, 31, 0, 0, loc)) {
+		t.Errorf("at %v", at)
+	}
+}
@@ -0,0 +1,99 @@
+package ble
+
+import (
+	"crypto/aes"
+	"crypto/cipher"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+)
+
+// Signed command writes, the firmware's LBS_CMD_SIGNED (ble_lbs.h): the
+// header carries a counter, one per signed write, and a MAC under the
+// fleet key broadcasts use follows the records. The brick runs each
+// counter once, so a write recorded on one connection can't be played
+// into another. Reading the command characteristic gives the latest
+// counter the brick has run, which a connection counts on from.
+const (
+	cmdSigned          = 0x80
+	cmdSignedHeaderLen = 6
+	cmdMacLen          = 4
+	cmdCounterLen      = 4
+)
+
+// errSignedTooLong is a record that fits an unsigned write but not a
+// signed one, which goes over the bulk channel instead
+var errSignedTooLong = errors.New("command too long for a signed write")
+
+// cmdSigner signs a connection's command writes
+type cmdSigner struct {
+	block   cipher.Block
+	counter uint32
+}
+
+func newCmdSigner(key []byte, counter uint32) (*cmdSigner, error) {
+	if len(key) != 16 {
+		return nil, fmt.Errorf("command key must be 16 bytes, got %d", len(key))
+	}
+	block, err := aes.NewCipher(key)
+	if err != nil {
+		return nil, err
+	}
+	return &cmdSigner{block: block, counter: counter}, nil
+}
+
+func (s *cmdSigner) header(seq uint8) []byte {
+	return []byte{cmdVersion | cmdSigned, seq, 0, 0, 0, 0}
+}
+
+// sign numbers w, a write from header(), and appends its MAC
+func (s *cmdSigner) sign(w []byte) []byte {
+	s.counter++
+	if s.counter == 0 {
+		// The brick's "none yet"
+		s.counter++
+	}
+	binary.LittleEndian.PutUint32(w[2:], s.counter)
+	return append(w, cbcMac(s.block, w)[:cmdMacLen]...)
+}
+
+// SignCommands signs command writes with key to every brick that takes
+// them, as the ones built to refuse unsigned writes need.
+func (ble *bleChannel) SignCommands(key []byte) error {
+	if _, err := newCmdSigner(key, 0); err != nil {
+		return err
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.cmdKey = append([]byte(nil), key...)
+	return nil
+}
+
+// signCommands starts signing on a brick that takes it, from the counter
+// it has run up to
+func (p *blePeriph) signCommands(id string, key []byte) {
+	if p.caps == nil || !p.caps.has(capCmdMac) || p.commandChar == nil {
+		return
+	}
+	if key == nil {
+		if p.caps.has(capCmdMacRequired) {
+			log.Printf("%s: only takes signed commands, and there's no key to sign them", id)
+		}
+		return
+	}
+	b, err := p.gp.ReadCharacteristic(p.commandChar)
+	if err == nil && len(b) < cmdCounterLen {
+		err = fmt.Errorf("short counter (%d bytes)", len(b))
+	}
+	if err != nil {
+		log.Printf("%s: signed commands: %s", id, err)
+		return
+	}
+	s, err := newCmdSigner(key, binary.LittleEndian.Uint32(b))
+	if err != nil {
+		log.Printf("%s: signed commands: %s", id, err)
+		return
+	}
+	p.acks.sign(s)
+}
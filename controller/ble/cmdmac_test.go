@@ -0,0 +1,59 @@
+package ble
+
+import (
+	"bytes"
+	"crypto/aes"
+	"encoding/binary"
+	"testing"
+)
+
+func TestSignedCommandWrites(t *testing.T) {
+	key := bytes.Repeat([]byte{0x11}, 16)
+	s, err := newCmdSigner(key, 41)
+	if err != nil {
+		t.Fatal(err)
+	}
+	ws, next, err := commandWrites([]cmdRecord{dimRecord(40), dimRecord(50), dimRecord(60), dimRecord(70)}, 9, s)
+	if err != nil {
+		t.Fatal(err)
+	}
+	// Three records to a write in the room the counter and MAC leave
+	if len(ws) != 2 || next != 11 {
+		t.Fatalf("%d writes, next %d", len(ws), next)
+	}
+	block, _ := aes.NewCipher(key)
+	for i, w := range ws {
+		if len(w) > cmdMaxWrite || w[0] != cmdVersion|cmdSigned || w[1] != uint8(9+i) {
+			t.Errorf("write %d % x", i, w)
+		}
+		if counter := binary.LittleEndian.Uint32(w[2:]); counter != uint32(42+i) {
+			t.Errorf("write %d counter %d", i, counter)
+		}
+		body := w[:len(w)-cmdMacLen]
+		if !bytes.Equal(w[len(body):], cbcMac(block, body)[:cmdMacLen]) {
+			t.Errorf("write %d MAC % x", i, w[len(body):])
+		}
+	}
+
+	// A full packed frame fits a plain write but not a signed one
+	frame := []cmdRecord{packedFrameRecord(0xff, 1000, make([]int, 8))}
+	if _, _, err := commandWrites(frame, 0, s); err != errSignedTooLong {
+		t.Errorf("signed frame: %v", err)
+	}
+	b := commandBatch(frame, 3, s)
+	if b[0] != cmdVersion|cmdSigned || binary.LittleEndian.Uint32(b[2:]) != 44 ||
+		len(b) != cmdSignedHeaderLen+cmdRecordHeader+len(frame[0].value)+cmdMacLen {
+		t.Errorf("signed batch % x", b)
+	}
+
+	// The brick's "none yet" is skipped when the counter wraps
+	s.counter = 0xffffffff
+	ws, _, _ = commandWrites([]cmdRecord{dimRecord(40)}, 0, s)
+	if counter := binary.LittleEndian.Uint32(ws[0][2:]); counter != 1 {
+		t.Errorf("wrapped to %d", counter)
+	}
+
+	if _, err := newCmdSigner(key[:8], 0); err == nil {
+		t.Error("short key taken")
+	}
+}
@@ -0,0 +1,297 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"sync"
+)
+
+// Versioned command protocol, laid out in the firmware's ble_lbs.h
+const (
+	cmdVersion      = 1
+	cmdHeaderLen    = 2
+	cmdRecordHeader = 2
+	cmdMaxWrite     = 20
+	cmdAckLen       = 10
+	cmdWindow       = 32
+
+	cmdOpLevel        = 1
+	cmdOpLevelAll     = 2
+	cmdOpOutputEnable = 3
+	cmdOpFade         = 4
+	cmdOpFadeAll      = 5
+	cmdOpFrame        = 6
+	cmdOpFramePacked  = 7
+	cmdOpProfile      = 8
+	cmdOpSceneRecall  = 9
+	cmdOpSceneSave    = 10
+	cmdOpSceneClear   = 11
+	cmdOpAt           = 12
+	cmdOpPwmFreq      = 13
+	cmdOpDither       = 14
+	cmdOpStage        = 15
+	cmdOpCommit       = 16
+	cmdOpDim          = 17
+	cmdOpSlew         = 18
+	cmdOpSim          = 19
+	cmdOpEffect       = 20
+	cmdOpBurnIn       = 21
+	cmdOpLease        = 22
+	cmdOpFanLead      = 23
+	cmdOpStreamStart  = 24
+	cmdOpStreamFrame  = 25
+
+	// Channels per staged record, so each fits one write
+	stageChannels = 8
+
+	// PWM frequencies the PCA9685 prescaler covers
+	pwmMinHz = 24
+	pwmMaxHz = 1526
+)
+
+type cmdRecord struct {
+	op    uint8
+	value []byte
+}
+
+// packedFrameRecord is a frame of levels (0-4095) for the channels in
+// mask, lowest first, packed two to three bytes.
+func packedFrameRecord(mask uint16, durationMs int, levels []int) cmdRecord {
+	v := []byte{byte(mask), byte(mask >> 8), byte(durationMs), byte(durationMs >> 8)}
+	for i := 0; i < len(levels); i += 2 {
+		a := levels[i] & 0xfff
+		b := 0
+		if i+1 < len(levels) {
+			b = levels[i+1] & 0xfff
+		}
+		v = append(v, byte(a), byte(a>>8)|byte(b<<4))
+		if i+1 < len(levels) {
+			v = append(v, byte(b>>4))
+		}
+	}
+	return cmdRecord{op: cmdOpFramePacked, value: v}
+}
+
+func pwmFreqRecord(hz int) cmdRecord {
+	return cmdRecord{op: cmdOpPwmFreq, value: []byte{byte(hz), byte(hz >> 8)}}
+}
+
+func outputEnableRecord(on bool) cmdRecord {
+	v := byte(0)
+	if on {
+		v = 1
+	}
+	return cmdRecord{op: cmdOpOutputEnable, value: []byte{v}}
+}
+
+func dimRecord(percent int) cmdRecord {
+	return cmdRecord{op: cmdOpDim, value: []byte{byte(percent)}}
+}
+
+// slewRecord limits the channels in mask to levels (0-4095) per second,
+// 0 lifting the limit
+func slewRecord(mask uint16, perSecond int) cmdRecord {
+	return cmdRecord{op: cmdOpSlew, value: []byte{byte(mask), byte(mask >> 8), byte(perSecond), byte(perSecond >> 8)}}
+}
+
+// Sensor simulations, in firmware built for them (sim.h)
+var simKinds = map[string]uint8{"off": 0, "ramp": 1, "step": 2, "stall": 3}
+
+// simRecord swings a simulated temperature between low and high (1/16
+// degree C) once every periodMin simulated minutes
+func simRecord(kind uint8, low, high int, periodMin int) cmdRecord {
+	return cmdRecord{op: cmdOpSim, value: []byte{kind, byte(low), byte(low >> 8),
+		byte(high), byte(high >> 8), byte(periodMin), byte(periodMin >> 8)}}
+}
+
+func ditherRecord(mask uint16) cmdRecord {
+	return cmdRecord{op: cmdOpDither, value: []byte{byte(mask), byte(mask >> 8)}}
+}
+
+// stageRecords holds levels (0-4095, from channel 0) in the brick's back
+// frame, a write's worth of channels per record. Staging adds up, so
+// the records make one frame.
+func stageRecords(durationMs int, levels []int) []cmdRecord {
+	var rs []cmdRecord
+	for first := 0; first < len(levels); first += stageChannels {
+		last := first + stageChannels
+		if last > len(levels) {
+			last = len(levels)
+		}
+		mask := uint16(1<<uint(last-first)-1) << uint(first)
+		r := packedFrameRecord(mask, durationMs, levels[first:last])
+		r.op = cmdOpStage
+		rs = append(rs, r)
+	}
+	return rs
+}
+
+func commitRecord() cmdRecord {
+	return cmdRecord{op: cmdOpCommit}
+}
+
+// commandWrites packs records into as few writes as fit, numbered from
+// seq, returning the next sequence number. s signs them, nil for none.
+func commandWrites(records []cmdRecord, seq uint8, s *cmdSigner) ([][]byte, uint8, error) {
+	var ws [][]byte
+	var w []byte
+	header, max := cmdHeaderLen, cmdMaxWrite
+	if s != nil {
+		header, max = cmdSignedHeaderLen, cmdMaxWrite-cmdMacLen
+	}
+	for _, r := range records {
+		n := cmdRecordHeader + len(r.value)
+		if header+n > max {
+			if cmdHeaderLen+n <= cmdMaxWrite {
+				return nil, seq, errSignedTooLong
+			}
+			return nil, seq, fmt.Errorf("command %d too long for one write (%d bytes)", r.op, n)
+		}
+		if w != nil && len(w)+n > max {
+			ws = append(ws, w)
+			w = nil
+		}
+		if w == nil {
+			w = []byte{cmdVersion, seq}
+			if s != nil {
+				w = s.header(seq)
+			}
+			seq++
+		}
+		w = append(w, r.op, byte(len(r.value)))
+		w = append(w, r.value...)
+	}
+	if w != nil {
+		ws = append(ws, w)
+	}
+	if s != nil {
+		for i := range ws {
+			ws[i] = s.sign(ws[i])
+		}
+	}
+	return ws, seq, nil
+}
+
+// commandBatch packs records into one command of any length, for the
+// bulk channel. s signs it, nil for none.
+func commandBatch(records []cmdRecord, seq uint8, s *cmdSigner) []byte {
+	b := []byte{cmdVersion, seq}
+	if s != nil {
+		b = s.header(seq)
+	}
+	for _, r := range records {
+		b = append(b, r.op, byte(len(r.value)))
+		b = append(b, r.value...)
+	}
+	if s != nil {
+		b = s.sign(b)
+	}
+	return b
+}
+
+type cmdAck struct {
+	seq      uint8
+	received uint32
+	rejected uint32
+	// On firmware tracing commands, when the ack carries one (trace.go)
+	trace *cmdTrace
+}
+
+func parseCmdAck(b []byte) (cmdAck, error) {
+	if len(b) < cmdAckLen {
+		return cmdAck{}, fmt.Errorf("short command ack (%d bytes)", len(b))
+	}
+	if b[0] != cmdVersion {
+		return cmdAck{}, fmt.Errorf("command ack version %d", b[0])
+	}
+	k := cmdAck{
+		seq:      b[1],
+		received: binary.LittleEndian.Uint32(b[2:]),
+		rejected: binary.LittleEndian.Uint32(b[6:]),
+	}
+	if len(b) >= cmdAckLen+cmdTraceLen {
+		t := parseCmdTrace(b[cmdAckLen:])
+		k.trace = &t
+	}
+	return k, nil
+}
+
+// cmdAcks numbers command writes and settles them from the acks: a
+// write the peripheral has moved past without receiving was lost.
+type cmdAcks struct {
+	next     uint8
+	pending  map[uint8]bool
+	lost     int
+	rejected int
+	// Signs the writes once the brick's counter is known, see cmdmac.go
+	signer *cmdSigner
+
+	lock sync.Mutex
+}
+
+func newCmdAcks() *cmdAcks {
+	return &cmdAcks{pending: make(map[uint8]bool)}
+}
+
+// writes numbers the records as writes to send
+func (a *cmdAcks) writes(records []cmdRecord) ([][]byte, error) {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	ws, next, err := commandWrites(records, a.next, a.signer)
+	if err != nil {
+		return nil, err
+	}
+	for _, w := range ws {
+		a.pending[w[1]] = true
+	}
+	a.next = next
+	return ws, nil
+}
+
+// batch numbers the records as one bulk command
+func (a *cmdAcks) batch(records []cmdRecord) []byte {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	b := commandBatch(records, a.next, a.signer)
+	a.pending[a.next] = true
+	a.next++
+	return b
+}
+
+// sign has s sign the writes from here on
+func (a *cmdAcks) sign(s *cmdSigner) {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	a.signer = s
+}
+
+// ack settles pending writes, returning how many were newly lost and
+// rejected.
+func (a *cmdAcks) ack(k cmdAck) (lost, rejected int) {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	for seq := range a.pending {
+		back := k.seq - seq
+		if back >= 0x80 {
+			// Sent after the write being acked
+			continue
+		}
+		bit := uint32(1) << back
+		switch {
+		case back >= cmdWindow || k.received&bit == 0:
+			lost++
+		case k.rejected&bit != 0:
+			rejected++
+		}
+		delete(a.pending, seq)
+	}
+	a.lost += lost
+	a.rejected += rejected
+	return lost, rejected
+}
+
+func (a *cmdAcks) Lost() int {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	return a.lost
+}
@@ -0,0 +1,140 @@
+package ble
+
+import (
+	"bytes"
+	"math/rand"
+	"testing"
+)
+
+func TestPackedFrameRecord(t *testing.T) {
+	r := packedFrameRecord(0x0007, 1000, []int{0x123, 0x456, 0xfff})
+	want := []byte{0x07, 0x00, 0xe8, 0x03, 0x23, 0x61, 0x45, 0xff, 0x0f}
+	if r.op != cmdOpFramePacked || !bytes.Equal(r.value, want) {
+		t.Errorf("record %d % x", r.op, r.value)
+	}
+	// Eight channels fill one write
+	ws, _, err := commandWrites([]cmdRecord{packedFrameRecord(0xff, 1000, make([]int, 8))}, 0, nil)
+	if err != nil || len(ws) != 1 || len(ws[0]) != cmdMaxWrite {
+		t.Errorf("%d writes, %v", len(ws), err)
+	}
+}
+
+func TestCommandWrites(t *testing.T) {
+	fade := cmdRecord{op: cmdOpFade, value: make([]byte, 5)}
+	ws, next, err := commandWrites([]cmdRecord{fade, fade, fade}, 255, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(ws) != 2 || next != 1 {
+		t.Fatalf("%d writes, next %d", len(ws), next)
+	}
+	if ws[0][0] != cmdVersion || ws[0][1] != 255 || ws[1][1] != 0 || len(ws[0]) != 2+2*7 {
+		t.Errorf("writes % x", ws)
+	}
+	if _, _, err := commandWrites([]cmdRecord{{op: cmdOpFrame, value: make([]byte, 20)}}, 0, nil); err == nil {
+		t.Error("oversized record accepted")
+	}
+}
+
+func TestCmdAcks(t *testing.T) {
+	a := newCmdAcks()
+	rec := []cmdRecord{{op: cmdOpLevelAll, value: []byte{0, 0}}}
+	for i := 0; i < 4; i++ {
+		a.writes(rec)
+	}
+	a.writes(rec)
+
+	// 0..3 acked at 3: 1 lost, 2 rejected, 4 still in flight
+	k, err := parseCmdAck([]byte{cmdVersion, 3, 0x0d, 0, 0, 0, 0x04, 0, 0, 0})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if lost, rejected := a.ack(k); lost != 1 || rejected != 1 {
+		t.Errorf("lost %d, rejected %d", lost, rejected)
+	}
+	if len(a.pending) != 1 || !a.pending[4] {
+		t.Errorf("pending %v", a.pending)
+	}
+	if _, err := parseCmdAck([]byte{2, 0, 0, 0, 0, 0, 0, 0, 0, 0}); err == nil {
+		t.Error("unknown version accepted")
+	}
+}
+
+func TestPwmFreqRecord(t *testing.T) {
+	ws, _, err := commandWrites([]cmdRecord{pwmFreqRecord(1000)}, 7, nil)
+	if err != nil || len(ws) != 1 || !bytes.Equal(ws[0], []byte{cmdVersion, 7, cmdOpPwmFreq, 2, 0xe8, 0x03}) {
+		t.Errorf("writes % x, %v", ws, err)
+	}
+}
+
+func TestDimRecord(t *testing.T) {
+	ws, _, err := commandWrites([]cmdRecord{dimRecord(40)}, 3, nil)
+	if err != nil || len(ws) != 1 || !bytes.Equal(ws[0], []byte{cmdVersion, 3, cmdOpDim, 1, 40}) {
+		t.Errorf("writes % x, %v", ws, err)
+	}
+}
+
+func TestSlewRecord(t *testing.T) {
+	r := slewRecord(0xffff, 4095)
+	if r.op != cmdOpSlew || !bytes.Equal(r.value, []byte{0xff, 0xff, 0xff, 0x0f}) {
+		t.Errorf("record %+v", r)
+	}
+}
+
+func TestSimRecord(t *testing.T) {
+	r := simRecord(simKinds["step"], 25*16, 70*16, 24*60)
+	if r.op != cmdOpSim || !bytes.Equal(r.value, []byte{2, 0x90, 0x01, 0x60, 0x04, 0xa0, 0x05}) {
+		t.Errorf("record %+v", r)
+	}
+}
+
+func TestWeatherRecord(t *testing.T) {
+	rnd := rand.New(rand.NewSource(1))
+	w := Weather{Kind: "storm", Seed: 0x1234, CloudDepth: 60, CloudSeconds: 30, StrikesPerMinute: 4, Seconds: 600}
+	r, err := w.record(rnd)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if r.op != cmdOpEffect || !bytes.Equal(r.value, []byte{2, 0x34, 0x12, 60, 30, 4, 0x58, 0x02}) {
+		t.Errorf("record %+v", r)
+	}
+	// Every brick gets the one seed picked
+	w.Seed = 0
+	if r, err = w.record(rnd); err != nil || r.value[1] == 0 && r.value[2] == 0 {
+		t.Errorf("unseeded record %+v, %v", r, err)
+	}
+	for _, bad := range []Weather{{Kind: "fog"}, {Kind: "clouds", CloudDepth: 101, CloudSeconds: 1},
+		{Kind: "clouds", CloudSeconds: 0}, {Kind: "storm", CloudSeconds: 1, StrikesPerMinute: 61}} {
+		if _, err := bad.record(rnd); err == nil {
+			t.Errorf("%+v accepted", bad)
+		}
+	}
+	if r, err := (Weather{Kind: "off"}).record(rnd); err != nil || r.value[0] != 0 {
+		t.Errorf("off %+v, %v", r, err)
+	}
+}
+
+func TestDitherRecord(t *testing.T) {
+	r := ditherRecord(0x8021)
+	if r.op != cmdOpDither || !bytes.Equal(r.value, []byte{0x21, 0x80}) {
+		t.Errorf("record %+v", r)
+	}
+}
+
+func TestStageRecords(t *testing.T) {
+	rs := stageRecords(500, make([]int, 12))
+	if len(rs) != 2 || rs[0].op != cmdOpStage {
+		t.Fatalf("records %+v", rs)
+	}
+	if rs[0].value[0] != 0xff || rs[0].value[1] != 0x00 || rs[1].value[0] != 0x00 || rs[1].value[1] != 0x0f {
+		t.Errorf("masks % x, % x", rs[0].value[:2], rs[1].value[:2])
+	}
+	if ws, _, err := commandWrites(rs, 0, nil); err != nil || len(ws) != 2 {
+		t.Errorf("%d writes, %v", len(ws), err)
+	}
+	// A commit at a shared time fits one write
+	ws, _, err := commandWrites(commandAt(1000, []cmdRecord{commitRecord()}), 0, nil)
+	if err != nil || len(ws) != 1 || !bytes.Equal(ws[0][2+2+4:], []byte{cmdOpCommit, 0}) {
+		t.Errorf("writes % x, %v", ws, err)
+	}
+}
@@ -0,0 +1,174 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Link characteristic, laid out in the firmware's ble_lbs.h
+const linkStatusLen = 8
+
+// Connection parameters follow what a brick is doing: a short interval
+// while levels are moving and while schedules, scenes, history or
+// firmware go over the link, then a long interval with slave latency
+// once it has been quiet a while, so an idle brick's radio sleeps
+// through most connection events. The controller moves the link itself
+// as the central, rather than having the brick ask (conn_profile.h),
+// which gatt never answers. That needs a link it drives directly, the
+// connectivity dongle (sddevice.go); a brick behind gatt stays on
+// whatever the adapter picked, and only has that read back for the
+// metrics.
+type connParams struct {
+	// 1.25 ms units, equal once negotiated
+	minInterval, maxInterval uint16
+	latency                  uint16
+	// 10 ms units
+	timeout uint16
+}
+
+func (p connParams) interval() time.Duration {
+	return time.Duration(p.maxInterval) * 1250 * time.Microsecond
+}
+
+func (p connParams) supervision() time.Duration {
+	return time.Duration(p.timeout) * 10 * time.Millisecond
+}
+
+type connProfileKind int
+
+const (
+	connIdle connProfileKind = iota
+	connBurst
+)
+
+// The firmware's own profiles, CONN_PROFILE_BURST and _IDLE
+var connProfiles = [...]connParams{
+	connIdle:  {minInterval: 400, maxInterval: 800, latency: 4, timeout: 1200},
+	connBurst: {minInterval: 8, maxInterval: 24, latency: 0, timeout: 400},
+}
+
+// Quiet after the last activity before the link drops back to idle, a
+// few write intervals so a slow ramp stays on burst
+const connBurstHold = 15 * time.Second
+
+// connUpdater is a link the controller can move from the central's side
+type connUpdater interface {
+	updateConn(p connParams) error
+	// What the link runs with, false once it's gone
+	linkParams() (connParams, bool)
+}
+
+// connProfile is one link's profile, asked for on one goroutine at a
+// time so a slow update never holds up the writer
+type connProfile struct {
+	u         connUpdater
+	want      connProfileKind
+	asked     connProfileKind
+	askedOnce bool
+	sending   bool
+	busyUntil time.Time
+	// Failed updates in a row, logged on the first
+	failures int
+
+	lock sync.Mutex
+}
+
+func newConnProfile(u connUpdater) *connProfile {
+	return &connProfile{u: u}
+}
+
+// activity holds the link on burst until connBurstHold from now
+func (c *connProfile) activity(now time.Time) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if until := now.Add(connBurstHold); until.After(c.busyUntil) {
+		c.busyUntil = until
+	}
+	c.want = connBurst
+	c.kick()
+}
+
+// poll drops back to idle once the hold is over, and retries an update
+// that failed
+func (c *connProfile) poll(now time.Time) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if c.want == connBurst && !now.Before(c.busyUntil) {
+		c.want = connIdle
+	}
+	c.kick()
+}
+
+func (c *connProfile) burst() bool {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	return c.want == connBurst
+}
+
+// kick sends the profile wanted if it isn't the one last asked for.
+// Called with c.lock held.
+func (c *connProfile) kick() {
+	if c.sending || (c.askedOnce && c.asked == c.want) {
+		return
+	}
+	c.sending = true
+	want := c.want
+	go func() {
+		err := c.u.updateConn(connProfiles[want])
+		c.lock.Lock()
+		defer c.lock.Unlock()
+		c.sending = false
+		if err != nil {
+			// Left for the next poll, the link may have been busy with
+			// an update of the brick's own
+			if c.failures++; c.failures == 1 {
+				log.Printf("Connection update: %s", err)
+			}
+			return
+		}
+		c.failures = 0
+		c.asked, c.askedOnce = want, true
+		c.kick()
+	}()
+}
+
+// linkBusy notes activity needing a short interval as of now
+func (p *blePeriph) linkBusy() {
+	if p.connProfile != nil {
+		p.connProfile.activity(p.now())
+	}
+}
+
+// pollLink moves an idle link back off burst and records what the link
+// runs with
+func (p *blePeriph) pollLink(now time.Time) {
+	if p.connProfile == nil {
+		return
+	}
+	p.connProfile.poll(now)
+	burst := int64(0)
+	if p.connProfile.burst() {
+		burst = 1
+	}
+	atomic.StoreInt64(&p.metrics.connBurst, burst)
+	if params, ok := p.connProfile.u.linkParams(); ok {
+		p.metrics.setConnParams(params)
+	}
+}
+
+// parseLinkStatus is the parameters from the brick's link
+// characteristic, after its profile and whether that was forced
+func parseLinkStatus(b []byte) (connParams, error) {
+	if len(b) < linkStatusLen {
+		return connParams{}, fmt.Errorf("short link status (%d bytes)", len(b))
+	}
+	interval := binary.LittleEndian.Uint16(b[2:])
+	return connParams{minInterval: interval, maxInterval: interval,
+		latency: binary.LittleEndian.Uint16(b[4:]),
+		timeout: binary.LittleEndian.Uint16(b[6:]),
+	}, nil
+}
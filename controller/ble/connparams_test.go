@@ -0,0 +1,72 @@
+package ble
+
+import (
+	"bytes"
+	"sync"
+	"testing"
+	"time"
+)
+
+type updaterPeriph struct {
+	asked []connParams
+	done  chan struct{}
+
+	lock sync.Mutex
+}
+
+func (u *updaterPeriph) updateConn(p connParams) error {
+	u.lock.Lock()
+	u.asked = append(u.asked, p)
+	u.lock.Unlock()
+	u.done <- struct{}{}
+	return nil
+}
+
+func (u *updaterPeriph) linkParams() (connParams, bool) { return connParams{}, true }
+
+func TestConnProfile(t *testing.T) {
+	u := &updaterPeriph{done: make(chan struct{}, 4)}
+	c := newConnProfile(u)
+	now := time.Now()
+	c.activity(now)
+	<-u.done
+	c.activity(now.Add(time.Second))
+	c.poll(now.Add(connBurstHold))
+	if !c.burst() {
+		t.Error("off burst within the hold of the last activity")
+	}
+	c.poll(now.Add(connBurstHold + time.Second))
+	<-u.done
+	c.poll(now.Add(2 * connBurstHold))
+	select {
+	case <-u.done:
+		t.Error("idle asked for again")
+	case <-time.After(10 * time.Millisecond):
+	}
+	u.lock.Lock()
+	defer u.lock.Unlock()
+	if len(u.asked) != 2 || u.asked[0] != connProfiles[connBurst] || u.asked[1] != connProfiles[connIdle] {
+		t.Errorf("asked for %+v", u.asked)
+	}
+}
+
+func TestConnParamsCodec(t *testing.T) {
+	cmd := sdConnUpdateCmd(1, connProfiles[connIdle])
+	if want := []byte{sdOpConnUpdate, 1, 0, sdPresent, 0x90, 1, 0x20, 3, 4, 0, 0xb0, 4}; !bytes.Equal(cmd, want) {
+		t.Errorf("update % x, want % x", cmd, want)
+	}
+	e, err := sdParseEvent([]byte{sdEvtConnUpdate, 0, 1, 0, 24, 0, 24, 0, 0, 0, 0x90, 1})
+	if err != nil || e.params.interval() != 30*time.Millisecond || e.params.supervision() != 4*time.Second {
+		t.Errorf("update event %+v, %v", e.params, err)
+	}
+	p, err := parseLinkStatus([]byte{2, 1, 0x20, 3, 4, 0, 0xb0, 4})
+	if err != nil || p.interval() != time.Second || p.latency != 4 {
+		t.Errorf("link status %+v, %v", p, err)
+	}
+	var m brickMetrics
+	m.setConnParams(connProfiles[connBurst])
+	m.setConnParams(connProfiles[connIdle])
+	if m.connUpdates != 1 || time.Duration(m.connInterval) != time.Second {
+		t.Errorf("%d updates to %v", m.connUpdates, time.Duration(m.connInterval))
+	}
+}
@@ -0,0 +1,56 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// The firmware's crash log (crash.h): a total count, then the newest
+// records first.
+const (
+	crashRecordLen = 20
+
+	crashHardFault = 0xFA000001
+	crashWatchdog  = 0xFA000002
+)
+
+type crashRecord struct {
+	err      uint32
+	line     uint16
+	fileHash uint16
+	pc       uint32
+	lr       uint32
+	uptime   uint32
+}
+
+func (r crashRecord) String() string {
+	switch r.err {
+	case crashHardFault:
+		return fmt.Sprintf("hard fault at pc 0x%08x lr 0x%08x, %ds after boot", r.pc, r.lr, r.uptime)
+	case crashWatchdog:
+		return "watchdog reset"
+	}
+	return fmt.Sprintf("error 0x%x at pc 0x%08x (line %d, file %04x), %ds after boot",
+		r.err, r.pc, r.line, r.fileHash, r.uptime)
+}
+
+// parseCrashLog returns the total crashes since power on and the records
+// that were kept.
+func parseCrashLog(b []byte) (int, []crashRecord, error) {
+	if len(b) < 2 || (len(b)-2)%crashRecordLen != 0 {
+		return 0, nil, fmt.Errorf("bad crash log length %d", len(b))
+	}
+	total := int(binary.LittleEndian.Uint16(b))
+	var recs []crashRecord
+	for r := b[2:]; len(r) > 0; r = r[crashRecordLen:] {
+		recs = append(recs, crashRecord{
+			err:      binary.LittleEndian.Uint32(r[0:]),
+			line:     binary.LittleEndian.Uint16(r[4:]),
+			fileHash: binary.LittleEndian.Uint16(r[6:]),
+			pc:       binary.LittleEndian.Uint32(r[8:]),
+			lr:       binary.LittleEndian.Uint32(r[12:]),
+			uptime:   binary.LittleEndian.Uint32(r[16:]),
+		})
+	}
+	return total, recs, nil
+}
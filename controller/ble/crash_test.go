@@ -0,0 +1,30 @@
+package ble
+
+import "testing"
+
+func TestParseCrashLog(t *testing.T) {
+	b := []byte{
+		5, 0,
+		0x01, 0x00, 0x00, 0xFA, 0, 0, 0, 0, 0x10, 0x32, 0x01, 0x00, 0x21, 0x43, 0x01, 0x00, 90, 0, 0, 0,
+		0x04, 0, 0, 0, 0x2A, 0, 0xCD, 0xAB, 0x00, 0x10, 0x02, 0x00, 0, 0, 0, 0, 0x10, 0x0E, 0, 0,
+	}
+	total, recs, err := parseCrashLog(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if total != 5 || len(recs) != 2 {
+		t.Fatalf("total %d, %d records", total, len(recs))
+	}
+	want := crashRecord{err: crashHardFault, pc: 0x13210, lr: 0x14321, uptime: 90}
+	if recs[0] != want {
+		t.Errorf("got %+v, want %+v", recs[0], want)
+	}
+	want = crashRecord{err: 4, line: 42, fileHash: 0xABCD, pc: 0x21000, uptime: 3600}
+	if recs[1] != want {
+		t.Errorf("got %+v, want %+v", recs[1], want)
+	}
+
+	if _, _, err := parseCrashLog(b[:10]); err == nil {
+		t.Error("partial record accepted")
+	}
+}
@@ -0,0 +1,78 @@
+package ble
+
+import (
+	"encoding/binary"
+	"time"
+)
+
+// The schedule's curve worked out the way the firmware does it, in
+// integers as schedule.h specifies, so the controller knows to the level
+// what a brick running its schedule shows. Both are held to the vectors
+// in testdata/curve.json.
+
+const scheduleSecondsPerDay = scheduleMinutes * 60
+
+// levelsAt is each channel's level t seconds into the day, from the
+// points as stored
+func (s *schedule) levelsAt(t uint32) []int {
+	return curveAt(s.data, s.count, s.channels, t)
+}
+
+// curveAt evaluates count points of channels each, laid out as
+// schedule.h stores them, t seconds into the day
+func curveAt(data []byte, count, channels int, t uint32) []int {
+	pointLen := 2 + 2*channels
+	minute := func(i int) int32 { return int32(binary.LittleEndian.Uint16(data[i*pointLen:])) }
+	level := func(i, channel int) int32 {
+		return int32(binary.LittleEndian.Uint16(data[i*pointLen+2+2*channel:]))
+	}
+
+	after := 0
+	for after < count && uint32(minute(after))*60 <= t {
+		after++
+	}
+	a := after % count
+	b := (after + count - 1) % count
+	span := (minute(a)*60 - minute(b)*60 + scheduleSecondsPerDay) % scheduleSecondsPerDay
+	elapsed := (int32(t) - minute(b)*60 + scheduleSecondsPerDay) % scheduleSecondsPerDay
+
+	levels := make([]int, channels)
+	for i := range levels {
+		lb, la := level(b, i), level(a, i)
+		// A single point holds all day
+		if span == 0 {
+			levels[i] = int(lb)
+		} else {
+			// Go's division truncates toward zero, as C's does
+			levels[i] = int(lb + (la-lb)*elapsed/span)
+		}
+	}
+	return levels
+}
+
+// blendLevels is the crossfade from before to after, done of total
+// seconds in, on the channels both have
+func blendLevels(before, after []int, done, total uint32) []int {
+	levels := append([]int(nil), after...)
+	if done >= total {
+		return levels
+	}
+	for i := 0; i < len(before) && i < len(levels); i++ {
+		lb := int32(before[i])
+		levels[i] = int(lb + (int32(levels[i])-lb)*int32(done)/int32(total))
+	}
+	return levels
+}
+
+// secondOfDay is now as the brick's clock has it, synced to loc
+func secondOfDay(now time.Time, loc *time.Location) uint32 {
+	now = now.In(loc)
+	return uint32(now.Hour()*3600 + now.Minute()*60 + now.Second())
+}
+
+// outputAt is what a brick running s shows at now in loc. Each step
+// fades linearly to where the curve will be when it lands, so between
+// points the output follows the curve, to the level as each step lands.
+func (s *schedule) outputAt(now time.Time, loc *time.Location) []int {
+	return s.levelsAt(secondOfDay(now, loc))
+}
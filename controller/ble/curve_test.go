@@ -0,0 +1,87 @@
+package ble
+
+import (
+	"encoding/json"
+	"io/ioutil"
+	"reflect"
+	"testing"
+	"time"
+)
+
+// The vectors the firmware's schedule.c is held to as well
+type curveVectors struct {
+	Curves []struct {
+		Name   string
+		Points []struct {
+			Minute int
+			Levels []int
+		}
+		At []struct {
+			T      uint32
+			Levels []int
+		}
+	}
+	Blends []struct {
+		Before, After []int
+		Done, Total   uint32
+		Levels        []int
+	}
+}
+
+func TestCurveVectors(t *testing.T) {
+	b, err := ioutil.ReadFile("testdata/curve.json")
+	if err != nil {
+		t.Fatal(err)
+	}
+	var v curveVectors
+	if err := json.Unmarshal(b, &v); err != nil {
+		t.Fatal(err)
+	}
+	for _, c := range v.Curves {
+		channels := len(c.Points[0].Levels)
+		var data []byte
+		for _, p := range c.Points {
+			data = append(data, byte(p.Minute), byte(p.Minute>>8))
+			for _, l := range p.Levels {
+				data = append(data, byte(l), byte(l>>8))
+			}
+		}
+		for _, at := range c.At {
+			if l := curveAt(data, len(c.Points), channels, at.T); !reflect.DeepEqual(l, at.Levels) {
+				t.Errorf("%s at %d: %v, want %v", c.Name, at.T, l, at.Levels)
+			}
+		}
+	}
+	for _, bl := range v.Blends {
+		if l := blendLevels(bl.Before, bl.After, bl.Done, bl.Total); !reflect.DeepEqual(l, bl.Levels) {
+			t.Errorf("%v to %v at %d/%d: %v, want %v", bl.Before, bl.After, bl.Done, bl.Total, l, bl.Levels)
+		}
+	}
+}
+
+func TestSchedulePredict(t *testing.T) {
+	s, _ := newSchedule(maintPoints)
+	nine := time.Date(2020, 1, 1, 9, 0, 0, 0, time.UTC)
+	if l := s.outputAt(nine, time.UTC); l[0] != 2000 || l[1] != 1000 {
+		t.Errorf("%v at 9:00", l)
+	}
+	if _, err := newSchedule([]SchedulePoint{{Percents: []float64{110}}}); err == nil {
+		t.Error("level past the firmware's accepted")
+	}
+
+	var c levelCache
+	now := time.Now()
+	c.sent([]int{0, 0, 0, 0, 0, 0, 0, 70}, 1)
+	c.predict(s.outputAt(nine, time.UTC), defaultBrickChannels, now)
+	if c.current(1, now) {
+		t.Error("predicted levels taken for a frame sent")
+	}
+	if m := c.changed([]int{2000, 1001, 0, 0, 0, 0, 0, 70}, now); m != 0x02 {
+		t.Errorf("mask %#x, want only the channel off the schedule", m)
+	}
+	c.invalidate()
+	c.predict([]int{1, 2}, defaultBrickChannels, now)
+	if !c.refreshDue(now) {
+		t.Error("channels the schedule doesn't drive taken as known")
+	}
+}
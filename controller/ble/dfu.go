@@ -0,0 +1,372 @@
+package ble
+
+import (
+	"archive/zip"
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"github.com/paypal/gatt"
+	"io/ioutil"
+	"log"
+	"time"
+)
+
+// Over the air updates through the SDK's legacy DFU service (ble_dfu.h).
+// The application hands over to the dual bank bootloader, which takes the
+// image into bank 1 while bank 0 stays valid, so a failed transfer falls
+// back to the running firmware.
+const (
+	dfuControlChar = "000015311212efde1523785feabcd123"
+	dfuPacketChar  = "000015321212efde1523785feabcd123"
+
+	// The bootloader's advertised name
+	dfuTargetName = "DfuTarg"
+
+	dfuOpStart          = 0x01
+	dfuOpInit           = 0x02
+	dfuOpReceive        = 0x03
+	dfuOpValidate       = 0x04
+	dfuOpActivate       = 0x05
+	dfuOpReceiptRequest = 0x08
+	dfuOpResponse       = 0x10
+	dfuOpReceipt        = 0x11
+
+	dfuImageApp     = 0x04
+	dfuInitBegin    = 0x00
+	dfuInitComplete = 0x01
+	dfuSuccess      = 0x01
+
+	dfuPacketLen = 20
+	// A receipt every this many packets. The bootloader buffers 16
+	// (hci_mem_pool_internal.h), so the window never outruns its flash
+	// writes but still fills several packets into each connection event.
+	dfuReceiptPackets = 12
+
+	// Starting erases the whole bank
+	dfuStartTimeout    = 30 * time.Second
+	dfuResponseTimeout = 10 * time.Second
+	dfuMaxAttempts     = 3
+	// Bricks updating at once, the rest keep running
+	dfuParallel = 2
+	// Past the bootloader's own timeout (DFU_TIMEOUT_INTERVAL), after
+	// which it is back on the old firmware
+	dfuSlotExpiry = 3 * time.Minute
+)
+
+type firmwareImage struct {
+	bin []byte
+	dat []byte
+}
+
+// The nrfutil package manifest, only the application part is used
+type dfuManifest struct {
+	Manifest struct {
+		Application *struct {
+			BinFile string `json:"bin_file"`
+			DatFile string `json:"dat_file"`
+		} `json:"application"`
+	} `json:"manifest"`
+}
+
+func readZipFile(r *zip.Reader, name string) ([]byte, error) {
+	for _, f := range r.File {
+		if f.Name != name {
+			continue
+		}
+		rc, err := f.Open()
+		if err != nil {
+			return nil, err
+		}
+		defer rc.Close()
+		return ioutil.ReadAll(rc)
+	}
+	return nil, fmt.Errorf("%s missing from the package", name)
+}
+
+func parseFirmwarePackage(r *zip.Reader) (*firmwareImage, error) {
+	b, err := readZipFile(r, "manifest.json")
+	if err != nil {
+		return nil, err
+	}
+	var m dfuManifest
+	if err := json.Unmarshal(b, &m); err != nil {
+		return nil, err
+	}
+	app := m.Manifest.Application
+	if app == nil {
+		return nil, errors.New("package has no application image")
+	}
+	img := &firmwareImage{}
+	if img.bin, err = readZipFile(r, app.BinFile); err != nil {
+		return nil, err
+	}
+	if img.dat, err = readZipFile(r, app.DatFile); err != nil {
+		return nil, err
+	}
+	if len(img.bin) == 0 || len(img.bin)%4 != 0 {
+		return nil, fmt.Errorf("bad image length %d", len(img.bin))
+	}
+	return img, nil
+}
+
+// Load a package built by the firmware's dfu_package target
+func loadFirmware(path string) (*firmwareImage, error) {
+	r, err := zip.OpenReader(path)
+	if err != nil {
+		return nil, err
+	}
+	defer r.Close()
+	return parseFirmwarePackage(&r.Reader)
+}
+
+// Softdevice, bootloader and application lengths, as sent after START
+func dfuStartSizes(appLen int) []byte {
+	b := make([]byte, 12)
+	binary.LittleEndian.PutUint32(b[8:], uint32(appLen))
+	return b
+}
+
+func dfuChunks(b []byte) [][]byte {
+	var cs [][]byte
+	for len(b) > dfuPacketLen {
+		cs = append(cs, b[:dfuPacketLen])
+		b = b[dfuPacketLen:]
+	}
+	if len(b) > 0 {
+		cs = append(cs, b)
+	}
+	return cs
+}
+
+type dfuNotification struct {
+	op uint8
+	// Response: the request and its status
+	request uint8
+	status  uint8
+	// Receipt: bytes taken so far
+	received int
+}
+
+func parseDfuNotification(b []byte) (dfuNotification, error) {
+	var n dfuNotification
+	if len(b) == 0 {
+		return n, errors.New("empty DFU notification")
+	}
+	n.op = b[0]
+	switch {
+	case n.op == dfuOpResponse && len(b) >= 3:
+		n.request, n.status = b[1], b[2]
+	case n.op == dfuOpReceipt && len(b) >= 5:
+		n.received = int(binary.LittleEndian.Uint32(b[1:]))
+	default:
+		return n, fmt.Errorf("bad DFU notification % x", b)
+	}
+	return n, nil
+}
+
+type dfuTransfer struct {
+	p      gatt.Peripheral
+	ctrl   *gatt.Characteristic
+	packet *gatt.Characteristic
+	notes  chan []byte
+	// The adapter's radio time, which packets wait for room on
+	air *airLedger
+}
+
+// control writes b to the control point
+func (t *dfuTransfer) control(b []byte) error {
+	t.air.charge(airBulk, airWrite(len(b), true))
+	return t.p.WriteCharacteristic(t.ctrl, b, false)
+}
+
+// send writes packets together, once the adapter has room for them
+func (t *dfuTransfer) send(packets [][]byte) error {
+	t.air.pace()
+	for _, b := range packets {
+		t.air.charge(airBulk, airWrite(len(b), false))
+	}
+	_, err := pipeline(t.p, t.packet, packets)
+	return err
+}
+
+func (t *dfuTransfer) await(timeout time.Duration) (dfuNotification, error) {
+	select {
+	case b := <-t.notes:
+		return parseDfuNotification(b)
+	case <-time.After(timeout):
+		return dfuNotification{}, errors.New("DFU response timed out")
+	}
+}
+
+func (t *dfuTransfer) request(b []byte, packet []byte, timeout time.Duration) error {
+	if err := t.control(b); err != nil {
+		return err
+	}
+	if packet != nil {
+		if err := t.send([][]byte{packet}); err != nil {
+			return err
+		}
+	}
+	return t.response(b[0], timeout)
+}
+
+func (t *dfuTransfer) response(op uint8, timeout time.Duration) error {
+	for {
+		n, err := t.await(timeout)
+		if err != nil {
+			return err
+		}
+		if n.op != dfuOpResponse {
+			continue
+		}
+		if n.request != op || n.status != dfuSuccess {
+			return fmt.Errorf("DFU request %d failed with status %d", n.request, n.status)
+		}
+		return nil
+	}
+}
+
+// Send the image to a brick in its bootloader, from the top: the SDK's
+// bootloader can't pick up part way through an image.
+func (t *dfuTransfer) run(img *firmwareImage) error {
+	if err := t.p.SetNotifyValue(t.ctrl, func(c *gatt.Characteristic, b []byte, err error) {
+		select {
+		case t.notes <- b:
+		default:
+		}
+	}); err != nil {
+		return err
+	}
+	if err := t.request([]byte{dfuOpStart, dfuImageApp}, dfuStartSizes(len(img.bin)), dfuStartTimeout); err != nil {
+		return err
+	}
+	if err := t.control([]byte{dfuOpInit, dfuInitBegin}); err != nil {
+		return err
+	}
+	if err := t.send(dfuChunks(img.dat)); err != nil {
+		return err
+	}
+	if err := t.request([]byte{dfuOpInit, dfuInitComplete}, nil, dfuResponseTimeout); err != nil {
+		return err
+	}
+	prn := []byte{dfuOpReceiptRequest, byte(dfuReceiptPackets), byte(dfuReceiptPackets >> 8)}
+	if err := t.control(prn); err != nil {
+		return err
+	}
+	if err := t.control([]byte{dfuOpReceive}); err != nil {
+		return err
+	}
+
+	// Each receipt's worth of packets goes out together
+	sent := 0
+	chunks := dfuChunks(img.bin)
+	for len(chunks) > 0 {
+		run := chunks
+		if len(run) > dfuReceiptPackets {
+			run = run[:dfuReceiptPackets]
+		}
+		chunks = chunks[len(run):]
+		if err := t.send(run); err != nil {
+			return err
+		}
+		for _, c := range run {
+			sent += len(c)
+		}
+		if len(run) < dfuReceiptPackets || sent == len(img.bin) {
+			continue
+		}
+		n, err := t.await(dfuResponseTimeout)
+		if err != nil {
+			return err
+		}
+		if n.op != dfuOpReceipt {
+			return fmt.Errorf("DFU request %d failed with status %d", n.request, n.status)
+		}
+		if n.received != sent {
+			return fmt.Errorf("DFU receipt for %d bytes, sent %d", n.received, sent)
+		}
+	}
+	if err := t.response(dfuOpReceive, dfuResponseTimeout); err != nil {
+		return err
+	}
+	if err := t.request([]byte{dfuOpValidate}, nil, dfuResponseTimeout); err != nil {
+		return err
+	}
+	// The bootloader resets into the new image straight away, so the
+	// write can be lost with the link
+	_ = t.control([]byte{dfuOpActivate})
+	return nil
+}
+
+// Ask a brick running the application to restart into its bootloader.
+// The DFU service needs its notifications on before it takes the request.
+func enterBootloader(p *blePeriph) error {
+	if err := p.gp.SetNotifyValue(p.dfuCtrlChar, func(c *gatt.Characteristic, b []byte, err error) {}); err != nil {
+		return err
+	}
+	return p.gp.WriteCharacteristic(p.dfuCtrlChar, []byte{dfuOpStart, dfuImageApp}, false)
+}
+
+func (ble *bleChannel) UpdateFirmware(path string, r FirmwareRollout) error {
+	if err := r.validate(); err != nil {
+		return err
+	}
+	img, err := loadFirmware(path)
+	if err != nil {
+		return err
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.dfu = newDfuUpdate(img, r)
+	ble.dfu.started = ble.clock.Now()
+	log.Printf("Updating bricks to %s (%d bytes), %d first then %d a wave", path, len(img.bin), r.Canary, r.Wave)
+	return nil
+}
+
+func (ble *bleChannel) startUpdate(p *blePeriph) {
+	log.Printf("%s: restarting into the bootloader for an update", p.gp.ID())
+	if err := enterBootloader(p); err != nil {
+		log.Printf("%s: entering the bootloader: %s", p.gp.ID(), err)
+	}
+}
+
+// Run the transfer on a brick connected in its bootloader
+func (ble *bleChannel) updatePeriph(p gatt.Peripheral, ctrl, packet *gatt.Characteristic) {
+	ble.lock.Lock()
+	u := ble.dfu
+	if u == nil || !u.wants(p.ID()) {
+		ble.lock.Unlock()
+		p.Device().CancelConnection(p)
+		return
+	}
+	j := u.job(p.ID())
+	j.attempts++
+	air := ble.airOf(ble.adapterOf(p.Device()))
+	ble.lock.Unlock()
+
+	// The image goes faster on a short interval
+	if cu, ok := p.(connUpdater); ok {
+		if err := cu.updateConn(connProfiles[connBurst]); err != nil {
+			log.Printf("%s: connection update: %s", p.ID(), err)
+		}
+	}
+	start := time.Now()
+	t := &dfuTransfer{p: p, ctrl: ctrl, packet: packet, notes: make(chan []byte, 64), air: air}
+	err := t.run(u.image)
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if err != nil {
+		// Back on the old firmware once the bootloader times out, and
+		// retried from there
+		j.failed = true
+		log.Printf("%s: update attempt %d failed: %s", p.ID(), j.attempts, err)
+		p.Device().CancelConnection(p)
+		return
+	}
+	took := time.Since(start)
+	rate := u.finished(p.ID(), len(u.image.bin)+len(u.image.dat), took, time.Now())
+	ble.metrics.brick(p.ID()).setDfuRate(rate)
+	log.Printf("%s: updated in %v at %.0f B/s", p.ID(), took.Truncate(time.Second), rate)
+}
@@ -0,0 +1,101 @@
+package ble
+
+import (
+	"archive/zip"
+	"bytes"
+	"testing"
+	"time"
+)
+
+func testPackage(t *testing.T, files map[string]string) *zip.Reader {
+	var buf bytes.Buffer
+	w := zip.NewWriter(&buf)
+	for name, body := range files {
+		f, err := w.Create(name)
+		if err != nil {
+			t.Fatal(err)
+		}
+		f.Write([]byte(body))
+	}
+	if err := w.Close(); err != nil {
+		t.Fatal(err)
+	}
+	r, err := zip.NewReader(bytes.NewReader(buf.Bytes()), int64(buf.Len()))
+	if err != nil {
+		t.Fatal(err)
+	}
+	return r
+}
+
+func TestParseFirmwarePackage(t *testing.T) {
+	manifest := `{"manifest": {"application": {"bin_file": "app.bin", "dat_file": "app.dat"}}}`
+	img, err := parseFirmwarePackage(testPackage(t, map[string]string{
+		"manifest.json": manifest,
+		"app.bin":       "12345678",
+		"app.dat":       "init",
+	}))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if string(img.bin) != "12345678" || string(img.dat) != "init" {
+		t.Errorf("got %q, %q", img.bin, img.dat)
+	}
+
+	if _, err := parseFirmwarePackage(testPackage(t, map[string]string{
+		"manifest.json": manifest,
+		"app.bin":       "123456",
+		"app.dat":       "init",
+	})); err == nil {
+		t.Error("unaligned image accepted")
+	}
+	if _, err := parseFirmwarePackage(testPackage(t, map[string]string{
+		"manifest.json": `{"manifest": {"bootloader": {}}}`,
+	})); err == nil {
+		t.Error("package without an application accepted")
+	}
+}
+
+func TestDfuPackets(t *testing.T) {
+	if b := dfuStartSizes(0x12345); !bytes.Equal(b, []byte{0, 0, 0, 0, 0, 0, 0, 0, 0x45, 0x23, 0x01, 0}) {
+		t.Errorf("start sizes % x", b)
+	}
+	cs := dfuChunks(make([]byte, 2*dfuPacketLen+4))
+	if len(cs) != 3 || len(cs[0]) != dfuPacketLen || len(cs[2]) != 4 {
+		t.Errorf("chunked into %d", len(cs))
+	}
+}
+
+func TestParseDfuNotification(t *testing.T) {
+	n, err := parseDfuNotification([]byte{0x10, 0x01, 0x06})
+	if err != nil || n.op != dfuOpResponse || n.request != dfuOpStart || n.status != 6 {
+		t.Errorf("response %+v, %v", n, err)
+	}
+	n, err = parseDfuNotification([]byte{0x11, 0x40, 0x01, 0, 0})
+	if err != nil || n.op != dfuOpReceipt || n.received != 320 {
+		t.Errorf("receipt %+v, %v", n, err)
+	}
+	if _, err := parseDfuNotification([]byte{0x10, 0x01}); err == nil {
+		t.Error("short response accepted")
+	}
+}
+
+func TestDfuSlots(t *testing.T) {
+	now := time.Now()
+	u := newDfuUpdate(nil, FirmwareRollout{Canary: 10, PerAdapter: dfuParallel})
+	for i, id := range []string{"a", "b", "c"} {
+		if got := u.claim(id, 0, now); got != (i < dfuParallel) {
+			t.Errorf("claim %s: %v", id, got)
+		}
+	}
+	if !u.wants("a") || u.wants("c") {
+		t.Error("bootloader wanted for the wrong brick")
+	}
+	if !u.claim("d", 1, now) {
+		t.Error("second adapter held up by the first")
+	}
+	u.jobs["a"].done = true
+	u.release("a")
+	if !u.claim("c", 0, now) || u.claim("a", 0, now) {
+		t.Error("slot not handed on")
+	}
+}
@@ -0,0 +1,92 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"time"
+)
+
+// The brick's debug log (the firmware's dlog.h): records of an ID and
+// two arguments, turned into text here so the image carries no format
+// strings.
+const (
+	dlogHeaderLen = 4
+	dlogRecordLen = 8
+)
+
+type dlogRecord struct {
+	seq    uint32
+	uptime time.Duration
+	id     uint8
+	a      uint8
+	b      uint16
+}
+
+// Indexed by ID, append only like the firmware's dlog_id_t
+var dlogFormats = []func(a uint8, b uint16) string{
+	1: func(a uint8, b uint16) string {
+		return fmt.Sprintf("boot, reset reason 0x%05x", uint32(b)<<16|uint32(a))
+	},
+	2: func(a uint8, b uint16) string {
+		return fmt.Sprintf("connected at %.2f ms, %d links", float64(b)*1.25, a)
+	},
+	3: func(a uint8, b uint16) string { return fmt.Sprintf("disconnected for 0x%02x, %d links left", a, b) },
+	4: func(a uint8, b uint16) string { return fmt.Sprintf("TWI job failed, class %d to 0x%02x", a, b) },
+	5: func(a uint8, b uint16) string { return fmt.Sprintf("supply shed at %d mV", b) },
+	6: func(a uint8, b uint16) string { return fmt.Sprintf("supply restored at %d mV", b) },
+	7: func(a uint8, b uint16) string {
+		if b != 0 {
+			return "lease lapsed, schedule took over"
+		}
+		return fmt.Sprintf("lease lapsed, fallback scene %d", a)
+	},
+}
+
+func (r dlogRecord) String() string {
+	if int(r.id) < len(dlogFormats) && dlogFormats[r.id] != nil {
+		return fmt.Sprintf("%v: %s", r.uptime, dlogFormats[r.id](r.a, r.b))
+	}
+	return fmt.Sprintf("%v: event %d (%d, %d)", r.uptime, r.id, r.a, r.b)
+}
+
+func parseDebugLog(b []byte) ([]dlogRecord, error) {
+	if len(b) < dlogHeaderLen || (len(b)-dlogHeaderLen)%dlogRecordLen != 0 {
+		return nil, fmt.Errorf("debug log is %d bytes", len(b))
+	}
+	seq := binary.LittleEndian.Uint32(b)
+	var recs []dlogRecord
+	for off := dlogHeaderLen; off < len(b); off += dlogRecordLen {
+		recs = append(recs, dlogRecord{
+			seq:    seq,
+			uptime: time.Duration(binary.LittleEndian.Uint32(b[off:])) * time.Millisecond,
+			id:     b[off+4],
+			a:      b[off+5],
+			b:      binary.LittleEndian.Uint16(b[off+6:]),
+		})
+		seq++
+	}
+	return recs, nil
+}
+
+// Log what the brick has recorded since the last read
+func (p *blePeriph) logDebugLog() error {
+	var body [4]byte
+	binary.LittleEndian.PutUint32(body[:], p.dlogNext)
+	b, err := p.bulk.request(bulkCmdDebugLog, body[:], bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	recs, err := parseDebugLog(b)
+	if err != nil {
+		return err
+	}
+	if len(recs) > 0 && recs[0].seq > p.dlogNext && p.dlogNext != 0 {
+		log.Printf("%s: debug: %d records lost", p.gp.ID(), recs[0].seq-p.dlogNext)
+	}
+	for _, r := range recs {
+		log.Printf("%s: debug: %s", p.gp.ID(), r)
+		p.dlogNext = r.seq + 1
+	}
+	return nil
+}
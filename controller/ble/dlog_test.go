@@ -0,0 +1,33 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+	"time"
+)
+
+func TestParseDebugLog(t *testing.T) {
+	b := make([]byte, dlogHeaderLen+2*dlogRecordLen)
+	binary.LittleEndian.PutUint32(b, 40)
+	binary.LittleEndian.PutUint32(b[4:], 1500)
+	b[8], b[9] = 3, 0x08
+	binary.LittleEndian.PutUint16(b[10:], 0)
+	binary.LittleEndian.PutUint32(b[12:], 2000)
+	b[16] = 99
+	recs, err := parseDebugLog(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(recs) != 2 || recs[0].seq != 40 || recs[1].seq != 41 || recs[0].uptime != 1500*time.Millisecond {
+		t.Fatalf("%+v", recs)
+	}
+	if s := recs[0].String(); s != "1.5s: disconnected for 0x08, 0 links left" {
+		t.Errorf("decoded %q", s)
+	}
+	if s := recs[1].String(); s != "2s: event 99 (0, 0)" {
+		t.Errorf("unknown ID %q", s)
+	}
+	if _, err := parseDebugLog(b[:len(b)-1]); err == nil {
+		t.Error("torn record accepted")
+	}
+}
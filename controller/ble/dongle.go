@@ -0,0 +1,65 @@
+package ble
+
+import (
+	"io"
+	"os"
+	"sync"
+)
+
+// Side channel to the bricks' esb_rx.h through a USB dongle running an
+// ESB transmitter. The dongle takes SLIP framed payloads over its serial
+// port and sends each as no-ack packets, repeated for at least the
+// bricks' listen period. Payloads are broadcaster frames, so the group,
+// sequence and MAC are shared with the advertised ones.
+const (
+	esbMaxPayload = 32
+	// Header and MAC leave room for eight channels
+	esbMaxChannels = (esbMaxPayload - broadcastHeaderLen - broadcastMacLen) / 2
+
+	slipEnd    = 0xc0
+	slipEsc    = 0xdb
+	slipEscEnd = 0xdc
+	slipEscEsc = 0xdd
+)
+
+// slipFrame escapes b and delimits it at both ends, so the dongle can
+// pick up mid-stream
+func slipFrame(b []byte) []byte {
+	out := []byte{slipEnd}
+	for _, c := range b {
+		switch c {
+		case slipEnd:
+			out = append(out, slipEsc, slipEscEnd)
+		case slipEsc:
+			out = append(out, slipEsc, slipEscEsc)
+		default:
+			out = append(out, c)
+		}
+	}
+	return append(out, slipEnd)
+}
+
+type dongle struct {
+	w io.Writer
+
+	lock sync.Mutex
+}
+
+func openDongle(path string) (*dongle, error) {
+	f, err := os.OpenFile(path, os.O_WRONLY, 0)
+	if err != nil {
+		return nil, err
+	}
+	return &dongle{w: f}, nil
+}
+
+func (d *dongle) send(payloads [][]byte) error {
+	d.lock.Lock()
+	defer d.lock.Unlock()
+	for _, p := range payloads {
+		if _, err := d.w.Write(slipFrame(p)); err != nil {
+			return err
+		}
+	}
+	return nil
+}
@@ -0,0 +1,31 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestSlipFrame(t *testing.T) {
+	got := slipFrame([]byte{1, slipEnd, 2, slipEsc})
+	want := []byte{slipEnd, 1, slipEsc, slipEscEnd, 2, slipEsc, slipEscEsc, slipEnd}
+	if !bytes.Equal(got, want) {
+		t.Errorf("framed % x", got)
+	}
+}
+
+func TestDongleFrames(t *testing.T) {
+	b, err := newBroadcaster(3, bytes.Repeat([]byte{0x11}, 16))
+	if err != nil {
+		t.Fatal(err)
+	}
+	fs := b.pack(make([]int, 8), 1000, esbMaxChannels)
+	if len(fs) != 1 || len(fs[0]) > esbMaxPayload || fs[0][6] != 0xff {
+		t.Errorf("packed into %d, % x", len(fs), fs)
+	}
+
+	var buf bytes.Buffer
+	d := &dongle{w: &buf}
+	if err := d.send(fs); err != nil || buf.Len() < len(fs[0])+2 {
+		t.Errorf("sent %d bytes, %v", buf.Len(), err)
+	}
+}
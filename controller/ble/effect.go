@@ -0,0 +1,85 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"math/rand"
+	"time"
+)
+
+// Weather run on the bricks themselves (the firmware's effect.h):
+// clouds dimming the outputs as they pass, and in a storm lightning.
+// It runs at tick rate on each brick, from a seed and start every brick
+// shares, so they keep together with nothing more sent.
+type Weather struct {
+	// "clouds", "storm", or "off" to stop
+	Kind string `json:"kind"`
+	// Picked at random when 0
+	Seed int `json:"seed,omitempty"`
+	// Percent the thickest cloud dims the outputs
+	CloudDepth int `json:"cloud_depth"`
+	// Seconds a cloud takes to pass, 1-255
+	CloudSeconds int `json:"cloud_seconds"`
+	// Average lightning strikes a minute in a storm
+	StrikesPerMinute int `json:"strikes_per_minute,omitempty"`
+	// Seconds to run for, 0 until stopped
+	Seconds int `json:"seconds,omitempty"`
+}
+
+var weatherKinds = map[string]uint8{"off": 0, "clouds": 1, "storm": 2}
+
+const weatherMaxStrikes = 60
+
+// record checks w and lays it out as a command, seeded from rnd if it
+// has no seed of its own
+func (w Weather) record(rnd *rand.Rand) (cmdRecord, error) {
+	k, ok := weatherKinds[w.Kind]
+	if !ok {
+		return cmdRecord{}, fmt.Errorf("unknown weather %q", w.Kind)
+	}
+	if k != 0 {
+		switch {
+		case w.CloudDepth < 0 || w.CloudDepth > 100:
+			return cmdRecord{}, fmt.Errorf("cloud depth must be 0-100%%, got %d", w.CloudDepth)
+		case w.CloudSeconds < 1 || w.CloudSeconds > 0xff:
+			return cmdRecord{}, fmt.Errorf("clouds must take 1-255 s to pass, got %d", w.CloudSeconds)
+		case w.StrikesPerMinute < 0 || w.StrikesPerMinute > weatherMaxStrikes:
+			return cmdRecord{}, fmt.Errorf("lightning must strike 0-%d times a minute, got %d", weatherMaxStrikes, w.StrikesPerMinute)
+		case w.Seconds < 0 || w.Seconds > 0xffff:
+			return cmdRecord{}, fmt.Errorf("weather must run 0-65535 s, got %d", w.Seconds)
+		case w.Seed < 0 || w.Seed > 0xffff:
+			return cmdRecord{}, fmt.Errorf("weather seed must be 0-65535, got %d", w.Seed)
+		}
+	}
+	seed := w.Seed
+	if seed == 0 {
+		seed = 1 + rnd.Intn(0xffff)
+	}
+	return cmdRecord{op: cmdOpEffect, value: []byte{k, byte(seed), byte(seed >> 8), byte(w.CloudDepth),
+		byte(w.CloudSeconds), byte(w.StrikesPerMinute), byte(w.Seconds), byte(w.Seconds >> 8)}}, nil
+}
+
+func (ble *bleChannel) StartWeather(w Weather) error {
+	r, err := w.record(rand.New(rand.NewSource(time.Now().UnixNano())))
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	now := ble.clock.Now()
+	syncAt := now.Add(syncLead)
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		records := []cmdRecord{r}
+		if at, ok := p.sync.at(syncAt, now); ok {
+			records = commandAt(at, records)
+		}
+		if err := p.sendCommands(records...); err != nil {
+			log.Printf("%s: weather: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
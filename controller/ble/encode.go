@@ -0,0 +1,100 @@
+package ble
+
+import (
+	"sync"
+	"time"
+)
+
+// frameEncodings is one state's levels and frame writes as encoded for
+// the bricks it goes to: the first writer needing an encoding makes it
+// and the rest share it. Every brick in a zone takes the same state, so
+// a frame is scaled and encoded once per zone rather than once per
+// brick, and only a brick differing from the others in width, channels
+// changed, fade or write path encodes its own alongside. Nothing is
+// changed once made, the writers hold the slices as they are.
+type frameEncodings struct {
+	encoded map[encodingKey]interface{}
+
+	lock sync.Mutex
+}
+
+type encodingKind int
+
+const (
+	encodeLevels encodingKind = iota
+	encodePacked
+	encodeFrames
+	encodeFades
+	encodeLevelWrites
+	encodeLegacyWrites
+)
+
+// encodingKey tells apart what different bricks make of one state
+type encodingKey struct {
+	kind encodingKind
+	mask uint16
+	// Channels, and the top level or the fade in ms
+	n, arg int
+}
+
+func newFrameEncodings() *frameEncodings {
+	return &frameEncodings{encoded: make(map[encodingKey]interface{})}
+}
+
+// encoding is s's encoding under k, made by encode the first time.
+// States without encodings, as tests make them, encode every time.
+func (s *ledState) encoding(k encodingKey, encode func() interface{}) interface{} {
+	e := s.enc
+	if e == nil {
+		return encode()
+	}
+	e.lock.Lock()
+	defer e.lock.Unlock()
+	if v, ok := e.encoded[k]; ok {
+		return v
+	}
+	v := encode()
+	e.encoded[k] = v
+	return v
+}
+
+// sharedLevels is levels(max, n), made once for every brick taking s
+func (s *ledState) sharedLevels(max, n int) []int {
+	return s.encoding(encodingKey{kind: encodeLevels, n: n, arg: max}, func() interface{} {
+		return s.levels(max, n)
+	}).([]int)
+}
+
+// packedFrame is packedFrame of levels, s's own, for every brick
+// taking s with the same mask and fade
+func (s *ledState) packedFrame(mask uint16, levels []int, fade time.Duration) []cmdRecord {
+	k := encodingKey{kind: encodePacked, mask: mask, n: len(levels), arg: int(fade / time.Millisecond)}
+	return s.encoding(k, func() interface{} {
+		return packedFrame(mask, levels, fade)
+	}).([]cmdRecord)
+}
+
+func (s *ledState) frameWrites(mask uint16, levels []int, fade time.Duration) [][]byte {
+	k := encodingKey{kind: encodeFrames, mask: mask, n: len(levels), arg: int(fade / time.Millisecond)}
+	return s.encoding(k, func() interface{} {
+		return frameWrites(mask, levels, fade)
+	}).([][]byte)
+}
+
+func (s *ledState) fadeWrites(mask uint16, levels []int, fade time.Duration) [][]byte {
+	k := encodingKey{kind: encodeFades, mask: mask, n: len(levels), arg: int(fade / time.Millisecond)}
+	return s.encoding(k, func() interface{} {
+		return fadeWrites(mask, levels, fade)
+	}).([][]byte)
+}
+
+// levelWrites are the per channel writes of levels, 12 bit when wide
+func (s *ledState) levelWrites(mask uint16, levels []int, wide bool) [][]byte {
+	k := encodingKey{kind: encodeLegacyWrites, mask: mask, n: len(levels)}
+	if wide {
+		k.kind = encodeLevelWrites
+	}
+	return s.encoding(k, func() interface{} {
+		return levelWrites(mask, levels, wide)
+	}).([][]byte)
+}
@@ -0,0 +1,55 @@
+package ble
+
+import (
+	"fmt"
+	"testing"
+	"time"
+)
+
+func TestSharedEncodings(t *testing.T) {
+	s := newLedState(&channelFrame{percents: [frameChannels]float64{0: 100, 3: 50}}, time.Time{})
+	a := s.sharedLevels(ledMaxLevel, defaultBrickChannels)
+	if b := s.sharedLevels(ledMaxLevel, defaultBrickChannels); &a[0] != &b[0] {
+		t.Error("levels encoded again for a second brick")
+	}
+	if wide := s.sharedLevels(ledMaxLevel, frameChannels); len(wide) != frameChannels || &wide[0] == &a[0] {
+		t.Error("a wider brick given the narrow levels")
+	}
+
+	rs := s.packedFrame(0x00ff, a, writeInterval)
+	if again := s.packedFrame(0x00ff, a, writeInterval); &again[0] != &rs[0] {
+		t.Error("packed frame encoded again for a second brick")
+	}
+	// Bricks differing in what moved or how long they fade get their own
+	if other := s.packedFrame(0x0001, a, writeInterval); &other[0] == &rs[0] || len(other[0].value) == len(rs[0].value) {
+		t.Error("one channel changed sent the whole frame")
+	}
+	if slow := s.packedFrame(0x00ff, a, 2*writeInterval); &slow[0] == &rs[0] {
+		t.Error("a slower brick given the faster one's fade")
+	}
+	if fmt.Sprint(rs) != fmt.Sprint(packedFrame(0x00ff, a, writeInterval)) {
+		t.Errorf("shared frame %v differs", rs)
+	}
+
+	// A boosted copy has levels of its own
+	b := s.boosted(0.5).sharedLevels(ledMaxLevel, defaultBrickChannels)
+	if b[0] == a[0] {
+		t.Errorf("boosted levels %v shared with %v", b, a)
+	}
+}
+
+// A zone's frame going out to many bricks with the same changes
+func BenchmarkSharedEncode(b *testing.B) {
+	for _, bricks := range []int{1, 16} {
+		b.Run(fmt.Sprintf("bricks=%d", bricks), func(b *testing.B) {
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				s := newLedState(&channelFrame{percents: [frameChannels]float64{0: float64(i % 100)}}, time.Time{})
+				for j := 0; j < bricks; j++ {
+					levels := s.sharedLevels(ledMaxLevel, defaultBrickChannels)
+					_ = s.packedFrame(0x00ff, levels, writeInterval)
+				}
+			}
+		})
+	}
+}
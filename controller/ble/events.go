@@ -0,0 +1,91 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"time"
+)
+
+// The firmware's error event log (error_handlers.h): the sequence number
+// of the first event, onsets per error, then events oldest first. Newer
+// firmware knows more errors, and as events are whole 8 bytes what's
+// left over after the sequence number is the onsets: two errors for the
+// oldest logs, three since the fan wear warning.
+const (
+	errorEventLen = 8
+	errorCount    = 2
+	errorMaxCount = 3
+
+	errorEventRaised  = 1
+	errorEventCleared = 2
+
+	// How often connected peripherals are drained
+	eventDrainInterval = 5 * time.Minute
+)
+
+var errorNames = []string{"fan", "temperature", "fan wear"}
+
+// Error bits that are warnings, leaving the outputs running
+const errorWarnings = 1 << 2
+
+type errorEvent struct {
+	seq    uint32
+	uptime uint32
+	err    int
+	kind   int
+	value  int
+}
+
+func (e errorEvent) String() string {
+	name := fmt.Sprintf("error %d", e.err)
+	if e.err < len(errorNames) {
+		name = errorNames[e.err]
+	}
+	switch e.kind {
+	case errorEventRaised:
+		return fmt.Sprintf("%s error raised (%d)", name, e.value)
+	case errorEventCleared:
+		return fmt.Sprintf("%s error cleared after %ds", name, e.value)
+	}
+	return fmt.Sprintf("%s event %d (%d)", name, e.kind, e.value)
+}
+
+type errorLog struct {
+	// Onsets per error since the peripheral booted
+	onsets []int
+	events []errorEvent
+	// Sequence number to acknowledge once the events are handled
+	next uint32
+}
+
+func parseErrorLog(b []byte) (errorLog, error) {
+	count := 0
+	if len(b) >= 4 {
+		count = (len(b) - 4) % errorEventLen / 2
+	}
+	header := 4 + 2*count
+	if len(b) < 4+2*errorCount || count < errorCount || count > errorMaxCount || (len(b)-header)%errorEventLen != 0 {
+		return errorLog{}, fmt.Errorf("bad error log length %d", len(b))
+	}
+	l := errorLog{next: binary.LittleEndian.Uint32(b)}
+	for i := 0; i < count; i++ {
+		l.onsets = append(l.onsets, int(binary.LittleEndian.Uint16(b[4+2*i:])))
+	}
+	for r := b[header:]; len(r) > 0; r = r[errorEventLen:] {
+		l.events = append(l.events, errorEvent{
+			seq:    l.next,
+			uptime: binary.LittleEndian.Uint32(r),
+			err:    int(r[4]),
+			kind:   int(r[5]),
+			value:  int(int16(binary.LittleEndian.Uint16(r[6:]))),
+		})
+		l.next++
+	}
+	return l, nil
+}
+
+func errorLogAck(seq uint32) []byte {
+	b := make([]byte, 4)
+	binary.LittleEndian.PutUint32(b, seq)
+	return b
+}
@@ -0,0 +1,56 @@
+package ble
+
+import "testing"
+
+func TestParseErrorLog(t *testing.T) {
+	b := []byte{
+		0x0A, 0, 0, 0,
+		3, 0, 1, 0,
+		0x10, 0x0E, 0, 0, 1, 1, 0x40, 0x06,
+		0x2E, 0x0E, 0, 0, 1, 2, 30, 0,
+	}
+	l, err := parseErrorLog(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(l.onsets) != 2 || l.onsets[0] != 3 || l.onsets[1] != 1 {
+		t.Errorf("onsets %v", l.onsets)
+	}
+	want := []errorEvent{
+		{seq: 10, uptime: 3600, err: 1, kind: errorEventRaised, value: 1600},
+		{seq: 11, uptime: 3630, err: 1, kind: errorEventCleared, value: 30},
+	}
+	if len(l.events) != len(want) {
+		t.Fatalf("%d events", len(l.events))
+	}
+	for i := range want {
+		if l.events[i] != want[i] {
+			t.Errorf("event %d: got %+v, want %+v", i, l.events[i], want[i])
+		}
+	}
+	if l.next != 12 {
+		t.Errorf("next %d", l.next)
+	}
+
+	l, err = parseErrorLog(b[:8])
+	if err != nil || len(l.events) != 0 || l.next != 10 {
+		t.Errorf("empty log: %+v %v", l, err)
+	}
+	if _, err := parseErrorLog(b[:12]); err == nil {
+		t.Error("partial event accepted")
+	}
+
+	// Three errors' onsets, the fan wear warning's last
+	b3 := append(append(append([]byte(nil), b[:8]...), 2, 0), b[8:16]...)
+	b3[14] = 2
+	l, err = parseErrorLog(b3)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(l.onsets) != 3 || l.onsets[2] != 2 || len(l.events) != 1 || l.events[0].err != 2 {
+		t.Errorf("three errors: %+v", l)
+	}
+	if s := l.events[0].String(); s != "fan wear error raised (1600)" {
+		t.Error(s)
+	}
+}
@@ -0,0 +1,78 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"time"
+)
+
+// Fan lead (the firmware's fan_control.h): a brick spins its fan up
+// ahead of its output rising, rather than its loop catching up once the
+// heat has arrived. Bricks running their own schedule, or fading, see
+// that coming themselves; those written frames only know the levels
+// now, so the tables say how far each zone rises over the lead and it
+// is passed on to them.
+const (
+	// FanLeadTime is how far ahead a rise counts, FAN_LEAD_S
+	FanLeadTime = 10 * time.Minute
+	// A brick holds a rise this long, renewed at half of it, so one
+	// from a controller gone doesn't keep its fan up
+	fanLeadHold = 2 * time.Minute
+)
+
+func fanLeadRecord(rise uint8, hold time.Duration) cmdRecord {
+	s := int(hold / time.Second)
+	return cmdRecord{op: cmdOpFanLead, value: []byte{rise, byte(s), byte(s >> 8)}}
+}
+
+// What a brick was last told of the rise ahead
+type fanLeadSent struct {
+	rise uint8
+	at   time.Time
+}
+
+// due is whether rise needs sending now, taking it as sent if so
+func (s *fanLeadSent) due(rise uint8, now time.Time) bool {
+	if rise == s.rise && (rise == 0 || now.Sub(s.at) < fanLeadHold/2) {
+		return false
+	}
+	*s = fanLeadSent{rise: rise, at: now}
+	return true
+}
+
+// SetZoneFanLead has the bricks in zone that take it spin their fans up
+// for their output rising by percent of full within FanLeadTime
+func (ble *bleChannel) SetZoneFanLead(zone string, percent float64) error {
+	if percent < 0 || percent > 100 {
+		return fmt.Errorf("rise must be 0-100%%, got %g", percent)
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if ble.fanLeads == nil {
+		ble.fanLeads = make(map[string]float64)
+	}
+	ble.fanLeads[zone] = percent
+	ble.sendFanLeads(ble.clock.Now())
+	return nil
+}
+
+// sendFanLeads tells each brick written frames of the rise ahead of it
+// when that has moved, or is due renewing. Called with ble.lock held.
+func (ble *bleChannel) sendFanLeads(now time.Time) {
+	for id, p := range ble.connectedPeriph {
+		if p.commandChar == nil || p.caps == nil || !p.caps.has(capFanLead) || (p.scheduled && !ble.manual) {
+			continue
+		}
+		name, _ := ble.zoneOf(id)
+		rise := uint8(math.Round(ble.fanLeads[name]))
+		if !p.fanLead.due(rise, now) {
+			continue
+		}
+		go func(p *blePeriph) {
+			if err := p.sendAt(prioSchedule, fanLeadRecord(rise, fanLeadHold)); err != nil {
+				log.Printf("%s: fan lead: %s", p.gp.ID(), err)
+			}
+		}(p)
+	}
+}
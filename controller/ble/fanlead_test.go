@@ -0,0 +1,28 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+	"time"
+)
+
+func TestFanLead(t *testing.T) {
+	if r := fanLeadRecord(12, fanLeadHold); r.op != cmdOpFanLead || !bytes.Equal(r.value, []byte{12, 120, 0}) {
+		t.Errorf("%+v", r)
+	}
+
+	var s fanLeadSent
+	now := time.Now()
+	if s.due(0, now) {
+		t.Error("no rise sent to a brick told nothing")
+	}
+	if !s.due(10, now) || s.due(10, now.Add(time.Second)) {
+		t.Error("rise not sent once")
+	}
+	if !s.due(10, now.Add(fanLeadHold/2)) {
+		t.Error("rise not renewed before the brick drops it")
+	}
+	if !s.due(0, now.Add(fanLeadHold/2+time.Second)) || s.due(0, now.Add(time.Hour)) {
+		t.Error("end of the rise not sent once")
+	}
+}
@@ -0,0 +1,387 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"sort"
+	"strings"
+	"sync"
+	"text/tabwriter"
+	"time"
+)
+
+// Fleet benchmarks (ledbrick -bench): scripted scenarios run on the
+// bricks this channel holds, through its own writers, bulk transfers and
+// links, so they measure what the tanks get rather than a copy of it.
+// Each op is timed from going to the adapter to the brick's response,
+// the command traces bricks echo (trace.go) split frames into link and
+// brick time, and afterwards each brick is asked what it saw itself.
+const (
+	// Full frames to every brick at once, every channel changing
+	benchStorm = "storm"
+	// The same as fades, each running into the next
+	benchFade = "fade"
+	// Each brick dropped in turn, until it's back
+	benchReconnect = "reconnect"
+	// Each brick's whole history log read back
+	benchBackfill = "backfill"
+
+	// A brick not back this long after it was dropped failed
+	benchReconnectTimeout = 30 * time.Second
+	benchPoll             = 50 * time.Millisecond
+)
+
+var benchScenarios = []string{benchStorm, benchFade, benchReconnect, benchBackfill}
+
+// FleetBench is what to run and on which bricks
+type FleetBench struct {
+	// Brick IDs, every brick connected if empty
+	Bricks []string
+	// Scenarios in the order run, of storm, fade, reconnect and backfill
+	Scenarios []string
+	// Frames or fades sent to each brick by the storm and fade
+	Rounds int
+	// Between them
+	Every time.Duration
+	// Each fade's length
+	Fade time.Duration
+}
+
+var DefaultFleetBench = FleetBench{Scenarios: benchScenarios, Rounds: 50,
+	Every: 100 * time.Millisecond, Fade: time.Second}
+
+func (b FleetBench) validate() error {
+	for _, s := range b.Scenarios {
+		known := false
+		for _, k := range benchScenarios {
+			known = known || s == k
+		}
+		if !known {
+			return fmt.Errorf("no scenario %q, only %s", s, strings.Join(benchScenarios, ", "))
+		}
+	}
+	switch {
+	case len(b.Scenarios) == 0:
+		return fmt.Errorf("no scenarios")
+	case b.Rounds < 1:
+		return fmt.Errorf("at least one round, got %d", b.Rounds)
+	case b.Every < 0:
+		return fmt.Errorf("spacing must be positive or 0, got %v", b.Every)
+	case b.Fade <= 0 || b.Fade > time.Minute:
+		return fmt.Errorf("fade must be over 0 and up to 1m, got %v", b.Fade)
+	}
+	return nil
+}
+
+// ScenarioReport is how one scenario went across the bricks
+type ScenarioReport struct {
+	Name   string
+	Bricks int
+	// Ops done, and those that failed or timed out
+	Ops, Failed int
+	Elapsed     time.Duration
+	// Over the ops done
+	P50, P90, P99, Max time.Duration
+	// Read back, for the backfill
+	Bytes int
+	// From the traces the bricks echoed, empty without them
+	Traces string
+}
+
+// PerSecond is the ops done a second across the fleet
+func (r ScenarioReport) PerSecond() float64 {
+	if r.Elapsed <= 0 {
+		return 0
+	}
+	return float64(r.Ops) / r.Elapsed.Seconds()
+}
+
+// FleetBenchReport is every scenario run, then what each brick said of
+// itself once they had: its hot path latencies, bus and link
+type FleetBenchReport struct {
+	Scenarios   []ScenarioReport
+	Diagnostics map[string][]string
+}
+
+func (r FleetBenchReport) String() string {
+	var buf bytes.Buffer
+	w := tabwriter.NewWriter(&buf, 0, 0, 2, ' ', 0)
+	fmt.Fprintln(w, "scenario\tbricks\tops\tfailed\tp50\tp90\tp99\tmax\tops/s\tbytes/s")
+	for _, s := range r.Scenarios {
+		rate := "-"
+		if s.Bytes > 0 && s.Elapsed > 0 {
+			rate = fmt.Sprintf("%.0f", float64(s.Bytes)/s.Elapsed.Seconds())
+		}
+		fmt.Fprintf(w, "%s\t%d\t%d\t%d\t%v\t%v\t%v\t%v\t%.1f\t%s\n", s.Name, s.Bricks, s.Ops, s.Failed,
+			s.P50, s.P90, s.P99, s.Max, s.PerSecond(), rate)
+	}
+	w.Flush()
+	for _, s := range r.Scenarios {
+		if s.Traces != "" {
+			fmt.Fprintf(&buf, "%s traces: %s\n", s.Name, s.Traces)
+		}
+	}
+	ids := make([]string, 0, len(r.Diagnostics))
+	for id := range r.Diagnostics {
+		ids = append(ids, id)
+	}
+	sort.Strings(ids)
+	for _, id := range ids {
+		for _, d := range r.Diagnostics[id] {
+			fmt.Fprintf(&buf, "%s: %s\n", id, d)
+		}
+	}
+	return strings.TrimRight(buf.String(), "\n")
+}
+
+// benchOps gathers one scenario's op times from every brick
+type benchOps struct {
+	took   []time.Duration
+	failed int
+	bytes  int
+
+	lock sync.Mutex
+}
+
+func (o *benchOps) done(d time.Duration, err error) {
+	o.lock.Lock()
+	defer o.lock.Unlock()
+	if err != nil {
+		o.failed++
+		return
+	}
+	o.took = append(o.took, d)
+}
+
+func (o *benchOps) report(name string, bricks int, elapsed time.Duration) ScenarioReport {
+	r := ScenarioReport{Name: name, Bricks: bricks, Ops: len(o.took), Failed: o.failed,
+		Elapsed: elapsed, Bytes: o.bytes}
+	if len(o.took) > 0 {
+		sort.Slice(o.took, func(i, j int) bool { return o.took[i] < o.took[j] })
+		at := func(p float64) time.Duration { return o.took[int(p*float64(len(o.took)-1)+0.5)] }
+		r.P50, r.P90, r.P99, r.Max = at(0.5), at(0.9), at(0.99), o.took[len(o.took)-1]
+	}
+	return r
+}
+
+// benchPercent is the level of round, neighbouring rounds always apart
+func benchPercent(round int) float64 {
+	return float64(1 + (round*37)%99)
+}
+
+// benchFrames sends each brick rounds of every channel at once, faded
+// over fade, all of them together
+func benchFrames(periphs []*blePeriph, b FleetBench, fade time.Duration, ops *benchOps) {
+	var wg sync.WaitGroup
+	for _, p := range periphs {
+		wg.Add(1)
+		go func(p *blePeriph) {
+			defer wg.Done()
+			width := p.width()
+			mask := uint16(1)<<uint(width) - 1
+			for round := 0; round < b.Rounds; round++ {
+				s := &ledState{}
+				for ch := 0; ch < width; ch++ {
+					s.percents[ch] = benchPercent(round)
+				}
+				start := time.Now()
+				err := p.sendLevels(s, mask, s.levels(ledMaxLevel, width), fade, false, p.now())
+				ops.done(time.Since(start), err)
+				time.Sleep(b.Every)
+			}
+		}(p)
+	}
+	wg.Wait()
+}
+
+// benchReconnect drops each brick in turn, timing it back to connected
+func (ble *bleChannel) benchReconnect(periphs []*blePeriph, ops *benchOps) {
+	for _, p := range periphs {
+		id := p.gp.ID()
+		start := time.Now()
+		p.gp.Device().CancelConnection(p.gp)
+		var err error
+		for {
+			time.Sleep(benchPoll)
+			ble.lock.Lock()
+			back := ble.connectedPeriph[id]
+			ble.lock.Unlock()
+			if back != nil && back != p {
+				break
+			}
+			if time.Since(start) > benchReconnectTimeout {
+				err = fmt.Errorf("not back after %v", benchReconnectTimeout)
+				break
+			}
+		}
+		ops.done(time.Since(start), err)
+	}
+}
+
+// benchHistory reads each brick's history log from its oldest block,
+// all of them together, without storing it
+func benchHistory(periphs []*blePeriph, ops *benchOps) {
+	var wg sync.WaitGroup
+	for _, p := range periphs {
+		if p.bulk == nil {
+			continue
+		}
+		wg.Add(1)
+		go func(p *blePeriph) {
+			defer wg.Done()
+			var seq uint32
+			for round := 0; round < backfillMaxRounds; round++ {
+				var body [4]byte
+				binary.LittleEndian.PutUint32(body[:], seq)
+				start := time.Now()
+				b, err := p.bulk.request(bulkCmdHistory, body[:], bulkReplyTimeout)
+				var l historyLog
+				if err == nil {
+					l, err = parseHistory(b)
+				}
+				ops.done(time.Since(start), err)
+				if err != nil {
+					return
+				}
+				ops.lock.Lock()
+				ops.bytes += len(b)
+				ops.lock.Unlock()
+				if len(l.blocks) == 0 || l.blocks[len(l.blocks)-1].seq == l.open {
+					return
+				}
+				seq = l.blocks[len(l.blocks)-1].seq + 1
+			}
+		}(p)
+	}
+	wg.Wait()
+}
+
+// benchDiagnostics is what p says of itself: its hot path latencies,
+// where built with them, then its bus and link
+func benchDiagnostics(p *blePeriph) []string {
+	var ds []string
+	if p.latencyChar != nil {
+		if b, err := p.gp.ReadLongCharacteristic(p.latencyChar); err == nil {
+			if hs, err := parseLatency(b); err == nil {
+				for i, h := range hs {
+					name := fmt.Sprintf("point %d", i)
+					if i < len(latencyNames) {
+						name = latencyNames[i]
+					}
+					ds = append(ds, fmt.Sprintf("%s latency: %s", name, h))
+				}
+			}
+		}
+	}
+	if p.bulk == nil {
+		return ds
+	}
+	if b, err := p.bulk.request(bulkCmdBusStats, nil, bulkReplyTimeout); err == nil {
+		if s, err := parseBusStats(b); err == nil {
+			ds = append(ds, fmt.Sprintf("bus: %s", s))
+		}
+	}
+	if b, err := p.bulk.request(bulkCmdLinkStats, nil, bulkReplyTimeout); err == nil {
+		if s, err := parseLinkStats(b); err == nil {
+			ds = append(ds, fmt.Sprintf("link: %s", s))
+		}
+	}
+	return ds
+}
+
+// benchPeriphs are the connected bricks named, or every one connected.
+// Called with ble.lock held.
+func (ble *bleChannel) benchPeriphs(ids []string) ([]*blePeriph, error) {
+	var periphs []*blePeriph
+	if len(ids) == 0 {
+		for _, p := range ble.connectedPeriph {
+			periphs = append(periphs, p)
+		}
+		sort.Slice(periphs, func(i, j int) bool { return periphs[i].gp.ID() < periphs[j].gp.ID() })
+	}
+	for _, id := range ids {
+		p := ble.connectedPeriph[id]
+		if p == nil {
+			return nil, fmt.Errorf("%s isn't connected", id)
+		}
+		periphs = append(periphs, p)
+	}
+	if len(periphs) == 0 {
+		return nil, fmt.Errorf("no bricks connected")
+	}
+	return periphs, nil
+}
+
+// RunFleetBench waits up to wait for b's bricks, or for those expected
+// (ExpectBricks) with none named, then runs b's scenarios on them in
+// order. Bricks running their schedules are held off it for the run,
+// and every brick gets the channel's levels again after.
+func (ble *bleChannel) RunFleetBench(b FleetBench, wait time.Duration) (FleetBenchReport, error) {
+	if err := b.validate(); err != nil {
+		return FleetBenchReport{}, err
+	}
+	deadline := time.Now().Add(wait)
+	for {
+		ble.lock.Lock()
+		ready := len(ble.connectedPeriph) > 0 && len(ble.connectedPeriph) >= ble.expected
+		for _, id := range b.Bricks {
+			ready = ready && ble.connectedPeriph[id] != nil
+		}
+		ble.lock.Unlock()
+		if ready || !time.Now().Before(deadline) {
+			break
+		}
+		time.Sleep(benchPoll)
+	}
+
+	ble.lock.Lock()
+	held := ble.manual
+	ble.lock.Unlock()
+	ble.HoldSchedule(true)
+	defer ble.HoldSchedule(held)
+
+	r := FleetBenchReport{Diagnostics: make(map[string][]string)}
+	var periphs []*blePeriph
+	for _, name := range b.Scenarios {
+		// Those reconnected are new peripherals
+		ble.lock.Lock()
+		ps, err := ble.benchPeriphs(b.Bricks)
+		ble.lock.Unlock()
+		if err != nil {
+			return r, err
+		}
+		periphs = ps
+		for _, p := range periphs {
+			p.traces.reset()
+		}
+		ops := &benchOps{}
+		start := time.Now()
+		switch name {
+		case benchStorm:
+			benchFrames(periphs, b, 0, ops)
+		case benchFade:
+			benchFrames(periphs, b, b.Fade, ops)
+		case benchReconnect:
+			ble.benchReconnect(periphs, ops)
+		case benchBackfill:
+			benchHistory(periphs, ops)
+		}
+		s := ops.report(name, len(periphs), time.Since(start))
+		if name == benchStorm || name == benchFade {
+			pool := newCmdTraces()
+			for _, p := range periphs {
+				pool.merge(p.traces)
+			}
+			if _, n := pool.percentiles(traceBrick); n > 0 {
+				s.Traces = pool.String()
+			}
+		}
+		r.Scenarios = append(r.Scenarios, s)
+	}
+	for _, p := range periphs {
+		r.Diagnostics[p.gp.ID()] = benchDiagnostics(p)
+		p.sentLevels.invalidate()
+	}
+	return r, nil
+}
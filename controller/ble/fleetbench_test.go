@@ -0,0 +1,52 @@
+package ble
+
+import (
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestFleetBench(t *testing.T) {
+	sc := NewSimChannel(SimConfig{Bricks: 4, ConnectionInterval: 10 * time.Millisecond, Latency: 2 * time.Millisecond})
+	defer sc.Close()
+	b := FleetBench{Scenarios: []string{benchStorm, benchFade, benchBackfill}, Rounds: 5, Fade: time.Second}
+	r, err := sc.RunFleetBench(b, 0)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(r.Scenarios) != 3 {
+		t.Fatalf("%d scenarios reported", len(r.Scenarios))
+	}
+	for _, s := range r.Scenarios[:2] {
+		if s.Bricks != 4 || s.Ops != 20 || s.Failed != 0 {
+			t.Errorf("%s: %d bricks, %d ops, %d failed", s.Name, s.Bricks, s.Ops, s.Failed)
+		}
+		// Each frame waits out a connection event at most
+		if s.P50 <= 0 || s.Max > 50*time.Millisecond || s.P50 > s.P99 {
+			t.Errorf("%s: p50 %v p99 %v max %v", s.Name, s.P50, s.P99, s.Max)
+		}
+	}
+	// The simulated bricks have no bulk transfers
+	if s := r.Scenarios[2]; s.Ops != 0 || s.Failed != 0 {
+		t.Errorf("backfill: %d ops, %d failed", s.Ops, s.Failed)
+	}
+	if out := r.String(); !strings.HasPrefix(out, "scenario") || !strings.Contains(out, "storm") {
+		t.Errorf("report:\n%s", out)
+	}
+	if sc.ble.manual {
+		t.Error("schedules left held")
+	}
+
+	if _, err := sc.RunFleetBench(FleetBench{Bricks: []string{"gone"}, Scenarios: []string{benchStorm}, Rounds: 1, Fade: time.Second}, 0); err == nil {
+		t.Error("ran on a brick not connected")
+	}
+	for _, bad := range []FleetBench{
+		{Scenarios: []string{"flood"}, Rounds: 1, Fade: time.Second},
+		{Scenarios: []string{benchStorm}, Rounds: 0, Fade: time.Second},
+		{Scenarios: []string{benchFade}, Rounds: 1},
+	} {
+		if bad.validate() == nil {
+			t.Errorf("%+v accepted", bad)
+		}
+	}
+}
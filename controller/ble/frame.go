@@ -0,0 +1,57 @@
+package ble
+
+import (
+	"sync"
+	"sync/atomic"
+)
+
+// Channels on the widest brick (LBS_FRAME_MAX_CHANNELS). Each brick
+// says how many it has wired in its output state, and is evaluated and
+// written for those alone.
+const frameChannels = 16
+
+// Channels on a brick that doesn't say
+const defaultBrickChannels = 8
+
+// channelFrame is every channel's setting as of one generation. Once
+// published it is never changed, so any number of readers can hold it.
+type channelFrame struct {
+	gen      uint64
+	percents [frameChannels]float64
+}
+
+// Generations across every frameCell, so a brick moved between zones
+// never takes another cell's frame for one it already has
+var frameGeneration uint64
+
+// frameCell holds the latest frame. Readers load it without locking;
+// writers take turns publishing a changed copy under a new generation.
+type frameCell struct {
+	v atomic.Value
+
+	lock sync.Mutex
+}
+
+var emptyFrame = &channelFrame{}
+
+func (c *frameCell) load() *channelFrame {
+	if f, ok := c.v.Load().(*channelFrame); ok {
+		return f
+	}
+	return emptyFrame
+}
+
+// update publishes the latest frame as changed by set, keeping the
+// generation when nothing changed so the bricks have nothing to write
+func (c *frameCell) update(set func(percents *[frameChannels]float64)) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	old := c.load()
+	f := *old
+	set(&f.percents)
+	if f.percents == old.percents && old != emptyFrame {
+		return
+	}
+	f.gen = atomic.AddUint64(&frameGeneration, 1)
+	c.v.Store(&f)
+}
@@ -0,0 +1,316 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"github.com/paypal/gatt"
+	"io/ioutil"
+	"log"
+	"os"
+	"path/filepath"
+	"sync"
+)
+
+// Handles from a full discovery, by peripheral ID, so a reconnect can
+// go straight to subscribing. Bricks hash their whole handle layout
+// into the schema characteristic, and the cache is only trusted while
+// that reads back the same.
+type gattCache struct {
+	entries map[string]*gattEntry
+	// Kept in this file as well when set, see SetGattCacheFile
+	path string
+
+	lock sync.Mutex
+}
+
+type gattEntry struct {
+	schema []byte
+	chars  []cachedChar
+	// The capability characteristic's value, covered by the schema so
+	// it needn't be read again, nil on firmware without it
+	capability []byte
+}
+
+type cachedChar struct {
+	service string
+	uuid    string
+	props   gatt.Property
+	h, vh   uint16
+	// Client configuration descriptor, 0 without one
+	cccd uint16
+}
+
+const cccdUUID = 0x2902
+
+func newGattCache() *gattCache {
+	return &gattCache{entries: make(map[string]*gattEntry)}
+}
+
+func (g *gattCache) get(id string) *gattEntry {
+	g.lock.Lock()
+	defer g.lock.Unlock()
+	if e := g.entries[id]; e != nil || g.path == "" {
+		return e
+	}
+	// Another controller may have connected it since
+	f, err := g.readFile()
+	if err != nil {
+		return nil
+	}
+	if fe, ok := f[id]; ok {
+		g.entries[id] = fe.entry()
+	}
+	return g.entries[id]
+}
+
+func (g *gattCache) put(id string, e *gattEntry) {
+	g.lock.Lock()
+	defer g.lock.Unlock()
+	g.entries[id] = e
+	g.update(id, e)
+}
+
+func (g *gattCache) drop(id string) {
+	g.lock.Lock()
+	defer g.lock.Unlock()
+	delete(g.entries, id)
+	g.update(id, nil)
+}
+
+// The cache as kept in a file, JSON by peripheral ID. Each change is
+// read, modified and written back for that brick alone, so controllers
+// sharing the file keep each other's entries.
+type gattFileEntry struct {
+	Schema     []byte         `json:"schema"`
+	Chars      []gattFileChar `json:"chars"`
+	Capability []byte         `json:"capability,omitempty"`
+}
+
+type gattFileChar struct {
+	Service string `json:"service"`
+	UUID    string `json:"uuid"`
+	Props   uint   `json:"props"`
+	Handle  uint16 `json:"handle"`
+	VHandle uint16 `json:"vhandle"`
+	CCCD    uint16 `json:"cccd,omitempty"`
+}
+
+func fileEntryOf(e *gattEntry) gattFileEntry {
+	fe := gattFileEntry{Schema: e.schema, Capability: e.capability}
+	for _, c := range e.chars {
+		fe.Chars = append(fe.Chars, gattFileChar{c.service, c.uuid, uint(c.props), c.h, c.vh, c.cccd})
+	}
+	return fe
+}
+
+func (fe gattFileEntry) entry() *gattEntry {
+	e := &gattEntry{schema: fe.Schema, capability: fe.Capability}
+	for _, c := range fe.Chars {
+		e.chars = append(e.chars, cachedChar{c.Service, c.UUID, gatt.Property(c.Props), c.Handle, c.VHandle, c.CCCD})
+	}
+	return e
+}
+
+// open loads the entries kept in path, none if it doesn't exist yet,
+// and keeps them there from now on
+func (g *gattCache) open(path string) error {
+	g.lock.Lock()
+	defer g.lock.Unlock()
+	g.path = path
+	f, err := g.readFile()
+	if err != nil {
+		g.path = ""
+		return err
+	}
+	for id, fe := range f {
+		g.entries[id] = fe.entry()
+	}
+	return nil
+}
+
+// Called with g.lock held and g.path set
+func (g *gattCache) readFile() (map[string]gattFileEntry, error) {
+	f := make(map[string]gattFileEntry)
+	b, err := ioutil.ReadFile(g.path)
+	if os.IsNotExist(err) {
+		return f, nil
+	}
+	if err != nil {
+		return nil, err
+	}
+	if err := json.Unmarshal(b, &f); err != nil {
+		return nil, fmt.Errorf("GATT cache %s: %v", g.path, err)
+	}
+	return f, nil
+}
+
+// update sets or, with e nil, removes id's entry in the file. It's
+// written whole and renamed over, so a reader never sees half of it.
+// Called with g.lock held.
+func (g *gattCache) update(id string, e *gattEntry) {
+	if g.path == "" {
+		return
+	}
+	f, err := g.readFile()
+	if err != nil {
+		log.Printf("Not keeping GATT handles: %v", err)
+		return
+	}
+	if e == nil {
+		delete(f, id)
+	} else {
+		f[id] = fileEntryOf(e)
+	}
+	b, err := json.Marshal(f)
+	if err == nil {
+		tmp := filepath.Join(filepath.Dir(g.path), "."+filepath.Base(g.path)+".tmp")
+		if err = ioutil.WriteFile(tmp, b, 0644); err == nil {
+			err = os.Rename(tmp, g.path)
+		}
+	}
+	if err != nil {
+		log.Printf("Not keeping GATT handles: %v", err)
+	}
+}
+
+func newGattEntry(schema []byte, cs []*gatt.Characteristic) *gattEntry {
+	e := &gattEntry{schema: schema}
+	for _, c := range cs {
+		cc := cachedChar{
+			service: c.Service().UUID().String(),
+			uuid:    c.UUID().String(),
+			props:   c.Properties(),
+			h:       c.Handle(),
+			vh:      c.VHandle(),
+		}
+		if d := c.Descriptor(); d != nil {
+			cc.cccd = d.Handle()
+		}
+		e.chars = append(e.chars, cc)
+	}
+	return e
+}
+
+// characteristics rebuilds the cached characteristics, those from one
+// service sharing it
+func (e *gattEntry) characteristics() []*gatt.Characteristic {
+	services := make(map[string]*gatt.Service)
+	cs := make([]*gatt.Characteristic, 0, len(e.chars))
+	for _, cc := range e.chars {
+		s := services[cc.service]
+		if s == nil {
+			s = gatt.NewService(gatt.MustParseUUID(cc.service))
+			services[cc.service] = s
+		}
+		c := gatt.NewCharacteristic(gatt.MustParseUUID(cc.uuid), s, cc.props, cc.h, cc.vh)
+		if cc.cccd != 0 {
+			c.SetDescriptor(gatt.NewDescriptor(gatt.UUID16(cccdUUID), cc.cccd, c))
+		}
+		s.SetCharacteristics(append(s.Characteristics(), c))
+		cs = append(cs, c)
+	}
+	return cs
+}
+
+// cachedCharacteristics gives the characteristics found last time p
+// connected, and the capability read then, if its schema still matches
+func (ble *bleChannel) cachedCharacteristics(p gatt.Peripheral) ([]*gatt.Characteristic, []byte, bool) {
+	e := ble.gattCache.get(p.ID())
+	if e == nil {
+		return nil, nil, false
+	}
+	cs := e.characteristics()
+	for _, c := range cs {
+		if c.UUID().String() != pwmSchemaChar {
+			continue
+		}
+		b, err := p.ReadCharacteristic(c)
+		if err == nil && bytes.Equal(b, e.schema) {
+			log.Printf("%s: GATT schema %x unchanged, using cached handles", p.ID(), b)
+			return cs, e.capability, true
+		}
+		break
+	}
+	log.Printf("%s: GATT schema changed, discovering again", p.ID())
+	ble.gattCache.drop(p.ID())
+	return nil, nil, false
+}
+
+func (ble *bleChannel) cacheCharacteristics(p gatt.Peripheral, schema *gatt.Characteristic, cs []*gatt.Characteristic, capability []byte) {
+	b, err := p.ReadCharacteristic(schema)
+	if err != nil {
+		log.Printf("%s: not caching handles, schema: %s", p.ID(), err)
+		return
+	}
+	e := newGattEntry(b, cs)
+	e.capability = capability
+	ble.gattCache.put(p.ID(), e)
+}
+
+// discoverCharacteristics finds and logs every service, characteristic
+// and descriptor on p, reading what it can
+func discoverCharacteristics(p gatt.Peripheral) ([]*gatt.Characteristic, error) {
+	// Discovery services
+	var all []*gatt.Characteristic
+	ss, err := p.DiscoverServices(nil)
+	if err != nil {
+		return nil, fmt.Errorf("failed to discover services: %s", err)
+	}
+
+	for _, s := range ss {
+		msg := "Service: " + s.UUID().String()
+		if len(s.Name()) > 0 {
+			msg += " (" + s.Name() + ")"
+		}
+		log.Println(msg)
+
+		// Discovery characteristics
+		cs, err := p.DiscoverCharacteristics(nil, s)
+		if err != nil {
+			return nil, fmt.Errorf("failed to discover characteristics: %s", err)
+		}
+
+		all = append(all, cs...)
+		for _, c := range cs {
+			msg := "  Characteristic  " + c.UUID().String()
+
+			if len(c.Name()) > 0 {
+				msg += " (" + c.Name() + ")"
+			}
+			msg += "\n    properties    " + c.Properties().String()
+			log.Println(msg)
+
+			// Read the characteristic, if possible.
+			if (c.Properties() & gatt.CharRead) != 0 {
+				b, err := p.ReadCharacteristic(c)
+				if err != nil {
+					return nil, fmt.Errorf("failed to read characteristic: %s", err)
+				}
+				log.Printf("    value         %x | %q\n", b, b)
+			}
+
+			// Discovery descriptors
+			ds, err := p.DiscoverDescriptors(nil, c)
+			if err != nil {
+				return nil, fmt.Errorf("failed to discover descriptors: %s", err)
+			}
+
+			for _, d := range ds {
+				msg := "  Descriptor      " + d.UUID().String()
+				if len(d.Name()) > 0 {
+					msg += " (" + d.Name() + ")"
+				}
+				log.Println(msg)
+
+				// Read descriptor (could fail, if it's not readable)
+				b, err := p.ReadDescriptor(d)
+				if err != nil {
+					return nil, fmt.Errorf("failed to read descriptor: %s", err)
+				}
+				log.Printf("    value         %x | %q\n", b, b)
+			}
+		}
+	}
+	return all, nil
+}
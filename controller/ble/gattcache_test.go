@@ -0,0 +1,87 @@
+package ble
+
+import (
+	"github.com/paypal/gatt"
+	"io/ioutil"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+func TestGattEntry(t *testing.T) {
+	svc := gatt.NewService(gatt.MustParseUUID(pwmService))
+	cmd := gatt.NewCharacteristic(gatt.MustParseUUID(pwmCommandChar), svc, gatt.CharWrite|gatt.CharNotify, 0x30, 0x31)
+	cmd.SetDescriptor(gatt.NewDescriptor(gatt.UUID16(cccdUUID), 0x32, cmd))
+	schema := gatt.NewCharacteristic(gatt.MustParseUUID(pwmSchemaChar), svc, gatt.CharRead, 0x33, 0x34)
+
+	e := newGattEntry([]byte{0x12, 0x34}, []*gatt.Characteristic{cmd, schema})
+	cs := e.characteristics()
+	if len(cs) != 2 {
+		t.Fatalf("%d characteristics", len(cs))
+	}
+	c := cs[0]
+	if c.UUID().String() != pwmCommandChar || c.Handle() != 0x30 || c.VHandle() != 0x31 ||
+		c.Properties() != gatt.CharWrite|gatt.CharNotify {
+		t.Errorf("command characteristic %s at %#x/%#x", c.UUID(), c.Handle(), c.VHandle())
+	}
+	if c.Descriptor() == nil || c.Descriptor().Handle() != 0x32 {
+		t.Error("command CCCD lost")
+	}
+	if cs[1].Descriptor() != nil {
+		t.Error("schema characteristic gained a CCCD")
+	}
+	if cs[0].Service() != cs[1].Service() || len(cs[0].Service().Characteristics()) != 2 {
+		t.Error("characteristics don't share their service")
+	}
+
+	g := newGattCache()
+	g.put("brick", e)
+	if g.get("brick") != e {
+		t.Error("entry not cached")
+	}
+	g.drop("brick")
+	if g.get("brick") != nil {
+		t.Error("entry not dropped")
+	}
+}
+
+func TestGattCacheFile(t *testing.T) {
+	dir, err := ioutil.TempDir("", "gattcache")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "handles.json")
+
+	svc := gatt.NewService(gatt.MustParseUUID(pwmService))
+	cmd := gatt.NewCharacteristic(gatt.MustParseUUID(pwmCommandChar), svc, gatt.CharWrite|gatt.CharNotify, 0x30, 0x31)
+	cmd.SetDescriptor(gatt.NewDescriptor(gatt.UUID16(cccdUUID), 0x32, cmd))
+	a, b := newGattCache(), newGattCache()
+	if err := a.open(path); err != nil {
+		t.Fatal(err)
+	}
+	if err := b.open(path); err != nil {
+		t.Fatal(err)
+	}
+	one := newGattEntry([]byte{1}, []*gatt.Characteristic{cmd})
+	one.capability = []byte{1, cmdVersion, 8, 0x0f, 0, 0, 0}
+	a.put("one", one)
+	b.put("two", newGattEntry([]byte{2}, []*gatt.Characteristic{cmd}))
+
+	// Each controller sees what the other found
+	e := b.get("one")
+	if e == nil || len(e.chars) != 1 || e.chars[0] != (cachedChar{pwmService, pwmCommandChar, gatt.CharWrite | gatt.CharNotify, 0x30, 0x31, 0x32}) {
+		t.Fatalf("shared entry %+v", e)
+	}
+	c := newGattCache()
+	if err := c.open(path); err != nil {
+		t.Fatal(err)
+	}
+	if e := c.get("one"); e == nil || len(e.capability) != capabilityLen || c.get("two") == nil {
+		t.Error("entries not kept in the file")
+	}
+	a.drop("two")
+	if d := newGattCache(); d.open(path) != nil || d.get("two") != nil {
+		t.Error("dropped entry still in the file")
+	}
+}
@@ -0,0 +1,231 @@
+package ble
+
+import (
+	"encoding/json"
+	"fmt"
+	"math"
+	"net/http"
+	"sync"
+	"time"
+)
+
+// Temperature and fan history per brick, kept for trending a failing
+// fan. Every sample goes into a ring per resolution, each a fixed size,
+// so memory stays the same however long the controller runs: the raw
+// samples for about the last hour, then minutes for a day and hours for
+// a month, each keeping the low, high and mean of its samples.
+type history struct {
+	bricks map[string]*brickHistory
+
+	lock sync.Mutex
+}
+
+var historyResolutions = [...]struct {
+	step time.Duration
+	size int
+}{
+	{0, 3600},
+	{time.Minute, 24 * 60},
+	{time.Hour, 30 * 24},
+}
+
+type brickHistory struct {
+	rings [len(historyResolutions)]historyRing
+	// Next of the brick's own history to download
+	cursor historyCursor
+
+	lock sync.Mutex
+}
+
+// One bucket, or one sample in the raw ring
+type historyBucket struct {
+	// Unix seconds at the start of the bucket
+	at      int64
+	n       uint32
+	tempMin float32
+	tempMax float32
+	tempSum float32
+	rpmMin  float32
+	rpmMax  float32
+	rpmSum  float32
+}
+
+type historyRing struct {
+	// Seconds per bucket, 0 keeps each sample
+	step    int64
+	buckets []historyBucket
+	// Where the next bucket goes, and how many are in use
+	next, used int
+}
+
+// HistoryPoint is one bucket of a brick's history
+type HistoryPoint struct {
+	At      time.Time `json:"at"`
+	Samples int       `json:"samples"`
+	TempMin float64   `json:"temp_min"`
+	TempMax float64   `json:"temp_max"`
+	Temp    float64   `json:"temp"`
+	RpmMin  float64   `json:"rpm_min"`
+	RpmMax  float64   `json:"rpm_max"`
+	Rpm     float64   `json:"rpm"`
+}
+
+func newHistory() *history {
+	return &history{bricks: make(map[string]*brickHistory)}
+}
+
+func (h *history) brick(id string) *brickHistory {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	b := h.bricks[id]
+	if b == nil {
+		b = &brickHistory{}
+		for i, r := range historyResolutions {
+			b.rings[i] = historyRing{step: int64(r.step / time.Second), buckets: make([]historyBucket, r.size)}
+		}
+		h.bricks[id] = b
+	}
+	return b
+}
+
+func (b *historyBucket) merge(tempC, rpm float32) {
+	b.n++
+	b.tempMin = float32(math.Min(float64(b.tempMin), float64(tempC)))
+	b.tempMax = float32(math.Max(float64(b.tempMax), float64(tempC)))
+	b.tempSum += tempC
+	b.rpmMin = float32(math.Min(float64(b.rpmMin), float64(rpm)))
+	b.rpmMax = float32(math.Max(float64(b.rpmMax), float64(rpm)))
+	b.rpmSum += rpm
+}
+
+// add records a sample, in order among those kept. Live samples always
+// land last; those backfilled from the brick (backfill.go) may go
+// further back.
+func (r *historyRing) add(at int64, tempC, rpm float32) {
+	if r.step > 0 {
+		at -= at % r.step
+	}
+	n := len(r.buckets)
+	start := r.next - r.used + n
+	// Buckets before the new one
+	i := r.used
+	for i > 0 && r.buckets[(start+i-1)%n].at > at {
+		i--
+	}
+	if r.step > 0 && i > 0 && r.buckets[(start+i-1)%n].at == at {
+		r.buckets[(start+i-1)%n].merge(tempC, rpm)
+		return
+	}
+	if r.used == n {
+		if i == 0 {
+			// Older than everything kept
+			return
+		}
+		// The oldest makes room
+		r.used--
+		i--
+		start++
+	}
+	for j := r.used; j > i; j-- {
+		r.buckets[(start+j)%n] = r.buckets[(start+j-1)%n]
+	}
+	r.buckets[(start+i)%n] = historyBucket{at: at, n: 1,
+		tempMin: tempC, tempMax: tempC, tempSum: tempC,
+		rpmMin: rpm, rpmMax: rpm, rpmSum: rpm}
+	r.next = (r.next + 1) % n
+	r.used++
+}
+
+// points is the buckets from since on, oldest first
+func (r *historyRing) points(since int64) []HistoryPoint {
+	var ps []HistoryPoint
+	for i := 0; i < r.used; i++ {
+		b := r.buckets[(r.next-r.used+i+len(r.buckets))%len(r.buckets)]
+		// Raw samples from since, buckets that end after it
+		if b.at < since && (r.step == 0 || b.at+r.step <= since) {
+			continue
+		}
+		n := float64(b.n)
+		ps = append(ps, HistoryPoint{At: time.Unix(b.at, 0), Samples: int(b.n),
+			TempMin: float64(b.tempMin), TempMax: float64(b.tempMax), Temp: float64(b.tempSum) / n,
+			RpmMin: float64(b.rpmMin), RpmMax: float64(b.rpmMax), Rpm: float64(b.rpmSum) / n})
+	}
+	return ps
+}
+
+// add records a reading at every resolution
+func (b *brickHistory) add(at time.Time, temperature16, rpm int) {
+	b.lock.Lock()
+	defer b.lock.Unlock()
+	for i := range b.rings {
+		b.rings[i].add(at.Unix(), float32(temperature16)/16, float32(rpm))
+	}
+}
+
+// newest is the time of the last sample, zero with none
+func (b *brickHistory) newest() time.Time {
+	b.lock.Lock()
+	defer b.lock.Unlock()
+	r := &b.rings[0]
+	if r.used == 0 {
+		return time.Time{}
+	}
+	return time.Unix(r.buckets[(r.next+len(r.buckets)-1)%len(r.buckets)].at, 0)
+}
+
+func (b *brickHistory) points(step time.Duration, since time.Time) ([]HistoryPoint, error) {
+	for i, r := range historyResolutions {
+		if r.step == step {
+			b.lock.Lock()
+			defer b.lock.Unlock()
+			return b.rings[i].points(since.Unix()), nil
+		}
+	}
+	return nil, fmt.Errorf("history is kept raw, by the minute or by the hour, not by %v", step)
+}
+
+func (ble *bleChannel) History(brick string, step time.Duration, since time.Time) ([]HistoryPoint, error) {
+	ble.history.lock.Lock()
+	b := ble.history.bricks[brick]
+	ble.history.lock.Unlock()
+	if b == nil {
+		return nil, fmt.Errorf("no history for brick %s", brick)
+	}
+	return b.points(step, since)
+}
+
+// HistoryHandler serves History as JSON, for
+//
+//	?brick=ID&step=1m&since=6h
+//
+// with step 0 (the default), 1m or 1h, and since a duration back or an
+// RFC 3339 time, everything kept by default
+func (ble *bleChannel) HistoryHandler() http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		q := r.URL.Query()
+		var step time.Duration
+		if s := q.Get("step"); s != "" && s != "0" {
+			var err error
+			if step, err = time.ParseDuration(s); err != nil {
+				http.Error(w, err.Error(), http.StatusBadRequest)
+				return
+			}
+		}
+		var since time.Time
+		if s := q.Get("since"); s != "" {
+			if d, err := time.ParseDuration(s); err == nil {
+				since = time.Now().Add(-d)
+			} else if since, err = time.Parse(time.RFC3339, s); err != nil {
+				http.Error(w, "since must be a duration or an RFC 3339 time", http.StatusBadRequest)
+				return
+			}
+		}
+		ps, err := ble.History(q.Get("brick"), step, since)
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusNotFound)
+			return
+		}
+		w.Header().Set("Content-Type", "application/json")
+		json.NewEncoder(w).Encode(ps)
+	})
+}
@@ -0,0 +1,72 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestHistory(t *testing.T) {
+	h := newHistory()
+	b := h.brick("a")
+	start := time.Date(2016, 6, 20, 12, 0, 0, 0, time.UTC)
+	// Two hours at one sample a second, warming 1 C a minute
+	for s := 0; s < 2*3600; s++ {
+		at := start.Add(time.Duration(s) * time.Second)
+		b.add(at, 16*(25+s/60), 1000+s%2)
+	}
+
+	raw, _ := b.points(0, time.Time{})
+	if len(raw) != historyResolutions[0].size || !raw[len(raw)-1].At.Equal(start.Add(2*time.Hour-time.Second)) {
+		t.Errorf("raw %d samples, last %v", len(raw), raw[len(raw)-1].At)
+	}
+	minutes, _ := b.points(time.Minute, start.Add(time.Hour))
+	if len(minutes) != 60 {
+		t.Fatalf("%d minutes in the last hour", len(minutes))
+	}
+	m := minutes[0]
+	if m.Samples != 60 || m.TempMin != 85 || m.TempMax != 85 || m.RpmMin != 1000 || m.RpmMax != 1001 || m.Rpm != 1000.5 {
+		t.Errorf("minute %+v", m)
+	}
+	hours, _ := b.points(time.Hour, time.Time{})
+	if len(hours) != 2 || hours[1].Samples != 3600 || hours[1].TempMin != 85 || hours[1].TempMax != 144 {
+		t.Errorf("hours %+v", hours)
+	}
+	if _, err := b.points(time.Second, time.Time{}); err == nil {
+		t.Error("history by the second")
+	}
+
+	// Bounded however long it runs
+	for s := 0; s < 3*24*3600; s += 30 {
+		b.add(start.Add(time.Duration(s)*time.Second+3*time.Hour), 400, 1000)
+	}
+	if minutes, _ := b.points(time.Minute, time.Time{}); len(minutes) != historyResolutions[1].size {
+		t.Errorf("%d minutes kept", len(minutes))
+	}
+}
+
+func TestHistoryBackfill(t *testing.T) {
+	b := newHistory().brick("a")
+	start := time.Date(2016, 6, 20, 12, 0, 0, 0, time.UTC)
+	b.add(start, 400, 1000)
+	b.add(start.Add(2*time.Hour), 400, 1000)
+	// Filled in afterwards, a sample a minute between the two
+	for m := 119; m > 0; m-- {
+		b.add(start.Add(time.Duration(m)*time.Minute), 800, 2000)
+	}
+	if !b.newest().Equal(start.Add(2 * time.Hour)) {
+		t.Errorf("newest %v", b.newest())
+	}
+	raw, _ := b.points(0, time.Time{})
+	if len(raw) != 121 {
+		t.Fatalf("%d raw samples", len(raw))
+	}
+	for i := 1; i < len(raw); i++ {
+		if !raw[i].At.After(raw[i-1].At) {
+			t.Fatalf("out of order at %d: %v after %v", i, raw[i].At, raw[i-1].At)
+		}
+	}
+	hours, _ := b.points(time.Hour, time.Time{})
+	if len(hours) != 3 || hours[0].Samples != 60 || hours[0].TempMin != 25 || hours[0].TempMax != 50 {
+		t.Errorf("hours %+v", hours)
+	}
+}
@@ -0,0 +1,240 @@
+package ble
+
+import (
+	"errors"
+	"github.com/paypal/gatt"
+	"log"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Every write to a brick is given a deadline. A write gatt never
+// returns can't be taken back, so it is abandoned and the brick takes
+// no more until it does. A brick failing writes in a row is moved to a
+// slow lane, written once a slow interval until a write gets through,
+// so its link stops costing the radio time the healthy bricks need.
+//
+// One write or run of writes is with gatt at a time, and those waiting
+// go in strict priority order: safety commands, then the ones asked for
+// interactively, then the writer's frames, then bulk transfers. Bulk
+// runs give the link up every few packets, so a safety command waits
+// behind no more than a connection event's worth of them, however long
+// the transfer. Commands are sent as asked for, never folded into a
+// later one the way frames are.
+const (
+	// Failed writes in a row before the slow lane
+	writeFailureBudget = 3
+	slowLaneInterval   = 10 * time.Second
+	// Packets of a bulk run sent between turns
+	bulkRunPackets = 2
+)
+
+type writePriority int
+
+const (
+	// Outputs off, the master dimmer
+	prioSafety writePriority = iota
+	// Scenes, settings and everything else a person or the API asks for
+	prioInteractive
+	// The writer's frames and sync probes
+	prioSchedule
+	// Bulk channel transfers: schedules, history, diagnostics
+	prioBulk
+	writePriorities
+)
+
+var (
+	// Shortened by the tests
+	writeTimeout = 2 * time.Second
+
+	errWriteTimeout = errors.New("write timed out")
+	errWriteStuck   = errors.New("an earlier write never finished")
+)
+
+type writeLane struct {
+	// A write is with gatt, and whether it was given up on
+	busy      bool
+	abandoned bool
+	// Writes waiting their turn, by priority
+	waiting  [writePriorities]int
+	turn     *sync.Cond
+	failures int
+	slow     bool
+	nextTry  time.Time
+	// The adapter's radio time the writes count against, see airtime.go
+	air *airLedger
+
+	lock sync.Mutex
+}
+
+func newWriteLane() *writeLane {
+	l := &writeLane{}
+	l.turn = sync.NewCond(&l.lock)
+	return l
+}
+
+// outranked is whether a write waits at a higher priority than prio.
+// Called with l.lock held.
+func (l *writeLane) outranked(prio writePriority) bool {
+	for p := prioSafety; p < prio; p++ {
+		if l.waiting[p] > 0 {
+			return true
+		}
+	}
+	return false
+}
+
+// begin waits for prio's turn, false if the write with gatt was given
+// up on. The wait is bounded by the deadline of the one ahead.
+func (l *writeLane) begin(prio writePriority) bool {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	l.waiting[prio]++
+	defer func() { l.waiting[prio]-- }()
+	for !l.abandoned && (l.busy || l.outranked(prio)) {
+		l.turn.Wait()
+	}
+	if l.abandoned {
+		return false
+	}
+	l.busy = true
+	return true
+}
+
+func (l *writeLane) end() {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	l.busy = false
+	l.abandoned = false
+	l.turn.Broadcast()
+}
+
+// abandon gives up on the write with gatt, failing those waiting until
+// it returns
+func (l *writeLane) abandon() {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	if l.busy {
+		l.abandoned = true
+		l.turn.Broadcast()
+	}
+}
+
+// run does w in prio's turn, or gives up at the deadline
+func (l *writeLane) run(prio writePriority, w func() error) error {
+	if !l.begin(prio) {
+		return errWriteStuck
+	}
+	done := make(chan error, 1)
+	go func() {
+		err := w()
+		l.end()
+		done <- err
+	}()
+	t := time.NewTimer(writeTimeout)
+	defer t.Stop()
+	select {
+	case err := <-done:
+		return err
+	case <-t.C:
+		l.abandon()
+		return errWriteTimeout
+	}
+}
+
+// runBulk sends bs to c without response at bulk priority, a few at a
+// turn so anything more urgent goes in between
+func (l *writeLane) runBulk(gp gatt.Peripheral, c *gatt.Characteristic, bs [][]byte) error {
+	for len(bs) > 0 {
+		n := bulkRunPackets
+		if n > len(bs) {
+			n = len(bs)
+		}
+		run := bs[:n]
+		l.air.pace()
+		for _, b := range run {
+			l.air.charge(airBulk, airWrite(len(b), false))
+		}
+		if err := l.run(prioBulk, func() error { _, err := pipeline(gp, c, run); return err }); err != nil {
+			return err
+		}
+		bs = bs[n:]
+	}
+	return nil
+}
+
+// due is whether a frame should be written as of now
+func (l *writeLane) due(now time.Time) bool {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	return !l.slow || !now.Before(l.nextTry)
+}
+
+// result counts a frame write, returning whether the brick moved lanes
+func (l *writeLane) result(err error, now time.Time) bool {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	if err == nil {
+		l.failures = 0
+		moved := l.slow
+		l.slow = false
+		return moved
+	}
+	l.failures++
+	l.nextTry = now.Add(slowLaneInterval)
+	if l.failures >= writeFailureBudget && !l.slow {
+		l.slow = true
+		return true
+	}
+	return false
+}
+
+func (l *writeLane) Slow() bool {
+	l.lock.Lock()
+	defer l.lock.Unlock()
+	return l.slow
+}
+
+// write sends b to c in prio's turn, or gives up at the deadline
+func (p *blePeriph) write(prio writePriority, c *gatt.Characteristic, b []byte, noRsp bool) error {
+	p.lane.air.charge(useOf(prio), airWrite(len(b), !noRsp))
+	err := p.lane.run(prio, func() error { return p.gp.WriteCharacteristic(c, b, noRsp) })
+	if err == errWriteTimeout {
+		atomic.AddInt64(&p.metrics.writeTimeouts, 1)
+	}
+	return err
+}
+
+// writeAll sends bs to c without response, pipelined (pipeline.go), in
+// prio's turn, or gives up at the deadline
+func (p *blePeriph) writeAll(prio writePriority, c *gatt.Characteristic, bs [][]byte) error {
+	if len(bs) == 1 {
+		return p.write(prio, c, bs[0], true)
+	}
+	for _, b := range bs {
+		p.lane.air.charge(useOf(prio), airWrite(len(b), false))
+	}
+	err := p.lane.run(prio, func() error {
+		depth, err := pipeline(p.gp, c, bs)
+		atomic.StoreInt64(&p.metrics.writeDepth, int64(depth))
+		return err
+	})
+	if err == errWriteTimeout {
+		atomic.AddInt64(&p.metrics.writeTimeouts, 1)
+	}
+	return err
+}
+
+// laneResult moves the brick between lanes on a frame write's outcome
+func (p *blePeriph) laneResult(err error, now time.Time) {
+	if !p.lane.result(err, now) {
+		return
+	}
+	if err != nil {
+		log.Printf("%s: %d writes failed in a row, writing every %v until one gets through: %s",
+			p.gp.ID(), writeFailureBudget, slowLaneInterval, err)
+	} else {
+		log.Printf("%s: writes getting through again", p.gp.ID())
+	}
+}
@@ -0,0 +1,130 @@
+package ble
+
+import (
+	"github.com/paypal/gatt"
+	"testing"
+	"time"
+)
+
+// Never returns a write until released
+type stuckPeriph struct {
+	gatt.Peripheral
+	release chan struct{}
+}
+
+func (s *stuckPeriph) ID() string { return "stuck" }
+func (s *stuckPeriph) WriteCharacteristic(*gatt.Characteristic, []byte, bool) error {
+	<-s.release
+	return nil
+}
+
+func TestWriteDeadline(t *testing.T) {
+	defer func(d time.Duration) { writeTimeout = d }(writeTimeout)
+	writeTimeout = 10 * time.Millisecond
+
+	sp := &stuckPeriph{release: make(chan struct{})}
+	p := &blePeriph{gp: sp, lane: newWriteLane(), metrics: newMetrics().brick("stuck")}
+	if err := p.write(prioSchedule, nil, nil, true); err != errWriteTimeout {
+		t.Errorf("stuck write %v", err)
+	}
+	if err := p.write(prioSafety, nil, nil, true); err != errWriteStuck {
+		t.Errorf("write behind a stuck one %v", err)
+	}
+	close(sp.release)
+	for i := 0; i < 100 && !p.lane.begin(prioSchedule); i++ {
+		time.Sleep(time.Millisecond)
+	}
+	p.lane.end()
+	if err := p.write(prioSchedule, nil, nil, true); err != nil {
+		t.Errorf("released write %v", err)
+	}
+	if p.metrics.writeTimeouts != 1 {
+		t.Errorf("%d timeouts", p.metrics.writeTimeouts)
+	}
+}
+
+func TestWriteLane(t *testing.T) {
+	l := newWriteLane()
+	now := time.Now()
+	for i := 1; i < writeFailureBudget; i++ {
+		if l.result(errWriteTimeout, now) || !l.due(now) {
+			t.Fatalf("slow after %d failures", i)
+		}
+	}
+	if !l.result(errWriteTimeout, now) || !l.Slow() {
+		t.Fatal("not slow once over budget")
+	}
+	if l.due(now.Add(slowLaneInterval-time.Second)) || !l.due(now.Add(slowLaneInterval)) {
+		t.Error("slow lane interval not kept")
+	}
+	if !l.result(nil, now) || l.Slow() || !l.due(now) {
+		t.Error("still slow after a write got through")
+	}
+}
+
+// Writes a packet at a time, noting each and holding it until released
+type gatedPeriph struct {
+	gatt.Peripheral
+	wrote chan []byte
+	next  chan struct{}
+}
+
+func (g *gatedPeriph) WriteCharacteristic(_ *gatt.Characteristic, b []byte, _ bool) error {
+	g.wrote <- b
+	<-g.next
+	return nil
+}
+
+func TestWritePriority(t *testing.T) {
+	g := &gatedPeriph{wrote: make(chan []byte, 16), next: make(chan struct{})}
+	p := &blePeriph{gp: g, lane: newWriteLane(), metrics: newMetrics().brick("gated")}
+
+	// A long bulk run, in the middle of which a frame then a safety
+	// command queue up
+	bulk := make([][]byte, 6)
+	for i := range bulk {
+		bulk[i] = []byte{'b', byte(i)}
+	}
+	done := make(chan error, 3)
+	go func() { done <- p.lane.runBulk(g, nil, bulk) }()
+	if b := <-g.wrote; b[1] != 0 {
+		t.Fatalf("bulk started with % x", b)
+	}
+	go func() { done <- p.write(prioSchedule, nil, []byte{'f'}, true) }()
+	waitWaiting(t, p.lane, prioSchedule)
+	go func() { done <- p.write(prioSafety, nil, []byte{'s'}, true) }()
+	waitWaiting(t, p.lane, prioSafety)
+
+	// The bulk turn finishes its packets, then the safety command goes
+	// ahead of the frame, and only then the rest of the bulk run
+	var order []byte
+	for i := 0; i < 8; i++ {
+		g.next <- struct{}{}
+		if i < 7 {
+			b := <-g.wrote
+			order = append(order, b[len(b)-1])
+		}
+	}
+	want := []byte{1, 's', 'f', 2, 3, 4, 5}
+	if string(order) != string(want) {
+		t.Errorf("written in order % x, want % x", order, want)
+	}
+	for i := 0; i < 3; i++ {
+		if err := <-done; err != nil {
+			t.Error(err)
+		}
+	}
+}
+
+func waitWaiting(t *testing.T, l *writeLane, prio writePriority) {
+	for i := 0; i < 1000; i++ {
+		l.lock.Lock()
+		n := l.waiting[prio]
+		l.lock.Unlock()
+		if n > 0 {
+			return
+		}
+		time.Sleep(time.Millisecond)
+	}
+	t.Fatalf("nothing waiting at priority %d", prio)
+}
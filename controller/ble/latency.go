@@ -0,0 +1,65 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"time"
+)
+
+// The firmware's latency histograms (latency.h): per point, log2 buckets
+// of RTC ticks then the longest seen.
+const (
+	latencyBuckets  = 16
+	latencyPointLen = 2*latencyBuckets + 2
+	latencyTick     = time.Second / 32768
+)
+
+var latencyNames = []string{"command", "twi", "poll", "thermal"}
+
+type latencyHistogram struct {
+	buckets [latencyBuckets]int
+	max     time.Duration
+}
+
+func (h latencyHistogram) count() int {
+	n := 0
+	for _, c := range h.buckets {
+		n += c
+	}
+	return n
+}
+
+// percentile gives the upper edge of the bucket holding the p'th
+// percentile, so it is an upper bound within a factor of two.
+func (h latencyHistogram) percentile(p float64) time.Duration {
+	target := int(p / 100 * float64(h.count()))
+	seen := 0
+	for i, c := range h.buckets {
+		seen += c
+		if seen > target {
+			return time.Duration(1<<uint(i)) * latencyTick
+		}
+	}
+	return h.max
+}
+
+func (h latencyHistogram) String() string {
+	return fmt.Sprintf("%d samples, p50 < %v, p99 < %v, max %v",
+		h.count(), h.percentile(50), h.percentile(99), h.max)
+}
+
+func parseLatency(b []byte) ([]latencyHistogram, error) {
+	if len(b) == 0 || len(b)%latencyPointLen != 0 {
+		return nil, fmt.Errorf("bad latency length %d", len(b))
+	}
+	var hs []latencyHistogram
+	for r := b; len(r) > 0; r = r[latencyPointLen:] {
+		var h latencyHistogram
+		for i := range h.buckets {
+			h.buckets[i] = int(binary.LittleEndian.Uint16(r[2*i:]))
+		}
+		h.max = time.Duration(binary.LittleEndian.Uint16(r[2*latencyBuckets:])) * latencyTick
+		hs = append(hs, h)
+	}
+	return hs, nil
+}
@@ -0,0 +1,33 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestParseLatency(t *testing.T) {
+	b := make([]byte, 2*latencyPointLen)
+	// First point: 90 under a tick, 10 at 8-15 ticks, longest 12 ticks
+	b[0] = 90
+	b[2*4] = 10
+	b[2*latencyBuckets] = 12
+	hs, err := parseLatency(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(hs) != 2 || hs[0].count() != 100 || hs[1].count() != 0 {
+		t.Fatalf("got %+v", hs)
+	}
+	if p := hs[0].percentile(50); p != latencyTick {
+		t.Errorf("p50 %v", p)
+	}
+	if p := hs[0].percentile(95); p != 16*latencyTick {
+		t.Errorf("p95 %v", p)
+	}
+	if hs[0].max != 12*latencyTick || hs[0].max > time.Millisecond {
+		t.Errorf("max %v", hs[0].max)
+	}
+	if _, err := parseLatency(b[:10]); err == nil {
+		t.Error("partial histogram accepted")
+	}
+}
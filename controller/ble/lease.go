@@ -0,0 +1,85 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"time"
+)
+
+// Control lease (the firmware's lease.h). Each brick is given a lease
+// and a heartbeat renews it a few times over per length; should the
+// controller die or lose the link the lease lapses on the brick, which
+// goes back to its stored schedule, or failing that the fallback scene,
+// within the lease length and without anything more from here.
+const (
+	leaseMax     = 60 * time.Second
+	leaseNoScene = 0xff
+	// Renewals per lease length, so a lost heartbeat or two doesn't lapse it
+	leaseRenewals = 3
+)
+
+type leaseConfig struct {
+	record cmdRecord
+	length time.Duration
+	every  time.Duration
+	last   time.Time
+}
+
+func leaseRecord(length time.Duration, scene int) (cmdRecord, error) {
+	seconds := int(length / time.Second)
+	if seconds < 0 || length > leaseMax || (seconds == 0 && length != 0) {
+		return cmdRecord{}, fmt.Errorf("lease must be whole seconds up to %v, got %v", leaseMax, length)
+	}
+	s := byte(leaseNoScene)
+	if scene >= 0 {
+		if scene >= sceneSlots {
+			return cmdRecord{}, fmt.Errorf("scene slot must be 0-%d, got %d", sceneSlots-1, scene)
+		}
+		s = byte(scene)
+	}
+	return cmdRecord{op: cmdOpLease, value: []byte{byte(seconds), byte(seconds >> 8), s}}, nil
+}
+
+func (ble *bleChannel) SetLease(length time.Duration, fallbackScene int) error {
+	r, err := leaseRecord(length, fallbackScene)
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if length == 0 {
+		ble.lease = nil
+		// Given up on every brick, so none fails over
+		ble.sendLease(r)
+		return nil
+	}
+	ble.lease = &leaseConfig{record: r, length: length, every: length / leaseRenewals}
+	return nil
+}
+
+// renewLeases sends the heartbeat to every brick once it's due
+func (ble *bleChannel) renewLeases(now time.Time) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if ble.lease == nil || now.Sub(ble.lease.last) < ble.lease.every {
+		return
+	}
+	ble.lease.last = now
+	ble.sendLease(ble.lease.record)
+}
+
+// Called with the lock held
+func (ble *bleChannel) sendLease(r cmdRecord) {
+	now := ble.clock.Now()
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if err := p.sendCommands(r); err != nil {
+			log.Printf("%s: lease: %s", p.gp.ID(), err)
+		} else if ble.lease != nil {
+			ble.leased(p.gp.ID(), now)
+		}
+	}
+}
@@ -0,0 +1,25 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+	"time"
+)
+
+func TestLeaseRecord(t *testing.T) {
+	r, err := leaseRecord(15*time.Second, 2)
+	if err != nil || r.op != cmdOpLease || !bytes.Equal(r.value, []byte{15, 0, 2}) {
+		t.Errorf("%+v, %v", r, err)
+	}
+	if r, err := leaseRecord(10*time.Second, -1); err != nil || r.value[2] != leaseNoScene {
+		t.Errorf("no scene %+v, %v", r, err)
+	}
+	for _, c := range []struct {
+		d     time.Duration
+		scene int
+	}{{90 * time.Second, -1}, {500 * time.Millisecond, -1}, {10 * time.Second, sceneSlots}} {
+		if _, err := leaseRecord(c.d, c.scene); err == nil {
+			t.Errorf("%v, scene %d accepted", c.d, c.scene)
+		}
+	}
+}
@@ -0,0 +1,173 @@
+package ble
+
+import (
+	"github.com/paypal/gatt"
+	"log"
+	"math/rand"
+	"time"
+)
+
+// LinkState is where a brick's connection stands. Bricks are found
+// advertising, connected, have their characteristics discovered, then
+// stay live while they keep sending. A brick that fails anywhere drops
+// back to discovered on its own, retried after a backoff, without
+// touching any other brick's link.
+type LinkState int
+
+const (
+	LinkDiscovered LinkState = iota
+	LinkConnecting
+	LinkDiscovering
+	LinkLive
+	// Silent for too long, being disconnected to start over
+	LinkStale
+)
+
+var linkStateNames = [...]string{"discovered", "connecting", "discovering", "live", "stale"}
+
+func (s LinkState) String() string {
+	if int(s) < len(linkStateNames) {
+		return linkStateNames[s]
+	}
+	return "unknown"
+}
+
+const (
+	linkBackoffMin = 2 * time.Second
+	linkBackoffMax = 5 * time.Minute
+	// To connect and finish discovery
+	linkConnectTimeout = 30 * time.Second
+	// A live brick sending nothing for this long is stale
+	linkStaleAfter = 5 * time.Minute
+)
+
+type brickLink struct {
+	p     gatt.Peripheral
+	state LinkState
+	since time.Time
+	// Index of the adapter holding the connection
+	adapter int
+	// Signal and time of the last advertisement the connection is
+	// planned on
+	rssi  int
+	heard time.Time
+	// Failures in a row, and when the next attempt may start
+	failures int
+	retryAt  time.Time
+}
+
+// linkBackoff is the wait after failures in a row, doubling to a cap,
+// spread by jitter (-1 to 1) up to a quarter either way so bricks that
+// failed together don't retry together
+func linkBackoff(failures int, jitter float64) time.Duration {
+	d := linkBackoffMin
+	for i := 1; i < failures && d < linkBackoffMax; i++ {
+		d *= 2
+	}
+	if d > linkBackoffMax {
+		d = linkBackoffMax
+	}
+	return d + time.Duration(jitter*float64(d)/4)
+}
+
+func (l *brickLink) set(state LinkState, now time.Time) {
+	l.state = state
+	l.since = now
+	if state == LinkLive {
+		l.failures = 0
+	}
+}
+
+// fail drops the link back to discovered, to retry after the backoff
+func (l *brickLink) fail(now time.Time) time.Duration {
+	l.failures++
+	wait := linkBackoff(l.failures, 2*rand.Float64()-1)
+	l.set(LinkDiscovered, now)
+	l.retryAt = now.Add(wait)
+	return wait
+}
+
+func (l *brickLink) canConnect(now time.Time) bool {
+	return l.state == LinkDiscovered && !now.Before(l.retryAt)
+}
+
+// link is id's link, made on first sight. Called with ble.lock held.
+func (ble *bleChannel) link(id string) *brickLink {
+	l := ble.links[id]
+	if l == nil {
+		l = &brickLink{since: ble.clock.Now()}
+		ble.links[id] = l
+	}
+	return l
+}
+
+// linkFailed abandons a connection attempt on p alone
+func (ble *bleChannel) linkFailed(p gatt.Peripheral) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	now := ble.clock.Now()
+	wait := ble.link(p.ID()).fail(now)
+	log.Printf("%s: connection failed, retrying in %v", p.ID(), wait.Truncate(time.Second))
+	p.Device().CancelConnection(p)
+	ble.planConnections(now)
+}
+
+// checkLinks gives up on connections that never finished and bricks
+// gone silent, so each is retried on its own
+func (ble *bleChannel) checkLinks(now time.Time) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	live := 0
+	for id, l := range ble.links {
+		switch l.state {
+		case LinkConnecting, LinkDiscovering:
+			if now.Sub(l.since) > linkConnectTimeout {
+				wait := l.fail(now)
+				log.Printf("%s: no connection after %v, retrying in %v", id, linkConnectTimeout,
+					wait.Truncate(time.Second))
+				l.p.Device().CancelConnection(l.p)
+			}
+		case LinkLive:
+			bp := ble.connectedPeriph[id]
+			if bp != nil && now.Sub(bp.readings.lastHeard()) > linkStaleAfter {
+				log.Printf("%s: nothing heard for %v, reconnecting", id, linkStaleAfter)
+				l.set(LinkStale, now)
+				l.p.Device().CancelConnection(l.p)
+				continue
+			}
+			if bp != nil {
+				bp.pollLink(now)
+			}
+			live++
+		case LinkStale:
+			// The disconnect never came through
+			if now.Sub(l.since) > linkConnectTimeout {
+				if bp := ble.connectedPeriph[id]; bp != nil {
+					bp.active = false
+					bp.states.close()
+					delete(ble.connectedPeriph, id)
+				}
+				l.fail(now)
+			}
+		}
+	}
+	if live != ble.liveLinks {
+		log.Printf("%d bricks live", live)
+		ble.liveLinks = live
+	}
+	ble.fleetLive(now)
+	ble.planConnections(now)
+	if ble.expected > 0 {
+		ble.setScanning(live < ble.expected)
+	}
+}
+
+func (ble *bleChannel) Links() map[string]LinkState {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	states := make(map[string]LinkState, len(ble.links))
+	for id, l := range ble.links {
+		states[id] = l.state
+	}
+	return states
+}
@@ -0,0 +1,48 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestLinkBackoff(t *testing.T) {
+	if d := linkBackoff(1, 0); d != linkBackoffMin {
+		t.Errorf("first backoff %v", d)
+	}
+	if d := linkBackoff(3, 0); d != 4*linkBackoffMin {
+		t.Errorf("third backoff %v", d)
+	}
+	if d := linkBackoff(100, 0); d != linkBackoffMax {
+		t.Errorf("backoff not capped: %v", d)
+	}
+	if lo, hi := linkBackoff(1, -1), linkBackoff(1, 0.999); lo < linkBackoffMin*3/4 || hi >= linkBackoffMin*5/4 {
+		t.Errorf("jitter spread %v-%v", lo, hi)
+	}
+}
+
+func TestBrickLink(t *testing.T) {
+	now := time.Now()
+	l := &brickLink{}
+	if !l.canConnect(now) {
+		t.Error("new link can't connect")
+	}
+	l.set(LinkConnecting, now)
+	if l.canConnect(now) {
+		t.Error("connecting link can connect again")
+	}
+	wait := l.fail(now)
+	if l.state != LinkDiscovered || l.failures != 1 {
+		t.Errorf("failed link %s after %d failures", l.state, l.failures)
+	}
+	if l.canConnect(now) || !l.canConnect(now.Add(wait)) {
+		t.Error("retry not held off for the backoff")
+	}
+	l.fail(now)
+	l.set(LinkLive, now)
+	if l.failures != 0 {
+		t.Error("live link kept its failures")
+	}
+	if LinkStale.String() != "stale" {
+		t.Errorf("stale named %q", LinkStale)
+	}
+}
@@ -0,0 +1,90 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"sync/atomic"
+)
+
+// The link as the brick sees it (the firmware's link_stats.h). The
+// SoftDevice counts no CRC errors, so disconnects by reason stand in:
+// supervision timeouts and MIC failures are the link failing. Firmware
+// with adaptive transmit power adds its power and changes after.
+const (
+	linkStatsLen     = 32
+	linkStatsTxLen   = 35
+	linkStatsReasons = 6
+)
+
+var linkReasonNames = []string{"timeout", "central", "brick", "mic", "establish", "other"}
+
+type linkStats struct {
+	connections, events, packets, writes uint32
+	disconnects                          [linkStatsReasons]uint16
+	lastReason                           uint8
+	// dBm, 0 before the first sample
+	rssi, rssiAvg, rssiMin int
+	// The brick's transmit power in dBm and its changes, with hasTx
+	hasTx     bool
+	txPower   int
+	txChanges uint16
+}
+
+func parseLinkStats(b []byte) (linkStats, error) {
+	if len(b) < linkStatsLen {
+		return linkStats{}, fmt.Errorf("short link stats (%d bytes)", len(b))
+	}
+	s := linkStats{
+		connections: binary.LittleEndian.Uint32(b[0:]),
+		events:      binary.LittleEndian.Uint32(b[4:]),
+		packets:     binary.LittleEndian.Uint32(b[8:]),
+		writes:      binary.LittleEndian.Uint32(b[12:]),
+		lastReason:  b[28],
+		rssi:        int(int8(b[29])),
+		rssiAvg:     int(int8(b[30])),
+		rssiMin:     int(int8(b[31])),
+	}
+	for i := range s.disconnects {
+		s.disconnects[i] = binary.LittleEndian.Uint16(b[16+2*i:])
+	}
+	if len(b) >= linkStatsTxLen {
+		s.hasTx = true
+		s.txPower = int(int8(b[32]))
+		s.txChanges = binary.LittleEndian.Uint16(b[33:])
+	}
+	return s, nil
+}
+
+func (s linkStats) String() string {
+	r := fmt.Sprintf("%d dBm (average %d, lowest %d), %d connections, %d events, %d packets sent, %d writes",
+		s.rssi, s.rssiAvg, s.rssiMin, s.connections, s.events, s.packets, s.writes)
+	for i, n := range s.disconnects {
+		if n != 0 {
+			r += fmt.Sprintf(", %d %s", n, linkReasonNames[i])
+		}
+	}
+	if s.hasTx {
+		r += fmt.Sprintf(", sending at %d dBm (%d changes)", s.txPower, s.txChanges)
+	}
+	if s.connections > 1 {
+		r += fmt.Sprintf(", last down for 0x%02x", s.lastReason)
+	}
+	return r
+}
+
+// Log the link from the brick's end, and grade it on the weaker signal
+// of the two
+func (p *blePeriph) logLinkStats() error {
+	b, err := p.bulk.request(bulkCmdLinkStats, nil, bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	s, err := parseLinkStats(b)
+	if err != nil {
+		return err
+	}
+	atomic.StoreInt64(&p.metrics.linkRssi, int64(s.rssiAvg))
+	log.Printf("%s: link: %s", p.gp.ID(), s)
+	return nil
+}
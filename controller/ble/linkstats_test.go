@@ -0,0 +1,48 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+)
+
+func TestParseLinkStats(t *testing.T) {
+	b := make([]byte, linkStatsLen)
+	binary.LittleEndian.PutUint32(b[0:], 3)
+	binary.LittleEndian.PutUint32(b[4:], 12000)
+	binary.LittleEndian.PutUint16(b[16:], 2) // Supervision timeouts
+	binary.LittleEndian.PutUint16(b[22:], 1) // MIC failure
+	b[28] = 0x08
+	b[29], b[30], b[31] = byte(0xc4), byte(0xc2), byte(0xb5) // -60, -62, -75
+	s, err := parseLinkStats(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if s.connections != 3 || s.events != 12000 || s.disconnects[0] != 2 || s.disconnects[3] != 1 {
+		t.Errorf("%+v", s)
+	}
+	if s.rssi != -60 || s.rssiAvg != -62 || s.rssiMin != -75 || s.lastReason != 0x08 {
+		t.Errorf("rssi %+v", s)
+	}
+	if s.hasTx {
+		t.Error("transmit power from older firmware")
+	}
+	if _, err := parseLinkStats(b[:linkStatsLen-1]); err == nil {
+		t.Error("short stats accepted")
+	}
+
+	b = append(b, byte(0xf8), 5, 0) // -8 dBm, 5 changes
+	if s, err = parseLinkStats(b); err != nil {
+		t.Fatal(err)
+	}
+	if !s.hasTx || s.txPower != -8 || s.txChanges != 5 {
+		t.Errorf("transmit power %+v", s)
+	}
+}
+
+func TestWeakerRssi(t *testing.T) {
+	for _, c := range []struct{ a, b, want int }{{-60, -80, -80}, {-80, -60, -80}, {0, -70, -70}, {-70, 0, -70}, {0, 0, 0}} {
+		if got := weakerRssi(c.a, c.b); got != c.want {
+			t.Errorf("weakerRssi(%d, %d) = %d", c.a, c.b, got)
+		}
+	}
+}
@@ -0,0 +1,270 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"github.com/paypal/gatt"
+	"github.com/theatrus/ledbrick/controller/clock"
+	"math/rand"
+	"sort"
+	"sync"
+	"time"
+)
+
+// A simulated radio, for load testing the controller against more bricks
+// than are to hand. Each simulated brick sits behind the real writer,
+// frame queue, level cache and command acks; only the peripheral is
+// fake. Writes land on the brick's next connection event, after the
+// latency, or are lost; each one that lands is acked, and telemetry is
+// notified on its own interval.
+type SimConfig struct {
+	Bricks int
+	// Time between a brick's connection events, each brick at its own
+	// offset
+	ConnectionInterval time.Duration
+	// From the connection event to the brick applying the write
+	Latency time.Duration
+	// Fraction of writes lost, 0 to 1
+	Loss float64
+	// Between telemetry notifications, 0 for none
+	TelemetryInterval time.Duration
+	// The controller's time, the real clock if nil. The bricks' radio
+	// runs in real time either way.
+	Clock clock.Clock
+}
+
+// simPeriph is one simulated brick. Only the calls the writer makes are
+// implemented.
+type simPeriph struct {
+	gatt.Peripheral
+	id     string
+	cfg    SimConfig
+	offset time.Duration
+	// Applying the acks and telemetry
+	bp *blePeriph
+
+	// Channel 0 level as each write landed, and the command acks
+	applied []simApply
+	ackSeq  uint8
+	ackBits uint32
+	acked   bool
+	rand    *rand.Rand
+
+	lock sync.Mutex
+}
+
+type simApply struct {
+	at    time.Time
+	level int
+}
+
+func (sp *simPeriph) ID() string   { return sp.id }
+func (sp *simPeriph) Name() string { return brickName }
+
+// nextEvent is the brick's first connection event after now
+func (sp *simPeriph) nextEvent(now time.Time) time.Time {
+	interval := sp.cfg.ConnectionInterval
+	if interval <= 0 {
+		return now
+	}
+	since := (now.UnixNano() - int64(sp.offset)) % int64(interval)
+	return now.Add(interval - time.Duration(since))
+}
+
+// WriteCharacteristic holds the write for the next connection event, as
+// a full controller buffer would, then has it land after the latency
+func (sp *simPeriph) WriteCharacteristic(c *gatt.Characteristic, b []byte, noRsp bool) error {
+	event := sp.nextEvent(time.Now())
+	time.Sleep(time.Until(event))
+	sp.lock.Lock()
+	lost := sp.rand.Float64() < sp.cfg.Loss
+	sp.lock.Unlock()
+	if lost || len(b) < cmdHeaderLen || b[0] != cmdVersion {
+		return nil
+	}
+	b = append([]byte(nil), b...)
+	time.AfterFunc(sp.cfg.Latency, func() { sp.land(b) })
+	return nil
+}
+
+// land applies a command write and acks it
+func (sp *simPeriph) land(b []byte) {
+	now := time.Now()
+	sp.lock.Lock()
+	seq := b[1]
+	switch back := seq - sp.ackSeq; {
+	case !sp.acked:
+		sp.ackSeq, sp.ackBits, sp.acked = seq, 1, true
+	case back < 0x80:
+		sp.ackSeq, sp.ackBits = seq, sp.ackBits<<back|1
+	case sp.ackSeq-seq < cmdWindow:
+		// Overtaken by a later write
+		sp.ackBits |= 1 << (sp.ackSeq - seq)
+	}
+	// A packed frame with channel 0 in it
+	if len(b) >= 10 && b[2] == cmdOpFramePacked && b[4]&1 != 0 {
+		sp.applied = append(sp.applied, simApply{at: now, level: int(b[8]) | int(b[9]&0xf)<<8})
+	}
+	ack := make([]byte, cmdAckLen)
+	ack[0], ack[1] = cmdVersion, sp.ackSeq
+	binary.LittleEndian.PutUint32(ack[2:], sp.ackBits)
+	sp.lock.Unlock()
+	sp.bp.onCommandAck(sp.id, ack)
+}
+
+// telemetry notifies a steady temperature and fan until done closes
+func (sp *simPeriph) telemetry(done chan struct{}) {
+	t := time.NewTicker(sp.cfg.TelemetryInterval)
+	defer t.Stop()
+	start := time.Now()
+	for {
+		select {
+		case <-done:
+			return
+		case now := <-t.C:
+			sp.lock.Lock()
+			temperature16 := 25*16 + sp.rand.Intn(16)
+			sp.lock.Unlock()
+			b := make([]byte, telemetryLen)
+			binary.LittleEndian.PutUint16(b[0:], uint16(temperature16))
+			binary.LittleEndian.PutUint16(b[2:], 1200)
+			b[5], b[6], b[7] = 100, 40, telemetryTempValid
+			binary.LittleEndian.PutUint32(b[8:], uint32(now.Sub(start)/time.Second))
+			// Nothing sent on the tracked characteristics
+			binary.LittleEndian.PutUint16(b[14:], 0xffff)
+			sp.bp.onTelemetry(sp.id, b)
+		}
+	}
+}
+
+// SimChannel is a channel of simulated bricks
+type SimChannel struct {
+	BLEChannel
+	ble    *bleChannel
+	bricks []*simPeriph
+	done   chan struct{}
+}
+
+// NewSimChannel connects cfg.Bricks simulated bricks, all in the
+// default zone
+func NewSimChannel(cfg SimConfig) *SimChannel {
+	c := cfg.Clock
+	if c == nil {
+		c = clock.Real
+	}
+	ble := newBleChannel(nil, c)
+	sc := &SimChannel{BLEChannel: ble, ble: ble, done: make(chan struct{})}
+	svc := gatt.NewService(gatt.MustParseUUID(pwmService))
+	for i := 0; i < cfg.Bricks; i++ {
+		sp := &simPeriph{id: fmt.Sprintf("sim-%04d", i), cfg: cfg,
+			rand: rand.New(rand.NewSource(int64(i))),
+		}
+		if cfg.ConnectionInterval > 0 {
+			sp.offset = time.Duration(sp.rand.Int63n(int64(cfg.ConnectionInterval)))
+		}
+		bp := &blePeriph{gp: sp,
+			active:      true,
+			readings:    newBrickReadings(c.Now()),
+			timeSource:  c,
+			commandChar: gatt.NewCharacteristic(gatt.MustParseUUID(pwmCommandChar), svc, gatt.CharWriteNR, 0, 0),
+			cmds:        newCmdTracker(),
+			acks:        newCmdAcks(),
+			traces:      newCmdTraces(),
+			sync:        newBrickSync(),
+			states:      newStateQueue(),
+			lane:        newWriteLane(),
+			quality:     &linkQuality{},
+			sentLevels:  &levelCache{},
+			metrics:     ble.metrics.brick(sp.id),
+			history:     ble.history.brick(sp.id),
+		}
+		bp.path = bp.choosePath()
+		sp.bp = bp
+		sc.bricks = append(sc.bricks, sp)
+		ble.connectedPeriph[sp.id] = bp
+		go bp.runWriter()
+		if cfg.TelemetryInterval > 0 {
+			go sp.telemetry(sc.done)
+		}
+	}
+	go ble.run()
+	return sc
+}
+
+// Close stops the bricks, once their writers have finished
+func (sc *SimChannel) Close() {
+	sc.ble.idleTicker.Stop()
+	close(sc.done)
+	sc.ble.lock.Lock()
+	defer sc.ble.lock.Unlock()
+	for _, p := range sc.ble.connectedPeriph {
+		p.states.close()
+	}
+}
+
+// LoadReport is how long updates took to apply across every brick
+type LoadReport struct {
+	Updates int
+	Bricks  int
+	// Applied updates, and those a brick never applied before the next
+	// one was set
+	Applied int
+	Missed  int
+	P50     time.Duration
+	P90     time.Duration
+	P99     time.Duration
+	Max     time.Duration
+}
+
+func (r LoadReport) String() string {
+	return fmt.Sprintf("%d updates to %d bricks: %d applied, %d missed, p50 %v, p90 %v, p99 %v, max %v",
+		r.Updates, r.Bricks, r.Applied, r.Missed, r.P50, r.P90, r.P99, r.Max)
+}
+
+// LoadTest sets channel 0 to a new level every interval, flushing each
+// at once, and measures from each update to each brick applying it. The
+// last update gets one more interval plus the settle time to land.
+func (sc *SimChannel) LoadTest(updates int, every, settle time.Duration) LoadReport {
+	starts := make([]time.Time, updates)
+	levels := make([]int, updates)
+	for u := 0; u < updates; u++ {
+		// Neighbouring updates always differ
+		percent := float64(1 + u%99)
+		levels[u] = int(percent / 100 * ledMaxLevel)
+		starts[u] = time.Now()
+		sc.SetChannel(0, percent)
+		sc.Flush()
+		time.Sleep(every)
+	}
+	time.Sleep(settle)
+	end := time.Now()
+
+	r := LoadReport{Updates: updates, Bricks: len(sc.bricks)}
+	var took []time.Duration
+	for _, sp := range sc.bricks {
+		sp.lock.Lock()
+		applied := append([]simApply(nil), sp.applied...)
+		sp.lock.Unlock()
+		for u, start := range starts {
+			until := end
+			if u+1 < updates {
+				until = starts[u+1]
+			}
+			i := sort.Search(len(applied), func(i int) bool { return !applied[i].at.Before(start) })
+			for ; i < len(applied) && applied[i].at.Before(until) && applied[i].level != levels[u]; i++ {
+			}
+			if i < len(applied) && applied[i].at.Before(until) {
+				took = append(took, applied[i].at.Sub(start))
+			} else {
+				r.Missed++
+			}
+		}
+	}
+	r.Applied = len(took)
+	if len(took) > 0 {
+		sort.Slice(took, func(i, j int) bool { return took[i] < took[j] })
+		at := func(p float64) time.Duration { return took[int(p*float64(len(took)-1))] }
+		r.P50, r.P90, r.P99, r.Max = at(0.5), at(0.9), at(0.99), took[len(took)-1]
+	}
+	return r
+}
@@ -0,0 +1,66 @@
+package ble
+
+import (
+	"github.com/theatrus/ledbrick/controller/clock"
+	"sync/atomic"
+	"testing"
+	"time"
+)
+
+func TestLoadTest(t *testing.T) {
+	sc := NewSimChannel(SimConfig{Bricks: 20,
+		ConnectionInterval: 15 * time.Millisecond,
+		Latency:            5 * time.Millisecond,
+		TelemetryInterval:  20 * time.Millisecond,
+	})
+	defer sc.Close()
+	r := sc.LoadTest(10, 50*time.Millisecond, 0)
+	if r.Applied+r.Missed != 200 || r.Missed != 0 {
+		t.Fatalf("report %s", r)
+	}
+	// Within one connection interval and the latency, with slack for a
+	// loaded machine
+	if r.P50 < 5*time.Millisecond || r.Max > 45*time.Millisecond {
+		t.Errorf("report %s", r)
+	}
+	if n := atomic.LoadInt64(&sc.ble.metrics.brick("sim-0000").writes); n < 10 {
+		t.Errorf("%d writes", n)
+	}
+}
+
+func TestLoadTestLoss(t *testing.T) {
+	sc := NewSimChannel(SimConfig{Bricks: 20, ConnectionInterval: 10 * time.Millisecond, Loss: 0.5})
+	defer sc.Close()
+	r := sc.LoadTest(10, 30*time.Millisecond, 0)
+	if r.Missed == 0 || r.Applied == 0 {
+		t.Errorf("report %s", r)
+	}
+	lost := 0
+	for _, sp := range sc.bricks {
+		lost += sp.bp.acks.Lost()
+	}
+	if lost == 0 {
+		t.Error("no losses acked")
+	}
+}
+
+func TestSimClock(t *testing.T) {
+	sim := clock.NewSim(time.Date(2016, 1, 1, 0, 0, 0, 0, time.UTC))
+	sc := NewSimChannel(SimConfig{Bricks: 2, Clock: sim})
+	defer sc.Close()
+	sc.SetChannel(0, 40)
+	// Written on the simulated tick, long before a real one
+	sim.Advance(writeInterval)
+	want := int(40.0 / 100 * ledMaxLevel)
+	for i := 0; i < 100; i++ {
+		sp := sc.bricks[0]
+		sp.lock.Lock()
+		applied := len(sp.applied) > 0 && sp.applied[len(sp.applied)-1].level == want
+		sp.lock.Unlock()
+		if applied {
+			return
+		}
+		time.Sleep(5 * time.Millisecond)
+	}
+	t.Error("not written on the simulated tick")
+}
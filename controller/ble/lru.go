@@ -0,0 +1,70 @@
+package ble
+
+import (
+	"container/list"
+	"time"
+)
+
+// timeLRU holds a time per ID, at most max of them, forgetting an ID
+// once its time is ttl old. The least recently put go first, so with
+// times put in order both limits cost O(1) a call.
+type timeLRU struct {
+	max   int
+	ttl   time.Duration
+	items map[string]*list.Element
+	// Most recently put at the front
+	order *list.List
+}
+
+type lruEntry struct {
+	id string
+	at time.Time
+}
+
+func newTimeLRU(max int, ttl time.Duration) *timeLRU {
+	return &timeLRU{max: max, ttl: ttl, items: make(map[string]*list.Element), order: list.New()}
+}
+
+// get is id's time, if it has one that isn't ttl old at now
+func (c *timeLRU) get(id string, now time.Time) (time.Time, bool) {
+	e, ok := c.items[id]
+	if !ok {
+		return time.Time{}, false
+	}
+	at := e.Value.(*lruEntry).at
+	if now.Sub(at) >= c.ttl {
+		c.order.Remove(e)
+		delete(c.items, id)
+		return time.Time{}, false
+	}
+	return at, true
+}
+
+// put sets id's time, dropping the oldest beyond max or ttl old
+func (c *timeLRU) put(id string, at time.Time) {
+	if e, ok := c.items[id]; ok {
+		e.Value.(*lruEntry).at = at
+		c.order.MoveToFront(e)
+	} else {
+		c.items[id] = c.order.PushFront(&lruEntry{id: id, at: at})
+	}
+	for back := c.order.Back(); back != nil; back = c.order.Back() {
+		old := back.Value.(*lruEntry)
+		if len(c.items) <= c.max && at.Sub(old.at) < c.ttl {
+			break
+		}
+		c.order.Remove(back)
+		delete(c.items, old.id)
+	}
+}
+
+func (c *timeLRU) remove(id string) {
+	if e, ok := c.items[id]; ok {
+		c.order.Remove(e)
+		delete(c.items, id)
+	}
+}
+
+func (c *timeLRU) len() int {
+	return len(c.items)
+}
@@ -0,0 +1,32 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestTimeLRU(t *testing.T) {
+	c := newTimeLRU(2, time.Minute)
+	now := time.Now()
+	c.put("a", now)
+	c.put("b", now.Add(time.Second))
+	c.put("a", now.Add(2*time.Second))
+	c.put("c", now.Add(3*time.Second))
+	if _, ok := c.get("b", now.Add(3*time.Second)); ok || c.len() != 2 {
+		t.Errorf("least recent kept, %d held", c.len())
+	}
+	if at, ok := c.get("a", now.Add(3*time.Second)); !ok || !at.Equal(now.Add(2*time.Second)) {
+		t.Errorf("a at %v, %v", at, ok)
+	}
+	if _, ok := c.get("a", now.Add(2*time.Second+time.Minute)); ok {
+		t.Error("a kept past its ttl")
+	}
+	c.put("d", now.Add(5*time.Minute))
+	if c.len() != 1 {
+		t.Errorf("%d held after the rest aged out", c.len())
+	}
+	c.remove("d")
+	if _, ok := c.get("d", now.Add(5*time.Minute)); ok || c.len() != 0 {
+		t.Error("d not removed")
+	}
+}
@@ -0,0 +1,284 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"time"
+)
+
+// MaintenanceWindow is when bulk work on the bricks (history backfill,
+// burn-in, firmware transfers) may run: while the schedule a brick is
+// running holds flat for the whole job, and dark too for jobs that take
+// over its lights, and only a few at once through each adapter, so the
+// links are left to the frames.
+type MaintenanceWindow struct {
+	// Flat is no channel moving more than this many percent over a job
+	FlatPercent float64
+	// Dark is every channel at or below this percent
+	DarkPercent float64
+	// Jobs at once through each adapter, firmware transfers included
+	PerAdapter int
+	// A job left waiting this long takes the next slot anyway, so a
+	// schedule that never rests doesn't hold it for good, 0 to wait
+	MaxWait time.Duration
+}
+
+var DefaultMaintenanceWindow = MaintenanceWindow{FlatPercent: 2, DarkPercent: 5, PerAdapter: 1, MaxWait: 12 * time.Hour}
+
+func (w MaintenanceWindow) validate() error {
+	switch {
+	case w.FlatPercent < 0 || w.FlatPercent > 100:
+		return fmt.Errorf("flat must be 0-100%%, got %g", w.FlatPercent)
+	case w.DarkPercent < 0 || w.DarkPercent > 100:
+		return fmt.Errorf("dark must be 0-100%%, got %g", w.DarkPercent)
+	case w.PerAdapter < 1:
+		return fmt.Errorf("at least one job per adapter, got %d", w.PerAdapter)
+	case w.MaxWait < 0:
+		return fmt.Errorf("longest wait must be positive or 0, got %v", w.MaxWait)
+	}
+	return nil
+}
+
+const (
+	maintBackfill = "history backfill"
+	maintBurnIn   = "burn-in"
+	// Reading back a day of history, enough for most
+	maintBackfillTime = 2 * time.Minute
+	// A firmware transfer, then back on the new one
+	maintFirmwareTime = dfuHealthTimeout
+)
+
+type maintJob struct {
+	kind string
+	id   string
+	// How long it holds the link, and how far ahead the schedule is
+	// checked
+	length time.Duration
+	// Takes over the lights, or turns them off
+	dark bool
+	// Radio time it takes of its adapter, roughly (airtime.go)
+	air    time.Duration
+	queued time.Time
+	run    func() error
+}
+
+// Bulk jobs waiting for their bricks' windows, and those running by
+// adapter
+type maintenance struct {
+	window  MaintenanceWindow
+	jobs    []*maintJob
+	running map[int]int
+}
+
+func newMaintenance(w MaintenanceWindow) *maintenance {
+	return &maintenance{window: w, running: make(map[int]int)}
+}
+
+// queue adds j, in place of one of its kind already waiting for the brick
+func (m *maintenance) queue(j *maintJob) {
+	for i, q := range m.jobs {
+		if q.kind == j.kind && q.id == j.id {
+			j.queued = q.queued
+			m.jobs[i] = j
+			return
+		}
+	}
+	m.jobs = append(m.jobs, j)
+}
+
+// cancel drops every waiting job of kind
+func (m *maintenance) cancel(kind string) {
+	waiting := m.jobs[:0]
+	for _, j := range m.jobs {
+		if j.kind != kind {
+			waiting = append(waiting, j)
+		}
+	}
+	m.jobs = waiting
+}
+
+// free is whether adapter has a slot, with busy firmware transfers of
+// its own going
+func (m *maintenance) free(adapter, busy int) bool {
+	return m.running[adapter]+busy < m.window.PerAdapter
+}
+
+// open is whether j can start now on a brick running s, nil for none,
+// and being written live. Without a schedule only the levels now are
+// known, so those have to be dark for a dark job.
+func (m *maintenance) open(j *maintJob, s *schedule, live *ledState, loc *time.Location, now time.Time) bool {
+	if m.window.MaxWait > 0 && now.Sub(j.queued) >= m.window.MaxWait {
+		return true
+	}
+	if j.dark {
+		for _, percent := range live.percents {
+			if percent > m.window.DarkPercent {
+				return false
+			}
+		}
+	}
+	if s == nil {
+		return true
+	}
+	swing, high := s.window(now.In(loc), j.length)
+	return swing <= m.window.FlatPercent && (!j.dark || high <= m.window.DarkPercent)
+}
+
+// percentsAt is where the schedule is t seconds into the day, as the
+// firmware works it out (curve.go)
+func (s *schedule) percentsAt(t uint32) []float64 {
+	levels := s.levelsAt(t)
+	percents := make([]float64, len(levels))
+	for i, level := range levels {
+		percents[i] = float64(level) * 100 / ledMaxLevel
+	}
+	return percents
+}
+
+// window is how far the schedule's channels move over length from the
+// local time now, the most any one does, and the highest any goes
+func (s *schedule) window(now time.Time, length time.Duration) (swing, high float64) {
+	start := secondOfDay(now, now.Location())
+	minutes := int(math.Ceil(length.Minutes()))
+	low := make([]float64, s.channels)
+	top := make([]float64, s.channels)
+	for i := range low {
+		low[i] = math.Inf(1)
+		top[i] = math.Inf(-1)
+	}
+	// The points fall on whole minutes, so checking each finds every turn
+	for m := 0; m <= minutes; m++ {
+		for i, pct := range s.percentsAt((start + uint32(m)*60) % scheduleSecondsPerDay) {
+			low[i] = math.Min(low[i], pct)
+			top[i] = math.Max(top[i], pct)
+		}
+	}
+	for i := range low {
+		swing = math.Max(swing, top[i]-low[i])
+		high = math.Max(high, top[i])
+	}
+	return swing, high
+}
+
+// SetMaintenance holds history backfill, burn-ins and firmware updates
+// for w's windows from now on. Jobs already started are left to finish.
+func (ble *bleChannel) SetMaintenance(w MaintenanceWindow) error {
+	if err := w.validate(); err != nil {
+		return err
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if ble.maint != nil {
+		ble.maint.window = w
+		return nil
+	}
+	ble.maint = newMaintenance(w)
+	return nil
+}
+
+// queueMaintenance adds the bulk jobs p is owed, once it's connected.
+// Called with ble.lock held.
+func (ble *bleChannel) queueMaintenance(p *blePeriph, since, until time.Time, loc *time.Location) {
+	id, now := p.gp.ID(), ble.clock.Now()
+	if p.bulk != nil {
+		air := airTransfer(backfillMaxRounds * historyFrameBlocks * historyBlockLen)
+		ble.maint.queue(&maintJob{kind: maintBackfill, id: id, length: maintBackfillTime, air: air, queued: now,
+			run: func() error {
+				err := p.backfillHistory(since, until, loc)
+				if err == bulkError(bulkStatusUnknown) {
+					// Firmware without the history doesn't know the command
+					return nil
+				}
+				return err
+			}})
+	}
+	if ble.burnIn != nil && !ble.burnInSent[id] && p.commandChar != nil {
+		ble.queueBurnIn(p, *ble.burnIn, ble.burnInFor, now)
+	}
+}
+
+// queueBurnIn queues r on p, taking over its lights for length. Called
+// with ble.lock held.
+func (ble *bleChannel) queueBurnIn(p *blePeriph, r cmdRecord, length time.Duration, now time.Time) {
+	id := p.gp.ID()
+	ble.maint.queue(&maintJob{kind: maintBurnIn, id: id, length: length, dark: true, queued: now,
+		air: airWrite(airCommandLen, false),
+		run: func() error {
+			if err := p.sendCommands(r); err != nil {
+				return err
+			}
+			ble.lock.Lock()
+			ble.burnInSent[id] = true
+			ble.lock.Unlock()
+			return nil
+		}})
+}
+
+// maintOpen is whether a bulk job of length on brick id can start now
+// through adapter, being written s, with the airtime for it. Called with
+// ble.lock held.
+func (ble *bleChannel) maintOpen(j *maintJob, adapter int, s *ledState, now time.Time) bool {
+	if !ble.airOf(adapter).admits(j.air.Seconds() / j.length.Seconds()) {
+		return false
+	}
+	busy := 0
+	if ble.dfu != nil {
+		busy = ble.dfu.busy(adapter, now)
+	}
+	return ble.maint.free(adapter, busy) && ble.maint.open(j, ble.scheduleFor(j.id), s, ble.loc, now)
+}
+
+// firmwareWindow is whether brick id can take a firmware update now.
+// Called with ble.lock held.
+func (ble *bleChannel) firmwareWindow(id string, s *ledState, now time.Time) bool {
+	adapter := ble.link(id).adapter
+	air := airTransfer(len(ble.dfu.image.bin) + len(ble.dfu.image.dat))
+	if ble.maint == nil {
+		return ble.airOf(adapter).admits(air.Seconds() / maintFirmwareTime.Seconds())
+	}
+	// The rollout holds its own place in the queue, so judged from when
+	// it started
+	j := &maintJob{id: id, length: maintFirmwareTime, dark: true, air: air, queued: ble.dfu.started}
+	return ble.maintOpen(j, adapter, s, now)
+}
+
+// runMaintenance starts the jobs whose windows have come, given each
+// brick's state as written this tick, and drops those for bricks gone,
+// which queue again on reconnect. Called with ble.lock held.
+func (ble *bleChannel) runMaintenance(now time.Time, state *ledState, zoneStates map[string]*ledState) {
+	m := ble.maint
+	waiting := m.jobs[:0]
+	for _, j := range m.jobs {
+		if ble.connectedPeriph[j.id] == nil {
+			continue
+		}
+		s := state
+		if name, z := ble.zoneOf(j.id); z != nil {
+			s = zoneStates[name]
+		}
+		adapter := ble.link(j.id).adapter
+		if !ble.maintOpen(j, adapter, s, now) {
+			waiting = append(waiting, j)
+			continue
+		}
+		if m.window.MaxWait > 0 && now.Sub(j.queued) >= m.window.MaxWait {
+			log.Printf("%s: %s waited %v for a window, going anyway", j.id, j.kind, m.window.MaxWait)
+		}
+		m.running[adapter]++
+		go ble.runMaintJob(m, j, adapter)
+	}
+	for i := len(waiting); i < len(m.jobs); i++ {
+		m.jobs[i] = nil
+	}
+	m.jobs = waiting
+}
+
+func (ble *bleChannel) runMaintJob(m *maintenance, j *maintJob, adapter int) {
+	if err := j.run(); err != nil {
+		log.Printf("%s: %s: %s", j.id, j.kind, err)
+	}
+	ble.lock.Lock()
+	m.running[adapter]--
+	ble.lock.Unlock()
+}
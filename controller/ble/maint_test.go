@@ -0,0 +1,106 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+// Dark until 08:00, up to full by 10:00, down again 18:00-20:00
+var maintPoints = []SchedulePoint{
+	{Minute: 8 * 60, Percents: []float64{0, 0}},
+	{Minute: 10 * 60, Percents: []float64{100, 50}},
+	{Minute: 18 * 60, Percents: []float64{100, 50}},
+	{Minute: 20 * 60, Percents: []float64{0, 0}},
+}
+
+func TestScheduleWindow(t *testing.T) {
+	s, err := newSchedule(maintPoints)
+	if err != nil {
+		t.Fatal(err)
+	}
+	at := func(h, m int) time.Time { return time.Date(2020, 1, 1, h, m, 0, 0, time.UTC) }
+
+	if p := s.percentsAt(9 * 3600); p[0] != 50 || p[1] != 25 {
+		t.Errorf("halfway up at %v", p)
+	}
+	// Round midnight, from the last point to the first
+	if p := s.percentsAt(2 * 3600); p[0] != 0 {
+		t.Errorf("night at %v", p)
+	}
+	for _, c := range []struct {
+		at           time.Time
+		length       time.Duration
+		swing, high  float64
+		flat, bright bool
+	}{
+		{at: at(2, 0), length: time.Hour, swing: 0, high: 0},
+		{at: at(12, 0), length: time.Hour, swing: 0, high: 100},
+		// Runs into the morning ramp by 6 minutes
+		{at: at(7, 54), length: 12 * time.Minute, swing: 5, high: 5},
+		{at: at(23, 30), length: time.Hour, swing: 0, high: 0},
+	} {
+		swing, high := s.window(c.at, c.length)
+		if swing != c.swing || high != c.high {
+			t.Errorf("%v for %v: swing %g high %g, want %g %g", c.at.Format("15:04"), c.length, swing, high, c.swing, c.high)
+		}
+	}
+}
+
+func TestMaintenanceOpen(t *testing.T) {
+	s, _ := newSchedule(maintPoints)
+	m := newMaintenance(MaintenanceWindow{FlatPercent: 2, DarkPercent: 5, PerAdapter: 1, MaxWait: 12 * time.Hour})
+	dark := &ledState{}
+	lit := &ledState{percents: [frameChannels]float64{100, 50}}
+	noon := time.Date(2020, 1, 1, 12, 0, 0, 0, time.UTC)
+	night := time.Date(2020, 1, 1, 2, 0, 0, 0, time.UTC)
+
+	backfill := &maintJob{kind: maintBackfill, id: "a", length: maintBackfillTime, queued: noon}
+	burnIn := &maintJob{kind: maintBurnIn, id: "a", length: time.Hour, dark: true, queued: noon}
+	if !m.open(backfill, s, lit, time.UTC, noon) {
+		t.Error("backfill held through a flat afternoon")
+	}
+	if m.open(burnIn, s, lit, time.UTC, noon) || !m.open(burnIn, s, dark, time.UTC, night) {
+		t.Error("burn-in not held for the night")
+	}
+	ramp := time.Date(2020, 1, 1, 9, 0, 0, 0, time.UTC)
+	long := &maintJob{kind: maintBackfill, id: "a", length: 10 * time.Minute, queued: noon}
+	if m.open(long, s, lit, time.UTC, ramp) {
+		t.Error("backfill went during the morning ramp")
+	}
+	// Held too long, it goes anyway
+	if !m.open(burnIn, s, lit, time.UTC, noon.Add(12*time.Hour)) {
+		t.Error("burn-in never went")
+	}
+	// Without a schedule only the levels now count
+	if !m.open(backfill, nil, lit, time.UTC, noon) || m.open(burnIn, nil, lit, time.UTC, noon) {
+		t.Error("judged a schedule that isn't there")
+	}
+
+	if !m.free(0, 0) {
+		t.Error("idle adapter full")
+	}
+	m.running[0]++
+	if m.free(0, 0) || !m.free(1, 0) || m.free(1, 1) {
+		t.Error("adapter slots not counted apart")
+	}
+}
+
+func TestMaintenanceQueue(t *testing.T) {
+	m := newMaintenance(DefaultMaintenanceWindow)
+	then := time.Now()
+	m.queue(&maintJob{kind: maintBackfill, id: "a", queued: then})
+	m.queue(&maintJob{kind: maintBurnIn, id: "a", queued: then})
+	m.queue(&maintJob{kind: maintBackfill, id: "a", queued: then.Add(time.Hour)})
+	m.queue(&maintJob{kind: maintBackfill, id: "b", queued: then})
+	if len(m.jobs) != 3 || !m.jobs[0].queued.Equal(then) {
+		t.Fatalf("%d jobs queued, the first from %v", len(m.jobs), m.jobs[0].queued)
+	}
+	m.cancel(maintBurnIn)
+	if len(m.jobs) != 2 {
+		t.Errorf("%d jobs left after cancelling burn-ins", len(m.jobs))
+	}
+
+	if err := (MaintenanceWindow{PerAdapter: 0}).validate(); err == nil {
+		t.Error("no slots accepted")
+	}
+}
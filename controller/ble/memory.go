@@ -0,0 +1,175 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"strings"
+	"sync/atomic"
+)
+
+// Stack, heap and queue high-water marks, laid out in the firmware's
+// mem_stats.h: a size and the most it has held since boot for each,
+// then the block pools (pool.h) with the allocs each failed. Tickless
+// firmware (tick.h) adds its timer wakeups in the last hour and since
+// boot after, and newer firmware where its CPU time went after that
+// (cpu_stats.h): the last window's length and each category's share of
+// it in RTC ticks, then the busiest window since boot awake.
+const (
+	memStatsLen  = 24
+	memBlockPool = 8
+	memWakeupsAt = memStatsLen + len(blockPoolNames)*memBlockPool
+	memCPUAt     = memWakeupsAt + 8
+	memCPULen    = 4 + 4*len(cpuCategoryNames) + 2
+)
+
+// In cpu_category_t order, sleep last
+var cpuCategoryNames = [...]string{"ble", "timers", "twi", "scheduler", "sleep"}
+
+var memPoolNames = [...]string{"stack", "heap", "scheduler", "timer ops", "flash ops", "twi"}
+
+var blockPoolNames = [...]string{"small", "large"}
+
+// A pool this full at its peak is logged as short of room
+const memTight = 0.85
+
+type memPool struct {
+	size, peak uint16
+}
+
+type blockPool struct {
+	memPool
+	exhausted uint32
+}
+
+type memStats struct {
+	pools [len(memPoolNames)]memPool
+	// Firmware before the block pools has none
+	blocks []blockPool
+	// With hasWakeups
+	hasWakeups           bool
+	wakeupsHour, wakeups uint32
+	// With hasCPU, 0 for the window until one has closed
+	hasCPU    bool
+	cpuWindow uint32
+	cpuTicks  [len(cpuCategoryNames)]uint32
+	// 1/100 percent awake
+	cpuPeak uint16
+}
+
+// cpuShare is the last window's share of ticks, 0 before one closed
+func (s memStats) cpuShare(ticks uint32) float64 {
+	if s.cpuWindow == 0 {
+		return 0
+	}
+	return float64(ticks) / float64(s.cpuWindow)
+}
+
+// cpuBusy is the last window's share awake
+func (s memStats) cpuBusy() float64 {
+	return 1 - s.cpuShare(s.cpuTicks[len(s.cpuTicks)-1])
+}
+
+func parseMemStats(b []byte) (memStats, error) {
+	var s memStats
+	if len(b) < memStatsLen {
+		return s, fmt.Errorf("short memory stats (%d bytes)", len(b))
+	}
+	for i := range s.pools {
+		s.pools[i] = memPool{size: binary.LittleEndian.Uint16(b[4*i:]), peak: binary.LittleEndian.Uint16(b[4*i+2:])}
+	}
+	for at := memStatsLen; at+memBlockPool <= len(b) && len(s.blocks) < len(blockPoolNames); at += memBlockPool {
+		s.blocks = append(s.blocks, blockPool{
+			memPool:   memPool{size: binary.LittleEndian.Uint16(b[at:]), peak: binary.LittleEndian.Uint16(b[at+2:])},
+			exhausted: binary.LittleEndian.Uint32(b[at+4:]),
+		})
+	}
+	if len(b) >= memWakeupsAt+8 {
+		s.hasWakeups = true
+		s.wakeupsHour = binary.LittleEndian.Uint32(b[memWakeupsAt:])
+		s.wakeups = binary.LittleEndian.Uint32(b[memWakeupsAt+4:])
+	}
+	if len(b) >= memCPUAt+memCPULen {
+		s.hasCPU = true
+		s.cpuWindow = binary.LittleEndian.Uint32(b[memCPUAt:])
+		for i := range s.cpuTicks {
+			s.cpuTicks[i] = binary.LittleEndian.Uint32(b[memCPUAt+4+4*i:])
+		}
+		s.cpuPeak = binary.LittleEndian.Uint16(b[memCPUAt+4+4*len(s.cpuTicks):])
+	}
+	return s, nil
+}
+
+// tight is the pools that have come close to running out
+func (s memStats) tight() []string {
+	var names []string
+	for i, p := range s.pools {
+		if p.size > 0 && float64(p.peak) >= memTight*float64(p.size) {
+			names = append(names, memPoolNames[i])
+		}
+	}
+	for i, p := range s.blocks {
+		if p.exhausted > 0 || (p.size > 0 && float64(p.peak) >= memTight*float64(p.size)) {
+			names = append(names, blockPoolNames[i]+" blocks")
+		}
+	}
+	return names
+}
+
+func (s memStats) String() string {
+	var parts []string
+	for i, p := range s.pools {
+		parts = append(parts, fmt.Sprintf("%s %d/%d", memPoolNames[i], p.peak, p.size))
+	}
+	for i, p := range s.blocks {
+		part := fmt.Sprintf("%s blocks %d/%d", blockPoolNames[i], p.peak, p.size)
+		if p.exhausted > 0 {
+			part += fmt.Sprintf(" (%d failed)", p.exhausted)
+		}
+		parts = append(parts, part)
+	}
+	if s.hasWakeups {
+		parts = append(parts, fmt.Sprintf("%d wakeups/h (%d since boot)", s.wakeupsHour, s.wakeups))
+	}
+	if s.hasCPU && s.cpuWindow > 0 {
+		// What the categories leave ran uncounted
+		other := s.cpuBusy()
+		var shares []string
+		for i, name := range cpuCategoryNames[:len(cpuCategoryNames)-1] {
+			share := s.cpuShare(s.cpuTicks[i])
+			other -= share
+			shares = append(shares, fmt.Sprintf("%s %.1f%%", name, 100*share))
+		}
+		if other < 0 {
+			other = 0
+		}
+		parts = append(parts, fmt.Sprintf("cpu %.1f%% (%s, other %.1f%%), peak %.1f%%", 100*s.cpuBusy(),
+			strings.Join(shares, " "), 100*other, float64(s.cpuPeak)/100))
+	}
+	r := strings.Join(parts, ", ")
+	if t := s.tight(); len(t) > 0 {
+		r += ", short of " + strings.Join(t, " ")
+	}
+	return r
+}
+
+// Log how near the brick's RAM has come to running out
+func (p *blePeriph) logMemory() error {
+	b, err := p.bulk.request(bulkCmdMemory, nil, bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	s, err := parseMemStats(b)
+	if err != nil {
+		return err
+	}
+	atomic.StoreInt64(&p.metrics.stackPeak, int64(s.pools[0].peak))
+	if s.hasWakeups {
+		atomic.StoreInt64(&p.metrics.wakeupsHour, int64(s.wakeupsHour))
+	}
+	if s.hasCPU && s.cpuWindow > 0 {
+		atomic.StoreInt64(&p.metrics.cpuBusy, int64(10000*s.cpuBusy()+0.5))
+	}
+	log.Printf("%s: memory: %s", p.gp.ID(), s)
+	return nil
+}
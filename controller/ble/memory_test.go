@@ -0,0 +1,86 @@
+package ble
+
+import (
+	"encoding/binary"
+	"math"
+	"strings"
+	"testing"
+)
+
+func TestParseMemStats(t *testing.T) {
+	b := make([]byte, memStatsLen)
+	for i, v := range []uint16{2048, 1210, 2048, 0, 16, 15, 8, 3, 12, 4, 16, 9} {
+		binary.LittleEndian.PutUint16(b[2*i:], v)
+	}
+	s, err := parseMemStats(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if s.pools[0] != (memPool{2048, 1210}) || s.pools[2] != (memPool{16, 15}) || s.pools[5] != (memPool{16, 9}) {
+		t.Errorf("%+v", s)
+	}
+	if len(s.blocks) != 0 {
+		t.Errorf("blocks %+v", s.blocks)
+	}
+	if tight := s.tight(); len(tight) != 1 || tight[0] != "scheduler" {
+		t.Errorf("tight %v", tight)
+	}
+	if !strings.Contains(s.String(), "stack 1210/2048") {
+		t.Error(s)
+	}
+
+	pools := make([]byte, 2*memBlockPool)
+	binary.LittleEndian.PutUint16(pools[0:], 18)
+	binary.LittleEndian.PutUint16(pools[2:], 7)
+	binary.LittleEndian.PutUint16(pools[8:], 4)
+	binary.LittleEndian.PutUint16(pools[10:], 4)
+	binary.LittleEndian.PutUint32(pools[12:], 2)
+	s, err = parseMemStats(append(b, pools...))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(s.blocks) != 2 || s.blocks[0].peak != 7 || s.blocks[1].exhausted != 2 {
+		t.Errorf("blocks %+v", s.blocks)
+	}
+	if tight := s.tight(); len(tight) != 2 || tight[1] != "large blocks" {
+		t.Errorf("tight %v", tight)
+	}
+	if !strings.Contains(s.String(), "large blocks 4/4 (2 failed)") || s.hasWakeups {
+		t.Error(s)
+	}
+	wakeups := make([]byte, 8)
+	binary.LittleEndian.PutUint32(wakeups, 4321)
+	binary.LittleEndian.PutUint32(wakeups[4:], 98765)
+	s, err = parseMemStats(append(append(b, pools...), wakeups...))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !s.hasWakeups || s.wakeupsHour != 4321 || s.wakeups != 98765 || !strings.Contains(s.String(), "4321 wakeups/h") {
+		t.Errorf("wakeups %+v", s)
+	}
+	if s.hasCPU {
+		t.Error("cpu without its trailer")
+	}
+
+	// A minute: ble 2%, timers 5%, twi 1%, scheduler 2%, asleep 88%
+	cpu := make([]byte, memCPULen)
+	binary.LittleEndian.PutUint32(cpu, 60*32768)
+	for i, pct := range []uint32{2, 5, 1, 2, 88} {
+		binary.LittleEndian.PutUint32(cpu[4+4*i:], pct*60*32768/100)
+	}
+	binary.LittleEndian.PutUint16(cpu[4+4*5:], 2500)
+	s, err = parseMemStats(append(append(append(b, pools...), wakeups...), cpu...))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !s.hasCPU || s.cpuPeak != 2500 || math.Abs(s.cpuBusy()-0.12) > 1e-4 {
+		t.Errorf("cpu %+v, busy %v", s, s.cpuBusy())
+	}
+	if str := s.String(); !strings.Contains(str, "cpu 12.0% (ble 2.0% timers 5.0% twi 1.0% scheduler 2.0%, other 2.0%), peak 25.0%") {
+		t.Error(str)
+	}
+
+	if _, err := parseMemStats(b[:memStatsLen-1]); err == nil {
+		t.Error("short stats accepted")
+	}
+}
@@ -0,0 +1,350 @@
+package ble
+
+import (
+	"fmt"
+	"io"
+	"math"
+	"net/http"
+	"sort"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Per-brick metrics, kept across reconnects and exported in the
+// Prometheus text format. The notification handlers and writers only
+// touch atomics; the lock is for finding a brick's set on connect.
+type metrics struct {
+	bricks map[string]*brickMetrics
+
+	lock sync.Mutex
+}
+
+// Frame write latency buckets, seconds
+var writeBuckets = [...]float64{0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1}
+
+type brickMetrics struct {
+	// 64 bit words first, for atomic access on 32 bit ARM
+	writeNanos  int64
+	writes      int64
+	writeErrors int64
+	// Given up on at the deadline, see lane.go
+	writeTimeouts int64
+	writeBuckets  [len(writeBuckets)]int64
+	connects      int64
+	disconnects   int64
+	// 1/16 degree C, math.MinInt64 until read: the hotspot, then each
+	// sensor on boards reporting them
+	temperature16 int64
+	sensors16     [tempMaxSensors]int64
+	fanRpm        int64
+	// Each fan, math.MinInt64 for those the brick doesn't list
+	fans [fanMaxFans]int64
+	rssi int64
+	// At the brick, averaged over the connection, 0 until read
+	linkRssi     int64
+	lostCommands int64
+	// PCA9685 registers the brick's scrubber found wrong
+	registerRepairs int64
+	derate          int64
+	// Write intervals between frames, see quality.go
+	writeSpacing int64
+	// Most writes in flight at once in the last run, see pipeline.go
+	writeDepth int64
+	// What the link runs with, 0 until known, changes to it, and
+	// whether burst was asked for (connparams.go)
+	connInterval int64
+	connLatency  int64
+	connTimeout  int64
+	connUpdates  int64
+	connBurst    int64
+	// From the capability characteristic, 0 on firmware without one,
+	// and the write path chosen for it (caps.go)
+	protocol  int64
+	writePath int64
+	// Last firmware transfer, bytes a second (rollout.go)
+	dfuRate int64
+	// Deepest the brick's stack has gone since boot, 0 until read
+	// (memory.go)
+	stackPeak int64
+	// Timer wakeups in the brick's last hour, 0 until read (memory.go)
+	wakeupsHour int64
+	// 1/100 percent of the brick's last CPU window awake, 0 until read
+	// (memory.go)
+	cpuBusy int64
+	// Advertised telemetry taken while monitoring (monitor.go)
+	advUpdates int64
+	// The brick's clock against ours, parts per billion, math.MinInt64
+	// until fitted, and how well it's known as of the last sync answer
+	// (sync.go)
+	clockDriftPpb  int64
+	syncErrorNanos int64
+	// Command latency percentiles by stage and the traces they're
+	// taken over, 0 until traced (trace.go)
+	traceNanos  [traceStages][len(traceQuantiles)]int64
+	traceCounts [traceStages]int64
+}
+
+func newMetrics() *metrics {
+	return &metrics{bricks: make(map[string]*brickMetrics)}
+}
+
+func (m *metrics) brick(id string) *brickMetrics {
+	m.lock.Lock()
+	defer m.lock.Unlock()
+	b := m.bricks[id]
+	if b == nil {
+		b = &brickMetrics{temperature16: math.MinInt64, derate: 100, writeSpacing: 1, clockDriftPpb: math.MinInt64}
+		for i := range b.sensors16 {
+			b.sensors16[i] = math.MinInt64
+		}
+		for i := range b.fans {
+			b.fans[i] = math.MinInt64
+		}
+		m.bricks[id] = b
+	}
+	return b
+}
+
+func (b *brickMetrics) observeWrite(d time.Duration, err error) {
+	atomic.AddInt64(&b.writes, 1)
+	atomic.AddInt64(&b.writeNanos, int64(d))
+	for i, le := range writeBuckets {
+		if d.Seconds() <= le {
+			atomic.AddInt64(&b.writeBuckets[i], 1)
+			break
+		}
+	}
+	if err != nil {
+		atomic.AddInt64(&b.writeErrors, 1)
+	}
+}
+
+func (b *brickMetrics) setTemperature16(t int) { atomic.StoreInt64(&b.temperature16, int64(t)) }
+func (b *brickMetrics) setFanRpm(rpm int)      { atomic.StoreInt64(&b.fanRpm, int64(rpm)) }
+
+// Sensors that didn't answer, or that the brick no longer lists, drop out
+func (b *brickMetrics) setSensors16(temps []int32) {
+	for i := range b.sensors16 {
+		v := int64(math.MinInt64)
+		if i < len(temps) && temps[i] != tempSensorNone {
+			v = int64(temps[i])
+		}
+		atomic.StoreInt64(&b.sensors16[i], v)
+	}
+}
+
+func (b *brickMetrics) setFans(rpms []int32) {
+	for i := range b.fans {
+		v := int64(math.MinInt64)
+		if i < len(rpms) {
+			v = int64(rpms[i])
+		}
+		atomic.StoreInt64(&b.fans[i], v)
+	}
+}
+
+// setConnParams records what the link runs with, counting changes
+func (b *brickMetrics) setConnParams(p connParams) {
+	interval := int64(p.interval())
+	if old := atomic.SwapInt64(&b.connInterval, interval); old != 0 && old != interval {
+		atomic.AddInt64(&b.connUpdates, 1)
+	}
+	atomic.StoreInt64(&b.connLatency, int64(p.latency))
+	atomic.StoreInt64(&b.connTimeout, int64(p.supervision()))
+}
+
+func (b *brickMetrics) setRssi(rssi int)      { atomic.StoreInt64(&b.rssi, int64(rssi)) }
+func (b *brickMetrics) addLost(lost int)      { atomic.AddInt64(&b.lostCommands, int64(lost)) }
+func (b *brickMetrics) addRepairs(n int)      { atomic.AddInt64(&b.registerRepairs, int64(n)) }
+func (b *brickMetrics) setDerate(percent int) { atomic.StoreInt64(&b.derate, int64(percent)) }
+
+// writeMetrics writes every brick's metrics and the channel levels
+func (m *metrics) writeMetrics(w io.Writer, levels map[int]float64, live map[string]bool) {
+	m.lock.Lock()
+	ids := make([]string, 0, len(m.bricks))
+	for id := range m.bricks {
+		ids = append(ids, id)
+	}
+	bricks := make([]*brickMetrics, len(ids))
+	sort.Strings(ids)
+	for i, id := range ids {
+		bricks[i] = m.bricks[id]
+	}
+	m.lock.Unlock()
+
+	gauge := func(name, help string, value func(id string, b *brickMetrics) (float64, bool)) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name)
+		for i, b := range bricks {
+			if v, ok := value(ids[i], b); ok {
+				fmt.Fprintf(w, "%s{brick=%q} %g\n", name, ids[i], v)
+			}
+		}
+	}
+	counter := func(name, help string, p func(b *brickMetrics) *int64) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s counter\n", name, help, name)
+		for i, b := range bricks {
+			fmt.Fprintf(w, "%s{brick=%q} %d\n", name, ids[i], atomic.LoadInt64(p(b)))
+		}
+	}
+	load := func(p *int64) float64 { return float64(atomic.LoadInt64(p)) }
+
+	gauge("ledbrick_brick_up", "Brick connected",
+		func(id string, b *brickMetrics) (float64, bool) {
+			if live[id] {
+				return 1, true
+			}
+			return 0, true
+		})
+	gauge("ledbrick_brick_temperature_celsius", "Brick temperature, at the hotspot with several sensors",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			t := atomic.LoadInt64(&b.temperature16)
+			return float64(t) / 16, t != math.MinInt64
+		})
+	gauge("ledbrick_brick_fan_rpm", "Brick fan speed, the slowest with several fans",
+		func(_ string, b *brickMetrics) (float64, bool) { return load(&b.fanRpm), true })
+	gauge("ledbrick_brick_rssi_dbm", "Signal strength of the brick's last advertisement",
+		func(_ string, b *brickMetrics) (float64, bool) { return load(&b.rssi), true })
+	gauge("ledbrick_brick_link_rssi_dbm", "Signal strength of the controller at the brick, averaged over the connection",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.linkRssi); return v, v != 0 })
+	gauge("ledbrick_brick_clock_drift_ppm", "Brick clock rate against the controller's, as fitted from sync answers",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			v := atomic.LoadInt64(&b.clockDriftPpb)
+			return float64(v) / 1000, v != math.MinInt64
+		})
+	gauge("ledbrick_brick_sync_error_seconds", "How well the brick's clock is known, half the window the sync answers leave",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			v := atomic.LoadInt64(&b.syncErrorNanos)
+			return float64(v) / 1e9, v != 0
+		})
+	gauge("ledbrick_brick_derate_percent", "Output allowed after thermal foldback",
+		func(_ string, b *brickMetrics) (float64, bool) { return load(&b.derate), true })
+	gauge("ledbrick_brick_write_interval_seconds", "Time between frame writes, longer on weak links",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			return load(&b.writeSpacing) * writeInterval.Seconds(), true
+		})
+	gauge("ledbrick_brick_write_pipeline_depth", "Most writes in flight at once in the brick's last run of them",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.writeDepth); return v, v != 0 })
+	gauge("ledbrick_brick_conn_interval_seconds", "Connection interval the link runs with",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			v := atomic.LoadInt64(&b.connInterval)
+			return time.Duration(v).Seconds(), v != 0
+		})
+	gauge("ledbrick_brick_conn_slave_latency", "Connection events the brick may skip",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			return load(&b.connLatency), atomic.LoadInt64(&b.connInterval) != 0
+		})
+	gauge("ledbrick_brick_conn_timeout_seconds", "Supervision timeout the link runs with",
+		func(_ string, b *brickMetrics) (float64, bool) {
+			v := atomic.LoadInt64(&b.connTimeout)
+			return time.Duration(v).Seconds(), v != 0
+		})
+	gauge("ledbrick_brick_conn_burst", "Short connection interval asked for, the brick being busy",
+		func(_ string, b *brickMetrics) (float64, bool) { return load(&b.connBurst), true })
+	gauge("ledbrick_brick_protocol_version", "Protocol version the brick's firmware reports",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.protocol); return v, v != 0 })
+	gauge("ledbrick_brick_dfu_bytes_per_second", "Speed of the brick's last firmware transfer",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.dfuRate); return v, v != 0 })
+	gauge("ledbrick_brick_stack_peak_bytes", "Deepest the brick's stack has gone since boot",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.stackPeak); return v, v != 0 })
+	gauge("ledbrick_brick_wakeups_per_hour", "Timer wakeups on the brick in its last hour, far fewer with its outputs still",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.wakeupsHour); return v, v != 0 })
+	gauge("ledbrick_brick_cpu_busy_ratio", "Share of the brick's last minute its CPU was awake",
+		func(_ string, b *brickMetrics) (float64, bool) { v := load(&b.cpuBusy); return v / 10000, v != 0 })
+	gauge("ledbrick_brick_write_path", "How levels go to the brick: 0 levels, 1 fades, 2 frames, 3 packed, 4 synced",
+		func(_ string, b *brickMetrics) (float64, bool) { return load(&b.writePath), true })
+	counter("ledbrick_brick_conn_updates_total", "Changes to the connection interval",
+		func(b *brickMetrics) *int64 { return &b.connUpdates })
+	counter("ledbrick_brick_lost_commands_total", "Commands the brick never received",
+		func(b *brickMetrics) *int64 { return &b.lostCommands })
+	counter("ledbrick_brick_register_repairs_total", "PWM registers found wrong on read back and repaired",
+		func(b *brickMetrics) *int64 { return &b.registerRepairs })
+	counter("ledbrick_brick_write_errors_total", "Frame writes that failed",
+		func(b *brickMetrics) *int64 { return &b.writeErrors })
+	counter("ledbrick_brick_write_timeouts_total", "Writes given up on at the deadline",
+		func(b *brickMetrics) *int64 { return &b.writeTimeouts })
+	counter("ledbrick_brick_adv_telemetry_total", "Advertised telemetry updates taken while monitoring, one per sequence number",
+		func(b *brickMetrics) *int64 { return &b.advUpdates })
+	counter("ledbrick_brick_connects_total", "Connections completed",
+		func(b *brickMetrics) *int64 { return &b.connects })
+	counter("ledbrick_brick_disconnects_total", "Connections lost",
+		func(b *brickMetrics) *int64 { return &b.disconnects })
+
+	name := "ledbrick_brick_sensor_temperature_celsius"
+	fmt.Fprintf(w, "# HELP %s Each of the brick's temperature sensors\n# TYPE %s gauge\n", name, name)
+	for i, b := range bricks {
+		for j := range b.sensors16 {
+			if t := atomic.LoadInt64(&b.sensors16[j]); t != math.MinInt64 {
+				fmt.Fprintf(w, "%s{brick=%q,sensor=\"%d\"} %g\n", name, ids[i], j, float64(t)/16)
+			}
+		}
+	}
+
+	name = "ledbrick_brick_fan_each_rpm"
+	fmt.Fprintf(w, "# HELP %s Each of the brick's fans, 0 while stopped\n# TYPE %s gauge\n", name, name)
+	for i, b := range bricks {
+		for j := range b.fans {
+			if v := atomic.LoadInt64(&b.fans[j]); v != math.MinInt64 {
+				fmt.Fprintf(w, "%s{brick=%q,fan=\"%d\"} %d\n", name, ids[i], j, v)
+			}
+		}
+	}
+
+	name = "ledbrick_brick_command_latency_seconds"
+	fmt.Fprintf(w, "# HELP %s Command latency from the brick's traces, over the link, on the brick and in all\n# TYPE %s gauge\n", name, name)
+	for i, b := range bricks {
+		for stage, s := range traceStageNames {
+			if atomic.LoadInt64(&b.traceCounts[stage]) == 0 {
+				continue
+			}
+			for j, q := range traceQuantiles {
+				v := atomic.LoadInt64(&b.traceNanos[stage][j])
+				fmt.Fprintf(w, "%s{brick=%q,stage=%q,quantile=\"%g\"} %g\n", name, ids[i], s, q, time.Duration(v).Seconds())
+			}
+		}
+	}
+
+	name = "ledbrick_brick_write_seconds"
+	fmt.Fprintf(w, "# HELP %s Time to write one frame to a brick\n# TYPE %s histogram\n", name, name)
+	for i, b := range bricks {
+		var cum int64
+		for j, le := range writeBuckets {
+			cum += atomic.LoadInt64(&b.writeBuckets[j])
+			fmt.Fprintf(w, "%s_bucket{brick=%q,le=\"%g\"} %d\n", name, ids[i], le, cum)
+		}
+		n := atomic.LoadInt64(&b.writes)
+		fmt.Fprintf(w, "%s_bucket{brick=%q,le=\"+Inf\"} %d\n", name, ids[i], n)
+		fmt.Fprintf(w, "%s_sum{brick=%q} %g\n", name, ids[i], time.Duration(atomic.LoadInt64(&b.writeNanos)).Seconds())
+		fmt.Fprintf(w, "%s_count{brick=%q} %d\n", name, ids[i], n)
+	}
+
+	name = "ledbrick_channel_percent"
+	fmt.Fprintf(w, "# HELP %s Level set on each channel\n# TYPE %s gauge\n", name, name)
+	channels := make([]int, 0, len(levels))
+	for ch := range levels {
+		channels = append(channels, ch)
+	}
+	sort.Ints(channels)
+	for _, ch := range channels {
+		fmt.Fprintf(w, "%s{channel=\"%d\"} %g\n", name, ch, levels[ch])
+	}
+}
+
+// MetricsHandler serves the metrics for Prometheus to scrape
+func (ble *bleChannel) MetricsHandler() http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		levels := make(map[int]float64, frameChannels)
+		for ch, pct := range ble.settings.load().percents {
+			levels[ch] = pct
+		}
+		ble.lock.Lock()
+		live := make(map[string]bool, len(ble.connectedPeriph))
+		for id := range ble.connectedPeriph {
+			live[id] = true
+		}
+		ble.lock.Unlock()
+		w.Header().Set("Content-Type", "text/plain; version=0.0.4")
+		ble.metrics.writeMetrics(w, levels, live)
+		ble.writeAirtime(w)
+	})
+}
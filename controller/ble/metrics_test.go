@@ -0,0 +1,42 @@
+package ble
+
+import (
+	"bytes"
+	"errors"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestMetrics(t *testing.T) {
+	m := newMetrics()
+	b := m.brick("aa:bb")
+	if m.brick("aa:bb") != b {
+		t.Fatal("brick metrics not kept")
+	}
+	b.setFanRpm(1200)
+	b.observeWrite(3*time.Millisecond, nil)
+	b.observeWrite(2*time.Second, errors.New("gone"))
+
+	var out bytes.Buffer
+	m.writeMetrics(&out, map[int]float64{0: 42.5}, map[string]bool{"aa:bb": true})
+	s := out.String()
+	for _, want := range []string{
+		`ledbrick_brick_up{brick="aa:bb"} 1`,
+		`ledbrick_brick_fan_rpm{brick="aa:bb"} 1200`,
+		`ledbrick_brick_write_errors_total{brick="aa:bb"} 1`,
+		`ledbrick_brick_write_seconds_bucket{brick="aa:bb",le="0.0025"} 0`,
+		`ledbrick_brick_write_seconds_bucket{brick="aa:bb",le="0.005"} 1`,
+		`ledbrick_brick_write_seconds_bucket{brick="aa:bb",le="+Inf"} 2`,
+		`ledbrick_brick_write_seconds_count{brick="aa:bb"} 2`,
+		`ledbrick_channel_percent{channel="0"} 42.5`,
+	} {
+		if !strings.Contains(s, want+"\n") {
+			t.Errorf("missing %s", want)
+		}
+	}
+	// No reading yet
+	if strings.Contains(s, "ledbrick_brick_temperature_celsius{") {
+		t.Error("temperature exported before it was read")
+	}
+}
@@ -0,0 +1,51 @@
+package ble
+
+import (
+	"log"
+	"sync/atomic"
+	"time"
+)
+
+// Monitor only: no brick is ever connected, everything known about
+// them comes from the telemetry in their advertisements (telemetry.go),
+// so a controller watching a hundred bricks holds no connections and
+// leaves them to the one driving them. Each brick's telemetry is taken
+// once per sequence number, however many adapters or reports carry it,
+// into its history and metrics. Connectivity dongles scan passively,
+// sending no scan requests; HCI adapters scan as the gatt package does.
+func (ble *bleChannel) SetMonitor(on bool) {
+	ble.lock.Lock()
+	ble.monitor = on
+	ble.lock.Unlock()
+	for _, a := range ble.adapters {
+		if d, ok := a.d.(*sdDevice); ok {
+			d.setPassive(on)
+		}
+	}
+	if on {
+		log.Printf("Monitoring advertised telemetry only, no bricks will be connected")
+	}
+}
+
+// takeAdvTelemetry records telemetry advertised by id, returning
+// whether its sequence number moved. Called with ble.lock held.
+func (ble *bleChannel) takeAdvTelemetry(id string, t advTelemetry, rssi int, now time.Time) bool {
+	last, seen := ble.advTelemetry[id]
+	ble.advTelemetry[id] = t
+	if seen && last.seq == t.seq {
+		return false
+	}
+	if !ble.monitor {
+		return true
+	}
+	m := ble.metrics.brick(id)
+	m.setRssi(rssi)
+	m.setFanRpm(t.fanRpm)
+	m.setDerate(t.derate)
+	atomic.AddInt64(&m.advUpdates, 1)
+	if t.flags&telemetryTempValid != 0 {
+		m.setTemperature16(t.temperature16)
+		ble.history.brick(id).add(now, t.temperature16, t.fanRpm)
+	}
+	return true
+}
@@ -0,0 +1,38 @@
+package ble
+
+import (
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+func advTelemetryBytes(seq byte) []byte {
+	return []byte{0xff, 0xff, advTelemetryMagic,
+		telemetryTempValid, 0, 0xc0, 0x01, 0xb0, 0x04, 90, 40, seq}
+}
+
+func TestMonitorTakesEachSequenceOnce(t *testing.T) {
+	ble := newBleChannel(nil, clock.Real)
+	ble.monitor = true
+	now := time.Unix(1500000000, 0)
+	for i, seq := range []byte{1, 1, 1, 2, 2} {
+		at, _ := parseAdvTelemetry(advTelemetryBytes(seq))
+		ble.takeAdvTelemetry("aa", at, -60, now.Add(time.Duration(i)*time.Second))
+	}
+	m := ble.metrics.brick("aa")
+	if m.advUpdates != 2 || m.temperature16 != 0x1c0 || m.fanRpm != 1200 || m.derate != 90 || m.rssi != -60 {
+		t.Errorf("metrics %d updates, %d/16 C, %d rpm, %d%%, %d dBm",
+			m.advUpdates, m.temperature16, m.fanRpm, m.derate, m.rssi)
+	}
+	if ps, _ := ble.History("aa", 0, now); len(ps) != 2 || ps[0].Temp != 28 {
+		t.Errorf("history %+v", ps)
+	}
+}
+
+func TestParseAdvTelemetryAllocs(t *testing.T) {
+	b := advTelemetryBytes(7)
+	if n := testing.AllocsPerRun(100, func() { parseAdvTelemetry(b) }); n != 0 {
+		t.Errorf("%v allocations a report", n)
+	}
+}
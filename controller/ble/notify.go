@@ -0,0 +1,254 @@
+package ble
+
+import (
+	"encoding/binary"
+	"github.com/paypal/gatt"
+	"github.com/theatrus/ledbrick/controller/logging"
+	"log"
+	"math"
+	"sync/atomic"
+	"time"
+)
+
+// Notifications arrive for every brick every few hundred milliseconds,
+// so their path is kept free of allocations: each subscribed
+// characteristic gets its handler when it's subscribed rather than
+// having its UUID formatted and matched on every notification, the
+// values are decoded into fixed structs after checking the length, and
+// published to brickReadings, read by the HTTP handlers and metrics
+// while notifications keep coming.
+
+// brickReadings are a brick's last reported values, each read and
+// written atomically
+type brickReadings struct {
+	// 64 bit words first, for atomic access on 32 bit ARM
+	// Unix nanoseconds of the last notification, of any kind
+	lastUpdate int64
+	// Peripheral clock at the last telemetry, Unix nanoseconds, 0
+	// until it is set
+	clockAt int64
+	// 1/16 degree C
+	temperature16 int32
+	fanRpm        int32
+	// Percent of requested output after thermal foldback
+	derate       int32
+	fanDuty      int32
+	errors       uint32
+	uptime       uint32
+	frameCommits uint32
+	// Last scrubber repair count, -1 until one is heard
+	repairs int32
+}
+
+func newBrickReadings(now time.Time) *brickReadings {
+	return &brickReadings{lastUpdate: now.UnixNano(), derate: 100, repairs: -1}
+}
+
+// repaired takes the brick's repair count and gives how many are new
+// since the last. The first heard only sets where counting starts, and
+// one gone backwards is a reboot, counting from zero.
+func (r *brickReadings) repaired(count uint16) int {
+	last := atomic.SwapInt32(&r.repairs, int32(count))
+	switch {
+	case last < 0:
+		return 0
+	case int32(count) < last:
+		return int(count)
+	}
+	return int(int32(count) - last)
+}
+
+func (r *brickReadings) heard(now time.Time) {
+	atomic.StoreInt64(&r.lastUpdate, now.UnixNano())
+}
+
+func (r *brickReadings) lastHeard() time.Time {
+	return time.Unix(0, atomic.LoadInt64(&r.lastUpdate))
+}
+
+// tempNotify is the temperature characteristic: whole degrees, clamped
+// at zero, then from newer firmware the signed reading in 1/16 degree,
+// and from newer still each sensor's own reading after it. The first
+// two are the hotspot on boards with several sensors.
+type tempNotify struct {
+	temperature16 int32
+	// 1/16 degree C, tempSensorNone if it didn't answer
+	sensors  [tempMaxSensors]int32
+	nSensors int
+}
+
+const (
+	tempMaxSensors = 4
+	tempSensorNone = math.MinInt16
+)
+
+func decodeTemp(b []byte) (tempNotify, bool) {
+	switch {
+	case len(b) >= 4:
+		t := tempNotify{temperature16: int32(int16(binary.LittleEndian.Uint16(b[2:])))}
+		for off := 4; off+2 <= len(b) && t.nSensors < tempMaxSensors; off += 2 {
+			t.sensors[t.nSensors] = int32(int16(binary.LittleEndian.Uint16(b[off:])))
+			t.nSensors++
+		}
+		return t, true
+	case len(b) >= 2:
+		return tempNotify{temperature16: int32(binary.LittleEndian.Uint16(b)) << 4}, true
+	case len(b) == 1:
+		return tempNotify{temperature16: int32(b[0]) << 4}, true
+	}
+	return tempNotify{}, false
+}
+
+// fanNotify is the slowest fan, and from newer firmware each fan's own
+// speed after it
+type fanNotify struct {
+	rpm   int32
+	fans  [fanMaxFans]int32
+	nFans int
+}
+
+const fanMaxFans = 3
+
+func decodeFan(b []byte) (fanNotify, bool) {
+	if len(b) < 2 {
+		return fanNotify{}, false
+	}
+	f := fanNotify{rpm: int32(binary.LittleEndian.Uint16(b))}
+	for off := 2; off+2 <= len(b) && f.nFans < fanMaxFans; off += 2 {
+		f.fans[f.nFans] = int32(binary.LittleEndian.Uint16(b[off:]))
+		f.nFans++
+	}
+	return f, true
+}
+
+// statusNotify is the status characteristic: command count and CRC,
+// then from newer firmware the derate and the frames committed, and
+// from newer still the registers its scrubber repaired since boot
+type statusNotify struct {
+	cmdCount     uint16
+	cmdCrc       uint16
+	derate       int32
+	frameCommits uint32
+	repairs      uint16
+	hasDerate    bool
+	hasCommits   bool
+	hasRepairs   bool
+}
+
+func decodeStatus(b []byte) (statusNotify, bool) {
+	if len(b) < 4 {
+		return statusNotify{}, false
+	}
+	s := statusNotify{
+		cmdCount: binary.LittleEndian.Uint16(b[0:]),
+		cmdCrc:   binary.LittleEndian.Uint16(b[2:]),
+	}
+	if len(b) >= 5 {
+		s.derate, s.hasDerate = int32(b[4]), true
+	}
+	if len(b) >= 9 {
+		s.frameCommits, s.hasCommits = binary.LittleEndian.Uint32(b[5:]), true
+	}
+	if len(b) >= 11 {
+		s.repairs, s.hasRepairs = binary.LittleEndian.Uint16(b[9:]), true
+	}
+	return s, true
+}
+
+type notifyFunc func(*gatt.Characteristic, []byte, error)
+
+// notifier is the handler for notifications of the characteristic with
+// UUID uuid, nil for one the controller doesn't take notifications from
+func (p *blePeriph) notifier(id, uuid string) notifyFunc {
+	var handle func(b []byte)
+	switch uuid {
+	case pwmTempChar:
+		handle = func(b []byte) { p.onTemp(id, b) }
+	case pwmFanChar:
+		handle = func(b []byte) { p.onFan(id, b) }
+	case pwmStatusChar:
+		handle = func(b []byte) { p.onStatus(id, b) }
+	case pwmTelemetryChar:
+		handle = func(b []byte) { p.onTelemetry(id, b) }
+	case pwmCommandChar:
+		handle = func(b []byte) { p.onCommandAck(id, b) }
+	case pwmSyncChar:
+		handle = func(b []byte) {
+			now := p.now()
+			if err := p.sync.answer(b, now); err != nil {
+				log.Printf("%s: %s", id, err)
+				return
+			}
+			ppm, fitted, bound := p.sync.estimate(now)
+			if fitted {
+				atomic.StoreInt64(&p.metrics.clockDriftPpb, int64(ppm*1000))
+			}
+			atomic.StoreInt64(&p.metrics.syncErrorNanos, int64(bound))
+		}
+	case nusNotifyChar:
+		handle = func(b []byte) {
+			if p.bulk != nil {
+				p.bulk.onNotify(b)
+			}
+		}
+	default:
+		return nil
+	}
+	return func(c *gatt.Characteristic, b []byte, err error) {
+		p.readings.heard(p.now())
+		handle(b)
+	}
+}
+
+func (p *blePeriph) onTemp(id string, b []byte) {
+	t, ok := decodeTemp(b)
+	if !ok {
+		log.Printf("%s: empty temperature notification", id)
+		return
+	}
+	atomic.StoreInt32(&p.readings.temperature16, t.temperature16)
+	p.metrics.setTemperature16(int(t.temperature16))
+	p.metrics.setSensors16(t.sensors[:t.nSensors])
+	p.history.add(p.now(), int(t.temperature16), p.FanRPM())
+	temperatureLog.Log(id, "temperature", logging.Str("brick", id),
+		logging.Float("c", float64(t.temperature16)/16.0))
+}
+
+func (p *blePeriph) onFan(id string, b []byte) {
+	f, ok := decodeFan(b)
+	if !ok {
+		log.Printf("%s: short fan notification: %d bytes", id, len(b))
+		return
+	}
+	atomic.StoreInt32(&p.readings.fanRpm, f.rpm)
+	p.metrics.setFanRpm(int(f.rpm))
+	p.metrics.setFans(f.fans[:f.nFans])
+	fanLog.Log(id, "fan speed", logging.Str("brick", id), logging.Int("rpm", int(f.rpm)))
+}
+
+func (p *blePeriph) onStatus(id string, b []byte) {
+	s, ok := decodeStatus(b)
+	if !ok {
+		log.Printf("%s: short status notification: %d bytes", id, len(b))
+		return
+	}
+	if lost := p.cmds.check(s.cmdCount, s.cmdCrc); lost > 0 {
+		p.sentLevels.invalidate()
+		p.metrics.addLost(lost)
+		log.Printf("%s: %d commands lost (%d total)", id, lost, p.cmds.Lost())
+	}
+	if s.hasDerate && atomic.SwapInt32(&p.readings.derate, s.derate) != s.derate {
+		p.metrics.setDerate(int(s.derate))
+		log.Printf("%s: thermal derate: %d%%", id, s.derate)
+		p.thermalChanged()
+	}
+	if s.hasCommits {
+		atomic.StoreUint32(&p.readings.frameCommits, s.frameCommits)
+	}
+	if s.hasRepairs {
+		if n := p.readings.repaired(s.repairs); n > 0 {
+			p.metrics.addRepairs(n)
+			log.Printf("%s: %d PWM registers found wrong and repaired", id, n)
+		}
+	}
+}
@@ -0,0 +1,102 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+	"time"
+)
+
+func TestDecodeNotify(t *testing.T) {
+	if n, ok := decodeTemp([]byte{0, 0, 0xf8, 0xff}); !ok || n.temperature16 != -8 {
+		t.Errorf("signed temperature %d, %v", n.temperature16, ok)
+	}
+	if n, ok := decodeTemp([]byte{0x2c, 0x01}); !ok || n.temperature16 != 300<<4 {
+		t.Errorf("whole degrees %d, %v", n.temperature16, ok)
+	}
+	n, ok := decodeTemp([]byte{0, 0, 0x40, 0x02, 0x30, 0x02, 0x00, 0x80, 0x40, 0x02})
+	if !ok || n.temperature16 != 0x240 || n.nSensors != 3 || n.sensors[0] != 0x230 || n.sensors[1] != tempSensorNone {
+		t.Errorf("sensors %+v, %v", n, ok)
+	}
+	if _, ok := decodeTemp(nil); ok {
+		t.Error("empty temperature decoded")
+	}
+	if _, ok := decodeFan([]byte{1}); ok {
+		t.Error("short fan decoded")
+	}
+	f, ok := decodeFan([]byte{0, 0, 0xb0, 0x04, 0, 0})
+	if !ok || f.rpm != 0 || f.nFans != 2 || f.fans[0] != 1200 || f.fans[1] != 0 {
+		t.Errorf("fans %+v, %v", f, ok)
+	}
+	s, ok := decodeStatus([]byte{5, 0, 0x34, 0x12})
+	if !ok || s.cmdCount != 5 || s.cmdCrc != 0x1234 || s.hasDerate || s.hasCommits {
+		t.Errorf("old status %+v", s)
+	}
+	s, ok = decodeStatus([]byte{5, 0, 0x34, 0x12, 80, 1, 2, 0, 0})
+	if !ok || s.derate != 80 || s.frameCommits != 0x201 || s.hasRepairs {
+		t.Errorf("status %+v", s)
+	}
+	s, ok = decodeStatus([]byte{5, 0, 0x34, 0x12, 80, 1, 2, 0, 0, 3, 1})
+	if !ok || s.frameCommits != 0x201 || !s.hasRepairs || s.repairs != 0x103 {
+		t.Errorf("status with repairs %+v", s)
+	}
+	if _, ok := decodeStatus([]byte{5, 0, 0x34}); ok {
+		t.Error("short status decoded")
+	}
+}
+
+func TestRepaired(t *testing.T) {
+	r := newBrickReadings(time.Now())
+	for _, c := range []struct {
+		count uint16
+		want  int
+	}{
+		// Where counting starts, then new ones, then a reboot
+		{7, 0}, {7, 0}, {9, 2}, {1, 1}, {1, 0},
+	} {
+		if got := r.repaired(c.count); got != c.want {
+			t.Errorf("repaired(%d) = %d, want %d", c.count, got, c.want)
+		}
+	}
+}
+
+func TestNotifyAllocs(t *testing.T) {
+	m := newMetrics()
+	p := &blePeriph{readings: newBrickReadings(time.Now()),
+		cmds:       newCmdTracker(),
+		acks:       newCmdAcks(),
+		sentLevels: &levelCache{},
+		metrics:    m.brick("allocs"),
+		history:    newHistory().brick("allocs"),
+	}
+	tlm := make([]byte, telemetryDropsLen)
+	binary.LittleEndian.PutUint16(tlm[0:], 25*16+3)
+	binary.LittleEndian.PutUint16(tlm[2:], 1200)
+	tlm[5], tlm[6], tlm[7] = 90, 40, telemetryTempValid
+	binary.LittleEndian.PutUint16(tlm[14:], 0xffff)
+	notifies := []struct {
+		uuid string
+		b    []byte
+	}{
+		{pwmTempChar, []byte{25, 0, 0x93, 0x01}},
+		{pwmFanChar, []byte{0xb0, 0x04}},
+		{pwmStatusChar, []byte{0, 0, 0xff, 0xff, 90, 1, 0, 0, 0}},
+		{pwmTelemetryChar, tlm},
+	}
+	for _, n := range notifies {
+		f := p.notifier("allocs", n.uuid)
+		// The first of each is logged
+		f(nil, n.b, nil)
+		if a := testing.AllocsPerRun(100, func() { f(nil, n.b, nil) }); a != 0 {
+			t.Errorf("%s: %g allocations a notification", n.uuid, a)
+		}
+	}
+	if p.TemperatureC() != 25+3.0/16 || p.FanRPM() != 1200 || p.Derate() != 90 || p.FanDuty() != 40 {
+		t.Errorf("read back %g C, %d rpm, derate %d, duty %d", p.TemperatureC(), p.FanRPM(), p.Derate(), p.FanDuty())
+	}
+	if p.FrameCommits() != 1 {
+		t.Errorf("%d frame commits", p.FrameCommits())
+	}
+	if p.notifier("allocs", pwmLedChar) != nil {
+		t.Error("handler for a characteristic that doesn't notify")
+	}
+}
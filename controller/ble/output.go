@@ -0,0 +1,114 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"time"
+)
+
+// The firmware's output state characteristic (LBS_OUTPUT_*): a
+// generation that moves with every change, the derate, master dim,
+// flags and register hash, then where each channel is headed and, from
+// firmware that says, how many channels the brick has wired.
+const (
+	outputHeaderLen  = 9
+	outputChannels   = 16
+	outputLen        = outputHeaderLen + 2*outputChannels
+	outputWiredLen   = outputLen + 1
+	outputFlagError  = 1 << 0
+	outputFlagFading = 1 << 1
+)
+
+type outputState struct {
+	gen     uint32
+	derate  int
+	dim     int
+	errored bool
+	fading  bool
+	hash    uint16
+	levels  []int
+	// Channels wired, defaultBrickChannels when the brick doesn't say
+	channels int
+}
+
+func (o outputState) String() string {
+	s := fmt.Sprintf("generation %d, derate %d%%, dim %d%%, levels %v", o.gen, o.derate, o.dim, o.levels)
+	if o.errored {
+		s += ", off for an error"
+	}
+	return s
+}
+
+// outputGeneration takes the generation from the start of the state,
+// all a short read needs to hold
+func outputGeneration(b []byte) (uint32, error) {
+	if len(b) < 4 {
+		return 0, fmt.Errorf("short output state (%d bytes)", len(b))
+	}
+	return binary.LittleEndian.Uint32(b), nil
+}
+
+func parseOutputState(b []byte) (outputState, error) {
+	if len(b) < outputLen {
+		return outputState{}, fmt.Errorf("short output state (%d bytes)", len(b))
+	}
+	o := outputState{
+		gen:      binary.LittleEndian.Uint32(b),
+		derate:   int(b[4]),
+		dim:      int(b[5]),
+		errored:  b[6]&outputFlagError != 0,
+		fading:   b[6]&outputFlagFading != 0,
+		hash:     binary.LittleEndian.Uint16(b[7:]),
+		levels:   make([]int, outputChannels),
+		channels: defaultBrickChannels,
+	}
+	for channel := range o.levels {
+		o.levels[channel] = int(binary.LittleEndian.Uint16(b[outputHeaderLen+2*channel:]))
+	}
+	if len(b) >= outputWiredLen {
+		o.channels = int(b[outputLen])
+		if o.channels < 1 || o.channels > frameChannels {
+			return outputState{}, fmt.Errorf("output state with %d channels", o.channels)
+		}
+	}
+	return o, nil
+}
+
+// readOutput reads back what the brick is driving
+func (p *blePeriph) readOutput() (outputState, error) {
+	b, err := p.gp.ReadLongCharacteristic(p.outputChar)
+	if err != nil {
+		return outputState{}, err
+	}
+	return parseOutputState(b)
+}
+
+// checkOutput reads back the brick's output when its levels are due a
+// full refresh, so only the channels it doesn't already have are
+// written. A generation unmoved since the levels were last confirmed,
+// with nothing written since, settles it in one short read.
+func (p *blePeriph) checkOutput(now time.Time) {
+	b, err := p.gp.ReadCharacteristic(p.outputChar)
+	if err != nil {
+		return
+	}
+	if gen, err := outputGeneration(b); err == nil && p.sentLevels.unchanged(gen, now) {
+		return
+	}
+	o, err := p.readOutput()
+	if err != nil {
+		log.Printf("%s: output state: %s", p.gp.ID(), err)
+		return
+	}
+	p.sentLevels.confirm(o.levels[:p.width()], o.gen, now)
+}
+
+// width is how many channels the brick has, as its output state said
+// on connecting
+func (p *blePeriph) width() int {
+	if p.channels == 0 {
+		return defaultBrickChannels
+	}
+	return p.channels
+}
@@ -0,0 +1,35 @@
+package ble
+
+import "testing"
+
+func TestParseOutputState(t *testing.T) {
+	b := make([]byte, outputLen)
+	copy(b, []byte{0x2a, 0x01, 0, 0, 80, 100, outputFlagFading, 0x34, 0x12})
+	b[outputHeaderLen], b[outputHeaderLen+1] = 0xff, 0x0f
+	b[outputLen-2] = 5
+	o, err := parseOutputState(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if o.gen != 298 || o.derate != 80 || o.dim != 100 || o.errored || !o.fading || o.hash != 0x1234 {
+		t.Errorf("got %+v", o)
+	}
+	if len(o.levels) != outputChannels || o.levels[0] != 4095 || o.levels[1] != 0 || o.levels[outputChannels-1] != 5 {
+		t.Errorf("levels %v", o.levels)
+	}
+	if _, err := parseOutputState(b[:20]); err == nil {
+		t.Error("short state accepted")
+	}
+	if gen, err := outputGeneration(b[:20]); err != nil || gen != 298 {
+		t.Errorf("generation %d, %v", gen, err)
+	}
+	if o.channels != defaultBrickChannels {
+		t.Errorf("%d channels from firmware not saying", o.channels)
+	}
+	if o, err := parseOutputState(append(b, 16)); err != nil || o.channels != 16 {
+		t.Errorf("wired %d, %v", o.channels, err)
+	}
+	if _, err := parseOutputState(append(b, 0)); err == nil {
+		t.Error("no channels accepted")
+	}
+}
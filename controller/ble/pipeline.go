@@ -0,0 +1,62 @@
+package ble
+
+import (
+	"sync/atomic"
+
+	"github.com/paypal/gatt"
+)
+
+// Runs of writes without response, pipelined. WriteCharacteristic hands
+// over one write per call and a run waits on each call in turn, so a
+// frame split over several writes, a bulk frame's packets or a DFU
+// image trickle out a call at a time. A link the controller drives
+// itself, the connectivity dongle (sddevice.go), also takes writes as an
+// asyncWriter: each goes into the link's buffers without waiting for the
+// one before, as many at once as the link holds, and is reported sent as
+// the link's transmit completions come back, so a run fills each
+// connection event. gatt keeps its HCI socket to itself, so bricks on a
+// local adapter write a call at a time as before.
+type asyncWriter interface {
+	// writeAsync hands b to the link as a write without response to c,
+	// waiting only while the link's buffers are full, and has sent called
+	// once it has gone out or never will. sent must not block.
+	writeAsync(c *gatt.Characteristic, b []byte, sent func(error)) error
+}
+
+// pipeline writes bs to c without response, all in flight together
+// where gp allows, returning once every one has gone out with the most
+// that were in flight at once
+func pipeline(gp gatt.Peripheral, c *gatt.Characteristic, bs [][]byte) (int, error) {
+	aw, ok := gp.(asyncWriter)
+	if !ok {
+		for _, b := range bs {
+			if err := gp.WriteCharacteristic(c, b, true); err != nil {
+				return 1, err
+			}
+		}
+		return 1, nil
+	}
+	results := make(chan error, len(bs))
+	var inflight int32
+	depth, handed := 0, 0
+	var err error
+	for _, b := range bs {
+		n := int(atomic.AddInt32(&inflight, 1))
+		if err = aw.writeAsync(c, b, func(err error) {
+			atomic.AddInt32(&inflight, -1)
+			results <- err
+		}); err != nil {
+			break
+		}
+		if n > depth {
+			depth = n
+		}
+		handed++
+	}
+	for ; handed > 0; handed-- {
+		if e := <-results; e != nil && err == nil {
+			err = e
+		}
+	}
+	return depth, err
+}
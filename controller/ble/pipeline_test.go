@@ -0,0 +1,72 @@
+package ble
+
+import (
+	"errors"
+	"github.com/paypal/gatt"
+	"sync"
+	"testing"
+)
+
+// Holds every write's completion until told to send them
+type pipePeriph struct {
+	gatt.Peripheral
+	held []func(error)
+	full chan struct{}
+	want int
+
+	lock sync.Mutex
+}
+
+func (pp *pipePeriph) writeAsync(c *gatt.Characteristic, b []byte, sent func(error)) error {
+	pp.lock.Lock()
+	defer pp.lock.Unlock()
+	pp.held = append(pp.held, sent)
+	if len(pp.held) == pp.want {
+		close(pp.full)
+	}
+	return nil
+}
+
+func TestPipeline(t *testing.T) {
+	pp := &pipePeriph{full: make(chan struct{}), want: 4}
+	bs := [][]byte{{1}, {2}, {3}, {4}}
+	go func() {
+		// Nothing goes out until all four are in flight
+		<-pp.full
+		pp.lock.Lock()
+		defer pp.lock.Unlock()
+		for i, sent := range pp.held {
+			var err error
+			if i == 2 {
+				err = errSdDisconnected
+			}
+			sent(err)
+		}
+	}()
+	depth, err := pipeline(pp, nil, bs)
+	if depth != 4 || err != errSdDisconnected {
+		t.Errorf("depth %d, %v", depth, err)
+	}
+
+	sp := &stuckPeriph{release: make(chan struct{})}
+	close(sp.release)
+	if depth, err := pipeline(sp, nil, bs); depth != 1 || err != nil {
+		t.Errorf("without a pipeline depth %d, %v", depth, err)
+	}
+}
+
+func TestSdPeriphSending(t *testing.T) {
+	p := newSdPeriph(nil, sdAddr{})
+	p.connect(1, connParams{})
+	var got []error
+	sent := func(err error) { got = append(got, err) }
+	p.sending = []func(error){sent, nil, sent, sent}
+	p.event(sdEvent{id: sdEvtTxComplete, conn: 1, txPackets: 3})
+	if len(got) != 2 || got[0] != nil || got[1] != nil || len(p.sending) != 1 {
+		t.Fatalf("after 3 sent %v, %d left", got, len(p.sending))
+	}
+	p.drop()
+	if len(got) != 3 || !errors.Is(got[2], errSdDisconnected) || p.sending != nil {
+		t.Errorf("after the drop %v", got)
+	}
+}
@@ -0,0 +1,78 @@
+package ble
+
+import (
+	"log"
+	"sort"
+	"time"
+)
+
+// Bricks aren't connected the moment they're heard. Each adapter makes
+// one connection at a time, which is all the controller does well, and
+// starts the next as soon as the last is up, so one brick's discovery
+// runs alongside the next one's connection. Waiting bricks go strongest
+// first, as they connect quickest and least often fail.
+const adapterConnecting = 1
+
+// nextConnects is the waiting links to start connecting now on each of
+// adapters, strongest first and at most adapterConnecting per adapter
+// counting those already connecting
+func nextConnects(links map[string]*brickLink, adapters int, now time.Time) []*brickLink {
+	busy := make([]int, adapters)
+	var waiting []*brickLink
+	for _, l := range links {
+		switch {
+		case l.state == LinkConnecting:
+			busy[l.adapter]++
+		case l.p != nil && l.canConnect(now) && now.Sub(l.heard) <= sightingTimeout:
+			waiting = append(waiting, l)
+		}
+	}
+	sort.Slice(waiting, func(i, j int) bool { return waiting[i].rssi > waiting[j].rssi })
+	var start []*brickLink
+	for _, l := range waiting {
+		if busy[l.adapter] < adapterConnecting {
+			busy[l.adapter]++
+			start = append(start, l)
+		}
+	}
+	return start
+}
+
+// planConnections starts whichever waiting bricks' connections can go
+// now. Called with ble.lock held.
+func (ble *bleChannel) planConnections(now time.Time) {
+	adapters := len(ble.adapters)
+	if adapters == 0 {
+		return
+	}
+	for _, l := range nextConnects(ble.links, adapters, now) {
+		if adapters > 1 {
+			log.Printf("Connecting to %s (%d dBm) from %s", l.p.ID(), l.rssi, ble.adapters[l.adapter])
+		} else {
+			log.Printf("Connecting to %s (%d dBm)", l.p.ID(), l.rssi)
+		}
+		l.set(LinkConnecting, now)
+		l.p.Device().Connect(l.p)
+	}
+}
+
+// fleetLive logs how long the expected bricks took to all come up, from
+// the start or from when the first dropped. Called with ble.lock held.
+func (ble *bleChannel) fleetLive(now time.Time) {
+	if ble.expected == 0 {
+		return
+	}
+	live := 0
+	for _, l := range ble.links {
+		if l.state == LinkLive {
+			live++
+		}
+	}
+	switch {
+	case live >= ble.expected && !ble.fleetSince.IsZero():
+		log.Printf("All %d bricks live in %v", live, now.Sub(ble.fleetSince).Truncate(time.Millisecond))
+		ble.fleetSince = time.Time{}
+	case live < ble.expected && ble.fleetSince.IsZero():
+		ble.fleetSince = now
+	}
+}
@@ -0,0 +1,35 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestNextConnects(t *testing.T) {
+	now := time.Now()
+	heard := func(rssi, adapter int) *brickLink {
+		return &brickLink{p: &stuckPeriph{}, rssi: rssi, adapter: adapter, heard: now}
+	}
+	links := map[string]*brickLink{
+		"weak":   heard(-90, 0),
+		"strong": heard(-40, 0),
+		"other":  heard(-70, 1),
+		"old":    {p: &stuckPeriph{}, rssi: -30, heard: now.Add(-2 * sightingTimeout)},
+		"unseen": {rssi: -20, heard: now},
+	}
+	start := nextConnects(links, 2, now)
+	if len(start) != 2 || start[0] != links["strong"] || start[1] != links["other"] {
+		t.Fatalf("started %v", start)
+	}
+
+	// One connecting per adapter, the next waits for it
+	links["strong"].set(LinkConnecting, now)
+	if start := nextConnects(links, 2, now); len(start) != 1 || start[0] != links["other"] {
+		t.Errorf("started %v behind a connection", start)
+	}
+	links["strong"].set(LinkDiscovering, now)
+	links["other"].set(LinkConnecting, now)
+	if start := nextConnects(links, 2, now); len(start) != 1 || start[0] != links["weak"] {
+		t.Errorf("started %v alongside a discovery", start)
+	}
+}
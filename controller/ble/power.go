@@ -0,0 +1,113 @@
+package ble
+
+import (
+	"fmt"
+	"github.com/theatrus/ledbrick/controller/logging"
+	"sync/atomic"
+	"time"
+)
+
+// Bricks sharing a supply are held under its budget together: each
+// frame's draw is estimated from what every channel takes at full
+// output, each brick's share cut by its own thermal derate and the
+// master dimmer and raised by any thermal share (thermal.go), and every frame scaled by the same factor when the
+// total would run over.
+type powerBudget struct {
+	watts float64
+	// Watts each channel draws at 100%
+	channelWatts [frameChannels]float64
+	// Factor the frames were last scaled by, 1 within budget
+	scale float64
+}
+
+// Scale changes smaller than this aren't worth rewriting every brick
+const powerScaleStep = 0.005
+
+var budgetLog = logging.NewSampler(logging.Info, time.Minute)
+
+// draw is a brick's watts on state at full derate
+func (b *powerBudget) draw(s *ledState) float64 {
+	w := 0.0
+	for channel, percent := range s.percents {
+		w += percent / 100 * b.channelWatts[channel]
+	}
+	return w
+}
+
+// SetPowerBudget holds every brick together under watts, given what
+// each channel draws at full output. 0 watts lifts the budget.
+func (ble *bleChannel) SetPowerBudget(watts float64, channelWatts []float64) error {
+	if watts < 0 {
+		return fmt.Errorf("negative power budget %g W", watts)
+	}
+	if len(channelWatts) > frameChannels {
+		return fmt.Errorf("%d channel wattages, bricks have %d channels", len(channelWatts), frameChannels)
+	}
+	b := &powerBudget{watts: watts, scale: 1}
+	for channel, w := range channelWatts {
+		if w < 0 {
+			return fmt.Errorf("channel %d draws negative power %g W", channel, w)
+		}
+		b.channelWatts[channel] = w
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if watts == 0 {
+		b = nil
+	}
+	ble.budget = b
+	for _, p := range ble.connectedPeriph {
+		p.sentLevels.invalidate()
+	}
+	return nil
+}
+
+// governPower scales the states in place to keep the connected bricks
+// within the budget. Each state is weighed once, then each brick is a
+// lookup. Called with ble.lock held, before the states are queued.
+func (ble *bleChannel) governPower(state *ledState, zoneStates map[string]*ledState) {
+	b := ble.budget
+	if b == nil {
+		return
+	}
+	draws := make(map[*ledState]float64, len(zoneStates)+1)
+	draws[state] = b.draw(state)
+	for _, s := range zoneStates {
+		draws[s] = b.draw(s)
+	}
+	total := 0.0
+	for id, p := range ble.connectedPeriph {
+		s := state
+		if name, z := ble.zoneOf(id); z != nil {
+			s = zoneStates[name]
+		}
+		total += draws[s] * float64(atomic.LoadInt64(&p.metrics.derate)) / 100 * ble.thermalBoost(id)
+	}
+	if ble.dimPercent > 0 {
+		total *= float64(ble.dimPercent) / 100
+	}
+
+	scale := 1.0
+	if total > b.watts {
+		scale = b.watts / total
+	}
+	// Always down at once, back up only by a step or all the way
+	if scale < b.scale || scale-b.scale >= powerScaleStep || (scale == 1 && b.scale != 1) {
+		budgetLog.Log("budget", "power budget", logging.Float("watts", total),
+			logging.Float("budget", b.watts), logging.Float("scale", scale))
+		b.scale = scale
+		// The frames' generations are the same, their levels aren't
+		for _, p := range ble.connectedPeriph {
+			p.sentLevels.invalidate()
+		}
+	}
+	if b.scale == 1 {
+		return
+	}
+	for s := range draws {
+		for channel := range s.percents {
+			s.percents[channel] *= b.scale
+		}
+	}
+}
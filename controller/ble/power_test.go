@@ -0,0 +1,56 @@
+package ble
+
+import (
+	"fmt"
+	"github.com/theatrus/ledbrick/controller/clock"
+	"math"
+	"testing"
+	"time"
+)
+
+func TestPowerBudget(t *testing.T) {
+	ble := newBleChannel(nil, clock.Real)
+	for i := 0; i < 4; i++ {
+		id := fmt.Sprint(i)
+		ble.connectedPeriph[id] = &blePeriph{sentLevels: &levelCache{}, metrics: ble.metrics.brick(id)}
+	}
+	if err := ble.SetPowerBudget(100, []float64{50, 50}); err != nil {
+		t.Fatal(err)
+	}
+	if err := ble.SetPowerBudget(100, make([]float64, frameChannels+1)); err == nil {
+		t.Error("took more channel wattages than channels")
+	}
+	state := func(a, b float64) *ledState {
+		return newLedState(&channelFrame{percents: [frameChannels]float64{a, b}}, time.Time{})
+	}
+
+	// Four bricks at 50 W each, held to 100 W
+	s := state(100, 0)
+	ble.governPower(s, nil)
+	if math.Abs(s.percents[0]-50) > 1e-9 || s.percents[1] != 0 {
+		t.Errorf("over budget %v", s.percents)
+	}
+
+	// Derated bricks draw less, leaving the others more
+	ble.metrics.brick("0").setDerate(50)
+	ble.metrics.brick("1").setDerate(50)
+	s = state(100, 0)
+	ble.governPower(s, nil)
+	if want := 100 * 100 / 150.0; math.Abs(s.percents[0]-want) > 1e-9 {
+		t.Errorf("derated %v, want %g", s.percents, want)
+	}
+
+	// Within budget, untouched
+	s = state(20, 20)
+	ble.governPower(s, nil)
+	if s.percents[0] != 20 || ble.budget.scale != 1 {
+		t.Errorf("within budget %v scale %g", s.percents, ble.budget.scale)
+	}
+
+	ble.SetPowerBudget(0, nil)
+	s = state(100, 100)
+	ble.governPower(s, nil)
+	if s.percents[0] != 100 {
+		t.Errorf("budget lifted %v", s.percents)
+	}
+}
@@ -0,0 +1,72 @@
+package ble
+
+import (
+	"sync"
+	"time"
+)
+
+// Each brick is written as often as its link takes well. A strong link
+// gets every update as it comes; a marginal one gets every second or
+// fourth write interval's worth, faded over the whole gap so it still
+// moves smoothly, and its frames skip the bulk channel synced frames
+// need. The grade comes from the weaker signal of the two ends, how
+// long its writes take and how many fail.
+const (
+	// Writes a link's averages are taken over, roughly
+	qualityWindow = 16
+
+	fairRssi    = -75
+	weakRssi    = -85
+	fairLatency = 100 * time.Millisecond
+	weakLatency = 250 * time.Millisecond
+	fairErrors  = 0.05
+	weakErrors  = 0.2
+)
+
+type linkQuality struct {
+	// Moving averages of write latency, seconds, and of writes failing
+	latency float64
+	errors  float64
+	writes  int
+
+	lock sync.Mutex
+}
+
+func (q *linkQuality) observe(d time.Duration, err error) {
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	failed := 0.0
+	if err != nil {
+		failed = 1
+	}
+	// Plain averages until the window fills
+	q.writes++
+	n := q.writes
+	if n > qualityWindow {
+		n = qualityWindow
+	}
+	q.latency += (d.Seconds() - q.latency) / float64(n)
+	q.errors += (failed - q.errors) / float64(n)
+}
+
+// weakerRssi is the lower of two signals in dBm, either 0 if unknown
+func weakerRssi(a, b int) int {
+	if a == 0 || (b != 0 && b < a) {
+		return b
+	}
+	return a
+}
+
+// spacing is how many write intervals apart to write a brick heard at
+// rssi dBm, 0 if unknown
+func (q *linkQuality) spacing(rssi int) int {
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	switch {
+	case rssi != 0 && rssi < weakRssi, q.latency > weakLatency.Seconds(), q.errors > weakErrors:
+		return 4
+	case rssi != 0 && rssi < fairRssi, q.latency > fairLatency.Seconds(), q.errors > fairErrors:
+		return 2
+	}
+	return 1
+}
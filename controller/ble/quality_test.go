@@ -0,0 +1,43 @@
+package ble
+
+import (
+	"errors"
+	"testing"
+	"time"
+)
+
+func TestLinkQuality(t *testing.T) {
+	var q linkQuality
+	if n := q.spacing(0); n != 1 {
+		t.Errorf("unknown link spaced %d", n)
+	}
+	if n := q.spacing(-80); n != 2 {
+		t.Errorf("fair signal spaced %d", n)
+	}
+	if n := q.spacing(-90); n != 4 {
+		t.Errorf("weak signal spaced %d", n)
+	}
+	for i := 0; i < qualityWindow; i++ {
+		q.observe(10*time.Millisecond, nil)
+	}
+	if n := q.spacing(-60); n != 1 {
+		t.Errorf("strong link spaced %d", n)
+	}
+	// One in ten failing
+	for i := 0; i < qualityWindow; i++ {
+		var err error
+		if i%10 == 0 {
+			err = errors.New("failed")
+		}
+		q.observe(10*time.Millisecond, err)
+	}
+	if n := q.spacing(-60); n != 2 {
+		t.Errorf("lossy link spaced %d, errors %g", n, q.errors)
+	}
+	for i := 0; i < 2*qualityWindow; i++ {
+		q.observe(time.Second, nil)
+	}
+	if n := q.spacing(-60); n != 4 {
+		t.Errorf("slow link spaced %d", n)
+	}
+}
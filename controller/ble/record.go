@@ -0,0 +1,300 @@
+package ble
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"github.com/paypal/gatt"
+	"io"
+	"log"
+	"sync"
+	"time"
+)
+
+// A session with real bricks can be recorded, everything gatt tells the
+// controller and everything the controller asks of it with how long it
+// took, and replayed later against a changed controller; see replay.go.
+// The recording sits between gatt and the channel, wrapping each adapter
+// and each peripheral it hands over.
+//
+// The log is a header then records, each the microseconds since the
+// last, a kind, and a length prefixed body of varints and length
+// prefixed strings. Brick IDs and UUIDs are given once, in their own
+// records, and referred to by the order they came in.
+const (
+	recHeader  = "LBREC\x01"
+	recFlushAt = time.Second
+)
+
+// Record kinds
+const (
+	// A brick ID or UUID, numbered in order
+	recBrick = iota + 1
+	recUUID
+	// Brick, name, RSSI, manufacturer data, advertised services
+	recDiscovered
+	// Brick: the controller asked to connect
+	recConnect
+	// Brick, error
+	recConnected
+	recDisconnected
+	// Brick, then service, UUID, properties, handle, value handle and
+	// descriptor handle of each characteristic
+	recChars
+	// Brick, UUID, value
+	recNotify
+	// Brick, UUID, no response, microseconds taken, error, value
+	recWrite
+	// Brick, UUID, microseconds taken, error, value
+	recRead
+)
+
+// recBuf builds a record body
+type recBuf []byte
+
+func (b *recBuf) uint(v uint64) {
+	var s [binary.MaxVarintLen64]byte
+	*b = append(*b, s[:binary.PutUvarint(s[:], v)]...)
+}
+
+func (b *recBuf) int(v int64) {
+	var s [binary.MaxVarintLen64]byte
+	*b = append(*b, s[:binary.PutVarint(s[:], v)]...)
+}
+
+func (b *recBuf) bytes(v []byte) {
+	b.uint(uint64(len(v)))
+	*b = append(*b, v...)
+}
+
+func (b *recBuf) str(s string) {
+	b.uint(uint64(len(s)))
+	*b = append(*b, s...)
+}
+
+func (b *recBuf) err(err error) {
+	if err == nil {
+		b.str("")
+		return
+	}
+	b.str(err.Error())
+}
+
+type recorder struct {
+	w      *bufio.Writer
+	start  time.Time
+	last   int64
+	bricks map[string]uint64
+	uuids  map[string]uint64
+
+	lock sync.Mutex
+}
+
+func newRecorder(w io.Writer) (*recorder, error) {
+	r := &recorder{w: bufio.NewWriter(w),
+		start:  time.Now(),
+		bricks: make(map[string]uint64),
+		uuids:  make(map[string]uint64),
+	}
+	if _, err := r.w.WriteString(recHeader); err != nil {
+		return nil, err
+	}
+	go r.flusher()
+	return r, nil
+}
+
+// flusher writes the buffer out every so often, so a recording cut
+// short loses little
+func (r *recorder) flusher() {
+	for range time.Tick(recFlushAt) {
+		r.lock.Lock()
+		if r.w == nil {
+			r.lock.Unlock()
+			return
+		}
+		if err := r.w.Flush(); err != nil {
+			r.failed(err)
+		}
+		r.lock.Unlock()
+	}
+}
+
+// failed stops the recording. Called with r.lock held.
+func (r *recorder) failed(err error) {
+	log.Printf("Recording stopped: %s", err)
+	r.w = nil
+}
+
+// emit writes one record. Called with r.lock held.
+func (r *recorder) emit(kind byte, body recBuf) {
+	if r.w == nil {
+		return
+	}
+	at := int64(time.Since(r.start) / time.Microsecond)
+	var b recBuf
+	b.uint(uint64(at - r.last))
+	r.last = at
+	b = append(b, kind)
+	b.bytes(body)
+	if _, err := r.w.Write(b); err != nil {
+		r.failed(err)
+	}
+}
+
+// intern numbers name, recording it the first time. Called with r.lock
+// held.
+func (r *recorder) intern(names map[string]uint64, kind byte, name string) uint64 {
+	i, ok := names[name]
+	if !ok {
+		i = uint64(len(names))
+		names[name] = i
+		var b recBuf
+		b.str(name)
+		r.emit(kind, b)
+	}
+	return i
+}
+
+func (r *recorder) uuid(u gatt.UUID) uint64 {
+	return r.intern(r.uuids, recUUID, u.String())
+}
+
+// event records kind for brick id, with the rest of the body from build
+func (r *recorder) event(kind byte, id string, build func(b *recBuf)) {
+	r.lock.Lock()
+	defer r.lock.Unlock()
+	if r.w == nil {
+		return
+	}
+	var b recBuf
+	b.uint(r.intern(r.bricks, recBrick, id))
+	if build != nil {
+		build(&b)
+	}
+	r.emit(kind, b)
+}
+
+// characteristics records the characteristics the brick was run with,
+// discovered or cached
+func (r *recorder) characteristics(id string, cs []*gatt.Characteristic) {
+	r.event(recChars, id, func(b *recBuf) {
+		chars := newGattEntry(nil, cs).chars
+		b.uint(uint64(len(chars)))
+		for _, cc := range chars {
+			b.uint(r.intern(r.uuids, recUUID, cc.service))
+			b.uint(r.intern(r.uuids, recUUID, cc.uuid))
+			b.uint(uint64(cc.props))
+			b.uint(uint64(cc.h))
+			b.uint(uint64(cc.vh))
+			b.uint(uint64(cc.cccd))
+		}
+	})
+}
+
+// recDevice records what goes through one adapter
+type recDevice struct {
+	gatt.Device
+	r *recorder
+}
+
+// recPeriph records a peripheral's reads, writes and notifications
+type recPeriph struct {
+	gatt.Peripheral
+	d *recDevice
+}
+
+func unwrapPeriph(p gatt.Peripheral) gatt.Peripheral {
+	if rp, ok := p.(*recPeriph); ok {
+		return rp.Peripheral
+	}
+	return p
+}
+
+func (d *recDevice) Connect(p gatt.Peripheral) {
+	d.r.event(recConnect, p.ID(), nil)
+	d.Device.Connect(unwrapPeriph(p))
+}
+
+func (d *recDevice) CancelConnection(p gatt.Peripheral) {
+	d.Device.CancelConnection(unwrapPeriph(p))
+}
+
+func (d *recDevice) discovered(f func(gatt.Peripheral, *gatt.Advertisement, int)) func(gatt.Peripheral, *gatt.Advertisement, int) {
+	return func(p gatt.Peripheral, a *gatt.Advertisement, rssi int) {
+		d.r.event(recDiscovered, p.ID(), func(b *recBuf) {
+			b.str(p.Name())
+			b.int(int64(rssi))
+			b.bytes(a.ManufacturerData)
+			b.uint(uint64(len(a.Services)))
+			for _, u := range a.Services {
+				b.uint(d.r.uuid(u))
+			}
+		})
+		f(&recPeriph{Peripheral: p, d: d}, a, rssi)
+	}
+}
+
+// connection wraps the connected or disconnected handler as kind
+func (d *recDevice) connection(kind byte, f func(gatt.Peripheral, error)) func(gatt.Peripheral, error) {
+	return func(p gatt.Peripheral, err error) {
+		d.r.event(kind, p.ID(), func(b *recBuf) { b.err(err) })
+		f(&recPeriph{Peripheral: p, d: d}, err)
+	}
+}
+
+func (p *recPeriph) Device() gatt.Device { return p.d }
+
+func (p *recPeriph) ReadCharacteristic(c *gatt.Characteristic) ([]byte, error) {
+	start := time.Now()
+	v, err := p.Peripheral.ReadCharacteristic(c)
+	took := time.Since(start)
+	p.d.r.event(recRead, p.ID(), func(b *recBuf) {
+		b.uint(p.d.r.uuid(c.UUID()))
+		b.uint(uint64(took / time.Microsecond))
+		b.err(err)
+		b.bytes(v)
+	})
+	return v, err
+}
+
+func (p *recPeriph) WriteCharacteristic(c *gatt.Characteristic, v []byte, noRsp bool) error {
+	start := time.Now()
+	err := p.Peripheral.WriteCharacteristic(c, v, noRsp)
+	took := time.Since(start)
+	p.d.r.event(recWrite, p.ID(), func(b *recBuf) {
+		b.uint(p.d.r.uuid(c.UUID()))
+		if noRsp {
+			b.uint(1)
+		} else {
+			b.uint(0)
+		}
+		b.uint(uint64(took / time.Microsecond))
+		b.err(err)
+		b.bytes(v)
+	})
+	return err
+}
+
+func (p *recPeriph) SetNotifyValue(c *gatt.Characteristic, f func(*gatt.Characteristic, []byte, error)) error {
+	id := p.ID()
+	return p.Peripheral.SetNotifyValue(c, func(c *gatt.Characteristic, v []byte, err error) {
+		p.d.r.event(recNotify, id, func(b *recBuf) {
+			b.uint(p.d.r.uuid(c.UUID()))
+			b.bytes(v)
+		})
+		f(c, v, err)
+	})
+}
+
+// NewRecordingBLEChannelOn is NewBLEChannelOn with everything to and
+// from the bricks recorded to w
+func NewRecordingBLEChannelOn(hcis []int, w io.Writer) (BLEChannel, error) {
+	if w == nil {
+		return nil, errors.New("nothing to record to")
+	}
+	r, err := newRecorder(w)
+	if err != nil {
+		return nil, err
+	}
+	return newBLEChannelOn(hcis, r), nil
+}
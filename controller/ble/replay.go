@@ -0,0 +1,533 @@
+package ble
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"github.com/paypal/gatt"
+	"github.com/theatrus/ledbrick/controller/clock"
+	"io"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// A recording, see record.go, is replayed through the channel's own gatt
+// handlers. Advertisements, notifications and disconnects come when they
+// came, scaled by the replay's speed. Connections, reads and writes come
+// when the controller asks for them, each brick's in the order they were
+// recorded and taking as long as they took, so a changed controller is
+// paced by the fleet it was recorded against. Whatever a brick was asked
+// past the end of its recording goes through at once: reads come back
+// empty and never-recorded connections never finish. Every brick comes
+// through one adapter.
+type Recording struct {
+	bricks []string
+	// Advertisements, notifications and disconnects in time order
+	timeline []recEvent
+	// Each brick's characteristics at each connection
+	chars map[int][][]cachedChar
+	// Connections, reads and writes by brick and characteristic, in order
+	ops map[recOp][]recIO
+	// How long the recorded session ran
+	Length time.Duration
+}
+
+type recOp struct {
+	kind  byte
+	brick int
+	uuid  string
+}
+
+type recEvent struct {
+	at       time.Duration
+	kind     byte
+	brick    int
+	name     string
+	rssi     int
+	uuid     string
+	value    []byte
+	services []gatt.UUID
+	err      string
+}
+
+// recIO is one connection, read or write and how it went
+type recIO struct {
+	took  time.Duration
+	err   string
+	value []byte
+}
+
+var errRecordShort = errors.New("record cut short")
+
+// recBody reads a record body
+type recBody struct {
+	b   []byte
+	err error
+}
+
+func (d *recBody) uint() uint64 {
+	v, n := binary.Uvarint(d.b)
+	if n <= 0 {
+		d.err, d.b = errRecordShort, nil
+		return 0
+	}
+	d.b = d.b[n:]
+	return v
+}
+
+func (d *recBody) int() int64 {
+	v, n := binary.Varint(d.b)
+	if n <= 0 {
+		d.err, d.b = errRecordShort, nil
+		return 0
+	}
+	d.b = d.b[n:]
+	return v
+}
+
+func (d *recBody) bytes() []byte {
+	n := d.uint()
+	if n > uint64(len(d.b)) {
+		d.err, d.b = errRecordShort, nil
+		return nil
+	}
+	v := d.b[:n:n]
+	d.b = d.b[n:]
+	return v
+}
+
+func (d *recBody) str() string { return string(d.bytes()) }
+
+// ReadRecording reads a recording back. One cut off mid-record, as one
+// stopped by a crash would be, is read up to the cut.
+func ReadRecording(r io.Reader) (*Recording, error) {
+	br := bufio.NewReader(r)
+	header := make([]byte, len(recHeader))
+	if _, err := io.ReadFull(br, header); err != nil || string(header) != recHeader {
+		return nil, errors.New("not a brick recording")
+	}
+	rec := &Recording{chars: make(map[int][][]cachedChar), ops: make(map[recOp][]recIO)}
+	var uuids []string
+	// When each brick last asked to connect
+	connecting := make(map[int]time.Duration)
+	var at time.Duration
+	for n := 0; ; n++ {
+		delta, err := binary.ReadUvarint(br)
+		if err == io.EOF {
+			break
+		}
+		var kind byte
+		var size uint64
+		if err == nil {
+			kind, err = br.ReadByte()
+		}
+		if err == nil {
+			size, err = binary.ReadUvarint(br)
+		}
+		body := make([]byte, size)
+		if err == nil {
+			_, err = io.ReadFull(br, body)
+		}
+		if err == io.EOF || err == io.ErrUnexpectedEOF {
+			break
+		}
+		if err != nil {
+			return nil, err
+		}
+		at += time.Duration(delta) * time.Microsecond
+		rec.Length = at
+
+		d := &recBody{b: body}
+		if kind == recUUID {
+			uuids = append(uuids, d.str())
+			continue
+		}
+		if kind == recBrick {
+			rec.bricks = append(rec.bricks, d.str())
+			continue
+		}
+		brick := int(d.uint())
+		if brick >= len(rec.bricks) && d.err == nil {
+			return nil, fmt.Errorf("record %d: brick %d not given", n, brick)
+		}
+		uuid := func() string {
+			i := d.uint()
+			if i >= uint64(len(uuids)) {
+				if d.err == nil {
+					d.err = fmt.Errorf("uuid %d not given", i)
+				}
+				return ""
+			}
+			return uuids[i]
+		}
+		e := recEvent{at: at, kind: kind, brick: brick}
+		switch kind {
+		case recDiscovered:
+			e.name = d.str()
+			e.rssi = int(d.int())
+			e.value = d.bytes()
+			for i := d.uint(); i > 0 && d.err == nil; i-- {
+				if u, err := gatt.ParseUUID(uuid()); err == nil {
+					e.services = append(e.services, u)
+				}
+			}
+			rec.timeline = append(rec.timeline, e)
+		case recConnect:
+			connecting[brick] = at
+		case recConnected:
+			op := recOp{kind: recConnected, brick: brick}
+			if since, ok := connecting[brick]; ok {
+				rec.ops[op] = append(rec.ops[op], recIO{took: at - since, err: d.str()})
+				delete(connecting, brick)
+			}
+		case recDisconnected:
+			e.err = d.str()
+			rec.timeline = append(rec.timeline, e)
+		case recChars:
+			var chars []cachedChar
+			for i := d.uint(); i > 0 && d.err == nil; i-- {
+				cc := cachedChar{service: uuid(), uuid: uuid()}
+				cc.props = gatt.Property(d.uint())
+				cc.h, cc.vh, cc.cccd = uint16(d.uint()), uint16(d.uint()), uint16(d.uint())
+				chars = append(chars, cc)
+			}
+			rec.chars[brick] = append(rec.chars[brick], chars)
+		case recNotify:
+			e.uuid = uuid()
+			e.value = d.bytes()
+			rec.timeline = append(rec.timeline, e)
+		case recWrite, recRead:
+			op := recOp{kind: kind, brick: brick, uuid: uuid()}
+			if kind == recWrite {
+				d.uint()
+			}
+			result := recIO{took: time.Duration(d.uint()) * time.Microsecond, err: d.str(), value: d.bytes()}
+			rec.ops[op] = append(rec.ops[op], result)
+		}
+		// Kinds from a later recorder are passed over
+		if d.err != nil {
+			return nil, fmt.Errorf("record %d: %v", n, d.err)
+		}
+	}
+	return rec, nil
+}
+
+func recError(s string) error {
+	if s == "" {
+		return nil
+	}
+	return errors.New(s)
+}
+
+// ReplayChannel is a channel driven by a recording
+type ReplayChannel struct {
+	BLEChannel
+	ble     *bleChannel
+	rec     *Recording
+	speed   float64
+	dev     *replayDevice
+	periphs []*replayPeriph
+	// How far through each brick's connections, reads and writes
+	next map[recOp]int
+	// Closed to stop, and once the timeline has played
+	done     chan struct{}
+	finished chan struct{}
+	start    time.Time
+
+	connects, writes, writeBytes, notifies int64
+
+	lock sync.Mutex
+}
+
+// ReplayReport is what a replay did
+type ReplayReport struct {
+	Length, Took time.Duration
+	Events       int
+	Connects     int64
+	Writes       int64
+	WriteBytes   int64
+	Notifies     int64
+}
+
+func (r ReplayReport) String() string {
+	return fmt.Sprintf("%v recorded replayed in %v: %d events, %d connections, %d writes (%d bytes), %d notifications",
+		r.Length, r.Took.Truncate(time.Millisecond), r.Events, r.Connects, r.Writes, r.WriteBytes, r.Notifies)
+}
+
+// Replay starts replaying the recording, speed times as fast as it was
+// recorded
+func (rec *Recording) Replay(speed float64) (*ReplayChannel, error) {
+	if speed <= 0 {
+		return nil, fmt.Errorf("replay speed %g", speed)
+	}
+	rc := &ReplayChannel{rec: rec, speed: speed,
+		next:     make(map[recOp]int),
+		done:     make(chan struct{}),
+		finished: make(chan struct{}),
+	}
+	rc.dev = &replayDevice{rc: rc}
+	rc.ble = newBleChannel([]*adapter{{d: rc.dev, hci: -1}}, clock.Real)
+	rc.BLEChannel = rc.ble
+	for i, id := range rec.bricks {
+		rc.periphs = append(rc.periphs, &replayPeriph{rc: rc, brick: i, id: id})
+	}
+	rc.start = time.Now()
+	go rc.ble.run()
+	go rc.run()
+	return rc, nil
+}
+
+// scaled is d at the replay's speed
+func (rc *ReplayChannel) scaled(d time.Duration) time.Duration {
+	return time.Duration(float64(d) / rc.speed)
+}
+
+// pop is brick's next recorded op, if there's one left
+func (rc *ReplayChannel) pop(op recOp) (recIO, bool) {
+	rc.lock.Lock()
+	defer rc.lock.Unlock()
+	ios := rc.rec.ops[op]
+	i := rc.next[op]
+	if i >= len(ios) {
+		return recIO{}, false
+	}
+	rc.next[op] = i + 1
+	return ios[i], true
+}
+
+// characteristics is what brick had at its nth connection, the last
+// ones again past the recorded connections
+func (rc *ReplayChannel) characteristics(brick, n int) []*gatt.Characteristic {
+	chars := rc.rec.chars[brick]
+	if len(chars) == 0 {
+		return nil
+	}
+	if n >= len(chars) {
+		n = len(chars) - 1
+	}
+	return (&gattEntry{chars: chars[n]}).characteristics()
+}
+
+func (rc *ReplayChannel) run() {
+	defer close(rc.finished)
+	for _, e := range rc.rec.timeline {
+		if wait := time.Until(rc.start.Add(rc.scaled(e.at))); wait > 0 {
+			t := time.NewTimer(wait)
+			select {
+			case <-rc.done:
+				t.Stop()
+				return
+			case <-t.C:
+			}
+		}
+		p := rc.periphs[e.brick]
+		switch e.kind {
+		case recDiscovered:
+			p.lock.Lock()
+			p.name = e.name
+			p.lock.Unlock()
+			rc.ble.onPeriphDiscovered(p, &gatt.Advertisement{LocalName: e.name,
+				ManufacturerData: e.value, Services: e.services}, e.rssi)
+		case recDisconnected:
+			if p.drop() {
+				rc.ble.onPeriphDisconnected(p, recError(e.err))
+			}
+		case recNotify:
+			if c, f := p.subscriber(e.uuid); f != nil {
+				atomic.AddInt64(&rc.notifies, 1)
+				f(c, e.value, nil)
+			}
+		}
+	}
+}
+
+// Wait waits for the recording to play out, or the replay to be closed
+func (rc *ReplayChannel) Wait() ReplayReport {
+	<-rc.finished
+	return ReplayReport{Length: rc.rec.Length,
+		Took:       time.Since(rc.start),
+		Events:     len(rc.rec.timeline),
+		Connects:   atomic.LoadInt64(&rc.connects),
+		Writes:     atomic.LoadInt64(&rc.writes),
+		WriteBytes: atomic.LoadInt64(&rc.writeBytes),
+		Notifies:   atomic.LoadInt64(&rc.notifies),
+	}
+}
+
+// Close stops the replay and the bricks' writers
+func (rc *ReplayChannel) Close() {
+	close(rc.done)
+	rc.ble.idleTicker.Stop()
+	rc.ble.lock.Lock()
+	defer rc.ble.lock.Unlock()
+	for _, p := range rc.ble.connectedPeriph {
+		p.states.close()
+	}
+}
+
+// replayDevice is the one adapter every replayed brick comes through.
+// Only what the channel calls is implemented.
+type replayDevice struct {
+	gatt.Device
+	rc *ReplayChannel
+}
+
+func (d *replayDevice) Scan(ss []gatt.UUID, dup bool)     {}
+func (d *replayDevice) StopScanning()                     {}
+func (d *replayDevice) Advertise(a *gatt.AdvPacket) error { return nil }
+
+// Connect connects the brick as its next recorded connection did
+func (d *replayDevice) Connect(p gatt.Peripheral) {
+	rp := p.(*replayPeriph)
+	c, ok := d.rc.pop(recOp{kind: recConnected, brick: rp.brick})
+	if !ok {
+		return
+	}
+	atomic.AddInt64(&d.rc.connects, 1)
+	time.AfterFunc(d.rc.scaled(c.took), func() {
+		select {
+		case <-d.rc.done:
+			return
+		default:
+		}
+		if c.err == "" {
+			rp.connect()
+		}
+		d.rc.ble.onPeriphConnected(rp, recError(c.err))
+	})
+}
+
+// CancelConnection drops the brick, as gatt would tell the channel
+func (d *replayDevice) CancelConnection(p gatt.Peripheral) {
+	rp := p.(*replayPeriph)
+	if rp.drop() {
+		go d.rc.ble.onPeriphDisconnected(rp, nil)
+	}
+}
+
+// replayPeriph is one replayed brick, across its connections
+type replayPeriph struct {
+	gatt.Peripheral
+	rc    *ReplayChannel
+	brick int
+	id    string
+
+	name      string
+	connected bool
+	// Connections so far
+	connections int
+	subs        map[string]replaySub
+
+	lock sync.Mutex
+}
+
+type replaySub struct {
+	c *gatt.Characteristic
+	f func(*gatt.Characteristic, []byte, error)
+}
+
+func (p *replayPeriph) connect() {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	p.connected = true
+	p.connections++
+	p.subs = make(map[string]replaySub)
+}
+
+// drop disconnects the brick, returning whether it was connected
+func (p *replayPeriph) drop() bool {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	was := p.connected
+	p.connected = false
+	p.subs = nil
+	return was
+}
+
+func (p *replayPeriph) subscriber(uuid string) (*gatt.Characteristic, func(*gatt.Characteristic, []byte, error)) {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	s := p.subs[uuid]
+	return s.c, s.f
+}
+
+func (p *replayPeriph) Device() gatt.Device { return p.rc.dev }
+func (p *replayPeriph) ID() string          { return p.id }
+func (p *replayPeriph) Name() string {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	return p.name
+}
+func (p *replayPeriph) ReadRSSI() int           { return 0 }
+func (p *replayPeriph) SetMTU(mtu uint16) error { return nil }
+
+func (p *replayPeriph) DiscoverServices(ss []gatt.UUID) ([]*gatt.Service, error) {
+	p.lock.Lock()
+	n := p.connections - 1
+	p.lock.Unlock()
+	var services []*gatt.Service
+	seen := make(map[*gatt.Service]bool)
+	for _, c := range p.rc.characteristics(p.brick, n) {
+		if s := c.Service(); !seen[s] {
+			seen[s] = true
+			services = append(services, s)
+		}
+	}
+	return services, nil
+}
+
+func (p *replayPeriph) DiscoverCharacteristics(cs []gatt.UUID, s *gatt.Service) ([]*gatt.Characteristic, error) {
+	return s.Characteristics(), nil
+}
+
+func (p *replayPeriph) DiscoverDescriptors(ds []gatt.UUID, c *gatt.Characteristic) ([]*gatt.Descriptor, error) {
+	if d := c.Descriptor(); d != nil {
+		return []*gatt.Descriptor{d}, nil
+	}
+	return nil, nil
+}
+
+func (p *replayPeriph) ReadDescriptor(d *gatt.Descriptor) ([]byte, error) {
+	return []byte{0, 0}, nil
+}
+
+func (p *replayPeriph) WriteDescriptor(d *gatt.Descriptor, b []byte) error { return nil }
+
+func (p *replayPeriph) ReadCharacteristic(c *gatt.Characteristic) ([]byte, error) {
+	r, ok := p.rc.pop(recOp{kind: recRead, brick: p.brick, uuid: c.UUID().String()})
+	if !ok {
+		return nil, nil
+	}
+	time.Sleep(p.rc.scaled(r.took))
+	return r.value, recError(r.err)
+}
+
+func (p *replayPeriph) ReadLongCharacteristic(c *gatt.Characteristic) ([]byte, error) {
+	return p.ReadCharacteristic(c)
+}
+
+func (p *replayPeriph) WriteCharacteristic(c *gatt.Characteristic, b []byte, noRsp bool) error {
+	atomic.AddInt64(&p.rc.writes, 1)
+	atomic.AddInt64(&p.rc.writeBytes, int64(len(b)))
+	w, ok := p.rc.pop(recOp{kind: recWrite, brick: p.brick, uuid: c.UUID().String()})
+	if !ok {
+		return nil
+	}
+	time.Sleep(p.rc.scaled(w.took))
+	return recError(w.err)
+}
+
+func (p *replayPeriph) SetNotifyValue(c *gatt.Characteristic, f func(*gatt.Characteristic, []byte, error)) error {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	if p.subs != nil {
+		p.subs[c.UUID().String()] = replaySub{c, f}
+	}
+	return nil
+}
+
+func (p *replayPeriph) SetIndicateValue(c *gatt.Characteristic, f func(*gatt.Characteristic, []byte, error)) error {
+	return p.SetNotifyValue(c, f)
+}
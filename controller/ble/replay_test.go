@@ -0,0 +1,109 @@
+package ble
+
+import (
+	"bytes"
+	"github.com/paypal/gatt"
+	"sync/atomic"
+	"testing"
+	"time"
+)
+
+// Connects when asked and takes its writes
+type recTestDevice struct {
+	gatt.Device
+	connected func(gatt.Peripheral, error)
+}
+
+func (d *recTestDevice) Connect(p gatt.Peripheral) {
+	time.Sleep(5 * time.Millisecond)
+	d.connected(p, nil)
+}
+
+type recTestPeriph struct {
+	gatt.Peripheral
+	notify func(*gatt.Characteristic, []byte, error)
+}
+
+func (p *recTestPeriph) ID() string   { return "recorded" }
+func (p *recTestPeriph) Name() string { return brickName }
+func (p *recTestPeriph) WriteCharacteristic(*gatt.Characteristic, []byte, bool) error {
+	time.Sleep(time.Millisecond)
+	return nil
+}
+func (p *recTestPeriph) SetNotifyValue(c *gatt.Characteristic, f func(*gatt.Characteristic, []byte, error)) error {
+	p.notify = f
+	return nil
+}
+
+func TestRecordReplay(t *testing.T) {
+	svc := gatt.NewService(gatt.MustParseUUID(pwmService))
+	command := gatt.NewCharacteristic(gatt.MustParseUUID(pwmCommandChar), svc, gatt.CharWriteNR|gatt.CharNotify, 10, 11)
+	telemetry := gatt.NewCharacteristic(gatt.MustParseUUID(pwmTelemetryChar), svc, gatt.CharNotify, 12, 13)
+	cs := []*gatt.Characteristic{command, telemetry}
+
+	var buf bytes.Buffer
+	r, err := newRecorder(&buf)
+	if err != nil {
+		t.Fatal(err)
+	}
+	d := &recTestDevice{}
+	rd := &recDevice{Device: d, r: r}
+	d.connected = rd.connection(recConnected, func(p gatt.Peripheral, err error) {
+		r.characteristics(p.ID(), cs)
+		p.SetNotifyValue(telemetry, func(*gatt.Characteristic, []byte, error) {})
+		p.WriteCharacteristic(command, []byte{1, 2, 3}, true)
+	})
+	discovered := rd.discovered(func(p gatt.Peripheral, a *gatt.Advertisement, rssi int) {
+		p.Device().Connect(p)
+	})
+	disconnected := rd.connection(recDisconnected, func(gatt.Peripheral, error) {})
+
+	p := &recTestPeriph{}
+	discovered(p, &gatt.Advertisement{LocalName: brickName}, -60)
+	time.Sleep(30 * time.Millisecond)
+	b := make([]byte, telemetryLen)
+	b[0], b[7] = 0x90, telemetryTempValid
+	p.notify(telemetry, b, nil)
+	time.Sleep(10 * time.Millisecond)
+	disconnected(p, nil)
+	r.lock.Lock()
+	r.w.Flush()
+	r.lock.Unlock()
+
+	rec, err := ReadRecording(bytes.NewReader(buf.Bytes()))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(rec.bricks) != 1 || len(rec.timeline) != 3 || rec.Length < 40*time.Millisecond {
+		t.Fatalf("%d bricks, %d events over %v", len(rec.bricks), len(rec.timeline), rec.Length)
+	}
+	connects := rec.ops[recOp{kind: recConnected}]
+	writes := rec.ops[recOp{kind: recWrite, uuid: pwmCommandChar}]
+	if len(connects) != 1 || connects[0].took < 5*time.Millisecond {
+		t.Errorf("connections %v", connects)
+	}
+	if len(writes) != 1 || !bytes.Equal(writes[0].value, []byte{1, 2, 3}) || writes[0].took < time.Millisecond {
+		t.Errorf("writes %v", writes)
+	}
+	// Cut off anywhere, it reads up to the cut
+	if _, err := ReadRecording(bytes.NewReader(buf.Bytes()[:buf.Len()-3])); err != nil {
+		t.Error(err)
+	}
+
+	rc, err := rec.Replay(2)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer rc.Close()
+	report := rc.Wait()
+	if report.Connects != 1 || report.Notifies != 1 || report.Took < 20*time.Millisecond {
+		t.Errorf("report %s", report)
+	}
+	m := rc.ble.metrics.brick("recorded")
+	if c, d := atomic.LoadInt64(&m.connects), atomic.LoadInt64(&m.disconnects); c != 1 || d != 1 {
+		t.Errorf("%d connects, %d disconnects", c, d)
+	}
+	if temperature16 := atomic.LoadInt64(&m.temperature16); temperature16 != 0x90 {
+		t.Errorf("telemetry not replayed: %d", temperature16)
+	}
+}
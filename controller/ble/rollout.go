@@ -0,0 +1,301 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"sync/atomic"
+	"time"
+)
+
+// FirmwareRollout is how an update goes across the bricks: a canary
+// wave first, then waves of the rest, each checked before the next
+// starts. Within a wave each adapter runs its own transfers, so a
+// controller with several spreads them out.
+type FirmwareRollout struct {
+	// Bricks in the first wave
+	Canary int
+	// Bricks in each wave after, 0 for all the rest at once
+	Wave int
+	// Transfers at once through each adapter
+	PerAdapter int
+	// A brick waits while any of its channels is above this percent,
+	// its lights going off for the restart, 100 to update whenever
+	BrightPercent float64
+	// Halt after a wave whose slowest transfer was under this many
+	// bytes a second, 0 for no floor
+	MinRate float64
+}
+
+var DefaultFirmwareRollout = FirmwareRollout{Canary: 1, Wave: 4, PerAdapter: dfuParallel, BrightPercent: 100}
+
+func (r FirmwareRollout) validate() error {
+	switch {
+	case r.Canary < 1:
+		return fmt.Errorf("canary wave must have a brick, got %d", r.Canary)
+	case r.Wave < 0:
+		return fmt.Errorf("wave must be positive or 0 for the rest, got %d", r.Wave)
+	case r.PerAdapter < 1:
+		return fmt.Errorf("at least one transfer per adapter, got %d", r.PerAdapter)
+	case r.BrightPercent < 0 || r.BrightPercent > 100:
+		return fmt.Errorf("bright level must be 0-100%%, got %g", r.BrightPercent)
+	case r.MinRate < 0:
+		return fmt.Errorf("minimum rate must be positive, got %g", r.MinRate)
+	}
+	return nil
+}
+
+const (
+	// Back on the new firmware this long before it's judged, so its
+	// telemetry has come in
+	dfuSettle = 30 * time.Second
+	// Not back this long after the transfer, it's judged failed
+	dfuHealthTimeout = 5 * time.Minute
+)
+
+type dfuJob struct {
+	attempts int
+	done     bool
+	// Handed over to the bootloader, zero while waiting for a slot
+	entered time.Time
+	// Last attempt failed, left for the bootloader to time out
+	failed bool
+	// Last offered a slot, so a brick gone for good stops holding up
+	// its wave
+	offered time.Time
+	// Wave it went in, once it has
+	admitted bool
+	wave     int
+	adapter  int
+	// Once done: when, how fast, and how it came back
+	updated time.Time
+	rate    float64
+	checked bool
+	healthy bool
+}
+
+// over is whether the job has gone as far as it will
+func (j *dfuJob) over(now time.Time) bool {
+	if j.done {
+		return j.checked
+	}
+	return j.attempts >= dfuMaxAttempts && (j.entered.IsZero() || now.Sub(j.entered) >= dfuSlotExpiry)
+}
+
+// A firmware update rolled across every brick seen, a wave at a time.
+// Each brick goes once per controller run.
+type dfuUpdate struct {
+	image   *firmwareImage
+	rollout FirmwareRollout
+	jobs    map[string]*dfuJob
+	// The wave going now, and whether the rollout stopped at one
+	wave   int
+	halted bool
+	// When it began, for holding it to maintenance windows
+	started time.Time
+}
+
+func newDfuUpdate(img *firmwareImage, r FirmwareRollout) *dfuUpdate {
+	return &dfuUpdate{image: img, rollout: r, jobs: make(map[string]*dfuJob)}
+}
+
+func (u *dfuUpdate) job(id string) *dfuJob {
+	j := u.jobs[id]
+	if j == nil {
+		j = &dfuJob{}
+		u.jobs[id] = j
+	}
+	return j
+}
+
+// busy is the transfers running through adapter, -1 for all of them
+func (u *dfuUpdate) busy(adapter int, now time.Time) int {
+	n := 0
+	for _, j := range u.jobs {
+		if !j.done && !j.entered.IsZero() && now.Sub(j.entered) < dfuSlotExpiry &&
+			(adapter < 0 || j.adapter == adapter) {
+			n++
+		}
+	}
+	return n
+}
+
+func (u *dfuUpdate) inProgress() bool {
+	return u.busy(-1, time.Now()) > 0
+}
+
+// size is how many bricks go in wave w, 0 for no limit
+func (u *dfuUpdate) size(w int) int {
+	if w == 0 {
+		return u.rollout.Canary
+	}
+	return u.rollout.Wave
+}
+
+func (u *dfuUpdate) members(w int) []*dfuJob {
+	var js []*dfuJob
+	for _, j := range u.jobs {
+		if j.admitted && j.wave == w {
+			js = append(js, j)
+		}
+	}
+	return js
+}
+
+// quiet is whether a brick being written s can go dark for the restart
+func (u *dfuUpdate) quiet(s *ledState) bool {
+	if u.rollout.BrightPercent >= 100 {
+		return true
+	}
+	for _, percent := range s.percents {
+		if percent > u.rollout.BrightPercent {
+			return false
+		}
+	}
+	return true
+}
+
+// Whether a brick running the application, connected through adapter,
+// should be sent over now
+func (u *dfuUpdate) claim(id string, adapter int, now time.Time) bool {
+	if u.halted {
+		return false
+	}
+	j := u.job(id)
+	if j.done || j.attempts >= dfuMaxAttempts {
+		return false
+	}
+	j.offered = now
+	if !j.entered.IsZero() && now.Sub(j.entered) < dfuSlotExpiry {
+		return false
+	}
+	if !j.admitted {
+		if n := u.size(u.wave); n > 0 && len(u.members(u.wave)) >= n {
+			return false
+		}
+	} else if j.wave != u.wave {
+		return false
+	}
+	if u.busy(adapter, now) >= u.rollout.PerAdapter {
+		return false
+	}
+	if !j.admitted {
+		j.admitted, j.wave = true, u.wave
+	}
+	j.entered = now
+	j.adapter = adapter
+	j.failed = false
+	return true
+}
+
+// Whether an advertising bootloader for this brick should be connected
+func (u *dfuUpdate) wants(id string) bool {
+	j := u.jobs[id]
+	return j != nil && !j.done && !j.failed && !j.entered.IsZero() &&
+		j.attempts < dfuMaxAttempts
+}
+
+// Back on the application, having timed out or finished
+func (u *dfuUpdate) release(id string) {
+	if j := u.jobs[id]; j != nil {
+		j.entered = time.Time{}
+	}
+}
+
+// finished records a transfer of n bytes that took d
+func (u *dfuUpdate) finished(id string, n int, d time.Duration, now time.Time) float64 {
+	j := u.job(id)
+	j.done = true
+	j.updated = now
+	if d > 0 {
+		j.rate = float64(n) / d.Seconds()
+	}
+	return j.rate
+}
+
+// advance judges the bricks updated in the wave going, once they've had
+// time to come back, and moves on to the next wave once every one has
+// gone as far as it will. health is whether a brick is back on the
+// application without errors, and whether it's connected at all. A
+// wave with a failure, or a transfer under the rollout's floor, halts
+// the rollout.
+func (u *dfuUpdate) advance(now time.Time, health func(id string) (healthy, back bool)) {
+	if u.halted {
+		return
+	}
+	for id, j := range u.jobs {
+		if !j.admitted || j.wave != u.wave || !j.done || j.checked {
+			continue
+		}
+		healthy, back := health(id)
+		switch {
+		case back && now.Sub(j.updated) >= dfuSettle:
+			j.checked, j.healthy = true, healthy
+		case now.Sub(j.updated) >= dfuHealthTimeout:
+			j.checked = true
+		default:
+			continue
+		}
+		if !j.healthy {
+			log.Printf("%s: unhealthy on the new firmware", id)
+		}
+	}
+
+	members := u.members(u.wave)
+	if len(members) == 0 {
+		return
+	}
+	waiting := false
+	for _, j := range u.jobs {
+		if !j.admitted && now.Sub(j.offered) < dfuSlotExpiry {
+			waiting = true
+		}
+	}
+	if n := u.size(u.wave); waiting && (n == 0 || len(members) < n) {
+		// Room for more before it's judged
+		return
+	}
+	updated, failed := 0, 0
+	slowest, total := math.Inf(1), 0.0
+	for _, j := range members {
+		if !j.over(now) {
+			return
+		}
+		if !j.done || !j.healthy {
+			failed++
+			continue
+		}
+		updated++
+		total += j.rate
+		slowest = math.Min(slowest, j.rate)
+	}
+	msg := fmt.Sprintf("Firmware wave %d: %d updated, %d failed", u.wave, updated, failed)
+	if updated > 0 {
+		msg += fmt.Sprintf(", %.0f B/s mean, %.0f B/s slowest", total/float64(updated), slowest)
+	}
+	log.Print(msg)
+	switch {
+	case failed > 0:
+		log.Printf("Firmware rollout halted at wave %d", u.wave)
+		u.halted = true
+	case u.rollout.MinRate > 0 && slowest < u.rollout.MinRate:
+		log.Printf("Firmware rollout halted at wave %d, transfers under %.0f B/s", u.wave, u.rollout.MinRate)
+		u.halted = true
+	default:
+		u.wave++
+	}
+}
+
+// dfuHealth is whether a brick is back on its application with no
+// errors standing, warnings aside. Called with ble.lock held.
+func (ble *bleChannel) dfuHealth(id string) (bool, bool) {
+	p := ble.connectedPeriph[id]
+	if p == nil || p.ledChar == nil {
+		return false, false
+	}
+	return p.Errors()&^errorWarnings == 0, true
+}
+
+func (b *brickMetrics) setDfuRate(rate float64) {
+	atomic.StoreInt64(&b.dfuRate, int64(rate))
+}
@@ -0,0 +1,70 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestRolloutWaves(t *testing.T) {
+	now := time.Now()
+	u := newDfuUpdate(&firmwareImage{bin: make([]byte, 1000)}, FirmwareRollout{Canary: 1, Wave: 2, PerAdapter: 4, MinRate: 50})
+	healthy := map[string]bool{}
+	health := func(id string) (bool, bool) {
+		ok, back := healthy[id]
+		return ok, back
+	}
+	update := func(id string, took time.Duration) {
+		u.finished(id, 1000, took, now)
+		u.release(id)
+		healthy[id] = true
+	}
+
+	// The canary goes alone
+	if !u.claim("a", 0, now) || u.claim("b", 0, now) || u.claim("c", 1, now) {
+		t.Fatal("canary not alone")
+	}
+	update("a", 10*time.Second)
+	u.advance(now, health)
+	if u.wave != 0 {
+		t.Fatal("canary judged before it settled")
+	}
+	now = now.Add(dfuSettle)
+	u.advance(now, health)
+	if u.wave != 1 || u.halted {
+		t.Fatalf("wave %d after the canary, halted %v", u.wave, u.halted)
+	}
+
+	// Then the rest, one too slow
+	if !u.claim("b", 0, now) || !u.claim("c", 1, now) || u.claim("d", 0, now) {
+		t.Fatal("second wave not filled")
+	}
+	update("b", 10*time.Second)
+	update("c", 100*time.Second)
+	now = now.Add(dfuSettle)
+	u.advance(now, health)
+	if !u.halted || u.claim("d", 0, now) {
+		t.Errorf("rollout not halted on a slow wave, wave %d", u.wave)
+	}
+
+	// A brick that doesn't come back fails its wave
+	u = newDfuUpdate(&firmwareImage{}, FirmwareRollout{Canary: 1, PerAdapter: 1})
+	u.claim("a", 0, now)
+	u.finished("a", 1000, time.Second, now)
+	u.advance(now.Add(dfuHealthTimeout), func(string) (bool, bool) { return false, false })
+	if !u.halted {
+		t.Error("rollout went on past a lost brick")
+	}
+}
+
+func TestRolloutQuiet(t *testing.T) {
+	u := newDfuUpdate(nil, FirmwareRollout{Canary: 1, PerAdapter: 1, BrightPercent: 20})
+	s := &ledState{}
+	s.percents[3] = 15
+	if !u.quiet(s) {
+		t.Error("dim brick held")
+	}
+	s.percents[9] = 60
+	if u.quiet(s) {
+		t.Error("bright brick updated")
+	}
+}
@@ -0,0 +1,93 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+	"strings"
+	"time"
+)
+
+// Per channel run hours and lumen maintenance, laid out in the
+// firmware's runhours.h. Hours are weighted by duty, so an hour at half
+// output counts half. A channel given its rated life to L70 has its
+// duty raised as it ages, up to half again.
+const (
+	runHoursChannels = 16
+	runHoursRecord   = 11
+	runHoursSet      = 5
+	runHoursGainOne  = 1 << 10
+)
+
+type runHours struct {
+	channel int
+	on      time.Duration
+	// Hours given to L70, 0 if not compensated
+	rated uint32
+	gain  float64
+}
+
+type runHoursLog []runHours
+
+func (l runHoursLog) String() string {
+	var r []string
+	for _, h := range l {
+		s := fmt.Sprintf("%d: %.0fh", h.channel, h.on.Hours())
+		if h.rated != 0 {
+			s += fmt.Sprintf(" of %dh, gain %.3f", h.rated, h.gain)
+		}
+		r = append(r, s)
+	}
+	return strings.Join(r, ", ")
+}
+
+func parseRunHours(b []byte) (runHoursLog, error) {
+	if len(b)%runHoursRecord != 0 {
+		return nil, fmt.Errorf("bad run hours length %d", len(b))
+	}
+	var l runHoursLog
+	for off := 0; off < len(b); off += runHoursRecord {
+		r := b[off:]
+		l = append(l, runHours{
+			channel: int(r[0]),
+			on:      time.Duration(binary.LittleEndian.Uint32(r[1:])) * time.Second,
+			rated:   binary.LittleEndian.Uint32(r[5:]),
+			gain:    float64(binary.LittleEndian.Uint16(r[9:])) / runHoursGainOne,
+		})
+	}
+	return l, nil
+}
+
+// runHoursBody packs rated lives, one per channel from 0, into one bulk
+// command body
+func runHoursBody(hours []int) ([]byte, error) {
+	if len(hours) > runHoursChannels {
+		return nil, fmt.Errorf("rated life for at most %d channels, got %d", runHoursChannels, len(hours))
+	}
+	body := make([]byte, 0, len(hours)*runHoursSet)
+	for i, h := range hours {
+		if h < 0 || h > 1000000 {
+			return nil, fmt.Errorf("channel %d: rated life must be 0-1000000 hours, got %d", i, h)
+		}
+		var r [runHoursSet]byte
+		r[0] = byte(i)
+		binary.LittleEndian.PutUint32(r[1:], uint32(h))
+		body = append(body, r[:]...)
+	}
+	return body, nil
+}
+
+// Set the rated lives in body, if any, and log the run hours the brick
+// replies with
+func (p *blePeriph) logRunHours(body []byte) error {
+	b, err := p.bulk.request(bulkCmdRunHours, body, bulkReplyTimeout)
+	if err != nil {
+		return err
+	}
+	l, err := parseRunHours(b)
+	if err != nil {
+		return err
+	}
+	log.Printf("%s: run hours: %s", p.gp.ID(), l)
+	return nil
+}
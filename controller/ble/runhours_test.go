@@ -0,0 +1,45 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+	"time"
+)
+
+func TestParseRunHours(t *testing.T) {
+	b := make([]byte, 2*runHoursRecord)
+	b[runHoursRecord] = 1
+	binary.LittleEndian.PutUint32(b[runHoursRecord+1:], 10000*3600)
+	binary.LittleEndian.PutUint32(b[runHoursRecord+5:], 50000)
+	binary.LittleEndian.PutUint16(b[runHoursRecord+9:], 1089)
+	l, err := parseRunHours(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(l) != 2 || l[0].channel != 0 || l[0].on != 0 {
+		t.Fatalf("%+v", l)
+	}
+	if h := l[1]; h.channel != 1 || h.on != 10000*time.Hour || h.rated != 50000 || h.gain < 1.06 || h.gain > 1.07 {
+		t.Errorf("%+v", h)
+	}
+	if _, err := parseRunHours(b[:runHoursRecord+1]); err == nil {
+		t.Error("short record parsed")
+	}
+}
+
+func TestRunHoursBody(t *testing.T) {
+	body, err := runHoursBody([]int{50000, 0, 36000})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(body) != 3*runHoursSet || body[2*runHoursSet] != 2 ||
+		binary.LittleEndian.Uint32(body[2*runHoursSet+1:]) != 36000 {
+		t.Errorf("body %x", body)
+	}
+	if _, err := runHoursBody([]int{-1}); err == nil {
+		t.Error("negative life accepted")
+	}
+	if _, err := runHoursBody(make([]int, runHoursChannels+1)); err == nil {
+		t.Error("too many channels accepted")
+	}
+}
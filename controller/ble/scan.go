@@ -0,0 +1,130 @@
+package ble
+
+import (
+	"github.com/paypal/gatt"
+	"log"
+	"sync"
+	"time"
+)
+
+// Scanning shares the radio with every connection, so reports are cut
+// down before they reach the channel lock and scanning stops while
+// every brick expected is live. Bricks advertise their name and
+// telemetry, with the LED service in the scan response; reconnecting
+// ones advertise directed, with nothing but their address, so those
+// are known by ID. Duplicates stay on, as the advertised telemetry
+// changes from report to report, but each device is only looked at
+// once a throttle interval. Phones and beacons rotate their addresses,
+// so what's kept on devices other than bricks is bounded, the longest
+// unseen forgotten first.
+const (
+	brickName       = "LEDBrick-PWM"
+	brickService    = 0x1523
+	scanThrottle    = time.Second
+	scanForgetAfter = 10 * time.Minute
+	// Devices throttled, and ignored as not bricks
+	scanMaxTracked = 1024
+	scanMaxIgnored = 4096
+	// Looked at again after this, in case one turns out to be a brick
+	scanIgnoreFor = time.Hour
+)
+
+var brickServiceUUID = gatt.UUID16(brickService)
+
+type scanFilter struct {
+	last *timeLRU
+	// Devices that aren't bricks, and bricks seen
+	ignored *timeLRU
+	bricks  map[string]bool
+
+	lock sync.Mutex
+}
+
+func newScanFilter() *scanFilter {
+	return &scanFilter{
+		last:    newTimeLRU(scanMaxTracked, scanForgetAfter),
+		ignored: newTimeLRU(scanMaxIgnored, scanIgnoreFor),
+		bricks:  make(map[string]bool),
+	}
+}
+
+// looksLikeBrick is whether an advertisement is from a brick, its
+// bootloader or a brick's broadcast telemetry
+func looksLikeBrick(a *gatt.Advertisement) bool {
+	if a.LocalName == brickName || a.LocalName == dfuTargetName {
+		return true
+	}
+	for _, u := range a.Services {
+		if u.Equal(brickServiceUUID) {
+			return true
+		}
+	}
+	_, ok := parseAdvTelemetry(a.ManufacturerData)
+	return ok
+}
+
+// pass is whether a report from id is worth handling now
+func (f *scanFilter) pass(id string, a *gatt.Advertisement, now time.Time) bool {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	if _, ok := f.ignored.get(id, now); ok {
+		return false
+	}
+	if last, ok := f.last.get(id, now); ok && now.Sub(last) < scanThrottle {
+		return false
+	}
+	if !f.bricks[id] && !looksLikeBrick(a) {
+		f.ignored.put(id, now)
+		f.last.remove(id)
+		return false
+	}
+	f.last.put(id, now)
+	return true
+}
+
+func (f *scanFilter) brick(id string) {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	f.bricks[id] = true
+}
+
+func (f *scanFilter) ignore(id string, now time.Time) {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	if !f.bricks[id] {
+		f.ignored.put(id, now)
+		f.last.remove(id)
+	}
+}
+
+// ExpectBricks stops scanning while n bricks are live, 0 to always scan
+func (ble *bleChannel) ExpectBricks(n int) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.expected = n
+	ble.setScanning(n == 0 || ble.liveLinks < n)
+}
+
+// setScanning starts or stops scanning on every powered adapter.
+// Called with ble.lock held.
+func (ble *bleChannel) setScanning(on bool) {
+	for _, a := range ble.adapters {
+		if !a.powered || a.scanning == on {
+			continue
+		}
+		a.scanning = on
+		if on {
+			a.d.Scan([]gatt.UUID{}, true)
+		} else {
+			a.d.StopScanning()
+		}
+	}
+	if on != ble.scanning {
+		ble.scanning = on
+		if on {
+			log.Println("Scanning...")
+		} else {
+			log.Printf("All %d bricks live, scanning paused", ble.expected)
+		}
+	}
+}
@@ -0,0 +1,67 @@
+package ble
+
+import (
+	"github.com/paypal/gatt"
+	"testing"
+	"time"
+)
+
+func TestScanFilter(t *testing.T) {
+	f := newScanFilter()
+	now := time.Now()
+	brick := &gatt.Advertisement{LocalName: brickName}
+	if !f.pass("a", brick, now) {
+		t.Error("brick dropped")
+	}
+	if f.pass("a", brick, now.Add(scanThrottle/2)) {
+		t.Error("duplicate inside the throttle passed")
+	}
+	if !f.pass("a", brick, now.Add(scanThrottle)) {
+		t.Error("report after the throttle dropped")
+	}
+
+	other := &gatt.Advertisement{LocalName: "Phone"}
+	if f.pass("b", other, now) || f.pass("b", brick, now.Add(time.Minute)) {
+		t.Error("other device passed")
+	}
+	if !f.pass("c", &gatt.Advertisement{Services: []gatt.UUID{brickServiceUUID}}, now) {
+		t.Error("brick service dropped")
+	}
+
+	// Directed reconnects carry nothing, known bricks get through
+	if f.pass("d", &gatt.Advertisement{}, now) {
+		t.Error("empty advertisement passed from an unknown device")
+	}
+	f.brick("e")
+	if !f.pass("e", &gatt.Advertisement{}, now) {
+		t.Error("known brick's directed advertisement dropped")
+	}
+	f.ignore("e", now)
+	if !f.pass("e", &gatt.Advertisement{}, now.Add(time.Minute)) {
+		t.Error("known brick ignored")
+	}
+}
+
+func TestScanFilterBounded(t *testing.T) {
+	f := newScanFilter()
+	now := time.Now()
+	phone := &gatt.Advertisement{LocalName: "Phone"}
+	for i := 0; i < 2*scanMaxIgnored; i++ {
+		f.pass(string(rune(i)), phone, now)
+	}
+	if f.ignored.len() != scanMaxIgnored {
+		t.Errorf("%d ignored", f.ignored.len())
+	}
+	brick := &gatt.Advertisement{LocalName: brickName}
+	for i := 0; i < 2*scanMaxTracked; i++ {
+		f.pass(string(rune(0x10000+i)), brick, now)
+	}
+	if f.last.len() != scanMaxTracked {
+		t.Errorf("%d tracked", f.last.len())
+	}
+	// Looked at again once the ignore lapses
+	f.ignore("x", now)
+	if f.pass("x", brick, now.Add(time.Minute)) || !f.pass("x", brick, now.Add(scanIgnoreFor)) {
+		t.Error("ignore didn't lapse")
+	}
+}
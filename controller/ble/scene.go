@@ -0,0 +1,44 @@
+package ble
+
+import (
+	"fmt"
+	"time"
+)
+
+// On-device scene presets, laid out in the firmware's scene.h
+const (
+	sceneSlots       = 8
+	sceneMaxChannels = 16
+)
+
+type scene struct {
+	slot     int
+	fade     time.Duration
+	percents []float64
+	// Bulk command body that programs the slot
+	body []byte
+}
+
+func newScene(slot int, fade time.Duration, percents []float64) (*scene, error) {
+	if slot < 0 || slot >= sceneSlots {
+		return nil, fmt.Errorf("scene slot must be 0-%d, got %d", sceneSlots-1, slot)
+	}
+	if len(percents) == 0 || len(percents) > sceneMaxChannels {
+		return nil, fmt.Errorf("scene needs 1-%d channels, got %d", sceneMaxChannels, len(percents))
+	}
+	ms := int(fade / time.Millisecond)
+	if ms < 0 || ms > 0xffff {
+		return nil, fmt.Errorf("scene fade out of range: %s", fade)
+	}
+	mask := uint16(1)<<uint(len(percents)) - 1
+	body := []byte{byte(slot), byte(mask), byte(mask >> 8), byte(ms), byte(ms >> 8)}
+	for _, pct := range percents {
+		level := int((pct / 100.0) * ledMaxLevel)
+		body = append(body, byte(level), byte(level>>8))
+	}
+	return &scene{slot: slot, fade: fade, percents: percents, body: body}, nil
+}
+
+func sceneRecallRecord(slot int) cmdRecord {
+	return cmdRecord{op: cmdOpSceneRecall, value: []byte{byte(slot)}}
+}
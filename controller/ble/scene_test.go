@@ -0,0 +1,43 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+	"time"
+)
+
+func TestSceneEncode(t *testing.T) {
+	sc, err := newScene(2, 1500*time.Millisecond, []float64{100, 0, 50})
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := []byte{2, 0x07, 0x00, 0xdc, 0x05, 0xa0, 0x0f, 0, 0, 0xd0, 0x07}
+	if !bytes.Equal(sc.body, want) {
+		t.Errorf("body % x", sc.body)
+	}
+	if _, err := newScene(sceneSlots, 0, []float64{0}); err == nil {
+		t.Error("out of range slot accepted")
+	}
+	if _, err := newScene(0, time.Minute+10*time.Second, []float64{0}); err == nil {
+		t.Error("fade over 65 s accepted")
+	}
+}
+
+func TestBroadcastScene(t *testing.T) {
+	b, err := newBroadcaster(3, bytes.Repeat([]byte{0x11}, 16))
+	if err != nil {
+		t.Fatal(err)
+	}
+	b.frames([]int{0}, 1000)
+	p := b.scene(5)
+	if len(p) != broadcastSceneLen+broadcastMacLen || p[0] != broadcastSceneMagic || p[1] != 3 || p[6] != 5 {
+		t.Errorf("payload % x", p)
+	}
+	// Shares the sequence with frames, so replay protection covers both
+	if p[2] != 2 {
+		t.Errorf("seq %d", p[2])
+	}
+	if !bytes.Equal(b.mac(p[:broadcastSceneLen]), p[broadcastSceneLen:]) {
+		t.Error("MAC mismatch")
+	}
+}
@@ -0,0 +1,217 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"sync"
+	"time"
+)
+
+// On-device schedule upload, laid out in the firmware's schedule.h
+const (
+	scheduleMagic       = 0x534c
+	scheduleMaxPoints   = 24
+	scheduleMaxChannels = 16
+	scheduleMinutes     = 24 * 60
+	scheduleMaxLevel    = 4095
+	// Write op and offset, then as much of the points as fits
+	scheduleChunk = 20 - 3
+
+	scheduleOpBegin  = 1
+	scheduleOpData   = 2
+	scheduleOpCommit = 3
+	scheduleOpClear  = 4
+	scheduleOpEdit   = 5
+
+	scheduleStatusLen   = 7
+	scheduleFlagTime    = 1 << 0
+	scheduleFlagRunning = 1 << 1
+	scheduleFlagHeld    = 1 << 2
+	scheduleFlagStoring = 1 << 3
+	scheduleFlagUnsaved = 1 << 4
+)
+
+// ScheduleMaxPoints is the most points a peripheral stores
+const ScheduleMaxPoints = scheduleMaxPoints
+
+// SchedulePoint is one step of a daily photoperiod, which peripherals
+// interpolate between on their own.
+type SchedulePoint struct {
+	// Minutes since local midnight
+	Minute   int
+	Percents []float64
+}
+
+type schedule struct {
+	writes [][]byte
+	// The same upload as one bulk command body
+	bulk     []byte
+	count    int
+	channels int
+	crc      uint16
+	// The points as stored
+	data []byte
+	// And as given, for placing work where it's quiet (maint.go)
+	points []SchedulePoint
+}
+
+// newSchedule encodes points, in time order, as the writes that upload
+// them, ending with the commit.
+func newSchedule(points []SchedulePoint) (*schedule, error) {
+	if len(points) == 0 || len(points) > scheduleMaxPoints {
+		return nil, fmt.Errorf("schedule needs 1-%d points, got %d", scheduleMaxPoints, len(points))
+	}
+	channels := len(points[0].Percents)
+	if channels == 0 || channels > scheduleMaxChannels {
+		return nil, fmt.Errorf("schedule needs 1-%d channels, got %d", scheduleMaxChannels, channels)
+	}
+
+	data := make([]byte, 0, len(points)*(2+2*channels))
+	for i, p := range points {
+		if p.Minute < 0 || p.Minute >= scheduleMinutes || (i > 0 && p.Minute <= points[i-1].Minute) {
+			return nil, errors.New("schedule points must be in order within one day")
+		}
+		if len(p.Percents) != channels {
+			return nil, errors.New("schedule points must all have the same channels")
+		}
+		data = append(data, byte(p.Minute), byte(p.Minute>>8))
+		for _, pct := range p.Percents {
+			level := int((pct / 100.0) * ledMaxLevel)
+			if level < 0 || level > scheduleMaxLevel {
+				return nil, fmt.Errorf("schedule level %g%% is past what bricks take", pct)
+			}
+			data = append(data, byte(level), byte(level>>8))
+		}
+	}
+
+	s := &schedule{count: len(points), channels: channels, crc: crc16(0xffff, data), data: data, points: points}
+	s.writes = append(s.writes, []byte{scheduleOpBegin, byte(len(points)), byte(channels)})
+	for off := 0; off < len(data); off += scheduleChunk {
+		end := off + scheduleChunk
+		if end > len(data) {
+			end = len(data)
+		}
+		w := []byte{scheduleOpData, byte(off), byte(off >> 8)}
+		s.writes = append(s.writes, append(w, data[off:end]...))
+	}
+	s.writes = append(s.writes, []byte{scheduleOpCommit, byte(s.crc), byte(s.crc >> 8)})
+	s.bulk = append([]byte{byte(len(points)), byte(channels), byte(s.crc), byte(s.crc >> 8)}, data...)
+	return s, nil
+}
+
+type scheduleStatus struct {
+	count    int
+	channels int
+	crc      uint16
+	flags    uint8
+	minute   int
+}
+
+func parseScheduleStatus(b []byte) (scheduleStatus, error) {
+	if len(b) < scheduleStatusLen {
+		return scheduleStatus{}, fmt.Errorf("short schedule status (%d bytes)", len(b))
+	}
+	return scheduleStatus{
+		count:    int(b[0]),
+		channels: int(b[1]),
+		crc:      binary.LittleEndian.Uint16(b[2:]),
+		flags:    b[4],
+		minute:   int(binary.LittleEndian.Uint16(b[5:])),
+	}, nil
+}
+
+// matches reports whether the peripheral already holds this schedule.
+func (s *schedule) matches(st scheduleStatus) bool {
+	return st.count == s.count && st.crc == s.crc && st.flags&scheduleFlagUnsaved == 0
+}
+
+// editWrites turns a peripheral holding prev into one holding s,
+// sending only the chunks of points that changed, and whether that
+// beats uploading s whole
+func (s *schedule) editWrites(prev *schedule) ([][]byte, bool) {
+	if prev.channels != s.channels {
+		return nil, false
+	}
+	ws := [][]byte{{scheduleOpEdit, byte(s.count), byte(s.channels)}}
+	for off := 0; off < len(s.data); off += scheduleChunk {
+		end := off + scheduleChunk
+		if end > len(s.data) {
+			end = len(s.data)
+		}
+		if end <= len(prev.data) && bytes.Equal(s.data[off:end], prev.data[off:end]) {
+			continue
+		}
+		w := []byte{scheduleOpData, byte(off), byte(off >> 8)}
+		ws = append(ws, append(w, s.data[off:end]...))
+	}
+	ws = append(ws, []byte{scheduleOpCommit, byte(s.crc), byte(s.crc >> 8)})
+	return ws, len(ws) < len(s.writes)
+}
+
+// heldSchedules is the schedule each brick last confirmed holding, by
+// peripheral ID, kept across reconnects so an edit is sent as one
+type heldSchedules struct {
+	bricks map[string]*schedule
+
+	lock sync.Mutex
+}
+
+func newHeldSchedules() *heldSchedules {
+	return &heldSchedules{bricks: make(map[string]*schedule)}
+}
+
+func (h *heldSchedules) get(id string) *schedule {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	return h.bricks[id]
+}
+
+func (h *heldSchedules) set(id string, s *schedule) {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.bricks[id] = s
+}
+
+// MaxScheduleCrossfade is the longest the firmware blends between
+// schedules over
+const MaxScheduleCrossfade = time.Hour
+
+// SetScheduleCrossfade has every upload from now on blend over d from
+// the schedule a brick is running, on bricks that take it; the rest
+// swap at once. Another upload during the blend starts from wherever
+// the first one is headed.
+func (ble *bleChannel) SetScheduleCrossfade(d time.Duration) error {
+	if d < 0 || d > MaxScheduleCrossfade {
+		return fmt.Errorf("crossfade must be 0-%v, got %v", MaxScheduleCrossfade, d)
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	ble.crossfade = d
+	return nil
+}
+
+// crossfades is whether p blends into the next schedule over crossfade
+func (p *blePeriph) crossfades(crossfade time.Duration) bool {
+	return crossfade > 0 && p.caps != nil && p.caps.has(capCrossfade)
+}
+
+// crossfadeBytes is crossfade as the commit and bulk schedule take it,
+// whole seconds
+func crossfadeBytes(crossfade time.Duration) []byte {
+	secs := uint16(crossfade / time.Second)
+	return []byte{byte(secs), byte(secs >> 8)}
+}
+
+// crossfaded is ws, ending in a commit, with the commit asking p to blend
+// over crossfade when it can
+func (p *blePeriph) crossfaded(ws [][]byte, crossfade time.Duration) [][]byte {
+	if !p.crossfades(crossfade) {
+		return ws
+	}
+	out := append([][]byte(nil), ws...)
+	last := out[len(out)-1]
+	out[len(out)-1] = append(last[:len(last):len(last)], crossfadeBytes(crossfade)...)
+	return out
+}
@@ -0,0 +1,115 @@
+package ble
+
+import (
+	"testing"
+	"time"
+)
+
+func TestScheduleEncode(t *testing.T) {
+	s, err := newSchedule([]SchedulePoint{
+		{Minute: 600, Percents: []float64{0, 0, 0, 0, 0, 0, 0, 0}},
+		{Minute: 630, Percents: []float64{100, 50, 0, 0, 0, 0, 0, 0}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// Begin, 36 bytes of points in 17 byte chunks, commit
+	if len(s.writes) != 1+3+1 {
+		t.Fatalf("%d writes", len(s.writes))
+	}
+	if b := s.writes[0]; b[0] != scheduleOpBegin || b[1] != 2 || b[2] != 8 {
+		t.Errorf("begin %x", b)
+	}
+	var data []byte
+	for _, w := range s.writes[1:4] {
+		if w[0] != scheduleOpData || int(w[1])|int(w[2])<<8 != len(data) || len(w) > 20 {
+			t.Errorf("data %x", w)
+		}
+		data = append(data, w[3:]...)
+	}
+	if len(data) != 36 || data[0] != 0x58 || data[1] != 0x02 {
+		t.Errorf("points %x", data)
+	}
+	// 100% on the second point's first channel
+	if level := int(data[20]) | int(data[21])<<8; level != ledMaxLevel {
+		t.Errorf("level %d", level)
+	}
+	c := s.writes[4]
+	if c[0] != scheduleOpCommit || uint16(c[1])|uint16(c[2])<<8 != crc16(0xffff, data) {
+		t.Errorf("commit %x", c)
+	}
+}
+
+func TestScheduleOrder(t *testing.T) {
+	_, err := newSchedule([]SchedulePoint{
+		{Minute: 630, Percents: []float64{0}},
+		{Minute: 600, Percents: []float64{0}},
+	})
+	if err == nil {
+		t.Error("out of order points accepted")
+	}
+}
+
+func TestScheduleEdit(t *testing.T) {
+	points := make([]SchedulePoint, 8)
+	for i := range points {
+		points[i] = SchedulePoint{Minute: 60 * i, Percents: []float64{0, 0, 0, 0, 0, 0, 0, 0}}
+	}
+	prev, err := newSchedule(points)
+	if err != nil {
+		t.Fatal(err)
+	}
+	points[5].Percents = []float64{0, 0, 0, 50, 0, 0, 0, 0}
+	s, _ := newSchedule(points)
+
+	ws, ok := s.editWrites(prev)
+	if !ok || len(ws) != 3 {
+		t.Fatalf("%d edit writes for one point", len(ws))
+	}
+	if b := ws[0]; b[0] != scheduleOpEdit || b[1] != 8 || b[2] != 8 {
+		t.Errorf("edit %x", b)
+	}
+	// Point 5's level for channel 3 at byte 5*18+2+6
+	if off := int(ws[1][1]) | int(ws[1][2])<<8; ws[1][0] != scheduleOpData || off > 98 || off+len(ws[1])-3 <= 98 {
+		t.Errorf("data %x", ws[1])
+	}
+	// Replaying the edit over the old points gives the new ones
+	data := append([]byte(nil), prev.data...)
+	for _, w := range ws[1 : len(ws)-1] {
+		off := int(w[1]) | int(w[2])<<8
+		copy(data[off:], w[3:])
+	}
+	if crc16(0xffff, data) != s.crc {
+		t.Error("edited points don't match")
+	}
+
+	// A channel count change goes whole
+	points[0].Percents = []float64{0}
+	for i := range points {
+		points[i].Percents = []float64{0}
+	}
+	narrow, _ := newSchedule(points)
+	if _, ok := narrow.editWrites(prev); ok {
+		t.Error("edited across a channel change")
+	}
+}
+
+func TestScheduleCrossfade(t *testing.T) {
+	s, _ := newSchedule(maintPoints)
+	old := &blePeriph{caps: &capability{}}
+	if ws := old.crossfaded(s.writes, time.Minute); len(ws[len(ws)-1]) != 3 {
+		t.Error("crossfade sent to firmware without it")
+	}
+	p := &blePeriph{caps: &capability{bits: capCrossfade}}
+	ws := p.crossfaded(s.writes, 90*time.Second)
+	if c := ws[len(ws)-1]; len(c) != 5 || c[0] != scheduleOpCommit || c[3] != 90 || c[4] != 0 {
+		t.Errorf("commit %x", c)
+	}
+	if len(s.writes[len(s.writes)-1]) != 3 {
+		t.Error("crossfade left on the schedule's own writes")
+	}
+	if ws := p.crossfaded(s.writes, 0); len(ws[len(ws)-1]) != 3 {
+		t.Error("crossfade sent for none")
+	}
+}
@@ -0,0 +1,435 @@
+package ble
+
+import (
+	"encoding/binary"
+	"encoding/hex"
+	"errors"
+	"fmt"
+	"io"
+)
+
+// A bare nRF51 dongle can stand in for an HCI adapter, running Nordic's
+// serialization connectivity firmware (components/serialization/
+// connectivity, on S130) so the SoftDevice's calls are made over its
+// UART. The UART PHY puts each packet's length ahead of it, 16 bit
+// little endian, and a packet is its type and then a command (opcode and
+// arguments), a command's response (opcode, result and outputs) or an
+// event (id and fields), each laid out as the serializers under
+// components/serialization do. Only the central's calls the channel
+// needs are coded here.
+const (
+	sdPktCmd  = 0
+	sdPktResp = 1
+	sdPktEvt  = 2
+
+	sdAbsent  = 0
+	sdPresent = 1
+
+	sdOpEnable        = 0x60
+	sdOpUUIDVSAdd     = 0x63
+	sdOpAdvDataSet    = 0x72
+	sdOpAdvStart      = 0x73
+	sdOpConnUpdate    = 0x75
+	sdOpDisconnect    = 0x76
+	sdOpRSSIStart     = 0x84
+	sdOpScanStart     = 0x86
+	sdOpScanStop      = 0x87
+	sdOpConnect       = 0x88
+	sdOpConnectCancel = 0x89
+	sdOpPrimDisc      = 0x90
+	sdOpCharDisc      = 0x92
+	sdOpDescDisc      = 0x93
+	sdOpRead          = 0x95
+	sdOpWrite         = 0x97
+
+	sdEvtTxComplete   = 0x01
+	sdEvtConnected    = 0x10
+	sdEvtDisconnected = 0x11
+	sdEvtConnUpdate   = 0x12
+	sdEvtTimeout      = 0x19
+	sdEvtRSSIChanged  = 0x1a
+	sdEvtAdvReport    = 0x1b
+	sdEvtPrimDisc     = 0x30
+	sdEvtCharDisc     = 0x32
+	sdEvtDescDisc     = 0x33
+	sdEvtReadRsp      = 0x35
+	sdEvtWriteRsp     = 0x37
+	sdEvtHVX          = 0x38
+	sdEvtGattcTimeout = 0x39
+
+	sdUUIDTypeBLE    = 1
+	sdWriteReq       = 1
+	sdWriteCmd       = 2
+	sdTimeoutSrcConn = 3
+	sdAdvNonConn     = 3
+
+	sdGattSuccess        = 0
+	sdGattAttrNotFound   = 0x010a
+	sdErrorInvalidState  = 8
+	sdErrorNoTxBuffers   = 0x3004
+	sdHciRemoteTerminate = 0x13
+
+	// ATT's default, S130 doesn't exchange a bigger one
+	sdAttMTU = 23
+)
+
+var errSdShort = errors.New("connectivity packet cut short")
+
+// sdError is a SoftDevice call that returned other than NRF_SUCCESS
+type sdError struct {
+	op   byte
+	code uint32
+}
+
+func (e sdError) Error() string {
+	return fmt.Sprintf("connectivity call 0x%02x failed, error 0x%x", e.op, e.code)
+}
+
+func sdFailedWith(err error, code uint32) bool {
+	e, ok := err.(sdError)
+	return ok && e.code == code
+}
+
+func sdWritePacket(w io.Writer, typ byte, body []byte) error {
+	b := make([]byte, 3, 3+len(body))
+	binary.LittleEndian.PutUint16(b, uint16(1+len(body)))
+	b[2] = typ
+	_, err := w.Write(append(b, body...))
+	return err
+}
+
+func sdReadPacket(r io.Reader) (byte, []byte, error) {
+	var n [2]byte
+	if _, err := io.ReadFull(r, n[:]); err != nil {
+		return 0, nil, err
+	}
+	b := make([]byte, binary.LittleEndian.Uint16(n[:]))
+	if len(b) == 0 {
+		return 0, nil, errors.New("empty connectivity packet")
+	}
+	if _, err := io.ReadFull(r, b); err != nil {
+		return 0, nil, err
+	}
+	return b[0], b[1:], nil
+}
+
+// sdAddr is a gap address as serialized: its type and then the address,
+// least significant byte first
+type sdAddr [7]byte
+
+// id is the address as gatt gives peripheral IDs
+func (a sdAddr) id() string {
+	return fmt.Sprintf("%02X:%02X:%02X:%02X:%02X:%02X", a[6], a[5], a[4], a[3], a[2], a[1])
+}
+
+// sdBuf builds a command
+type sdBuf []byte
+
+func (b *sdBuf) u8(v byte) { *b = append(*b, v) }
+
+func (b *sdBuf) u16(v uint16) { *b = append(*b, byte(v), byte(v>>8)) }
+
+func (b *sdBuf) u32(v uint32) { *b = append(*b, byte(v), byte(v>>8), byte(v>>16), byte(v>>24)) }
+
+// scanParams is a present ble_gap_scan_params_t without a whitelist,
+// active sending scan requests, in 0.625 ms units and the timeout in
+// seconds
+func (b *sdBuf) scanParams(active bool, interval, window, timeout uint16) {
+	a := byte(0)
+	if active {
+		a = 1
+	}
+	*b = append(*b, sdPresent, a, sdAbsent)
+	b.u16(interval)
+	b.u16(window)
+	b.u16(timeout)
+}
+
+func sdEnableCmd() []byte {
+	b := sdBuf{sdOpEnable, sdPresent, 0}
+	// The default attribute table, the dongle serves nothing itself
+	b.u32(0)
+	return b
+}
+
+// sdUUIDVSAddCmd registers base, a 128 bit UUID as its string is
+// written, so its 16 bit values come back as a vendor type
+func sdUUIDVSAddCmd(base string) []byte {
+	be, _ := hex.DecodeString(base)
+	b := sdBuf{sdOpUUIDVSAdd, sdPresent}
+	for i := len(be) - 1; i >= 0; i-- {
+		b.u8(be[i])
+	}
+	// Asks for the type back
+	b.u8(sdPresent)
+	return b
+}
+
+func sdScanStartCmd(active bool, interval, window uint16) []byte {
+	b := sdBuf{sdOpScanStart}
+	b.scanParams(active, interval, window, 0)
+	return b
+}
+
+func sdScanStopCmd() []byte { return []byte{sdOpScanStop} }
+
+// sdConnectCmd connects to a, scanning for it as given and asking for
+// connection intervals between min and max (1.25 ms units) and a
+// supervision timeout (10 ms units)
+func sdConnectCmd(a sdAddr, interval, window, min, max, timeout uint16) []byte {
+	b := sdBuf{sdOpConnect, sdPresent}
+	b = append(b, a[:]...)
+	b.scanParams(true, interval, window, 0)
+	b.u8(sdPresent)
+	b.u16(min)
+	b.u16(max)
+	b.u16(0)
+	b.u16(timeout)
+	return b
+}
+
+func sdConnectCancelCmd() []byte { return []byte{sdOpConnectCancel} }
+
+// sdConnUpdateCmd has the central move conn onto p, no L2CAP request
+// needed
+func sdConnUpdateCmd(conn uint16, p connParams) []byte {
+	b := sdBuf{sdOpConnUpdate}
+	b.u16(conn)
+	b.u8(sdPresent)
+	b.u16(p.minInterval)
+	b.u16(p.maxInterval)
+	b.u16(p.latency)
+	b.u16(p.timeout)
+	return b
+}
+
+func sdDisconnectCmd(conn uint16) []byte {
+	b := sdBuf{sdOpDisconnect}
+	b.u16(conn)
+	b.u8(sdHciRemoteTerminate)
+	return b
+}
+
+// sdRSSIStartCmd reports every change in signal strength
+func sdRSSIStartCmd(conn uint16) []byte {
+	b := sdBuf{sdOpRSSIStart}
+	b.u16(conn)
+	b.u8(0)
+	b.u8(0)
+	return b
+}
+
+// sdAdvDataSetCmd advertises data, with no scan response
+func sdAdvDataSetCmd(data []byte) []byte {
+	b := sdBuf{sdOpAdvDataSet, byte(len(data)), sdPresent}
+	b = append(b, data...)
+	return append(b, 0, sdAbsent)
+}
+
+// sdAdvStartCmd advertises non-connectable every interval (0.625 ms
+// units) on all three channels until stopped
+func sdAdvStartCmd(interval uint16) []byte {
+	b := sdBuf{sdOpAdvStart, sdPresent, sdAdvNonConn, sdAbsent, 0, sdAbsent}
+	b.u16(interval)
+	b.u16(0)
+	b.u8(0)
+	return b
+}
+
+// sdPrimDiscCmd finds primary services from start, all of them
+func sdPrimDiscCmd(conn, start uint16) []byte {
+	b := sdBuf{sdOpPrimDisc}
+	b.u16(conn)
+	b.u16(start)
+	b.u8(sdAbsent)
+	return b
+}
+
+// sdRangeCmd is characteristic or descriptor discovery (op) over a
+// handle range
+func sdRangeCmd(op byte, conn, start, end uint16) []byte {
+	b := sdBuf{op}
+	b.u16(conn)
+	b.u8(sdPresent)
+	b.u16(start)
+	b.u16(end)
+	return b
+}
+
+func sdReadCmd(conn, handle, offset uint16) []byte {
+	b := sdBuf{sdOpRead}
+	b.u16(conn)
+	b.u16(handle)
+	b.u16(offset)
+	return b
+}
+
+func sdWriteCmdOf(conn uint16, op byte, handle uint16, v []byte) []byte {
+	b := sdBuf{sdOpWrite}
+	b.u16(conn)
+	b = append(b, sdPresent, op, 0)
+	b.u16(handle)
+	b.u16(0)
+	b.u16(uint16(len(v)))
+	b.u8(sdPresent)
+	return append(b, v...)
+}
+
+// sdBody reads a response or event
+type sdBody struct {
+	b   []byte
+	err error
+}
+
+func (d *sdBody) take(n int) []byte {
+	if n > len(d.b) {
+		d.err, d.b = errSdShort, nil
+		return make([]byte, n)
+	}
+	v := d.b[:n:n]
+	d.b = d.b[n:]
+	return v
+}
+
+func (d *sdBody) u8() byte { return d.take(1)[0] }
+
+func (d *sdBody) u16() uint16 { return binary.LittleEndian.Uint16(d.take(2)) }
+
+func (d *sdBody) u32() uint32 { return binary.LittleEndian.Uint32(d.take(4)) }
+
+func (d *sdBody) addr() (a sdAddr) {
+	copy(a[:], d.take(len(a)))
+	return a
+}
+
+// sdParseResponse splits a response into its opcode, result and outputs
+func sdParseResponse(b []byte) (byte, uint32, []byte, error) {
+	d := &sdBody{b: b}
+	op, result := d.u8(), d.u32()
+	return op, result, d.b, d.err
+}
+
+// sdUUID is a UUID as the SoftDevice gives it, 16 bits of a base it
+// knows by type
+type sdUUID struct {
+	uuid uint16
+	typ  byte
+}
+
+func (d *sdBody) connParams() connParams {
+	return connParams{minInterval: d.u16(), maxInterval: d.u16(), latency: d.u16(), timeout: d.u16()}
+}
+
+func (d *sdBody) uuid() sdUUID {
+	u := d.u16()
+	return sdUUID{uuid: u, typ: d.u8()}
+}
+
+type sdService struct {
+	uuid       sdUUID
+	start, end uint16
+}
+
+type sdChar struct {
+	uuid   sdUUID
+	props  byte
+	decl   uint16
+	handle uint16
+}
+
+type sdDesc struct {
+	handle uint16
+	uuid   sdUUID
+}
+
+// sdEvent is one event, with whichever fields its id has
+type sdEvent struct {
+	id   uint16
+	conn uint16
+
+	addr    sdAddr
+	rssi    int
+	scanRsp bool
+	// Advertising data, or a GATT value
+	data []byte
+	// Disconnect reason or timeout source
+	reason byte
+	// What the link runs with, on connecting and each update
+	params connParams
+
+	status    uint16
+	services  []sdService
+	chars     []sdChar
+	descs     []sdDesc
+	handle    uint16
+	offset    uint16
+	writeOp   byte
+	hvxType   byte
+	txPackets byte
+}
+
+func sdParseEvent(b []byte) (sdEvent, error) {
+	d := &sdBody{b: b}
+	e := sdEvent{id: d.u16(), conn: d.u16()}
+	switch e.id {
+	case sdEvtTxComplete:
+		e.txPackets = d.u8()
+	case sdEvtConnected:
+		e.addr = d.addr()
+		// Own address, role and IRK match
+		d.take(len(e.addr) + 2)
+		e.params = d.connParams()
+	case sdEvtConnUpdate:
+		e.params = d.connParams()
+	case sdEvtDisconnected, sdEvtTimeout:
+		e.reason = d.u8()
+	case sdEvtRSSIChanged:
+		e.rssi = int(int8(d.u8()))
+	case sdEvtAdvReport:
+		e.addr = d.addr()
+		e.rssi = int(int8(d.u8()))
+		flags := d.u8()
+		e.scanRsp = flags&1 != 0
+		e.data = d.take(int(flags >> 3))
+	case sdEvtGattcTimeout:
+		e.reason = d.u8()
+	case sdEvtPrimDisc, sdEvtCharDisc, sdEvtDescDisc, sdEvtReadRsp, sdEvtWriteRsp, sdEvtHVX:
+		e.status = d.u16()
+		// The handle an error came with
+		d.u16()
+		switch e.id {
+		case sdEvtPrimDisc:
+			for n := d.u16(); n > 0 && d.err == nil; n-- {
+				s := sdService{uuid: d.uuid()}
+				s.start, s.end = d.u16(), d.u16()
+				e.services = append(e.services, s)
+			}
+		case sdEvtCharDisc:
+			for n := d.u16(); n > 0 && d.err == nil; n-- {
+				c := sdChar{uuid: d.uuid(), props: d.u8()}
+				// Extended properties
+				d.u8()
+				c.decl, c.handle = d.u16(), d.u16()
+				e.chars = append(e.chars, c)
+			}
+		case sdEvtDescDisc:
+			for n := d.u16(); n > 0 && d.err == nil; n-- {
+				h := d.u16()
+				e.descs = append(e.descs, sdDesc{handle: h, uuid: d.uuid()})
+			}
+		case sdEvtReadRsp:
+			e.handle, e.offset = d.u16(), d.u16()
+			e.data = d.take(int(d.u16()))
+		case sdEvtWriteRsp:
+			e.handle, e.writeOp, e.offset = d.u16(), d.u8(), d.u16()
+			e.data = d.take(int(d.u16()))
+		case sdEvtHVX:
+			e.handle, e.hvxType = d.u16(), d.u8()
+			e.data = d.take(int(d.u16()))
+		}
+	}
+	if d.err != nil {
+		return e, fmt.Errorf("event 0x%02x: %v", e.id, d.err)
+	}
+	return e, nil
+}
@@ -0,0 +1,85 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+)
+
+func TestSdPackets(t *testing.T) {
+	var w bytes.Buffer
+	if err := sdWritePacket(&w, sdPktCmd, sdScanStopCmd()); err != nil {
+		t.Fatal(err)
+	}
+	if !bytes.Equal(w.Bytes(), []byte{2, 0, sdPktCmd, sdOpScanStop}) {
+		t.Errorf("framed % x", w.Bytes())
+	}
+	typ, b, err := sdReadPacket(bytes.NewReader([]byte{6, 0, sdPktResp, sdOpScanStop, 8, 0, 0, 0}))
+	if err != nil || typ != sdPktResp {
+		t.Fatalf("read %d, %v", typ, err)
+	}
+	if op, result, out, err := sdParseResponse(b); op != sdOpScanStop || result != sdErrorInvalidState || len(out) != 0 || err != nil {
+		t.Errorf("response 0x%02x %d % x %v", op, result, out, err)
+	}
+
+	cases := []struct {
+		cmd  []byte
+		want []byte
+	}{
+		{sdScanStartCmd(true, 320, 160), []byte{sdOpScanStart, 1, 1, 0, 0x40, 0x01, 0xa0, 0, 0, 0}},
+		{sdScanStartCmd(false, 320, 160), []byte{sdOpScanStart, 1, 0, 0, 0x40, 0x01, 0xa0, 0, 0, 0}},
+		{sdConnectCmd(sdAddr{1, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11}, 320, 160, 16, 32, 400),
+			[]byte{sdOpConnect, 1, 1, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 1, 1, 0, 0x40, 0x01, 0xa0, 0, 0, 0,
+				1, 16, 0, 32, 0, 0, 0, 0x90, 0x01}},
+		{sdRangeCmd(sdOpCharDisc, 0, 12, 0x20), []byte{sdOpCharDisc, 0, 0, 1, 12, 0, 0x20, 0}},
+		{sdWriteCmdOf(1, sdWriteReq, 0x0e, []byte{1, 0}), []byte{sdOpWrite, 1, 0, 1, sdWriteReq, 0, 0x0e, 0, 0, 0, 2, 0, 1, 1, 0}},
+	}
+	for i, c := range cases {
+		if !bytes.Equal(c.cmd, c.want) {
+			t.Errorf("command %d: % x, want % x", i, c.cmd, c.want)
+		}
+	}
+	// The base as it goes over the air, with the type asked for back
+	if vs := sdUUIDVSAddCmd(pwmService); len(vs) != 19 || vs[2] != 0x23 || vs[14] != 0x23 || vs[15] != 0x15 || vs[18] != sdPresent {
+		t.Errorf("vendor UUID % x", vs)
+	}
+}
+
+func TestSdEvents(t *testing.T) {
+	adv := []byte{sdEvtAdvReport, 0, 0xff, 0xff, 1, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0xc4, 7<<3 | 1,
+		6, 0x09, 'B', 'r', 'i', 'c', 'k'}
+	e, err := sdParseEvent(adv)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if e.addr.id() != "11:22:33:44:55:66" || e.rssi != -60 || !e.scanRsp || len(e.data) != 7 {
+		t.Errorf("advertisement %+v", e)
+	}
+	if _, err := sdParseEvent(adv[:len(adv)-1]); err == nil {
+		t.Error("short advertisement parsed")
+	}
+
+	p := newSdPeriph(nil, e.addr)
+	if a := p.heard(e); a.LocalName != "Brick" {
+		t.Errorf("name %q", a.LocalName)
+	}
+	a := p.heard(sdEvent{data: []byte{5, 0xff, 0x59, 0x00, 1, 2, 0, 0}})
+	if a.LocalName != "Brick" || !bytes.Equal(a.ManufacturerData, []byte{0x59, 0, 1, 2}) {
+		t.Errorf("scan response not added to %+v", a)
+	}
+
+	chars := []byte{sdEvtCharDisc, 0, 1, 0, 0, 0, 0, 0, 2, 0,
+		0x25, 0x15, 2, 0x1a, 0, 0x0c, 0, 0x0d, 0,
+		0x26, 0x15, 2, 0x12, 0, 0x0f, 0, 0x10, 0}
+	e, err = sdParseEvent(chars)
+	if err != nil || e.conn != 1 || len(e.chars) != 2 {
+		t.Fatalf("characteristics %+v, %v", e, err)
+	}
+	if c := e.chars[1]; c.uuid != (sdUUID{0x1526, 2}) || c.props != 0x12 || c.decl != 0x0f || c.handle != 0x10 {
+		t.Errorf("characteristic %+v", c)
+	}
+
+	hvx := []byte{sdEvtHVX, 0, 1, 0, 0, 0, 0, 0, 0x10, 0, 1, 2, 0, 0x90, 0x01}
+	if e, err := sdParseEvent(hvx); err != nil || e.handle != 0x10 || !bytes.Equal(e.data, []byte{0x90, 0x01}) {
+		t.Errorf("notification %+v, %v", e, err)
+	}
+}
@@ -0,0 +1,898 @@
+package ble
+
+import (
+	"bufio"
+	"errors"
+	"fmt"
+	"github.com/paypal/gatt"
+	"io"
+	"log"
+	"os"
+	"sync"
+	"time"
+)
+
+// sdDevice is a connectivity dongle (sdcodec.go) as one of the channel's
+// adapters. Only what the channel calls is implemented, as for
+// replayDevice. Commands go one at a time, each waiting for its
+// response, reading events in between. The channel's handlers run in
+// event order on a goroutine of their own so a slow one never holds up
+// a response, except connections, which are discovered alongside
+// everything else as gatt does. GATT client responses go straight to
+// the procedure waiting on them.
+//
+// The port must already be set up as the connectivity firmware's
+// ser_config.h has it, 1 Mbaud with even parity and RTS/CTS, e.g.
+//
+//	stty -F /dev/ttyACM0 raw 1000000 parenb -parodd crtscts
+//
+// S130 holds up to three bricks at once and scans or connects, not
+// both, so scanning stops for each connection and comes back after.
+type sdDevice struct {
+	gatt.Device
+	port io.ReadWriter
+	path string
+
+	discovered   func(gatt.Peripheral, *gatt.Advertisement, int)
+	connected    func(gatt.Peripheral, error)
+	disconnected func(gatt.Peripheral, error)
+	stateChanged func(gatt.Device, gatt.State)
+
+	// One command at a time, answered in resp
+	cmd  sync.Mutex
+	resp chan []byte
+
+	// Handlers yet to run, in order
+	qlock  sync.Mutex
+	q      []func()
+	qready chan struct{}
+
+	lock sync.Mutex
+	// Every peripheral heard, by ID
+	periphs map[string]*sdPeriph
+	// Connected ones by connection handle
+	conns map[uint16]*sdPeriph
+	// The one being connected to
+	connecting *sdPeriph
+	// Scanning was asked for, whether or not a connect has it paused
+	scanning    bool
+	advertising bool
+	// Scanning without scan requests, see setPassive
+	passive bool
+	// What pwmService's base was registered as
+	vsType byte
+}
+
+const (
+	sdMaxConnections = 3
+	sdCommandTimeout = 2 * time.Second
+	// Longer than a connection interval or two, the SoftDevice gives up
+	// on its own after ATT's 30 seconds
+	sdProcedureTimeout = 10 * time.Second
+	// Scanning, as connecting, 100 ms windows every 200 ms
+	sdScanInterval = 320
+	sdScanWindow   = 160
+	// Connection intervals of 20-40 ms, dropped after 4 s unheard
+	sdConnMin     = 16
+	sdConnMax     = 32
+	sdConnTimeout = 400
+	// The broadcaster's advertisements, every 100 ms
+	sdAdvInterval = 160
+)
+
+var errSdDisconnected = errors.New("disconnected")
+
+func openSdDevice(path string) (*sdDevice, error) {
+	f, err := os.OpenFile(path, os.O_RDWR, 0)
+	if err != nil {
+		return nil, err
+	}
+	d := &sdDevice{
+		port:    f,
+		path:    path,
+		resp:    make(chan []byte, 1),
+		qready:  make(chan struct{}, 1),
+		periphs: make(map[string]*sdPeriph),
+		conns:   make(map[uint16]*sdPeriph),
+	}
+	go d.read()
+	go d.runQueue()
+	return d, nil
+}
+
+// call runs one command and gives its outputs
+func (d *sdDevice) call(cmd []byte) ([]byte, error) {
+	d.cmd.Lock()
+	defer d.cmd.Unlock()
+	// The late answer to one that timed out
+	select {
+	case <-d.resp:
+	default:
+	}
+	if err := sdWritePacket(d.port, sdPktCmd, cmd); err != nil {
+		return nil, err
+	}
+	select {
+	case b := <-d.resp:
+		op, result, out, err := sdParseResponse(b)
+		switch {
+		case err != nil:
+			return nil, err
+		case op != cmd[0]:
+			return nil, fmt.Errorf("connectivity answered 0x%02x for 0x%02x", op, cmd[0])
+		case result != 0:
+			return out, sdError{op: op, code: result}
+		}
+		return out, nil
+	case <-time.After(sdCommandTimeout):
+		return nil, fmt.Errorf("connectivity call 0x%02x: no response", cmd[0])
+	}
+}
+
+func (d *sdDevice) queue(f func()) {
+	d.qlock.Lock()
+	d.q = append(d.q, f)
+	d.qlock.Unlock()
+	select {
+	case d.qready <- struct{}{}:
+	default:
+	}
+}
+
+func (d *sdDevice) runQueue() {
+	for range d.qready {
+		for {
+			d.qlock.Lock()
+			if len(d.q) == 0 {
+				d.qlock.Unlock()
+				break
+			}
+			f := d.q[0]
+			d.q = d.q[1:]
+			d.qlock.Unlock()
+			f()
+		}
+	}
+}
+
+func (d *sdDevice) read() {
+	r := bufio.NewReader(d.port)
+	for {
+		typ, b, err := sdReadPacket(r)
+		if err != nil {
+			log.Printf("Connectivity dongle %s: %v", d.path, err)
+			d.lost()
+			return
+		}
+		switch typ {
+		case sdPktResp:
+			select {
+			case d.resp <- b:
+			default:
+			}
+		case sdPktEvt:
+			e, err := sdParseEvent(b)
+			if err != nil {
+				log.Printf("Connectivity dongle %s: %v", d.path, err)
+				continue
+			}
+			d.event(e)
+		}
+	}
+}
+
+// lost drops every connection and powers the adapter down, for a
+// dongle gone from its port
+func (d *sdDevice) lost() {
+	d.lock.Lock()
+	var gone []*sdPeriph
+	for conn, p := range d.conns {
+		gone = append(gone, p)
+		delete(d.conns, conn)
+		p.drop()
+	}
+	d.lock.Unlock()
+	d.queue(func() {
+		for _, p := range gone {
+			d.disconnected(p, errSdDisconnected)
+		}
+		if d.stateChanged != nil {
+			d.stateChanged(d, gatt.StatePoweredOff)
+		}
+	})
+}
+
+func (d *sdDevice) event(e sdEvent) {
+	d.lock.Lock()
+	defer d.lock.Unlock()
+	switch e.id {
+	case sdEvtAdvReport:
+		p := d.periphs[e.addr.id()]
+		if p == nil {
+			p = newSdPeriph(d, e.addr)
+			d.periphs[p.id] = p
+		}
+		a := p.heard(e)
+		d.queue(func() { d.discovered(p, a, e.rssi) })
+	case sdEvtConnected:
+		p := d.periphs[e.addr.id()]
+		if p == nil || p != d.connecting {
+			// Nothing here asked for it
+			go d.call(sdDisconnectCmd(e.conn))
+			return
+		}
+		d.connecting = nil
+		d.conns[e.conn] = p
+		p.connect(e.conn, e.params)
+		go func() {
+			if _, err := d.call(sdRSSIStartCmd(e.conn)); err != nil {
+				log.Printf("%s: no signal strength: %v", p.id, err)
+			}
+			d.resumeScan()
+			d.connected(p, nil)
+		}()
+	case sdEvtTimeout:
+		if e.reason == sdTimeoutSrcConn && d.connecting != nil {
+			// Left to the channel to give up on and try again
+			d.connecting = nil
+			go d.resumeScan()
+		}
+	case sdEvtDisconnected:
+		p := d.conns[e.conn]
+		if p == nil {
+			return
+		}
+		delete(d.conns, e.conn)
+		p.drop()
+		d.queue(func() { d.disconnected(p, nil) })
+	default:
+		if p := d.conns[e.conn]; p != nil {
+			p.event(e)
+		}
+	}
+}
+
+// Init enables the SoftDevice and registers the bricks' UUID base
+// ahead of telling the channel it's up
+func (d *sdDevice) Init(stateChanged func(gatt.Device, gatt.State)) error {
+	d.stateChanged = stateChanged
+	// Enabled already if the dongle outlived the last controller
+	if _, err := d.call(sdEnableCmd()); err != nil && !sdFailedWith(err, sdErrorInvalidState) {
+		return err
+	}
+	out, err := d.call(sdUUIDVSAddCmd(pwmService))
+	if err != nil {
+		return err
+	}
+	if len(out) < 2 {
+		return errSdShort
+	}
+	d.lock.Lock()
+	d.vsType = out[1]
+	d.lock.Unlock()
+	stateChanged(d, gatt.StatePoweredOn)
+	return nil
+}
+
+// uuid is u as gatt has it. Called with d.lock held.
+func (d *sdDevice) uuid(u sdUUID) gatt.UUID {
+	if u.typ != sdUUIDTypeBLE && u.typ == d.vsType {
+		return gatt.MustParseUUID(fmt.Sprintf("%s%04x%s", pwmService[:4], u.uuid, pwmService[8:]))
+	}
+	return gatt.UUID16(u.uuid)
+}
+
+func (d *sdDevice) Scan(ss []gatt.UUID, dup bool) {
+	d.lock.Lock()
+	d.scanning = true
+	d.lock.Unlock()
+	d.resumeScan()
+}
+
+// resumeScan scans if it's wanted and no connect has it paused
+func (d *sdDevice) resumeScan() {
+	d.lock.Lock()
+	scan := d.scanning && d.connecting == nil
+	passive := d.passive
+	d.lock.Unlock()
+	if !scan {
+		return
+	}
+	if _, err := d.call(sdScanStartCmd(!passive, sdScanInterval, sdScanWindow)); err != nil && !sdFailedWith(err, sdErrorInvalidState) {
+		log.Printf("Connectivity dongle %s: scan: %v", d.path, err)
+	}
+}
+
+// setPassive has scans hear only advertisements, not scan responses, a
+// running scan starting over
+func (d *sdDevice) setPassive(on bool) {
+	d.lock.Lock()
+	restart := d.passive != on && d.scanning && d.connecting == nil
+	d.passive = on
+	d.lock.Unlock()
+	if restart {
+		d.call(sdScanStopCmd())
+		d.resumeScan()
+	}
+}
+
+func (d *sdDevice) StopScanning() {
+	d.lock.Lock()
+	d.scanning = false
+	d.lock.Unlock()
+	d.call(sdScanStopCmd())
+}
+
+// Connect starts connecting to p. One that can't go is left for the
+// channel to time out, as one that never comes back is.
+func (d *sdDevice) Connect(p gatt.Peripheral) {
+	sp := p.(*sdPeriph)
+	d.lock.Lock()
+	if d.connecting != nil {
+		d.lock.Unlock()
+		log.Printf("%s: still connecting to %s", d.path, d.connecting.id)
+		return
+	}
+	d.connecting = sp
+	scanning := d.scanning
+	d.lock.Unlock()
+	if scanning {
+		d.call(sdScanStopCmd())
+	}
+	if _, err := d.call(sdConnectCmd(sp.addr, sdScanInterval, sdScanWindow, sdConnMin, sdConnMax, sdConnTimeout)); err != nil {
+		log.Printf("%s: can't connect: %v", sp.id, err)
+		d.lock.Lock()
+		d.connecting = nil
+		d.lock.Unlock()
+		d.resumeScan()
+	}
+}
+
+// CancelConnection gives up connecting to p, or disconnects it, which
+// the channel hears of as any other disconnect
+func (d *sdDevice) CancelConnection(p gatt.Peripheral) {
+	sp := p.(*sdPeriph)
+	d.lock.Lock()
+	pending := d.connecting == sp
+	if pending {
+		d.connecting = nil
+	}
+	conn, connected := sp.handle()
+	d.lock.Unlock()
+	switch {
+	case pending:
+		d.call(sdConnectCancelCmd())
+		d.resumeScan()
+	case connected:
+		d.call(sdDisconnectCmd(conn))
+	}
+}
+
+// Advertise broadcasts a's data non-connectable, alongside scanning and
+// connections
+func (d *sdDevice) Advertise(a *gatt.AdvPacket) error {
+	b := a.Bytes()
+	if _, err := d.call(sdAdvDataSetCmd(b[:a.Len()])); err != nil {
+		return err
+	}
+	d.lock.Lock()
+	started := d.advertising
+	d.lock.Unlock()
+	if started {
+		return nil
+	}
+	if _, err := d.call(sdAdvStartCmd(sdAdvInterval)); err != nil && !sdFailedWith(err, sdErrorInvalidState) {
+		return err
+	}
+	d.lock.Lock()
+	d.advertising = true
+	d.lock.Unlock()
+	return nil
+}
+
+// sdPeriph is one peripheral heard through a dongle, across its
+// connections
+type sdPeriph struct {
+	gatt.Peripheral
+	d    *sdDevice
+	id   string
+	addr sdAddr
+
+	// One GATT client procedure at a time, as the SoftDevice runs them,
+	// answered in rsp
+	proc sync.Mutex
+	rsp  chan sdEvent
+	// Signalled as write commands go out, for those waiting on room
+	tx chan struct{}
+	// Write commands go to the SoftDevice one at a time, so their
+	// transmit completions come back in the order of sending
+	wlock sync.Mutex
+
+	lock      sync.Mutex
+	adv       *gatt.Advertisement
+	rssi      int
+	conn      uint16
+	connected bool
+	// Closed on disconnect
+	gone chan struct{}
+	// Where discovery found things
+	ranges map[*gatt.Service][2]uint16
+	ends   map[*gatt.Characteristic]uint16
+	// Notified characteristics and their handlers, by value handle
+	notified map[uint16]*gatt.Characteristic
+	subs     map[uint16]func(*gatt.Characteristic, []byte, error)
+	// What the link runs with, see connparams.go
+	params connParams
+	// Each write command the SoftDevice holds, oldest first, with what
+	// to tell once it's sent (pipeline.go), nil for none
+	sending []func(error)
+}
+
+func newSdPeriph(d *sdDevice, a sdAddr) *sdPeriph {
+	return &sdPeriph{d: d, id: a.id(), addr: a,
+		rsp:  make(chan sdEvent, 1),
+		tx:   make(chan struct{}, 1),
+		adv:  &gatt.Advertisement{},
+		gone: make(chan struct{}),
+	}
+}
+
+// heard adds an advertisement or scan response to what's been heard of
+// p, as gatt does, and gives the lot
+func (p *sdPeriph) heard(e sdEvent) *gatt.Advertisement {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	a := *p.adv
+	for b := e.data; len(b) >= 2 && b[0] > 0 && int(b[0]) < len(b); b = b[1+b[0]:] {
+		field := b[2 : 1+b[0]]
+		switch b[1] {
+		case 0x08, 0x09:
+			a.LocalName = string(field)
+		case 0xff:
+			a.ManufacturerData = append([]byte(nil), field...)
+		case 0x02, 0x03:
+			a.Services = nil
+			for i := 0; i+2 <= len(field); i += 2 {
+				a.Services = append(a.Services, gatt.UUID16(uint16(field[i])|uint16(field[i+1])<<8))
+			}
+		case 0x06, 0x07:
+			a.Services = nil
+			for i := 0; i+16 <= len(field); i += 16 {
+				var be [16]byte
+				for j := range be {
+					be[j] = field[i+15-j]
+				}
+				a.Services = append(a.Services, gatt.MustParseUUID(fmt.Sprintf("%x", be)))
+			}
+		}
+	}
+	p.adv = &a
+	p.rssi = e.rssi
+	return &a
+}
+
+func (p *sdPeriph) connect(conn uint16, params connParams) {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	p.conn, p.connected = conn, true
+	p.params = params
+	p.gone = make(chan struct{})
+	p.ranges = make(map[*gatt.Service][2]uint16)
+	p.ends = make(map[*gatt.Characteristic]uint16)
+	p.notified = make(map[uint16]*gatt.Characteristic)
+	p.subs = make(map[uint16]func(*gatt.Characteristic, []byte, error))
+	p.sending = nil
+}
+
+func (p *sdPeriph) drop() {
+	p.lock.Lock()
+	sending := p.sending
+	p.sending = nil
+	if p.connected {
+		p.connected = false
+		close(p.gone)
+	}
+	p.lock.Unlock()
+	for _, sent := range sending {
+		if sent != nil {
+			sent(errSdDisconnected)
+		}
+	}
+}
+
+func (p *sdPeriph) handle() (uint16, bool) {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	return p.conn, p.connected
+}
+
+// event takes one of p's connection's events
+func (p *sdPeriph) event(e sdEvent) {
+	switch e.id {
+	case sdEvtTxComplete:
+		p.lock.Lock()
+		n := int(e.txPackets)
+		if n > len(p.sending) {
+			n = len(p.sending)
+		}
+		sent := p.sending[:n]
+		p.sending = p.sending[n:]
+		p.lock.Unlock()
+		for _, f := range sent {
+			if f != nil {
+				f(nil)
+			}
+		}
+		select {
+		case p.tx <- struct{}{}:
+		default:
+		}
+	case sdEvtRSSIChanged:
+		p.lock.Lock()
+		p.rssi = e.rssi
+		p.lock.Unlock()
+	case sdEvtConnUpdate:
+		p.lock.Lock()
+		p.params = e.params
+		p.lock.Unlock()
+	case sdEvtHVX:
+		p.lock.Lock()
+		c, f := p.notified[e.handle], p.subs[e.handle]
+		p.lock.Unlock()
+		if f != nil {
+			p.d.queue(func() { f(c, e.data, nil) })
+		}
+	default:
+		select {
+		case p.rsp <- e:
+		default:
+		}
+	}
+}
+
+// procedure runs a GATT client procedure, cmd given the connection, and
+// gives the event it finished with
+func (p *sdPeriph) procedure(cmd func(conn uint16) []byte, want uint16) (sdEvent, error) {
+	p.lock.Lock()
+	conn, connected, gone := p.conn, p.connected, p.gone
+	p.lock.Unlock()
+	if !connected {
+		return sdEvent{}, errSdDisconnected
+	}
+	// The late answer to one that timed out
+	select {
+	case <-p.rsp:
+	default:
+	}
+	if _, err := p.d.call(cmd(conn)); err != nil {
+		return sdEvent{}, err
+	}
+	select {
+	case e := <-p.rsp:
+		switch {
+		case e.id == sdEvtGattcTimeout:
+			return e, errors.New("GATT procedure timed out")
+		case e.id != want:
+			return e, fmt.Errorf("GATT event 0x%02x waiting on 0x%02x", e.id, want)
+		}
+		return e, nil
+	case <-gone:
+		return sdEvent{}, errSdDisconnected
+	case <-time.After(sdProcedureTimeout):
+		return sdEvent{}, errors.New("GATT procedure never finished")
+	}
+}
+
+// updateConn moves the link onto params, which the SoftDevice
+// negotiates with the brick from the central's side
+func (p *sdPeriph) updateConn(params connParams) error {
+	conn, connected := p.handle()
+	if !connected {
+		return errSdDisconnected
+	}
+	_, err := p.d.call(sdConnUpdateCmd(conn, params))
+	return err
+}
+
+func (p *sdPeriph) linkParams() (connParams, bool) {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	return p.params, p.connected
+}
+
+func (p *sdPeriph) Device() gatt.Device { return p.d }
+func (p *sdPeriph) ID() string          { return p.id }
+func (p *sdPeriph) Name() string {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	return p.adv.LocalName
+}
+
+func (p *sdPeriph) ReadRSSI() int {
+	p.lock.Lock()
+	defer p.lock.Unlock()
+	return p.rssi
+}
+
+// SetMTU leaves the MTU at ATT's default, S130 can't exchange it
+func (p *sdPeriph) SetMTU(mtu uint16) error { return nil }
+
+func sdWanted(u gatt.UUID, of []gatt.UUID) bool {
+	if len(of) == 0 {
+		return true
+	}
+	for _, w := range of {
+		if w.Equal(u) {
+			return true
+		}
+	}
+	return false
+}
+
+func (p *sdPeriph) DiscoverServices(ss []gatt.UUID) ([]*gatt.Service, error) {
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	var out []*gatt.Service
+	for start := uint16(1); ; {
+		e, err := p.procedure(func(conn uint16) []byte { return sdPrimDiscCmd(conn, start) }, sdEvtPrimDisc)
+		if err != nil {
+			return nil, err
+		}
+		if e.status == sdGattAttrNotFound || len(e.services) == 0 {
+			break
+		}
+		if e.status != sdGattSuccess {
+			return nil, fmt.Errorf("service discovery: GATT status 0x%04x", e.status)
+		}
+		p.d.lock.Lock()
+		p.lock.Lock()
+		for _, s := range e.services {
+			u := p.d.uuid(s.uuid)
+			if !sdWanted(u, ss) {
+				continue
+			}
+			gs := gatt.NewService(u)
+			p.ranges[gs] = [2]uint16{s.start, s.end}
+			out = append(out, gs)
+		}
+		p.lock.Unlock()
+		p.d.lock.Unlock()
+		last := e.services[len(e.services)-1].end
+		if last == 0xffff {
+			break
+		}
+		start = last + 1
+	}
+	return out, nil
+}
+
+func (p *sdPeriph) DiscoverCharacteristics(cs []gatt.UUID, s *gatt.Service) ([]*gatt.Characteristic, error) {
+	p.lock.Lock()
+	r, ok := p.ranges[s]
+	p.lock.Unlock()
+	if !ok {
+		return nil, errors.New("service not discovered on this connection")
+	}
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	var found []sdChar
+	for start := r[0]; start <= r[1]; {
+		e, err := p.procedure(func(conn uint16) []byte { return sdRangeCmd(sdOpCharDisc, conn, start, r[1]) }, sdEvtCharDisc)
+		if err != nil {
+			return nil, err
+		}
+		if e.status == sdGattAttrNotFound || len(e.chars) == 0 {
+			break
+		}
+		if e.status != sdGattSuccess {
+			return nil, fmt.Errorf("characteristic discovery: GATT status 0x%04x", e.status)
+		}
+		found = append(found, e.chars...)
+		last := e.chars[len(e.chars)-1].handle
+		if last >= r[1] {
+			break
+		}
+		start = last + 1
+	}
+
+	var out []*gatt.Characteristic
+	p.d.lock.Lock()
+	p.lock.Lock()
+	for i, c := range found {
+		u := p.d.uuid(c.uuid)
+		// Each runs up to the next one's declaration
+		end := r[1]
+		if i+1 < len(found) {
+			end = found[i+1].decl - 1
+		}
+		gc := gatt.NewCharacteristic(u, s, gatt.Property(c.props), c.decl, c.handle)
+		p.ends[gc] = end
+		if sdWanted(u, cs) {
+			out = append(out, gc)
+		}
+	}
+	p.lock.Unlock()
+	p.d.lock.Unlock()
+	s.SetCharacteristics(out)
+	return out, nil
+}
+
+func (p *sdPeriph) DiscoverDescriptors(ds []gatt.UUID, c *gatt.Characteristic) ([]*gatt.Descriptor, error) {
+	p.lock.Lock()
+	end, ok := p.ends[c]
+	p.lock.Unlock()
+	if !ok {
+		return nil, errors.New("characteristic not discovered on this connection")
+	}
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	var out []*gatt.Descriptor
+	for start := c.VHandle() + 1; start <= end && start != 0; {
+		e, err := p.procedure(func(conn uint16) []byte { return sdRangeCmd(sdOpDescDisc, conn, start, end) }, sdEvtDescDisc)
+		if err != nil {
+			return nil, err
+		}
+		if e.status == sdGattAttrNotFound || len(e.descs) == 0 {
+			break
+		}
+		if e.status != sdGattSuccess {
+			return nil, fmt.Errorf("descriptor discovery: GATT status 0x%04x", e.status)
+		}
+		p.d.lock.Lock()
+		for _, dd := range e.descs {
+			u := p.d.uuid(dd.uuid)
+			if !sdWanted(u, ds) {
+				continue
+			}
+			gd := gatt.NewDescriptor(u, dd.handle, c)
+			if dd.uuid == (sdUUID{uuid: 0x2902, typ: sdUUIDTypeBLE}) {
+				c.SetDescriptor(gd)
+			}
+			out = append(out, gd)
+		}
+		p.d.lock.Unlock()
+		start = e.descs[len(e.descs)-1].handle + 1
+	}
+	c.SetDescriptors(out)
+	return out, nil
+}
+
+func (p *sdPeriph) read(handle, offset uint16) ([]byte, error) {
+	e, err := p.procedure(func(conn uint16) []byte { return sdReadCmd(conn, handle, offset) }, sdEvtReadRsp)
+	if err != nil {
+		return nil, err
+	}
+	if e.status != sdGattSuccess {
+		return nil, fmt.Errorf("read: GATT status 0x%04x", e.status)
+	}
+	return e.data, nil
+}
+
+func (p *sdPeriph) ReadCharacteristic(c *gatt.Characteristic) ([]byte, error) {
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	return p.read(c.VHandle(), 0)
+}
+
+// ReadLongCharacteristic reads on from where each read stopped, while
+// they come back full
+func (p *sdPeriph) ReadLongCharacteristic(c *gatt.Characteristic) ([]byte, error) {
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	var v []byte
+	for {
+		b, err := p.read(c.VHandle(), uint16(len(v)))
+		if err != nil {
+			return nil, err
+		}
+		v = append(v, b...)
+		if len(b) < sdAttMTU-1 {
+			return v, nil
+		}
+	}
+}
+
+func (p *sdPeriph) ReadDescriptor(d *gatt.Descriptor) ([]byte, error) {
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	return p.read(d.Handle(), 0)
+}
+
+func (p *sdPeriph) write(handle uint16, b []byte) error {
+	p.proc.Lock()
+	defer p.proc.Unlock()
+	e, err := p.procedure(func(conn uint16) []byte { return sdWriteCmdOf(conn, sdWriteReq, handle, b) }, sdEvtWriteRsp)
+	if err != nil {
+		return err
+	}
+	if e.status != sdGattSuccess {
+		return fmt.Errorf("write: GATT status 0x%04x", e.status)
+	}
+	return nil
+}
+
+// WriteCharacteristic writes without a response alongside whatever
+// procedure is running, waiting for room when the SoftDevice's buffers
+// are full
+func (p *sdPeriph) WriteCharacteristic(c *gatt.Characteristic, b []byte, noRsp bool) error {
+	if len(b) > sdAttMTU-3 {
+		return fmt.Errorf("write of %d bytes, S130 takes %d", len(b), sdAttMTU-3)
+	}
+	if !noRsp {
+		return p.write(c.VHandle(), b)
+	}
+	return p.writeCmd(c.VHandle(), b, nil)
+}
+
+// writeAsync is WriteCharacteristic without response, calling sent as
+// the write's transmit completes rather than waiting for it
+func (p *sdPeriph) writeAsync(c *gatt.Characteristic, b []byte, sent func(error)) error {
+	if len(b) > sdAttMTU-3 {
+		return fmt.Errorf("write of %d bytes, S130 takes %d", len(b), sdAttMTU-3)
+	}
+	return p.writeCmd(c.VHandle(), b, sent)
+}
+
+// writeCmd hands a write command to the SoftDevice, waiting for room
+// when its buffers are full
+func (p *sdPeriph) writeCmd(handle uint16, b []byte, sent func(error)) error {
+	p.wlock.Lock()
+	defer p.wlock.Unlock()
+	for {
+		p.lock.Lock()
+		conn, connected, gone := p.conn, p.connected, p.gone
+		if connected {
+			// Ahead of the call, its completion could beat the response
+			p.sending = append(p.sending, sent)
+		}
+		p.lock.Unlock()
+		if !connected {
+			return errSdDisconnected
+		}
+		_, err := p.d.call(sdWriteCmdOf(conn, sdWriteCmd, handle, b))
+		if err == nil {
+			return nil
+		}
+		p.lock.Lock()
+		if n := len(p.sending); p.gone == gone && n > 0 {
+			// Not taken, and nothing was sent after it
+			p.sending = p.sending[:n-1]
+		}
+		p.lock.Unlock()
+		if !sdFailedWith(err, sdErrorNoTxBuffers) {
+			return err
+		}
+		select {
+		case <-p.tx:
+		case <-gone:
+			return errSdDisconnected
+		case <-time.After(sdProcedureTimeout):
+			return errors.New("no room to write")
+		}
+	}
+}
+
+func (p *sdPeriph) WriteDescriptor(d *gatt.Descriptor, b []byte) error {
+	return p.write(d.Handle(), b)
+}
+
+// SetNotifyValue turns c's notifications on, or off for a nil f
+func (p *sdPeriph) SetNotifyValue(c *gatt.Characteristic, f func(*gatt.Characteristic, []byte, error)) error {
+	cccd := c.Descriptor()
+	if cccd == nil {
+		return errors.New("characteristic can't notify")
+	}
+	p.lock.Lock()
+	if f != nil {
+		p.notified[c.VHandle()], p.subs[c.VHandle()] = c, f
+	} else {
+		delete(p.notified, c.VHandle())
+		delete(p.subs, c.VHandle())
+	}
+	p.lock.Unlock()
+	v := []byte{0, 0}
+	if f != nil {
+		v[0] = 1
+	}
+	return p.write(cccd.Handle(), v)
+}
@@ -0,0 +1,67 @@
+package ble
+
+import (
+	"log"
+	"time"
+)
+
+// Active/standby. Every controller meant to drive the same bricks runs
+// in standby with a lease: each connects only a brick advertising that
+// no lease is held on it, or one it held the lease on itself within the
+// lease length, so whichever holds a brick's lease drives it. Should
+// that controller die, its leases lapse within their length, the bricks
+// fail over to their schedules and advertise themselves free, and the
+// first controller to hear one connects it, on the handles another
+// controller found when they share a GATT cache file, and takes the
+// lease over. A restarted controller waits for the leases it lost the
+// same way.
+type standbyState struct {
+	// When each brick's lease was last renewed from here
+	leasedAt map[string]time.Time
+	// Bricks last heard leased elsewhere, so holding off is logged once
+	elsewhere map[string]bool
+}
+
+func (ble *bleChannel) SetStandby(standby bool) {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if !standby {
+		ble.standby = nil
+		return
+	}
+	ble.standby = &standbyState{leasedAt: make(map[string]time.Time), elsewhere: make(map[string]bool)}
+}
+
+func (ble *bleChannel) SetGattCacheFile(path string) error {
+	return ble.gattCache.open(path)
+}
+
+// mayConnect is whether standby leaves id free to connect as of now.
+// Called with ble.lock held.
+func (ble *bleChannel) mayConnect(id string, now time.Time) bool {
+	s := ble.standby
+	if s == nil {
+		return true
+	}
+	if at, ok := s.leasedAt[id]; ok && ble.lease != nil && now.Sub(at) < ble.lease.length {
+		// Still ours
+		return true
+	}
+	t, ok := ble.advTelemetry[id]
+	free := ok && t.flags&telemetryLeased == 0
+	if !free && !s.elsewhere[id] {
+		log.Printf("%s: leased to another controller, standing by", id)
+	} else if free && s.elsewhere[id] {
+		log.Printf("%s: lease released, taking over", id)
+	}
+	s.elsewhere[id] = !free
+	return free
+}
+
+// leased notes the lease on id renewed from here. Called with ble.lock
+// held.
+func (ble *bleChannel) leased(id string, now time.Time) {
+	if ble.standby != nil {
+		ble.standby.leasedAt[id] = now
+	}
+}
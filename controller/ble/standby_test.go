@@ -0,0 +1,37 @@
+package ble
+
+import (
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+func TestStandby(t *testing.T) {
+	ble := newBleChannel(nil, clock.Real)
+	now := time.Now()
+	if !ble.mayConnect("a", now) {
+		t.Error("held off without standing by")
+	}
+	ble.SetStandby(true)
+	if err := ble.SetLease(10*time.Second, -1); err != nil {
+		t.Fatal(err)
+	}
+	if ble.mayConnect("a", now) {
+		t.Error("connected a brick not yet heard advertising")
+	}
+	ble.advTelemetry["a"] = advTelemetry{flags: telemetryLeased}
+	if ble.mayConnect("a", now) {
+		t.Error("took a brick leased elsewhere")
+	}
+	ble.advTelemetry["a"] = advTelemetry{flags: telemetryLeaseLapsed}
+	if !ble.mayConnect("a", now) {
+		t.Error("lapsed lease not taken over")
+	}
+	// One of ours that dropped comes straight back
+	ble.advTelemetry["a"] = advTelemetry{flags: telemetryLeased}
+	ble.leased("a", now)
+	if !ble.mayConnect("a", now.Add(9*time.Second)) || ble.mayConnect("a", now.Add(10*time.Second)) {
+		t.Error("own lease not reclaimed within its length alone")
+	}
+}
@@ -0,0 +1,290 @@
+package ble
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"log"
+	"math"
+	"os"
+	"path/filepath"
+	"time"
+)
+
+// Warm restart state: what a controller restarted under its bricks
+// would otherwise have to learn again, written on the way down and read
+// back on the way up. Bricks known by ID are taken on their first
+// report, directed advertisements included, instead of being ignored
+// until they advertise their name again. Their handles skip discovery
+// while the schema reads back the same (gattcache.go). The output each
+// brick had at shutdown is put back when its generation hasn't moved,
+// so the first write only sends what changed since, after one short
+// read. The temperature and fan history carries on without a gap to
+// backfill.
+const (
+	stateVersion = 1
+	// Bricks still connected at shutdown are read this long for their
+	// output, those slower start over from a full read
+	stateReadTimeout = 3 * time.Second
+)
+
+type stateFile struct {
+	Version int                    `json:"version"`
+	Saved   time.Time              `json:"saved"`
+	Bricks  map[string]*brickState `json:"bricks"`
+}
+
+type brickState struct {
+	Gatt *gattFileEntry `json:"gatt,omitempty"`
+	// Output as read back at shutdown, nil when it wasn't
+	Output *outputSnapshot `json:"output,omitempty"`
+	// Every history ring packed, see packHistory
+	History      []byte `json:"history,omitempty"`
+	HistorySeq   uint32 `json:"history_seq,omitempty"`
+	HistoryTaken int    `json:"history_taken,omitempty"`
+}
+
+type outputSnapshot struct {
+	Gen      uint32 `json:"gen"`
+	Channels int    `json:"channels"`
+	Levels   []int  `json:"levels"`
+}
+
+// Bytes per history bucket packed: at (int64), samples (uint32), then
+// the temperature and rpm low, high and sum (float32 each)
+const historyBucketLen = 8 + 4 + 6*4
+
+// packHistory is each ring's bucket count (uint32 LE), then its buckets
+// oldest first. Called with b.lock held.
+func packHistory(b *brickHistory) []byte {
+	var buf bytes.Buffer
+	for i := range b.rings {
+		r := &b.rings[i]
+		binary.Write(&buf, binary.LittleEndian, uint32(r.used))
+		n := len(r.buckets)
+		for j := 0; j < r.used; j++ {
+			k := r.buckets[(r.next-r.used+j+n)%n]
+			binary.Write(&buf, binary.LittleEndian, k.at)
+			binary.Write(&buf, binary.LittleEndian, k.n)
+			for _, f := range [...]float32{k.tempMin, k.tempMax, k.tempSum, k.rpmMin, k.rpmMax, k.rpmSum} {
+				binary.Write(&buf, binary.LittleEndian, math.Float32bits(f))
+			}
+		}
+	}
+	return buf.Bytes()
+}
+
+// unpackHistory puts packed rings back into b, the newest of each when
+// it has more than the ring holds. Called with b.lock held.
+func unpackHistory(b *brickHistory, p []byte) error {
+	for i := range b.rings {
+		if len(p) < 4 {
+			return fmt.Errorf("history ring %d: truncated", i)
+		}
+		used := int(binary.LittleEndian.Uint32(p))
+		p = p[4:]
+		if len(p) < used*historyBucketLen {
+			return fmt.Errorf("history ring %d: %d buckets in %d bytes", i, used, len(p))
+		}
+		r := &b.rings[i]
+		skip := 0
+		if used > len(r.buckets) {
+			skip = used - len(r.buckets)
+		}
+		r.next, r.used = 0, 0
+		for j := 0; j < used; j++ {
+			q := p[j*historyBucketLen:]
+			if j < skip {
+				continue
+			}
+			f := func(k int) float32 { return math.Float32frombits(binary.LittleEndian.Uint32(q[12+4*k:])) }
+			r.buckets[r.used] = historyBucket{at: int64(binary.LittleEndian.Uint64(q)), n: binary.LittleEndian.Uint32(q[8:]),
+				tempMin: f(0), tempMax: f(1), tempSum: f(2), rpmMin: f(3), rpmMax: f(4), rpmSum: f(5)}
+			r.used++
+		}
+		r.next = r.used % len(r.buckets)
+		p = p[used*historyBucketLen:]
+	}
+	return nil
+}
+
+// readOutputs reads back every brick's output at once, giving up on
+// those still going after stateReadTimeout
+func readOutputs(periphs []*blePeriph) map[string]outputState {
+	type result struct {
+		id string
+		o  outputState
+	}
+	c := make(chan result, len(periphs))
+	for _, p := range periphs {
+		p := p
+		go func() {
+			o, err := p.readOutput()
+			if err != nil {
+				log.Printf("%s: output state: %s", p.gp.ID(), err)
+				c <- result{}
+				return
+			}
+			c <- result{p.gp.ID(), o}
+		}()
+	}
+	outputs := make(map[string]outputState)
+	timeout := time.After(stateReadTimeout)
+	for range periphs {
+		select {
+		case r := <-c:
+			if r.id != "" {
+				outputs[r.id] = r.o
+			}
+		case <-timeout:
+			return outputs
+		}
+	}
+	return outputs
+}
+
+// SaveState writes the warm restart state to path, gzipped JSON,
+// replacing it whole so a reader never sees half of it
+func (ble *bleChannel) SaveState(path string) error {
+	ble.lock.Lock()
+	ids := make([]string, 0, len(ble.brickPeriph))
+	for id := range ble.brickPeriph {
+		ids = append(ids, id)
+	}
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.outputChar != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	st := stateFile{Version: stateVersion, Saved: ble.clock.Now(), Bricks: make(map[string]*brickState)}
+	for _, id := range ids {
+		st.Bricks[id] = &brickState{}
+	}
+	outputs := readOutputs(periphs)
+	for _, p := range periphs {
+		if o, ok := outputs[p.gp.ID()]; ok && st.Bricks[p.gp.ID()] != nil {
+			st.Bricks[p.gp.ID()].Output = &outputSnapshot{Gen: o.gen, Channels: o.channels, Levels: o.levels}
+		}
+	}
+
+	ble.gattCache.lock.Lock()
+	for id, e := range ble.gattCache.entries {
+		if bs := st.Bricks[id]; bs != nil {
+			fe := fileEntryOf(e)
+			bs.Gatt = &fe
+		}
+	}
+	ble.gattCache.lock.Unlock()
+
+	ble.history.lock.Lock()
+	for id, b := range ble.history.bricks {
+		if bs := st.Bricks[id]; bs != nil {
+			b.lock.Lock()
+			bs.History = packHistory(b)
+			bs.HistorySeq, bs.HistoryTaken = b.cursor.seq, b.cursor.taken
+			b.lock.Unlock()
+		}
+	}
+	ble.history.lock.Unlock()
+
+	var buf bytes.Buffer
+	z := gzip.NewWriter(&buf)
+	err := json.NewEncoder(z).Encode(st)
+	if err == nil {
+		err = z.Close()
+	}
+	if err == nil {
+		tmp := filepath.Join(filepath.Dir(path), "."+filepath.Base(path)+".tmp")
+		if err = ioutil.WriteFile(tmp, buf.Bytes(), 0644); err == nil {
+			err = os.Rename(tmp, path)
+		}
+	}
+	if err != nil {
+		return fmt.Errorf("state %s: %v", path, err)
+	}
+	log.Printf("Saved state of %d bricks, %d outputs read back, %d bytes", len(ids), len(outputs), buf.Len())
+	return nil
+}
+
+// RestoreState loads the warm restart state from path, if there is one.
+// Call before the bricks connect.
+func (ble *bleChannel) RestoreState(path string) error {
+	b, err := ioutil.ReadFile(path)
+	if os.IsNotExist(err) {
+		return nil
+	}
+	if err != nil {
+		return err
+	}
+	var st stateFile
+	z, err := gzip.NewReader(bytes.NewReader(b))
+	if err == nil {
+		err = json.NewDecoder(z).Decode(&st)
+	}
+	if err != nil {
+		return fmt.Errorf("state %s: %v", path, err)
+	}
+	if st.Version != stateVersion {
+		log.Printf("Ignoring state %s, version %d", path, st.Version)
+		return nil
+	}
+
+	outputs := 0
+	ble.lock.Lock()
+	for id, bs := range st.Bricks {
+		ble.brickPeriph[id] = true
+		ble.scan.brick(id)
+		if o := bs.Output; o != nil && o.Channels >= 1 && o.Channels <= len(o.Levels) {
+			ble.warm[id] = o
+			outputs++
+		}
+	}
+	ble.lock.Unlock()
+
+	ble.gattCache.lock.Lock()
+	for id, bs := range st.Bricks {
+		// A shared cache file is newer than anything kept here
+		if bs.Gatt != nil && ble.gattCache.entries[id] == nil {
+			ble.gattCache.entries[id] = bs.Gatt.entry()
+		}
+	}
+	ble.gattCache.lock.Unlock()
+
+	for id, bs := range st.Bricks {
+		if bs.History == nil {
+			continue
+		}
+		h := ble.history.brick(id)
+		h.lock.Lock()
+		if err := unpackHistory(h, bs.History); err != nil {
+			log.Printf("%s: history: %v", id, err)
+		} else {
+			h.cursor = historyCursor{seq: bs.HistorySeq, taken: bs.HistoryTaken}
+		}
+		h.lock.Unlock()
+	}
+	log.Printf("Restored state of %d bricks from %v ago, %d outputs", len(st.Bricks),
+		ble.clock.Now().Sub(st.Saved).Round(time.Second), outputs)
+	return nil
+}
+
+// warmOutput puts back the output a brick had at shutdown, if its
+// generation says it still has it, settling it in one short read
+func (p *blePeriph) warmOutput(o *outputSnapshot, now time.Time) bool {
+	b, err := p.gp.ReadCharacteristic(p.outputChar)
+	if err != nil {
+		return false
+	}
+	if gen, err := outputGeneration(b); err != nil || gen != o.Gen {
+		return false
+	}
+	p.channels = o.Channels
+	p.sentLevels.confirm(o.Levels[:p.width()], o.Gen, now)
+	return true
+}
@@ -0,0 +1,64 @@
+package ble
+
+import (
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+func TestStateRoundTrip(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "state.json.gz")
+	a := newBleChannel(nil, clock.Real)
+	if err := a.RestoreState(path); err != nil {
+		t.Fatalf("missing state: %v", err)
+	}
+	a.brickPeriph["aa"] = true
+	a.gattCache.entries["aa"] = &gattEntry{schema: []byte{1, 2},
+		chars: []cachedChar{{service: "1523", uuid: "1524", h: 10, vh: 11, cccd: 12}}}
+	at := time.Unix(1500000000, 0)
+	h := a.history.brick("aa")
+	for i := 0; i < 90; i++ {
+		h.add(at.Add(time.Duration(i)*time.Second), 16*30+i, 1200)
+	}
+	h.cursor = historyCursor{seq: 7, taken: 3}
+	if err := a.SaveState(path); err != nil {
+		t.Fatal(err)
+	}
+
+	b := newBleChannel(nil, clock.Real)
+	if err := b.RestoreState(path); err != nil {
+		t.Fatal(err)
+	}
+	if !b.brickPeriph["aa"] || !b.scan.bricks["aa"] {
+		t.Error("brick not known")
+	}
+	if e := b.gattCache.entries["aa"]; e == nil || len(e.chars) != 1 || e.chars[0].cccd != 12 {
+		t.Errorf("handles %+v", e)
+	}
+	for _, step := range []time.Duration{0, time.Minute} {
+		want, _ := a.History("aa", step, at)
+		got, err := b.History("aa", step, at)
+		if err != nil || len(got) != len(want) || got[len(got)-1] != want[len(want)-1] {
+			t.Errorf("history by %v: %d points, want %d", step, len(got), len(want))
+		}
+	}
+	if c := b.history.brick("aa").cursor; c.seq != 7 || c.taken != 3 {
+		t.Errorf("cursor %+v", c)
+	}
+	// Live samples carry on after those restored
+	b.history.brick("aa").add(at.Add(90*time.Second), 16*40, 1300)
+	if got, _ := b.History("aa", 0, at); len(got) != 91 || got[90].Temp != 40 {
+		t.Errorf("after restore %d points", len(got))
+	}
+}
+
+func TestUnpackHistoryTruncated(t *testing.T) {
+	a := newHistory().brick("aa")
+	a.add(time.Unix(1500000000, 0), 16*25, 1000)
+	p := packHistory(a)
+	if err := unpackHistory(newHistory().brick("aa"), p[:len(p)-1]); err == nil {
+		t.Error("truncated history accepted")
+	}
+}
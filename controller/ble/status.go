@@ -0,0 +1,90 @@
+package ble
+
+import (
+	"sync"
+)
+
+// Number of sent commands remembered for matching against status
+// notifications, which trail the writes by up to a few seconds.
+const cmdHistoryLen = 64
+
+// crc16 matches the firmware's crc16_compute (CCITT, seed 0xffff).
+func crc16(crc uint16, b []byte) uint16 {
+	for _, v := range b {
+		crc = (crc >> 8) | (crc << 8)
+		crc ^= uint16(v)
+		crc ^= (crc & 0xff) >> 4
+		crc ^= (crc << 8) << 4
+		crc ^= ((crc & 0xff) << 4) << 1
+	}
+	return crc
+}
+
+type cmdState struct {
+	count uint16
+	crc   uint16
+}
+
+// cmdTracker mirrors the peripheral's command count and CRC, so lost
+// write without response commands show up when the status arrives.
+type cmdTracker struct {
+	cur     cmdState
+	history [cmdHistoryLen]cmdState
+	lost    int
+
+	lock sync.Mutex
+}
+
+func newCmdTracker() *cmdTracker {
+	t := &cmdTracker{}
+	t.reset()
+	return t
+}
+
+// reset starts a new connection, matching the peripheral which clears
+// its status on connect.
+func (t *cmdTracker) reset() {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	t.cur = cmdState{count: 0, crc: 0xffff}
+	t.history[0] = t.cur
+}
+
+func (t *cmdTracker) sent(b []byte) {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	t.cur.count++
+	t.cur.crc = crc16(t.cur.crc, b)
+	t.history[t.cur.count%cmdHistoryLen] = t.cur
+}
+
+// check compares a status (count and CRC) reported by the peripheral
+// with what was sent, returning the number of commands believed lost.
+// Writes may still be in flight, so the peripheral is allowed to lag.
+func (t *cmdTracker) check(count, crc uint16) int {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+
+	behind := t.cur.count - count
+	if behind < cmdHistoryLen {
+		if h := t.history[count%cmdHistoryLen]; h.count == count && h.crc == crc {
+			return 0
+		}
+	}
+	// Either a command vanished or the counts drifted out of the history.
+	// Resync on the peripheral's view so one loss is only reported once.
+	lost := int(behind)
+	if lost == 0 {
+		lost = 1
+	}
+	t.lost += lost
+	t.cur = cmdState{count: count, crc: crc}
+	t.history[count%cmdHistoryLen] = t.cur
+	return lost
+}
+
+func (t *cmdTracker) Lost() int {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	return t.lost
+}
@@ -0,0 +1,66 @@
+package ble
+
+import (
+	"testing"
+)
+
+func TestCrc16(t *testing.T) {
+	// CRC-16/CCITT-FALSE check value
+	if c := crc16(0xffff, []byte("123456789")); c != 0x29b1 {
+		t.Errorf("Wrong CRC %04x", c)
+	}
+}
+
+func TestCmdTrackerInSync(t *testing.T) {
+	tr := newCmdTracker()
+	crc := uint16(0xffff)
+	for i := 0; i < 5; i++ {
+		b := []byte{byte(i), 0x10}
+		tr.sent(b)
+		crc = crc16(crc, b)
+	}
+	if lost := tr.check(5, crc); lost != 0 {
+		t.Errorf("Expected no loss, got %d", lost)
+	}
+}
+
+func TestCmdTrackerLagging(t *testing.T) {
+	tr := newCmdTracker()
+	crc := uint16(0xffff)
+	for i := 0; i < 5; i++ {
+		b := []byte{byte(i), 0x10}
+		tr.sent(b)
+		if i < 3 {
+			crc = crc16(crc, b)
+		}
+	}
+	// The last two writes haven't landed yet
+	if lost := tr.check(3, crc); lost != 0 {
+		t.Errorf("Expected no loss while lagging, got %d", lost)
+	}
+}
+
+func TestCmdTrackerLost(t *testing.T) {
+	tr := newCmdTracker()
+	crc := uint16(0xffff)
+	for i := 0; i < 5; i++ {
+		b := []byte{byte(i), 0x10}
+		tr.sent(b)
+		// Peripheral never saw the second command
+		if i != 1 {
+			crc = crc16(crc, b)
+		}
+	}
+	if lost := tr.check(4, crc); lost != 1 {
+		t.Errorf("Expected one lost command, got %d", lost)
+	}
+	if tr.Lost() != 1 {
+		t.Errorf("Expected total of one, got %d", tr.Lost())
+	}
+	// Resynced, so more traffic is clean again
+	b := []byte{5, 0x10}
+	tr.sent(b)
+	if lost := tr.check(5, crc16(crc, b)); lost != 0 {
+		t.Errorf("Expected resync, got %d", lost)
+	}
+}
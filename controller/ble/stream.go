@@ -0,0 +1,259 @@
+package ble
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"time"
+)
+
+// Frame streams (the firmware's stream.h), for effects driven from
+// outside the tables, synced to music or video. Each frame is numbered
+// and goes ahead of its turn without response into a ring on the brick,
+// which plays them out from a start and period the bricks share, so
+// every brick fades to frame n at the same moment however the link
+// jitters. A frame arriving after its turn is dropped, a missing one
+// is faded across, and the bricks count both for StreamStats. Bricks
+// without streams, or whose clock isn't known, are written each frame
+// as it comes, faded over the period.
+//
+// Frames are sent streamAhead periods ahead of their turn. A caller
+// falling behind has its next frame moved on to that far ahead again,
+// skipping the turns it missed; one running ahead of the ring by more
+// than it holds has its frames refused. Writes to the channels are
+// held off while a stream runs.
+const (
+	// STREAM_SLOTS and STREAM_MAX_CHANNELS
+	streamSlots       = 8
+	streamMaxChannels = 8
+	// STREAM_MIN_PERIOD_MS, a tick, which periods are whole multiples of
+	streamTick      = 20 * time.Millisecond
+	streamMaxPeriod = time.Second
+	// STREAM_IDLE_MS: bricks with nothing to play this long end the
+	// stream, so a pause as long starts it over
+	streamIdle  = 2 * time.Second
+	streamAhead = 4
+	// A stream's counters and the frames held, BULK_CMD_STREAM
+	streamStatsLen = 21
+)
+
+var errStreamAhead = errors.New("stream frames coming faster than their period")
+
+// StreamStats is what a brick counted of the frames streamed to it
+// since it booted
+type StreamStats struct {
+	Played uint32 `json:"played"`
+	// Dropped arriving after their turn, or past the end of the ring
+	Late  uint32 `json:"late"`
+	Early uint32 `json:"early"`
+	// Turns without their frame faded across to a later one, and those
+	// without any frame held
+	Interpolated uint32 `json:"interpolated"`
+	Underruns    uint32 `json:"underruns"`
+	// Waiting for their turn now
+	Held int `json:"held"`
+}
+
+func parseStreamStats(b []byte) (StreamStats, error) {
+	if len(b) < streamStatsLen {
+		return StreamStats{}, fmt.Errorf("short stream stats (%d bytes)", len(b))
+	}
+	u := func(i int) uint32 { return binary.LittleEndian.Uint32(b[4*i:]) }
+	return StreamStats{Played: u(0), Late: u(1), Early: u(2), Interpolated: u(3), Underruns: u(4),
+		Held: int(b[20])}, nil
+}
+
+func (s StreamStats) String() string {
+	return fmt.Sprintf("%d played, %d late, %d early, %d interpolated, %d underruns",
+		s.Played, s.Late, s.Early, s.Interpolated, s.Underruns)
+}
+
+// streamStartRecord starts a stream whose frame 0 plays at startMs on the
+// brick's clock, for the channels in mask. A period of 0 stops it.
+func streamStartRecord(startMs uint32, periodMs int, mask uint16) cmdRecord {
+	return cmdRecord{op: cmdOpStreamStart, value: []byte{byte(startMs), byte(startMs >> 8), byte(startMs >> 16),
+		byte(startMs >> 24), byte(periodMs), byte(periodMs >> 8), byte(mask), byte(mask >> 8)}}
+}
+
+// streamFrameRecord is frame n of levels (0-4095), packed as a packed
+// frame's
+func streamFrameRecord(n uint16, levels []int) cmdRecord {
+	v := packedFrameRecord(0, 0, levels).value[4:]
+	return cmdRecord{op: cmdOpStreamFrame, value: append([]byte{byte(n), byte(n >> 8)}, v...)}
+}
+
+// frameStream is the stream running on the channel
+type frameStream struct {
+	period   time.Duration
+	channels int
+	// When frame 0 plays, and the number of the next frame
+	start time.Time
+	next  int
+	// The last frame sent, to tell a pause the bricks ended the stream on
+	last time.Time
+	// Bricks started on it, as connected
+	started map[*blePeriph]bool
+}
+
+func (s *frameStream) mask() uint16 {
+	return uint16(1<<uint(s.channels) - 1)
+}
+
+// due is when frame n plays
+func (s *frameStream) due(n int) time.Time {
+	return s.start.Add(time.Duration(n) * s.period)
+}
+
+// restart sets frame 0 streamAhead periods on from now, starting the
+// bricks over on it
+func (s *frameStream) restart(now time.Time) {
+	s.start = now.Add(streamAhead * s.period)
+	s.next = 0
+	s.started = make(map[*blePeriph]bool)
+}
+
+// frame numbers the next frame as of now, moving it on past the turns a
+// slow caller missed
+func (s *frameStream) frame(now time.Time) (int, error) {
+	if !s.last.IsZero() && now.Sub(s.last) >= streamIdle {
+		s.restart(now)
+	}
+	if s.due(s.next).Before(now.Add(s.period)) {
+		s.next = int(now.Sub(s.start)/s.period) + streamAhead
+	}
+	if s.due(s.next).After(now.Add((streamSlots - 1) * s.period)) {
+		return 0, errStreamAhead
+	}
+	n := s.next
+	s.next++
+	s.last = now
+	return n, nil
+}
+
+func (p *blePeriph) streams() bool {
+	return p.commandChar != nil && p.caps != nil && p.caps.has(capStream)
+}
+
+// StartStream takes frames for the first channels of every brick, one
+// played each period (a multiple of 20 ms, up to a second), until
+// StopStream
+func (ble *bleChannel) StartStream(period time.Duration, channels int) error {
+	switch {
+	case period < streamTick || period > streamMaxPeriod || period%streamTick != 0:
+		return fmt.Errorf("stream period must be a multiple of %v up to %v, got %v", streamTick, streamMaxPeriod, period)
+	case channels < 1 || channels > streamMaxChannels:
+		return fmt.Errorf("streams carry 1-%d channels, got %d", streamMaxChannels, channels)
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if ble.stream != nil {
+		return fmt.Errorf("a stream is already running")
+	}
+	ble.stream = &frameStream{period: period, channels: channels}
+	ble.stream.restart(ble.clock.Now())
+	return nil
+}
+
+// StreamFrame sends the next frame of the stream, percents from
+// channel 0
+func (ble *bleChannel) StreamFrame(percents []float64) error {
+	ble.lock.Lock()
+	s := ble.stream
+	if s == nil {
+		ble.lock.Unlock()
+		return fmt.Errorf("no stream running")
+	}
+	if len(percents) != s.channels {
+		ble.lock.Unlock()
+		return fmt.Errorf("stream of %d channels sent %d", s.channels, len(percents))
+	}
+	now := ble.clock.Now()
+	n, err := s.frame(now)
+	if err != nil {
+		ble.lock.Unlock()
+		return err
+	}
+	levels := make([]int, len(percents))
+	for ch, pct := range percents {
+		levels[ch] = int((pct / 100.0) * ledMaxLevel)
+	}
+	frame := streamFrameRecord(uint16(n), levels)
+	plain := packedFrameRecord(s.mask(), int(s.period/time.Millisecond), levels)
+	// The first frame a brick gets starts it
+	sends := make(map[*blePeriph][]cmdRecord, len(ble.connectedPeriph))
+	for _, p := range ble.connectedPeriph {
+		if p.commandChar == nil {
+			continue
+		}
+		if p.streams() && !s.started[p] {
+			if at, ok := p.sync.at(s.start, now); ok {
+				sends[p] = []cmdRecord{streamStartRecord(at, int(s.period/time.Millisecond), s.mask())}
+				s.started[p] = true
+			}
+		}
+		if s.started[p] {
+			sends[p] = append(sends[p], frame)
+		} else {
+			sends[p] = []cmdRecord{plain}
+		}
+	}
+	ble.lock.Unlock()
+
+	for p, records := range sends {
+		if err := p.sendAt(prioSchedule, records...); err != nil {
+			log.Printf("%s: stream frame %d: %s", p.gp.ID(), n, err)
+		}
+	}
+	return nil
+}
+
+// StopStream ends the stream, leaving each brick where its last frame
+// took it until the channels are written again
+func (ble *bleChannel) StopStream() error {
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	s := ble.stream
+	if s == nil {
+		return nil
+	}
+	ble.stream = nil
+	for _, p := range ble.connectedPeriph {
+		if !s.started[p] {
+			continue
+		}
+		if err := p.sendCommands(streamStartRecord(0, 0, 0)); err != nil {
+			log.Printf("%s: stream stop: %s", p.gp.ID(), err)
+		}
+	}
+	return nil
+}
+
+// StreamStats reads what every connected brick taking streams counted
+// of them, by peripheral ID
+func (ble *bleChannel) StreamStats() map[string]StreamStats {
+	ble.lock.Lock()
+	var periphs []*blePeriph
+	for _, p := range ble.connectedPeriph {
+		if p.streams() && p.bulk != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	out := make(map[string]StreamStats)
+	for _, p := range periphs {
+		b, err := p.bulk.request(bulkCmdStream, nil, bulkReplyTimeout)
+		if err != nil {
+			log.Printf("%s: stream stats: %s", p.gp.ID(), err)
+			continue
+		}
+		s, err := parseStreamStats(b)
+		if err != nil {
+			log.Printf("%s: stream stats: %s", p.gp.ID(), err)
+			continue
+		}
+		out[p.gp.ID()] = s
+	}
+	return out
+}
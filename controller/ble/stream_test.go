@@ -0,0 +1,104 @@
+package ble
+
+import (
+	"bytes"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/clock"
+)
+
+func TestStreamRecords(t *testing.T) {
+	if r := streamStartRecord(0x01020304, 40, 0x07); r.op != cmdOpStreamStart ||
+		!bytes.Equal(r.value, []byte{4, 3, 2, 1, 40, 0, 7, 0}) {
+		t.Errorf("start %+v", r)
+	}
+	// Frame number, then the levels packed as a packed frame's
+	if r := streamFrameRecord(0x0102, []int{0xabc, 0x123, 0x456}); r.op != cmdOpStreamFrame ||
+		!bytes.Equal(r.value, []byte{2, 1, 0xbc, 0x3a, 0x12, 0x56, 0x04}) {
+		t.Errorf("frame %+v % x", r, r.value)
+	}
+	// A full stream frame fits a command write with its headers
+	if r := streamFrameRecord(0, make([]int, streamMaxChannels)); cmdHeaderLen+cmdRecordHeader+len(r.value) > cmdMaxWrite {
+		t.Errorf("frame of %d bytes", len(r.value))
+	}
+
+	s, err := parseStreamStats([]byte{1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0, 4, 0, 0, 0, 5, 0, 0, 0, 6})
+	if err != nil || s != (StreamStats{Played: 1, Late: 2, Early: 3, Interpolated: 4, Underruns: 5, Held: 6}) {
+		t.Errorf("stats %+v, %v", s, err)
+	}
+	if _, err := parseStreamStats(make([]byte, 20)); err == nil {
+		t.Error("short stats taken")
+	}
+}
+
+func TestFrameStream(t *testing.T) {
+	now := time.Date(2020, 1, 1, 0, 0, 0, 0, time.UTC)
+	period := 40 * time.Millisecond
+	s := &frameStream{period: period, channels: 3}
+	s.restart(now)
+	if s.mask() != 0x07 || !s.due(0).Equal(now.Add(streamAhead*period)) {
+		t.Fatalf("mask %x, frame 0 at %v", s.mask(), s.due(0))
+	}
+	// Frames sent as fast as they play keep streamAhead ahead
+	for i := 0; i < 10; i++ {
+		if n, err := s.frame(now.Add(time.Duration(i) * period)); n != i || err != nil {
+			t.Fatalf("frame %d numbered %d, %v", i, n, err)
+		}
+	}
+	// Running ahead fills the ring, then is refused
+	at := now.Add(9 * period)
+	for i := 10; i < 10+streamSlots-1-streamAhead; i++ {
+		if _, err := s.frame(at); err != nil {
+			t.Fatalf("frame %d: %v", i, err)
+		}
+	}
+	if _, err := s.frame(at); err != errStreamAhead {
+		t.Errorf("frame past the ring: %v", err)
+	}
+	// Falling behind skips to streamAhead from now
+	at = now.Add(30 * period)
+	if n, err := s.frame(at); n != 30 || err != nil {
+		t.Errorf("late frame numbered %d, %v", n, err)
+	}
+	s.started[&blePeriph{}] = true
+	// A pause the bricks end the stream on starts it over
+	at = at.Add(streamIdle)
+	if n, err := s.frame(at); n != 0 || err != nil || len(s.started) != 0 || !s.due(0).Equal(at.Add(streamAhead*period)) {
+		t.Errorf("frame after a pause numbered %d, %v", n, err)
+	}
+}
+
+func TestStartStream(t *testing.T) {
+	ble := newBleChannel(nil, clock.NewSim(time.Date(2020, 1, 1, 0, 0, 0, 0, time.UTC)))
+	for _, c := range []struct {
+		period   time.Duration
+		channels int
+	}{{10 * time.Millisecond, 3}, {50 * time.Millisecond, 3}, {2 * time.Second, 3}, {40 * time.Millisecond, 0},
+		{40 * time.Millisecond, streamMaxChannels + 1}} {
+		if err := ble.StartStream(c.period, c.channels); err == nil {
+			t.Errorf("stream of %d channels every %v started", c.channels, c.period)
+		}
+	}
+	if err := ble.StreamFrame([]float64{1}); err == nil {
+		t.Error("frame sent without a stream")
+	}
+	if err := ble.StartStream(40*time.Millisecond, 2); err != nil {
+		t.Fatal(err)
+	}
+	if err := ble.StartStream(40*time.Millisecond, 2); err == nil {
+		t.Error("second stream started")
+	}
+	if err := ble.StreamFrame([]float64{1, 2, 3}); err == nil {
+		t.Error("frame of the wrong channels sent")
+	}
+	if err := ble.StreamFrame([]float64{1, 2}); err != nil {
+		t.Error(err)
+	}
+	if ble.writeLedState(); ble.stream == nil {
+		t.Error("stream lost")
+	}
+	if err := ble.StopStream(); err != nil || ble.stream != nil {
+		t.Errorf("stream left running, %v", err)
+	}
+}
@@ -0,0 +1,47 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// The firmware's supply stats (supply.h): the last reading, the lowest,
+// highest and mean over the window since the last poll, then counts
+// since boot.
+const (
+	supplyLen         = 13
+	supplyFlagPresent = 1 << 0
+	supplyFlagShed    = 1 << 1
+)
+
+type supplyStats struct {
+	lastMv, minMv, maxMv, meanMv int
+	// VDD power-fail warnings and LED supply sags since boot
+	powerFails, sags int
+	present, shed    bool
+}
+
+func (s supplyStats) String() string {
+	if !s.present {
+		return fmt.Sprintf("not measured, %d power-fail warnings", s.powerFails)
+	}
+	return fmt.Sprintf("%.2f V (%.2f-%.2f, mean %.2f), %d sags, %d power-fail warnings",
+		float64(s.lastMv)/1000, float64(s.minMv)/1000, float64(s.maxMv)/1000,
+		float64(s.meanMv)/1000, s.sags, s.powerFails)
+}
+
+func parseSupply(b []byte) (supplyStats, error) {
+	if len(b) < supplyLen {
+		return supplyStats{}, fmt.Errorf("short supply stats (%d bytes)", len(b))
+	}
+	return supplyStats{
+		lastMv:     int(binary.LittleEndian.Uint16(b[0:])),
+		minMv:      int(binary.LittleEndian.Uint16(b[2:])),
+		maxMv:      int(binary.LittleEndian.Uint16(b[4:])),
+		meanMv:     int(binary.LittleEndian.Uint16(b[6:])),
+		powerFails: int(binary.LittleEndian.Uint16(b[8:])),
+		sags:       int(binary.LittleEndian.Uint16(b[10:])),
+		present:    b[12]&supplyFlagPresent != 0,
+		shed:       b[12]&supplyFlagShed != 0,
+	}, nil
+}
@@ -0,0 +1,27 @@
+package ble
+
+import "testing"
+
+func TestParseSupply(t *testing.T) {
+	b := []byte{
+		0xc0, 0x5d, // 24000 mV
+		0x98, 0x58, // 22680
+		0x10, 0x5e, // 24080
+		0xb8, 0x5d, // 23992
+		1, 0,
+		2, 0,
+		supplyFlagPresent | supplyFlagShed,
+	}
+	s, err := parseSupply(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := supplyStats{lastMv: 24000, minMv: 22680, maxMv: 24080, meanMv: 23992,
+		powerFails: 1, sags: 2, present: true, shed: true}
+	if s != want {
+		t.Errorf("got %+v", s)
+	}
+	if _, err := parseSupply(b[:12]); err == nil {
+		t.Error("short stats accepted")
+	}
+}
@@ -0,0 +1,230 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"math"
+	"sync"
+	"time"
+)
+
+// Sync characteristic, laid out in the firmware's ble_lbs.h: a token
+// written is notified back with the brick's clock_ms() as it arrived.
+const (
+	syncWriteLen = 4
+	syncLen      = 8
+
+	// How often each brick is probed, and how many answers are kept
+	syncProbeInterval = 5 * time.Second
+	syncSamples       = 60
+	// Both crystals together, for how fast an answer goes stale
+	syncDriftPpm = 100
+	// The brick's rate against ours is fitted from at least this many
+	// answers this far apart, leaving three standard errors of it
+	// unknown, and no less than syncFitPpm
+	syncFitSamples = 6
+	syncFitSpan    = time.Minute
+	syncFitPpm     = 2
+	// A brick whose offset is known no better than this isn't held to
+	// the shared time
+	syncMaxError = 40 * time.Millisecond
+
+	// Time synced frames are sent ahead of being applied, enough for
+	// every brick's write to land over its own connection
+	syncLead = 250 * time.Millisecond
+)
+
+// syncSample pins the brick's clock to ours: it read brick ms some time
+// between sent and recv.
+type syncSample struct {
+	sent, recv time.Time
+	brick      uint32
+}
+
+func (s syncSample) rtt() time.Duration {
+	return s.recv.Sub(s.sent)
+}
+
+func msSince(t, ref time.Time) float64 {
+	return float64(t.Sub(ref)) / float64(time.Millisecond)
+}
+
+// interval is what s says of the offset, the brick's ms less ours since
+// ref was sent, somewhere from lo to hi, and the ms the middle is at.
+// The brick counts whole ms, so it was up to one further on than it read.
+func (s syncSample) interval(ref syncSample) (lo, hi, mid float64) {
+	b := float64(int32(s.brick - ref.brick))
+	return b - msSince(s.recv, ref.sent), b + 1 - msSince(s.sent, ref.sent), msSince(s.sent.Add(s.rtt()/2), ref.sent)
+}
+
+// brickSync estimates a brick's clock_ms() from its sync answers. The
+// write and notification go out on different connection events, so
+// one answer only places the brick's clock somewhere in its round trip.
+// Each is a window on the offset between the clocks, and the windows
+// of every answer kept, carried forward at the brick's rate and widened
+// for what is unknown of it, overlap in a far narrower one: a quick
+// round trip pins one end, and an answer read early or late in a slow
+// one can still pin the other. The rate is fitted over the answers once
+// they span a minute, leaving only what the fit can't tell unknown
+// rather than the crystals' full syncDriftPpm, so the window stays
+// narrow between probes. An answer whose window misses the rest, as after the brick
+// restarted, starts the estimate over.
+type brickSync struct {
+	next    uint32
+	sent    map[uint32]time.Time
+	samples []syncSample
+	probed  time.Time
+
+	lock sync.Mutex
+}
+
+func newBrickSync() *brickSync {
+	return &brickSync{sent: make(map[uint32]time.Time)}
+}
+
+func (s *brickSync) due(now time.Time) bool {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	return now.Sub(s.probed) >= syncProbeInterval
+}
+
+// probe returns the next token to write, sent at now
+func (s *brickSync) probe(now time.Time) []byte {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	for token, t := range s.sent {
+		// Never answered
+		if now.Sub(t) > syncProbeInterval {
+			delete(s.sent, token)
+		}
+	}
+	s.next++
+	s.sent[s.next] = now
+	s.probed = now
+	b := make([]byte, syncWriteLen)
+	binary.LittleEndian.PutUint32(b, s.next)
+	return b
+}
+
+// answer takes a sync notification received at now
+func (s *brickSync) answer(b []byte, now time.Time) error {
+	if len(b) < syncLen {
+		return fmt.Errorf("short sync (%d bytes)", len(b))
+	}
+	token := binary.LittleEndian.Uint32(b[0:])
+
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	sent, ok := s.sent[token]
+	if !ok {
+		return fmt.Errorf("sync answer to unknown token %d", token)
+	}
+	delete(s.sent, token)
+	s.samples = append(s.samples, syncSample{sent: sent, recv: now, brick: binary.LittleEndian.Uint32(b[4:])})
+	if len(s.samples) > syncSamples {
+		s.samples = s.samples[len(s.samples)-syncSamples:]
+	}
+	if _, _, ok := s.window(now, now); !ok {
+		s.samples = append(s.samples[:0], s.samples[len(s.samples)-1])
+	}
+	return nil
+}
+
+// rate fits the brick's ms gained per ms of ours, from the answers with
+// round trips near the quickest, once there are enough far enough
+// apart, and how much of it is still unknown. Called with s.lock held.
+func (s *brickSync) rate() (float64, float64, bool) {
+	limit := float64(syncDriftPpm) / 1e6
+	if len(s.samples) < syncFitSamples {
+		return 0, limit, false
+	}
+	ref := s.samples[len(s.samples)-1]
+	quickest := ref.rtt()
+	for _, x := range s.samples {
+		if x.rtt() < quickest {
+			quickest = x.rtt()
+		}
+	}
+	var xs, ys []float64
+	var sx, sy float64
+	for _, x := range s.samples {
+		if x.rtt() > 2*quickest+time.Millisecond {
+			continue
+		}
+		lo, hi, mid := x.interval(ref)
+		xs, ys = append(xs, mid), append(ys, (lo+hi)/2)
+		sx, sy = sx+mid, sy+(lo+hi)/2
+	}
+	n := float64(len(xs))
+	if len(xs) < syncFitSamples || xs[len(xs)-1]-xs[0] < float64(syncFitSpan/time.Millisecond) {
+		return 0, limit, false
+	}
+	var sxx, sxy float64
+	for i := range xs {
+		sxx += (xs[i] - sx/n) * (xs[i] - sx/n)
+		sxy += (xs[i] - sx/n) * (ys[i] - sy/n)
+	}
+	d := sxy / sxx
+	var res float64
+	for i := range xs {
+		r := ys[i] - sy/n - d*(xs[i]-sx/n)
+		res += r * r
+	}
+	unknown := math.Max(float64(syncFitPpm)/1e6, 3*math.Sqrt(res/(n-2)/sxx))
+	if unknown >= limit {
+		return 0, limit, false
+	}
+	return math.Max(-limit, math.Min(limit, d)), unknown, true
+}
+
+// window is where the answers place the offset at t, as of now: its
+// middle and half width in ms, relative to the newest answer, false if
+// they don't agree. Called with s.lock held.
+func (s *brickSync) window(t, now time.Time) (float64, float64, bool) {
+	ref := s.samples[len(s.samples)-1]
+	d, unknown, _ := s.rate()
+	at, nowMs := msSince(t, ref.sent), msSince(now, ref.sent)
+	lo, hi := math.Inf(-1), math.Inf(1)
+	for _, x := range s.samples {
+		l, h, mid := x.interval(ref)
+		age := math.Max(math.Abs(at-mid), nowMs-mid)
+		lo = math.Max(lo, l+d*(at-mid)-unknown*age)
+		hi = math.Min(hi, h+d*(at-mid)+unknown*age)
+	}
+	return (lo + hi) / 2, (hi - lo) / 2, lo <= hi
+}
+
+// estimate is the brick's rate against ours in ppm, when fitted, and
+// how well its clock is known at now
+func (s *brickSync) estimate(now time.Time) (float64, bool, time.Duration) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	if len(s.samples) == 0 {
+		return 0, false, 0
+	}
+	d, _, fitted := s.rate()
+	_, half, _ := s.window(now, now)
+	return d * 1e6, fitted, time.Duration(half * float64(time.Millisecond))
+}
+
+// at gives t on the brick's clock, if it is known well enough as of now
+func (s *brickSync) at(t, now time.Time) (uint32, bool) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	if len(s.samples) == 0 {
+		return 0, false
+	}
+	offset, half, ok := s.window(t, now)
+	if !ok || time.Duration(half*float64(time.Millisecond)) > syncMaxError {
+		return 0, false
+	}
+	ref := s.samples[len(s.samples)-1]
+	return ref.brick + uint32(int32(math.Floor(msSince(t, ref.sent)+offset))), true
+}
+
+// commandAt holds records on the brick until its clock reads at
+func commandAt(at uint32, records []cmdRecord) []cmdRecord {
+	v := make([]byte, 4)
+	binary.LittleEndian.PutUint32(v, at)
+	return append([]cmdRecord{{op: cmdOpAt, value: v}}, records...)
+}
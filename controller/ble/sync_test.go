@@ -0,0 +1,115 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"math"
+	"testing"
+	"time"
+)
+
+func syncAnswer(token, ms uint32) []byte {
+	b := make([]byte, syncLen)
+	binary.LittleEndian.PutUint32(b[0:], token)
+	binary.LittleEndian.PutUint32(b[4:], ms)
+	return b
+}
+
+func TestBrickSyncEstimate(t *testing.T) {
+	s := newBrickSync()
+	t0 := time.Unix(1000, 0)
+	if _, ok := s.at(t0, t0); ok {
+		t.Error("placed with no samples")
+	}
+
+	// A slow round trip, then a quick one that should win
+	p := s.probe(t0)
+	if err := s.answer(syncAnswer(binary.LittleEndian.Uint32(p), 5000), t0.Add(60*time.Millisecond)); err != nil {
+		t.Fatal(err)
+	}
+	t1 := t0.Add(time.Second)
+	p = s.probe(t1)
+	if err := s.answer(syncAnswer(binary.LittleEndian.Uint32(p), 7010), t1.Add(20*time.Millisecond)); err != nil {
+		t.Fatal(err)
+	}
+	at, ok := s.at(t1.Add(500*time.Millisecond), t1.Add(20*time.Millisecond))
+	if !ok || at != 7500 {
+		t.Errorf("placed at %d, %v", at, ok)
+	}
+
+	if err := s.answer(syncAnswer(99, 0), t1); err == nil {
+		t.Error("unknown token accepted")
+	}
+	// Stale enough to no longer be trusted
+	if _, ok := s.at(t1, t1.Add(time.Hour)); ok {
+		t.Error("stale sample trusted")
+	}
+}
+
+// A brick running 60 ppm fast, answered over round trips of one to four
+// connection intervals read anywhere in them, is placed inside a
+// millisecond between probes once the answers overlap and the rate is
+// fitted
+func TestBrickSyncDrift(t *testing.T) {
+	s := newBrickSync()
+	t0 := time.Unix(1000, 0)
+	brickAt := func(t time.Time) float64 {
+		return 1e6 + float64(t.Sub(t0))/float64(time.Millisecond)*(1+60e-6)
+	}
+	rtts := []time.Duration{30, 7500, 22500, 15000, 7500, 30000, 15000}
+	reads := []float64{0.9, 0.1, 0.5, 0.7, 0.3, 0.05, 0.95, 0.4}
+	var now time.Time
+	for i := 0; i < syncSamples; i++ {
+		sent := t0.Add(time.Duration(i) * syncProbeInterval)
+		rtt := rtts[i%len(rtts)] * time.Microsecond
+		read := sent.Add(time.Duration(float64(rtt) * reads[i%len(reads)]))
+		now = sent.Add(rtt)
+		p := s.probe(sent)
+		if err := s.answer(syncAnswer(binary.LittleEndian.Uint32(p), uint32(brickAt(read))), now); err != nil {
+			t.Fatal(err)
+		}
+	}
+	ppm, fitted, bound := s.estimate(now)
+	if !fitted || ppm < 55 || ppm > 65 {
+		t.Errorf("fitted %v at %.1f ppm", fitted, ppm)
+	}
+	if bound > time.Millisecond {
+		t.Errorf("known to %v", bound)
+	}
+	// Just before the next probe, a commit syncLead out
+	now = now.Add(syncProbeInterval)
+	at, ok := s.at(now.Add(syncLead), now)
+	if want := brickAt(now.Add(syncLead)); !ok || math.Abs(float64(at)-math.Floor(want)) > 1 {
+		t.Errorf("placed at %d (%v), the brick reads %.1f", at, ok, want)
+	}
+
+	// Restarted, its clock back near 0: the old answers are dropped
+	p := s.probe(now)
+	s.answer(syncAnswer(binary.LittleEndian.Uint32(p), 500), now.Add(10*time.Millisecond))
+	if at, ok := s.at(now.Add(time.Second), now.Add(10*time.Millisecond)); !ok || at < 1490 || at > 1510 {
+		t.Errorf("restarted brick placed at %d, %v", at, ok)
+	}
+}
+
+func TestBrickSyncWrap(t *testing.T) {
+	s := newBrickSync()
+	t0 := time.Unix(1000, 0)
+	p := s.probe(t0)
+	s.answer(syncAnswer(binary.LittleEndian.Uint32(p), 0xfffffff0), t0)
+	if at, ok := s.at(t0.Add(32*time.Millisecond), t0); !ok || at != 0x10 {
+		t.Errorf("placed at %#x, %v", at, ok)
+	}
+}
+
+func TestCommandAtBatch(t *testing.T) {
+	a := newCmdAcks()
+	b := a.batch(commandAt(0x01020304, []cmdRecord{packedFrameRecord(0x3, 1000, []int{0xabc, 0x123})}))
+	want := []byte{cmdVersion, 0, cmdOpAt, 4, 0x04, 0x03, 0x02, 0x01,
+		cmdOpFramePacked, 7, 0x03, 0x00, 0xe8, 0x03, 0xbc, 0x3a, 0x12}
+	if !bytes.Equal(b, want) {
+		t.Errorf("batch % x", b)
+	}
+	if lost, _ := a.ack(cmdAck{seq: 0, received: 1}); lost != 0 || len(a.pending) != 0 {
+		t.Errorf("batch not settled, %d lost", lost)
+	}
+}
@@ -0,0 +1,99 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// Length of the packed telemetry notification; older firmware stops
+// before the drop counter
+const (
+	telemetryLen      = 18
+	telemetryDropsLen = 20
+)
+
+// Flags in the telemetry notification
+const (
+	telemetryTempValid = 1 << 0
+	telemetryTripped   = 1 << 1
+	telemetryNoOutput  = 1 << 2
+	// Outputs held off, the LED supply sagged or VDD is failing
+	telemetrySupplyShed = 1 << 3
+	// The control lease ran out and the brick failed over (lease.go)
+	telemetryLeaseLapsed = 1 << 4
+	// A controller holds the lease, this one or another (standby.go)
+	telemetryLeased = 1 << 5
+)
+
+// telemetry is one packed notification from the telemetry
+// characteristic, which carries what the fan, temperature and status
+// characteristics send separately.
+type telemetry struct {
+	temperature16 int // 1/16 degree C
+	fanRpm        int
+	errors        uint8
+	derate        int // Percent of requested output
+	fanDuty       int // Percent
+	flags         uint8
+	uptime        uint32 // Seconds
+	cmdCount      uint16
+	cmdCrc        uint16
+	outputHash    uint16
+	txDrops       int // Notifications the peripheral failed to send
+}
+
+func parseTelemetry(b []byte) (telemetry, error) {
+	if len(b) < telemetryLen {
+		return telemetry{}, fmt.Errorf("short telemetry: %d bytes", len(b))
+	}
+	t := telemetry{
+		temperature16: int(int16(binary.LittleEndian.Uint16(b[0:]))),
+		fanRpm:        int(binary.LittleEndian.Uint16(b[2:])),
+		errors:        b[4],
+		derate:        int(b[5]),
+		fanDuty:       int(b[6]),
+		flags:         b[7],
+		uptime:        binary.LittleEndian.Uint32(b[8:]),
+		cmdCount:      binary.LittleEndian.Uint16(b[12:]),
+		cmdCrc:        binary.LittleEndian.Uint16(b[14:]),
+		outputHash:    binary.LittleEndian.Uint16(b[16:]),
+	}
+	if len(b) >= telemetryDropsLen {
+		t.txDrops = int(binary.LittleEndian.Uint16(b[18:]))
+	}
+	return t, nil
+}
+
+// Telemetry a brick carries in its advertisement, readable by a passive
+// scan without a connection. Manufacturer data starts with the company
+// ID, as gatt hands it over.
+const (
+	advTelemetryLen   = 12
+	advTelemetryMagic = 0x54
+)
+
+type advTelemetry struct {
+	flags         uint8
+	errors        uint8
+	temperature16 int
+	fanRpm        int
+	derate        int
+	fanDuty       int
+	seq           uint8 // Moves whenever any other field does
+}
+
+func parseAdvTelemetry(b []byte) (advTelemetry, bool) {
+	if len(b) < advTelemetryLen ||
+		binary.LittleEndian.Uint16(b[0:]) != broadcastCompanyID || b[2] != advTelemetryMagic {
+		return advTelemetry{}, false
+	}
+	return advTelemetry{
+		flags:         b[3],
+		errors:        b[4],
+		temperature16: int(int16(binary.LittleEndian.Uint16(b[5:]))),
+		fanRpm:        int(binary.LittleEndian.Uint16(b[7:])),
+		derate:        int(b[9]),
+		fanDuty:       int(b[10]),
+		seq:           b[11],
+	}, true
+}
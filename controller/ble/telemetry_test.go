@@ -0,0 +1,66 @@
+package ble
+
+import (
+	"testing"
+)
+
+func TestParseTelemetry(t *testing.T) {
+	b := []byte{
+		0xf8, 0xff, // -0.5 C
+		0xb8, 0x0b, // 3000 rpm
+		0x02, // ERROR_TEMP
+		75,   // derate
+		40,   // fan duty
+		telemetryTempValid,
+		0x10, 0x0e, 0x00, 0x00, // 3600 s
+		0x05, 0x00,
+		0x34, 0x12,
+		0xcd, 0xab,
+	}
+	tm, err := parseTelemetry(b)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if tm.temperature16 != -8 || tm.fanRpm != 3000 {
+		t.Errorf("temperature %d, rpm %d", tm.temperature16, tm.fanRpm)
+	}
+	if tm.errors != 2 || tm.derate != 75 || tm.fanDuty != 40 || tm.flags != telemetryTempValid {
+		t.Errorf("errors %d, derate %d, duty %d, flags %d", tm.errors, tm.derate, tm.fanDuty, tm.flags)
+	}
+	if tm.uptime != 3600 || tm.cmdCount != 5 || tm.cmdCrc != 0x1234 || tm.outputHash != 0xabcd {
+		t.Errorf("uptime %d, count %d, crc %x, hash %x", tm.uptime, tm.cmdCount, tm.cmdCrc, tm.outputHash)
+	}
+
+	if tm.txDrops != 0 {
+		t.Errorf("drops %d without the counter", tm.txDrops)
+	}
+	tm, err = parseTelemetry(append(b, 0x07, 0x00))
+	if err != nil || tm.txDrops != 7 {
+		t.Errorf("drops %d, err %v", tm.txDrops, err)
+	}
+
+	if _, err := parseTelemetry(b[:telemetryLen-1]); err == nil {
+		t.Error("short telemetry accepted")
+	}
+}
+
+func TestParseAdvTelemetry(t *testing.T) {
+	b := []byte{0xff, 0xff, advTelemetryMagic, telemetryTempValid, 0x01,
+		0x70, 0x02, // 39 C
+		0xdc, 0x05, // 1500 rpm
+		100, 35, 9}
+	a, ok := parseAdvTelemetry(b)
+	if !ok {
+		t.Fatal("not parsed")
+	}
+	if a.temperature16 != 39*16 || a.fanRpm != 1500 || a.errors != 1 ||
+		a.derate != 100 || a.fanDuty != 35 || a.seq != 9 {
+		t.Errorf("parsed %+v", a)
+	}
+
+	// Controller broadcasts share the company ID
+	b[2] = broadcastMagic
+	if _, ok := parseAdvTelemetry(b); ok {
+		t.Error("broadcast frame parsed as telemetry")
+	}
+}
@@ -0,0 +1,158 @@
+package ble
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"sort"
+	"sync/atomic"
+)
+
+// Bricks in a zone light one stretch of tank between them, so one
+// derating for heat leaves a dim patch while the rest stay bright. With
+// thermal sharing on, the zone's bricks that aren't derating make up the
+// light the others lost, split evenly between them and each raised no
+// more than its headroom allows, and never a channel past full. Bricks in
+// no zone share as one. The shares are worked out again only when a
+// brick's derate changes or a brick comes or goes, not every frame.
+// Bricks running their schedule on-device aren't written frames, so they
+// neither give nor take.
+type thermalShare struct {
+	// Most a cool brick is raised, 0.2 for a fifth more
+	headroom float64
+	// Factor each brick's frames are raised by, those at 1 left out
+	boosts map[string]float64
+}
+
+// Boosts smaller than this aren't worth rewriting a brick for
+const thermalBoostStep = 0.01
+
+// SetThermalShare has bricks that aren't derating raise their output by
+// up to percent to make up for neighbours in their zone that are. 0
+// turns it off.
+func (ble *bleChannel) SetThermalShare(percent float64) error {
+	if percent < 0 || percent > 100 {
+		return fmt.Errorf("thermal share must be 0-100%%, got %g", percent)
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	if percent == 0 {
+		ble.thermal = nil
+	} else {
+		ble.thermal = &thermalShare{headroom: percent / 100, boosts: make(map[string]float64)}
+	}
+	for _, p := range ble.connectedPeriph {
+		p.sentLevels.invalidate()
+	}
+	ble.thermalChanged()
+	return nil
+}
+
+// thermalChanged has the shares worked out again on the next frame, when
+// a brick's derate changes. Safe without ble.lock.
+func (ble *bleChannel) thermalChanged() {
+	atomic.StoreInt32(&ble.thermalDirty, 1)
+}
+
+// share works out every brick's boost from derates, by brick, and
+// groups, the bricks lighting each stretch together. It gives back those
+// whose boost moved.
+func (t *thermalShare) share(groups [][]string, derates map[string]int) []string {
+	boosts := make(map[string]float64)
+	for _, group := range groups {
+		lost, cool := 0.0, 0
+		for _, id := range group {
+			if d := derates[id]; d < 100 {
+				lost += float64(100-d) / 100
+			} else {
+				cool++
+			}
+		}
+		if lost == 0 || cool == 0 {
+			continue
+		}
+		boost := 1 + math.Min(t.headroom, lost/float64(cool))
+		for _, id := range group {
+			if derates[id] >= 100 {
+				boosts[id] = boost
+			}
+		}
+	}
+
+	var moved []string
+	for id, b := range boosts {
+		if math.Abs(b-t.boost(id)) >= thermalBoostStep {
+			t.boosts[id] = b
+			moved = append(moved, id)
+		}
+	}
+	for id := range t.boosts {
+		if _, ok := boosts[id]; !ok {
+			delete(t.boosts, id)
+			moved = append(moved, id)
+		}
+	}
+	sort.Strings(moved)
+	return moved
+}
+
+// boost is what brick id's frames are raised by, 1 for none
+func (t *thermalShare) boost(id string) float64 {
+	if b, ok := t.boosts[id]; ok {
+		return b
+	}
+	return 1
+}
+
+// boosted is s raised by b, clipped at full
+func (s *ledState) boosted(b float64) *ledState {
+	r := *s
+	r.enc = newFrameEncodings()
+	for channel, percent := range r.percents {
+		r.percents[channel] = math.Min(100, percent*b)
+	}
+	return &r
+}
+
+// shareThermal works the shares out again if a derate changed since the
+// last frame. Called with ble.lock held, before the states are queued.
+func (ble *bleChannel) shareThermal() {
+	t := ble.thermal
+	if t == nil || atomic.SwapInt32(&ble.thermalDirty, 0) == 0 {
+		return
+	}
+	byZone := make(map[string][]string)
+	derates := make(map[string]int, len(ble.connectedPeriph))
+	for id, p := range ble.connectedPeriph {
+		if p.scheduled && !ble.manual {
+			continue
+		}
+		name, _ := ble.zoneOf(id)
+		byZone[name] = append(byZone[name], id)
+		derates[id] = p.Derate()
+	}
+	groups := make([][]string, 0, len(byZone))
+	for _, ids := range byZone {
+		groups = append(groups, ids)
+	}
+	for _, id := range t.share(groups, derates) {
+		if b := t.boost(id); b != 1 {
+			log.Printf("%s: raised %.0f%% for derating neighbours", id, (b-1)*100)
+		} else {
+			log.Printf("%s: no longer raised for its neighbours", id)
+		}
+		if p := ble.connectedPeriph[id]; p != nil {
+			// The frame's generation is the same, its levels aren't
+			p.sentLevels.invalidate()
+		}
+	}
+}
+
+// thermalBoost is what brick id's frames are raised by. Called with
+// ble.lock held.
+func (ble *bleChannel) thermalBoost(id string) float64 {
+	if ble.thermal == nil {
+		return 1
+	}
+	return ble.thermal.boost(id)
+}
@@ -0,0 +1,40 @@
+package ble
+
+import (
+	"math"
+	"testing"
+)
+
+func TestThermalShare(t *testing.T) {
+	ts := &thermalShare{headroom: 0.2, boosts: make(map[string]float64)}
+	tank := [][]string{{"a", "b", "c"}, {"d"}}
+
+	// One brick down a fifth, the other two make half of it up each
+	moved := ts.share(tank, map[string]int{"a": 80, "b": 100, "c": 100, "d": 100})
+	if len(moved) != 2 || math.Abs(ts.boost("b")-1.1) > 1e-9 || ts.boost("a") != 1 || ts.boost("d") != 1 {
+		t.Fatalf("moved %v, boosts %v", moved, ts.boosts)
+	}
+	// Only again once a derate moves
+	if moved := ts.share(tank, map[string]int{"a": 80, "b": 100, "c": 100, "d": 100}); len(moved) != 0 {
+		t.Errorf("moved %v with nothing changed", moved)
+	}
+	// No more than the headroom, however much is lost
+	ts.share(tank, map[string]int{"a": 20, "b": 100, "c": 100, "d": 100})
+	if ts.boost("b") != 1.2 {
+		t.Errorf("raised %g past the headroom", ts.boost("b"))
+	}
+	// A brick that starts derating gives its boost up
+	ts.share(tank, map[string]int{"a": 80, "b": 90, "c": 100, "d": 100})
+	if ts.boost("b") != 1 || ts.boost("c") != 1.2 {
+		t.Errorf("boosts %v", ts.boosts)
+	}
+	// Back to normal
+	if moved := ts.share(tank, map[string]int{"a": 100, "b": 100, "c": 100, "d": 100}); len(moved) != 1 || len(ts.boosts) != 0 {
+		t.Errorf("moved %v, left %v", moved, ts.boosts)
+	}
+
+	s := &ledState{percents: [frameChannels]float64{50, 90}}
+	if b := s.boosted(1.2); b.percents[0] != 60 || b.percents[1] != 100 || s.percents[0] != 50 {
+		t.Errorf("boosted to %v from %v", b.percents, s.percents)
+	}
+}
@@ -0,0 +1,181 @@
+package ble
+
+import (
+	"encoding/binary"
+	"fmt"
+	"sort"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// Command latency traces (the firmware's trace.h): the brick stamps the
+// first write to change its outputs since its last trace as it arrives
+// and as the frame it made commits, on its clock_ms(), and echoes the
+// write's sequence number with them in an ack. With the brick's clock
+// placed (sync.go) the time the write went to the adapter maps onto it,
+// so a trace splits into the link, from sending to arrival, the brick,
+// from arrival to the commit, and the whole. Without it only the
+// brick's part is known.
+const (
+	// Sequence number, arrival ms (uint32 LE), then ms to the commit
+	// (uint16 LE), after the ack
+	cmdTraceLen = 7
+	// Traces per stage the percentiles are taken over
+	traceSamples = 128
+	// Send times older than this are long gone from the brick's window:
+	// sequence numbers come round again within seconds at full rate
+	traceMaxAge = 2 * time.Second
+)
+
+const (
+	traceLink = iota
+	traceBrick
+	traceTotal
+	traceStages
+)
+
+var traceStageNames = [traceStages]string{"link", "brick", "total"}
+
+var traceQuantiles = [...]float64{0.5, 0.9, 0.99}
+
+type cmdTrace struct {
+	seq        uint8
+	receivedMs uint32
+	commitMs   uint16
+}
+
+func parseCmdTrace(b []byte) cmdTrace {
+	return cmdTrace{seq: b[0], receivedMs: binary.LittleEndian.Uint32(b[1:]),
+		commitMs: binary.LittleEndian.Uint16(b[5:])}
+}
+
+// cmdTraces keeps when each write went, by sequence number, and the
+// latest traces of each stage
+type cmdTraces struct {
+	sentAt [256]time.Time
+	rings  [traceStages][]time.Duration
+	next   [traceStages]int
+
+	lock sync.Mutex
+}
+
+func newCmdTraces() *cmdTraces {
+	return &cmdTraces{}
+}
+
+// sent notes when writes numbered by cmdAcks went out
+func (t *cmdTraces) sent(ws [][]byte, now time.Time) {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	for _, w := range ws {
+		t.sentAt[w[1]] = now
+	}
+}
+
+// Called with t.lock held
+func (t *cmdTraces) add(stage int, d time.Duration) {
+	if len(t.rings[stage]) < traceSamples {
+		t.rings[stage] = append(t.rings[stage], d)
+		return
+	}
+	t.rings[stage][t.next[stage]] = d
+	t.next[stage] = (t.next[stage] + 1) % traceSamples
+}
+
+// observe takes a trace, placing its stamps with s as of now. False when
+// its write's send time isn't known, as after a reconnect.
+func (t *cmdTraces) observe(k cmdTrace, s *brickSync, now time.Time) bool {
+	t.lock.Lock()
+	sentAt := t.sentAt[k.seq]
+	t.sentAt[k.seq] = time.Time{}
+	t.lock.Unlock()
+	if sentAt.IsZero() || now.Sub(sentAt) > traceMaxAge {
+		return false
+	}
+	brick := time.Duration(k.commitMs) * time.Millisecond
+	sent, placed := s.at(sentAt, now)
+
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	t.add(traceBrick, brick)
+	if placed {
+		link := time.Duration(int32(k.receivedMs-sent)) * time.Millisecond
+		if link < 0 {
+			// Inside the clock's error
+			link = 0
+		}
+		t.add(traceLink, link)
+		t.add(traceTotal, link+brick)
+	}
+	return true
+}
+
+// reset drops the traces kept, leaving the send times
+func (t *cmdTraces) reset() {
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	for stage := range t.rings {
+		t.rings[stage] = nil
+		t.next[stage] = 0
+	}
+}
+
+// merge adds other's traces to t's, beyond the traceSamples of one brick
+func (t *cmdTraces) merge(other *cmdTraces) {
+	other.lock.Lock()
+	var rings [traceStages][]time.Duration
+	for stage, ring := range other.rings {
+		rings[stage] = append(rings[stage], ring...)
+	}
+	other.lock.Unlock()
+	t.lock.Lock()
+	defer t.lock.Unlock()
+	for stage, ring := range rings {
+		t.rings[stage] = append(t.rings[stage], ring...)
+	}
+}
+
+// percentiles gives a stage's traceQuantiles and how many traces they
+// are taken over
+func (t *cmdTraces) percentiles(stage int) ([len(traceQuantiles)]time.Duration, int) {
+	t.lock.Lock()
+	ds := append([]time.Duration(nil), t.rings[stage]...)
+	t.lock.Unlock()
+	var ps [len(traceQuantiles)]time.Duration
+	if len(ds) == 0 {
+		return ps, 0
+	}
+	sort.Slice(ds, func(i, j int) bool { return ds[i] < ds[j] })
+	for i, q := range traceQuantiles {
+		ps[i] = ds[int(q*float64(len(ds)-1)+0.5)]
+	}
+	return ps, len(ds)
+}
+
+func (t *cmdTraces) String() string {
+	var parts []string
+	for stage, name := range traceStageNames {
+		ps, n := t.percentiles(stage)
+		if n == 0 {
+			continue
+		}
+		parts = append(parts, fmt.Sprintf("%s p50 %v p90 %v p99 %v", name, ps[0], ps[1], ps[2]))
+	}
+	if len(parts) == 0 {
+		return "no traces"
+	}
+	return strings.Join(parts, ", ")
+}
+
+// setTraces keeps the percentiles for export
+func (b *brickMetrics) setTraces(t *cmdTraces) {
+	for stage := range traceStageNames {
+		ps, n := t.percentiles(stage)
+		for i, p := range ps {
+			atomic.StoreInt64(&b.traceNanos[stage][i], int64(p))
+		}
+		atomic.StoreInt64(&b.traceCounts[stage], int64(n))
+	}
+}
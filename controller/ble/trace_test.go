@@ -0,0 +1,68 @@
+package ble
+
+import (
+	"encoding/binary"
+	"testing"
+	"time"
+)
+
+func TestCmdTraces(t *testing.T) {
+	s := newBrickSync()
+	t0 := time.Unix(1000, 0)
+	p := s.probe(t0)
+	if err := s.answer(syncAnswer(binary.LittleEndian.Uint32(p), 5000), t0.Add(2*time.Millisecond)); err != nil {
+		t.Fatal(err)
+	}
+
+	tr := newCmdTraces()
+	ws, _, err := commandWrites([]cmdRecord{dimRecord(50)}, 7, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	sent := t0.Add(100 * time.Millisecond)
+	tr.sent(ws, sent)
+
+	ack := make([]byte, cmdAckLen+cmdTraceLen)
+	ack[0], ack[1] = cmdVersion, 7
+	ack[cmdAckLen] = 7
+	binary.LittleEndian.PutUint32(ack[cmdAckLen+1:], 5111)
+	binary.LittleEndian.PutUint16(ack[cmdAckLen+5:], 4)
+	k, err := parseCmdAck(ack)
+	if err != nil || k.trace == nil {
+		t.Fatalf("trace not parsed: %v", err)
+	}
+	if !tr.observe(*k.trace, s, sent.Add(30*time.Millisecond)) {
+		t.Fatal("trace not taken")
+	}
+	// The answer places the write at 5100 on the brick's clock, give or
+	// take the round trip and its whole ms
+	for stage, want := range map[int]time.Duration{traceLink: 10, traceBrick: 4, traceTotal: 14} {
+		ps, n := tr.percentiles(stage)
+		if d := ps[0] - want*time.Millisecond; n != 1 || d < -2*time.Millisecond || d > 2*time.Millisecond {
+			t.Errorf("%s: %v over %d", traceStageNames[stage], ps[0], n)
+		}
+	}
+
+	// Once only, and not for a write from before a reconnect
+	if tr.observe(*k.trace, s, sent.Add(time.Second)) {
+		t.Error("trace taken twice")
+	}
+	if tr.observe(cmdTrace{seq: 200}, s, sent) {
+		t.Error("unknown write traced")
+	}
+
+	// Without the clock placed, just the brick's part
+	tr.sent(ws, sent.Add(time.Hour))
+	tr.observe(*k.trace, newBrickSync(), sent.Add(time.Hour))
+	if _, n := tr.percentiles(traceBrick); n != 2 {
+		t.Errorf("%d brick traces", n)
+	}
+	if _, n := tr.percentiles(traceLink); n != 1 {
+		t.Errorf("%d link traces", n)
+	}
+
+	// Plain acks carry none
+	if k, _ := parseCmdAck(ack[:cmdAckLen]); k.trace != nil {
+		t.Error("trace in a plain ack")
+	}
+}
@@ -0,0 +1,247 @@
+package ble
+
+import (
+	"errors"
+	"fmt"
+	"sync"
+	"time"
+
+	"github.com/paypal/gatt"
+
+	"github.com/theatrus/ledbrick/controller/logging"
+)
+
+// The broadcast transmitter puts one advertisement on air at a time
+// from the first adapter, time sliced between the groups it sends. A
+// group's frames go out Burst times over when its levels change, then
+// again, freshly sequenced, every Keepalive while they don't, so a brick
+// that missed the change or came up since catches up. A change while a
+// burst is still going waits for it to end, the newest replacing any
+// already waiting, so a frame split over several advertisements always
+// lands whole.
+//
+// Each advertisement is held for a slot, at least one advertising event
+// as non-connectable advertising goes no faster than every 100 ms. A
+// brick scanning 50 ms of every 100 (broadcast.h) hears about half of
+// them, so a burst of 3 lands 7 times in 8. A group's levels can then
+// change at most once every Slot × frames × Burst: with the defaults, every 300 ms for up to 6 channels (3.3 updates a second)
+// and every 600 ms for 8 (1.7 a second), both inside the write
+// interval. Groups changing at once share that between them.
+// BenchmarkTransmitter measures the rate, and the controller's cost per
+// slot, under a microsecond.
+type BroadcastTiming struct {
+	// How long each advertisement is held
+	Slot time.Duration
+	// Times each change goes out
+	Burst int
+	// A group whose levels haven't changed is sent again this often
+	Keepalive time.Duration
+}
+
+var DefaultBroadcastTiming = BroadcastTiming{Slot: 100 * time.Millisecond, Burst: 3, Keepalive: 5 * time.Second}
+
+// The fastest non-connectable advertising goes, and plenty
+const (
+	minBroadcastSlot = 100 * time.Millisecond
+	maxBroadcastSlot = time.Second
+)
+
+var broadcastLog = logging.NewSampler(logging.Warn, time.Minute)
+
+func (t BroadcastTiming) validate() error {
+	switch {
+	case t.Slot < minBroadcastSlot || t.Slot > maxBroadcastSlot:
+		return fmt.Errorf("broadcast slot must be %v-%v, got %v", minBroadcastSlot, maxBroadcastSlot, t.Slot)
+	case t.Burst < 1:
+		return fmt.Errorf("broadcast burst must be at least 1, got %d", t.Burst)
+	case t.Keepalive < t.Slot:
+		return fmt.Errorf("broadcast keepalive must be at least a slot, got %v", t.Keepalive)
+	}
+	return nil
+}
+
+// One group sent, following a zone's levels
+type txGroup struct {
+	group uint8
+	// "" for the bricks in none
+	zone string
+	// The newest levels asked for, nil from a scene recall until the
+	// next, and whether they've gone out yet
+	levels     []int
+	durationMs int
+	dirty      bool
+	// Scene slot to recall next, -1 for none
+	scene int
+	// Frames on air, sends of them left and the next to send
+	frames [][]byte
+	left   int
+	next   int
+	// When its frames last went out in full
+	sent time.Time
+}
+
+type transmitter struct {
+	b      *broadcaster
+	timing BroadcastTiming
+	groups []*txGroup
+	// Group whose turn is next
+	turn int
+
+	lock sync.Mutex
+}
+
+func newTransmitter(b *broadcaster, t BroadcastTiming) *transmitter {
+	tx := &transmitter{b: b, timing: t}
+	tx.groups = append(tx.groups, &txGroup{group: b.group, scene: -1})
+	return tx
+}
+
+// follow sends group the levels of zone
+func (tx *transmitter) follow(zone string, group uint8) error {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	for _, g := range tx.groups {
+		if g.group == group {
+			return fmt.Errorf("broadcast group %d already follows zone %q", group, g.zone)
+		}
+	}
+	tx.groups = append(tx.groups, &txGroup{group: group, zone: zone, scene: -1})
+	return nil
+}
+
+func (tx *transmitter) setTiming(t BroadcastTiming) {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	tx.timing = t
+}
+
+func (tx *transmitter) slot() time.Duration {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	return tx.timing.Slot
+}
+
+// update has the groups following zone send levels, if they changed
+func (tx *transmitter) update(zone string, levels []int, durationMs int) {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	for _, g := range tx.groups {
+		if g.zone != zone || sameInts(g.levels, levels) {
+			continue
+		}
+		g.levels = append(g.levels[:0], levels...)
+		g.durationMs = durationMs
+		g.dirty = true
+	}
+}
+
+// scene has every group recall slot. Their levels aren't kept alive
+// until the next update, as they're the scene's now.
+func (tx *transmitter) scene(slot int) {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	for _, g := range tx.groups {
+		g.scene = slot
+		g.levels = nil
+		g.dirty = false
+	}
+}
+
+// start puts a group's next frames on air, if it has any due. Called
+// with tx.lock held.
+func (tx *transmitter) start(g *txGroup, now time.Time) bool {
+	switch {
+	case g.scene >= 0:
+		g.frames = [][]byte{tx.b.sceneFor(g.group, g.scene)}
+		g.scene = -1
+		g.left = tx.timing.Burst
+	case g.dirty:
+		g.frames = tx.b.packFor(g.group, g.levels, g.durationMs, broadcastMaxChannels)
+		g.dirty = false
+		g.left = tx.timing.Burst * len(g.frames)
+	case g.levels != nil && now.Sub(g.sent) >= tx.timing.Keepalive:
+		g.frames = tx.b.packFor(g.group, g.levels, g.durationMs, broadcastMaxChannels)
+		g.left = len(g.frames)
+	default:
+		return false
+	}
+	g.next = 0
+	return len(g.frames) > 0
+}
+
+// next is the payload to hold for the coming slot, taking the groups
+// with something to send in turn, nil to leave the last on air
+func (tx *transmitter) next(now time.Time) []byte {
+	tx.lock.Lock()
+	defer tx.lock.Unlock()
+	n := len(tx.groups)
+	for i := 0; i < n; i++ {
+		g := tx.groups[(tx.turn+i)%n]
+		if g.left == 0 && !tx.start(g, now) {
+			continue
+		}
+		f := g.frames[g.next%len(g.frames)]
+		g.next++
+		g.left--
+		if g.left == 0 {
+			g.sent = now
+		}
+		tx.turn = (tx.turn + i + 1) % n
+		return f
+	}
+	return nil
+}
+
+func sameInts(a, b []int) bool {
+	if a == nil || len(a) != len(b) {
+		return false
+	}
+	for i := range a {
+		if a[i] != b[i] {
+			return false
+		}
+	}
+	return true
+}
+
+// transmit advertises the transmitter's payloads, one a slot
+func (ble *bleChannel) transmit(tx *transmitter) {
+	for {
+		time.Sleep(tx.slot())
+		f := tx.next(time.Now())
+		if f == nil {
+			continue
+		}
+		a := &gatt.AdvPacket{}
+		a.AppendManufacturerData(broadcastCompanyID, f)
+		if err := ble.device.Advertise(a); err != nil {
+			broadcastLog.Log("advertise", "broadcast failed", logging.Err(err))
+		}
+	}
+}
+
+// BroadcastZone also broadcasts a zone's levels, to the bricks
+// following group
+func (ble *bleChannel) BroadcastZone(zone string, group uint8) error {
+	ble.lock.Lock()
+	tx := ble.tx
+	ble.lock.Unlock()
+	if tx == nil {
+		return errors.New("broadcasting a zone needs broadcast enabled")
+	}
+	return tx.follow(zone, group)
+}
+
+func (ble *bleChannel) SetBroadcastTiming(t BroadcastTiming) error {
+	if err := t.validate(); err != nil {
+		return err
+	}
+	ble.lock.Lock()
+	tx := ble.tx
+	ble.lock.Unlock()
+	if tx == nil {
+		return errors.New("broadcast timing needs broadcast enabled")
+	}
+	tx.setTiming(t)
+	return nil
+}
@@ -0,0 +1,168 @@
+package ble
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"testing"
+	"time"
+)
+
+func testTransmitter(t testing.TB) *transmitter {
+	b, err := newBroadcaster(3, bytes.Repeat([]byte{0x11}, 16))
+	if err != nil {
+		t.Fatal(err)
+	}
+	return newTransmitter(b, DefaultBroadcastTiming)
+}
+
+// sent is the group and sequence number of each of n slots, 0 for
+// those left alone
+func sent(tx *transmitter, now *time.Time, n int) [][2]uint32 {
+	var out [][2]uint32
+	for i := 0; i < n; i++ {
+		*now = now.Add(tx.timing.Slot)
+		f := tx.next(*now)
+		if f == nil {
+			out = append(out, [2]uint32{})
+			continue
+		}
+		out = append(out, [2]uint32{uint32(f[1]), binary.LittleEndian.Uint32(f[2:])})
+	}
+	return out
+}
+
+func TestTransmitterBurst(t *testing.T) {
+	tx := testTransmitter(t)
+	now := time.Unix(1000, 0)
+	levels := []int{0, 100, 200, 300, 400, 500, 600, 4000}
+
+	tx.update("", levels, 1000)
+	got := sent(tx, &now, 8)
+	want := [][2]uint32{{3, 1}, {3, 2}, {3, 1}, {3, 2}, {3, 1}, {3, 2}, {}, {}}
+	for i := range want {
+		if got[i] != want[i] {
+			t.Fatalf("burst slot %d sent %v, want %v", i, got[i], want[i])
+		}
+	}
+
+	// The same levels again aren't a change
+	tx.update("", levels, 1000)
+	if f := tx.next(now.Add(tx.timing.Slot)); f != nil {
+		t.Errorf("unchanged levels sent % x", f)
+	}
+
+	// A change mid-burst waits for it, the newest replacing any waiting
+	tx.update("", []int{1, 2, 3}, 1000)
+	got = sent(tx, &now, 1)
+	tx.update("", []int{4, 5, 6}, 1000)
+	tx.update("", []int{7, 8, 9}, 1000)
+	got = append(got, sent(tx, &now, 6)...)
+	want = [][2]uint32{{3, 3}, {3, 3}, {3, 3}, {3, 4}, {3, 4}, {3, 4}, {}}
+	for i := range want {
+		if got[i] != want[i] {
+			t.Fatalf("replaced slot %d sent %v, want %v", i, got[i], want[i])
+		}
+	}
+	if f := tx.next(now); f != nil {
+		t.Fatal("more after the burst")
+	}
+
+	// Then kept alive, freshly sequenced and once only
+	now = now.Add(tx.timing.Keepalive)
+	got = sent(tx, &now, 2)
+	if got[0] != [2]uint32{3, 5} || got[1] != [2]uint32{} {
+		t.Errorf("keepalive sent %v", got)
+	}
+	last := tx.groups[0].frames[0]
+	if level := binary.LittleEndian.Uint16(last[broadcastHeaderLen:]); level != 7 {
+		t.Errorf("keepalive level %d", level)
+	}
+}
+
+func TestTransmitterGroups(t *testing.T) {
+	tx := testTransmitter(t)
+	if err := tx.follow("tank", 4); err != nil {
+		t.Fatal(err)
+	}
+	if err := tx.follow("sump", 4); err == nil {
+		t.Error("group followed twice")
+	}
+	tx.timing.Burst = 2
+	now := time.Unix(1000, 0)
+
+	tx.update("", []int{1, 2}, 1000)
+	tx.update("tank", []int{3, 4}, 1000)
+	got := sent(tx, &now, 5)
+	// Taking turns, each with its own sequence number
+	want := [][2]uint32{{3, 1}, {4, 2}, {3, 1}, {4, 2}, {}}
+	for i := range want {
+		if got[i] != want[i] {
+			t.Fatalf("slot %d sent %v, want %v", i, got[i], want[i])
+		}
+	}
+
+	// A scene goes to every group, and their levels aren't kept after
+	tx.scene(2)
+	got = sent(tx, &now, 5)
+	for i, s := range got[:4] {
+		if s[0] != [2]uint32{3, 4}[i%2] {
+			t.Errorf("scene slot %d went to group %d", i, s[0])
+		}
+	}
+	if f := tx.groups[1].frames[0]; f[0] != broadcastSceneMagic || f[6] != 2 {
+		t.Errorf("scene frame % x", f)
+	}
+	now = now.Add(tx.timing.Keepalive)
+	if f := tx.next(now); f != nil {
+		t.Errorf("kept scene levels alive: % x", f)
+	}
+}
+
+func TestBroadcastTimingValidate(t *testing.T) {
+	if err := DefaultBroadcastTiming.validate(); err != nil {
+		t.Fatal(err)
+	}
+	for _, bad := range []BroadcastTiming{
+		{Slot: 10 * time.Millisecond, Burst: 3, Keepalive: time.Second},
+		{Slot: 100 * time.Millisecond, Burst: 0, Keepalive: time.Second},
+		{Slot: 100 * time.Millisecond, Burst: 1, Keepalive: 0},
+	} {
+		if bad.validate() == nil {
+			t.Errorf("%+v accepted", bad)
+		}
+	}
+}
+
+// BenchmarkTransmitter changes every group's 8 channels each slot and
+// reports the updates each group gets on air a second at the default
+// timing, along with the controller's cost per slot
+func BenchmarkTransmitter(b *testing.B) {
+	for _, groups := range []int{1, 3} {
+		b.Run(fmt.Sprintf("groups%d", groups), func(b *testing.B) {
+			tx := testTransmitter(b)
+			zones := []string{""}
+			for g := 1; g < groups; g++ {
+				zones = append(zones, fmt.Sprint(g))
+				tx.follow(zones[g], uint8(10+g))
+			}
+			levels := make([]int, frameChannels)
+			now := time.Unix(1000, 0)
+			frames := 0
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				levels[0] = i
+				for _, zone := range zones {
+					tx.update(zone, levels, 1000)
+				}
+				now = now.Add(tx.timing.Slot)
+				if tx.next(now) != nil {
+					frames++
+				}
+			}
+			perUpdate := frames / (2 * tx.timing.Burst * groups)
+			b.ReportMetric(float64(perUpdate)/(time.Duration(b.N)*tx.timing.Slot).Seconds(), "updates/s/group")
+		})
+	}
+}
@@ -0,0 +1,420 @@
+package ble
+
+import (
+	"log"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// ledState is the channel settings as of one write interval, with the
+// moment bricks that hold frames should apply them. Every brick's
+// writer shares it, so it is never changed once made.
+type ledState struct {
+	percents [frameChannels]float64
+	// Generation of the frame the settings came from
+	gen    uint64
+	syncAt time.Time
+	// Changes fade out to here on the bricks, when later than a write
+	// would take them (FadeOver)
+	fadeUntil time.Time
+	// As encoded for the bricks' writers so far, see encode.go
+	enc *frameEncodings
+}
+
+func newLedState(f *channelFrame, syncAt time.Time) *ledState {
+	return &ledState{percents: f.percents, gen: f.gen, syncAt: syncAt, enc: newFrameEncodings()}
+}
+
+// levels scales the first n settings to max
+func (s *ledState) levels(max, n int) []int {
+	levels := make([]int, n)
+	for channel, percent := range s.percents[:n] {
+		levels[channel] = int((percent / 100.0) * float64(max))
+	}
+	return levels
+}
+
+// levelCache is what a brick was last sent per channel, so only the
+// channels that moved need writing. Anything reported lost or rejected
+// makes it stale, and it is written out in full every refresh interval
+// in case a loss went unseen.
+type levelCache struct {
+	levels []int
+	// Frame generation the levels came from
+	gen       uint64
+	valid     bool
+	refreshed time.Time
+	// Brick output generation as of the last read back agreeing with
+	// levels, and whether nothing has been sent since (output.go)
+	brickGen uint32
+	checked  bool
+	// The levels are what the brick's own schedule has it at, not from
+	// a frame (curve.go)
+	predicted bool
+
+	lock sync.Mutex
+}
+
+// changed gives the mask of channels in levels to send as of now
+func (c *levelCache) changed(levels []int, now time.Time) uint16 {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if !c.valid || len(c.levels) != len(levels) || now.Sub(c.refreshed) >= fullRefreshInterval {
+		c.refreshed = now
+		return uint16(1)<<uint(len(levels)) - 1
+	}
+	var mask uint16
+	for channel, level := range levels {
+		if level != c.levels[channel] {
+			mask |= 1 << uint(channel)
+		}
+	}
+	return mask
+}
+
+// current is whether generation gen has gone out and isn't yet due a
+// refresh, so there's nothing to write
+func (c *levelCache) current(gen uint64, now time.Time) bool {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	return c.valid && !c.predicted && c.gen == gen && now.Sub(c.refreshed) < fullRefreshInterval
+}
+
+func (c *levelCache) sent(levels []int, gen uint64) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	c.levels = append(c.levels[:0], levels...)
+	c.gen = gen
+	c.valid = true
+	c.checked = false
+	c.predicted = false
+}
+
+// predict takes levels as worked out from the schedule the brick is
+// running, so taking it back over only sends the channels that differ.
+// Channels of the width past the schedule's are left as last sent, and
+// not knowing those it goes out in full.
+func (c *levelCache) predict(levels []int, width int, now time.Time) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	switch {
+	case len(levels) == width:
+		c.levels = append(c.levels[:0], levels...)
+	case len(levels) < width && c.valid && len(c.levels) == width:
+		copy(c.levels, levels)
+	default:
+		c.valid = false
+		c.checked = false
+		c.predicted = false
+		return
+	}
+	c.valid = true
+	c.refreshed = now
+	c.checked = false
+	c.predicted = true
+}
+
+// refreshDue is whether the next state goes out in full, not knowing
+// what the brick has
+func (c *levelCache) refreshDue(now time.Time) bool {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	return !c.valid || now.Sub(c.refreshed) >= fullRefreshInterval
+}
+
+// confirm takes levels as read back from the brick at its output
+// generation brickGen, putting off the refresh
+func (c *levelCache) confirm(levels []int, brickGen uint32, now time.Time) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	c.levels = append(c.levels[:0], levels...)
+	c.valid = true
+	c.refreshed = now
+	c.brickGen = brickGen
+	c.checked = true
+}
+
+// unchanged puts off the refresh if the brick is still at the output
+// generation last confirmed and nothing has been sent since
+func (c *levelCache) unchanged(brickGen uint32, now time.Time) bool {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if !c.valid || !c.checked || c.brickGen != brickGen {
+		return false
+	}
+	c.refreshed = now
+	return true
+}
+
+// invalidate has the next state written in full
+func (c *levelCache) invalidate() {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	c.valid = false
+	c.checked = false
+	c.predicted = false
+}
+
+// masked picks out the levels for the channels in mask, lowest first
+func masked(mask uint16, levels []int) []int {
+	var m []int
+	for channel, level := range levels {
+		if mask&(1<<uint(channel)) != 0 {
+			m = append(m, level)
+		}
+	}
+	return m
+}
+
+// stateQueue hands states to one brick's writer. It holds one: a brick
+// that falls behind skips to the newest state rather than working
+// through stale ones, and never holds up the others.
+type stateQueue struct {
+	c      chan *ledState
+	closed bool
+
+	lock sync.Mutex
+}
+
+func newStateQueue() *stateQueue {
+	return &stateQueue{c: make(chan *ledState, 1)}
+}
+
+// put queues s, returning whether it replaced one the writer hadn't
+// got to
+func (q *stateQueue) put(s *ledState) bool {
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	if q.closed {
+		return false
+	}
+	dropped := false
+	select {
+	case <-q.c:
+		dropped = true
+	default:
+	}
+	q.c <- s
+	return dropped
+}
+
+// close ends the writer once it has finished the state in hand
+func (q *stateQueue) close() {
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	if !q.closed {
+		q.closed = true
+		close(q.c)
+	}
+}
+
+// runWriter sends each state queued for the brick, on its own goroutine
+// so a slow brick only delays itself. Ends when the queue is closed.
+func (p *blePeriph) runWriter() {
+	for s := range p.states.c {
+		p.writeState(s)
+	}
+}
+
+// writeState sends the channels that moved since the last state, if
+// any did
+func (p *blePeriph) writeState(s *ledState) {
+	now := p.now()
+	if p.sentLevels.current(s.gen, now) || !p.lane.due(now) {
+		return
+	}
+	// Weaker links are written less often, see quality.go. The state is
+	// queued again each write interval until it goes.
+	spacing := p.quality.spacing(weakerRssi(int(atomic.LoadInt64(&p.metrics.rssi)),
+		int(atomic.LoadInt64(&p.metrics.linkRssi))))
+	fade := time.Duration(spacing) * writeInterval
+	atomic.StoreInt64(&p.metrics.writeSpacing, int64(spacing))
+	if spacing > 1 && now.Sub(p.lastWrite) < fade-writeInterval/2 {
+		return
+	}
+	if left := s.fadeUntil.Sub(now); left > fade {
+		fade = left
+	}
+	// A brick that can say what it has only gets what it's missing
+	if p.outputChar != nil && p.sentLevels.refreshDue(now) {
+		p.checkOutput(now)
+	}
+	levels := s.sharedLevels(ledMaxLevel, p.width())
+	mask := p.sentLevels.changed(levels, now)
+	if mask == 0 {
+		return
+	}
+	p.linkBusy()
+	start := time.Now()
+	err := p.sendLevels(s, mask, levels, fade, spacing == 1, now)
+	took := time.Since(start)
+	p.metrics.observeWrite(took, err)
+	p.quality.observe(took, err)
+	p.laneResult(err, now)
+	if err != nil {
+		p.sentLevels.invalidate()
+		return
+	}
+	p.lastWrite = now
+	p.sentLevels.sent(levels, s.gen)
+}
+
+// sendLevels writes the channels of s in mask, levels as scaled for the
+// brick, by the path settled at connect (caps.go), fading over fade.
+// Frames with a sync time ahead go synced when synced is set.
+func (p *blePeriph) sendLevels(s *ledState, mask uint16, levels []int, fade time.Duration, synced bool, now time.Time) error {
+	switch p.path {
+	case pathSynced:
+		// Rather than wait out a bulk transfer's reply, the frame goes as
+		// it is
+		if synced && now.Before(s.syncAt) && !p.bulk.busy() {
+			if at, ok := p.sync.at(s.syncAt, now); ok {
+				return p.writeSyncedFrame(at, s.packedFrame(mask, levels, fade)...)
+			}
+		}
+		fallthrough
+	case pathPacked:
+		return p.writePackedFrame(s.packedFrame(mask, levels, fade))
+	case pathFrames:
+		return p.writeFrame(s.frameWrites(mask, levels, fade))
+	case pathFades:
+		return p.writeFades(s.fadeWrites(mask, levels, fade))
+	}
+	if p.levels12Bit() {
+		return p.writeLevels(s.levelWrites(mask, levels, true))
+	}
+	return p.writeLevels(s.levelWrites(mask, s.sharedLevels(legacyMaxLevel, p.width()), false))
+}
+
+// Send the channels a frame write per frameWriteChannels, faded until
+// the next and each applied by the peripheral in one burst.
+func (p *blePeriph) writeFrame(bs [][]byte) error {
+	err := p.writeCommands(p.frameChar, bs)
+	if err != nil {
+		log.Printf("Frame send error: %s", err)
+	}
+	return err
+}
+
+func frameWrites(mask uint16, levels []int, fade time.Duration) [][]byte {
+	duration := int(fade / time.Millisecond)
+	var bs [][]byte
+	for _, m := range splitMask(mask, len(levels)) {
+		buf := make([]byte, 0, 4+2*frameWriteChannels)
+		buf = append(buf, byte(m), byte(m>>8), byte(duration), byte(duration>>8))
+		for _, level := range masked(m, levels) {
+			buf = append(buf, byte(level), byte(level>>8))
+		}
+		bs = append(bs, buf)
+	}
+	return bs
+}
+
+// Send the channels as one packed frame command. Each write is acked by
+// sequence number, so losses show up per write.
+func (p *blePeriph) writePackedFrame(frame []cmdRecord) error {
+	err := p.sendAt(prioSchedule, frame...)
+	if err != nil {
+		log.Printf("Frame send error: %s", err)
+	}
+	return err
+}
+
+// A write per channel, 8 bit unless the brick takes full levels
+func (p *blePeriph) writeLevels(bs [][]byte) error {
+	err := p.writeCommands(p.ledChar, bs)
+	if err != nil {
+		log.Printf("Command send error: %s", err)
+	}
+	return err
+}
+
+func levelWrites(mask uint16, levels []int, wide bool) [][]byte {
+	var bs [][]byte
+	for _, channel := range channelsIn(mask, len(levels)) {
+		if wide {
+			bs = append(bs, []byte{byte(channel), byte(levels[channel]), byte(levels[channel] >> 8)})
+		} else {
+			bs = append(bs, []byte{byte(channel), byte(levels[channel])})
+		}
+	}
+	return bs
+}
+
+// Send a packed frame to be applied at brick time at
+func (p *blePeriph) writeSyncedFrame(at uint32, frame ...cmdRecord) error {
+	err := p.sendCommandsAt(at, frame...)
+	if err != nil {
+		log.Printf("Synced frame send error: %s", err)
+	}
+	return err
+}
+
+// packedFrame is a record per frameWriteChannels, as 16 channel
+// fixtures take them
+func packedFrame(mask uint16, levels []int, fade time.Duration) []cmdRecord {
+	duration := int(fade / time.Millisecond)
+	var rs []cmdRecord
+	for _, m := range splitMask(mask, len(levels)) {
+		rs = append(rs, packedFrameRecord(m, duration, masked(m, levels)))
+	}
+	return rs
+}
+
+// Channels in one frame write or packed record, so each fits a write
+const frameWriteChannels = 8
+
+// splitMask is mask's channels below n, frameWriteChannels at a time,
+// leaving out the runs with none
+func splitMask(mask uint16, n int) []uint16 {
+	var ms []uint16
+	for first := 0; first < n; first += frameWriteChannels {
+		run := uint16(1)<<frameWriteChannels - 1
+		if m := mask & (run << uint(first)); m != 0 {
+			ms = append(ms, m)
+		}
+	}
+	return ms
+}
+
+func channelsIn(mask uint16, n int) []int {
+	var cs []int
+	for channel := 0; channel < n; channel++ {
+		if mask&(1<<uint(channel)) != 0 {
+			cs = append(cs, channel)
+		}
+	}
+	return cs
+}
+
+// Send each channel as a fade lasting until the next write, so the
+// peripheral ramps between updates instead of stepping.
+func (p *blePeriph) writeFades(bs [][]byte) error {
+	err := p.writeCommands(p.fadeChar, bs)
+	if err != nil {
+		log.Printf("Fade send error: %s", err)
+	}
+	return err
+}
+
+func fadeWrites(mask uint16, levels []int, fade time.Duration) [][]byte {
+	duration := int(fade / time.Millisecond)
+	var bs [][]byte
+	var buf []byte
+	channels := channelsIn(mask, len(levels))
+	for i, channel := range channels {
+		if buf == nil {
+			buf = make([]byte, 0, fadeRecordLen*fadeRecordsPerWrite)
+		}
+		level := levels[channel]
+		buf = append(buf, byte(channel),
+			byte(level), byte(level>>8),
+			byte(duration), byte(duration>>8))
+		if len(buf) == cap(buf) || i == len(channels)-1 {
+			bs = append(bs, buf)
+			buf = nil
+		}
+	}
+	return bs
+}
@@ -0,0 +1,176 @@
+package ble
+
+import (
+	"fmt"
+	"testing"
+	"time"
+)
+
+func TestLedStateLevels(t *testing.T) {
+	s := newLedState(&channelFrame{percents: [frameChannels]float64{0: 100, 3: 50}}, time.Time{})
+	l := s.levels(ledMaxLevel, defaultBrickChannels)
+	if len(l) != 8 || l[0] != ledMaxLevel || l[3] != ledMaxLevel/2 || l[7] != 0 {
+		t.Errorf("levels %v", l)
+	}
+}
+
+func TestPackedFrameSplit(t *testing.T) {
+	levels := make([]int, frameChannels)
+	rs := packedFrame(0x0101, levels, writeInterval)
+	if len(rs) != 2 || rs[0].value[0] != 0x01 || rs[0].value[1] != 0 || rs[1].value[0] != 0 || rs[1].value[1] != 0x01 {
+		t.Errorf("records %v", rs)
+	}
+	if ms := splitMask(0x00f0, defaultBrickChannels); len(ms) != 1 || ms[0] != 0x00f0 {
+		t.Errorf("masks %v", ms)
+	}
+	if _, _, err := commandWrites(packedFrame(0xffff, levels, writeInterval), 0, nil); err != nil {
+		t.Error(err)
+	}
+}
+
+func TestStateQueue(t *testing.T) {
+	q := newStateQueue()
+	a, b := &ledState{}, &ledState{}
+	if q.put(a) {
+		t.Error("first put dropped a state")
+	}
+	if !q.put(b) {
+		t.Error("second put didn't replace the first")
+	}
+	if s := <-q.c; s != b {
+		t.Error("writer got a stale state")
+	}
+	q.close()
+	q.close()
+	if q.put(a) {
+		t.Error("put after close")
+	}
+	if _, ok := <-q.c; ok {
+		t.Error("queue still open")
+	}
+}
+
+func TestLevelCache(t *testing.T) {
+	var c levelCache
+	now := time.Now()
+	a := []int{0, 10, 20, 30, 40, 50, 60, 70}
+	if m := c.changed(a, now); m != 0xff {
+		t.Errorf("first mask %#x, want everything", m)
+	}
+	c.sent(a, 1)
+	if !c.current(1, now.Add(time.Second)) || c.current(2, now) {
+		t.Error("current generation not tracked")
+	}
+	if m := c.changed(a, now.Add(time.Second)); m != 0 {
+		t.Errorf("unchanged mask %#x", m)
+	}
+	b := append([]int(nil), a...)
+	b[2], b[7] = 21, 71
+	m := c.changed(b, now.Add(time.Second))
+	if m != 0x84 {
+		t.Errorf("changed mask %#x, want 0x84", m)
+	}
+	if l := masked(m, b); len(l) != 2 || l[0] != 21 || l[1] != 71 {
+		t.Errorf("masked levels %v", l)
+	}
+	c.sent(b, 2)
+	if c.current(2, now.Add(fullRefreshInterval)) {
+		t.Error("current past the refresh interval")
+	}
+	if m := c.changed(b, now.Add(fullRefreshInterval)); m != 0xff {
+		t.Errorf("refresh mask %#x, want everything", m)
+	}
+	c.sent(b, 2)
+	c.invalidate()
+	if m := c.changed(b, now.Add(fullRefreshInterval+time.Second)); m != 0xff {
+		t.Errorf("mask after invalidate %#x, want everything", m)
+	}
+}
+
+func TestFrameCell(t *testing.T) {
+	var c frameCell
+	if f := c.load(); f.gen != 0 || f.percents[0] != 0 {
+		t.Errorf("empty cell %v", f)
+	}
+	c.update(func(percents *[frameChannels]float64) { percents[1] = 50 })
+	f := c.load()
+	c.update(func(percents *[frameChannels]float64) { percents[2] = 25 })
+	g := c.load()
+	if f.percents[2] != 0 || g.percents[1] != 50 || g.percents[2] != 25 || g.gen <= f.gen {
+		t.Errorf("frames %v then %v", f, g)
+	}
+}
+
+// The encode path for one brick's frame: levels, the changed mask, the
+// packed record and its numbered writes
+func BenchmarkEncodeFrame(b *testing.B) {
+	for _, changed := range []int{1, 8} {
+		b.Run(fmt.Sprintf("changed=%d", changed), func(b *testing.B) {
+			var c levelCache
+			acks := newCmdAcks()
+			s := &ledState{}
+			now := time.Now()
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				for ch := 0; ch < changed; ch++ {
+					s.percents[ch] = float64(i % 100)
+				}
+				levels := s.levels(ledMaxLevel, defaultBrickChannels)
+				mask := c.changed(levels, now)
+				if mask == 0 {
+					continue
+				}
+				if _, err := acks.writes(packedFrame(mask, levels, writeInterval)); err != nil {
+					b.Fatal(err)
+				}
+				c.sent(levels, uint64(i))
+			}
+		})
+	}
+}
+
+// One write interval's fan-out to every brick's queue
+func BenchmarkWriteLedState(b *testing.B) {
+	for _, bricks := range []int{1, 16, 64} {
+		b.Run(fmt.Sprintf("bricks=%d", bricks), func(b *testing.B) {
+			ble := &bleChannel{connectedPeriph: make(map[string]*blePeriph), zones: make(map[string]*zone)}
+			for i := 0; i < bricks; i++ {
+				ble.connectedPeriph[fmt.Sprint(i)] = &blePeriph{states: newStateQueue(), sentLevels: &levelCache{}}
+			}
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				ble.SetChannel(i%frameChannels, float64(i%100))
+				ble.writeLedState()
+				for _, p := range ble.connectedPeriph {
+					<-p.states.c
+				}
+			}
+		})
+	}
+}
+
+func TestLevelCacheConfirm(t *testing.T) {
+	var c levelCache
+	now := time.Now()
+	a := []int{0, 10, 20, 30, 40, 50, 60, 70}
+	if !c.refreshDue(now) || c.unchanged(0, now) {
+		t.Error("empty cache not due")
+	}
+	brick := append([]int(nil), a...)
+	brick[3] = 0
+	c.confirm(brick, 7, now)
+	if c.refreshDue(now) {
+		t.Error("due straight after a read back")
+	}
+	if m := c.changed(a, now); m != 0x08 {
+		t.Errorf("mask %#x, want only what the brick lacks", m)
+	}
+	later := now.Add(fullRefreshInterval)
+	if !c.refreshDue(later) || !c.unchanged(7, later) || c.refreshDue(later) {
+		t.Error("unmoved generation didn't put off the refresh")
+	}
+	c.sent(a, 1)
+	if c.unchanged(7, later) {
+		t.Error("unmoved generation trusted after a send")
+	}
+}
@@ -0,0 +1,242 @@
+package ble
+
+import (
+	"fmt"
+	"time"
+)
+
+// A zone is a named set of bricks run on their own channel settings and
+// schedule, so several tanks can share one controller. Its channels are
+// logical, mapped onto the physical channels of its bricks, so bricks
+// wired differently can follow the same table. Bricks in no zone follow
+// SetChannel and SetSchedule.
+type zone struct {
+	bricks map[string]bool
+	// Physical channel for each logical one
+	channels []int
+	// In the zone's channels
+	settings *frameCell
+	schedule *schedule
+}
+
+func newZone(bricks []string, channels []int) (*zone, error) {
+	if len(bricks) == 0 {
+		return nil, fmt.Errorf("zone has no bricks")
+	}
+	if channels == nil {
+		for physical := 0; physical < frameChannels; physical++ {
+			channels = append(channels, physical)
+		}
+	}
+	seen := make(map[int]bool)
+	for logical, physical := range channels {
+		if physical < 0 || physical >= frameChannels {
+			return nil, fmt.Errorf("zone channel %d maps to missing channel %d", logical, physical)
+		}
+		if seen[physical] {
+			return nil, fmt.Errorf("zone maps channel %d twice", physical)
+		}
+		seen[physical] = true
+	}
+	z := &zone{bricks: make(map[string]bool), channels: channels, settings: &frameCell{}}
+	for _, id := range bricks {
+		z.bricks[id] = true
+	}
+	return z, nil
+}
+
+// physical is the latest settings by brick channel, those mapped from
+// no logical channel off
+func (z *zone) physical() *channelFrame {
+	logical := z.settings.load()
+	f := &channelFrame{gen: logical.gen}
+	for channel, physical := range z.channels {
+		f.percents[physical] = logical.percents[channel]
+	}
+	return f
+}
+
+// physicalPoints maps a schedule in logical channels onto the brick's
+func (z *zone) physicalPoints(points []SchedulePoint) []SchedulePoint {
+	mapped := make([]SchedulePoint, len(points))
+	for i, p := range points {
+		// Out to the last channel the schedule sets, not every one a
+		// brick might have
+		width := 0
+		for logical, physical := range z.channels {
+			if logical < len(p.Percents) && physical >= width {
+				width = physical + 1
+			}
+		}
+		percents := make([]float64, width)
+		for logical, physical := range z.channels {
+			if logical < len(p.Percents) {
+				percents[physical] = p.Percents[logical]
+			}
+		}
+		mapped[i] = SchedulePoint{Minute: p.Minute, Percents: percents}
+	}
+	return mapped
+}
+
+// zoneOf is the zone brick id belongs to, if any. Called with ble.lock
+// held.
+func (ble *bleChannel) zoneOf(id string) (string, *zone) {
+	for name, z := range ble.zones {
+		if z.bricks[id] {
+			return name, z
+		}
+	}
+	return "", nil
+}
+
+// scheduleFor is the schedule brick id should run. Called with
+// ble.lock held.
+func (ble *bleChannel) scheduleFor(id string) *schedule {
+	if _, z := ble.zoneOf(id); z != nil {
+		return z.schedule
+	}
+	return ble.schedule
+}
+
+func (ble *bleChannel) SetZone(name string, bricks []string, channels []int) error {
+	if name == "" {
+		return fmt.Errorf("zones need a name")
+	}
+	z, err := newZone(bricks, channels)
+	if err != nil {
+		return fmt.Errorf("zone %s: %v", name, err)
+	}
+
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	for _, id := range bricks {
+		if other, _ := ble.zoneOf(id); other != "" && other != name {
+			return fmt.Errorf("zone %s: brick %s is already in zone %s", name, id, other)
+		}
+	}
+	if old := ble.zones[name]; old != nil {
+		z.settings = old.settings
+		z.schedule = old.schedule
+	}
+	ble.zones[name] = z
+	ble.thermalChanged()
+	return nil
+}
+
+// ZoneMap places one zone's bricks and channels, for SetZones
+type ZoneMap struct {
+	Bricks []string
+	// Brick channel for each of the zone's, nil for the same ones
+	Channels []int
+}
+
+func (ble *bleChannel) SetZones(zones map[string]ZoneMap) error {
+	made := make(map[string]*zone, len(zones))
+	owner := make(map[string]string)
+	for name, zm := range zones {
+		if name == "" {
+			return fmt.Errorf("zones need a name")
+		}
+		z, err := newZone(zm.Bricks, zm.Channels)
+		if err != nil {
+			return fmt.Errorf("zone %s: %v", name, err)
+		}
+		for _, id := range zm.Bricks {
+			if other, ok := owner[id]; ok {
+				return fmt.Errorf("brick %s is in zones %s and %s", id, other, name)
+			}
+			owner[id] = name
+		}
+		made[name] = z
+	}
+
+	ble.lock.Lock()
+	for name, z := range made {
+		if old := ble.zones[name]; old != nil {
+			z.settings = old.settings
+			z.schedule = old.schedule
+		}
+	}
+	before := make(map[string]string, len(ble.connectedPeriph))
+	for id := range ble.connectedPeriph {
+		before[id], _ = ble.zoneOf(id)
+	}
+	ble.zones = made
+	ble.thermalChanged()
+	// Bricks that changed zone are written in full, and take up their
+	// new zone's schedule
+	type move struct {
+		p *blePeriph
+		s *schedule
+	}
+	var moved []move
+	for id, p := range ble.connectedPeriph {
+		if name, _ := ble.zoneOf(id); name != before[id] {
+			p.sentLevels.invalidate()
+			if s := ble.scheduleFor(id); s != nil && p.scheduleChar != nil {
+				moved = append(moved, move{p, s})
+			}
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, m := range moved {
+		go ble.startSchedule(m.p, m.s)
+	}
+	return nil
+}
+
+func (ble *bleChannel) SetZoneChannel(name string, channel int, percent float64) error {
+	if name == "" {
+		return ble.SetChannel(channel, percent)
+	}
+	if percent < 0 || percent > 100 {
+		return fmt.Errorf("Out of range percent (0-100)")
+	}
+	ble.lock.Lock()
+	defer ble.lock.Unlock()
+	z := ble.zones[name]
+	if z == nil {
+		return fmt.Errorf("no zone %s", name)
+	}
+	if channel < 0 || channel >= len(z.channels) {
+		return fmt.Errorf("zone %s has channels 0-%d, got %d", name, len(z.channels)-1, channel)
+	}
+	z.settings.update(func(percents *[frameChannels]float64) {
+		percents[channel] = percent
+	})
+	return nil
+}
+
+func (ble *bleChannel) SetZoneSchedule(name string, loc *time.Location, points []SchedulePoint) error {
+	if name == "" {
+		return ble.SetSchedule(loc, points)
+	}
+	ble.lock.Lock()
+	z := ble.zones[name]
+	ble.lock.Unlock()
+	if z == nil {
+		return fmt.Errorf("no zone %s", name)
+	}
+	s, err := newSchedule(z.physicalPoints(points))
+	if err != nil {
+		return err
+	}
+
+	ble.lock.Lock()
+	z.schedule = s
+	ble.loc = loc
+	var periphs []*blePeriph
+	for id, p := range ble.connectedPeriph {
+		if z.bricks[id] && p.scheduleChar != nil {
+			periphs = append(periphs, p)
+		}
+	}
+	ble.lock.Unlock()
+
+	for _, p := range periphs {
+		go ble.startSchedule(p, s)
+	}
+	return nil
+}
@@ -0,0 +1,78 @@
+package ble
+
+import (
+	"testing"
+)
+
+func TestZone(t *testing.T) {
+	if _, err := newZone([]string{"a"}, []int{0, frameChannels}); err == nil {
+		t.Error("mapped past the brick's channels")
+	}
+	if _, err := newZone([]string{"a"}, []int{1, 1}); err == nil {
+		t.Error("mapped one channel twice")
+	}
+	if _, err := newZone(nil, nil); err == nil {
+		t.Error("made a zone with no bricks")
+	}
+
+	z, err := newZone([]string{"a"}, []int{3, 0})
+	if err != nil {
+		t.Fatal(err)
+	}
+	z.settings.update(func(percents *[frameChannels]float64) {
+		percents[0], percents[1] = 40, 60
+	})
+	if p := z.physical().percents; p[3] != 40 || p[0] != 60 || p[1] != 0 {
+		t.Errorf("physical %v", p)
+	}
+	points := z.physicalPoints([]SchedulePoint{{Minute: 10, Percents: []float64{40, 60}}})
+	if got := points[0].Percents; len(got) != 4 || got[3] != 40 || got[0] != 60 || got[1] != 0 {
+		t.Errorf("schedule %v", got)
+	}
+
+	ble := &bleChannel{zones: make(map[string]*zone)}
+	if err := ble.SetZone("reef", []string{"a", "b"}, nil); err != nil {
+		t.Fatal(err)
+	}
+	if err := ble.SetZone("frag", []string{"b"}, nil); err == nil {
+		t.Error("put a brick in two zones")
+	}
+	if name, _ := ble.zoneOf("a"); name != "reef" {
+		t.Errorf("brick a in zone %q", name)
+	}
+	if err := ble.SetZoneChannel("reef", frameChannels, 50); err == nil {
+		t.Error("set a channel past the zone's")
+	}
+	if err := ble.SetZoneChannel("", 2, 50); err != nil || ble.settings.load().percents[2] != 50 {
+		t.Errorf("default zone %v %v", err, ble.settings.load())
+	}
+}
+
+func TestSetZones(t *testing.T) {
+	ble := &bleChannel{zones: make(map[string]*zone), connectedPeriph: make(map[string]*blePeriph)}
+	if err := ble.SetZone("reef", []string{"a", "b"}, nil); err != nil {
+		t.Fatal(err)
+	}
+	ble.SetZoneChannel("reef", 0, 40)
+	// b moves to a new zone, reef keeps its settings
+	err := ble.SetZones(map[string]ZoneMap{
+		"reef": {Bricks: []string{"a"}},
+		"frag": {Bricks: []string{"b"}, Channels: []int{1}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if name, _ := ble.zoneOf("b"); name != "frag" {
+		t.Errorf("brick b in zone %q", name)
+	}
+	if ble.zones["reef"].settings.load().percents[0] != 40 {
+		t.Error("reef lost its settings")
+	}
+	err = ble.SetZones(map[string]ZoneMap{"reef": {Bricks: []string{"a"}}, "frag": {Bricks: []string{"a"}}})
+	if err == nil {
+		t.Error("put a brick in two zones")
+	}
+	if ble.SetZones(nil) != nil || len(ble.zones) != 0 {
+		t.Error("zones not cleared")
+	}
+}
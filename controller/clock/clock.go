@@ -0,0 +1,191 @@
+// Package clock is the time the controller runs on: the real one, or a
+// simulated one that only moves when told, so a day of schedules and
+// writes can be run through in seconds.
+package clock
+
+import (
+	"sort"
+	"sync"
+	"time"
+)
+
+type Clock interface {
+	Now() time.Time
+	// As the time package's
+	NewTimer(d time.Duration) Timer
+	NewTicker(d time.Duration) Ticker
+}
+
+type Timer interface {
+	C() <-chan time.Time
+	Stop() bool
+}
+
+type Ticker interface {
+	C() <-chan time.Time
+	Stop()
+}
+
+// Real is the system clock
+var Real Clock = realClock{}
+
+type realClock struct{}
+
+func (realClock) Now() time.Time                   { return time.Now() }
+func (realClock) NewTimer(d time.Duration) Timer   { return realTimer{time.NewTimer(d)} }
+func (realClock) NewTicker(d time.Duration) Ticker { return realTicker{time.NewTicker(d)} }
+
+type realTimer struct{ t *time.Timer }
+
+func (t realTimer) C() <-chan time.Time { return t.t.C }
+func (t realTimer) Stop() bool          { return t.t.Stop() }
+
+type realTicker struct{ t *time.Ticker }
+
+func (t realTicker) C() <-chan time.Time { return t.t.C }
+func (t realTicker) Stop()               { t.t.Stop() }
+
+// Sim is a clock that moves only when advanced. Its timers and tickers
+// fire in order as it passes them, each with the clock at its own time,
+// and like the time package's drop ticks nobody was ready for.
+type Sim struct {
+	now     time.Time
+	waiters []*simWaiter
+	// Signalled each time a timer or ticker is made
+	added *sync.Cond
+
+	lock sync.Mutex
+}
+
+type simWaiter struct {
+	s      *Sim
+	c      chan time.Time
+	at     time.Time
+	period time.Duration
+}
+
+// NewSim is a simulated clock reading start
+func NewSim(start time.Time) *Sim {
+	s := &Sim{now: start}
+	s.added = sync.NewCond(&s.lock)
+	return s
+}
+
+func (s *Sim) Now() time.Time {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	return s.now
+}
+
+func (s *Sim) add(d, period time.Duration) *simWaiter {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	w := &simWaiter{s: s, c: make(chan time.Time, 1), at: s.now.Add(d), period: period}
+	if d <= 0 {
+		// Already due
+		w.c <- s.now
+		return w
+	}
+	s.waiters = append(s.waiters, w)
+	s.added.Broadcast()
+	return w
+}
+
+func (s *Sim) NewTimer(d time.Duration) Timer {
+	return simTimer{s.add(d, 0)}
+}
+
+func (s *Sim) NewTicker(d time.Duration) Ticker {
+	if d <= 0 {
+		panic("clock: non-positive ticker interval")
+	}
+	return simTicker{s.add(d, d)}
+}
+
+// remove drops w, returning whether it was still waiting. Called with
+// s.lock held.
+func (s *Sim) remove(w *simWaiter) bool {
+	for i, o := range s.waiters {
+		if o == w {
+			s.waiters = append(s.waiters[:i], s.waiters[i+1:]...)
+			return true
+		}
+	}
+	return false
+}
+
+type simTimer struct{ w *simWaiter }
+
+func (t simTimer) C() <-chan time.Time { return t.w.c }
+func (t simTimer) Stop() bool {
+	t.w.s.lock.Lock()
+	defer t.w.s.lock.Unlock()
+	return t.w.s.remove(t.w)
+}
+
+type simTicker struct{ w *simWaiter }
+
+func (t simTicker) C() <-chan time.Time { return t.w.c }
+func (t simTicker) Stop() {
+	t.w.s.lock.Lock()
+	defer t.w.s.lock.Unlock()
+	t.w.s.remove(t.w)
+}
+
+// fireNext fires the first timer or ticker due by until, returning
+// false if none is. Called with s.lock held.
+func (s *Sim) fireNext(until time.Time) bool {
+	if len(s.waiters) == 0 {
+		return false
+	}
+	sort.SliceStable(s.waiters, func(i, j int) bool { return s.waiters[i].at.Before(s.waiters[j].at) })
+	w := s.waiters[0]
+	if w.at.After(until) {
+		return false
+	}
+	s.now = w.at
+	select {
+	case w.c <- s.now:
+	default:
+	}
+	if w.period > 0 {
+		w.at = w.at.Add(w.period)
+	} else {
+		s.waiters = s.waiters[1:]
+	}
+	return true
+}
+
+// Advance moves the clock on by d, firing what falls due on the way
+func (s *Sim) Advance(d time.Duration) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	until := s.now.Add(d)
+	for s.fireNext(until) {
+	}
+	s.now = until
+}
+
+// Next moves the clock to the first timer or ticker and fires it,
+// returning false if there are none
+func (s *Sim) Next() bool {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	var first time.Time
+	for i, w := range s.waiters {
+		if i == 0 || w.at.Before(first) {
+			first = w.at
+		}
+	}
+	return len(s.waiters) > 0 && s.fireNext(first)
+}
+
+// BlockUntil waits for n timers and tickers to be waiting, so a test
+// knows the goroutines it drives have come round again
+func (s *Sim) BlockUntil(n int) {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	for len(s.waiters) < n {
+		s.added.Wait()
+	}
+}
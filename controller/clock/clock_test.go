@@ -0,0 +1,61 @@
+package clock
+
+import (
+	"testing"
+	"time"
+)
+
+func TestSim(t *testing.T) {
+	start := time.Date(2016, 1, 1, 0, 0, 0, 0, time.UTC)
+	s := NewSim(start)
+	ticker := s.NewTicker(time.Second)
+	timer := s.NewTimer(1500 * time.Millisecond)
+	stopped := s.NewTimer(time.Second)
+	if !stopped.Stop() {
+		t.Error("waiting timer didn't stop")
+	}
+
+	s.Advance(time.Second)
+	if at := <-ticker.C(); !at.Equal(start.Add(time.Second)) {
+		t.Errorf("ticked at %v", at)
+	}
+	s.Advance(time.Second)
+	if at := <-timer.C(); !at.Equal(start.Add(1500 * time.Millisecond)) {
+		t.Errorf("timer fired at %v", at)
+	}
+	// Ticks nobody took are dropped
+	s.Advance(10 * time.Second)
+	if at := <-ticker.C(); !at.Equal(start.Add(2 * time.Second)) {
+		t.Errorf("ticked at %v", at)
+	}
+	select {
+	case at := <-ticker.C():
+		t.Errorf("second tick at %v", at)
+	case <-stopped.C():
+		t.Error("stopped timer fired")
+	default:
+	}
+	if !s.Now().Equal(start.Add(12 * time.Second)) {
+		t.Errorf("now %v", s.Now())
+	}
+
+	ticker.Stop()
+	if s.Next() {
+		t.Error("fired with nothing waiting")
+	}
+	done := make(chan bool)
+	go func() {
+		s.BlockUntil(1)
+		done <- s.Next()
+	}()
+	later := s.NewTimer(time.Hour)
+	if !<-done {
+		t.Error("nothing fired")
+	}
+	if at := <-later.C(); !at.Equal(start.Add(12*time.Second + time.Hour)) {
+		t.Errorf("timer fired at %v", at)
+	}
+	if timer.Stop() || later.Stop() {
+		t.Error("fired timers stopped")
+	}
+}
@@ -0,0 +1,54 @@
+// Package diag serves what's needed to see where the controller's time
+// goes on the board it runs on, without a rebuild: the net/http/pprof
+// profiles, execution traces, and runtime counters in the Prometheus
+// text format. It's opt in, as a profile or trace costs CPU while it
+// runs.
+package diag
+
+import (
+	"fmt"
+	"io"
+	"net/http"
+	"net/http/pprof"
+	"runtime"
+	"time"
+)
+
+// Handler serves the profiles on /debug/pprof/, a trace of the next
+// few seconds on /debug/pprof/trace?seconds=N, and the runtime counters
+// on /debug/runtime
+func Handler() http.Handler {
+	mux := http.NewServeMux()
+	mux.HandleFunc("/debug/pprof/", pprof.Index)
+	mux.HandleFunc("/debug/pprof/cmdline", pprof.Cmdline)
+	mux.HandleFunc("/debug/pprof/profile", pprof.Profile)
+	mux.HandleFunc("/debug/pprof/symbol", pprof.Symbol)
+	mux.HandleFunc("/debug/pprof/trace", pprof.Trace)
+	mux.HandleFunc("/debug/runtime", func(w http.ResponseWriter, r *http.Request) {
+		w.Header().Set("Content-Type", "text/plain; version=0.0.4")
+		WriteRuntimeMetrics(w)
+	})
+	return mux
+}
+
+// WriteRuntimeMetrics writes the goroutine, heap and GC counters. Reading
+// them stops the world for a moment, so they're read when asked for.
+func WriteRuntimeMetrics(w io.Writer) {
+	var m runtime.MemStats
+	runtime.ReadMemStats(&m)
+	gauge := func(name, help string, v float64) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s gauge\n%s %g\n", name, help, name, name, v)
+	}
+	counter := func(name, help string, v float64) {
+		fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s counter\n%s %g\n", name, help, name, name, v)
+	}
+	gauge("ledbrick_goroutines", "Goroutines running", float64(runtime.NumGoroutine()))
+	gauge("ledbrick_heap_bytes", "Bytes of live and not yet swept heap objects", float64(m.HeapAlloc))
+	gauge("ledbrick_heap_objects", "Heap objects allocated and not yet freed", float64(m.HeapObjects))
+	gauge("ledbrick_sys_bytes", "Bytes obtained from the OS", float64(m.Sys))
+	counter("ledbrick_alloc_bytes_total", "Bytes allocated on the heap", float64(m.TotalAlloc))
+	counter("ledbrick_gc_runs_total", "Garbage collections finished", float64(m.NumGC))
+	counter("ledbrick_gc_pause_seconds_total", "Time the world was stopped for garbage collection",
+		time.Duration(m.PauseTotalNs).Seconds())
+	gauge("ledbrick_gc_cpu_fraction", "Fraction of CPU time spent in garbage collection", m.GCCPUFraction)
+}
@@ -0,0 +1,22 @@
+package diag
+
+import (
+	"net/http/httptest"
+	"strings"
+	"testing"
+)
+
+func TestHandler(t *testing.T) {
+	h := Handler()
+	for path, want := range map[string]string{
+		"/debug/runtime":      "ledbrick_goroutines ",
+		"/debug/pprof/":       "goroutine",
+		"/debug/pprof/symbol": "num_symbols",
+	} {
+		w := httptest.NewRecorder()
+		h.ServeHTTP(w, httptest.NewRequest("GET", path, nil))
+		if w.Code != 200 || !strings.Contains(w.Body.String(), want) {
+			t.Errorf("%s: %d %q", path, w.Code, w.Body.String())
+		}
+	}
+}
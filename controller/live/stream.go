@@ -0,0 +1,289 @@
+// Package live streams the controller's state to dashboards as
+// server-sent events: a snapshot on connecting, then each change to a
+// brick's telemetry or a zone's channel levels as a diff. One sampler
+// makes and encodes each diff once into a shared ring of events, and
+// every viewer copies the same bytes out of it, so many viewers cost
+// little more than one. A viewer that falls behind the ring, or
+// reconnects past it, starts over from a snapshot.
+package live
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"log"
+	"net/http"
+	"strconv"
+	"sync"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+const (
+	// Events kept for viewers catching up
+	ringLen = 64
+	// Comment lines keeping idle connections open through proxies
+	keepalive = 15 * time.Second
+)
+
+// Bricks gives the connected bricks, ble.BLEChannel does
+type Bricks interface {
+	Perhipherals() []ble.BLEPeripheral
+}
+
+// Levels gives each zone's channel percents, ltable.LightDriver does
+type Levels interface {
+	Levels() map[string][]float64
+}
+
+// brick is one brick's telemetry, as it goes out
+type brick struct {
+	Active       bool    `json:"active"`
+	TemperatureC float64 `json:"c"`
+	FanRpm       int     `json:"rpm"`
+	FanDuty      int     `json:"fan_duty"`
+	Derate       int     `json:"derate"`
+	Errors       uint8   `json:"errors"`
+	Lost         int     `json:"lost"`
+}
+
+// state is everything streamed. In a diff, a brick or zone that went
+// away is null.
+type state struct {
+	At     int64                `json:"at"`
+	Bricks map[string]*brick    `json:"bricks,omitempty"`
+	Levels map[string][]float64 `json:"levels,omitempty"`
+}
+
+// event is one encoded SSE event
+type event struct {
+	seq  uint64
+	data []byte
+}
+
+type Stream struct {
+	bricks   Bricks
+	levels   Levels
+	interval time.Duration
+	stop     chan struct{}
+
+	// Last sampled, and its snapshot event once a viewer needed it
+	last     state
+	snapshot *event
+	// The newest ringLen events, seq running on from 1
+	ring []event
+	seq  uint64
+	// Closed and replaced on each new event
+	notify  chan struct{}
+	viewers int
+
+	lock sync.Mutex
+}
+
+func NewStream(bricks Bricks, levels Levels, interval time.Duration) *Stream {
+	return &Stream{bricks: bricks, levels: levels, interval: interval,
+		stop:   make(chan struct{}),
+		notify: make(chan struct{}),
+	}
+}
+
+// Start samples the state every interval until Stop
+func (s *Stream) Start() {
+	go func() {
+		t := time.NewTicker(s.interval)
+		defer t.Stop()
+		for {
+			select {
+			case <-s.stop:
+				return
+			case now := <-t.C:
+				s.sample(now)
+			}
+		}
+	}()
+}
+
+func (s *Stream) Stop() {
+	close(s.stop)
+}
+
+// Viewers is how many are connected
+func (s *Stream) Viewers() int {
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	return s.viewers
+}
+
+func (s *Stream) read(now time.Time) state {
+	st := state{At: now.Unix(), Bricks: make(map[string]*brick), Levels: s.levels.Levels()}
+	for _, p := range s.bricks.Perhipherals() {
+		st.Bricks[p.ID()] = &brick{Active: p.Active(), TemperatureC: p.TemperatureC(),
+			FanRpm: p.FanRPM(), FanDuty: p.FanDuty(), Derate: p.Derate(),
+			Errors: p.Errors(), Lost: p.LostCommands()}
+	}
+	return st
+}
+
+// sample reads the state and publishes what changed, if anything did
+func (s *Stream) sample(now time.Time) {
+	next := s.read(now)
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	d, changed := diff(s.last, next)
+	s.last = next
+	if !changed {
+		return
+	}
+	s.seq++
+	if s.viewers == 0 {
+		// Nobody to tell, a viewer starts from a snapshot anyway
+		s.ring = s.ring[:0]
+		s.snapshot = nil
+		return
+	}
+	ev := event{seq: s.seq, data: encode(s.seq, "diff", d)}
+	if len(s.ring) == ringLen {
+		s.ring = append(s.ring[:0], s.ring[1:]...)
+	}
+	s.ring = append(s.ring, ev)
+	s.snapshot = nil
+	close(s.notify)
+	s.notify = make(chan struct{})
+}
+
+// diff is what moved from last to next
+func diff(last, next state) (state, bool) {
+	d := state{At: next.At, Bricks: make(map[string]*brick), Levels: make(map[string][]float64)}
+	for id, b := range next.Bricks {
+		if l, ok := last.Bricks[id]; !ok || *l != *b {
+			d.Bricks[id] = b
+		}
+	}
+	for id := range last.Bricks {
+		if _, ok := next.Bricks[id]; !ok {
+			d.Bricks[id] = nil
+		}
+	}
+	for zone, percents := range next.Levels {
+		if !sameLevels(last.Levels[zone], percents) {
+			d.Levels[zone] = percents
+		}
+	}
+	for zone := range last.Levels {
+		if _, ok := next.Levels[zone]; !ok {
+			d.Levels[zone] = nil
+		}
+	}
+	return d, len(d.Bricks) > 0 || len(d.Levels) > 0
+}
+
+func sameLevels(a, b []float64) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	for i := range a {
+		if a[i] != b[i] {
+			return false
+		}
+	}
+	return true
+}
+
+func encode(seq uint64, name string, v interface{}) []byte {
+	data, err := json.Marshal(v)
+	if err != nil {
+		log.Printf("Live %s: %v", name, err)
+		data = []byte("{}")
+	}
+	var b bytes.Buffer
+	fmt.Fprintf(&b, "id: %d\nevent: %s\ndata: %s\n\n", seq, name, data)
+	return b.Bytes()
+}
+
+// since is the events after seq, or the snapshot when they're no
+// longer all in the ring, with the channel closed on the next. Called
+// with s.lock held.
+func (s *Stream) since(seq uint64) ([][]byte, uint64, chan struct{}) {
+	if seq == s.seq {
+		return nil, seq, s.notify
+	}
+	if len(s.ring) > 0 && seq+1 >= s.ring[0].seq && seq < s.seq {
+		var out [][]byte
+		for _, ev := range s.ring[seq+1-s.ring[0].seq:] {
+			out = append(out, ev.data)
+		}
+		return out, s.seq, s.notify
+	}
+	if s.snapshot == nil || s.snapshot.seq != s.seq {
+		s.snapshot = &event{seq: s.seq, data: encode(s.seq, "snapshot", s.last)}
+	}
+	return [][]byte{s.snapshot.data}, s.seq, s.notify
+}
+
+// Handler serves the stream, GET only:
+//
+//	event: snapshot    {"at": ..., "bricks": {"<id>": {...}}, "levels": {"<zone>": [...]}}
+//	event: diff        the same, with only what changed and null for what went away
+//
+// A viewer reconnecting with Last-Event-ID gets the diffs it missed if
+// they're still held, else a snapshot.
+func (s *Stream) Handler() http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		if r.Method != http.MethodGet {
+			http.Error(w, "GET only", http.StatusMethodNotAllowed)
+			return
+		}
+		flusher, ok := w.(http.Flusher)
+		if !ok {
+			http.Error(w, "streaming unsupported", http.StatusInternalServerError)
+			return
+		}
+		w.Header().Set("Content-Type", "text/event-stream")
+		w.Header().Set("Cache-Control", "no-cache")
+
+		now := s.read(time.Now())
+		s.lock.Lock()
+		if s.viewers == 0 {
+			// Diffs weren't kept while nobody watched
+			s.last = now
+		}
+		s.viewers++
+		seq := ^uint64(0)
+		if id, err := strconv.ParseUint(r.Header.Get("Last-Event-ID"), 10, 64); err == nil {
+			seq = id
+		}
+		s.lock.Unlock()
+		defer func() {
+			s.lock.Lock()
+			s.viewers--
+			s.lock.Unlock()
+		}()
+
+		ping := time.NewTicker(keepalive)
+		defer ping.Stop()
+		for {
+			s.lock.Lock()
+			out, next, notify := s.since(seq)
+			s.lock.Unlock()
+			seq = next
+			for _, b := range out {
+				if _, err := w.Write(b); err != nil {
+					return
+				}
+			}
+			flusher.Flush()
+			select {
+			case <-r.Context().Done():
+				return
+			case <-s.stop:
+				return
+			case <-notify:
+			case <-ping.C:
+				if _, err := w.Write([]byte(": ping\n\n")); err != nil {
+					return
+				}
+			}
+		}
+	})
+}
@@ -0,0 +1,132 @@
+package live
+
+import (
+	"bufio"
+	"net/http"
+	"net/http/httptest"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+type fakeBrick struct {
+	ble.BLEPeripheral
+	id   string
+	temp float64
+}
+
+func (b *fakeBrick) ID() string            { return b.id }
+func (b *fakeBrick) Active() bool          { return true }
+func (b *fakeBrick) TemperatureC() float64 { return b.temp }
+func (b *fakeBrick) FanRPM() int           { return 1200 }
+func (b *fakeBrick) FanDuty() int          { return 40 }
+func (b *fakeBrick) Derate() int           { return 100 }
+func (b *fakeBrick) Errors() uint8         { return 0 }
+func (b *fakeBrick) LostCommands() int     { return 0 }
+
+type fakeState struct {
+	bricks []ble.BLEPeripheral
+	levels map[string][]float64
+
+	lock sync.Mutex
+}
+
+func (f *fakeState) Perhipherals() []ble.BLEPeripheral {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	return f.bricks
+}
+func (f *fakeState) Levels() map[string][]float64 {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	return f.levels
+}
+
+func TestDiff(t *testing.T) {
+	a := state{Bricks: map[string]*brick{"a": {TemperatureC: 30}, "b": {}},
+		Levels: map[string][]float64{"": {10, 20}}}
+	b := state{Bricks: map[string]*brick{"a": {TemperatureC: 31}},
+		Levels: map[string][]float64{"": {10, 20}, "reef": {5}}}
+	d, changed := diff(a, b)
+	if !changed || d.Bricks["a"].TemperatureC != 31 || d.Bricks["b"] != nil || len(d.Bricks) != 2 ||
+		len(d.Levels) != 1 || d.Levels["reef"][0] != 5 {
+		t.Errorf("diff %+v", d)
+	}
+	if _, changed := diff(b, b); changed {
+		t.Error("unchanged state made a diff")
+	}
+}
+
+func TestSince(t *testing.T) {
+	a := &fakeBrick{id: "a", temp: 30}
+	f := &fakeState{bricks: []ble.BLEPeripheral{a}, levels: map[string][]float64{"": {10}}}
+	s := NewStream(f, f, time.Second)
+	s.viewers = 1
+	for i := 0; i < ringLen+2; i++ {
+		a.temp++
+		s.sample(time.Unix(int64(i), 0))
+	}
+	if out, seq, _ := s.since(s.seq - 2); len(out) != 2 || seq != s.seq || !strings.Contains(string(out[0]), "event: diff") {
+		t.Errorf("caught up with %q", out)
+	}
+	// Past the ring, and new, both start from one shared snapshot
+	out, _, _ := s.since(1)
+	again, _, _ := s.since(^uint64(0))
+	if len(out) != 1 || !strings.Contains(string(out[0]), "event: snapshot") || &out[0][0] != &again[0][0] {
+		t.Errorf("behind the ring %q", out)
+	}
+	if out, _, notify := s.since(s.seq); out != nil {
+		t.Errorf("up to date got %q", out)
+	} else {
+		s.sample(time.Unix(100, 0))
+		select {
+		case <-notify:
+			t.Error("woken with nothing new")
+		default:
+		}
+		a.temp++
+		s.sample(time.Unix(101, 0))
+		<-notify
+	}
+}
+
+func TestHandler(t *testing.T) {
+	a := &fakeBrick{id: "a", temp: 30}
+	f := &fakeState{bricks: []ble.BLEPeripheral{a}, levels: map[string][]float64{"": {10}}}
+	s := NewStream(f, f, time.Second)
+	defer s.Stop()
+	srv := httptest.NewServer(s.Handler())
+	defer srv.Close()
+	resp, err := http.Get(srv.URL)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer resp.Body.Close()
+	r := bufio.NewReader(resp.Body)
+	next := func() string {
+		var ev []string
+		for {
+			line, err := r.ReadString('\n')
+			if err != nil {
+				t.Fatal(err)
+			}
+			if line == "\n" {
+				return strings.Join(ev, "")
+			}
+			ev = append(ev, line)
+		}
+	}
+	if ev := next(); !strings.Contains(ev, "event: snapshot") || !strings.Contains(ev, `"c":30`) {
+		t.Errorf("first %q", ev)
+	}
+	f.lock.Lock()
+	f.levels = map[string][]float64{"": {20}}
+	f.lock.Unlock()
+	s.sample(time.Unix(1, 0))
+	if ev := next(); !strings.Contains(ev, "event: diff") || !strings.Contains(ev, `"levels":{"":[20]}`) || strings.Contains(ev, "bricks") {
+		t.Errorf("diff %q", ev)
+	}
+}
@@ -0,0 +1,96 @@
+// Command loadtest runs the controller's writers against simulated
+// bricks and reports how long level updates take to reach them, or
+// replays a session recorded with ledbrick -record and reports what the
+// controller did with it.
+package main
+
+import (
+	"flag"
+	"fmt"
+	"github.com/theatrus/ledbrick/controller/ble"
+	"io/ioutil"
+	"log"
+	"net/http"
+	"os"
+	"time"
+)
+
+var bricks = flag.Int("bricks", 100, "Simulated bricks")
+var interval = flag.Duration("interval", 30*time.Millisecond, "Connection interval of each brick")
+var latency = flag.Duration("latency", 5*time.Millisecond, "From a connection event to the brick applying a write")
+var loss = flag.Float64("loss", 0, "Fraction of writes lost (0-1)")
+var telemetry = flag.Duration("telemetry", time.Second, "Between each brick's telemetry notifications, 0 for none")
+var updates = flag.Int("updates", 50, "Level updates to send")
+var every = flag.Duration("every", 200*time.Millisecond, "Between updates")
+var metricsAddr = flag.String("metrics", "", "Serve the simulated bricks' Prometheus metrics on /metrics at this address")
+var replay = flag.String("replay", "", "Replay this recorded session instead of simulating bricks")
+var speed = flag.Float64("speed", 1, "Replay this many times as fast as recorded")
+var verbose = flag.Bool("v", false, "Log what the controller logs")
+
+func main() {
+	flag.Parse()
+	if !*verbose {
+		log.SetOutput(ioutil.Discard)
+	}
+	if *replay != "" {
+		runReplay()
+		return
+	}
+	sc := ble.NewSimChannel(ble.SimConfig{Bricks: *bricks,
+		ConnectionInterval: *interval,
+		Latency:            *latency,
+		Loss:               *loss,
+		TelemetryInterval:  *telemetry,
+	})
+	defer sc.Close()
+	serveMetrics(sc)
+	fmt.Println(sc.LoadTest(*updates, *every, *interval+*latency))
+}
+
+func serveMetrics(ch ble.BLEChannel) {
+	if *metricsAddr == "" {
+		return
+	}
+	mux := http.NewServeMux()
+	mux.Handle("/metrics", ch.MetricsHandler())
+	go func() {
+		fmt.Println(http.ListenAndServe(*metricsAddr, mux))
+	}()
+}
+
+// runReplay replays the recording, setting a new level every interval
+// as the load test does, until it has played out
+func runReplay() {
+	f, err := os.Open(*replay)
+	if err != nil {
+		fmt.Println(err)
+		os.Exit(1)
+	}
+	rec, err := ble.ReadRecording(f)
+	f.Close()
+	if err != nil {
+		fmt.Println(err)
+		os.Exit(1)
+	}
+	rc, err := rec.Replay(*speed)
+	if err != nil {
+		fmt.Println(err)
+		os.Exit(1)
+	}
+	defer rc.Close()
+	serveMetrics(rc)
+	finished := make(chan ble.ReplayReport)
+	go func() { finished <- rc.Wait() }()
+	t := time.NewTicker(*every)
+	defer t.Stop()
+	for u := 0; ; u++ {
+		select {
+		case r := <-finished:
+			fmt.Println(r)
+			return
+		case <-t.C:
+			rc.SetChannel(0, float64(1+u%99))
+			rc.Flush()
+		}
+	}
+}
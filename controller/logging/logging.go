@@ -0,0 +1,241 @@
+// Package logging is leveled key=value logging for the controller's
+// busy paths, on top of the standard logger. Fields are typed, so a
+// call at a disabled level costs a comparison and allocates nothing.
+// Sampler and Summary thin out what is logged all the time: a line per
+// key per interval, or one summary line per key per interval.
+package logging
+
+import (
+	"flag"
+	"fmt"
+	"log"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+type Level int32
+
+const (
+	Debug Level = iota
+	Info
+	Warn
+	Error
+)
+
+var levelNames = [...]string{"debug", "info", "warn", "error"}
+
+func (l Level) String() string {
+	if l >= 0 && int(l) < len(levelNames) {
+		return levelNames[l]
+	}
+	return "level" + strconv.Itoa(int(l))
+}
+
+func ParseLevel(s string) (Level, error) {
+	for l, name := range levelNames {
+		if strings.EqualFold(s, name) {
+			return Level(l), nil
+		}
+	}
+	return Info, fmt.Errorf("log level must be debug, info, warn or error, got %q", s)
+}
+
+var minLevel = int32(Info)
+
+func SetLevel(l Level) { atomic.StoreInt32(&minLevel, int32(l)) }
+
+func (l Level) Enabled() bool { return int32(l) >= atomic.LoadInt32(&minLevel) }
+
+type levelFlag struct{}
+
+func (levelFlag) String() string { return Level(atomic.LoadInt32(&minLevel)).String() }
+func (levelFlag) Set(s string) error {
+	l, err := ParseLevel(s)
+	if err == nil {
+		SetLevel(l)
+	}
+	return err
+}
+
+func init() {
+	flag.Var(levelFlag{}, "log-level", "Log at this level and above: debug, info, warn or error")
+}
+
+type fieldKind uint8
+
+const (
+	kindString fieldKind = iota
+	kindInt
+	kindFloat
+	kindError
+)
+
+// Field is one key=value on a line
+type Field struct {
+	key  string
+	kind fieldKind
+	s    string
+	i    int64
+	f    float64
+	err  error
+}
+
+func Str(key, value string) Field       { return Field{key: key, kind: kindString, s: value} }
+func Int(key string, value int) Field   { return Field{key: key, kind: kindInt, i: int64(value)} }
+func Float(key string, v float64) Field { return Field{key: key, kind: kindFloat, f: v} }
+func Err(err error) Field               { return Field{key: "err", kind: kindError, err: err} }
+
+func appendValue(b []byte, s string) []byte {
+	if s == "" || strings.ContainsAny(s, " =\"\t\n") {
+		return strconv.AppendQuote(b, s)
+	}
+	return append(b, s...)
+}
+
+func (f Field) append(b []byte) []byte {
+	b = append(b, ' ')
+	b = append(b, f.key...)
+	b = append(b, '=')
+	switch f.kind {
+	case kindInt:
+		return strconv.AppendInt(b, f.i, 10)
+	case kindFloat:
+		return strconv.AppendFloat(b, f.f, 'f', -1, 64)
+	case kindError:
+		if f.err == nil {
+			return append(b, "nil"...)
+		}
+		return appendValue(b, f.err.Error())
+	}
+	return appendValue(b, f.s)
+}
+
+// depth is the caller's, for log.Lshortfile
+func output(depth int, l Level, msg string, fields []Field) {
+	b := make([]byte, 0, 64+16*len(fields))
+	b = append(b, "level="...)
+	b = append(b, l.String()...)
+	b = append(b, " msg="...)
+	b = appendValue(b, msg)
+	for _, f := range fields {
+		b = f.append(b)
+	}
+	log.Output(depth+1, string(b))
+}
+
+func (l Level) Log(msg string, fields ...Field) {
+	if l.Enabled() {
+		output(2, l, msg, fields)
+	}
+}
+
+// Sampler logs a line at most once an interval per key, such as a
+// brick's ID, counting the lines it held back
+type Sampler struct {
+	level Level
+	every time.Duration
+	keys  map[string]*sampled
+
+	lock sync.Mutex
+}
+
+type sampled struct {
+	last       time.Time
+	suppressed int
+}
+
+func NewSampler(level Level, every time.Duration) *Sampler {
+	return &Sampler{level: level, every: every, keys: make(map[string]*sampled)}
+}
+
+func (s *Sampler) Log(key, msg string, fields ...Field) {
+	if !s.level.Enabled() {
+		return
+	}
+	now := time.Now()
+	s.lock.Lock()
+	st := s.keys[key]
+	if st == nil {
+		st = &sampled{}
+		s.keys[key] = st
+	}
+	if !st.last.IsZero() && now.Sub(st.last) < s.every {
+		st.suppressed++
+		s.lock.Unlock()
+		return
+	}
+	held := st.suppressed
+	st.last, st.suppressed = now, 0
+	s.lock.Unlock()
+	if held > 0 {
+		fields = append(fields[:len(fields):len(fields)], Int("suppressed", held))
+	}
+	output(2, s.level, msg, fields)
+}
+
+// Summary gathers values by key, such as a channel's level, and logs
+// each key's count, low, high and mean once an interval instead of
+// every value
+type Summary struct {
+	level Level
+	msg   string
+	every time.Duration
+	start time.Time
+	keys  map[string]*aggregate
+
+	lock sync.Mutex
+}
+
+type aggregate struct {
+	n             int
+	min, max, sum float64
+}
+
+func NewSummary(level Level, msg string, every time.Duration) *Summary {
+	return &Summary{level: level, msg: msg, every: every, keys: make(map[string]*aggregate)}
+}
+
+func (s *Summary) Add(key string, v float64) {
+	if !s.level.Enabled() {
+		return
+	}
+	now := time.Now()
+	s.lock.Lock()
+	defer s.lock.Unlock()
+	if s.start.IsZero() {
+		s.start = now
+	}
+	a := s.keys[key]
+	if a == nil {
+		a = &aggregate{min: math.Inf(1), max: math.Inf(-1)}
+		s.keys[key] = a
+	}
+	a.n++
+	a.sum += v
+	a.min = math.Min(a.min, v)
+	a.max = math.Max(a.max, v)
+	if now.Sub(s.start) >= s.every {
+		s.flush(now)
+	}
+}
+
+// flush logs every key and starts over. Called with s.lock held.
+func (s *Summary) flush(now time.Time) {
+	keys := make([]string, 0, len(s.keys))
+	for k := range s.keys {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	for _, k := range keys {
+		a := s.keys[k]
+		output(3, s.level, s.msg, []Field{Str("key", k), Int("n", a.n),
+			Float("min", a.min), Float("max", a.max), Float("mean", a.sum/float64(a.n))})
+		delete(s.keys, k)
+	}
+	s.start = now
+}
@@ -0,0 +1,86 @@
+package logging
+
+import (
+	"bytes"
+	"errors"
+	"log"
+	"os"
+	"strings"
+	"testing"
+	"time"
+)
+
+func capture(t *testing.T) *bytes.Buffer {
+	var buf bytes.Buffer
+	log.SetOutput(&buf)
+	flags := log.Flags()
+	log.SetFlags(0)
+	t.Cleanup(func() {
+		log.SetOutput(os.Stderr)
+		log.SetFlags(flags)
+		SetLevel(Info)
+	})
+	return &buf
+}
+
+func TestLog(t *testing.T) {
+	buf := capture(t)
+	Info.Log("fan speed", Str("brick", "a"), Int("rpm", 1200), Float("c", 41.5), Err(errors.New("no ack")))
+	if got, want := buf.String(), `level=info msg="fan speed" brick=a rpm=1200 c=41.5 err="no ack"`+"\n"; got != want {
+		t.Errorf("got %q, want %q", got, want)
+	}
+	buf.Reset()
+	Debug.Log("hidden")
+	if buf.Len() != 0 {
+		t.Errorf("debug logged at info: %q", buf)
+	}
+	if l, err := ParseLevel("WARN"); err != nil || l != Warn {
+		t.Errorf("parsed %v %v", l, err)
+	}
+}
+
+func TestDisabledAllocs(t *testing.T) {
+	capture(t)
+	id, rpm := "a", 1200
+	s := NewSampler(Debug, time.Minute)
+	if n := testing.AllocsPerRun(100, func() {
+		Debug.Log("fan speed", Str("brick", id), Int("rpm", rpm), Float("c", 41.5))
+		s.Log(id, "fan speed", Int("rpm", rpm))
+	}); n != 0 {
+		t.Errorf("%v allocations at a disabled level", n)
+	}
+}
+
+func TestSampler(t *testing.T) {
+	buf := capture(t)
+	s := NewSampler(Info, time.Hour)
+	for i := 0; i < 5; i++ {
+		s.Log("a", "temperature", Int("i", i))
+		s.Log("b", "temperature", Int("i", i))
+	}
+	if n := strings.Count(buf.String(), "\n"); n != 2 {
+		t.Errorf("%d lines for two keys: %q", n, buf)
+	}
+	s.keys["a"].last = time.Now().Add(-2 * time.Hour)
+	s.Log("a", "temperature", Int("i", 5))
+	if !strings.Contains(buf.String(), "i=5 suppressed=4") {
+		t.Errorf("held back lines not counted: %q", buf)
+	}
+}
+
+func TestSummary(t *testing.T) {
+	buf := capture(t)
+	s := NewSummary(Info, "channel", time.Hour)
+	s.Add("0", 10)
+	s.Add("0", 30)
+	s.Add("1", 5)
+	if buf.Len() != 0 {
+		t.Errorf("summary before the interval: %q", buf)
+	}
+	s.start = time.Now().Add(-2 * time.Hour)
+	s.Add("0", 20)
+	lines := strings.Split(strings.TrimSpace(buf.String()), "\n")
+	if len(lines) != 2 || lines[0] != "level=info msg=channel key=0 n=3 min=10 max=30 mean=20" {
+		t.Errorf("summary %q", lines)
+	}
+}
@@ -0,0 +1,56 @@
+package ltable
+
+import (
+	"fmt"
+	"time"
+)
+
+// acclimation holds a zone's output to a cap that grows from
+// FromPercent of its table on Start, a local date, to all of it Days
+// later, for new livestock. The cap steps up once a local day, so the
+// bricks run a scaled copy of the table on their own and each update
+// adds one multiply per channel. Being worked out from the date, it
+// carries on across restarts and reloads where it left off.
+//
+//	{"acclimation": {"start": "2016-06-20", "from_percent": 30, "days": 42}, "table": [...]}
+//
+// or the same key on a zone.
+type acclimation struct {
+	Start       string  `json:"start"`
+	FromPercent float64 `json:"from_percent"`
+	Days        int     `json:"days"`
+	// Start as a date, midnight UTC
+	start time.Time
+}
+
+func (a *acclimation) check() error {
+	start, err := time.Parse("2006-01-02", a.Start)
+	if err != nil {
+		return fmt.Errorf("acclimation start %q isn't a date (2006-01-02)", a.Start)
+	}
+	if a.FromPercent < 0 || a.FromPercent > 100 {
+		return fmt.Errorf("acclimation must start from 0-100 percent, got %g", a.FromPercent)
+	}
+	if a.Days <= 0 {
+		return fmt.Errorf("acclimation needs a day or more, got %d", a.Days)
+	}
+	a.start = start
+	return nil
+}
+
+// capOn is the share of the table run on the local day starting at
+// day, 1 with no acclimation or once it's done
+func (a *acclimation) capOn(day time.Time) float64 {
+	if a == nil {
+		return 1
+	}
+	y, m, d := day.Date()
+	days := time.Date(y, m, d, 0, 0, 0, 0, time.UTC).Sub(a.start).Hours() / 24
+	switch {
+	case days <= 0:
+		return a.FromPercent / 100
+	case days >= float64(a.Days):
+		return 1
+	}
+	return (a.FromPercent + (100-a.FromPercent)*days/float64(a.Days)) / 100
+}
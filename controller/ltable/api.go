@@ -0,0 +1,340 @@
+package ltable
+
+import (
+	"encoding/json"
+	"fmt"
+	"net/http"
+	"sort"
+	"strconv"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// Manual control layered over the tables, the same in every zone. An override sets one channel
+// until it expires or is cleared, whatever the table says; pausing
+// stops the table writing at all, leaving the channels where they were
+// or where a scene took them. Either way every brick is written
+// directly, those running the schedule themselves included, and a
+// change is pushed out at once rather than at the next tick.
+type override struct {
+	percent float64
+	// Zero until cleared
+	until time.Time
+}
+
+// Override sets channel to percent for d, or until cleared if d is 0
+func (ld *LightDriver) Override(channel int, percent float64, d time.Duration) error {
+	if channel < 0 || channel >= maxChannels {
+		return fmt.Errorf("channel must be 0-%d, got %d", maxChannels-1, channel)
+	}
+	if percent < 0 || percent > 100 {
+		return fmt.Errorf("percent must be 0-100, got %g", percent)
+	}
+	if d < 0 {
+		return fmt.Errorf("negative override duration %v", d)
+	}
+	ld.lock.Lock()
+	o := override{percent: percent}
+	if d > 0 {
+		o.until = ld.clock.Now().Add(d)
+	}
+	ld.overrides[channel] = o
+	ld.lock.Unlock()
+	return ld.push()
+}
+
+// ClearOverride hands channel back to the table, every channel if -1
+func (ld *LightDriver) ClearOverride(channel int) error {
+	ld.lock.Lock()
+	if channel < 0 {
+		ld.overrides = make(map[int]override)
+	} else {
+		delete(ld.overrides, channel)
+	}
+	ld.lock.Unlock()
+	return ld.push()
+}
+
+// Pause stops the table changing the channels, until Resume
+func (ld *LightDriver) Pause() error {
+	ld.lock.Lock()
+	ld.paused = true
+	ld.lock.Unlock()
+	return ld.push()
+}
+
+func (ld *LightDriver) Resume() error {
+	ld.lock.Lock()
+	ld.paused = false
+	ld.lock.Unlock()
+	return ld.push()
+}
+
+// Scene fades every brick to a programmed scene and pauses the table
+// there
+func (ld *LightDriver) Scene(slot int) error {
+	ld.lock.Lock()
+	ld.paused = true
+	ld.lock.Unlock()
+	if err := ld.ble.RecallScene(slot); err != nil {
+		return err
+	}
+	return ld.push()
+}
+
+// startCue runs a cue once from now, over any other started this way
+// under the same name
+func (ld *LightDriver) startCue(cc cueConfig) error {
+	cc.At = ld.clock.Now().Format(time.RFC3339)
+	c, err := cc.compile()
+	if err != nil {
+		return err
+	}
+	ld.lock.Lock()
+	ld.timeline.run(ld.ble, c, ld.clock.Now())
+	ld.lock.Unlock()
+	return ld.push()
+}
+
+// stopCue ends the cue called name now
+func (ld *LightDriver) stopCue(name string) error {
+	ld.lock.Lock()
+	stopped := ld.timeline.stop(ld.ble, name, ld.clock.Now())
+	ld.lock.Unlock()
+	if !stopped {
+		return fmt.Errorf("no cue %s running", name)
+	}
+	return ld.push()
+}
+
+func (ld *LightDriver) push() error {
+	ld.updateChannels()
+	return ld.ble.Flush()
+}
+
+// expireOverrides drops the overrides run out as of now. Called with
+// ld.lock held.
+func (ld *LightDriver) expireOverrides(now time.Time) {
+	for channel, o := range ld.overrides {
+		if !o.until.IsZero() && !now.Before(o.until) {
+			delete(ld.overrides, channel)
+		}
+	}
+}
+
+// layered is each channel's level with the cues over the table and the
+// overrides over them,
+// false for channels left alone while paused. It only reads the driver,
+// so zones are layered together (parallel.go). Called with ld.lock held.
+func (ld *LightDriver) layered(now time.Time, levels []float64, set []bool) {
+	ld.timeline.layer(now, levels)
+	for channel := range levels {
+		if o, ok := ld.overrides[channel]; ok {
+			levels[channel] = o.percent
+			set[channel] = true
+			continue
+		}
+		set[channel] = !ld.paused
+	}
+}
+
+type apiOverride struct {
+	Channel int     `json:"channel"`
+	Percent float64 `json:"percent"`
+	// A duration ("30m"), until cleared when empty
+	For   string    `json:"for,omitempty"`
+	Until time.Time `json:"until,omitempty"`
+}
+
+type apiZone struct {
+	Name  string    `json:"name,omitempty"`
+	Table []float64 `json:"table"`
+	// Percent of the table run today while acclimating
+	Acclimation float64 `json:"acclimation,omitempty"`
+}
+
+type apiCue struct {
+	Name  string    `json:"name"`
+	Start time.Time `json:"start"`
+	End   time.Time `json:"end"`
+}
+
+type apiState struct {
+	Paused    bool          `json:"paused"`
+	Zones     []apiZone     `json:"zones"`
+	Overrides []apiOverride `json:"overrides"`
+	Cues      []apiCue      `json:"cues"`
+}
+
+// Handler serves the control API:
+//
+//	GET    /api/state                   each zone's table levels, overrides and whether paused
+//	POST   /api/override                {"channel": 0, "percent": 50, "for": "30m"}
+//	DELETE /api/override[?channel=n]    one channel's override, or all of them
+//	POST   /api/scene                   {"slot": 0}, pausing the table
+//	POST   /api/weather                 {"kind": "storm", "cloud_depth": 60, "cloud_seconds": 30,
+//	                                     "strikes_per_minute": 4, "seconds": 600}, see ble.Weather
+//	POST   /api/cue                     {"name": "photo", "for": "20m", "fade": "5s", "percents": {"6": 100},
+//	                                     "table": 20}, run once from now, see cueConfig
+//	DELETE /api/cue?name=photo          ending a running cue now
+//	POST   /api/pause, /api/resume
+//	POST   /api/benchmark               each brick's self benchmark, see ble.BenchResult, taking
+//	                                     a second or two a brick
+//	GET    /api/stream                  each brick's frame stream counters, see ble.StreamStats
+//	POST   /api/preview[?date=2020-06-01]  a config file as the body, rendered for every minute of
+//	                                     the day without applying it, see preview
+func (ld *LightDriver) Handler() http.Handler {
+	mux := http.NewServeMux()
+	reply := func(w http.ResponseWriter, err error) {
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		ld.writeState(w)
+	}
+	mux.HandleFunc("/api/state", func(w http.ResponseWriter, r *http.Request) {
+		if r.Method != http.MethodGet {
+			http.Error(w, "GET only", http.StatusMethodNotAllowed)
+			return
+		}
+		ld.writeState(w)
+	})
+	mux.HandleFunc("/api/override", func(w http.ResponseWriter, r *http.Request) {
+		switch r.Method {
+		case http.MethodPost:
+			var o apiOverride
+			if err := json.NewDecoder(r.Body).Decode(&o); err != nil {
+				reply(w, err)
+				return
+			}
+			var d time.Duration
+			if o.For != "" {
+				var err error
+				if d, err = time.ParseDuration(o.For); err != nil {
+					reply(w, err)
+					return
+				}
+			}
+			reply(w, ld.Override(o.Channel, o.Percent, d))
+		case http.MethodDelete:
+			channel := -1
+			if s := r.URL.Query().Get("channel"); s != "" {
+				var err error
+				if channel, err = strconv.Atoi(s); err != nil {
+					reply(w, err)
+					return
+				}
+			}
+			reply(w, ld.ClearOverride(channel))
+		default:
+			http.Error(w, "POST or DELETE only", http.StatusMethodNotAllowed)
+		}
+	})
+	post := func(path string, f func(r *http.Request) error) {
+		mux.HandleFunc(path, func(w http.ResponseWriter, r *http.Request) {
+			if r.Method != http.MethodPost {
+				http.Error(w, "POST only", http.StatusMethodNotAllowed)
+				return
+			}
+			reply(w, f(r))
+		})
+	}
+	post("/api/scene", func(r *http.Request) error {
+		var s struct {
+			Slot int `json:"slot"`
+		}
+		if err := json.NewDecoder(r.Body).Decode(&s); err != nil {
+			return err
+		}
+		return ld.Scene(s.Slot)
+	})
+	post("/api/weather", func(r *http.Request) error {
+		var w ble.Weather
+		if err := json.NewDecoder(r.Body).Decode(&w); err != nil {
+			return err
+		}
+		return ld.ble.StartWeather(w)
+	})
+	mux.HandleFunc("/api/benchmark", func(w http.ResponseWriter, r *http.Request) {
+		if r.Method != http.MethodPost {
+			http.Error(w, "POST only", http.StatusMethodNotAllowed)
+			return
+		}
+		w.Header().Set("Content-Type", "application/json")
+		json.NewEncoder(w).Encode(ld.ble.Benchmark())
+	})
+	mux.HandleFunc("/api/stream", func(w http.ResponseWriter, r *http.Request) {
+		w.Header().Set("Content-Type", "application/json")
+		json.NewEncoder(w).Encode(ld.ble.StreamStats())
+	})
+	mux.HandleFunc("/api/cue", func(w http.ResponseWriter, r *http.Request) {
+		switch r.Method {
+		case http.MethodPost:
+			var cc cueConfig
+			if err := json.NewDecoder(r.Body).Decode(&cc); err != nil {
+				reply(w, err)
+				return
+			}
+			reply(w, ld.startCue(cc))
+		case http.MethodDelete:
+			reply(w, ld.stopCue(r.URL.Query().Get("name")))
+		default:
+			http.Error(w, "POST or DELETE only", http.StatusMethodNotAllowed)
+		}
+	})
+	mux.HandleFunc("/api/preview", func(w http.ResponseWriter, r *http.Request) {
+		if r.Method != http.MethodPost {
+			http.Error(w, "POST only", http.StatusMethodNotAllowed)
+			return
+		}
+		p, err := previewRequest(r, ld.clock.Now())
+		if err != nil {
+			http.Error(w, err.Error(), http.StatusBadRequest)
+			return
+		}
+		w.Header().Set("Content-Type", "application/json")
+		json.NewEncoder(w).Encode(p)
+	})
+	post("/api/pause", func(*http.Request) error { return ld.Pause() })
+	post("/api/resume", func(*http.Request) error { return ld.Resume() })
+	return mux
+}
+
+// Levels is each zone's channel percents as last set, by zone name
+func (ld *LightDriver) Levels() map[string][]float64 {
+	ld.lock.Lock()
+	defer ld.lock.Unlock()
+	levels := make(map[string][]float64, len(ld.zones))
+	for _, z := range ld.zones {
+		levels[z.name] = append([]float64(nil), z.percents...)
+	}
+	return levels
+}
+
+func (ld *LightDriver) writeState(w http.ResponseWriter) {
+	ld.lock.Lock()
+	s := apiState{Paused: ld.paused}
+	for _, z := range ld.zones {
+		table := make([]float64, len(z.percents))
+		z.table.percentsAt(z.second(ld.clock.Now()), table)
+		az := apiZone{Name: z.name, Table: table}
+		if z.acclim != nil {
+			az.Acclimation = z.cap * 100
+			for i := range table {
+				table[i] *= z.cap
+			}
+		}
+		s.Zones = append(s.Zones, az)
+	}
+	for channel, o := range ld.overrides {
+		s.Overrides = append(s.Overrides, apiOverride{Channel: channel, Percent: o.percent, Until: o.until})
+	}
+	for _, o := range ld.timeline.running {
+		s.Cues = append(s.Cues, apiCue{Name: o.cue.name, Start: o.start, End: o.end})
+	}
+	ld.lock.Unlock()
+	sort.Slice(s.Overrides, func(i, j int) bool { return s.Overrides[i].Channel < s.Overrides[j].Channel })
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(s)
+}
@@ -0,0 +1,129 @@
+package ltable
+
+import (
+	"fmt"
+	"math"
+	"time"
+)
+
+// astroTable is a light table worked out each day for where the tank
+// is meant to be: day levels from sunrise to sunset, eased in and out
+// over the ramp, and moonlight through the night scaled by the moon's
+// phase. Times are in the ltable.location zone.
+type astroTable struct {
+	// Degrees, north and east positive
+	Latitude  float64 `json:"latitude"`
+	Longitude float64 `json:"longitude"`
+	// Minutes from sunrise to full day levels, and from them to sunset
+	RampMinutes int       `json:"ramp_minutes"`
+	Day         []float64 `json:"day"`
+	// Levels under a full moon
+	Moon []float64 `json:"moon"`
+}
+
+const (
+	julianUnixEpoch = 2440587.5
+	julian2000      = 2451545.0
+	// A new moon, 2000-01-06 18:14 UTC, and the mean synodic month
+	julianNewMoon = 2451550.26
+	synodicMonth  = 29.530588853
+)
+
+func julianDay(t time.Time) float64 {
+	return float64(t.Unix())/secondsPerDay + julianUnixEpoch
+}
+
+func fromJulian(jd float64) time.Time {
+	return time.Unix(int64(math.Round((jd-julianUnixEpoch)*secondsPerDay)), 0)
+}
+
+func sinDeg(d float64) float64 { return math.Sin(d * math.Pi / 180) }
+func cosDeg(d float64) float64 { return math.Cos(d * math.Pi / 180) }
+
+// sunTimes is sunrise and sunset around solar noon on day, by the
+// sunrise equation. up is set when the sun never sets that day, and
+// both times are zero when it either never sets or never rises.
+func sunTimes(day time.Time, latitude, longitude float64) (rise, set time.Time, up bool) {
+	noon := time.Date(day.Year(), day.Month(), day.Day(), 12, 0, 0, 0, day.Location())
+	n := math.Round(julianDay(noon) - julian2000 - 0.0008 + longitude/360)
+	mean := n - longitude/360
+	anomaly := math.Mod(357.5291+0.98560028*mean, 360)
+	centre := 1.9148*sinDeg(anomaly) + 0.02*sinDeg(2*anomaly) + 0.0003*sinDeg(3*anomaly)
+	ecliptic := math.Mod(anomaly+centre+180+102.9372, 360)
+	transit := julian2000 + mean + 0.0053*sinDeg(anomaly) - 0.0069*sinDeg(2*ecliptic)
+	sinDecl := sinDeg(ecliptic) * sinDeg(23.4397)
+	cosDecl := math.Sqrt(1 - sinDecl*sinDecl)
+	// The sun's centre 0.833 degrees below the horizon, for refraction
+	// and its radius
+	cosHour := (sinDeg(-0.833) - sinDeg(latitude)*sinDecl) / (cosDeg(latitude) * cosDecl)
+	if cosHour < -1 || cosHour > 1 {
+		return time.Time{}, time.Time{}, cosHour < -1
+	}
+	hour := math.Acos(cosHour) * 180 / math.Pi
+	return fromJulian(transit - hour/360), fromJulian(transit + hour/360), false
+}
+
+// moonIllumination is the lit fraction of the moon at t, from its mean
+// phase
+func moonIllumination(t time.Time) float64 {
+	age := math.Mod(julianDay(t)-julianNewMoon, synodicMonth) / synodicMonth
+	return (1 - math.Cos(2*math.Pi*age)) / 2
+}
+
+func minuteOfDay(t time.Time) int {
+	t = t.In(timeLocation)
+	return t.Hour()*60 + t.Minute()
+}
+
+func atMinute(minute int) string {
+	minute = (minute%(24*60) + 24*60) % (24 * 60)
+	return fmt.Sprintf("%d:%02d", minute/60, minute%60)
+}
+
+// settingPoints is the table for the local day containing day
+func (a *astroTable) settingPoints(day time.Time) (settingPoints, error) {
+	if len(a.Day) == 0 || len(a.Day) != len(a.Moon) {
+		return nil, fmt.Errorf("astronomical table needs day and moon levels for the same channels")
+	}
+	day = day.In(timeLocation)
+	moon := make([]float64, len(a.Moon))
+	lit := moonIllumination(day)
+	for channel, pct := range a.Moon {
+		moon[channel] = pct * lit
+	}
+
+	rise, set, up := sunTimes(day, a.Latitude, a.Longitude)
+	if rise.IsZero() {
+		if up {
+			return settingPoints{{At: "0:00", Percents: a.Day}}, nil
+		}
+		return settingPoints{{At: "0:00", Percents: moon}}, nil
+	}
+	r, s := minuteOfDay(rise), minuteOfDay(set)
+	length := (s - r + 24*60) % (24 * 60)
+	if length < 3 {
+		return settingPoints{{At: "0:00", Percents: moon}}, nil
+	}
+	// Keep the four points apart however short the day
+	ramp := a.RampMinutes
+	if ramp > (length-1)/2 {
+		ramp = (length - 1) / 2
+	}
+	if ramp < 1 {
+		ramp = 1
+	}
+	return settingPoints{
+		{At: atMinute(r), Percents: moon, Curve: "sine"},
+		{At: atMinute(r + ramp), Percents: a.Day},
+		{At: atMinute(s - ramp), Percents: a.Day, Curve: "sine"},
+		{At: atMinute(s), Percents: moon},
+	}, nil
+}
+
+func (a *astroTable) compile(day time.Time) (*compiledTable, error) {
+	sps, err := a.settingPoints(day)
+	if err != nil {
+		return nil, err
+	}
+	return compileTable(sps)
+}
@@ -0,0 +1,119 @@
+package ltable
+
+import "time"
+
+// Tables are written in local clock time but run in real time. Each
+// local day, a table's setpoints are placed at the instants the clock
+// reads them, and between two the table runs in proportion, so a tick
+// is a search and a division with no calendar in it. On the days the
+// clocks change, a setpoint in an hour skipped going forward takes
+// effect as the clocks jump, one in an hour repeated going back the
+// first time round, and the segment over the change runs an hour short
+// or long rather than jumping or running backwards.
+type dayClock struct {
+	// Local midnight starting the day and the next, Unix seconds
+	start, end int64
+	knots      []clockKnot
+}
+
+// clockKnot is the instant the table reaches second
+type clockKnot struct {
+	unix   int64
+	second int
+}
+
+// newDayClock places table's setpoints on the local day containing t
+func newDayClock(t time.Time, table *compiledTable) *dayClock {
+	y, m, d := t.In(timeLocation).Date()
+	k := &dayClock{knots: make([]clockKnot, 0, len(table.at)+2)}
+	k.knots = append(k.knots, clockKnot{wallInstant(y, m, d, 0), 0})
+	for _, at := range table.at {
+		if at > 0 {
+			k.knots = append(k.knots, clockKnot{wallInstant(y, m, d, at), at})
+		}
+	}
+	k.knots = append(k.knots, clockKnot{wallInstant(y, m, d, secondsPerDay), secondsPerDay})
+	k.start, k.end = k.knots[0].unix, k.knots[len(k.knots)-1].unix
+	return k
+}
+
+func zoneOffset(unix int64) int64 {
+	_, offset := time.Unix(unix, 0).In(timeLocation).Zone()
+	return int64(offset)
+}
+
+// wallInstant is when the local clock first reads second past midnight
+// on the day, or if it skips that time, when it jumps past it
+func wallInstant(y int, m time.Month, d, second int) int64 {
+	wall := time.Date(y, m, d, 0, 0, second, 0, time.UTC).Unix()
+	// The offsets either side of any change that day
+	before, after := zoneOffset(wall-secondsPerDay), zoneOffset(wall+secondsPerDay)
+	first := int64(0)
+	found := false
+	for _, offset := range []int64{before, after} {
+		if u := wall - offset; zoneOffset(u) == offset && (!found || u < first) {
+			first, found = u, true
+		}
+	}
+	if found || before >= after {
+		if !found {
+			first = wall - before
+		}
+		return first
+	}
+	// Skipped: the first instant on the later offset
+	lo, hi := wall-after, wall-before
+	for lo < hi {
+		mid := lo + (hi-lo)/2
+		if zoneOffset(mid) == after {
+			hi = mid
+		} else {
+			lo = mid + 1
+		}
+	}
+	return lo
+}
+
+// contains is whether t falls in the day
+func (k *dayClock) contains(t time.Time) bool {
+	u := t.Unix()
+	return u >= k.start && u < k.end
+}
+
+// second is the table second t falls on, t within the day
+func (k *dayClock) second(t time.Time) float64 {
+	u := t.Unix()
+	// Last knot at or before u, the later of two at one instant
+	lo, hi := 0, len(k.knots)
+	for lo < hi {
+		mid := int(uint(lo+hi) >> 1)
+		if k.knots[mid].unix <= u {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	if lo == 0 {
+		return 0
+	}
+	if lo == len(k.knots) {
+		return secondsPerDay - 1
+	}
+	a, b := k.knots[lo-1], k.knots[lo]
+	return float64(a.second) + float64(u-a.unix)*float64(b.second-a.second)/float64(b.unix-a.unix)
+}
+
+// at is the first whole second the table reaches second, the end of the
+// day if it doesn't
+func (k *dayClock) at(second int) time.Time {
+	for i := 1; i < len(k.knots); i++ {
+		a, b := k.knots[i-1], k.knots[i]
+		if second > b.second || b.second == a.second {
+			continue
+		}
+		span := (b.unix - a.unix) * int64(second-a.second)
+		steps := int64(b.second - a.second)
+		return time.Unix(a.unix+(span+steps-1)/steps, 0)
+	}
+	return time.Unix(k.end, 0)
+}
@@ -0,0 +1,325 @@
+package ltable
+
+import (
+	"fmt"
+	"math"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+const secondsPerDay = 24 * 60 * 60
+
+// How a level gets from one setpoint to the next
+type curve int
+
+const (
+	curveLinear curve = iota
+	// Monotone cubic Hermite through the neighbouring setpoints, so ramps
+	// don't kink at each point and never overshoot them
+	curveCubic
+	// Eased in and out, flat at both setpoints like half a sine wave
+	curveSine
+)
+
+var curveNames = map[string]curve{
+	"":       curveLinear,
+	"linear": curveLinear,
+	"cubic":  curveCubic,
+	"sine":   curveSine,
+}
+
+// Coefficients per channel per segment, a cubic in how far through
+// the segment
+const segmentCoefs = 4
+
+// compiledTable is a table parsed once at load: setpoint times as
+// seconds since local midnight in order, and for the segment from each
+// to the next, per channel, a cubic in how far through it. Evaluating
+// it doesn't parse or allocate.
+type compiledTable struct {
+	at       []int
+	coefs    []float64
+	channels int
+	// Every channel's level every frameStep seconds through the day, row
+	// by row, so the levels at any second are two rows blended. Setpoints
+	// fall on whole minutes, so linear segments come out exact and the
+	// steepest curves within a tenth of an output step.
+	frames []float32
+}
+
+// Seconds between rows of the frame table
+const (
+	frameStep = 10
+	frameRows = secondsPerDay / frameStep
+)
+
+// secondOfDay parses an "hh:mm" setpoint time
+func (sp settingPoint) secondOfDay() (int, error) {
+	hm := strings.Split(sp.At, ":")
+	if len(hm) != 2 {
+		return 0, fmt.Errorf("setpoint time %q isn't hh:mm", sp.At)
+	}
+	hours, err := strconv.Atoi(hm[0])
+	if err != nil || hours < 0 || hours > 23 {
+		return 0, fmt.Errorf("bad hours in setpoint time %q", sp.At)
+	}
+	minutes, err := strconv.Atoi(hm[1])
+	if err != nil || minutes < 0 || minutes > 59 {
+		return 0, fmt.Errorf("bad minutes in setpoint time %q", sp.At)
+	}
+	return hours*3600 + minutes*60, nil
+}
+
+func compileTable(s settingPoints) (*compiledTable, error) {
+	if len(s) == 0 {
+		return nil, fmt.Errorf("empty light table")
+	}
+	type row struct {
+		at       int
+		percents []float64
+		curve    curve
+	}
+	rows := make([]row, len(s))
+	channels := len(s[0].Percents)
+	for i, sp := range s {
+		at, err := sp.secondOfDay()
+		if err != nil {
+			return nil, err
+		}
+		if len(sp.Percents) != channels {
+			return nil, fmt.Errorf("setpoint %s has %d channels, want %d", sp.At, len(sp.Percents), channels)
+		}
+		curve, ok := curveNames[sp.Curve]
+		if !ok {
+			return nil, fmt.Errorf("setpoint %s has unknown curve %q", sp.At, sp.Curve)
+		}
+		rows[i] = row{at, sp.Percents, curve}
+	}
+	sort.SliceStable(rows, func(i, j int) bool { return rows[i].at < rows[j].at })
+
+	n := len(rows)
+	c := &compiledTable{
+		at:       make([]int, n),
+		coefs:    make([]float64, 0, n*channels*segmentCoefs),
+		channels: channels,
+	}
+	for i, r := range rows {
+		c.at[i] = r.at
+	}
+	// Segment i runs from point i to the next, the last wrapping to the
+	// first. Slopes are per second.
+	length := func(i int) int {
+		i = (i + n) % n
+		return (c.at[(i+1)%n] - c.at[i] + secondsPerDay) % secondsPerDay
+	}
+	secant := func(i, channel int) float64 {
+		i = (i + n) % n
+		if length(i) == 0 {
+			return 0
+		}
+		return (rows[(i+1)%n].percents[channel] - rows[i].percents[channel]) / float64(length(i))
+	}
+	// Fritsch-Butland: flat at a peak or trough, otherwise a harmonic mean
+	// of the secants either side, which keeps each segment monotone
+	tangent := func(i, channel int) float64 {
+		d0, d1 := secant(i-1, channel), secant(i, channel)
+		if d0*d1 <= 0 {
+			return 0
+		}
+		h0, h1 := float64(length(i-1)), float64(length(i))
+		return 3 * (h0 + h1) / ((2*h1+h0)/d0 + (h1+2*h0)/d1)
+	}
+	for i, r := range rows {
+		h := float64(length(i))
+		for channel, y := range r.percents {
+			dy := rows[(i+1)%n].percents[channel] - y
+			switch {
+			case h == 0:
+				c.coefs = append(c.coefs, y, 0, 0, 0)
+			case r.curve == curveCubic:
+				m0, m1 := tangent(i, channel)*h, tangent(i+1, channel)*h
+				c.coefs = append(c.coefs, y, m0, 3*dy-2*m0-m1, m0+m1-2*dy)
+			case r.curve == curveSine:
+				// Smoothstep, within 1% of the step of a true half sine
+				c.coefs = append(c.coefs, y, 0, 3*dy, -2*dy)
+			default:
+				c.coefs = append(c.coefs, y, dy, 0, 0)
+			}
+		}
+	}
+	c.frames = make([]float32, frameRows*channels)
+	levels := make([]float64, channels)
+	for row := 0; row < frameRows; row++ {
+		c.levelsAt(row*frameStep, levels)
+		for channel, level := range levels {
+			c.frames[row*channels+channel] = float32(level)
+		}
+	}
+	return c, nil
+}
+
+// level is channel's level frac of the way through segment
+func (c *compiledTable) level(segment, channel int, frac float64) float64 {
+	k := c.coefs[(segment*c.channels+channel)*segmentCoefs:]
+	return k[0] + frac*(k[1]+frac*(k[2]+frac*k[3]))
+}
+
+// span finds the segment second falls in, wrapping from the last point
+// of the day to the first, and how far second is through it.
+func (c *compiledTable) span(second int) (segment int, frac float64) {
+	// First point after second
+	lo, hi := 0, len(c.at)
+	for lo < hi {
+		mid := int(uint(lo+hi) >> 1)
+		if c.at[mid] <= second {
+			lo = mid + 1
+		} else {
+			hi = mid
+		}
+	}
+	before, after := lo-1, lo
+	if before < 0 {
+		before = len(c.at) - 1
+	}
+	if after == len(c.at) {
+		after = 0
+	}
+	length := (c.at[after] - c.at[before] + secondsPerDay) % secondsPerDay
+	if length == 0 {
+		return before, 0
+	}
+	into := (second - c.at[before] + secondsPerDay) % secondsPerDay
+	return before, float64(into) / float64(length)
+}
+
+// percentsAt fills out with every channel's level second into the
+// table's day, past the table's channels with 0, from the frame table
+func (c *compiledTable) percentsAt(second float64, out []float64) {
+	row := int(second) / frameStep
+	if row >= frameRows {
+		row = frameRows - 1
+	}
+	a := c.frames[row*c.channels:]
+	b := c.frames[(row+1)%frameRows*c.channels:]
+	frac := (second - float64(row*frameStep)) / frameStep
+	for channel := range out {
+		if channel >= c.channels {
+			out[channel] = 0
+			continue
+		}
+		from := float64(a[channel])
+		out[channel] = from + frac*(float64(b[channel])-from)
+	}
+}
+
+func (c *compiledTable) levelsAt(second int, out []float64) {
+	segment, frac := c.span(second)
+	for channel := range out {
+		if channel >= c.channels {
+			out[channel] = 0
+			continue
+		}
+		out[channel] = c.level(segment, channel, frac)
+	}
+}
+
+// nextChange is how many seconds after second any channel first moves
+// at least step from its level then, a day if none ever does. Every
+// segment is monotone, so a channel can only cross within a segment
+// it ends more than step away, and there the first second over it is
+// found by bisection.
+func (c *compiledTable) nextChange(second int, step float64) int {
+	segment, frac := c.span(second)
+	n := len(c.at)
+	length := func(i int) int {
+		return (c.at[(i+1)%n] - c.at[i] + secondsPerDay) % secondsPerDay
+	}
+	into := int(math.Round(frac * float64(length(segment))))
+	moved := func(segment, channel int, frac float64, from float64) bool {
+		return math.Abs(c.level(segment, channel, frac)-from) >= step
+	}
+	var levels [maxChannels]float64
+	from := levels[:]
+	if c.channels > maxChannels {
+		from = make([]float64, c.channels)
+	}
+	from = from[:c.channels]
+	for channel := range from {
+		from[channel] = c.level(segment, channel, frac)
+	}
+	elapsed := 0
+	for i := 0; i < n+1 && elapsed < secondsPerDay; i++ {
+		h := length(segment)
+		if h > 0 {
+			first := h + 1
+			for channel := range from {
+				if !moved(segment, channel, 1, from[channel]) {
+					continue
+				}
+				lo, hi := into+1, h
+				for lo < hi {
+					mid := int(uint(lo+hi) >> 1)
+					if moved(segment, channel, float64(mid)/float64(h), from[channel]) {
+						hi = mid
+					} else {
+						lo = mid + 1
+					}
+				}
+				if lo < first {
+					first = lo
+				}
+			}
+			if first <= h {
+				return elapsed + first - into
+			}
+			elapsed += h - into
+		}
+		segment, into = (segment+1)%n, 0
+	}
+	return secondsPerDay
+}
+
+// Where a schedule's straight lines may stray from the curves, in
+// percent
+const scheduleTolerance = 0.5
+
+// scheduleMinutes picks the minutes to put in a schedule peripherals
+// run themselves. They only interpolate linearly, so while there's room
+// each curved segment is split at the minute where a straight line
+// strays furthest from it.
+func (c *compiledTable) scheduleMinutes(maxPoints int) []int {
+	minutes := make([]int, len(c.at))
+	for i, at := range c.at {
+		minutes[i] = at / 60
+	}
+	a := make([]float64, c.channels)
+	b := make([]float64, c.channels)
+	mid := make([]float64, c.channels)
+	for len(minutes) < maxPoints {
+		worst, worstErr := -1, scheduleTolerance
+		for i, from := range minutes {
+			length := (minutes[(i+1)%len(minutes)] - from + 24*60) % (24 * 60)
+			if length < 2 {
+				continue
+			}
+			at := (from + length/2) % (24 * 60)
+			c.levelsAt(from*60, a)
+			c.levelsAt((from+length)%(24*60)*60, b)
+			c.levelsAt(at*60, mid)
+			frac := float64(length/2) / float64(length)
+			for channel := range mid {
+				e := math.Abs(a[channel] + frac*(b[channel]-a[channel]) - mid[channel])
+				if e > worstErr {
+					worst, worstErr = at, e
+				}
+			}
+		}
+		if worst < 0 {
+			break
+		}
+		minutes = append(minutes, worst)
+		sort.Ints(minutes)
+	}
+	return minutes
+}
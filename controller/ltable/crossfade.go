@@ -0,0 +1,79 @@
+package ltable
+
+import (
+	"fmt"
+	"math"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// crossfade blends a zone from the table it ran before to the one it
+// runs now, both evaluated each update, so a reload or the next day's
+// table doesn't jump the output. The bricks running the table on their
+// own are handed the same blend with the new schedule (see
+// ble.SetScheduleCrossfade), so they take it in one upload.
+type crossfade struct {
+	// The zone as it was, blending on from its own crossfade if it had
+	// one
+	from   *zoneTable
+	start  time.Time
+	length time.Duration
+}
+
+// MaxCrossfade is the longest a table change can blend over
+const MaxCrossfade = ble.MaxScheduleCrossfade
+
+// SetCrossfade blends every table change after this over d, 0 to swap
+// tables at once
+func (ld *LightDriver) SetCrossfade(d time.Duration) error {
+	if d < 0 || d > MaxCrossfade {
+		return fmt.Errorf("crossfade must be 0-%v, got %v", MaxCrossfade, d)
+	}
+	ld.lock.Lock()
+	defer ld.lock.Unlock()
+	ld.crossfade = d
+	for _, z := range ld.zones {
+		z.crossfade = d
+	}
+	return nil
+}
+
+// blendFrom starts the zone blending from old, as it stood, at now
+func (z *zoneTable) blendFrom(old *zoneTable, now time.Time) {
+	if z.crossfade == 0 || old.table == nil {
+		return
+	}
+	z.blend = &crossfade{from: old, start: now, length: z.crossfade}
+}
+
+// blendDone drops the blend once it has run its length by now
+func (z *zoneTable) blendDone(now time.Time) {
+	if z.blend != nil && !now.Before(z.blend.start.Add(z.blend.length)) {
+		z.blend = nil
+	}
+}
+
+// evaluate fills percents with the zone's table at now, scaled by its
+// acclimation and light integral and blended from the table before
+// while a crossfade runs
+func (z *zoneTable) evaluate(now time.Time, percents []float64) {
+	z.table.percentsAt(z.second(now), percents)
+	if f := z.factor(); f != 1 {
+		for i := range percents {
+			percents[i] = math.Min(100, percents[i]*f)
+		}
+	}
+	if z.blend == nil {
+		return
+	}
+	w := float64(now.Sub(z.blend.start)) / float64(z.blend.length)
+	if w >= 1 || w < 0 {
+		return
+	}
+	before := make([]float64, len(percents))
+	z.blend.from.evaluate(now, before)
+	for i := range percents {
+		percents[i] = before[i] + w*(percents[i]-before[i])
+	}
+}
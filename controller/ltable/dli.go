@@ -0,0 +1,262 @@
+package ltable
+
+import (
+	"fmt"
+	"log"
+	"math"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// dliTarget scales a zone's table so a day of it gives the tank Target
+// mol/m²/d of photosynthetic light (its daily light integral), from the
+// PPFD each channel gives at full output, in µmol/m²/s:
+//
+//	{"dli": {"target": 12, "par": [310, 120, 45]}, "table": [...]}
+//
+// or the same key on a zone. The scale is solved for once a local day
+// over the table as compiled, each channel clipped at full, and any
+// acclimation caps what comes of it. Through the day the light actually
+// commanded, overrides, pauses, cues and bricks derating for heat
+// included, is added up at each update against what the plan gave over
+// the same time. Once the two are dliDrift of the target apart the scale
+// is solved again for the rest of the day to make up the difference, so
+// the integral is only worked out on those changes, not every update.
+type dliTarget struct {
+	Target float64   `json:"target"`
+	PAR    []float64 `json:"par"`
+}
+
+func (t *dliTarget) check() error {
+	if t.Target <= 0 || t.Target > dliMaxTarget {
+		return fmt.Errorf("daily light integral must be over 0 and up to %g mol/m², got %g", float64(dliMaxTarget), t.Target)
+	}
+	if len(t.PAR) == 0 || len(t.PAR) > maxChannels {
+		return fmt.Errorf("daily light integral needs PAR for 1-%d channels, got %d", maxChannels, len(t.PAR))
+	}
+	lit := false
+	for i, par := range t.PAR {
+		if par < 0 {
+			return fmt.Errorf("channel %d has negative PAR %g", i, par)
+		}
+		lit = lit || par > 0
+	}
+	if !lit {
+		return fmt.Errorf("daily light integral needs a channel with PAR")
+	}
+	return nil
+}
+
+const (
+	// Full sun on a reef flat is about 60
+	dliMaxTarget = 100
+	// Commanded and planned light this share of the target apart solve
+	// the scale again
+	dliDrift = 0.02
+	// Scales this far apart aren't worth sending the bricks a schedule for
+	dliScaleStep = 0.01
+	// Most the scale is moved from the day's during it, so a long
+	// override doesn't leave the rest of the day dark or blinding
+	dliMaxCorrection = 0.5
+)
+
+// dliDay is a zone's light integral through the local day
+type dliDay struct {
+	// Factor on the table, and the one the day started on
+	scale, base float64
+	// mol/m² commanded and planned since the last solve, up to at
+	given, planned float64
+	at             time.Time
+	// PPFD commanded and planned from at
+	givenPPFD, planPPFD float64
+	// Each channel as last commanded, for those left alone while paused
+	sent []float64
+}
+
+// ppfd is the light percents give, in µmol/m²/s
+func (t *dliTarget) ppfd(percents []float64) float64 {
+	sum := 0.0
+	for i, percent := range percents {
+		if i < len(t.PAR) {
+			sum += t.PAR[i] * percent / 100
+		}
+	}
+	return sum
+}
+
+// dli is the light, in mol/m², the table gives scaled by scale from
+// second to the end of its day, with par for each channel's PPFD
+func (c *compiledTable) dli(par []float64, scale float64, second int) float64 {
+	sum := 0.0
+	for row := second / frameStep; row < frameRows; row++ {
+		levels := c.frames[row*c.channels : (row+1)*c.channels]
+		for channel, level := range levels {
+			if channel < len(par) {
+				sum += par[channel] * math.Min(100, float64(level)*scale) / 100
+			}
+		}
+	}
+	return sum * frameStep / 1e6
+}
+
+// dliScale is the factor on the table giving need mol/m² from second to
+// the end of its day, held to lo-hi. Clipping at full only slows the
+// light rising with the scale, so it's found by bisection.
+func (c *compiledTable) dliScale(par []float64, need float64, second int, lo, hi float64) float64 {
+	if c.dli(par, hi, second) <= need {
+		return hi
+	}
+	if c.dli(par, lo, second) >= need {
+		return lo
+	}
+	for i := 0; i < 40; i++ {
+		mid := (lo + hi) / 2
+		if c.dli(par, mid, second) < need {
+			lo = mid
+		} else {
+			hi = mid
+		}
+	}
+	return (lo + hi) / 2
+}
+
+// Highest the scale goes, where every channel with any light in the
+// table is well past full
+func (c *compiledTable) dliMaxScale() float64 {
+	low := 100.0
+	for _, level := range c.frames {
+		if level > 0 && float64(level) < low {
+			low = float64(level)
+		}
+	}
+	return math.Max(1, 100/low)
+}
+
+// scaleFor is the factor on table giving a day of the target
+func (t *dliTarget) scaleFor(table *compiledTable) float64 {
+	return table.dliScale(t.PAR, t.Target, 0, 0, table.dliMaxScale())
+}
+
+// planDLI solves the scale for a day of table, starting the day's
+// integral at now. It gives whether the scale moved.
+func (z *zoneTable) planDLI(table *compiledTable, now time.Time) bool {
+	if z.target == nil {
+		return false
+	}
+	was := 0.0
+	if z.dli != nil {
+		was = z.dli.scale
+	}
+	scale := z.target.scaleFor(table)
+	if reached := table.dli(z.target.PAR, scale, 0); reached < z.target.Target*(1-dliDrift) {
+		log.Printf("Light table%s only reaches %.1f mol/m² of its %g target at full", z.label(), reached, z.target.Target)
+	} else {
+		log.Printf("Light table%s scaled by %.2f for %g mol/m² a day", z.label(), scale, z.target.Target)
+	}
+	z.dli = &dliDay{scale: scale, base: scale, at: now, sent: make([]float64, len(z.percents))}
+	return math.Abs(scale-was) >= dliScaleStep
+}
+
+// trackDLI adds up the light commanded and planned between the last
+// update and now, solving the scale again for the rest of the day if
+// they've drifted apart. It gives whether the scale moved.
+func (z *zoneTable) trackDLI(now time.Time) bool {
+	d := z.dli
+	if d == nil {
+		return false
+	}
+	if dt := now.Sub(d.at).Seconds(); dt > 0 {
+		d.given += d.givenPPFD * dt / 1e6
+		d.planned += d.planPPFD * dt / 1e6
+	}
+	d.at = now
+	drift := d.given - d.planned
+	capped := z.factor() / d.scale
+	if math.Abs(drift) < dliDrift*z.target.Target || capped == 0 {
+		return false
+	}
+	second := int(z.second(now))
+	// The rest of the plan, less what was over it so far, in the
+	// table's terms before the acclimation cap
+	rest := z.table.dli(z.target.PAR, d.scale, second) - drift/capped
+	lo, hi := d.base*(1-dliMaxCorrection), d.base*(1+dliMaxCorrection)
+	scale := z.table.dliScale(z.target.PAR, math.Max(0, rest), second, lo, hi)
+	d.given, d.planned = 0, 0
+	if math.Abs(scale-d.scale) < dliScaleStep {
+		return false
+	}
+	verb := "up"
+	if scale < d.scale {
+		verb = "down"
+	}
+	log.Printf("Light table%s scaled %s to %.2f, %.2f mol/m² off its plan", z.label(), verb, scale, drift)
+	d.scale = scale
+	return true
+}
+
+// recordDLI notes the light from now on: plan as the table gives it,
+// and percents as commanded where set, each brick's share cut by
+// derate
+func (z *zoneTable) recordDLI(plan float64, percents []float64, set []bool, derate float64) {
+	d := z.dli
+	if d == nil {
+		return
+	}
+	for i, percent := range percents {
+		if set[i] {
+			d.sent[i] = percent
+		}
+	}
+	d.planPPFD = plan
+	d.givenPPFD = z.target.ppfd(d.sent) * derate
+}
+
+// factor is what the zone's table is multiplied by, the acclimation cap
+// and the light integral's scale
+func (z *zoneTable) factor() float64 {
+	f := 1.0
+	if z.acclim != nil {
+		f = z.cap
+	}
+	if z.dli != nil {
+		f *= z.dli.scale
+	}
+	return f
+}
+
+// derates is the share of their output each zone's bricks give after
+// derating for heat, on average, 1 while none have said, by zone name.
+// Called with ld.lock held.
+func (ld *LightDriver) derates() map[string]float64 {
+	zoneOf := make(map[string]string)
+	for _, z := range ld.zones {
+		for _, id := range z.bricks {
+			zoneOf[id] = z.name
+		}
+	}
+	sums, ns := make(map[string]int), make(map[string]int)
+	for _, p := range ld.ble.Perhipherals() {
+		// Bricks placed nowhere run the zone called ""
+		if d := p.Derate(); d > 0 {
+			sums[zoneOf[p.ID()]] += d
+			ns[zoneOf[p.ID()]]++
+		}
+	}
+	derates := make(map[string]float64, len(ld.zones))
+	for _, z := range ld.zones {
+		derates[z.name] = 1
+		if n := ns[z.name]; n > 0 {
+			derates[z.name] = float64(sums[z.name]) / float64(n) / 100
+		}
+	}
+	return derates
+}
+
+// dliPush sends z's bricks running the table themselves its new scale.
+// Called with ld.lock held.
+func (z *zoneTable) dliPush(ch ble.BLEChannel) {
+	clock := z.clock
+	z.setTable(ch, z.table)
+	z.clock = clock
+}
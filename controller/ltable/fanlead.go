@@ -0,0 +1,23 @@
+package ltable
+
+import (
+	"math"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// rise is how far the zone's table takes its channels up over the
+// bricks' fan lead, on average and in percent of full, from percents as
+// evaluated at now. Looking ahead leaves the zone's clock on today.
+func (z *zoneTable) rise(now time.Time) float64 {
+	ahead := make([]float64, len(z.percents))
+	clock := z.clock
+	z.evaluate(now.Add(ble.FanLeadTime), ahead)
+	z.clock = clock
+	sum := 0.0
+	for i, percent := range ahead {
+		sum += percent - z.percents[i]
+	}
+	return math.Max(0, sum/float64(len(ahead)))
+}
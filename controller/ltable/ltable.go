@@ -1,15 +1,18 @@
 package ltable
 
 import (
-	"encoding/json"
 	"flag"
 	"fmt"
 	"log"
+	"runtime"
 	"strconv"
 	"strings"
+	"sync"
 	"time"
 
 	"github.com/theatrus/ledbrick/controller/ble"
+	"github.com/theatrus/ledbrick/controller/clock"
+	"github.com/theatrus/ledbrick/controller/logging"
 )
 
 var timeLocation *time.Location
@@ -32,6 +35,13 @@ func initLtables() {
 type settingPoint struct {
 	At       string    `json:"at"`
 	Percents []float64 `json:"percents"`
+	// Instead of percents, a colour temperature in kelvin and how
+	// bright, mixed from the emitters (spectrum.go)
+	CCT       float64 `json:"cct,omitempty"`
+	Intensity float64 `json:"intensity,omitempty"`
+	// How levels get to the next setpoint: linear (the default), cubic
+	// or sine
+	Curve string `json:"curve,omitempty"`
 }
 
 func (sp settingPoint) TimeAt() time.Time {
@@ -43,11 +53,11 @@ func (sp settingPoint) TimeAt() time.Time {
 	hm := strings.Split(sp.At, ":")
 	hours, err := strconv.ParseInt(hm[0], 10, 32)
 	if err != nil {
-		log.Println("Bad hours, using 0: %s", err)
+		log.Printf("Bad hours, using 0: %s", err)
 	}
 	minutes, err := strconv.ParseInt(hm[1], 10, 32)
 	if err != nil {
-		log.Println("bad minutes, using 0: %s", err)
+		log.Printf("bad minutes, using 0: %s", err)
 	}
 
 	return time.Date(0, 0, 0, int(hours), int(minutes), 0, 0, timeLocation)
@@ -61,92 +71,272 @@ func (s settingPoints) Less(i, j int) bool {
 	return s[i].TimeAt().Before(s[j].TimeAt())
 }
 
-func (ld settingPoints) percentForTime(t time.Time, channel int) float64 {
+// percentForTime is one channel's level at t
+func (c *compiledTable) percentForTime(t time.Time, channel int) float64 {
 	if timeLocation == nil {
 		initLtables() // Lazy init
 	}
+	return c.percentAt(int(newDayClock(t, c).second(t)), channel)
+}
 
-	// All the math is done in "local" time which may not be system
-	// local time, so adjust everything to our location
-	lt := t.In(timeLocation)
-	// Grab a zero m/d/y version for comparison
-	compareTime := time.Date(0, 0, 0, lt.Hour(), lt.Minute(), lt.Second(), 0, timeLocation)
-
-	var iBefore int = len(ld) - 1 // Allow time to wrap
-	var iAfter int = len(ld) - 1
-	for i, v := range ld {
-		if v.TimeAt().Equal(compareTime) {
-			return v.Percents[channel]
-		}
-
-		if v.TimeAt().Before(compareTime) {
-			iBefore = i
-		} else {
-			iAfter = i
-			break
-		}
+// percentAt is one channel's level second into the table's day
+func (c *compiledTable) percentAt(second, channel int) float64 {
+	if channel >= c.channels {
+		return 0
 	}
+	segment, frac := c.span(second)
+	return c.level(segment, channel, frac)
+}
 
-	valueBefore := ld[iBefore].Percents[channel]
-	valueAfter := ld[iAfter].Percents[channel]
-
-	// Don't interpolate
-	if valueBefore == valueAfter {
-		return valueAfter
+// The table as a schedule peripherals can run themselves, in time
+// order, curves as straight lines between extra points
+func (c *compiledTable) schedulePoints() []ble.SchedulePoint {
+	minutes := c.scheduleMinutes(ble.ScheduleMaxPoints)
+	points := make([]ble.SchedulePoint, len(minutes))
+	for i, minute := range minutes {
+		percents := make([]float64, c.channels)
+		c.levelsAt(minute*60, percents)
+		points[i] = ble.SchedulePoint{Minute: minute, Percents: percents}
 	}
+	return points
+}
 
-	difference := ld[iAfter].TimeAt().Sub(ld[iBefore].TimeAt()) / time.Second
-	if difference < 0 {
-		difference = difference * -1
-	}
-	nowDifference := compareTime.Sub(ld[iBefore].TimeAt()) / time.Second
-	if nowDifference < 0 {
-		nowDifference = nowDifference * -1
-	}
+// Every channel is set each update; the levels are summed up at info
+var channelSummary = logging.NewSummary(logging.Info, "channel percent", 10*time.Minute)
 
-	lerpMult := float64(nowDifference) / float64(difference)
-	return valueBefore + lerpMult*(valueAfter-valueBefore)
-}
+// The longest the driver sleeps between updates, however flat the
+// tables, in case the clock jumps
+const maxUpdateWait = 10 * time.Minute
 
 type LightDriver struct {
-	ble      ble.BLEChannel
-	settings settingPoints
-	ticker   *time.Ticker
+	ble   ble.BLEChannel
+	clock clock.Clock
+	zones []*zoneTable
+	// When the levels next move by an output step, an override runs
+	// out or an astronomical table needs the new day
+	nextAt time.Time
+	// Woken when an update brings nextAt forward, and stopped
+	wake chan struct{}
+	stop chan struct{}
+	// Manual control over the tables, see api.go
+	overrides map[int]override
+	paused    bool
+	// Cues over the tables, under the overrides, see timeline.go
+	timeline timeline
+	// Table changes blend over this, see crossfade.go
+	crossfade time.Duration
+
+	lock sync.Mutex
 }
 
 func NewLightDriverFromJson(ble ble.BLEChannel, data []byte) (*LightDriver, error) {
+	return NewLightDriverWithClock(ble, data, clock.Real)
+}
+
+// NewLightDriverWithClock runs the tables on c, which with a simulated
+// clock runs a day of them as fast as it's advanced
+func NewLightDriverWithClock(ble ble.BLEChannel, data []byte, c clock.Clock) (*LightDriver, error) {
 	if timeLocation == nil {
 		initLtables() // Lazy init
 	}
 
-	var settings settingPoints
-	err := json.Unmarshal(data, &settings)
+	zones, configs, err := parseZones(data)
+	if err != nil {
+		return nil, err
+	}
+	cues, err := parseCues(data)
 	if err != nil {
 		return nil, err
 	}
 	ld := &LightDriver{ble: ble,
-		settings: settings,
-		ticker:   time.NewTicker(10 * time.Second),
+		clock:     c,
+		overrides: make(map[int]override),
+		wake:      make(chan struct{}, 1),
+		stop:      make(chan struct{}),
+	}
+	if err := ld.setZones(zones, configs); err != nil {
+		return nil, err
 	}
+	ld.timeline.setCues(cues)
 
-	go ld.run()
 	ld.updateChannels()
+	go ld.run()
 	return ld, nil
 }
 
+// Reload swaps in a new config file, the links and any overrides left
+// as they are, and pushes what changed. A config that doesn't parse is
+// refused and the old one kept.
+func (ld *LightDriver) Reload(data []byte) error {
+	zones, configs, err := parseZones(data)
+	if err != nil {
+		return err
+	}
+	cues, err := parseCues(data)
+	if err != nil {
+		return err
+	}
+	ld.lock.Lock()
+	now := ld.clock.Now()
+	for _, z := range zones {
+		z.crossfade = ld.crossfade
+		for _, old := range ld.zones {
+			if old.name == z.name {
+				z.blendFrom(old, now)
+			}
+		}
+	}
+	err = ld.setZones(zones, configs)
+	if err == nil {
+		ld.timeline.setCues(cues)
+		ld.update(ld.clock.Now())
+	}
+	ld.lock.Unlock()
+	if err != nil {
+		return err
+	}
+	return ld.ble.Flush()
+}
+
+// setZones places the zones on the bricks and starts their tables.
+// Called with ld.lock held, or before the driver runs.
+func (ld *LightDriver) setZones(zones []*zoneTable, configs []zoneConfig) error {
+	maps := make(map[string]ble.ZoneMap, len(configs))
+	for _, zc := range configs {
+		maps[zc.Name] = ble.ZoneMap{Bricks: zc.Bricks, Channels: zc.Channels}
+	}
+	if err := ld.ble.SetZones(maps); err != nil {
+		return err
+	}
+	for _, z := range zones {
+		if z.daily() {
+			if err := z.newDay(ld.ble, ld.clock.Now()); err != nil {
+				return err
+			}
+		} else {
+			z.setTable(ld.ble, z.table)
+		}
+	}
+	ld.zones = zones
+	return nil
+}
+
 func (ld *LightDriver) updateChannels() {
-	log.Println("Updating channel settings")
-	now := time.Now().In(timeLocation)
-	for i := 0; i < 8; i++ {
-		percent := ld.settings.percentForTime(now, i)
-		log.Printf("    ---- channel %d percent %f", i, percent)
-		ld.ble.SetChannel(i, percent)
+	ld.lock.Lock()
+	defer ld.lock.Unlock()
+	ld.update(ld.clock.Now())
+}
+
+// update evaluates every zone's table with the overrides over it and
+// sets the channels. Called with ld.lock held.
+func (ld *LightDriver) update(now time.Time) {
+	logging.Debug.Log("updating channel settings")
+	ld.timeline.advance(ld.ble, now)
+	for _, z := range ld.zones {
+		if z.daily() {
+			if err := z.newDay(ld.ble, now); err != nil {
+				log.Printf("Keeping yesterday's light table%s: %v", z.label(), err)
+			}
+		}
+		z.blendDone(now)
+		if z.trackDLI(now) {
+			z.dliPush(ld.ble)
+		}
+	}
+	ld.expireOverrides(now)
+	ld.evaluateZones(now, runtime.GOMAXPROCS(0))
+	var derates map[string]float64
+	for _, z := range ld.zones {
+		ld.ble.SetZoneFanLead(z.name, z.rising)
+		if z.dli != nil {
+			if derates == nil {
+				derates = ld.derates()
+			}
+			z.recordDLI(z.plan, z.percents, z.set, derates[z.name])
+		}
+	}
+	ld.ble.HoldSchedule(ld.paused || len(ld.overrides) > 0 || len(ld.timeline.running) > 0)
+	for _, z := range ld.zones {
+		for i, percent := range z.percents {
+			if !z.set[i] {
+				continue
+			}
+			logging.Debug.Log("channel", logging.Str("zone", z.name), logging.Int("channel", i),
+				logging.Float("percent", percent))
+			channelSummary.Add(z.key(i), percent)
+			ld.ble.SetZoneChannel(z.name, i, percent)
+		}
+	}
+
+	next := ld.next(now)
+	if next.Before(ld.nextAt) {
+		select {
+		case ld.wake <- struct{}{}:
+		default:
+		}
 	}
+	ld.nextAt = next
+}
 
+// next is the first time after now anything set at now needs setting
+// again. Called with ld.lock held.
+func (ld *LightDriver) next(now time.Time) time.Time {
+	next := now.Add(maxUpdateWait)
+	earlier := func(t time.Time) {
+		if t.Before(next) {
+			next = t
+		}
+	}
+	for _, o := range ld.overrides {
+		if !o.until.IsZero() {
+			earlier(o.until)
+		}
+	}
+	if at := ld.timeline.next(); !at.IsZero() {
+		earlier(at)
+	}
+	if ld.paused {
+		return next
+	}
+	// Tables are evaluated to the second
+	soon := now.Truncate(time.Second).Add(time.Second)
+	if ld.timeline.fading(now) {
+		earlier(soon)
+	}
+	for _, z := range ld.zones {
+		if z.blend != nil {
+			earlier(soon)
+		}
+	}
+	for _, z := range ld.zones {
+		earlier(z.due)
+	}
+	return next
 }
 
+// run updates the channels each time they next change, sleeping through
+// flat stretches of the tables, and pushes the update at once
 func (ld *LightDriver) run() {
-	for _ = range ld.ticker.C {
-		ld.updateChannels()
+	for {
+		ld.lock.Lock()
+		timer := ld.clock.NewTimer(ld.nextAt.Sub(ld.clock.Now()))
+		ld.lock.Unlock()
+		select {
+		case <-ld.stop:
+			timer.Stop()
+			return
+		case <-ld.wake:
+			timer.Stop()
+		case <-timer.C():
+			ld.updateChannels()
+			if err := ld.ble.Flush(); err != nil {
+				log.Printf("Writing the channels: %v", err)
+			}
+		}
 	}
 }
+
+// Stop ends the updates
+func (ld *LightDriver) Stop() {
+	close(ld.stop)
+}
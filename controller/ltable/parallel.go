@@ -0,0 +1,78 @@
+package ltable
+
+import (
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// Zones each worker is worth starting for: below it the handoff costs
+// more than evaluating them in turn
+const zonesPerWorker = 32
+
+// evaluateZones works out every zone's levels as of now, with the cues
+// and overrides over them, how far they rise ahead of the fan lead, and
+// when each next changes. Each zone only touches its own state here and
+// reads the driver's, so with many they're shared among up to workers
+// goroutines, each taking the next zone in turn as it finishes one.
+// Everything else goes on in zone order after, one at a time, so the
+// levels set and their order are the same however many ran. Called with
+// ld.lock held.
+func (ld *LightDriver) evaluateZones(now time.Time, workers int) {
+	if n := len(ld.zones) / zonesPerWorker; n < workers {
+		workers = n
+	}
+	if workers < 2 {
+		for _, z := range ld.zones {
+			ld.evaluateZone(z, now)
+		}
+		return
+	}
+	next := int32(-1)
+	var wg sync.WaitGroup
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := int(atomic.AddInt32(&next, 1)); i < len(ld.zones); i = int(atomic.AddInt32(&next, 1)) {
+				ld.evaluateZone(ld.zones[i], now)
+			}
+		}()
+	}
+	wg.Wait()
+}
+
+func (ld *LightDriver) evaluateZone(z *zoneTable, now time.Time) {
+	z.evaluate(now, z.percents)
+	z.rising = z.rise(now)
+	if z.dli != nil {
+		z.plan = z.target.ppfd(z.percents)
+	}
+	ld.layered(now, z.percents, z.set)
+	z.due = z.nextChange(now)
+}
+
+// nextChange is when the zone's table next moves by an output step, or
+// its new local day, a day on at most
+func (z *zoneTable) nextChange(now time.Time) time.Time {
+	next := now.Add(maxUpdateWait)
+	second := int(z.second(now))
+	if wait := z.table.nextChange(second, ble.LevelStep); wait < secondsPerDay {
+		// Tables are evaluated to the second
+		at := z.clock.at(second + wait)
+		if soon := now.Truncate(time.Second).Add(time.Second); at.Before(soon) {
+			at = soon
+		}
+		if at.Before(next) {
+			next = at
+		}
+	}
+	if z.daily() {
+		if day := z.day.AddDate(0, 0, 1); day.Before(next) {
+			next = day
+		}
+	}
+	return next
+}
@@ -0,0 +1,207 @@
+package ltable
+
+import (
+	"fmt"
+	"io/ioutil"
+	"math"
+	"net/http"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// Previews render a candidate config file into every zone's levels for
+// each minute of a local day, before it goes anywhere near the bricks:
+//
+//	POST /api/preview?date=2020-06-01&watts=300&channel_watts=40,25,10&bricks=2
+//
+// with the config as the body. The tables are compiled and evaluated as
+// the driver runs them, curves, astronomical and seasonal tables worked
+// out for the day, the acclimation cap and daily light integral scale
+// included. With watts and channel_watts each minute is held under the
+// power budget as the bricks sharing a supply would be, bricks being
+// each zone's listed, or bricks for a zone without a list (1 if not
+// given). Derating and the master dimmer aren't known ahead, so left
+// out, as are cues and overrides.
+type previewZone struct {
+	Name string `json:"name,omitempty"`
+	// Factor on the table, the acclimation cap and light integral scale
+	Scale float64 `json:"scale"`
+	// mol/m² over the day, with a light integral target
+	DLI float64 `json:"dli,omitempty"`
+	// Each minute's channel percents
+	Minutes [][]float64 `json:"minutes"`
+}
+
+type preview struct {
+	Date  string        `json:"date"`
+	Zones []previewZone `json:"zones"`
+	// Each minute's draw and what the budget scaled it by, with one
+	Watts  []float64 `json:"watts,omitempty"`
+	Budget []float64 `json:"budget,omitempty"`
+}
+
+// previewBudget is the supply the bricks share, for a preview
+type previewBudget struct {
+	Watts        float64
+	ChannelWatts []float64
+	// Bricks in zones that don't list theirs
+	Bricks int
+}
+
+const (
+	minutesPerDay = 24 * 60
+	// Larger than any config file a person writes
+	previewMaxBody = 1 << 20
+)
+
+// previewRequest renders the config in r's body for its date, today as
+// of now without one
+func previewRequest(r *http.Request, now time.Time) (*preview, error) {
+	q := r.URL.Query()
+	day := now
+	if s := q.Get("date"); s != "" {
+		var err error
+		if day, err = time.ParseInLocation("2006-01-02", s, timeLocation); err != nil {
+			return nil, err
+		}
+	}
+	var budget *previewBudget
+	if s := q.Get("watts"); s != "" {
+		budget = &previewBudget{Bricks: 1}
+		var err error
+		if budget.Watts, err = strconv.ParseFloat(s, 64); err != nil {
+			return nil, fmt.Errorf("watts: %v", err)
+		}
+		for _, s := range strings.Split(q.Get("channel_watts"), ",") {
+			w, err := strconv.ParseFloat(strings.TrimSpace(s), 64)
+			if err != nil {
+				return nil, fmt.Errorf("channel watts: %v", err)
+			}
+			budget.ChannelWatts = append(budget.ChannelWatts, w)
+		}
+		if s := q.Get("bricks"); s != "" {
+			if budget.Bricks, err = strconv.Atoi(s); err != nil {
+				return nil, fmt.Errorf("bricks: %v", err)
+			}
+		}
+	}
+	data, err := ioutil.ReadAll(http.MaxBytesReader(nil, r.Body, previewMaxBody))
+	if err != nil {
+		return nil, err
+	}
+	return renderPreview(data, day, budget)
+}
+
+func (b *previewBudget) check() error {
+	switch {
+	case b.Watts <= 0:
+		return fmt.Errorf("power budget must be positive, got %g W", b.Watts)
+	case len(b.ChannelWatts) == 0 || len(b.ChannelWatts) > maxChannels:
+		return fmt.Errorf("power budget needs watts for 1-%d channels, got %d", maxChannels, len(b.ChannelWatts))
+	case b.Bricks < 1:
+		return fmt.Errorf("at least one brick, got %d", b.Bricks)
+	}
+	for i, w := range b.ChannelWatts {
+		if w < 0 {
+			return fmt.Errorf("channel %d draws negative power %g W", i, w)
+		}
+	}
+	return nil
+}
+
+// draw is the watts a brick takes on percents
+func (b *previewBudget) draw(percents []float64) float64 {
+	w := 0.0
+	for i, percent := range percents {
+		if i < len(b.ChannelWatts) {
+			w += percent / 100 * b.ChannelWatts[i]
+		}
+	}
+	return w
+}
+
+// round keeps a preview's numbers to what the bricks can tell apart
+func round(v float64) float64 {
+	return math.Round(v*100) / 100
+}
+
+// renderPreview renders config data for the local day containing day,
+// held under budget when it isn't nil
+func renderPreview(data []byte, day time.Time, budget *previewBudget) (*preview, error) {
+	if budget != nil {
+		if err := budget.check(); err != nil {
+			return nil, err
+		}
+	}
+	zones, _, err := parseZones(data)
+	if err != nil {
+		return nil, err
+	}
+	y, m, d := day.In(timeLocation).Date()
+	start := time.Date(y, m, d, 0, 0, 0, 0, timeLocation)
+	p := &preview{Date: start.Format("2006-01-02")}
+	for _, z := range zones {
+		table, err := z.tableOn(start)
+		if err != nil {
+			return nil, fmt.Errorf("zone %q: %v", z.name, err)
+		}
+		z.table = table
+		z.cap = z.acclim.capOn(start)
+		pz := previewZone{Name: z.name}
+		if z.target != nil {
+			z.dli = &dliDay{scale: z.target.scaleFor(table)}
+		}
+		pz.Scale = z.factor()
+		// The wall clock minutes, which a clock change skips or repeats
+		for minute := 0; minute < minutesPerDay; minute++ {
+			at := time.Date(y, m, d, minute/60, minute%60, 0, 0, timeLocation)
+			percents := make([]float64, len(z.percents))
+			z.evaluate(at, percents)
+			pz.Minutes = append(pz.Minutes, percents)
+		}
+		p.Zones = append(p.Zones, pz)
+	}
+	if budget != nil {
+		p.Watts = make([]float64, minutesPerDay)
+		p.Budget = make([]float64, minutesPerDay)
+		for minute := range p.Watts {
+			total := 0.0
+			for i, z := range zones {
+				bricks := len(z.bricks)
+				if bricks == 0 {
+					bricks = budget.Bricks
+				}
+				total += budget.draw(p.Zones[i].Minutes[minute]) * float64(bricks)
+			}
+			scale := 1.0
+			if total > budget.Watts {
+				scale = budget.Watts / total
+			}
+			for i := range p.Zones {
+				for c := range p.Zones[i].Minutes[minute] {
+					p.Zones[i].Minutes[minute][c] *= scale
+				}
+			}
+			p.Watts[minute], p.Budget[minute] = round(total*scale), round(scale)
+		}
+	}
+	for i, z := range zones {
+		pz := &p.Zones[i]
+		if z.target != nil {
+			// Over the minutes as sent, the budget included
+			sum := 0.0
+			for _, percents := range pz.Minutes {
+				sum += z.target.ppfd(percents) * 60
+			}
+			pz.DLI = round(sum / 1e6)
+		}
+		pz.Scale = round(pz.Scale)
+		for _, percents := range pz.Minutes {
+			for c := range percents {
+				percents[c] = round(percents[c])
+			}
+		}
+	}
+	return p, nil
+}
@@ -0,0 +1,138 @@
+package ltable
+
+import (
+	"fmt"
+	"math"
+	"sort"
+	"time"
+)
+
+// seasonalTable is a light table blended each local day from reference
+// tables placed through the year, so day length and levels move a
+// little every day instead of one table repeating. Between two
+// references each setpoint slides from its time and levels in the one
+// to those in the next, in proportion to the days between them, and the
+// year wraps from the last back to the first. The blend is compiled
+// once a day, so a tick costs what a fixed table does.
+//
+//	{"seasons": [{"date": "12-21", "table": [...]}, {"date": "06-21", "table": [...]}]}
+//
+// Every reference needs as many setpoints, and channels, as the others.
+// Colour temperatures are mixed in each reference before blending.
+type seasonalTable struct {
+	Seasons []season `json:"seasons"`
+	// By day of the year, checked
+	refs []seasonRef
+}
+
+type season struct {
+	// Month and day, "01-02"
+	Date  string        `json:"date"`
+	Table settingPoints `json:"table"`
+}
+
+type seasonRef struct {
+	day    int
+	points []seasonPoint
+}
+
+type seasonPoint struct {
+	minute   int
+	percents []float64
+	curve    string
+}
+
+const daysPerYear = 365
+
+// dayOfYear counts from 0 on a year without 29 February, which falls on
+// 1 March
+func dayOfYear(m time.Month, d int) int {
+	return time.Date(2001, m, d, 0, 0, 0, 0, time.UTC).YearDay() - 1
+}
+
+func (s *seasonalTable) check(mix *mixer) error {
+	if len(s.Seasons) == 0 {
+		return fmt.Errorf("seasonal table needs a reference table")
+	}
+	s.refs = make([]seasonRef, len(s.Seasons))
+	for i, sn := range s.Seasons {
+		date, err := time.Parse("01-02", sn.Date)
+		if err != nil {
+			return fmt.Errorf("season date %q isn't a month and day (01-02)", sn.Date)
+		}
+		if err := sn.Table.mix(mix); err != nil {
+			return fmt.Errorf("season %s: %v", sn.Date, err)
+		}
+		// Checks the setpoints themselves
+		if _, err := compileTable(sn.Table); err != nil {
+			return fmt.Errorf("season %s: %v", sn.Date, err)
+		}
+		ref := seasonRef{day: dayOfYear(date.Month(), date.Day())}
+		for _, sp := range sn.Table {
+			at, _ := sp.secondOfDay()
+			ref.points = append(ref.points, seasonPoint{at / 60, sp.Percents, sp.Curve})
+		}
+		sort.SliceStable(ref.points, func(i, j int) bool { return ref.points[i].minute < ref.points[j].minute })
+		s.refs[i] = ref
+	}
+	sort.SliceStable(s.refs, func(i, j int) bool { return s.refs[i].day < s.refs[j].day })
+	first := s.refs[0]
+	for i, ref := range s.refs {
+		if i > 0 && ref.day == s.refs[i-1].day {
+			return fmt.Errorf("two seasons on the same day")
+		}
+		if len(ref.points) != len(first.points) {
+			return fmt.Errorf("seasons need as many setpoints each, got %d and %d", len(first.points), len(ref.points))
+		}
+		if len(ref.points[0].percents) != len(first.points[0].percents) {
+			return fmt.Errorf("seasons need as many channels each, got %d and %d",
+				len(first.points[0].percents), len(ref.points[0].percents))
+		}
+	}
+	return nil
+}
+
+// settingPoints is the blend for the local day containing day
+func (s *seasonalTable) settingPoints(day time.Time) settingPoints {
+	day = day.In(timeLocation)
+	today := dayOfYear(day.Month(), day.Day())
+	// Last reference on or before today, wrapping to the year before
+	n := len(s.refs)
+	from := n - 1
+	for i, ref := range s.refs {
+		if ref.day <= today {
+			from = i
+		}
+	}
+	a, b := s.refs[from], s.refs[(from+1)%n]
+	span := (b.day - a.day + daysPerYear) % daysPerYear
+	w := 0.0
+	if span > 0 {
+		w = float64((today-a.day+daysPerYear)%daysPerYear) / float64(span)
+	}
+
+	sps := make(settingPoints, len(a.points))
+	for i, p := range a.points {
+		q := b.points[i]
+		// The shorter way round midnight
+		shift := (q.minute-p.minute+24*60+12*60)%(24*60) - 12*60
+		percents := make([]float64, len(p.percents))
+		for channel, pct := range p.percents {
+			percents[channel] = pct + w*(q.percents[channel]-pct)
+		}
+		curve := p.curve
+		if w >= 0.5 {
+			curve = q.curve
+		}
+		sps[i] = settingPoint{
+			At:       atMinute(p.minute + int(math.Round(w*float64(shift)))),
+			Percents: percents,
+			Curve:    curve,
+		}
+	}
+	return sps
+}
+
+func (s *seasonalTable) compile(day time.Time) (*compiledTable, error) {
+	return compileTable(s.settingPoints(day))
+}
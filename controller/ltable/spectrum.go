@@ -0,0 +1,186 @@
+package ltable
+
+import (
+	"fmt"
+	"math"
+)
+
+// emitter is one channel's LEDs as the mixer sees them: their colour as
+// CIE 1931 chromaticity, and the light they give at full output in any
+// unit, as long as every channel is in the same one. Light adds up
+// linearly in XYZ, so that's all mixing needs of the spectrum.
+type emitter struct {
+	Name   string  `json:"name,omitempty"`
+	X      float64 `json:"x"`
+	Y      float64 `json:"y"`
+	Lumens float64 `json:"lumens"`
+}
+
+// mixer turns a colour temperature and intensity into channel levels,
+// for setpoints giving those instead of percents
+//
+//	{"emitters": [{"name": "white", "x": 0.31, "y": 0.32, "lumens": 180}, ...],
+//	 "table": [{"at": "12:00", "cct": 14000, "intensity": 80}, ...]}
+//
+// or the same key on a zone, in the order of the table's channels. The
+// brightest mix landing on the black body locus is solved for once per
+// step of reciprocal temperature at load, so each setpoint is two rows
+// blended. Intensity is a percent of the brightest mix at that colour.
+// Setpoints are mixed, not the ramps between them, which blend the
+// channels and so cut the locus slightly between distant colours.
+type mixer struct {
+	channels int
+	// Each row's mix as a share of full output per channel, rows
+	// mixerStep mireds apart from mixerMinMired, nil where the emitters
+	// can't reach the colour
+	rows [][]float64
+}
+
+// Reciprocal megakelvin (mired) range and step of the mix rows, 25000 K
+// to 1667 K, where the locus approximation holds
+const (
+	mixerMinMired = 40
+	mixerMaxMired = 600
+	mixerStep     = 5
+)
+
+func newMixer(emitters []emitter) (*mixer, error) {
+	if len(emitters) == 0 || len(emitters) > maxChannels {
+		return nil, fmt.Errorf("mixing needs 1-%d emitters, got %d", maxChannels, len(emitters))
+	}
+	for i, e := range emitters {
+		if e.X <= 0 || e.Y <= 0 || e.X+e.Y > 1 || e.Lumens < 0 {
+			return nil, fmt.Errorf("emitter %d (%s) needs a chromaticity inside the diagram and lumens", i, e.Name)
+		}
+	}
+	m := &mixer{channels: len(emitters)}
+	for mired := mixerMinMired; mired <= mixerMaxMired; mired += mixerStep {
+		x, y := locus(1e6 / float64(mired))
+		m.rows = append(m.rows, brightestMix(emitters, x, y))
+	}
+	return m, nil
+}
+
+// locus is the chromaticity of a black body at kelvin, by Kim et al.'s
+// cubic spline
+func locus(kelvin float64) (x, y float64) {
+	t := 1e3 / kelvin
+	if kelvin <= 4000 {
+		x = ((-0.2661239*t-0.2343589)*t+0.8776956)*t + 0.179910
+	} else {
+		x = ((-3.0258469*t+2.1070379)*t+0.2226347)*t + 0.240390
+	}
+	switch {
+	case kelvin <= 2222:
+		y = ((-1.1063814*x-1.34811020)*x+2.18555832)*x - 0.20219683
+	case kelvin <= 4000:
+		y = ((-0.9549476*x-1.37418593)*x+2.09137015)*x - 0.16748867
+	default:
+		y = ((3.0817580*x-5.87338670)*x+3.75112997)*x - 0.37001483
+	}
+	return x, y
+}
+
+// brightestMix is the share of each emitter giving the most light at
+// chromaticity x, y, nil if none reaches it. Holding the mix's X and Z
+// to its Y are two linear constraints, so the best mix is a vertex with
+// at most two emitters partway and the rest off or full; every one is
+// tried, which stays quick for a table's channels.
+func brightestMix(emitters []emitter, x, y float64) []float64 {
+	n := len(emitters)
+	// Each emitter's X and Z beyond what its Y needs at the target
+	a := make([]float64, n)
+	b := make([]float64, n)
+	lum := make([]float64, n)
+	for i, e := range emitters {
+		lum[i] = e.Lumens
+		a[i] = e.Lumens*e.X/e.Y - x/y*e.Lumens
+		b[i] = e.Lumens*(1-e.X-e.Y)/e.Y - (1-x-y)/y*e.Lumens
+	}
+	const eps = 1e-9
+	var best []float64
+	bestLum := eps
+	w := make([]float64, n)
+	for p := 0; p < n; p++ {
+		for q := p + 1; q < n; q++ {
+			det := a[p]*b[q] - a[q]*b[p]
+			if math.Abs(det) < eps {
+				continue
+			}
+			// The others off or full, by the bits of full
+			for full := 0; full < 1<<uint(n-2); full++ {
+				var sa, sb, sl float64
+				bit := 0
+				for i := 0; i < n; i++ {
+					if i == p || i == q {
+						continue
+					}
+					w[i] = float64(full >> uint(bit) & 1)
+					bit++
+					sa += w[i] * a[i]
+					sb += w[i] * b[i]
+					sl += w[i] * lum[i]
+				}
+				wp := (-sa*b[q] + sb*a[q]) / det
+				wq := (-sb*a[p] + sa*b[p]) / det
+				if wp < -eps || wp > 1+eps || wq < -eps || wq > 1+eps {
+					continue
+				}
+				w[p], w[q] = math.Max(0, math.Min(1, wp)), math.Max(0, math.Min(1, wq))
+				if l := sl + w[p]*lum[p] + w[q]*lum[q]; l > bestLum {
+					bestLum = l
+					best = append(best[:0], w...)
+				}
+			}
+		}
+	}
+	return best
+}
+
+// percents fills out with the channel levels for intensity percent of
+// the brightest mix at kelvin, blending the two rows either side
+func (m *mixer) percents(kelvin, intensity float64, out []float64) error {
+	if kelvin <= 0 || intensity < 0 || intensity > 100 {
+		return fmt.Errorf("mixing needs a colour temperature and an intensity of 0-100, got %g K at %g", kelvin, intensity)
+	}
+	pos := (1e6/kelvin - mixerMinMired) / mixerStep
+	if pos < 0 || pos > float64(len(m.rows)-1) {
+		return fmt.Errorf("%g K is outside %d-%d K", kelvin, 1000000/mixerMaxMired, 1000000/mixerMinMired)
+	}
+	row := int(pos)
+	next := row
+	if row < len(m.rows)-1 {
+		next++
+	}
+	a, b := m.rows[row], m.rows[next]
+	if a == nil || b == nil {
+		return fmt.Errorf("the emitters can't mix %g K", kelvin)
+	}
+	frac := pos - float64(row)
+	for channel := range out {
+		out[channel] = (a[channel] + frac*(b[channel]-a[channel])) * intensity
+	}
+	return nil
+}
+
+// mix gives the setpoints with a colour temperature their channel
+// levels from m
+func (s settingPoints) mix(m *mixer) error {
+	for i := range s {
+		sp := &s[i]
+		if sp.CCT == 0 {
+			continue
+		}
+		if m == nil {
+			return fmt.Errorf("setpoint %s gives a colour temperature but there are no emitters", sp.At)
+		}
+		if len(sp.Percents) != 0 {
+			return fmt.Errorf("setpoint %s gives both percents and a colour temperature", sp.At)
+		}
+		sp.Percents = make([]float64, m.channels)
+		if err := m.percents(sp.CCT, sp.Intensity, sp.Percents); err != nil {
+			return fmt.Errorf("setpoint %s: %v", sp.At, err)
+		}
+	}
+	return nil
+}
@@ -1,9 +1,22 @@
 package ltable
 
 import (
+	"fmt"
+	"io/ioutil"
+	"log"
+	"math"
+	"net/http/httptest"
+	"os"
+	"path/filepath"
+	"reflect"
 	"sort"
+	"strings"
+	"sync/atomic"
 	"testing"
 	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+	"github.com/theatrus/ledbrick/controller/clock"
 )
 
 var percents = []float64{1.0, 2.0}
@@ -39,37 +52,1207 @@ func TestPercentForTime(t *testing.T) {
 			settingPoint{At: "11:00", Percents: percents2},
 			settingPoint{At: "12:00", Percents: percents1},
 		})
-	sort.Sort(sps)
+	c, err := compileTable(sps)
+	if err != nil {
+		t.Fatal(err)
+	}
 
 	now := time.Date(2016, 1, 1, 10, 0, 0, 0, timeLocation)
-	value := sps.percentForTime(now, 0)
+	value := c.percentForTime(now, 0)
 	if value != percents1[0] {
 		t.Errorf("Value was not %f, got %f", percents1[0], value)
 	}
 
 	now = time.Date(2016, 1, 1, 10, 30, 0, 0, timeLocation)
-	value = sps.percentForTime(now, 0)
+	value = c.percentForTime(now, 0)
 	if value != 50 {
 		t.Errorf("Value was not 50, got %f", value)
 	}
 
 	now = time.Date(2016, 1, 1, 11, 15, 0, 0, timeLocation)
-	value = sps.percentForTime(now, 0)
+	value = c.percentForTime(now, 0)
 	if value != 75 {
 		t.Errorf("Value was not 75, got %f", value)
 	}
 
 	// Check for negative wrap around
 	now = time.Date(2016, 1, 1, 9, 30, 0, 0, timeLocation)
-	value = sps.percentForTime(now, 0)
+	value = c.percentForTime(now, 0)
 	if value != 0 {
 		t.Errorf("Value was not 0, got %f", value)
 	}
 
 	// Check for positive wrap around
 	now = time.Date(2016, 1, 1, 13, 30, 0, 0, timeLocation)
-	value = sps.percentForTime(now, 0)
+	value = c.percentForTime(now, 0)
 	if value != 0 {
 		t.Errorf("Value was not 0, got %f", value)
 	}
 }
+
+func TestCompileTable(t *testing.T) {
+	initLtables()
+
+	c, err := compileTable(settingPoints{
+		{At: "22:00", Percents: percents2},
+		{At: "2:00", Percents: percents1},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if c.at[0] != 2*3600 || c.at[1] != 22*3600 {
+		t.Errorf("setpoints out of order: %v", c.at)
+	}
+	// Midnight is halfway through the wrap from 22:00 back to 2:00
+	out := make([]float64, 8)
+	c.percentsAt(0, out)
+	if out[0] != 50 || out[1] != 25 || out[7] != 0 {
+		t.Errorf("levels at midnight %v", out)
+	}
+	if n := testing.AllocsPerRun(100, func() { c.percentsAt(12345, out) }); n != 0 {
+		t.Errorf("%v allocations per evaluation", n)
+	}
+
+	for _, bad := range []settingPoints{
+		{},
+		{{At: "25:00", Percents: percents}},
+		{{At: "10", Percents: percents}},
+		{{At: "10:00", Percents: percents}, {At: "11:00", Percents: []float64{1}}},
+	} {
+		if _, err := compileTable(bad); err == nil {
+			t.Errorf("compiled %v", bad)
+		}
+	}
+}
+
+// A day of setpoints every 15 minutes, for the benchmarks
+func TestNextChange(t *testing.T) {
+	c, err := compileTable(settingPoints{
+		{At: "0:00", Percents: []float64{10, 0}},
+		{At: "6:00", Percents: []float64{10, 0}},
+		{At: "7:00", Percents: []float64{50, 0}, Curve: "sine"},
+		{At: "8:00", Percents: []float64{50, 100}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	// Flat until 6:00, then 40% over the hour: three seconds to a step
+	if n := c.nextChange(3*3600, ble.LevelStep); n != 3*3600+3 {
+		t.Errorf("from 3:00 %d", n)
+	}
+	// Eased in and out, slow at each end
+	n := c.nextChange(7*3600, ble.LevelStep)
+	if n <= 3 || n > 120 {
+		t.Errorf("from 7:00 %d", n)
+	}
+	// From 8:00 back down over 16 hours, the faster channel first
+	if n := c.nextChange(20*3600, ble.LevelStep); n != 15 {
+		t.Errorf("from 20:00 %d", n)
+	}
+	flat, _ := compileTable(settingPoints{{At: "9:00", Percents: []float64{10}}})
+	if n := flat.nextChange(0, ble.LevelStep); n != secondsPerDay {
+		t.Errorf("flat table %d", n)
+	}
+}
+
+func TestNextUpdate(t *testing.T) {
+	initLtables()
+
+	table, err := compileTable(settingPoints{{At: "0:00", Percents: []float64{10}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	f := &fakeChannel{levels: make(map[int]float64)}
+	z := &zoneTable{table: table, percents: make([]float64, 1), set: make([]bool, 1)}
+	ld := &LightDriver{ble: f, clock: clock.Real, zones: []*zoneTable{z}, overrides: make(map[int]override),
+		wake: make(chan struct{}, 1),
+	}
+	now := time.Now()
+	ld.update(now)
+	if !ld.nextAt.Equal(now.Add(maxUpdateWait)) {
+		t.Errorf("flat table next at %v", ld.nextAt.Sub(now))
+	}
+	ld.overrides[0] = override{percent: 50, until: now.Add(time.Minute)}
+	ld.update(now)
+	if !ld.nextAt.Equal(now.Add(time.Minute)) {
+		t.Errorf("override next at %v", ld.nextAt.Sub(now))
+	}
+	select {
+	case <-ld.wake:
+	default:
+		t.Error("not woken for the sooner update")
+	}
+}
+
+func TestDayClock(t *testing.T) {
+	initLtables()
+
+	c, err := compileTable(settingPoints{
+		{At: "1:00", Percents: []float64{0}},
+		{At: "4:00", Percents: []float64{100}},
+		{At: "5:00", Percents: []float64{0}},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	utc := func(month time.Month, day, hour, minute int) time.Time {
+		return time.Date(2016, month, day, hour, minute, 0, 0, time.UTC)
+	}
+	// Clocks go forward at 2:00 PST, 10:00 UTC, and back at 2:00 PDT, 9:00
+	// UTC. Either way the ramp runs from 1:00 to 4:00 local and is
+	// halfway two real hours in.
+	for _, tt := range []struct {
+		at      time.Time
+		percent float64
+	}{
+		{utc(3, 13, 9, 0), 0},
+		{utc(3, 13, 10, 0), 50},
+		{utc(3, 13, 11, 0), 100},
+		{utc(11, 6, 8, 0), 0},
+		{utc(11, 6, 10, 0), 50},
+		{utc(11, 6, 12, 0), 100},
+		{utc(6, 1, 9, 30), 50},
+	} {
+		if got := c.percentForTime(tt.at, 0); math.Abs(got-tt.percent) > 1e-9 {
+			t.Errorf("at %v got %g, want %g", tt.at.In(timeLocation), got, tt.percent)
+		}
+	}
+
+	// Skipped hours take effect as the clocks jump, repeated ones the
+	// first time round
+	if got := wallInstant(2016, 3, 13, 2*3600+30*60); got != utc(3, 13, 10, 0).Unix() {
+		t.Errorf("2:30 on the skipped day at %v", time.Unix(got, 0).UTC())
+	}
+	if got := wallInstant(2016, 11, 6, 3600+30*60); got != utc(11, 6, 8, 30).Unix() {
+		t.Errorf("1:30 on the repeated day at %v", time.Unix(got, 0).UTC())
+	}
+
+	for day, hours := range map[int]int{12: 24, 13: 23} {
+		k := newDayClock(time.Date(2016, 3, day, 12, 0, 0, 0, timeLocation), c)
+		if got := time.Duration(k.end-k.start) * time.Second; got != time.Duration(hours)*time.Hour {
+			t.Errorf("March %d %v long", day, got)
+		}
+	}
+	k := newDayClock(utc(11, 6, 20, 0), c)
+	if got := time.Duration(k.end-k.start) * time.Second; got != 25*time.Hour {
+		t.Errorf("November 6 %v long", got)
+	}
+	last := -1.0
+	for u := k.start; u < k.end; u += 60 {
+		second := k.second(time.Unix(u, 0))
+		if second < last {
+			t.Fatalf("clock ran back at %v", time.Unix(u, 0).In(timeLocation))
+		}
+		last = second
+		if at := k.at(int(math.Ceil(second))); at.Unix() < u || at.Unix() > u+1 {
+			t.Fatalf("second %g at %v, not %v", second, at, time.Unix(u, 0))
+		}
+	}
+}
+
+// Counts the frames pushed
+type countingChannel struct {
+	fakeChannel
+	flushes int64
+}
+
+func (c *countingChannel) Flush() error {
+	atomic.AddInt64(&c.flushes, 1)
+	return nil
+}
+
+func TestSimulatedDay(t *testing.T) {
+	initLtables()
+
+	start := time.Date(2016, 1, 1, 0, 0, 0, 0, timeLocation)
+	sim := clock.NewSim(start)
+	f := &countingChannel{fakeChannel: fakeChannel{levels: make(map[int]float64)}}
+	ld, err := NewLightDriverWithClock(f, []byte(`[{"at": "6:00", "percents": [0]},
+		{"at": "12:00", "percents": [100]}, {"at": "18:00", "percents": [0]}]`), sim)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer ld.Stop()
+	level := func() float64 {
+		ld.lock.Lock()
+		defer ld.lock.Unlock()
+		return f.levels[0]
+	}
+	// Each update fires the driver's one timer, and the next is made once
+	// it's done
+	runUntil := func(until time.Time) {
+		for sim.Now().Before(until) {
+			sim.BlockUntil(1)
+			sim.Next()
+		}
+		sim.BlockUntil(1)
+	}
+	runUntil(start.Add(9 * time.Hour))
+	if l := level(); math.Abs(l-50) > 2*ble.LevelStep {
+		t.Errorf("%g%% at 9:00", l)
+	}
+	runUntil(start.AddDate(0, 0, 1))
+	if l := level(); l != 0 {
+		t.Errorf("%g%% at midnight", l)
+	}
+	// About an update for each output step up and down, each landing on
+	// the whole second after, and a few for the flat night
+	steps := int64(math.Round(100 / ble.LevelStep))
+	if n := atomic.LoadInt64(&f.flushes); n < 2*steps*8/10 || n > 2*steps+200 {
+		t.Errorf("%d updates in the day", n)
+	}
+}
+
+func TestFrameTable(t *testing.T) {
+	initLtables()
+
+	c, err := compileTable(settingPoints{
+		{At: "6:00", Percents: []float64{0, 100}, Curve: "sine"},
+		{At: "6:30", Percents: []float64{100, 0}, Curve: "cubic"},
+		{At: "12:00", Percents: []float64{40, 60}},
+		{At: "20:00", Percents: []float64{0, 5}, Curve: "cubic"},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+	looked, exact := make([]float64, 2), make([]float64, 2)
+	worst := 0.0
+	for second := 0; second < secondsPerDay; second++ {
+		c.percentsAt(float64(second), looked)
+		c.levelsAt(second, exact)
+		for channel := range exact {
+			worst = math.Max(worst, math.Abs(looked[channel]-exact[channel]))
+		}
+	}
+	// A 30 minute full scale sine ramp is the worst of it
+	if worst > ble.LevelStep/5 {
+		t.Errorf("frame table off by %g%%", worst)
+	}
+}
+
+func dayTable() settingPoints {
+	return sizedTable(96, 8)
+}
+
+// sizedTable is points setpoints spread over the day
+func sizedTable(points, channels int) settingPoints {
+	var sps settingPoints
+	for i := 0; i < points; i++ {
+		m := i * 24 * 60 / points
+		p := make([]float64, channels)
+		for channel := range p {
+			p[channel] = float64((m + channel*60) % 100)
+		}
+		sps = append(sps, settingPoint{At: fmt.Sprintf("%d:%02d", m/60, m%60), Percents: p})
+	}
+	return sps
+}
+
+func BenchmarkCompileTable(b *testing.B) {
+	initLtables()
+	sps := dayTable()
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := compileTable(sps); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkPercentsAt(b *testing.B) {
+	initLtables()
+	c, err := compileTable(dayTable())
+	if err != nil {
+		b.Fatal(err)
+	}
+	out := make([]float64, 8)
+	b.ReportAllocs()
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		c.percentsAt(float64(i%secondsPerDay), out)
+	}
+}
+
+// One channel looked up, against tables of growing size
+func BenchmarkPercentForTime(b *testing.B) {
+	initLtables()
+	for _, points := range []int{4, 16, 96, 720} {
+		b.Run(fmt.Sprintf("points=%d", points), func(b *testing.B) {
+			c, err := compileTable(sizedTable(points, 8))
+			if err != nil {
+				b.Fatal(err)
+			}
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				c.percentAt(i%secondsPerDay, i%8)
+			}
+		})
+	}
+}
+
+// Every channel of every zone's frame, one tick's evaluation
+func BenchmarkFrame(b *testing.B) {
+	initLtables()
+	for _, channels := range []int{8, 16} {
+		for _, zones := range []int{1, 16, 64} {
+			b.Run(fmt.Sprintf("channels=%d/zones=%d", channels, zones), func(b *testing.B) {
+				tables := make([]*compiledTable, zones)
+				for z := range tables {
+					c, err := compileTable(sizedTable(96, channels))
+					if err != nil {
+						b.Fatal(err)
+					}
+					tables[z] = c
+				}
+				out := make([]float64, channels)
+				b.ReportAllocs()
+				b.ResetTimer()
+				for i := 0; i < b.N; i++ {
+					at := float64(i % secondsPerDay)
+					for _, c := range tables {
+						c.percentsAt(at, out)
+					}
+				}
+			})
+		}
+	}
+}
+
+// A whole driver update, overrides and logging included, into a fake
+// channel
+func BenchmarkUpdate(b *testing.B) {
+	initLtables()
+	log.SetOutput(ioutil.Discard)
+	defer log.SetOutput(os.Stderr)
+	for _, zones := range []int{1, 16, 256} {
+		b.Run(fmt.Sprintf("zones=%d", zones), func(b *testing.B) {
+			f := &fakeChannel{levels: make(map[int]float64), zones: make(map[string]map[int]float64)}
+			ld := &LightDriver{ble: f, overrides: map[int]override{3: {percent: 50}}}
+			for z := 0; z < zones; z++ {
+				c, err := compileTable(dayTable())
+				if err != nil {
+					b.Fatal(err)
+				}
+				ld.zones = append(ld.zones, &zoneTable{name: fmt.Sprint("zone", z), table: c,
+					percents: make([]float64, 8), set: make([]bool, 8)})
+			}
+			now := time.Now()
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				ld.update(now.Add(time.Duration(i) * time.Second))
+			}
+		})
+	}
+}
+
+// Zones evaluated by several workers come out as they do one at a time
+func TestParallelZones(t *testing.T) {
+	initLtables()
+	build := func() *LightDriver {
+		ld := &LightDriver{overrides: map[int]override{3: {percent: 50}}}
+		for z := 0; z < 4*zonesPerWorker+5; z++ {
+			c, err := compileTable(sizedTable(24+z%7, 8))
+			if err != nil {
+				t.Fatal(err)
+			}
+			ld.zones = append(ld.zones, &zoneTable{name: fmt.Sprint("zone", z), table: c,
+				percents: make([]float64, 8), set: make([]bool, 8)})
+		}
+		return ld
+	}
+	now := time.Date(2020, 6, 1, 9, 30, 15, 0, timeLocation)
+	one, many := build(), build()
+	one.evaluateZones(now, 1)
+	many.evaluateZones(now, 4)
+	for i, z := range one.zones {
+		p := many.zones[i]
+		if !reflect.DeepEqual(z.percents, p.percents) || !reflect.DeepEqual(z.set, p.set) ||
+			z.rising != p.rising || !z.due.Equal(p.due) {
+			t.Fatalf("%s: %v %v rising %g due %v alone, %v %v rising %g due %v together", z.name,
+				z.percents, z.set, z.rising, z.due, p.percents, p.set, p.rising, p.due)
+		}
+	}
+	if z := many.zones[0]; z.percents[3] != 50 || !z.set[0] || !z.due.After(now) {
+		t.Errorf("zone 0 at %v, set %v, due %v", z.percents, z.set, z.due)
+	}
+}
+
+func TestCurves(t *testing.T) {
+	initLtables()
+
+	sps := settingPoints{
+		{At: "8:00", Percents: percents1, Curve: "cubic"},
+		{At: "10:00", Percents: []float64{80, 40}, Curve: "cubic"},
+		{At: "12:00", Percents: percents2, Curve: "sine"},
+		{At: "18:00", Percents: percents1},
+	}
+	c, err := compileTable(sps)
+	if err != nil {
+		t.Fatal(err)
+	}
+	at := func(h, m int) float64 {
+		return c.percentForTime(time.Date(2016, 1, 1, h, m, 0, 0, timeLocation), 0)
+	}
+	if at(8, 0) != 0 || at(10, 0) != 80 || at(12, 0) != 100 || at(18, 0) != 0 {
+		t.Error("curves miss their setpoints")
+	}
+	// The cubic rises without overshooting either end
+	last := 0.0
+	for m := 8 * 60; m <= 12*60; m += 5 {
+		v := at(m/60, m%60)
+		if v < last || v > 100 {
+			t.Fatalf("cubic not monotone at %d:%02d: %f after %f", m/60, m%60, v, last)
+		}
+		last = v
+	}
+	// The sine eases out of 12:00 and lands halfway at 15:00
+	if v := at(12, 30); v < 95 {
+		t.Errorf("sine at 12:30 is %f, not eased", v)
+	}
+	if v := at(15, 0); v != 50 {
+		t.Errorf("sine at 15:00 is %f, want 50", v)
+	}
+
+	points := c.schedulePoints()
+	if len(points) <= len(sps) || len(points) > 24 {
+		t.Errorf("%d schedule points for curves", len(points))
+	}
+	for i, p := range points {
+		if i > 0 && p.Minute <= points[i-1].Minute {
+			t.Fatalf("schedule out of order at %d", i)
+		}
+	}
+	linear, _ := compileTable(settingPoints{{At: "8:00", Percents: percents1}, {At: "12:00", Percents: percents2}})
+	if n := len(linear.schedulePoints()); n != 2 {
+		t.Errorf("%d schedule points for a linear table", n)
+	}
+
+	if _, err := compileTable(settingPoints{{At: "8:00", Percents: percents, Curve: "wiggly"}}); err == nil {
+		t.Error("compiled an unknown curve")
+	}
+}
+
+func TestSunTimes(t *testing.T) {
+	initLtables()
+
+	// Los Angeles on the solstice: 5:42 to 20:08 PDT
+	day := time.Date(2016, 6, 21, 0, 0, 0, 0, timeLocation)
+	rise, set, _ := sunTimes(day, 34.05, -118.24)
+	near := func(got time.Time, h, m int) bool {
+		want := time.Date(2016, 6, 21, h, m, 0, 0, timeLocation)
+		d := got.Sub(want)
+		return d > -3*time.Minute && d < 3*time.Minute
+	}
+	if !near(rise, 5, 42) || !near(set, 20, 8) {
+		t.Errorf("sun %s to %s", rise.In(timeLocation), set.In(timeLocation))
+	}
+	if rise, _, up := sunTimes(day, 80, 0); !rise.IsZero() || !up {
+		t.Error("no midnight sun at 80N in June")
+	}
+	if rise, _, up := sunTimes(time.Date(2016, 12, 21, 0, 0, 0, 0, timeLocation), 80, 0); !rise.IsZero() || up {
+		t.Error("no polar night at 80N in December")
+	}
+
+	// Full on 2016-06-20, new on 2016-07-04
+	if lit := moonIllumination(time.Date(2016, 6, 20, 11, 0, 0, 0, time.UTC)); lit < 0.98 {
+		t.Errorf("full moon %f lit", lit)
+	}
+	if lit := moonIllumination(time.Date(2016, 7, 4, 11, 0, 0, 0, time.UTC)); lit > 0.02 {
+		t.Errorf("new moon %f lit", lit)
+	}
+}
+
+func TestAstroTable(t *testing.T) {
+	initLtables()
+
+	a := &astroTable{Latitude: 34.05, Longitude: -118.24, RampMinutes: 60,
+		Day: []float64{100, 80}, Moon: []float64{0, 10}}
+	c, err := a.compile(time.Date(2016, 6, 20, 0, 0, 0, 0, timeLocation))
+	if err != nil {
+		t.Fatal(err)
+	}
+	out := make([]float64, 2)
+	c.percentsAt(13*3600, out)
+	if out[0] != 100 || out[1] != 80 {
+		t.Errorf("midday %v", out)
+	}
+	c.percentsAt(3600, out)
+	if out[0] != 0 || out[1] < 9.8 {
+		t.Errorf("full moon night %v", out)
+	}
+
+	a.Moon = []float64{0}
+	if _, err := a.compile(time.Now()); err == nil {
+		t.Error("compiled mismatched day and moon levels")
+	}
+}
+
+func TestSeasonalTable(t *testing.T) {
+	initLtables()
+
+	// Winter days 8:00-16:00 at 40%, summer 6:00-20:00 at 100%
+	config := []byte(`{"seasons": [
+		{"date": "06-21", "table": [{"at": "0:00", "percents": [0]}, {"at": "6:00", "percents": [0]},
+			{"at": "7:00", "percents": [100]}, {"at": "20:00", "percents": [0]}]},
+		{"date": "12-21", "table": [{"at": "0:00", "percents": [0]}, {"at": "8:00", "percents": [0]},
+			{"at": "9:00", "percents": [40]}, {"at": "16:00", "percents": [0]}]}]}`)
+	zones, _, err := parseZones(config)
+	if err != nil {
+		t.Fatal(err)
+	}
+	s := zones[0].seasons
+	for _, c := range []struct {
+		day   time.Time
+		rise  string
+		level float64
+	}{
+		{time.Date(2016, 6, 21, 0, 0, 0, 0, timeLocation), "6:00", 100},
+		{time.Date(2016, 12, 21, 0, 0, 0, 0, timeLocation), "8:00", 40},
+		// Halfway between, both ways round the year
+		{time.Date(2016, 9, 20, 0, 0, 0, 0, timeLocation), "7:00", 70},
+		{time.Date(2017, 3, 22, 0, 0, 0, 0, timeLocation), "7:00", 70},
+	} {
+		sps := s.settingPoints(c.day)
+		if sps[1].At != c.rise || math.Abs(sps[2].Percents[0]-c.level) > 0.5 {
+			t.Errorf("%s: rise %s at %v, want %s at %v", c.day.Format("2006-01-02"),
+				sps[1].At, sps[2].Percents[0], c.rise, c.level)
+		}
+	}
+
+	for _, bad := range []string{
+		`{"seasons": []}`,
+		`{"seasons": [{"date": "June", "table": [{"at": "0:00", "percents": [1]}]}]}`,
+		`{"seasons": [{"date": "06-21", "table": [{"at": "0:00", "percents": [1]}]},
+			{"date": "12-21", "table": [{"at": "0:00", "percents": [1]}, {"at": "1:00", "percents": [2]}]}]}`,
+		`{"seasons": [{"date": "06-21", "table": [{"at": "0:00", "percents": [1]}]},
+			{"date": "12-21", "table": [{"at": "0:00", "percents": [1, 2]}]}]}`,
+	} {
+		if _, _, err := parseZones([]byte(bad)); err == nil {
+			t.Errorf("parsed %s", bad)
+		}
+	}
+}
+
+// Records what a light driver sets, the rest of the channel unused
+type fakeChannel struct {
+	ble.BLEChannel
+	levels map[int]float64
+	zones  map[string]map[int]float64
+	held   bool
+	// Last zones placed
+	zoneMaps map[string]ble.ZoneMap
+}
+
+func (f *fakeChannel) SetZoneChannel(zone string, channel int, percent float64) error {
+	if zone == "" {
+		f.levels[channel] = percent
+		return nil
+	}
+	if f.zones[zone] == nil {
+		f.zones[zone] = make(map[int]float64)
+	}
+	f.zones[zone][channel] = percent
+	return nil
+}
+func (f *fakeChannel) SetZones(zones map[string]ble.ZoneMap) error {
+	f.zoneMaps = zones
+	return nil
+}
+func (f *fakeChannel) SetZoneSchedule(string, *time.Location, []ble.SchedulePoint) error {
+	return nil
+}
+func (f *fakeChannel) SetZoneFanLead(string, float64) error { return nil }
+func (f *fakeChannel) HoldSchedule(hold bool)               { f.held = hold }
+func (f *fakeChannel) Flush() error                         { return nil }
+
+func TestOverrides(t *testing.T) {
+	initLtables()
+
+	table, err := compileTable(settingPoints{{At: "0:00", Percents: []float64{10, 20}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	f := &fakeChannel{levels: make(map[int]float64)}
+	z := &zoneTable{table: table, percents: make([]float64, 2), set: make([]bool, 2)}
+	ld := &LightDriver{ble: f, clock: clock.Real, zones: []*zoneTable{z}, overrides: make(map[int]override)}
+
+	if err := ld.Override(1, 75, time.Hour); err != nil {
+		t.Fatal(err)
+	}
+	if f.levels[0] != 10 || f.levels[1] != 75 || !f.held {
+		t.Errorf("override %v held %v", f.levels, f.held)
+	}
+	if err := ld.Override(maxChannels, 50, 0); err == nil {
+		t.Error("overrode a channel past the table")
+	}
+
+	// Paused, only the override still writes
+	ld.Pause()
+	f.levels = make(map[int]float64)
+	ld.updateChannels()
+	if _, ok := f.levels[0]; ok || f.levels[1] != 75 {
+		t.Errorf("paused %v", f.levels)
+	}
+	ld.Resume()
+
+	// Expired, the table takes the channel back
+	ld.lock.Lock()
+	ld.overrides[1] = override{percent: 75, until: time.Now().Add(-time.Second)}
+	ld.lock.Unlock()
+	ld.updateChannels()
+	if f.levels[1] != 20 || f.held || len(ld.overrides) != 0 {
+		t.Errorf("expired override %v held %v", f.levels, f.held)
+	}
+}
+
+func TestZones(t *testing.T) {
+	initLtables()
+
+	config := []byte(`{"zones": [
+		{"name": "reef", "bricks": ["a", "b"], "channels": [3, 1],
+		 "table": [{"at": "0:00", "percents": [10, 20]}]},
+		{"name": "frag", "bricks": ["c"],
+		 "table": [{"at": "0:00", "percents": [1, 2, 3, 4, 5, 6, 7, 8]}]}]}`)
+	f := &fakeChannel{levels: make(map[int]float64), zones: make(map[string]map[int]float64)}
+	ld, err := NewLightDriverFromJson(f, config)
+	if err != nil {
+		t.Fatal(err)
+	}
+	ld.Stop()
+	if len(f.levels) != 0 {
+		t.Errorf("zoned config set bricks in no zone %v", f.levels)
+	}
+	if len(f.zones["reef"]) != 2 || f.zones["reef"][1] != 20 {
+		t.Errorf("reef %v", f.zones["reef"])
+	}
+	if len(f.zones["frag"]) != 8 || f.zones["frag"][7] != 8 {
+		t.Errorf("frag %v", f.zones["frag"])
+	}
+
+	same := []byte(`{"zones": [{"name": "a", "table": [{"at": "0:00", "percents": [1]}]},
+		{"name": "b", "table": [ {"at": "0:00",  "percents": [1]} ]}]}`)
+	zones, _, err := parseZones(same)
+	if err != nil || zones[0].table != zones[1].table {
+		t.Error("zones with the same setpoints compiled them twice")
+	}
+	if len(zones[0].percents) != 1 {
+		t.Errorf("zone without a channel map evaluates %d channels", len(zones[0].percents))
+	}
+
+	// Each zone's table the size of its channel map
+	bad := []byte(`{"zones": [{"name": "reef", "bricks": ["a"], "channels": [0],
+		"table": [{"at": "0:00", "percents": [10, 20]}]}]}`)
+	if _, _, err := parseZones(bad); err == nil {
+		t.Error("parsed a zone table wider than its channels")
+	}
+	dup := []byte(`{"zones": [{"name": "reef", "table": [{"at": "0:00", "percents": [1]}]},
+		{"name": "reef", "table": [{"at": "0:00", "percents": [1]}]}]}`)
+	if _, _, err := parseZones(dup); err == nil {
+		t.Error("parsed two zones with one name")
+	}
+}
+
+func TestReload(t *testing.T) {
+	initLtables()
+
+	f := &fakeChannel{levels: make(map[int]float64), zones: make(map[string]map[int]float64)}
+	ld, err := NewLightDriverFromJson(f, []byte(`[{"at": "0:00", "percents": [10, 20]}]`))
+	if err != nil {
+		t.Fatal(err)
+	}
+	ld.Stop()
+	ld.Override(0, 90, 0)
+
+	if err := ld.Reload([]byte(`[{"at": "0:00", "percents": [30, 40]}]`)); err != nil {
+		t.Fatal(err)
+	}
+	if f.levels[0] != 90 || f.levels[1] != 40 {
+		t.Errorf("reloaded %v, want the override kept over the new table", f.levels)
+	}
+	if err := ld.Reload([]byte(`[{"at": "25:00", "percents": [0, 0]}]`)); err == nil {
+		t.Error("reloaded a bad table")
+	}
+	if ld.zones[0].table.channels != 2 || f.levels[1] != 40 {
+		t.Error("bad table replaced the old one")
+	}
+
+	zoned := []byte(`{"zones": [{"name": "reef", "bricks": ["a"],
+		"table": [{"at": "0:00", "percents": [1, 2, 3, 4, 5, 6, 7, 8]}]}]}`)
+	if err := ld.Reload(zoned); err != nil {
+		t.Fatal(err)
+	}
+	if len(f.zoneMaps) != 1 || f.zones["reef"][7] != 8 {
+		t.Errorf("zones %v levels %v", f.zoneMaps, f.zones)
+	}
+}
+
+func TestCrossfade(t *testing.T) {
+	initLtables()
+
+	start := time.Date(2016, 1, 1, 12, 0, 0, 0, timeLocation)
+	sim := clock.NewSim(start)
+	f := &fakeChannel{levels: make(map[int]float64), zones: make(map[string]map[int]float64)}
+	ld, err := NewLightDriverWithClock(f, []byte(`[{"at": "0:00", "percents": [10]}]`), sim)
+	if err != nil {
+		t.Fatal(err)
+	}
+	ld.Stop()
+	if err := ld.SetCrossfade(2 * time.Hour); err == nil {
+		t.Error("crossfade past the firmware's accepted")
+	}
+	if err := ld.SetCrossfade(10 * time.Minute); err != nil {
+		t.Fatal(err)
+	}
+	if err := ld.Reload([]byte(`[{"at": "0:00", "percents": [50]}]`)); err != nil {
+		t.Fatal(err)
+	}
+	if f.levels[0] != 10 {
+		t.Errorf("jumped to %g%% on reload", f.levels[0])
+	}
+	sim.Advance(5 * time.Minute)
+	ld.updateChannels()
+	if math.Abs(f.levels[0]-30) > 0.01 {
+		t.Errorf("%g%% halfway through the crossfade", f.levels[0])
+	}
+	sim.Advance(5 * time.Minute)
+	ld.updateChannels()
+	if f.levels[0] != 50 || ld.zones[0].blend != nil {
+		t.Errorf("%g%% after the crossfade", f.levels[0])
+	}
+}
+
+func TestFanLeadRise(t *testing.T) {
+	initLtables()
+
+	table, err := compileTable(settingPoints{{At: "8:00", Percents: []float64{0, 0}},
+		{At: "10:00", Percents: []float64{100, 50}}, {At: "18:00", Percents: []float64{100, 50}},
+		{At: "20:00", Percents: []float64{0, 0}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	z := &zoneTable{table: table, percents: make([]float64, 2), set: make([]bool, 2)}
+	day := time.Date(2016, 1, 1, 0, 0, 0, 0, timeLocation)
+	rise := func(at time.Duration) float64 {
+		z.evaluate(day.Add(at), z.percents)
+		return z.rise(day.Add(at))
+	}
+	if r := rise(9 * time.Hour); math.Abs(r-6.25) > 0.5 {
+		t.Errorf("%g%% rise on the morning ramp", r)
+	}
+	if r := rise(23*time.Hour + 55*time.Minute); r != 0 || !z.clock.contains(day.Add(23*time.Hour)) {
+		t.Errorf("%g%% rise at night, or the clock moved on to tomorrow", r)
+	}
+	if r := rise(12 * time.Hour); r != 0 {
+		t.Errorf("%g%% rise at noon", r)
+	}
+	if r := rise(19 * time.Hour); r != 0 {
+		t.Errorf("%g%% rise with the lights going down", r)
+	}
+}
+
+func TestWatchFile(t *testing.T) {
+	dir, err := ioutil.TempDir("", "ltable")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer os.RemoveAll(dir)
+	path := filepath.Join(dir, "table.json")
+	if err := ioutil.WriteFile(path, []byte("[]"), 0644); err != nil {
+		t.Fatal(err)
+	}
+	changed := make(chan struct{}, 1)
+	if err := watchFile(path, func() { changed <- struct{}{} }); err != nil {
+		t.Fatal(err)
+	}
+	// Replaced the way editors save
+	tmp := filepath.Join(dir, "table.json.new")
+	ioutil.WriteFile(tmp, []byte("[ ]"), 0644)
+	os.Rename(tmp, path)
+	select {
+	case <-changed:
+	case <-time.After(5 * time.Second):
+		t.Error("no change seen")
+	}
+}
+
+// Records the schedules placed, per zone
+type scheduleChannel struct {
+	fakeChannel
+	schedules map[string][]ble.SchedulePoint
+}
+
+func (s *scheduleChannel) SetZoneSchedule(zone string, loc *time.Location, points []ble.SchedulePoint) error {
+	s.schedules[zone] = points
+	return nil
+}
+
+func TestAcclimation(t *testing.T) {
+	initLtables()
+
+	a := &acclimation{Start: "2016-06-20", FromPercent: 20, Days: 10}
+	if err := a.check(); err != nil {
+		t.Fatal(err)
+	}
+	for _, c := range []struct {
+		day  time.Time
+		want float64
+	}{
+		{time.Date(2016, 6, 1, 0, 0, 0, 0, timeLocation), 0.2},
+		{time.Date(2016, 6, 20, 0, 0, 0, 0, timeLocation), 0.2},
+		{time.Date(2016, 6, 25, 0, 0, 0, 0, timeLocation), 0.6},
+		{time.Date(2016, 7, 30, 0, 0, 0, 0, timeLocation), 1},
+	} {
+		if got := a.capOn(c.day); math.Abs(got-c.want) > 1e-9 {
+			t.Errorf("%s: cap %v, want %v", c.day.Format("2006-01-02"), got, c.want)
+		}
+	}
+	// Across the clocks going back, still whole days
+	if got := a.capOn(time.Date(2016, 11, 7, 0, 0, 0, 0, timeLocation)); got != 1 {
+		t.Errorf("cap %v after the clocks changed", got)
+	}
+
+	f := &scheduleChannel{fakeChannel: fakeChannel{levels: make(map[int]float64)},
+		schedules: make(map[string][]ble.SchedulePoint)}
+	start := time.Now().In(timeLocation).AddDate(0, 0, -5).Format("2006-01-02")
+	config := []byte(`{"acclimation": {"start": "` + start + `", "from_percent": 20, "days": 10},
+		"table": [{"at": "0:00", "percents": [50, 100]}]}`)
+	ld, err := NewLightDriverFromJson(f, config)
+	if err != nil {
+		t.Fatal(err)
+	}
+	ld.Stop()
+	if math.Abs(f.levels[0]-30) > 1e-9 || math.Abs(f.levels[1]-60) > 1e-9 {
+		t.Errorf("levels %v, want 60%% of the table", f.levels)
+	}
+	if p := f.schedules[""]; len(p) == 0 || math.Abs(p[0].Percents[1]-60) > 1e-9 {
+		t.Errorf("schedule %v, want 60%% of the table", p)
+	}
+
+	for _, bad := range []string{
+		`{"acclimation": {"start": "June", "from_percent": 20, "days": 10}, "table": [{"at": "0:00", "percents": [1]}]}`,
+		`{"acclimation": {"start": "2016-06-20", "from_percent": 120, "days": 10}, "table": [{"at": "0:00", "percents": [1]}]}`,
+		`{"zones": [{"name": "reef", "acclimation": {"start": "2016-06-20", "days": 0},
+			"table": [{"at": "0:00", "percents": [1]}]}]}`,
+	} {
+		if _, _, err := parseZones([]byte(bad)); err == nil {
+			t.Errorf("parsed %s", bad)
+		}
+	}
+}
+
+// Bricks derating by their own amounts, in no zone
+type derateChannel struct {
+	fakeChannel
+	bricks []ble.BLEPeripheral
+}
+
+type deratedBrick struct {
+	ble.BLEPeripheral
+	id     string
+	derate int
+}
+
+func (b deratedBrick) ID() string  { return b.id }
+func (b deratedBrick) Derate() int { return b.derate }
+
+func (f *derateChannel) Perhipherals() []ble.BLEPeripheral { return f.bricks }
+
+func TestDLI(t *testing.T) {
+	initLtables()
+
+	// 50% all day at 500 µmol/m²/s from full is 21.6 mol/m²
+	table, err := compileTable(settingPoints{{At: "0:00", Percents: []float64{50}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	par := []float64{500}
+	if got := table.dli(par, 1, 0); math.Abs(got-21.6) > 1e-6 {
+		t.Errorf("day of the table gives %g mol/m²", got)
+	}
+	if s := table.dliScale(par, 10.8, 0, 0, table.dliMaxScale()); math.Abs(s-0.5) > 1e-6 {
+		t.Errorf("scale %g for half the light", s)
+	}
+	// Past full every channel clips, so the scale stops where it does
+	if s := table.dliScale(par, 80, 0, 0, table.dliMaxScale()); s != 2 {
+		t.Errorf("scale %g for more than full gives", s)
+	}
+
+	start := time.Date(2016, 6, 1, 0, 0, 0, 0, timeLocation)
+	z := &zoneTable{table: table, cap: 1, percents: make([]float64, 1), set: []bool{true},
+		target: &dliTarget{Target: 10.8, PAR: par}}
+	z.planDLI(table, start)
+	z.evaluate(start, z.percents)
+	if math.Abs(z.percents[0]-25) > 1e-6 {
+		t.Errorf("%g%%, want the table at half", z.percents[0])
+	}
+	// An hour overridden dark, then the rest of the day makes it up
+	z.recordDLI(z.target.ppfd(z.percents), []float64{0}, z.set, 1)
+	if !z.trackDLI(start.Add(time.Hour)) {
+		t.Fatal("an hour dark didn't scale the table")
+	}
+	if want := 10.8 / (21.6 * 23 / 24); math.Abs(z.dli.scale-want) > 1e-3 {
+		t.Errorf("scaled to %g, want %g", z.dli.scale, want)
+	}
+	// Derating short of the plan counts the same, a little isn't worth
+	// a new schedule
+	z.evaluate(start.Add(time.Hour), z.percents)
+	z.recordDLI(z.target.ppfd(z.percents), z.percents, z.set, 0.99)
+	if z.trackDLI(start.Add(2 * time.Hour)) {
+		t.Error("scaled for a 1% derate over an hour")
+	}
+
+	f := &derateChannel{fakeChannel: fakeChannel{levels: make(map[int]float64)},
+		bricks: []ble.BLEPeripheral{deratedBrick{id: "a", derate: 100}}}
+	ld, err := NewLightDriverFromJson(f, []byte(`{"dli": {"target": 10.8, "par": [500]},
+		"table": [{"at": "0:00", "percents": [50]}]}`))
+	if err != nil {
+		t.Fatal(err)
+	}
+	ld.Stop()
+	if math.Abs(f.levels[0]-25) > 1e-6 {
+		t.Errorf("levels %v, want the table at half", f.levels)
+	}
+
+	for _, bad := range []string{
+		`{"dli": {"target": 0, "par": [500]}, "table": [{"at": "0:00", "percents": [1]}]}`,
+		`{"dli": {"target": 12, "par": [0]}, "table": [{"at": "0:00", "percents": [1]}]}`,
+		`{"zones": [{"name": "reef", "dli": {"target": 12, "par": [-1]},
+			"table": [{"at": "0:00", "percents": [1]}]}]}`,
+	} {
+		if _, _, err := parseZones([]byte(bad)); err == nil {
+			t.Errorf("parsed %s", bad)
+		}
+	}
+}
+
+func TestPreview(t *testing.T) {
+	initLtables()
+
+	config := `{"zones": [
+		{"name": "reef", "bricks": ["a", "b"], "table": [{"at": "0:00", "percents": [50, 100]}],
+			"acclimation": {"start": "2016-06-20", "from_percent": 20, "days": 10}},
+		{"name": "sump", "table": [{"at": "0:00", "percents": [100, 0]}]}]}`
+	day := time.Date(2016, 6, 25, 15, 0, 0, 0, timeLocation)
+	p, err := renderPreview([]byte(config), day, nil)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if p.Date != "2016-06-25" || len(p.Zones) != 2 || p.Watts != nil {
+		t.Fatalf("preview of %s, %d zones", p.Date, len(p.Zones))
+	}
+	reef := p.Zones[0]
+	if len(reef.Minutes) != minutesPerDay || reef.Scale != 0.6 {
+		t.Fatalf("%d minutes scaled by %g", len(reef.Minutes), reef.Scale)
+	}
+	if got := reef.Minutes[12*60]; !reflect.DeepEqual(got, []float64{30, 60}) {
+		t.Errorf("noon at %v, want 60%% of the table", got)
+	}
+
+	// Two reef bricks at 24 W and a sump brick at 40 W, on a 44 W supply
+	budget := &previewBudget{Watts: 44, ChannelWatts: []float64{40, 20}, Bricks: 1}
+	if p, err = renderPreview([]byte(config), day, budget); err != nil {
+		t.Fatal(err)
+	}
+	if p.Budget[0] != 0.5 || p.Watts[0] != 44 {
+		t.Errorf("scaled by %g to %g W", p.Budget[0], p.Watts[0])
+	}
+	if got := p.Zones[0].Minutes[0]; !reflect.DeepEqual(got, []float64{15, 30}) {
+		t.Errorf("reef at %v under the budget", got)
+	}
+
+	r := httptest.NewRequest("POST", "/api/preview?date=2016-06-25&watts=44&channel_watts=40,20", strings.NewReader(config))
+	if p, err = previewRequest(r, time.Now()); err != nil {
+		t.Fatal(err)
+	}
+	if p.Date != "2016-06-25" || p.Budget[0] != 0.5 {
+		t.Errorf("request previewed %s scaled by %g", p.Date, p.Budget[0])
+	}
+
+	for _, bad := range []string{
+		"/api/preview?date=June",
+		"/api/preview?watts=44",
+		"/api/preview?watts=0&channel_watts=40",
+		"/api/preview?watts=44&channel_watts=40&bricks=0",
+	} {
+		if _, err := previewRequest(httptest.NewRequest("POST", bad, strings.NewReader(config)), time.Now()); err == nil {
+			t.Errorf("previewed %s", bad)
+		}
+	}
+	if _, err := renderPreview([]byte(`{"table": []}`), day, nil); err == nil {
+		t.Error("previewed an empty table")
+	}
+}
+
+func TestMixer(t *testing.T) {
+	// White, royal blue, cyan and violet, no red for warm light
+	emitters := []emitter{
+		{Name: "white", X: 0.31, Y: 0.32, Lumens: 180},
+		{Name: "rb", X: 0.15, Y: 0.03, Lumens: 20},
+		{Name: "cyan", X: 0.05, Y: 0.45, Lumens: 60},
+		{Name: "violet", X: 0.17, Y: 0.01, Lumens: 2},
+	}
+	m, err := newMixer(emitters)
+	if err != nil {
+		t.Fatal(err)
+	}
+	out := make([]float64, len(emitters))
+	for _, kelvin := range []float64{8000, 12345, 20000} {
+		if err := m.percents(kelvin, 100, out); err != nil {
+			t.Fatalf("%g K: %v", kelvin, err)
+		}
+		var X, Y, Z float64
+		for i, e := range emitters {
+			if out[i] < 0 || out[i] > 100+1e-9 {
+				t.Errorf("%g K: channel %d at %g", kelvin, i, out[i])
+			}
+			l := out[i] / 100 * e.Lumens
+			X += l * e.X / e.Y
+			Y += l
+			Z += l * (1 - e.X - e.Y) / e.Y
+		}
+		x, y := locus(kelvin)
+		if mx, my := X/(X+Y+Z), Y/(X+Y+Z); math.Abs(mx-x) > 0.002 || math.Abs(my-y) > 0.002 {
+			t.Errorf("%g K mixed to %.4f, %.4f, want %.4f, %.4f", kelvin, mx, my, x, y)
+		}
+	}
+	half := make([]float64, len(emitters))
+	m.percents(12345, 50, half)
+	m.percents(12345, 100, out)
+	for i := range out {
+		if math.Abs(half[i]*2-out[i]) > 1e-9 {
+			t.Errorf("intensity doesn't scale channel %d: %g, %g", i, half[i], out[i])
+		}
+	}
+	if err := m.percents(2000, 100, out); err == nil {
+		t.Error("mixed warm light without a warm emitter")
+	}
+	if err := m.percents(100000, 100, out); err == nil {
+		t.Error("mixed past the locus")
+	}
+
+	config := `{"emitters": [{"x": 0.31, "y": 0.32, "lumens": 180}, {"x": 0.15, "y": 0.03, "lumens": 20},
+		{"x": 0.05, "y": 0.45, "lumens": 60}, {"x": 0.17, "y": 0.01, "lumens": 2}],
+		"table": [{"at": "00:00", "percents": [0, 0, 0, 0]}, {"at": "12:00", "cct": 12345, "intensity": 50}]}`
+	zones, _, err := parseZones([]byte(config))
+	if err != nil {
+		t.Fatal(err)
+	}
+	got := make([]float64, len(emitters))
+	zones[0].table.levelsAt(12*3600, got)
+	for i := range got {
+		if math.Abs(got[i]-half[i]) > 1e-9 {
+			t.Errorf("table channel %d at %g, want %g", i, got[i], half[i])
+		}
+	}
+	if _, _, err := parseZones([]byte(`[{"at": "00:00", "cct": 6500, "intensity": 10}]`)); err == nil {
+		t.Error("colour temperature taken without emitters")
+	}
+}
+
+// Records the work handed to the bricks
+type cueChannel struct {
+	fakeChannel
+	fades   []time.Duration
+	weather []ble.Weather
+}
+
+func (c *cueChannel) FadeOver(d time.Duration) error {
+	c.fades = append(c.fades, d)
+	return nil
+}
+func (c *cueChannel) StartWeather(w ble.Weather) error {
+	c.weather = append(c.weather, w)
+	return nil
+}
+
+func TestCues(t *testing.T) {
+	initLtables()
+
+	cues, err := parseCues([]byte(`{"cues": [
+		{"name": "feed", "at": "18:00", "for": "10m", "fade": "30s", "table": 20},
+		{"name": "storm", "at": "2016-01-01T20:00:00-08:00", "for": "1h",
+		 "weather": {"kind": "storm", "cloud_depth": 50, "cloud_seconds": 20}},
+		{"name": "dawn", "at": "23:00", "for": "2h", "fade": "10m", "percents": {"1": 100}}]}`))
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, bad := range []string{
+		`{"cues": [{"name": "a", "at": "18:00", "for": "1m", "fade": "40s"}]}`,
+		`{"cues": [{"name": "a", "at": "soon", "for": "1m"}]}`,
+		`{"cues": [{"name": "a", "at": "18:00", "for": "1m", "percents": {"16": 1}}]}`,
+		`{"cues": [{"name": "a", "at": "18:00", "for": "1m"}, {"name": "a", "at": "19:00", "for": "1m"}]}`,
+	} {
+		if _, err := parseCues([]byte(bad)); err == nil {
+			t.Errorf("parsed %s", bad)
+		}
+	}
+
+	day := time.Date(2016, 1, 1, 0, 0, 0, 0, timeLocation)
+	events := compileCues(cues, day, day.AddDate(0, 0, 1))
+	for i := 1; i < len(events); i++ {
+		if events[i].at.Before(events[i-1].at) {
+			t.Fatalf("events out of order at %d", i)
+		}
+	}
+	// Feed today, the storm, dawn from the night before and tonight
+	if len(events) != 8 {
+		t.Errorf("%d events", len(events))
+	}
+
+	table, err := compileTable(settingPoints{{At: "0:00", Percents: []float64{50, 10}}})
+	if err != nil {
+		t.Fatal(err)
+	}
+	sim := clock.NewSim(day.Add(17 * time.Hour))
+	f := &cueChannel{fakeChannel: fakeChannel{levels: make(map[int]float64)}}
+	z := &zoneTable{table: table, percents: make([]float64, 2), set: make([]bool, 2), cap: 1}
+	ld := &LightDriver{ble: f, clock: sim, zones: []*zoneTable{z}, overrides: make(map[int]override),
+		wake: make(chan struct{}, 1)}
+	ld.timeline.setCues(cues)
+	at := func(d time.Duration) {
+		sim.Advance(day.Add(d).Sub(sim.Now()))
+		ld.updateChannels()
+	}
+	at(17 * time.Hour)
+	if next := ld.timeline.next(); !next.Equal(day.Add(18 * time.Hour)) {
+		t.Errorf("next update %v", next)
+	}
+
+	// The bricks run the fade in, the channels go straight to the cue
+	at(18 * time.Hour)
+	if f.levels[0] != 10 || f.levels[1] != 2 || !f.held || len(f.fades) != 1 || f.fades[0] != 30*time.Second {
+		t.Errorf("feeding %v held %v fades %v", f.levels, f.held, f.fades)
+	}
+	at(18*time.Hour + 10*time.Minute)
+	if f.levels[0] != 50 || f.held || len(f.fades) != 2 {
+		t.Errorf("fed %v held %v fades %v", f.levels, f.held, f.fades)
+	}
+
+	// Weather goes to the bricks for what's left of the cue
+	at(20*time.Hour + 30*time.Minute)
+	if len(f.weather) != 1 || f.weather[0].Kind != "storm" || f.weather[0].Seconds != 1800 {
+		t.Errorf("weather %v", f.weather)
+	}
+
+	// Streamed, the fade is followed a second at a time
+	at(23*time.Hour + 5*time.Minute)
+	if math.Abs(f.levels[1]-55) > 0.01 || len(f.fades) != 2 || !ld.nextAt.Equal(sim.Now().Add(time.Second)) {
+		t.Errorf("dawn %v fades %v next %v", f.levels, f.fades, ld.nextAt)
+	}
+
+	// Started and stopped through the API, over what's running
+	if err := ld.startCue(cueConfig{Name: "photo", For: "20m", Percents: map[int]float64{0: 100}}); err != nil {
+		t.Fatal(err)
+	}
+	if f.levels[0] != 100 || len(ld.timeline.running) != 2 {
+		t.Errorf("photo %v", f.levels)
+	}
+	if err := ld.stopCue("photo"); err != nil || f.levels[0] != 50 {
+		t.Errorf("photo stopped %v %v", f.levels, err)
+	}
+	if err := ld.stopCue("photo"); err == nil {
+		t.Error("stopped a cue not running")
+	}
+}
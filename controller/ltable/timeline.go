@@ -0,0 +1,383 @@
+package ltable
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"log"
+	"math"
+	"sort"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// Cues are scripted sequences over the daily tables, such as a feeding dim,
+// a storm passing or a photo mode. Each one runs from its start for its length,
+// daily at a local time or once at an instant. The cues are compiled
+// into one list of start and end events, merged in time order, a day
+// or two ahead at a time. The driver runs the events as it reaches
+// them and lays the running cues over the tables, with the overrides
+// over both. The bricks do what they can themselves: a cue's fades go
+// out as one long fade on each brick (ble.FadeOver) rather than a frame
+// every write interval, and its weather runs as the bricks' own
+// effect. Fades longer than one write carries are streamed.
+type cueConfig struct {
+	Name string `json:"name"`
+	// "18:30" daily in the table's time zone, or an RFC 3339 time once
+	At  string `json:"at"`
+	For string `json:"for"`
+	// Into the cue and back out of it, a step when empty
+	Fade string `json:"fade,omitempty"`
+	// Channels set while the cue runs
+	Percents map[int]float64 `json:"percents,omitempty"`
+	// Percent of the table run on the channels the cue doesn't set, all
+	// of it when left out
+	Table *float64 `json:"table,omitempty"`
+	// Run on the bricks for the cue's length
+	Weather *ble.Weather `json:"weather,omitempty"`
+}
+
+type cue struct {
+	name string
+	// Daily at offset into the local day, else once at once
+	daily  bool
+	offset time.Duration
+	once   time.Time
+	length time.Duration
+	fade   time.Duration
+	// Percents by channel, and the share of the table elsewhere
+	percents map[int]float64
+	table    float64
+	weather  *ble.Weather
+}
+
+func (cc cueConfig) compile() (*cue, error) {
+	c := &cue{name: cc.Name, percents: cc.Percents, table: 1, weather: cc.Weather}
+	if cc.Name == "" {
+		return nil, fmt.Errorf("cue needs a name")
+	}
+	if t, err := time.Parse("15:04", cc.At); err == nil {
+		c.daily = true
+		c.offset = time.Duration(t.Hour())*time.Hour + time.Duration(t.Minute())*time.Minute
+	} else if c.once, err = time.Parse(time.RFC3339, cc.At); err != nil {
+		return nil, fmt.Errorf("cue %s: at must be 15:04 or an RFC 3339 time, got %q", cc.Name, cc.At)
+	}
+	var err error
+	if c.length, err = time.ParseDuration(cc.For); err != nil || c.length <= 0 {
+		return nil, fmt.Errorf("cue %s: needs a length, got %q", cc.Name, cc.For)
+	}
+	if c.daily && c.length > 24*time.Hour {
+		return nil, fmt.Errorf("cue %s: daily cues run at most a day, got %v", cc.Name, c.length)
+	}
+	if cc.Fade != "" {
+		if c.fade, err = time.ParseDuration(cc.Fade); err != nil {
+			return nil, fmt.Errorf("cue %s: %v", cc.Name, err)
+		}
+	}
+	if c.fade < 0 || 2*c.fade > c.length {
+		return nil, fmt.Errorf("cue %s: fades in and out must fit its length, got %v", cc.Name, c.fade)
+	}
+	for channel, percent := range c.percents {
+		if channel < 0 || channel >= maxChannels {
+			return nil, fmt.Errorf("cue %s: channel must be 0-%d, got %d", cc.Name, maxChannels-1, channel)
+		}
+		if percent < 0 || percent > 100 {
+			return nil, fmt.Errorf("cue %s: percent must be 0-100, got %g", cc.Name, percent)
+		}
+	}
+	if cc.Table != nil {
+		if *cc.Table < 0 || *cc.Table > 100 {
+			return nil, fmt.Errorf("cue %s: table share must be 0-100%%, got %g", cc.Name, *cc.Table)
+		}
+		c.table = *cc.Table / 100
+	}
+	if c.weather != nil && c.length > time.Duration(0xffff)*time.Second {
+		return nil, fmt.Errorf("cue %s: weather runs at most 65535 s, got %v", cc.Name, c.length)
+	}
+	return c, nil
+}
+
+// streamed is whether the cue's fades are too long for the bricks to run
+func (c *cue) streamed() bool {
+	return c.fade > ble.MaxWriteFade
+}
+
+// parseCues reads the cues from a config file object, none from a list
+// of setpoints
+func parseCues(data []byte) ([]*cue, error) {
+	var config struct {
+		Cues []cueConfig `json:"cues"`
+	}
+	if trimmed := bytes.TrimSpace(data); len(trimmed) == 0 || trimmed[0] != '{' {
+		return nil, nil
+	}
+	if err := json.Unmarshal(data, &config); err != nil {
+		return nil, err
+	}
+	var cues []*cue
+	names := make(map[string]bool)
+	for _, cc := range config.Cues {
+		if names[cc.Name] {
+			return nil, fmt.Errorf("cues need different names, got %q twice", cc.Name)
+		}
+		names[cc.Name] = true
+		c, err := cc.compile()
+		if err != nil {
+			return nil, err
+		}
+		cues = append(cues, c)
+	}
+	return cues, nil
+}
+
+// occurrence is one run of a cue
+type occurrence struct {
+	cue        *cue
+	start, end time.Time
+}
+
+type cueEvent struct {
+	at  time.Time
+	occ occurrence
+	end bool
+}
+
+// How far ahead the events are compiled at a time
+const cueHorizon = 48 * time.Hour
+
+// compileCues merges the runs of cues that overlap from to until into
+// one event list in time order, ends before starts at the same moment
+func compileCues(cues []*cue, from, until time.Time) []cueEvent {
+	var events []cueEvent
+	add := func(o occurrence) {
+		if o.start.Before(until) && o.end.After(from) {
+			events = append(events, cueEvent{at: o.start, occ: o}, cueEvent{at: o.end, occ: o, end: true})
+		}
+	}
+	for _, c := range cues {
+		if !c.daily {
+			add(occurrence{cue: c, start: c.once, end: c.once.Add(c.length)})
+			continue
+		}
+		// From the day before, for a run still going over midnight
+		y, m, d := from.In(timeLocation).AddDate(0, 0, -1).Date()
+		for day := time.Date(y, m, d, 0, 0, 0, 0, timeLocation); day.Before(until); day = day.AddDate(0, 0, 1) {
+			start := time.Date(day.Year(), day.Month(), day.Day(), int(c.offset/time.Hour),
+				int(c.offset%time.Hour/time.Minute), 0, 0, timeLocation)
+			add(occurrence{cue: c, start: start, end: start.Add(c.length)})
+		}
+	}
+	sort.SliceStable(events, func(i, j int) bool {
+		if !events[i].at.Equal(events[j].at) {
+			return events[i].at.Before(events[j].at)
+		}
+		return events[i].end && !events[j].end
+	})
+	return events
+}
+
+// timeline runs the cues' events as the driver reaches them
+type timeline struct {
+	// From the config, and started through the API
+	cues  []*cue
+	adhoc []*cue
+	// Events after ran, compiled up to until
+	events []cueEvent
+	until  time.Time
+	ran    time.Time
+	// In the order they started, the latest on top
+	running []occurrence
+}
+
+// setCues swaps in a config's cues, keeping those started through the
+// API. Runs going on carry over to a cue of the same name, if any.
+func (tl *timeline) setCues(cues []*cue) {
+	tl.cues = cues
+	byName := make(map[string]*cue)
+	for _, c := range tl.all() {
+		byName[c.name] = c
+	}
+	running := tl.running[:0]
+	for _, o := range tl.running {
+		if c := byName[o.cue.name]; c != nil {
+			o.cue = c
+			running = append(running, o)
+		}
+	}
+	tl.running = running
+	tl.until = time.Time{}
+}
+
+func (tl *timeline) all() []*cue {
+	return append(append([]*cue(nil), tl.cues...), tl.adhoc...)
+}
+
+// advance runs the events up to now, starting and ending cues on ch
+func (tl *timeline) advance(ch ble.BLEChannel, now time.Time) {
+	if tl.ran.IsZero() || now.Before(tl.ran) {
+		// Starting, or the clock went back: whatever covers now runs,
+		// started afresh
+		tl.ran = now
+		tl.running = nil
+		for _, e := range compileCues(tl.all(), now, now.Add(time.Nanosecond)) {
+			if !e.end && !e.at.After(now) {
+				tl.start(ch, e.occ, now)
+			}
+		}
+		tl.until = time.Time{}
+	}
+	if !now.Before(tl.until.Add(-cueHorizon / 2)) {
+		tl.recompile()
+	}
+	for len(tl.events) > 0 && !tl.events[0].at.After(now) {
+		e := tl.events[0]
+		tl.events = tl.events[1:]
+		if e.end {
+			tl.finish(ch, e.at, now)
+		} else if e.occ.end.After(now) {
+			tl.start(ch, e.occ, now)
+		}
+	}
+	tl.finish(ch, now, now)
+	tl.ran = now
+}
+
+// recompile lists the events after ran out to the horizon
+func (tl *timeline) recompile() {
+	tl.until = tl.ran.Add(cueHorizon)
+	tl.events = tl.events[:0]
+	for _, e := range compileCues(tl.all(), tl.ran, tl.until) {
+		if e.at.After(tl.ran) {
+			tl.events = append(tl.events, e)
+		}
+	}
+}
+
+func (tl *timeline) start(ch ble.BLEChannel, o occurrence, now time.Time) {
+	for _, r := range tl.running {
+		if r.cue == o.cue && r.start.Equal(o.start) {
+			return
+		}
+	}
+	tl.running = append(tl.running, o)
+	log.Printf("Cue %s until %s", o.cue.name, o.end.In(timeLocation).Format("15:04:05"))
+	tl.fade(ch, o.cue, o.start.Add(o.cue.fade).Sub(now))
+	if w := o.cue.weather; w != nil {
+		run := *w
+		run.Seconds = int(o.end.Sub(now) / time.Second)
+		if err := ch.StartWeather(run); err != nil {
+			log.Printf("Cue %s weather: %v", o.cue.name, err)
+		}
+	}
+}
+
+// finish ends the runs over as of at
+func (tl *timeline) finish(ch ble.BLEChannel, at, now time.Time) {
+	running := tl.running[:0]
+	for _, o := range tl.running {
+		if o.end.After(at) {
+			running = append(running, o)
+			continue
+		}
+		log.Printf("Cue %s over", o.cue.name)
+		tl.fade(ch, o.cue, o.cue.fade-now.Sub(o.end))
+	}
+	tl.running = running
+}
+
+// fade hands what's left of a cue's fade to the bricks, unless it's
+// streamed
+func (tl *timeline) fade(ch ble.BLEChannel, c *cue, left time.Duration) {
+	if c.fade == 0 || c.streamed() || left <= 0 {
+		return
+	}
+	if err := ch.FadeOver(left); err != nil {
+		log.Printf("Cue %s fade: %v", c.name, err)
+	}
+}
+
+// run starts c once, now
+func (tl *timeline) run(ch ble.BLEChannel, c *cue, now time.Time) {
+	c.daily, c.once = false, now
+	adhoc := tl.adhoc[:0]
+	for _, a := range tl.adhoc {
+		if a.name != c.name {
+			adhoc = append(adhoc, a)
+		}
+	}
+	tl.adhoc = append(adhoc, c)
+	tl.start(ch, occurrence{cue: c, start: now, end: now.Add(c.length)}, now)
+	tl.until = time.Time{}
+}
+
+// stop ends the runs of the cue called name now, returning whether any
+// were running
+func (tl *timeline) stop(ch ble.BLEChannel, name string, now time.Time) bool {
+	stopped := false
+	for i, o := range tl.running {
+		if o.cue.name == name {
+			tl.running[i].end = now
+			if o.cue.weather != nil {
+				if err := ch.StartWeather(ble.Weather{Kind: "off"}); err != nil {
+					log.Printf("Cue %s weather: %v", name, err)
+				}
+			}
+			stopped = true
+		}
+	}
+	adhoc := tl.adhoc[:0]
+	for _, a := range tl.adhoc {
+		if a.name != name {
+			adhoc = append(adhoc, a)
+		}
+	}
+	tl.adhoc = adhoc
+	tl.finish(ch, now, now)
+	return stopped
+}
+
+// layer lays the running cues over the table's levels, the latest
+// started on top
+func (tl *timeline) layer(now time.Time, levels []float64) {
+	for _, o := range tl.running {
+		w := o.weight(now)
+		for channel := range levels {
+			target := levels[channel] * o.cue.table
+			if percent, ok := o.cue.percents[channel]; ok {
+				target = percent
+			}
+			levels[channel] += (target - levels[channel]) * w
+		}
+	}
+}
+
+// weight is how far into the cue its levels are as of now: all the way
+// when the bricks run the fades, else along the streamed fades
+func (o occurrence) weight(now time.Time) float64 {
+	c := o.cue
+	if !c.streamed() {
+		return 1
+	}
+	in := float64(now.Sub(o.start)) / float64(c.fade)
+	out := float64(o.end.Sub(now)) / float64(c.fade)
+	return math.Max(0, math.Min(1, math.Min(in, out)))
+}
+
+// fading is whether a streamed fade is under way as of now
+func (tl *timeline) fading(now time.Time) bool {
+	for _, o := range tl.running {
+		if w := o.weight(now); w > 0 && w < 1 {
+			return true
+		}
+	}
+	return false
+}
+
+// next is the first event after now, zero when there isn't one
+func (tl *timeline) next() time.Time {
+	if len(tl.events) == 0 {
+		return time.Time{}
+	}
+	return tl.events[0].at
+}
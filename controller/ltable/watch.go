@@ -0,0 +1,43 @@
+package ltable
+
+import (
+	"io/ioutil"
+	"log"
+	"time"
+)
+
+// Editors write a file in more than one go; wait for them to finish
+const reloadSettle = 250 * time.Millisecond
+
+// Watch reloads the config file at path whenever it changes
+func (ld *LightDriver) Watch(path string) error {
+	changed := make(chan struct{}, 1)
+	err := watchFile(path, func() {
+		select {
+		case changed <- struct{}{}:
+		default:
+		}
+	})
+	if err != nil {
+		return err
+	}
+	go func() {
+		for range changed {
+			time.Sleep(reloadSettle)
+			select {
+			case <-changed:
+			default:
+			}
+			data, err := ioutil.ReadFile(path)
+			if err == nil {
+				err = ld.Reload(data)
+			}
+			if err != nil {
+				log.Printf("Keeping the old light table, reloading %s: %v", path, err)
+				continue
+			}
+			log.Printf("Reloaded light table from %s", path)
+		}
+	}()
+	return nil
+}
@@ -0,0 +1,32 @@
+//go:build !linux
+// +build !linux
+
+package ltable
+
+import (
+	"os"
+	"time"
+)
+
+const watchPoll = 2 * time.Second
+
+// watchFile calls changed after path's size or modification time moves
+func watchFile(path string, changed func()) error {
+	fi, err := os.Stat(path)
+	if err != nil {
+		return err
+	}
+	go func() {
+		for range time.Tick(watchPoll) {
+			now, err := os.Stat(path)
+			if err != nil {
+				continue
+			}
+			if !now.ModTime().Equal(fi.ModTime()) || now.Size() != fi.Size() {
+				fi = now
+				changed()
+			}
+		}
+	}()
+	return nil
+}
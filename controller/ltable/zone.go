@@ -0,0 +1,347 @@
+package ltable
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"log"
+	"math"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// Channels in a table, as many as the widest brick has
+const maxChannels = 16
+
+// zoneTable is one zone's light table, evaluated on its own and written
+// to the zone's bricks alone. The zone named "" is every brick in no
+// other zone.
+type zoneTable struct {
+	name     string
+	table    *compiledTable
+	percents []float64
+	// Channels written this update, not left alone while paused
+	set []bool
+	// Worked out again each local day, when either is set
+	astro   *astroTable
+	seasons *seasonalTable
+	day     time.Time
+	// Ramps the zone's output up over days when set, and the share of
+	// the table run today
+	acclim *acclimation
+	cap    float64
+	// The table placed on the local day being run, see clock.go
+	clock *dayClock
+	// Each channel's name in the channel summary
+	keys []string
+	// Blending from the table before, and for how long a change
+	// blends, see crossfade.go
+	blend     *crossfade
+	crossfade time.Duration
+	// Scaled for a daily light integral when set, see dli.go
+	target *dliTarget
+	dli    *dliDay
+	// Bricks placed in the zone, none for ""
+	bricks []string
+	// As worked out this update (parallel.go): how far the outputs rise
+	// over the fan lead, the light planned, in µmol/m²/s, and when the
+	// zone next needs an update
+	rising, plan float64
+	due          time.Time
+}
+
+// zoneConfig places a zone in a config file
+//
+//	{"zones": [{"name": "reef", "bricks": ["..."], "channels": [2, 0, 1], "table": [...]}]}
+//
+// where table is anything a config file can be but another zone list.
+type zoneConfig struct {
+	Name   string   `json:"name"`
+	Bricks []string `json:"bricks"`
+	// Brick channel for each of the table's, the same ones when empty
+	Channels    []int           `json:"channels,omitempty"`
+	Table       json.RawMessage `json:"table"`
+	Acclimation *acclimation    `json:"acclimation,omitempty"`
+	Emitters    []emitter       `json:"emitters,omitempty"`
+	DLI         *dliTarget      `json:"dli,omitempty"`
+}
+
+// parseZones reads a config file: a list of setpoints, an object
+// placing an astronomical table, an object of seasonal reference tables
+// (seasonal.go), or an object listing zones. Any of
+// these objects may carry an acclimation, emitters or a daily light
+// integral (dli.go) for every zone without its own, and a list of
+// setpoints given either goes under "table".
+func parseZones(data []byte) ([]*zoneTable, []zoneConfig, error) {
+	var zones struct {
+		Zones       []zoneConfig    `json:"zones"`
+		Table       json.RawMessage `json:"table"`
+		Acclimation *acclimation    `json:"acclimation"`
+		Emitters    []emitter       `json:"emitters"`
+		DLI         *dliTarget      `json:"dli"`
+	}
+	if trimmed := bytes.TrimSpace(data); len(trimmed) > 0 && trimmed[0] == '{' {
+		if err := json.Unmarshal(data, &zones); err != nil {
+			return nil, nil, err
+		}
+	}
+	if zones.Acclimation != nil {
+		if err := zones.Acclimation.check(); err != nil {
+			return nil, nil, err
+		}
+	}
+	if zones.DLI != nil {
+		if err := zones.DLI.check(); err != nil {
+			return nil, nil, err
+		}
+	}
+	var mix *mixer
+	if len(zones.Emitters) > 0 {
+		var err error
+		if mix, err = newMixer(zones.Emitters); err != nil {
+			return nil, nil, err
+		}
+	}
+	if len(zones.Zones) == 0 {
+		if zones.Table != nil {
+			data = zones.Table
+		}
+		z, err := parseTable("", data, 0, mix, nil)
+		if err != nil {
+			return nil, nil, err
+		}
+		z.acclim = zones.Acclimation
+		z.target = zones.DLI
+		return []*zoneTable{z}, nil, nil
+	}
+
+	var tables []*zoneTable
+	names := make(map[string]bool)
+	compiled := make(map[string]*compiledTable)
+	for _, zc := range zones.Zones {
+		if zc.Name == "" || names[zc.Name] {
+			return nil, nil, fmt.Errorf("zones need different names, got %q twice or empty", zc.Name)
+		}
+		names[zc.Name] = true
+		zoneMix := mix
+		if len(zc.Emitters) > 0 {
+			var err error
+			if zoneMix, err = newMixer(zc.Emitters); err != nil {
+				return nil, nil, fmt.Errorf("zone %s: %v", zc.Name, err)
+			}
+		}
+		z, err := parseTable(zc.Name, zc.Table, len(zc.Channels), zoneMix, compiled)
+		if err != nil {
+			return nil, nil, fmt.Errorf("zone %s: %v", zc.Name, err)
+		}
+		z.acclim = zones.Acclimation
+		if zc.Acclimation != nil {
+			if err := zc.Acclimation.check(); err != nil {
+				return nil, nil, fmt.Errorf("zone %s: %v", zc.Name, err)
+			}
+			z.acclim = zc.Acclimation
+		}
+		z.target = zones.DLI
+		if zc.DLI != nil {
+			if err := zc.DLI.check(); err != nil {
+				return nil, nil, fmt.Errorf("zone %s: %v", zc.Name, err)
+			}
+			z.target = zc.DLI
+		}
+		z.bricks = zc.Bricks
+		tables = append(tables, z)
+	}
+	return tables, zones.Zones, nil
+}
+
+// parseTable reads one zone's table, mixing any colour temperatures
+// with mix. Zones with the same setpoints and emitters share one
+// compiled table, and its frame table, through compiled when given.
+// The zone has channels channels, or as many as the table when 0.
+func parseTable(name string, data []byte, channels int, mix *mixer, compiled map[string]*compiledTable) (*zoneTable, error) {
+	z := &zoneTable{name: name, cap: 1}
+	if channels > 0 {
+		z.percents = make([]float64, channels)
+		z.set = make([]bool, channels)
+	}
+	if trimmed := bytes.TrimSpace(data); len(trimmed) > 0 && trimmed[0] == '{' {
+		var probe struct {
+			Seasons json.RawMessage `json:"seasons"`
+		}
+		if err := json.Unmarshal(data, &probe); err != nil {
+			return nil, err
+		}
+		if probe.Seasons != nil {
+			z.seasons = &seasonalTable{}
+			if err := json.Unmarshal(data, z.seasons); err != nil {
+				return nil, err
+			}
+			if err := z.seasons.check(mix); err != nil {
+				return nil, err
+			}
+			table, err := z.seasons.compile(time.Now())
+			if err != nil {
+				return nil, err
+			}
+			return z, z.fits(table)
+		}
+		z.astro = &astroTable{}
+		if err := json.Unmarshal(data, z.astro); err != nil {
+			return nil, err
+		}
+		// Checked here, compiled once the zone's bricks are known
+		table, err := z.astro.compile(time.Now())
+		if err != nil {
+			return nil, err
+		}
+		return z, z.fits(table)
+	}
+	var key bytes.Buffer
+	if err := json.Compact(&key, data); err != nil {
+		return nil, err
+	}
+	if mix != nil {
+		fmt.Fprintf(&key, "/%p", mix)
+	}
+	if table := compiled[key.String()]; table != nil {
+		z.table = table
+		return z, z.fits(table)
+	}
+	var settings settingPoints
+	if err := json.Unmarshal(data, &settings); err != nil {
+		return nil, err
+	}
+	if err := settings.mix(mix); err != nil {
+		return nil, err
+	}
+	table, err := compileTable(settings)
+	if err != nil {
+		return nil, err
+	}
+	if compiled != nil {
+		compiled[key.String()] = table
+	}
+	z.table = table
+	return z, z.fits(table)
+}
+
+// fits checks table against the zone's channels, sizing a zone without
+// its own to the table so only the channels it sets are evaluated and
+// written
+func (z *zoneTable) fits(table *compiledTable) error {
+	if z.percents == nil {
+		if table.channels > maxChannels {
+			return fmt.Errorf("table has %d channels, bricks at most %d", table.channels, maxChannels)
+		}
+		z.percents = make([]float64, table.channels)
+		z.set = make([]bool, table.channels)
+		return nil
+	}
+	if table.channels > len(z.percents) {
+		return fmt.Errorf("table has %d channels, the zone %d", table.channels, len(z.percents))
+	}
+	return nil
+}
+
+func (z *zoneTable) setTable(ch ble.BLEChannel, table *compiledTable) {
+	z.table = table
+	z.clock = nil
+	points := table.schedulePoints()
+	if f := z.factor(); f != 1 {
+		for _, p := range points {
+			for i := range p.Percents {
+				p.Percents[i] = math.Min(100, p.Percents[i]*f)
+			}
+		}
+	}
+	if err := ch.SetZoneSchedule(z.name, timeLocation, points); err != nil {
+		log.Printf("Not running the table on-device%s: %v", z.label(), err)
+	}
+}
+
+// tableOn is the zone's table for the local day starting day, worked
+// out for it when astronomical or seasonal
+func (z *zoneTable) tableOn(day time.Time) (*compiledTable, error) {
+	switch {
+	case z.astro != nil:
+		return z.astro.compile(day)
+	case z.seasons != nil:
+		return z.seasons.compile(day)
+	}
+	return z.table, nil
+}
+
+// daily zones have their table worked out again each local day
+func (z *zoneTable) daily() bool {
+	return z.astro != nil || z.seasons != nil || z.acclim != nil || z.target != nil
+}
+
+// newDay works out the astronomical or seasonal table, the acclimation
+// cap and the light integral's scale for the local day containing now,
+// if it hasn't already
+func (z *zoneTable) newDay(ch ble.BLEChannel, now time.Time) error {
+	now = now.In(timeLocation)
+	y, m, d := now.Date()
+	day := time.Date(y, m, d, 0, 0, 0, 0, timeLocation)
+	if day.Equal(z.day) {
+		return nil
+	}
+	table, err := z.tableOn(day)
+	if err != nil {
+		return err
+	}
+	first := z.day.IsZero()
+	old := *z
+	z.day = day
+	was := z.cap
+	z.cap = z.acclim.capOn(day)
+	scaled := z.planDLI(table, now)
+	if first || table != z.table || z.cap != was || scaled {
+		if !first {
+			z.blendFrom(&old, now)
+		}
+		z.setTable(ch, table)
+	}
+	if z.astro != nil {
+		log.Printf("Light table%s for %s worked out for %.2f, %.2f", z.label(), day.Format("2006-01-02"),
+			z.astro.Latitude, z.astro.Longitude)
+	}
+	if z.seasons != nil {
+		log.Printf("Light table%s for %s blended from the seasons", z.label(), day.Format("2006-01-02"))
+	}
+	if z.acclim != nil && z.cap != was {
+		log.Printf("Acclimating%s: %.0f%% of the light table for %s", z.label(), z.cap*100, day.Format("2006-01-02"))
+	}
+	return nil
+}
+
+// second is the table second now falls on, placing the table on the
+// local day's clock once now reaches it
+func (z *zoneTable) second(now time.Time) float64 {
+	if z.clock == nil || !z.clock.contains(now) {
+		z.clock = newDayClock(now, z.table)
+	}
+	return z.clock.second(now)
+}
+
+func (z *zoneTable) key(channel int) string {
+	if len(z.keys) != len(z.percents) {
+		z.keys = make([]string, len(z.percents))
+		for i := range z.keys {
+			z.keys[i] = fmt.Sprint(i)
+			if z.name != "" {
+				z.keys[i] = z.name + "/" + z.keys[i]
+			}
+		}
+	}
+	return z.keys[channel]
+}
+
+// label names the zone in logs
+func (z *zoneTable) label() string {
+	if z.name == "" {
+		return ""
+	}
+	return " in zone " + z.name
+}
@@ -1,31 +1,477 @@
 package main
 
 import (
+	"encoding/hex"
+	"encoding/json"
 	"flag"
+	"fmt"
 	"github.com/theatrus/ledbrick/controller/ble"
+	"github.com/theatrus/ledbrick/controller/diag"
+	"github.com/theatrus/ledbrick/controller/live"
 	"github.com/theatrus/ledbrick/controller/ltable"
+	"github.com/theatrus/ledbrick/controller/mqtt"
+	"github.com/theatrus/ledbrick/controller/remote"
 	"io/ioutil"
 	"log"
+	"net/http"
+	"os"
+	"os/signal"
+	"strconv"
+	"strings"
+	"syscall"
+	"time"
 )
 
 var done = make(chan struct{})
 var config = flag.String("config", "/etc/ledbrick-table.json", "Config file name")
+var expectBricks = flag.Int("expect-bricks", 0, "Pause scanning while this many bricks are connected, 0 to always scan")
+var hci = flag.String("hci", "", "Run bricks from these HCI adapters (comma separated device numbers), the first found if empty")
+var connectivity = flag.String("connectivity", "", "Run bricks from nRF51 connectivity dongles at these serial ports (comma separated) instead of HCI adapters")
+var broadcastGroup = flag.Int("broadcast-group", -1, "Also broadcast levels to this brick group (0-255), -1 to disable")
+var broadcastKey = flag.String("broadcast-key", "", "Broadcast MAC key, 32 hex digits")
+var signCommands = flag.Bool("sign-commands", false, "Sign command writes with the broadcast key, to bricks that take them")
+var broadcastZones = flag.String("broadcast-zones", "", "Also broadcast zones' levels to their own groups, as zone=group (comma separated)")
+var broadcastSlot = flag.Duration("broadcast-slot", ble.DefaultBroadcastTiming.Slot, "How long each broadcast advertisement is held, the groups taking turns")
+var broadcastBurst = flag.Int("broadcast-burst", ble.DefaultBroadcastTiming.Burst, "Times each broadcast change goes out")
+var broadcastKeepalive = flag.Duration("broadcast-keepalive", ble.DefaultBroadcastTiming.Keepalive, "How often unchanged broadcast levels go out again")
+var esbDongle = flag.String("esb-dongle", "", "Also send the broadcast frames over ESB through the dongle at this serial port")
+var pwmHz = flag.Int("pwm-hz", 0, "Run every brick's PWM at this frequency (24-1526 Hz), 0 for the firmware default")
+var dither = flag.String("dither", "", "Dither these channels (comma separated) for smooth deep dim levels")
+var masterDim = flag.Int("master-dim", 100, "Scale every brick's output together to this percent")
+var powerBudget = flag.Float64("power-budget", 0, "Hold every brick together under this many watts from the shared supply, 0 for no limit")
+var channelWatts = flag.String("channel-watts", "", "Watts each channel draws at full output (comma separated), for -power-budget")
+var slewLimit = flag.Float64("slew-limit", 0, "Hold every channel to at most this percent of full scale per second, 0 for no limit")
+var simulate = flag.String("simulate", "", "Run every brick on a simulated temperature (ramp, step or stall), firmware built with SIM_ENABLED only")
+var simLow = flag.Float64("sim-low", 25, "Lowest simulated temperature, degrees C")
+var simHigh = flag.Float64("sim-high", 70, "Highest simulated temperature, degrees C")
+var simPeriod = flag.Duration("sim-period", 24*time.Hour, "Simulated time for one low-high-low swing")
+var lease = flag.Duration("lease", 0, "Hold a control lease this long (whole seconds, up to 1m) on every brick, so one that stops hearing from the controller goes back to its schedule, 0 for none")
+var leaseScene = flag.Int("lease-scene", -1, "Scene slot a brick falls back to when its lease lapses and it has no schedule to run, -1 to hold its levels")
+var standby = flag.Bool("standby", false, "Only connect bricks no other controller holds the lease on, taking them over once it lapses; needs -lease, and every controller driving the bricks runs with it")
+var gattCache = flag.String("gatt-cache", "", "Keep the GATT handles found on each brick in this file, shared by -standby controllers so a takeover skips discovery")
+var monitor = flag.Bool("monitor", false, "Never connect a brick, only take the telemetry bricks advertise into -metrics and the history")
+var stateFile = flag.String("state", "", "Keep the bricks known, their handles, outputs and history in this file across restarts, written on SIGTERM or SIGINT")
+var burnIn = flag.Duration("burn-in", 0, "Burn in every brick as it's seen for this long (whole minutes), logging a pass or fail")
+var burnInRise = flag.Int("burn-in-rise", 25, "Fail a burn-in that heats a brick more than this, degrees C")
+var calibration = flag.String("calibration", "", "Program per channel calibration from this JSON file into every brick")
+var auxOutputs = flag.String("aux", "", "Program spare PWM outputs (fan, pumps, moonlight) from this JSON file into every brick")
+var ratedLife = flag.String("rated-life", "", "Hours each channel's LEDs are rated to 70% output (comma separated), so bricks raise their duty as they age")
+var metricsAddr = flag.String("metrics", "", "Serve Prometheus metrics on /metrics, and brick temperature and fan history on /history, at this address (e.g. :9100)")
+var apiAddr = flag.String("api", "", "Serve the control API (overrides, scenes, pause) on /api/, and live state as server-sent events on /api/live, at this address (e.g. :8080)")
+var liveInterval = flag.Duration("live-interval", time.Second, "How often /api/live looks for changes to stream")
+var debugAddr = flag.String("debug", "", "Serve pprof profiles and execution traces on /debug/pprof/, and goroutine and GC counters on /debug/runtime, at this address (e.g. localhost:6060)")
+var mqttBroker = flag.String("mqtt", "", "Publish brick telemetry to, and take override commands from, the MQTT broker at this address (host:port)")
+var mqttPrefix = flag.String("mqtt-prefix", "ledbrick", "Topic prefix for -mqtt, telemetry on <prefix>/telemetry and commands under <prefix>/cmd/")
+var mqttInterval = flag.Duration("mqtt-interval", 10*time.Second, "How often -mqtt publishes a telemetry batch")
+var record = flag.String("record", "", "Record everything to and from the bricks to this file, for replay by loadtest -replay")
+var firmware = flag.String("firmware", "", "Update every brick to this firmware package (nrfutil zip)")
+var firmwareCanary = flag.Int("firmware-canary", ble.DefaultFirmwareRollout.Canary, "Bricks -firmware updates first, checked before any others go")
+var firmwareWave = flag.Int("firmware-wave", ble.DefaultFirmwareRollout.Wave, "Bricks -firmware updates in each wave after the canary, 0 for all the rest at once")
+var firmwareParallel = flag.Int("firmware-parallel", ble.DefaultFirmwareRollout.PerAdapter, "Firmware transfers at once through each adapter")
+var firmwareBright = flag.Float64("firmware-bright", 25, "Hold a brick's update while any of its channels is above this percent, 100 to update whenever")
+var agentsAddr = flag.String("agents", "", "Serve radio agents at this address, streaming them the levels set here and taking their bricks' telemetry on /agent/ (see remote)")
+var central = flag.String("central", "", "Run as a radio agent of the central controller at this URL, running its levels on the bricks in range instead of tables of its own")
+var agentName = flag.String("agent-name", "", "Name this agent goes by with -central, the host name if empty")
+var agentToken = flag.String("agent-token", "", "Token the central and its agents share, none if empty")
+var agentInterval = flag.Duration("agent-interval", 10*time.Second, "How often an agent posts its bricks' telemetry to -central")
+var maintenance = flag.Bool("maintenance", false, "Hold history backfill, -burn-in and -firmware for where each brick's schedule is flat, and dark for those that take its lights")
+var maintFlat = flag.Float64("maintenance-flat", ble.DefaultMaintenanceWindow.FlatPercent, "Flat for -maintenance is no channel moving more than this percent over a job")
+var maintDark = flag.Float64("maintenance-dark", ble.DefaultMaintenanceWindow.DarkPercent, "Dark for -maintenance is every channel at or below this percent")
+var maintParallel = flag.Int("maintenance-parallel", ble.DefaultMaintenanceWindow.PerAdapter, "Bulk jobs at once through each adapter with -maintenance, firmware transfers included")
+var maintMaxWait = flag.Duration("maintenance-max-wait", ble.DefaultMaintenanceWindow.MaxWait, "Run a -maintenance job held this long anyway, 0 to wait for a window however long")
+var crossfade = flag.Duration("crossfade", 0, "Blend from the old table to the new over this on a reload or a new day's table, up to 1h, 0 to swap at once")
+var thermalShare = flag.Float64("thermal-share", 0, "Raise bricks that aren't derating for heat by up to this percent, to make up for neighbours in their zone that are, 0 for none")
+var bench = flag.String("bench", "", "Benchmark the bricks with these scenarios (comma separated, of storm, fade, reconnect and backfill) instead of running tables, printing how they went")
+var benchBricks = flag.String("bench-bricks", "", "Bricks -bench runs on (comma separated IDs), every one connected if empty")
+var benchRounds = flag.Int("bench-rounds", ble.DefaultFleetBench.Rounds, "Frames or fades -bench sends each brick in the storm and fade")
+var benchEvery = flag.Duration("bench-every", ble.DefaultFleetBench.Every, "Between a brick's -bench frames or fades")
+var benchFade = flag.Duration("bench-fade", ble.DefaultFleetBench.Fade, "Length of each -bench fade")
+var benchWait = flag.Duration("bench-wait", time.Minute, "Longest -bench waits for the bricks named, or those expected, to connect")
+var firmwareMinRate = flag.Float64("firmware-min-rate", 0, "Halt the firmware rollout after a wave with a transfer slower than this many bytes a second, 0 for no floor")
 
 func main() {
 	flag.Parse()
 	log.Println("LEDBrick Controller Master")
-	log.Printf("Parsing config file %s", config)
-
-	file, err := ioutil.ReadFile(*config)
-	if err != nil {
-		log.Printf("Error: %v", err)
+	if *central != "" && (*agentsAddr != "" || *apiAddr != "" || *mqttBroker != "") {
+		log.Printf("Error: agent: the central serves agents, the API and MQTT")
+		return
+	}
+	var file []byte
+	var err error
+	if *central == "" && *bench == "" {
+		// An agent's tables are the central's
+		log.Printf("Parsing config file %s", config)
+		file, err = ioutil.ReadFile(*config)
+		if err != nil {
+			log.Printf("Error: %v", err)
+			return
+		}
+	}
+	var hcis []int
+	if *hci != "" {
+		for _, s := range strings.Split(*hci, ",") {
+			n, err := strconv.Atoi(strings.TrimSpace(s))
+			if err != nil {
+				log.Printf("Error: hci: %v", err)
+				return
+			}
+			hcis = append(hcis, n)
+		}
+	}
+	var bleChannel ble.BLEChannel
+	if *connectivity != "" {
+		if *record != "" {
+			log.Printf("Error: record: HCI adapters only")
+			return
+		}
+		var ports []string
+		for _, s := range strings.Split(*connectivity, ",") {
+			ports = append(ports, strings.TrimSpace(s))
+		}
+		bleChannel, err = ble.NewBLEChannelVia(ports)
+		if err != nil {
+			log.Printf("Error: connectivity: %v", err)
+			return
+		}
+	} else if *record != "" {
+		f, err := os.Create(*record)
+		if err != nil {
+			log.Printf("Error: record: %v", err)
+			return
+		}
+		defer f.Close()
+		bleChannel, err = ble.NewRecordingBLEChannelOn(hcis, f)
+		if err != nil {
+			log.Printf("Error: record: %v", err)
+			return
+		}
+	} else {
+		bleChannel = ble.NewBLEChannelOn(hcis)
+	}
+	var hub *remote.Hub
+	if *agentsAddr != "" {
+		// Everything set from here on goes to the agents too
+		hub = remote.NewHub(bleChannel, *agentToken)
+		bleChannel = hub
+	}
+	if *expectBricks > 0 {
+		bleChannel.ExpectBricks(*expectBricks)
+	}
+	if *monitor {
+		bleChannel.SetMonitor(true)
+	}
+	// One server per address, shared when the metrics and API are on the
+	// same one
+	muxes := make(map[string]*http.ServeMux)
+	handle := func(addr, pattern string, h http.Handler) {
+		if muxes[addr] == nil {
+			muxes[addr] = http.NewServeMux()
+		}
+		muxes[addr].Handle(pattern, h)
+	}
+	if *metricsAddr != "" {
+		handle(*metricsAddr, "/metrics", bleChannel.MetricsHandler())
+		handle(*metricsAddr, "/history", bleChannel.HistoryHandler())
+	}
+	if *debugAddr != "" {
+		handle(*debugAddr, "/debug/", diag.Handler())
+	}
+	if hub != nil {
+		handle(*agentsAddr, "/agent/", hub.Handler())
+	}
+	if *signCommands {
+		key, err := hex.DecodeString(*broadcastKey)
+		if err == nil {
+			err = bleChannel.SignCommands(key)
+		}
+		if err != nil {
+			log.Printf("Error: signing commands: %v", err)
+			return
+		}
+	}
+	if *broadcastGroup >= 0 {
+		key, err := hex.DecodeString(*broadcastKey)
+		if err == nil {
+			err = bleChannel.EnableBroadcast(uint8(*broadcastGroup), key)
+		}
+		if err == nil {
+			err = bleChannel.SetBroadcastTiming(ble.BroadcastTiming{Slot: *broadcastSlot,
+				Burst: *broadcastBurst, Keepalive: *broadcastKeepalive})
+		}
+		if err == nil && *broadcastZones != "" {
+			for _, zg := range strings.Split(*broadcastZones, ",") {
+				var group int
+				eq := strings.LastIndexByte(zg, '=')
+				if eq < 0 {
+					err = fmt.Errorf("%q isn't zone=group", zg)
+				} else if group, err = strconv.Atoi(zg[eq+1:]); err == nil && (group < 0 || group > 255) {
+					err = fmt.Errorf("group %d isn't 0-255", group)
+				}
+				if err == nil {
+					err = bleChannel.BroadcastZone(zg[:eq], uint8(group))
+				}
+				if err != nil {
+					break
+				}
+			}
+		}
+		if err != nil {
+			log.Printf("Error: broadcast: %v", err)
+			return
+		}
+	}
+	if *esbDongle != "" {
+		if err := bleChannel.EnableDongle(*esbDongle); err != nil {
+			log.Printf("Error: ESB dongle: %v", err)
+			return
+		}
+	}
+	if *pwmHz != 0 {
+		if err := bleChannel.SetPWMFrequency(*pwmHz); err != nil {
+			log.Printf("Error: PWM: %v", err)
+			return
+		}
+	}
+	if *dither != "" {
+		var channels []int
+		for _, s := range strings.Split(*dither, ",") {
+			ch, err := strconv.Atoi(strings.TrimSpace(s))
+			if err != nil {
+				log.Printf("Error: dither: %v", err)
+				return
+			}
+			channels = append(channels, ch)
+		}
+		if err := bleChannel.SetDither(channels); err != nil {
+			log.Printf("Error: dither: %v", err)
+			return
+		}
+	}
+	if *masterDim != 100 {
+		if err := bleChannel.SetMasterDim(*masterDim); err != nil {
+			log.Printf("Error: master dim: %v", err)
+			return
+		}
+	}
+	if *slewLimit != 0 {
+		if err := bleChannel.SetSlewLimit(*slewLimit); err != nil {
+			log.Printf("Error: slew limit: %v", err)
+			return
+		}
+	}
+	if *powerBudget != 0 {
+		var watts []float64
+		for _, s := range strings.Split(*channelWatts, ",") {
+			w, err := strconv.ParseFloat(strings.TrimSpace(s), 64)
+			if err != nil {
+				log.Printf("Error: channel watts: %v", err)
+				return
+			}
+			watts = append(watts, w)
+		}
+		if err := bleChannel.SetPowerBudget(*powerBudget, watts); err != nil {
+			log.Printf("Error: power budget: %v", err)
+			return
+		}
+	}
+	if *simulate != "" {
+		if err := bleChannel.Simulate(*simulate, *simLow, *simHigh, *simPeriod); err != nil {
+			log.Printf("Error: simulation: %v", err)
+			return
+		}
+	}
+	if *lease != 0 {
+		if err := bleChannel.SetLease(*lease, *leaseScene); err != nil {
+			log.Printf("Error: lease: %v", err)
+			return
+		}
+	}
+	if *standby {
+		if *lease == 0 {
+			log.Printf("Error: standby: needs a -lease to hold")
+			return
+		}
+		bleChannel.SetStandby(true)
+	}
+	if *gattCache != "" {
+		if err := bleChannel.SetGattCacheFile(*gattCache); err != nil {
+			log.Printf("Error: GATT cache: %v", err)
+			return
+		}
+	}
+	if *stateFile != "" {
+		// Cold start without it
+		if err := bleChannel.RestoreState(*stateFile); err != nil {
+			log.Printf("Error: state: %v", err)
+		}
+	}
+	if *thermalShare != 0 {
+		if err := bleChannel.SetThermalShare(*thermalShare); err != nil {
+			log.Printf("Error: thermal share: %v", err)
+			return
+		}
+	}
+	if *maintenance {
+		w := ble.MaintenanceWindow{FlatPercent: *maintFlat, DarkPercent: *maintDark,
+			PerAdapter: *maintParallel, MaxWait: *maintMaxWait}
+		if err := bleChannel.SetMaintenance(w); err != nil {
+			log.Printf("Error: maintenance: %v", err)
+			return
+		}
+	}
+	if *burnIn != 0 {
+		if err := bleChannel.BurnIn(*burnIn, *burnInRise); err != nil {
+			log.Printf("Error: burn-in: %v", err)
+			return
+		}
+	}
+	if *calibration != "" {
+		var cs []ble.Calibration
+		b, err := ioutil.ReadFile(*calibration)
+		if err == nil {
+			err = json.Unmarshal(b, &cs)
+		}
+		if err == nil {
+			err = bleChannel.SetCalibration(cs)
+		}
+		if err != nil {
+			log.Printf("Error: calibration: %v", err)
+			return
+		}
+	}
+	if *auxOutputs != "" {
+		var as []ble.AuxOutput
+		b, err := ioutil.ReadFile(*auxOutputs)
+		if err == nil {
+			err = json.Unmarshal(b, &as)
+		}
+		if err == nil {
+			err = bleChannel.SetAux(as)
+		}
+		if err != nil {
+			log.Printf("Error: aux outputs: %v", err)
+			return
+		}
+	}
+	if *ratedLife != "" {
+		var hours []int
+		for _, s := range strings.Split(*ratedLife, ",") {
+			h, err := strconv.Atoi(strings.TrimSpace(s))
+			if err != nil {
+				log.Printf("Error: rated life: %v", err)
+				return
+			}
+			hours = append(hours, h)
+		}
+		if err := bleChannel.SetRatedLife(hours); err != nil {
+			log.Printf("Error: rated life: %v", err)
+			return
+		}
+	}
+	if *firmware != "" {
+		r := ble.FirmwareRollout{Canary: *firmwareCanary, Wave: *firmwareWave,
+			PerAdapter: *firmwareParallel, BrightPercent: *firmwareBright, MinRate: *firmwareMinRate}
+		if err := bleChannel.UpdateFirmware(*firmware, r); err != nil {
+			log.Printf("Error: firmware: %v", err)
+			return
+		}
+	}
+	if *bench != "" {
+		b := ble.DefaultFleetBench
+		b.Scenarios = nil
+		for _, s := range strings.Split(*bench, ",") {
+			b.Scenarios = append(b.Scenarios, strings.TrimSpace(s))
+		}
+		if *benchBricks != "" {
+			for _, s := range strings.Split(*benchBricks, ",") {
+				b.Bricks = append(b.Bricks, strings.TrimSpace(s))
+			}
+		}
+		b.Rounds, b.Every, b.Fade = *benchRounds, *benchEvery, *benchFade
+		r, err := bleChannel.RunFleetBench(b, *benchWait)
+		if err != nil {
+			log.Printf("Error: bench: %v", err)
+		}
+		fmt.Println(r)
+		return
+	}
+	if *central != "" {
+		name := *agentName
+		if name == "" {
+			name, err = os.Hostname()
+		}
+		var agent *remote.Agent
+		if err == nil {
+			agent, err = remote.NewAgent(*central, name, *agentToken, bleChannel, *agentInterval)
+		}
+		if err == nil && *agentInterval <= 0 {
+			err = fmt.Errorf("interval must be positive, got %v", *agentInterval)
+		}
+		if err != nil {
+			log.Printf("Error: agent: %v", err)
+			return
+		}
+		agent.Start()
+		serve(muxes, bleChannel)
 		return
 	}
-	bleChannel := ble.NewBLEChannel()
-	_, err = ltable.NewLightDriverFromJson(bleChannel, file)
+	driver, err := ltable.NewLightDriverFromJson(bleChannel, file)
 	if err != nil {
 		log.Printf("error in loading driver: %v", err)
 		return
 	}
-	<-done
+	if *crossfade != 0 {
+		if err := driver.SetCrossfade(*crossfade); err != nil {
+			log.Printf("Error: crossfade: %v", err)
+			return
+		}
+		if err := bleChannel.SetScheduleCrossfade(*crossfade); err != nil {
+			log.Printf("Error: crossfade: %v", err)
+			return
+		}
+	}
+	// New tables are swapped in without dropping the bricks
+	if err := driver.Watch(*config); err != nil {
+		log.Printf("Error: not watching %s: %v", *config, err)
+	}
+	if *apiAddr != "" {
+		if *liveInterval <= 0 {
+			log.Printf("Error: live: interval must be positive, got %v", *liveInterval)
+			return
+		}
+		handle(*apiAddr, "/api/", driver.Handler())
+		stream := live.NewStream(bleChannel, driver, *liveInterval)
+		stream.Start()
+		handle(*apiAddr, "/api/live", stream.Handler())
+	}
+	if *mqttBroker != "" {
+		if *mqttInterval <= 0 {
+			log.Printf("Error: MQTT: interval must be positive, got %v", *mqttInterval)
+			return
+		}
+		mqtt.NewBridge(*mqttBroker, *mqttPrefix, *mqttInterval, bleChannel, driver).Start()
+	}
+	serve(muxes, bleChannel)
+}
+
+// serve runs the servers until stopped, saving the state on a signal
+func serve(muxes map[string]*http.ServeMux, bleChannel ble.BLEChannel) {
+	for addr, mux := range muxes {
+		addr, mux := addr, mux
+		go func() {
+			log.Printf("Error: %s: %v", addr, http.ListenAndServe(addr, mux))
+		}()
+	}
+	stop := make(chan os.Signal, 1)
+	signal.Notify(stop, syscall.SIGTERM, os.Interrupt)
+	select {
+	case <-done:
+	case s := <-stop:
+		log.Printf("Stopping on %v", s)
+		if *stateFile != "" {
+			if err := bleChannel.SaveState(*stateFile); err != nil {
+				log.Printf("Error: %v", err)
+			}
+		}
+	}
 }
@@ -0,0 +1,359 @@
+// Package mqtt bridges the controller to plant monitoring over MQTT:
+// brick telemetry goes out batched, a message per interval with only
+// the bricks that moved past a deadband, and commands come in on topics
+// feeding the override layer. Publishes wait in a bounded queue, oldest
+// dropped first, so a slow or missing broker never holds up the bricks.
+package mqtt
+
+import (
+	"bufio"
+	"encoding/json"
+	"errors"
+	"log"
+	"math"
+	"net"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// Topics under the prefix:
+//
+//	<prefix>/telemetry       batches out, see batch
+//	<prefix>/cmd/override    {"channel": 2, "percent": 40, "for": "30m"}, "for" empty until cleared
+//	<prefix>/cmd/clear       {"channel": 2}, every channel when -1 or empty
+//	<prefix>/cmd/pause       anything
+//	<prefix>/cmd/resume      anything
+//	<prefix>/cmd/scene       {"slot": 1}
+const (
+	telemetryTopic = "/telemetry"
+	commandTopic   = "/cmd/"
+)
+
+// How far a reading moves before a batch carries it again. Derate,
+// errors and lost commands go out on any change.
+const (
+	tempDeadbandC  = 0.5
+	fanDeadbandRpm = 50
+	// Every brick goes out this often in batches, for new subscribers
+	fullBatchEvery = 6
+)
+
+const (
+	queueLen       = 16
+	keepalive      = 30 * time.Second
+	dialTimeout    = 10 * time.Second
+	connectTimeout = 10 * time.Second
+	writeTimeout   = 5 * time.Second
+	reconnectMin   = time.Second
+	reconnectMax   = time.Minute
+	subscribeID    = 1
+)
+
+// Bricks gives the connected bricks, ble.BLEChannel does
+type Bricks interface {
+	Perhipherals() []ble.BLEPeripheral
+}
+
+// Driver takes the commands, ltable.LightDriver does
+type Driver interface {
+	Override(channel int, percent float64, d time.Duration) error
+	ClearOverride(channel int) error
+	Pause() error
+	Resume() error
+	Scene(slot int) error
+}
+
+var (
+	errMissingChannel = errors.New("override needs a channel")
+	errUnknownCommand = errors.New("unknown command")
+)
+
+// sample is one brick in a batch
+type sample struct {
+	TemperatureC float64 `json:"c"`
+	FanRpm       int     `json:"rpm"`
+	Derate       int     `json:"derate"`
+	Errors       uint8   `json:"errors"`
+	Lost         int     `json:"lost"`
+}
+
+// moved is whether s is past the deadband from what was last sent
+func (s sample) moved(last sample) bool {
+	return math.Abs(s.TemperatureC-last.TemperatureC) >= tempDeadbandC ||
+		s.FanRpm-last.FanRpm >= fanDeadbandRpm || last.FanRpm-s.FanRpm >= fanDeadbandRpm ||
+		s.Derate != last.Derate || s.Errors != last.Errors || s.Lost != last.Lost
+}
+
+type batchMessage struct {
+	At     int64             `json:"at"`
+	Full   bool              `json:"full,omitempty"`
+	Bricks map[string]sample `json:"bricks"`
+}
+
+type Bridge struct {
+	addr     string
+	prefix   string
+	interval time.Duration
+	bricks   Bricks
+	driver   Driver
+	// Batches waiting for the broker, the newest queueLen
+	queue   chan []byte
+	dropped int64
+	// What each brick was last sent as, and batches made
+	last    map[string]sample
+	batches int
+	stop    chan struct{}
+
+	lock sync.Mutex
+}
+
+func NewBridge(addr, prefix string, interval time.Duration, bricks Bricks, driver Driver) *Bridge {
+	return &Bridge{addr: addr,
+		prefix:   strings.TrimSuffix(prefix, "/"),
+		interval: interval,
+		bricks:   bricks,
+		driver:   driver,
+		queue:    make(chan []byte, queueLen),
+		last:     make(map[string]sample),
+		stop:     make(chan struct{}),
+	}
+}
+
+// Start batches telemetry and keeps a broker connection, each on its
+// own goroutine, until Stop
+func (b *Bridge) Start() {
+	go b.runBatches()
+	go b.runBroker()
+}
+
+func (b *Bridge) Stop() {
+	close(b.stop)
+}
+
+// Dropped is how many batches the queue has let go unsent
+func (b *Bridge) Dropped() int64 {
+	return atomic.LoadInt64(&b.dropped)
+}
+
+func (b *Bridge) runBatches() {
+	t := time.NewTicker(b.interval)
+	defer t.Stop()
+	for {
+		select {
+		case <-b.stop:
+			return
+		case now := <-t.C:
+			if msg := b.batch(now); msg != nil {
+				b.enqueue(msg)
+			}
+		}
+	}
+}
+
+// batch is the next telemetry message, the bricks that moved or all of
+// them every fullBatchEvery, nil when there's nothing to say
+func (b *Bridge) batch(now time.Time) []byte {
+	b.lock.Lock()
+	defer b.lock.Unlock()
+	full := b.batches%fullBatchEvery == 0
+	b.batches++
+	m := batchMessage{At: now.Unix(), Full: full, Bricks: make(map[string]sample)}
+	for _, p := range b.bricks.Perhipherals() {
+		if !p.Active() {
+			continue
+		}
+		s := sample{TemperatureC: p.TemperatureC(), FanRpm: p.FanRPM(), Derate: p.Derate(),
+			Errors: p.Errors(), Lost: p.LostCommands()}
+		last, seen := b.last[p.ID()]
+		if !full && seen && !s.moved(last) {
+			continue
+		}
+		b.last[p.ID()] = s
+		m.Bricks[p.ID()] = s
+	}
+	if len(m.Bricks) == 0 && !full {
+		return nil
+	}
+	msg, err := json.Marshal(m)
+	if err != nil {
+		log.Printf("MQTT: telemetry: %v", err)
+		return nil
+	}
+	return msg
+}
+
+// enqueue never waits, a full queue loses its oldest batch
+func (b *Bridge) enqueue(msg []byte) {
+	for {
+		select {
+		case b.queue <- msg:
+			return
+		default:
+		}
+		select {
+		case <-b.queue:
+			atomic.AddInt64(&b.dropped, 1)
+		default:
+		}
+	}
+}
+
+// runBroker connects and publishes until Stop, backing off between
+// failed connections
+func (b *Bridge) runBroker() {
+	wait := reconnectMin
+	for {
+		start := time.Now()
+		err := b.session()
+		select {
+		case <-b.stop:
+			return
+		default:
+		}
+		log.Printf("MQTT: %s: %v", b.addr, err)
+		if time.Since(start) > reconnectMax {
+			wait = reconnectMin
+		}
+		select {
+		case <-b.stop:
+			return
+		case <-time.After(wait):
+		}
+		if wait *= 2; wait > reconnectMax {
+			wait = reconnectMax
+		}
+	}
+}
+
+// session runs one broker connection until it fails or Stop
+func (b *Bridge) session() error {
+	conn, err := net.DialTimeout("tcp", b.addr, dialTimeout)
+	if err != nil {
+		return err
+	}
+	defer conn.Close()
+	r := bufio.NewReader(conn)
+	conn.SetDeadline(time.Now().Add(connectTimeout))
+	id := "ledbrick-" + strings.Replace(b.prefix, "/", "-", -1)
+	if err := writePacket(conn, pktConnect, 0, connectBody(id, keepalive)); err != nil {
+		return err
+	}
+	if typ, _, body, err := readPacket(r); err != nil {
+		return err
+	} else if typ != pktConnack {
+		return errMalformed
+	} else if err := connackError(body); err != nil {
+		return err
+	}
+	if err := writePacket(conn, pktSubscribe, subscribeFlags, subscribeBody(subscribeID, b.prefix+commandTopic+"#")); err != nil {
+		return err
+	}
+	conn.SetDeadline(time.Time{})
+	log.Printf("MQTT: connected to %s", b.addr)
+
+	// Only this goroutine writes, the reader just reads
+	send := func(typ, flags byte, body []byte) error {
+		conn.SetWriteDeadline(time.Now().Add(writeTimeout))
+		return writePacket(conn, typ, flags, body)
+	}
+	failed := make(chan error, 1)
+	go func() { failed <- b.read(conn, r) }()
+
+	ping := time.NewTicker(keepalive / 2)
+	defer ping.Stop()
+	for {
+		select {
+		case <-b.stop:
+			send(pktDisconnect, 0, nil)
+			return nil
+		case err := <-failed:
+			return err
+		case msg := <-b.queue:
+			if err := send(pktPublish, 0, publishBody(b.prefix+telemetryTopic, msg)); err != nil {
+				// Lost with the connection, the next full batch makes up for it
+				return err
+			}
+		case <-ping.C:
+			if err := send(pktPingreq, 0, nil); err != nil {
+				return err
+			}
+		}
+	}
+}
+
+// read takes the broker's packets, handing commands on, until the
+// connection goes quiet past the keepalive or fails
+func (b *Bridge) read(conn net.Conn, r *bufio.Reader) error {
+	for {
+		conn.SetReadDeadline(time.Now().Add(keepalive * 3 / 2))
+		typ, flags, body, err := readPacket(r)
+		if err != nil {
+			return err
+		}
+		switch typ {
+		case pktSuback:
+			if err := subackError(body); err != nil {
+				return err
+			}
+		case pktPublish:
+			topic, payload, err := parsePublish(flags, body)
+			if err != nil {
+				return err
+			}
+			if err := b.command(topic, payload); err != nil {
+				log.Printf("MQTT: %s: %v", topic, err)
+			}
+		}
+	}
+}
+
+type commandMessage struct {
+	Channel *int    `json:"channel"`
+	Percent float64 `json:"percent"`
+	For     string  `json:"for"`
+	Slot    int     `json:"slot"`
+}
+
+// command runs one message from a command topic
+func (b *Bridge) command(topic string, payload []byte) error {
+	var m commandMessage
+	name := strings.TrimPrefix(topic, b.prefix+commandTopic)
+	if name == "override" || name == "clear" || name == "scene" {
+		if len(payload) > 0 {
+			if err := json.Unmarshal(payload, &m); err != nil {
+				return err
+			}
+		}
+	}
+	switch name {
+	case "override":
+		var d time.Duration
+		if m.For != "" {
+			var err error
+			if d, err = time.ParseDuration(m.For); err != nil {
+				return err
+			}
+		}
+		if m.Channel == nil {
+			return errMissingChannel
+		}
+		return b.driver.Override(*m.Channel, m.Percent, d)
+	case "clear":
+		channel := -1
+		if m.Channel != nil {
+			channel = *m.Channel
+		}
+		return b.driver.ClearOverride(channel)
+	case "pause":
+		return b.driver.Pause()
+	case "resume":
+		return b.driver.Resume()
+	case "scene":
+		return b.driver.Scene(m.Slot)
+	}
+	return errUnknownCommand
+}
@@ -0,0 +1,108 @@
+package mqtt
+
+import (
+	"encoding/json"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+type fakeBrick struct {
+	ble.BLEPeripheral
+	id   string
+	temp float64
+	rpm  int
+}
+
+func (b *fakeBrick) ID() string            { return b.id }
+func (b *fakeBrick) Active() bool          { return true }
+func (b *fakeBrick) TemperatureC() float64 { return b.temp }
+func (b *fakeBrick) FanRPM() int           { return b.rpm }
+func (b *fakeBrick) Derate() int           { return 100 }
+func (b *fakeBrick) Errors() uint8         { return 0 }
+func (b *fakeBrick) LostCommands() int     { return 0 }
+
+type fakeBricks []ble.BLEPeripheral
+
+func (f fakeBricks) Perhipherals() []ble.BLEPeripheral { return f }
+
+type fakeDriver struct {
+	channel int
+	percent float64
+	d       time.Duration
+	paused  bool
+}
+
+func (f *fakeDriver) Override(channel int, percent float64, d time.Duration) error {
+	f.channel, f.percent, f.d = channel, percent, d
+	return nil
+}
+func (f *fakeDriver) ClearOverride(channel int) error { f.channel = channel; return nil }
+func (f *fakeDriver) Pause() error                    { f.paused = true; return nil }
+func (f *fakeDriver) Resume() error                   { f.paused = false; return nil }
+func (f *fakeDriver) Scene(slot int) error            { return nil }
+
+func TestBatches(t *testing.T) {
+	a := &fakeBrick{id: "a", temp: 30, rpm: 1000}
+	c := &fakeBrick{id: "c", temp: 40, rpm: 2000}
+	b := NewBridge("", "tank/", time.Second, fakeBricks{a, c}, &fakeDriver{})
+	now := time.Unix(1000, 0)
+	decode := func(msg []byte) batchMessage {
+		var m batchMessage
+		if err := json.Unmarshal(msg, &m); err != nil {
+			t.Fatal(err)
+		}
+		return m
+	}
+	if m := decode(b.batch(now)); !m.Full || len(m.Bricks) != 2 || m.Bricks["c"].FanRpm != 2000 {
+		t.Errorf("first batch %+v", m)
+	}
+	a.temp = 30.4
+	c.rpm = 2049
+	if msg := b.batch(now); msg != nil {
+		t.Errorf("inside the deadband: %s", msg)
+	}
+	a.temp = 30.5
+	if m := decode(b.batch(now)); m.Full || len(m.Bricks) != 1 || m.Bricks["a"].TemperatureC != 30.5 {
+		t.Errorf("moved batch %+v", m)
+	}
+	for i := 3; i < fullBatchEvery; i++ {
+		b.batch(now)
+	}
+	if m := decode(b.batch(now)); !m.Full || len(m.Bricks) != 2 {
+		t.Errorf("full batch %+v", m)
+	}
+
+	// The queue keeps the newest
+	for i := 0; i < queueLen+3; i++ {
+		b.enqueue([]byte{byte(i)})
+	}
+	if b.Dropped() != 3 || len(b.queue) != queueLen {
+		t.Errorf("dropped %d, %d queued", b.Dropped(), len(b.queue))
+	}
+	if first := <-b.queue; first[0] != 3 {
+		t.Errorf("oldest kept %d", first[0])
+	}
+}
+
+func TestCommands(t *testing.T) {
+	d := &fakeDriver{}
+	b := NewBridge("", "tank", time.Second, fakeBricks{}, d)
+	if err := b.command("tank/cmd/override", []byte(`{"channel": 2, "percent": 40, "for": "30m"}`)); err != nil ||
+		d.channel != 2 || d.percent != 40 || d.d != 30*time.Minute {
+		t.Errorf("override %+v, %v", d, err)
+	}
+	if err := b.command("tank/cmd/clear", nil); err != nil || d.channel != -1 {
+		t.Errorf("clear %+v, %v", d, err)
+	}
+	if err := b.command("tank/cmd/pause", []byte("now")); err != nil || !d.paused {
+		t.Errorf("pause %+v, %v", d, err)
+	}
+	if err := b.command("tank/cmd/override", []byte(`{"percent": 40}`)); err != errMissingChannel {
+		t.Errorf("override without a channel: %v", err)
+	}
+	if err := b.command("tank/cmd/reboot", nil); err != errUnknownCommand {
+		t.Errorf("unknown command: %v", err)
+	}
+}
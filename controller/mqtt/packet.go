@@ -0,0 +1,154 @@
+package mqtt
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"time"
+)
+
+// The little of MQTT 3.1.1 the bridge needs: a clean session, QoS 0
+// publishes both ways, one subscription and keepalive pings.
+const (
+	pktConnect    = 1
+	pktConnack    = 2
+	pktPublish    = 3
+	pktSubscribe  = 8
+	pktSuback     = 9
+	pktPingreq    = 12
+	pktPingresp   = 13
+	pktDisconnect = 14
+
+	protocolLevel    = 4
+	connectClean     = 1 << 1
+	subscribeFlags   = 0x2 // Reserved bits the spec sets
+	maxRemainingLen  = 268435455
+	subscribeFailure = 0x80
+)
+
+var errMalformed = errors.New("malformed MQTT packet")
+
+func appendString(b []byte, s string) []byte {
+	b = append(b, byte(len(s)>>8), byte(len(s)))
+	return append(b, s...)
+}
+
+func readString(b []byte) (string, []byte, error) {
+	if len(b) < 2 {
+		return "", nil, errMalformed
+	}
+	n := int(binary.BigEndian.Uint16(b))
+	if len(b) < 2+n {
+		return "", nil, errMalformed
+	}
+	return string(b[2 : 2+n]), b[2+n:], nil
+}
+
+// writePacket frames body under a fixed header, the remaining length
+// seven bits a byte
+func writePacket(w io.Writer, typ, flags byte, body []byte) error {
+	if len(body) > maxRemainingLen {
+		return fmt.Errorf("MQTT packet of %d bytes", len(body))
+	}
+	buf := make([]byte, 0, 5+len(body))
+	buf = append(buf, typ<<4|flags)
+	n := len(body)
+	for {
+		b := byte(n & 0x7f)
+		n >>= 7
+		if n > 0 {
+			b |= 0x80
+		}
+		buf = append(buf, b)
+		if n == 0 {
+			break
+		}
+	}
+	_, err := w.Write(append(buf, body...))
+	return err
+}
+
+func readPacket(r *bufio.Reader) (typ, flags byte, body []byte, err error) {
+	h, err := r.ReadByte()
+	if err != nil {
+		return 0, 0, nil, err
+	}
+	n, shift := 0, uint(0)
+	for i := 0; ; i++ {
+		b, err := r.ReadByte()
+		if err != nil {
+			return 0, 0, nil, err
+		}
+		if i == 4 {
+			return 0, 0, nil, errMalformed
+		}
+		n |= int(b&0x7f) << shift
+		shift += 7
+		if b&0x80 == 0 {
+			break
+		}
+	}
+	body = make([]byte, n)
+	if _, err := io.ReadFull(r, body); err != nil {
+		return 0, 0, nil, err
+	}
+	return h >> 4, h & 0xf, body, nil
+}
+
+func connectBody(clientID string, keepalive time.Duration) []byte {
+	b := appendString(nil, "MQTT")
+	s := int(keepalive / time.Second)
+	b = append(b, protocolLevel, connectClean, byte(s>>8), byte(s))
+	return appendString(b, clientID)
+}
+
+// connackError is the broker's refusal in a CONNACK, nil if it took the
+// connection
+func connackError(body []byte) error {
+	if len(body) != 2 {
+		return errMalformed
+	}
+	if body[1] != 0 {
+		return fmt.Errorf("MQTT broker refused the connection (%d)", body[1])
+	}
+	return nil
+}
+
+// publishBody is a QoS 0 publish, which carries no packet ID
+func publishBody(topic string, payload []byte) []byte {
+	b := appendString(make([]byte, 0, 2+len(topic)+len(payload)), topic)
+	return append(b, payload...)
+}
+
+func parsePublish(flags byte, body []byte) (topic string, payload []byte, err error) {
+	topic, rest, err := readString(body)
+	if err != nil {
+		return "", nil, err
+	}
+	if qos := flags >> 1 & 3; qos != 0 {
+		// Subscribed at QoS 0, but a broker may still send the ID
+		if len(rest) < 2 {
+			return "", nil, errMalformed
+		}
+		rest = rest[2:]
+	}
+	return topic, rest, nil
+}
+
+func subscribeBody(id uint16, filter string) []byte {
+	b := []byte{byte(id >> 8), byte(id)}
+	b = appendString(b, filter)
+	return append(b, 0) // QoS 0
+}
+
+func subackError(body []byte) error {
+	if len(body) < 3 {
+		return errMalformed
+	}
+	if body[2] == subscribeFailure {
+		return errors.New("MQTT broker refused the subscription")
+	}
+	return nil
+}
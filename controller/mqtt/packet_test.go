@@ -0,0 +1,50 @@
+package mqtt
+
+import (
+	"bufio"
+	"bytes"
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestPackets(t *testing.T) {
+	var w bytes.Buffer
+	if err := writePacket(&w, pktConnect, 0, connectBody("ledbrick-a", 30*time.Second)); err != nil {
+		t.Fatal(err)
+	}
+	want := []byte{0x10, 22, 0, 4, 'M', 'Q', 'T', 'T', 4, 2, 0, 30, 0, 10, 'l', 'e', 'd', 'b', 'r', 'i', 'c', 'k', '-', 'a'}
+	if !bytes.Equal(w.Bytes(), want) {
+		t.Errorf("connect % x", w.Bytes())
+	}
+
+	// Long enough for a two byte remaining length
+	payload := []byte(strings.Repeat("x", 200))
+	w.Reset()
+	writePacket(&w, pktPublish, 0, publishBody("a/telemetry", payload))
+	if b := w.Bytes(); b[1] != 0x80|(213&0x7f) || b[2] != 1 {
+		t.Errorf("remaining length % x", b[:3])
+	}
+	typ, flags, body, err := readPacket(bufio.NewReader(&w))
+	if err != nil || typ != pktPublish || flags != 0 {
+		t.Fatalf("read %d %d, %v", typ, flags, err)
+	}
+	topic, got, err := parsePublish(flags, body)
+	if err != nil || topic != "a/telemetry" || !bytes.Equal(got, payload) {
+		t.Errorf("publish %q % x, %v", topic, got, err)
+	}
+	// QoS 1 carries a packet ID ahead of the payload
+	if topic, got, err := parsePublish(2, append(publishBody("a/cmd/pause", nil)[:13], 0, 7, '!')); err != nil || topic != "a/cmd/pause" || string(got) != "!" {
+		t.Errorf("QoS 1 publish %q %q, %v", topic, got, err)
+	}
+
+	if err := connackError([]byte{0, 5}); err == nil {
+		t.Error("refused connection taken")
+	}
+	if err := subackError([]byte{0, 1, subscribeFailure}); err == nil {
+		t.Error("refused subscription taken")
+	}
+	if _, _, _, err := readPacket(bufio.NewReader(bytes.NewReader([]byte{0x30, 0xff, 0xff, 0xff, 0xff, 1}))); err != errMalformed {
+		t.Errorf("overlong length: %v", err)
+	}
+}
@@ -0,0 +1,278 @@
+package remote
+
+import (
+	"bufio"
+	"bytes"
+	"context"
+	"encoding/json"
+	"fmt"
+	"log"
+	"net/http"
+	"net/url"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+const (
+	reconnectMin = time.Second
+	reconnectMax = time.Minute
+	postTimeout  = 10 * time.Second
+	// Longest line taken from the stream, a snapshot with every schedule
+	maxEventBytes = 1 << 20
+)
+
+// Agent is a radio host's side: it runs the bricks in range on its own
+// channel as the central streams it, reconnecting when the stream drops.
+// The bricks hold their levels, and run the schedules they were given,
+// while it's away.
+type Agent struct {
+	central  string
+	name     string
+	token    string
+	ch       ble.BLEChannel
+	interval time.Duration
+	client   *http.Client
+	stop     chan struct{}
+
+	lock sync.Mutex
+	// Last event applied, to notice one missed
+	seq uint64
+}
+
+// NewAgent follows the central at base, an http:// URL, as name, and
+// posts telemetry every interval
+func NewAgent(base, name, token string, ch ble.BLEChannel, interval time.Duration) (*Agent, error) {
+	u, err := url.Parse(base)
+	if err != nil {
+		return nil, err
+	}
+	if u.Scheme != "http" && u.Scheme != "https" {
+		return nil, fmt.Errorf("central %q isn't an http URL", base)
+	}
+	if name == "" {
+		return nil, fmt.Errorf("agents need a name")
+	}
+	return &Agent{central: strings.TrimSuffix(base, "/"), name: name, token: token, ch: ch,
+		interval: interval, client: &http.Client{}, stop: make(chan struct{})}, nil
+}
+
+// Start follows the stream and posts telemetry, each on its own
+// goroutine, until Stop
+func (a *Agent) Start() {
+	go a.runStream()
+	go a.runTelemetry()
+}
+
+func (a *Agent) Stop() {
+	close(a.stop)
+}
+
+func (a *Agent) request(method, path string, body []byte) (*http.Request, error) {
+	r, err := http.NewRequest(method, a.central+path, bytes.NewReader(body))
+	if err != nil {
+		return nil, err
+	}
+	if a.token != "" {
+		r.Header.Set("Authorization", bearer(a.token))
+	}
+	return r, nil
+}
+
+func (a *Agent) runStream() {
+	wait := reconnectMin
+	for {
+		start := time.Now()
+		err := a.follow()
+		select {
+		case <-a.stop:
+			return
+		default:
+		}
+		if time.Since(start) > reconnectMax {
+			// It had been up a while, this is a fresh failure
+			wait = reconnectMin
+		}
+		log.Printf("Agent: stream from %s: %v, again in %v", a.central, err, wait)
+		select {
+		case <-a.stop:
+			return
+		case <-time.After(wait):
+		}
+		if wait *= 2; wait > reconnectMax {
+			wait = reconnectMax
+		}
+	}
+}
+
+// follow applies the stream until it ends
+func (a *Agent) follow() error {
+	r, err := a.request(http.MethodGet, "/agent/stream?name="+url.QueryEscape(a.name), nil)
+	if err != nil {
+		return err
+	}
+	// Stop ends the stream too
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	go func() {
+		select {
+		case <-a.stop:
+		case <-ctx.Done():
+		}
+		cancel()
+	}()
+	resp, err := a.client.Do(r.WithContext(ctx))
+	if err != nil {
+		return err
+	}
+	defer resp.Body.Close()
+	if resp.StatusCode != http.StatusOK {
+		return fmt.Errorf("%s", resp.Status)
+	}
+	log.Printf("Agent: following %s as %s", a.central, a.name)
+	s := bufio.NewScanner(resp.Body)
+	s.Buffer(make([]byte, 0, 4096), maxEventBytes)
+	for s.Scan() {
+		line := s.Bytes()
+		if len(line) == 0 {
+			continue // Keepalive
+		}
+		var ev event
+		if err := json.Unmarshal(line, &ev); err != nil {
+			return err
+		}
+		if err := a.apply(ev); err != nil {
+			return err
+		}
+	}
+	if err := s.Err(); err != nil {
+		return err
+	}
+	return fmt.Errorf("stream ended")
+}
+
+// apply runs an event on the channel. A diff that doesn't follow the
+// last event applied means one went missing, so the stream starts over
+// from a snapshot.
+func (a *Agent) apply(ev event) error {
+	a.lock.Lock()
+	defer a.lock.Unlock()
+	if !ev.Full && ev.Seq != a.seq+1 {
+		return fmt.Errorf("event %d after %d", ev.Seq, a.seq)
+	}
+	a.seq = ev.Seq
+
+	if ev.Zones != nil || ev.Full {
+		if err := a.ch.SetZones(ev.Zones); err != nil {
+			log.Printf("Agent: zones: %v", err)
+		}
+	}
+	for zone, s := range ev.Schedules {
+		loc, err := time.LoadLocation(s.Location)
+		if err == nil {
+			err = a.ch.SetZoneSchedule(zone, loc, s.Points)
+		}
+		if err != nil {
+			log.Printf("Agent: schedule %q: %v", zone, err)
+		}
+	}
+	if ev.Hold != nil {
+		a.ch.HoldSchedule(*ev.Hold)
+	}
+	if ev.Dim != nil {
+		if err := a.ch.SetMasterDim(*ev.Dim); err != nil {
+			log.Printf("Agent: master dim: %v", err)
+		}
+	}
+	if ev.Off != nil {
+		if err := a.ch.AllOff(*ev.Off); err != nil {
+			log.Printf("Agent: outputs off: %v", err)
+		}
+	}
+	if ev.Weather != nil {
+		if err := a.ch.StartWeather(*ev.Weather); err != nil {
+			log.Printf("Agent: weather: %v", err)
+		}
+	}
+	if ev.FadeMs != nil {
+		if err := a.ch.FadeOver(time.Duration(*ev.FadeMs) * time.Millisecond); err != nil {
+			log.Printf("Agent: fade: %v", err)
+		}
+	}
+	if ev.Scene != nil {
+		if err := a.ch.RecallScene(*ev.Scene); err != nil {
+			log.Printf("Agent: scene %d: %v", *ev.Scene, err)
+		}
+	}
+	if len(ev.Levels) == 0 {
+		return nil
+	}
+	for zone, percents := range ev.Levels {
+		for channel, percent := range percents {
+			var err error
+			if zone == "" {
+				err = a.ch.SetChannel(channel, percent)
+			} else {
+				err = a.ch.SetZoneChannel(zone, channel, percent)
+			}
+			if err != nil {
+				log.Printf("Agent: zone %q channel %d: %v", zone, channel, err)
+			}
+		}
+	}
+	if err := a.ch.Flush(); err != nil {
+		log.Printf("Agent: flush: %v", err)
+	}
+	return nil
+}
+
+func (a *Agent) runTelemetry() {
+	t := time.NewTicker(a.interval)
+	defer t.Stop()
+	for {
+		select {
+		case <-a.stop:
+			return
+		case now := <-t.C:
+			if err := a.post(a.batch(now)); err != nil {
+				log.Printf("Agent: telemetry: %v", err)
+			}
+		}
+	}
+}
+
+// batch is every brick in range, as it stands
+func (a *Agent) batch(now time.Time) batch {
+	b := batch{Agent: a.name, At: now.Unix(), Bricks: make(map[string]sample)}
+	for _, p := range a.ch.Perhipherals() {
+		b.Bricks[p.ID()] = sample{Active: p.Active(), TemperatureC: p.TemperatureC(),
+			FanRpm: p.FanRPM(), FanDuty: p.FanDuty(), Derate: p.Derate(),
+			Errors: p.Errors(), Lost: p.LostCommands()}
+	}
+	return b
+}
+
+func (a *Agent) post(b batch) error {
+	body, err := json.Marshal(b)
+	if err != nil {
+		return err
+	}
+	r, err := a.request(http.MethodPost, "/agent/telemetry", body)
+	if err != nil {
+		return err
+	}
+	r.Header.Set("Content-Type", "application/json")
+	c := *a.client
+	c.Timeout = postTimeout
+	resp, err := c.Do(r)
+	if err != nil {
+		return err
+	}
+	resp.Body.Close()
+	if resp.StatusCode != http.StatusNoContent {
+		return fmt.Errorf("%s", resp.Status)
+	}
+	return nil
+}
@@ -0,0 +1,70 @@
+package remote
+
+import (
+	"net/http/httptest"
+	"testing"
+	"time"
+)
+
+// eventually polls cond for up to a second
+func eventually(t *testing.T, what string, cond func() bool) {
+	t.Helper()
+	for i := 0; i < 100; i++ {
+		if cond() {
+			return
+		}
+		time.Sleep(10 * time.Millisecond)
+	}
+	t.Fatalf("never %s", what)
+}
+
+func TestAgentFollows(t *testing.T) {
+	h := NewHub(newFakeChannel(), "secret")
+	srv := httptest.NewServer(h.Handler())
+	defer srv.Close()
+	h.SetZoneChannel("tank", 1, 20)
+	h.Flush()
+
+	local := newFakeChannel()
+	a, err := NewAgent(srv.URL+"/", "rack1", "secret", local, time.Hour)
+	if err != nil {
+		t.Fatal(err)
+	}
+	a.Start()
+	defer a.Stop()
+
+	eventually(t, "took the snapshot", func() bool {
+		level, flushes := local.level("tank", 1)
+		return level == 20 && flushes == 1
+	})
+	h.SetZoneChannel("tank", 1, 35)
+	h.Flush()
+	eventually(t, "took the diff", func() bool {
+		level, flushes := local.level("tank", 1)
+		return level == 35 && flushes == 2
+	})
+	h.AllOff(true)
+	eventually(t, "turned off", func() bool {
+		local.lock.Lock()
+		defer local.lock.Unlock()
+		return local.off
+	})
+
+	// A gap means an event went missing
+	a.lock.Lock()
+	seq := a.seq
+	a.lock.Unlock()
+	if err := a.apply(event{Seq: seq + 2}); err == nil {
+		t.Error("gap taken")
+	}
+	if err := a.apply(event{Seq: 1, Full: true}); err != nil {
+		t.Errorf("snapshot after a gap: %v", err)
+	}
+
+	if _, err := NewAgent("rack:1", "rack1", "", local, time.Hour); err == nil {
+		t.Error("non-http central taken")
+	}
+	if _, err := NewAgent(srv.URL, "", "", local, time.Hour); err == nil {
+		t.Error("nameless agent taken")
+	}
+}
@@ -0,0 +1,450 @@
+// Package remote splits the controller across hosts, for rooms more
+// than one radio can reach. A central scheduler runs the light tables,
+// zones and overrides as one controller does, and radio agents on small
+// hosts near each rack run the bricks in their range. The central
+// streams every agent the same compact diffs of the levels it flushes,
+// and the zones, schedules, scenes and safety commands as they change,
+// so any number of agents follow one schedule source. Agents post their
+// bricks' telemetry back in batches.
+//
+// Both directions are plain HTTP, as the rest of the controller serves:
+//
+//	GET  /agent/stream?name=rack1     events, one JSON object a line, a snapshot first
+//	POST /agent/telemetry             a batch from an agent
+//	GET  /agent/status                every agent and its bricks' latest telemetry
+//
+// With a token set, both ends send it as a bearer token and the central
+// refuses requests without it.
+package remote
+
+import (
+	"encoding/json"
+	"fmt"
+	"log"
+	"net/http"
+	"sync"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+const (
+	// Events an agent may fall behind by before it's dropped, to start
+	// over from a snapshot
+	agentQueueLen = 64
+	// Blank lines keeping idle streams open through proxies
+	keepalive = 15 * time.Second
+	// Largest telemetry batch taken
+	maxBatchBytes = 1 << 20
+)
+
+// event is one line of the stream. A snapshot has every field that is
+// set, a diff only what changed: levels by zone ("" for bricks in none)
+// and channel.
+type event struct {
+	Seq       uint64                     `json:"seq"`
+	Full      bool                       `json:"full,omitempty"`
+	Zones     map[string]ble.ZoneMap     `json:"zones,omitempty"`
+	Schedules map[string]schedule        `json:"schedules,omitempty"`
+	Levels    map[string]map[int]float64 `json:"levels,omitempty"`
+	Hold      *bool                      `json:"hold,omitempty"`
+	Off       *bool                      `json:"off,omitempty"`
+	Dim       *int                       `json:"dim,omitempty"`
+	Scene     *int                       `json:"scene,omitempty"`
+	// Ms the next changes fade over, ble.FadeOver
+	FadeMs  *int64       `json:"fade_ms,omitempty"`
+	Weather *ble.Weather `json:"weather,omitempty"`
+}
+
+type schedule struct {
+	Location string              `json:"loc"`
+	Points   []ble.SchedulePoint `json:"points"`
+}
+
+// sample is one brick in a telemetry batch
+type sample struct {
+	Active       bool    `json:"active"`
+	TemperatureC float64 `json:"c"`
+	FanRpm       int     `json:"rpm"`
+	FanDuty      int     `json:"fan_duty"`
+	Derate       int     `json:"derate"`
+	Errors       uint8   `json:"errors"`
+	Lost         int     `json:"lost"`
+}
+
+type batch struct {
+	Agent  string            `json:"agent"`
+	At     int64             `json:"at"`
+	Bricks map[string]sample `json:"bricks"`
+}
+
+// AgentStatus is what the central knows of an agent
+type AgentStatus struct {
+	Connected bool              `json:"connected"`
+	Seen      int64             `json:"seen"`
+	Bricks    map[string]sample `json:"bricks"`
+}
+
+type agentConn struct {
+	name   string
+	events chan []byte
+	// Closed when the agent fell behind
+	dropped chan struct{}
+}
+
+// Hub is the central's side. It stands in for the central's own
+// channel, which still runs any bricks in its range, and passes on
+// what the tables do to it to every agent.
+type Hub struct {
+	ble.BLEChannel
+	token string
+
+	seq       uint64
+	zones     map[string]ble.ZoneMap
+	schedules map[string]schedule
+	// Levels as set and as last flushed to the agents
+	levels  map[string]map[int]float64
+	flushed map[string]map[int]float64
+	hold    bool
+	off     bool
+	dim     int
+	conns   map[*agentConn]bool
+	agents  map[string]*AgentStatus
+
+	lock sync.Mutex
+}
+
+func NewHub(ch ble.BLEChannel, token string) *Hub {
+	return &Hub{BLEChannel: ch, token: token,
+		schedules: make(map[string]schedule),
+		levels:    make(map[string]map[int]float64),
+		flushed:   make(map[string]map[int]float64),
+		dim:       100,
+		conns:     make(map[*agentConn]bool),
+		agents:    make(map[string]*AgentStatus),
+	}
+}
+
+// publish sends ev to every agent, numbered. Called with h.lock held.
+func (h *Hub) publish(ev event) {
+	h.seq++
+	ev.Seq = h.seq
+	if len(h.conns) == 0 {
+		return
+	}
+	b, err := json.Marshal(ev)
+	if err != nil {
+		log.Printf("Agents: %v", err)
+		return
+	}
+	b = append(b, '\n')
+	for c := range h.conns {
+		select {
+		case c.events <- b:
+		default:
+			log.Printf("Agents: %s fell behind, starting it over", c.name)
+			delete(h.conns, c)
+			close(c.dropped)
+		}
+	}
+}
+
+// snapshot is the whole state as it was last flushed. Called with
+// h.lock held.
+func (h *Hub) snapshot() event {
+	hold, off, dim := h.hold, h.off, h.dim
+	ev := event{Seq: h.seq, Full: true, Zones: h.zones, Schedules: h.schedules,
+		Levels: h.flushed, Hold: &hold, Off: &off, Dim: &dim}
+	return ev
+}
+
+func (h *Hub) set(zone string, channel int, percent float64) {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	if h.levels[zone] == nil {
+		h.levels[zone] = make(map[int]float64)
+	}
+	h.levels[zone][channel] = percent
+}
+
+func (h *Hub) SetChannel(channel int, percent float64) error {
+	if err := h.BLEChannel.SetChannel(channel, percent); err != nil {
+		return err
+	}
+	h.set("", channel, percent)
+	return nil
+}
+
+func (h *Hub) SetZoneChannel(zone string, channel int, percent float64) error {
+	if err := h.BLEChannel.SetZoneChannel(zone, channel, percent); err != nil {
+		return err
+	}
+	h.set(zone, channel, percent)
+	return nil
+}
+
+// Flush sends the agents the levels that moved since the last one, and
+// the bricks in range theirs
+func (h *Hub) Flush() error {
+	err := h.BLEChannel.Flush()
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	d := make(map[string]map[int]float64)
+	for zone, percents := range h.levels {
+		for channel, percent := range percents {
+			if last, ok := h.flushed[zone][channel]; ok && last == percent {
+				continue
+			}
+			if d[zone] == nil {
+				d[zone] = make(map[int]float64)
+			}
+			d[zone][channel] = percent
+			if h.flushed[zone] == nil {
+				h.flushed[zone] = make(map[int]float64)
+			}
+			h.flushed[zone][channel] = percent
+		}
+	}
+	if len(d) > 0 {
+		h.publish(event{Levels: d})
+	}
+	return err
+}
+
+func (h *Hub) SetZones(zones map[string]ble.ZoneMap) error {
+	if err := h.BLEChannel.SetZones(zones); err != nil {
+		return err
+	}
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.zones = zones
+	// A zone gone takes its levels and schedule with it
+	for zone := range h.levels {
+		if _, ok := zones[zone]; !ok && zone != "" {
+			delete(h.levels, zone)
+			delete(h.flushed, zone)
+			delete(h.schedules, zone)
+		}
+	}
+	h.publish(event{Zones: zones})
+	return nil
+}
+
+func (h *Hub) SetSchedule(loc *time.Location, points []ble.SchedulePoint) error {
+	return h.SetZoneSchedule("", loc, points)
+}
+
+func (h *Hub) SetZoneSchedule(zone string, loc *time.Location, points []ble.SchedulePoint) error {
+	if err := h.BLEChannel.SetZoneSchedule(zone, loc, points); err != nil {
+		return err
+	}
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	s := schedule{Location: loc.String(), Points: points}
+	h.schedules[zone] = s
+	h.publish(event{Schedules: map[string]schedule{zone: s}})
+	return nil
+}
+
+func (h *Hub) HoldSchedule(hold bool) {
+	h.BLEChannel.HoldSchedule(hold)
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	if hold == h.hold {
+		return
+	}
+	h.hold = hold
+	h.publish(event{Hold: &hold})
+}
+
+func (h *Hub) AllOff(off bool) error {
+	err := h.BLEChannel.AllOff(off)
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.off = off
+	h.publish(event{Off: &off})
+	return err
+}
+
+func (h *Hub) SetMasterDim(percent int) error {
+	if err := h.BLEChannel.SetMasterDim(percent); err != nil {
+		return err
+	}
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.dim = percent
+	h.publish(event{Dim: &percent})
+	return nil
+}
+
+// RecallScene has every agent recall the slot too, from the scenes its
+// bricks were given
+func (h *Hub) RecallScene(slot int) error {
+	err := h.BLEChannel.RecallScene(slot)
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.publish(event{Scene: &slot})
+	return err
+}
+
+func (h *Hub) FadeOver(d time.Duration) error {
+	if err := h.BLEChannel.FadeOver(d); err != nil {
+		return err
+	}
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	ms := int64(d / time.Millisecond)
+	h.publish(event{FadeMs: &ms})
+	return nil
+}
+
+func (h *Hub) StartWeather(w ble.Weather) error {
+	err := h.BLEChannel.StartWeather(w)
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	h.publish(event{Weather: &w})
+	return err
+}
+
+// Agents is what each agent last told, by name
+func (h *Hub) Agents() map[string]AgentStatus {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	out := make(map[string]AgentStatus, len(h.agents))
+	for name, a := range h.agents {
+		s := *a
+		s.Bricks = make(map[string]sample, len(a.Bricks))
+		for id, b := range a.Bricks {
+			s.Bricks[id] = b
+		}
+		out[name] = s
+	}
+	return out
+}
+
+func (h *Hub) agent(name string) *AgentStatus {
+	a := h.agents[name]
+	if a == nil {
+		a = &AgentStatus{Bricks: make(map[string]sample)}
+		h.agents[name] = a
+	}
+	return a
+}
+
+func (h *Hub) authorized(r *http.Request) bool {
+	return h.token == "" || r.Header.Get("Authorization") == bearer(h.token)
+}
+
+// Handler serves the agents, under /agent/
+func (h *Hub) Handler() http.Handler {
+	mux := http.NewServeMux()
+	mux.HandleFunc("/agent/stream", h.serveStream)
+	mux.HandleFunc("/agent/telemetry", h.serveTelemetry)
+	mux.HandleFunc("/agent/status", h.serveStatus)
+	return http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		if !h.authorized(r) {
+			http.Error(w, "unauthorized", http.StatusUnauthorized)
+			return
+		}
+		mux.ServeHTTP(w, r)
+	})
+}
+
+func (h *Hub) serveStream(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodGet {
+		http.Error(w, "GET only", http.StatusMethodNotAllowed)
+		return
+	}
+	name := r.URL.Query().Get("name")
+	if name == "" {
+		http.Error(w, "agents need a name", http.StatusBadRequest)
+		return
+	}
+	flusher, ok := w.(http.Flusher)
+	if !ok {
+		http.Error(w, "streaming unsupported", http.StatusInternalServerError)
+		return
+	}
+	w.Header().Set("Content-Type", "application/x-ndjson")
+	w.Header().Set("Cache-Control", "no-cache")
+
+	c := &agentConn{name: name, events: make(chan []byte, agentQueueLen), dropped: make(chan struct{})}
+	h.lock.Lock()
+	// Registered with the snapshot taken, so the next event follows it
+	snap, err := json.Marshal(h.snapshot())
+	h.conns[c] = true
+	h.agent(name).Connected = true
+	h.lock.Unlock()
+	log.Printf("Agents: %s streaming from %s", name, r.RemoteAddr)
+	defer func() {
+		h.lock.Lock()
+		delete(h.conns, c)
+		h.agent(name).Connected = false
+		h.lock.Unlock()
+		log.Printf("Agents: %s gone", name)
+	}()
+	if err != nil {
+		log.Printf("Agents: snapshot: %v", err)
+		return
+	}
+	if _, err := w.Write(append(snap, '\n')); err != nil {
+		return
+	}
+	flusher.Flush()
+
+	ping := time.NewTicker(keepalive)
+	defer ping.Stop()
+	for {
+		select {
+		case <-r.Context().Done():
+			return
+		case <-c.dropped:
+			return
+		case b := <-c.events:
+			if _, err := w.Write(b); err != nil {
+				return
+			}
+		case <-ping.C:
+			if _, err := w.Write([]byte("\n")); err != nil {
+				return
+			}
+		}
+		flusher.Flush()
+	}
+}
+
+func (h *Hub) serveTelemetry(w http.ResponseWriter, r *http.Request) {
+	if r.Method != http.MethodPost {
+		http.Error(w, "POST only", http.StatusMethodNotAllowed)
+		return
+	}
+	var b batch
+	if err := json.NewDecoder(http.MaxBytesReader(w, r.Body, maxBatchBytes)).Decode(&b); err != nil {
+		http.Error(w, fmt.Sprintf("batch: %v", err), http.StatusBadRequest)
+		return
+	}
+	if b.Agent == "" {
+		http.Error(w, "batches need an agent", http.StatusBadRequest)
+		return
+	}
+	h.lock.Lock()
+	a := h.agent(b.Agent)
+	a.Seen = b.At
+	// Every brick the agent has comes in each batch
+	a.Bricks = b.Bricks
+	if a.Bricks == nil {
+		a.Bricks = make(map[string]sample)
+	}
+	h.lock.Unlock()
+	w.WriteHeader(http.StatusNoContent)
+}
+
+func (h *Hub) serveStatus(w http.ResponseWriter, r *http.Request) {
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(h.Agents())
+}
+
+// bearer is the Authorization header value for token
+func bearer(token string) string {
+	return "Bearer " + token
+}
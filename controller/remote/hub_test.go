@@ -0,0 +1,175 @@
+package remote
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"net/http"
+	"net/http/httptest"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/theatrus/ledbrick/controller/ble"
+)
+
+// fakeChannel takes what the hub or an agent passes it
+type fakeChannel struct {
+	ble.BLEChannel
+	levels  map[string]map[int]float64
+	zones   map[string]ble.ZoneMap
+	flushes int
+	off     bool
+	bricks  []ble.BLEPeripheral
+
+	lock sync.Mutex
+}
+
+func newFakeChannel() *fakeChannel {
+	return &fakeChannel{levels: make(map[string]map[int]float64)}
+}
+
+func (f *fakeChannel) SetChannel(channel int, percent float64) error {
+	return f.SetZoneChannel("", channel, percent)
+}
+
+func (f *fakeChannel) SetZoneChannel(zone string, channel int, percent float64) error {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	if f.levels[zone] == nil {
+		f.levels[zone] = make(map[int]float64)
+	}
+	f.levels[zone][channel] = percent
+	return nil
+}
+
+func (f *fakeChannel) SetZones(zones map[string]ble.ZoneMap) error {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	f.zones = zones
+	return nil
+}
+
+func (f *fakeChannel) Flush() error {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	f.flushes++
+	return nil
+}
+
+func (f *fakeChannel) HoldSchedule(hold bool)         {}
+func (f *fakeChannel) SetMasterDim(percent int) error { return nil }
+func (f *fakeChannel) RecallScene(slot int) error     { return nil }
+
+func (f *fakeChannel) AllOff(off bool) error {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	f.off = off
+	return nil
+}
+
+func (f *fakeChannel) Perhipherals() []ble.BLEPeripheral {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	return f.bricks
+}
+
+func (f *fakeChannel) level(zone string, channel int) (float64, int) {
+	f.lock.Lock()
+	defer f.lock.Unlock()
+	return f.levels[zone][channel], f.flushes
+}
+
+func readEvent(t *testing.T, s *bufio.Scanner) event {
+	t.Helper()
+	for s.Scan() {
+		if len(s.Bytes()) == 0 {
+			continue
+		}
+		var ev event
+		if err := json.Unmarshal(s.Bytes(), &ev); err != nil {
+			t.Fatal(err)
+		}
+		return ev
+	}
+	t.Fatalf("stream ended: %v", s.Err())
+	return event{}
+}
+
+func TestHubStream(t *testing.T) {
+	h := NewHub(newFakeChannel(), "secret")
+	srv := httptest.NewServer(h.Handler())
+	defer srv.Close()
+
+	h.SetZoneChannel("tank", 2, 40)
+	h.Flush()
+
+	if resp, err := http.Get(srv.URL + "/agent/stream?name=rack1"); err != nil || resp.StatusCode != http.StatusUnauthorized {
+		t.Fatalf("no token: %v %v", resp, err)
+	}
+	r, _ := http.NewRequest(http.MethodGet, srv.URL+"/agent/stream?name=rack1", nil)
+	r.Header.Set("Authorization", bearer("secret"))
+	resp, err := http.DefaultClient.Do(r)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer resp.Body.Close()
+	s := bufio.NewScanner(resp.Body)
+
+	// The snapshot carries what was flushed before
+	snap := readEvent(t, s)
+	if !snap.Full || snap.Seq != 1 || snap.Levels["tank"][2] != 40 {
+		t.Fatalf("snapshot %+v", snap)
+	}
+
+	// Then only what moved
+	h.SetZoneChannel("tank", 2, 40)
+	h.SetZoneChannel("tank", 3, 10)
+	h.SetChannel(0, 5)
+	h.Flush()
+	d := readEvent(t, s)
+	if d.Full || d.Seq != 2 || len(d.Levels["tank"]) != 1 || d.Levels["tank"][3] != 10 || d.Levels[""][0] != 5 {
+		t.Errorf("diff %+v", d)
+	}
+	// An unchanged flush says nothing, a safety command goes at once
+	h.Flush()
+	h.AllOff(true)
+	if off := readEvent(t, s); off.Seq != 3 || off.Off == nil || !*off.Off || off.Levels != nil {
+		t.Errorf("off %+v", off)
+	}
+	if a := h.Agents()["rack1"]; !a.Connected {
+		t.Errorf("rack1 %+v", a)
+	}
+}
+
+func TestHubTelemetry(t *testing.T) {
+	h := NewHub(newFakeChannel(), "")
+	srv := httptest.NewServer(h.Handler())
+	defer srv.Close()
+
+	post := func(b batch) int {
+		body, _ := json.Marshal(b)
+		resp, err := http.Post(srv.URL+"/agent/telemetry", "application/json", bytes.NewReader(body))
+		if err != nil {
+			t.Fatal(err)
+		}
+		resp.Body.Close()
+		return resp.StatusCode
+	}
+	at := time.Unix(1000, 0).Unix()
+	if code := post(batch{Agent: "rack1", At: at, Bricks: map[string]sample{"a": {Active: true, TemperatureC: 31}}}); code != http.StatusNoContent {
+		t.Fatalf("status %d", code)
+	}
+	if code := post(batch{At: at}); code != http.StatusBadRequest {
+		t.Errorf("nameless batch: status %d", code)
+	}
+	a := h.Agents()["rack1"]
+	if a.Connected || a.Seen != at || a.Bricks["a"].TemperatureC != 31 {
+		t.Errorf("rack1 %+v", a)
+	}
+	// Each batch has every brick the agent has
+	post(batch{Agent: "rack1", At: at + 10, Bricks: map[string]sample{"b": {}}})
+	if a := h.Agents()["rack1"]; len(a.Bricks) != 1 {
+		t.Errorf("rack1 bricks %v", a.Bricks)
+	}
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "pstorage.h"
+#include "ledbrick_flash.h"
+#include "flash_sched.h"
+#include "tick.h"
+#include "clock.h"
+#include "fan_control.h"
+#include "aux.h"
+
+// Stored layout: magic (uint16 LE, AUX_MAGIC), reserved (uint16), then a
+// record per output in channel order. Boards with no spare outputs keep
+// a slot so the tables stay sized.
+#define SLOTS MAX(AUX_CHANNELS, 1)
+#define HEADER_LEN 4
+// pstorage wants word aligned lengths and buffers
+#define STORE_LEN ((HEADER_LEN + SLOTS * AUX_RECORD_LEN + 3) & ~3)
+
+STATIC_ASSERT(AUX_FIRST <= PCA9685_NUM_LEDS);
+STATIC_ASSERT(STORE_LEN <= FLASH_PAGE_SIZE); // Its one page
+
+static uint32_t store_buf[STORE_LEN / 4];
+static uint8_t * const stored = (uint8_t *)store_buf;
+static pstorage_handle_t store;
+static uint8_t save_job = FLASH_SCHED_INVALID;
+static uint16_t duties[SLOTS];
+static uint8_t task = TICK_INVALID;
+
+static uint8_t * record(uint8_t i) {
+	return &stored[HEADER_LEN + i * AUX_RECORD_LEN];
+}
+
+static void record_default(uint8_t i, uint8_t * p_record) {
+	memset(p_record, 0, AUX_RECORD_LEN);
+	p_record[0] = AUX_FIRST + i;
+}
+
+static bool record_valid(uint8_t const * p_record) {
+	uint16_t low = uint16_decode(&p_record[2]);
+	uint16_t high = uint16_decode(&p_record[4]);
+
+	if (p_record[0] < AUX_FIRST || p_record[0] >= PCA9685_NUM_LEDS || p_record[1] >= AUX_MODE_COUNT) {
+		return false;
+	}
+	if (low >= PCA9685_COUNTS || high >= PCA9685_COUNTS || p_record[8] > 100) {
+		return false;
+	}
+	return p_record[1] != AUX_MODE_WAVE || uint16_decode(&p_record[6]) > 0;
+}
+
+// What an output drives right now
+static uint16_t duty_of(uint8_t const * p_record) {
+	uint16_t low = uint16_decode(&p_record[2]);
+	uint16_t high = uint16_decode(&p_record[4]);
+
+	switch ((aux_mode_t)p_record[1]) {
+	case AUX_MODE_FIXED:
+		return high;
+	case AUX_MODE_FAN: {
+		uint8_t percent = fan_control_duty();
+		if (percent == 0) {
+			return 0;
+		}
+		return low + (int32_t)(high - low) * percent / 100;
+	}
+	case AUX_MODE_WAVE: {
+		uint32_t period_ms = uint16_decode(&p_record[6]) * 1000UL;
+		uint32_t t = (clock_ms() + period_ms * p_record[8] / 100) % period_ms;
+		return t < period_ms / 2 ? high : low;
+	}
+	default:
+		return 0;
+	}
+}
+
+// Flushed with whatever else is dirty, or held into the frame being
+// built (pca9685_hold()). Fixed outputs leave the tick idle once set.
+static void on_tick(void) {
+	bool moved = false;
+	bool live = false;
+
+	for (uint8_t i = 0; i < AUX_CHANNELS; i++) {
+		uint16_t d = duty_of(record(i));
+		live |= record(i)[1] == AUX_MODE_FAN || record(i)[1] == AUX_MODE_WAVE;
+		if (d != duties[i]) {
+			duties[i] = d;
+			pca9685_set_aux(AUX_FIRST + i, d);
+			moved = true;
+		}
+	}
+	if (moved) {
+		pca9685_flush();
+	}
+	if (live) {
+		tick_wake(task);
+	} else {
+		tick_idle(task);
+	}
+}
+
+static void on_store(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result,
+                     uint8_t * p_data, uint32_t data_len) {
+	// A failed write still leaves the outputs running until the next reset
+}
+
+static void save_run(void) {
+	(void)pstorage_update(&store, stored, STORE_LEN, 0);
+}
+
+bool aux_set(uint8_t const * p_record) {
+	uint8_t i = p_record[0] - AUX_FIRST;
+
+	if (!record_valid(p_record)) {
+		return false;
+	}
+	// Controllers program every output on each connect
+	if (memcmp(record(i), p_record, AUX_RECORD_LEN) == 0) {
+		return true;
+	}
+	memcpy(record(i), p_record, AUX_RECORD_LEN);
+	on_tick();
+	flash_sched_request(save_job);
+	return true;
+}
+
+uint16_t aux_get(uint8_t * p_out) {
+	memcpy(p_out, record(0), AUX_CHANNELS * AUX_RECORD_LEN);
+	return AUX_CHANNELS * AUX_RECORD_LEN;
+}
+
+void aux_init(void) {
+	pstorage_module_param_t param = {
+		.cb = on_store,
+		.block_size = STORE_LEN,
+		.block_count = 1,
+	};
+	bool usable;
+
+	if (AUX_CHANNELS == 0) {
+		return;
+	}
+	save_job = flash_sched_register(save_run);
+	usable = pstorage_register(&param, &store) == NRF_SUCCESS &&
+	         pstorage_load(stored, &store, STORE_LEN, 0) == NRF_SUCCESS &&
+	         uint16_decode(&stored[0]) == AUX_MAGIC;
+	for (uint8_t i = 0; i < AUX_CHANNELS; i++) {
+		// Erased flash, or nothing usable
+		if (!usable || !record_valid(record(i)) || record(i)[0] != AUX_FIRST + i) {
+			record_default(i, record(i));
+		}
+	}
+	uint16_encode(AUX_MAGIC, &stored[0]);
+	task = tick_register(on_tick, AUX_TICK_MS, 0);
+	on_tick();
+}
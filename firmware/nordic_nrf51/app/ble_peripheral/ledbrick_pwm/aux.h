@@ -0,0 +1,56 @@
+#ifndef _AUX_H_
+#define _AUX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+
+// Auxiliary outputs: the PCA9685 channels past the emitter strings a
+// board wires (BOARD_LED_CHANNELS up to PCA9685_NUM_LEDS), driving
+// pumps, wavemakers, a switched fan or a moonlight string with duties of
+// their own. They skip gamma, calibration and derate, ride out the LED
+// error shutdown, and go out in the same burst as the LED frame, so they
+// cost no bus transactions of their own. Kept in flash, so a pump comes
+// back on after a power cut.
+//
+// They still share OE with the LEDs: the master dimmer, effects, supply
+// shedding and a thermal trip all hold them too, and the PWM runs at
+// the LED frequency (pca9685.h). A fan here wants switching through a
+// FET, the 25 kHz PWM input of a 4-wire fan needs the nRF's own pin
+// (fan_control.h).
+#define AUX_FIRST BOARD_LED_CHANNELS
+#define AUX_CHANNELS (PCA9685_NUM_LEDS - BOARD_LED_CHANNELS)
+#define AUX_TICK_MS 100
+
+typedef enum {
+	AUX_MODE_OFF = 0,
+	AUX_MODE_FIXED, // High duty, for a pump or a moonlight
+	AUX_MODE_FAN,   // Low to high duty with the fan loop, off when it is
+	AUX_MODE_WAVE,  // High for the first half of each period, low for the
+	                // second, phase percent into the period at boot, so
+	                // two wavemakers at 0 and 50 take turns
+	AUX_MODE_COUNT
+} aux_mode_t;
+
+// A record, as stored and over BULK_CMD_AUX (bulk.h):
+//   0  channel (uint8, AUX_FIRST and up)
+//   1  mode (uint8, aux_mode_t)
+//   2  low duty, high duty (uint16 LE each, 0-4095)
+//   6  period s (uint16 LE, 1 and up for AUX_MODE_WAVE)
+//   8  phase percent (uint8)
+#define AUX_RECORD_LEN 9
+
+#define AUX_MAGIC 0x4158
+
+// Needs pstorage_init() and tick_init() to have run. Puts every output
+// back as stored.
+void aux_init(void);
+
+// Set an output from a record, false if it isn't auxiliary or the record
+// doesn't make sense. Unchanged records cost no flash write, changed ones
+// are written at the next opening (flash_sched.h).
+bool aux_set(uint8_t const * p_record);
+// Every output's record, AUX_RECORD_LEN each, returns the length
+uint16_t aux_get(uint8_t * p_out);
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "nrf_soc.h"
+#include "pstorage.h"
+#include "bulk.h"
+#include "clock.h"
+#include "flash_sched.h"
+#include "pca9685.h"
+#include "twi_queue.h"
+#include "bench.h"
+
+#define ALL_OUTPUTS ((1 << PCA9685_OUTPUTS) - 1)
+
+typedef enum {
+	FLASH_IDLE = 0,
+	FLASH_ERASE,
+	FLASH_WRITE,
+} flash_state_t;
+
+static bool running = false;
+static uint16_t results[BENCH_LEN / 2];
+
+static flash_state_t flash_state = FLASH_IDLE;
+static uint8_t flash_writes;
+static uint32_t flash_start;
+static uint32_t flash_total_us;
+static uint16_t flash_max_us;
+// Written from here, so it must outlive the operation
+static uint32_t flash_word;
+
+static uint16_t per_second(uint32_t count, uint32_t ms) {
+	return ms == 0 ? 0 : MIN((count * 1000) / ms, BENCH_SKIPPED - 1);
+}
+
+static void finish(void) {
+	uint8_t * p_reply = bulk_reply_body();
+	uint16_t len = 0;
+
+	for (uint8_t i = 0; i < BENCH_LEN / 2; i++) {
+		len += uint16_encode(results[i], &p_reply[len]);
+	}
+	running = false;
+	bulk_complete(BULK_STATUS_OK, len);
+}
+
+// Since flash_start, off the RTC1 counter
+static uint16_t elapsed_us(void) {
+	uint32_t now, ticks;
+
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, flash_start, &ticks);
+	// 1000000 / 32768 us a tick, capped ahead so the product fits
+	ticks = MIN(ticks, 0x10000);
+	return MIN((ticks * 15625) / 512, BENCH_SKIPPED - 1);
+}
+
+static uint32_t * swap_page(void) {
+	return (uint32_t *)PSTORAGE_SWAP_ADDR;
+}
+
+static void flash_fail(void) {
+	flash_state = FLASH_IDLE;
+	results[3] = results[4] = results[5] = BENCH_SKIPPED;
+	finish();
+}
+
+static void flash_next(void) {
+	if (flash_writes == BENCH_FLASH_WRITES) {
+		flash_state = FLASH_IDLE;
+		results[4] = flash_total_us / BENCH_FLASH_WRITES;
+		results[5] = flash_max_us;
+		finish();
+		return;
+	}
+	flash_state = FLASH_WRITE;
+	flash_word = flash_writes;
+	app_timer_cnt_get(&flash_start);
+	if (sd_flash_write(swap_page() + flash_writes, &flash_word, 1) != NRF_SUCCESS) {
+		flash_fail();
+	}
+}
+
+void bench_on_sys_evt(uint32_t sys_evt) {
+	if (flash_state == FLASH_IDLE) {
+		return;
+	}
+	if (sys_evt == NRF_EVT_FLASH_OPERATION_ERROR) {
+		flash_fail();
+		return;
+	}
+	if (sys_evt != NRF_EVT_FLASH_OPERATION_SUCCESS) {
+		return;
+	}
+	uint16_t us = elapsed_us();
+	if (flash_state == FLASH_ERASE) {
+		results[3] = us;
+	} else {
+		flash_total_us += us;
+		flash_max_us = MAX(flash_max_us, us);
+		flash_writes++;
+	}
+	flash_next();
+}
+
+static void flash_phase(void) {
+	uint32_t queued;
+
+	if (pstorage_access_status_get(&queued) != NRF_SUCCESS || queued != 0 || !flash_sched_open()) {
+		results[3] = results[4] = results[5] = BENCH_SKIPPED;
+		finish();
+		return;
+	}
+	flash_writes = 0;
+	flash_total_us = 0;
+	flash_max_us = 0;
+	flash_state = FLASH_ERASE;
+	app_timer_cnt_get(&flash_start);
+	if (sd_flash_page_erase(PSTORAGE_SWAP_ADDR / PSTORAGE_FLASH_PAGE_SIZE) != NRF_SUCCESS) {
+		flash_fail();
+	}
+}
+
+static void on_fill_done(uint32_t packets, uint32_t ms) {
+	results[2] = per_second(packets, ms);
+	flash_phase();
+}
+
+// Frames of outputs, back to back, each waited out
+static uint16_t twi_rate(uint16_t outputs) {
+	uint32_t start = clock_ms();
+	uint32_t frames = 0;
+
+	if (!pca9685_present()) {
+		return 0;
+	}
+	while (clock_ms() - start < BENCH_TWI_MS) {
+		pca9685_resend(outputs);
+		if (!twi_queue_flush()) {
+			break;
+		}
+		frames++;
+	}
+	return per_second(frames, clock_ms() - start);
+}
+
+// Out of the bulk handler, which holds flushes for its own frame
+static void run(void * p_event_data, uint16_t event_size) {
+	results[0] = twi_rate(1);
+	results[1] = twi_rate(ALL_OUTPUTS);
+	if (!bulk_fill(BENCH_NOTIFY_MS, on_fill_done)) {
+		// The link went while the bus ran
+		results[2] = 0;
+		flash_phase();
+	}
+}
+
+bool bench_start(void) {
+	if (running || app_sched_event_put(NULL, 0, run) != NRF_SUCCESS) {
+		return false;
+	}
+	running = true;
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Self benchmark (BULK_CMD_BENCH), for the controller to run across a
+// fleet and pick out the bricks whose bus or link has gone bad. The
+// phases run back to back, about a second and a half in all, and the
+// reply waits for the last (bulk.h):
+//   TWI     PCA9685 frames back to back for BENCH_TWI_MS each, first one
+//           output per chip, then every output. They re-send the outputs
+//           as they are, so nothing moves, and hold the main loop while
+//           they run, as bring up does.
+//   Notify  bulk filler packets as fast as the SoftDevice takes them,
+//           for BENCH_NOTIFY_MS, on the link's parameters as they are.
+//   Flash   a page erase and BENCH_FLASH_WRITES word writes, each timed
+//           to its completion, on pstorage's swap page, which it erases
+//           before every use and keeps nothing in between. Skipped while
+//           pstorage has work queued or the link leaves flash no room
+//           (flash_sched.h), as a stalled queue would need a reset.
+#define BENCH_TWI_MS 200
+#define BENCH_NOTIFY_MS 1000
+#define BENCH_FLASH_WRITES 8
+#define BENCH_SKIPPED 0xFFFF
+
+// Reply, BENCH_LEN bytes:
+//   0  one output frames a second (uint16 LE)
+//   2  full frames a second (uint16 LE)
+//   4  notifications a second (uint16 LE)
+//   6  page erase, then word write mean and longest, us (uint16 LE
+//      each, BENCH_SKIPPED when the flash phase was)
+#define BENCH_LEN 12
+
+// From the bulk handler: true if a run has started and will complete
+// the pending reply, false if one is already going
+bool bench_start(void);
+void bench_on_sys_evt(uint32_t sys_evt);
+
+#endif
@@ -1,63 +1,1953 @@
 
 #include "ble_lbs.h"
+#include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
 #include "nordic_common.h"
 #include "ble_srv_common.h"
 #include "app_util.h"
+#include "crc16.h"
+#include "pool.h"
 
+STATIC_ASSERT(sizeof(ble_lbs_tx_t) <= POOL_SMALL_SIZE);
+
+
+
+static void status_reset(ble_lbs_t * p_lbs)
+{
+    p_lbs->cmd_count = 0;
+    p_lbs->cmd_crc   = 0xFFFF;
+}
+
+
+static void telemetry_reset(ble_lbs_telemetry_t * p_tlm)
+{
+    memset(p_tlm, 0, sizeof(*p_tlm));
+}
+
+
+// Decide whether a new value is worth a notification
+static bool telemetry_due(ble_lbs_t * p_lbs, ble_lbs_telemetry_t * p_tlm,
+                          uint32_t value, uint16_t deadband)
+{
+    uint32_t delta;
+
+    p_tlm->age++;
+    if (!p_tlm->sent)
+    {
+        return true;
+    }
+    delta = (value > p_tlm->last) ? value - p_tlm->last : p_tlm->last - value;
+    if (delta > deadband)
+    {
+        return true;
+    }
+    return (p_lbs->max_interval != 0) && (p_tlm->age >= p_lbs->max_interval);
+}
+
+
+static void tx_reset(ble_lbs_t * p_lbs)
+{
+    p_lbs->tx_head  = 0;
+    p_lbs->tx_count = 0;
+}
+
+
+static uint8_t link_of(ble_lbs_t const * p_lbs, uint16_t conn_handle)
+{
+    for (uint8_t i = 0; i < LBS_MAX_LINKS; i++)
+    {
+        if (p_lbs->conn_handles[i] == conn_handle)
+        {
+            return i;
+        }
+    }
+    return LBS_NO_LINK;
+}
+
+
+// Hand queued notifications to the SoftDevice, each to every link still
+// waiting for it, until it runs out of buffers. BLE_EVT_TX_COMPLETE
+// calls this again as they free up.
+static void tx_pump(ble_lbs_t * p_lbs)
+{
+    ble_gatts_hvx_params_t params;
+    uint32_t err_code;
+
+    while (p_lbs->tx_count > 0)
+    {
+        ble_lbs_tx_t * p_tx = p_lbs->tx_queue[p_lbs->tx_head];
+
+        for (uint8_t i = 0; (i < LBS_MAX_LINKS) && (p_tx->links != 0); i++)
+        {
+            uint16_t len = p_tx->len;
+
+            if (!(p_tx->links & (1 << i)))
+            {
+                continue;
+            }
+            memset(&params, 0, sizeof(params));
+            params.type = BLE_GATT_HVX_NOTIFICATION;
+            params.handle = p_tx->handle;
+            params.p_data = p_tx->live ? NULL : p_tx->data;
+            params.p_len = &len;
+
+            err_code = sd_ble_gatts_hvx(p_lbs->conn_handles[i], &params);
+            if (err_code == BLE_ERROR_NO_TX_BUFFERS)
+            {
+                return;
+            }
+            if (err_code == NRF_SUCCESS)
+            {
+                p_lbs->tx_stats.sent++;
+            }
+            else
+            {
+                p_lbs->tx_stats.dropped_error++;
+            }
+            p_tx->links &= ~(1 << i);
+        }
+        pool_free(POOL_SMALL, p_tx);
+        p_lbs->tx_head = (p_lbs->tx_head + 1) % LBS_TX_QUEUE_SIZE;
+        p_lbs->tx_count--;
+    }
+}
+
+
+// Queue a notification for links, a bit each. A value still waiting for
+// the same handle is stale, so it is overwritten in place rather than
+// sent twice, and goes to everyone it's now for.
+static uint32_t tx_queue(ble_lbs_t * p_lbs, uint16_t handle, uint8_t const * p_data, uint16_t len,
+                         uint8_t links)
+{
+    ble_lbs_tx_t * p_tx = NULL;
+
+    for (uint8_t i = 0; i < p_lbs->tx_count; i++)
+    {
+        ble_lbs_tx_t * p_entry = p_lbs->tx_queue[(p_lbs->tx_head + i) % LBS_TX_QUEUE_SIZE];
+        if (p_entry->handle == handle)
+        {
+            p_tx = p_entry;
+            p_lbs->tx_stats.merged++;
+            break;
+        }
+    }
+    if (p_tx == NULL)
+    {
+        if (p_lbs->tx_count < LBS_TX_QUEUE_SIZE)
+        {
+            p_tx = pool_alloc(POOL_SMALL);
+        }
+        if (p_tx == NULL)
+        {
+            p_lbs->tx_stats.dropped_full++;
+            return NRF_ERROR_NO_MEM;
+        }
+        p_lbs->tx_queue[(p_lbs->tx_head + p_lbs->tx_count) % LBS_TX_QUEUE_SIZE] = p_tx;
+        p_lbs->tx_count++;
+    }
+
+    p_tx->handle = handle;
+    p_tx->len    = len;
+    p_tx->links  = links;
+    p_tx->live   = (p_data == NULL);
+    if (p_data != NULL)
+    {
+        memcpy(p_tx->data, p_data, len);
+    }
+
+    tx_pump(p_lbs);
+    return NRF_SUCCESS;
+}
+
+
+static uint32_t telemetry_send(ble_lbs_t * p_lbs, ble_lbs_telemetry_t * p_tlm,
+                               uint16_t handle, uint32_t value,
+                               uint8_t * p_data, uint16_t len)
+{
+    uint32_t err_code;
+
+    err_code = tx_queue(p_lbs, handle, p_data, len, p_tlm->enabled);
+    if (err_code == NRF_SUCCESS)
+    {
+        p_tlm->sent = true;
+        p_tlm->last = value;
+        p_tlm->age  = 0;
+    }
+    return err_code;
+}
+
+
+// Links are only ever subscribed while connected, see link_forget()
+static bool telemetry_active(ble_lbs_t * p_lbs, ble_lbs_telemetry_t const * p_tlm)
+{
+    UNUSED_PARAMETER(p_lbs);
+    return p_tlm->enabled != 0;
+}
+
+
+static void on_cccd_write(ble_lbs_telemetry_t * p_tlm, uint8_t link, ble_gatts_evt_write_t * p_evt_write)
+{
+    if (p_evt_write->len == 2)
+    {
+        if (ble_srv_is_notification_enabled(p_evt_write->data))
+        {
+            p_tlm->enabled |= 1 << link;
+        }
+        else
+        {
+            p_tlm->enabled &= ~(1 << link);
+        }
+        p_tlm->sent = false; // New subscribers get the current value next update
+    }
+}
+
+
+// Take control for link if nobody holds it, true if link has it
+static bool control_take(ble_lbs_t * p_lbs, uint8_t link)
+{
+    if (p_lbs->control == LBS_NO_LINK)
+    {
+        p_lbs->control = link;
+        status_reset(p_lbs);
+        p_lbs->cmd_synced = false;
+    }
+    return p_lbs->control == link;
+}
+
+
+// Drop link's subscriptions, and anything queued for it alone
+static void link_forget(ble_lbs_t * p_lbs, uint8_t link)
+{
+    uint8_t keep = ~(1 << link);
+
+    p_lbs->fan_tlm.enabled &= keep;
+    p_lbs->temp_tlm.enabled &= keep;
+    p_lbs->status_tlm.enabled &= keep;
+    p_lbs->telemetry_tlm.enabled &= keep;
+    p_lbs->link_tlm.enabled &= keep;
+    p_lbs->cmd_tlm.enabled &= keep;
+    p_lbs->sync_tlm.enabled &= keep;
+    p_lbs->temp_reads &= keep;
+    p_lbs->fan_reads &= keep;
+    for (uint8_t i = 0; i < p_lbs->tx_count; i++)
+    {
+        p_lbs->tx_queue[(p_lbs->tx_head + i) % LBS_TX_QUEUE_SIZE]->links &= keep;
+    }
+}
 
 
 static void on_connect(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
 {
-    p_lbs->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    uint8_t link = link_of(p_lbs, BLE_CONN_HANDLE_INVALID);
+
+    if (link == LBS_NO_LINK)
+    {
+        return;
+    }
+    p_lbs->conn_handles[link] = p_ble_evt->evt.gap_evt.conn_handle;
+    // No bonding, so every connection starts with notifications off
+    link_forget(p_lbs, link);
 }
 
 
 static void on_disconnect(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
 {
-    UNUSED_PARAMETER(p_ble_evt);
-    p_lbs->conn_handle = BLE_CONN_HANDLE_INVALID;
+    uint8_t link = link_of(p_lbs, p_ble_evt->evt.gap_evt.conn_handle);
+
+    if (link == LBS_NO_LINK)
+    {
+        return;
+    }
+    p_lbs->conn_handles[link] = BLE_CONN_HANDLE_INVALID;
+    link_forget(p_lbs, link);
+    if (p_lbs->control == link)
+    {
+        p_lbs->control = LBS_NO_LINK;
+    }
+    if (p_lbs->sync_link == link)
+    {
+        p_lbs->sync_link = LBS_NO_LINK;
+    }
+    if (ble_lbs_links(p_lbs) == 0)
+    {
+        tx_reset(p_lbs);
+    }
 }
 
 
 
-static void on_write(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
+// Unpack a frame into levels indexed by channel. Packed frames carry 12
+// bit levels, two to three bytes.
+static bool frame_decode(uint8_t const * p_data, uint16_t len, bool packed,
+                         uint16_t * p_mask, uint16_t * p_levels, uint16_t * p_duration_ms)
 {
-    ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
-    
-    if ((p_evt_write->handle == p_lbs->led_char_handles.value_handle) &&
-        (p_evt_write->len == 2) &&
-        (p_lbs->led_write_handler != NULL))
+    uint16_t mask;
+    uint16_t count = 0;
+
+    if (len < LBS_FRAME_HEADER_LEN)
+    {
+        return false;
+    }
+    mask = uint16_decode(&p_data[0]);
+
+    for (uint8_t i = 0; i < LBS_FRAME_MAX_CHANNELS; i++)
+    {
+        if (mask & (1 << i))
+        {
+            count++;
+        }
+    }
+    // Fewer or more levels than mask bits drops the frame
+    if (len != LBS_FRAME_HEADER_LEN + (packed ? (count * 3 + 1) / 2 : count * 2))
+    {
+        return false;
+    }
+
+    count = 0;
+    for (uint8_t i = 0; i < LBS_FRAME_MAX_CHANNELS; i++)
     {
-        p_lbs->led_write_handler(p_lbs, p_evt_write->data[0], p_evt_write->data[1]);
+        if (!(mask & (1 << i)))
+        {
+            continue;
+        }
+        if (packed)
+        {
+            uint8_t const * p_pair = &p_data[LBS_FRAME_HEADER_LEN + (count / 2) * 3];
+            p_levels[i] = (count % 2 == 0) ? p_pair[0] | ((p_pair[1] & 0x0F) << 8)
+                                           : (p_pair[1] >> 4) | (p_pair[2] << 4);
+        }
+        else
+        {
+            p_levels[i] = uint16_decode(&p_data[LBS_FRAME_HEADER_LEN + count * 2]);
+        }
+        count++;
     }
+
+    *p_mask        = mask;
+    *p_duration_ms = uint16_decode(&p_data[2]);
+    return true;
 }
 
 
-void ble_lbs_on_ble_evt(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
+static void on_frame_write(ble_lbs_t * p_lbs, ble_gatts_evt_write_t * p_evt_write)
 {
-    switch (p_ble_evt->header.evt_id)
+    uint16_t levels[LBS_FRAME_MAX_CHANNELS];
+    uint16_t mask;
+    uint16_t duration_ms;
+
+    if (frame_decode(p_evt_write->data, p_evt_write->len, false, &mask, levels, &duration_ms))
     {
-        case BLE_GAP_EVT_CONNECTED:
-            on_connect(p_lbs, p_ble_evt);
-            break;
-            
-        case BLE_GAP_EVT_DISCONNECTED:
-            on_disconnect(p_lbs, p_ble_evt);
-            break;
-            
-        case BLE_GATTS_EVT_WRITE:
-            on_write(p_lbs, p_ble_evt);
-            break;
-            
-        default:
-            // No implementation needed.
-            break;
+        p_lbs->frame_write_handler(p_lbs, mask, levels, duration_ms);
+    }
+}
+
+
+// Longest frame value, the unpacked frame of every channel. The default
+// ATT payload is the practical limit, longer records need a bulk frame.
+#define CMD_FRAME_MAX_LEN (LBS_FRAME_HEADER_LEN + 2 * LBS_FRAME_MAX_CHANNELS)
+
+// Command records. Entries run with the value length already checked
+// against the table and return false to reject the write.
+typedef bool (*cmd_run_t)(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len);
+
+typedef struct
+{
+    uint8_t   op;
+    uint8_t   min_len;
+    uint8_t   max_len;
+    cmd_run_t run;
+} cmd_entry_t;
+
+static bool cmd_level(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if ((p_lbs->led_write_handler == NULL) || (p_value[0] >= LBS_FRAME_MAX_CHANNELS))
+    {
+        return false;
+    }
+    p_lbs->led_write_handler(p_lbs, p_value[0], uint16_decode(&p_value[1]));
+    return true;
+}
+
+static bool cmd_level_all(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->led_write_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->led_write_handler(p_lbs, 0xFF, uint16_decode(&p_value[0]));
+    return true;
+}
+
+static bool cmd_output_enable(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->led_write_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->led_write_handler(p_lbs, 0xFE, p_value[0]);
+    return true;
+}
+
+static bool cmd_fade(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if ((p_lbs->fade_write_handler == NULL) || (p_value[0] >= LBS_FRAME_MAX_CHANNELS))
+    {
+        return false;
+    }
+    p_lbs->fade_write_handler(p_lbs, p_value[0], uint16_decode(&p_value[1]), uint16_decode(&p_value[3]));
+    return true;
+}
+
+static bool cmd_fade_all(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->fade_write_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->fade_write_handler(p_lbs, 0xFF, uint16_decode(&p_value[0]), uint16_decode(&p_value[2]));
+    return true;
+}
+
+static bool cmd_frame_common(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len, bool packed)
+{
+    uint16_t levels[LBS_FRAME_MAX_CHANNELS];
+    uint16_t mask;
+    uint16_t duration_ms;
+
+    if ((p_lbs->frame_write_handler == NULL) ||
+        !frame_decode(p_value, len, packed, &mask, levels, &duration_ms))
+    {
+        return false;
+    }
+    p_lbs->frame_write_handler(p_lbs, mask, levels, duration_ms);
+    return true;
+}
+
+static bool cmd_frame(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return cmd_frame_common(p_lbs, p_value, len, false);
+}
+
+static bool cmd_frame_packed(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return cmd_frame_common(p_lbs, p_value, len, true);
+}
+
+static bool cmd_profile(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->link_write_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->link_write_handler(p_lbs, p_value[0]);
+    return true;
+}
+
+static bool cmd_scene(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len, uint8_t op)
+{
+    return (p_lbs->scene_handler != NULL) &&
+           p_lbs->scene_handler(p_lbs, op, p_value[0], (len >= 3) ? uint16_decode(&p_value[1]) : 0);
+}
+
+static bool cmd_scene_recall(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return cmd_scene(p_lbs, p_value, len, LBS_CMD_OP_SCENE_RECALL);
+}
+
+static bool cmd_scene_save(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return cmd_scene(p_lbs, p_value, len, LBS_CMD_OP_SCENE_SAVE);
+}
+
+static bool cmd_scene_clear(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return cmd_scene(p_lbs, p_value, len, LBS_CMD_OP_SCENE_CLEAR);
+}
+
+static bool cmd_pwm_freq(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->pwm_freq_handler != NULL) &&
+           p_lbs->pwm_freq_handler(p_lbs, uint16_decode(p_value));
+}
+
+static bool cmd_dither(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->dither_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->dither_handler(p_lbs, uint16_decode(p_value));
+    return true;
+}
+
+static bool cmd_stage(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    uint16_t levels[LBS_FRAME_MAX_CHANNELS];
+    uint16_t mask;
+    uint16_t duration_ms;
+
+    if ((p_lbs->stage_handler == NULL) ||
+        !frame_decode(p_value, len, true, &mask, levels, &duration_ms))
+    {
+        return false;
+    }
+    p_lbs->stage_handler(p_lbs, mask, levels, duration_ms);
+    return true;
+}
+
+static bool cmd_commit(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->commit_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->commit_handler(p_lbs);
+    return true;
+}
+
+static bool cmd_dim(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->dim_handler != NULL) &&
+           p_lbs->dim_handler(p_lbs, p_value[0]);
+}
+
+static bool cmd_slew(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->slew_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->slew_handler(p_lbs, uint16_decode(&p_value[0]), uint16_decode(&p_value[2]));
+    return true;
+}
+
+static bool cmd_sim(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->sim_handler != NULL) &&
+           p_lbs->sim_handler(p_lbs, p_value[0], (int16_t)uint16_decode(&p_value[1]),
+                              (int16_t)uint16_decode(&p_value[3]), uint16_decode(&p_value[5]));
+}
+
+static bool cmd_effect(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->effect_handler != NULL) &&
+           p_lbs->effect_handler(p_lbs, p_value[0], uint16_decode(&p_value[1]), p_value[3],
+                                 p_value[4], p_value[5], uint16_decode(&p_value[6]));
+}
+
+static bool cmd_burnin(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->burnin_handler != NULL) &&
+           p_lbs->burnin_handler(p_lbs, uint16_decode(&p_value[0]), p_value[2]);
+}
+
+static bool cmd_lease(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->lease_handler != NULL) &&
+           p_lbs->lease_handler(p_lbs, uint16_decode(&p_value[0]), p_value[2]);
+}
+
+static bool cmd_fan_lead(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    if (p_lbs->fan_lead_handler == NULL)
+    {
+        return false;
+    }
+    p_lbs->fan_lead_handler(p_lbs, p_value[0], uint16_decode(&p_value[1]));
+    return true;
+}
+
+static bool cmd_stream_start(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->stream_start_handler != NULL) &&
+           p_lbs->stream_start_handler(p_lbs, uint32_decode(&p_value[0]), uint16_decode(&p_value[4]),
+                                       uint16_decode(&p_value[6]));
+}
+
+static bool cmd_stream_frame(ble_lbs_t * p_lbs, uint8_t const * p_value, uint8_t len)
+{
+    return (p_lbs->stream_frame_handler != NULL) &&
+           p_lbs->stream_frame_handler(p_lbs, p_value, len);
+}
+
+static const cmd_entry_t cmd_table[] =
+{
+    { LBS_CMD_OP_LEVEL,         3,                    3,                    cmd_level },
+    { LBS_CMD_OP_LEVEL_ALL,     2,                    2,                    cmd_level_all },
+    { LBS_CMD_OP_OUTPUT_ENABLE, 1,                    1,                    cmd_output_enable },
+    { LBS_CMD_OP_FADE,          LBS_FADE_RECORD_LEN,  LBS_FADE_RECORD_LEN,  cmd_fade },
+    { LBS_CMD_OP_FADE_ALL,      4,                    4,                    cmd_fade_all },
+    { LBS_CMD_OP_FRAME,         LBS_FRAME_HEADER_LEN, CMD_FRAME_MAX_LEN,    cmd_frame },
+    { LBS_CMD_OP_FRAME_PACKED,  LBS_FRAME_HEADER_LEN, CMD_FRAME_MAX_LEN,    cmd_frame_packed },
+    { LBS_CMD_OP_PROFILE,       1,                    1,                    cmd_profile },
+    { LBS_CMD_OP_SCENE_RECALL,  1,                    1,                    cmd_scene_recall },
+    { LBS_CMD_OP_SCENE_SAVE,    3,                    3,                    cmd_scene_save },
+    { LBS_CMD_OP_SCENE_CLEAR,   1,                    1,                    cmd_scene_clear },
+    { LBS_CMD_OP_AT,            4,                    4,                    NULL },  // In cmd_run
+    { LBS_CMD_OP_PWM_FREQ,      2,                    2,                    cmd_pwm_freq },
+    { LBS_CMD_OP_DITHER,        2,                    2,                    cmd_dither },
+    { LBS_CMD_OP_STAGE,         LBS_FRAME_HEADER_LEN, CMD_FRAME_MAX_LEN,    cmd_stage },
+    { LBS_CMD_OP_COMMIT,        0,                    0,                    cmd_commit },
+    { LBS_CMD_OP_DIM,           1,                    1,                    cmd_dim },
+    { LBS_CMD_OP_SLEW,          4,                    4,                    cmd_slew },
+    { LBS_CMD_OP_SIM,           7,                    7,                    cmd_sim },
+    { LBS_CMD_OP_EFFECT,        8,                    8,                    cmd_effect },
+    { LBS_CMD_OP_BURN_IN,       3,                    3,                    cmd_burnin },
+    { LBS_CMD_OP_LEASE,         3,                    3,                    cmd_lease },
+    { LBS_CMD_OP_FAN_LEAD,      3,                    3,                    cmd_fan_lead },
+    { LBS_CMD_OP_STREAM_START,  8,                    8,                    cmd_stream_start },
+    { LBS_CMD_OP_STREAM_FRAME,  2,                    14,                   cmd_stream_frame },
+};
+
+static cmd_entry_t const * cmd_lookup(uint8_t op)
+{
+    for (uint8_t i = 0; i < sizeof(cmd_table) / sizeof(cmd_table[0]); i++)
+    {
+        if (cmd_table[i].op == op)
+        {
+            return &cmd_table[i];
+        }
+    }
+    return NULL;
+}
+
+
+// Walk the records once without running them, so a bad one anywhere
+// leaves the whole write unapplied
+static bool cmd_valid(uint8_t const * p_records, uint16_t len)
+{
+    uint16_t offset = 0;
+
+    while (offset < len)
+    {
+        cmd_entry_t const * p_entry;
+
+        if (offset + LBS_CMD_RECORD_HEADER_LEN > len)
+        {
+            return false;
+        }
+        p_entry = cmd_lookup(p_records[offset]);
+        uint8_t value_len = p_records[offset + 1];
+        offset += LBS_CMD_RECORD_HEADER_LEN;
+        if ((p_entry == NULL) || (offset + value_len > len) ||
+            (value_len < p_entry->min_len) || (value_len > p_entry->max_len))
+        {
+            return false;
+        }
+        offset += value_len;
     }
+    return true;
+}
+
+
+static bool cmd_run(ble_lbs_t * p_lbs, uint8_t const * p_records, uint16_t len)
+{
+    uint16_t offset = 0;
+    bool ok = true;
+
+    while (offset < len)
+    {
+        cmd_entry_t const * p_entry = cmd_lookup(p_records[offset]);
+        uint8_t value_len = p_records[offset + 1];
+
+        offset += LBS_CMD_RECORD_HEADER_LEN;
+        if (p_entry->op == LBS_CMD_OP_AT)
+        {
+            // Takes the rest of the write with it
+            return ok && (p_lbs->at_handler != NULL) &&
+                   p_lbs->at_handler(p_lbs, uint32_decode(&p_records[offset]),
+                                     &p_records[offset + value_len], len - offset - value_len);
+        }
+        ok &= p_entry->run(p_lbs, &p_records[offset], value_len);
+        offset += value_len;
+    }
+    return ok;
+}
+
+
+bool ble_lbs_run(ble_lbs_t * p_lbs, uint8_t const * p_records, uint16_t len)
+{
+    return cmd_valid(p_records, len) && cmd_run(p_lbs, p_records, len);
+}
+
+
+// Whether a write changes the outputs now, for tracing. Records held for
+// later would only time the hold.
+static bool cmd_traced(uint8_t const * p_records, uint16_t len)
+{
+    bool output = false;
+
+    for (uint16_t offset = 0; offset < len; offset += LBS_CMD_RECORD_HEADER_LEN + p_records[offset + 1])
+    {
+        switch (p_records[offset])
+        {
+            case LBS_CMD_OP_AT:
+                return false;
+            case LBS_CMD_OP_LEVEL:
+            case LBS_CMD_OP_LEVEL_ALL:
+            case LBS_CMD_OP_FADE:
+            case LBS_CMD_OP_FADE_ALL:
+            case LBS_CMD_OP_FRAME:
+            case LBS_CMD_OP_FRAME_PACKED:
+            case LBS_CMD_OP_COMMIT:
+            case LBS_CMD_OP_SCENE_RECALL:
+                output = true;
+                break;
+            default:
+                break;
+        }
+    }
+    return output;
+}
+
+
+// Acks go to the link in control, or every subscriber if none has it,
+// for commands from other transports. p_trace is the trace to append,
+// NULL for none.
+static void cmd_ack(ble_lbs_t * p_lbs, uint8_t const * p_trace)
+{
+    uint8_t ack[LBS_CMD_ACK_TRACE_LEN];
+    uint16_t len = LBS_CMD_ACK_LEN;
+    uint8_t links = p_lbs->cmd_tlm.enabled;
+
+    if (p_lbs->control != LBS_NO_LINK)
+    {
+        links &= 1 << p_lbs->control;
+    }
+    if (links == 0)
+    {
+        return;
+    }
+    ack[0] = LBS_CMD_VERSION;
+    ack[1] = p_lbs->cmd_seq;
+    uint32_encode(p_lbs->cmd_received, &ack[2]);
+    uint32_encode(p_lbs->cmd_rejected, &ack[6]);
+    if (p_trace != NULL)
+    {
+        memcpy(&ack[LBS_CMD_ACK_LEN], p_trace, LBS_CMD_ACK_TRACE_LEN - LBS_CMD_ACK_LEN);
+        len = LBS_CMD_ACK_TRACE_LEN;
+    }
+    (void)tx_queue(p_lbs, p_lbs->command_char_handles.value_handle, ack, len, links);
+}
+
+
+void ble_lbs_command_trace(ble_lbs_t * p_lbs, uint8_t seq, uint32_t received_ms, uint16_t commit_ms)
+{
+    uint8_t trace[LBS_CMD_ACK_TRACE_LEN - LBS_CMD_ACK_LEN];
+
+    if (!p_lbs->cmd_synced)
+    {
+        return; // Control changed hands since
+    }
+    trace[0] = seq;
+    uint32_encode(received_ms, &trace[1]);
+    uint16_encode(commit_ms, &trace[5]);
+    cmd_ack(p_lbs, trace);
+}
+
+
+// Whether a signed write's counter hasn't run: newer than the latest,
+// or one of the window before it not yet seen
+static bool cmd_counter_fresh(ble_lbs_t const * p_lbs, uint32_t counter)
+{
+    uint32_t delta = counter - p_lbs->cmd_counter;
+
+    if (counter == 0)
+    {
+        return false;
+    }
+    if ((delta != 0) && (delta < 0x80000000UL))
+    {
+        return true;
+    }
+    delta = -delta;
+    return (delta < LBS_CMD_WINDOW) && !(p_lbs->cmd_counters & (1UL << delta));
+}
+
+
+// Takes a fresh counter, sliding the window as the sequence numbers' does
+static void cmd_counter_take(ble_lbs_t * p_lbs, uint32_t counter)
+{
+    uint32_t delta = counter - p_lbs->cmd_counter;
+
+    if (delta < 0x80000000UL)
+    {
+        p_lbs->cmd_counters = (delta < LBS_CMD_WINDOW) ? (p_lbs->cmd_counters << delta) | 1 : 1;
+        p_lbs->cmd_counter  = counter;
+    }
+    else
+    {
+        p_lbs->cmd_counters |= 1UL << (uint32_t)-delta;
+    }
+}
+
+
+// A command write from link. Nothing moves until it is known to be
+// genuine and fresh: not control, nor either window.
+static bool cmd_write(ble_lbs_t * p_lbs, uint8_t link, uint8_t const * p_data, uint16_t len)
+{
+    uint8_t seq;
+    uint8_t delta;
+    uint8_t shift;
+    uint32_t bit;
+    uint32_t received;
+    uint32_t rejected;
+    bool ok;
+    bool is_signed;
+    bool fresh;
+    uint16_t header = LBS_CMD_HEADER_LEN;
+    uint32_t counter = 0;
+
+    if ((len < LBS_CMD_HEADER_LEN) || ((p_data[0] & ~LBS_CMD_SIGNED) != LBS_CMD_VERSION))
+    {
+        return false;
+    }
+    is_signed = (p_data[0] & LBS_CMD_SIGNED) != 0;
+    if (is_signed)
+    {
+        // The MAC first, so nothing forged moves the window. Its length
+        // byte limits signed writes to 255 bytes, bulk ones included.
+        header = LBS_CMD_SIGNED_HEADER_LEN;
+        if ((p_lbs->mac_handler == NULL) ||
+            (len < LBS_CMD_SIGNED_HEADER_LEN + LBS_CMD_MAC_LEN) || (len - LBS_CMD_MAC_LEN > 0xFF) ||
+            !p_lbs->mac_handler(p_data, len - LBS_CMD_MAC_LEN, &p_data[len - LBS_CMD_MAC_LEN]))
+        {
+            return false;
+        }
+        len -= LBS_CMD_MAC_LEN;
+        counter = uint32_decode(&p_data[2]);
+    }
+    else if (p_lbs->cmd_mac_required)
+    {
+        // Refused unacked, before it can take a sequence number a signed
+        // write would then find already run
+        return false;
+    }
+    // A counter that has run can only be a resend, from the link that
+    // already holds control, so it mustn't take it
+    fresh = !is_signed || cmd_counter_fresh(p_lbs, counter);
+    if (!(fresh ? control_take(p_lbs, link) : (p_lbs->control == link)))
+    {
+        return false;
+    }
+    seq = p_data[1];
+
+    // Where the window would slide up to a newer sequence number, or the
+    // bit of one that arrived late
+    delta = p_lbs->cmd_synced ? (uint8_t)(seq - p_lbs->cmd_seq) : 0;
+    if (delta < 0x80)
+    {
+        shift = delta;
+        bit = 1;
+    }
+    else if ((uint8_t)-delta < LBS_CMD_WINDOW)
+    {
+        shift = 0;
+        bit = 1UL << (uint8_t)-delta;
+    }
+    else
+    {
+        return false; // Too old to ack
+    }
+    received = (p_lbs->cmd_synced && (shift < LBS_CMD_WINDOW)) ? p_lbs->cmd_received << shift : 0;
+    rejected = (p_lbs->cmd_synced && (shift < LBS_CMD_WINDOW)) ? p_lbs->cmd_rejected << shift : 0;
+
+    if (received & bit)
+    {
+        // A resend of one already run
+        ok = !(rejected & bit);
+    }
+    else if (!fresh)
+    {
+        // Played back from before, dropped unacked as a bad MAC is so it
+        // can't take the sequence number of the write it reuses
+        return false;
+    }
+    else
+    {
+        if (is_signed)
+        {
+            cmd_counter_take(p_lbs, counter);
+        }
+        if (bit == 1)
+        {
+            p_lbs->cmd_seq = seq;
+        }
+        p_lbs->cmd_synced   = true;
+        p_lbs->cmd_received = received;
+        p_lbs->cmd_rejected = rejected;
+        ok = cmd_valid(&p_data[header], len - header) &&
+             cmd_run(p_lbs, &p_data[header], len - header);
+        p_lbs->cmd_received |= bit;
+        if (!ok)
+        {
+            p_lbs->cmd_rejected |= bit;
+        }
+        else if ((p_lbs->trace_handler != NULL) &&
+                 cmd_traced(&p_data[header], len - header))
+        {
+            p_lbs->trace_handler(p_lbs, seq);
+        }
+    }
+    cmd_ack(p_lbs, NULL);
+    return ok;
+}
+
+
+bool ble_lbs_command(ble_lbs_t * p_lbs, uint16_t conn_handle, uint8_t const * p_data, uint16_t len)
+{
+    uint8_t link = link_of(p_lbs, conn_handle);
+
+    return (link != LBS_NO_LINK) && cmd_write(p_lbs, link, p_data, len);
+}
+
+
+bool ble_lbs_control_take(ble_lbs_t * p_lbs, uint16_t conn_handle)
+{
+    uint8_t link = link_of(p_lbs, conn_handle);
+
+    return !p_lbs->cmd_mac_required && (link != LBS_NO_LINK) && control_take(p_lbs, link);
+}
+
+
+static void on_write(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
+{
+    ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
+    uint8_t link = link_of(p_lbs, p_ble_evt->evt.gatts_evt.conn_handle);
+
+    if (link == LBS_NO_LINK)
+    {
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->fan_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->fan_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->temp_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->temp_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->status_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->status_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->telemetry_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->telemetry_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->link_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->link_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->command_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->cmd_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->sync_char_handles.cccd_handle)
+    {
+        on_cccd_write(&p_lbs->sync_tlm, link, p_evt_write);
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->sync_char_handles.value_handle)
+    {
+        if ((p_evt_write->len == LBS_SYNC_WRITE_LEN) && (p_lbs->sync_write_handler != NULL))
+        {
+            p_lbs->sync_link = link;
+            p_lbs->sync_write_handler(p_lbs, uint32_decode(p_evt_write->data));
+        }
+        return;
+    }
+    // Everything below drives the brick. A command write takes control
+    // once it checks out; with MAC required nothing else can.
+    if (p_evt_write->handle == p_lbs->command_char_handles.value_handle)
+    {
+        (void)cmd_write(p_lbs, link, p_evt_write->data, p_evt_write->len);
+        return;
+    }
+    if (p_lbs->cmd_mac_required || !control_take(p_lbs, link))
+    {
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->link_char_handles.value_handle)
+    {
+        if ((p_evt_write->len == LBS_LINK_WRITE_LEN) && (p_lbs->link_write_handler != NULL))
+        {
+            p_lbs->link_write_handler(p_lbs, p_evt_write->data[0]);
+        }
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->time_char_handles.value_handle)
+    {
+        if (((p_evt_write->len == LBS_TIME_WRITE_LEN) || (p_evt_write->len == LBS_TIME_WRITE_FRACTION_LEN)) &&
+            (p_lbs->time_write_handler != NULL))
+        {
+            p_lbs->time_write_handler(p_lbs, uint32_decode(&p_evt_write->data[0]),
+                                      (p_evt_write->len == LBS_TIME_WRITE_FRACTION_LEN) ? p_evt_write->data[4] : 0);
+        }
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->events_char_handles.value_handle)
+    {
+        if (p_evt_write->len == 4 && p_lbs->events_ack_handler != NULL)
+        {
+            p_lbs->events_ack_handler(p_lbs, uint32_decode(p_evt_write->data));
+        }
+        return;
+    }
+#if LATENCY_ENABLED
+    if (p_evt_write->handle == p_lbs->latency_char_handles.value_handle)
+    {
+        if (p_lbs->latency_reset_handler != NULL)
+        {
+            p_lbs->latency_reset_handler(p_lbs);
+        }
+        return;
+    }
+#endif
+    if (p_evt_write->handle == p_lbs->crash_char_handles.value_handle)
+    {
+        if (p_lbs->crash_clear_handler != NULL)
+        {
+            p_lbs->crash_clear_handler(p_lbs);
+        }
+        return;
+    }
+    if (p_evt_write->handle == p_lbs->schedule_char_handles.value_handle)
+    {
+        if ((p_evt_write->len > 0) && (p_lbs->schedule_write_handler != NULL))
+        {
+            p_lbs->schedule_write_handler(p_lbs, p_evt_write->data, p_evt_write->len);
+        }
+        return;
+    }
+
+    // Requests and commands arrive the same way, account for every
+    // command write, valid or not, so the counts line up with the sender
+    if ((p_evt_write->handle == p_lbs->led_char_handles.value_handle) ||
+        (p_evt_write->handle == p_lbs->fade_char_handles.value_handle) ||
+        (p_evt_write->handle == p_lbs->frame_char_handles.value_handle))
+    {
+        p_lbs->cmd_count++;
+        p_lbs->cmd_crc = crc16_compute(p_evt_write->data, p_evt_write->len, &p_lbs->cmd_crc);
+    }
+    
+    if ((p_evt_write->handle == p_lbs->led_char_handles.value_handle) &&
+        (p_evt_write->len == LBS_LED_LEGACY_LEN) &&
+        (p_lbs->led_write_handler != NULL))
+    {
+        p_lbs->led_write_handler(p_lbs, p_evt_write->data[0],
+                                 p_evt_write->data[1] << LBS_LED_LEGACY_SHIFT);
+    }
+    else if ((p_evt_write->handle == p_lbs->led_char_handles.value_handle) &&
+             (p_evt_write->len == LBS_LED_LEVEL_LEN) &&
+             (p_lbs->led_write_handler != NULL))
+    {
+        p_lbs->led_write_handler(p_lbs, p_evt_write->data[0],
+                                 uint16_decode(&p_evt_write->data[1]));
+    }
+    else if ((p_evt_write->handle == p_lbs->fade_char_handles.value_handle) &&
+             (p_evt_write->len > 0) &&
+             (p_evt_write->len % LBS_FADE_RECORD_LEN == 0) &&
+             (p_lbs->fade_write_handler != NULL))
+    {
+        for (uint16_t i = 0; i < p_evt_write->len; i += LBS_FADE_RECORD_LEN)
+        {
+            uint8_t * p_rec = &p_evt_write->data[i];
+            p_lbs->fade_write_handler(p_lbs, p_rec[0],
+                                      uint16_decode(&p_rec[1]),
+                                      uint16_decode(&p_rec[3]));
+        }
+    }
+    else if ((p_evt_write->handle == p_lbs->frame_char_handles.value_handle) &&
+             (p_lbs->frame_write_handler != NULL))
+    {
+        on_frame_write(p_lbs, p_evt_write);
+    }
+}
+
+
+// Answer every read held in *p_reads with p_data, or with the value as
+// it stands when NULL
+static void read_reply(ble_lbs_t * p_lbs, uint8_t * p_reads, uint8_t * p_data, uint16_t len)
+{
+    ble_gatts_rw_authorize_reply_params_t reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.type = BLE_GATTS_AUTHORIZE_TYPE_READ;
+    reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+    reply.params.read.update = (p_data != NULL);
+    reply.params.read.offset = 0;
+    reply.params.read.len = len;
+    reply.params.read.p_data = p_data;
+    for (uint8_t i = 0; i < LBS_MAX_LINKS; i++)
+    {
+        if (*p_reads & (1 << i))
+        {
+            (void)sd_ble_gatts_rw_authorize_reply(p_lbs->conn_handles[i], &reply);
+        }
+    }
+    *p_reads = 0;
+}
+
+
+// A read of a sensor is held for the handler to take a reading. Another
+// read of the same sensor waits on the same one. The command
+// characteristic is answered at once.
+static void on_rw_authorize(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
+{
+    ble_gatts_evt_rw_authorize_request_t * p_req = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+    uint8_t link = link_of(p_lbs, p_ble_evt->evt.gatts_evt.conn_handle);
+    uint8_t * p_reads;
+    uint8_t sensor;
+
+    if ((p_req->type != BLE_GATTS_AUTHORIZE_TYPE_READ) || (link == LBS_NO_LINK))
+    {
+        return;
+    }
+    if (p_req->request.read.handle == p_lbs->command_char_handles.value_handle)
+    {
+        uint8_t counter[LBS_CMD_COUNTER_LEN];
+        uint8_t reads = 1 << link;
+
+        uint32_encode(p_lbs->cmd_counter, counter);
+        read_reply(p_lbs, &reads, counter, sizeof(counter));
+        return;
+    }
+    if (p_req->request.read.handle == p_lbs->temp_char_handles.value_handle)
+    {
+        p_reads = &p_lbs->temp_reads;
+        sensor = LBS_SENSOR_TEMP;
+    }
+    else if (p_req->request.read.handle == p_lbs->fan_char_handles.value_handle)
+    {
+        p_reads = &p_lbs->fan_reads;
+        sensor = LBS_SENSOR_FAN;
+    }
+    else
+    {
+        return;
+    }
+    *p_reads |= 1 << link;
+    if (p_lbs->sensor_read_handler != NULL)
+    {
+        p_lbs->sensor_read_handler(p_lbs, sensor);
+    }
+    else
+    {
+        read_reply(p_lbs, p_reads, NULL, 0);
+    }
+}
+
+
+void ble_lbs_on_ble_evt(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            on_connect(p_lbs, p_ble_evt);
+            break;
+            
+        case BLE_GAP_EVT_DISCONNECTED:
+            on_disconnect(p_lbs, p_ble_evt);
+            break;
+            
+        case BLE_GATTS_EVT_WRITE:
+            on_write(p_lbs, p_ble_evt);
+            break;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            on_rw_authorize(p_lbs, p_ble_evt);
+            break;
+
+        case BLE_EVT_TX_COMPLETE:
+            tx_pump(p_lbs);
+            break;
+            
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+ 
+static uint32_t led_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_LED_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_LED_LEGACY_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_LED_LEVEL_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->led_char_handles);
+}
+
+
+static uint32_t fade_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_FADE_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_FADE_RECORD_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_FADE_RECORD_LEN * LBS_FADE_MAX_RECORDS;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->fade_char_handles);
+}
+
+
+static uint32_t frame_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_FRAME_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_FRAME_HEADER_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_FRAME_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->frame_char_handles);
+}
+
+
+static uint32_t fan_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = &cccd_md;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_FAN_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 1;  // Read on demand, see on_rw_authorize()
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_FAN_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_FAN_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->fan_char_handles);
+}
+
+static uint32_t temp_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = &cccd_md;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_TEMP_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 1;  // Read on demand, see on_rw_authorize()
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_TEMP_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_TEMP_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->temp_char_handles);
+}
+
+static uint32_t status_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = &cccd_md;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_STATUS_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_USER;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_STATUS_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_STATUS_LEN;
+    attr_char_value.p_value      = p_lbs->status_value;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->status_char_handles);
+}
+
+static uint32_t telemetry_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = &cccd_md;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_TELEMETRY_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_USER;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_TELEMETRY_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_TELEMETRY_LEN;
+    attr_char_value.p_value      = p_lbs->telemetry_value;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->telemetry_char_handles);
+}
+
+static uint32_t link_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+    
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = &cccd_md;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_LINK_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_LINK_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_LINK_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->link_char_handles);
+}
+
+static uint32_t schedule_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_SCHEDULE_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = 1;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_SCHEDULE_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->schedule_char_handles);
+}
+
+static uint32_t time_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_TIME_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_TIME_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_TIME_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->time_char_handles);
+}
+
+static uint32_t crash_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_CRASH_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = 2;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_CRASH_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->crash_char_handles);
+}
+
+static uint32_t events_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_EVENTS_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = 8;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_EVENTS_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->events_char_handles);
+}
+
+#if LATENCY_ENABLED
+static uint32_t latency_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_LATENCY_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 1;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_LATENCY_MAX_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_LATENCY_MAX_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->latency_char_handles);
+}
+#endif
+
+static uint32_t boot_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_BOOT_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_BOOT_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_BOOT_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->boot_char_handles);
+}
+
+static uint32_t supply_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_SUPPLY_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_SUPPLY_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_SUPPLY_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->supply_char_handles);
+}
+
+static uint32_t output_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_OUTPUT_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_OUTPUT_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_OUTPUT_LEN;
+    attr_char_value.p_value      = NULL;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->output_char_handles);
+}
+
+static uint32_t capability_char_add(ble_lbs_t * p_lbs, uint8_t * p_data)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    memset(&char_md, 0, sizeof(char_md));
+    
+    char_md.char_props.read   = 1;
+    char_md.p_char_user_desc  = NULL;
+    char_md.p_char_pf         = NULL;
+    char_md.p_user_desc_md    = NULL;
+    char_md.p_cccd_md         = NULL;
+    char_md.p_sccd_md         = NULL;
+    
+    ble_uuid.type = p_lbs->uuid_type;
+    ble_uuid.uuid = LBS_UUID_CAPABILITY_CHAR;
+    
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc       = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth    = 0;
+    attr_md.wr_auth    = 0;
+    attr_md.vlen       = 0;
+    
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid       = &ble_uuid;
+    attr_char_value.p_attr_md    = &attr_md;
+    attr_char_value.init_len     = LBS_CAPABILITY_LEN;
+    attr_char_value.init_offs    = 0;
+    attr_char_value.max_len      = LBS_CAPABILITY_LEN;
+    attr_char_value.p_value      = p_data;
+    
+    return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_lbs->capability_char_handles);
 }
 
- 
-static uint32_t led_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+static uint32_t schema_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
 {
     ble_gatts_char_md_t char_md;
     ble_gatts_attr_t    attr_char_value;
@@ -67,7 +1957,6 @@ static uint32_t led_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_ini
     memset(&char_md, 0, sizeof(char_md));
     
     char_md.char_props.read   = 1;
-    char_md.char_props.write  = 1;
     char_md.p_char_user_desc  = NULL;
     char_md.p_char_pf         = NULL;
     char_md.p_user_desc_md    = NULL;
@@ -75,12 +1964,12 @@ static uint32_t led_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_ini
     char_md.p_sccd_md         = NULL;
     
     ble_uuid.type = p_lbs->uuid_type;
-    ble_uuid.uuid = LBS_UUID_LED_CHAR;
+    ble_uuid.uuid = LBS_UUID_SCHEMA_CHAR;
     
     memset(&attr_md, 0, sizeof(attr_md));
 
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
-    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
     attr_md.vloc       = BLE_GATTS_VLOC_STACK;
     attr_md.rd_auth    = 0;
     attr_md.wr_auth    = 0;
@@ -90,18 +1979,17 @@ static uint32_t led_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_ini
 
     attr_char_value.p_uuid       = &ble_uuid;
     attr_char_value.p_attr_md    = &attr_md;
-    attr_char_value.init_len     = sizeof(uint16_t);
+    attr_char_value.init_len     = LBS_SCHEMA_LEN;
     attr_char_value.init_offs    = 0;
-    attr_char_value.max_len      = sizeof(uint16_t);
+    attr_char_value.max_len      = LBS_SCHEMA_LEN;
     attr_char_value.p_value      = NULL;
     
     return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
                                                &attr_char_value,
-                                               &p_lbs->led_char_handles);
+                                               &p_lbs->schema_char_handles);
 }
 
-
-static uint32_t fan_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+static uint32_t command_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
 {
     ble_gatts_char_md_t char_md;
     ble_gatts_attr_md_t cccd_md;
@@ -118,6 +2006,8 @@ static uint32_t fan_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_ini
     memset(&char_md, 0, sizeof(char_md));
     
     char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
     char_md.char_props.notify = 1;
     char_md.p_char_user_desc  = NULL;
     char_md.p_char_pf         = NULL;
@@ -126,32 +2016,32 @@ static uint32_t fan_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_ini
     char_md.p_sccd_md         = NULL;
     
     ble_uuid.type = p_lbs->uuid_type;
-    ble_uuid.uuid = LBS_UUID_FAN_CHAR;
+    ble_uuid.uuid = LBS_UUID_COMMAND_CHAR;
     
     memset(&attr_md, 0, sizeof(attr_md));
 
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
-    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
     attr_md.vloc       = BLE_GATTS_VLOC_STACK;
-    attr_md.rd_auth    = 0;
+    attr_md.rd_auth    = 1;  // The signed write counter, see on_rw_authorize()
     attr_md.wr_auth    = 0;
-    attr_md.vlen       = 0;
+    attr_md.vlen       = 1;
     
     memset(&attr_char_value, 0, sizeof(attr_char_value));
 
     attr_char_value.p_uuid       = &ble_uuid;
     attr_char_value.p_attr_md    = &attr_md;
-    attr_char_value.init_len     = sizeof(uint16_t);
+    attr_char_value.init_len     = LBS_CMD_HEADER_LEN;
     attr_char_value.init_offs    = 0;
-    attr_char_value.max_len      = sizeof(uint16_t);
+    attr_char_value.max_len      = LBS_CMD_MAX_LEN;
     attr_char_value.p_value      = NULL;
     
     return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
                                                &attr_char_value,
-                                               &p_lbs->fan_char_handles);
+                                               &p_lbs->command_char_handles);
 }
 
-static uint32_t temp_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
+static uint32_t sync_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
 {
     ble_gatts_char_md_t char_md;
     ble_gatts_attr_md_t cccd_md;
@@ -167,7 +2057,8 @@ static uint32_t temp_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_in
     
     memset(&char_md, 0, sizeof(char_md));
     
-    char_md.char_props.read   = 1;
+    char_md.char_props.write  = 1;
+    char_md.char_props.write_wo_resp = 1;
     char_md.char_props.notify = 1;
     char_md.p_char_user_desc  = NULL;
     char_md.p_char_pf         = NULL;
@@ -176,39 +2067,95 @@ static uint32_t temp_char_add(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_in
     char_md.p_sccd_md         = NULL;
     
     ble_uuid.type = p_lbs->uuid_type;
-    ble_uuid.uuid = LBS_UUID_TEMP_CHAR;
+    ble_uuid.uuid = LBS_UUID_SYNC_CHAR;
     
     memset(&attr_md, 0, sizeof(attr_md));
 
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
-    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
     attr_md.vloc       = BLE_GATTS_VLOC_STACK;
     attr_md.rd_auth    = 0;
     attr_md.wr_auth    = 0;
-    attr_md.vlen       = 0;
+    attr_md.vlen       = 1;
     
     memset(&attr_char_value, 0, sizeof(attr_char_value));
 
     attr_char_value.p_uuid       = &ble_uuid;
     attr_char_value.p_attr_md    = &attr_md;
-    attr_char_value.init_len     = sizeof(uint16_t);
+    attr_char_value.init_len     = LBS_SYNC_LEN;
     attr_char_value.init_offs    = 0;
-    attr_char_value.max_len      = sizeof(uint16_t);
+    attr_char_value.max_len      = LBS_SYNC_LEN;
     attr_char_value.p_value      = NULL;
     
     return sd_ble_gatts_characteristic_add(p_lbs->service_handle, &char_md,
                                                &attr_char_value,
-                                               &p_lbs->temp_char_handles);
+                                               &p_lbs->sync_char_handles);
 }
 
 uint32_t ble_lbs_init(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
 {
     uint32_t   err_code;
     ble_uuid_t ble_uuid;
+    uint8_t    capability[LBS_CAPABILITY_LEN];
 
     // Initialize service structure
-    p_lbs->conn_handle       = BLE_CONN_HANDLE_INVALID;
+    for (uint8_t i = 0; i < LBS_MAX_LINKS; i++)
+    {
+        p_lbs->conn_handles[i] = BLE_CONN_HANDLE_INVALID;
+    }
+    p_lbs->control           = LBS_NO_LINK;
+    p_lbs->sync_link         = LBS_NO_LINK;
+    status_reset(p_lbs);
+    tx_reset(p_lbs);
+    memset(&p_lbs->tx_stats, 0, sizeof(p_lbs->tx_stats));
+    memset(p_lbs->status_value, 0, sizeof(p_lbs->status_value));
+    memset(p_lbs->telemetry_value, 0, sizeof(p_lbs->telemetry_value));
     p_lbs->led_write_handler = p_lbs_init->led_write_handler;
+    p_lbs->fade_write_handler = p_lbs_init->fade_write_handler;
+    p_lbs->frame_write_handler = p_lbs_init->frame_write_handler;
+    p_lbs->link_write_handler = p_lbs_init->link_write_handler;
+    p_lbs->schedule_write_handler = p_lbs_init->schedule_write_handler;
+    p_lbs->time_write_handler = p_lbs_init->time_write_handler;
+    p_lbs->crash_clear_handler = p_lbs_init->crash_clear_handler;
+    p_lbs->events_ack_handler = p_lbs_init->events_ack_handler;
+    p_lbs->scene_handler = p_lbs_init->scene_handler;
+    p_lbs->at_handler = p_lbs_init->at_handler;
+    p_lbs->sync_write_handler = p_lbs_init->sync_write_handler;
+    p_lbs->trace_handler = p_lbs_init->trace_handler;
+    p_lbs->pwm_freq_handler = p_lbs_init->pwm_freq_handler;
+    p_lbs->dither_handler = p_lbs_init->dither_handler;
+    p_lbs->stage_handler = p_lbs_init->stage_handler;
+    p_lbs->commit_handler = p_lbs_init->commit_handler;
+    p_lbs->dim_handler = p_lbs_init->dim_handler;
+    p_lbs->slew_handler = p_lbs_init->slew_handler;
+    p_lbs->sim_handler = p_lbs_init->sim_handler;
+    p_lbs->effect_handler = p_lbs_init->effect_handler;
+    p_lbs->burnin_handler = p_lbs_init->burnin_handler;
+    p_lbs->lease_handler = p_lbs_init->lease_handler;
+    p_lbs->fan_lead_handler = p_lbs_init->fan_lead_handler;
+    p_lbs->stream_start_handler = p_lbs_init->stream_start_handler;
+    p_lbs->stream_frame_handler = p_lbs_init->stream_frame_handler;
+    p_lbs->sensor_read_handler = p_lbs_init->sensor_read_handler;
+    p_lbs->mac_handler         = p_lbs_init->mac_handler;
+    p_lbs->cmd_mac_required    = p_lbs_init->cmd_mac_required && (p_lbs_init->mac_handler != NULL);
+    p_lbs->cmd_counter         = 0;
+    p_lbs->cmd_counters        = 0;
+    p_lbs->temp_reads = 0;
+    p_lbs->fan_reads = 0;
+#if LATENCY_ENABLED
+    p_lbs->latency_reset_handler = p_lbs_init->latency_reset_handler;
+#endif
+    p_lbs->fan_deadband      = p_lbs_init->fan_deadband;
+    p_lbs->temp_deadband     = p_lbs_init->temp_deadband;
+    p_lbs->max_interval      = p_lbs_init->max_interval;
+    telemetry_reset(&p_lbs->fan_tlm);
+    telemetry_reset(&p_lbs->temp_tlm);
+    telemetry_reset(&p_lbs->status_tlm);
+    telemetry_reset(&p_lbs->telemetry_tlm);
+    telemetry_reset(&p_lbs->link_tlm);
+    telemetry_reset(&p_lbs->cmd_tlm);
+    telemetry_reset(&p_lbs->sync_tlm);
+    p_lbs->cmd_synced = false;
     
     // Add service
     ble_uuid128_t base_uuid = {LBS_UUID_BASE};
@@ -244,34 +2191,462 @@ uint32_t ble_lbs_init(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init)
     {
         return err_code;
     }
-    
-    return NRF_SUCCESS;
+
+    err_code = fade_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = frame_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = status_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = telemetry_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = link_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = schedule_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = time_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = crash_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = events_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+#if LATENCY_ENABLED
+    err_code = latency_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+#endif
+
+    err_code = boot_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = command_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = sync_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = supply_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = output_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    capability[0] = LBS_PROTOCOL_VERSION;
+    capability[1] = LBS_CMD_VERSION;
+    capability[2] = p_lbs_init->channels;
+    uint32_encode(p_lbs_init->capabilities, &capability[3]);
+    err_code = capability_char_add(p_lbs, capability);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    err_code = schema_char_add(p_lbs, p_lbs_init);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    // The handles are laid out back to back from the service handle
+    p_lbs->schema = 0xFFFF;
+    err_code = ble_lbs_schema_add(p_lbs, &p_lbs->service_handle,
+                                  offsetof(ble_lbs_t, schema) - offsetof(ble_lbs_t, service_handle));
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+    // New firmware with the same handles still tells a cache apart
+    return ble_lbs_schema_add(p_lbs, capability, LBS_CAPABILITY_LEN);
 }
 
-uint32_t ble_lbs_update_fan(ble_lbs_t* p_lbs, uint8_t* rpm)
+static uint16_t fan_packet(uint8_t * p_data, uint16_t rpm, uint16_t const * p_fans, uint8_t fan_count)
 {
-    ble_gatts_hvx_params_t params;
-    uint16_t len = 2;
-    
-    memset(&params, 0, sizeof(params));
-    params.type = BLE_GATT_HVX_NOTIFICATION;
-    params.handle = p_lbs->fan_char_handles.value_handle;
-    params.p_data = rpm;
-    params.p_len = &len;
-    
-    return sd_ble_gatts_hvx(p_lbs->conn_handle, &params);
+    uint16_encode(rpm, &p_data[0]);
+    fan_count = MIN(fan_count, LBS_FAN_MAX_FANS);
+    for (uint8_t i = 0; i < fan_count; i++)
+    {
+        uint16_encode(p_fans[i], &p_data[LBS_FAN_LEN + 2*i]);
+    }
+    return LBS_FAN_LEN + 2*fan_count;
 }
 
-uint32_t ble_lbs_update_temp(ble_lbs_t* p_lbs, uint8_t* temp)
+static uint16_t temp_packet(uint8_t * p_data, int16_t temp, int16_t const * p_sensors, uint8_t sensor_count)
 {
-    ble_gatts_hvx_params_t params;
-    uint16_t len = 2;
-    
-    memset(&params, 0, sizeof(params));
-    params.type = BLE_GATT_HVX_NOTIFICATION;
-    params.handle = p_lbs->temp_char_handles.value_handle;
-    params.p_data = temp;
-    params.p_len = &len;
+    int16_t whole = (temp < 0) ? 0 : (temp >> 4);
+
+    uint16_encode((uint16_t)whole, &p_data[0]);
+    uint16_encode((uint16_t)temp, &p_data[2]);
+    sensor_count = MIN(sensor_count, LBS_TEMP_MAX_SENSORS);
+    for (uint8_t i = 0; i < sensor_count; i++)
+    {
+        uint16_encode((uint16_t)p_sensors[i], &p_data[LBS_TEMP_LEN + 2*i]);
+    }
+    return LBS_TEMP_LEN + 2*sensor_count;
+}
+
+void ble_lbs_reply_fan(ble_lbs_t* p_lbs, uint16_t rpm, uint16_t const * p_fans, uint8_t fan_count)
+{
+    uint8_t data[LBS_FAN_MAX_LEN];
+
+    if (p_lbs->fan_reads != 0)
+    {
+        read_reply(p_lbs, &p_lbs->fan_reads, data, fan_packet(data, rpm, p_fans, fan_count));
+    }
+}
+
+void ble_lbs_reply_temp(ble_lbs_t* p_lbs, int16_t temp, int16_t const * p_sensors, uint8_t sensor_count)
+{
+    uint8_t data[LBS_TEMP_MAX_LEN];
+
+    if (p_lbs->temp_reads != 0)
+    {
+        read_reply(p_lbs, &p_lbs->temp_reads, data, temp_packet(data, temp, p_sensors, sensor_count));
+    }
+}
+
+uint32_t ble_lbs_update_fan(ble_lbs_t* p_lbs, uint16_t rpm, uint16_t const * p_fans, uint8_t fan_count)
+{
+    uint8_t data[LBS_FAN_MAX_LEN];
+
+    ble_lbs_reply_fan(p_lbs, rpm, p_fans, fan_count);
+    if (!telemetry_active(p_lbs, &p_lbs->fan_tlm))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (!telemetry_due(p_lbs, &p_lbs->fan_tlm, rpm, p_lbs->fan_deadband))
+    {
+        return NRF_SUCCESS;
+    }
+
+    return telemetry_send(p_lbs, &p_lbs->fan_tlm, p_lbs->fan_char_handles.value_handle,
+                          rpm, data, fan_packet(data, rpm, p_fans, fan_count));
+}
+
+uint32_t ble_lbs_update_temp(ble_lbs_t* p_lbs, int16_t temp, int16_t const * p_sensors, uint8_t sensor_count)
+{
+    uint8_t data[LBS_TEMP_MAX_LEN];
+    uint32_t value = (uint32_t)(temp + 0x8000); // Offset so the deadband compares signed
+
+    ble_lbs_reply_temp(p_lbs, temp, p_sensors, sensor_count);
+    if (!telemetry_active(p_lbs, &p_lbs->temp_tlm))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (!telemetry_due(p_lbs, &p_lbs->temp_tlm, value, p_lbs->temp_deadband))
+    {
+        return NRF_SUCCESS;
+    }
+
+    return telemetry_send(p_lbs, &p_lbs->temp_tlm, p_lbs->temp_char_handles.value_handle,
+                          value, data, temp_packet(data, temp, p_sensors, sensor_count));
+}
+
+uint32_t ble_lbs_update_status(ble_lbs_t* p_lbs, uint8_t derate_pct, uint32_t commits, uint16_t repairs)
+{
+    uint8_t * status = p_lbs->status_value;
+    uint16_t crc;
+
+    // Kept current for reads whether or not anyone is subscribed
+    uint16_encode(p_lbs->cmd_count, &status[0]);
+    uint16_encode(p_lbs->cmd_crc, &status[2]);
+    status[4] = derate_pct;
+    uint32_encode(commits, &status[5]);
+    uint16_encode(repairs, &status[LBS_STATUS_REPAIRS]);
+
+    if (!telemetry_active(p_lbs, &p_lbs->status_tlm))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // Any change but the commit count counts, compare a CRC of the rest
+    crc = crc16_compute(status, LBS_STATUS_KEY_LEN, NULL);
+    crc = crc16_compute(&status[LBS_STATUS_REPAIRS], 2, &crc);
+    if (!telemetry_due(p_lbs, &p_lbs->status_tlm, crc, 0))
+    {
+        return NRF_SUCCESS;
+    }
     
-    return sd_ble_gatts_hvx(p_lbs->conn_handle, &params);
+    return telemetry_send(p_lbs, &p_lbs->status_tlm, p_lbs->status_char_handles.value_handle,
+                          crc, NULL, LBS_STATUS_LEN);
+}
+
+uint32_t ble_lbs_update_telemetry(ble_lbs_t* p_lbs, ble_lbs_telemetry_data_t const * p_data)
+{
+    uint8_t * packet = p_lbs->telemetry_value;
+    uint16_t key;
+    uint32_t err_code;
+    bool due;
+
+    // Kept current for reads whether or not anyone is subscribed
+    uint16_encode((uint16_t)p_data->temp, &packet[0]);
+    uint16_encode(p_data->rpm, &packet[2]);
+    packet[4] = p_data->errors;
+    packet[5] = p_data->derate_pct;
+    packet[6] = p_data->fan_duty;
+    packet[7] = p_data->flags;
+    uint32_encode(p_data->uptime, &packet[8]);
+    uint16_encode(p_lbs->cmd_count, &packet[12]);
+    uint16_encode(p_lbs->cmd_crc, &packet[14]);
+    uint16_encode(p_data->output_hash, &packet[16]);
+    uint16_encode(ble_lbs_tx_drops(p_lbs), &packet[18]);
+
+    if (!telemetry_active(p_lbs, &p_lbs->telemetry_tlm))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // The discrete fields must match exactly, the analog ones only need to
+    // stay inside their deadbands. Uptime always moves, so leave it out.
+    key = crc16_compute(&packet[4], 4, NULL);
+    key = crc16_compute(&packet[12], LBS_TELEMETRY_LEN - 12, &key);
+    due = telemetry_due(p_lbs, &p_lbs->telemetry_tlm, key, 0);
+    if (p_lbs->telemetry_tlm.sent)
+    {
+        due |= abs(p_data->temp - p_lbs->telemetry_temp) > p_lbs->temp_deadband;
+        due |= abs(p_data->rpm - p_lbs->telemetry_rpm) > p_lbs->fan_deadband;
+    }
+    if (!due)
+    {
+        return NRF_SUCCESS;
+    }
+
+    err_code = telemetry_send(p_lbs, &p_lbs->telemetry_tlm, p_lbs->telemetry_char_handles.value_handle,
+                              key, NULL, LBS_TELEMETRY_LEN);
+    if (err_code == NRF_SUCCESS)
+    {
+        p_lbs->telemetry_temp = p_data->temp;
+        p_lbs->telemetry_rpm  = p_data->rpm;
+    }
+    return err_code;
+}
+
+uint32_t ble_lbs_update_link(ble_lbs_t* p_lbs, uint8_t profile, bool forced,
+                             ble_gap_conn_params_t const * p_params)
+{
+    uint8_t data[LBS_LINK_LEN];
+    uint16_t len = LBS_LINK_LEN;
+    uint16_t key;
+    ble_gatts_value_t value;
+
+    data[0] = profile;
+    data[1] = forced ? 1 : 0;
+    // The central picks within [min, max], both hold what it chose
+    uint16_encode(p_params->max_conn_interval, &data[2]);
+    uint16_encode(p_params->slave_latency, &data[4]);
+    uint16_encode(p_params->conn_sup_timeout, &data[6]);
+
+    // Keep reads current even when nobody is subscribed
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = data;
+    (void)sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->link_char_handles.value_handle, &value);
+
+    if (!telemetry_active(p_lbs, &p_lbs->link_tlm))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    key = crc16_compute(data, len, NULL);
+    if (!telemetry_due(p_lbs, &p_lbs->link_tlm, key, 0))
+    {
+        return NRF_SUCCESS;
+    }
+    return telemetry_send(p_lbs, &p_lbs->link_tlm, p_lbs->link_char_handles.value_handle,
+                          key, data, len);
+}
+
+uint32_t ble_lbs_update_schedule(ble_lbs_t* p_lbs, uint8_t const * p_status, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_status;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->schedule_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_update_crash_log(ble_lbs_t* p_lbs, uint8_t const * p_log, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_log;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->crash_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_update_events(ble_lbs_t* p_lbs, uint8_t const * p_log, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_log;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->events_char_handles.value_handle, &value);
+}
+
+#if LATENCY_ENABLED
+uint32_t ble_lbs_update_latency(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->latency_char_handles.value_handle, &value);
+}
+#endif
+
+uint32_t ble_lbs_update_boot(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->boot_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_update_supply(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->supply_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_update_output(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len)
+{
+    ble_gatts_value_t value;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = len;
+    value.p_value = (uint8_t *)p_data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->output_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_schema_add(ble_lbs_t* p_lbs, void const * p_handles, uint16_t len)
+{
+    ble_gatts_value_t value;
+    uint8_t           data[LBS_SCHEMA_LEN];
+
+    p_lbs->schema = crc16_compute(p_handles, len, &p_lbs->schema);
+    uint16_encode(p_lbs->schema, data);
+    memset(&value, 0, sizeof(value));
+    value.len     = LBS_SCHEMA_LEN;
+    value.p_value = data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->schema_char_handles.value_handle, &value);
+}
+
+uint32_t ble_lbs_update_sync(ble_lbs_t* p_lbs, uint32_t token, uint32_t ms)
+{
+    uint8_t data[LBS_SYNC_LEN];
+    uint8_t links = p_lbs->sync_tlm.enabled;
+
+    // Answered to whoever asked
+    if (p_lbs->sync_link != LBS_NO_LINK)
+    {
+        links &= 1 << p_lbs->sync_link;
+    }
+    if (links == 0)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    uint32_encode(token, &data[0]);
+    uint32_encode(ms, &data[4]);
+    return tx_queue(p_lbs, p_lbs->sync_char_handles.value_handle, data, LBS_SYNC_LEN, links);
+}
+
+uint8_t ble_lbs_links(ble_lbs_t const * p_lbs)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < LBS_MAX_LINKS; i++)
+    {
+        count += p_lbs->conn_handles[i] != BLE_CONN_HANDLE_INVALID;
+    }
+    return count;
+}
+
+bool ble_lbs_in_control(ble_lbs_t const * p_lbs, uint16_t conn_handle)
+{
+    return (p_lbs->control != LBS_NO_LINK) && (p_lbs->conn_handles[p_lbs->control] == conn_handle);
+}
+
+uint32_t ble_lbs_update_time(ble_lbs_t* p_lbs, uint32_t time, uint32_t uptime,
+                             int16_t drift_ppm, bool set)
+{
+    uint8_t data[LBS_TIME_LEN];
+    ble_gatts_value_t value;
+
+    uint32_encode(time, &data[0]);
+    uint32_encode(uptime, &data[4]);
+    uint16_encode((uint16_t)drift_ppm, &data[8]);
+    data[10] = set ? LBS_TIME_FLAG_SET : 0;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = sizeof(data);
+    value.p_value = data;
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbs->time_char_handles.value_handle, &value);
+}
+
+uint16_t ble_lbs_tx_drops(ble_lbs_t const * p_lbs)
+{
+    uint32_t drops = p_lbs->tx_stats.dropped_full + p_lbs->tx_stats.dropped_error;
+
+    return (drops > UINT16_MAX) ? UINT16_MAX : drops;
 }
@@ -5,40 +5,624 @@
 #include <stdbool.h>
 #include "ble.h"
 #include "ble_srv_common.h"
+#include "latency.h"
+#include "boot_trace.h"
+#include "supply.h"
 
 #define LBS_UUID_BASE {0x23, 0xD1, 0xBC, 0xEA, 0x5F, 0x78, 0x23, 0x15, 0xDE, 0xEF, 0x12, 0x12, 0x00, 0x00, 0x00, 0x00}
 #define LBS_UUID_SERVICE 0x1523
 #define LBS_UUID_LED_CHAR 0x1525
 #define LBS_UUID_FAN_CHAR 0x1524
 #define LBS_UUID_TEMP_CHAR 0x1526
+#define LBS_UUID_FADE_CHAR 0x1527
+#define LBS_UUID_FRAME_CHAR 0x1528
+#define LBS_UUID_STATUS_CHAR 0x1529
+#define LBS_UUID_TELEMETRY_CHAR 0x152A
+#define LBS_UUID_LINK_CHAR 0x152B
+#define LBS_UUID_SCHEDULE_CHAR 0x152C
+#define LBS_UUID_TIME_CHAR 0x152D
+#define LBS_UUID_CRASH_CHAR 0x152E
+#define LBS_UUID_EVENTS_CHAR 0x152F
+// 0x1530 - 0x1534 on this base belong to the DFU service (ble_dfu.h)
+#define LBS_UUID_LATENCY_CHAR 0x1535
+#define LBS_UUID_BOOT_CHAR 0x1536
+#define LBS_UUID_COMMAND_CHAR 0x1537
+#define LBS_UUID_SYNC_CHAR 0x1538
+#define LBS_UUID_SUPPLY_CHAR 0x1539
+#define LBS_UUID_SCHEMA_CHAR 0x153A
+#define LBS_UUID_OUTPUT_CHAR 0x153B
+#define LBS_UUID_CAPABILITY_CHAR 0x153C
+
+// Status: commands received since connect (uint16 LE) and a CRC16 of
+// their payloads in order (uint16 LE). Covers the LED, fade and frame
+// characteristics, so a controller using write without response can
+// spot lost commands by comparing against what it sent. Followed by the
+// thermal derate factor (uint8, percent of requested output) and the
+// bursts the PCA9685s have taken since boot (uint32 LE, pca9685.h). The
+// count rides along with other changes rather than being one itself.
+// Last come the registers the scrubber found wrong and repaired since
+// boot (uint16 LE, wrapping, pca9685_scrub()), a change of their own.
+#define LBS_STATUS_LEN 11
+#define LBS_STATUS_KEY_LEN 5
+#define LBS_STATUS_REPAIRS 9
+
+// Telemetry: everything the controller polls for in one notification.
+//   0  temperature, 1/16 degree C (int16 LE)
+//   2  fan rpm (uint16 LE)
+//   4  error bits (uint8, 1 << error_e)
+//   5  derate, percent of requested output (uint8)
+//   6  fan duty percent (uint8)
+//   7  flags (uint8, LBS_TELEMETRY_FLAG_*)
+//   8  uptime seconds (uint32 LE)
+//  12  command count and CRC as in the status characteristic (uint16 LE x2)
+//  16  output state hash, CRC16 of the PCA9685 registers (uint16 LE)
+//  18  notifications dropped since boot (uint16 LE, saturating)
+#define LBS_TELEMETRY_LEN 20
+#define LBS_TELEMETRY_FLAG_TEMP_VALID (1 << 0)
+#define LBS_TELEMETRY_FLAG_TRIPPED    (1 << 1)  // OE held off by the thermal hardware path
+#define LBS_TELEMETRY_FLAG_NO_OUTPUT  (1 << 2)  // PCA9685 missing, the outputs aren't driven
+#define LBS_TELEMETRY_FLAG_SUPPLY_SHED (1 << 3) // OE held off, the supply sagged or VDD is failing
+#define LBS_TELEMETRY_FLAG_LEASE_LAPSED (1 << 4) // The control lease ran out and the brick failed over
+#define LBS_TELEMETRY_FLAG_LEASED       (1 << 5) // A controller holds the lease, a standby one keeps off
+
+// Link: writes pick a connection profile (uint8, conn_profile_t). Reads
+// and notifications give the profile in use (uint8), whether it was
+// forced by a write (uint8), then the connection interval (1.25 ms units),
+// slave latency and supervision timeout (10 ms units) the link is running
+// with (uint16 LE each). Enabling notifications here is also how a central
+// says it answers connection parameter update requests.
+#define LBS_LINK_LEN 8
+#define LBS_LINK_WRITE_LEN 1
+
+// Schedule: writes carry the on-device schedule upload protocol and reads
+// give its status, both laid out in schedule.h
+#define LBS_SCHEDULE_MAX_LEN 20
+
+// Time: writes set the local clock (clock.h), seconds (uint32 LE) and
+// optionally 1/256 s (uint8). Reads give the clock (uint32 LE), the
+// uptime it goes with (uint32 LE, as in telemetry, so telemetry can be
+// placed on the clock), the rate correction (int16 LE, ppm) and flags
+// (uint8, LBS_TIME_FLAG_*).
+#define LBS_TIME_LEN 11
+#define LBS_TIME_WRITE_LEN 4
+#define LBS_TIME_WRITE_FRACTION_LEN 5
+#define LBS_TIME_FLAG_SET (1 << 0)
+
+// Crash log: reads give the records laid out in crash.h, longer than one
+// ATT packet so they need a long read. Any write clears the log.
+#define LBS_CRASH_MAX_LEN 82
+
+// Error events: reads give the log laid out in error_handlers.h, also a
+// long read. Writing a sequence number (uint32 LE) drops the events
+// before it.
+#define LBS_EVENTS_MAX_LEN 264
+
+// Latency histograms as laid out in latency.h, refreshed every poll.
+// Any write resets them. Only there with LATENCY_ENABLED.
+#define LBS_LATENCY_MAX_LEN LATENCY_LEN
+
+// Boot trace as laid out in boot_trace.h, set once at startup
+#define LBS_BOOT_LEN BOOT_TRACE_LEN
+
+// Supply voltage stats as laid out in supply.h, a window per poll
+#define LBS_SUPPLY_LEN SUPPLY_LEN
+
+// Output state: what the brick is driving, for a controller to check
+// before writing what's already there.
+//   0  generation (uint32 LE), moves whenever anything below does
+//   4  derate, percent of requested output (uint8)
+//   5  master dim, percent (uint8)
+//   6  flags (uint8, LBS_OUTPUT_FLAG_*)
+//   7  output state hash, CRC16 of the PCA9685 registers (uint16 LE)
+//   9  target level per channel, where any fade ends (uint16 LE x
+//      LBS_FRAME_MAX_CHANNELS)
+//  41  channels wired (uint8, BOARD_LED_CHANNELS), the controller only
+//      evaluates and writes those
+// The hash is as of the last change, it doesn't follow a running fade.
+#define LBS_OUTPUT_HEADER_LEN 9
+#define LBS_OUTPUT_CHANNELS_OFFSET (LBS_OUTPUT_HEADER_LEN + 2 * LBS_FRAME_MAX_CHANNELS)
+#define LBS_OUTPUT_LEN (LBS_OUTPUT_CHANNELS_OFFSET + 1)
+#define LBS_OUTPUT_FLAG_ERROR  (1 << 0) // Outputs off for an error
+#define LBS_OUTPUT_FLAG_FADING (1 << 1) // A fade was running at the change
+
+// Capability: what this firmware takes, so a controller picks the
+// fastest path the brick has rather than guessing from the
+// characteristics found. Set once at init, and folded into the schema
+// so a controller can cache it with the handles.
+//   0  protocol version (uint8, LBS_PROTOCOL_VERSION), moves when a
+//      layout in this file changes in a way older controllers misread
+//   1  command protocol version (uint8, LBS_CMD_VERSION)
+//   2  channels wired (uint8, BOARD_LED_CHANNELS)
+//   3  LBS_CAP_* bits (uint32 LE)
+#define LBS_CAPABILITY_LEN 7
+#define LBS_PROTOCOL_VERSION 1
+#define LBS_CAP_LEVEL_12BIT (1 << 0)  // LED writes take 12 bit levels
+#define LBS_CAP_FADE        (1 << 1)
+#define LBS_CAP_FRAME       (1 << 2)
+#define LBS_CAP_COMMAND     (1 << 3)  // Versioned command protocol, packed frames
+#define LBS_CAP_BULK        (1 << 4)  // Bulk transfers (bulk.h)
+#define LBS_CAP_SYNC        (1 << 5)  // Records applied at brick time (LBS_CMD_OP_AT)
+#define LBS_CAP_SCHEDULE    (1 << 6)
+#define LBS_CAP_SCENES      (1 << 7)
+#define LBS_CAP_BROADCAST   (1 << 8)  // Follows group broadcast advertisements
+#define LBS_CAP_ESB         (1 << 9)  // Follows broadcast frames over ESB too
+#define LBS_CAP_EFFECT      (1 << 10)
+#define LBS_CAP_LEASE       (1 << 11)
+#define LBS_CAP_OUTPUT      (1 << 12) // Output state characteristic
+#define LBS_CAP_DFU         (1 << 13)
+#define LBS_CAP_SIM         (1 << 14) // Built with SIM_ENABLED
+#define LBS_CAP_LATENCY     (1 << 15) // Built with LATENCY_ENABLED
+#define LBS_CAP_DLOG        (1 << 16) // Built with DLOG_ENABLED
+#define LBS_CAP_AUX         (1 << 17) // Auxiliary outputs (aux.h)
+#define LBS_CAP_TRACE       (1 << 18) // Command acks carry traces (trace.h)
+#define LBS_CAP_CMD_MAC     (1 << 19) // Takes signed command writes (LBS_CMD_SIGNED)
+#define LBS_CAP_CMD_MAC_REQUIRED (1 << 20) // And refuses unsigned ones
+#define LBS_CAP_CROSSFADE   (1 << 21) // Schedule commits take a crossfade (schedule.h)
+#define LBS_CAP_FAN_LEAD    (1 << 22) // Takes LBS_CMD_OP_FAN_LEAD
+#define LBS_CAP_LONG_WRITE  (1 << 23) // Bulk frames written whole to the frame characteristic (bulk.h)
+#define LBS_CAP_STREAM      (1 << 24) // Takes LBS_CMD_OP_STREAM_* (stream.h)
+
+// Schema: CRC16 of every characteristic handle on the device (uint16
+// LE), set once services are added. A controller holding handles from
+// an earlier connection checks it matches before skipping discovery.
+#define LBS_SCHEMA_LEN 2
+
+// LED writes: channel, power (uint8, legacy) or channel, level (uint16 LE, 0-4095)
+#define LBS_LED_LEGACY_LEN 2
+#define LBS_LED_LEVEL_LEN 3
+#define LBS_LED_LEGACY_SHIFT 4
+
+// Fade records: channel, target level (uint16 LE), duration ms (uint16 LE)
+#define LBS_FADE_RECORD_LEN 5
+#define LBS_FADE_MAX_RECORDS 4
+
+// Frames: channel mask (uint16 LE), duration ms (uint16 LE), then one
+// level (uint16 LE) per set mask bit, lowest channel first. The default
+// ATT payload fits eight channels; 16 channel fixtures send two frames.
+#define LBS_FRAME_HEADER_LEN 4
+#define LBS_FRAME_MAX_LEN 20
+#define LBS_FRAME_MAX_CHANNELS 16
+
+// Commands: the versioned protocol, several commands per write. Writes
+// are a version (uint8, LBS_CMD_VERSION), a sequence number (uint8,
+// picked by the controller, one per write), then records of an opcode
+// (uint8, lbs_cmd_op_t), a value length (uint8) and the value. Records
+// run in order. A write with an unknown opcode or a bad length runs none
+// of them. A sequence number still in the ack window is acked again but
+// not run twice, so a controller can resend anything it didn't see acked.
+//
+// Notifications ack the writes: the version, the latest sequence number
+// (uint8), then bitmaps (uint32 LE, bit n for latest - n) of the writes
+// received and, of those, the ones rejected. The window restarts with
+// each connection. With LBS_CAP_TRACE an ack may carry a trace too
+// (trace.h): the sequence number traced (uint8), clock_ms() as it
+// arrived (uint32 LE) and ms from then to its frame committing (uint16
+// LE). Each trace goes out once, in the ack sent as it commits.
+//
+// With LBS_CAP_CMD_MAC a write may be signed with the fleet key, the one
+// broadcasts carry (broadcast.h): the version with LBS_CMD_SIGNED set,
+// the sequence number, a counter (uint32 LE, from 1, one per signed
+// write), then the records and the first four bytes of an AES-128
+// CBC-MAC over the length and everything before it. Each counter runs
+// once: it has to be newer than the latest run since boot, on any link,
+// or one of the LBS_CMD_WINDOW before it not yet seen, so writes from
+// different priorities may pass each other. Reading the characteristic
+// gives the latest (uint32 LE, 0 for none) for a controller to count on
+// from. This keeps a write recorded on one connection from being played
+// into another; a reboot forgets it, as it does the broadcast sequence.
+// A bad MAC or a counter that has run isn't acked, so neither moves the
+// window (a resend still in it is acked again). With
+// LBS_CAP_CMD_MAC_REQUIRED unsigned writes are dropped unacked too, and
+// writes to every other characteristic but the CCCDs and sync are
+// ignored: nothing unsigned takes control or changes anything.
+#define LBS_CMD_VERSION 1
+#define LBS_CMD_SIGNED 0x80
+#define LBS_CMD_HEADER_LEN 2
+#define LBS_CMD_SIGNED_HEADER_LEN 6
+#define LBS_CMD_MAC_LEN 4
+#define LBS_CMD_COUNTER_LEN 4
+#define LBS_CMD_RECORD_HEADER_LEN 2
+#define LBS_CMD_MAX_LEN 20
+#define LBS_CMD_ACK_LEN 10
+#define LBS_CMD_ACK_TRACE_LEN (LBS_CMD_ACK_LEN + 7)
+#define LBS_CMD_WINDOW 32
+
+typedef enum
+{
+    LBS_CMD_OP_LEVEL = 1,      // channel (uint8), level (uint16 LE)
+    LBS_CMD_OP_LEVEL_ALL,      // level (uint16 LE)
+    LBS_CMD_OP_OUTPUT_ENABLE,  // enabled (uint8)
+    LBS_CMD_OP_FADE,           // one record as on the fade characteristic
+    LBS_CMD_OP_FADE_ALL,       // level, duration ms (uint16 LE each)
+    LBS_CMD_OP_FRAME,          // as on the frame characteristic
+    LBS_CMD_OP_FRAME_PACKED,   // a frame with the levels packed to 12 bits,
+                               // two to three bytes low bits first, so
+                               // eight channels fit in one write
+    LBS_CMD_OP_PROFILE,        // connection profile (uint8, conn_profile_t)
+    LBS_CMD_OP_SCENE_RECALL,   // scene slot (uint8, scene.h)
+    LBS_CMD_OP_SCENE_SAVE,     // scene slot (uint8), fade ms (uint16 LE), keeps
+                               // where every channel is headed now
+    LBS_CMD_OP_SCENE_CLEAR,    // scene slot (uint8)
+    LBS_CMD_OP_AT,             // apply time (uint32 LE, clock_ms() base): the
+                               // records after it are held until then
+    LBS_CMD_OP_PWM_FREQ,       // PWM frequency in Hz (uint16 LE, pca9685.h)
+    LBS_CMD_OP_DITHER,         // channel mask (uint16 LE) to dither (fade.h)
+    LBS_CMD_OP_STAGE,          // a packed frame, held in the back frame until
+                               // a commit (fade.h)
+    LBS_CMD_OP_COMMIT,         // no value, applies the back frame. After an
+                               // LBS_CMD_OP_AT it lands at a shared time.
+    LBS_CMD_OP_DIM,            // master dimmer percent (uint8, pca9685.h)
+    LBS_CMD_OP_SLEW,           // channel mask (uint16 LE), slew limit in levels
+                               // per second (uint16 LE, 0 to lift it, fade.h)
+    LBS_CMD_OP_SIM,            // simulation (uint8, sim_kind_t), low and high
+                               // temperature (int16 LE, 1/16 degree C) and
+                               // period in simulated minutes (uint16 LE).
+                               // Rejected unless built with SIM_ENABLED.
+    LBS_CMD_OP_EFFECT,         // weather (uint8, effect_kind_t), seed (uint16
+                               // LE), cloud depth percent, cloud period s and
+                               // lightning strikes per minute (uint8 each),
+                               // duration s (uint16 LE, 0 to run until
+                               // stopped, effect.h). After an LBS_CMD_OP_AT
+                               // bricks sharing the seed run it together.
+    LBS_CMD_OP_BURN_IN,        // duration minutes (uint16 LE, 0 to stop) and
+                               // the temperature rise allowed in degrees C
+                               // (uint8, burnin.h)
+    LBS_CMD_OP_LEASE,          // lease seconds (uint16 LE, 0 to give it up)
+                               // and the scene slot to fall back to without
+                               // a schedule (uint8, LEASE_NO_SCENE for none,
+                               // lease.h). Sent again as the heartbeat.
+    LBS_CMD_OP_FAN_LEAD,       // percent of full output the controller's
+                               // levels rise by within FAN_LEAD_S (uint8) and
+                               // how long that holds in s (uint16 LE, 0 until
+                               // sent again), fan_control.h
+    LBS_CMD_OP_STREAM_START,   // when frame 0 plays in the brick's clock
+                               // (uint32 LE), frame period ms (uint16 LE, 0
+                               // to stop, a multiple of TICK_MS) and channel
+                               // mask (uint16 LE, up to STREAM_MAX_CHANNELS
+                               // set), stream.h
+    LBS_CMD_OP_STREAM_FRAME,   // frame number (uint16 LE) then the stream's
+                               // levels packed as LBS_CMD_OP_FRAME_PACKED.
+                               // Sent without response ahead of its turn;
+                               // late and early frames are dropped, not
+                               // rejected.
+} lbs_cmd_op_t;
+
+// Sync: a controller writes a token (uint32 LE) and the notification
+// gives it back with clock_ms() as the write arrived (uint32 LE). From
+// the round trips the controller works out where its own clock falls in
+// each brick's, for LBS_CMD_OP_AT.
+#define LBS_SYNC_WRITE_LEN 4
+#define LBS_SYNC_LEN 8
+
+// Telemetry defaults. Notifications only go out to a subscribed client,
+// when the value has moved by more than the deadband, or once max_interval
+// updates have passed without one.
+#define LBS_FAN_DEADBAND 50     // rpm
+#define LBS_TEMP_DEADBAND 4     // 1/16 degree C
+#define LBS_MAX_INTERVAL 12     // update calls
+
+// Peripheral links held at once. Each subscribes on its own and a value
+// is queued once for every link subscribed to it. The first link to write
+// anything that drives the brick (outputs, clock, schedule, logs) holds
+// control until it drops; the others can read and subscribe but their
+// control writes are ignored, so a monitoring client never takes the
+// brick from its controller. S130 1.0 takes one peripheral link, so one
+// until the SoftDevice allows more.
+#define LBS_MAX_LINKS 1 // Up to 8, a bit each below
+#define LBS_NO_LINK 0xFF
+
+// Outbound notifications waiting for SoftDevice TX buffers. One slot per
+// notifying characteristic is enough since a newer value replaces any
+// queued one for the same handle. Characteristics kept in application
+// RAM (BLE_GATTS_VLOC_USER) queue no copy, and send their value as it is
+// when a buffer frees up. Each waits in a block of the small pool
+// (pool.h), shared with the TWI queue.
+#define LBS_TX_QUEUE_SIZE 5
+#define LBS_TX_MAX_LEN 20
+
+typedef struct
+{
+    uint16_t handle;
+    uint16_t len;
+    uint8_t  links;   // Bit per link still to be sent it
+    bool     live;    // Sends the attribute's own value, data unused
+    uint8_t  data[LBS_TX_MAX_LEN];
+} ble_lbs_tx_t;
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t merged;         // Replaced a stale queued value
+    uint32_t dropped_full;   // Queue full, or the pool dry
+    uint32_t dropped_error;  // Rejected by the SoftDevice
+} ble_lbs_tx_stats_t;
 
 // Forward declaration of the ble_lbs_t type. 
 typedef struct ble_lbs_s ble_lbs_t;
 
-typedef void (*ble_lbs_led_write_handler_t) (ble_lbs_t * p_lbs, uint8_t led, uint8_t power);
+// Levels are always passed on the 12 bit scale, legacy writes are scaled up
+typedef void (*ble_lbs_led_write_handler_t) (ble_lbs_t * p_lbs, uint8_t led, uint16_t level);
+typedef void (*ble_lbs_fade_write_handler_t) (ble_lbs_t * p_lbs, uint8_t led, uint16_t level, uint16_t duration_ms);
+// p_levels is indexed by channel, only entries with their mask bit set are valid
+typedef void (*ble_lbs_frame_write_handler_t) (ble_lbs_t * p_lbs, uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms);
+typedef void (*ble_lbs_link_write_handler_t) (ble_lbs_t * p_lbs, uint8_t profile);
+typedef void (*ble_lbs_schedule_write_handler_t) (ble_lbs_t * p_lbs, uint8_t const * p_data, uint16_t len);
+typedef void (*ble_lbs_time_write_handler_t) (ble_lbs_t * p_lbs, uint32_t time, uint8_t fraction);
+typedef void (*ble_lbs_crash_clear_handler_t) (ble_lbs_t * p_lbs);
+typedef void (*ble_lbs_events_ack_handler_t) (ble_lbs_t * p_lbs, uint32_t seq);
+typedef void (*ble_lbs_latency_reset_handler_t) (ble_lbs_t * p_lbs);
+// op is one of the LBS_CMD_OP_SCENE_*, fade_ms only set for a save.
+// Returns false to reject the command.
+typedef bool (*ble_lbs_scene_handler_t) (ble_lbs_t * p_lbs, uint8_t op, uint8_t slot, uint16_t fade_ms);
+// Holds already validated records for ble_lbs_run() at at_ms, false to reject
+typedef bool (*ble_lbs_at_handler_t) (ble_lbs_t * p_lbs, uint32_t at_ms, uint8_t const * p_records, uint16_t len);
+typedef void (*ble_lbs_sync_write_handler_t) (ble_lbs_t * p_lbs, uint32_t token);
+// A command write changing the outputs ran, not held for later
+typedef void (*ble_lbs_trace_handler_t) (ble_lbs_t * p_lbs, uint8_t seq);
+// Returns false to reject the frequency
+typedef bool (*ble_lbs_pwm_freq_handler_t) (ble_lbs_t * p_lbs, uint16_t hz);
+typedef void (*ble_lbs_dither_handler_t) (ble_lbs_t * p_lbs, uint16_t mask);
+typedef void (*ble_lbs_commit_handler_t) (ble_lbs_t * p_lbs);
+// Returns false to reject the percentage
+typedef bool (*ble_lbs_dim_handler_t) (ble_lbs_t * p_lbs, uint8_t percent);
+typedef void (*ble_lbs_slew_handler_t) (ble_lbs_t * p_lbs, uint16_t mask, uint16_t levels_per_s);
+// Returns false to reject the simulation
+typedef bool (*ble_lbs_sim_handler_t) (ble_lbs_t * p_lbs, uint8_t kind, int16_t low, int16_t high,
+                                       uint16_t period_min);
+// Returns false to reject the effect
+typedef bool (*ble_lbs_effect_handler_t) (ble_lbs_t * p_lbs, uint8_t kind, uint16_t seed, uint8_t depth_pct,
+                                          uint8_t period_s, uint8_t strikes_per_min, uint16_t duration_s);
+// Returns false to reject the burn-in
+typedef bool (*ble_lbs_burnin_handler_t) (ble_lbs_t * p_lbs, uint16_t duration_min, uint8_t max_rise_c);
+// Returns false to reject the lease
+typedef bool (*ble_lbs_lease_handler_t) (ble_lbs_t * p_lbs, uint16_t seconds, uint8_t scene);
+typedef void (*ble_lbs_fan_lead_handler_t) (ble_lbs_t * p_lbs, uint8_t rise, uint16_t hold_s);
+// Return false to reject the stream, or a frame that doesn't fit it
+typedef bool (*ble_lbs_stream_start_handler_t) (ble_lbs_t * p_lbs, uint32_t start_ms, uint16_t period_ms,
+                                                uint16_t mask);
+typedef bool (*ble_lbs_stream_frame_handler_t) (ble_lbs_t * p_lbs, uint8_t const * p_frame, uint8_t len);
+// Temperature and fan reads are authorized and held until a reading
+// answers them, so a controller that polls rather than subscribes reads
+// a fresh one. The handler takes the reading, at once or asynchronously,
+// and hands it to ble_lbs_update_temp()/_fan() or ble_lbs_reply_temp()/
+// _fan(), which answer every read held on that sensor.
+#define LBS_SENSOR_TEMP 0
+#define LBS_SENSOR_FAN  1
+typedef void (*ble_lbs_sensor_read_handler_t) (ble_lbs_t * p_lbs, uint8_t sensor);
+// Whether p_mac is the fleet key's MAC over len bytes of p_msg
+typedef bool (*ble_lbs_mac_handler_t) (uint8_t const * p_msg, uint8_t len, uint8_t const * p_mac);
 
 typedef struct
 {
     ble_lbs_led_write_handler_t led_write_handler;                    /**< Event handler to be called when LED characteristic is written. */
+    ble_lbs_fade_write_handler_t fade_write_handler;                  /**< Event handler to be called for each record written to the fade characteristic. */
+    ble_lbs_frame_write_handler_t frame_write_handler;                /**< Event handler to be called when a frame is written. */
+    ble_lbs_link_write_handler_t link_write_handler;                  /**< Event handler to be called when a connection profile is requested. */
+    ble_lbs_schedule_write_handler_t schedule_write_handler;          /**< Event handler to be called for each schedule upload write. */
+    ble_lbs_time_write_handler_t time_write_handler;                  /**< Event handler to be called when the clock is set. */
+    ble_lbs_crash_clear_handler_t crash_clear_handler;                /**< Event handler to be called when the crash log is written. */
+    ble_lbs_events_ack_handler_t events_ack_handler;                  /**< Event handler to be called when error events are acknowledged. */
+    ble_lbs_scene_handler_t scene_handler;                            /**< Event handler to be called for scene commands. */
+    ble_lbs_at_handler_t at_handler;                                  /**< Event handler to be called with records to hold for later. */
+    ble_lbs_sync_write_handler_t sync_write_handler;                  /**< Event handler to be called when a sync token is written. */
+    ble_lbs_trace_handler_t trace_handler;                            /**< Event handler to be called when a command write changing the outputs has run, NULL not to trace. */
+    ble_lbs_pwm_freq_handler_t pwm_freq_handler;                      /**< Event handler to be called when a PWM frequency is set. */
+    ble_lbs_dither_handler_t dither_handler;                          /**< Event handler to be called when the dithered channels are set. */
+    ble_lbs_frame_write_handler_t stage_handler;                      /**< Event handler to be called when a frame is staged. */
+    ble_lbs_commit_handler_t commit_handler;                          /**< Event handler to be called when the staged frame is committed. */
+    ble_lbs_dim_handler_t dim_handler;                                /**< Event handler to be called when the master dimmer is set. */
+    ble_lbs_slew_handler_t slew_handler;                              /**< Event handler to be called when a slew limit is set. */
+    ble_lbs_sim_handler_t sim_handler;                                /**< Event handler to be called when a sensor simulation is set, NULL without one. */
+    ble_lbs_effect_handler_t effect_handler;                          /**< Event handler to be called when a weather effect is started. */
+    ble_lbs_burnin_handler_t burnin_handler;                          /**< Event handler to be called when a burn-in is started or stopped. */
+    ble_lbs_lease_handler_t lease_handler;                            /**< Event handler to be called when the control lease is taken or renewed. */
+    ble_lbs_fan_lead_handler_t fan_lead_handler;                      /**< Event handler to be called when the controller says the output is about to rise. */
+    ble_lbs_stream_start_handler_t stream_start_handler;              /**< Event handler to be called when a frame stream is started or stopped. */
+    ble_lbs_stream_frame_handler_t stream_frame_handler;              /**< Event handler to be called with each streamed frame. */
+    ble_lbs_sensor_read_handler_t sensor_read_handler;                /**< Event handler to be called when a sensor is read, NULL to answer with the last value sent. */
+    ble_lbs_mac_handler_t mac_handler;                                /**< Checks signed command writes, NULL to take none. */
+    bool cmd_mac_required;                                            /**< Refuse unsigned command writes, and writes to the other characteristics. */
+#if LATENCY_ENABLED
+    ble_lbs_latency_reset_handler_t latency_reset_handler;            /**< Event handler to be called when the latency histograms are written. */
+#endif
+    uint16_t fan_deadband;                                            /**< Fan change (rpm) that triggers a notification. */
+    uint16_t temp_deadband;                                           /**< Temperature change (1/16 degree C) that triggers a notification. */
+    uint16_t max_interval;                                            /**< Update calls after which a value is sent even if unchanged, 0 never. */
+    uint8_t channels;                                                 /**< Channels wired, told in the capability characteristic. */
+    uint32_t capabilities;                                            /**< LBS_CAP_* bits, told in the capability characteristic. */
 } ble_lbs_init_t;
 
+typedef struct
+{
+    int16_t  temp;
+    uint16_t rpm;
+    uint8_t  errors;
+    uint8_t  derate_pct;
+    uint8_t  fan_duty;
+    uint8_t  flags;
+    uint32_t uptime;
+    uint16_t output_hash;
+} ble_lbs_telemetry_data_t;
+
+// Per characteristic notification state
+typedef struct
+{
+    uint8_t  enabled;  // Bit per link whose CCCD has notifications on
+    bool     sent;     // last holds what the client has
+    uint32_t last;
+    uint16_t age;      // Update calls since the last notification
+} ble_lbs_telemetry_t;
+
 typedef struct ble_lbs_s
 {
     uint16_t                    service_handle;
     ble_gatts_char_handles_t    led_char_handles;
+    ble_gatts_char_handles_t    fade_char_handles;
+    ble_gatts_char_handles_t    frame_char_handles;
+    ble_gatts_char_handles_t    status_char_handles;
+    ble_gatts_char_handles_t    telemetry_char_handles;
+    ble_gatts_char_handles_t    link_char_handles;
+    ble_gatts_char_handles_t    schedule_char_handles;
+    ble_gatts_char_handles_t    time_char_handles;
+    ble_gatts_char_handles_t    crash_char_handles;
+    ble_gatts_char_handles_t    events_char_handles;
+#if LATENCY_ENABLED
+    ble_gatts_char_handles_t    latency_char_handles;
+#endif
+    ble_gatts_char_handles_t    boot_char_handles;
+    ble_gatts_char_handles_t    command_char_handles;
+    ble_gatts_char_handles_t    sync_char_handles;
+    ble_gatts_char_handles_t    supply_char_handles;
+    ble_gatts_char_handles_t    output_char_handles;
+    ble_gatts_char_handles_t    capability_char_handles;
     ble_gatts_char_handles_t    fan_char_handles;
 	  ble_gatts_char_handles_t    temp_char_handles;
+    ble_gatts_char_handles_t    schema_char_handles;  // Last of the handles, the schema covers them all
+    uint16_t                    schema;
     uint8_t                     uuid_type;
-    uint16_t                    conn_handle;
+    uint16_t                    conn_handles[LBS_MAX_LINKS];  // BLE_CONN_HANDLE_INVALID when free
+    uint8_t                     control;        // Link holding control, LBS_NO_LINK for none
+    uint8_t                     sync_link;      // Last to write a sync token, for the answer
+    uint16_t                    cmd_count;
+    uint16_t                    cmd_crc;
+    bool                        cmd_synced;     // Seen a command write since control was taken
+    uint8_t                     cmd_seq;        // Latest command sequence number
+    uint32_t                    cmd_received;   // Ack window, bit n for cmd_seq - n
+    uint32_t                    cmd_rejected;
+    ble_lbs_mac_handler_t       mac_handler;
+    bool                        cmd_mac_required;
+    uint32_t                    cmd_counter;    // Latest signed write counter run since boot
+    uint32_t                    cmd_counters;   // Bit n for cmd_counter - n run
+    uint16_t                    fan_deadband;
+    uint16_t                    temp_deadband;
+    uint16_t                    max_interval;
+    ble_lbs_telemetry_t         fan_tlm;
+    ble_lbs_telemetry_t         temp_tlm;
+    ble_lbs_telemetry_t         status_tlm;
+    ble_lbs_telemetry_t         telemetry_tlm;
+    ble_lbs_telemetry_t         link_tlm;
+    ble_lbs_telemetry_t         cmd_tlm;
+    ble_lbs_telemetry_t         sync_tlm;
+    int16_t                     telemetry_temp;  // Last sent, for the deadbands
+    uint16_t                    telemetry_rpm;
+    // Status and telemetry values, BLE_GATTS_VLOC_USER: the SoftDevice
+    // answers reads from here and notifies what's here, so an update is
+    // written once and never copied into the stack
+    uint8_t                     status_value[LBS_STATUS_LEN];
+    uint8_t                     telemetry_value[LBS_TELEMETRY_LEN];
+    ble_lbs_tx_t *              tx_queue[LBS_TX_QUEUE_SIZE];
+    uint8_t                     tx_head;
+    uint8_t                     tx_count;
+    ble_lbs_tx_stats_t          tx_stats;
     ble_lbs_led_write_handler_t led_write_handler;
+    ble_lbs_fade_write_handler_t fade_write_handler;
+    ble_lbs_frame_write_handler_t frame_write_handler;
+    ble_lbs_link_write_handler_t link_write_handler;
+    ble_lbs_schedule_write_handler_t schedule_write_handler;
+    ble_lbs_time_write_handler_t time_write_handler;
+    ble_lbs_crash_clear_handler_t crash_clear_handler;
+    ble_lbs_events_ack_handler_t events_ack_handler;
+    ble_lbs_scene_handler_t scene_handler;
+    ble_lbs_at_handler_t at_handler;
+    ble_lbs_sync_write_handler_t sync_write_handler;
+    ble_lbs_trace_handler_t trace_handler;
+    ble_lbs_pwm_freq_handler_t pwm_freq_handler;
+    ble_lbs_dither_handler_t dither_handler;
+    ble_lbs_frame_write_handler_t stage_handler;
+    ble_lbs_commit_handler_t commit_handler;
+    ble_lbs_dim_handler_t dim_handler;
+    ble_lbs_slew_handler_t slew_handler;
+    ble_lbs_sim_handler_t sim_handler;
+    ble_lbs_effect_handler_t effect_handler;
+    ble_lbs_burnin_handler_t burnin_handler;
+    ble_lbs_lease_handler_t lease_handler;
+    ble_lbs_fan_lead_handler_t fan_lead_handler;
+    ble_lbs_stream_start_handler_t stream_start_handler;
+    ble_lbs_stream_frame_handler_t stream_frame_handler;
+    ble_lbs_sensor_read_handler_t sensor_read_handler;
+    uint8_t                     temp_reads;     // Bit per link with a read held, see ble_lbs_sensor_read_handler_t
+    uint8_t                     fan_reads;
+#if LATENCY_ENABLED
+    ble_lbs_latency_reset_handler_t latency_reset_handler;
+#endif
 } ble_lbs_t;
 
 uint32_t ble_lbs_init(ble_lbs_t * p_lbs, const ble_lbs_init_t * p_lbs_init);
 
+// Run a command write from conn_handle's link, laid out as on the
+// command characteristic but of any length, for transports with room for
+// more records. It takes control and is checked as one on the
+// characteristic would be. False if it was dropped, malformed or a
+// record was rejected.
+bool ble_lbs_command(ble_lbs_t * p_lbs, uint16_t conn_handle, uint8_t const * p_data, uint16_t len);
+// Take control for a write from another transport that drives the brick,
+// as one to the characteristics would. False if another link holds it,
+// or with MAC required, where only signed commands drive the brick.
+bool ble_lbs_control_take(ble_lbs_t * p_lbs, uint16_t conn_handle);
+// Run records held by the at handler
+bool ble_lbs_run(ble_lbs_t * p_lbs, uint8_t const * p_records, uint16_t len);
+// Ack again with a completed trace, as trace_take() gives it
+void ble_lbs_command_trace(ble_lbs_t * p_lbs, uint8_t seq, uint32_t received_ms, uint16_t commit_ms);
+
 void ble_lbs_on_ble_evt(ble_lbs_t * p_lbs, ble_evt_t * p_ble_evt);
 
-uint32_t ble_lbs_update_fan(ble_lbs_t* p_lbs, uint8_t* rpm);
-uint32_t ble_lbs_update_temp(ble_lbs_t* p_lbs, uint8_t* temp);
+// The update functions are meant to be called on every new value. They
+// return NRF_ERROR_INVALID_STATE without building a packet when nobody is
+// connected and subscribed, and NRF_SUCCESS when the value is within the
+// deadband or was queued. NRF_ERROR_NO_MEM means the TX queue was full.
+// Status and telemetry are the exception in building theirs regardless,
+// into the value reads are served from, so a controller polling them
+// rather than subscribing still reads what's current. Fan and
+// temperature build theirs for any read held on them.
+// Fan speed is the slowest fan (uint16 LE, what older controllers read),
+// then each fan's own (uint16 LE, 0 while stopped). Like the sensors
+// below, the fans ride along with changes to the first.
+#define LBS_FAN_LEN 2
+#define LBS_FAN_MAX_FANS 3
+#define LBS_FAN_MAX_LEN (LBS_FAN_LEN + 2 * LBS_FAN_MAX_FANS)
+uint32_t ble_lbs_update_fan(ble_lbs_t* p_lbs, uint16_t rpm, uint16_t const * p_fans, uint8_t fan_count);
+// Temperature is sent as whole degrees (uint16 LE, what older controllers
+// read) followed by the signed 1/16 degree reading (int16 LE), both the
+// hotspot (mcp9808.h), then each sensor's own reading (int16 LE, 1/16
+// degree, INT16_MIN if it didn't answer). The sensors ride along with
+// hotspot changes rather than being sent for their own.
+#define LBS_TEMP_LEN 4
+#define LBS_TEMP_MAX_SENSORS 4
+#define LBS_TEMP_MAX_LEN (LBS_TEMP_LEN + 2 * LBS_TEMP_MAX_SENSORS)
+uint32_t ble_lbs_update_temp(ble_lbs_t* p_lbs, int16_t temp, int16_t const * p_sensors, uint8_t sensor_count);
+// Answer held reads alone, for a reading taken without anything new to
+// notify or that failed and leaves the last one standing
+void ble_lbs_reply_fan(ble_lbs_t* p_lbs, uint16_t rpm, uint16_t const * p_fans, uint8_t fan_count);
+void ble_lbs_reply_temp(ble_lbs_t* p_lbs, int16_t temp, int16_t const * p_sensors, uint8_t sensor_count);
+uint32_t ble_lbs_update_status(ble_lbs_t* p_lbs, uint8_t derate_pct, uint32_t commits, uint16_t repairs);
+// Temperature and rpm use their deadbands, any other field change is sent
+uint32_t ble_lbs_update_telemetry(ble_lbs_t* p_lbs, ble_lbs_telemetry_data_t const * p_data);
+uint32_t ble_lbs_update_link(ble_lbs_t* p_lbs, uint8_t profile, bool forced,
+                             ble_gap_conn_params_t const * p_params);
+// Read only, sets the value for the next read
+uint32_t ble_lbs_update_schedule(ble_lbs_t* p_lbs, uint8_t const * p_status, uint16_t len);
+uint32_t ble_lbs_update_crash_log(ble_lbs_t* p_lbs, uint8_t const * p_log, uint16_t len);
+uint32_t ble_lbs_update_events(ble_lbs_t* p_lbs, uint8_t const * p_log, uint16_t len);
+#if LATENCY_ENABLED
+uint32_t ble_lbs_update_latency(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len);
+#endif
+uint32_t ble_lbs_update_boot(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len);
+uint32_t ble_lbs_update_supply(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len);
+uint32_t ble_lbs_update_output(ble_lbs_t* p_lbs, uint8_t const * p_data, uint16_t len);
+// Fold another service's characteristic handles into the schema
+uint32_t ble_lbs_schema_add(ble_lbs_t* p_lbs, void const * p_handles, uint16_t len);
+// Answer a sync write, ms as close to its arrival as can be had
+uint32_t ble_lbs_update_sync(ble_lbs_t* p_lbs, uint32_t token, uint32_t ms);
+uint32_t ble_lbs_update_time(ble_lbs_t* p_lbs, uint32_t time, uint32_t uptime,
+                             int16_t drift_ppm, bool set);
+
+// Links connected, and whether conn_handle's holds control
+uint8_t ble_lbs_links(ble_lbs_t const * p_lbs);
+bool ble_lbs_in_control(ble_lbs_t const * p_lbs, uint16_t conn_handle);
+
+// Notifications lost to a full queue or a SoftDevice error, saturating.
+// The full breakdown is in p_lbs->tx_stats.
+uint16_t ble_lbs_tx_drops(ble_lbs_t const * p_lbs);
 
 
 #endif // BLE_LBS_H__
@@ -0,0 +1,118 @@
+#ifndef _BOARD_PROFILE_H_
+#define _BOARD_PROFILE_H_
+
+#include "app_util.h"
+
+// What is fitted to the brick being built for, picked with
+// -DBOARD_LEDBRICK_<name> in the Makefile alongside the BSP's board (which
+// still only covers the buttons and LEDs it drives). The drivers size
+// their tables and loops from these counts, so none of it is looked up at
+// run time, and a part a board leaves out (its pin BOARD_PIN_NONE) has its
+// code left out with it.
+#define BOARD_PIN_NONE 0xFF
+
+// A profile may also give BOARD_LED_TEMPCO, each LED channel's output
+// lost per degree C of heatsink above 25, in ppm: around 1000-2000 for
+// blue and white strings, 4000-8000 for red and amber. The output stage
+// makes it up (derate.h). Channels left out, or a profile without it,
+// aren't compensated.
+//
+// BOARD_LED_RISE gives each LED channel's junction rise over the board
+// sensor at full duty, in MCP9808 units (MCP9808_DEG), for the
+// junction estimate the fan and derate act on (junction.h). Without it
+// they act on the board reading.
+//
+// BOARD_REMOTE_SENSORS, with BOARD_REMOTE_SENSOR_COUNT, names BLE sensors
+// the brick connects to on S130 for the tank's water temperature and the
+// room's light (remote_sensor.h), as ble_gap_addr_t initialisers:
+//   { { BLE_GAP_ADDR_TYPE_RANDOM_STATIC, { 0x11, 0x22, 0x33, 0x44, 0x55, 0xC6 } } }
+// with the address least significant byte first.
+
+#if defined(BOARD_LEDBRICK_V1)
+
+// One driver, one sensor and one fan
+#define BOARD_PIN_SCL 30
+#define BOARD_PIN_SDA 0
+#define BOARD_PIN_OE 1
+#define BOARD_PIN_ALERT 2
+#define BOARD_PIN_FANCTRL 9
+#define BOARD_PIN_ERRORLED 12
+
+// P0.04, through 100k over 10k to ground
+#define BOARD_SUPPLY_AIN ADC_CONFIG_PSEL_AnalogInput5
+#define BOARD_SUPPLY_TOP_KOHM 100
+#define BOARD_SUPPLY_BOTTOM_KOHM 10
+
+#define BOARD_PCA9685_DEVICES 1
+#define BOARD_PCA9685_ADDRESSES { 0x7F }
+// Emitter strings wired, logical channels 0 to n-1, told to the
+// controller so it only evaluates and sends those. Logical channels from
+// n up to PCA9685_NUM_LEDS are auxiliary outputs (aux.h).
+#define BOARD_LED_CHANNELS 8
+#define BOARD_PCA9685_CHANNEL_MAP { \
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }, \
+}
+
+#define BOARD_MCP9808_SENSORS 1
+#define BOARD_MCP9808_ADDRESSES { 0x1F }
+#define BOARD_MCP9808_WEIGHTS { 1 }
+
+#define BOARD_FANS 1
+#define BOARD_FAN_TACH_PINS { 8 }
+#define BOARD_FAN_GATE_PINS { BOARD_PIN_NONE }
+
+#elif defined(BOARD_LEDBRICK_TWIN)
+
+// Long emitter bar: two drivers wired in parallel for the current, a
+// sensor at each end and one in the middle, and a fan at each end that
+// can be switched off on its own. No error LED on the front panel.
+#define BOARD_PIN_SCL 30
+#define BOARD_PIN_SDA 0
+#define BOARD_PIN_OE 1
+#define BOARD_PIN_ALERT 2
+#define BOARD_PIN_FANCTRL 9
+#define BOARD_PIN_ERRORLED BOARD_PIN_NONE
+
+#define BOARD_SUPPLY_AIN ADC_CONFIG_PSEL_AnalogInput5
+#define BOARD_SUPPLY_TOP_KOHM 100
+#define BOARD_SUPPLY_BOTTOM_KOHM 10
+
+#define BOARD_PCA9685_DEVICES 2
+#define BOARD_PCA9685_ADDRESSES { 0x7F, 0x7E }
+#define BOARD_LED_CHANNELS 16
+#define BOARD_PCA9685_CHANNEL_MAP { \
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }, \
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }, \
+}
+
+#define BOARD_MCP9808_SENSORS 3
+#define BOARD_MCP9808_ADDRESSES { 0x18, 0x19, 0x1A }
+#define BOARD_MCP9808_WEIGHTS { 1, 2, 1 }
+
+#define BOARD_FANS 2
+#define BOARD_FAN_TACH_PINS { 8, 10 }
+#define BOARD_FAN_GATE_PINS { 11, 13 }
+
+#else
+#error "No board profile, define BOARD_LEDBRICK_<name>"
+#endif
+
+#define BOARD_PIN_VALID(pin) ((pin) < 32 || (pin) == BOARD_PIN_NONE)
+#define BOARD_PIN_FITTED(pin) ((pin) != BOARD_PIN_NONE)
+
+// Every named pin is a real one, and the fixed ones are each used once.
+// Tables are checked against their counts where they are laid out.
+STATIC_ASSERT(BOARD_PIN_VALID(BOARD_PIN_SCL) && BOARD_PIN_VALID(BOARD_PIN_SDA));
+STATIC_ASSERT(BOARD_PIN_VALID(BOARD_PIN_OE) && BOARD_PIN_VALID(BOARD_PIN_ALERT));
+STATIC_ASSERT(BOARD_PIN_VALID(BOARD_PIN_FANCTRL) && BOARD_PIN_VALID(BOARD_PIN_ERRORLED));
+STATIC_ASSERT(BOARD_PIN_SCL != BOARD_PIN_SDA && BOARD_PIN_OE != BOARD_PIN_ALERT);
+STATIC_ASSERT(BOARD_PIN_OE != BOARD_PIN_FANCTRL && BOARD_PIN_ALERT != BOARD_PIN_FANCTRL);
+STATIC_ASSERT(BOARD_PIN_ERRORLED != BOARD_PIN_OE && BOARD_PIN_ERRORLED != BOARD_PIN_FANCTRL);
+STATIC_ASSERT(BOARD_PCA9685_DEVICES >= 1 && BOARD_PCA9685_DEVICES <= 8);
+// Logical channels, PCA9685_NUM_LEDS
+STATIC_ASSERT(BOARD_LED_CHANNELS >= 1 && BOARD_LED_CHANNELS <= 16);
+// A2-A0 straps
+STATIC_ASSERT(BOARD_MCP9808_SENSORS >= 1 && BOARD_MCP9808_SENSORS <= 8);
+STATIC_ASSERT(BOARD_FANS >= 1);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+#include "app_util.h"
+#include "boot_trace.h"
+
+static const uint16_t budget_ms[BOOT_PHASE_COUNT] = {
+	[BOOT_PHASE_CORE]        = BOOT_BUDGET_CORE_MS,
+	[BOOT_PHASE_LIGHT]       = BOOT_BUDGET_LIGHT_MS,
+	[BOOT_PHASE_STACK]       = BOOT_BUDGET_STACK_MS,
+	[BOOT_PHASE_SENSORS]     = BOOT_BUDGET_SENSORS_MS,
+	[BOOT_PHASE_SERVICES]    = BOOT_BUDGET_SERVICES_MS,
+	[BOOT_PHASE_ADVERTISING] = BOOT_BUDGET_ADVERTISING_MS,
+	[BOOT_PHASE_BOOTLOADER]  = BOOT_BUDGET_BOOTLOADER_MS,
+};
+
+static uint32_t phase_us[BOOT_PHASE_COUNT];
+static uint32_t last_us = 0;
+static uint8_t over = 0;
+static bool running = false;
+
+void boot_trace_start(void) {
+	// Still 0 when nothing started it, a reset stops every timer
+	NRF_TIMER1->TASKS_CAPTURE[0] = 1;
+	phase_us[BOOT_PHASE_BOOTLOADER] = NRF_TIMER1->CC[0];
+	if (phase_us[BOOT_PHASE_BOOTLOADER] > BOOT_BUDGET_BOOTLOADER_MS * 1000UL) {
+		over |= (1 << BOOT_PHASE_BOOTLOADER);
+	}
+
+	NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
+	NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	NRF_TIMER1->PRESCALER = 4; // 16 MHz / 2^4
+	NRF_TIMER1->TASKS_CLEAR = 1;
+	NRF_TIMER1->TASKS_START = 1;
+	running = true;
+}
+
+uint32_t boot_trace_elapsed_us(void) {
+	if (!running) {
+		return 0;
+	}
+	NRF_TIMER1->TASKS_CAPTURE[0] = 1;
+	return NRF_TIMER1->CC[0];
+}
+
+void boot_trace_mark(boot_phase_t phase) {
+	uint32_t now = boot_trace_elapsed_us();
+
+	phase_us[phase] = now - last_us;
+	last_us = now;
+	if (phase_us[phase] > budget_ms[phase] * 1000UL) {
+		over |= (1 << phase);
+	}
+}
+
+void boot_trace_end(void) {
+	// Left for the fan PWM driver to set up from scratch
+	NRF_TIMER1->TASKS_STOP = 1;
+	NRF_TIMER1->TASKS_SHUTDOWN = 1;
+	running = false;
+}
+
+uint16_t boot_trace_get(uint8_t * p_data) {
+	for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+		uint32_encode(phase_us[i], &p_data[4*i]);
+	}
+	p_data[4 * BOOT_PHASE_COUNT] = over;
+	return BOOT_TRACE_LEN;
+}
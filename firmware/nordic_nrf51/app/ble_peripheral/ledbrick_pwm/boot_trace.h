@@ -0,0 +1,53 @@
+#ifndef _BOOT_TRACE_H_
+#define _BOOT_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Startup timing. The LFCLK, and with it RTC1, only runs once the
+// SoftDevice is up, so this counts microseconds on TIMER1 from the HFCLK
+// instead. TIMER1 is the fan PWM's (fan_control.c), which only starts
+// after boot_trace_end(). The DFU bootloader starts it at reset and hands
+// it over running, so what it took comes first, 0 without one.
+typedef enum {
+	BOOT_PHASE_CORE = 0,    // Retained state, watchdog, scheduler, timers, buttons, TWI
+	BOOT_PHASE_LIGHT,       // PCA9685 up and the restored frame on its way out
+	BOOT_PHASE_STACK,       // SoftDevice enabled, overlapping the frame transfer
+	BOOT_PHASE_SENSORS,     // Temperature sensor, fan and thermal alerts
+	BOOT_PHASE_SERVICES,    // GATT services, Device Manager, schedule
+	BOOT_PHASE_ADVERTISING, // GAP and advertising set up, first advertisement
+	BOOT_PHASE_BOOTLOADER,  // Reset to main(), counted by the bootloader, last
+	                        // so older controllers keep their indexes
+	BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Budget per phase. Overruns are only flagged, the bounded waits in each
+// phase and the watchdog are what actually stop a hang.
+#define BOOT_BUDGET_CORE_MS        5
+#define BOOT_BUDGET_LIGHT_MS       20
+#define BOOT_BUDGET_STACK_MS       20
+#define BOOT_BUDGET_SENSORS_MS     20
+#define BOOT_BUDGET_SERVICES_MS    30
+#define BOOT_BUDGET_ADVERTISING_MS 10
+// The fast path (app/dfu/bootloader/main.c). The first boot after an
+// update runs the image CRC and goes over.
+#define BOOT_BUDGET_BOOTLOADER_MS  1
+
+// Trace layout, also the GATT format: the length of each phase in
+// microseconds (uint32 LE each), then a bitmask of the phases that ran
+// over budget (uint8, 1 << boot_phase_t)
+#define BOOT_TRACE_LEN (4 * BOOT_PHASE_COUNT + 1)
+
+// First thing in main()
+void boot_trace_start(void);
+// End of a phase, phases are marked in order
+void boot_trace_mark(boot_phase_t phase);
+// Microseconds since boot_trace_start(), for bounding waits during init
+uint32_t boot_trace_elapsed_us(void);
+// After the last phase, powers the timer down
+void boot_trace_end(void);
+
+// Returns the length written, BOOT_TRACE_LEN
+uint16_t boot_trace_get(uint8_t * p_data);
+
+#endif
@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_util.h"
+#include "broadcast.h"
+
+#include "nrf_soc.h"
+
+static uint8_t group_id;
+static nrf_ecb_hal_data_t ecb;
+static broadcast_frame_handler_t frame_handler;
+static broadcast_scene_handler_t scene_handler;
+static broadcast_relay_handler_t relay_handler;
+
+static bool have_seq = false;
+static uint32_t last_seq;
+static broadcast_stats_t stats;
+
+// CBC-MAC over a length byte and the message, zero padded. The length
+// up front keeps messages of different sizes from sharing a MAC.
+bool broadcast_mac_check(uint8_t const * p_msg, uint8_t len, uint8_t const * p_mac) {
+	uint8_t block[16];
+	uint8_t pos = 0;
+	bool first = true;
+
+	memset(ecb.ciphertext, 0, sizeof(ecb.ciphertext));
+	while (first || pos < len) {
+		memset(block, 0, sizeof(block));
+		uint8_t i = 0;
+		if (first) {
+			block[i++] = len;
+			first = false;
+		}
+		for (; i < sizeof(block) && pos < len; i++) {
+			block[i] = p_msg[pos++];
+		}
+		for (i = 0; i < sizeof(block); i++) {
+			ecb.cleartext[i] = block[i] ^ ecb.ciphertext[i];
+		}
+		if (sd_ecb_block_encrypt(&ecb) != NRF_SUCCESS) {
+			return false;
+		}
+	}
+	return memcmp(ecb.ciphertext, p_mac, BROADCAST_MAC_LEN) == 0;
+}
+
+// Group and sequence checks shared by every packet type. Controllers
+// repeat each packet for a while, drop repeats before spending time on
+// the MAC.
+static bool addressed(uint8_t const * p_data) {
+	if (p_data[1] != group_id && p_data[1] != BROADCAST_GROUP_ALL) {
+		return false;
+	}
+	if (have_seq && (int32_t)(uint32_decode(&p_data[2]) - last_seq) <= 0) {
+		stats.replayed++;
+		return false;
+	}
+	return true;
+}
+
+// len is up to the end of the MAC, hops follow when relayed
+static void accept(uint8_t const * p_data, uint8_t len, uint8_t hops) {
+	have_seq = true;
+	last_seq = uint32_decode(&p_data[2]);
+	stats.accepted++;
+	if (relay_handler) {
+		relay_handler(p_data, len, hops);
+	}
+}
+
+// Hops a payload of len has come, when len is a relayed one's
+static uint8_t hops_of(uint8_t const * p_data, uint8_t len, uint8_t signed_len) {
+	return len == signed_len + BROADCAST_HOPS_LEN ? p_data[signed_len] : 0;
+}
+
+static void on_scene(uint8_t const * p_data, uint8_t len) {
+	uint8_t const signed_len = BROADCAST_SCENE_LEN + BROADCAST_MAC_LEN;
+
+	if (!addressed(p_data)) {
+		return;
+	}
+	if (len != signed_len && len != signed_len + BROADCAST_HOPS_LEN) {
+		stats.malformed++;
+		return;
+	}
+	if (!broadcast_mac_check(p_data, BROADCAST_SCENE_LEN, &p_data[BROADCAST_SCENE_LEN])) {
+		stats.bad_mac++;
+		return;
+	}
+	accept(p_data, signed_len, hops_of(p_data, len, signed_len));
+	if (scene_handler) {
+		scene_handler(p_data[6]);
+	}
+}
+
+void broadcast_on_payload(uint8_t const * p_data, uint8_t len) {
+	uint16_t levels[16];
+	uint16_t mask, duration_ms;
+	uint8_t offset = BROADCAST_HEADER_LEN;
+
+	if (len >= BROADCAST_SCENE_LEN && p_data[0] == BROADCAST_SCENE_MAGIC) {
+		on_scene(p_data, len);
+		return;
+	}
+	if (len < BROADCAST_HEADER_LEN + BROADCAST_MAC_LEN || p_data[0] != BROADCAST_MAGIC) {
+		return; // Someone else's data
+	}
+	if (!addressed(p_data)) {
+		return;
+	}
+
+	mask = uint16_decode(&p_data[6]);
+	duration_ms = uint16_decode(&p_data[8]);
+	for (uint8_t i = 0; i < 16; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		if (offset + sizeof(uint16_t) + BROADCAST_MAC_LEN > len) {
+			stats.malformed++;
+			return;
+		}
+		levels[i] = uint16_decode(&p_data[offset]);
+		offset += sizeof(uint16_t);
+	}
+	if (offset + BROADCAST_MAC_LEN != len && offset + BROADCAST_MAC_LEN + BROADCAST_HOPS_LEN != len) {
+		stats.malformed++;
+		return;
+	}
+
+	if (!broadcast_mac_check(p_data, offset, &p_data[offset])) {
+		stats.bad_mac++;
+		return;
+	}
+
+	accept(p_data, offset + BROADCAST_MAC_LEN, hops_of(p_data, len, offset + BROADCAST_MAC_LEN));
+	if (frame_handler) {
+		frame_handler(mask, levels, duration_ms);
+	}
+}
+
+void broadcast_set_group(uint8_t group) {
+	group_id = group;
+	// Sequence numbers are per controller, start over
+	have_seq = false;
+}
+
+void broadcast_set_relay(broadcast_relay_handler_t handler) {
+	relay_handler = handler;
+}
+
+void broadcast_stats(broadcast_stats_t * p_stats) {
+	*p_stats = stats;
+}
+
+bool broadcast_init(uint8_t group, uint8_t const * p_key, broadcast_frame_handler_t handler,
+                    broadcast_scene_handler_t scene) {
+	memcpy(ecb.key, p_key, BROADCAST_KEY_LEN);
+	frame_handler = handler;
+	scene_handler = scene;
+	broadcast_set_group(group);
+	memset(&stats, 0, sizeof(stats));
+	return true;
+}
+
+#ifdef S130
+
+#include "ble_gap.h"
+
+#define AD_TYPE_MANUFACTURER 0xFF
+
+static bool scanning = false;
+
+static const ble_gap_scan_params_t scan_params = {
+	.active = 0,
+	.selective = 0,
+	.p_whitelist = NULL,
+	.interval = BROADCAST_SCAN_INTERVAL,
+	.window = BROADCAST_SCAN_WINDOW,
+	.timeout = 0,
+};
+
+static void on_adv_report(ble_gap_evt_adv_report_t const * p_report) {
+	uint8_t pos = 0;
+
+	// Walk the AD structures looking for our manufacturer data
+	while (pos + 1 < p_report->dlen) {
+		uint8_t field_len = p_report->data[pos];
+		uint8_t const * p_field = &p_report->data[pos + 1];
+
+		if (field_len == 0 || pos + 1 + field_len > p_report->dlen) {
+			return;
+		}
+		if (p_field[0] == AD_TYPE_MANUFACTURER && field_len >= 3 &&
+		    uint16_decode(&p_field[1]) == BROADCAST_COMPANY_ID) {
+			broadcast_on_payload(&p_field[3], field_len - 3);
+			return;
+		}
+		pos += 1 + field_len;
+	}
+}
+
+void broadcast_on_ble_evt(ble_evt_t * p_ble_evt) {
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_ADV_REPORT:
+		on_adv_report(&p_ble_evt->evt.gap_evt.params.adv_report);
+		break;
+	case BLE_GAP_EVT_TIMEOUT:
+		if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_SCAN && scanning) {
+			scanning = false;
+			broadcast_start();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool broadcast_start(void) {
+	if (scanning) {
+		return true;
+	}
+	scanning = (sd_ble_gap_scan_start(&scan_params) == NRF_SUCCESS);
+	return scanning;
+}
+
+void broadcast_stop(void) {
+	if (scanning) {
+		(void)sd_ble_gap_scan_stop();
+		scanning = false;
+	}
+}
+
+#else
+
+// Stubs so S110 builds link, the SoftDevice has no observer role
+bool broadcast_start(void) {
+	return false;
+}
+
+void broadcast_stop(void) {
+}
+
+void broadcast_on_ble_evt(ble_evt_t * p_ble_evt) {
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _BROADCAST_H_
+#define _BROADCAST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Connectionless control: the controller advertises frames as
+// manufacturer specific data and every brick in the group scanning for
+// them applies the same frame at once. Scanning needs the S130 observer
+// role, the S110 build compiles it out; payloads from other carriers
+// (esb_rx.h) go through broadcast_on_payload() on either.
+//
+// Payload after the company ID:
+//   0  magic (BROADCAST_MAGIC)
+//   1  group ID, 0xFF addresses every group
+//   2  sequence number (uint32 LE), must increase per packet
+//   6  channel mask (uint16 LE)
+//   8  duration ms (uint16 LE)
+//  10  one level (uint16 LE) per set mask bit, lowest channel first
+//   n  first four bytes of an AES-128 CBC-MAC over the length and
+//      everything above
+// Scene recalls (scene.h) share the group, sequence and MAC:
+//   0  magic (BROADCAST_SCENE_MAGIC)
+//   1  group ID
+//   2  sequence number (uint32 LE)
+//   6  scene slot (uint8)
+//   7  MAC
+// A brick relaying either (relay.h) adds the hops it has come as one
+// byte after the MAC, outside it so relays don't need to sign.
+#define BROADCAST_COMPANY_ID 0xFFFF // Unassigned, for internal use
+#define BROADCAST_MAGIC 0x4C
+#define BROADCAST_SCENE_MAGIC 0x53
+#define BROADCAST_SCENE_LEN 7
+#define BROADCAST_GROUP_ALL 0xFF
+#define BROADCAST_HEADER_LEN 10
+#define BROADCAST_MAC_LEN 4
+#define BROADCAST_MAX_CHANNELS 6 // What fits in one advertisement, ESB fits 8
+#define BROADCAST_HOPS_LEN 1
+
+// Scan timing, in 0.625 ms units
+#define BROADCAST_SCAN_INTERVAL 0x00A0 // 100 ms
+#define BROADCAST_SCAN_WINDOW 0x0050   // 50 ms
+
+#define BROADCAST_KEY_LEN 16
+
+// p_levels is indexed by channel, only entries with their mask bit set are valid
+typedef void (*broadcast_frame_handler_t)(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms);
+typedef void (*broadcast_scene_handler_t)(uint8_t slot);
+// Called with each payload accepted, without its hop count, and the
+// hops it came: 0 straight from the controller
+typedef void (*broadcast_relay_handler_t)(uint8_t const * p_data, uint8_t len, uint8_t hops);
+
+typedef struct {
+	uint32_t accepted;
+	uint32_t replayed;  // Sequence not newer than the last accepted
+	uint32_t bad_mac;
+	uint32_t malformed;
+} broadcast_stats_t;
+
+bool broadcast_init(uint8_t group, uint8_t const * p_key, broadcast_frame_handler_t handler,
+                    broadcast_scene_handler_t scene);
+bool broadcast_start(void);
+void broadcast_stop(void);
+void broadcast_on_ble_evt(ble_evt_t * p_ble_evt);
+// A payload as laid out above, from after the company ID
+void broadcast_on_payload(uint8_t const * p_data, uint8_t len);
+
+void broadcast_set_group(uint8_t group);
+void broadcast_set_relay(broadcast_relay_handler_t handler);
+void broadcast_stats(broadcast_stats_t * p_stats);
+// Whether p_mac is the key's MAC over len bytes of p_msg, the first
+// BROADCAST_MAC_LEN bytes, for signed command writes (ble_lbs.h) too
+bool broadcast_mac_check(uint8_t const * p_msg, uint8_t len, uint8_t const * p_mac);
+
+#endif
@@ -0,0 +1,440 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ble_nus.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "clock.h"
+#include "bulk.h"
+
+static ble_nus_t nus;
+static bulk_handler_t handler;
+
+// Frame being received, a header byte is never stored
+static uint8_t rx_buf[BULK_MAX_FRAME];
+static uint16_t rx_len = 0;
+static uint8_t rx_seq = 0;
+static bool rx_open = false;
+static bool rx_bad = false;
+
+// Reply being sent, built in place so the handler writes its body
+// straight into it
+static uint8_t tx_buf[BULK_MAX_FRAME];
+static uint16_t tx_len = 0;
+static uint16_t tx_off = 0;
+static uint8_t tx_seq = 0;
+
+// Command whose reply a handler left pending
+static bool pending = false;
+static uint8_t pending_cmd;
+
+// Queued writes to the frame characteristic, lent to the SoftDevice for
+// one link at a time. It lays the prepared writes out here as they come
+// and the frame is put together where they lie, so the characteristic's
+// value is the same memory.
+static uint8_t queue_buf[BULK_QUEUE_LEN];
+static uint16_t queue_conn = BLE_CONN_HANDLE_INVALID;
+static ble_gatts_char_handles_t frame_handles;
+
+// Filler being sent, and since when
+static bulk_fill_done_t fill_done = NULL;
+static uint32_t fill_ms;
+static uint32_t fill_start;
+static uint32_t fill_packets;
+
+static void rx_reset(void) {
+	rx_len = 0;
+	rx_open = false;
+	rx_bad = false;
+}
+
+// Whether the link has notifications on, from its CCCD as it stands
+static bool subscribed(uint16_t conn_handle) {
+	uint8_t cccd[BLE_CCCD_VALUE_LEN];
+	ble_gatts_value_t value = { .len = sizeof(cccd), .offset = 0, .p_value = cccd };
+
+	return sd_ble_gatts_value_get(conn_handle, nus.rx_handles.cccd_handle, &value) == NRF_SUCCESS &&
+	       value.len == sizeof(cccd) && ble_srv_is_notification_enabled(cccd);
+}
+
+// The service is held by one link at a time, nus.conn_handle: the first
+// to use it, until it drops. Whether conn_handle's holds it.
+static bool owner_take(uint16_t conn_handle) {
+	if (nus.conn_handle == BLE_CONN_HANDLE_INVALID) {
+		nus.conn_handle = conn_handle;
+		nus.is_notification_enabled = subscribed(conn_handle);
+	}
+	return nus.conn_handle == conn_handle;
+}
+
+// Hand packets to the SoftDevice until it runs out of buffers.
+// BLE_EVT_TX_COMPLETE calls this again as they free up.
+static void tx_pump(void) {
+	uint8_t packet[BULK_PACKET_LEN];
+
+	while (tx_off < tx_len) {
+		uint16_t chunk = MIN(tx_len - tx_off, BULK_PACKET_DATA);
+		uint8_t header = tx_seq & BULK_SEQ_MASK;
+
+		if (tx_off == 0) header |= BULK_FIRST;
+		if (tx_off + chunk == tx_len) header |= BULK_LAST;
+		packet[0] = header;
+		memcpy(&packet[1], &tx_buf[tx_off], chunk);
+
+		uint32_t err_code = ble_nus_string_send(&nus, packet, chunk + 1);
+		if (err_code == BLE_ERROR_NO_TX_BUFFERS) {
+			return;
+		}
+		if (err_code != NRF_SUCCESS) {
+			// Gone or unsubscribed, the controller will ask again
+			tx_len = 0;
+			return;
+		}
+		tx_seq++;
+		tx_off += chunk;
+	}
+	tx_len = 0;
+}
+
+static void reply(uint8_t cmd, bulk_status_t status, uint16_t body_len) {
+	tx_buf[0] = cmd | BULK_REPLY;
+	tx_buf[1] = status;
+	uint16_encode(crc16_compute(tx_buf, 2 + body_len, NULL), &tx_buf[2 + body_len]);
+	tx_len = 2 + body_len + 2;
+	tx_off = 0;
+	tx_pump();
+}
+
+static bool busy(void) {
+	return tx_len != 0 || pending;
+}
+
+// Runs the len byte frame at p_frame, answering it as bad if it is
+static void frame_run(uint8_t const * p_frame, uint16_t len, bool bad) {
+	uint8_t cmd = (len > 0) ? p_frame[0] : 0;
+	uint16_t body_len = 0;
+	bulk_status_t status;
+
+	if (bad || len < 3 ||
+	    crc16_compute(p_frame, len - 2, NULL) != uint16_decode(&p_frame[len - 2])) {
+		reply(cmd, BULK_STATUS_BAD_FRAME, 0);
+		return;
+	}
+	status = handler(nus.conn_handle, cmd, &p_frame[1], len - 3, &tx_buf[2], &body_len);
+	if (status == BULK_STATUS_PENDING) {
+		pending = true;
+		pending_cmd = cmd;
+		return;
+	}
+	reply(cmd, status, (status == BULK_STATUS_OK) ? body_len : 0);
+}
+
+static void frame_done(void) {
+	if (busy()) {
+		// Still sending the last reply, a controller waits for it first
+		return;
+	}
+	frame_run(rx_buf, rx_len, rx_bad);
+}
+
+// Puts the prepared writes in queue_buf together into one frame where
+// they lie: each chunk moves down to its offset past the first header,
+// which only ever lands on chunks already moved. The block is left as a
+// single write of the whole frame ending the queue, so what the
+// SoftDevice writes to the value once the execute is allowed is the
+// frame over itself. The frame's length, or -1 if the chunks aren't one
+// run of it in order.
+static int32_t queue_frame(void) {
+	uint8_t * p_frame = &queue_buf[BULK_QUEUE_HEADER];
+	uint16_t pos = 0;
+	uint16_t len = 0;
+
+	while (pos + 2 <= sizeof(queue_buf) && uint16_decode(&queue_buf[pos]) != BLE_GATT_HANDLE_INVALID) {
+		if (pos + BULK_QUEUE_HEADER > sizeof(queue_buf)) {
+			return -1;
+		}
+		uint16_t handle = uint16_decode(&queue_buf[pos]);
+		uint16_t offset = uint16_decode(&queue_buf[pos + 2]);
+		uint16_t chunk = uint16_decode(&queue_buf[pos + 4]);
+
+		if (handle != frame_handles.value_handle || offset != len ||
+		    pos + BULK_QUEUE_HEADER + chunk > sizeof(queue_buf) || len + chunk > BULK_MAX_FRAME) {
+			return -1;
+		}
+		memmove(&p_frame[len], &queue_buf[pos + BULK_QUEUE_HEADER], chunk);
+		len += chunk;
+		pos += BULK_QUEUE_HEADER + chunk;
+	}
+	uint16_encode(frame_handles.value_handle, &queue_buf[0]);
+	uint16_encode(0, &queue_buf[2]);
+	uint16_encode(len, &queue_buf[4]);
+	uint16_encode(BLE_GATT_HANDLE_INVALID, &p_frame[len]);
+	return len;
+}
+
+static void authorize_reply(uint16_t conn_handle, uint16_t status) {
+	ble_gatts_rw_authorize_reply_params_t auth = {
+		.type = BLE_GATTS_AUTHORIZE_TYPE_WRITE,
+		.params.write.gatt_status = status,
+	};
+
+	(void)sd_ble_gatts_rw_authorize_reply(conn_handle, &auth);
+}
+
+// Writes to the frame characteristic: a whole frame at once, as one write
+// or prepared writes into queue_buf. The reply goes back over the UART
+// service as any other's. While the last one is still going the write
+// itself fails, so a controller knows to send it again.
+static void on_authorize(ble_evt_t * p_ble_evt) {
+	uint16_t conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
+	ble_gatts_evt_rw_authorize_request_t * p_req = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+	ble_gatts_evt_write_t * p_write = &p_req->request.write;
+	int32_t len;
+
+	if (p_req->type != BLE_GATTS_AUTHORIZE_TYPE_WRITE) {
+		return;
+	}
+	switch (p_write->op) {
+	case BLE_GATTS_OP_WRITE_REQ:
+		if (p_write->handle != frame_handles.value_handle) {
+			return;
+		}
+		// The value shares the queue block, so not while it's lent
+		if (!owner_take(conn_handle) || busy() || queue_conn != BLE_CONN_HANDLE_INVALID) {
+			authorize_reply(conn_handle, BLE_GATT_STATUS_ATTERR_INSUF_RESOURCES);
+			return;
+		}
+		authorize_reply(conn_handle, BLE_GATT_STATUS_SUCCESS);
+		frame_run(p_write->data, p_write->len, false);
+		break;
+	case BLE_GATTS_OP_PREP_WRITE_REQ:
+		if (p_write->handle != frame_handles.value_handle) {
+			return;
+		}
+		authorize_reply(conn_handle, (p_write->offset + p_write->len <= BULK_MAX_FRAME)
+		                ? BLE_GATT_STATUS_SUCCESS : BLE_GATT_STATUS_ATTERR_INVALID_OFFSET);
+		break;
+	case BLE_GATTS_OP_EXEC_WRITE_REQ_NOW:
+		if (conn_handle != queue_conn || !owner_take(conn_handle) || busy()) {
+			authorize_reply(conn_handle, BLE_GATT_STATUS_ATTERR_INSUF_RESOURCES);
+			return;
+		}
+		len = queue_frame();
+		if (len < 0) {
+			authorize_reply(conn_handle, BLE_GATT_STATUS_ATTERR_INVALID_OFFSET);
+			return;
+		}
+		// Run from where it lies, before the SoftDevice can take the
+		// block back
+		frame_run(&queue_buf[BULK_QUEUE_HEADER], len, false);
+		authorize_reply(conn_handle, BLE_GATT_STATUS_SUCCESS);
+		break;
+	case BLE_GATTS_OP_EXEC_WRITE_REQ_CANCEL:
+		authorize_reply(conn_handle, BLE_GATT_STATUS_SUCCESS);
+		break;
+	default:
+		break;
+	}
+}
+
+// Lends queue_buf to the link asking, if no other has it and it holds the
+// service. Without it the SoftDevice turns the prepared writes away.
+static void on_mem_request(ble_evt_t * p_ble_evt) {
+	uint16_t conn_handle = p_ble_evt->evt.common_evt.conn_handle;
+	ble_user_mem_block_t block = { .p_mem = queue_buf, .len = sizeof(queue_buf) };
+
+	if (p_ble_evt->evt.common_evt.params.user_mem_request.type != BLE_USER_MEM_TYPE_GATTS_QUEUED_WRITES ||
+	    queue_conn != BLE_CONN_HANDLE_INVALID || !owner_take(conn_handle)) {
+		(void)sd_ble_user_mem_reply(conn_handle, NULL);
+		return;
+	}
+	if (sd_ble_user_mem_reply(conn_handle, &block) == NRF_SUCCESS) {
+		queue_conn = conn_handle;
+	}
+}
+
+static void fill_end(void) {
+	bulk_fill_done_t done = fill_done;
+
+	fill_done = NULL;
+	if (done != NULL) {
+		done(fill_packets, clock_ms() - fill_start);
+	}
+}
+
+// A header with no first bit, sequence 0, and zeroes
+static void fill_pump(void) {
+	uint8_t packet[BULK_PACKET_LEN] = { 0 };
+
+	if (clock_ms() - fill_start >= fill_ms) {
+		fill_end();
+		return;
+	}
+	for (;;) {
+		uint32_t err_code = ble_nus_string_send(&nus, packet, sizeof(packet));
+		if (err_code == BLE_ERROR_NO_TX_BUFFERS) {
+			return;
+		}
+		if (err_code != NRF_SUCCESS) {
+			fill_end();
+			return;
+		}
+	}
+}
+
+static void on_data(ble_nus_t * p_nus, uint8_t * p_data, uint16_t length) {
+	if (length == 0) {
+		return;
+	}
+	uint8_t header = p_data[0];
+
+	if (header & BULK_FIRST) {
+		rx_reset();
+		rx_open = true;
+	} else if (!rx_open) {
+		return;
+	} else if ((header & BULK_SEQ_MASK) != rx_seq) {
+		rx_bad = true;
+	}
+	rx_seq = (header + 1) & BULK_SEQ_MASK;
+
+	if (rx_len + (length - 1) > sizeof(rx_buf)) {
+		rx_bad = true;
+	} else if (!rx_bad) {
+		memcpy(&rx_buf[rx_len], &p_data[1], length - 1);
+		rx_len += length - 1;
+	}
+
+	if (header & BULK_LAST) {
+		frame_done();
+		rx_reset();
+	}
+}
+
+// Writes to the UART service's own handles, the ones that can take it
+static bool nus_write(ble_gatts_evt_write_t const * p_write) {
+	return p_write->handle == nus.tx_handles.value_handle ||
+	       p_write->handle == nus.rx_handles.cccd_handle;
+}
+
+// The link holding the service went, whatever it had going goes with it
+static void owner_release(void) {
+	nus.conn_handle = BLE_CONN_HANDLE_INVALID;
+	nus.is_notification_enabled = false;
+	rx_reset();
+	tx_len = 0;
+	tx_seq = 0;
+	pending = false;
+	fill_end();
+}
+
+// The UART service sees only the holding link's writes; it would take
+// any link's connect as its own, so those are kept from it
+void bulk_on_ble_evt(ble_evt_t * p_ble_evt) {
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_DISCONNECTED:
+		if (p_ble_evt->evt.gap_evt.conn_handle == queue_conn) {
+			queue_conn = BLE_CONN_HANDLE_INVALID;
+		}
+		if (p_ble_evt->evt.gap_evt.conn_handle == nus.conn_handle) {
+			owner_release();
+		}
+		break;
+	case BLE_GATTS_EVT_WRITE:
+		if (nus_write(&p_ble_evt->evt.gatts_evt.params.write) &&
+		    owner_take(p_ble_evt->evt.gatts_evt.conn_handle)) {
+			ble_nus_on_ble_evt(&nus, p_ble_evt);
+		}
+		break;
+	case BLE_EVT_TX_COMPLETE:
+		if (p_ble_evt->evt.common_evt.conn_handle != nus.conn_handle) {
+			break; // Another link's buffers
+		}
+		if (fill_done != NULL) {
+			fill_packets += p_ble_evt->evt.common_evt.params.tx_complete.count;
+			fill_pump();
+		} else {
+			tx_pump();
+		}
+		break;
+	case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+		on_authorize(p_ble_evt);
+		break;
+	case BLE_EVT_USER_MEM_REQUEST:
+		on_mem_request(p_ble_evt);
+		break;
+	case BLE_EVT_USER_MEM_RELEASE:
+		if (p_ble_evt->evt.common_evt.conn_handle == queue_conn) {
+			queue_conn = BLE_CONN_HANDLE_INVALID;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void const * bulk_handles(uint16_t * p_len) {
+	static ble_gatts_char_handles_t handles[3];
+
+	handles[0] = nus.tx_handles;
+	handles[1] = nus.rx_handles;
+	handles[2] = frame_handles;
+	*p_len = sizeof(handles);
+	return handles;
+}
+
+uint8_t * bulk_reply_body(void) {
+	return &tx_buf[2];
+}
+
+void bulk_complete(bulk_status_t status, uint16_t body_len) {
+	if (!pending) {
+		return;
+	}
+	pending = false;
+	reply(pending_cmd, status, (status == BULK_STATUS_OK) ? body_len : 0);
+}
+
+bool bulk_fill(uint32_t ms, bulk_fill_done_t done) {
+	if (!pending || fill_done != NULL) {
+		return false;
+	}
+	fill_done = done;
+	fill_ms = ms;
+	fill_start = clock_ms();
+	fill_packets = 0;
+	fill_pump();
+	return true;
+}
+
+// Written with response, and authorized so that a write can be turned
+// away while a reply is still going. The value lives in queue_buf, see
+// queue_frame().
+static uint32_t frame_char_add(void) {
+	ble_gatts_char_md_t char_md = { .char_props.write = 1 };
+	ble_uuid_t ble_uuid = { .type = nus.uuid_type, .uuid = BULK_UUID_FRAME_CHAR };
+	ble_gatts_attr_md_t attr_md = { .vloc = BLE_GATTS_VLOC_USER, .wr_auth = 1, .vlen = 1 };
+	ble_gatts_attr_t attr_char_value = {
+		.p_uuid = &ble_uuid,
+		.p_attr_md = &attr_md,
+		.max_len = BULK_MAX_FRAME,
+		.p_value = &queue_buf[BULK_QUEUE_HEADER],
+	};
+
+	BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+	BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+	return sd_ble_gatts_characteristic_add(nus.service_handle, &char_md, &attr_char_value, &frame_handles);
+}
+
+uint32_t bulk_init(bulk_handler_t bulk_handler) {
+	ble_nus_init_t init = { .data_handler = on_data };
+	uint32_t err_code;
+
+	handler = bulk_handler;
+	err_code = ble_nus_init(&nus, &init);
+	if (err_code != NRF_SUCCESS) {
+		return err_code;
+	}
+	return frame_char_add();
+}
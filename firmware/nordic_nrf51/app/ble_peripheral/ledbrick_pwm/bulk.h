@@ -0,0 +1,151 @@
+#ifndef _BULK_H_
+#define _BULK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Framed transfers over the Nordic UART Service (ble_nus.h), for anything
+// too big for one characteristic write. The controller writes without
+// response and replies go out as several notifications per connection
+// event, paced by BLE_EVT_TX_COMPLETE.
+//
+// Every packet starts with a header byte, then up to BULK_PACKET_DATA
+// bytes of the frame:
+//   bits 0-5  sequence number, counted per direction
+//   bit 6     first packet of a frame
+//   bit 7     last packet of a frame
+// A frame is a command (uint8), its body, then a CRC16 of both (uint16
+// LE). Replies carry the command with BULK_REPLY set, then a status
+// (uint8, bulk_status_t), then the body. A sequence gap, overrun or bad
+// CRC drops the frame with BULK_STATUS_BAD_FRAME.
+//
+// With LBS_CAP_LONG_WRITE a frame can instead be written whole to the
+// frame characteristic in the same service, without the packet headers:
+// as one write if it fits, otherwise as a long (prepared) write, queued
+// straight into a block of ours and run from there once executed. The
+// write fails with insufficient resources while the last reply is still
+// going, and the reply comes back over the UART service as before.
+//
+// One link uses the service at a time: the first to subscribe or write
+// to it holds it until it drops, and the others' packets and frame writes
+// are turned away meanwhile, so a second controller or a monitoring
+// client can't cut into a transfer.
+#define BULK_PACKET_LEN 20
+#define BULK_PACKET_DATA (BULK_PACKET_LEN - 1)
+#define BULK_SEQ_MASK 0x3F
+#define BULK_FIRST (1 << 6)
+#define BULK_LAST  (1 << 7)
+#define BULK_REPLY 0x80
+
+// Largest frame either way, command and CRC included
+#define BULK_MAX_FRAME 512
+// Room for a reply body: command, status and CRC around it
+#define BULK_MAX_REPLY (BULK_MAX_FRAME - 4)
+
+// On the UART service's base UUID
+#define BULK_UUID_FRAME_CHAR 0x0004
+// A queued write: handle, offset and length (uint16 LE each), then data.
+// The block holds a largest frame in prepared writes at the default MTU,
+// and the handle ending the queue.
+#define BULK_QUEUE_HEADER 6
+#define BULK_QUEUE_CHUNK (GATT_MTU_SIZE_DEFAULT - 5)
+#define BULK_QUEUE_LEN (BULK_MAX_FRAME + \
+                        CEIL_DIV(BULK_MAX_FRAME, BULK_QUEUE_CHUNK) * BULK_QUEUE_HEADER + 2)
+
+typedef enum {
+	// Body: point count (uint8), channel count (uint8), CRC16 of the points
+	// (uint16 LE), then the points as laid out in schedule.h, and with
+	// LBS_CAP_CROSSFADE optionally a crossfade (uint16 LE seconds). Stores
+	// it as the schedule upload would.
+	BULK_CMD_SCHEDULE = 1,
+	// Reply: the error event log as laid out in error_handlers.h
+	BULK_CMD_EVENTS,
+	// Reply: the crash log as laid out in crash.h
+	BULK_CMD_CRASH,
+	// Body: a command write of any length (ble_lbs.h), acked as usual
+	BULK_CMD_COMMANDS,
+	// Body: scene slot (uint8), channel mask (uint16 LE), fade ms (uint16
+	// LE), then one level (uint16 LE) per set mask bit, lowest channel
+	// first. Programs the slot (scene.h).
+	BULK_CMD_SCENE,
+	// Body: records of a channel (uint8) then its calibration as laid out
+	// in calib.h, stored and applied straight away. An empty body reads
+	// every channel back the same way.
+	BULK_CMD_CALIB,
+	// Reply: per TWI class (twi_queue.h), jobs, failed jobs and bytes on
+	// the wire since boot (uint32 LE each), then the bursts the PCA9685s
+	// have taken (uint32 LE, pca9685.h). Frame bytes over bursts is the
+	// bus cost of a frame. Then the bus recoveries (uint32 LE) and, for
+	// each device seen, its address (uint8) and address NACKs, data
+	// NACKs, overruns and timeouts (uint16 LE each).
+	BULK_CMD_BUS_STATS,
+	// Body: the first history block wanted (uint32 LE). Reply: the
+	// history log from there, as laid out in history.h.
+	BULK_CMD_HISTORY,
+	// Body: records of a channel (uint8) then its rated life in hours
+	// (uint32 LE), empty to leave them be. Reply: every channel's run
+	// hours record as laid out in runhours.h.
+	BULK_CMD_RUN_HOURS,
+	// Reply: the link counters and RSSI as laid out in link_stats.h
+	BULK_CMD_LINK_STATS,
+	// Body: the first record wanted (uint32 LE). Reply: the debug log
+	// from there, as laid out in dlog.h.
+	BULK_CMD_DEBUG_LOG,
+	// Reply: the burn-in summary as laid out in burnin.h
+	BULK_CMD_BURN_IN,
+	// Reply: stack, heap and queue high-water marks as laid out in
+	// mem_stats.h, then the timer wakeups in the last hour and since
+	// boot (uint32 LE each, tick.h), then the CPU time as laid out in
+	// cpu_stats.h
+	BULK_CMD_MEMORY,
+	// Body: auxiliary output records as laid out in aux.h, stored and
+	// applied straight away. An empty body reads every output back the
+	// same way.
+	BULK_CMD_AUX,
+	// Reply: the self benchmark as laid out in bench.h, once it has run
+	BULK_CMD_BENCH,
+	// Reply: the frame stream's counters and frames held, as laid out in
+	// stream.h
+	BULK_CMD_STREAM,
+} bulk_cmd_t;
+
+typedef enum {
+	BULK_STATUS_OK = 0,
+	BULK_STATUS_BAD_FRAME,
+	BULK_STATUS_UNKNOWN,  // Command not supported
+	BULK_STATUS_REJECTED, // Well formed, but the command refused it
+	// From a handler only, never sent: the reply follows through
+	// bulk_complete(), and frames wait until it has
+	BULK_STATUS_PENDING,
+} bulk_status_t;
+
+// Told the filler packets acknowledged and the ms they took
+typedef void (*bulk_fill_done_t)(uint32_t packets, uint32_t ms);
+
+// Runs a complete command frame from the main loop, from the link on
+// conn_handle. Any reply body goes into p_reply (up to BULK_MAX_REPLY)
+// with its length in *p_reply_len.
+typedef bulk_status_t (*bulk_handler_t)(uint16_t conn_handle, uint8_t cmd, uint8_t const * p_body, uint16_t len,
+                                        uint8_t * p_reply, uint16_t * p_reply_len);
+
+// Adds the service, after the SoftDevice is up
+uint32_t bulk_init(bulk_handler_t handler);
+void bulk_on_ble_evt(ble_evt_t * p_ble_evt);
+// The UART service's characteristic handles, tx, rx then the frame
+// characteristic, back to back
+void const * bulk_handles(uint16_t * p_len);
+
+// A reply left pending: its body goes here, up to BULK_MAX_REPLY, then
+// out with bulk_complete(). Completing once the link has dropped, or
+// with nothing pending, is a no-op.
+uint8_t * bulk_reply_body(void);
+void bulk_complete(bulk_status_t status, uint16_t body_len);
+
+// Send filler packets as fast as the SoftDevice takes them, for ms, then
+// call done (from the main loop, early if the link goes). They open no
+// frame, so a controller waiting on a reply drops them. Only while a
+// reply is pending, false otherwise.
+bool bulk_fill(uint32_t ms, bulk_fill_done_t done);
+
+#endif
@@ -0,0 +1,228 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util.h"
+#include "nordic_common.h"
+#include "pca9685.h"
+#include "fade.h"
+#include "calib.h"
+#include "derate.h"
+#include "clock.h"
+#include "tick.h"
+#include "twi_queue.h"
+#include "mcp9808.h"
+#include "fan_monitor.h"
+#include "fan_control.h"
+#include "error_handlers.h"
+#include "burnin.h"
+
+typedef enum {
+	PATTERN_FULL = 0,
+	PATTERN_SWEEP,
+	PATTERN_CHECKER,
+	PATTERN_NOISE,
+	PATTERN_COUNT
+} pattern_t;
+
+#define FULL (PCA9685_COUNTS - 1)
+
+static burnin_state_t state = BURNIN_IDLE;
+static uint8_t failures;
+static uint32_t start_ms;
+static uint32_t duration_ms;
+static uint32_t run_s; // Once finished
+static uint8_t max_rise;
+static int16_t temp_start = MCP9808_TEMP_NONE, temp_peak = MCP9808_TEMP_NONE;
+static uint16_t rpm_start, rpm_max;
+static uint16_t fan_response_s = BURNIN_FAN_NEVER;
+static uint32_t jobs_start, failed_start;
+static uint32_t jobs, failed; // Once finished
+static uint8_t derate_low;
+static uint32_t frames;
+static uint32_t tick_count;
+static uint8_t task = TICK_INVALID;
+
+static void twi_totals(uint32_t * p_jobs, uint32_t * p_failed) {
+	twi_class_stats_t stats;
+
+	*p_jobs = 0;
+	*p_failed = 0;
+	for (uint8_t c = 0; c < TWI_CLASS_COUNT; c++) {
+		twi_queue_stats((twi_class_t)c, &stats);
+		*p_jobs += stats.jobs;
+		*p_failed += stats.failed;
+	}
+}
+
+// Jobs and failed jobs since the start, as of now while running
+static void twi_run(uint32_t * p_jobs, uint32_t * p_failed) {
+	if (state != BURNIN_RUNNING) {
+		*p_jobs = jobs;
+		*p_failed = failed;
+		return;
+	}
+	twi_totals(p_jobs, p_failed);
+	*p_jobs -= jobs_start;
+	*p_failed -= failed_start;
+}
+
+static uint32_t elapsed_s(void) {
+	return (state == BURNIN_RUNNING) ? (clock_ms() - start_ms) / 1000 : run_s;
+}
+
+static uint16_t hash(uint32_t n) {
+	n *= 0x9E3779B1;
+	n ^= n >> 15;
+	n *= 0x846CA68B;
+	return (n >> 16) & FULL;
+}
+
+static uint16_t pattern_duty(pattern_t pattern, uint8_t channel, uint32_t t) {
+	uint32_t phase;
+
+	switch (pattern) {
+	case PATTERN_SWEEP:
+		// A triangle, each channel a step further along
+		phase = (t + channel * BURNIN_SWEEP_MS / FADE_NUM_CHANNELS) % BURNIN_SWEEP_MS;
+		phase = (phase < BURNIN_SWEEP_MS / 2) ? phase : BURNIN_SWEEP_MS - phase;
+		return phase * FULL / (BURNIN_SWEEP_MS / 2);
+	case PATTERN_CHECKER:
+		return ((channel + tick_count) & 1) ? FULL : 0;
+	case PATTERN_NOISE:
+		return hash((tick_count << 4) + channel);
+	default:
+		return FULL;
+	}
+}
+
+static void finish(uint8_t failure) {
+	uint32_t ppm;
+
+	twi_run(&jobs, &failed);
+	run_s = elapsed_s();
+	failures |= failure;
+	ppm = (jobs > 0) ? (uint32_t)((uint64_t)failed * 1000000 / jobs) : 0;
+	if (ppm > BURNIN_TWI_FAIL_PPM) {
+		failures |= BURNIN_FAIL_TWI;
+	}
+	// A fan that never needed to pick up hasn't failed to
+	if ((fan_response_s != BURNIN_FAN_NEVER && fan_response_s > BURNIN_FAN_RESPONSE_S) ||
+	    (fan_response_s == BURNIN_FAN_NEVER && temp_peak != MCP9808_TEMP_NONE && temp_peak > FAN_TARGET_TEMP)) {
+		failures |= BURNIN_FAIL_FAN;
+	}
+	state = failures ? BURNIN_FAILED : BURNIN_PASSED;
+	// Back to whatever the levels are now, fades included
+	fade_refresh();
+}
+
+static void on_tick(void) {
+	uint32_t t;
+	pattern_t pattern;
+
+	if (state != BURNIN_RUNNING) {
+		tick_idle(task);
+		return;
+	}
+	t = clock_ms() - start_ms;
+	if (error_any()) {
+		finish(BURNIN_FAIL_ERROR);
+		return;
+	}
+	if (t >= duration_ms) {
+		finish(0);
+		return;
+	}
+	derate_low = MIN(derate_low, derate_percent());
+	if (derate_low < BURNIN_MIN_DERATE_PCT) {
+		failures |= BURNIN_FAIL_DERATE;
+	}
+
+	pattern = (pattern_t)((t / (BURNIN_PATTERN_S * 1000)) % PATTERN_COUNT);
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		pca9685_set_led(i, 0, derate_apply(i, calib_apply(i, pattern_duty(pattern, i, t))));
+	}
+	pca9685_flush();
+	frames++;
+	tick_count++;
+}
+
+void burnin_init(void) {
+	task = tick_register(on_tick, BURNIN_TICK_MS, 0);
+	tick_idle(task);
+}
+
+bool burnin_start(uint16_t duration_min, uint8_t max_rise_c) {
+	if (duration_min == 0) {
+		if (state == BURNIN_RUNNING) {
+			finish(BURNIN_FAIL_STOPPED);
+		}
+		return true;
+	}
+	if (max_rise_c == 0 || max_rise_c > 100 || error_any()) {
+		return false;
+	}
+	if (state == BURNIN_RUNNING) {
+		finish(BURNIN_FAIL_STOPPED);
+	}
+	failures = 0;
+	start_ms = clock_ms();
+	duration_ms = (uint32_t)duration_min * 60000;
+	max_rise = max_rise_c;
+	temp_start = MCP9808_TEMP_NONE;
+	temp_peak = MCP9808_TEMP_NONE;
+	rpm_start = fantach_rpm();
+	rpm_max = rpm_start;
+	fan_response_s = BURNIN_FAN_NEVER;
+	twi_totals(&jobs_start, &failed_start);
+	derate_low = derate_percent();
+	frames = 0;
+	tick_count = 0;
+	state = BURNIN_RUNNING;
+	tick_wake(task);
+	return true;
+}
+
+bool burnin_active(void) {
+	return state == BURNIN_RUNNING;
+}
+
+void burnin_sample(bool temp_valid, int16_t temp, uint16_t rpm) {
+	if (state != BURNIN_RUNNING) {
+		return;
+	}
+	if (temp_valid) {
+		if (temp_start == MCP9808_TEMP_NONE) {
+			temp_start = temp;
+		}
+		if (temp_peak == MCP9808_TEMP_NONE || temp > temp_peak) {
+			temp_peak = temp;
+		}
+		if (temp_peak - temp_start > MCP9808_DEG(max_rise)) {
+			failures |= BURNIN_FAIL_TEMP;
+		}
+	}
+	rpm_max = MAX(rpm_max, rpm);
+	if (fan_response_s == BURNIN_FAN_NEVER && rpm >= rpm_start + BURNIN_FAN_RISE_RPM) {
+		fan_response_s = MIN(elapsed_s(), BURNIN_FAN_NEVER - 1);
+	}
+}
+
+uint16_t burnin_get(uint8_t * p_data) {
+	uint32_t run_jobs, run_failed;
+
+	twi_run(&run_jobs, &run_failed);
+	p_data[0] = state;
+	p_data[1] = failures;
+	uint32_encode(elapsed_s(), &p_data[2]);
+	uint32_encode(duration_ms / 1000, &p_data[6]);
+	uint16_encode(temp_start, &p_data[10]);
+	uint16_encode(temp_peak, &p_data[12]);
+	p_data[14] = max_rise;
+	uint16_encode(rpm_start, &p_data[15]);
+	uint16_encode(rpm_max, &p_data[17]);
+	uint16_encode(fan_response_s, &p_data[19]);
+	uint32_encode(run_jobs, &p_data[21]);
+	uint32_encode(run_failed, &p_data[25]);
+	p_data[29] = derate_low;
+	uint32_encode(frames, &p_data[30]);
+	return BURNIN_LEN;
+}
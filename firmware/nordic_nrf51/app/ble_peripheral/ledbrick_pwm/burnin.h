@@ -0,0 +1,69 @@
+#ifndef _BURNIN_H_
+#define _BURNIN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Burn-in for qualifying a new brick before it goes out. Every channel is
+// swept through duty patterns with a new frame every tick, so the bus
+// runs as hard as the outputs are ever driven, while the fan loop,
+// foldback and the history log (history.h, the temperature rise curve)
+// carry on as normal. At the end the outputs go back to the levels as set
+// and the summary stays for BULK_CMD_BURN_IN (bulk.h) until the next run.
+#define BURNIN_TICK_MS 20
+// Each pattern runs this long before the next, in turn: everything at
+// full, a ramp sweeping across the channels, alternate channels swapping
+// every tick, and noise
+#define BURNIN_PATTERN_S 60
+#define BURNIN_SWEEP_MS 2000
+
+// Fails beyond these (besides the temperature rise asked for): failed bus
+// jobs per million, any thermal foldback at all, and the fan taking longer
+// than this to pick up by BURNIN_FAN_RISE_RPM over where it started
+#define BURNIN_TWI_FAIL_PPM 100
+#define BURNIN_MIN_DERATE_PCT 100
+#define BURNIN_FAN_RISE_RPM 300
+#define BURNIN_FAN_RESPONSE_S 600
+
+typedef enum {
+	BURNIN_IDLE = 0, // Never run since boot
+	BURNIN_RUNNING,
+	BURNIN_PASSED,
+	BURNIN_FAILED,
+} burnin_state_t;
+
+#define BURNIN_FAIL_TEMP    (1 << 0) // Rose further than allowed
+#define BURNIN_FAIL_TWI     (1 << 1) // Too many failed bus jobs
+#define BURNIN_FAIL_DERATE  (1 << 2) // Foldback cut in
+#define BURNIN_FAIL_FAN     (1 << 3) // Slow to respond, or never did
+#define BURNIN_FAIL_ERROR   (1 << 4) // A fan or temperature error stopped it
+#define BURNIN_FAIL_STOPPED (1 << 5) // Stopped before the end
+
+// Summary, also the bulk format:
+//   0  state (uint8, burnin_state_t)
+//   1  failures (uint8, BURNIN_FAIL_*), so far while running
+//   2  seconds run (uint32 LE) and asked for (uint32 LE)
+//  10  temperature at the start and the highest since (int16 LE each,
+//      1/16 degree C, MCP9808_TEMP_NONE without a reading)
+//  14  allowed rise (uint8, whole degrees C)
+//  15  fan rpm at the start, the highest since (uint16 LE each) and
+//      seconds until it picked up (uint16 LE, 0xFFFF if it hasn't)
+//  21  bus jobs and failed jobs during the run (uint32 LE each)
+//  29  lowest derate percent (uint8)
+//  30  frames sent (uint32 LE)
+#define BURNIN_LEN 34
+#define BURNIN_FAN_NEVER 0xFFFF
+
+// After tick_init()
+void burnin_init(void);
+// Runs for duration_min minutes, failing if the temperature climbs more
+// than max_rise_c over where it started. 0 minutes stops a run. Returns
+// false if out of range or the brick is already in error.
+bool burnin_start(uint16_t duration_min, uint8_t max_rise_c);
+bool burnin_active(void);
+// Call with each temperature reading and fan rpm
+void burnin_sample(bool temp_valid, int16_t temp, uint16_t rpm);
+// Returns the length written, BURNIN_LEN
+uint16_t burnin_get(uint8_t * p_data);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "kv.h"
+#include "calib.h"
+
+STATIC_ASSERT(KV_KEY_CALIB + CALIB_CHANNELS <= KV_MAX_KEYS);
+STATIC_ASSERT(CALIB_RECORD_LEN <= KV_MAX_VALUE);
+
+// 12.4 input span of one segment
+#define SEGMENT_SHIFT 13
+
+// Each channel's record as stored, which kv.h writes from
+static uint8_t stored[CALIB_CHANNELS][CALIB_RECORD_LEN];
+
+// Precomputed per segment: output at its start and its rise over the
+// segment, both 12.4. The curve never falls, so these stay unsigned.
+typedef struct {
+	uint32_t base[CALIB_SEGMENTS];
+	uint32_t rise[CALIB_SEGMENTS];
+} calib_map_t;
+
+static calib_map_t maps[CALIB_CHANNELS];
+static uint16_t identity = 0; // Channels left as they are
+
+static uint8_t * record(uint8_t channel) {
+	return stored[channel];
+}
+
+static void record_default(uint8_t * p_record) {
+	uint16_encode(0, &p_record[0]);
+	uint16_encode(CALIB_FULL, &p_record[2]);
+	for (uint8_t i = 0; i < CALIB_POINTS; i++) {
+		uint16_encode(i * (CALIB_FULL / CALIB_SEGMENTS), &p_record[4 + 2*i]);
+	}
+}
+
+static bool record_valid(uint8_t const * p_record) {
+	uint16_t min = uint16_decode(&p_record[0]);
+	uint16_t max = uint16_decode(&p_record[2]);
+	uint16_t last = 0;
+
+	if (max > CALIB_FULL || min >= max) {
+		return false;
+	}
+	for (uint8_t i = 0; i < CALIB_POINTS; i++) {
+		uint16_t point = uint16_decode(&p_record[4 + 2*i]);
+		if (point > CALIB_FULL || point < last) {
+			return false;
+		}
+		last = point;
+	}
+	return true;
+}
+
+static void precompute(uint8_t channel) {
+	uint8_t const * p_record = record(channel);
+	uint8_t def[CALIB_RECORD_LEN];
+	uint32_t min = uint16_decode(&p_record[0]);
+	uint32_t span = uint16_decode(&p_record[2]) - min;
+	uint32_t out[CALIB_POINTS];
+	calib_map_t * p_map = &maps[channel];
+
+	record_default(def);
+	if (memcmp(p_record, def, CALIB_RECORD_LEN) == 0) {
+		identity |= (1 << channel);
+		return;
+	}
+	identity &= ~(1 << channel);
+
+	// Points in 12.4 after the min/max mapping
+	for (uint8_t i = 0; i < CALIB_POINTS; i++) {
+		out[i] = (min << 4) + ((uint32_t)uint16_decode(&p_record[4 + 2*i]) * span >> 8);
+	}
+	for (uint8_t i = 0; i < CALIB_SEGMENTS; i++) {
+		p_map->base[i] = out[i];
+		p_map->rise[i] = out[i + 1] - out[i];
+	}
+}
+
+bool calib_set(uint8_t channel, uint8_t const * p_record) {
+	if (channel >= CALIB_CHANNELS || !record_valid(p_record)) {
+		return false;
+	}
+	// Controllers program every channel on each connect, only changes
+	// cost a flash write
+	if (memcmp(record(channel), p_record, CALIB_RECORD_LEN) == 0) {
+		return true;
+	}
+	memcpy(record(channel), p_record, CALIB_RECORD_LEN);
+	precompute(channel);
+	// Just this channel's record goes, a failed write still leaves the
+	// calibration in use until the next reset
+	(void)kv_put(KV_KEY_CALIB + channel, record(channel), CALIB_RECORD_LEN);
+	return true;
+}
+
+void calib_get(uint8_t channel, uint8_t * p_record) {
+	memcpy(p_record, record(channel), CALIB_RECORD_LEN);
+}
+
+bool calib_uniform(void) {
+	for (uint8_t i = 1; i < CALIB_CHANNELS; i++) {
+		if (memcmp(record(i), record(0), CALIB_RECORD_LEN) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint16_t calib_max(uint8_t channel) {
+	return uint16_decode(&record(channel)[2]);
+}
+
+uint16_t calib_apply_fine(uint8_t channel, uint16_t duty) {
+	if ((identity & (1 << channel)) || duty == 0) {
+		return duty;
+	}
+	calib_map_t const * p_map = &maps[channel];
+	uint8_t segment = duty >> SEGMENT_SHIFT;
+	uint32_t offset = duty & ((1 << SEGMENT_SHIFT) - 1);
+	uint32_t out = p_map->base[segment] + ((offset * p_map->rise[segment]) >> SEGMENT_SHIFT);
+
+	return (out > 0xFFFF) ? 0xFFFF : out;
+}
+
+uint16_t calib_apply(uint8_t channel, uint16_t duty) {
+	if (identity & (1 << channel)) {
+		return duty;
+	}
+	uint16_t out = calib_apply_fine(channel, duty << 4) >> 4;
+	// Keep the lowest level lit when min_duty is under one code
+	return (duty != 0 && out == 0) ? 1 : MIN(out, PCA9685_COUNTS - 1);
+}
+
+void calib_init(void) {
+	for (uint8_t i = 0; i < CALIB_CHANNELS; i++) {
+		// Never set, or nothing usable
+		if (kv_get(KV_KEY_CALIB + i, record(i), CALIB_RECORD_LEN) != CALIB_RECORD_LEN ||
+		    !record_valid(record(i))) {
+			record_default(record(i));
+		}
+	}
+	for (uint8_t i = 0; i < CALIB_CHANNELS; i++) {
+		precompute(i);
+	}
+}
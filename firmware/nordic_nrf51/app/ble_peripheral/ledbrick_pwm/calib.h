@@ -0,0 +1,47 @@
+#ifndef _CALIB_H_
+#define _CALIB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+
+// Per channel output calibration kept in flash, for strings of different
+// LEDs that don't respond alike. Between the gamma curve and the thermal
+// derate, in the same duty units:
+//   - a linearization curve through CALIB_POINTS evenly spaced points,
+//     0-4096 at duty 0, 512, ... 4096
+//   - the result mapped onto min_duty..max_duty, so the lowest level
+//     still lights and the top is current limited. 0 stays off.
+// Both fold into one multiplier per segment when set, so applying it is
+// a multiply and a shift.
+//
+// Stored a record of CALIB_RECORD_LEN per channel, under KV_KEY_CALIB
+// and on (kv.h):
+//   min duty (uint16 LE), max duty (uint16 LE, 4096 for no limit)
+//   CALIB_POINTS curve points (uint16 LE)
+#define CALIB_CHANNELS PCA9685_NUM_LEDS
+#define CALIB_SEGMENTS 8
+#define CALIB_POINTS (CALIB_SEGMENTS + 1)
+#define CALIB_FULL 4096
+#define CALIB_RECORD_LEN (4 + 2 * CALIB_POINTS)
+
+// Needs kv_init() to have run
+void calib_init(void);
+
+// Set a channel from a record as stored, false if out of range or not
+// rising. Unchanged records don't cost a flash write, changed ones are
+// appended at the next opening (flash_sched.h).
+bool calib_set(uint8_t channel, uint8_t const * p_record);
+// Copy a channel's record out, as stored
+void calib_get(uint8_t channel, uint8_t * p_record);
+
+// True if every channel has the same calibration
+bool calib_uniform(void);
+// A channel's max duty, CALIB_FULL for no limit
+uint16_t calib_max(uint8_t channel);
+
+// Map a 12 bit duty, or a 12.4 one for the dithered path
+uint16_t calib_apply(uint8_t channel, uint16_t duty);
+uint16_t calib_apply_fine(uint8_t channel, uint16_t duty);
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "tick.h"
+#include "clock.h"
+
+#define TICK_HZ APP_TIMER_CLOCK_FREQ // Prescaler 0
+#define SECONDS_PER_DAY 86400UL
+
+static uint32_t last_cnt;
+static uint32_t uptime_s;
+static uint32_t uptime_ticks;
+
+static bool set = false;
+static uint32_t time_s;
+static uint32_t time_ticks;
+static int32_t drift_ppm = 0;
+static int64_t drift_rem = 0; // Correction not yet a whole tick, in ticks * 1e6
+
+// Drift is measured from the first set after sync_uptime, counting every
+// step made since then
+static uint32_t sync_uptime;
+static int64_t stepped_ticks;
+
+static void advance(void) {
+	uint32_t now, dt;
+	int64_t corr;
+
+	// Error events read the uptime from interrupts
+	CRITICAL_REGION_ENTER();
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, last_cnt, &dt);
+	last_cnt = now;
+
+	uptime_ticks += dt;
+	uptime_s += uptime_ticks / TICK_HZ;
+	uptime_ticks %= TICK_HZ;
+
+	// The wall clock runs off the same ticks with the rate trimmed
+	corr = (int64_t)dt * drift_ppm + drift_rem;
+	drift_rem = corr % 1000000;
+	time_ticks += dt + (int32_t)(corr / 1000000);
+	time_s += time_ticks / TICK_HZ;
+	time_ticks %= TICK_HZ;
+	CRITICAL_REGION_EXIT();
+}
+
+void clock_set(uint32_t time, uint8_t fraction) {
+	uint32_t new_ticks = ((uint32_t)fraction * TICK_HZ) >> 8;
+
+	advance();
+	if (set) {
+		uint32_t elapsed = uptime_s - sync_uptime;
+
+		// How far behind the clock had fallen, positive if it runs slow
+		stepped_ticks += ((int64_t)time - time_s) * TICK_HZ + new_ticks - time_ticks;
+		if (elapsed >= CLOCK_DRIFT_MIN_S) {
+			// Only move halfway, the set itself is off by the link latency
+			drift_ppm += (stepped_ticks * 1000000 / ((int64_t)elapsed * TICK_HZ)) / 2;
+			if (drift_ppm > CLOCK_DRIFT_MAX_PPM) drift_ppm = CLOCK_DRIFT_MAX_PPM;
+			if (drift_ppm < -CLOCK_DRIFT_MAX_PPM) drift_ppm = -CLOCK_DRIFT_MAX_PPM;
+			sync_uptime = uptime_s;
+			stepped_ticks = 0;
+		}
+	} else {
+		sync_uptime = uptime_s;
+		stepped_ticks = 0;
+	}
+
+	time_s = time;
+	time_ticks = new_ticks;
+	drift_rem = 0;
+	set = true;
+}
+
+bool clock_is_set(void) {
+	return set;
+}
+
+uint32_t clock_time(void) {
+	advance();
+	return time_s;
+}
+
+uint32_t clock_time_of_day(void) {
+	return clock_time() % SECONDS_PER_DAY;
+}
+
+uint32_t clock_uptime(void) {
+	advance();
+	return uptime_s;
+}
+
+uint32_t clock_ms(void) {
+	uint32_t ms;
+
+	advance();
+	CRITICAL_REGION_ENTER();
+	ms = uptime_s * 1000 + (uptime_ticks * 1000) / TICK_HZ;
+	CRITICAL_REGION_EXIT();
+	return ms;
+}
+
+int16_t clock_drift_ppm(void) {
+	return drift_ppm;
+}
+
+void clock_init(void) {
+	app_timer_cnt_get(&last_cnt);
+	tick_register(advance, CLOCK_UPDATE_MS, 0);
+}
@@ -0,0 +1,36 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Wall clock and uptime from the RTC1 counter app_timer already runs.
+// Time is local, as seconds since 1970-01-01 with no zone applied, so the
+// time of day is just time % 86400. Every set after the first also
+// trims the rate, so the clock holds between syncs.
+
+// How often the counter is folded into the clock, inside the 512 s the
+// 24 bit RTC takes to wrap
+#define CLOCK_UPDATE_MS 60000
+// Sets closer together than this only step the clock, the rate is
+// measured over at least this long
+#define CLOCK_DRIFT_MIN_S 3600
+#define CLOCK_DRIFT_MAX_PPM 500
+
+void clock_init(void);
+
+// fraction is in 1/256 s, like the Current Time Service
+void clock_set(uint32_t time, uint8_t fraction);
+bool clock_is_set(void);
+
+uint32_t clock_time(void);
+uint32_t clock_time_of_day(void);
+// Safe from interrupts
+uint32_t clock_uptime(void);
+// Uptime in ms, wrapping every 49 days. The time base synchronized
+// actions are scheduled in, the controller tracks each brick's offset.
+uint32_t clock_ms(void);
+// Rate correction in use, positive when the RTC runs slow
+int16_t clock_drift_ppm(void);
+
+#endif
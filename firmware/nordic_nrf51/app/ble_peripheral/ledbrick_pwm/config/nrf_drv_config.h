@@ -40,7 +40,7 @@
 #define TIMER0_INSTANCE_INDEX      0
 #endif
 
-#define TIMER1_ENABLED 0
+#define TIMER1_ENABLED 1
 
 #if (TIMER1_ENABLED == 1)
 #define TIMER1_CONFIG_FREQUENCY    NRF_TIMER_FREQ_16MHz
@@ -113,9 +113,9 @@
 #define TWI1_ENABLED 1
 
 #if (TWI1_ENABLED == 1)
-#define TWI1_CONFIG_FREQUENCY NRF_TWI_FREQ_250K
-#define TWI1_CONFIG_SCL          0
-#define TWI1_CONFIG_SDA          1
+#define TWI1_CONFIG_FREQUENCY    NRF_TWI_FREQ_100K
+#define TWI1_CONFIG_SCL          30
+#define TWI1_CONFIG_SDA          0
 #define TWI1_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_LOW
 
 #define TWI1_INSTANCE_INDEX      (TWI0_ENABLED)
@@ -150,11 +150,11 @@
 #endif
 
 /* WDT */
-#define WDT_ENABLED 0
+#define WDT_ENABLED 1
 
 #if (WDT_ENABLED == 1)
 #define WDT_CONFIG_BEHAVIOUR     NRF_WDT_BEHAVIOUR_RUN_SLEEP
-#define WDT_CONFIG_RELOAD_VALUE  2000
+#define WDT_CONFIG_RELOAD_VALUE  15000
 #define WDT_CONFIG_IRQ_PRIORITY  APP_IRQ_PRIORITY_HIGH
 #endif
 
@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include "nrf.h"
+#include "ledbrick_flash.h"
 
 static __INLINE uint16_t pstorage_flash_page_size()
 {
@@ -40,9 +41,9 @@ static __INLINE uint32_t pstorage_flash_page_end()
 
 #define PSTORAGE_FLASH_PAGE_END pstorage_flash_page_end()
 
-#define PSTORAGE_NUM_OF_PAGES       2                                                           /**< Number of flash pages allocated for the pstorage module excluding the swap page, configurable based on system requirements. */
+#define PSTORAGE_NUM_OF_PAGES       LEDBRICK_PSTORAGE_PAGES                                     /**< Number of flash pages allocated for the pstorage module excluding the swap page, configurable based on system requirements. Laid out in ledbrick_flash.h, which the bootloader keeps them by. */
 
-#define PSTORAGE_MAX_APPLICATIONS   1                                                           /**< Maximum number of applications that can be registered with the module, configurable based on system requirements. */
+#define PSTORAGE_MAX_APPLICATIONS   (7 + (HISTORY_FLASH_PAGES > 0))                             /**< Maximum number of applications that can be registered with the module, configurable based on system requirements. Journal (4 pages), device manager, schedule, scenes and auxiliary outputs (a page each), the config store (2 pages, kv.h), run hours, and the history log when it has flash (history.h). */
 #define PSTORAGE_MIN_BLOCK_SIZE     0x0010                                                      /**< Minimum size of block that can be registered with the module. Should be configured based on system requirements, recommendation is not have this value to be at least size of word. */
 
 #define PSTORAGE_DATA_START_ADDR    ((PSTORAGE_FLASH_PAGE_END - PSTORAGE_NUM_OF_PAGES - 1) \
@@ -51,7 +52,9 @@ static __INLINE uint32_t pstorage_flash_page_end()
 #define PSTORAGE_SWAP_ADDR          PSTORAGE_DATA_END_ADDR                                      /**< Top-most page is used as swap area for clear and update. */
 
 #define PSTORAGE_MAX_BLOCK_SIZE     PSTORAGE_FLASH_PAGE_SIZE                                    /**< Maximum size of block that can be registered with the module. Should be configured based on system requirements. And should be greater than or equal to the minimum size. */
-#define PSTORAGE_CMD_QUEUE_SIZE     10                                                          /**< Maximum number of flash access commands that can be maintained by the module for all applications. Configurable. */
+#ifndef PSTORAGE_CMD_QUEUE_SIZE
+#define PSTORAGE_CMD_QUEUE_SIZE     13                                                          /**< Maximum number of flash access commands that can be maintained by the module for all applications. Configurable. Held app work goes in one batch (flash_sched.h): a clear and a store each for the journal, run hours and history, an update each for the schedule, scenes and auxiliary outputs, one write at a time from the config store, and room for the device manager. */
+#endif
 
 
 /** Abstracts persistently memory block identifier. */
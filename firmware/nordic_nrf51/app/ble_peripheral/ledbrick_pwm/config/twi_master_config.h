@@ -12,7 +12,9 @@
 #ifndef TWI_MASTER_CONFIG
 #define TWI_MASTER_CONFIG
 
-#define TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER (30U)
-#define TWI_MASTER_CONFIG_DATA_PIN_NUMBER (0U)
+#include "board_profile.h"
+
+#define TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER (BOARD_PIN_SCL)
+#define TWI_MASTER_CONFIG_DATA_PIN_NUMBER (BOARD_PIN_SDA)
 
 #endif
@@ -0,0 +1,160 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_util.h"
+#include "ble_srv_common.h"
+#include "ble_conn_params.h"
+#include "conn_profile.h"
+
+static const ble_gap_conn_params_t profiles[CONN_PROFILE_COUNT] = {
+	[CONN_PROFILE_BURST] = {
+		.min_conn_interval = MSEC_TO_UNITS(CONN_PROFILE_BURST_MIN_MS, UNIT_1_25_MS),
+		.max_conn_interval = MSEC_TO_UNITS(CONN_PROFILE_BURST_MAX_MS, UNIT_1_25_MS),
+		.slave_latency     = CONN_PROFILE_BURST_LATENCY,
+		.conn_sup_timeout  = MSEC_TO_UNITS(CONN_PROFILE_BURST_TIMEOUT_MS, UNIT_10_MS),
+	},
+	[CONN_PROFILE_IDLE] = {
+		.min_conn_interval = MSEC_TO_UNITS(CONN_PROFILE_IDLE_MIN_MS, UNIT_1_25_MS),
+		.max_conn_interval = MSEC_TO_UNITS(CONN_PROFILE_IDLE_MAX_MS, UNIT_1_25_MS),
+		.slave_latency     = CONN_PROFILE_IDLE_LATENCY,
+		.conn_sup_timeout  = MSEC_TO_UNITS(CONN_PROFILE_IDLE_TIMEOUT_MS, UNIT_10_MS),
+	},
+};
+
+static uint16_t opt_in_handle;
+// The first link up, as ble_conn_params has it, when there are several
+static uint16_t conn_handle = BLE_CONN_HANDLE_INVALID;
+static ble_gap_conn_params_t conn_params;
+static ble_gap_conn_params_t default_params;
+
+static bool opted_in = false;
+static bool failed = false;
+static bool forced = false;
+static conn_profile_t current = CONN_PROFILE_AUTO;
+static uint8_t idle_polls = 0;
+
+static void apply(conn_profile_t profile) {
+	ble_gap_conn_params_t params = profiles[profile];
+
+	if (profile == current) {
+		return;
+	}
+	current = profile;
+	if (conn_handle == BLE_CONN_HANDLE_INVALID || !opted_in || failed) {
+		return;
+	}
+	// Busy means an update is already on the air, the module retries
+	// towards the newest preferred parameters once it completes
+	(void)ble_conn_params_change_conn_params(&params);
+}
+
+static void link_reset(void) {
+	opted_in = false;
+	failed = false;
+	forced = false;
+	current = CONN_PROFILE_AUTO;
+	idle_polls = 0;
+	// Don't leave a profile in the PPCP for the next central to read
+	(void)sd_ble_gap_ppcp_set(&default_params);
+}
+
+void conn_profile_request(conn_profile_t profile) {
+	if (profile >= CONN_PROFILE_COUNT) {
+		return;
+	}
+	forced = (profile != CONN_PROFILE_AUTO);
+	if (forced) {
+		apply(profile);
+	} else {
+		idle_polls = CONN_PROFILE_IDLE_POLLS;
+		apply(CONN_PROFILE_BURST);
+	}
+}
+
+void conn_profile_activity(void) {
+	if (forced) {
+		return;
+	}
+	idle_polls = CONN_PROFILE_IDLE_POLLS;
+	apply(CONN_PROFILE_BURST);
+}
+
+void conn_profile_poll(void) {
+	if (forced || current != CONN_PROFILE_BURST) {
+		return;
+	}
+	if (idle_polls > 0 && --idle_polls == 0) {
+		apply(CONN_PROFILE_IDLE);
+	}
+}
+
+void conn_profile_failed(void) {
+	failed = true;
+}
+
+conn_profile_t conn_profile_current(void) {
+	return current;
+}
+
+bool conn_profile_forced(void) {
+	return forced;
+}
+
+void conn_profile_params(ble_gap_conn_params_t * p_params) {
+	*p_params = conn_params;
+}
+
+static void on_opt_in(bool enabled) {
+	conn_profile_t profile = current;
+
+	opted_in = enabled;
+	if (!enabled) {
+		return;
+	}
+	// Start busy, the central is still setting up the link
+	current = CONN_PROFILE_AUTO;
+	if (forced) {
+		apply(profile);
+	} else {
+		conn_profile_activity();
+	}
+}
+
+void conn_profile_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gatts_evt_write_t * p_write;
+
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_CONNECTED:
+		if (conn_handle == BLE_CONN_HANDLE_INVALID) {
+			conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+			conn_params = p_ble_evt->evt.gap_evt.params.connected.conn_params;
+		}
+		break;
+	case BLE_GAP_EVT_DISCONNECTED:
+		if (p_ble_evt->evt.gap_evt.conn_handle == conn_handle) {
+			conn_handle = BLE_CONN_HANDLE_INVALID;
+			link_reset();
+		}
+		break;
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+		if (p_ble_evt->evt.gap_evt.conn_handle == conn_handle) {
+			conn_params = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+		}
+		break;
+	case BLE_GATTS_EVT_WRITE:
+		p_write = &p_ble_evt->evt.gatts_evt.params.write;
+		if (p_write->handle == opt_in_handle && p_write->len == 2 &&
+		    p_ble_evt->evt.gatts_evt.conn_handle == conn_handle) {
+			on_opt_in(ble_srv_is_notification_enabled(p_write->data));
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void conn_profile_init(uint16_t opt_in_cccd_handle) {
+	opt_in_handle = opt_in_cccd_handle;
+	(void)sd_ble_gap_ppcp_get(&default_params);
+	memset(&conn_params, 0, sizeof(conn_params));
+}
@@ -0,0 +1,53 @@
+#ifndef _CONN_PROFILE_H_
+#define _CONN_PROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_gap.h"
+
+// Connection parameter profiles. A link starts on whatever the central
+// chose (the PPCP set in gap_params_init() is only a hint) and nothing is
+// requested until the central opts in by enabling notifications on the
+// opt-in CCCD. Centrals that never answer L2CAP parameter update requests
+// get dropped by the SoftDevice when a request times out, so silence is
+// the only safe default.
+typedef enum {
+	CONN_PROFILE_AUTO = 0, // Firmware picks burst or idle from activity
+	CONN_PROFILE_BURST,    // Short interval for transitions and transfers
+	CONN_PROFILE_IDLE,     // Long interval plus slave latency
+	CONN_PROFILE_COUNT
+} conn_profile_t;
+
+#define CONN_PROFILE_BURST_MIN_MS 10
+#define CONN_PROFILE_BURST_MAX_MS 30
+#define CONN_PROFILE_BURST_LATENCY 0
+#define CONN_PROFILE_BURST_TIMEOUT_MS 4000
+
+#define CONN_PROFILE_IDLE_MIN_MS 500
+#define CONN_PROFILE_IDLE_MAX_MS 1000
+#define CONN_PROFILE_IDLE_LATENCY 4
+#define CONN_PROFILE_IDLE_TIMEOUT_MS 12000
+
+// Polls without activity before auto drops back to idle
+#define CONN_PROFILE_IDLE_POLLS 2
+
+void conn_profile_init(uint16_t opt_in_cccd_handle);
+void conn_profile_on_ble_evt(ble_evt_t * p_ble_evt);
+
+// Force a profile, or hand control back to the firmware with AUTO
+void conn_profile_request(conn_profile_t profile);
+// Something is changing or streaming, go to burst when in auto
+void conn_profile_activity(void);
+// Call on every poll to time out of burst
+void conn_profile_poll(void);
+// The central didn't accept the parameters, stop asking on this link
+void conn_profile_failed(void);
+
+// Profile last asked for, AUTO if none yet
+conn_profile_t conn_profile_current(void);
+bool conn_profile_forced(void);
+// Parameters the link is actually running with
+void conn_profile_params(ble_gap_conn_params_t * p_params);
+
+#endif
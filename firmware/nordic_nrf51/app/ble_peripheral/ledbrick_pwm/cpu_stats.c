@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <string.h>
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "cpu_stats.h"
+
+#define WINDOW_TICKS APP_TIMER_TICKS(CPU_WINDOW_MS, 0)
+
+// Every tick given to a category, ever, so a region can tell how much
+// of its time went to what it interrupted or ran
+static volatile uint32_t accounted;
+static uint32_t ticks[CPU_COUNT];
+static uint32_t window_start;
+static uint32_t last[CPU_COUNT];
+static uint32_t last_window;
+static uint16_t peak_busy;
+
+cpu_mark_t cpu_begin(void) {
+	cpu_mark_t mark;
+
+	CRITICAL_REGION_ENTER();
+	app_timer_cnt_get(&mark.start);
+	mark.accounted = accounted;
+	CRITICAL_REGION_EXIT();
+	return mark;
+}
+
+void cpu_end(cpu_category_t category, cpu_mark_t mark) {
+	uint32_t now, elapsed, nested;
+
+	CRITICAL_REGION_ENTER();
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, mark.start, &elapsed);
+	nested = accounted - mark.accounted;
+	// A nested handler can come out a tick over what held it
+	if (elapsed > nested) {
+		ticks[category] += elapsed - nested;
+		accounted += elapsed - nested;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+void cpu_roll(void) {
+	uint32_t now, elapsed;
+	uint16_t busy;
+
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, window_start, &elapsed);
+	if (elapsed < WINDOW_TICKS) {
+		return;
+	}
+	CRITICAL_REGION_ENTER();
+	memcpy(last, ticks, sizeof(last));
+	memset(ticks, 0, sizeof(ticks));
+	CRITICAL_REGION_EXIT();
+	window_start = now;
+	last_window = elapsed;
+
+	busy = last[CPU_SLEEP] >= elapsed ? 0 : (uint64_t)(elapsed - last[CPU_SLEEP]) * 10000 / elapsed;
+	if (busy > peak_busy) {
+		peak_busy = busy;
+	}
+}
+
+uint16_t cpu_stats_get(uint8_t * p_data) {
+	uint16_t len = uint32_encode(last_window, p_data);
+
+	for (uint8_t c = 0; c < CPU_COUNT; c++) {
+		len += uint32_encode(last[c], &p_data[len]);
+	}
+	len += uint16_encode(peak_busy, &p_data[len]);
+	return len;
+}
@@ -0,0 +1,50 @@
+#ifndef _CPU_STATS_H_
+#define _CPU_STATS_H_
+
+#include <stdint.h>
+
+// Where the CPU's time goes, for the headroom left before more engines
+// share the core (BULK_CMD_MEMORY, bulk.h). Timed off the RTC1 counter
+// app_timer already runs, like latency.h, so it costs two counter reads
+// a handler. A tick is 30.5 us, longer than many handlers take, but a
+// handler lands at a random phase of it, so the ticks counted over many
+// come out in proportion to their time.
+//
+// Time is exclusive: a handler taking an interrupt, or the scheduler
+// running a BLE event, gives the nested time to what ran inside, so the
+// categories add up. The SoftDevice's own interrupts aren't seen and
+// count towards whatever they cut into, sleep mostly.
+typedef enum {
+	CPU_BLE = 0, // BLE and SoC events, from the scheduler
+	CPU_TIMER,   // Shared tick tasks (tick.h)
+	CPU_TWI,     // TWI interrupts, job callbacks included
+	CPU_SCHED,   // Every other scheduler event
+	CPU_SLEEP,   // In sd_app_evt_wait()
+	CPU_COUNT
+} cpu_category_t;
+
+// Totals roll over once a window, read from polled_event_update() at
+// least every 512 s so the 24-bit counter can't wrap unseen
+#define CPU_WINDOW_MS 60000
+
+// Reply: the last full window's length in ticks (uint32 LE), its ticks
+// per category in cpu_category_t order (uint32 LE each), then the
+// busiest window since boot, 1/100 percent awake (uint16 LE). What the
+// categories leave of the window ran uncounted, mostly the main loop.
+#define CPU_STATS_LEN (4 + 4 * CPU_COUNT + 2)
+
+typedef struct {
+	uint32_t start;
+	uint32_t accounted;
+} cpu_mark_t;
+
+// Around anything timed. Safe from interrupts.
+cpu_mark_t cpu_begin(void);
+void cpu_end(cpu_category_t category, cpu_mark_t mark);
+
+// From the main context, closes the window once it's long enough
+void cpu_roll(void);
+// Returns the length written, CPU_STATS_LEN
+uint16_t cpu_stats_get(uint8_t * p_data);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "nrf.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "clock.h"
+#include "retained.h"
+#include "crash.h"
+
+#define LOG_MAGIC 0x43524153
+
+typedef struct {
+	uint32_t error;
+	uint16_t line;
+	uint16_t file_hash;
+	uint32_t pc;
+	uint32_t lr;
+	uint32_t uptime;
+} crash_record_t;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t total;
+	uint8_t next; // Slot the next record goes in
+	crash_record_t records[CRASH_LOG_LEN];
+	uint16_t crc;
+} crash_log_t;
+
+static crash_log_t m_log RETAINED;
+
+static uint16_t log_crc(void) {
+	return crc16_compute((uint8_t const *)&m_log, offsetof(crash_log_t, crc), NULL);
+}
+
+static void log_reset(void) {
+	memset(&m_log, 0, sizeof(m_log));
+	m_log.magic = LOG_MAGIC;
+	m_log.crc = log_crc();
+}
+
+static void log_add(uint32_t error, uint32_t line, uint8_t const * p_file,
+                    uint32_t pc, uint32_t lr) {
+	crash_record_t * p_rec = &m_log.records[m_log.next];
+
+	p_rec->error = error;
+	p_rec->line = line;
+	p_rec->file_hash = p_file ? crc16_compute(p_file, strlen((char const *)p_file), NULL) : 0;
+	p_rec->pc = pc;
+	p_rec->lr = lr;
+	p_rec->uptime = clock_uptime();
+	m_log.next = (m_log.next + 1) % CRASH_LOG_LEN;
+	if (m_log.total < UINT16_MAX) {
+		m_log.total++;
+	}
+	m_log.crc = log_crc();
+}
+
+void crash_reset(uint32_t error, uint32_t line, uint8_t const * p_file,
+                 uint32_t pc, uint32_t lr) {
+	log_add(error, line, p_file, pc, lr);
+	NVIC_SystemReset();
+	for (;;);
+}
+
+#if defined(__GNUC__)
+void crash_hardfault(uint32_t const * p_frame) {
+	// Exception frame: r0-r3, r12, lr, pc, xpsr
+	crash_reset(CRASH_HARDFAULT, 0, NULL, p_frame[6], p_frame[5]);
+}
+
+// Find the exception frame on whichever stack was in use and hand it on
+void HardFault_Handler(void) __attribute__((naked));
+void HardFault_Handler(void) {
+	__asm volatile(
+		"	movs r0, #4\n"
+		"	mov r1, lr\n"
+		"	tst r0, r1\n"
+		"	beq 1f\n"
+		"	mrs r0, psp\n"
+		"	b 2f\n"
+		"1:	mrs r0, msp\n"
+		"2:	ldr r1, =crash_hardfault\n"
+		"	bx r1\n"
+	);
+}
+#endif
+
+void crash_init(void) {
+	if (!retained_ram_kept() || m_log.magic != LOG_MAGIC ||
+	    m_log.next >= CRASH_LOG_LEN || m_log.crc != log_crc()) {
+		log_reset();
+	}
+	if (retained_reset_reason() & POWER_RESETREAS_DOG_Msk) {
+		log_add(CRASH_WATCHDOG, 0, NULL, 0, 0);
+	}
+}
+
+uint16_t crash_log_get(uint8_t * p_data) {
+	uint16_t len = 2;
+	uint8_t count = (m_log.total < CRASH_LOG_LEN) ? m_log.total : CRASH_LOG_LEN;
+
+	uint16_encode(m_log.total, p_data);
+	for (uint8_t i = 1; i <= count; i++) {
+		crash_record_t const * p_rec = &m_log.records[(m_log.next + CRASH_LOG_LEN - i) % CRASH_LOG_LEN];
+		uint8_t * p = &p_data[len];
+
+		uint32_encode(p_rec->error, &p[0]);
+		uint16_encode(p_rec->line, &p[4]);
+		uint16_encode(p_rec->file_hash, &p[6]);
+		uint32_encode(p_rec->pc, &p[8]);
+		uint32_encode(p_rec->lr, &p[12]);
+		uint32_encode(p_rec->uptime, &p[16]);
+		len += CRASH_RECORD_LEN;
+	}
+	return len;
+}
+
+void crash_log_clear(void) {
+	log_reset();
+}
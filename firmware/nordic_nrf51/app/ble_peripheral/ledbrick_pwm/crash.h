@@ -0,0 +1,38 @@
+#ifndef _CRASH_H_
+#define _CRASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Post-mortem records kept in retained RAM across the reset that follows
+// a fault, newest first.
+#define CRASH_LOG_LEN 4
+
+// Error codes for records that don't come from app_error_handler()
+#define CRASH_HARDFAULT 0xFA000001
+#define CRASH_WATCHDOG  0xFA000002 // Found at boot, PC, LR and uptime unknown
+
+// Record layout, also the GATT format:
+//   0  error code (uint32 LE)
+//   4  line (uint16 LE, 0 in builds without DEBUG)
+//   6  CRC16 of the file name (uint16 LE, 0 without DEBUG)
+//   8  PC (uint32 LE), the failing call site or the faulting instruction
+//  12  LR (uint32 LE), 0 for app errors
+//  16  uptime in seconds (uint32 LE)
+#define CRASH_RECORD_LEN 20
+// Total crashes since power on (uint16 LE), then up to CRASH_LOG_LEN
+// records. Counts above CRASH_LOG_LEN mean older records were lost.
+#define CRASH_LOG_MAX_LEN (2 + CRASH_LOG_LEN * CRASH_RECORD_LEN)
+
+// After retained_init(). Adds a record for a watchdog reset.
+void crash_init(void);
+
+// Record an error and reset, never returns
+void crash_reset(uint32_t error, uint32_t line, uint8_t const * p_file,
+                 uint32_t pc, uint32_t lr) __attribute__((noreturn));
+
+// Returns the length written
+uint16_t crash_log_get(uint8_t * p_data);
+void crash_log_clear(void);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+#include "calib.h"
+#include "derate.h"
+
+#ifndef BOARD_LED_TEMPCO
+#define BOARD_LED_TEMPCO { 0 }
+#endif
+
+#define PPM 1000000L
+
+static int16_t band_start;
+static int16_t band_end;
+static uint16_t factor_min;
+static volatile uint16_t factor = DERATE_ONE;
+// Heatsink alone, and the remote inputs
+static uint16_t board_factor = DERATE_ONE;
+static uint16_t tank_factor = DERATE_ONE;
+static uint16_t ambient_factor = DERATE_ONE;
+
+static const uint16_t tempco[DERATE_CHANNELS] = BOARD_LED_TEMPCO;
+// Compensation gain at the last reading, and it times the derate
+static uint16_t comp[DERATE_CHANNELS];
+static volatile uint16_t channel_factor[DERATE_CHANNELS];
+
+static uint16_t pct_factor(uint8_t pct) {
+	return ((uint32_t)pct << DERATE_SHIFT) / 100;
+}
+
+void derate_set_band(int16_t start, int16_t end, uint8_t min_pct) {
+	if (end <= start || min_pct > 100) return;
+	band_start = start;
+	band_end = end;
+	factor_min = pct_factor(min_pct);
+}
+
+// Gain making up a channel's loss at a whole degree, the inverse of the
+// output left: 1 / (1 - tempco * degrees above DERATE_COMP_REF)
+static uint16_t comp_gain(uint8_t channel, int16_t degrees) {
+	int32_t loss = (int32_t)tempco[channel] * (degrees - (DERATE_COMP_REF >> MCP9808_FRAC_BITS));
+	if (loss >= PPM / 2) {
+		return DERATE_COMP_MAX;
+	}
+	uint32_t gain = ((uint32_t)DERATE_ONE * PPM) / (uint32_t)(PPM - loss);
+	return MAX(MIN(gain, DERATE_COMP_MAX), DERATE_COMP_MIN);
+}
+
+// Straight down from full at start to min at end, and held there above
+static uint16_t band_factor(int32_t value, int32_t start, int32_t end, uint16_t min) {
+	if (value <= start) {
+		return DERATE_ONE;
+	}
+	if (value >= end) {
+		return min;
+	}
+	// Integer interpolation across the band
+	return DERATE_ONE - ((uint32_t)(DERATE_ONE - min) * (uint32_t)(value - start)) / (uint32_t)(end - start);
+}
+
+static bool fold(void) {
+	bool changed = false;
+	uint32_t remote = ((uint32_t)tank_factor * ambient_factor) >> DERATE_SHIFT;
+	factor = ((uint32_t)board_factor * remote) >> DERATE_SHIFT;
+	for (uint8_t i = 0; i < DERATE_CHANNELS; i++) {
+		uint16_t next = ((uint32_t)factor * comp[i]) >> DERATE_SHIFT;
+		if (next != channel_factor[i]) {
+			channel_factor[i] = next;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool derate_update(int16_t temp) {
+	board_factor = band_factor(temp, band_start, band_end, factor_min);
+
+	// Arithmetic shift floors, so -0.5 degrees is taken as -1
+	int16_t degrees = temp >> MCP9808_FRAC_BITS;
+	for (uint8_t i = 0; i < DERATE_CHANNELS; i++) {
+		comp[i] = tempco[i] != 0 ? comp_gain(i, degrees) : DERATE_ONE;
+	}
+	return fold();
+}
+
+bool derate_update_tank(int16_t temp, bool valid) {
+	tank_factor = valid ? band_factor(temp, DERATE_TANK_START, DERATE_TANK_END,
+	                                  pct_factor(DERATE_TANK_MIN_PCT)) : DERATE_ONE;
+	return fold();
+}
+
+bool derate_update_ambient(uint32_t lux, bool valid) {
+	// Past the band holds at its end, which also keeps the span in range
+	lux = MIN(lux, DERATE_AMBIENT_END_LUX);
+	ambient_factor = valid ? band_factor(lux, DERATE_AMBIENT_START_LUX, DERATE_AMBIENT_END_LUX,
+	                                     pct_factor(DERATE_AMBIENT_MIN_PCT)) : DERATE_ONE;
+	return fold();
+}
+
+uint16_t derate_factor(void) {
+	return factor;
+}
+
+uint8_t derate_percent(void) {
+	return ((uint32_t)factor * 100 + DERATE_ONE / 2) >> DERATE_SHIFT;
+}
+
+bool derate_uniform(void) {
+	for (uint8_t i = 1; i < DERATE_CHANNELS; i++) {
+		if (channel_factor[i] != channel_factor[0]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// A channel raised past its calibrated maximum would run over the
+// string's current limit
+uint16_t derate_apply(uint8_t channel, uint16_t level) {
+	uint16_t f = channel_factor[channel];
+	uint32_t out = ((uint32_t)level * f) >> DERATE_SHIFT;
+	if (f > DERATE_ONE) {
+		out = MIN(out, MIN(calib_max(channel), PCA9685_COUNTS - 1));
+	}
+	return out;
+}
+
+uint16_t derate_apply_fine(uint8_t channel, uint16_t level) {
+	uint16_t f = channel_factor[channel];
+	uint32_t out = ((uint32_t)level * f) >> DERATE_SHIFT;
+	if (f > DERATE_ONE) {
+		out = MIN(out, MIN((uint32_t)calib_max(channel) << 4, 0xFFFF));
+	}
+	return out;
+}
+
+void derate_init(void) {
+	derate_set_band(DERATE_DEFAULT_START, DERATE_DEFAULT_END, DERATE_DEFAULT_MIN_PCT);
+	board_factor = tank_factor = ambient_factor = DERATE_ONE;
+	for (uint8_t i = 0; i < DERATE_CHANNELS; i++) {
+		comp[i] = DERATE_ONE;
+	}
+	(void)fold();
+}
@@ -0,0 +1,67 @@
+#ifndef _DERATE_H_
+#define _DERATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcp9808.h"
+#include "pca9685.h"
+
+// Factor is fixed point, DERATE_ONE is full output
+#define DERATE_SHIFT 10
+#define DERATE_ONE (1 << DERATE_SHIFT)
+
+// Output scales linearly from full at start down to min_pct at end,
+// and holds there above it. The hard cutoff stays above the band.
+#define DERATE_DEFAULT_START MCP9808_DEG(50)
+#define DERATE_DEFAULT_END MCP9808_DEG(62)
+#define DERATE_DEFAULT_MIN_PCT 25
+
+// Feedforward for the light LEDs lose as they heat, which differs by
+// colour so a brick also shifts hue: each channel's duty is raised by
+// the inverse of its string's loss at the reading, from the board's
+// coefficients (BOARD_LED_TEMPCO, ppm of output lost per degree above
+// DERATE_COMP_REF), up to DERATE_COMP_MAX and never past the channel's
+// calibrated maximum (calib.h). The gains are worked out on each
+// reading, on whole degrees so sensor noise doesn't rewrite the outputs,
+// and folded into one factor per channel with the derate, so the output
+// stage still multiplies once.
+#define DERATE_CHANNELS PCA9685_NUM_LEDS
+#define DERATE_COMP_REF MCP9808_DEG(25)
+#define DERATE_COMP_MAX (DERATE_ONE * 5 / 4)
+#define DERATE_COMP_MIN (DERATE_ONE * 3 / 4)
+
+// Inputs from sensors off the board (remote_sensor.h), each a factor of
+// its own multiplied in with the heatsink's: the tank's water above its
+// band folds the light back to stop it heating the tank further, and
+// daylight coming in dims it across the ambient band. Full output while
+// there's no reading.
+#define DERATE_TANK_START MCP9808_DEG(28)
+#define DERATE_TANK_END MCP9808_DEG(31)
+#define DERATE_TANK_MIN_PCT 40
+#define DERATE_AMBIENT_START_LUX 500
+#define DERATE_AMBIENT_END_LUX 5000
+#define DERATE_AMBIENT_MIN_PCT 30
+
+void derate_init(void);
+void derate_set_band(int16_t start, int16_t end, uint8_t min_pct);
+
+// Feed a new reading. Returns true if any channel's factor changed.
+bool derate_update(int16_t temp);
+// Feed a remote reading, valid false once there's none. Returns true if
+// any channel's factor changed.
+bool derate_update_tank(int16_t temp, bool valid);
+bool derate_update_ambient(uint32_t lux, bool valid);
+
+// The derate and remote inputs together, without the compensation
+uint16_t derate_factor(void);
+// Factor as 0-100, for reporting
+uint8_t derate_percent(void);
+
+// True if every channel has the same factor
+bool derate_uniform(void);
+// Scale a 12 bit duty by the channel's factor, or a 12.4 one for the
+// dithered path, clamped to full scale
+uint16_t derate_apply(uint8_t channel, uint16_t level);
+uint16_t derate_apply_fine(uint8_t channel, uint16_t level);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "clock.h"
+#include "dlog.h"
+
+#if DLOG_ENABLED
+
+typedef struct {
+	uint32_t ms;
+	uint8_t id;
+	uint8_t a;
+	uint16_t b;
+} record_t;
+
+// head is a free running sequence number, the next record's
+static record_t records[DLOG_LEN];
+static uint32_t head = 0;
+
+void dlog(dlog_id_t id, uint8_t a, uint16_t b) {
+	uint32_t ms = clock_ms();
+
+	CRITICAL_REGION_ENTER();
+	record_t * p_rec = &records[head % DLOG_LEN];
+	p_rec->ms = ms;
+	p_rec->id = id;
+	p_rec->a = a;
+	p_rec->b = b;
+	head++;
+	CRITICAL_REGION_EXIT();
+}
+
+bool dlog_read(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+	uint16_t out = DLOG_HEADER_LEN;
+	uint32_t s, oldest;
+
+	if (len < 4) {
+		return false;
+	}
+	s = uint32_decode(p_body);
+
+	CRITICAL_REGION_ENTER();
+	oldest = (head > DLOG_LEN) ? head - DLOG_LEN : 0;
+	if (s > head || s < oldest) {
+		// From before a reset, or already written over
+		s = oldest;
+	}
+	uint32_encode(s, &p_reply[0]);
+	for (; s != head; s++) {
+		record_t const * p_rec = &records[s % DLOG_LEN];
+		uint32_encode(p_rec->ms, &p_reply[out]);
+		p_reply[out + 4] = p_rec->id;
+		p_reply[out + 5] = p_rec->a;
+		uint16_encode(p_rec->b, &p_reply[out + 6]);
+		out += DLOG_RECORD_LEN;
+	}
+	CRITICAL_REGION_EXIT();
+	*p_reply_len = out;
+	return true;
+}
+
+#endif
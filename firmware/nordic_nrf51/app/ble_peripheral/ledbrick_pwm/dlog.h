@@ -0,0 +1,55 @@
+#ifndef _DLOG_H_
+#define _DLOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Debug log in place of printf: fixed size records of an ID and two
+// arguments, kept in a RAM ring and read over BULK_CMD_DEBUG_LOG (bulk.h).
+// The controller turns the IDs back into text, so no format strings or
+// formatting code go into the image.
+#ifndef DLOG_ENABLED
+#define DLOG_ENABLED 1
+#endif
+
+#define DLOG_LEN 32 // Power of two
+
+// Append only, so the controller's names for these stay valid
+typedef enum {
+	DLOG_BOOT = 1,        // a: RESETREAS bits 0-7, b: bits 16-19
+	DLOG_CONNECTED,       // a: links now, b: interval in 1.25 ms units
+	DLOG_DISCONNECTED,    // a: BLE_HCI_* reason, b: links left
+	DLOG_TWI_FAILED,      // a: class (twi_queue.h), b: 7 bit address
+	DLOG_SUPPLY_SHED,     // b: supply in mV
+	DLOG_SUPPLY_RESTORED, // b: supply in mV
+	DLOG_LEASE_LAPSED,    // a: fallback scene, b: 1 if the schedule took over
+} dlog_id_t;
+
+// Record layout, also the bulk format:
+//   0  milliseconds since boot (uint32 LE)
+//   4  id (uint8, dlog_id_t)
+//   5  a (uint8)
+//   6  b (uint16 LE)
+#define DLOG_RECORD_LEN 8
+// Read body: the first sequence number wanted (uint32 LE). Reply: the
+// sequence number of the first record given (uint32 LE), then records
+// oldest first. Past what was asked for means the ring wrapped first.
+#define DLOG_HEADER_LEN 4
+#define DLOG_MAX_LEN (DLOG_HEADER_LEN + DLOG_LEN * DLOG_RECORD_LEN)
+
+#if DLOG_ENABLED
+
+// Safe from interrupts
+void dlog(dlog_id_t id, uint8_t a, uint16_t b);
+bool dlog_read(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len);
+
+#else
+
+static inline void dlog(dlog_id_t id, uint8_t a, uint16_t b) { }
+static inline bool dlog_read(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+	return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "pca9685.h"
+#include "fade.h"
+#include "calib.h"
+#include "derate.h"
+#include "clock.h"
+#include "tick.h"
+#include "effect.h"
+
+// Noise streams, so clouds and lightning don't repeat each other
+#define SALT_CLOUD 0x00000000
+#define SALT_DETAIL 0x6C8E9CF5
+#define SALT_STRIKE 0xB5297A4D
+
+// Noise below this much cover is clear sky, so clouds come and go
+// rather than the light always wavering
+#define CLEAR_COVER 96
+
+// Flashes in a strike, how long each lights and the gap between them
+#define FLASHES_MAX 3
+#define FLASH_MIN_MS 40
+#define FLASH_SPREAD_MS 60
+#define GAP_MIN_MS 60
+#define GAP_SPREAD_MS 90
+
+static effect_allowed_t allowed;
+static effect_kind_t kind = EFFECT_OFF;
+static uint32_t seed;
+static uint32_t start_ms;
+static uint32_t duration_ms;
+static uint8_t depth;
+static uint32_t period_ms;
+static uint32_t strike_mean_ms;
+
+// Strikes are numbered from the start. The next one, or the flash or gap
+// running in the current one, ends at phase_ms.
+static uint32_t strike;
+static uint8_t flashes_left;
+static bool flash_on;
+static uint32_t phase_ms;
+// Whether this flash went out, it doesn't when it's over before a tick
+// sees it or while lightning isn't allowed
+static bool lit = false;
+static uint8_t task = TICK_INVALID;
+
+static uint32_t hash(uint32_t salt, uint32_t n) {
+	uint32_t x = (seed ^ salt) * 0x9E3779B1 + n;
+
+	x ^= x >> 16;
+	x *= 0x7FEB352D;
+	x ^= x >> 15;
+	x *= 0x846CA68B;
+	x ^= x >> 16;
+	return x;
+}
+
+// Value noise, 0-255: a random value every period, eased between
+static uint32_t noise(uint32_t salt, uint32_t t, uint32_t period) {
+	uint32_t k = t / period;
+	uint32_t f = ((t % period) << 8) / period;
+	int32_t a = hash(salt, k) & 0xFF;
+	int32_t b = hash(salt, k + 1) & 0xFF;
+
+	f = (f * f * (3 * 256 - 2 * f)) >> 16; // Smoothstep
+	return a + (((b - a) * (int32_t)f) >> 8);
+}
+
+static bool clouds(uint32_t t) {
+	uint32_t cover = (2 * noise(SALT_CLOUD, t, period_ms) +
+	                  noise(SALT_DETAIL, t, period_ms / 4 + 1)) / 3;
+
+	cover = (cover > CLEAR_COVER) ? (cover - CLEAR_COVER) * 255 / (255 - CLEAR_COVER) : 0;
+	return pca9685_modulate(PCA9685_DIM_FULL - (depth * cover) / 255);
+}
+
+static void light(bool on) {
+	if (!on) {
+		if (lit) {
+			// Back to whatever the levels are now, fades included
+			lit = false;
+			fade_refresh();
+		}
+		return;
+	}
+	lit = true;
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		pca9685_set_led(i, 0, derate_apply(i, calib_apply(i, PCA9685_COUNTS - 1)));
+	}
+	pca9685_flush();
+}
+
+// Strikes land uniformly between a fifth and 1.8 times the mean apart
+static uint32_t strike_gap(uint32_t n) {
+	return strike_mean_ms / 5 + hash(SALT_STRIKE, 2 * n) % (strike_mean_ms * 8 / 5);
+}
+
+// Phases run back to back from when they were due, not when a tick saw
+// them, so bricks ticking out of step still flash together
+static void lightning(uint32_t t) {
+	uint32_t h;
+
+	while (strike_mean_ms != 0 && t >= phase_ms) {
+		h = hash(SALT_STRIKE, 2 * strike + 1);
+		if (flash_on) {
+			flash_on = false;
+			light(false);
+			if (--flashes_left > 0) {
+				phase_ms += GAP_MIN_MS + (h >> 8) % GAP_SPREAD_MS;
+			} else {
+				strike++;
+				phase_ms += strike_gap(strike);
+			}
+		} else {
+			if (flashes_left == 0) {
+				flashes_left = 1 + h % FLASHES_MAX;
+			}
+			phase_ms += FLASH_MIN_MS + (h >> (8 * flashes_left)) % FLASH_SPREAD_MS;
+			flash_on = true;
+			if (t < phase_ms && (allowed == NULL || allowed())) {
+				light(true);
+			}
+		}
+	}
+}
+
+static void on_tick(void) {
+	uint32_t t;
+
+	if (kind == EFFECT_OFF) {
+		tick_idle(task);
+		return;
+	}
+	t = clock_ms() - start_ms;
+	if (duration_ms != 0 && t >= duration_ms) {
+		effect_stop();
+		return;
+	}
+	(void)clouds(t);
+	if (kind == EFFECT_STORM) {
+		lightning(t);
+	}
+}
+
+void effect_init(effect_allowed_t on_allowed) {
+	allowed = on_allowed;
+	task = tick_register(on_tick, EFFECT_TICK_MS, 0);
+	tick_idle(task);
+}
+
+bool effect_start(effect_kind_t new_kind, uint16_t new_seed, uint8_t depth_pct, uint8_t period_s,
+                  uint8_t strikes_per_min, uint16_t duration_s) {
+	if (new_kind >= EFFECT_COUNT) {
+		return false;
+	}
+	if (new_kind == EFFECT_OFF) {
+		effect_stop();
+		return true;
+	}
+	if (depth_pct > PCA9685_DIM_FULL || period_s == 0 || strikes_per_min > EFFECT_STRIKES_MAX) {
+		return false;
+	}
+	effect_stop();
+	seed = new_seed;
+	depth = depth_pct;
+	period_ms = (uint32_t)period_s * 1000;
+	duration_ms = (uint32_t)duration_s * 1000;
+	strike_mean_ms = (new_kind == EFFECT_STORM && strikes_per_min > 0) ? 60000 / strikes_per_min : 0;
+	strike = 0;
+	flashes_left = 0;
+	flash_on = false;
+	phase_ms = strike_mean_ms ? strike_gap(0) : 0;
+	start_ms = clock_ms();
+	// The dimmer has to be there for clouds to pass
+	if (depth > 0 && !pca9685_modulate(PCA9685_DIM_FULL - 1)) {
+		return false;
+	}
+	(void)clouds(0);
+	kind = new_kind;
+	tick_wake(task);
+	return true;
+}
+
+void effect_stop(void) {
+	if (kind == EFFECT_OFF) {
+		return;
+	}
+	kind = EFFECT_OFF;
+	flash_on = false;
+	light(false);
+	(void)pca9685_modulate(PCA9685_DIM_FULL);
+}
+
+bool effect_active(void) {
+	return kind != EFFECT_OFF;
+}
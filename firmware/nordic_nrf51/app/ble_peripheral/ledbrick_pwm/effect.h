@@ -0,0 +1,42 @@
+#ifndef _EFFECT_H_
+#define _EFFECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Weather run on the brick, faster than levels can be written over the
+// link. Clouds pass over as seeded value noise scaling the master
+// dimmer's OE switching (pca9685_modulate()), so they cost no bus
+// traffic; a storm adds lightning, bursts of flashes taking every
+// channel to its calibrated full for a few tens of ms. Everything is
+// worked out from the seed and the ms since the start, so bricks
+// started with one seed at one moment (LBS_CMD_OP_AT, ble_lbs.h) run
+// the same weather together.
+typedef enum {
+	EFFECT_OFF = 0,
+	EFFECT_CLOUDS,
+	EFFECT_STORM,  // Clouds and lightning
+	EFFECT_COUNT
+} effect_kind_t;
+
+#define EFFECT_TICK_MS 20
+#define EFFECT_STRIKES_MAX 60 // Per minute
+
+// Lightning is held off while this says no, for the error handling to
+// keep the outputs dark
+typedef bool (*effect_allowed_t)(void);
+
+// After tick_init()
+void effect_init(effect_allowed_t allowed);
+
+// depth_pct is how far the thickest cloud dims the outputs and period_s
+// about how long one takes to pass, strikes_per_min how often lightning
+// strikes on average in a storm. Runs for duration_s, 0 for until
+// stopped. Returns false if out of range.
+bool effect_start(effect_kind_t kind, uint16_t seed, uint8_t depth_pct, uint8_t period_s,
+                  uint8_t strikes_per_min, uint16_t duration_s);
+// Back to the levels as set
+void effect_stop(void);
+bool effect_active(void);
+
+#endif
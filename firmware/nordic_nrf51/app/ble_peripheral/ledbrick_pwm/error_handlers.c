@@ -1,31 +1,99 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <nrf_gpio.h>
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "clock.h"
 #include "error_handlers.h"
-#include <app_timer.h>
+#include "tick.h"
+#include "board_profile.h"
 
-#define PIN_ERRORLED 12
+#define PIN_ERRORLED BOARD_PIN_ERRORLED
 
-static int errors = 0;
-static int errors_last = 0;
-static app_timer_id_t timer;
+typedef struct {
+	uint32_t uptime;
+	uint8_t error;
+	uint8_t kind;
+	int16_t value;
+} error_event_t;
+
+static volatile uint8_t errors = 0;
+static volatile uint8_t errors_last = 0;
+
+static uint16_t onsets[ERROR_COUNT];
+static uint32_t started[ERROR_COUNT];
+
+// Written from any context, read and acked from the main loop. head and
+// tail are free running sequence numbers.
+static error_event_t events[ERROR_EVENTS_LEN];
+static uint32_t events_head = 0;
+static uint32_t events_tail = 0;
+static volatile bool events_changed = false;
+
+// The M0 has no exclusive loads and stores, so claiming a slot masks
+// interrupts for the few instructions the copy takes
+static void event_add(error_e error, uint8_t kind, int16_t value) {
+	CRITICAL_REGION_ENTER();
+	error_event_t * p_evt = &events[events_head % ERROR_EVENTS_LEN];
+	p_evt->uptime = clock_uptime();
+	p_evt->error = error;
+	p_evt->kind = kind;
+	p_evt->value = value;
+	events_head++;
+	if (events_head - events_tail > ERROR_EVENTS_LEN) {
+		// Full, the oldest goes
+		events_tail = events_head - ERROR_EVENTS_LEN;
+	}
+	events_changed = true;
+	CRITICAL_REGION_EXIT();
+}
 
 static void on_update(void) {
+#if BOARD_PIN_FITTED(PIN_ERRORLED)
 	if (errors) {
 		nrf_gpio_pin_clear(PIN_ERRORLED);
 	}
+#endif
 }
 
-static void on_timer(void* ctx) {
+static void on_tick(void) {
+	uint8_t cleared;
+
+#if BOARD_PIN_FITTED(PIN_ERRORLED)
 	if (errors == 0 && errors_last == 0)
 		nrf_gpio_pin_set(PIN_ERRORLED);
+#endif
+
+	CRITICAL_REGION_ENTER();
+	cleared = errors_last & ~errors;
 	errors_last = errors;
 	errors = 0;
+	CRITICAL_REGION_EXIT();
+
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		if (cleared & (1 << i)) {
+			uint32_t lasted = clock_uptime() - started[i];
+			event_add((error_e)i, ERROR_EVENT_CLEARED, (lasted > INT16_MAX) ? INT16_MAX : lasted);
+		}
+	}
 }
 
 
-void error_raise(error_e error) {
+void error_raise(error_e error, int16_t value) {
+	bool onset;
+
+	CRITICAL_REGION_ENTER();
+	onset = !((errors | errors_last) & (1 << error));
 	errors |= (1 << error);
+	if (onset) {
+		if (onsets[error] < UINT16_MAX) onsets[error]++;
+		started[error] = clock_uptime();
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (onset) {
+		event_add(error, ERROR_EVENT_RAISED, value);
+	}
 	on_update();
 }
 
@@ -34,11 +102,59 @@ bool error_present(error_e error) {
 }
 
 bool error_any(void) {
-	return errors != 0 || errors_last != 0;
+	return ((errors | errors_last) & ~ERROR_WARNINGS) != 0;
+}
+
+uint8_t error_bits(void) {
+	return errors | errors_last;
+}
+
+uint16_t error_log_get(uint8_t * p_data) {
+	uint16_t len = ERROR_LOG_HEADER_LEN;
+	uint32_t head, tail;
+
+	CRITICAL_REGION_ENTER();
+	head = events_head;
+	tail = events_tail;
+	uint32_encode(tail, &p_data[0]);
+	for (uint8_t i = 0; i < ERROR_COUNT; i++) {
+		uint16_encode(onsets[i], &p_data[4 + 2*i]);
+	}
+	for (uint32_t seq = tail; seq != head; seq++) {
+		error_event_t const * p_evt = &events[seq % ERROR_EVENTS_LEN];
+		uint32_encode(p_evt->uptime, &p_data[len]);
+		p_data[len + 4] = p_evt->error;
+		p_data[len + 5] = p_evt->kind;
+		uint16_encode(p_evt->value, &p_data[len + 6]);
+		len += ERROR_EVENT_LEN;
+	}
+	CRITICAL_REGION_EXIT();
+	return len;
+}
+
+void error_log_ack(uint32_t seq) {
+	CRITICAL_REGION_ENTER();
+	// Only ever forward, and no further than what has been logged
+	if ((int32_t)(seq - events_tail) > 0 && (int32_t)(events_head - seq) >= 0) {
+		events_tail = seq;
+		events_changed = true;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+bool error_log_changed(void) {
+	bool changed;
+
+	CRITICAL_REGION_ENTER();
+	changed = events_changed;
+	events_changed = false;
+	CRITICAL_REGION_EXIT();
+	return changed;
 }
 
 void error_init(void) {
+#if BOARD_PIN_FITTED(PIN_ERRORLED)
 	nrf_gpio_pin_dir_set(PIN_ERRORLED, NRF_GPIO_PIN_DIR_OUTPUT);
-	app_timer_create(&timer, APP_TIMER_MODE_REPEATED, on_timer);
-	app_timer_start(timer, APP_TIMER_TICKS(5000, 0), NULL);
+#endif
+	tick_register(on_tick, 5000, 0);
 }
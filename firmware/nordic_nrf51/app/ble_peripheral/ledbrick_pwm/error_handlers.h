@@ -1,17 +1,54 @@
 #ifndef _ERROR_HANDLERS_H_
 #define _ERROR_HANDLERS_H_
 
+#include <stdint.h>
 #include <stdbool.h>
 
 typedef enum {
 	ERROR_FAN = 0,
-	ERROR_TEMP = 1
+	ERROR_TEMP = 1,
+	ERROR_FAN_WEAR = 2, // A warning (fan_wear.h)
+	ERROR_COUNT
 } error_e;
 
-void error_raise(error_e error);
+// Warnings are reported and logged like errors but leave the outputs
+// running: error_any() doesn't count them
+#define ERROR_WARNINGS (1 << ERROR_FAN_WEAR)
+
+// An error stays present for 5-10 s after the last raise. Each time one
+// starts or clears an event goes into a ring for the controller to drain.
+#define ERROR_EVENTS_LEN 32 // Power of two
+#define ERROR_EVENT_RAISED  1
+#define ERROR_EVENT_CLEARED 2
+
+// Event layout, also the GATT format:
+//   0  uptime in seconds (uint32 LE)
+//   4  error (uint8, error_e)
+//   5  kind (uint8, ERROR_EVENT_*)
+//   6  value (int16 LE), what was passed to error_raise() for the onset,
+//      how long the error lasted in seconds for the clear
+#define ERROR_EVENT_LEN 8
+// Log as read: sequence number of the first event (uint32 LE), onsets
+// per error since boot (uint16 LE each), then events oldest first. A
+// gap in the sequence means the ring wrapped before it was drained.
+#define ERROR_LOG_HEADER_LEN (4 + 2 * ERROR_COUNT)
+#define ERROR_LOG_MAX_LEN (ERROR_LOG_HEADER_LEN + ERROR_EVENTS_LEN * ERROR_EVENT_LEN)
+
+// Safe from interrupts. value is kept with the onset event.
+void error_raise(error_e error, int16_t value);
 bool error_present(error_e error);
+// Any error but a warning
 bool error_any(void);
+// Bitmask of errors raised this period or the last, (1 << error_e)
+uint8_t error_bits(void);
 void error_init(void);
 
+// Returns the length written
+uint16_t error_log_get(uint8_t * p_data);
+// Drop every event before seq, once the controller has it
+void error_log_ack(uint32_t seq);
+// True once after events have been added or dropped
+bool error_log_changed(void);
+
 
 #endif
@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "app_scheduler.h"
+#include "radio_idle.h"
+#include "esb_rx.h"
+
+// Packets move from the timeslot callback (priority 0, where no sd_*
+// call is allowed) to main context through this ring, one producer and
+// one consumer. SWI1 is the hop in between that may use the scheduler.
+#define QUEUE_LEN 8 // Power of two
+
+typedef struct {
+	uint8_t len;
+	uint8_t data[ESB_RX_MAX_PAYLOAD];
+} packet_t;
+
+// Radio buffer: length field, S1 (PID and no-ack), payload
+typedef struct {
+	uint8_t len;
+	uint8_t s1;
+	uint8_t data[ESB_RX_MAX_PAYLOAD];
+} radio_packet_t;
+
+static packet_t queue[QUEUE_LEN];
+static volatile uint8_t queue_head;
+static volatile uint8_t queue_tail;
+// SWI1 pended for the queue, and not (only) a radio notification
+static volatile bool swi_pended;
+
+static radio_packet_t rx_packet;
+static uint8_t rf_channel;
+static uint32_t base0;
+static uint32_t prefix0;
+static esb_rx_handler_t rx_handler;
+static esb_rx_stats_t stats;
+
+static nrf_radio_signal_callback_return_param_t signal_return;
+
+static nrf_radio_request_t earliest_request = {
+	.request_type = NRF_RADIO_REQ_TYPE_EARLIEST,
+	.params.earliest = {
+		.hfclk = NRF_RADIO_HFCLK_CFG_FORCE_XTAL,
+		.priority = NRF_RADIO_PRIORITY_NORMAL,
+		.length_us = ESB_RX_SLOT_US,
+		.timeout_us = NRF_RADIO_EARLIEST_TIMEOUT_MAX_US,
+	},
+};
+
+static nrf_radio_request_t next_request = {
+	.request_type = NRF_RADIO_REQ_TYPE_NORMAL,
+	.params.normal = {
+		.hfclk = NRF_RADIO_HFCLK_CFG_FORCE_XTAL,
+		.priority = NRF_RADIO_PRIORITY_NORMAL,
+		.distance_us = ESB_RX_PERIOD_US,
+		.length_us = ESB_RX_SLOT_US,
+	},
+};
+
+// ESB addresses go out most significant bit first, the radio sends
+// each byte least significant bit first
+static uint32_t bit_swap(uint32_t v) {
+	v = ((v & 0xF0F0F0F0) >> 4) | ((v & 0x0F0F0F0F) << 4);
+	v = ((v & 0xCCCCCCCC) >> 2) | ((v & 0x33333333) << 2);
+	return ((v & 0xAAAAAAAA) >> 1) | ((v & 0x55555555) << 1);
+}
+
+static void radio_start(void) {
+	NRF_RADIO->POWER = 1;
+	NRF_RADIO->MODE = RADIO_MODE_MODE_Nrf_2Mbit << RADIO_MODE_MODE_Pos;
+	NRF_RADIO->FREQUENCY = rf_channel;
+	NRF_RADIO->PCNF0 = (6 << RADIO_PCNF0_LFLEN_Pos) | (3 << RADIO_PCNF0_S1LEN_Pos);
+	NRF_RADIO->PCNF1 = (RADIO_PCNF1_WHITEEN_Disabled << RADIO_PCNF1_WHITEEN_Pos) |
+	                   (RADIO_PCNF1_ENDIAN_Big << RADIO_PCNF1_ENDIAN_Pos) |
+	                   ((ESB_RX_ADDRESS_LEN - 1) << RADIO_PCNF1_BALEN_Pos) |
+	                   (ESB_RX_MAX_PAYLOAD << RADIO_PCNF1_MAXLEN_Pos);
+	NRF_RADIO->BASE0 = base0;
+	NRF_RADIO->PREFIX0 = prefix0;
+	NRF_RADIO->RXADDRESSES = 1;
+	NRF_RADIO->CRCCNF = RADIO_CRCCNF_LEN_Two << RADIO_CRCCNF_LEN_Pos;
+	NRF_RADIO->CRCINIT = 0xFFFF;
+	NRF_RADIO->CRCPOLY = 0x11021;
+	NRF_RADIO->PACKETPTR = (uint32_t)&rx_packet;
+
+	NRF_RADIO->SHORTS = RADIO_SHORTS_READY_START_Msk;
+	NRF_RADIO->EVENTS_END = 0;
+	NRF_RADIO->INTENSET = RADIO_INTENSET_END_Msk;
+	NVIC_EnableIRQ(RADIO_IRQn);
+	NRF_RADIO->TASKS_RXEN = 1;
+}
+
+static void radio_stop(void) {
+	NRF_RADIO->INTENCLR = 0xFFFFFFFF;
+	NVIC_DisableIRQ(RADIO_IRQn);
+	NRF_RADIO->SHORTS = 0;
+	NRF_RADIO->TASKS_DISABLE = 1;
+}
+
+static void on_radio_end(void) {
+	NRF_RADIO->EVENTS_END = 0;
+	if (NRF_RADIO->CRCSTATUS && rx_packet.len <= ESB_RX_MAX_PAYLOAD) {
+		uint8_t head = queue_head;
+		if ((uint8_t)(head - queue_tail) < QUEUE_LEN) {
+			packet_t * p_packet = &queue[head & (QUEUE_LEN - 1)];
+			p_packet->len = rx_packet.len;
+			memcpy(p_packet->data, rx_packet.data, rx_packet.len);
+			queue_head = head + 1;
+			swi_pended = true;
+			NVIC_SetPendingIRQ(SWI1_IRQn);
+		} else {
+			stats.dropped++;
+		}
+	}
+	NRF_RADIO->TASKS_START = 1;
+}
+
+static nrf_radio_signal_callback_return_param_t * on_signal(uint8_t signal_type) {
+	signal_return.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_NONE;
+
+	switch (signal_type) {
+	case NRF_RADIO_CALLBACK_SIGNAL_TYPE_START:
+		stats.slots++;
+		// TIMER0 runs at 1 MHz from the start of the timeslot
+		NRF_TIMER0->CC[0] = ESB_RX_SLOT_US - ESB_RX_MARGIN_US;
+		NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+		NRF_TIMER0->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+		NVIC_EnableIRQ(TIMER0_IRQn);
+		radio_start();
+		break;
+	case NRF_RADIO_CALLBACK_SIGNAL_TYPE_RADIO:
+		if (NRF_RADIO->EVENTS_END) {
+			on_radio_end();
+		}
+		break;
+	case NRF_RADIO_CALLBACK_SIGNAL_TYPE_TIMER0:
+		NRF_TIMER0->EVENTS_COMPARE[0] = 0;
+		NRF_TIMER0->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+		radio_stop();
+		signal_return.callback_action = NRF_RADIO_SIGNAL_CALLBACK_ACTION_REQUEST_AND_END;
+		signal_return.params.request.p_next = &next_request;
+		break;
+	default:
+		break;
+	}
+	return &signal_return;
+}
+
+static void drain(void * p_event_data, uint16_t event_size) {
+	while (queue_tail != queue_head) {
+		packet_t * p_packet = &queue[queue_tail & (QUEUE_LEN - 1)];
+		stats.received++;
+		rx_handler(p_packet->data, p_packet->len);
+		queue_tail++;
+	}
+}
+
+// Also the radio notification IRQ. One landing on a pend of ours is
+// lost, and radio_idle.h counts on from the one before.
+void SWI1_IRQHandler(void) {
+	if (swi_pended) {
+		swi_pended = false;
+		(void)app_sched_event_put(NULL, 0, drain);
+	} else {
+		radio_idle_on_notification();
+	}
+}
+
+static void request_earliest(void) {
+	if (sd_radio_request(&earliest_request) != NRF_SUCCESS) {
+		stats.blocked++;
+	}
+}
+
+void esb_rx_on_sys_evt(uint32_t sys_evt) {
+	if (rx_handler == NULL) {
+		return;
+	}
+	switch (sys_evt) {
+	case NRF_EVT_RADIO_BLOCKED:
+	case NRF_EVT_RADIO_CANCELED:
+		// A BLE event or a flash operation had the radio, start over
+		stats.blocked++;
+		request_earliest();
+		break;
+	case NRF_EVT_RADIO_SESSION_IDLE:
+		request_earliest();
+		break;
+	default:
+		break;
+	}
+}
+
+void esb_rx_stats(esb_rx_stats_t * p_stats) {
+	*p_stats = stats;
+}
+
+bool esb_rx_init(uint8_t channel, uint8_t const * p_address, esb_rx_handler_t handler) {
+	rf_channel = channel;
+	prefix0 = bit_swap(p_address[0]);
+	base0 = __REV(bit_swap(uint32_decode(&p_address[1])));
+	memset(&stats, 0, sizeof(stats));
+	queue_head = queue_tail = 0;
+
+	if (sd_nvic_SetPriority(SWI1_IRQn, APP_IRQ_PRIORITY_LOW) != NRF_SUCCESS ||
+	    sd_nvic_EnableIRQ(SWI1_IRQn) != NRF_SUCCESS ||
+	    sd_radio_session_open(on_signal) != NRF_SUCCESS) {
+		return false;
+	}
+	rx_handler = handler;
+	if (sd_radio_request(&earliest_request) != NRF_SUCCESS) {
+		rx_handler = NULL;
+		(void)sd_radio_session_close();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,43 @@
+#ifndef _ESB_RX_H_
+#define _ESB_RX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Side channel from a controller dongle over Enhanced ShockBurst, for
+// updates faster than the connection interval allows. The radio is
+// borrowed from the SoftDevice in timeslots; BLE stays for everything
+// else. Receive only: the dongle sends every packet as no-ack (so any
+// number of bricks can listen) and repeats it, and the payload is a
+// broadcast.h frame or scene recall with its group, sequence and MAC.
+//
+// On air this is ESB with dynamic payload length at 2 Mbit, what a
+// stock nRF24L01+ or nrf_esb PTX sends with no-ack set.
+#define ESB_RX_ADDRESS_LEN 5
+#define ESB_RX_MAX_PAYLOAD 32
+
+// Listen for ESB_RX_SLOT_US out of every ESB_RX_PERIOD_US. The gap
+// left over fits a flash page erase, so pstorage isn't starved; the
+// dongle repeats each packet for at least a period.
+#define ESB_RX_SLOT_US 30000
+#define ESB_RX_PERIOD_US 55000
+// Radio off this long before the timeslot ends
+#define ESB_RX_MARGIN_US 1000
+
+// Called in main context with each payload received with a good CRC
+typedef void (*esb_rx_handler_t)(uint8_t const * p_data, uint8_t len);
+
+typedef struct {
+	uint32_t slots;
+	uint32_t received;
+	uint32_t dropped;   // Queue full, main context too far behind
+	uint32_t blocked;   // Timeslot requests the SoftDevice turned down
+} esb_rx_stats_t;
+
+// channel is the RF channel (2400 + channel MHz), p_address the
+// pipe address, prefix byte first
+bool esb_rx_init(uint8_t channel, uint8_t const * p_address, esb_rx_handler_t handler);
+void esb_rx_on_sys_evt(uint32_t sys_evt);
+void esb_rx_stats(esb_rx_stats_t * p_stats);
+
+#endif
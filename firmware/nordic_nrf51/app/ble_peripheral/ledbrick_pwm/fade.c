@@ -0,0 +1,331 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "pca9685.h"
+#include "gamma.h"
+#include "derate.h"
+#include "calib.h"
+#include "runhours.h"
+#include "tick.h"
+#include "fade.h"
+
+// Levels are kept in 16.16 fixed point so slow ramps still advance
+// every tick without any floating point. They're linear, the gamma
+// curve and thermal derate and compensation (derate.h) are only applied
+// on the way out to the PCA9685, along with the channel's calibration
+// and the lumen maintenance gain for its age (runhours.h), before
+// calibration so the calibrated maximum still caps it.
+typedef struct {
+	uint32_t level;
+	int32_t step;
+	uint16_t ticks_left;
+	uint16_t target;
+} fade_channel_t;
+
+#define DITHER_SHIFT (4 - FADE_DITHER_BITS)
+#define DITHER_ONE (1 << FADE_DITHER_BITS)
+
+static fade_channel_t channels[FADE_NUM_CHANNELS];
+// Per channel slew limit, as the rate and its 16.16 per tick step
+static uint16_t slew_rate[FADE_NUM_CHANNELS];
+static uint32_t slew_step[FADE_NUM_CHANNELS];
+static uint16_t slewed = 0;  // Channels with a limit
+static uint16_t active = 0; // Bitmask of channels with a fade running
+static bool timer_running = false;
+static app_timer_id_t timer;
+
+// Back frame, see fade_stage()
+static uint16_t staged = 0;
+static uint16_t staged_levels[FADE_NUM_CHANNELS];
+static uint16_t staged_duration_ms = 0;
+
+static uint16_t dither = 0;   // Channels dithered
+static uint16_t between = 0;  // Dithered channels sitting between codes
+static uint8_t dither_error[FADE_NUM_CHANNELS];
+static bool dither_running = false;
+static app_timer_id_t dither_timer;
+
+// First order: the fraction builds up each output and the code steps up
+// once it passes one, so the average lands on the fraction
+static uint16_t dithered(uint8_t channel) {
+	uint16_t fine = derate_apply_fine(channel, calib_apply_fine(channel, runhours_apply_fine(channel, gamma_apply_fine(channel, channels[channel].level))));
+	uint16_t code = fine >> 4;
+	uint8_t frac = (fine >> DITHER_SHIFT) & (DITHER_ONE - 1);
+
+	if (frac == 0) {
+		between &= ~(1 << channel);
+		return code;
+	}
+	between |= (1 << channel);
+	dither_error[channel] += frac;
+	if (dither_error[channel] >= DITHER_ONE) {
+		dither_error[channel] -= DITHER_ONE;
+		code++;
+	}
+	return MIN(code, FADE_MAX_LEVEL);
+}
+
+static void dither_ensure_running(void) {
+	if (!dither_running && between != 0) {
+		dither_running = true;
+		app_timer_start(dither_timer, APP_TIMER_TICKS(FADE_DITHER_TICK_MS, 0), NULL);
+	}
+}
+
+static void output(uint8_t channel) {
+	if (dither & (1 << channel)) {
+		pca9685_set_led(channel, 0x0, dithered(channel));
+		dither_ensure_running();
+		return;
+	}
+	uint16_t level = calib_apply(channel, runhours_apply(channel, gamma_apply(channel, channels[channel].level >> 16)));
+	pca9685_set_led(channel, 0x0, derate_apply(channel, level));
+}
+
+static void on_dither_tick(void * p_context) {
+	uint16_t mask = between;
+
+	tick_note_wakeup();
+	for (uint8_t i = 0; mask != 0; i++, mask >>= 1) {
+		if (mask & 1) {
+			output(i);
+		}
+	}
+	pca9685_flush();
+
+	if (between == 0) {
+		app_timer_stop(dither_timer);
+		dither_running = false;
+	}
+}
+
+static void on_tick(void * p_context) {
+	uint16_t mask = active;
+
+	tick_note_wakeup();
+	for (uint8_t i = 0; mask != 0; i++, mask >>= 1) {
+		if (!(mask & 1)) {
+			continue;
+		}
+		fade_channel_t * p_ch = &channels[i];
+		if (--p_ch->ticks_left == 0) {
+			p_ch->level = (uint32_t)p_ch->target << 16;
+			active &= ~(1 << i);
+		} else {
+			p_ch->level += p_ch->step;
+		}
+		output(i);
+	}
+	pca9685_flush();
+
+	if (active == 0) {
+		app_timer_stop(timer);
+		timer_running = false;
+	}
+}
+
+static void timer_ensure_running(void) {
+	if (!timer_running && active != 0) {
+		timer_running = true;
+		app_timer_start(timer, APP_TIMER_TICKS(FADE_TICK_MS, 0), NULL);
+	}
+}
+
+// Fewest ticks the slew limit allows reaching level in, 0 if unlimited
+static uint16_t slew_ticks(uint8_t channel, uint16_t level) {
+	uint32_t from = channels[channel].level;
+	uint32_t to = (uint32_t)level << 16;
+	uint32_t delta = (to > from) ? to - from : from - to;
+	uint32_t ticks;
+
+	if (!(slewed & (1 << channel)) || delta == 0) {
+		return 0;
+	}
+	ticks = (delta + slew_step[channel] - 1) / slew_step[channel];
+	return (ticks > 0xFFFF) ? 0xFFFF : ticks;
+}
+
+static void start_fade(uint8_t channel, uint16_t level, uint16_t ticks) {
+	if (level > FADE_MAX_LEVEL) level = FADE_MAX_LEVEL;
+	ticks = MAX(ticks, slew_ticks(channel, level));
+
+	CRITICAL_REGION_ENTER();
+	fade_channel_t * p_ch = &channels[channel];
+	p_ch->target = level;
+	p_ch->ticks_left = ticks;
+	p_ch->step = (((int32_t)level << 16) - (int32_t)p_ch->level) / ticks;
+	active |= (1 << channel);
+	CRITICAL_REGION_EXIT();
+}
+
+static void set_level(uint8_t channel, uint16_t level) {
+	if (level > FADE_MAX_LEVEL) level = FADE_MAX_LEVEL;
+
+	if (slew_ticks(channel, level) > 1) {
+		start_fade(channel, level, 1);
+		timer_ensure_running();
+		return;
+	}
+
+	CRITICAL_REGION_ENTER();
+	active &= ~(1 << channel);
+	channels[channel].level = (uint32_t)level << 16;
+	channels[channel].target = level;
+	CRITICAL_REGION_EXIT();
+
+	output(channel);
+}
+
+void fade_set(uint8_t channel, uint16_t level) {
+	if (channel >= FADE_NUM_CHANNELS) return;
+
+	set_level(channel, level);
+	pca9685_flush();
+}
+
+void fade_set_all(uint16_t level) {
+	if (level > FADE_MAX_LEVEL) level = FADE_MAX_LEVEL;
+
+	if (slewed != 0 && level != 0) {
+		for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+			set_level(i, level);
+		}
+		pca9685_flush();
+		return;
+	}
+
+	CRITICAL_REGION_ENTER();
+	active = 0;
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		channels[i].level = (uint32_t)level << 16;
+		channels[i].target = level;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (gamma_uniform() && runhours_uniform() && calib_uniform() && derate_uniform() && dither == 0) {
+		pca9685_write_all(0x0, derate_apply(0, calib_apply(0, runhours_apply(0, gamma_apply(0, level)))));
+	} else {
+		for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+			output(i);
+		}
+		pca9685_flush();
+	}
+}
+
+void fade_to(uint8_t channel, uint16_t level, uint16_t duration_ms) {
+	uint16_t ticks = duration_ms / FADE_TICK_MS;
+
+	if (channel >= FADE_NUM_CHANNELS) return;
+	if (ticks == 0) {
+		fade_set(channel, level);
+		return;
+	}
+
+	start_fade(channel, level, ticks);
+	timer_ensure_running();
+}
+
+void fade_frame(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+	uint16_t ticks = duration_ms / FADE_TICK_MS;
+
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		if (ticks == 0) {
+			set_level(i, p_levels[i]);
+		} else {
+			start_fade(i, p_levels[i], ticks);
+		}
+	}
+
+	if (ticks == 0) {
+		pca9685_flush();
+	} else {
+		timer_ensure_running();
+	}
+}
+
+void fade_set_slew(uint16_t mask, uint16_t levels_per_s) {
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		slew_rate[i] = levels_per_s;
+		// At least one 16.16 step, so a tiny rate still gets there
+		slew_step[i] = MAX(((uint64_t)levels_per_s << 16) * FADE_TICK_MS / 1000, 1);
+		if (levels_per_s != 0) {
+			slewed |= (1 << i);
+		} else {
+			slewed &= ~(1 << i);
+		}
+	}
+}
+
+uint16_t fade_slew(uint8_t channel) {
+	return slew_rate[channel];
+}
+
+void fade_stage(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		if (mask & (1 << i)) {
+			staged_levels[i] = p_levels[i];
+		}
+	}
+	staged |= mask;
+	staged_duration_ms = duration_ms;
+}
+
+uint16_t fade_commit(void) {
+	uint16_t mask = staged;
+
+	staged = 0;
+	if (mask != 0) {
+		fade_frame(mask, staged_levels, staged_duration_ms);
+	}
+	return mask;
+}
+
+void fade_discard(void) {
+	staged = 0;
+}
+
+void fade_refresh(void) {
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		output(i);
+	}
+	pca9685_flush();
+}
+
+uint16_t fade_level(uint8_t channel) {
+	return channels[channel].level >> 16;
+}
+
+uint16_t fade_target(uint8_t channel) {
+	return channels[channel].target;
+}
+
+void fade_set_dither(uint16_t mask) {
+	dither = mask;
+	between &= mask;
+	// Their duty changes every tick, so keep them from moving the others
+	pca9685_set_volatile(mask);
+	fade_refresh();
+}
+
+uint16_t fade_dither(void) {
+	return dither;
+}
+
+bool fade_active(void) {
+	return active != 0;
+}
+
+void fade_init(void) {
+	gamma_init();
+	derate_init();
+	app_timer_create(&timer, APP_TIMER_MODE_REPEATED, on_tick);
+	app_timer_create(&dither_timer, APP_TIMER_MODE_REPEATED, on_dither_tick);
+}
@@ -0,0 +1,68 @@
+#ifndef _FADE_H_
+#define _FADE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+
+#define FADE_NUM_CHANNELS PCA9685_NUM_LEDS
+#define FADE_MAX_LEVEL 4095
+#define FADE_TICK_MS 20 // 50 Hz interpolation
+
+// Dithered channels alternate between neighbouring duty codes to land
+// between them, for moonlight levels where one code is a visible step.
+// Only the top FADE_DITHER_BITS of the 12.4 duty are dithered, which
+// keeps the slowest pattern at 1000 / (FADE_DITHER_TICK_MS << bits) =
+// 50 Hz. The tick is an RTC app timer, the radio isn't involved.
+#define FADE_DITHER_BITS 2
+#define FADE_DITHER_TICK_MS 5
+
+// Bytes per record on the fade characteristic:
+// channel, target level (uint16 LE, 0-4095), duration in ms (uint16 LE)
+#define FADE_RECORD_LEN 5
+
+void fade_init(void);
+
+// Levels are linear 0-4095 and pass through the channel's gamma curve
+
+// Move a channel to a level immediately, cancelling any fade on it
+void fade_set(uint8_t channel, uint16_t level);
+// Move every channel to a level immediately, in one bus transaction
+// when all channels share a gamma curve
+void fade_set_all(uint16_t level);
+// Ramp a channel linearly from its current level to a target
+void fade_to(uint8_t channel, uint16_t level, uint16_t duration_ms);
+// Move every channel in mask together (levels indexed by channel), in a
+// single burst when duration_ms is 0 or on the same ticks otherwise
+void fade_frame(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms);
+
+// The back frame: staged channels wait there, costing no bus traffic,
+// until a commit moves them all as one fade_frame(). A later stage of a
+// channel replaces its level, and the last duration staged is the one
+// the commit fades over.
+void fade_stage(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms);
+// Returns the channels that moved, none if nothing was staged
+uint16_t fade_commit(void);
+void fade_discard(void);
+
+// Slew limit: channels in mask move no faster than levels_per_s from
+// now on, 0 lifts the limit (for effects). Instant changes become the
+// shortest ramp within it, and fades are stretched to it. Going dark
+// all at once through fade_set_all(0) is never limited, errors shut
+// the outputs that way.
+void fade_set_slew(uint16_t mask, uint16_t levels_per_s);
+uint16_t fade_slew(uint8_t channel);
+
+// Channels in mask are dithered from now on, the rest aren't
+void fade_set_dither(uint16_t mask);
+uint16_t fade_dither(void);
+
+// Re-send every channel, e.g. after the derate factor has moved
+void fade_refresh(void);
+
+uint16_t fade_level(uint8_t channel);
+// Where the channel ends up once any running fade completes
+uint16_t fade_target(uint8_t channel);
+bool fade_active(void);
+
+#endif
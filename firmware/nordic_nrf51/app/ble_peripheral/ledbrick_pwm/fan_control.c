@@ -0,0 +1,238 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_pwm.h"
+#include "app_timer.h"
+#include "nrf_gpio.h"
+#include "clock.h"
+#include "fan_monitor.h"
+#include "fan_control.h"
+
+#define PIN_FANCTRL BOARD_PIN_FANCTRL
+
+#define DUTY_Q8_MAX (100 << 8)
+
+APP_PWM_INSTANCE(fan_pwm, 1);
+
+static app_timer_id_t kick_timer;
+static bool kicking = false;
+
+static int32_t integral = 0; // Duty percent * 256
+static int16_t last_error = 0;
+static bool have_last = false;
+static uint8_t duty_floor = FAN_MIN_DUTY;
+static uint8_t duty = 0;  // Loop output
+static uint8_t applied = 0; // What the pin is actually driven at
+
+// Rises ahead by source, and the uptime each lapses at, 0 for never
+static uint8_t lead_rise[FAN_LEAD_SOURCES];
+static uint32_t lead_until[FAN_LEAD_SOURCES];
+
+typedef enum {
+	FAN_OK,
+	FAN_KICKED, // Stopped, and kicked to see if it starts
+	FAN_FAILED, // Still stopped after the kick
+} fan_state_t;
+
+static uint8_t const gate_pins[FANTACH_NUM_FANS] = FAN_GATE_PINS;
+STATIC_ASSERT(sizeof((uint8_t[])FAN_GATE_PINS) == FANTACH_NUM_FANS);
+STATIC_ASSERT(BOARD_PIN_FITTED(PIN_FANCTRL));
+static fan_state_t states[FANTACH_NUM_FANS];
+static uint32_t retry_s[FANTACH_NUM_FANS]; // Uptime to kick a failed fan again
+
+static bool gated_off(uint8_t fan) {
+	return states[fan] == FAN_FAILED && gate_pins[fan] != FAN_PIN_NONE;
+}
+
+static void pwm_apply(uint8_t percent) {
+	applied = percent;
+	// Busy only while a previous change is still being latched, the next
+	// update catches up
+	(void)app_pwm_channel_duty_set(&fan_pwm, 0, percent);
+
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		bool on = percent > 0 && !gated_off(f);
+
+		if (gate_pins[f] != FAN_PIN_NONE) {
+			if (on) {
+				nrf_gpio_pin_set(gate_pins[f]);
+			} else {
+				nrf_gpio_pin_clear(gate_pins[f]);
+			}
+		}
+		if (on) {
+			fantach_enable(f);
+		} else {
+			fantach_disable(f);
+		}
+	}
+}
+
+static void on_kick_done(void * p_context) {
+	kicking = false;
+	pwm_apply(duty);
+}
+
+static void kick(void) {
+	if (kicking) return;
+	kicking = true;
+	pwm_apply(100);
+	app_timer_start(kick_timer, APP_TIMER_TICKS(FAN_KICK_MS, 0), NULL);
+}
+
+static void output(uint8_t percent) {
+	bool starting = (duty == 0 && percent > 0);
+
+	duty = percent;
+	if (kicking) {
+		return; // Picked up when the kick ends
+	}
+	if (starting) {
+		kick();
+	} else {
+		pwm_apply(percent);
+	}
+}
+
+static int32_t clamp(int32_t v, int32_t lo, int32_t hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// The largest rise ahead still current
+static uint8_t lead(void) {
+	uint32_t now = clock_uptime();
+	uint8_t rise = 0;
+
+	for (uint8_t s = 0; s < FAN_LEAD_SOURCES; s++) {
+		if (lead_until[s] != 0 && (int32_t)(now - lead_until[s]) >= 0) {
+			lead_rise[s] = 0;
+			lead_until[s] = 0;
+		}
+		if (lead_rise[s] > rise) {
+			rise = lead_rise[s];
+		}
+	}
+	return rise;
+}
+
+// Tach feedback, fan by fan: one that can't make the minimum speed gets
+// more duty, one that has stopped gets kicked, and one still stopped
+// after that has failed. Returns the failed count.
+static uint8_t fans_check(void) {
+	uint32_t now = clock_uptime();
+	bool want_kick = false;
+	uint8_t failed = 0;
+
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		uint16_t rpm = fantach_fan_rpm(f);
+
+		if (rpm > 0) {
+			states[f] = FAN_OK;
+			if (rpm < FAN_MIN_RPM && duty_floor < 100) {
+				duty_floor += FAN_FLOOR_STEP;
+				if (duty_floor > 100) duty_floor = 100;
+			}
+			continue;
+		}
+		switch (states[f]) {
+		case FAN_OK:
+			states[f] = FAN_KICKED;
+			want_kick = true;
+			break;
+		case FAN_KICKED:
+			states[f] = FAN_FAILED;
+			retry_s[f] = now + FAN_RETRY_S;
+			failed++;
+			break;
+		case FAN_FAILED:
+			if ((int32_t)(now - retry_s[f]) >= 0) {
+				states[f] = FAN_KICKED;
+				want_kick = true;
+			} else {
+				failed++;
+			}
+			break;
+		}
+	}
+	if (want_kick) {
+		kick(); // Also powers up a gated fan coming out of FAN_FAILED
+	}
+	return failed;
+}
+
+void fan_control_update(bool valid, int16_t temp) {
+	if (!valid) {
+		have_last = false;
+		output(100);
+		return;
+	}
+
+	int16_t error = temp - FAN_TARGET_TEMP;
+	int32_t derivative = have_last ? (error - last_error) : 0;
+	last_error = error;
+	have_last = true;
+
+	// Conditional integration: stop winding up once the output saturates
+	int32_t p = (int32_t)FAN_KP * error;
+	int32_t d = (int32_t)FAN_KD * derivative;
+	// Ahead of the heat, falling away as the rise arrives and the error
+	// takes over
+	int32_t ff = (int32_t)FAN_KFF * lead();
+	int32_t next = clamp(integral + (int32_t)FAN_KI * error, 0, DUTY_Q8_MAX);
+	int32_t out = p + next + d + ff;
+	if (out >= 0 && out <= DUTY_Q8_MAX) {
+		integral = next;
+	}
+	out = clamp(p + integral + d + ff, 0, DUTY_Q8_MAX);
+
+	uint8_t percent = (out + 128) >> 8;
+	uint8_t failed = 0;
+
+	if (applied > 0 && !kicking) {
+		failed = fans_check();
+	} else {
+		for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+			failed += (states[f] == FAN_FAILED);
+		}
+	}
+
+	if (failed > 0) {
+		// What's left turning has to do the failed fans' work too
+		percent = 100;
+	} else if (percent < FAN_MIN_DUTY) {
+		percent = 0;
+	} else if (percent < duty_floor) {
+		percent = duty_floor;
+	}
+	output(percent);
+}
+
+uint8_t fan_control_duty(void) {
+	return applied;
+}
+
+void fan_control_lead(fan_lead_source_t source, uint8_t rise, uint16_t hold_s) {
+	if (source >= FAN_LEAD_SOURCES) {
+		return;
+	}
+	lead_rise[source] = (rise > 100) ? 100 : rise;
+	lead_until[source] = (hold_s == 0) ? 0 : clock_uptime() + hold_s;
+}
+
+void fan_control_init(void) {
+	app_pwm_config_t config = APP_PWM_DEFAULT_CONFIG_1CH(FAN_PWM_PERIOD_US, PIN_FANCTRL);
+	config.pin_polarity[0] = APP_PWM_POLARITY_ACTIVE_HIGH;
+
+	app_timer_create(&kick_timer, APP_TIMER_MODE_SINGLE_SHOT, on_kick_done);
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		if (gate_pins[f] != FAN_PIN_NONE) {
+			nrf_gpio_cfg_output(gate_pins[f]);
+		}
+	}
+
+	app_pwm_init(&fan_pwm, &config, NULL);
+	app_pwm_enable(&fan_pwm);
+
+	// Start flat out until the first reading arrives, as before
+	duty = 100;
+	pwm_apply(100);
+}
@@ -0,0 +1,71 @@
+#ifndef _FAN_CONTROL_H_
+#define _FAN_CONTROL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcp9808.h"
+#include "fan_monitor.h"
+
+#define FAN_PWM_PERIOD_US 40 // 25 kHz, above hearing
+
+// Junction temperature the loop holds (junction.h), the heatsink's
+// on a board without the model
+#define FAN_TARGET_TEMP MCP9808_DEG(38)
+
+// PID gains in duty percent * 256 per 1/16 C (P), per 1/16 C per
+// sample (I) and per 1/16 C change between samples (D)
+#define FAN_KP 160 // 10 % per C
+#define FAN_KI 16  // 1 % per C per sample
+#define FAN_KD 320 // 20 % per C change
+
+// Below this the fan is switched off rather than crawling
+#define FAN_MIN_DUTY 20
+// Running below this RPM raises the duty floor by FAN_FLOOR_STEP
+#define FAN_MIN_RPM 600
+#define FAN_FLOOR_STEP 5
+
+// Full power for this long when starting from rest or after a stall
+#define FAN_KICK_MS 1000
+
+// Every fan (fan_monitor.h) runs at the one duty: TIMER1 has no compare
+// left for a second PWM channel, the master dimmer holds it (pca9685.c).
+// What each fan has of its own is a gate pin switching its power,
+// FAN_PIN_NONE for a fan wired straight to the PWM.
+#define FAN_PIN_NONE BOARD_PIN_NONE
+#define FAN_GATE_PINS BOARD_FAN_GATE_PINS
+
+// A fan still stopped after its kick has failed. The others run flat out
+// to carry its heat, and it's switched off if gated and kicked again
+// every FAN_RETRY_S.
+#define FAN_RETRY_S 60
+
+// Feedforward: where the output is about to rise, the fan is spun up
+// ahead of it rather than the loop catching up once the heat has
+// reached the junctions. FAN_KFF is duty percent * 256 per percent of
+// full output the rise adds, looked for FAN_LEAD_S ahead, about the
+// heatsink's time constant.
+#define FAN_KFF 128 // Half a percent per percent
+#define FAN_LEAD_S 600
+
+typedef enum {
+	FAN_LEAD_SCHEDULE, // The brick's own schedule (schedule.h)
+	FAN_LEAD_FADE,     // Fades running to brighter targets
+	FAN_LEAD_HINT,     // The controller's, from its tables (LBS_CMD_OP_FAN_LEAD)
+	FAN_LEAD_SOURCES,
+} fan_lead_source_t;
+
+void fan_control_init(void);
+
+// Run one step of the loop with a new reading. A failed read runs the
+// fan flat out.
+void fan_control_update(bool valid, int16_t temp);
+
+// Current duty cycle in percent
+uint8_t fan_control_duty(void);
+
+// The output from source rises by rise percent of full within
+// FAN_LEAD_S. Holds for hold_s, or until said again for 0. The largest
+// of the sources feeds forward.
+void fan_control_lead(fan_lead_source_t source, uint8_t rise, uint16_t hold_s);
+
+#endif
@@ -1,83 +1,280 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "nrf.h"
 #include "boards.h"
+#include "app_util.h"
+#include "app_util_platform.h"
 #include <nrf_gpio.h>
 #include <nrf_drv_gpiote.h>
 #include <nrf_drv_ppi.h>
 #include <nrf_drv_timer.h>
 #include "error_handlers.h"
+#include "sim.h"
 #include "fan_monitor.h"
 
-#define PIN_FANTACH 8
-#define PIN_FANCTRL 9
+#define TACH_TIMER_HZ 31250
+#define TACH_PULSES_PER_REV 2
+// Timer ticks per revolution-minute, rpm = this / period
+#define TACH_RPM_TICKS ((TACH_TIMER_HZ * 60UL) / TACH_PULSES_PER_REV)
+
+// Fan n captures on CC n, this compare at 0 marks each wrap
+#define WRAP_CC NRF_TIMER_CC_CHANNEL3
+
+STATIC_ASSERT(FANTACH_NUM_FANS <= FANTACH_MAX_FANS);
 
 const nrf_drv_timer_t timer2 = NRF_DRV_TIMER_INSTANCE(2);
-nrf_ppi_channel_t ppi_channel;
-nrf_ppi_channel_t ppi_channel2;
 
-nrf_drv_gpiote_in_config_t gpio_config = GPIOTE_CONFIG_IN_SENSE_HITOLO(true);
+static uint8_t const pins[FANTACH_NUM_FANS] = FANTACH_PINS;
+STATIC_ASSERT(sizeof((uint8_t[])FANTACH_PINS) == FANTACH_NUM_FANS);
+
+typedef struct {
+	// Ring of the most recent captured periods, in timer ticks
+	uint16_t periods[FANTACH_SAMPLES];
+	uint8_t head;
+	uint8_t count;
+	uint16_t last;  // Timer at the last edge
+	uint8_t wraps;  // Since the last edge, up to FANTACH_STALL_WRAPS
+	bool discard;   // The first period after a stall or restart is partial
+	bool stalled;
+	bool enabled;
+} tach_t;
+
+static volatile tach_t tachs[FANTACH_NUM_FANS];
+static nrf_ppi_channel_t ppi_channels[FANTACH_NUM_FANS];
 
-static bool fan_enabled = true;
+static void tach_reset(volatile tach_t * p_tach) {
+	CRITICAL_REGION_ENTER();
+	p_tach->head = 0;
+	p_tach->count = 0;
+	p_tach->wraps = 0;
+	p_tach->discard = true;
+	p_tach->stalled = false;
+	CRITICAL_REGION_EXIT();
+}
 
+// Runs on every tach edge. The first fans' edges have already captured
+// the timer through PPI, the rest capture it here.
 static void pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {
- // Not used
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		volatile tach_t * p_tach = &tachs[f];
+		nrf_timer_cc_channel_t cc = (nrf_timer_cc_channel_t)f;
+
+		if (pins[f] != pin) {
+			continue;
+		}
+		uint16_t now = (f < FANTACH_PPI_FANS) ? nrf_drv_timer_capture_get(&timer2, cc)
+		                                      : nrf_drv_timer_capture(&timer2, cc);
+		uint16_t ticks = now - p_tach->last;
+		// Across one wrap the difference still holds as long as the count
+		// hasn't come back round past the last edge
+		bool whole = p_tach->wraps == 0 || (p_tach->wraps == 1 && now < p_tach->last);
+
+		p_tach->last = now;
+		p_tach->wraps = 0;
+		p_tach->stalled = false;
+		if (p_tach->discard || !whole || ticks == 0) {
+			p_tach->discard = false;
+			return;
+		}
+		p_tach->periods[p_tach->head] = ticks;
+		p_tach->head = (p_tach->head + 1) % FANTACH_SAMPLES;
+		if (p_tach->count < FANTACH_SAMPLES) {
+			p_tach->count++;
+		}
+		return;
+	}
+}
+
+// Each fan that should be turning and has gone quiet for long enough
+// stalls on its own, the others carry on reporting
+static void timer_handler(nrf_timer_event_t event_type, void * p_context) {
+	if (event_type != NRF_TIMER_EVENT_COMPARE3) {
+		return;
+	}
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		volatile tach_t * p_tach = &tachs[f];
+		bool stalled = false;
+
+		CRITICAL_REGION_ENTER();
+		if (p_tach->enabled) {
+			if (p_tach->wraps < FANTACH_STALL_WRAPS) {
+				p_tach->wraps++;
+			}
+			if (p_tach->wraps == FANTACH_STALL_WRAPS) {
+				p_tach->head = 0;
+				p_tach->count = 0;
+				p_tach->discard = true;
+				p_tach->stalled = true;
+				stalled = true;
+			}
+		}
+		CRITICAL_REGION_EXIT();
+		if (stalled) {
+			error_raise(ERROR_FAN, f);
+		}
+	}
+}
+
+static uint16_t ticks_to_rpm(uint32_t ticks) {
+	return (TACH_RPM_TICKS + ticks / 2) / ticks;
+}
+
+void fantach_stats(uint8_t fan, fantach_stats_t * p_stats) {
+	uint16_t sorted[FANTACH_SAMPLES];
+	uint8_t n;
+	uint32_t sum = 0;
+	uint16_t lo = 0xFFFF, hi = 0;
+	uint8_t used = 0;
+	volatile tach_t * p_tach = &tachs[fan];
+
+	memset(p_stats, 0, sizeof(*p_stats));
+	if (fan >= FANTACH_NUM_FANS || !p_tach->enabled || p_tach->stalled) return;
+
+	CRITICAL_REGION_ENTER();
+	n = p_tach->count;
+	for (uint8_t i = 0; i < n; i++) {
+		sorted[i] = p_tach->periods[i];
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (n == 0) return;
+
+	// Insertion sort, the ring is tiny
+	for (uint8_t i = 1; i < n; i++) {
+		uint16_t v = sorted[i];
+		uint8_t j = i;
+		for (; j > 0 && sorted[j - 1] > v; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = v;
+	}
+
+	uint16_t median = sorted[n / 2];
+	uint16_t band = ((uint32_t)median * FANTACH_OUTLIER_PCT) / 100;
+
+	for (uint8_t i = 0; i < n; i++) {
+		if (sorted[i] + band < median || sorted[i] > median + band) {
+			continue;
+		}
+		sum += sorted[i];
+		used++;
+		if (sorted[i] < lo) lo = sorted[i];
+		if (sorted[i] > hi) hi = sorted[i];
+	}
+
+	// The median itself always passes, so used is never 0 here
+	p_stats->rpm = ticks_to_rpm((sum + used / 2) / used);
+	p_stats->rpm_min = ticks_to_rpm(hi);
+	p_stats->rpm_max = ticks_to_rpm(lo);
+	p_stats->jitter_us = ((uint32_t)(hi - lo) * 1000000UL) / TACH_TIMER_HZ;
+	p_stats->samples = used;
+	p_stats->rejected = n - used;
 }
 
-void timer_dummy_handler(nrf_timer_event_t event_type, void * p_context){
-	if (event_type == NRF_TIMER_EVENT_COMPARE1 && fan_enabled)
-		error_raise(ERROR_FAN);
+uint16_t fantach_fan_rpm(uint8_t fan) {
+	fantach_stats_t stats;
+
+#if SIM_ENABLED
+	if (sim_active()) {
+		return sim_rpm();
+	}
+#endif
+	fantach_stats(fan, &stats);
+	return stats.rpm;
 }
 
 uint16_t fantach_rpm(void) {
-	uint32_t ticks = nrf_drv_timer_capture_get(&timer2, NRF_TIMER_CC_CHANNEL0);
-	if (!fan_enabled || error_present(ERROR_FAN)) return 0;
-	uint16_t rpm = (uint16_t)(( (31250.0f / 2.0f) / (float)ticks ) * 60.0f);
-	return rpm;
+	uint16_t slowest = 0;
+	bool any = false;
+
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		if (!tachs[f].enabled) {
+			continue;
+		}
+		uint16_t rpm = fantach_fan_rpm(f);
+		if (!any || rpm < slowest) {
+			slowest = rpm;
+		}
+		any = true;
+	}
+	return slowest;
 }
 
-void fantach_enable(void) {
-	fan_enabled = true;
-	nrf_gpio_pin_set(PIN_FANCTRL);
+bool fantach_stalled(uint8_t fan) {
+	return fan < FANTACH_NUM_FANS && tachs[fan].stalled;
 }
 
-void fantach_disable(void) {
-	fan_enabled = false;
-	nrf_gpio_pin_clear(PIN_FANCTRL);
+#if FANTACH_IDLE_STOP
+static bool any_enabled(void) {
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		if (tachs[f].enabled) {
+			return true;
+		}
+	}
+	return false;
 }
+#endif
 
-bool fantach_enabled(void) {
-	return fan_enabled;
+// The fan power belongs to fan_control, these only tell the monitor
+// whether a fan should be turning
+void fantach_enable(uint8_t fan) {
+	if (fan >= FANTACH_NUM_FANS || tachs[fan].enabled) {
+		return;
+	}
+	tach_reset(&tachs[fan]);
+#if FANTACH_IDLE_STOP
+	if (!any_enabled()) {
+		nrf_drv_timer_clear(&timer2);
+		nrf_drv_timer_enable(&timer2);
+	}
+	nrf_drv_gpiote_in_event_enable(pins[fan], true);
+#endif
+	tachs[fan].enabled = true;
 }
 
-void fantach_init(void) {
-	
-	nrf_drv_timer_init(&timer2, NULL, timer_dummy_handler);
-  nrf_drv_timer_enable(&timer2);
-	
-	// Compare at max to check for stalled fans
-	nrf_drv_timer_extended_compare(&timer2, NRF_TIMER_CC_CHANNEL1, 0xFFFFUL, NRF_TIMER_SHORT_COMPARE1_CLEAR_MASK, true);
+void fantach_disable(uint8_t fan) {
+	if (fan >= FANTACH_NUM_FANS || !tachs[fan].enabled) {
+		return;
+	}
+	tachs[fan].enabled = false;
+#if FANTACH_IDLE_STOP
+	nrf_drv_gpiote_in_event_disable(pins[fan]);
+	if (!any_enabled()) {
+		nrf_drv_timer_disable(&timer2);
+	}
+#endif
+}
 
-	nrf_gpio_pin_dir_set(PIN_FANTACH, NRF_GPIO_PIN_DIR_INPUT);
-	nrf_gpio_pin_dir_set(PIN_FANCTRL, NRF_GPIO_PIN_DIR_OUTPUT);
-	nrf_gpio_pin_set(PIN_FANCTRL);
+bool fantach_enabled(uint8_t fan) {
+	return fan < FANTACH_NUM_FANS && tachs[fan].enabled;
+}
 
+void fantach_init(void) {
+	nrf_drv_timer_init(&timer2, NULL, timer_handler);
+	// Free running, so every fan can capture against the same count
+	nrf_drv_timer_compare(&timer2, WRAP_CC, 0, true);
+	nrf_drv_timer_enable(&timer2);
 
 	nrf_drv_ppi_init();
-	nrf_drv_ppi_channel_alloc(&ppi_channel);
-	nrf_drv_ppi_channel_alloc(&ppi_channel2);
-	
-	nrf_drv_gpiote_in_init(PIN_FANTACH, &gpio_config, pin_handler);
-	nrf_drv_gpiote_in_event_enable(PIN_FANTACH, true);
-	
-	uint32_t ppi_addr = nrf_drv_gpiote_in_event_addr_get(PIN_FANTACH);
-  uint32_t capture_addr = nrf_drv_timer_capture_task_address_get(&timer2, 0);
-	uint32_t clear_addr = nrf_drv_timer_task_address_get(&timer2, NRF_TIMER_TASK_CLEAR);
-	
-	nrf_drv_ppi_channel_assign(ppi_channel, ppi_addr, capture_addr);
-	nrf_drv_ppi_channel_enable(ppi_channel);
-	
-	nrf_drv_ppi_channel_assign(ppi_channel2, ppi_addr, clear_addr);
-	nrf_drv_ppi_channel_enable(ppi_channel2);
-	
+	if (!nrf_drv_gpiote_is_init()) {
+		nrf_drv_gpiote_init();
+	}
+
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_HITOLO(f < FANTACH_PPI_FANS);
+
+		nrf_gpio_pin_dir_set(pins[f], NRF_GPIO_PIN_DIR_INPUT);
+		tach_reset(&tachs[f]);
+		nrf_drv_gpiote_in_init(pins[f], &config, pin_handler);
+		nrf_drv_gpiote_in_event_enable(pins[f], true);
+
+		if (f < FANTACH_PPI_FANS) {
+			nrf_drv_ppi_channel_alloc(&ppi_channels[f]);
+			nrf_drv_ppi_channel_assign(ppi_channels[f], nrf_drv_gpiote_in_event_addr_get(pins[f]),
+			                           nrf_drv_timer_capture_task_address_get(&timer2, f));
+			nrf_drv_ppi_channel_enable(ppi_channels[f]);
+		}
+		tachs[f].enabled = true;
+	}
 }
@@ -3,11 +3,52 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "board_profile.h"
+
+// Fans on the board and their tach pins. TIMER2 runs free and each fan
+// captures it on its own CC channel, the last channel marking the
+// counter wrapping, so at most three.
+#define FANTACH_NUM_FANS BOARD_FANS
+#define FANTACH_PINS BOARD_FAN_TACH_PINS
+#define FANTACH_MAX_FANS 3
+
+// nRF51 has four GPIOTE channels. OE, the thermal alert and the fan PWM
+// take three, leaving one tach its own event to capture the timer
+// through PPI. Tachs past that sense the port and capture from the
+// handler instead, the interrupt latency showing up as jitter.
+#define FANTACH_PPI_FANS 1
+
+// Tach periods kept for smoothing, and how far (percent) one may sit
+// from the median before it is thrown away as a glitch
+#define FANTACH_SAMPLES 8
+#define FANTACH_OUTLIER_PCT 25
+// A fan is stalled once the timer wraps this often (2.1 s each) without
+// an edge
+#define FANTACH_STALL_WRAPS 2
+// Stop TIMER2 and the tach edge events while every fan is off, so
+// nothing holds the 16 MHz clock on between radio events
+#define FANTACH_IDLE_STOP 1
+
+typedef struct {
+	uint16_t rpm;       // Mean of the accepted periods
+	uint16_t rpm_min;
+	uint16_t rpm_max;
+	uint16_t jitter_us; // Spread between the longest and shortest period
+	uint8_t samples;    // Periods accepted
+	uint8_t rejected;   // Periods dropped as outliers
+} fantach_stats_t;
 
 void fantach_init(void);
+// The slowest fan that should be turning, 0 if any has stalled
 uint16_t fantach_rpm(void);
-void fantach_enable(void);
-void fantach_disable(void);
-bool fantach_enabled(void);
+uint16_t fantach_fan_rpm(uint8_t fan);
+// All zero while the fan is off, stalled or has no samples yet
+void fantach_stats(uint8_t fan, fantach_stats_t * p_stats);
+// Each fan raises ERROR_FAN with its number on stalling
+bool fantach_stalled(uint8_t fan);
+// Whether a fan should be turning, set by fan_control
+void fantach_enable(uint8_t fan);
+void fantach_disable(uint8_t fan);
+bool fantach_enabled(uint8_t fan);
 
 #endif
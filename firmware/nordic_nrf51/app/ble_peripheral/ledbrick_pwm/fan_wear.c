@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "crc16.h"
+#include "error_handlers.h"
+#include "fan_control.h"
+#include "retained.h"
+#include "fan_wear.h"
+
+#define WEAR_MAGIC 0x46574152
+
+// sum adds up the samples while learning, then holds the average of
+// now in 1/2^FAN_WEAR_SHIFT rpm
+typedef struct {
+	uint32_t sum;
+	uint16_t base;
+	uint8_t samples;
+} band_t;
+
+typedef struct {
+	uint32_t magic;
+	band_t bands[FANTACH_NUM_FANS][FAN_WEAR_TEMP_BANDS][FAN_WEAR_DUTY_BANDS];
+	uint16_t crc;
+} wear_t;
+
+static wear_t m_wear RETAINED;
+static uint8_t last_duty = 0;
+
+static uint16_t wear_crc(void) {
+	return crc16_compute((uint8_t const *)m_wear.bands, sizeof(m_wear.bands), NULL);
+}
+
+void fan_wear_init(void) {
+	if (!retained_ram_kept() || m_wear.magic != WEAR_MAGIC || m_wear.crc != wear_crc()) {
+		memset(&m_wear, 0, sizeof(m_wear));
+		m_wear.magic = WEAR_MAGIC;
+		m_wear.crc = wear_crc();
+	}
+}
+
+static band_t * band_of(uint8_t fan, uint8_t duty, int16_t temp) {
+	uint8_t d = (uint16_t)(duty - FAN_MIN_DUTY) * FAN_WEAR_DUTY_BANDS / (101 - FAN_MIN_DUTY);
+
+	return &m_wear.bands[fan][temp >= FAN_WEAR_WARM][d];
+}
+
+void fan_wear_sample(uint8_t duty, int16_t temp) {
+	bool steady = duty >= FAN_MIN_DUTY && duty == last_duty;
+
+	last_duty = duty;
+	if (!steady) {
+		return;
+	}
+	for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+		uint16_t rpm = fantach_fan_rpm(f);
+		band_t * p_band = band_of(f, duty, temp);
+		uint32_t now;
+
+		if (!fantach_enabled(f) || rpm == 0) {
+			continue;
+		}
+		if (p_band->samples < FAN_WEAR_LEARN) {
+			p_band->sum += rpm;
+			if (++p_band->samples == FAN_WEAR_LEARN) {
+				p_band->base = p_band->sum / FAN_WEAR_LEARN;
+				p_band->sum = (uint32_t)p_band->base << FAN_WEAR_SHIFT;
+			}
+			continue;
+		}
+		p_band->sum += rpm - (p_band->sum >> FAN_WEAR_SHIFT);
+		now = p_band->sum >> FAN_WEAR_SHIFT;
+		if (p_band->base > 0 && now * 100 <= (uint32_t)p_band->base * (100 - FAN_WEAR_PCT)) {
+			error_raise(ERROR_FAN_WEAR, f * 1000 + now * 100 / p_band->base);
+		}
+	}
+	m_wear.crc = wear_crc();
+}
@@ -0,0 +1,32 @@
+#ifndef _FAN_WEAR_H_
+#define _FAN_WEAR_H_
+
+#include <stdint.h>
+#include "fan_monitor.h"
+#include "mcp9808.h"
+
+// A fan wearing out turns slower at the same duty for weeks before it
+// stalls. Each fan keeps a baseline rpm per duty band and board
+// temperature band, the mean of its first FAN_WEAR_LEARN steady samples
+// there, and a slow average of what it turns now. Running FAN_WEAR_PCT
+// or more under the baseline in a learned band raises ERROR_FAN_WEAR, a
+// warning, with the fan and its speed as a percent of the baseline:
+// fan * 1000 + percent.
+//
+// A sample is steady when the duty is the one the last sample saw and
+// the fan is turning. The baselines sit in retained RAM (retained.h),
+// so resets carry on with them and a power cycle, which any fan swap
+// takes, learns them afresh.
+#define FAN_WEAR_DUTY_BANDS 8 // FAN_MIN_DUTY to full, evenly
+#define FAN_WEAR_TEMP_BANDS 2
+#define FAN_WEAR_WARM MCP9808_DEG(40) // Board temperature between them
+#define FAN_WEAR_LEARN 60 // Samples, 5 minutes at the poll interval
+#define FAN_WEAR_SHIFT 6  // Now is a 1/64 average, about 5 minutes
+#define FAN_WEAR_PCT 15
+
+// Call once at boot, after retained_init()
+void fan_wear_init(void);
+// With each good temperature reading and the fan duty driven as of it
+void fan_wear_sample(uint8_t duty, int16_t temp);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nrf_error.h"
+#include "pstorage.h"
+#include "flash_ring.h"
+
+// Rings registered, for the store callback pstorage gives the module by
+static flash_ring_t * rings[FLASH_RING_MAX];
+static uint8_t ring_count = 0;
+
+static uint16_t per_page(flash_ring_t const * p_ring) {
+	return FLASH_PAGE_SIZE / p_ring->record_len;
+}
+
+static uint32_t seq_of(void const * p_rec) {
+	return *(uint32_t const *)p_rec;
+}
+
+static bool erased(flash_ring_t * p_ring, uint16_t i) {
+	uint32_t const * p_word = flash_ring_at(p_ring, i);
+
+	for (uint16_t w = 0; w < p_ring->record_len / 4; w++) {
+		if (p_word[w] != FLASH_RING_ERASED) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void on_store(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result,
+                     uint8_t * p_data, uint32_t data_len) {
+	if (op_code != PSTORAGE_STORE_OP_CODE) {
+		return;
+	}
+	for (uint8_t i = 0; i < ring_count; i++) {
+		if (rings[i]->base.module_id == p_handle->module_id) {
+			rings[i]->busy = false;
+			if (rings[i]->stored != NULL) {
+				rings[i]->stored();
+			}
+			return;
+		}
+	}
+}
+
+// Skip to the first blank slot after the newest record, or the next page
+static void resume(flash_ring_t * p_ring, uint16_t newest) {
+	uint16_t per = per_page(p_ring);
+
+	p_ring->page = newest / per;
+	for (p_ring->slot = newest % per + 1; p_ring->slot < per; p_ring->slot++) {
+		if (erased(p_ring, p_ring->page * per + p_ring->slot)) {
+			return;
+		}
+	}
+	p_ring->page = (p_ring->page + 1) % p_ring->pages;
+	p_ring->slot = 0;
+}
+
+void const * flash_ring_init(flash_ring_t * p_ring, uint8_t pages, uint16_t record_len,
+                             flash_ring_valid_t valid, flash_ring_stored_t stored) {
+	pstorage_module_param_t param = {
+		.cb = on_store,
+		.block_size = FLASH_PAGE_SIZE,
+		.block_count = pages,
+	};
+	void const * p_newest = NULL;
+	uint16_t newest = 0;
+
+	p_ring->stored = stored;
+	p_ring->record_len = record_len;
+	p_ring->pages = pages;
+	p_ring->page = 0;
+	p_ring->slot = 0;
+	p_ring->busy = false;
+	p_ring->registered = (ring_count < FLASH_RING_MAX) &&
+	                     (pstorage_register(&param, &p_ring->base) == NRF_SUCCESS);
+	if (!p_ring->registered) {
+		return NULL;
+	}
+	rings[ring_count++] = p_ring;
+
+	for (uint16_t i = 0; i < flash_ring_records(p_ring); i++) {
+		void const * p_rec = flash_ring_at(p_ring, i);
+		if (seq_of(p_rec) == FLASH_RING_ERASED || !valid(p_rec)) {
+			continue;
+		}
+		if (p_newest == NULL || seq_of(p_rec) > seq_of(p_newest)) {
+			p_newest = p_rec;
+			newest = i;
+		}
+	}
+	if (p_newest != NULL) {
+		resume(p_ring, newest);
+	}
+	return p_newest;
+}
+
+uint16_t flash_ring_records(flash_ring_t const * p_ring) {
+	return p_ring->pages * per_page(p_ring);
+}
+
+void const * flash_ring_at(flash_ring_t * p_ring, uint16_t i) {
+	pstorage_handle_t block;
+
+	pstorage_block_identifier_get(&p_ring->base, i / per_page(p_ring), &block);
+	return (void const *)(block.block_id + (i % per_page(p_ring)) * p_ring->record_len);
+}
+
+bool flash_ring_ready(flash_ring_t const * p_ring) {
+	return p_ring->registered && !p_ring->busy;
+}
+
+bool flash_ring_append(flash_ring_t * p_ring, void * p_rec) {
+	pstorage_handle_t block;
+
+	if (!flash_ring_ready(p_ring)) {
+		return false;
+	}
+	pstorage_block_identifier_get(&p_ring->base, p_ring->page, &block);
+	if (p_ring->slot == 0 && !erased(p_ring, p_ring->page * per_page(p_ring))) {
+		// Wrapped onto an old page, clear it first (queued ahead of the store)
+		if (pstorage_clear(&block, FLASH_PAGE_SIZE) != NRF_SUCCESS) {
+			return false;
+		}
+	}
+	if (pstorage_store(&block, (uint8_t *)p_rec, p_ring->record_len,
+	                   p_ring->slot * p_ring->record_len) != NRF_SUCCESS) {
+		return false;
+	}
+	p_ring->busy = true;
+	if (++p_ring->slot == per_page(p_ring)) {
+		p_ring->page = (p_ring->page + 1) % p_ring->pages;
+		p_ring->slot = 0;
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _FLASH_RING_H_
+#define _FLASH_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pstorage.h"
+#include "ledbrick_flash.h"
+
+// Records appended round a ring of flash pages, for the logs that pick up
+// from their newest after a reset (journal.h, runhours.h, history.h).
+// Records are a fixed size per ring, a word multiple, as many to a page as
+// fit, and lead with a sequence number (uint32, erased for a blank slot)
+// counting up across the ring. The ring picks up past the newest valid
+// record; anything torn after it is left alone and the ring moves on. A
+// page is cleared as the ring comes back round to it, queued ahead of the
+// store, so the oldest page's worth goes at once.
+#define FLASH_RING_MAX 3
+#define FLASH_RING_ERASED 0xFFFFFFFF
+
+// Whether a record that isn't blank holds together (its CRC)
+typedef bool (*flash_ring_valid_t)(void const * p_rec);
+// Told once each store completes, from pstorage's callback
+typedef void (*flash_ring_stored_t)(void);
+
+typedef struct {
+	pstorage_handle_t base;
+	flash_ring_stored_t stored;
+	uint16_t record_len;
+	uint8_t pages;
+	// Where the next record goes
+	uint8_t page;
+	uint8_t slot;
+	bool registered;
+	bool busy; // A store is going, its record has to stay put
+} flash_ring_t;
+
+// Registers the pages with pstorage, after pstorage_init(), and finds the
+// newest valid record to go on from. NULL for none, or if the pages
+// couldn't be had, where appends fail.
+void const * flash_ring_init(flash_ring_t * p_ring, uint8_t pages, uint16_t record_len,
+                             flash_ring_valid_t valid, flash_ring_stored_t stored);
+
+// Records the ring holds, and record i of them, page by page
+uint16_t flash_ring_records(flash_ring_t const * p_ring);
+void const * flash_ring_at(flash_ring_t * p_ring, uint16_t i);
+
+// Whether an append would be taken now, before filling the record
+bool flash_ring_ready(flash_ring_t const * p_ring);
+// Stores p_rec, record_len bytes that stay put until it completes, in the
+// next slot. False if not ready or pstorage turned it away.
+bool flash_ring_append(flash_ring_t * p_ring, void * p_rec);
+
+#endif
@@ -0,0 +1,83 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_gap.h"
+#include "tick.h"
+#include "flash_sched.h"
+
+static flash_sched_job_t jobs[FLASH_SCHED_MAX_JOBS];
+static uint8_t job_count = 0;
+static uint16_t pending = 0;
+static uint8_t task = TICK_INVALID;
+// Ticks the oldest pending job has waited
+static uint16_t held = 0;
+
+static bool connected = false;
+static uint16_t interval; // 1.25 ms units
+
+bool flash_sched_open(void) {
+	return !connected || interval * 5 >= FLASH_SCHED_MIN_INTERVAL_MS * 4;
+}
+
+static void on_tick(void) {
+	uint16_t run;
+
+	if (pending == 0) {
+		tick_idle(task);
+		return;
+	}
+	if (!flash_sched_open() && ++held < FLASH_SCHED_MAX_HOLD_S * 1000 / FLASH_SCHED_TICK_MS) {
+		return;
+	}
+	// Jobs may ask again from inside, for the next opening
+	run = pending;
+	pending = 0;
+	held = 0;
+	for (uint8_t i = 0; i < job_count; i++) {
+		if (run & (1 << i)) {
+			jobs[i]();
+		}
+	}
+}
+
+void flash_sched_init(void) {
+	task = tick_register(on_tick, FLASH_SCHED_TICK_MS, 0);
+	tick_idle(task);
+}
+
+void flash_sched_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+	switch (p_ble_evt->header.evt_id) {
+		case BLE_GAP_EVT_CONNECTED:
+			connected = true;
+			interval = p_gap->params.connected.conn_params.max_conn_interval;
+			break;
+
+		case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+			interval = p_gap->params.conn_param_update.conn_params.max_conn_interval;
+			break;
+
+		case BLE_GAP_EVT_DISCONNECTED:
+			connected = false;
+			break;
+
+		default:
+			break;
+	}
+}
+
+uint8_t flash_sched_register(flash_sched_job_t job) {
+	if (job_count == FLASH_SCHED_MAX_JOBS) {
+		return FLASH_SCHED_INVALID;
+	}
+	jobs[job_count] = job;
+	return job_count++;
+}
+
+void flash_sched_request(uint8_t id) {
+	if (id < job_count) {
+		pending |= (1 << id);
+		tick_wake(task);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef _FLASH_SCHED_H_
+#define _FLASH_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// App flash work (journal, run hours, history, schedule, scenes, the
+// config store) held until the link leaves room for it, then let go in
+// one batch so it lands back to back in the same quiet stretch.
+//
+// The SoftDevice only starts a flash operation in a gap between radio
+// events it fits in, so connection events are never dropped for it, but
+// a page erase is up to 22.3 ms: on a shorter interval it can't fit,
+// the operation fails, and after three tries pstorage stalls its queue
+// until reset. Radio notifications (ble_radio_notification) would time
+// this more finely but need SWI1, which esb_rx has; ESB timeslots
+// already leave an erase sized gap (esb_rx.h).
+//
+// So work waits while connected on an interval under
+// FLASH_SCHED_MIN_INTERVAL_MS, which in practice is the burst profile
+// (conn_profile.h) during transitions and transfers; auto drops to idle
+// soon after. Work held FLASH_SCHED_MAX_HOLD_S, with a forced burst
+// profile, goes anyway.
+#define FLASH_SCHED_MAX_JOBS 8
+#define FLASH_SCHED_TICK_MS 100
+#define FLASH_SCHED_MIN_INTERVAL_MS 30
+#define FLASH_SCHED_MAX_HOLD_S 60
+#define FLASH_SCHED_INVALID 0xFF
+
+// Starts its pstorage operations, and copes with them being refused
+typedef void (*flash_sched_job_t)(void);
+
+// After tick_init()
+void flash_sched_init(void);
+void flash_sched_on_ble_evt(ble_evt_t * p_ble_evt);
+
+// Any time, jobs run in registration order. Returns a job id, or
+// FLASH_SCHED_INVALID when full.
+uint8_t flash_sched_register(flash_sched_job_t job);
+// Run the job at the next opening, once however often it's asked for
+void flash_sched_request(uint8_t id);
+// True if flash work started now would fit around the radio
+bool flash_sched_open(void);
+
+#endif
@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "gamma.h"
+
+static const uint16_t * const tables[GAMMA_CURVE_COUNT] = {
+	[GAMMA_LINEAR]  = NULL,
+	[GAMMA_2_2]     = gamma_table_22,
+	[GAMMA_CIE1931] = gamma_table_cie1931,
+};
+
+static uint8_t curves[GAMMA_NUM_CHANNELS];
+
+void gamma_set_curve(uint8_t channel, gamma_curve_t curve) {
+	if (channel >= GAMMA_NUM_CHANNELS || curve >= GAMMA_CURVE_COUNT) return;
+	curves[channel] = curve;
+}
+
+gamma_curve_t gamma_curve(uint8_t channel) {
+	return (gamma_curve_t)curves[channel];
+}
+
+bool gamma_uniform(void) {
+	for (uint8_t i = 1; i < GAMMA_NUM_CHANNELS; i++) {
+		if (curves[i] != curves[0]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint16_t gamma_apply(uint8_t channel, uint16_t level) {
+	uint16_t const * p_table = tables[curves[channel]];
+
+	if (level >= GAMMA_TABLE_SIZE) level = GAMMA_TABLE_SIZE - 1;
+	return p_table ? p_table[level] : level;
+}
+
+uint16_t gamma_apply_fine(uint8_t channel, uint32_t level) {
+	uint16_t const * p_table = tables[curves[channel]];
+	uint16_t index = level >> 16;
+	uint16_t frac = (level >> 12) & 0xF;
+
+	if (index >= GAMMA_TABLE_SIZE - 1) {
+		return gamma_apply(channel, index) << 4;
+	}
+	if (!p_table) {
+		return (index << 4) | frac;
+	}
+	return (p_table[index] << 4) + (((int32_t)p_table[index + 1] - p_table[index]) * frac);
+}
+
+void gamma_init(void) {
+	for (uint8_t i = 0; i < GAMMA_NUM_CHANNELS; i++) {
+		curves[i] = GAMMA_DEFAULT_CURVE;
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef _GAMMA_H_
+#define _GAMMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+
+// One entry per 12 bit level
+#define GAMMA_TABLE_SIZE 4096
+#define GAMMA_NUM_CHANNELS PCA9685_NUM_LEDS
+
+typedef enum {
+	GAMMA_LINEAR = 0,
+	GAMMA_2_2,
+	GAMMA_CIE1931,
+	GAMMA_CURVE_COUNT
+} gamma_curve_t;
+
+// Curve every channel starts with. Linear keeps existing schedules,
+// which were tuned against raw duty cycle, looking the same.
+#define GAMMA_DEFAULT_CURVE GAMMA_LINEAR
+
+// Tables live in flash, generated by gamma_gen.py into gamma_table.c
+extern const uint16_t gamma_table_22[GAMMA_TABLE_SIZE];
+extern const uint16_t gamma_table_cie1931[GAMMA_TABLE_SIZE];
+
+void gamma_init(void);
+
+void gamma_set_curve(uint8_t channel, gamma_curve_t curve);
+gamma_curve_t gamma_curve(uint8_t channel);
+// True if every channel uses the same curve
+bool gamma_uniform(void);
+
+// Map a 0-4095 level to the output duty cycle for a channel
+uint16_t gamma_apply(uint8_t channel, uint16_t level);
+// Same for a 16.16 level, interpolated between entries to a 12.4 duty
+uint16_t gamma_apply_fine(uint8_t channel, uint32_t level);
+
+#endif
@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+# Generates gamma_table.c, the lookup tables used by gamma.c to map
+# linear channel levels onto perceptual brightness curves.
+#
+#   python gamma_gen.py > gamma_table.c
+
+import sys
+
+SIZE = 4096
+MAX = SIZE - 1
+
+
+def gamma22(x):
+    return x ** 2.2
+
+
+def cie1931(x):
+    # Inverse of CIE 1931 lightness, x is L* / 100
+    l = x * 100.0
+    if l <= 8.0:
+        return l / 903.3
+    return ((l + 16.0) / 116.0) ** 3
+
+
+def table(name, curve):
+    out = ["const uint16_t %s[GAMMA_TABLE_SIZE] = {" % name]
+    values = [int(round(curve(float(i) / MAX) * MAX)) for i in range(SIZE)]
+    for i in range(0, SIZE, 16):
+        out.append("\t" + ", ".join("%4d" % v for v in values[i:i + 16]) + ",")
+    out.append("};")
+    return "\n".join(out)
+
+
+def main():
+    w = sys.stdout.write
+    w("// Generated by gamma_gen.py, do not edit\n\n")
+    w("#include <stdint.h>\n")
+    w("#include \"gamma.h\"\n\n")
+    w(table("gamma_table_22", gamma22) + "\n\n")
+    w(table("gamma_table_cie1931", cie1931) + "\n")
+
+
+if __name__ == "__main__":
+    main()
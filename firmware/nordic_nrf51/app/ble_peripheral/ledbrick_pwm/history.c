@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_util.h"
+#include "crc16.h"
+#include "clock.h"
+#include "bulk.h"
+#include "flash_ring.h"
+#include "flash_sched.h"
+#include "history.h"
+
+#define OFF_SEQ 0
+#define OFF_TIME 4
+#define OFF_UPTIME 8
+#define OFF_TEMP 12
+#define OFF_RPM 14
+#define OFF_DERATE 16
+#define OFF_COUNT 17
+#define OFF_SAMPLES 18
+#define OFF_CRC (HISTORY_BLOCK_LEN - 2)
+// Longest sample: header, two three byte varints and the derate
+#define SAMPLE_MAX 8
+#define REPLY_HEADER_LEN 6
+
+// Word aligned for pstorage
+static uint32_t ram[HISTORY_RAM_BLOCKS][HISTORY_BLOCK_LEN / 4];
+
+// Block being filled, and the first one this boot
+static uint32_t seq;
+static uint32_t boot_seq;
+static uint8_t fill = 0;
+static bool open = false;
+// Last sample, each added as the change from it
+static int16_t last_temp;
+static uint16_t last_rpm;
+static uint8_t last_derate;
+static uint32_t last_sample_s;
+// Blocks from before the clock was set get their time once it is
+static bool stamped = false;
+
+static uint8_t * ram_block(uint32_t s) {
+	return (uint8_t *)ram[s % HISTORY_RAM_BLOCKS];
+}
+
+static uint16_t block_crc(uint8_t const * p_block) {
+	return crc16_compute(p_block, OFF_CRC, NULL);
+}
+
+// Oldest block in RAM
+static uint32_t ram_low(void) {
+	if (seq - boot_seq >= HISTORY_RAM_BLOCKS) {
+		return seq - HISTORY_RAM_BLOCKS + 1;
+	}
+	return boot_seq;
+}
+
+static uint8_t zigzag_put(int32_t v, uint8_t * p_out) {
+	uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+	uint8_t n = 0;
+
+	while (z >= 0x80) {
+		p_out[n++] = (uint8_t)(z | 0x80);
+		z >>= 7;
+	}
+	p_out[n++] = (uint8_t)z;
+	return n;
+}
+
+#if HISTORY_FLASH_PAGES > 0
+static flash_ring_t ring;
+static uint32_t pending[HISTORY_BLOCK_LEN / 4]; // Stays put until the store completes
+// Next closed block to go to flash
+static uint32_t spilled = 0;
+static uint8_t spill_job = FLASH_SCHED_INVALID;
+
+static bool flash_valid(void const * p_block) {
+	return uint16_decode(&((uint8_t const *)p_block)[OFF_CRC]) == block_crc(p_block);
+}
+
+static void on_stored(void) {
+	if (spilled < seq) {
+		flash_sched_request(spill_job);
+	}
+}
+
+static void flash_spill(void);
+
+static void flash_init(void) {
+	uint8_t const * p_newest = flash_ring_init(&ring, HISTORY_FLASH_PAGES, HISTORY_BLOCK_LEN,
+	                                           flash_valid, on_stored);
+
+	if (ring.registered) {
+		spill_job = flash_sched_register(flash_spill);
+	}
+	if (p_newest != NULL) {
+		seq = uint32_decode(&p_newest[OFF_SEQ]) + 1;
+	}
+}
+
+// Appends the oldest closed block not yet in flash, when flash_sched.h
+// lets it, and the next once that's stored. Best effort, any that drop
+// out of the RAM ring while the radio is busy stay out.
+static void flash_spill(void) {
+	if (spilled < ram_low()) {
+		spilled = ram_low();
+	}
+	if (!flash_ring_ready(&ring) || spilled >= seq) {
+		return;
+	}
+	memcpy(pending, ram_block(spilled), sizeof(pending));
+	if (flash_ring_append(&ring, pending)) {
+		spilled++;
+	}
+}
+
+static void flash_request(void) {
+	flash_sched_request(spill_job);
+}
+
+// The oldest block in flash numbered from s, before the RAM ring
+static uint8_t const * flash_find(uint32_t s) {
+	uint8_t const * p_best = NULL;
+	uint32_t best = 0;
+
+	for (uint16_t i = 0; i < flash_ring_records(&ring); i++) {
+		uint8_t const * p_block = flash_ring_at(&ring, i);
+		uint32_t n = uint32_decode(&p_block[OFF_SEQ]);
+		if (n == FLASH_RING_ERASED || n < s || n >= ram_low() || (p_best != NULL && n >= best)) {
+			continue;
+		}
+		if (flash_valid(p_block)) {
+			p_best = p_block;
+			best = n;
+		}
+	}
+	return p_best;
+}
+#else
+static void flash_init(void) {}
+static void flash_request(void) {}
+static uint8_t const * flash_find(uint32_t s) { return NULL; }
+#endif
+
+void history_init(void) {
+	seq = 0;
+	flash_init();
+	boot_seq = seq;
+}
+
+static void block_open(int16_t temp, uint16_t rpm, uint8_t derate, uint32_t uptime) {
+	uint8_t * p_block = ram_block(seq);
+
+	memset(p_block, 0xFF, HISTORY_BLOCK_LEN);
+	uint32_encode(seq, &p_block[OFF_SEQ]);
+	uint32_encode(clock_is_set() ? clock_time() : 0, &p_block[OFF_TIME]);
+	uint32_encode(uptime, &p_block[OFF_UPTIME]);
+	uint16_encode((uint16_t)temp, &p_block[OFF_TEMP]);
+	uint16_encode(rpm, &p_block[OFF_RPM]);
+	p_block[OFF_DERATE] = derate;
+	p_block[OFF_COUNT] = 1;
+	fill = OFF_SAMPLES;
+	open = true;
+}
+
+static void block_close(void) {
+	uint8_t * p_block = ram_block(seq);
+
+	uint16_encode(block_crc(p_block), &p_block[OFF_CRC]);
+	seq++;
+	open = false;
+	flash_request();
+}
+
+// Once the clock is set, blocks from this boot started without it are
+// placed from their uptime
+static void stamp(void) {
+	uint32_t now = clock_time();
+	uint32_t uptime = clock_uptime();
+
+	for (uint32_t s = ram_low(); s <= seq; s++) {
+		uint8_t * p_block = ram_block(s);
+		if ((s == seq && !open) || uint32_decode(&p_block[OFF_TIME]) != 0) {
+			continue;
+		}
+		uint32_encode(now - (uptime - uint32_decode(&p_block[OFF_UPTIME])), &p_block[OFF_TIME]);
+		if (s != seq) {
+			uint16_encode(block_crc(p_block), &p_block[OFF_CRC]);
+		}
+	}
+	stamped = true;
+}
+
+void history_update(bool temp_valid, int16_t temp, uint16_t rpm, uint8_t derate, uint32_t uptime) {
+	uint8_t sample[SAMPLE_MAX];
+	uint8_t n = 1;
+
+	if (!stamped && clock_is_set()) {
+		stamp();
+	}
+	if (open && uptime - last_sample_s < HISTORY_INTERVAL_S) {
+		return;
+	}
+	if (!temp_valid) {
+		temp = HISTORY_TEMP_NONE;
+	}
+
+	if (open) {
+		int32_t dt = (int32_t)temp - last_temp;
+
+		if (dt > HISTORY_TEMP_ESCAPE && dt < -HISTORY_TEMP_ESCAPE) {
+			sample[0] = (uint8_t)dt & 0x1F;
+		} else {
+			sample[0] = (uint8_t)HISTORY_TEMP_ESCAPE & 0x1F;
+			n += zigzag_put(dt, &sample[n]);
+		}
+		if (rpm != last_rpm) {
+			sample[0] |= HISTORY_FAN_CHANGED;
+			n += zigzag_put((int32_t)rpm - last_rpm, &sample[n]);
+		}
+		if (derate != last_derate) {
+			sample[0] |= HISTORY_DERATE_CHANGED;
+			sample[n++] = derate;
+		}
+
+		uint8_t * p_block = ram_block(seq);
+		if (fill + n <= OFF_CRC && p_block[OFF_COUNT] < UINT8_MAX) {
+			memcpy(&p_block[fill], sample, n);
+			fill += n;
+			p_block[OFF_COUNT]++;
+		} else {
+			block_close();
+		}
+	}
+	if (!open) {
+		block_open(temp, rpm, derate, uptime);
+	}
+	last_temp = temp;
+	last_rpm = rpm;
+	last_derate = derate;
+	last_sample_s = uptime;
+}
+
+bool history_read(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+	uint16_t out = REPLY_HEADER_LEN;
+	uint32_t s;
+
+	if (len < 4) {
+		return false;
+	}
+	s = uint32_decode(p_body);
+	if (s > seq) {
+		// From before a reset that lost the log, start over
+		s = 0;
+	}
+	uint32_encode(seq, &p_reply[0]);
+	uint16_encode(HISTORY_INTERVAL_S, &p_reply[4]);
+
+	while (s <= seq && (s < seq || open) && out + HISTORY_BLOCK_LEN <= BULK_MAX_REPLY) {
+		uint8_t const * p_block;
+
+		if (s >= ram_low()) {
+			p_block = ram_block(s);
+		} else if ((p_block = flash_find(s)) == NULL) {
+			s = ram_low();
+			continue;
+		}
+		memcpy(&p_reply[out], p_block, HISTORY_BLOCK_LEN);
+		out += HISTORY_BLOCK_LEN;
+		s = uint32_decode(&p_block[OFF_SEQ]) + 1;
+	}
+	*p_reply_len = out;
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Temperature, fan and derate kept on the brick while no controller is
+// listening, so a reconnect fills the gap in a few bulk frames
+// (BULK_CMD_HISTORY, bulk.h). A sample is taken every
+// HISTORY_INTERVAL_S into fixed size blocks, each delta encoded from
+// its own first sample so it reads back alone. Full blocks stay in a
+// RAM ring and, in builds with HISTORY_FLASH_PAGES set
+// (pstorage_platform.h), are also appended to a ring of flash pages
+// that outlasts a reset.
+//
+// Block layout, HISTORY_BLOCK_LEN bytes:
+//   0  sequence number (uint32 LE), counting up across the log
+//   4  local wall time of the first sample (uint32 LE, clock.h), 0 if
+//      the clock wasn't set
+//   8  uptime of the first sample (uint32 LE, seconds)
+//  12  first temperature (int16 LE, 1/16 degree C, HISTORY_TEMP_NONE
+//      without a reading), fan rpm (uint16 LE) and derate (uint8)
+//  17  sample count, the first included (uint8)
+//  18  the rest of the samples, each a header byte then what it flags:
+//        bits 0-4  temperature change, signed, or HISTORY_TEMP_ESCAPE
+//                  for a zigzag varint change following
+//        bit 5     a zigzag varint fan change follows
+//        bit 6     the new derate (uint8) follows
+//  62  CRC16 of bytes 0-61 (uint16 LE), left erased while the block is
+//      being filled
+#define HISTORY_INTERVAL_S 60
+#define HISTORY_BLOCK_LEN 64
+// About four hours of samples
+#define HISTORY_RAM_BLOCKS 16
+
+#define HISTORY_TEMP_NONE INT16_MIN
+#define HISTORY_TEMP_ESCAPE (-16)
+#define HISTORY_FAN_CHANGED (1 << 5)
+#define HISTORY_DERATE_CHANGED (1 << 6)
+
+// Needs pstorage_init() to have run
+void history_init(void);
+
+// Call regularly, a sample is kept once the interval has passed
+void history_update(bool temp_valid, int16_t temp, uint16_t rpm, uint8_t derate, uint32_t uptime);
+
+// Bulk read from the block numbered by p_body (uint32 LE), or the oldest
+// kept if that's gone. Reply: the sequence number of the block being
+// filled (uint32 LE) and the sample interval (uint16 LE, seconds), then
+// whole blocks in order up to and including that one, as many as fit.
+bool history_read(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len);
+
+#endif
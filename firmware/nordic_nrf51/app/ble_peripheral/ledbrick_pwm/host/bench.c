@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ble_lbs.h"
+#include "pca9685.h"
+#include "mcp9808.h"
+#include "fan_monitor.h"
+#include "twi_queue.h"
+#include "fake_twi.h"
+#include "fake_hw.h"
+#include "fake_ble.h"
+#include "fake_app.h"
+
+// Microbenchmarks: each operation runs BENCH_RUNS times over the fakes,
+// for the TWI bytes and jobs it puts on the bus, the notification bytes
+// it sends and the time it takes, each per run. The bus and GATT numbers
+// are what a brick puts on the air and the wire, and are what protocol
+// changes are held to. The times take in the fakes, and a host core is
+// nothing like a Cortex-M0, so they only compare one build with another.
+
+#define BENCH_RUNS 20000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_UNIT "cycles"
+// The builtin, as x86intrin.h clashes with the CMSIS __I
+static uint64_t bench_time(void) {
+	return __builtin_ia32_rdtsc();
+}
+#else
+#include <time.h>
+#define BENCH_UNIT "ns"
+static uint64_t bench_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#define TACH_PIN 8
+
+static ble_lbs_t lbs;
+static uint32_t tach_now;
+
+typedef struct {
+	char const * p_name;
+	void (*run)(uint32_t i);
+} bench_t;
+
+static uint32_t twi_bytes(void) {
+	uint32_t bytes = 0;
+
+	for (twi_class_t c = 0; c < TWI_CLASS_COUNT; c++) {
+		twi_class_stats_t stats;
+
+		twi_queue_stats(c, &stats);
+		bytes += stats.bytes;
+	}
+	return bytes;
+}
+
+static uint32_t twi_jobs(void) {
+	uint32_t jobs = 0;
+
+	for (twi_class_t c = 0; c < TWI_CLASS_COUNT; c++) {
+		twi_class_stats_t stats;
+
+		twi_queue_stats(c, &stats);
+		jobs += stats.jobs;
+	}
+	return jobs;
+}
+
+// Levels moving every run, so each is a real change
+static uint16_t level_at(uint32_t i, uint8_t ch) {
+	return 100 + ((i * 37 + ch * 512) % 3900);
+}
+
+// As main.c, straight to the driver without a fade
+static void on_frame(ble_lbs_t * p_lbs, uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+	for (uint8_t ch = 0; ch < BOARD_LED_CHANNELS; ch++) {
+		if (mask & (1 << ch)) {
+			pca9685_set_led(ch, 0, p_levels[ch]);
+		}
+	}
+	pca9685_flush();
+}
+
+static void on_led(ble_lbs_t * p_lbs, uint8_t led, uint16_t level) {
+	pca9685_write_led(led, 0, level);
+}
+
+static void run_last_channel(uint32_t i) {
+	pca9685_write_led(BOARD_LED_CHANNELS - 1, 0, level_at(i, 0));
+	fake_twi_run();
+}
+
+static void run_first_channel(uint32_t i) {
+	pca9685_write_led(0, 0, level_at(i, 0) / BOARD_LED_CHANNELS);
+	fake_twi_run();
+}
+
+static void run_full_frame(uint32_t i) {
+	for (uint8_t ch = 0; ch < BOARD_LED_CHANNELS; ch++) {
+		pca9685_set_led(ch, 0, level_at(i, ch) / BOARD_LED_CHANNELS);
+	}
+	pca9685_flush();
+	fake_twi_run();
+}
+
+static void run_state_hash(uint32_t i) {
+	(void)pca9685_state_hash();
+}
+
+static void run_temp_sample(uint32_t i) {
+	(void)mcp9808_sample(NULL);
+	fake_twi_run();
+}
+
+static void run_fan_stats(uint32_t i) {
+	fantach_stats_t stats;
+
+	tach_now += 781 + (i % 7);
+	fake_timer_set(2, tach_now & 0xFFFF);
+	fake_gpio_input(TACH_PIN, true);
+	fake_gpio_input(TACH_PIN, false);
+	fantach_stats(0, &stats);
+}
+
+static void run_level_command(uint32_t i) {
+	uint16_t level = level_at(i, 0);
+	uint8_t const write[] = { LBS_CMD_VERSION, (uint8_t)i, LBS_CMD_OP_LEVEL, 3,
+	                          BOARD_LED_CHANNELS - 1, level & 0xFF, level >> 8 };
+
+	fake_ble_write(&lbs, lbs.command_char_handles.value_handle, write, sizeof(write));
+	fake_twi_run();
+}
+
+// Every channel in one packed frame, what a schedule step sends
+static void run_packed_frame(uint32_t i) {
+	uint8_t write[2 + 2 + 4 + (BOARD_LED_CHANNELS * 3 + 1) / 2] = {
+		LBS_CMD_VERSION, (uint8_t)i, LBS_CMD_OP_FRAME_PACKED, sizeof(write) - 4,
+		(1 << BOARD_LED_CHANNELS) - 1, 0, 0, 0,
+	};
+
+	for (uint8_t ch = 0; ch < BOARD_LED_CHANNELS; ch += 2) {
+		uint16_t a = level_at(i, ch) / BOARD_LED_CHANNELS;
+		uint16_t b = level_at(i, ch + 1) / BOARD_LED_CHANNELS;
+		uint8_t * p_pair = &write[8 + (ch / 2) * 3];
+
+		p_pair[0] = a & 0xFF;
+		p_pair[1] = (a >> 8) | ((b & 0x0F) << 4);
+		p_pair[2] = b >> 4;
+	}
+	fake_ble_write(&lbs, lbs.command_char_handles.value_handle, write, sizeof(write));
+	fake_twi_run();
+}
+
+static bench_t const benches[] = {
+	{ "pca9685 last channel", run_last_channel },
+	{ "pca9685 first channel", run_first_channel },
+	{ "pca9685 full frame", run_full_frame },
+	{ "pca9685 state hash", run_state_hash },
+	{ "mcp9808 sample", run_temp_sample },
+	{ "fan tach edge + stats", run_fan_stats },
+	{ "lbs level command", run_level_command },
+	{ "lbs packed frame", run_packed_frame },
+};
+
+static void setup(void) {
+	ble_lbs_init_t init;
+
+	fake_twi_reset();
+	fake_hw_reset();
+	fake_ble_reset();
+	fake_app_reset();
+
+	(void)fake_twi_pca9685(0x7F);
+	(void)fake_twi_mcp9808(0x1F);
+	(void)pca9685_init();
+	(void)mcp9808_init(MCP9808_DEFAULT_RESOLUTION);
+	fantach_init();
+	fake_twi_run();
+
+	memset(&init, 0, sizeof(init));
+	init.led_write_handler = on_led;
+	init.frame_write_handler = on_frame;
+	init.channels = BOARD_LED_CHANNELS;
+	(void)ble_lbs_init(&lbs, &init);
+	fake_ble_connect(&lbs);
+	fake_ble_subscribe(&lbs, &lbs.command_char_handles);
+}
+
+int main(void) {
+	setup();
+	printf("%-24s %10s %10s %10s %10s\n", "operation", "TWI bytes", "TWI jobs", "GATT bytes", BENCH_UNIT);
+	for (uint8_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+		uint32_t bytes = twi_bytes();
+		uint32_t jobs = twi_jobs();
+		uint32_t gatt = fake_ble_bytes();
+		uint64_t start = bench_time();
+
+		for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+			benches[b].run(i);
+		}
+		uint64_t elapsed = bench_time() - start;
+
+		printf("%-24s %10.1f %10.2f %10.1f %10.0f\n", benches[b].p_name,
+		       (double)(twi_bytes() - bytes) / BENCH_RUNS,
+		       (double)(twi_jobs() - jobs) / BENCH_RUNS,
+		       (double)(fake_ble_bytes() - gatt) / BENCH_RUNS,
+		       (double)elapsed / BENCH_RUNS);
+	}
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+// One thread and no interrupts on the host, so critical regions are
+// only counted
+
+#include <stdint.h>
+#include "compiler_abstraction.h"
+#include <nrf51.h>  // Searched for, so fake/nrf51.h can include_next the SDK's
+#include "nrf_soc.h"
+#include "app_error.h"
+
+typedef enum
+{
+	APP_IRQ_PRIORITY_HIGH = 1,
+	APP_IRQ_PRIORITY_LOW  = 3
+} app_irq_priority_t;
+
+#define NRF_APP_PRIORITY_THREAD 4
+
+#define PACKED(TYPE) __packed TYPE
+
+extern uint32_t fake_critical_regions;
+
+#define CRITICAL_REGION_ENTER() { fake_critical_regions++;
+#define CRITICAL_REGION_EXIT() }
+
+static __INLINE uint8_t current_int_priority_get(void)
+{
+	return NRF_APP_PRIORITY_THREAD;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "pstorage.h"
+#include "error_handlers.h"
+#include "clock.h"
+#include "tick.h"
+#include "flash_sched.h"
+#include "fake_app.h"
+
+// The rest of the app, as far as the modules under test call into it.
+// Errors raised stay present until the next reset. Ticks and flash jobs
+// never run by themselves, and flash reads as erased.
+
+static uint32_t raised;
+static bool clock_known;
+static uint32_t time_of_day;
+static fake_fade_t fade;
+
+void fake_app_reset(void) {
+	raised = 0;
+	clock_known = false;
+	memset(&fade, 0, sizeof(fade));
+}
+
+void error_raise(error_e error, int16_t value) {
+	raised |= 1UL << error;
+}
+
+bool error_present(error_e error) {
+	return (raised >> error) & 1;
+}
+
+void fake_clock_set(uint32_t new_time_of_day) {
+	clock_known = true;
+	time_of_day = new_time_of_day;
+}
+
+bool clock_is_set(void) {
+	return clock_known;
+}
+
+uint32_t clock_time_of_day(void) {
+	return time_of_day;
+}
+
+uint8_t tick_register(tick_handler_t handler, uint32_t period_ms, uint32_t phase_ms) {
+	return 0;
+}
+
+void tick_restart(uint8_t id) {
+}
+
+fake_fade_t const * fake_fade_last(void) {
+	return &fade;
+}
+
+void fade_frame(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+	fade.frames++;
+	fade.mask = mask;
+	memcpy(fade.levels, p_levels, sizeof(fade.levels));
+	fade.duration_ms = duration_ms;
+}
+
+uint16_t fade_target(uint8_t channel) {
+	return 0;
+}
+
+uint8_t flash_sched_register(flash_sched_job_t job) {
+	return 0;
+}
+
+void flash_sched_request(uint8_t id) {
+}
+
+uint32_t pstorage_register(pstorage_module_param_t * p_module_param, pstorage_handle_t * p_block_id) {
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_load(uint8_t * p_dest, pstorage_handle_t * p_src, pstorage_size_t size, pstorage_size_t offset) {
+	memset(p_dest, 0xFF, size);
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_update(pstorage_handle_t * p_dest, uint8_t * p_src, pstorage_size_t size, pstorage_size_t offset) {
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_clear(pstorage_handle_t * p_base_id, pstorage_size_t size) {
+	return NRF_SUCCESS;
+}
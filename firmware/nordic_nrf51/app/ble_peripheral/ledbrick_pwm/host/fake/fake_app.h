@@ -0,0 +1,24 @@
+#ifndef FAKE_APP_H
+#define FAKE_APP_H
+
+#include <stdint.h>
+#include "fade.h"
+
+// error_handlers.h, keeping what was raised for error_present(), and
+// the clock, tick, fade, flash_sched and pstorage calls schedule.c makes
+void fake_app_reset(void);
+
+// clock.h, unset until a time of day is given
+void fake_clock_set(uint32_t time_of_day);
+
+// The latest fade_frame()
+typedef struct {
+	uint32_t frames;
+	uint16_t mask;
+	uint16_t levels[FADE_NUM_CHANNELS];
+	uint16_t duration_ms;
+} fake_fade_t;
+
+fake_fade_t const * fake_fade_last(void);
+
+#endif
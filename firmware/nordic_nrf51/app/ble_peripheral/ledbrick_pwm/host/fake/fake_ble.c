@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <string.h>
+#include "ble.h"
+#include "ble_gatts.h"
+#include "ble_lbs.h"
+#include "fake_ble.h"
+
+// Past the GATT and GAP services the SoftDevice adds
+#define FIRST_HANDLE 0x000C
+
+static uint16_t next_handle;
+static uint8_t buffers;
+static uint8_t buffers_used;
+static uint32_t notifications;
+static uint32_t bytes;
+static fake_ble_hvx_t last;
+
+// Room behind the event for the longest write
+static union {
+	ble_evt_t evt;
+	uint8_t raw[sizeof(ble_evt_t) + FAKE_BLE_MAX_WRITE];
+} evt_buf;
+
+void fake_ble_reset(void) {
+	next_handle = FIRST_HANDLE;
+	buffers = 0;
+	buffers_used = 0;
+	notifications = 0;
+	bytes = 0;
+	memset(&last, 0, sizeof(last));
+}
+
+void fake_ble_connect(ble_lbs_t * p_lbs) {
+	memset(&evt_buf, 0, sizeof(evt_buf));
+	evt_buf.evt.header.evt_id = BLE_GAP_EVT_CONNECTED;
+	evt_buf.evt.evt.gap_evt.conn_handle = FAKE_BLE_CONN_HANDLE;
+	ble_lbs_on_ble_evt(p_lbs, &evt_buf.evt);
+}
+
+void fake_ble_disconnect(ble_lbs_t * p_lbs) {
+	memset(&evt_buf, 0, sizeof(evt_buf));
+	evt_buf.evt.header.evt_id = BLE_GAP_EVT_DISCONNECTED;
+	evt_buf.evt.evt.gap_evt.conn_handle = FAKE_BLE_CONN_HANDLE;
+	ble_lbs_on_ble_evt(p_lbs, &evt_buf.evt);
+}
+
+void fake_ble_write(ble_lbs_t * p_lbs, uint16_t handle, uint8_t const * p_data, uint16_t len) {
+	ble_gatts_evt_write_t * p_write = &evt_buf.evt.evt.gatts_evt.params.write;
+
+	memset(&evt_buf, 0, sizeof(evt_buf));
+	evt_buf.evt.header.evt_id = BLE_GATTS_EVT_WRITE;
+	evt_buf.evt.evt.gatts_evt.conn_handle = FAKE_BLE_CONN_HANDLE;
+	p_write->handle = handle;
+	p_write->op = BLE_GATTS_OP_WRITE_CMD;
+	p_write->len = (len < FAKE_BLE_MAX_WRITE) ? len : FAKE_BLE_MAX_WRITE;
+	memcpy(p_write->data, p_data, p_write->len);
+	ble_lbs_on_ble_evt(p_lbs, &evt_buf.evt);
+}
+
+void fake_ble_subscribe(ble_lbs_t * p_lbs, ble_gatts_char_handles_t const * p_handles) {
+	uint8_t const cccd[2] = { BLE_GATT_HVX_NOTIFICATION, 0 };
+
+	fake_ble_write(p_lbs, p_handles->cccd_handle, cccd, sizeof(cccd));
+}
+
+void fake_ble_tx_complete(ble_lbs_t * p_lbs) {
+	buffers_used = 0;
+	memset(&evt_buf, 0, sizeof(evt_buf));
+	evt_buf.evt.header.evt_id = BLE_EVT_TX_COMPLETE;
+	evt_buf.evt.evt.common_evt.conn_handle = FAKE_BLE_CONN_HANDLE;
+	ble_lbs_on_ble_evt(p_lbs, &evt_buf.evt);
+}
+
+void fake_ble_tx_buffers(uint8_t n) {
+	buffers = n;
+}
+
+uint32_t fake_ble_notifications(void) {
+	return notifications;
+}
+
+uint32_t fake_ble_bytes(void) {
+	return bytes;
+}
+
+fake_ble_hvx_t const * fake_ble_last(void) {
+	return &last;
+}
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type) {
+	*p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle) {
+	*p_handle = next_handle++;
+	return NRF_SUCCESS;
+}
+
+// Declaration, value, then the descriptors asked for
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const * p_char_md,
+                                         ble_gatts_attr_t const * p_attr_char_value,
+                                         ble_gatts_char_handles_t * p_handles) {
+	memset(p_handles, 0, sizeof(*p_handles));
+	next_handle++;
+	p_handles->value_handle = next_handle++;
+	if (p_char_md->char_props.notify || p_char_md->char_props.indicate) {
+		p_handles->cccd_handle = next_handle++;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle,
+                                         ble_gatts_rw_authorize_reply_params_t const * p_rw_authorize_reply_params) {
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params) {
+	uint16_t len = *p_hvx_params->p_len;
+
+	if (conn_handle != FAKE_BLE_CONN_HANDLE) {
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	if (buffers != 0 && buffers_used == buffers) {
+		return BLE_ERROR_NO_TX_BUFFERS;
+	}
+	buffers_used++;
+	notifications++;
+	bytes += len;
+	last.handle = p_hvx_params->handle;
+	last.len = len;
+	// A value in application RAM goes as it is, which a test reads there
+	if (p_hvx_params->p_data != NULL) {
+		memcpy(last.data, p_hvx_params->p_data, (len < sizeof(last.data)) ? len : sizeof(last.data));
+	}
+	return NRF_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#ifndef FAKE_BLE_H
+#define FAKE_BLE_H
+
+#include <stdint.h>
+#include "ble_lbs.h"
+
+// The SoftDevice's GATT server as ble_lbs.c uses it: handles are handed
+// out in order, and notifications are counted and kept rather than sent.
+// Events reach the service the way main.c passes them on.
+
+#define FAKE_BLE_CONN_HANDLE 1
+#define FAKE_BLE_MAX_WRITE 256
+
+void fake_ble_reset(void);
+
+void fake_ble_connect(ble_lbs_t * p_lbs);
+void fake_ble_disconnect(ble_lbs_t * p_lbs);
+void fake_ble_write(ble_lbs_t * p_lbs, uint16_t handle, uint8_t const * p_data, uint16_t len);
+// Turns notifications on through a CCCD
+void fake_ble_subscribe(ble_lbs_t * p_lbs, ble_gatts_char_handles_t const * p_handles);
+// Frees the buffers, as the SoftDevice does after a connection event
+void fake_ble_tx_complete(ble_lbs_t * p_lbs);
+
+// Notifications the SoftDevice takes before running out of buffers
+// until the next tx complete, 0 for no limit
+void fake_ble_tx_buffers(uint8_t buffers);
+
+typedef struct {
+	uint16_t handle;
+	uint16_t len;
+	uint8_t data[LBS_TX_MAX_LEN];
+} fake_ble_hvx_t;
+
+// Notifications taken since the reset, their value bytes, and the last
+uint32_t fake_ble_notifications(void);
+uint32_t fake_ble_bytes(void);
+fake_ble_hvx_t const * fake_ble_last(void);
+
+#endif
@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_drv_ppi.h"
+#include "nrf_drv_timer.h"
+#include "fake_hw.h"
+
+#define GPIOTE_CHANNELS 4
+#define PPI_CHANNELS 16
+#define PPI_GROUPS 4
+#define TIMERS 3
+#define PINS 32
+#define NO_CHANNEL 0xFF
+
+NRF_GPIO_Type fake_gpio;
+NRF_GPIOTE_Type fake_gpiote;
+NRF_PPI_Type fake_ppi;
+NRF_TIMER_Type fake_timer[TIMERS];
+
+uint32_t fake_critical_regions;
+uint32_t fake_delay_us;
+
+typedef struct {
+	nrf_drv_gpiote_evt_handler_t handler;
+	nrf_gpiote_polarity_t sense;
+	uint8_t channel;  // GPIOTE channel, NO_CHANNEL for the port event
+	bool input;
+	bool enabled;
+} pin_t;
+
+static bool gpiote_init;
+static pin_t pins[PINS];
+static uint8_t gpiote_channels;
+static uint8_t ppi_channels;
+static uint8_t ppi_groups;
+static uint32_t counts[TIMERS];
+static nrf_timer_event_handler_t timer_handlers[TIMERS];
+static void * timer_contexts[TIMERS];
+
+void fake_hw_reset(void) {
+	memset(&fake_gpio, 0, sizeof(fake_gpio));
+	memset(&fake_gpiote, 0, sizeof(fake_gpiote));
+	memset(&fake_ppi, 0, sizeof(fake_ppi));
+	memset(fake_timer, 0, sizeof(fake_timer));
+	memset(pins, 0, sizeof(pins));
+	memset(counts, 0, sizeof(counts));
+	memset(timer_handlers, 0, sizeof(timer_handlers));
+	gpiote_init = false;
+	gpiote_channels = 0;
+	ppi_channels = 0;
+	ppi_groups = 0;
+	fake_critical_regions = 0;
+	fake_delay_us = 0;
+}
+
+static uint32_t addr(void volatile const * p_reg) {
+	return (uint32_t)(uintptr_t)p_reg;
+}
+
+// Capture tasks wired to the event through an enabled channel
+static void ppi_fire(uint32_t event) {
+	for (uint8_t ch = 0; ch < PPI_CHANNELS; ch++) {
+		if (!(fake_ppi.CHEN & (1UL << ch)) || fake_ppi.CH[ch].EEP != event) {
+			continue;
+		}
+		for (uint8_t t = 0; t < TIMERS; t++) {
+			for (uint8_t cc = 0; cc < 4; cc++) {
+				if (fake_ppi.CH[ch].TEP == addr(&fake_timer[t].TASKS_CAPTURE[cc])) {
+					fake_timer[t].CC[cc] = counts[t];
+				}
+			}
+		}
+	}
+}
+
+void fake_gpio_input(uint32_t pin, bool high) {
+	pin_t * p_pin = &pins[pin];
+	bool was = (fake_gpio.IN >> pin) & 1;
+	nrf_gpiote_polarity_t edge = high ? NRF_GPIOTE_POLARITY_LOTOHI : NRF_GPIOTE_POLARITY_HITOLO;
+
+	// IN is read only to the code under test
+	uint32_t volatile * p_in = (uint32_t volatile *)&fake_gpio.IN;
+
+	if (high) {
+		*p_in |= 1UL << pin;
+	} else {
+		*p_in &= ~(1UL << pin);
+	}
+	if (was == high || !p_pin->input || !p_pin->enabled ||
+	    (p_pin->sense != NRF_GPIOTE_POLARITY_TOGGLE && p_pin->sense != edge)) {
+		return;
+	}
+	if (p_pin->channel != NO_CHANNEL) {
+		ppi_fire(addr(&fake_gpiote.EVENTS_IN[p_pin->channel]));
+	}
+	if (p_pin->handler != NULL) {
+		p_pin->handler(pin, edge);
+	}
+}
+
+void fake_timer_set(uint8_t instance, uint32_t count) {
+	counts[instance] = count;
+}
+
+void fake_timer_event(uint8_t instance, nrf_timer_event_t event) {
+	if (timer_handlers[instance] != NULL) {
+		timer_handlers[instance](event, timer_contexts[instance]);
+	}
+}
+
+uint8_t fake_ppi_channels(void) {
+	return ppi_channels;
+}
+
+uint8_t fake_ppi_groups(void) {
+	return ppi_groups;
+}
+
+ret_code_t nrf_drv_gpiote_init(void) {
+	gpiote_init = true;
+	for (uint8_t pin = 0; pin < PINS; pin++) {
+		pins[pin].channel = NO_CHANNEL;
+	}
+	return NRF_SUCCESS;
+}
+
+bool nrf_drv_gpiote_is_init(void) {
+	return gpiote_init;
+}
+
+static ret_code_t channel_take(nrf_drv_gpiote_pin_t pin) {
+	if (gpiote_channels == GPIOTE_CHANNELS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	pins[pin].channel = gpiote_channels++;
+	return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_gpiote_out_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_out_config_t const * p_config) {
+	if (p_config->task_pin) {
+		ret_code_t err_code = channel_take(pin);
+
+		if (err_code != NRF_SUCCESS) {
+			return err_code;
+		}
+		fake_gpiote.CONFIG[pins[pin].channel] = (pin << GPIOTE_CONFIG_PSEL_Pos) |
+		                                        (p_config->action << GPIOTE_CONFIG_POLARITY_Pos) |
+		                                        (p_config->init_state << GPIOTE_CONFIG_OUTINIT_Pos);
+	}
+	fake_gpio.DIRSET = 1UL << pin;
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_out_task_enable(nrf_drv_gpiote_pin_t pin) {
+	fake_gpiote.CONFIG[pins[pin].channel] |= GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos;
+}
+
+uint32_t nrf_drv_gpiote_out_task_addr_get(nrf_drv_gpiote_pin_t pin) {
+	return addr(&fake_gpiote.TASKS_OUT[pins[pin].channel]);
+}
+
+ret_code_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t const * p_config,
+                                  nrf_drv_gpiote_evt_handler_t evt_handler) {
+	if (p_config->hi_accuracy) {
+		ret_code_t err_code = channel_take(pin);
+
+		if (err_code != NRF_SUCCESS) {
+			return err_code;
+		}
+	}
+	pins[pin].input = true;
+	pins[pin].sense = p_config->sense;
+	pins[pin].handler = evt_handler;
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable) {
+	pins[pin].enabled = true;
+}
+
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin) {
+	pins[pin].enabled = false;
+}
+
+bool nrf_drv_gpiote_in_is_set(nrf_drv_gpiote_pin_t pin) {
+	return (fake_gpio.IN >> pin) & 1;
+}
+
+uint32_t nrf_drv_gpiote_in_event_addr_get(nrf_drv_gpiote_pin_t pin) {
+	return addr(&fake_gpiote.EVENTS_IN[pins[pin].channel]);
+}
+
+uint32_t nrf_drv_ppi_init(void) {
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channel_alloc(nrf_ppi_channel_t * p_channel) {
+	if (ppi_channels == PPI_CHANNELS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	*p_channel = (nrf_ppi_channel_t)ppi_channels++;
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep) {
+	fake_ppi.CH[channel].EEP = eep;
+	fake_ppi.CH[channel].TEP = tep;
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channel_enable(nrf_ppi_channel_t channel) {
+	fake_ppi.CHEN |= 1UL << channel;
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channel_disable(nrf_ppi_channel_t channel) {
+	fake_ppi.CHEN &= ~(1UL << channel);
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_group_alloc(nrf_ppi_channel_group_t * p_group) {
+	if (ppi_groups == PPI_GROUPS) {
+		return NRF_ERROR_NO_MEM;
+	}
+	*p_group = (nrf_ppi_channel_group_t)ppi_groups++;
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_channels_include_in_group(uint32_t channel_mask, nrf_ppi_channel_group_t group) {
+	fake_ppi.CHG[group] |= channel_mask;
+	return NRF_SUCCESS;
+}
+
+uint32_t nrf_drv_ppi_group_disable(nrf_ppi_channel_group_t group) {
+	fake_ppi.TASKS_CHG[group].DIS = 1;
+	return NRF_SUCCESS;
+}
+
+// instance_id counts only the timers nrf_drv_config.h enables
+static uint8_t timer_of(nrf_drv_timer_t const * const p_instance) {
+	return p_instance->p_reg - fake_timer;
+}
+
+ret_code_t nrf_drv_timer_init(nrf_drv_timer_t const * const p_instance, nrf_drv_timer_config_t const * p_config,
+                              nrf_timer_event_handler_t timer_event_handler) {
+	timer_handlers[timer_of(p_instance)] = timer_event_handler;
+	timer_contexts[timer_of(p_instance)] = (p_config != NULL) ? p_config->p_context : NULL;
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_timer_enable(nrf_drv_timer_t const * const p_instance) {
+	p_instance->p_reg->TASKS_START = 1;
+}
+
+void nrf_drv_timer_disable(nrf_drv_timer_t const * const p_instance) {
+	p_instance->p_reg->TASKS_SHUTDOWN = 1;
+}
+
+void nrf_drv_timer_clear(nrf_drv_timer_t const * const p_instance) {
+	counts[timer_of(p_instance)] = 0;
+}
+
+void nrf_drv_timer_compare(nrf_drv_timer_t const * const p_instance, nrf_timer_cc_channel_t cc_channel,
+                           uint32_t cc_value, bool enable) {
+	p_instance->p_reg->CC[cc_channel] = cc_value;
+	if (enable) {
+		p_instance->p_reg->INTENSET = TIMER_INTENSET_COMPARE0_Msk << cc_channel;
+	}
+}
+
+uint32_t nrf_drv_timer_capture(nrf_drv_timer_t const * const p_instance, nrf_timer_cc_channel_t cc_channel) {
+	p_instance->p_reg->CC[cc_channel] = counts[timer_of(p_instance)];
+	return p_instance->p_reg->CC[cc_channel];
+}
+
+uint32_t nrf_drv_timer_capture_get(nrf_drv_timer_t const * const p_instance, nrf_timer_cc_channel_t cc_channel) {
+	return p_instance->p_reg->CC[cc_channel];
+}
+
+uint32_t nrf_drv_timer_capture_task_address_get(nrf_drv_timer_t const * const p_instance, uint32_t channel) {
+	return addr(&p_instance->p_reg->TASKS_CAPTURE[channel]);
+}
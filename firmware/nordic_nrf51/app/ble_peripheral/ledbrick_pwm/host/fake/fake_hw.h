@@ -0,0 +1,33 @@
+#ifndef FAKE_HW_H
+#define FAKE_HW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+#include "nrf_timer.h"
+
+// GPIOTE, PPI and TIMER drivers over the register blocks fake/nrf51.h
+// moves into host memory. Nothing happens on its own: tests move the
+// timers and pins, and an edge runs its handler after the PPI channels
+// wired to its event have captured their timers.
+
+extern uint32_t fake_critical_regions;
+extern uint32_t fake_delay_us;
+
+void fake_hw_reset(void);
+
+// Sets a TIMER's count, which capture tasks and nrf_drv_timer_capture()
+// take
+void fake_timer_set(uint8_t instance, uint32_t count);
+// Runs the handler a TIMER was started with
+void fake_timer_event(uint8_t instance, nrf_timer_event_t event);
+
+// Drives an input to level. An edge the pin senses fires its GPIOTE
+// event, through PPI, then its handler.
+void fake_gpio_input(uint32_t pin, bool high);
+
+// PPI channels and groups allocated
+uint8_t fake_ppi_channels(void);
+uint8_t fake_ppi_groups(void);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "twi_queue.h"
+#include "fake_twi.h"
+
+#define PCA9685_MODE1 0x00
+#define PCA9685_MODE1_RESTART (1 << 7)
+
+static fake_twi_device_t devices[FAKE_TWI_DEVICES];
+static uint8_t device_count;
+
+static twi_job_t queue[FAKE_TWI_QUEUE_SIZE];
+static uint8_t head;
+static uint8_t count;
+static uint8_t peak;
+static int32_t fail_after = -1;
+
+static twi_class_stats_t stats[TWI_CLASS_COUNT];
+static fake_twi_job_t last;
+static uint32_t recoveries;
+
+void fake_twi_reset(void) {
+	memset(devices, 0, sizeof(devices));
+	device_count = 0;
+	head = 0;
+	count = 0;
+	peak = 0;
+	fail_after = -1;
+	memset(stats, 0, sizeof(stats));
+	memset(&last, 0, sizeof(last));
+	recoveries = 0;
+}
+
+fake_twi_device_t * fake_twi_device(uint8_t address, uint8_t width) {
+	fake_twi_device_t * p_dev;
+
+	if (device_count == FAKE_TWI_DEVICES) {
+		return NULL;
+	}
+	p_dev = &devices[device_count++];
+	p_dev->address = address;
+	p_dev->width = width;
+	p_dev->present = true;
+	return p_dev;
+}
+
+// Powered up: asleep, all-call answered, outputs fully off
+fake_twi_device_t * fake_twi_pca9685(uint8_t address) {
+	fake_twi_device_t * p_dev = fake_twi_device(address, 1);
+
+	if (p_dev != NULL) {
+		p_dev->pca9685 = true;
+		p_dev->regs[PCA9685_MODE1] = 0x11;
+	}
+	return p_dev;
+}
+
+fake_twi_device_t * fake_twi_mcp9808(uint8_t address) {
+	return fake_twi_device(address, 2);
+}
+
+uint16_t fake_twi_reg(fake_twi_device_t const * p_dev, uint8_t reg) {
+	uint16_t value = 0;
+
+	for (uint8_t i = 0; i < p_dev->width; i++) {
+		value = (value << 8) | p_dev->regs[reg * p_dev->width + i];
+	}
+	return value;
+}
+
+void fake_twi_reg_set(fake_twi_device_t * p_dev, uint8_t reg, uint16_t value) {
+	for (uint8_t i = 0; i < p_dev->width; i++) {
+		p_dev->regs[reg * p_dev->width + i] = value >> (8 * (p_dev->width - 1 - i));
+	}
+}
+
+static fake_twi_device_t * device_at(uint8_t address) {
+	for (uint8_t i = 0; i < device_count; i++) {
+		if (devices[i].address == address && devices[i].present) {
+			return &devices[i];
+		}
+	}
+	return NULL;
+}
+
+static void device_write(fake_twi_device_t * p_dev, uint8_t const * p_tx, uint8_t len) {
+	uint16_t size = 256 * p_dev->width;
+
+	p_dev->writes++;
+	p_dev->pointer = p_tx[0] * p_dev->width;
+	for (uint8_t i = 1; i < len; i++) {
+		uint8_t value = p_tx[i];
+
+		if (p_dev->pca9685 && p_dev->pointer == PCA9685_MODE1) {
+			value &= ~PCA9685_MODE1_RESTART;
+		}
+		p_dev->regs[p_dev->pointer] = value;
+		p_dev->pointer = (p_dev->pointer + 1) % size;
+	}
+}
+
+static void device_read(fake_twi_device_t * p_dev, uint8_t * p_rx, uint8_t len) {
+	uint16_t size = 256 * p_dev->width;
+
+	p_dev->reads++;
+	for (uint8_t i = 0; i < len; i++) {
+		p_rx[i] = p_dev->regs[p_dev->pointer];
+		p_dev->pointer = (p_dev->pointer + 1) % size;
+	}
+}
+
+// The general call reaches every chip and is always ACKed
+static bool land(twi_job_t const * p_job) {
+	fake_twi_device_t * p_dev = device_at(p_job->address);
+
+	if (fail_after == 0) {
+		return false;
+	}
+	if (fail_after > 0) {
+		fail_after--;
+	}
+	if (p_job->address == 0x00) {
+		return true;
+	}
+	if (p_dev == NULL) {
+		return false;
+	}
+	if (p_job->tx_len > 0) {
+		device_write(p_dev, p_job->p_tx, p_job->tx_len);
+	}
+	if (p_job->rx_len > 0) {
+		device_read(p_dev, p_job->p_rx, p_job->rx_len);
+	}
+	return true;
+}
+
+uint32_t fake_twi_run(void) {
+	uint32_t ran = 0;
+
+	while (count > 0) {
+		twi_job_t job = queue[head];
+		bool success;
+
+		head = (head + 1) % FAKE_TWI_QUEUE_SIZE;
+		count--;
+		success = land(&job);
+
+		stats[job.xfer_class].jobs++;
+		stats[job.xfer_class].failed += !success;
+		stats[job.xfer_class].bytes += job.tx_len + (job.tx_len > 0) + job.rx_len + (job.rx_len > 0);
+		last.address = job.address;
+		last.tx_len = job.tx_len;
+		last.rx_len = job.rx_len;
+		last.xfer_class = job.xfer_class;
+		last.success = success;
+		memcpy(last.tx, job.p_tx, (job.tx_len < sizeof(last.tx)) ? job.tx_len : sizeof(last.tx));
+		ran++;
+
+		if (job.callback != NULL) {
+			job.callback(&job, success);
+		}
+	}
+	return ran;
+}
+
+uint8_t fake_twi_pending(void) {
+	return count;
+}
+
+void fake_twi_fail_after(int32_t jobs) {
+	fail_after = jobs;
+}
+
+fake_twi_job_t const * fake_twi_last(void) {
+	return &last;
+}
+
+void twi_queue_init(void) {
+}
+
+// Nothing hangs or fails behind a job's back here, so nothing resyncs
+void twi_queue_set_resync(twi_queue_resync_t handler) {
+}
+
+bool twi_queue_submit(twi_job_t const * p_job) {
+	if (count == FAKE_TWI_QUEUE_SIZE || p_job->xfer_class >= TWI_CLASS_COUNT) {
+		return false;
+	}
+	queue[(head + count) % FAKE_TWI_QUEUE_SIZE] = *p_job;
+	count++;
+	if (count > peak) {
+		peak = count;
+	}
+	return true;
+}
+
+bool twi_queue_idle(void) {
+	return count == 0;
+}
+
+void twi_queue_set_speed(twi_class_t xfer_class, twi_speed_t speed) {
+}
+
+twi_speed_t twi_queue_speed(twi_class_t xfer_class) {
+	return (xfer_class == TWI_CLASS_CONFIG) ? TWI_QUEUE_SPEED_CONFIG : TWI_SPEED_400K;
+}
+
+void twi_queue_stats(twi_class_t xfer_class, twi_class_stats_t * p_stats) {
+	*p_stats = stats[xfer_class];
+}
+
+uint8_t twi_queue_peak(void) {
+	return peak;
+}
+
+bool twi_queue_device_stats(uint8_t index, twi_device_stats_t * p_stats) {
+	return false;
+}
+
+uint32_t twi_queue_recoveries(void) {
+	return recoveries;
+}
+
+void twi_queue_radio_idle(void) {
+}
+
+bool twi_queue_flush(void) {
+	fake_twi_run();
+	return true;
+}
+
+void twi_queue_recover(void) {
+	recoveries++;
+}
@@ -0,0 +1,60 @@
+#ifndef FAKE_TWI_H
+#define FAKE_TWI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "twi_queue.h"
+
+// The TWI queue (twi_queue.h) over a bus of modelled devices. Jobs wait
+// in order until fake_twi_run(), or a twi_queue_flush() from the code
+// under test, lands them and runs their callbacks, which may queue more.
+// Bytes are counted per class as twi_queue.c counts them, address bytes
+// included, so the numbers match BULK_CMD_BUS_STATS on a brick.
+
+#define FAKE_TWI_DEVICES 8
+#define FAKE_TWI_QUEUE_SIZE TWI_QUEUE_SIZE
+
+// A register file behind a one byte pointer, which the first byte
+// written sets and the rest fill from, reads taking from it in turn.
+// Registers are width bytes, MSB first, and the pointer moves on through
+// them (PCA9685 auto-increment, width 1; MCP9808, width 2).
+typedef struct {
+	uint8_t address;
+	uint8_t width;
+	bool present;
+	// A PCA9685 clears MODE1's RESTART bit as it is written
+	bool pca9685;
+	uint8_t regs[256 * 2];
+	uint16_t pointer;  // Byte offset into regs
+	uint32_t writes;   // Jobs with a write phase
+	uint32_t reads;
+} fake_twi_device_t;
+
+// Empties the bus and the queue, and zeroes the counts
+void fake_twi_reset(void);
+fake_twi_device_t * fake_twi_device(uint8_t address, uint8_t width);
+fake_twi_device_t * fake_twi_pca9685(uint8_t address);
+fake_twi_device_t * fake_twi_mcp9808(uint8_t address);
+uint16_t fake_twi_reg(fake_twi_device_t const * p_dev, uint8_t reg);
+void fake_twi_reg_set(fake_twi_device_t * p_dev, uint8_t reg, uint16_t value);
+
+// Lands every job queued, and those their callbacks queue. Returns how
+// many ran.
+uint32_t fake_twi_run(void);
+uint8_t fake_twi_pending(void);
+// Jobs queued after this many more fail as NACKed, -1 for none
+void fake_twi_fail_after(int32_t jobs);
+
+// The last job landed, for checking what went on the wire
+typedef struct {
+	uint8_t address;
+	uint8_t tx[1 + 16 * 4];
+	uint8_t tx_len;
+	uint8_t rx_len;
+	twi_class_t xfer_class;
+	bool success;
+} fake_twi_job_t;
+
+fake_twi_job_t const * fake_twi_last(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef NRF_H
+#define NRF_H
+
+// The device headers the SDK's nrf.h leaves out on a host build
+
+#include <nrf51.h>  // Searched for, so fake/nrf51.h can include_next the SDK's
+#include "nrf51_bitfields.h"
+#include "nrf51_deprecated.h"
+#include "compiler_abstraction.h"
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef FAKE_NRF51_H
+#define FAKE_NRF51_H
+
+// The real register layout, with the peripherals the app modules touch
+// moved into host memory (fake_hw.c) so tests can read and set them
+
+#include_next "nrf51.h"
+
+#undef NRF_GPIO
+#undef NRF_GPIOTE
+#undef NRF_PPI
+#undef NRF_TIMER0
+#undef NRF_TIMER1
+#undef NRF_TIMER2
+
+extern NRF_GPIO_Type fake_gpio;
+extern NRF_GPIOTE_Type fake_gpiote;
+extern NRF_PPI_Type fake_ppi;
+extern NRF_TIMER_Type fake_timer[3];
+
+#define NRF_GPIO (&fake_gpio)
+#define NRF_GPIOTE (&fake_gpiote)
+#define NRF_PPI (&fake_ppi)
+#define NRF_TIMER0 (&fake_timer[0])
+#define NRF_TIMER1 (&fake_timer[1])
+#define NRF_TIMER2 (&fake_timer[2])
+
+#endif
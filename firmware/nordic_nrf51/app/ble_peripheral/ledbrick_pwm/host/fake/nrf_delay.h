@@ -0,0 +1,20 @@
+#ifndef _NRF_DELAY_H
+#define _NRF_DELAY_H
+
+#include <stdint.h>
+
+// Busy waits only add up, in fake_delay_us, so tests run at full speed
+
+extern uint32_t fake_delay_us;
+
+static __inline void nrf_delay_us(uint32_t number_of_us)
+{
+	fake_delay_us += number_of_us;
+}
+
+static __inline void nrf_delay_ms(uint32_t number_of_ms)
+{
+	fake_delay_us += number_of_ms * 1000;
+}
+
+#endif
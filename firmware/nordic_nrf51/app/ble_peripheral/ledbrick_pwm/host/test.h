@@ -0,0 +1,30 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Checks report and carry on, so one run shows everything that broke.
+// The modules under test keep their state in statics, so each file's
+// cases run in order on one set of fakes.
+
+extern uint32_t test_checks;
+extern uint32_t test_failures;
+
+#define CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(got, want) test_check_eq((long)(got), (long)(want), #got, __FILE__, __LINE__)
+
+void test_check(bool ok, char const * p_what, char const * p_file, int line);
+void test_check_eq(long got, long want, char const * p_what, char const * p_file, int line);
+
+// Empties the bus and zeroes the peripherals and counts
+void test_fakes_reset(void);
+
+void test_pca9685(void);
+void test_mcp9808(void);
+void test_fan_monitor(void);
+void test_ble_lbs(void);
+void test_schedule(void);
+
+#endif
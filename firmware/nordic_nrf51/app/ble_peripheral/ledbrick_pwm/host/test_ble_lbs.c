@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ble_lbs.h"
+#include "fake_ble.h"
+#include "cmdwindow_vectors.h"
+#include "test.h"
+
+static ble_lbs_t lbs;
+
+static uint8_t led_writes;
+static uint8_t led;
+static uint16_t led_level;
+static uint8_t frames;
+static uint16_t frame_mask;
+static uint16_t frame_levels[LBS_FRAME_MAX_CHANNELS];
+static uint16_t frame_duration;
+
+static void on_led(ble_lbs_t * p_lbs, uint8_t new_led, uint16_t level) {
+	led_writes++;
+	led = new_led;
+	led_level = level;
+}
+
+static void on_frame(ble_lbs_t * p_lbs, uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+	frames++;
+	frame_mask = mask;
+	memcpy(frame_levels, p_levels, sizeof(frame_levels));
+	frame_duration = duration_ms;
+}
+
+static void command(uint8_t const * p_write, uint16_t len) {
+	fake_ble_write(&lbs, lbs.command_char_handles.value_handle, p_write, len);
+}
+
+// The ack notified for the latest write
+static void check_ack(uint8_t seq, uint32_t received, uint32_t rejected, int line) {
+	fake_ble_hvx_t const * p_ack = fake_ble_last();
+
+	test_check_eq(p_ack->handle, lbs.command_char_handles.value_handle, "ack handle", __FILE__, line);
+	test_check_eq(p_ack->len, LBS_CMD_ACK_LEN, "ack length", __FILE__, line);
+	test_check_eq(p_ack->data[1], seq, "acked seq", __FILE__, line);
+	test_check_eq(uint32_decode(&p_ack->data[2]), received, "received", __FILE__, line);
+	test_check_eq(uint32_decode(&p_ack->data[6]), rejected, "rejected", __FILE__, line);
+}
+
+#define CHECK_ACK(seq, received, rejected) check_ack((seq), (received), (rejected), __LINE__)
+
+static void test_init(void) {
+	ble_lbs_init_t init;
+
+	memset(&init, 0, sizeof(init));
+	init.led_write_handler = on_led;
+	init.frame_write_handler = on_frame;
+	init.channels = 8;
+	CHECK_EQ(ble_lbs_init(&lbs, &init), NRF_SUCCESS);
+
+	fake_ble_connect(&lbs);
+	fake_ble_subscribe(&lbs, &lbs.command_char_handles);
+}
+
+static void test_command(void) {
+	uint8_t const level[] = { LBS_CMD_VERSION, 5, LBS_CMD_OP_LEVEL, 3, 2, 0x34, 0x12 };
+	uint8_t const unknown[] = { LBS_CMD_VERSION, 6, 0x7F, 0 };
+	uint8_t const late[] = { LBS_CMD_VERSION, 4, LBS_CMD_OP_LEVEL_ALL, 2, 0x00, 0x08 };
+
+	command(level, sizeof(level));
+	CHECK_EQ(led_writes, 1);
+	CHECK_EQ(led, 2);
+	CHECK_EQ(led_level, 0x1234);
+	CHECK_ACK(5, 0x1, 0);
+
+	// A resend is acked again without running twice
+	command(level, sizeof(level));
+	CHECK_EQ(led_writes, 1);
+	CHECK_ACK(5, 0x1, 0);
+
+	command(unknown, sizeof(unknown));
+	CHECK_EQ(led_writes, 1);
+	CHECK_ACK(6, 0x3, 0x1);
+
+	// Overtaken by a later write, still run and acked in its place
+	command(late, sizeof(late));
+	CHECK_EQ(led_writes, 2);
+	CHECK_EQ(led, 0xFF);
+	CHECK_ACK(6, 0x7, 0x1);
+}
+
+// Three 12 bit levels to five bytes, the low bits first
+static void test_frame(void) {
+	uint8_t const packed[] = { LBS_CMD_VERSION, 7, LBS_CMD_OP_FRAME_PACKED, 9,
+	                           0x07, 0x00, 40, 0, 0xbc, 0x3a, 0x12, 0x56, 0x04 };
+
+	command(packed, sizeof(packed));
+	CHECK_EQ(frames, 1);
+	CHECK_EQ(frame_mask, 0x07);
+	CHECK_EQ(frame_duration, 40);
+	CHECK_EQ(frame_levels[0], 0xabc);
+	CHECK_EQ(frame_levels[1], 0x123);
+	CHECK_EQ(frame_levels[2], 0x456);
+	CHECK_ACK(7, 0xF, 0x2);
+}
+
+// The LED characteristic's older single byte levels are 4 bits short
+static void test_led_char(void) {
+	uint8_t const legacy[] = { 3, 0x80 };
+	uint8_t const level[] = { 4, 0xff, 0x0f };
+
+	fake_ble_write(&lbs, lbs.led_char_handles.value_handle, legacy, sizeof(legacy));
+	CHECK_EQ(led, 3);
+	CHECK_EQ(led_level, 0x800);
+	fake_ble_write(&lbs, lbs.led_char_handles.value_handle, level, sizeof(level));
+	CHECK_EQ(led, 4);
+	CHECK_EQ(led_level, 0xfff);
+}
+
+static cmd_vector_write_t const * p_vector_write;
+
+// The controller's tests check the vectors' MACs against the key, so
+// here only which were forged matters
+static bool on_mac(uint8_t const * p_msg, uint8_t len, uint8_t const * p_mac) {
+	return !p_vector_write->forged;
+}
+
+// testdata/cmdwindow.json, the writes each case sends on a fresh link
+// and the ack each gets, if any
+static void test_cmd_window(void) {
+	for (uint8_t c = 0; c < CMD_VECTORS; c++) {
+		cmd_vector_t const * p_case = &cmd_vectors[c];
+		ble_lbs_init_t init;
+
+		fake_ble_reset();
+		memset(&lbs, 0, sizeof(lbs));
+		memset(&init, 0, sizeof(init));
+		init.led_write_handler = on_led;
+		init.frame_write_handler = on_frame;
+		init.mac_handler = on_mac;
+		init.cmd_mac_required = p_case->mac_required;
+		init.channels = 8;
+		CHECK_EQ(ble_lbs_init(&lbs, &init), NRF_SUCCESS);
+		fake_ble_connect(&lbs);
+		fake_ble_subscribe(&lbs, &lbs.command_char_handles);
+
+		for (uint8_t w = 0; w < p_case->count; w++) {
+			uint32_t notifications = fake_ble_notifications();
+			fake_ble_hvx_t const * p_ack = fake_ble_last();
+
+			p_vector_write = &p_case->p_writes[w];
+			command(p_vector_write->p_write, p_vector_write->len);
+			if (p_vector_write->p_ack == NULL) {
+				test_check(fake_ble_notifications() == notifications, p_case->p_name, __FILE__, __LINE__);
+				continue;
+			}
+			test_check(fake_ble_notifications() == notifications + 1 &&
+			           p_ack->len == LBS_CMD_ACK_LEN &&
+			           memcmp(p_ack->data, p_vector_write->p_ack, LBS_CMD_ACK_LEN) == 0,
+			           p_case->p_name, __FILE__, __LINE__);
+		}
+	}
+}
+
+static uint8_t time_writes;
+
+static void on_time(ble_lbs_t * p_lbs, uint32_t time, uint8_t fraction) {
+	time_writes++;
+}
+
+// With MAC required nothing unsigned, on any characteristic, takes
+// control or changes anything
+static void test_mac_required(void) {
+	ble_lbs_init_t init;
+	uint8_t const time[] = { 0x00, 0x10, 0x00, 0x00 };
+	uint8_t const legacy[] = { 3, 0x80 };
+	uint8_t const level[] = { LBS_CMD_VERSION, 1, LBS_CMD_OP_LEVEL, 3, 2, 0x34, 0x12 };
+	static cmd_vector_write_t const genuine = { NULL, 0, false, NULL };
+
+	fake_ble_reset();
+	memset(&lbs, 0, sizeof(lbs));
+	memset(&init, 0, sizeof(init));
+	init.led_write_handler = on_led;
+	init.time_write_handler = on_time;
+	init.mac_handler = on_mac;
+	init.cmd_mac_required = true;
+	init.channels = 8;
+	CHECK_EQ(ble_lbs_init(&lbs, &init), NRF_SUCCESS);
+	fake_ble_connect(&lbs);
+	fake_ble_subscribe(&lbs, &lbs.command_char_handles);
+	p_vector_write = &genuine;
+	led_writes = 0;
+
+	fake_ble_write(&lbs, lbs.time_char_handles.value_handle, time, sizeof(time));
+	CHECK_EQ(time_writes, 0);
+	fake_ble_write(&lbs, lbs.led_char_handles.value_handle, legacy, sizeof(legacy));
+	command(level, sizeof(level));
+	CHECK_EQ(led_writes, 0);
+	CHECK(!ble_lbs_control_take(&lbs, FAKE_BLE_CONN_HANDLE)); // As bulk.c asks
+	CHECK(!ble_lbs_in_control(&lbs, FAKE_BLE_CONN_HANDLE));
+	CHECK_EQ(fake_ble_notifications(), 0);
+}
+
+void test_ble_lbs(void) {
+	test_init();
+	test_command();
+	test_frame();
+	test_led_char();
+	test_cmd_window();
+	test_mac_required();
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf_timer.h"
+#include "fan_monitor.h"
+#include "error_handlers.h"
+#include "fake_hw.h"
+#include "test.h"
+
+#define TACH_TIMER 2
+#define TACH_PIN 8
+// TACH_TIMER_HZ * 60 over two pulses a revolution
+#define TACH_RPM_TICKS 937500UL
+
+static uint32_t now;
+
+// A tach pulse period ticks after the last, PPI capturing the timer at
+// the falling edge. The 16 bit timer marks each wrap on the way.
+static void tach_pulse(uint32_t ticks) {
+	if (((now & 0xFFFF) + ticks) > 0xFFFF) {
+		fake_timer_event(TACH_TIMER, NRF_TIMER_EVENT_COMPARE3);
+	}
+	now += ticks;
+	fake_timer_set(TACH_TIMER, now & 0xFFFF);
+	fake_gpio_input(TACH_PIN, true);
+	fake_gpio_input(TACH_PIN, false);
+}
+
+static void test_rpm(void) {
+	fantach_stats_t stats;
+
+	fantach_init();
+	CHECK(fantach_enabled(0));
+	CHECK_EQ(fantach_rpm(), 0);
+
+	// Up to the first edge is partial and thrown away
+	tach_pulse(5);
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.samples, 0);
+	for (uint8_t i = 0; i < FANTACH_SAMPLES; i++) {
+		tach_pulse(TACH_RPM_TICKS / 1200);
+	}
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.rpm, 1200);
+	CHECK_EQ(stats.samples, FANTACH_SAMPLES);
+	CHECK_EQ(stats.rejected, 0);
+	CHECK_EQ(stats.jitter_us, 0);
+	CHECK_EQ(fantach_rpm(), 1200);
+
+	// A glitch well off the median is rejected, a little jitter kept
+	tach_pulse(TACH_RPM_TICKS / 1200 / 3);
+	tach_pulse(TACH_RPM_TICKS / 1200 + 10);
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.rejected, 1);
+	CHECK_EQ(stats.samples, FANTACH_SAMPLES - 1);
+	CHECK_EQ(stats.rpm_max, 1200);
+	CHECK(stats.rpm_min < 1200);
+	CHECK_EQ(stats.jitter_us, 10 * 1000000UL / 31250);
+
+	// Across the counter wrapping
+	tach_pulse(0x10000 - (now & 0xFFFF) - 1000);
+	for (uint8_t i = 0; i < FANTACH_SAMPLES; i++) {
+		tach_pulse(TACH_RPM_TICKS / 1200);
+	}
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.rpm, 1200);
+	CHECK_EQ(stats.rejected, 0);
+}
+
+// Quiet for FANTACH_STALL_WRAPS wraps of the timer
+static void test_stall(void) {
+	fantach_stats_t stats;
+
+	for (uint8_t i = 0; i < FANTACH_STALL_WRAPS; i++) {
+		CHECK(!fantach_stalled(0));
+		fake_timer_event(TACH_TIMER, NRF_TIMER_EVENT_COMPARE3);
+	}
+	CHECK(fantach_stalled(0));
+	CHECK(error_present(ERROR_FAN));
+	CHECK_EQ(fantach_rpm(), 0);
+
+	// Turning again after the period it restarts on
+	tach_pulse(TACH_RPM_TICKS / 750);
+	tach_pulse(TACH_RPM_TICKS / 750);
+	CHECK(!fantach_stalled(0));
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.samples, 1);
+	CHECK_EQ(stats.rpm, 750);
+
+	// Off, nothing reported and no stall
+	fantach_disable(0);
+	fantach_stats(0, &stats);
+	CHECK_EQ(stats.samples, 0);
+	fake_timer_event(TACH_TIMER, NRF_TIMER_EVENT_COMPARE3);
+	fake_timer_event(TACH_TIMER, NRF_TIMER_EVENT_COMPARE3);
+	CHECK(!fantach_stalled(0));
+	fantach_enable(0);
+}
+
+void test_fan_monitor(void) {
+	test_rpm();
+	test_stall();
+}
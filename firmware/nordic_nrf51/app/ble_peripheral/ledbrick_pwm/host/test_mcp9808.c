@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcp9808.h"
+#include "twi_queue.h"
+#include "fake_twi.h"
+#include "fake_hw.h"
+#include "test.h"
+
+#define CONFIG_REG 0x01
+#define UPPER_REG 0x02
+#define LOWER_REG 0x03
+#define CRIT_REG 0x04
+#define TEMP_REG 0x05
+#define RESOLUTION_REG 0x08
+
+static fake_twi_device_t * p_sensor;
+static uint8_t samples;
+static bool sample_ok;
+static int16_t sample_temp;
+static uint8_t alerts;
+static bool alert_asserted;
+
+static void on_sample(bool success, int16_t temp) {
+	samples++;
+	sample_ok = success;
+	sample_temp = temp;
+}
+
+static void on_alert(bool asserted) {
+	alerts++;
+	alert_asserted = asserted;
+}
+
+static void test_init(void) {
+	p_sensor = fake_twi_mcp9808(0x1F);
+
+	CHECK(mcp9808_init(MCP9808_RES_0_0625));
+	fake_twi_run();
+	// RESOLUTION is the one 8 bit register, written as the high byte
+	CHECK_EQ(fake_twi_reg(p_sensor, RESOLUTION_REG) >> 8, MCP9808_RES_0_0625);
+}
+
+static void test_alert(void) {
+	CHECK(mcp9808_alert_init(MCP9808_DEG(10), MCP9808_DEG(60), MCP9808_DEG(80), false, on_alert));
+	fake_twi_run();
+	CHECK_EQ(fake_twi_reg(p_sensor, LOWER_REG), 160);
+	CHECK_EQ(fake_twi_reg(p_sensor, UPPER_REG), 960);
+	CHECK_EQ(fake_twi_reg(p_sensor, CRIT_REG), 1280);
+	// Comparator mode, 1.5 C hysteresis
+	CHECK_EQ(fake_twi_reg(p_sensor, CONFIG_REG), (1 << 3) | (1 << 9));
+
+	// Open drain, active low
+	fake_gpio_input(MCP9808_PIN_ALERT, true);
+	CHECK_EQ(alerts, 1);
+	CHECK(!alert_asserted && !mcp9808_alert_asserted());
+	fake_gpio_input(MCP9808_PIN_ALERT, false);
+	CHECK_EQ(alerts, 2);
+	CHECK(alert_asserted && mcp9808_alert_asserted());
+}
+
+// The register is 13 bit two's complement in 1/16 C, under three alert
+// flags
+static void test_sample(void) {
+	static struct {
+		uint16_t reg;
+		int16_t temp;
+	} const cases[] = {
+		{ 0x0191, 401 },   // 25.0625 C
+		{ 0xE191, 401 },   // The same with every flag up
+		{ 0x0000, 0 },
+		{ 0x1FFF, -1 },    // -0.0625 C
+		{ 0x1F58, -168 },  // -10.5 C
+		{ 0x07FF, 2047 },
+		{ 0x1000, -4096 },
+	};
+	uint32_t bytes;
+	twi_class_stats_t stats;
+
+	for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		fake_twi_reg_set(p_sensor, TEMP_REG, cases[i].reg);
+		samples = 0;
+		CHECK(mcp9808_sample(on_sample));
+		fake_twi_run();
+		CHECK_EQ(samples, 1);
+		CHECK(sample_ok);
+		CHECK_EQ(sample_temp, cases[i].temp);
+		CHECK_EQ(mcp9808_temp(), cases[i].temp);
+	}
+
+	// Pointer, then two bytes back
+	twi_queue_stats(TWI_CLASS_SENSOR, &stats);
+	bytes = stats.bytes;
+	CHECK(mcp9808_sample(on_sample));
+	CHECK(!mcp9808_sample(on_sample));
+	fake_twi_run();
+	twi_queue_stats(TWI_CLASS_SENSOR, &stats);
+	CHECK_EQ(stats.bytes - bytes, 1 + 1 + 1 + 2);
+}
+
+// A sensor that doesn't answer reads as none, the last good reading kept
+static void test_absent(void) {
+	int16_t temps[MCP9808_NUM_SENSORS];
+	int16_t last = mcp9808_temp();
+
+	p_sensor->present = false;
+	CHECK(mcp9808_sample(on_sample));
+	fake_twi_run();
+	CHECK(!sample_ok);
+	CHECK_EQ(mcp9808_temp(), last);
+	mcp9808_sensors(temps);
+	CHECK_EQ(temps[0], MCP9808_TEMP_NONE);
+	p_sensor->present = true;
+}
+
+void test_mcp9808(void) {
+	test_init();
+	test_alert();
+	test_sample();
+	test_absent();
+}
@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+#include "twi_queue.h"
+#include "fake_twi.h"
+#include "fake_hw.h"
+#include "test.h"
+
+#define REG_MODE1 0x00
+#define REG_MODE2 0x01
+#define REG_LED0 0x06
+#define REG_PRESCALE 0xFE
+
+static fake_twi_device_t * p_chip;
+
+static uint16_t led_on(uint8_t out) {
+	return fake_twi_reg(p_chip, REG_LED0 + 4*out) | (fake_twi_reg(p_chip, REG_LED0 + 4*out + 1) << 8);
+}
+
+static uint16_t led_off(uint8_t out) {
+	return fake_twi_reg(p_chip, REG_LED0 + 4*out + 2) | (fake_twi_reg(p_chip, REG_LED0 + 4*out + 3) << 8);
+}
+
+static uint32_t frame_bytes(void) {
+	twi_class_stats_t stats;
+
+	twi_queue_stats(TWI_CLASS_FRAME, &stats);
+	return stats.bytes;
+}
+
+// A chip missing at boot is tried PCA9685_INIT_ATTEMPTS times, then
+// brought up by a retry
+static void test_init(void) {
+	p_chip = fake_twi_pca9685(0x7F);
+	p_chip->present = false;
+
+	CHECK(!pca9685_init());
+	CHECK(!pca9685_present());
+	CHECK_EQ(twi_queue_recoveries(), PCA9685_INIT_ATTEMPTS - 1);
+	fake_twi_run();
+	CHECK_EQ(pca9685_commits(), 0);
+
+	p_chip->present = true;
+	CHECK(pca9685_retry());
+	CHECK(pca9685_present());
+	CHECK_EQ(fake_twi_reg(p_chip, REG_MODE1), 0x21);
+	CHECK_EQ(fake_twi_reg(p_chip, REG_MODE2), 0x04);
+	CHECK_EQ(fake_twi_reg(p_chip, REG_PRESCALE), 23);
+	CHECK_EQ(pca9685_frequency(), 254);
+	// MODE1 read back once the oscillator had its 500 us
+	CHECK(fake_delay_us >= 500);
+
+	// Every output goes out, in one burst
+	CHECK_EQ(fake_twi_pending(), 1);
+	CHECK_EQ(fake_twi_run(), 1);
+	CHECK_EQ(fake_twi_last()->tx_len, 1 + 16 * 4);
+	CHECK_EQ(pca9685_commits(), 1);
+	// The LED channels laid end to end, the auxiliary outputs full off
+	for (uint8_t out = 0; out < BOARD_LED_CHANNELS; out++) {
+		CHECK_EQ(led_on(out), 16 * out);
+		CHECK_EQ(led_off(out), 16 * (out + 1));
+	}
+	CHECK_EQ(led_off(BOARD_LED_CHANNELS), 0x1000);
+}
+
+// The bytes a frame costs on the bus, which depend on how far along the
+// period the change moves the edges
+static void test_frame_bytes(void) {
+	uint32_t bytes = frame_bytes();
+	uint16_t hash = pca9685_state_hash();
+
+	// The last lit channel moves only its own off edge
+	pca9685_write_led(BOARD_LED_CHANNELS - 1, 0, 100);
+	fake_twi_run();
+	CHECK_EQ(frame_bytes() - bytes, 1 + 1 + 4);
+	CHECK_EQ(fake_twi_last()->tx[0], REG_LED0 + 4 * (BOARD_LED_CHANNELS - 1));
+	CHECK_EQ(led_off(BOARD_LED_CHANNELS - 1), 16 * (BOARD_LED_CHANNELS - 1) + 100);
+	CHECK(pca9685_state_hash() != hash);
+
+	// The first moves every edge after it
+	bytes = frame_bytes();
+	pca9685_write_led(0, 0, 200);
+	fake_twi_run();
+	CHECK_EQ(frame_bytes() - bytes, 1 + 1 + 4 * BOARD_LED_CHANNELS);
+	CHECK_EQ(led_on(1), 200);
+
+	// Unchanged, nothing goes
+	bytes = frame_bytes();
+	pca9685_write_led(0, 0, 200);
+	fake_twi_run();
+	CHECK_EQ(frame_bytes(), bytes);
+}
+
+static void test_hold(void) {
+	uint32_t commits = pca9685_commits();
+
+	pca9685_hold();
+	pca9685_set_led(2, 0, 300);
+	pca9685_set_led(5, 0, 400);
+	pca9685_flush();
+	CHECK_EQ(fake_twi_pending(), 0);
+	pca9685_release();
+	CHECK_EQ(fake_twi_pending(), 1);
+	fake_twi_run();
+	CHECK_EQ(pca9685_commits(), commits + 1);
+	CHECK_EQ(led_off(5) - led_on(5), 400);
+}
+
+// A burst that fails stays dirty and goes with the next flush
+static void test_retry(void) {
+	fake_twi_fail_after(0);
+	pca9685_write_led(BOARD_LED_CHANNELS - 1, 0, 50);
+	fake_twi_run();
+	CHECK(!fake_twi_last()->success);
+	CHECK(led_off(BOARD_LED_CHANNELS - 1) - led_on(BOARD_LED_CHANNELS - 1) != 50);
+
+	fake_twi_fail_after(-1);
+	pca9685_flush();
+	fake_twi_run();
+	CHECK_EQ(led_off(BOARD_LED_CHANNELS - 1) - led_on(BOARD_LED_CHANNELS - 1), 50);
+}
+
+// With auxiliary outputs on the chip ALL_LED would light them, so every
+// channel goes as a burst instead
+static void test_write_all(void) {
+	pca9685_write_all(0, 0x800);
+	fake_twi_run();
+	CHECK(fake_twi_last()->tx[0] != 0xFA);
+	CHECK_EQ(led_off(0) - led_on(0), 0x800);
+	CHECK_EQ(led_off(BOARD_LED_CHANNELS), 0x1000);
+}
+
+static void test_frequency(void) {
+	CHECK(!pca9685_set_frequency(PCA9685_FREQ_MIN_HZ - 1));
+	CHECK(pca9685_set_frequency(1000));
+	CHECK_EQ(fake_twi_reg(p_chip, REG_PRESCALE), 5);
+	CHECK_EQ(fake_twi_reg(p_chip, REG_MODE1), 0x21);
+}
+
+void test_pca9685(void) {
+	test_init();
+	test_frame_bytes();
+	test_hold();
+	test_retry();
+	test_write_all();
+	test_frequency();
+}
@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "crc16.h"
+#include "schedule.h"
+#include "fake_app.h"
+#include "curve_vectors.h"
+#include "test.h"
+
+#define SECONDS_PER_DAY 86400UL
+#define EVAL_S (SCHEDULE_EVAL_MS / 1000)
+
+// testdata/curve.json, which the controller's curveAt is held to
+static void test_curve(void) {
+	for (uint8_t c = 0; c < CURVE_VECTORS; c++) {
+		curve_vector_t const * p_curve = &curve_vectors[c];
+
+		for (uint8_t i = 0; i < p_curve->count; i++) {
+			uint16_t levels[SCHEDULE_MAX_CHANNELS];
+
+			schedule_curve_at(p_curve->p_sched, p_curve->p_at[i].t, levels);
+			test_check(memcmp(levels, p_curve->p_at[i].levels, p_curve->p_sched[3] * sizeof(uint16_t)) == 0,
+			           p_curve->p_name, __FILE__, __LINE__);
+		}
+	}
+}
+
+// And its blendLevels
+static void test_blend(void) {
+	for (uint8_t b = 0; b < BLEND_VECTORS; b++) {
+		blend_vector_t const * p_blend = &blend_vectors[b];
+		uint16_t levels[CURVE_VECTOR_CHANNELS];
+
+		memcpy(levels, p_blend->after, sizeof(levels));
+		schedule_blend(levels, p_blend->channels, p_blend->before, p_blend->before_channels,
+		               p_blend->done, p_blend->total);
+		CHECK(memcmp(levels, p_blend->levels, p_blend->channels * sizeof(uint16_t)) == 0);
+	}
+}
+
+// A running schedule fades each step to where the curve is as it lands
+static void test_running(void) {
+	schedule_init(NULL);
+	CHECK(!schedule_release());
+	fake_clock_set(0);
+	for (uint8_t c = 0; c < CURVE_VECTORS; c++) {
+		curve_vector_t const * p_curve = &curve_vectors[c];
+		uint8_t count = p_curve->p_sched[2];
+		uint8_t channels = p_curve->p_sched[3];
+		uint8_t const * p_points = &p_curve->p_sched[SCHEDULE_HEADER_LEN];
+		uint16_t len = count * SCHEDULE_POINT_LEN(channels);
+
+		CHECK(schedule_load(count, channels, p_points, len, crc16_compute(p_points, len, NULL), 0));
+		for (uint8_t i = 0; i < p_curve->count; i++) {
+			fake_fade_t const * p_fade = fake_fade_last();
+
+			fake_clock_set((p_curve->p_at[i].t + SECONDS_PER_DAY - EVAL_S) % SECONDS_PER_DAY);
+			CHECK(schedule_release());
+			test_check(p_fade->mask == (1 << channels) - 1 && p_fade->duration_ms == SCHEDULE_EVAL_MS &&
+			           memcmp(p_fade->levels, p_curve->p_at[i].levels, channels * sizeof(uint16_t)) == 0,
+			           p_curve->p_name, __FILE__, __LINE__);
+		}
+	}
+}
+
+void test_schedule(void) {
+	test_curve();
+	test_blend();
+	test_running();
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "fake_twi.h"
+#include "fake_hw.h"
+#include "fake_ble.h"
+#include "fake_app.h"
+#include "test.h"
+
+uint32_t test_checks;
+uint32_t test_failures;
+
+void test_check(bool ok, char const * p_what, char const * p_file, int line) {
+	test_checks++;
+	if (!ok) {
+		test_failures++;
+		printf("%s:%d: %s\n", p_file, line, p_what);
+	}
+}
+
+void test_check_eq(long got, long want, char const * p_what, char const * p_file, int line) {
+	test_checks++;
+	if (got != want) {
+		test_failures++;
+		printf("%s:%d: %s is %ld, want %ld\n", p_file, line, p_what, got, want);
+	}
+}
+
+void test_fakes_reset(void) {
+	fake_twi_reset();
+	fake_hw_reset();
+	fake_ble_reset();
+	fake_app_reset();
+}
+
+int main(void) {
+	test_fakes_reset();
+	test_pca9685();
+	test_fakes_reset();
+	test_mcp9808();
+	test_fakes_reset();
+	test_fan_monitor();
+	test_fakes_reset();
+	test_ble_lbs();
+	test_fakes_reset();
+	test_schedule();
+
+	printf("%u checks, %u failed\n", test_checks, test_failures);
+	return test_failures != 0;
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python
+# Generates the host tests' vector headers from the JSON the controller's
+# tests read (controller/ble/testdata), so the firmware and the controller
+# are held to the same cases.
+#
+#   python vectors_gen.py cmdwindow cmdwindow.json > cmdwindow_vectors.h
+#   python vectors_gen.py curve curve.json > curve_vectors.h
+
+import json
+import sys
+
+
+def byte_array(name, data):
+    return "static uint8_t const %s[] = { %s };" % (
+        name, ", ".join("0x%02x" % b for b in bytearray(data)))
+
+
+def unhex(s):
+    return bytearray.fromhex(s)
+
+
+def u16(v):
+    return [v & 0xFF, v >> 8]
+
+
+def levels(l):
+    return "{ %s }" % ", ".join("%d" % v for v in l)
+
+
+def cmdwindow(v):
+    out = [
+        "typedef struct {",
+        "\tuint8_t const * p_write;",
+        "\tuint8_t len;",
+        "\tbool forged;",
+        "\tuint8_t const * p_ack;  // NULL for a write dropped unacked",
+        "} cmd_vector_write_t;",
+        "",
+        "typedef struct {",
+        "\tchar const * p_name;",
+        "\tbool mac_required;",
+        "\tcmd_vector_write_t const * p_writes;",
+        "\tuint8_t count;",
+        "} cmd_vector_t;",
+        "",
+    ]
+    cases = []
+    for c, case in enumerate(v["cases"]):
+        writes = []
+        for w, write in enumerate(case["writes"]):
+            name = "cmd_vector_%d_%d" % (c, w)
+            data = unhex(write["write"])
+            out.append(byte_array(name, data))
+            ack = "NULL"
+            if write["ack"]:
+                out.append(byte_array(name + "_ack", unhex(write["ack"])))
+                ack = name + "_ack"
+            writes.append("\t{ %s, %d, %s, %s }," % (
+                name, len(data), "true" if write.get("forged") else "false", ack))
+        out.append("static cmd_vector_write_t const cmd_vector_%d[] = {" % c)
+        out.extend(writes)
+        out.append("};")
+        out.append("")
+        cases.append("\t{ %s, %s, cmd_vector_%d, %d }," % (
+            json.dumps(case["name"]), "true" if case["mac_required"] else "false",
+            c, len(case["writes"])))
+    out.append("static cmd_vector_t const cmd_vectors[] = {")
+    out.extend(cases)
+    out.append("};")
+    out.append("#define CMD_VECTORS (sizeof(cmd_vectors) / sizeof(cmd_vectors[0]))")
+    return out
+
+
+# Points laid out as schedule.h stores them, header and all. The CRC is
+# left out, nothing evaluating a curve checks it.
+def stored(points):
+    data = u16(0x534C) + [len(points), len(points[0]["levels"])] + u16(0)
+    for p in points:
+        data += u16(p["minute"])
+        for l in p["levels"]:
+            data += u16(l)
+    return data
+
+
+def curve(v):
+    channels = max([len(p["levels"]) for c in v["curves"] for p in c["points"]] +
+                   [len(b[k]) for b in v["blends"] for k in ("before", "after")])
+    out = [
+        "#define CURVE_VECTOR_CHANNELS %d" % channels,
+        "",
+        "typedef struct {",
+        "\tuint32_t t;",
+        "\tuint16_t levels[CURVE_VECTOR_CHANNELS];",
+        "} curve_vector_at_t;",
+        "",
+        "typedef struct {",
+        "\tchar const * p_name;",
+        "\tuint8_t const * p_sched;",
+        "\tcurve_vector_at_t const * p_at;",
+        "\tuint8_t count;",
+        "} curve_vector_t;",
+        "",
+        "typedef struct {",
+        "\tuint16_t before[CURVE_VECTOR_CHANNELS];",
+        "\tuint8_t before_channels;",
+        "\tuint16_t after[CURVE_VECTOR_CHANNELS];",
+        "\tuint8_t channels;",
+        "\tuint32_t done;",
+        "\tuint32_t total;",
+        "\tuint16_t levels[CURVE_VECTOR_CHANNELS];",
+        "} blend_vector_t;",
+        "",
+    ]
+    curves = []
+    for c, case in enumerate(v["curves"]):
+        name = "curve_vector_%d" % c
+        out.append(byte_array(name + "_sched", stored(case["points"])))
+        out.append("static curve_vector_at_t const %s_at[] = {" % name)
+        for at in case["at"]:
+            out.append("\t{ %d, %s }," % (at["t"], levels(at["levels"])))
+        out.append("};")
+        out.append("")
+        curves.append("\t{ %s, %s_sched, %s_at, %d }," % (
+            json.dumps(case["name"]), name, name, len(case["at"])))
+    out.append("static curve_vector_t const curve_vectors[] = {")
+    out.extend(curves)
+    out.append("};")
+    out.append("#define CURVE_VECTORS (sizeof(curve_vectors) / sizeof(curve_vectors[0]))")
+    out.append("")
+    out.append("static blend_vector_t const blend_vectors[] = {")
+    for b in v["blends"]:
+        out.append("\t{ %s, %d, %s, %d, %d, %d, %s }," % (
+            levels(b["before"]), len(b["before"]), levels(b["after"]), len(b["after"]),
+            b["done"], b["total"], levels(b["levels"])))
+    out.append("};")
+    out.append("#define BLEND_VECTORS (sizeof(blend_vectors) / sizeof(blend_vectors[0]))")
+    return out
+
+
+GENERATORS = {
+    "cmdwindow": cmdwindow,
+    "curve": curve,
+}
+
+
+def main():
+    kind, path = sys.argv[1], sys.argv[2]
+    with open(path) as f:
+        v = json.load(f)
+    guard = "_%s_VECTORS_H_" % kind.upper()
+    out = ["// Generated by vectors_gen.py from %s, do not edit" % path.split("/")[-1],
+           "#ifndef %s" % guard, "#define %s" % guard, "",
+           "#include <stdint.h>", "#include <stdbool.h>", "#include <stddef.h>", ""]
+    out.extend(GENERATORS[kind](v))
+    out.extend(["", "#endif"])
+    sys.stdout.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
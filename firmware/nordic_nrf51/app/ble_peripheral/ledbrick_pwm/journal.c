@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "crc16.h"
+#include "flash_ring.h"
+#include "flash_sched.h"
+#include "journal.h"
+
+typedef struct {
+	uint32_t seq;
+	uint16_t levels[FADE_NUM_CHANNELS];
+	uint16_t crc;   // Over seq and levels
+	uint16_t spare; // Keeps records word sized, left erased
+} record_t;
+
+static flash_ring_t ring;
+// What the next record will be numbered
+static uint32_t seq;
+
+static record_t pending; // Stays put until the store completes
+static uint16_t last[FADE_NUM_CHANNELS];
+static uint32_t last_write_s = 0;
+// Frame held for flash_sched.h
+static uint16_t wanted[FADE_NUM_CHANNELS];
+static uint32_t wanted_s;
+static uint8_t job = FLASH_SCHED_INVALID;
+
+static void journal_job(void);
+
+static uint16_t record_crc(record_t const * p_rec) {
+	return crc16_compute((uint8_t const *)p_rec, offsetof(record_t, crc), NULL);
+}
+
+static bool record_valid(void const * p_rec) {
+	return record_crc(p_rec) == ((record_t const *)p_rec)->crc;
+}
+
+bool journal_init(uint16_t * p_levels) {
+	record_t const * p_newest = flash_ring_init(&ring, JOURNAL_PAGES, sizeof(record_t), record_valid, NULL);
+
+	if (ring.registered) {
+		job = flash_sched_register(journal_job);
+	}
+	if (p_newest == NULL) {
+		// Blank journal, the ring starts at the top of the first page
+		seq = 0;
+		return false;
+	}
+	seq = p_newest->seq + 1;
+	memcpy(last, p_newest->levels, sizeof(last));
+	memcpy(p_levels, p_newest->levels, sizeof(last));
+	return true;
+}
+
+static void journal_write(uint16_t const * p_levels, uint32_t uptime) {
+	if (!flash_ring_ready(&ring) || memcmp(p_levels, last, sizeof(last)) == 0) {
+		return;
+	}
+
+	memset(&pending, 0xFF, sizeof(pending));
+	pending.seq = seq;
+	memcpy(pending.levels, p_levels, sizeof(pending.levels));
+	pending.crc = record_crc(&pending);
+
+	if (!flash_ring_append(&ring, &pending)) {
+		return;
+	}
+	memcpy(last, p_levels, sizeof(last));
+	last_write_s = uptime;
+	seq++;
+}
+
+static void journal_job(void) {
+	journal_write(wanted, wanted_s);
+}
+
+void journal_update(uint16_t const * p_levels, uint32_t uptime) {
+	if (uptime - last_write_s >= JOURNAL_INTERVAL_S && memcmp(p_levels, last, sizeof(last)) != 0) {
+		memcpy(wanted, p_levels, sizeof(wanted));
+		wanted_s = uptime;
+		flash_sched_request(job);
+	}
+}
+
+void journal_flush(uint16_t const * p_levels, uint32_t uptime) {
+	// Power outlasting a held write matters more than the link
+	journal_write(p_levels, uptime);
+}
@@ -0,0 +1,30 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fade.h"
+
+// Last committed output levels, appended to a ring of flash pages so
+// they can be put back at power on. Records are only erased a page at a
+// time, when the ring wraps onto it.
+
+#define JOURNAL_PAGES 4
+// A changed frame is written at most this often, and not at all until
+// the first interval after boot has passed
+#define JOURNAL_INTERVAL_S 300
+
+// Needs pstorage_init() and has to register before any other pstorage
+// user, so it can be read before the SoftDevice is up. Returns true and
+// fills p_levels (linear, per channel) if a frame was found.
+bool journal_init(uint16_t * p_levels);
+
+// Call regularly with the levels the outputs are headed for, a record
+// goes out once the interval has passed and the frame has changed, at
+// the next opening flash_sched.h gives
+void journal_update(uint16_t const * p_levels, uint32_t uptime);
+// Write a changed frame now, ahead of the interval, for when power is
+// going. Best effort: the write may not land before it does.
+void journal_flush(uint16_t const * p_levels, uint32_t uptime);
+
+#endif
@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nordic_common.h"
+#include "board_profile.h"
+#include "clock.h"
+#include "pca9685.h"
+#include "junction.h"
+
+#ifndef BOARD_LED_RISE
+#define BOARD_LED_RISE { 0 }
+#endif
+
+// Excess carried with extra fraction bits so slow approaches don't
+// round away, and the step taken toward the target in 1/256ths
+#define EXCESS_SHIFT 4
+#define ALPHA_SHIFT 8
+
+static const int16_t rise[BOARD_LED_CHANNELS] = BOARD_LED_RISE;
+static int32_t excess;
+static uint32_t last_at;
+static bool started = false;
+
+// Where the excess heads at the duty going out now
+static int32_t target(void) {
+	int32_t sum = 0;
+	for (uint8_t i = 0; i < BOARD_LED_CHANNELS; i++) {
+		if (rise[i] != 0) {
+			sum += ((int32_t)rise[i] * pca9685_output(i)) / (PCA9685_COUNTS - 1);
+		}
+	}
+	return sum << EXCESS_SHIFT;
+}
+
+int16_t junction_update(int16_t board) {
+	uint32_t now = clock_ms();
+	int32_t to = target();
+
+	if (!started) {
+		// No history to go on, take it as settled, which errs hot
+		started = true;
+		excess = to;
+	} else {
+		// A gap longer than the time constant has mostly settled anyway,
+		// and capping it keeps the step at most half
+		int32_t dt = MIN(now - last_at, JUNCTION_TAU_MS);
+		int32_t alpha = (dt << ALPHA_SHIFT) / (JUNCTION_TAU_MS + dt);
+		excess += ((to - excess) * alpha) >> ALPHA_SHIFT;
+	}
+	last_at = now;
+	int32_t estimate = board + (excess >> EXCESS_SHIFT);
+	return MIN(estimate, INT16_MAX);
+}
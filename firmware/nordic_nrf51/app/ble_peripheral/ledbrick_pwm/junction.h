@@ -0,0 +1,25 @@
+#ifndef _JUNCTION_H_
+#define _JUNCTION_H_
+
+#include <stdint.h>
+#include "mcp9808.h"
+
+// LED junction temperature estimated from the board reading and the
+// duty going out, so the fan loop and derate act on heat as the LEDs
+// make it rather than once it reaches the sensor tens of seconds later.
+// A first-order model: the junctions sit above the board by each
+// string's rise at full duty (BOARD_LED_RISE) times its duty after the
+// dimmer, summed, and move toward that with time constant
+// JUNCTION_TAU_MS. Run on each reading, a multiply per channel and one
+// divide.
+//
+// A profile without BOARD_LED_RISE has no rise, the estimate is the
+// board reading and the loops hold the heatsink as before. With it,
+// FAN_TARGET_TEMP and the derate band are taken as junction
+// temperatures; the hard cutoff (TEMP_CRITICAL) stays on the reading.
+#define JUNCTION_TAU_MS 8000
+
+// A new board reading, in MCP9808 units. Returns the estimate.
+int16_t junction_update(int16_t board);
+
+#endif
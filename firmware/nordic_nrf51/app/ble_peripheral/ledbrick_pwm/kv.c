@@ -0,0 +1,330 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "pstorage.h"
+#include "ledbrick_flash.h"
+#include "flash_sched.h"
+#include "kv.h"
+
+#define ERASED 0xFFFFFFFF
+#define HEADER_LEN 4
+#define RECORD_HEADER_LEN 4
+#define RECORD_LEN(len) (RECORD_HEADER_LEN + (((len) + 3) & ~3))
+#define NONE 0
+
+// After a copy every key can have its newest record, and one more still
+// fits, so a put never finds the log full
+STATIC_ASSERT(HEADER_LEN + (KV_MAX_KEYS + 1) * RECORD_LEN(KV_MAX_VALUE) <= FLASH_PAGE_SIZE);
+STATIC_ASSERT(KV_MAX_KEYS <= 32);
+
+typedef enum {
+	OP_NONE,
+	OP_APPEND,
+	OP_CLEAR,
+	OP_COPY,
+	OP_HEADER,
+} kv_op_t;
+
+static pstorage_handle_t base;
+static bool registered = false;
+
+// The page in use, its sequence, and where the next record goes
+static uint8_t active;
+static uint16_t active_seq;
+static uint16_t cursor;
+// Offset of each key's newest record in it, NONE for no record
+static uint16_t offsets[KV_MAX_KEYS];
+
+// Puts not yet in flash, by key
+static uint8_t const * p_source[KV_MAX_KEYS];
+static uint8_t source_len[KV_MAX_KEYS];
+static uint32_t dirty = 0;
+
+// The write in flight, which stays put until it completes
+static uint32_t out_buf[RECORD_LEN(KV_MAX_VALUE) / 4];
+static uint8_t * const out = (uint8_t *)out_buf;
+static kv_op_t op = OP_NONE;
+static uint8_t op_key;
+
+// Copying to the other page: the next key, where it goes, and where
+// each has gone
+static bool collecting = false;
+static uint8_t gc_key;
+static uint16_t gc_cursor;
+static uint16_t gc_offsets[KV_MAX_KEYS];
+
+static uint8_t job = FLASH_SCHED_INVALID;
+
+static uint8_t const * page_at(uint8_t p) {
+	pstorage_handle_t block;
+
+	pstorage_block_identifier_get(&base, p, &block);
+	return (uint8_t const *)block.block_id;
+}
+
+static uint16_t record_crc(uint8_t key, uint8_t len, uint8_t const * p_value) {
+	uint8_t head[2] = { key, len };
+	uint16_t crc = crc16_compute(head, sizeof(head), NULL);
+
+	return crc16_compute(p_value, len, &crc);
+}
+
+static bool header_valid(uint8_t p) {
+	return uint16_decode(page_at(p)) == KV_MAGIC;
+}
+
+static bool page_erased(uint8_t p) {
+	uint32_t const * p_word = (uint32_t const *)page_at(p);
+
+	for (uint16_t i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+		if (p_word[i] != ERASED) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Index the page in use, leaving cursor after its last record. A length
+// no put could have written means the rest can't be walked, so the page
+// counts as full and the next put copies out of it.
+static void scan(void) {
+	uint8_t const * p_page = page_at(active);
+	uint16_t off = HEADER_LEN;
+
+	memset(offsets, 0, sizeof(offsets));
+	while (off + RECORD_HEADER_LEN <= FLASH_PAGE_SIZE) {
+		uint8_t key = p_page[off];
+		uint8_t len = p_page[off + 1];
+
+		if (key == 0xFF && len == 0xFF) {
+			break;
+		}
+		if (len > KV_MAX_VALUE || off + RECORD_LEN(len) > FLASH_PAGE_SIZE) {
+			off = FLASH_PAGE_SIZE;
+			break;
+		}
+		if (key < KV_MAX_KEYS &&
+		    record_crc(key, len, &p_page[off + RECORD_HEADER_LEN]) == uint16_decode(&p_page[off + 2])) {
+			offsets[key] = off;
+		}
+		off += RECORD_LEN(len);
+	}
+	cursor = off;
+}
+
+// Lay key's value out in out, ready to store
+static uint16_t record_build(uint8_t key, uint8_t const * p_value, uint8_t len) {
+	memset(out_buf, 0xFF, sizeof(out_buf));
+	out[0] = key;
+	out[1] = len;
+	uint16_encode(record_crc(key, len, p_value), &out[2]);
+	memcpy(&out[RECORD_HEADER_LEN], p_value, len);
+	return RECORD_LEN(len);
+}
+
+static bool store(uint8_t p, uint16_t len, uint16_t offset, kv_op_t what) {
+	pstorage_handle_t block;
+
+	pstorage_block_identifier_get(&base, p, &block);
+	if (pstorage_store(&block, out, len, offset) != NRF_SUCCESS) {
+		// The queue is full, tried again at the next opening
+		flash_sched_request(job);
+		return false;
+	}
+	op = what;
+	return true;
+}
+
+// One step of the copy to the other page
+static void collect_step(void) {
+	uint8_t other = active ^ 1;
+	pstorage_handle_t block;
+
+	if (!collecting) {
+		collecting = true;
+		gc_key = 0;
+		gc_cursor = HEADER_LEN;
+		memset(gc_offsets, 0, sizeof(gc_offsets));
+		if (!page_erased(other)) {
+			// Left from the last copy, or one a reset cut short
+			pstorage_block_identifier_get(&base, other, &block);
+			if (pstorage_clear(&block, FLASH_PAGE_SIZE) == NRF_SUCCESS) {
+				op = OP_CLEAR;
+			} else {
+				collecting = false;
+				flash_sched_request(job);
+			}
+			return;
+		}
+	}
+	while (gc_key < KV_MAX_KEYS && offsets[gc_key] == NONE) {
+		gc_key++;
+	}
+	if (gc_key < KV_MAX_KEYS) {
+		uint8_t const * p_rec = page_at(active) + offsets[gc_key];
+		uint16_t len = record_build(gc_key, &p_rec[RECORD_HEADER_LEN], p_rec[1]);
+		(void)store(other, len, gc_cursor, OP_COPY);
+		return;
+	}
+	// Everything is over, the header makes the page the one in use
+	memset(out_buf, 0xFF, sizeof(out_buf));
+	uint16_encode(KV_MAGIC, &out[0]);
+	uint16_encode(active_seq + 1, &out[2]);
+	(void)store(other, HEADER_LEN, 0, OP_HEADER);
+}
+
+static void kv_run(void) {
+	if (!registered || op != OP_NONE) {
+		// Asked again once the write in flight completes
+		return;
+	}
+	if (collecting) {
+		collect_step();
+		return;
+	}
+	if (dirty == 0) {
+		return;
+	}
+
+	uint8_t key = 0;
+	while (!(dirty & (1UL << key))) {
+		key++;
+	}
+	if (cursor + RECORD_LEN(source_len[key]) > FLASH_PAGE_SIZE) {
+		collect_step();
+		return;
+	}
+	uint16_t len = record_build(key, p_source[key], source_len[key]);
+	if (store(active, len, cursor, OP_APPEND)) {
+		op_key = key;
+		// Put again while in flight, it goes again
+		dirty &= ~(1UL << key);
+	}
+}
+
+static void on_store(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result,
+                     uint8_t * p_data, uint32_t data_len) {
+	kv_op_t done = op;
+
+	op = OP_NONE;
+	if (result != NRF_SUCCESS) {
+		// Tried again at the next opening, from the same step
+		if (done == OP_APPEND) {
+			dirty |= (1UL << op_key);
+		}
+		flash_sched_request(job);
+		return;
+	}
+	switch (done) {
+	case OP_APPEND:
+		offsets[op_key] = cursor;
+		cursor += RECORD_LEN(out[1]);
+		break;
+	case OP_CLEAR:
+		break;
+	case OP_COPY:
+		gc_offsets[gc_key] = gc_cursor;
+		gc_cursor += RECORD_LEN(out[1]);
+		gc_key++;
+		break;
+	case OP_HEADER:
+		active ^= 1;
+		active_seq++;
+		cursor = gc_cursor;
+		memcpy(offsets, gc_offsets, sizeof(offsets));
+		collecting = false;
+		break;
+	default:
+		return;
+	}
+	if (collecting || dirty != 0) {
+		flash_sched_request(job);
+	}
+}
+
+// The newest value under key: put and waiting, on its way, or in flash.
+// NULL if it has none.
+static uint8_t const * newest(uint8_t key, uint8_t * p_len) {
+	uint8_t const * p_rec;
+
+	if (dirty & (1UL << key)) {
+		*p_len = source_len[key];
+		return p_source[key];
+	}
+	if (op == OP_APPEND && op_key == key) {
+		p_rec = out;
+	} else if (offsets[key] != NONE) {
+		p_rec = page_at(active) + offsets[key];
+	} else {
+		return NULL;
+	}
+	*p_len = p_rec[1];
+	return &p_rec[RECORD_HEADER_LEN];
+}
+
+int16_t kv_get(uint8_t key, uint8_t * p_value, uint8_t max) {
+	uint8_t const * p_data;
+	uint8_t len;
+
+	if (key >= KV_MAX_KEYS || (p_data = newest(key, &len)) == NULL) {
+		return -1;
+	}
+	memcpy(p_value, p_data, MIN(len, max));
+	return len;
+}
+
+bool kv_put(uint8_t key, uint8_t const * p_value, uint8_t len) {
+	uint8_t const * p_data;
+	uint8_t had;
+
+	if (key >= KV_MAX_KEYS || len > KV_MAX_VALUE) {
+		return false;
+	}
+	p_data = newest(key, &had);
+	if (p_data != NULL && p_data != p_value && had == len && memcmp(p_data, p_value, len) == 0) {
+		return true;
+	}
+	p_source[key] = p_value;
+	source_len[key] = len;
+	dirty |= (1UL << key);
+	flash_sched_request(job);
+	return true;
+}
+
+void kv_init(void) {
+	pstorage_module_param_t param = {
+		.cb = on_store,
+		.block_size = FLASH_PAGE_SIZE,
+		.block_count = KV_PAGES,
+	};
+	bool valid[KV_PAGES];
+
+	job = flash_sched_register(kv_run);
+	if (pstorage_register(&param, &base) != NRF_SUCCESS) {
+		return;
+	}
+	registered = true;
+
+	for (uint8_t p = 0; p < KV_PAGES; p++) {
+		valid[p] = header_valid(p);
+	}
+	if (!valid[0] && !valid[1]) {
+		// Blank, or never finished a copy: the first put starts the log
+		// off on page 0 through a copy of nothing
+		active = 1;
+		active_seq = 0xFFFF;
+		cursor = FLASH_PAGE_SIZE;
+		return;
+	}
+	active = valid[1] ? 1 : 0;
+	if (valid[0] && valid[1] &&
+	    (int16_t)(uint16_decode(page_at(0) + 2) - uint16_decode(page_at(1) + 2)) > 0) {
+		active = 0;
+	}
+	active_seq = uint16_decode(page_at(active) + 2);
+	scan();
+}
@@ -0,0 +1,48 @@
+#ifndef _KV_H_
+#define _KV_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Small configuration values by key, appended to a log over two flash
+// pages so a change costs one record written rather than a page
+// rewritten through the pstorage swap page. Where each key's newest
+// record sits is indexed in RAM once at boot, so a lookup is an array
+// read.
+//
+// Page layout:
+//   0  magic (uint16 LE, KV_MAGIC)
+//   2  sequence (uint16 LE), the higher page in use
+//   4  records, each:
+//        key, length
+//        CRC-16 over key, length and value (uint16 LE)
+//        value, padded to a word with 0xFF
+// A record a reset tore fails its CRC and is passed over at boot.
+//
+// When a record won't fit in the page in use, the newest of each key
+// are copied to the other page a record at a time, one step per
+// flash_sched.h opening, and its header goes last: a reset part way
+// leaves the old page in use, and the copy starts over. Puts in the
+// meantime wait their turn.
+#define KV_MAGIC 0x4B56
+#define KV_PAGES 2
+#define KV_MAX_KEYS 24
+#define KV_MAX_VALUE 32
+
+// Keys, by owner
+#define KV_KEY_CALIB 0 // A channel each, CALIB_CHANNELS of them
+
+// Needs pstorage_init() to have run
+void kv_init(void);
+
+// Copy key's value, the newest put whether or not it has reached flash,
+// into p_value (up to max bytes). Returns its length, or -1 if it has
+// none.
+int16_t kv_get(uint8_t key, uint8_t * p_value, uint8_t max);
+// Set key to len bytes at p_value, written at the next opening. p_value
+// has to stay put until then, as with pstorage; putting the key again
+// in the meantime only moves what gets written. An unchanged value
+// costs nothing. False if key or len is out of range.
+bool kv_put(uint8_t key, uint8_t const * p_value, uint8_t len);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "latency.h"
+
+#if LATENCY_ENABLED
+
+typedef struct {
+	uint16_t buckets[LATENCY_BUCKETS];
+	uint16_t max;
+} histogram_t;
+
+static histogram_t histograms[LATENCY_COUNT];
+
+uint32_t latency_start(void) {
+	uint32_t ticks;
+
+	app_timer_cnt_get(&ticks);
+	return ticks;
+}
+
+void latency_record(latency_point_t point, uint32_t start) {
+	uint32_t now, ticks;
+	uint8_t bucket = 0;
+
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, start, &ticks);
+	while (ticks >> bucket && bucket < LATENCY_BUCKETS - 1) {
+		bucket++;
+	}
+
+	CRITICAL_REGION_ENTER();
+	histogram_t * p_hist = &histograms[point];
+	if (p_hist->buckets[bucket] < UINT16_MAX) {
+		p_hist->buckets[bucket]++;
+	}
+	if (ticks > p_hist->max) {
+		p_hist->max = (ticks > UINT16_MAX) ? UINT16_MAX : ticks;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+uint16_t latency_get(uint8_t * p_data) {
+	uint16_t len = 0;
+
+	CRITICAL_REGION_ENTER();
+	for (uint8_t i = 0; i < LATENCY_COUNT; i++) {
+		for (uint8_t b = 0; b < LATENCY_BUCKETS; b++) {
+			len += uint16_encode(histograms[i].buckets[b], &p_data[len]);
+		}
+		len += uint16_encode(histograms[i].max, &p_data[len]);
+	}
+	CRITICAL_REGION_EXIT();
+	return len;
+}
+
+void latency_reset(void) {
+	CRITICAL_REGION_ENTER();
+	memset(histograms, 0, sizeof(histograms));
+	CRITICAL_REGION_EXIT();
+}
+
+#endif
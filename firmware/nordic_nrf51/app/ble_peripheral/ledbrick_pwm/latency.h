@@ -0,0 +1,47 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hot path timing from the RTC1 counter app_timer already runs, so it
+// costs no clock or power. Ticks are 1/32768 s (about 30.5 us).
+#ifndef LATENCY_ENABLED
+#define LATENCY_ENABLED 1
+#endif
+
+typedef enum {
+	LATENCY_COMMAND = 0, // LED, fade and frame write handlers
+	LATENCY_TWI,         // One TWI job on the bus
+	LATENCY_POLL,        // polled_event_update()
+	LATENCY_THERMAL,     // Temperature reading to foldback and fan applied
+	LATENCY_COUNT
+} latency_point_t;
+
+// log2 buckets: 0 is under one tick, n is [2^(n-1), 2^n) ticks, the last
+// also takes anything longer
+#define LATENCY_BUCKETS 16
+
+// Per point: count per bucket (uint16 LE each, saturating), then the
+// longest seen in ticks (uint16 LE, saturating)
+#define LATENCY_POINT_LEN (2 * LATENCY_BUCKETS + 2)
+#define LATENCY_LEN (LATENCY_COUNT * LATENCY_POINT_LEN)
+
+#if LATENCY_ENABLED
+
+uint32_t latency_start(void);
+// Safe from interrupts
+void latency_record(latency_point_t point, uint32_t start);
+
+// Returns the length written, LATENCY_LEN
+uint16_t latency_get(uint8_t * p_data);
+void latency_reset(void);
+
+#else
+
+static inline uint32_t latency_start(void) { return 0; }
+static inline void latency_record(latency_point_t point, uint32_t start) { }
+
+#endif
+
+#endif
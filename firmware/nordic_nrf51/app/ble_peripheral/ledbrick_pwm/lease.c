@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "tick.h"
+#include "schedule.h"
+#include "lease.h"
+
+static lease_expired_handler_t expired_handler;
+static uint16_t left_s = 0;
+static uint8_t fallback = LEASE_NO_SCENE;
+static bool expired = false;
+static uint8_t task = TICK_INVALID;
+
+static void on_tick(void) {
+	if (left_s == 0) {
+		tick_idle(task);
+		return;
+	}
+	if (--left_s > 0) {
+		return;
+	}
+	expired = true;
+	if (expired_handler != NULL) {
+		expired_handler(fallback);
+	}
+}
+
+void lease_init(lease_expired_handler_t handler) {
+	expired_handler = handler;
+	task = tick_register(on_tick, LEASE_TICK_MS, 0);
+	tick_idle(task);
+}
+
+bool lease_renew(uint16_t seconds, uint8_t scene) {
+	if (seconds > LEASE_MAX_S) {
+		return false;
+	}
+	left_s = seconds;
+	fallback = scene;
+	expired = false;
+	if (seconds > 0) {
+		schedule_hold();
+		tick_wake(task);
+	}
+	return true;
+}
+
+bool lease_held(void) {
+	return left_s > 0;
+}
+
+bool lease_expired(void) {
+	return expired;
+}
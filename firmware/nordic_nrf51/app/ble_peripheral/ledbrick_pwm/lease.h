@@ -0,0 +1,31 @@
+#ifndef _LEASE_H_
+#define _LEASE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "schedule.h"
+
+// Control lease. A controller that takes one renews it with a heartbeat
+// (LBS_CMD_OP_LEASE, ble_lbs.h) well inside its length; while it runs
+// the schedule is held off, and once it lapses, link up or not, the
+// brick fails over on its own: the stored schedule takes the outputs
+// back straight away, or where there's none to run the fallback scene is
+// recalled. Without a lease the brick holds its last levels as before.
+#define LEASE_TICK_MS 1000
+// No longer than the schedule hold each renewal restarts
+#define LEASE_MAX_S SCHEDULE_HOLD_S
+#define LEASE_NO_SCENE 0xFF
+
+// Runs in the main context as the lease lapses, with the scene asked for
+typedef void (*lease_expired_handler_t)(uint8_t scene);
+
+// After tick_init()
+void lease_init(lease_expired_handler_t handler);
+// Takes or renews the lease for seconds (1 to LEASE_MAX_S), 0 to give it
+// up without failing over. Returns false if out of range.
+bool lease_renew(uint16_t seconds, uint8_t scene);
+bool lease_held(void);
+// Whether a lease has lapsed since the last renewal
+bool lease_expired(void);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_gap.h"
+#include "ble_hci.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "clock.h"
+#include "link_stats.h"
+#include "tx_power.h"
+
+// Averaged over about this many reports, as 1/16 dBm
+#define RSSI_AVG_SHIFT 3
+
+static uint32_t connections;
+static uint32_t events;
+static uint32_t packets;
+static uint32_t writes;
+static uint16_t reasons[LINK_STATS_REASONS];
+static uint8_t last_reason;
+
+// Interval of the connection (1.25 ms units) and since when
+static uint16_t interval;
+static uint32_t interval_ms;
+
+static int8_t rssi, rssi_min;
+static int16_t rssi_avg16;
+
+// Intervals run at the current one so far
+static uint32_t events_pending(void) {
+	if (interval == 0) {
+		return 0;
+	}
+	return ((clock_ms() - interval_ms) * 4) / (interval * 5);
+}
+
+// The interval is about to change
+static void events_update(void) {
+	events += events_pending();
+	interval_ms = clock_ms();
+}
+
+static link_stats_reason_t reason_of(uint8_t hci) {
+	switch (hci) {
+		case BLE_HCI_CONNECTION_TIMEOUT:
+			return LINK_STATS_TIMEOUT;
+		case BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION:
+		case BLE_HCI_REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES:
+		case BLE_HCI_REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF:
+			return LINK_STATS_REMOTE;
+		case BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION:
+			return LINK_STATS_LOCAL;
+		case BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE:
+			return LINK_STATS_MIC;
+		case BLE_HCI_CONN_FAILED_TO_BE_ESTABLISHED:
+			return LINK_STATS_ESTABLISH;
+		default:
+			return LINK_STATS_OTHER;
+	}
+}
+
+void link_stats_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+	switch (p_ble_evt->header.evt_id) {
+		case BLE_GAP_EVT_CONNECTED:
+			connections++;
+			interval = p_gap->params.connected.conn_params.max_conn_interval;
+			interval_ms = clock_ms();
+			rssi = rssi_min = 0;
+			rssi_avg16 = 0;
+			// Best effort, the counts carry on without it
+			(void)sd_ble_gap_rssi_start(p_gap->conn_handle, LINK_STATS_RSSI_THRESHOLD_DBM, LINK_STATS_RSSI_SKIP);
+			break;
+
+		case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+			events_update();
+			interval = p_gap->params.conn_param_update.conn_params.max_conn_interval;
+			break;
+
+		case BLE_GAP_EVT_DISCONNECTED:
+			events_update();
+			interval = 0;
+			last_reason = p_gap->params.disconnected.reason;
+			reasons[reason_of(last_reason)]++;
+			break;
+
+		case BLE_GAP_EVT_RSSI_CHANGED:
+			rssi = p_gap->params.rssi_changed.rssi;
+			if (rssi_avg16 == 0) {
+				rssi_avg16 = rssi * 16;
+				rssi_min = rssi;
+			}
+			rssi_avg16 += (rssi * 16 - rssi_avg16) >> RSSI_AVG_SHIFT;
+			rssi_min = MIN(rssi_min, rssi);
+			break;
+
+		case BLE_EVT_TX_COMPLETE:
+			packets += p_ble_evt->evt.common_evt.params.tx_complete.count;
+			break;
+
+		case BLE_GATTS_EVT_WRITE:
+			writes++;
+			break;
+
+		default:
+			break;
+	}
+}
+
+uint16_t link_stats_get(uint8_t * p_reply) {
+	uint16_t len = 0;
+
+	len += uint32_encode(connections, &p_reply[len]);
+	len += uint32_encode(events + events_pending(), &p_reply[len]);
+	len += uint32_encode(packets, &p_reply[len]);
+	len += uint32_encode(writes, &p_reply[len]);
+	for (uint8_t i = 0; i < LINK_STATS_REASONS; i++) {
+		len += uint16_encode(reasons[i], &p_reply[len]);
+	}
+	p_reply[len++] = last_reason;
+	p_reply[len++] = (uint8_t)rssi;
+	p_reply[len++] = (uint8_t)(rssi_avg16 / 16);
+	p_reply[len++] = (uint8_t)rssi_min;
+	p_reply[len++] = (uint8_t)tx_power_dbm();
+	len += uint16_encode(tx_power_changes(), &p_reply[len]);
+	return len;
+}
+
+int8_t link_stats_rssi_avg(void) {
+	return rssi_avg16 / 16;
+}
@@ -0,0 +1,48 @@
+#ifndef _LINK_STATS_H_
+#define _LINK_STATS_H_
+
+#include <stdint.h>
+#include "ble.h"
+
+// The link as the brick sees it, for the controller to weigh against
+// its own end (BULK_CMD_LINK_STATS, bulk.h). RSSI is sampled by the
+// SoftDevice on every connection event and reported whenever it moves
+// by LINK_STATS_RSSI_THRESHOLD_DBM. The SoftDevice doesn't count CRC
+// errors or hand out connection events (radio notifications would take
+// SWI1 from esb_rx.c), so events are counted off the interval, and
+// the disconnect reasons, MIC failures and supervision timeouts above
+// all, stand for the packets lost.
+#define LINK_STATS_RSSI_THRESHOLD_DBM 2
+#define LINK_STATS_RSSI_SKIP 3
+
+// Reply, LINK_STATS_LEN bytes:
+//   0  connections since boot (uint32 LE)
+//   4  connection events, elapsed intervals (uint32 LE)
+//   8  packets sent (uint32 LE)
+//  12  writes received (uint32 LE)
+//  16  disconnects by reason (uint16 LE each): supervision timeout,
+//      central terminated, brick terminated, MIC failure, failed to be
+//      established, anything else
+//  28  last disconnect reason (uint8, BLE_HCI_*)
+//  29  RSSI now, on this connection's average and its lowest (int8
+//      each, dBm, 0 before the first sample)
+//  32  transmit power now (int8 dBm, tx_power.h)
+//  33  transmit power changes since boot (uint16 LE)
+#define LINK_STATS_LEN 35
+
+typedef enum {
+	LINK_STATS_TIMEOUT = 0,
+	LINK_STATS_REMOTE,
+	LINK_STATS_LOCAL,
+	LINK_STATS_MIC,
+	LINK_STATS_ESTABLISH,
+	LINK_STATS_OTHER,
+	LINK_STATS_REASONS
+} link_stats_reason_t;
+
+void link_stats_on_ble_evt(ble_evt_t * p_ble_evt);
+uint16_t link_stats_get(uint8_t * p_reply);
+// This connection's average RSSI in dBm, 0 before the first sample
+int8_t link_stats_rssi_avg(void);
+
+#endif
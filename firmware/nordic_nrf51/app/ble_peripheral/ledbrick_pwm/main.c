@@ -26,7 +26,6 @@
 
 #include <stdint.h>
 #include <string.h>
-#include <inttypes.h>
 #include "nordic_common.h"
 #include "nrf.h"
 #include "app_error.h"
@@ -38,31 +37,85 @@
 #include "ble_advertising.h"
 #include "ble_conn_params.h"
 #include "boards.h"
-#include "softdevice_handler.h"
-#include "app_timer.h"
+#include "softdevice_handler_appsh.h"
+#include "app_timer_appsh.h"
+#include "app_scheduler.h"
 #include "device_manager.h"
 #include "pstorage.h"
-#include "app_trace.h"
 #include "bsp.h"
 #include "bsp_btn_ble.h"
 #include "ble_lbs.h"
-#include "twi_master.h"
+#include "twi_queue.h"
 #include "pca9685.h"
 #include "mcp9808.h"
 #include "fan_monitor.h"
+#include "fan_control.h"
+#include "fan_wear.h"
+#include "fade.h"
+#include "derate.h"
+#include "conn_profile.h"
+#include "broadcast.h"
+#include "esb_rx.h"
+#include "relay.h"
+#include "remote_sensor.h"
+#include "junction.h"
+#include "tx_power.h"
+#include "bench.h"
+#include "trace.h"
+#include "schedule.h"
+#include "clock.h"
+#include "journal.h"
+#include "retained.h"
+#include "watchdog.h"
+#include "crash.h"
+#include "latency.h"
+#include "boot_trace.h"
+#include "bulk.h"
+#include "scene.h"
+#include "kv.h"
+#include "calib.h"
+#include "aux.h"
+#include "history.h"
+#include "runhours.h"
+#include "effect.h"
+#include "stream.h"
+#include "link_stats.h"
+#include "flash_sched.h"
+#include "radio_idle.h"
+#include "sync_apply.h"
+#include "supply.h"
+#include "tick.h"
+#include "dlog.h"
+#include "burnin.h"
+#include "lease.h"
+#include "sim.h"
+#include "mem_stats.h"
+#include "cpu_stats.h"
 #include "error_handlers.h"
+#ifdef BLE_DFU_APP_SUPPORT
+#include "nrf_delay.h"
+#include "ble_dfu.h"
+#include "dfu_app_handler.h"
+#include "dfu_types.h"
+#endif // BLE_DFU_APP_SUPPORT
 
 #define IS_SRVC_CHANGED_CHARACT_PRESENT  1                                          /**< Include or not the service_changed characteristic. if not enabled, the server's database cannot be changed for the lifetime of the device*/
 
 #define DEVICE_NAME                      "LEDBrick-PWM"                               /**< Name of device. Will be included in the advertising data. */
 #define MANUFACTURER_NAME                "theatr.us"                      /**< Manufacturer. Will be passed to Device Information Service. */
-#define APP_ADV_INTERVAL                 300                                        /**< The advertising interval (in units of 0.625 ms. This value corresponds to 25 ms). */
-#define APP_ADV_TIMEOUT_IN_SECONDS       86400                                        /**< The advertising timeout in units of seconds. */
+#define APP_ADV_FAST_INTERVAL            40                                         /**< Fast advertising interval (in units of 0.625 ms. This value corresponds to 25 ms). */
+#define APP_ADV_FAST_TIMEOUT_IN_SECONDS  30                                         /**< Fast advertising window after boot or after directed advertising has timed out. */
+#define APP_ADV_SLOW_INTERVAL            1636                                       /**< Slow advertising interval (in units of 0.625 ms. This value corresponds to 1022.5 ms). */
+#define APP_ADV_SLOW_TIMEOUT_IN_SECONDS  0                                          /**< Slow advertising never times out. */
+#define APP_ADV_NIGHT_INTERVAL           8000                                       /**< Slow advertising interval while the outputs sleep for the night (in units of 0.625 ms. This value corresponds to 5 s). */
 
 #define APP_TIMER_PRESCALER              0                                          /**< Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_MAX_TIMERS             (7+BSP_APP_TIMERS_NUMBER)                  /**< Maximum number of simultaneously created timers. */
+#define APP_TIMER_MAX_TIMERS             (6+BSP_APP_TIMERS_NUMBER)                  /**< Maximum number of simultaneously created timers. */
 #define APP_TIMER_OP_QUEUE_SIZE          8                                          /**< Size of timer operation queues. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE        MAX(APP_TIMER_SCHED_EVT_SIZE, sizeof(temp_event_t)) /**< Maximum size of scheduler events (timer events and temperature samples). */
+#define SCHED_QUEUE_SIZE                 16                                         /**< Maximum number of events in the scheduler queue. */
+
 #define MIN_CONN_INTERVAL                MSEC_TO_UNITS(50, UNIT_1_25_MS)           /**< Minimum acceptable connection interval (0.05 seconds). */
 #define MAX_CONN_INTERVAL                MSEC_TO_UNITS(200, UNIT_1_25_MS)           /**< Maximum acceptable connection interval (.2 second). */
 #define SLAVE_LATENCY                    0                                          /**< Slave latency. */
@@ -81,16 +134,92 @@
 
 #define DEAD_BEEF                        0xDEADBEEF                                 /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
+#ifdef BLE_DFU_APP_SUPPORT
+#define DFU_REV_MAJOR                    0x00                                       /** DFU Major revision number to be exposed. */
+#define DFU_REV_MINOR                    0x01                                       /** DFU Minor revision number to be exposed. */
+#define DFU_REVISION                     ((DFU_REV_MAJOR << 8) | DFU_REV_MINOR)     /** DFU Revision number to be exposed. Combined of major and minor versions. */
+#define APP_SERVICE_HANDLE_START         0x000C                                     /**< Handle of first application specific service when when service changed characteristic is present. */
+#define BLE_HANDLE_MAX                   0xFFFF                                     /**< Max handle value in BLE. */
+#define DFU_HANDOVER_DELAY_MS            500                                        /**< Time for the disconnect and the last output write to complete before the bootloader takes over. */
+
+STATIC_ASSERT(IS_SRVC_CHANGED_CHARACT_PRESENT);                                     /** When having DFU Service support in application the Service Changed Characteristic should always be present. */
+STATIC_ASSERT((PSTORAGE_NUM_OF_PAGES + 1) * CODE_PAGE_SIZE <= DFU_APP_DATA_RESERVED); /** Every pstorage page, and its swap page, kept out of a DFU bank's way. */
+#endif // BLE_DFU_APP_SUPPORT
+
+static bool                              m_write_held = false;                       /**< Outputs held by write_coalesce() until the next flush is due. */
+static uint32_t                          m_write_flush_ms;                           /**< When coalesced writes last went out, clock_ms(). */
+static uint8_t                           m_write_task = TICK_INVALID;                /**< Tick task flushing held writes, idle while nothing is held or fading. */
+static uint8_t                           m_output[LBS_OUTPUT_LEN];                   /**< Output state as last published, see output_state_update(). */
+static uint32_t                          m_output_gen;                               /**< Generation of m_output, moves with every change published. */
 static dm_application_instance_t         m_app_handle;                               /**< Application identifier allocated by device manager */
+static bool                              m_adv_night = false;                        /**< Advertising stretched out to APP_ADV_NIGHT_INTERVAL. */
+static ble_gap_addr_t                    m_last_central;                             /**< Controller to send directed advertising to after a disconnect, addr_type 0xFF when there is none. */
 static ble_lbs_t                         m_lbs;
-static uint16_t                          m_conn_handle = BLE_CONN_HANDLE_INVALID;   /**< Handle of the current connection. */
-static app_timer_id_t                    m_apptimer_id;
+#ifdef BLE_DFU_APP_SUPPORT
+static ble_dfu_t                         m_dfus;                                    /**< Structure used to identify the DFU service. */
+#endif // BLE_DFU_APP_SUPPORT
+
+#define BROADCAST_GROUP                  0x01                                       /**< Controller broadcast group this brick follows. */
+#define BROADCAST_KEY                    { 0x4c, 0x45, 0x44, 0x42, 0x72, 0x69, 0x63, 0x6b, \
+                                           0x2d, 0x62, 0x63, 0x61, 0x73, 0x74, 0x30, 0x31 } /**< Shared broadcast and command MAC key, change per installation. */
+#define CMD_MAC_REQUIRED                 0                                          /**< Only take command writes signed with the broadcast key, and no writes to the other characteristics (ble_lbs.h). */
+#define ESB_RX_ENABLED                   0                                          /**< Also take broadcast frames from a controller dongle over ESB, in radio timeslots. */
+#define BROADCAST_RELAY                  0                                          /**< Re-advertise accepted broadcasts while connected, for bricks out of the controller's range (relay.h, S130 only). */
+#if BROADCAST_RELAY && LBS_MAX_LINKS > 1
+#error "The relay takes the advertising set while connected, which a second link needs"
+#endif
+#define ESB_RX_CHANNEL                   76                                         /**< Dongle RF channel, 2400 + n MHz. */
+#define ESB_RX_ADDRESS                   { 0xE7, 0xE7, 0xE7, 0xE7, 0xE7 }           /**< Dongle pipe address, prefix byte first. */
+
+/* Telemetry in the advertisement's manufacturer data (company BROADCAST_COMPANY_ID):
+ * magic, telemetry flags, error bits, temperature (1/16 degree C, int16 LE), fan rpm (uint16 LE),
+ * derate percent, fan duty percent, change sequence. Fills the advertisement alongside the flags
+ * and full name. */
+#define ADV_TELEMETRY_LEN                10
+#define ADV_TELEMETRY_MAGIC              0x54                                       /**< Distinguishes brick telemetry from controller broadcasts (BROADCAST_MAGIC). */
+
+#define POLL_INTERVAL_MS                 5000                                       /**< Sensor poll and telemetry update interval. */
+#define SENSOR_FRESH_MS                  1000                                       /**< A sensor read this soon after a reading is answered with it rather than another. */
+#define TELEMETRY_MAX_INTERVAL_MS        60000                                      /**< Unchanged telemetry is still notified this often, well inside the controller's stale timeout. */
+#define WRITE_COALESCE_MS                TICK_MS                                    /**< Output writes closer together than this go out together, at most one frame per interval (write_coalesce()). */
+
+/* Tasks on the shared tick (tick.h): aux, burn-in, clock, effect, the error log, flash_sched,
+ * lease, run hours, schedule, stream, supply, the TWI health check and two of ours, then the
+ * relay, the simulation and the remote sensors where they are built in. */
+#if defined(S130) && defined(BOARD_REMOTE_SENSORS)
+#define TICK_TASKS_REMOTE_SENSOR         1
+#else
+#define TICK_TASKS_REMOTE_SENSOR         0
+#endif
+#define TICK_TASKS                       (14 + (BROADCAST_RELAY ? 1 : 0) + (SIM_ENABLED ? 1 : 0) + TICK_TASKS_REMOTE_SENSOR)
+STATIC_ASSERT(TICK_TASKS <= TICK_MAX_TASKS);
+
+#define TEMP_ALERT_LOWER                 MCP9808_DEG(30)                            /**< Crossing below this takes an extra sample for the fan loop. */
+#define TEMP_ALERT_UPPER                 MCP9808_DEG(42)                            /**< Crossing above this takes an extra sample for the fan loop. */
+#define TEMP_CRITICAL                    MCP9808_DEG(65)                            /**< Outputs shut down above this, the derate band (derate.h) sits below it. */
+#define TEMP_HW_SHUTDOWN                 1                                          /**< Cut OE through PPI when the sensor trips T_CRIT. The ALERT pin then only reports T_CRIT, so the fan loop only gets the regular poll. */
+
+/* Idle power policy. The DC/DC converter needs its inductor fitted. TWI and tach gating are
+ * TWI_QUEUE_IDLE_DISABLE (twi_queue.h) and FANTACH_IDLE_STOP (fan_monitor.h). */
+#define POWER_DCDC                       1                                          /**< Run the radio from the DC/DC converter instead of the LDO. */
+
+static volatile bool                     m_thermal_trip = false;                    /**< OE was forced off by the hardware path and hasn't been restored. */
+static int16_t                           m_temp = 0;                                /**< Last good reading, 1/16 degree C. */
+static bool                              m_temp_valid = false;                      /**< The last sample succeeded. */
+static uint32_t                          m_temp_at = 0;                             /**< clock_ms() of the last good reading. */
+static uint16_t                          m_output_hash = 0;                         /**< PCA9685 state at the last poll. */
+
+typedef struct
+{
+    bool    success;
+    int16_t temp;                                                                   /**< 1/16 degree C. */
+    uint32_t start;                                                                 /**< latency_start() as the reading came in. */
+} temp_event_t;
 
 #define LEDBUTTON_LED_PIN_NO            BSP_LED_1
 #define LEDBUTTON_BUTTON_PIN_NO         BSP_BUTTON_1
-
-#define TWI0_CONFIG_FREQUENCY NRF_TWI_FREQ_100K
-#define TWI0_CONFIG_IRQ_PRIORITY 0
+#define SCENE_BUTTON_ID                 2                                           /**< BSP button whose long press steps through the scenes, 0 and 1 belong to bsp_btn_ble. */
+#define SCENE_BUTTON_EVENT              BSP_EVENT_KEY_2
 
 
 void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
@@ -99,151 +228,1226 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
 }
 
 
-static void timers_init(void)
-{
-    // Initialize timer module.
-    APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_MAX_TIMERS, APP_TIMER_OP_QUEUE_SIZE, false);
+/**@brief Function for the event scheduler initialization.
+ *
+ * @details Timer timeouts, BLE events and I2C completions are all queued here and handled from
+ *          the main loop, so nothing at interrupt priority waits on the bus or the SoftDevice.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+}
+
+
+static void timers_init(void)
+{
+    // Initialize timer module, dispatching timeouts through the scheduler.
+    APP_TIMER_APPSH_INIT(APP_TIMER_PRESCALER, APP_TIMER_MAX_TIMERS, APP_TIMER_OP_QUEUE_SIZE, true);
+}
+
+
+/**@brief Function for the GAP initialization.
+ *
+ * @details This function sets up all the necessary GAP (Generic Access Profile) parameters of the
+ *          device including the device name, appearance, and the preferred connection parameters.
+ */
+static void gap_params_init(void)
+{
+    uint32_t                err_code;
+    ble_gap_conn_params_t   gap_conn_params;
+    ble_gap_conn_sec_mode_t sec_mode;
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&sec_mode);
+
+    err_code = sd_ble_gap_device_name_set(&sec_mode,
+                                          (const uint8_t *)DEVICE_NAME,
+                                          strlen(DEVICE_NAME));
+    APP_ERROR_CHECK(err_code);
+
+    /* YOUR_JOB: Use an appearance value matching the application's use case.
+       err_code = sd_ble_gap_appearance_set(BLE_APPEARANCE_);
+       APP_ERROR_CHECK(err_code); */
+
+    memset(&gap_conn_params, 0, sizeof(gap_conn_params));
+
+    gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
+    gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
+    gap_conn_params.slave_latency     = SLAVE_LATENCY;
+    gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+
+    err_code = sd_ble_gap_ppcp_set(&gap_conn_params);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
+{
+    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
+    {
+        // Keep the link on whatever the central wants
+        conn_profile_failed();
+    }
+}
+
+static void conn_params_error_handler(uint32_t nrf_error)
+{
+    // A request colliding with one in flight isn't fatal, the module
+    // retries on its own timer
+    if (nrf_error != NRF_ERROR_BUSY)
+    {
+        APP_ERROR_HANDLER(nrf_error);
+    }
+}
+
+
+/**@brief Function for initializing the Connection Parameters module.
+ */
+static void conn_params_init(void)
+{
+    uint32_t               err_code;
+    ble_conn_params_init_t cp_init;
+
+    memset(&cp_init, 0, sizeof(cp_init));
+
+    cp_init.p_conn_params                  = NULL;
+    cp_init.first_conn_params_update_delay = FIRST_CONN_PARAMS_UPDATE_DELAY;
+    cp_init.next_conn_params_update_delay  = NEXT_CONN_PARAMS_UPDATE_DELAY;
+    cp_init.max_conn_params_update_count   = MAX_CONN_PARAMS_UPDATE_COUNT;
+    cp_init.start_on_notify_cccd_handle    = m_lbs.link_char_handles.cccd_handle;
+    cp_init.disconnect_on_fail             = false;
+    cp_init.evt_handler                    = on_conn_params_evt;
+    cp_init.error_handler                  = conn_params_error_handler;
+
+    // Negotiating on connect made the Paypal GATT client drop the link.
+    // It never answers the L2CAP update request, and the SoftDevice
+    // disconnects when the request times out whatever disconnect_on_fail
+    // says. Only start once the central opts in on the link characteristic.
+    err_code = ble_conn_params_init(&cp_init);
+    APP_ERROR_CHECK(err_code);
+
+    conn_profile_init(m_lbs.link_char_handles.cccd_handle);
+}
+
+static void link_status_update(void)
+{
+    ble_gap_conn_params_t params;
+
+    conn_profile_params(&params);
+    ble_lbs_update_link(&m_lbs, conn_profile_current(), conn_profile_forced(), &params);
+}
+
+static void link_write_handler(ble_lbs_t * p_lbs, uint8_t profile)
+{
+    conn_profile_request((conn_profile_t)profile);
+    link_status_update();
+}
+
+static void led_write_all(uint16_t level) {
+    fade_set_all(level);
+}
+
+static void time_status_update(void)
+{
+    // Doubles as the radio watchdog feed, the SoftDevice has to be answering
+    if (ble_lbs_update_time(&m_lbs, clock_time(), clock_uptime(), clock_drift_ppm(), clock_is_set()) == NRF_SUCCESS)
+    {
+        watchdog_feed(WATCHDOG_RADIO);
+    }
+}
+
+static void time_write_handler(ble_lbs_t * p_lbs, uint32_t time, uint8_t fraction)
+{
+    clock_set(time, fraction);
+    time_status_update();
+    schedule_resync();
+}
+
+static void crash_log_update(void)
+{
+    uint8_t log[CRASH_LOG_MAX_LEN];
+
+    (void)ble_lbs_update_crash_log(&m_lbs, log, crash_log_get(log));
+}
+
+static void crash_clear_handler(ble_lbs_t * p_lbs)
+{
+    crash_log_clear();
+    crash_log_update();
+}
+
+static void error_log_update(void)
+{
+    uint8_t log[ERROR_LOG_MAX_LEN];
+
+    (void)ble_lbs_update_events(&m_lbs, log, error_log_get(log));
+}
+
+static void events_ack_handler(ble_lbs_t * p_lbs, uint32_t seq)
+{
+    error_log_ack(seq);
+}
+
+static void boot_status_update(void)
+{
+    uint8_t data[BOOT_TRACE_LEN];
+
+    (void)ble_lbs_update_boot(&m_lbs, data, boot_trace_get(data));
+}
+
+#if LATENCY_ENABLED
+static void latency_status_update(void)
+{
+    uint8_t data[LATENCY_LEN];
+
+    (void)ble_lbs_update_latency(&m_lbs, data, latency_get(data));
+}
+
+static void latency_reset_handler(ble_lbs_t * p_lbs)
+{
+    latency_reset();
+    latency_status_update();
+}
+#endif
+
+static void schedule_status_update(void)
+{
+    uint8_t status[SCHEDULE_STATUS_LEN];
+
+    schedule_status(status);
+    (void)ble_lbs_update_schedule(&m_lbs, status, sizeof(status));
+}
+
+static void schedule_write_handler(ble_lbs_t * p_lbs, uint8_t const * p_data, uint16_t len)
+{
+    (void)schedule_write(p_data, len);
+    schedule_status_update();
+}
+
+// Scenes hold the schedule off like any other direct command
+static bool scene_activate(uint8_t slot) {
+    if (error_any() || !scene_recall(slot)) {
+        return false;
+    }
+    schedule_hold();
+    return true;
+}
+
+static bool scene_handler(ble_lbs_t * p_lbs, uint8_t op, uint8_t slot, uint16_t fade_ms) {
+    switch (op) {
+        case LBS_CMD_OP_SCENE_RECALL:
+            return scene_activate(slot);
+        case LBS_CMD_OP_SCENE_SAVE:
+            return scene_capture(slot, fade_ms);
+        case LBS_CMD_OP_SCENE_CLEAR:
+            return scene_clear(slot);
+        default:
+            return false;
+    }
+}
+
+static void broadcast_scene_handler(uint8_t slot) {
+    (void)scene_activate(slot);
+}
+
+// Stamp as early as the event reaches us, the controller filters the rest
+static void sync_write_handler(ble_lbs_t * p_lbs, uint32_t token) {
+    (void)ble_lbs_update_sync(p_lbs, token, clock_ms());
+}
+
+static void trace_handler(ble_lbs_t * p_lbs, uint8_t seq) {
+    trace_received(seq);
+}
+
+static void trace_process(void * p_data, uint16_t size) {
+    uint8_t seq;
+    uint32_t received_ms;
+    uint16_t commit_ms;
+
+    if (trace_take(&seq, &received_ms, &commit_ms)) {
+        ble_lbs_command_trace(&m_lbs, seq, received_ms, commit_ms);
+    }
+}
+
+// Runs in the TWI interrupt. If the queue is full the trace is lost, and
+// replaced once it goes stale.
+static void on_commit(void) {
+    if (trace_committed()) {
+        (void)app_sched_event_put(NULL, 0, trace_process);
+    }
+}
+
+static bool at_handler(ble_lbs_t * p_lbs, uint32_t at_ms, uint8_t const * p_records, uint16_t len) {
+    return sync_apply_stage(at_ms, p_records, len);
+}
+
+static bool pwm_freq_handler(ble_lbs_t * p_lbs, uint16_t hz) {
+    return pca9685_set_frequency(hz);
+}
+
+static void dither_handler(ble_lbs_t * p_lbs, uint16_t mask) {
+    fade_set_dither(mask);
+}
+
+static bool dim_handler(ble_lbs_t * p_lbs, uint8_t percent) {
+    // For the output state
+    tick_wake(m_write_task);
+    return pca9685_dim(percent);
+}
+
+static void slew_handler(ble_lbs_t * p_lbs, uint16_t mask, uint16_t levels_per_s) {
+    fade_set_slew(mask, levels_per_s);
+}
+
+#if SIM_ENABLED
+static bool sim_handler(ble_lbs_t * p_lbs, uint8_t kind, int16_t low, int16_t high, uint16_t period_min) {
+    return sim_start((sim_kind_t)kind, low, high, period_min);
+}
+#endif
+
+static bool effect_handler(ble_lbs_t * p_lbs, uint8_t kind, uint16_t seed, uint8_t depth_pct,
+                           uint8_t period_s, uint8_t strikes_per_min, uint16_t duration_s) {
+    return effect_start((effect_kind_t)kind, seed, depth_pct, period_s, strikes_per_min, duration_s);
+}
+
+static bool stream_start_handler(ble_lbs_t * p_lbs, uint32_t start_ms, uint16_t period_ms, uint16_t mask) {
+    return stream_start(start_ms, period_ms, mask);
+}
+
+static bool stream_frame_handler(ble_lbs_t * p_lbs, uint8_t const * p_frame, uint8_t len) {
+    return stream_frame(p_frame, len);
+}
+
+static bool burnin_handler(ble_lbs_t * p_lbs, uint16_t duration_min, uint8_t max_rise_c) {
+    return burnin_start(duration_min, max_rise_c);
+}
+
+// Lightning would light outputs the error handling holds dark
+static bool effect_allowed(void) {
+    return !error_any();
+}
+
+static void stage_handler(ble_lbs_t * p_lbs, uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+    fade_stage(mask, p_levels, duration_ms);
+}
+
+static void commit_handler(ble_lbs_t * p_lbs) {
+    uint32_t start = latency_start();
+
+    schedule_hold();
+    if (error_any()) {
+        fade_discard(); // Outputs stay off
+    } else {
+        (void)fade_commit();
+    }
+    latency_record(LATENCY_COMMAND, start);
+}
+
+static void sync_apply_handler(uint8_t const * p_records, uint16_t len) {
+    pca9685_hold();
+    (void)ble_lbs_run(&m_lbs, p_records, len);
+    pca9685_release();
+}
+
+static bool bulk_scene_store(uint8_t const * p_body, uint16_t len) {
+    uint16_t levels[SCENE_MAX_CHANNELS];
+    uint16_t mask;
+    uint16_t offset = 5;
+
+    if (len < offset) {
+        return false;
+    }
+    mask = uint16_decode(&p_body[1]);
+    for (uint8_t i = 0; i < SCENE_MAX_CHANNELS; i++) {
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+        if (offset + sizeof(uint16_t) > len) {
+            return false;
+        }
+        levels[i] = uint16_decode(&p_body[offset]);
+        offset += sizeof(uint16_t);
+    }
+    return (offset == len) && scene_store(p_body[0], mask, levels, uint16_decode(&p_body[3]));
+}
+
+static bool bulk_calib(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+    bool ok = true;
+
+    if (len == 0) {
+        for (uint8_t i = 0; i < CALIB_CHANNELS; i++) {
+            p_reply[0] = i;
+            calib_get(i, &p_reply[1]);
+            p_reply += 1 + CALIB_RECORD_LEN;
+        }
+        *p_reply_len = CALIB_CHANNELS * (1 + CALIB_RECORD_LEN);
+        return true;
+    }
+    if (len % (1 + CALIB_RECORD_LEN) != 0) {
+        return false;
+    }
+    for (uint16_t offset = 0; offset < len; offset += 1 + CALIB_RECORD_LEN) {
+        ok &= calib_set(p_body[offset], &p_body[offset + 1]);
+    }
+    fade_refresh();
+    return ok;
+}
+
+static bool bulk_aux(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+    bool ok = true;
+
+    if (len == 0) {
+        *p_reply_len = aux_get(p_reply);
+        return true;
+    }
+    if (len % AUX_RECORD_LEN != 0) {
+        return false;
+    }
+    for (uint16_t offset = 0; offset < len; offset += AUX_RECORD_LEN) {
+        ok &= aux_set(&p_body[offset]);
+    }
+    return ok;
+}
+
+// Ratings set, if any, then the counts read back either way
+static bool bulk_run_hours(uint8_t const * p_body, uint16_t len, uint8_t * p_reply, uint16_t * p_reply_len) {
+    bool ok = true;
+
+    if (len % 5 != 0) {
+        return false;
+    }
+    for (uint16_t offset = 0; offset < len; offset += 5) {
+        ok &= runhours_set_rated(p_body[offset], uint32_decode(&p_body[offset + 1]));
+    }
+    *p_reply_len = 0;
+    for (uint8_t i = 0; i < RUNHOURS_CHANNELS; i++) {
+        *p_reply_len += runhours_get(i, &p_reply[*p_reply_len]);
+    }
+    return ok;
+}
+
+static uint16_t bulk_bus_stats(uint8_t * p_reply)
+{
+    twi_class_stats_t stats;
+    twi_device_stats_t dev;
+    uint16_t len = 0;
+
+    for (uint8_t i = 0; i < TWI_CLASS_COUNT; i++)
+    {
+        twi_queue_stats((twi_class_t)i, &stats);
+        len += uint32_encode(stats.jobs, &p_reply[len]);
+        len += uint32_encode(stats.failed, &p_reply[len]);
+        len += uint32_encode(stats.bytes, &p_reply[len]);
+    }
+    len += uint32_encode(pca9685_commits(), &p_reply[len]);
+    len += uint32_encode(twi_queue_recoveries(), &p_reply[len]);
+    for (uint8_t i = 0; twi_queue_device_stats(i, &dev); i++)
+    {
+        p_reply[len++] = dev.address;
+        len += uint16_encode(dev.address_nack, &p_reply[len]);
+        len += uint16_encode(dev.data_nack, &p_reply[len]);
+        len += uint16_encode(dev.overrun, &p_reply[len]);
+        len += uint16_encode(dev.timeout, &p_reply[len]);
+    }
+    return len;
+}
+
+// Whether a bulk command drives the brick, as a characteristic write
+// would, rather than only reading it back
+static bool bulk_drives(uint8_t cmd, uint16_t len)
+{
+    switch (cmd)
+    {
+        case BULK_CMD_SCHEDULE:
+        case BULK_CMD_SCENE:
+        case BULK_CMD_BENCH:
+            return true;
+
+        case BULK_CMD_CALIB:
+        case BULK_CMD_RUN_HOURS:
+        case BULK_CMD_AUX:
+            return len > 0; // An empty body reads them back
+
+        default:
+            return false;
+    }
+}
+
+static bulk_status_t bulk_handler(uint16_t conn_handle, uint8_t cmd, uint8_t const * p_body, uint16_t len,
+                                  uint8_t * p_reply, uint16_t * p_reply_len)
+{
+    // Held to the same control and MAC checks as the characteristics;
+    // command writes check for themselves
+    if (bulk_drives(cmd, len) && !ble_lbs_control_take(&m_lbs, conn_handle))
+    {
+        return BULK_STATUS_REJECTED;
+    }
+    switch (cmd)
+    {
+        case BULK_CMD_SCHEDULE:
+        {
+            // Points, then optionally a crossfade (uint16 LE seconds)
+            uint16_t points = (len >= 4) ? p_body[0] * SCHEDULE_POINT_LEN(p_body[1]) : 0;
+            bool crossfade = (len == 4 + points + 2);
+            bool ok = (len >= 4) &&
+                      schedule_load(p_body[0], p_body[1], &p_body[4], crossfade ? points : len - 4,
+                                    uint16_decode(&p_body[2]),
+                                    crossfade ? uint16_decode(&p_body[4 + points]) : 0);
+            schedule_status_update();
+            return ok ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+        }
+
+        case BULK_CMD_EVENTS:
+            *p_reply_len = error_log_get(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_CRASH:
+            *p_reply_len = crash_log_get(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_COMMANDS:
+            return ble_lbs_command(&m_lbs, conn_handle, p_body, len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_SCENE:
+            return bulk_scene_store(p_body, len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_CALIB:
+            return bulk_calib(p_body, len, p_reply, p_reply_len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_BUS_STATS:
+            *p_reply_len = bulk_bus_stats(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_HISTORY:
+            return history_read(p_body, len, p_reply, p_reply_len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_RUN_HOURS:
+            return bulk_run_hours(p_body, len, p_reply, p_reply_len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_LINK_STATS:
+            *p_reply_len = link_stats_get(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_BENCH:
+            return bench_start() ? BULK_STATUS_PENDING : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_STREAM:
+            *p_reply_len = stream_stats_get(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_DEBUG_LOG:
+            return dlog_read(p_body, len, p_reply, p_reply_len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        case BULK_CMD_BURN_IN:
+            *p_reply_len = burnin_get(p_reply);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_MEMORY:
+            *p_reply_len = mem_stats_get(SCHED_QUEUE_SIZE, APP_TIMER_OP_QUEUE_SIZE, p_reply);
+            *p_reply_len += uint32_encode(tick_wakeups_hour(), &p_reply[*p_reply_len]);
+            *p_reply_len += uint32_encode(tick_wakeups(), &p_reply[*p_reply_len]);
+            *p_reply_len += cpu_stats_get(&p_reply[*p_reply_len]);
+            return BULK_STATUS_OK;
+
+        case BULK_CMD_AUX:
+            return bulk_aux(p_body, len, p_reply, p_reply_len) ? BULK_STATUS_OK : BULK_STATUS_REJECTED;
+
+        default:
+            return BULK_STATUS_UNKNOWN;
+    }
+}
+
+/**@brief Function for coalescing output writes that come faster than the bus needs them.
+ *
+ * @details The first write after a quiet spell goes straight out. One within WRITE_COALESCE_MS of
+ *          the last flush holds the outputs (pca9685_hold()), so it and any that follow only move
+ *          the shadow, later ones to a channel overwriting earlier, and the tick lets them all go
+ *          as one frame once the interval is up. Writes arriving faster stop adding bus traffic.
+ */
+static void write_coalesce(void)
+{
+    uint32_t now = clock_ms();
+
+    tick_wake(m_write_task);
+    if (m_write_held)
+    {
+        return;
+    }
+    if (now - m_write_flush_ms < WRITE_COALESCE_MS)
+    {
+        pca9685_hold();
+        m_write_held = true;
+        return;
+    }
+    m_write_flush_ms = now;
+}
+
+STATIC_ASSERT(FADE_NUM_CHANNELS <= LBS_FRAME_MAX_CHANNELS);
+
+/**@brief Function for publishing the output state when it has moved.
+ *
+ * @details Only the derate, dim, error flag and targets are compared, so a running fade or the
+ *          register hash following it doesn't move the generation. That stays put until a read
+ *          would find the brick meant to drive something else.
+ */
+static void output_state_update(void)
+{
+    uint8_t data[LBS_OUTPUT_LEN];
+
+    memset(data, 0, sizeof(data));
+    data[4] = derate_percent();
+    data[5] = pca9685_dim_percent();
+    data[6] = error_any() ? LBS_OUTPUT_FLAG_ERROR : 0;
+    for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+        uint16_encode(fade_target(i), &data[LBS_OUTPUT_HEADER_LEN + 2 * i]);
+    }
+    data[LBS_OUTPUT_CHANNELS_OFFSET] = BOARD_LED_CHANNELS;
+    if (m_output_gen != 0 &&
+        memcmp(&data[4], &m_output[4], 2) == 0 &&
+        (data[6] & LBS_OUTPUT_FLAG_ERROR) == (m_output[6] & LBS_OUTPUT_FLAG_ERROR) &&
+        memcmp(&data[LBS_OUTPUT_HEADER_LEN], &m_output[LBS_OUTPUT_HEADER_LEN],
+               LBS_OUTPUT_LEN - LBS_OUTPUT_HEADER_LEN) == 0) {
+        return;
+    }
+    uint32_encode(++m_output_gen, data);
+    data[6] |= fade_active() ? LBS_OUTPUT_FLAG_FADING : 0;
+    uint16_encode(pca9685_state_hash(), &data[7]);
+    memcpy(m_output, data, sizeof(m_output));
+    (void)ble_lbs_update_output(&m_lbs, m_output, sizeof(m_output));
+}
+
+static void write_coalesce_tick(void)
+{
+    uint32_t now = clock_ms();
+
+    if (m_write_held && now - m_write_flush_ms >= WRITE_COALESCE_MS)
+    {
+        m_write_held = false;
+        m_write_flush_ms = now;
+        pca9685_release();
+    }
+    // Once a tick, after whatever was held has gone out. Still, the
+    // tick sleeps until the next write, and the poll picks up what else
+    // moves the state (derate, errors, the schedule's own fades' ends).
+    output_state_update();
+    if (!m_write_held && !fade_active())
+    {
+        tick_idle(m_write_task);
+    }
+}
+
+/**@brief Function for turning every output off on an error or thermal shutdown.
+ *
+ * @details Held writes only move the shadow, so the blackout lets the coalescing hold go at once
+ *          rather than waiting out the interval with the outputs still lit.
+ */
+static void write_blackout(void)
+{
+    led_write_all(0);
+    if (m_write_held)
+    {
+        m_write_held = false;
+        m_write_flush_ms = clock_ms();
+        pca9685_release();
+    }
+}
+
+static void led_write_handler(ble_lbs_t * p_lbs, uint8_t led, uint16_t level) {
+    uint32_t start = latency_start();
+
+    nrf_gpio_pin_toggle(LEDBUTTON_LED_PIN_NO);
+    schedule_hold();
+    write_coalesce();
+    if (error_any()) {
+        write_blackout();
+    } else if (led == 0xFF) { // All LEDs
+        led_write_all(level);
+    } else if (led == 0xFE) {
+        pca9685_enable(level != 0);
+    } else {
+        fade_set(led, level);
+    }
+    latency_record(LATENCY_COMMAND, start);
+}
+
+static void fade_write_handler(ble_lbs_t * p_lbs, uint8_t led, uint16_t level, uint16_t duration_ms) {
+    uint32_t start = latency_start();
+
+    schedule_hold();
+    write_coalesce();
+    if (error_any()) {
+        // Outputs stay off
+    } else if (led == 0xFF) { // All LEDs
+        for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+            fade_to(i, level, duration_ms);
+        }
+    } else {
+        fade_to(led, level, duration_ms);
+    }
+    latency_record(LATENCY_COMMAND, start);
+}
+
+static void frame_write_handler(ble_lbs_t * p_lbs, uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+    uint32_t start = latency_start();
+
+    schedule_hold();
+    write_coalesce();
+    if (!error_any()) {
+        fade_frame(mask, p_levels, duration_ms);
+    }
+    latency_record(LATENCY_COMMAND, start);
+}
+
+static void broadcast_frame_handler(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+    schedule_hold();
+    write_coalesce();
+    if (error_any()) {
+        return;
+    }
+
+    fade_frame(mask, p_levels, duration_ms);
+}
+
+// Each streamed frame is taken as the controller's, holding the schedule
+// off as a written one does
+static void stream_output_handler(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms) {
+    schedule_hold();
+    write_coalesce();
+    if (!error_any()) {
+        fade_frame(mask, p_levels, duration_ms);
+    }
+}
+
+static void advertising_telemetry_update(ble_lbs_telemetry_data_t const * p_data);
+static void advertising_pace(void);
+
+static void telemetry_update(void) {
+    ble_lbs_telemetry_data_t data;
+
+    data.temp        = m_temp;
+    data.rpm         = fantach_rpm();
+    data.errors      = error_bits();
+    data.derate_pct  = derate_percent();
+    data.fan_duty    = fan_control_duty();
+    data.flags       = (m_temp_valid ? LBS_TELEMETRY_FLAG_TEMP_VALID : 0) |
+                       (m_thermal_trip ? LBS_TELEMETRY_FLAG_TRIPPED : 0) |
+                       (pca9685_present() ? 0 : LBS_TELEMETRY_FLAG_NO_OUTPUT) |
+                       (supply_shed() ? LBS_TELEMETRY_FLAG_SUPPLY_SHED : 0) |
+                       (lease_expired() ? LBS_TELEMETRY_FLAG_LEASE_LAPSED : 0) |
+                       (lease_held() ? LBS_TELEMETRY_FLAG_LEASED : 0);
+    data.uptime      = clock_uptime();
+    data.output_hash = pca9685_state_hash();
+    ble_lbs_update_telemetry(&m_lbs, &data);
+    advertising_telemetry_update(&data);
+}
+
+// Answer reads held on the temperature with the last good reading
+static void temp_reply(void) {
+    int16_t sensors[MCP9808_NUM_SENSORS];
+
+    mcp9808_sensors(sensors);
+    ble_lbs_reply_temp(&m_lbs, m_temp, sensors, sim_active() ? 0 : MCP9808_NUM_SENSORS);
+}
+
+static void temp_sample(void);
+
+// A controller reading rather than subscribing gets a reading taken for
+// it, at most one per SENSOR_FRESH_MS. The fan tach needs no bus traffic
+// so is answered straight away; the temperature is answered from
+// temp_sample_process() once the sensors have been read, or by the next
+// poll should the bus be too busy to take the sample.
+static void sensor_read_handler(ble_lbs_t * p_lbs, uint8_t sensor) {
+    if (sensor == LBS_SENSOR_FAN) {
+        uint16_t fans[FANTACH_NUM_FANS];
+
+        for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+            fans[f] = fantach_fan_rpm(f);
+        }
+        ble_lbs_reply_fan(p_lbs, fantach_rpm(), fans, FANTACH_NUM_FANS);
+        return;
+    }
+    // A simulation feeds readings on its own schedule
+    if (sim_active() || (m_temp_valid && (clock_ms() - m_temp_at) < SENSOR_FRESH_MS)) {
+        temp_reply();
+        return;
+    }
+    // Already sampling leaves the read to that sample
+    temp_sample();
+}
+
+// How far the outputs rise from where they are to p_levels, in percent
+// of full output across every channel
+static uint8_t output_rise(uint16_t const * p_levels) {
+    int32_t sum = 0;
+
+    for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++)
+    {
+        sum += (int32_t)p_levels[i] - fade_level(i);
+    }
+    return (sum <= 0) ? 0 : (uint8_t)(sum * 100 / (FADE_NUM_CHANNELS * FADE_MAX_LEVEL));
+}
+
+// What the brick knows of its own output ahead, for the fan: the fades
+// running and the schedule FAN_LEAD_S on
+static void fan_lead_update(void) {
+    uint16_t levels[FADE_NUM_CHANNELS];
+
+    for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++)
+    {
+        levels[i] = fade_target(i);
+    }
+    fan_control_lead(FAN_LEAD_FADE, output_rise(levels), 0);
+    fan_control_lead(FAN_LEAD_SCHEDULE,
+                     schedule_ahead(FAN_LEAD_S, levels) ? output_rise(levels) : 0, 0);
+}
+
+static void temp_sample_process(void * p_event_data, uint16_t event_size) {
+		temp_event_t const * p_evt = p_event_data;
+		int16_t temp = p_evt->temp;
+
+		watchdog_feed(WATCHDOG_SENSORS);
+		m_temp_valid = p_evt->success;
+		if (p_evt->success) {
+			int16_t sensors[MCP9808_NUM_SENSORS];
+
+			m_temp = temp;
+			m_temp_at = clock_ms();
+			mcp9808_sensors(sensors);
+			// A simulated reading has no sensors behind it
+			ble_lbs_update_temp(&m_lbs, temp, sensors, sim_active() ? 0 : MCP9808_NUM_SENSORS);
+		} else {
+			// Reads held on this sample get the last good one
+			temp_reply();
+		}
+
+		// The loops act on the junctions, leading the board reading
+		int16_t junction = p_evt->success ? junction_update(temp) : temp;
+
+		// Fan speed loop, failing safe to the fan flat out
+		fan_lead_update();
+		fan_control_update(p_evt->success, junction);
+		// A simulation would teach the baselines what isn't there
+		if (p_evt->success && !sim_active()) {
+			fan_wear_sample(fan_control_duty(), temp);
+		}
+
+		// Fold the output back before the hard cutoff
+		if (p_evt->success && derate_update(junction)) {
+			fade_refresh();
+		}
+		
+		if (p_evt->success && temp > TEMP_CRITICAL) {
+			error_raise(ERROR_TEMP, temp);
+		}
+
+		// Give OE back once the sensor has released ALERT
+		if (m_thermal_trip && p_evt->success && temp < TEMP_CRITICAL &&
+		    !mcp9808_alert_asserted()) {
+			m_thermal_trip = false;
+			pca9685_protect_reset();
+		}
+		
+    if (error_any()) {
+        write_blackout();
+    }
+
+    telemetry_update();
+    latency_record(LATENCY_THERMAL, p_evt->start);
+}
+
+// Runs in the TWI interrupt, hand the reading to the main loop. If the
+// queue is full the sample is dropped, the next poll takes another.
+static void on_temp_sample(bool success, int16_t temp) {
+    temp_event_t evt = { .success = success, .temp = temp, .start = latency_start() };
+    (void)app_sched_event_put(&evt, sizeof(evt), temp_sample_process);
+}
+
+// A simulation feeds its own readings, the sensor is left alone while it runs
+static void temp_sample(void) {
+    if (!sim_active()) {
+        mcp9808_sample(on_temp_sample);
+    }
+}
+
+// Runs in the GPIOTE interrupt when the sensor crosses a threshold. Take
+// a reading straight away rather than waiting for the next poll. With the
+// hardware shutdown the outputs are already off by the time this runs.
+static void on_temp_alert(bool asserted) {
+#if TEMP_HW_SHUTDOWN
+    if (asserted) {
+        pca9685_protect_trip();
+        m_thermal_trip = true;
+        error_raise(ERROR_TEMP, m_temp);
+    }
+#endif
+    temp_sample();
+}
+
+/**@brief Function for putting the last known levels back on the outputs.
+ *
+ * @details Runs before the SoftDevice is enabled. A reset that kept RAM (watchdog, fault) has
+ *          the freshest copy, otherwise the journal is read straight out of flash.
+ */
+static void output_restore(void)
+{
+    uint16_t levels[FADE_NUM_CHANNELS];
+    bool found = journal_init(levels);
+
+    if (retained_levels(levels) || found)
+    {
+        fade_frame((1 << FADE_NUM_CHANNELS) - 1, levels, 0);
+    }
+}
+
+static void output_save(void)
+{
+    uint16_t levels[FADE_NUM_CHANNELS];
+
+    for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++)
+    {
+        levels[i] = fade_target(i);
+    }
+    retained_levels_set(levels);
+    journal_update(levels, clock_uptime());
+}
+
+static void on_supply_shed(bool shed) {
+    dlog(shed ? DLOG_SUPPLY_SHED : DLOG_SUPPLY_RESTORED, 0, supply_mv());
+    pca9685_shed(shed);
+    if (shed) {
+        uint16_t levels[FADE_NUM_CHANNELS];
+
+        // Power may not last, save what the outputs were headed for now
+        for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++)
+        {
+            levels[i] = fade_target(i);
+        }
+        retained_levels_set(levels);
+        journal_flush(levels, clock_uptime());
+        runhours_flush();
+    }
+    telemetry_update();
+}
+
+static void fan_lead_handler(ble_lbs_t * p_lbs, uint8_t rise, uint16_t hold_s) {
+    fan_control_lead(FAN_LEAD_HINT, rise, hold_s);
+}
+
+static bool lease_handler(ble_lbs_t * p_lbs, uint16_t seconds, uint8_t scene) {
+    if (!lease_renew(seconds, scene)) {
+        return false;
+    }
+    telemetry_update();
+    return true;
+}
+
+// The controller stopped renewing, the schedule takes over, or the
+// fallback scene where there's nothing to run
+static void on_lease_expired(uint8_t scene) {
+    bool scheduled = schedule_release();
+
+    if (!scheduled && scene != LEASE_NO_SCENE) {
+        (void)scene_activate(scene);
+    }
+    dlog(DLOG_LEASE_LAPSED, scene, scheduled);
+    schedule_status_update();
+    telemetry_update();
+}
+
+static void supply_status_update(void)
+{
+    uint8_t data[SUPPLY_LEN];
+
+    (void)ble_lbs_update_supply(&m_lbs, data, supply_window(data));
+}
+
+static void polled_event_update(void) {
+    uint32_t start = latency_start();
+    uint16_t rpm = fantach_rpm();
+    uint16_t fans[FANTACH_NUM_FANS];
+    for (uint8_t f = 0; f < FANTACH_NUM_FANS; f++) {
+        fans[f] = fantach_fan_rpm(f);
+    }
+    ble_lbs_update_fan(&m_lbs, rpm, fans, FANTACH_NUM_FANS);
+    ble_lbs_update_status(&m_lbs, derate_percent(), pca9685_commits(), pca9685_scrub_repairs());
+    pca9685_scrub();
+    pca9685_night(clock_uptime());
+    advertising_pace();
+    cpu_roll();
+
+    // Output moving counts as activity for the auto connection profile
+    uint16_t output_hash = pca9685_state_hash();
+    if (output_hash != m_output_hash) {
+        m_output_hash = output_hash;
+        conn_profile_activity();
+    }
+    conn_profile_poll();
+    tx_power_poll();
+    link_status_update();
+    time_status_update();
+    if (error_log_changed()) {
+        error_log_update();
+    }
+    output_save();
+    history_update(m_temp_valid, m_temp, rpm, derate_percent(), clock_uptime());
+    burnin_sample(m_temp_valid, m_temp, rpm);
+    supply_status_update();
+    output_state_update();
+    // Degraded since boot, keep trying to bring the outputs back
+    (void)pca9685_retry();
+
+    // Temperature handling continues in on_temp_sample() once the
+    // read completes, without blocking this handler on the bus. Threshold
+    // crossings don't wait for this, they come in through on_temp_alert().
+    temp_sample();
+#if LATENCY_ENABLED
+    latency_status_update();
+#endif
+    latency_record(LATENCY_POLL, start);
+}
+
+
+static void application_timers_start(void) {
+    // Half a period off the error and schedule ticks, so they don't all land together.
+    // Registered last, so these fail if any task before them didn't fit either.
+    APP_ERROR_CHECK_BOOL(tick_register(polled_event_update, POLL_INTERVAL_MS, POLL_INTERVAL_MS / 2) != TICK_INVALID);
+    m_write_task = tick_register(write_coalesce_tick, WRITE_COALESCE_MS, 0);
+    APP_ERROR_CHECK_BOOL(m_write_task != TICK_INVALID);
 }
 
 
-/**@brief Function for the GAP initialization.
- *
- * @details This function sets up all the necessary GAP (Generic Access Profile) parameters of the
- *          device including the device name, appearance, and the preferred connection parameters.
- */
-static void gap_params_init(void)
+static void services_init(void)
 {
-    uint32_t                err_code;
-    ble_gap_conn_params_t   gap_conn_params;
-    ble_gap_conn_sec_mode_t sec_mode;
+    uint32_t err_code;
+    ble_lbs_init_t init;
+    void const * p_handles;
+    uint16_t handles_len;
 
-    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&sec_mode);
+    init.led_write_handler = led_write_handler;
+    init.fade_write_handler = fade_write_handler;
+    init.frame_write_handler = frame_write_handler;
+    init.link_write_handler = link_write_handler;
+    init.schedule_write_handler = schedule_write_handler;
+    init.time_write_handler = time_write_handler;
+    init.crash_clear_handler = crash_clear_handler;
+    init.events_ack_handler = events_ack_handler;
+    init.scene_handler = scene_handler;
+    init.at_handler = at_handler;
+    init.sync_write_handler = sync_write_handler;
+    init.trace_handler = trace_handler;
+    init.pwm_freq_handler = pwm_freq_handler;
+    init.dither_handler = dither_handler;
+    init.stage_handler = stage_handler;
+    init.dim_handler = dim_handler;
+    init.slew_handler = slew_handler;
+#if SIM_ENABLED
+    init.sim_handler = sim_handler;
+#else
+    init.sim_handler = NULL;
+#endif
+    init.commit_handler = commit_handler;
+    init.effect_handler = effect_handler;
+    init.burnin_handler = burnin_handler;
+    init.lease_handler = lease_handler;
+    init.fan_lead_handler = fan_lead_handler;
+    init.stream_start_handler = stream_start_handler;
+    init.stream_frame_handler = stream_frame_handler;
+    init.sensor_read_handler = sensor_read_handler;
+    init.mac_handler = broadcast_mac_check;
+    init.cmd_mac_required = CMD_MAC_REQUIRED;
+#if LATENCY_ENABLED
+    init.latency_reset_handler = latency_reset_handler;
+#endif
+    init.fan_deadband = LBS_FAN_DEADBAND;
+    init.temp_deadband = LBS_TEMP_DEADBAND;
+    init.max_interval = TELEMETRY_MAX_INTERVAL_MS / POLL_INTERVAL_MS;
+    init.channels = BOARD_LED_CHANNELS;
+    init.capabilities = LBS_CAP_LEVEL_12BIT | LBS_CAP_FADE | LBS_CAP_FRAME | LBS_CAP_COMMAND |
+                        LBS_CAP_BULK | LBS_CAP_SYNC | LBS_CAP_SCHEDULE | LBS_CAP_SCENES |
+                        LBS_CAP_BROADCAST | LBS_CAP_ESB | LBS_CAP_EFFECT | LBS_CAP_LEASE |
+                        LBS_CAP_OUTPUT | LBS_CAP_TRACE | LBS_CAP_CMD_MAC | LBS_CAP_CROSSFADE |
+                        LBS_CAP_FAN_LEAD | LBS_CAP_LONG_WRITE | LBS_CAP_STREAM;
+#ifdef BLE_DFU_APP_SUPPORT
+    init.capabilities |= LBS_CAP_DFU;
+#endif
+#if SIM_ENABLED
+    init.capabilities |= LBS_CAP_SIM;
+#endif
+#if CMD_MAC_REQUIRED
+    init.capabilities |= LBS_CAP_CMD_MAC_REQUIRED;
+#endif
+#if LATENCY_ENABLED
+    init.capabilities |= LBS_CAP_LATENCY;
+#endif
+#if DLOG_ENABLED
+    init.capabilities |= LBS_CAP_DLOG;
+#endif
+    if (AUX_CHANNELS > 0) {
+        init.capabilities |= LBS_CAP_AUX;
+    }
 
-    err_code = sd_ble_gap_device_name_set(&sec_mode,
-                                          (const uint8_t *)DEVICE_NAME,
-                                          strlen(DEVICE_NAME));
+    err_code = ble_lbs_init(&m_lbs, &init);
+    APP_ERROR_CHECK(err_code);
+    pca9685_on_commit(on_commit);
+    err_code = bulk_init(bulk_handler);
     APP_ERROR_CHECK(err_code);
+    p_handles = bulk_handles(&handles_len);
+    err_code = ble_lbs_schema_add(&m_lbs, p_handles, handles_len);
+    APP_ERROR_CHECK(err_code);
+    crash_log_update();
+    error_log_update();
+}
 
-    /* YOUR_JOB: Use an appearance value matching the application's use case.
-       err_code = sd_ble_gap_appearance_set(BLE_APPEARANCE_);
-       APP_ERROR_CHECK(err_code); */
 
-    memset(&gap_conn_params, 0, sizeof(gap_conn_params));
+#ifdef BLE_DFU_APP_SUPPORT
+/**@brief Function for stopping advertising.
+ */
+static void advertising_stop(void)
+{
+    uint32_t err_code;
 
-    gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
-    gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
-    gap_conn_params.slave_latency     = SLAVE_LATENCY;
-    gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+    err_code = sd_ble_gap_adv_stop();
+    APP_ERROR_CHECK(err_code);
 
-    err_code = sd_ble_gap_ppcp_set(&gap_conn_params);
+    err_code = bsp_indication_set(BSP_INDICATE_IDLE);
     APP_ERROR_CHECK(err_code);
 }
 
-static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
+
+// Drop every link, for a reset or the disconnect button
+static void links_disconnect(void)
 {
-//    uint32_t err_code;
+    uint32_t err_code;
 
-    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
+    for (uint8_t i = 0; i < LBS_MAX_LINKS; i++)
     {
-        //err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
-        //APP_ERROR_CHECK(err_code);
+        if (m_lbs.conn_handles[i] == BLE_CONN_HANDLE_INVALID)
+        {
+            continue;
+        }
+        err_code = sd_ble_gap_disconnect(m_lbs.conn_handles[i], BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+        if (err_code != NRF_ERROR_INVALID_STATE)
+        {
+            APP_ERROR_CHECK(err_code);
+        }
     }
 }
 
-static void conn_params_error_handler(uint32_t nrf_error)
-{
-    APP_ERROR_HANDLER(nrf_error);
-}
-
 
-/**@brief Function for initializing the Connection Parameters module.
+/**@brief Function for loading application-specific context after establishing a secure connection.
+ *
+ * @details This function will load the application context and check if the ATT table is marked as
+ *          changed. If the ATT table is marked as changed, a Service Changed Indication
+ *          is sent to the peer if the Service Changed CCCD is set to indicate.
+ *
+ * @param[in] p_handle The Device Manager handle that identifies the connection for which the context
+ *                     should be loaded.
  */
-static void conn_params_init(void)
+static void app_context_load(dm_handle_t const * p_handle, uint16_t conn_handle)
 {
-    //uint32_t               err_code;
-    ble_conn_params_init_t cp_init;
-
-    memset(&cp_init, 0, sizeof(cp_init));
+    uint32_t                 err_code;
+    static uint32_t          context_data;
+    dm_application_context_t context;
 
-    cp_init.p_conn_params                  = NULL;
-    cp_init.first_conn_params_update_delay = FIRST_CONN_PARAMS_UPDATE_DELAY;
-    cp_init.next_conn_params_update_delay  = NEXT_CONN_PARAMS_UPDATE_DELAY;
-    cp_init.max_conn_params_update_count   = MAX_CONN_PARAMS_UPDATE_COUNT;
-    cp_init.start_on_notify_cccd_handle    = BLE_GATT_HANDLE_INVALID;
-    cp_init.disconnect_on_fail             = false;
-    cp_init.evt_handler                    = on_conn_params_evt;
-    cp_init.error_handler                  = conn_params_error_handler;
+    context.len    = sizeof(context_data);
+    context.p_data = (uint8_t *)&context_data;
 
-	  // Disabled as this currently makes the Paypal GATT server
-	  // unhappy - it disconnects even though told not to.
-	
-    //err_code = ble_conn_params_init(&cp_init);
-    //APP_ERROR_CHECK(err_code);
-}
+    err_code = dm_application_context_get(p_handle, &context);
+    if (err_code == NRF_SUCCESS)
+    {
+        // Send Service Changed Indication if ATT table has changed.
+        if ((context_data & (DFU_APP_ATT_TABLE_CHANGED << DFU_APP_ATT_TABLE_POS)) != 0)
+        {
+            err_code = sd_ble_gatts_service_changed(conn_handle, APP_SERVICE_HANDLE_START, BLE_HANDLE_MAX);
+            if ((err_code != NRF_SUCCESS) &&
+                (err_code != BLE_ERROR_INVALID_CONN_HANDLE) &&
+                (err_code != NRF_ERROR_INVALID_STATE) &&
+                (err_code != BLE_ERROR_NO_TX_BUFFERS) &&
+                (err_code != NRF_ERROR_BUSY) &&
+                (err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING))
+            {
+                APP_ERROR_HANDLER(err_code);
+            }
+        }
 
-static void led_write_all(uint8_t power) {
-    for (int i = 0; i < 16; i++) {
-        pca9685_write_led(i, 0x0, power << 4);
+        err_code = dm_application_context_delete(p_handle);
+        APP_ERROR_CHECK(err_code);
+    }
+    else if (err_code == DM_NO_APP_CONTEXT)
+    {
+        // No context available. Ignore.
+    }
+    else
+    {
+        APP_ERROR_HANDLER(err_code);
     }
 }
 
-static void led_write_handler(ble_lbs_t * p_lbs, uint8_t led, uint8_t power) {
-    nrf_gpio_pin_toggle(LEDBUTTON_LED_PIN_NO);
-    if (error_any()) {
-        led_write_all(0);
-        return;
-    }
 
-    if (led == 0xFF) { // All LEDs
-        led_write_all(power);
-    } else if (led == 0xFE) {
-        pca9685_enable(power);
-    } else {
-        pca9685_write_led(led, 0x0, power << 4);
+/**@brief Function for preparing for the jump into the bootloader.
+ *
+ * @details Running fades are snapped to their targets and kept in retained RAM for the new image.
+ *          The PCA9685 then holds the outputs by itself for the whole transfer; OE and the thermal
+ *          PPI cutoff are left configured, the bootloader touches neither.
+ */
+static void reset_prepare(void)
+{
+    uint32_t err_code;
+    uint16_t levels[FADE_NUM_CHANNELS];
+
+    for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++)
+    {
+        levels[i] = fade_target(i);
     }
-}
+    fade_frame((1 << FADE_NUM_CHANNELS) - 1, levels, 0);
+    // Not the journal, a flash write can't complete once the SoftDevice is gone
+    retained_levels_set(levels);
 
-static void polled_event_update(void* p) {
-    uint16_t rpm = fantach_rpm();
-    uint8_t rpma[2] = { rpm & 0xFF, rpm >> 8 };
-    ble_lbs_update_fan(&m_lbs, rpma);
-		uint16_t temp = mcp9808_temp();
-		uint8_t tempa[2] = { temp & 0XFF, temp >> 8};
-		ble_lbs_update_temp(&m_lbs, tempa);
-
-		// Do fan movement logic
-		if (temp > 0 && temp < 30) {
-			fantach_disable();
-		} else if (temp == 0 || temp > 42) {
-			fantach_enable();
-		}
-		
-		if (temp > 65) {
-			error_raise(ERROR_TEMP);
-		}
-		
-    if (error_any()) {
-        led_write_all(0);
+    if (ble_lbs_links(&m_lbs) > 0)
+    {
+        links_disconnect();
+        err_code = bsp_indication_set(BSP_INDICATE_IDLE);
+        APP_ERROR_CHECK(err_code);
+    }
+    else
+    {
+        // If not connected, the device will be advertising. Hence stop the advertising.
+        advertising_stop();
     }
-}
 
+    err_code = ble_conn_params_stop();
+    APP_ERROR_CHECK(err_code);
 
-static void application_timers_start(void) {
-    app_timer_create(&m_apptimer_id, APP_TIMER_MODE_REPEATED, polled_event_update);
-    app_timer_start(m_apptimer_id, APP_TIMER_TICKS(5000, 0), NULL);
+    // Interrupts still run here, the bus write and the disconnect complete
+    nrf_delay_ms(DFU_HANDOVER_DELAY_MS);
 }
 
 
-static void services_init(void)
+/**@brief Function for initializing the DFU Service.
+ *
+ * @details Writing the start procedure to its control point hands over to the dual bank
+ *          bootloader, which takes the new image into the spare bank and only replaces this one
+ *          once it has been validated.
+ */
+static void dfu_init(void)
 {
-    uint32_t err_code;
-    ble_lbs_init_t init;
+    uint32_t       err_code;
+    ble_dfu_init_t dfus_init;
 
-    init.led_write_handler = led_write_handler;
+    memset(&dfus_init, 0, sizeof(dfus_init));
 
-    err_code = ble_lbs_init(&m_lbs, &init);
+    dfus_init.evt_handler   = dfu_app_on_dfu_evt;
+    dfus_init.error_handler = NULL;
+    dfus_init.revision      = DFU_REVISION;
+
+    err_code = ble_dfu_init(&m_dfus, &dfus_init);
+    APP_ERROR_CHECK(err_code);
+    // Its four characteristics' handles sit together
+    err_code = ble_lbs_schema_add(&m_lbs, &m_dfus.dfu_pkt_handles, 4 * sizeof(ble_gatts_char_handles_t));
     APP_ERROR_CHECK(err_code);
+
+    dfu_app_reset_prepare_set(reset_prepare);
+    dfu_app_dm_appl_instance_set(m_app_handle);
 }
+#endif // BLE_DFU_APP_SUPPORT
 
 
 /**@brief Function for putting the chip into sleep mode.
@@ -277,14 +1481,57 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
     switch (ble_adv_evt)
     {
+    case BLE_ADV_EVT_DIRECTED:
+        err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_DIRECTED);
+        APP_ERROR_CHECK(err_code);
+        break;
     case BLE_ADV_EVT_FAST:
+    case BLE_ADV_EVT_FAST_WHITELIST:
         err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
         APP_ERROR_CHECK(err_code);
         break;
+    case BLE_ADV_EVT_SLOW_WHITELIST:
+        // Only the fast window is kept for bonded controllers, anyone
+        // can connect in the long tail
+        err_code = ble_advertising_restart_without_whitelist();
+        APP_ERROR_CHECK(err_code);
+        break;
+    case BLE_ADV_EVT_SLOW:
+        err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_SLOW);
+        APP_ERROR_CHECK(err_code);
+        break;
+    case BLE_ADV_EVT_WHITELIST_REQUEST:
+    {
+        ble_gap_whitelist_t whitelist;
+        ble_gap_addr_t    * p_whitelist_addr[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+        ble_gap_irk_t     * p_whitelist_irk[BLE_GAP_WHITELIST_IRK_MAX_COUNT];
+
+        whitelist.addr_count = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+        whitelist.irk_count  = BLE_GAP_WHITELIST_IRK_MAX_COUNT;
+        whitelist.pp_addrs   = p_whitelist_addr;
+        whitelist.pp_irks    = p_whitelist_irk;
+
+        // Empty without bonds, which advertises unfiltered
+        err_code = dm_whitelist_create(&m_app_handle, &whitelist);
+        APP_ERROR_CHECK(err_code);
+
+        err_code = ble_advertising_whitelist_reply(&whitelist);
+        APP_ERROR_CHECK(err_code);
+        break;
+    }
+    case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+        // Directed advertising can't reach a resolvable or non-resolvable
+        // private address, those go straight on to the fast window
+        if (m_last_central.addr_type == BLE_GAP_ADDR_TYPE_PUBLIC ||
+            m_last_central.addr_type == BLE_GAP_ADDR_TYPE_RANDOM_STATIC)
+        {
+            err_code = ble_advertising_peer_addr_reply(&m_last_central);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
     case BLE_ADV_EVT_IDLE:
-			  // Never sleep, always advertise.
-				ble_advertising_start(BLE_ADV_MODE_FAST);
-        //sleep_mode_enter();
+        // Never sleep, always advertise.
+        ble_advertising_start(BLE_ADV_MODE_SLOW);
         break;
     default:
         break;
@@ -305,15 +1552,32 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
     case BLE_GAP_EVT_CONNECTED:
         err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
         APP_ERROR_CHECK(err_code);
-        m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+        m_last_central = p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+        break;
+
+    default:
+        // No implementation needed.
+        break;
+    }
+}
+
+
+// Links coming and going, once the service has counted them
+static void link_log(ble_evt_t * p_ble_evt)
+{
+    ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+    case BLE_GAP_EVT_CONNECTED:
+        dlog(DLOG_CONNECTED, ble_lbs_links(&m_lbs), p_gap->params.connected.conn_params.max_conn_interval);
         break;
 
     case BLE_GAP_EVT_DISCONNECTED:
-        m_conn_handle = BLE_CONN_HANDLE_INVALID;
+        dlog(DLOG_DISCONNECTED, p_gap->params.disconnected.reason, ble_lbs_links(&m_lbs));
         break;
 
     default:
-        // No implementation needed.
         break;
     }
 }
@@ -328,13 +1592,49 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
  */
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
+    cpu_mark_t mark = cpu_begin();
+
+    // Sensor links are the brick's own, not the controller's
+    if (remote_sensor_on_ble_evt(p_ble_evt))
+    {
+        cpu_end(CPU_BLE, mark);
+        return;
+    }
+    // Every channel a write sets goes out as one frame
+    pca9685_hold();
     dm_ble_evt_handler(p_ble_evt);
     ble_conn_params_on_ble_evt(p_ble_evt);
     bsp_btn_ble_on_ble_evt(p_ble_evt);
     on_ble_evt(p_ble_evt);
+    // Gives the advertising data back before advertising starts again
+    relay_on_ble_evt(p_ble_evt);
     ble_advertising_on_ble_evt(p_ble_evt);
     ble_lbs_on_ble_evt(&m_lbs, p_ble_evt);
+    link_log(p_ble_evt);
+#if LBS_MAX_LINKS > 1
+    if ((p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED) && (ble_lbs_links(&m_lbs) < LBS_MAX_LINKS))
+    {
+        // Room for a monitor or a standby controller alongside
+        (void)ble_advertising_start(BLE_ADV_MODE_FAST);
+    }
+#endif
+    bulk_on_ble_evt(p_ble_evt);
+    conn_profile_on_ble_evt(p_ble_evt);
+    link_stats_on_ble_evt(p_ble_evt);
+    tx_power_on_ble_evt(p_ble_evt);
+    flash_sched_on_ble_evt(p_ble_evt);
+    radio_idle_on_ble_evt(p_ble_evt);
+    broadcast_on_ble_evt(p_ble_evt);
+#ifdef BLE_DFU_APP_SUPPORT
+    ble_dfu_on_ble_evt(&m_dfus, p_ble_evt);
+#endif // BLE_DFU_APP_SUPPORT
 
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONN_PARAM_UPDATE)
+    {
+        link_status_update();
+    }
+    pca9685_release();
+    cpu_end(CPU_BLE, mark);
 }
 
 
@@ -347,8 +1647,15 @@ static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
  */
 static void sys_evt_dispatch(uint32_t sys_evt)
 {
+    cpu_mark_t mark = cpu_begin();
+
     pstorage_sys_event_handler(sys_evt);
+    // Ignores flash events unless it started the operation
+    bench_on_sys_evt(sys_evt);
     ble_advertising_on_sys_evt(sys_evt);
+    esb_rx_on_sys_evt(sys_evt);
+    supply_on_sys_evt(sys_evt);
+    cpu_end(CPU_BLE, mark);
 }
 
 
@@ -361,7 +1668,7 @@ static void ble_stack_init(void)
     uint32_t err_code;
 
     // Initialize the SoftDevice handler module.
-    SOFTDEVICE_HANDLER_INIT( NRF_CLOCK_LFCLKSRC_RC_250_PPM_4000MS_CALIBRATION, NULL);
+    SOFTDEVICE_HANDLER_APPSH_INIT( NRF_CLOCK_LFCLKSRC_RC_250_PPM_4000MS_CALIBRATION, true);
 
 #if defined(S110) || defined(S130)
     // Enable BLE stack.
@@ -382,6 +1689,11 @@ static void ble_stack_init(void)
     // Register with the SoftDevice handler module for BLE events.
     err_code = softdevice_sys_evt_handler_set(sys_evt_dispatch);
     APP_ERROR_CHECK(err_code);
+
+#if POWER_DCDC
+    err_code = sd_power_dcdc_mode_set(NRF_POWER_DCDC_ENABLE);
+    APP_ERROR_CHECK(err_code);
+#endif
 }
 
 
@@ -399,12 +1711,18 @@ void bsp_event_handler(bsp_event_t event)
         break;
 
     case BSP_EVENT_DISCONNECT:
-        err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
-        if (err_code != NRF_ERROR_INVALID_STATE)
+        links_disconnect();
+        break;
+
+    case SCENE_BUTTON_EVENT:
+    {
+        uint8_t slot = scene_next();
+        if (slot < SCENE_SLOTS)
         {
-            APP_ERROR_CHECK(err_code);
+            (void)scene_activate(slot);
         }
         break;
+    }
 
     case BSP_EVENT_WHITELIST_OFF:
         err_code = ble_advertising_restart_without_whitelist();
@@ -433,7 +1751,7 @@ static uint32_t device_manager_evt_handler(dm_handle_t const * p_handle,
 #ifdef BLE_DFU_APP_SUPPORT
     if (p_event->event_id == DM_EVT_LINK_SECURED)
     {
-        app_context_load(p_handle);
+        app_context_load(p_handle, p_event->event_param.p_gap_param->conn_handle);
     }
 #endif // BLE_DFU_APP_SUPPORT
 
@@ -452,10 +1770,6 @@ static void device_manager_init(bool erase_bonds)
     dm_init_param_t        init_param = {.clear_persistent_data = erase_bonds};
     dm_application_param_t register_param;
 
-    // Initialize persistent storage module.
-    err_code = pstorage_init();
-    APP_ERROR_CHECK(err_code);
-
     err_code = dm_init(&init_param);
     APP_ERROR_CHECK(err_code);
 
@@ -477,34 +1791,135 @@ static void device_manager_init(bool erase_bonds)
 
 /**@brief Function for initializing the Advertising functionality.
  */
-static void advertising_init(void)
+//ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}, {LBS_UUID_SERVICE, m_lbs.uuid_type}};
+//ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}};
+static ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}, {LBS_UUID_SERVICE, BLE_UUID_TYPE_BLE}}; /**< Universally unique service identifiers. */
+
+static uint8_t                  m_adv_telemetry[ADV_TELEMETRY_LEN];                 /**< Manufacturer data payload, see ADV_TELEMETRY_LEN. */
+static ble_advdata_manuf_data_t m_adv_manuf;
+
+/**@brief Function for building the advertising and scan response data.
+ *
+ * @details The name and telemetry go in the advertisement so passive scanners see them, the
+ *          service UUIDs and appearance move to the scan response to make room.
+ */
+static void advertising_data_build(ble_advdata_t * p_advdata, ble_advdata_t * p_srdata)
 {
-    uint32_t      err_code;
+    memset(p_advdata, 0, sizeof(*p_advdata));
+    memset(p_srdata, 0, sizeof(*p_srdata));
+
+    m_adv_manuf.company_identifier = BROADCAST_COMPANY_ID;
+    m_adv_manuf.data.p_data        = m_adv_telemetry;
+    m_adv_manuf.data.size          = sizeof(m_adv_telemetry);
+
+    p_advdata->name_type             = BLE_ADVDATA_FULL_NAME;
+    p_advdata->flags                 = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+    p_advdata->p_manuf_specific_data = &m_adv_manuf;
+
+    p_srdata->include_appearance      = true;
+    p_srdata->uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+    p_srdata->uuids_complete.p_uuids  = m_adv_uuids;
+}
+
+/**@brief Function for refreshing the telemetry carried in the advertisement.
+ *
+ * @details Only touches the SoftDevice when the payload changed. The sequence byte moves with
+ *          every change so scanners can tell a new reading from a repeat.
+ */
+static void advertising_telemetry_update(ble_lbs_telemetry_data_t const * p_data)
+{
+    uint8_t       payload[ADV_TELEMETRY_LEN];
     ble_advdata_t advdata;
+    ble_advdata_t srdata;
+
+    payload[0] = ADV_TELEMETRY_MAGIC;
+    payload[1] = p_data->flags;
+    payload[2] = p_data->errors;
+    uint16_encode((uint16_t)p_data->temp, &payload[3]);
+    uint16_encode(p_data->rpm, &payload[5]);
+    payload[7] = p_data->derate_pct;
+    payload[8] = p_data->fan_duty;
+    payload[9] = m_adv_telemetry[9];
+
+    if (memcmp(payload, m_adv_telemetry, ADV_TELEMETRY_LEN) == 0)
+    {
+        return;
+    }
+    payload[9]++;
+    memcpy(m_adv_telemetry, payload, ADV_TELEMETRY_LEN);
+
+    // The relay puts the latest back when it's done
+    if (relay_active())
+    {
+        return;
+    }
+    advertising_data_build(&advdata, &srdata);
+    (void)ble_advdata_set(&advdata, &srdata);
+}
 
-    //ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}, {LBS_UUID_SERVICE, m_lbs.uuid_type}};
-    //ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}};
-    ble_uuid_t m_adv_uuids[] = {{BLE_UUID_DEVICE_INFORMATION_SERVICE, BLE_UUID_TYPE_BLE}, {LBS_UUID_SERVICE, BLE_UUID_TYPE_BLE}}; /**< Universally unique service identifiers. */
+/**@brief Function for putting the advertising data back after the relay has used it.
+ */
+static void advertising_restore(void)
+{
+    ble_advdata_t advdata;
+    ble_advdata_t srdata;
 
+    advertising_data_build(&advdata, &srdata);
+    (void)ble_advdata_set(&advdata, &srdata);
+}
 
-    // Build advertising data struct to pass into @ref ble_advertising_init.
-    memset(&advdata, 0, sizeof(advdata));
+static void advertising_init(uint32_t slow_interval)
+{
+    uint32_t      err_code;
+    ble_advdata_t advdata;
+    ble_advdata_t srdata;
 
-    advdata.name_type               = BLE_ADVDATA_FULL_NAME;
-    advdata.include_appearance      = true;
-    advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-    advdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
-    advdata.uuids_complete.p_uuids  = m_adv_uuids;
+    m_adv_telemetry[0] = ADV_TELEMETRY_MAGIC;
 
-    ble_adv_modes_config_t options = {0};
-    options.ble_adv_fast_enabled  = BLE_ADV_FAST_ENABLED;
-    options.ble_adv_fast_interval = APP_ADV_INTERVAL;
-    options.ble_adv_fast_timeout  = APP_ADV_TIMEOUT_IN_SECONDS;
+    // Build advertising data struct to pass into @ref ble_advertising_init.
+    advertising_data_build(&advdata, &srdata);
 
-    err_code = ble_advertising_init(&advdata, NULL, &options, on_adv_evt, NULL);
+    // High duty directed to the last controller for 1.28 s after a link drops, then a fast
+    // window filtered to bonded controllers, then slow advertising for anyone
+    ble_adv_modes_config_t options = {0};
+    options.ble_adv_whitelist_enabled = BLE_ADV_WHITELIST_ENABLED;
+    options.ble_adv_directed_enabled  = BLE_ADV_DIRECTED_ENABLED;
+    options.ble_adv_fast_enabled      = BLE_ADV_FAST_ENABLED;
+    options.ble_adv_fast_interval     = APP_ADV_FAST_INTERVAL;
+    options.ble_adv_fast_timeout      = APP_ADV_FAST_TIMEOUT_IN_SECONDS;
+    options.ble_adv_slow_enabled      = BLE_ADV_SLOW_ENABLED;
+    options.ble_adv_slow_interval     = slow_interval;
+    options.ble_adv_slow_timeout      = APP_ADV_SLOW_TIMEOUT_IN_SECONDS;
+
+    err_code = ble_advertising_init(&advdata, &srdata, &options, on_adv_evt, NULL);
     APP_ERROR_CHECK(err_code);
 }
 
+/**@brief Function for stretching slow advertising out while the outputs sleep for the
+ *        night, and back once they wake.
+ *
+ * @details Nothing is lit to be controlled, so a controller finding the brick a few seconds
+ *          later costs nothing. Left until the relay has given the advertising data back.
+ */
+static void advertising_pace(void)
+{
+    bool night = pca9685_asleep();
+
+    if (night == m_adv_night || relay_active())
+    {
+        return;
+    }
+    m_adv_night = night;
+
+    // Not advertising while the links are full, the next start picks the interval up
+    (void)sd_ble_gap_adv_stop();
+    advertising_init(night ? APP_ADV_NIGHT_INTERVAL : APP_ADV_SLOW_INTERVAL);
+    if (ble_lbs_links(&m_lbs) < LBS_MAX_LINKS)
+    {
+        (void)ble_advertising_start(BLE_ADV_MODE_SLOW);
+    }
+}
+
 
 /**@brief Function for initializing buttons and leds.
  *
@@ -522,6 +1937,13 @@ static void buttons_leds_init(bool * p_erase_bonds)
     err_code = bsp_btn_ble_init(NULL, &startup_event);
     APP_ERROR_CHECK(err_code);
 
+    // A long press steps through the programmed scenes, a short one does
+    // nothing so it can't be hit by accident
+    err_code = bsp_event_to_button_action_assign(SCENE_BUTTON_ID, BSP_BUTTON_ACTION_PUSH, BSP_EVENT_NOTHING);
+    APP_ERROR_CHECK(err_code);
+    err_code = bsp_event_to_button_action_assign(SCENE_BUTTON_ID, BSP_BUTTON_ACTION_LONG_PUSH, SCENE_BUTTON_EVENT);
+    APP_ERROR_CHECK(err_code);
+
     *p_erase_bonds = (startup_event == BSP_EVENT_CLEAR_BONDING_DATA);
 }
 
@@ -530,18 +1952,20 @@ static void buttons_leds_init(bool * p_erase_bonds)
  */
 static void power_manage(void)
 {
+    cpu_mark_t mark = cpu_begin();
     uint32_t err_code = sd_app_evt_wait();
+
+    cpu_end(CPU_SLEEP, mark);
     APP_ERROR_CHECK(err_code);
 }
 
 
 void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
 {
-    for(;;) {
-        printf( "%"PRIu32"", error_code);
-        printf( "%"PRIu32"", line_num);
-        printf( "%s", p_file_name);
-    }
+    // Nothing reads the UART in the field. Keep a record for the crash log
+    // characteristic, then reset straight away and let output_restore()
+    // put the levels back from retained RAM.
+    crash_reset(error_code, line_num, p_file_name, (uint32_t)__builtin_return_address(0), 0);
 }
 
 /**@brief Function for application main entry.
@@ -552,31 +1976,114 @@ int main(void)
     bool erase_bonds;
 
 
-    // Initialize.
+    // Initialize. Only what the restored frame needs runs ahead of it,
+    // the transfer then overlaps the SoftDevice coming up.
+    mem_stats_paint();
+    boot_trace_start();
+
+    retained_init();
+
+    crash_init();
+
+    watchdog_init();
+
+    scheduler_init();
+
     timers_init();
+    tick_init();
+    flash_sched_init();
+
+    clock_init();
 
     error_init();
 
     buttons_leds_init(&erase_bonds);
 
-    twi_master_init();
+    twi_queue_init();
+    boot_trace_mark(BOOT_PHASE_CORE);
 
-    pca9685_init();
+    // Carries on without outputs rather than hold the radio up
+    (void)pca9685_init();
 
-    fantach_init();
+    fade_init();
+
+    // Persistent storage is set up ahead of the SoftDevice, the journal
+    // has to register first to be readable this early
+    err_code = pstorage_init();
+    APP_ERROR_CHECK(err_code);
+    output_restore();
+    boot_trace_mark(BOOT_PHASE_LIGHT);
 
     ble_stack_init();
+    boot_trace_mark(BOOT_PHASE_STACK);
+    // Frames go out whenever they're ready without it
+    (void)radio_idle_init(twi_queue_radio_idle);
+
+    mcp9808_init(MCP9808_DEFAULT_RESOLUTION);
+
+    fantach_init();
+    fan_wear_init();
+#if SIM_ENABLED
+    sim_init(on_temp_sample);
+#endif
+
+    mcp9808_alert_init(TEMP_ALERT_LOWER, TEMP_ALERT_UPPER, TEMP_CRITICAL, TEMP_HW_SHUTDOWN, on_temp_alert);
+#if TEMP_HW_SHUTDOWN
+    pca9685_protect_init(mcp9808_alert_event_addr());
+#endif
+    boot_trace_mark(BOOT_PHASE_SENSORS);
 
     services_init();
 
+    // Needs the SoftDevice for the power-fail comparator
+    supply_init(on_supply_shed);
+
     device_manager_init(erase_bonds);
 
+#ifdef BLE_DFU_APP_SUPPORT
+    // Needs the Device Manager registration
+    dfu_init();
+#endif // BLE_DFU_APP_SUPPORT
+
+    // Runs the stored photoperiod once the controller has set the time
+    schedule_init(schedule_status_update);
+    schedule_status_update();
+    scene_init();
+    // Calibration keeps its records there
+    kv_init();
+    calib_init();
+    aux_init();
+    history_init();
+    runhours_init(fade_refresh);
+    effect_init(effect_allowed);
+    stream_init(stream_output_handler);
+    burnin_init();
+    lease_init(on_lease_expired);
+    // Anything restored before now went out uncalibrated and uncompensated
+    fade_refresh();
+    sync_apply_init(sync_apply_handler);
+    boot_trace_mark(BOOT_PHASE_SERVICES);
+
     gap_params_init();
+    tx_power_init();
 
-    advertising_init();
+    m_last_central.addr_type = 0xFF;
+    advertising_init(APP_ADV_SLOW_INTERVAL);
 
     conn_params_init();
 
+    static const uint8_t broadcast_key[BROADCAST_KEY_LEN] = BROADCAST_KEY;
+    broadcast_init(BROADCAST_GROUP, broadcast_key, broadcast_frame_handler, broadcast_scene_handler);
+#if ESB_RX_ENABLED
+    static const uint8_t esb_address[ESB_RX_ADDRESS_LEN] = ESB_RX_ADDRESS;
+    // Same frames as the broadcasts, checked against the same sequence
+    (void)esb_rx_init(ESB_RX_CHANNEL, esb_address, broadcast_on_payload);
+#endif
+#if BROADCAST_RELAY
+    relay_init(advertising_restore);
+#endif
+    remote_sensor_init();
+
     // Start execution.
     application_timers_start();
 
@@ -584,9 +2091,24 @@ int main(void)
 
     APP_ERROR_CHECK(err_code);
 
+    // Follow controller broadcasts alongside the connection (S130 only)
+    broadcast_start();
+    boot_trace_mark(BOOT_PHASE_ADVERTISING);
+    boot_trace_end();
+    boot_status_update();
+    dlog(DLOG_BOOT, retained_reset_reason() & 0xFF, (retained_reset_reason() >> 16) & 0x0F);
+
+    // Runs flat out until the first temperature reading, on TIMER1 once
+    // the boot trace is done with it
+    fan_control_init();
+
     // Enter main loop.
     for (;;)
     {
+        cpu_mark_t mark = cpu_begin();
+
+        app_sched_execute();
+        cpu_end(CPU_SCHED, mark);
         power_manage();
     }
 }
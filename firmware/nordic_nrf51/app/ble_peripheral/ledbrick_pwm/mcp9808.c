@@ -1,26 +1,231 @@
 #include "mcp9808.h"
 
-#include "twi_master.h"
 #include <stdint.h>
+#include <nrf_drv_gpiote.h>
+#include "app_util_platform.h"
+#include "twi_queue.h"
 
-#define ADDR 0x3e
-
+#define CONFIG_REG 0x01
+#define UPPER_REG 0x02
+#define LOWER_REG 0x03
+#define CRIT_REG 0x04
 #define TEMP_REG 0x05
+#define RESOLUTION_REG 0x08
+
+#define CONFIG_ALERT_SEL (1 << 2)
+#define CONFIG_ALERT_CTRL (1 << 3)
+#define CONFIG_HYST_SHIFT 9
+
+static const uint8_t addresses[MCP9808_NUM_SENSORS] = MCP9808_ADDRESSES;
+#if MCP9808_HOTSPOT == MCP9808_HOTSPOT_WEIGHTED
+static const int16_t weights[MCP9808_NUM_SENSORS] = MCP9808_WEIGHTS;
+STATIC_ASSERT(sizeof((uint8_t[])MCP9808_ADDRESSES) == MCP9808_NUM_SENSORS);
+STATIC_ASSERT(sizeof((int16_t[])MCP9808_WEIGHTS) == sizeof(weights));
+STATIC_ASSERT(BOARD_PIN_FITTED(MCP9808_PIN_ALERT));
+#endif
+
+static const uint8_t obuf[1] = { TEMP_REG };
+static uint8_t ibuf[MCP9808_NUM_SENSORS][2];
+static int16_t temps[MCP9808_NUM_SENSORS] = { [0 ... MCP9808_NUM_SENSORS - 1] = MCP9808_TEMP_NONE };
+static uint8_t outstanding;
+static uint8_t res_buf[2];
+static uint8_t limit_buf[3][3];
+static uint8_t config_buf[3];
+static mcp9808_alert_handler_t alert_handler;
+static volatile bool busy = false;
+static volatile int16_t last_temp = 0;
+static mcp9808_callback_t pending_callback;
+
+// The register is a 13 bit two's complement value in 1/16 degree steps,
+// with the alert flags in the top three bits
+static int16_t mcp9808_convert(uint8_t const * buf) {
+	int16_t raw = ((buf[0] & 0x1f) << 8) | buf[1];
+
+	if (raw & 0x1000) {
+		raw -= 0x2000;
+	}
+	return raw;
+}
+
+// Returns false if no sensor answered
+static bool hotspot(int16_t * p_temp) {
+	bool any = false;
+	bool all = true;
+
+	for (uint8_t i = 0; i < MCP9808_NUM_SENSORS; i++) {
+		if (temps[i] == MCP9808_TEMP_NONE) {
+			all = false;
+		} else if (!any || temps[i] > *p_temp) {
+			*p_temp = temps[i];
+			any = true;
+		}
+	}
+#if MCP9808_HOTSPOT == MCP9808_HOTSPOT_WEIGHTED
+	int32_t sum = 0, total = 0;
+
+	for (uint8_t i = 0; all && i < MCP9808_NUM_SENSORS; i++) {
+		sum += (int32_t)weights[i] * temps[i];
+		total += weights[i];
+	}
+	if (all && total != 0) {
+		*p_temp = sum / total;
+	}
+#else
+	(void)all;
+#endif
+	return any;
+}
+
+static void on_read(twi_job_t const * p_job, bool success) {
+	uint8_t i = (uint8_t)(uintptr_t)p_job->p_context;
+	int16_t temp = 0;
+	bool last, any;
+
+	temps[i] = success ? mcp9808_convert(ibuf[i]) : MCP9808_TEMP_NONE;
+	CRITICAL_REGION_ENTER();
+	last = (--outstanding == 0);
+	CRITICAL_REGION_EXIT();
+	if (!last) {
+		return;
+	}
+
+	any = hotspot(&temp);
+	if (any) {
+		last_temp = temp;
+	}
+	busy = false;
+	if (pending_callback) {
+		pending_callback(any, temp);
+	}
+}
+
+bool mcp9808_init(mcp9808_resolution_t resolution) {
+	bool queued = true;
+
+	res_buf[0] = RESOLUTION_REG;
+	res_buf[1] = resolution & 0x03;
+
+	for (uint8_t i = 0; i < MCP9808_NUM_SENSORS; i++) {
+		twi_job_t job = {
+			.address = addresses[i],
+			.p_tx = res_buf,
+			.tx_len = 2,
+			.xfer_class = TWI_CLASS_CONFIG,
+		};
+		queued &= twi_queue_submit(&job);
+	}
+	return queued;
+}
+
+static void reg16_job(uint8_t * buf, uint8_t reg, uint16_t value) {
+	buf[0] = reg;
+	buf[1] = value >> 8;
+	buf[2] = value & 0xFF;
+}
+
+// Limits are 13 bit two's complement with 0.25 C resolution
+static uint16_t limit_encode(int16_t temp) {
+	return (uint16_t)temp & 0x1FFC;
+}
+
+static void on_alert(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {
+	if (alert_handler) {
+		alert_handler(mcp9808_alert_asserted());
+	}
+}
+
+bool mcp9808_alert_asserted(void) {
+	return !nrf_drv_gpiote_in_is_set(MCP9808_PIN_ALERT);
+}
+
+uint32_t mcp9808_alert_event_addr(void) {
+	return nrf_drv_gpiote_in_event_addr_get(MCP9808_PIN_ALERT);
+}
+
+bool mcp9808_alert_init(int16_t lower, int16_t upper, int16_t crit, bool crit_only,
+                        mcp9808_alert_handler_t handler) {
+	nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(true);
+	bool queued = true;
+
+	alert_handler = handler;
+
+	reg16_job(limit_buf[0], LOWER_REG, limit_encode(lower));
+	reg16_job(limit_buf[1], UPPER_REG, limit_encode(upper));
+	reg16_job(limit_buf[2], CRIT_REG, limit_encode(crit));
+	// Comparator mode, active low, enabled last
+	reg16_job(config_buf, CONFIG_REG,
+	          CONFIG_ALERT_CTRL | (crit_only ? CONFIG_ALERT_SEL : 0) |
+	          (MCP9808_ALERT_HYSTERESIS << CONFIG_HYST_SHIFT));
+
+	// The same limits on every sensor, whichever crosses first drives ALERT
+	for (uint8_t s = 0; s < MCP9808_NUM_SENSORS; s++) {
+		for (uint8_t i = 0; i < 3; i++) {
+			twi_job_t job = { .address = addresses[s], .p_tx = limit_buf[i], .tx_len = 3 };
+			queued &= twi_queue_submit(&job);
+		}
+		twi_job_t job = { .address = addresses[s], .p_tx = config_buf, .tx_len = 3 };
+		queued &= twi_queue_submit(&job);
+	}
+
+	if (!nrf_drv_gpiote_is_init()) {
+		nrf_drv_gpiote_init();
+	}
+	config.pull = NRF_GPIO_PIN_PULLUP;
+	nrf_drv_gpiote_in_init(MCP9808_PIN_ALERT, &config, on_alert);
+	nrf_drv_gpiote_in_event_enable(MCP9808_PIN_ALERT, true);
+
+	return queued;
+}
+
+bool mcp9808_sample(mcp9808_callback_t callback) {
+	uint32_t missed = 0;
+
+	if (busy) {
+		return false;
+	}
+	busy = true;
+	pending_callback = callback;
+	// Completions count down from all of them, so the callback can't run
+	// before the last is queued
+	outstanding = MCP9808_NUM_SENSORS;
 
+	for (uint8_t i = 0; i < MCP9808_NUM_SENSORS; i++) {
+		twi_job_t job = {
+			.address = addresses[i],
+			.p_tx = obuf,
+			.tx_len = 1,
+			.p_rx = ibuf[i],
+			.rx_len = 2,
+			.xfer_class = TWI_CLASS_SENSOR,
+			.callback = on_read,
+			.p_context = (void *)(uintptr_t)i,
+		};
+		ibuf[i][0] = 0;
+		ibuf[i][1] = 0;
+		if (!twi_queue_submit(&job)) {
+			missed |= (1UL << i);
+		}
+	}
+	if (missed == (1UL << MCP9808_NUM_SENSORS) - 1) {
+		busy = false;
+		return false;
+	}
+	// Any that didn't queue count as not answering
+	for (uint8_t i = 0; i < MCP9808_NUM_SENSORS; i++) {
+		if (missed & (1UL << i)) {
+			twi_job_t job = { .p_context = (void *)(uintptr_t)i };
+			on_read(&job, false);
+		}
+	}
+	return true;
+}
+
+int16_t mcp9808_temp(void) {
+	return last_temp;
+}
 
-uint16_t mcp9808_temp(void) {
-	uint8_t obuf[1] = { 0 };
-	uint8_t ibuf[2] = { 0, 0 };
-	obuf[0] = TEMP_REG;
-	twi_master_transfer(ADDR, obuf, 1, false);
-	twi_master_transfer(ADDR | 0x01, ibuf, 2, true);
-	
-	ibuf[0] &= 0x1f; // Clear flags
-	
-	//return ibuf[0] << 8 | ibuf[1];
-	if (ibuf[0] & 0x10) {
-		return 256 - (((ibuf[0] & 0x0f) * 16) + (ibuf[1] / 16));
-	} else {
-		return (ibuf[0] * 16) + (ibuf[1] / 16);
+void mcp9808_sensors(int16_t * p_temps) {
+	for (uint8_t i = 0; i < MCP9808_NUM_SENSORS; i++) {
+		p_temps[i] = temps[i];
 	}
 }
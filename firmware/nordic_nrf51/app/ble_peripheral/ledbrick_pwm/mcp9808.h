@@ -2,8 +2,73 @@
 #define _MCP9808_H_
 
 #include <stdint.h>
-#include "twi_master.h"
+#include <stdbool.h>
+#include "board_profile.h"
 
-uint16_t mcp9808_temp(void);
+// Temperatures are signed fixed point in 1/16 degree C steps
+#define MCP9808_FRAC_BITS 4
+#define MCP9808_DEG(d) ((int16_t)((d) << MCP9808_FRAC_BITS))
+
+// Conversion resolution, finer steps take longer per conversion
+typedef enum {
+	MCP9808_RES_0_5 = 0,    // 30 ms
+	MCP9808_RES_0_25 = 1,   // 65 ms
+	MCP9808_RES_0_125 = 2,  // 130 ms
+	MCP9808_RES_0_0625 = 3  // 250 ms
+} mcp9808_resolution_t;
+
+#define MCP9808_DEFAULT_RESOLUTION MCP9808_RES_0_0625
+
+// Sensors on the bus (7 bit, by their A2-A0 straps), read together. On
+// big emitter boards the hotspot is far from any one of them. ALERT is
+// open drain, so sensors wired to the same line trip it together.
+#define MCP9808_NUM_SENSORS BOARD_MCP9808_SENSORS
+#define MCP9808_ADDRESSES BOARD_MCP9808_ADDRESSES
+// Reading of a sensor that didn't answer
+#define MCP9808_TEMP_NONE INT16_MIN
+
+// The one temperature the fan loop, derate and cutoff run on: the
+// hottest sensor, or a weighted estimate of the hotspot from them all
+// (sum of weight * reading over the sum of the weights). A negative
+// weight places the hotspot beyond the other sensors, away from that
+// one. Until every sensor answers, the hottest is used.
+#define MCP9808_HOTSPOT_MAX 0
+#define MCP9808_HOTSPOT_WEIGHTED 1
+#define MCP9808_HOTSPOT MCP9808_HOTSPOT_MAX
+#define MCP9808_WEIGHTS BOARD_MCP9808_WEIGHTS
+
+// ALERT output (open drain, active low)
+#define MCP9808_PIN_ALERT BOARD_PIN_ALERT
+// Alert deasserts this far back inside the window (0, 1.5, 3 or 6 C)
+#define MCP9808_ALERT_HYSTERESIS 1 // 1.5 C
+
+// success if any sensor answered, temp is the hotspot
+typedef void (*mcp9808_callback_t)(bool success, int16_t temp);
+// Called from the GPIOTE interrupt whenever ALERT changes state
+typedef void (*mcp9808_alert_handler_t)(bool asserted);
+
+// Queue the resolution register writes
+bool mcp9808_init(mcp9808_resolution_t resolution);
+
+// Program the alert window and critical limit (1/16 C, the sensor keeps
+// 0.25 C) and watch the ALERT pin. In comparator mode ALERT is held while
+// the temperature is below lower, above upper or above crit, or only
+// above crit when crit_only is set.
+bool mcp9808_alert_init(int16_t lower, int16_t upper, int16_t crit, bool crit_only,
+                        mcp9808_alert_handler_t handler);
+bool mcp9808_alert_asserted(void);
+// GPIOTE event for ALERT edges, for hooking up through PPI
+uint32_t mcp9808_alert_event_addr(void);
+
+// Start an asynchronous read of every sensor, queued back to back. The
+// callback runs from the TWI interrupt once the last is in. Returns
+// false if a read is already in flight or nothing could be queued.
+bool mcp9808_sample(mcp9808_callback_t callback);
+
+// Last successful hotspot reading
+int16_t mcp9808_temp(void);
+// Each sensor's reading from the last sample, MCP9808_TEMP_NONE for
+// those that didn't answer
+void mcp9808_sensors(int16_t * p_temps);
 
 #endif
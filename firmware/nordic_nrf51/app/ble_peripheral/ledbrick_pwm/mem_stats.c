@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include "nrf.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "pstorage.h"
+#include "twi_queue.h"
+#include "mem_stats.h"
+
+// gcc_startup_nrf51.s
+extern uint32_t __StackLimit;
+extern uint32_t __StackTop;
+extern uint32_t __HeapBase;
+extern uint32_t __HeapLimit;
+
+void mem_stats_paint(void) {
+	uint32_t * p = &__StackLimit;
+	uint32_t * sp = (uint32_t *)(__get_MSP() - MEM_STATS_PAINT_MARGIN);
+
+	while (p < sp) {
+		*p++ = MEM_STATS_PAINT;
+	}
+	for (p = &__HeapBase; p < &__HeapLimit; p++) {
+		*p = MEM_STATS_PAINT;
+	}
+}
+
+uint16_t mem_stats_stack_peak(void) {
+	// Grows down, paint still at the limit was never reached
+	uint32_t const * p = &__StackLimit;
+	while (p < &__StackTop && *p == MEM_STATS_PAINT) {
+		p++;
+	}
+	return (&__StackTop - p) * sizeof(uint32_t);
+}
+
+// Grows up, from the base to the highest word written
+static uint16_t heap_peak(void) {
+	uint32_t const * p = &__HeapLimit;
+	while (p > &__HeapBase && *(p - 1) == MEM_STATS_PAINT) {
+		p--;
+	}
+	return (p - &__HeapBase) * sizeof(uint32_t);
+}
+
+static uint16_t pair_encode(uint16_t size, uint16_t peak, uint8_t * p_out) {
+	uint16_t len = uint16_encode(size, p_out);
+	return len + uint16_encode(peak, &p_out[len]);
+}
+
+uint16_t mem_stats_get(uint16_t sched_size, uint16_t timer_op_size, uint8_t * p_reply) {
+	uint16_t len = 0;
+
+	len += pair_encode((&__StackTop - &__StackLimit) * sizeof(uint32_t), mem_stats_stack_peak(), &p_reply[len]);
+	len += pair_encode((&__HeapLimit - &__HeapBase) * sizeof(uint32_t), heap_peak(), &p_reply[len]);
+	len += pair_encode(sched_size, app_sched_queue_utilization_get(), &p_reply[len]);
+	len += pair_encode(timer_op_size, app_timer_op_queue_utilization_get(), &p_reply[len]);
+	len += pair_encode(PSTORAGE_CMD_QUEUE_SIZE, pstorage_access_peak_get(), &p_reply[len]);
+	len += pair_encode(TWI_QUEUE_SIZE, twi_queue_peak(), &p_reply[len]);
+	for (uint8_t i = 0; i < POOL_COUNT; i++) {
+		pool_stats_t stats;
+		pool_stats((pool_id_t)i, &stats);
+		len += pair_encode(stats.blocks, stats.peak, &p_reply[len]);
+		len += uint32_encode(stats.exhausted, &p_reply[len]);
+	}
+	return len;
+}
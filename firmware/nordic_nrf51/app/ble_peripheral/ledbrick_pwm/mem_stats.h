@@ -0,0 +1,40 @@
+#ifndef _MEM_STATS_H_
+#define _MEM_STATS_H_
+
+#include <stdint.h>
+#include "pool.h"
+
+// How close RAM has come to running out, for sizing the stack, heap and
+// queues off a running brick rather than guesses (BULK_CMD_MEMORY,
+// bulk.h). The stack and heap are painted at boot and the high-water
+// mark is the deepest word no longer holding the paint, so it covers
+// interrupts and the SoftDevice's handlers on the same stack. The
+// queues count their own peaks as entries go in.
+#define MEM_STATS_PAINT 0xDEADBEEF
+
+// Headroom left below the stack pointer when painting, for the paint
+// loop and any interrupt taken during it
+#define MEM_STATS_PAINT_MARGIN 32
+
+// Reply, MEM_STATS_LEN bytes, size then peak used (uint16 LE each) for:
+//   0  stack, bytes
+//   4  heap, bytes
+//   8  scheduler queue, events
+//  12  timer operation queue, operations
+//  16  flash operation queue (pstorage), operations
+//  20  TWI queue (twi_queue.h), jobs
+// then for each block pool (pool.h), small first, its blocks and peak in
+// use (uint16 LE each) and the allocs it failed (uint32 LE)
+#define MEM_STATS_POOL_AT 24
+#define MEM_STATS_LEN (MEM_STATS_POOL_AT + 8 * POOL_COUNT)
+
+// Paints the stack below the caller and the whole heap, first thing in
+// main() before anything has run deep
+void mem_stats_paint(void);
+// Bytes of stack used at the deepest so far
+uint16_t mem_stats_stack_peak(void);
+// The reply, with the scheduler and timer queue sizes main() set them up
+// with
+uint16_t mem_stats_get(uint16_t sched_size, uint16_t timer_op_size, uint8_t * p_reply);
+
+#endif
@@ -1,80 +1,1058 @@
 #include <stdint.h>
-#include <twi_master.h>
+#include <string.h>
 #include <nrf_gpio.h>
+#include <nrf_drv_gpiote.h>
+#include <nrf_drv_ppi.h>
+#include "nrf_delay.h"
+#include "nordic_common.h"
+#include "app_util_platform.h"
+#include "crc16.h"
+#include "twi_queue.h"
 #include "pca9685.h"
 
-#define ADDR 0xFE
-
 #define REG_MODE1 0x00
+#define MODE1_RESTART (1 << 7)
+#define MODE1_AI (1 << 5) // Auto-increment
+#define MODE1_SLEEP (1 << 4)
+#define MODE1_ALLCALL 1
 #define REG_MODE2 0x01
+#define MODE2_OUTDRV (1 << 2) // Totem pole outputs
+#define MODE2_OCH (1 << 3) // Change on ACK, clear to change on STOP
 #define REG_LED0 0x06 // Start of LED registers
+#define REG_ALL_LED 0xFA // ALL_LED_ON_L..ALL_LED_OFF_H
 #define REG_PRESCALE 0xFE
 
-#define PIN_OE 1
+#define FULL_OFF 0x1000 // LEDn_OFF bit 12
+
+#define PIN_OE BOARD_PIN_OE
+
+// The master dimmer rides on TIMER1, the fan PWM's (fan_control.c). With
+// one channel app_pwm leaves CC1 spare and ends each period on CC2.
+#define DIM_TIMER NRF_TIMER1
+#define DIM_CC 1
+#define DIM_PERIOD_CC 2
+
+// MODE1 polls after a restart, the oscillator needs 500 us
+#define RESTART_POLLS 10
+#define RESTART_POLL_US 500
+
+#define ALL_OUTPUTS ((1 << PCA9685_OUTPUTS) - 1)
+
+// Per device: a RAM copy of the LEDn_ON_L..LEDn_OFF_H registers. Outputs
+// are marked dirty when their value changes, and a flush sends the
+// smallest contiguous dirty range in one auto-increment transaction.
+typedef struct {
+	uint8_t shadow[PCA9685_OUTPUTS * 4];
+	volatile uint16_t dirty;
+	volatile bool flush_busy;
+	// Register pointer followed by up to the full register file
+	uint8_t flush_buf[1 + PCA9685_OUTPUTS * 4];
+	uint16_t flush_mask;
+	uint8_t all_buf[5];
+	volatile bool all_busy;
+} device_t;
+
+static const uint8_t addresses[PCA9685_NUM_DEVICES] = PCA9685_ADDRESSES;
+static const uint8_t channel_map[PCA9685_NUM_DEVICES][PCA9685_OUTPUTS] = PCA9685_CHANNEL_MAP;
+STATIC_ASSERT(sizeof((uint8_t[])PCA9685_ADDRESSES) == PCA9685_NUM_DEVICES);
+STATIC_ASSERT(sizeof((uint8_t[][PCA9685_OUTPUTS])PCA9685_CHANNEL_MAP) == sizeof(channel_map));
+STATIC_ASSERT(BOARD_PIN_FITTED(PIN_OE));
+static device_t devices[PCA9685_NUM_DEVICES];
+// Every output driven by some LED channel, so ALL_LED can stand in for
+// them
+static bool fully_mapped = true;
+
+// Duty per logical channel, placed in each device's period by
+// allocate_phases()
+static uint16_t duty[PCA9685_NUM_LEDS];
+static volatile bool phases_stale = false;
+static uint16_t volatile_mask = 0;
+static uint8_t prescale = PCA9685_OSC_HZ / (PCA9685_COUNTS * PCA9685_FREQ_DEFAULT_HZ) - 1;
+// Nested pca9685_hold() calls, and whether a flush waits on the release
+static uint8_t hold_depth = 0;
+static bool hold_pending = false;
+static uint32_t commits = 0;
+static pca9685_lit_handler_t lit_handler;
+static pca9685_commit_handler_t commit_handler;
+
+static uint8_t reg_buf[2];
+static uint8_t read_buf[1];
+static volatile bool reg_ok;
+
+// Scrub readback, the chip and first output of the next window, and the
+// commit count as the reads went out
+static uint8_t scrub_mode_reg[1] = { REG_MODE1 };
+static uint8_t scrub_mode[1];
+static uint8_t scrub_led_reg[1];
+static uint8_t scrub_leds[PCA9685_SCRUB_OUTPUTS * 4];
+static uint8_t scrub_device = 0;
+static uint8_t scrub_first = 0;
+static volatile uint8_t scrub_pending = 0;
+static uint32_t scrub_commits;
+static volatile uint8_t scrub_reconfigure = 0; // Mask of devices
+static uint16_t scrub_repairs = 0;
+STATIC_ASSERT(PCA9685_OUTPUTS % PCA9685_SCRUB_OUTPUTS == 0);
+STATIC_ASSERT(PCA9685_NUM_DEVICES <= 8);
+
+// Every device answered at the last bring-up
+static bool present = false;
+
+// Dark through the night: the oscillators stopped and OE held off, and
+// when the shadow first went dark, 0 while lit
+static volatile bool asleep = false;
+static uint32_t dark_since = 0;
+static uint8_t wake_buf[2] = { REG_MODE1, MODE1_AI | MODE1_ALLCALL };
+static uint8_t restart_buf[2] = { REG_MODE1, MODE1_RESTART | MODE1_AI | MODE1_ALLCALL };
+
+// Once protection or the dimmer is set up OE belongs to GPIOTE and is
+// driven as a task
+static bool oe_task = false;
+static bool protected = false;
+static volatile bool tripped = false;
+static bool shed = false;
+static bool oe_state = false;
+static nrf_ppi_channel_t protect_channel;
+static uint32_t protect_event;
+
+// Master dimmer: CC1 and CC2 each toggle OE through PPI. A third channel
+// enables the group on a CC2, so every period starts with OE high (off)
+// and the outputs come on at CC1, with nothing for the CPU to do.
+#define DIM_TOGGLE_CC 0
+#define DIM_TOGGLE_PERIOD 1
+#define DIM_START 2
+static uint8_t dim = PCA9685_DIM_FULL;
+static uint8_t modulation = PCA9685_DIM_FULL; // Over dim, for effects
+static bool dim_ready = false;
+static nrf_ppi_channel_t dim_channels[3];
+static nrf_ppi_channel_group_t dim_group;
+
+static void on_reg_done(twi_job_t const * p_job, bool success) {
+	reg_ok = success;
+}
+
+// Run a register job to completion
+static bool pca9685_xfer(twi_job_t * p_job) {
+	reg_ok = false;
+	p_job->callback = on_reg_done;
+	return twi_queue_submit(p_job) && twi_queue_flush() && reg_ok;
+}
+
+static bool pca9685_write(uint8_t address, uint8_t reg, uint8_t data) {
+	reg_buf[0] = reg;
+	reg_buf[1] = data;
+	twi_job_t job = { .address = address, .p_tx = reg_buf, .tx_len = 2 };
+	return pca9685_xfer(&job);
+}
+
+static bool pca9685_bus_reset(void) {
+	// SWRST on the general call address
+	reg_buf[0] = 0x06;
+	twi_job_t job = { .address = 0x00, .p_tx = reg_buf, .tx_len = 1 };
+	return pca9685_xfer(&job);
+}
+
+// OE's GPIOTE channel, from its task address
+static uint32_t oe_channel(void) {
+	return (nrf_drv_gpiote_out_task_addr_get(PIN_OE) - (uint32_t)&NRF_GPIOTE->TASKS_OUT[0]) / sizeof(uint32_t);
+}
+
+// One write, so the pin goes straight to high without a glitch
+static void oe_configure(nrf_gpiote_polarity_t polarity, bool high) {
+	uint32_t ch = oe_channel();
+
+	NRF_GPIOTE->CONFIG[ch] = (NRF_GPIOTE->CONFIG[ch] & ~(GPIOTE_CONFIG_POLARITY_Msk | GPIOTE_CONFIG_OUTINIT_Msk)) |
+	                         (polarity << GPIOTE_CONFIG_POLARITY_Pos) |
+	                         ((high ? NRF_GPIOTE_INITIAL_VALUE_HIGH : NRF_GPIOTE_INITIAL_VALUE_LOW) << GPIOTE_CONFIG_OUTINIT_Pos);
+}
+
+static bool oe_attach(void) {
+	nrf_drv_gpiote_out_config_t config = GPIOTE_CONFIG_OUT_TASK_HIGH;
+
+	if (oe_task) {
+		return true;
+	}
+	config.init_state = oe_state ? NRF_GPIOTE_INITIAL_VALUE_HIGH : NRF_GPIOTE_INITIAL_VALUE_LOW;
+
+	if (!nrf_drv_gpiote_is_init()) {
+		nrf_drv_gpiote_init();
+	}
+	nrf_drv_ppi_init(); // May already be up for the fan tach
+
+	if (nrf_drv_gpiote_out_init(PIN_OE, &config) != NRF_SUCCESS) {
+		return false;
+	}
+	nrf_drv_gpiote_out_task_enable(PIN_OE);
+	oe_task = true;
+	return true;
+}
+
+static void dim_stop(void) {
+	if (dim_ready) {
+		// The start channel would enable the group again
+		nrf_drv_ppi_channel_disable(dim_channels[DIM_START]);
+		nrf_drv_ppi_group_disable(dim_group);
+	}
+}
+
+// A trip now only has to stop the toggling, or in the static case drive
+// OE high itself
+static void protect_target(bool dimming) {
+	if (!protected) {
+		return;
+	}
+	nrf_drv_ppi_channel_assign(protect_channel, protect_event,
+	                           dimming ? nrf_drv_ppi_task_addr_group_disable_get(dim_group)
+	                                   : nrf_drv_gpiote_out_task_addr_get(PIN_OE));
+}
+
+// What OE is switched at, the dimmer and any modulation together
+static uint8_t dim_level(void) {
+	return (uint16_t)dim * modulation / PCA9685_DIM_FULL;
+}
+
+static void oe_apply(void) {
+	uint32_t period = DIM_TIMER->CC[DIM_PERIOD_CC];
+	uint8_t level = dim_level();
+	bool high = oe_state || tripped || shed || asleep || level == 0;
+
+	if (!oe_task) {
+		nrf_gpio_pin_write(PIN_OE, high);
+		return;
+	}
+	dim_stop();
+	if (high || level >= PCA9685_DIM_FULL || period == 0) {
+		protect_target(false);
+		oe_configure(NRF_GPIOTE_POLARITY_LOTOHI, high);
+		return;
+	}
+	// Off from here to the next CC2, then on from CC1 each period
+	DIM_TIMER->CC[DIM_CC] = period - (period * level) / PCA9685_DIM_FULL;
+	oe_configure(NRF_GPIOTE_POLARITY_TOGGLE, true);
+	protect_target(true);
+	nrf_drv_ppi_channel_enable(dim_channels[DIM_START]);
+}
+
+static void lit_check(void) {
+	if (lit_handler == NULL) {
+		return;
+	}
+	for (uint8_t led = 0; led < PCA9685_NUM_LEDS; led++) {
+		if (pca9685_output(led) != 0) {
+			lit_handler();
+			return;
+		}
+	}
+}
 
-static void pca9685_write(uint8_t reg, uint8_t data) {
-	uint8_t obuf[2];
-	obuf[0] = reg;
-	obuf[1] = data;
-	twi_master_transfer(ADDR, obuf, 2, true);
+void pca9685_on_lit(pca9685_lit_handler_t handler) {
+	lit_handler = handler;
 }
 
-static void pca9685_bus_reset(void) {
-	uint8_t obuf[1];
-	obuf[0] = 0x06;
-	twi_master_transfer(0, obuf, 1, true);
+void pca9685_on_commit(pca9685_commit_handler_t handler) {
+	commit_handler = handler;
 }
 
 void pca9685_enable(bool on) {
-	nrf_gpio_pin_write(PIN_OE, on);
+	oe_state = on;
+	oe_apply();
+	lit_check();
 }
 
-void pca9685_write_led(uint8_t led, int on, int off) {
-	uint8_t obuf[5];
-	
-	on += (20 * led);
-	off += (20 * led);
+void pca9685_shed(bool on) {
+	shed = on;
+	oe_apply();
+}
+
+void pca9685_protect_reset(void) {
+	tripped = false;
+	oe_apply();
+	lit_check();
+}
+
+void pca9685_protect_trip(void) {
+	tripped = true;
+	if (oe_task) {
+		// The PPI path has already stopped any dimming
+		dim_stop();
+		oe_configure(NRF_GPIOTE_POLARITY_LOTOHI, true);
+	}
+}
+
+bool pca9685_protect_init(uint32_t event_addr) {
+	if (!oe_attach()) {
+		return false;
+	}
+	if (nrf_drv_ppi_channel_alloc(&protect_channel) != NRF_SUCCESS) {
+		return false;
+	}
+	protect_event = event_addr;
+	protected = true;
+	protect_target(false);
+	nrf_drv_ppi_channel_enable(protect_channel);
+	oe_apply();
+	return true;
+}
+
+static bool dim_init(void) {
+	uint32_t toggle;
+
+	if (dim_ready) {
+		return true;
+	}
+	if (!oe_attach()) {
+		return false;
+	}
+	for (uint8_t i = 0; i < 3; i++) {
+		if (nrf_drv_ppi_channel_alloc(&dim_channels[i]) != NRF_SUCCESS) {
+			return false;
+		}
+	}
+	if (nrf_drv_ppi_group_alloc(&dim_group) != NRF_SUCCESS) {
+		return false;
+	}
+	toggle = nrf_drv_gpiote_out_task_addr_get(PIN_OE);
+	nrf_drv_ppi_channel_assign(dim_channels[DIM_TOGGLE_CC],
+	                           (uint32_t)&DIM_TIMER->EVENTS_COMPARE[DIM_CC], toggle);
+	nrf_drv_ppi_channel_assign(dim_channels[DIM_TOGGLE_PERIOD],
+	                           (uint32_t)&DIM_TIMER->EVENTS_COMPARE[DIM_PERIOD_CC], toggle);
+	nrf_drv_ppi_channel_assign(dim_channels[DIM_START],
+	                           (uint32_t)&DIM_TIMER->EVENTS_COMPARE[DIM_PERIOD_CC],
+	                           nrf_drv_ppi_task_addr_group_enable_get(dim_group));
+	// The start channel is in the group too, so a trip stops all three
+	nrf_drv_ppi_channels_include_in_group(nrf_drv_ppi_channel_to_mask(dim_channels[DIM_TOGGLE_CC]) |
+	                                      nrf_drv_ppi_channel_to_mask(dim_channels[DIM_TOGGLE_PERIOD]) |
+	                                      nrf_drv_ppi_channel_to_mask(dim_channels[DIM_START]),
+	                                      dim_group);
+	dim_ready = true;
+	return true;
+}
+
+bool pca9685_dim(uint8_t percent) {
+	if (percent > PCA9685_DIM_FULL) {
+		return false;
+	}
+	if (percent < PCA9685_DIM_FULL && !dim_init()) {
+		return false;
+	}
+	dim = percent;
+	oe_apply();
+	lit_check();
+	return true;
+}
+
+uint8_t pca9685_dim_percent(void) {
+	return dim;
+}
+
+bool pca9685_modulate(uint8_t percent) {
+	if (percent > PCA9685_DIM_FULL) {
+		return false;
+	}
+	if (percent < PCA9685_DIM_FULL && !dim_init()) {
+		return false;
+	}
+	if (percent != modulation) {
+		modulation = percent;
+		oe_apply();
+		lit_check();
+	}
+	return true;
+}
+
+uint16_t pca9685_output(uint8_t led) {
+	if (oe_state || tripped || shed) {
+		return 0;
+	}
+	return (uint32_t)duty[led] * dim_level() / PCA9685_DIM_FULL;
+}
+
+static device_t * device_of(uint8_t const * p_tx) {
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		if (p_tx == devices[d].flush_buf || p_tx == devices[d].all_buf) {
+			return &devices[d];
+		}
+	}
+	return NULL;
+}
+
+static void flush_device(uint8_t d);
+
+static void on_flush_done(twi_job_t const * p_job, bool success) {
+	device_t * p_dev = device_of(p_job->p_tx);
+	bool again, settled;
+
+	CRITICAL_REGION_ENTER();
+	p_dev->flush_busy = false;
+	if (success) {
+		commits++;
+	} else {
+		// Keep the range dirty so the next flush retries it
+		p_dev->dirty |= p_dev->flush_mask;
+	}
+	again = success && p_dev->dirty != 0;
+	settled = success && !again;
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		settled &= !devices[d].flush_busy && devices[d].dirty == 0;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (again) {
+		flush_device(p_dev - devices);
+	} else if (settled && commit_handler != NULL) {
+		commit_handler();
+	}
+}
+
+static void shadow_set(uint8_t d, uint8_t out, uint16_t on, uint16_t off) {
+	uint8_t regs[4];
+
+	regs[0] = on & 0xFF;
+	regs[1] = (on >> 8) & 0xFF;
+	regs[2] = off & 0xFF;
+	regs[3] = (off >> 8) & 0xFF;
+	if (memcmp(&devices[d].shadow[4*out], regs, 4) != 0) {
+		memcpy(&devices[d].shadow[4*out], regs, 4);
+		devices[d].dirty |= (1 << out);
+	}
+}
+
+// On each device, every lit output turns on where the one before turned
+// off, wrapping round the period. At most ceil(total duty / period) are
+// ever on at once, which is as low as it goes, and the edges are spread
+// instead of bunched at count 0. Called with interrupts held off.
+static void allocate_phases(void) {
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		uint16_t phase = 0;
+		uint16_t last = volatile_mask | (uint16_t)~PCA9685_LED_MASK;
+
+		// Steady channels first, then the volatile and auxiliary ones
+		for (uint8_t pass = 0; pass < 2; pass++) {
+			for (uint8_t out = 0; out < PCA9685_OUTPUTS; out++) {
+				uint8_t led = channel_map[d][out];
+
+				if (led == PCA9685_UNMAPPED) {
+					if (pass == 0) {
+						shadow_set(d, out, 0, FULL_OFF);
+					}
+					continue;
+				}
+				if (((last >> led) & 1) != pass) {
+					continue;
+				}
+				if (duty[led] == 0) {
+					shadow_set(d, out, 0, FULL_OFF);
+					continue;
+				}
+				shadow_set(d, out, phase, (phase + duty[led]) % PCA9685_COUNTS);
+				phase = (phase + duty[led]) % PCA9685_COUNTS;
+			}
+		}
+	}
+	phases_stale = false;
+}
+
+void pca9685_set_volatile(uint16_t mask) {
+	CRITICAL_REGION_ENTER();
+	volatile_mask = mask;
+	phases_stale = true;
+	CRITICAL_REGION_EXIT();
+}
+
+static void flush_device(uint8_t d) {
+	device_t * p_dev = &devices[d];
+	uint16_t mask;
+	uint8_t first, last;
+	uint8_t len = 0;
+
+	CRITICAL_REGION_ENTER();
+	mask = p_dev->dirty;
+	if (!p_dev->flush_busy && mask != 0) {
+		for (first = 0; !(mask & (1 << first)); first++);
+		for (last = PCA9685_OUTPUTS - 1; !(mask & (1 << last)); last--);
+
+		// Snapshot the range so later updates don't tear this transfer
+		len = 4 * (last - first + 1);
+		p_dev->flush_buf[0] = REG_LED0 + 4*first;
+		memcpy(&p_dev->flush_buf[1], &p_dev->shadow[4*first], len);
+		p_dev->flush_mask = mask;
+		p_dev->flush_busy = true;
+		p_dev->dirty = 0;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (len == 0) {
+		return;
+	}
+
+	twi_job_t job = {
+		.address = addresses[d],
+		.p_tx = p_dev->flush_buf,
+		.tx_len = 1 + len,
+		.xfer_class = TWI_CLASS_FRAME,
+		.callback = on_flush_done,
+	};
+	if (!twi_queue_submit(&job)) {
+		on_flush_done(&job, false);
+	}
+}
+
+static bool shadow_dark(void) {
+	for (uint8_t led = 0; led < PCA9685_NUM_LEDS; led++) {
+		if (duty[led] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void mode1_submit(uint8_t * p_buf) {
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		twi_job_t job = {
+			.address = addresses[d],
+			.p_tx = p_buf,
+			.tx_len = 2,
+			.xfer_class = TWI_CLASS_FRAME,
+		};
+		// Lost, the scrub finds the chip asleep and configures it again
+		(void)twi_queue_submit(&job);
+	}
+}
+
+// Out of the night's sleep once anything is to light. The oscillators
+// start ahead of the bursts, which carry the whole shadow so nothing
+// depends on what the chips held.
+static bool wake(void) {
+	bool woke;
+
+	CRITICAL_REGION_ENTER();
+	woke = asleep && !shadow_dark();
+	if (woke) {
+		asleep = false;
+		for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+			devices[d].dirty = ALL_OUTPUTS;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (woke) {
+		mode1_submit(wake_buf);
+		oe_apply();
+	}
+	return woke;
+}
+
+void pca9685_flush(void) {
+	bool held, woke;
+
+	CRITICAL_REGION_ENTER();
+	held = hold_depth > 0;
+	if (held) {
+		hold_pending = true;
+	} else if (phases_stale) {
+		allocate_phases();
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (held) {
+		return;
+	}
+	woke = wake();
+	lit_check();
+
+	// One burst per device, queued back to back
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		flush_device(d);
+	}
+	if (woke) {
+		// A full burst is well over the 500 us the oscillator needs
+		// before RESTART, and the frame landing has usually cleared it
+		// already
+		mode1_submit(restart_buf);
+	}
+}
+
+// off of 0xFFFE and over means fully off, as it always has
+static uint16_t duty_of(int on, int off) {
+	if (off >= 0xFFFE || off <= on) {
+		return 0;
+	}
+	return MIN(off - on, PCA9685_COUNTS - 1);
+}
+
+void pca9685_set_led(uint8_t led, int on, int off) {
+	uint16_t d = duty_of(on, off);
+
+	if (!PCA9685_IS_LED(led)) {
+		return;
+	}
+	CRITICAL_REGION_ENTER();
+	if (duty[led] != d) {
+		duty[led] = d;
+		phases_stale = true;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+void pca9685_set_aux(uint8_t led, uint16_t d) {
+	if (led >= PCA9685_NUM_LEDS || PCA9685_IS_LED(led)) {
+		return;
+	}
+	d = MIN(d, PCA9685_COUNTS - 1);
+	CRITICAL_REGION_ENTER();
+	if (duty[led] != d) {
+		duty[led] = d;
+		phases_stale = true;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+static void mark_all_dirty(void) {
+	CRITICAL_REGION_ENTER();
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		devices[d].dirty = ALL_OUTPUTS;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+void pca9685_resend(uint16_t outputs) {
+	CRITICAL_REGION_ENTER();
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		devices[d].dirty |= outputs;
+	}
+	CRITICAL_REGION_EXIT();
+	pca9685_flush();
+}
+
+// Failed ranges are still marked dirty, so sending them again is a
+// flush. A recovery may have cut a burst short anywhere, so the whole
+// shadow goes then. Chips that never came up wait for pca9685_retry().
+static void on_resync(bool recovered) {
+	if (!present) {
+		return;
+	}
+	if (recovered) {
+		mark_all_dirty();
+	}
+	pca9685_flush();
+}
+
+static void on_all_done(twi_job_t const * p_job, bool success) {
+	device_t * p_dev = device_of(p_job->p_tx);
+
+	p_dev->all_busy = false;
+	CRITICAL_REGION_ENTER();
+	if (success) {
+		commits++;
+	} else {
+		p_dev->dirty = ALL_OUTPUTS;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+void pca9685_write_all(int on, int off) {
+	bool use_burst = false;
 	if (off >= 0xFFFE) off = 0xFFFF;
-	
-	obuf[0] = REG_LED0 + 4*led;
-	obuf[1] = on & 0xFF;
-	obuf[2] = (on >> 8) & 0xFF;
-	obuf[3] = off & 0xFF;
-	obuf[4] = (off >> 8) & 0xFF;
-	
-	twi_master_transfer(ADDR, obuf, 5, true);
+
+	if (!fully_mapped || hold_depth > 0 || asleep) {
+		// ALL_LED would light the spare outputs too, move the auxiliary
+		// ones, go out ahead of the rest of a held frame, or find the
+		// chips asleep
+		for (uint8_t led = 0; led < PCA9685_NUM_LEDS; led++) {
+			pca9685_set_led(led, on, off);
+		}
+		pca9685_flush();
+		return;
+	}
+
+	CRITICAL_REGION_ENTER();
+	for (uint8_t led = 0; led < PCA9685_NUM_LEDS; led++) {
+		// The next flush spreads them out again
+		duty[led] = duty_of(on, off);
+	}
+	CRITICAL_REGION_EXIT();
+	lit_check();
+
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		device_t * p_dev = &devices[d];
+
+		CRITICAL_REGION_ENTER();
+		for (uint8_t out = 0; out < PCA9685_OUTPUTS; out++) {
+			p_dev->shadow[4*out + 0] = on & 0xFF;
+			p_dev->shadow[4*out + 1] = (on >> 8) & 0xFF;
+			p_dev->shadow[4*out + 2] = off & 0xFF;
+			p_dev->shadow[4*out + 3] = (off >> 8) & 0xFF;
+		}
+		phases_stale = true;
+		if (p_dev->all_busy) {
+			// Previous broadcast still on the bus, send the shadow instead
+			p_dev->dirty = ALL_OUTPUTS;
+			use_burst = true;
+		} else {
+			p_dev->dirty = 0;
+			p_dev->all_busy = true;
+			p_dev->all_buf[0] = REG_ALL_LED;
+			memcpy(&p_dev->all_buf[1], &p_dev->shadow[0], 4);
+		}
+		CRITICAL_REGION_EXIT();
+
+		if (use_burst) {
+			flush_device(d);
+			use_burst = false;
+			continue;
+		}
+
+		twi_job_t job = {
+			.address = addresses[d],
+			.p_tx = p_dev->all_buf,
+			.tx_len = 5,
+			.xfer_class = TWI_CLASS_FRAME,
+			.callback = on_all_done,
+		};
+		if (!twi_queue_submit(&job)) {
+			on_all_done(&job, false);
+			flush_device(d);
+		}
+	}
+}
+
+uint16_t pca9685_state_hash(void) {
+	uint16_t crc = 0xFFFF;
+
+	CRITICAL_REGION_ENTER();
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		crc = crc16_compute(devices[d].shadow, sizeof(devices[d].shadow), &crc);
+	}
+	CRITICAL_REGION_EXIT();
+	return crc;
+}
+
+void pca9685_hold(void) {
+	CRITICAL_REGION_ENTER();
+	hold_depth++;
+	CRITICAL_REGION_EXIT();
+}
+
+void pca9685_release(void) {
+	bool flush;
+
+	CRITICAL_REGION_ENTER();
+	if (hold_depth > 0) {
+		hold_depth--;
+	}
+	flush = hold_depth == 0 && hold_pending;
+	if (flush) {
+		hold_pending = false;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (flush) {
+		pca9685_flush();
+	}
+}
+
+uint32_t pca9685_commits(void) {
+	return commits;
+}
+
+void pca9685_write_led(uint8_t led, int on, int off) {
+	pca9685_set_led(led, on, off);
+	pca9685_flush();
+}
+
+
+static bool pca9685_read(uint8_t address, uint8_t reg, uint8_t * p_value) {
+	reg_buf[0] = reg;
+	read_buf[0] = 0;
+	twi_job_t job = { .address = address, .p_tx = reg_buf, .tx_len = 1, .p_rx = read_buf, .rx_len = 1 };
+	if (!pca9685_xfer(&job)) {
+		return false;
+	}
+	*p_value = read_buf[0];
+	return true;
+}
+
+static bool configure(uint8_t address) {
+	uint8_t mode1 = 0;
+
+	if (!pca9685_write(address, REG_PRESCALE, prescale) ||
+	    !pca9685_write(address, REG_MODE1, (1 << 7) | 1)) {
+		return false;
+	}
+	for (uint8_t i = 0; i < RESTART_POLLS && mode1 != 0x01; i++) {
+		nrf_delay_us(RESTART_POLL_US);
+		if (!pca9685_read(address, REG_MODE1, &mode1)) {
+			return false;
+		}
+	}
+	// Outputs latch at STOP, so each burst lands on one PWM cycle
+	return mode1 == 0x01 &&
+	       pca9685_write(address, REG_MODE2, MODE2_OUTDRV) &&
+	       pca9685_write(address, REG_MODE1, (1 << 5) | 1); // Auto-increment + on-call
 }
 
+// The software reset is a general call, so every chip starts over
+// together and all of them are configured again
+static bool configure_all(void) {
+	if (!pca9685_bus_reset()) {
+		return false;
+	}
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		if (!configure(addresses[d])) {
+			return false;
+		}
+	}
+	return true;
+}
 
-static uint8_t pca9685_read(uint8_t reg) {
-	uint8_t obuf[1];
-	obuf[0] = reg;
-	twi_master_transfer(ADDR, obuf, 1, true);
-	obuf[0] = 0;
-	twi_master_transfer(ADDR | 0x01, obuf, 1, true);
-	return obuf[0];
+static bool bring_up(void) {
+	for (uint8_t attempt = 0; attempt < PCA9685_INIT_ATTEMPTS; attempt++) {
+		if (attempt > 0) {
+			// Whatever went wrong may have left a slave holding the bus
+			twi_queue_recover();
+		}
+		if (configure_all()) {
+			return true;
+		}
+	}
+	return false;
 }
 
-void pca9685_init(void) {
-	// Configure OE
+bool pca9685_init(void) {
+	// Configure OE, shared by every chip
 	nrf_gpio_pin_dir_set(PIN_OE, NRF_GPIO_PIN_DIR_OUTPUT);
 	nrf_gpio_pin_clear(PIN_OE);
-	
-	// Do a bus reset
-	pca9685_bus_reset();
-  pca9685_write(REG_PRESCALE, 0x17);
 
-	pca9685_write(REG_MODE1, (1 << 7) | 1);
-	for(;;) {
-		if (0x01 == pca9685_read(REG_MODE1)) {
-			break;
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		for (uint8_t out = 0; out < PCA9685_OUTPUTS; out++) {
+			uint8_t led = channel_map[d][out];
+			if (led == PCA9685_UNMAPPED || !PCA9685_IS_LED(led)) {
+				fully_mapped = false;
+			}
+		}
+	}
+
+	present = bring_up();
+	twi_queue_set_resync(on_resync);
+
+	// The shadows start zeroed, so force every output out once
+	for(int i = 0; i < PCA9685_NUM_LEDS; i++) {
+		pca9685_set_led(i, 0x0, 0x10);
+	}
+	mark_all_dirty();
+	// Not waited for, a restored frame queues up behind it
+	pca9685_flush();
+	return present;
+}
+
+bool pca9685_set_frequency(uint16_t hz) {
+	if (hz < PCA9685_FREQ_MIN_HZ || hz > PCA9685_FREQ_MAX_HZ) {
+		return false;
+	}
+	// Rounded to the nearest prescale
+	prescale = (PCA9685_OSC_HZ + PCA9685_COUNTS * hz / 2) / (PCA9685_COUNTS * hz) - 1;
+	if (!present) {
+		return true; // Taken up by the next bring-up
+	}
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		uint8_t address = addresses[d];
+
+		// PRESCALE only takes writes while the oscillator sleeps, RESTART
+		// then picks the channels up where they were
+		if (!pca9685_write(address, REG_MODE1, (1 << 5) | (1 << 4) | 1) ||
+		    !pca9685_write(address, REG_PRESCALE, prescale)) {
+			return false;
+		}
+		if (asleep) {
+			// Taken up at the wake
+			continue;
+		}
+		if (!pca9685_write(address, REG_MODE1, (1 << 5) | 1)) {
+			return false;
+		}
+		nrf_delay_us(RESTART_POLL_US);
+		if (!pca9685_write(address, REG_MODE1, (1 << 7) | (1 << 5) | 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint16_t pca9685_frequency(void) {
+	return PCA9685_OSC_HZ / (PCA9685_COUNTS * (prescale + 1));
+}
+
+bool pca9685_present(void) {
+	return present;
+}
+
+// Whether a scrub read of device d can be judged: nothing has landed
+// since it went out and nothing is on its way. Called with interrupts
+// held off.
+static bool scrub_still(uint8_t d) {
+	device_t * p_dev = &devices[d];
+
+	return commits == scrub_commits && hold_depth == 0 &&
+	       p_dev->dirty == 0 && !p_dev->flush_busy && !p_dev->all_busy;
+}
+
+static void on_scrub_mode(twi_job_t const * p_job, bool success) {
+	uint8_t d = (uint32_t)p_job->p_context;
+
+	scrub_pending--;
+	// RESTART reads back set after a sleep, the rest is what configure()
+	// left
+	if (success && (scrub_mode[0] & ~(1 << 7)) != ((1 << 5) | 1)) {
+		scrub_reconfigure |= 1 << d;
+		scrub_repairs++;
+	}
+}
+
+static void on_scrub_leds(twi_job_t const * p_job, bool success) {
+	uint8_t d = (uint32_t)p_job->p_context;
+	uint8_t first = (p_job->p_tx[0] - REG_LED0) / 4;
+	uint16_t wrong = 0;
+
+	scrub_pending--;
+	if (!success) {
+		return;
+	}
+	CRITICAL_REGION_ENTER();
+	if (scrub_still(d)) {
+		for (uint8_t i = 0; i < PCA9685_SCRUB_OUTPUTS; i++) {
+			if (memcmp(&scrub_leds[4*i], &devices[d].shadow[4*(first + i)], 4) != 0) {
+				wrong |= 1 << (first + i);
+				scrub_repairs++;
+			}
+		}
+		devices[d].dirty |= wrong;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (wrong != 0) {
+		flush_device(d);
+	}
+}
+
+void pca9685_scrub(void) {
+	uint8_t d = scrub_device;
+	bool idle;
+
+	if (!present || asleep || scrub_pending > 0) {
+		return;
+	}
+	if (scrub_reconfigure & (1 << d)) {
+		// Blocking, as at bring-up, then the whole shadow again
+		CRITICAL_REGION_ENTER();
+		scrub_reconfigure &= ~(1 << d);
+		CRITICAL_REGION_EXIT();
+		if (configure(addresses[d])) {
+			CRITICAL_REGION_ENTER();
+			devices[d].dirty = ALL_OUTPUTS;
+			CRITICAL_REGION_EXIT();
+			pca9685_flush();
 		}
+		return;
 	}
-	pca9685_write(REG_MODE1, (1 << 5) | 1); // Auto-increment + on-call
 
-	
-	for(int i = 0; i < 16; i++) {
-		pca9685_write_led(i, 0x0, 0x10);
+	CRITICAL_REGION_ENTER();
+	scrub_commits = commits;
+	idle = scrub_still(d);
+	CRITICAL_REGION_EXIT();
+	if (!idle) {
+		return;
+	}
+
+	scrub_led_reg[0] = REG_LED0 + 4*scrub_first;
+	twi_job_t mode = {
+		.address = addresses[d],
+		.p_tx = scrub_mode_reg,
+		.tx_len = 1,
+		.p_rx = scrub_mode,
+		.rx_len = 1,
+		.xfer_class = TWI_CLASS_SENSOR,
+		.callback = on_scrub_mode,
+		.p_context = (void *)(uint32_t)d,
+	};
+	twi_job_t leds = mode;
+	leds.p_tx = scrub_led_reg;
+	leds.p_rx = scrub_leds;
+	leds.rx_len = sizeof(scrub_leds);
+	leds.callback = on_scrub_leds;
+
+	scrub_pending = 2;
+	if (!twi_queue_submit(&mode)) {
+		scrub_pending--;
+	}
+	if (!twi_queue_submit(&leds)) {
+		scrub_pending--;
+	}
+
+	scrub_first += PCA9685_SCRUB_OUTPUTS;
+	if (scrub_first >= PCA9685_OUTPUTS) {
+		scrub_first = 0;
+		scrub_device = (d + 1) % PCA9685_NUM_DEVICES;
+	}
+}
+
+uint16_t pca9685_scrub_repairs(void) {
+	return scrub_repairs;
+}
+
+void pca9685_night(uint32_t uptime) {
+	bool still = true;
+	bool sleep = false;
+
+	if (!present || asleep) {
+		return;
+	}
+	CRITICAL_REGION_ENTER();
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		still &= devices[d].dirty == 0 && !devices[d].flush_busy && !devices[d].all_busy;
+	}
+	still &= hold_depth == 0 && !phases_stale && scrub_pending == 0 && shadow_dark();
+	if (!still) {
+		dark_since = 0;
+	} else if (dark_since == 0) {
+		dark_since = MAX(uptime, 1);
+	} else if (uptime - dark_since >= PCA9685_NIGHT_S) {
+		// A flush from here on wakes them
+		sleep = asleep = true;
+		dark_since = 0;
+	}
+	CRITICAL_REGION_EXIT();
+	if (!sleep) {
+		return;
+	}
+
+	// Blocking, as the scrub's repairs are. One that doesn't take is
+	// woken with the rest all the same.
+	oe_apply();
+	for (uint8_t d = 0; d < PCA9685_NUM_DEVICES; d++) {
+		(void)pca9685_write(addresses[d], REG_MODE1, MODE1_AI | MODE1_SLEEP | MODE1_ALLCALL);
+	}
+	if (!asleep) {
+		// Woken while going down, so its wake may have gone out ahead
+		// of the sleep
+		mode1_submit(wake_buf);
+		mark_all_dirty();
+		pca9685_flush();
+		mode1_submit(restart_buf);
+	}
+}
+
+bool pca9685_asleep(void) {
+	return asleep;
+}
+
+bool pca9685_retry(void) {
+	if (present) {
+		return true;
+	}
+	present = bring_up();
+	if (present) {
+		// Everything set while they were missing
+		mark_all_dirty();
+		pca9685_flush();
 	}
-	
+	return present;
 }
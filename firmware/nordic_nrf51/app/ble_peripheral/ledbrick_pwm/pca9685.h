@@ -3,9 +3,139 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "board_profile.h"
 
-void pca9685_init(void);
+#define PCA9685_NUM_LEDS 16 // Logical channels, the width of a mask
+// Channels past the emitter strings wired are auxiliary outputs (aux.h),
+// set only through pca9685_set_aux(): the LED paths leave them be
+#define PCA9685_LED_MASK ((uint16_t)((1UL << BOARD_LED_CHANNELS) - 1))
+#define PCA9685_IS_LED(led) (((PCA9685_LED_MASK >> (led)) & 1) != 0)
+#define PCA9685_OUTPUTS 16 // Per chip
+#define PCA9685_COUNTS 4096 // Per PWM period
+
+// Chips on the bus, sharing OE, and which logical channel each of their
+// outputs drives. Several outputs may drive one channel, and an
+// unmapped output is held off. Laid out in the board profile.
+#define PCA9685_NUM_DEVICES BOARD_PCA9685_DEVICES
+#define PCA9685_ADDRESSES BOARD_PCA9685_ADDRESSES
+#define PCA9685_UNMAPPED 0xFF
+#define PCA9685_CHANNEL_MAP BOARD_PCA9685_CHANNEL_MAP
+
+// PWM frequency range the prescaler covers off the internal oscillator
+#define PCA9685_OSC_HZ 25000000
+#define PCA9685_FREQ_MIN_HZ 24
+#define PCA9685_FREQ_MAX_HZ 1526
+#define PCA9685_FREQ_DEFAULT_HZ 254
+
+// Configuration attempts before giving up, with a bus recovery between
+#define PCA9685_INIT_ATTEMPTS 3
+
+// Returns false if any chip never answered. Everything else carries on
+// without it, channel updates just fail on the bus.
+bool pca9685_init(void);
+bool pca9685_present(void);
+// Another go at bringing up a missing chip, bounded like pca9685_init(),
+// then sends the whole shadow over. Returns whether it is there.
+bool pca9685_retry(void);
+
+// Higher is flicker free on camera, lower switches less. Puts the chip
+// to sleep for the change, so outputs stop for about a millisecond.
+// Returns false if out of range or the chip didn't take it.
+bool pca9685_set_frequency(uint16_t hz);
+// What the prescaler actually gives, close to the requested rate
+uint16_t pca9685_frequency(void);
+
+// Update a channel in the shadow register file without touching the bus.
+// Only the duty (off - on) is kept: the ON edges of all channels are
+// laid end to end around the period at each flush, so as few channels
+// as the duties allow are on together.
+void pca9685_set_led(uint8_t led, int on, int off);
+// Set an auxiliary channel's duty (0-4095) in the shadow, with no gamma,
+// calibration or derate. Laid out after the LED channels, so their edges
+// stay put when it moves. Ignored for an LED channel.
+void pca9685_set_aux(uint8_t led, uint16_t duty);
+// Channels in mask change duty often (dithering, fade.h). They're laid
+// out last, so their changes don't move every other channel's edges.
+void pca9685_set_volatile(uint16_t mask);
+// Send all dirty channels in a single burst per chip. The chips latch
+// their outputs at the burst's STOP, so a frame changes on one PWM cycle.
+void pca9685_flush(void);
+// Between these, flushes wait for the release, so everything set in
+// between goes out as one frame. They nest.
+void pca9685_hold(void);
+void pca9685_release(void);
+// Bursts the chips have taken since boot
+uint32_t pca9685_commits(void);
+
+// Register scrubbing: each call reads back MODE1 and a window of
+// PCA9685_SCRUB_OUTPUTS outputs from the next chip in turn, a few dozen
+// bytes on the sensor class, and checks them against the shadow. An
+// output that differs is sent again, and a chip that lost MODE1 (a
+// brownout puts it to sleep with the outputs off) is configured again
+// at the next call. A read that overlaps a frame is thrown away, so
+// only a still output is ever judged. Skipped while held, flushing or
+// asleep.
+#define PCA9685_SCRUB_OUTPUTS 4
+void pca9685_scrub(void);
+// Registers found wrong and repaired since boot, wrapping
+uint16_t pca9685_scrub_repairs(void);
+
+// Night power-down: once every channel has been at 0 for
+// PCA9685_NIGHT_S, with nothing on its way, the chips' oscillators are
+// put to sleep and OE held off. The first flush with anything to light
+// wakes them, MODE1 queued ahead of bursts carrying the whole shadow, so
+// the frame lands on the first PWM cycle back. Call from main context
+// with the uptime in seconds; the sleep itself is blocking.
+#define PCA9685_NIGHT_S (15 * 60)
+void pca9685_night(uint32_t uptime);
+bool pca9685_asleep(void);
+// Send outputs (a mask per chip) again as they are, to time the bus
+// (bench.h). Nothing on the outputs moves.
+void pca9685_resend(uint16_t outputs);
+// Set and flush a single channel
 void pca9685_write_led(uint8_t led, int on, int off);
+// Set every LED channel at once through the ALL_LED registers (one
+// transaction per chip, no per-channel phase offset). Falls back to a
+// flush if some output is unmapped or auxiliary.
+void pca9685_write_all(int on, int off);
 void pca9685_enable(bool on);
+// CRC16 of the shadow register file, changes whenever any output does
+uint16_t pca9685_state_hash(void);
+
+// Master dimmer: OE is switched at the fan PWM's 25 kHz by TIMER1, PPI
+// and GPIOTE, scaling every channel together without touching the bus.
+// PCA9685_DIM_FULL stops it. Returns false if out of range or the PPI
+// channels aren't there.
+#define PCA9685_DIM_FULL 100
+bool pca9685_dim(uint8_t percent);
+uint8_t pca9685_dim_percent(void);
+// Scales the dimmer again, for effects (effect.h) to move the outputs
+// many times a second, leaving pca9685_dim() as it was set
+bool pca9685_modulate(uint8_t percent);
+// Duty a channel drives its LEDs at after the master dimmer, 0 while OE
+// holds them off
+uint16_t pca9685_output(uint8_t led);
+
+// Hardware shutdown: connect an event (e.g. a GPIOTE IN event) through
+// PPI to a GPIOTE task that drives OE high, turning every output off
+// without software or the bus being involved
+bool pca9685_protect_init(uint32_t event_addr);
+// Put OE back to the last pca9685_enable() state after a trip
+void pca9685_protect_reset(void);
+// From the trip's interrupt. While dimming the PPI path can only stop
+// the toggling, this drives OE off after it.
+void pca9685_protect_trip(void);
+
+// Hold OE off while the supply can't carry the load, apart from any
+// thermal trip or pca9685_enable() state
+void pca9685_shed(bool on);
+// Called, in the caller's context, whenever a flush or an OE change
+// leaves any output driven, for a watch that sleeps while all are dark
+typedef void (*pca9685_lit_handler_t)(void);
+void pca9685_on_lit(pca9685_lit_handler_t handler);
+// Called from the TWI interrupt as a burst lands with nothing left to
+// send on any device, the frame committed in full (trace.h)
+typedef void (*pca9685_commit_handler_t)(void);
+void pca9685_on_commit(pca9685_commit_handler_t handler);
 
 #endif
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "pool.h"
+
+STATIC_ASSERT(POOL_SMALL_SIZE % sizeof(uint32_t) == 0);
+STATIC_ASSERT(POOL_LARGE_SIZE % sizeof(uint32_t) == 0);
+
+// A free block holds the next free one in its first word
+typedef struct free_block_s {
+	struct free_block_s * p_next;
+} free_block_t;
+
+typedef struct {
+	uint8_t * p_fresh;      // Blocks never handed out start here
+	uint8_t * p_end;
+	uint16_t size;
+	free_block_t * p_free;  // Blocks given back
+	pool_stats_t stats;
+} pool_t;
+
+static uint32_t small_blocks[POOL_SMALL_BLOCKS * POOL_SMALL_SIZE / sizeof(uint32_t)];
+static uint32_t large_blocks[POOL_LARGE_BLOCKS * POOL_LARGE_SIZE / sizeof(uint32_t)];
+
+// Linked up as blocks come back rather than at init, so the pools are
+// ready before anything runs
+static pool_t pools[POOL_COUNT] = {
+	[POOL_SMALL] = {
+		(uint8_t *)small_blocks, (uint8_t *)small_blocks + sizeof(small_blocks),
+		POOL_SMALL_SIZE, NULL, { .blocks = POOL_SMALL_BLOCKS },
+	},
+	[POOL_LARGE] = {
+		(uint8_t *)large_blocks, (uint8_t *)large_blocks + sizeof(large_blocks),
+		POOL_LARGE_SIZE, NULL, { .blocks = POOL_LARGE_BLOCKS },
+	},
+};
+
+void * pool_alloc(pool_id_t pool) {
+	pool_t * p_pool = &pools[pool];
+	void * p_block = NULL;
+
+	CRITICAL_REGION_ENTER();
+	if (p_pool->p_free != NULL) {
+		p_block = p_pool->p_free;
+		p_pool->p_free = p_pool->p_free->p_next;
+	} else if (p_pool->p_fresh < p_pool->p_end) {
+		p_block = p_pool->p_fresh;
+		p_pool->p_fresh += p_pool->size;
+	}
+	if (p_block != NULL) {
+		p_pool->stats.allocs++;
+		if (++p_pool->stats.in_use > p_pool->stats.peak) {
+			p_pool->stats.peak = p_pool->stats.in_use;
+		}
+	} else {
+		p_pool->stats.exhausted++;
+	}
+	CRITICAL_REGION_EXIT();
+	return p_block;
+}
+
+void pool_free(pool_id_t pool, void * p_block) {
+	pool_t * p_pool = &pools[pool];
+
+	if (p_block == NULL) {
+		return;
+	}
+	CRITICAL_REGION_ENTER();
+	((free_block_t *)p_block)->p_next = p_pool->p_free;
+	p_pool->p_free = p_block;
+	p_pool->stats.in_use--;
+	CRITICAL_REGION_EXIT();
+}
+
+void pool_stats(pool_id_t pool, pool_stats_t * p_stats) {
+	CRITICAL_REGION_ENTER();
+	*p_stats = pools[pool].stats;
+	CRITICAL_REGION_EXIT();
+}
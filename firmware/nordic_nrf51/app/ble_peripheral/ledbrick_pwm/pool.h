@@ -0,0 +1,44 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+
+// Fixed-block pools for objects that come and go at times nobody can
+// plan for: TWI jobs, queued notifications and staged commands. Each
+// pool is one reserve sized at compile time that its users draw on
+// between them, rather than every one of them holding its own worst
+// case all the time. Alloc and free are O(1) and safe from interrupts.
+// A pool that runs dry fails the alloc and counts it, and the caller
+// treats that the same as its own queue being full.
+
+typedef enum {
+	POOL_SMALL = 0, // Up to POOL_SMALL_SIZE: twi_job_t, ble_lbs_tx_t
+	POOL_LARGE,     // Up to POOL_LARGE_SIZE: staged commands (sync_apply.h)
+	POOL_COUNT
+} pool_id_t;
+
+// Block sizes, multiples of 4
+#define POOL_SMALL_SIZE 28
+#define POOL_LARGE_SIZE 72
+
+// A full TWI queue (twi_queue.h) is 16, every notification queued at
+// once (ble_lbs.h) 5. Both at once is a bus that has stopped and a
+// link that has too, so the two share a little less than their sum.
+#define POOL_SMALL_BLOCKS 18
+#define POOL_LARGE_BLOCKS 4
+
+typedef struct {
+	uint32_t allocs;
+	uint32_t exhausted; // Allocs failed for want of a block
+	uint8_t blocks;
+	uint8_t in_use;
+	uint8_t peak;
+} pool_stats_t;
+
+// A block of the pool, NULL when none is free
+void * pool_alloc(pool_id_t pool);
+// Back to the pool it came from, NULL ignored
+void pool_free(pool_id_t pool, void * p_block);
+void pool_stats(pool_id_t pool, pool_stats_t * p_stats);
+
+#endif
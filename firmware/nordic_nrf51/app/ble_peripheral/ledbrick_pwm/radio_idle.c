@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf_soc.h"
+#include "nrf_error.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "ble.h"
+#include "ble_gap.h"
+#include "radio_idle.h"
+
+// RTC1 ticks, 1/32768 s, to microseconds and back
+#define TICKS_TO_US(t) (((uint64_t)(t) * 15625) >> 9)
+
+static radio_idle_handler_t idle_handler;
+static bool connected = false;
+static uint32_t interval_us;
+// When the last radio event ended, if one has on these parameters
+static volatile bool synced = false;
+static volatile uint32_t idle_ticks;
+
+bool radio_idle_init(radio_idle_handler_t on_idle) {
+	idle_handler = on_idle;
+	return sd_nvic_SetPriority(SWI1_IRQn, APP_IRQ_PRIORITY_LOW) == NRF_SUCCESS &&
+	       sd_nvic_EnableIRQ(SWI1_IRQn) == NRF_SUCCESS &&
+	       sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_INACTIVE,
+	                                     NRF_RADIO_NOTIFICATION_DISTANCE_NONE) == NRF_SUCCESS;
+}
+
+void radio_idle_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+	switch (p_ble_evt->header.evt_id) {
+		case BLE_GAP_EVT_CONNECTED:
+			interval_us = p_gap->params.connected.conn_params.max_conn_interval * 1250UL;
+			synced = false;
+			connected = true;
+			break;
+
+		case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+			// The events move, wait for one to end to find them again
+			synced = false;
+			interval_us = p_gap->params.conn_param_update.conn_params.max_conn_interval * 1250UL;
+			break;
+
+		case BLE_GAP_EVT_DISCONNECTED:
+			connected = false;
+			synced = false;
+			if (idle_handler != NULL) {
+				idle_handler();
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+void radio_idle_on_notification(void) {
+	uint32_t now;
+
+	app_timer_cnt_get(&now);
+	idle_ticks = now;
+	synced = true;
+	if (idle_handler != NULL) {
+		idle_handler();
+	}
+}
+
+bool radio_idle_fits(uint32_t us) {
+	uint32_t now, since, ticks;
+	bool is_synced;
+
+	CRITICAL_REGION_ENTER();
+	is_synced = synced;
+	ticks = idle_ticks;
+	CRITICAL_REGION_EXIT();
+
+	if (!connected || !is_synced || interval_us <= RADIO_IDLE_GUARD_US) {
+		return true;
+	}
+	app_timer_cnt_get(&now);
+	app_timer_cnt_diff_compute(now, ticks, &since);
+	return (TICKS_TO_US(since) % interval_us) + us <= interval_us - RADIO_IDLE_GUARD_US;
+}
@@ -0,0 +1,36 @@
+#ifndef _RADIO_IDLE_H_
+#define _RADIO_IDLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Where the link's next radio event falls, so bus work that suffers from
+// being preempted (a TWI transfer stretches for as long as the SoftDevice
+// has the CPU) can start where it fits in between. The SoftDevice's
+// radio notification fires as the radio goes inactive after each event,
+// and the next one comes an interval on, less RADIO_IDLE_GUARD_US for
+// its wind up and window widening. Slave latency only makes the gap
+// longer, and a missed notification is covered by counting whole
+// intervals on from the last.
+//
+// ble_radio_notification wants SWI1 to itself, which esb_rx also pends,
+// so esb_rx's SWI1 handler passes on what it didn't pend itself.
+#define RADIO_IDLE_GUARD_US 2500
+
+typedef void (*radio_idle_handler_t)(void);
+
+// After the SoftDevice is up. on_idle runs in interrupt context (SWI1,
+// APP_IRQ_PRIORITY_LOW) as each radio event ends, and once more when
+// the link goes so nothing is left waiting for a notification.
+bool radio_idle_init(radio_idle_handler_t on_idle);
+void radio_idle_on_ble_evt(ble_evt_t * p_ble_evt);
+// From SWI1_IRQHandler, for a notification
+void radio_idle_on_notification(void);
+
+// True if work taking us microseconds, started now, ends before the next
+// radio event. Always true with no link, or before the first
+// notification on new parameters.
+bool radio_idle_fits(uint32_t us);
+
+#endif
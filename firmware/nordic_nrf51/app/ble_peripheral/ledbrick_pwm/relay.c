@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "broadcast.h"
+#include "tick.h"
+#include "relay.h"
+
+#ifdef S130
+
+#include "ble_gap.h"
+
+#define AD_TYPE_MANUFACTURER 0xFF
+// Length, type and company ID ahead of the payload
+#define AD_HEADER_LEN 4
+
+typedef struct {
+	uint8_t data[RELAY_MAX_PAYLOAD];
+	uint8_t len;
+	uint8_t left;
+} slot_t;
+
+static slot_t slots[RELAY_SLOTS];
+static uint8_t next_slot = 0; // Oldest, replaced first
+static uint8_t turn = 0;
+static bool connected = false;
+static bool advertising = false;
+static relay_restore_t restore_handler;
+static uint8_t task = TICK_INVALID;
+
+static const ble_gap_adv_params_t adv_params = {
+	.type = BLE_GAP_ADV_TYPE_ADV_NONCONN_IND,
+	.p_peer_addr = NULL,
+	.fp = BLE_GAP_ADV_FP_ANY,
+	.p_whitelist = NULL,
+	.interval = MSEC_TO_UNITS(RELAY_INTERVAL_MS, UNIT_0_625_MS),
+	.timeout = 0,
+};
+
+// From the broadcast checks, in main context
+static void on_accepted(uint8_t const * p_data, uint8_t len, uint8_t hops) {
+	if (!connected) {
+		return;
+	}
+	if (hops >= RELAY_MAX_HOPS || len + BROADCAST_HOPS_LEN > RELAY_MAX_PAYLOAD) {
+		return;
+	}
+	slot_t * p_slot = &slots[next_slot];
+	next_slot = (next_slot + 1) % RELAY_SLOTS;
+	memcpy(p_slot->data, p_data, len);
+	p_slot->data[len] = hops + 1;
+	p_slot->len = len + BROADCAST_HOPS_LEN;
+	p_slot->left = RELAY_REPEATS;
+	tick_wake(task);
+}
+
+static void stop(void) {
+	if (advertising) {
+		(void)sd_ble_gap_adv_stop();
+		advertising = false;
+		if (restore_handler) {
+			restore_handler();
+		}
+	}
+}
+
+// One payload an event, the slots with any left taking turns
+static void on_tick(void) {
+	uint8_t adv[AD_HEADER_LEN + RELAY_MAX_PAYLOAD];
+
+	for (uint8_t i = 0; i < RELAY_SLOTS; i++) {
+		slot_t * p_slot = &slots[(turn + i) % RELAY_SLOTS];
+		if (p_slot->left == 0) {
+			continue;
+		}
+		turn = (turn + i + 1) % RELAY_SLOTS;
+		p_slot->left--;
+		adv[0] = 3 + p_slot->len;
+		adv[1] = AD_TYPE_MANUFACTURER;
+		uint16_encode(BROADCAST_COMPANY_ID, &adv[2]);
+		memcpy(&adv[AD_HEADER_LEN], p_slot->data, p_slot->len);
+		if (sd_ble_gap_adv_data_set(adv, AD_HEADER_LEN + p_slot->len, NULL, 0) != NRF_SUCCESS) {
+			return;
+		}
+		if (!advertising) {
+			if (sd_ble_gap_adv_start(&adv_params) != NRF_SUCCESS) {
+				// The data set is still the relay's
+				advertising = true;
+				stop();
+				return;
+			}
+			advertising = true;
+		}
+		return;
+	}
+	stop();
+	tick_idle(task);
+}
+
+void relay_on_ble_evt(ble_evt_t * p_ble_evt) {
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_CONNECTED:
+		connected = true;
+		break;
+	case BLE_GAP_EVT_DISCONNECTED:
+		// Ahead of ble_advertising starting again, on its own data
+		connected = false;
+		memset(slots, 0, sizeof(slots));
+		stop();
+		break;
+	default:
+		break;
+	}
+}
+
+void relay_init(relay_restore_t restore) {
+	restore_handler = restore;
+	broadcast_set_relay(on_accepted);
+	task = tick_register(on_tick, RELAY_INTERVAL_MS, 0);
+	tick_idle(task);
+}
+
+bool relay_active(void) {
+	return advertising;
+}
+
+#else
+
+// The S110 can't advertise alongside its connection, nothing to relay
+void relay_init(relay_restore_t restore) {
+}
+
+void relay_on_ble_evt(ble_evt_t * p_ble_evt) {
+}
+
+bool relay_active(void) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _RELAY_H_
+#define _RELAY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Relay role, for bricks at the edge of the controller's range: one
+// connected to the controller re-advertises each broadcast payload it
+// accepts (broadcast.h, from the air or ESB), for the bricks of its
+// group further off, hop count raised by one. Foreign payloads are never
+// relayed, only what passed the group, sequence and MAC checks, so each
+// sequence number goes out once per relay and relays hearing each other
+// drop the echoes as replays. Payloads RELAY_MAX_HOPS from the
+// controller go no further.
+//
+// Non-connectable advertising, alongside the connection and the
+// broadcast scan, so it needs S130 and a brick taking a single link: it
+// works in place of the connectable advertising, whose data it puts back
+// (restore) once it has nothing more to send. A disconnect stops it
+// before advertising for the controller starts again.
+#define RELAY_MAX_HOPS 2
+// Payloads held to send at once, the newest replacing the oldest
+#define RELAY_SLOTS 4
+// Advertising events each payload goes out in, taking turns one event
+// each, with non-connectable advertising's shortest interval
+#define RELAY_REPEATS 3
+#define RELAY_INTERVAL_MS 100
+// Manufacturer data left for a payload in a 31 byte advertisement,
+// hop count included: 8 channel ESB frames don't fit and aren't relayed
+#define RELAY_MAX_PAYLOAD 27
+
+typedef void (*relay_restore_t)(void);
+
+// After broadcast_init() and tick_init(). restore puts back the
+// connectable advertising data.
+void relay_init(relay_restore_t restore);
+void relay_on_ble_evt(ble_evt_t * p_ble_evt);
+// True while the relay holds the advertising data
+bool relay_active(void);
+
+#endif
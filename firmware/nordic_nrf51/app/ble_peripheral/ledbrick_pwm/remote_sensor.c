@@ -0,0 +1,348 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "board_profile.h"
+#include "remote_sensor.h"
+
+#if defined(S130) && defined(BOARD_REMOTE_SENSORS)
+
+#include "ble_gap.h"
+#include "ble_gattc.h"
+#include "ble_hci.h"
+#include "ble_db_discovery.h"
+#include "broadcast.h"
+#include "clock.h"
+#include "derate.h"
+#include "fade.h"
+#include "mcp9808.h"
+#include "tick.h"
+
+STATIC_ASSERT(BOARD_REMOTE_SENSOR_COUNT >= 1 && BOARD_REMOTE_SENSOR_COUNT <= REMOTE_SENSOR_MAX);
+
+typedef enum {
+	SENSOR_IDLE = 0,
+	SENSOR_CONNECTING,
+	SENSOR_DISCOVERING,
+	SENSOR_RUNNING,
+} sensor_state_t;
+
+typedef struct {
+	sensor_state_t state;
+	uint16_t conn_handle;
+	ble_db_discovery_t db;
+	// Value handles, and the CCCDs left to turn notifications on in
+	uint16_t temp_handle;
+	uint16_t lux_handle;
+	uint16_t cccd[2];
+	uint8_t cccd_next;
+	// Latest readings, in the sensor's units and derate's
+	bool temp_valid;
+	int16_t temp;
+	uint32_t temp_at;
+	bool lux_valid;
+	uint32_t lux;
+	uint32_t lux_at;
+} sensor_t;
+
+static const ble_gap_addr_t addresses[BOARD_REMOTE_SENSOR_COUNT] = BOARD_REMOTE_SENSORS;
+static sensor_t sensors[BOARD_REMOTE_SENSOR_COUNT];
+static bool connecting = false;
+
+static const ble_gap_scan_params_t connect_params = {
+	.active = 0,
+	.selective = 0,
+	.p_whitelist = NULL,
+	.interval = BROADCAST_SCAN_INTERVAL,
+	.window = BROADCAST_SCAN_WINDOW,
+	.timeout = REMOTE_SENSOR_CONNECT_TIMEOUT_S,
+};
+
+static const ble_gap_conn_params_t conn_params = {
+	.min_conn_interval = MSEC_TO_UNITS(REMOTE_SENSOR_MIN_INTERVAL_MS, UNIT_1_25_MS),
+	.max_conn_interval = MSEC_TO_UNITS(REMOTE_SENSOR_MAX_INTERVAL_MS, UNIT_1_25_MS),
+	.slave_latency = 0,
+	.conn_sup_timeout = MSEC_TO_UNITS(REMOTE_SENSOR_SUPERVISION_MS, UNIT_10_MS),
+};
+
+static void reset(sensor_t * p_sensor) {
+	memset(p_sensor, 0, sizeof(*p_sensor));
+	p_sensor->state = SENSOR_IDLE;
+	p_sensor->conn_handle = BLE_CONN_HANDLE_INVALID;
+}
+
+static sensor_t * by_handle(uint16_t conn_handle) {
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		if (sensors[i].state >= SENSOR_DISCOVERING && sensors[i].conn_handle == conn_handle) {
+			return &sensors[i];
+		}
+	}
+	return NULL;
+}
+
+// Hottest water and brightest room of those reporting into derate
+static void feed(void) {
+	int16_t temp = INT16_MIN;
+	uint32_t lux = 0;
+	bool temp_valid = false;
+	bool lux_valid = false;
+
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		sensor_t const * p_sensor = &sensors[i];
+		if (p_sensor->temp_valid) {
+			temp = MAX(temp, p_sensor->temp);
+			temp_valid = true;
+		}
+		if (p_sensor->lux_valid) {
+			lux = MAX(lux, p_sensor->lux);
+			lux_valid = true;
+		}
+	}
+	bool changed = derate_update_tank(temp, temp_valid);
+	if (derate_update_ambient(lux, lux_valid)) {
+		changed = true;
+	}
+	if (changed) {
+		fade_refresh();
+	}
+}
+
+static void disconnect(sensor_t * p_sensor) {
+	(void)sd_ble_gap_disconnect(p_sensor->conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+}
+
+// One CCCD write outstanding at a time, the next on its response
+static void cccd_write_next(sensor_t * p_sensor) {
+	static uint8_t notify[2] = { BLE_GATT_HVX_NOTIFICATION, 0 };
+
+	while (p_sensor->cccd_next < sizeof(p_sensor->cccd) / sizeof(p_sensor->cccd[0])) {
+		uint16_t handle = p_sensor->cccd[p_sensor->cccd_next++];
+		if (handle == BLE_GATT_HANDLE_INVALID) {
+			continue;
+		}
+		ble_gattc_write_params_t params = {
+			.write_op = BLE_GATT_OP_WRITE_REQ,
+			.handle = handle,
+			.offset = 0,
+			.len = sizeof(notify),
+			.p_value = notify,
+		};
+		if (sd_ble_gattc_write(p_sensor->conn_handle, &params) != NRF_SUCCESS) {
+			disconnect(p_sensor);
+		}
+		return;
+	}
+}
+
+static void on_discovery(ble_db_discovery_evt_t * p_evt) {
+	sensor_t * p_sensor = by_handle(p_evt->conn_handle);
+	if (p_sensor == NULL) {
+		return;
+	}
+	if (p_evt->evt_type != BLE_DB_DISCOVERY_COMPLETE) {
+		disconnect(p_sensor);
+		return;
+	}
+
+	ble_db_discovery_srv_t const * p_srv = &p_evt->params.discovered_db;
+	for (uint8_t i = 0; i < p_srv->char_count; i++) {
+		ble_db_discovery_char_t const * p_char = &p_srv->charateristics[i];
+		if (p_char->cccd_handle == BLE_GATT_HANDLE_INVALID) {
+			continue;
+		}
+		switch (p_char->characteristic.uuid.uuid) {
+		case REMOTE_SENSOR_UUID_TEMPERATURE:
+			p_sensor->temp_handle = p_char->characteristic.handle_value;
+			p_sensor->cccd[0] = p_char->cccd_handle;
+			break;
+		case REMOTE_SENSOR_UUID_ILLUMINANCE:
+			p_sensor->lux_handle = p_char->characteristic.handle_value;
+			p_sensor->cccd[1] = p_char->cccd_handle;
+			break;
+		default:
+			break;
+		}
+	}
+	if (p_sensor->temp_handle == BLE_GATT_HANDLE_INVALID && p_sensor->lux_handle == BLE_GATT_HANDLE_INVALID) {
+		// Nothing here to follow, and the link would only cost radio time
+		disconnect(p_sensor);
+		return;
+	}
+	p_sensor->state = SENSOR_RUNNING;
+	cccd_write_next(p_sensor);
+}
+
+static void on_hvx(sensor_t * p_sensor, ble_gattc_evt_hvx_t const * p_hvx) {
+	if (p_hvx->type == BLE_GATT_HVX_INDICATION) {
+		(void)sd_ble_gattc_hv_confirm(p_sensor->conn_handle, p_hvx->handle);
+	}
+	if (p_hvx->handle == p_sensor->temp_handle && p_hvx->len >= 2) {
+		int32_t centi = (int16_t)uint16_decode(p_hvx->data);
+		p_sensor->temp = (centi << MCP9808_FRAC_BITS) / 100;
+		p_sensor->temp_valid = true;
+		p_sensor->temp_at = clock_ms();
+	} else if (p_hvx->handle == p_sensor->lux_handle && p_hvx->len >= 3) {
+		uint32_t centi = uint16_decode(p_hvx->data) | ((uint32_t)p_hvx->data[2] << 16);
+		p_sensor->lux = centi / 100;
+		p_sensor->lux_valid = true;
+		p_sensor->lux_at = clock_ms();
+	} else {
+		return;
+	}
+	feed();
+}
+
+// Broadcast reception picks up again once the connection is settled
+static void connect_done(void) {
+	connecting = false;
+	(void)broadcast_start();
+}
+
+static void on_adv_report(ble_gap_evt_adv_report_t const * p_report) {
+	if (connecting || p_report->scan_rsp ||
+	    (p_report->type != BLE_GAP_ADV_TYPE_ADV_IND && p_report->type != BLE_GAP_ADV_TYPE_ADV_DIRECT_IND)) {
+		return;
+	}
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		if (sensors[i].state != SENSOR_IDLE ||
+		    p_report->peer_addr.addr_type != addresses[i].addr_type ||
+		    memcmp(p_report->peer_addr.addr, addresses[i].addr, BLE_GAP_ADDR_LEN) != 0) {
+			continue;
+		}
+		// Connecting can't share the radio with the scan
+		broadcast_stop();
+		if (sd_ble_gap_connect(&addresses[i], &connect_params, &conn_params) != NRF_SUCCESS) {
+			(void)broadcast_start();
+			return;
+		}
+		sensors[i].state = SENSOR_CONNECTING;
+		connecting = true;
+		return;
+	}
+}
+
+static void on_connected(ble_evt_t * p_ble_evt) {
+	uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+	connect_done();
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		sensor_t * p_sensor = &sensors[i];
+		if (p_sensor->state != SENSOR_CONNECTING) {
+			continue;
+		}
+		p_sensor->state = SENSOR_DISCOVERING;
+		p_sensor->conn_handle = conn_handle;
+		ble_db_discovery_on_ble_evt(&p_sensor->db, p_ble_evt);
+		if (ble_db_discovery_start(&p_sensor->db, conn_handle) != NRF_SUCCESS) {
+			disconnect(p_sensor);
+		}
+		return;
+	}
+	(void)sd_ble_gap_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+}
+
+bool remote_sensor_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_ADV_REPORT:
+		// The broadcasts come in the same reports
+		on_adv_report(&p_gap->params.adv_report);
+		return false;
+	case BLE_GAP_EVT_TIMEOUT:
+		if (p_gap->params.timeout.src != BLE_GAP_TIMEOUT_SRC_CONN) {
+			return false;
+		}
+		for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+			if (sensors[i].state == SENSOR_CONNECTING) {
+				reset(&sensors[i]);
+			}
+		}
+		connect_done();
+		return true;
+	case BLE_GAP_EVT_CONNECTED:
+		if (p_gap->params.connected.role != BLE_GAP_ROLE_CENTRAL) {
+			return false;
+		}
+		on_connected(p_ble_evt);
+		return true;
+	default:
+		break;
+	}
+
+	// The rest share the connection handle's place in every event
+	sensor_t * p_sensor = by_handle(p_gap->conn_handle);
+	if (p_sensor == NULL) {
+		return false;
+	}
+	ble_db_discovery_on_ble_evt(&p_sensor->db, p_ble_evt);
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_DISCONNECTED:
+		reset(p_sensor);
+		feed();
+		break;
+	case BLE_GATTC_EVT_WRITE_RSP:
+		cccd_write_next(p_sensor);
+		break;
+	case BLE_GATTC_EVT_HVX:
+		on_hvx(p_sensor, &p_ble_evt->evt.gattc_evt.params.hvx);
+		break;
+	case BLE_GATTS_EVT_SYS_ATTR_MISSING:
+		(void)sd_ble_gatts_sys_attr_set(p_sensor->conn_handle, NULL, 0, 0);
+		break;
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
+		(void)sd_ble_gap_conn_param_update(p_sensor->conn_handle,
+		                                   &p_gap->params.conn_param_update_request.conn_params);
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+// Readings too old to act on drop out
+static void on_tick(void) {
+	uint32_t now = clock_ms();
+	bool dropped = false;
+
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		sensor_t * p_sensor = &sensors[i];
+		if (p_sensor->temp_valid && now - p_sensor->temp_at > REMOTE_SENSOR_STALE_MS) {
+			p_sensor->temp_valid = false;
+			dropped = true;
+		}
+		if (p_sensor->lux_valid && now - p_sensor->lux_at > REMOTE_SENSOR_STALE_MS) {
+			p_sensor->lux_valid = false;
+			dropped = true;
+		}
+	}
+	if (dropped) {
+		feed();
+	}
+}
+
+void remote_sensor_init(void) {
+	static const ble_uuid_t service = { .uuid = REMOTE_SENSOR_UUID_SERVICE, .type = BLE_UUID_TYPE_BLE };
+
+	for (uint8_t i = 0; i < BOARD_REMOTE_SENSOR_COUNT; i++) {
+		reset(&sensors[i]);
+	}
+	if (ble_db_discovery_init() != NRF_SUCCESS ||
+	    ble_db_discovery_evt_register(&service, on_discovery) != NRF_SUCCESS) {
+		return;
+	}
+	(void)tick_register(on_tick, REMOTE_SENSOR_TICK_MS, 0);
+}
+
+#else
+
+// Stubs for S110, which has no central role, and boards naming no sensors
+void remote_sensor_init(void) {
+}
+
+bool remote_sensor_on_ble_evt(ble_evt_t * p_ble_evt) {
+	return false;
+}
+
+#endif
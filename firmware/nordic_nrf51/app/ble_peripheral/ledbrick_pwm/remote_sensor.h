@@ -0,0 +1,45 @@
+#ifndef _REMOTE_SENSOR_H_
+#define _REMOTE_SENSOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Central role for BLE sensors by the tank, so the loops they feed run
+// on the brick at the sensor's own rate instead of round the controller.
+// The brick connects to each sensor its board profile names
+// (BOARD_REMOTE_SENSORS, addresses as advertised), discovers the
+// Environmental Sensing Service and takes notifications from its
+// Temperature (the water) and Illuminance (the room) characteristics,
+// each going straight into derate (derate.h). The hottest water and
+// brightest room of the sensors connected count. A sensor silent for
+// REMOTE_SENSOR_STALE_MS, or gone, drops out and leaves the output at
+// full; the heatsink's own derate and cutoff don't depend on it.
+//
+// Needs S130, the S110 build compiles it out. Sensors are found in the
+// broadcast scan's reports (broadcast.h), which pauses while the brick
+// connects to one and picks up again after. Discovery takes only the
+// first BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV characteristics in the
+// service, so a sensor with more wants these two first.
+#define REMOTE_SENSOR_MAX 2
+#define REMOTE_SENSOR_STALE_MS 60000
+#define REMOTE_SENSOR_TICK_MS 1000
+// Connecting gives up after this long, trying again the next time the
+// sensor is seen
+#define REMOTE_SENSOR_CONNECT_TIMEOUT_S 2
+// Sensors send on their own schedule, the link only needs to hold
+#define REMOTE_SENSOR_MIN_INTERVAL_MS 200
+#define REMOTE_SENSOR_MAX_INTERVAL_MS 400
+#define REMOTE_SENSOR_SUPERVISION_MS 4000
+
+#define REMOTE_SENSOR_UUID_SERVICE 0x181A
+#define REMOTE_SENSOR_UUID_TEMPERATURE 0x2A6E // sint16, 0.01 C
+#define REMOTE_SENSOR_UUID_ILLUMINANCE 0x2AFB // uint24, 0.01 lux
+
+// After broadcast_init() and tick_init()
+void remote_sensor_init(void);
+// Takes the events of the sensor links, and connects when a sensor
+// advertises. Returns true for those the peripheral side mustn't see.
+bool remote_sensor_on_ble_evt(ble_evt_t * p_ble_evt);
+
+#endif
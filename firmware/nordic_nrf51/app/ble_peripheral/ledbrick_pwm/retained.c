@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "crc16.h"
+#include "retained.h"
+
+#define LEVELS_MAGIC 0x4C564C53
+
+// Resets that leave RAM as it was
+#define RAM_KEPT (POWER_RESETREAS_DOG_Msk | POWER_RESETREAS_SREQ_Msk | \
+                  POWER_RESETREAS_LOCKUP_Msk | POWER_RESETREAS_RESETPIN_Msk)
+
+typedef struct {
+	uint32_t magic;
+	uint16_t levels[FADE_NUM_CHANNELS];
+	uint16_t crc;
+} retained_levels_t;
+
+static retained_levels_t m_levels RETAINED;
+static uint32_t reset_reason;
+
+static uint16_t levels_crc(void) {
+	return crc16_compute((uint8_t const *)m_levels.levels, sizeof(m_levels.levels), NULL);
+}
+
+void retained_init(void) {
+	reset_reason = NRF_POWER->RESETREAS;
+	NRF_POWER->RESETREAS = 0xFFFFFFFF;
+
+	// Power on leaves noise that could pass the checks by chance
+	if (!retained_ram_kept()) {
+		m_levels.magic = 0;
+	}
+}
+
+uint32_t retained_reset_reason(void) {
+	return reset_reason;
+}
+
+bool retained_ram_kept(void) {
+	return (reset_reason & RAM_KEPT) != 0;
+}
+
+void retained_levels_set(uint16_t const * p_levels) {
+	memcpy(m_levels.levels, p_levels, sizeof(m_levels.levels));
+	m_levels.crc = levels_crc();
+	m_levels.magic = LEVELS_MAGIC;
+}
+
+bool retained_levels(uint16_t * p_levels) {
+	if (m_levels.magic != LEVELS_MAGIC || m_levels.crc != levels_crc()) {
+		return false;
+	}
+	memcpy(p_levels, m_levels.levels, sizeof(m_levels.levels));
+	return true;
+}
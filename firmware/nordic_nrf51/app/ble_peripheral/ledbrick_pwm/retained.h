@@ -0,0 +1,33 @@
+#ifndef _RETAINED_H_
+#define _RETAINED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fade.h"
+
+// Variables placed here are left alone by the startup code, so they
+// survive any reset that keeps RAM powered (watchdog, soft reset, lockup,
+// the reset pin). The linker script keeps the section at the top of RAM,
+// out of the way of the stack. Contents are only trusted behind a magic
+// and CRC.
+#if defined(__GNUC__)
+#define RETAINED __attribute__((section(".noinit")))
+#else
+#define RETAINED
+#endif
+
+// Has to run before the SoftDevice is enabled, it reads and clears
+// RESETREAS
+void retained_init(void);
+
+// POWER->RESETREAS as found at boot
+uint32_t retained_reset_reason(void);
+// Whether the last reset kept RAM, RETAINED contents are noise otherwise
+bool retained_ram_kept(void);
+
+// Last output levels (linear, per channel), for putting back after a
+// reset without waiting on flash
+void retained_levels_set(uint16_t const * p_levels);
+bool retained_levels(uint16_t * p_levels);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "tick.h"
+#include "flash_ring.h"
+#include "flash_sched.h"
+#include "runhours.h"
+
+#define FINE_MAX 0xFFFF
+
+typedef struct {
+	uint32_t seq;
+	uint32_t seconds[RUNHOURS_CHANNELS];
+	uint32_t rated_hours[RUNHOURS_CHANNELS];
+	uint16_t crc;   // Over everything before it
+	uint16_t spare; // Keeps records word sized, left erased
+} record_t;
+
+static flash_ring_t ring;
+// What the next record will be numbered
+static uint32_t seq;
+
+static record_t pending; // Stays put until the store completes
+
+// Counts as of now, the duty left over below a full output second, and
+// the gain each channel is raised by
+static uint32_t seconds[RUNHOURS_CHANNELS];
+static uint32_t rated_hours[RUNHOURS_CHANNELS];
+static uint16_t part[RUNHOURS_CHANNELS];
+static uint16_t gain[RUNHOURS_CHANNELS] = { [0 ... RUNHOURS_CHANNELS - 1] = RUNHOURS_GAIN_ONE };
+static bool dirty = false;
+static uint16_t since_save_s = 0;
+static runhours_gain_handler_t gain_handler;
+static uint8_t save_job = FLASH_SCHED_INVALID;
+
+static uint16_t record_crc(record_t const * p_rec) {
+	return crc16_compute((uint8_t const *)p_rec, offsetof(record_t, crc), NULL);
+}
+
+static bool record_valid(void const * p_rec) {
+	return record_crc(p_rec) == ((record_t const *)p_rec)->crc;
+}
+
+// Output lost over the rated life is taken as linear, so the gain is
+// 1 / (1 - (1 - RUNHOURS_RATED_PCT) * hours / rated)
+static uint16_t gain_for(uint8_t channel) {
+	uint32_t rated = rated_hours[channel];
+	uint32_t lost = (100 - RUNHOURS_RATED_PCT) * (seconds[channel] / 3600);
+
+	if (rated == 0) {
+		return RUNHOURS_GAIN_ONE;
+	}
+	rated *= 100;
+	// Past the cap, and out of the way of overflowing below
+	if ((uint64_t)lost * RUNHOURS_GAIN_MAX >= (uint64_t)rated * (RUNHOURS_GAIN_MAX - RUNHOURS_GAIN_ONE)) {
+		return RUNHOURS_GAIN_MAX;
+	}
+	return RUNHOURS_GAIN_ONE + RUNHOURS_GAIN_ONE * lost / (rated - lost);
+}
+
+// Returns true if any channel's gain moved
+static bool gains_update(void) {
+	bool moved = false;
+
+	for (uint8_t i = 0; i < RUNHOURS_CHANNELS; i++) {
+		uint16_t g = gain_for(i);
+		if (g != gain[i]) {
+			gain[i] = g;
+			moved = true;
+		}
+	}
+	return moved;
+}
+
+static void save(void) {
+	if (!flash_ring_ready(&ring) || !dirty) {
+		return;
+	}
+
+	memset(&pending, 0xFF, sizeof(pending));
+	pending.seq = seq;
+	memcpy(pending.seconds, seconds, sizeof(pending.seconds));
+	memcpy(pending.rated_hours, rated_hours, sizeof(pending.rated_hours));
+	pending.crc = record_crc(&pending);
+
+	if (!flash_ring_append(&ring, &pending)) {
+		return;
+	}
+	dirty = false;
+	since_save_s = 0;
+	seq++;
+}
+
+// Each channel adds its duty, a second's count at full scale
+static void on_tick(void) {
+	bool hour = false;
+
+	for (uint8_t i = 0; i < RUNHOURS_CHANNELS; i++) {
+		part[i] += pca9685_output(i);
+		if (part[i] >= PCA9685_COUNTS) {
+			part[i] -= PCA9685_COUNTS;
+			seconds[i]++;
+			dirty = true;
+			hour |= (seconds[i] % 3600) == 0;
+		}
+	}
+	if (hour && gains_update() && gain_handler != NULL) {
+		gain_handler();
+	}
+	if (++since_save_s >= RUNHOURS_SAVE_S * 1000 / RUNHOURS_TICK_MS) {
+		flash_sched_request(save_job);
+	}
+}
+
+void runhours_init(runhours_gain_handler_t on_gain) {
+	record_t const * p_newest = flash_ring_init(&ring, RUNHOURS_PAGES, sizeof(record_t), record_valid, NULL);
+
+	gain_handler = on_gain;
+	seq = 0;
+	if (ring.registered) {
+		save_job = flash_sched_register(save);
+	}
+	if (p_newest != NULL) {
+		memcpy(seconds, p_newest->seconds, sizeof(seconds));
+		memcpy(rated_hours, p_newest->rated_hours, sizeof(rated_hours));
+		seq = p_newest->seq + 1;
+	}
+	gains_update();
+	tick_register(on_tick, RUNHOURS_TICK_MS, 0);
+}
+
+void runhours_flush(void) {
+	save();
+}
+
+uint32_t runhours_seconds(uint8_t channel) {
+	return (channel < RUNHOURS_CHANNELS) ? seconds[channel] : 0;
+}
+
+bool runhours_set_rated(uint8_t channel, uint32_t hours) {
+	if (channel >= RUNHOURS_CHANNELS) {
+		return false;
+	}
+	if (rated_hours[channel] == hours) {
+		// Controllers set every channel on each connect
+		return true;
+	}
+	rated_hours[channel] = hours;
+	dirty = true;
+	flash_sched_request(save_job);
+	if (gains_update() && gain_handler != NULL) {
+		gain_handler();
+	}
+	return true;
+}
+
+uint16_t runhours_get(uint8_t channel, uint8_t * p_record) {
+	p_record[0] = channel;
+	uint32_encode(seconds[channel], &p_record[1]);
+	uint32_encode(rated_hours[channel], &p_record[5]);
+	uint16_encode(gain[channel], &p_record[9]);
+	return RUNHOURS_RECORD_LEN;
+}
+
+bool runhours_uniform(void) {
+	for (uint8_t i = 1; i < RUNHOURS_CHANNELS; i++) {
+		if (gain[i] != gain[0]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint16_t runhours_apply(uint8_t channel, uint16_t duty) {
+	if (gain[channel] == RUNHOURS_GAIN_ONE) {
+		return duty;
+	}
+	return MIN(((uint32_t)duty * gain[channel]) >> RUNHOURS_GAIN_SHIFT, PCA9685_COUNTS - 1);
+}
+
+uint16_t runhours_apply_fine(uint8_t channel, uint16_t duty) {
+	if (gain[channel] == RUNHOURS_GAIN_ONE) {
+		return duty;
+	}
+	return MIN(((uint32_t)duty * gain[channel]) >> RUNHOURS_GAIN_SHIFT, FINE_MAX);
+}
@@ -0,0 +1,57 @@
+#ifndef _RUNHOURS_H_
+#define _RUNHOURS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pca9685.h"
+
+// Per channel run hours, weighted by the duty each channel drives so an
+// hour at half output counts half, for LEDs losing output as they age.
+// Counted once a second on the shared tick (tick.h) and appended to a
+// ring of flash pages every RUNHOURS_SAVE_S, so a reset loses at most
+// that much.
+//
+// A channel given its rated life, full output hours until it's down to
+// RUNHOURS_RATED_PCT of new (L70), has the loss made up in the output
+// stage: output is taken to fall linearly over the rated life, and the
+// duty is raised by the inverse, up to RUNHOURS_GAIN_MAX. Nothing is
+// raised past full scale, so a channel run flat out just falls off.
+#define RUNHOURS_CHANNELS PCA9685_NUM_LEDS
+#define RUNHOURS_PAGES 2 // Counted in pstorage_platform.h
+#define RUNHOURS_TICK_MS 1000
+#define RUNHOURS_SAVE_S 3600
+#define RUNHOURS_RATED_PCT 70
+
+// Gain is fixed point, RUNHOURS_GAIN_ONE leaves the output alone
+#define RUNHOURS_GAIN_SHIFT 10
+#define RUNHOURS_GAIN_ONE (1 << RUNHOURS_GAIN_SHIFT)
+#define RUNHOURS_GAIN_MAX (RUNHOURS_GAIN_ONE * 3 / 2)
+
+// Bulk record (BULK_CMD_RUN_HOURS, bulk.h): channel (uint8), full
+// output seconds (uint32 LE), rated life in hours (uint32 LE, 0 for no
+// compensation), gain in use (uint16 LE)
+#define RUNHOURS_RECORD_LEN 11
+
+typedef void (*runhours_gain_handler_t)(void);
+
+// Needs pstorage_init() and tick_init(). on_gain runs whenever a
+// channel's gain moves, to put it on the outputs.
+void runhours_init(runhours_gain_handler_t on_gain);
+
+// Write the counts now, ahead of the interval, for when power is going
+void runhours_flush(void);
+
+uint32_t runhours_seconds(uint8_t channel);
+// Rated life to RUNHOURS_RATED_PCT, 0 stops compensating the channel.
+// False for a bad channel.
+bool runhours_set_rated(uint8_t channel, uint32_t hours);
+// Channel's record as laid out above, returns its length
+uint16_t runhours_get(uint8_t channel, uint8_t * p_record);
+
+// True if no channel is compensated, or all by the same gain
+bool runhours_uniform(void);
+// Raise a 12 bit duty, or a 12.4 one for the dithered path
+uint16_t runhours_apply(uint8_t channel, uint16_t duty);
+uint16_t runhours_apply_fine(uint8_t channel, uint16_t duty);
+
+#endif
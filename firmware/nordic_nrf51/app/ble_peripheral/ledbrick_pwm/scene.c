@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "app_util.h"
+#include "pstorage.h"
+#include "ledbrick_flash.h"
+#include "flash_sched.h"
+#include "fade.h"
+#include "scene.h"
+
+// pstorage wants word aligned lengths and buffers
+#define STORE_LEN (((SCENE_STORE_LEN) + 3) & ~3)
+STATIC_ASSERT(STORE_LEN <= FLASH_PAGE_SIZE); // Its one page
+
+static uint32_t scenes_buf[STORE_LEN / 4];
+static uint8_t * const scenes = (uint8_t *)scenes_buf;
+
+static pstorage_handle_t store;
+static uint8_t save_job = FLASH_SCHED_INVALID;
+static uint8_t last_recalled = SCENE_SLOTS - 1;
+
+static uint8_t * slot_data(uint8_t slot) {
+	return &scenes[SCENE_HEADER_LEN + slot * SCENE_SLOT_LEN];
+}
+
+static bool programmed(uint8_t slot) {
+	return uint16_decode(slot_data(slot)) != 0;
+}
+
+static void on_store(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result,
+                     uint8_t * p_data, uint32_t data_len) {
+	// A failed write still leaves the slot usable until the next reset
+}
+
+static void save_run(void) {
+	(void)pstorage_update(&store, scenes, STORE_LEN, 0);
+}
+
+// Updates are written from the live buffer when pstorage gets to them,
+// and held for flash_sched.h, so back to back stores (a controller
+// programming every slot) land in one write
+static bool save(void) {
+	flash_sched_request(save_job);
+	return true;
+}
+
+bool scene_store(uint8_t slot, uint16_t mask, uint16_t const * p_levels, uint16_t fade_ms) {
+	uint8_t data[SCENE_SLOT_LEN];
+
+	if (slot >= SCENE_SLOTS || mask == 0) {
+		return false;
+	}
+	memset(data, 0, sizeof(data));
+	uint16_encode(mask, &data[0]);
+	uint16_encode(fade_ms, &data[2]);
+	for (uint8_t i = 0; i < SCENE_MAX_CHANNELS; i++) {
+		if (mask & (1 << i)) {
+			uint16_encode(p_levels[i], &data[4 + 2*i]);
+		}
+	}
+
+	// Controllers program every slot on each connect, only changes
+	// cost a flash write
+	if (memcmp(slot_data(slot), data, sizeof(data)) == 0) {
+		return true;
+	}
+	memcpy(slot_data(slot), data, sizeof(data));
+	return save();
+}
+
+bool scene_capture(uint8_t slot, uint16_t fade_ms) {
+	uint16_t levels[SCENE_MAX_CHANNELS];
+
+	for (uint8_t i = 0; i < SCENE_MAX_CHANNELS; i++) {
+		levels[i] = fade_target(i);
+	}
+	return scene_store(slot, (1UL << SCENE_MAX_CHANNELS) - 1, levels, fade_ms);
+}
+
+bool scene_clear(uint8_t slot) {
+	if (slot >= SCENE_SLOTS) {
+		return false;
+	}
+	memset(slot_data(slot), 0, SCENE_SLOT_LEN);
+	return save();
+}
+
+bool scene_recall(uint8_t slot) {
+	uint16_t levels[SCENE_MAX_CHANNELS];
+
+	if (slot >= SCENE_SLOTS || !programmed(slot)) {
+		return false;
+	}
+	uint8_t const * p_slot = slot_data(slot);
+	for (uint8_t i = 0; i < SCENE_MAX_CHANNELS; i++) {
+		levels[i] = uint16_decode(&p_slot[4 + 2*i]);
+	}
+	fade_frame(uint16_decode(&p_slot[0]), levels, uint16_decode(&p_slot[2]));
+	last_recalled = slot;
+	return true;
+}
+
+uint8_t scene_next(void) {
+	for (uint8_t i = 1; i <= SCENE_SLOTS; i++) {
+		uint8_t slot = (last_recalled + i) % SCENE_SLOTS;
+		if (programmed(slot)) {
+			return slot;
+		}
+	}
+	return SCENE_SLOTS;
+}
+
+void scene_init(void) {
+	pstorage_module_param_t param = {
+		.cb = on_store,
+		.block_size = STORE_LEN,
+		.block_count = 1,
+	};
+
+	save_job = flash_sched_register(save_run);
+	if (pstorage_register(&param, &store) != NRF_SUCCESS ||
+	    pstorage_load(scenes, &store, STORE_LEN, 0) != NRF_SUCCESS ||
+	    uint16_decode(&scenes[0]) != SCENE_MAGIC) {
+		// Erased flash, or nothing usable
+		memset(scenes, 0, STORE_LEN);
+		uint16_encode(SCENE_MAGIC, &scenes[0]);
+	}
+}
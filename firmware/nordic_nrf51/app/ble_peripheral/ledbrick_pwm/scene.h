@@ -0,0 +1,43 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fade.h"
+
+// Preset output levels kept in flash, so a whole look ("feeding", "photo",
+// "all off") is recalled with one byte instead of every channel. Recall
+// runs as a frame on the fade engine.
+//
+// Stored layout:
+//   0  magic (uint16 LE, SCENE_MAGIC)
+//   2  reserved (uint16)
+//   4  SCENE_SLOTS slots of:
+//        channel mask (uint16 LE), 0 for an empty slot
+//        fade ms (uint16 LE)
+//        one linear level (uint16 LE) per channel, SCENE_MAX_CHANNELS
+#define SCENE_MAGIC 0x5343
+#define SCENE_SLOTS 8
+#define SCENE_MAX_CHANNELS FADE_NUM_CHANNELS
+#define SCENE_SLOT_LEN (4 + 2 * SCENE_MAX_CHANNELS)
+#define SCENE_HEADER_LEN 4
+#define SCENE_STORE_LEN (SCENE_HEADER_LEN + SCENE_SLOTS * SCENE_SLOT_LEN)
+
+// Needs pstorage_init() to have run
+void scene_init(void);
+
+// Program a slot. p_levels is indexed by channel, only entries with their
+// mask bit set are kept. False for a bad slot or an empty mask; the
+// flash write waits for an opening (flash_sched.h).
+bool scene_store(uint8_t slot, uint16_t mask, uint16_t const * p_levels, uint16_t fade_ms);
+// Program a slot with where every channel is headed now
+bool scene_capture(uint8_t slot, uint16_t fade_ms);
+bool scene_clear(uint8_t slot);
+
+// Start the fade to a slot, false if it is empty
+bool scene_recall(uint8_t slot);
+// The programmed slot after the last one recalled, wrapping, for
+// stepping through them from a button. SCENE_SLOTS with none programmed.
+uint8_t scene_next(void);
+
+#endif
@@ -0,0 +1,377 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf_error.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+#include "pstorage.h"
+#include "ledbrick_flash.h"
+#include "clock.h"
+#include "tick.h"
+#include "flash_sched.h"
+#include "fade.h"
+#include "schedule.h"
+
+// pstorage wants word aligned lengths and buffers
+#define STORE_LEN (((SCHEDULE_MAX_LEN) + 3) & ~3)
+STATIC_ASSERT(STORE_LEN <= FLASH_PAGE_SIZE); // Its one page
+
+#define SECONDS_PER_DAY (60UL * SCHEDULE_MINUTES_PER_DAY)
+#define EVAL_S (SCHEDULE_EVAL_MS / 1000)
+
+// The schedule being run, and the flash write source
+static uint32_t active_buf[STORE_LEN / 4];
+static uint8_t * const active = (uint8_t *)active_buf;
+// An upload in progress, copied over active on commit
+static uint32_t staging_buf[STORE_LEN / 4];
+static uint8_t * const staging = (uint8_t *)staging_buf;
+static bool staging_open = false;
+
+static pstorage_handle_t store;
+static bool storing = false;
+static bool unsaved = false;
+// Waiting on flash_sched.h, to write active or to clear
+static bool queued = false;
+static bool clearing = false;
+static uint8_t store_job = FLASH_SCHED_INVALID;
+
+static uint16_t hold_s = 0;
+static bool running = false;
+// Crossfade from the schedule committed over, held in staging until an
+// upload needs it: seconds left, of how many
+static uint16_t blend_s = 0;
+static uint16_t blend_total_s = 0;
+
+static uint8_t task = TICK_INVALID;
+static schedule_status_handler_t status_handler;
+
+static uint16_t points_len(uint8_t const * p_sched) {
+	return p_sched[2] * SCHEDULE_POINT_LEN(p_sched[3]);
+}
+
+static bool valid(uint8_t const * p_sched) {
+	uint8_t count = p_sched[2];
+	uint8_t channels = p_sched[3];
+	uint16_t last = 0;
+
+	if (uint16_decode(&p_sched[0]) != SCHEDULE_MAGIC ||
+	    count == 0 || count > SCHEDULE_MAX_POINTS ||
+	    channels == 0 || channels > SCHEDULE_MAX_CHANNELS) {
+		return false;
+	}
+	if (crc16_compute(&p_sched[SCHEDULE_HEADER_LEN], points_len(p_sched), NULL) !=
+	    uint16_decode(&p_sched[4])) {
+		return false;
+	}
+	// Points have to be in order within one day for the lookup
+	for (uint8_t i = 0; i < count; i++) {
+		uint16_t minute = uint16_decode(&p_sched[SCHEDULE_HEADER_LEN + i * SCHEDULE_POINT_LEN(channels)]);
+		if (minute >= SCHEDULE_MINUTES_PER_DAY || (i > 0 && minute <= last)) {
+			return false;
+		}
+		// And in range for the evaluation's arithmetic
+		for (uint8_t c = 0; c < channels; c++) {
+			if (uint16_decode(&p_sched[SCHEDULE_HEADER_LEN + i * SCHEDULE_POINT_LEN(channels) + 2 + 2*c]) >
+			    SCHEDULE_MAX_LEVEL) {
+				return false;
+			}
+		}
+		last = minute;
+	}
+	return true;
+}
+
+static uint8_t const * point(uint8_t const * p_sched, uint8_t i) {
+	return &p_sched[SCHEDULE_HEADER_LEN + i * SCHEDULE_POINT_LEN(p_sched[3])];
+}
+
+void schedule_curve_at(uint8_t const * p_sched, uint32_t t, uint16_t * p_levels) {
+	uint8_t count = p_sched[2];
+	uint8_t channels = p_sched[3];
+	uint8_t after;
+	uint32_t t_before, t_after, span, elapsed;
+
+	for (after = 0; after < count && uint16_decode(point(p_sched, after)) * 60UL <= t; after++);
+	uint8_t const * p_after = point(p_sched, after % count);
+	uint8_t const * p_before = point(p_sched, (after + count - 1) % count);
+
+	t_before = uint16_decode(p_before) * 60UL;
+	t_after = uint16_decode(p_after) * 60UL;
+	span = (t_after + SECONDS_PER_DAY - t_before) % SECONDS_PER_DAY;
+	elapsed = (t + SECONDS_PER_DAY - t_before) % SECONDS_PER_DAY;
+
+	for (uint8_t i = 0; i < channels; i++) {
+		int32_t lb = uint16_decode(&p_before[2 + 2*i]);
+		int32_t la = uint16_decode(&p_after[2 + 2*i]);
+		// A single point holds all day
+		p_levels[i] = (span == 0) ? lb : lb + ((la - lb) * (int32_t)elapsed) / (int32_t)span;
+	}
+}
+
+void schedule_blend(uint16_t * p_levels, uint8_t channels, uint16_t const * p_before, uint8_t before_channels,
+                    uint32_t done, uint32_t total) {
+	if (done >= total) {
+		return;
+	}
+	for (uint8_t i = 0; i < MIN(channels, before_channels); i++) {
+		int32_t lb = p_before[i];
+		p_levels[i] = lb + (((int32_t)p_levels[i] - lb) * (int32_t)done) / (int32_t)total;
+	}
+}
+
+static void notify(void) {
+	if (status_handler) {
+		status_handler();
+	}
+}
+
+static void evaluate(void) {
+	uint8_t count = active[2];
+	uint8_t channels = active[3];
+	uint16_t levels[FADE_NUM_CHANNELS];
+	uint16_t before[FADE_NUM_CHANNELS];
+	uint32_t t;
+
+	running = clock_is_set() && count > 0 && hold_s == 0;
+	if (!running) {
+		return;
+	}
+
+	// Aim for where the curve will be when this step's fade lands
+	t = (clock_time_of_day() + EVAL_S) % SECONDS_PER_DAY;
+	schedule_curve_at(active, t, levels);
+	if (blend_s > 0) {
+		// Both curves, mixed for how far the crossfade is when this
+		// step lands
+		uint32_t done = blend_total_s - blend_s + EVAL_S;
+		if (done < blend_total_s) {
+			schedule_curve_at(staging, t, before);
+			schedule_blend(levels, channels, before, staging[3], done, blend_total_s);
+		}
+	}
+	fade_frame((1 << channels) - 1, levels, SCHEDULE_EVAL_MS);
+}
+
+static void on_tick(void) {
+	hold_s = (hold_s > EVAL_S) ? hold_s - EVAL_S : 0;
+	blend_s = (blend_s > EVAL_S) ? blend_s - EVAL_S : 0;
+	evaluate();
+	notify();
+}
+
+static void on_store(pstorage_handle_t * p_handle, uint8_t op_code, uint32_t result,
+                     uint8_t * p_data, uint32_t data_len) {
+	storing = false;
+	unsaved = (result != NRF_SUCCESS);
+	notify();
+}
+
+static void store_run(void) {
+	uint32_t err_code;
+
+	if (!queued || storing) {
+		return;
+	}
+	queued = false;
+	err_code = clearing ? pstorage_clear(&store, STORE_LEN) : pstorage_update(&store, active, STORE_LEN, 0);
+	// Still runs from RAM until the next reset if this fails
+	storing = (err_code == NRF_SUCCESS);
+	unsaved = !storing;
+	notify();
+}
+
+// Until the job runs active can still change, and the latest goes
+static void store_queue(bool clear) {
+	queued = true;
+	clearing = clear;
+	unsaved = false;
+	flash_sched_request(store_job);
+}
+
+// Staging is about to take an upload, which ends any crossfade from
+// what it held
+static void staging_take(void) {
+	blend_s = 0;
+}
+
+static bool commit(uint16_t crc, uint16_t crossfade_s) {
+	if (!staging_open || storing) {
+		return false;
+	}
+	uint16_encode(crc, &staging[4]);
+	if (!valid(staging)) {
+		return false;
+	}
+
+	if (crossfade_s > 0 && running) {
+		// The schedule before stays in staging for the crossfade
+		for (uint16_t i = 0; i < STORE_LEN / 4; i++) {
+			uint32_t word = active_buf[i];
+			active_buf[i] = staging_buf[i];
+			staging_buf[i] = word;
+		}
+		blend_s = blend_total_s = MIN(crossfade_s, SCHEDULE_MAX_CROSSFADE_S);
+	} else {
+		memcpy(active, staging, STORE_LEN);
+		blend_s = 0;
+	}
+	staging_open = false;
+	store_queue(false);
+	evaluate();
+	return true;
+}
+
+static bool clear(void) {
+	if (storing) {
+		return false;
+	}
+	memset(active, 0, STORE_LEN);
+	running = false;
+	blend_s = 0;
+	store_queue(true);
+	return true;
+}
+
+bool schedule_write(uint8_t const * p_data, uint16_t len) {
+	bool ok = false;
+
+	if (len == 0) {
+		return false;
+	}
+
+	switch (p_data[0]) {
+	case SCHEDULE_OP_BEGIN:
+		if (len == 3) {
+			staging_take();
+			memset(staging, 0, STORE_LEN);
+			uint16_encode(SCHEDULE_MAGIC, &staging[0]);
+			staging[2] = p_data[1];
+			staging[3] = p_data[2];
+			ok = p_data[1] <= SCHEDULE_MAX_POINTS && p_data[2] <= SCHEDULE_MAX_CHANNELS;
+			staging_open = ok;
+			return ok;
+		}
+		break;
+	case SCHEDULE_OP_EDIT:
+		if (len == 3 && valid(active) && p_data[2] == active[3]) {
+			staging_take();
+			memcpy(staging, active, STORE_LEN);
+			staging[2] = p_data[1];
+			ok = p_data[1] <= SCHEDULE_MAX_POINTS;
+			staging_open = ok;
+			return ok;
+		}
+		break;
+	case SCHEDULE_OP_DATA:
+		if (staging_open && len > 3) {
+			uint16_t offset = uint16_decode(&p_data[1]);
+			if (offset + (len - 3) <= points_len(staging)) {
+				memcpy(&staging[SCHEDULE_HEADER_LEN + offset], &p_data[3], len - 3);
+				return true;
+			}
+		}
+		break;
+	case SCHEDULE_OP_COMMIT:
+		ok = (len == 3 || len == 5) &&
+		     commit(uint16_decode(&p_data[1]), (len == 5) ? uint16_decode(&p_data[3]) : 0);
+		break;
+	case SCHEDULE_OP_CLEAR:
+		ok = (len == 1) && clear();
+		break;
+	default:
+		break;
+	}
+
+	staging_open = false;
+	notify();
+	return ok;
+}
+
+bool schedule_load(uint8_t count, uint8_t channels, uint8_t const * p_points, uint16_t len,
+                   uint16_t crc, uint16_t crossfade_s) {
+	bool ok = false;
+
+	if (count <= SCHEDULE_MAX_POINTS && channels <= SCHEDULE_MAX_CHANNELS &&
+	    len == count * SCHEDULE_POINT_LEN(channels)) {
+		staging_take();
+		memset(staging, 0, STORE_LEN);
+		uint16_encode(SCHEDULE_MAGIC, &staging[0]);
+		staging[2] = count;
+		staging[3] = channels;
+		memcpy(&staging[SCHEDULE_HEADER_LEN], p_points, len);
+		staging_open = true;
+		ok = commit(crc, crossfade_s);
+	}
+
+	staging_open = false;
+	notify();
+	return ok;
+}
+
+void schedule_resync(void) {
+	// Restart the step so evaluation stays aligned with the new clock
+	tick_restart(task);
+	evaluate();
+	notify();
+}
+
+void schedule_hold(void) {
+	hold_s = SCHEDULE_HOLD_S;
+	running = false;
+}
+
+bool schedule_release(void) {
+	hold_s = 0;
+	evaluate();
+	notify();
+	return running;
+}
+
+bool schedule_ahead(uint32_t lead_s, uint16_t * p_levels) {
+	if (!running) {
+		return false;
+	}
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		p_levels[i] = fade_target(i);
+	}
+	schedule_curve_at(active, (clock_time_of_day() + lead_s) % SECONDS_PER_DAY, p_levels);
+	return true;
+}
+
+void schedule_status(uint8_t * p_status) {
+	uint8_t flags = 0;
+
+	if (clock_is_set()) flags |= SCHEDULE_FLAG_TIME;
+	if (running) flags |= SCHEDULE_FLAG_RUNNING;
+	if (hold_s > 0) flags |= SCHEDULE_FLAG_HELD;
+	if (storing || queued) flags |= SCHEDULE_FLAG_STORING;
+	if (unsaved) flags |= SCHEDULE_FLAG_UNSAVED;
+	if (blend_s > 0) flags |= SCHEDULE_FLAG_BLENDING;
+
+	p_status[0] = active[2];
+	p_status[1] = active[3];
+	p_status[2] = active[4];
+	p_status[3] = active[5];
+	p_status[4] = flags;
+	uint16_encode(clock_time_of_day() / 60, &p_status[5]);
+}
+
+void schedule_init(schedule_status_handler_t handler) {
+	pstorage_module_param_t param = {
+		.cb = on_store,
+		.block_size = STORE_LEN,
+		.block_count = 1,
+	};
+
+	status_handler = handler;
+	task = tick_register(on_tick, SCHEDULE_EVAL_MS, 0);
+	store_job = flash_sched_register(store_run);
+
+	if (pstorage_register(&param, &store) != NRF_SUCCESS ||
+	    pstorage_load(active, &store, STORE_LEN, 0) != NRF_SUCCESS ||
+	    !valid(active)) {
+		// Erased flash, or nothing usable
+		memset(active, 0, STORE_LEN);
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fade.h"
+
+// A daily photoperiod kept on the brick so it carries on without the
+// controller. Points are minutes since local midnight with one linear
+// level (0-4095) per channel; levels are interpolated between points,
+// wrapping from the last point of the day to the first.
+//
+// Stored layout (also what is uploaded):
+//   0  magic (uint16 LE, SCHEDULE_MAGIC)
+//   2  point count (uint8)
+//   3  channel count (uint8), channels 0..n-1
+//   4  CRC16 of the points (uint16 LE)
+//   6  points, in time order: minute (uint16 LE), then one level
+//      (uint16 LE) per channel
+#define SCHEDULE_MAGIC 0x534C
+#define SCHEDULE_HEADER_LEN 6
+#define SCHEDULE_MAX_POINTS 24
+#define SCHEDULE_MAX_CHANNELS FADE_NUM_CHANNELS
+#define SCHEDULE_POINT_LEN(channels) (2 + 2 * (channels))
+#define SCHEDULE_MAX_LEN (SCHEDULE_HEADER_LEN + \
+	SCHEDULE_MAX_POINTS * SCHEDULE_POINT_LEN(SCHEDULE_MAX_CHANNELS))
+#define SCHEDULE_MINUTES_PER_DAY 1440
+#define SCHEDULE_MAX_LEVEL 4095
+
+// Evaluation, in integers only so the controller can work out exactly
+// what a brick shows (controller/ble/curve.go, checked against the
+// vectors in controller/ble/testdata/curve.json). At t seconds into the
+// day, with B the last point at or before t (wrapping to the day's last
+// point before the first) and A the one after it (wrapping to the
+// first):
+//   span    = (A.minute*60 - B.minute*60 + 86400) % 86400
+//   elapsed = (t - B.minute*60 + 86400) % 86400
+//   level   = span == 0 ? B.level : B.level + (A.level - B.level) * elapsed / span
+// in signed 32 bits, the division truncating toward zero. Levels are at
+// most SCHEDULE_MAX_LEVEL, so the product can't overflow. While
+// crossfading, with the curve before at level b and the new one at a,
+// done of total seconds in:
+//   level   = b + (a - b) * done / total
+// on the channels both have. Each evaluation aims for where the curve
+// is SCHEDULE_EVAL_MS on, when its fade lands.
+
+// The curve of a schedule as stored, t seconds into the day, one level
+// per channel it has
+void schedule_curve_at(uint8_t const * p_sched, uint32_t t, uint16_t * p_levels);
+// The crossfade above, from p_before to p_levels in place, leaving them
+// once done reaches total
+void schedule_blend(uint16_t * p_levels, uint8_t channels, uint16_t const * p_before, uint8_t before_channels,
+                    uint32_t done, uint32_t total);
+
+// How often the schedule is evaluated, each step fades over the whole
+// interval so the output never visibly steps
+#define SCHEDULE_EVAL_MS 10000
+// Longest crossfade a commit can ask for, an hour
+#define SCHEDULE_MAX_CROSSFADE_S 3600
+// Direct LED, fade or frame commands hold the schedule off this long
+// after the last one, so a live controller keeps full control
+#define SCHEDULE_HOLD_S 60
+
+// Upload operations, the first byte of every write
+typedef enum {
+	SCHEDULE_OP_BEGIN = 1,  // point count (uint8), channel count (uint8)
+	SCHEDULE_OP_DATA,       // offset into the points (uint16 LE), bytes
+	SCHEDULE_OP_COMMIT,     // CRC16 of the points (uint16 LE), validates and stores;
+	                        // then optionally a crossfade (uint16 LE seconds):
+	                        // a running schedule blends from the old curve to
+	                        // the new over it rather than jumping. Another
+	                        // upload starting cuts the crossfade short.
+	SCHEDULE_OP_CLEAR,      // drop the stored schedule
+	SCHEDULE_OP_EDIT,       // point count (uint8), channel count (uint8), as BEGIN but
+	                        // starting from the stored points, so DATA need only
+	                        // carry those that changed; the channels can't change
+} schedule_op_t;
+
+// Status, as read back by the controller:
+//   0  point count (uint8), 0 without a schedule
+//   1  channel count (uint8)
+//   2  CRC16 of the points (uint16 LE)
+//   4  flags (uint8, SCHEDULE_FLAG_*)
+//   5  minute of the day (uint16 LE), valid with SCHEDULE_FLAG_TIME
+#define SCHEDULE_STATUS_LEN 7
+#define SCHEDULE_FLAG_TIME    (1 << 0)  // Clock has been set (clock.h)
+#define SCHEDULE_FLAG_RUNNING (1 << 1)  // Driving the outputs
+#define SCHEDULE_FLAG_HELD    (1 << 2)  // Held off by direct commands
+#define SCHEDULE_FLAG_STORING (1 << 3)  // Flash write in progress
+#define SCHEDULE_FLAG_UNSAVED (1 << 4)  // Last flash write failed, running from RAM
+#define SCHEDULE_FLAG_BLENDING (1 << 5) // Crossfading from the schedule before
+
+// Called whenever the status moves (upload, store, running state)
+typedef void (*schedule_status_handler_t)(void);
+
+// Needs pstorage_init() to have run. Loads any stored schedule, which
+// starts running once the clock has been set.
+void schedule_init(schedule_status_handler_t handler);
+
+// Handle one write of the upload protocol. Returns false if it was
+// malformed or out of sequence, which abandons any upload in progress.
+bool schedule_write(uint8_t const * p_data, uint16_t len);
+// The whole upload in one go, as BEGIN, DATA and COMMIT would do it,
+// crossfading over crossfade_s (0 for none). Also abandons any upload
+// in progress.
+bool schedule_load(uint8_t count, uint8_t channels, uint8_t const * p_points, uint16_t len,
+                   uint16_t crc, uint16_t crossfade_s);
+
+// Re-evaluate straight away after the clock has been set
+void schedule_resync(void);
+// Hold the schedule off for SCHEDULE_HOLD_S
+void schedule_hold(void);
+// End any hold now and run the schedule straight away. Returns false if
+// there is none to run (no schedule, or the clock isn't set).
+bool schedule_release(void);
+
+void schedule_status(uint8_t * p_status);
+
+// Where the running schedule has the outputs lead_s from now, for the
+// fan to get ahead of (fan_control.h). Channels it doesn't drive are
+// left at their targets. Returns false when it isn't running.
+bool schedule_ahead(uint32_t lead_s, uint16_t * p_levels);
+
+#endif
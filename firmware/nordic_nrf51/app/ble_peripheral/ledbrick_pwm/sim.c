@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "sensorsim.h"
+#include "fan_control.h"
+#include "tick.h"
+#include "sim.h"
+
+#if SIM_ENABLED
+
+static sim_sample_handler_t sample_handler;
+static sim_kind_t kind = SIM_OFF;
+static int16_t low, high;
+static sensorsim_cfg_t cfg;
+static sensorsim_state_t state;
+static uint8_t task = TICK_INVALID;
+
+static void on_tick(void) {
+	uint32_t value;
+
+	if (kind == SIM_OFF) {
+		tick_idle(task);
+		return;
+	}
+	value = sensorsim_measure(&state, &cfg);
+	if (kind == SIM_STEP) {
+		// The ramp's upper half is the high step
+		value = (value >= (uint32_t)(low + high) / 2) ? high : low;
+	}
+	sample_handler(true, (int16_t)value);
+}
+
+void sim_init(sim_sample_handler_t handler) {
+	sample_handler = handler;
+	task = tick_register(on_tick, SIM_SAMPLE_MS, 0);
+	tick_idle(task);
+}
+
+bool sim_start(sim_kind_t new_kind, int16_t new_low, int16_t new_high, uint16_t period_min) {
+	uint32_t samples = ((uint32_t)period_min * 60000) / SIM_SAMPLE_STEP_MS;
+
+	if (new_kind >= SIM_COUNT) {
+		return false;
+	}
+	if (new_kind != SIM_OFF && (new_low < 0 || new_high <= new_low || samples < 2)) {
+		return false;
+	}
+	kind = new_kind;
+	tick_wake(task);
+	low = new_low;
+	high = new_high;
+	// Up and back down once a period
+	cfg.min = low;
+	cfg.max = high;
+	cfg.incr = (2 * (uint32_t)(high - low)) / samples;
+	if (cfg.incr == 0) {
+		cfg.incr = 1;
+	}
+	cfg.start_at_max = false;
+	sensorsim_init(&state, &cfg);
+	return true;
+}
+
+bool sim_active(void) {
+	return kind != SIM_OFF;
+}
+
+uint16_t sim_rpm(void) {
+	if (kind == SIM_STALL) {
+		return 0;
+	}
+	return ((uint32_t)SIM_RPM_FULL * fan_control_duty()) / 100;
+}
+
+#endif
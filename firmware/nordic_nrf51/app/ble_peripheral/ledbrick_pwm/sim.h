@@ -0,0 +1,48 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sensor simulation: sensorsim waveforms stand in for the temperature
+// sensor and fan tach, so thermal foldback, the fan loop and error
+// handling can be soaked without heating anything. Off unless built in.
+#ifndef SIM_ENABLED
+#define SIM_ENABLED 0
+#endif
+
+typedef enum {
+	SIM_OFF = 0, // Real sensors
+	SIM_RAMP,    // Temperature ramps low-high-low each period
+	SIM_STEP,    // Temperature holds low then high for half a period each
+	SIM_STALL,   // As ramp, with the fan reading stopped
+	SIM_COUNT
+} sim_kind_t;
+
+// A sample is taken every SIM_SAMPLE_MS and stands for a regular poll,
+// so time runs 50 times fast: a day of temperatures replays in under
+// half an hour. The fan loop and foldback count samples, not time.
+#define SIM_SAMPLE_MS 100
+#define SIM_SAMPLE_STEP_MS 5000
+// Tach reading with the fan flat out, scaled with the duty below that
+#define SIM_RPM_FULL 3000
+
+// Gets each simulated reading, in the main context
+typedef void (*sim_sample_handler_t)(bool success, int16_t temp);
+
+#if SIM_ENABLED
+
+void sim_init(sim_sample_handler_t handler);
+// low and high in 1/16 degree C (non-negative), period_min in simulated
+// minutes. Returns false if out of range.
+bool sim_start(sim_kind_t kind, int16_t low, int16_t high, uint16_t period_min);
+bool sim_active(void);
+uint16_t sim_rpm(void);
+
+#else
+
+static inline bool sim_active(void) { return false; }
+
+#endif
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "app_util.h"
+#include "fade.h"
+#include "clock.h"
+#include "tick.h"
+#include "stream.h"
+
+#define STREAM_PACKED_LEN (STREAM_FRAME_MAX_LEN - STREAM_FRAME_HEADER_LEN)
+
+// A frame waiting for its turn, counted from frame 0 without wrapping
+typedef struct {
+	int32_t turn;  // -1 when empty
+	uint8_t packed[STREAM_PACKED_LEN];
+} stream_slot_t;
+
+static stream_output_t output;
+static uint8_t task = TICK_INVALID;
+static bool active = false;
+static uint32_t start_ms;
+static uint16_t period_ms;
+static uint16_t mask;
+static uint8_t channels;
+// The last turn played, -1 before the first
+static int32_t turn;
+// Turns in a row with nothing to play
+static uint32_t quiet;
+static stream_slot_t slots[STREAM_SLOTS];
+static stream_stats_t stats;
+
+static void slots_clear(void) {
+	for (uint8_t i = 0; i < STREAM_SLOTS; i++) {
+		slots[i].turn = -1;
+	}
+}
+
+static void play(stream_slot_t const * p_slot, uint32_t duration_ms) {
+	uint16_t levels[FADE_NUM_CHANNELS];
+	uint8_t count = 0;
+
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+		uint8_t const * p_pair = &p_slot->packed[(count / 2) * 3];
+		levels[i] = (count % 2 == 0) ? p_pair[0] | ((p_pair[1] & 0x0F) << 8)
+		                             : (p_pair[1] >> 4) | (p_pair[2] << 4);
+		count++;
+	}
+	output(mask, levels, (uint16_t)duration_ms);
+}
+
+// Each turn the frame due is faded to over the period. Turns a late tick
+// stepped over drop the frames they held, and a frame missing takes the
+// period up to the next one held as its fade.
+static void on_tick(void) {
+	uint32_t elapsed;
+	int32_t now;
+	stream_slot_t * p_next = NULL;
+
+	if (!active) {
+		tick_idle(task);
+		return;
+	}
+	elapsed = clock_ms() - start_ms;
+	if ((int32_t)elapsed < 0) {
+		return;
+	}
+	now = (int32_t)(elapsed / period_ms);
+	if (now <= turn) {
+		return;
+	}
+	for (uint8_t i = 0; i < STREAM_SLOTS; i++) {
+		if (slots[i].turn < 0) {
+			continue;
+		}
+		if (slots[i].turn < now) {
+			slots[i].turn = -1;
+			stats.late++;
+		} else if (p_next == NULL || slots[i].turn < p_next->turn) {
+			p_next = &slots[i];
+		}
+	}
+	if (p_next == NULL) {
+		stats.underruns++;
+		quiet += now - turn;
+		turn = now;
+		if (quiet * period_ms >= STREAM_IDLE_MS) {
+			stream_stop();
+		}
+		return;
+	}
+	turn = now;
+	quiet = 0;
+	play(p_next, (uint32_t)(p_next->turn - now + 1) * period_ms);
+	if (p_next->turn == now) {
+		p_next->turn = -1;
+		stats.played++;
+	} else {
+		stats.interpolated++;
+	}
+}
+
+void stream_init(stream_output_t on_output) {
+	output = on_output;
+	slots_clear();
+	task = tick_register(on_tick, TICK_MS, 0);
+	tick_idle(task);
+}
+
+bool stream_start(uint32_t new_start_ms, uint16_t new_period_ms, uint16_t new_mask) {
+	uint32_t elapsed = clock_ms() - new_start_ms;
+	uint8_t count = 0;
+
+	if (new_period_ms == 0) {
+		stream_stop();
+		return true;
+	}
+	if (new_period_ms < STREAM_MIN_PERIOD_MS || new_period_ms > STREAM_MAX_PERIOD_MS ||
+	    new_period_ms % TICK_MS != 0) {
+		return false;
+	}
+	if (new_mask == 0 || (new_mask >> FADE_NUM_CHANNELS) != 0) {
+		return false;
+	}
+	for (uint8_t i = 0; i < FADE_NUM_CHANNELS; i++) {
+		if (new_mask & (1 << i)) {
+			count++;
+		}
+	}
+	if (count > STREAM_MAX_CHANNELS || -(int32_t)elapsed > STREAM_MAX_AHEAD_MS) {
+		return false;
+	}
+	slots_clear();
+	start_ms = new_start_ms;
+	period_ms = new_period_ms;
+	mask = new_mask;
+	channels = count;
+	// Joining a stream already running, frames are taken from the turn
+	// due now
+	turn = ((int32_t)elapsed < 0) ? -1 : (int32_t)(elapsed / period_ms) - 1;
+	quiet = 0;
+	active = true;
+	tick_wake(task);
+	return true;
+}
+
+void stream_stop(void) {
+	active = false;
+	slots_clear();
+}
+
+bool stream_active(void) {
+	return active;
+}
+
+// Frame numbers are taken as the nearest turn to the next one due, so
+// they wrap every 65536 frames without the stream noticing
+bool stream_frame(uint8_t const * p_value, uint8_t len) {
+	uint16_t frame;
+	int32_t base;
+	int32_t at;
+
+	if (!active || len != STREAM_FRAME_HEADER_LEN + (channels * 3 + 1) / 2) {
+		return false;
+	}
+	frame = uint16_decode(p_value);
+	base = turn + 1;
+	at = base + (int16_t)(frame - (uint16_t)base);
+	if (at < base) {
+		stats.late++;
+		return true;
+	}
+	if (at >= base + STREAM_SLOTS) {
+		stats.early++;
+		return true;
+	}
+	slots[at % STREAM_SLOTS].turn = at;
+	memcpy(slots[at % STREAM_SLOTS].packed, &p_value[STREAM_FRAME_HEADER_LEN], len - STREAM_FRAME_HEADER_LEN);
+	return true;
+}
+
+void stream_stats(stream_stats_t * p_stats) {
+	*p_stats = stats;
+}
+
+uint16_t stream_stats_get(uint8_t * p_reply) {
+	uint16_t len = uint32_encode(stats.played, p_reply);
+	uint8_t held = 0;
+
+	len += uint32_encode(stats.late, &p_reply[len]);
+	len += uint32_encode(stats.early, &p_reply[len]);
+	len += uint32_encode(stats.interpolated, &p_reply[len]);
+	len += uint32_encode(stats.underruns, &p_reply[len]);
+	for (uint8_t i = 0; i < STREAM_SLOTS; i++) {
+		if (slots[i].turn >= 0) {
+			held++;
+		}
+	}
+	p_reply[len++] = held;
+	return len;
+}
@@ -0,0 +1,70 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tick.h"
+
+// Frames streamed from the controller for effects driven from outside,
+// synced to music or video, played out at a steady rate whatever the
+// link's jitter. A stream starts with when frame 0 plays in the
+// clock_ms() time base, its period and the channels it carries, then
+// takes numbered frames written ahead without response
+// (LBS_CMD_OP_STREAM_*, ble_lbs.h). They wait in a ring of STREAM_SLOTS
+// for their turn, and at each one the tick fades the outputs to the
+// frame due over the period, so the levels move as smoothly as the frame
+// rate allows. A frame arriving after its turn is dropped. A turn
+// without its frame fades to the next frame held over the gap, which
+// interpolates the ones missing; with no later frame held either (an
+// underrun) the outputs carry on to where they were headed.
+// STREAM_IDLE_MS with nothing to play ends the stream, leaving the
+// levels where they are.
+
+#define STREAM_SLOTS 8
+// Channels one frame write carries, packed to 12 bits
+#define STREAM_MAX_CHANNELS 8
+#define STREAM_FRAME_HEADER_LEN 2
+#define STREAM_FRAME_MAX_LEN (STREAM_FRAME_HEADER_LEN + (STREAM_MAX_CHANNELS * 3 + 1) / 2)
+// Periods are whole ticks, so every turn lands on one
+#define STREAM_MIN_PERIOD_MS TICK_MS
+#define STREAM_MAX_PERIOD_MS 1000
+#define STREAM_IDLE_MS 2000
+// A start further off than this is taken as a stale offset
+#define STREAM_MAX_AHEAD_MS 10000
+
+// Counters since boot, laid out in that order (uint32 LE each) then the
+// frames held now (uint8) for BULK_CMD_STREAM (bulk.h)
+typedef struct {
+	uint32_t played;
+	uint32_t late;          // After their turn, dropped
+	uint32_t early;         // Past the end of the ring, dropped
+	uint32_t interpolated;  // Turns without their frame, faded to a later one
+	uint32_t underruns;     // Turns without any frame held
+} stream_stats_t;
+
+#define STREAM_STATS_LEN 21
+
+// Moves the channels in mask as a frame over duration_ms, levels
+// indexed by channel
+typedef void (*stream_output_t)(uint16_t mask, uint16_t const * p_levels, uint16_t duration_ms);
+
+// After tick_init()
+void stream_init(stream_output_t output);
+
+// Frame 0 plays at start_ms, the rest period_ms apart, each carrying the
+// channels in mask lowest first. A period of 0 ends the stream. Returns
+// false if out of range.
+bool stream_start(uint32_t start_ms, uint16_t period_ms, uint16_t mask);
+void stream_stop(void);
+bool stream_active(void);
+// Frame number (uint16 LE, wrapping) then the stream's channels packed
+// two to three bytes, as in LBS_CMD_OP_FRAME_PACKED. Returns false
+// without a stream or with the wrong number of levels; late and early
+// frames are dropped and counted but not refused.
+bool stream_frame(uint8_t const * p_value, uint8_t len);
+
+void stream_stats(stream_stats_t * p_stats);
+// The stats as laid out above, returning the length
+uint16_t stream_stats_get(uint8_t * p_reply);
+
+#endif
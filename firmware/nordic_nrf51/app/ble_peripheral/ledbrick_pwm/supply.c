@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "tick.h"
+#include "nordic_common.h"
+#include "board_profile.h"
+#include "pca9685.h"
+#include "supply.h"
+
+#define SUPPLY_AIN BOARD_SUPPLY_AIN
+#define DIVIDER_TOP_KOHM BOARD_SUPPLY_TOP_KOHM
+#define DIVIDER_BOTTOM_KOHM BOARD_SUPPLY_BOTTOM_KOHM
+
+// 10 bits against the 1.2 V bandgap with the input scaled by 1/3, so
+// full scale is 3.6 V at the pin. Fits 32 bits for any sane divider.
+#define ADC_FULL_SCALE 1023
+#define ADC_FULL_SCALE_MV 3600
+#define RAW_TO_MV(raw) ((uint32_t)(raw) * ADC_FULL_SCALE_MV * (DIVIDER_TOP_KOHM + DIVIDER_BOTTOM_KOHM) / \
+	(ADC_FULL_SCALE * DIVIDER_BOTTOM_KOHM))
+
+// Samples the supply has to stay above SUPPLY_RESTORE_MV, and ticks
+// after the last power-fail warning, before the load comes back
+#define RESTORE_TICKS (500 / SUPPLY_SAMPLE_MS)
+#define POF_HOLD_TICKS (1000 / SUPPLY_SAMPLE_MS)
+
+static supply_shed_handler_t shed_handler;
+
+static uint16_t last_mv;
+static uint16_t min_mv, max_mv;
+static uint32_t sum_mv;
+static uint16_t samples;
+static uint16_t pof_count, sag_count;
+
+static bool shed;
+static bool sagging;
+static uint8_t good_ticks;
+static uint8_t pof_hold;
+static uint8_t task = TICK_INVALID;
+
+static void shed_set(bool on) {
+	if (on == shed) {
+		return;
+	}
+	shed = on;
+	if (shed_handler != NULL) {
+		shed_handler(on);
+	}
+}
+
+static void sample(uint16_t mv) {
+	last_mv = mv;
+	min_mv = samples == 0 ? mv : MIN(min_mv, mv);
+	max_mv = samples == 0 ? mv : MAX(max_mv, mv);
+	sum_mv += mv;
+	samples++;
+
+	if (mv < SUPPLY_ABSENT_MV) {
+		// Nothing fitted, only the power-fail comparator to go on
+		sagging = false;
+	} else if (mv < SUPPLY_SHED_MV) {
+		if (!sagging && sag_count < UINT16_MAX) {
+			sag_count++;
+		}
+		sagging = true;
+		good_ticks = 0;
+	} else if (mv >= SUPPLY_RESTORE_MV && sagging && ++good_ticks >= RESTORE_TICKS) {
+		sagging = false;
+	}
+}
+
+static bool dark(void) {
+	for (uint8_t led = 0; led < PCA9685_NUM_LEDS; led++) {
+		if (pca9685_output(led) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Read the conversion the last tick started, then start the next. With
+// every output dark there's no load to shed, so sampling stops until
+// one comes on (pca9685_on_lit()), as long as nothing is shed.
+static void on_tick(void) {
+	if (NRF_ADC->EVENTS_END) {
+		NRF_ADC->EVENTS_END = 0;
+		sample(RAW_TO_MV(NRF_ADC->RESULT));
+	}
+	if (pof_hold > 0) {
+		pof_hold--;
+	}
+	shed_set(sagging || pof_hold > 0);
+	if (!shed && dark()) {
+		tick_idle(task);
+		return;
+	}
+	NRF_ADC->TASKS_START = 1;
+}
+
+static void on_lit(void) {
+	tick_wake(task);
+}
+
+void supply_init(supply_shed_handler_t handler) {
+	shed_handler = handler;
+
+	NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) |
+		(ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) |
+		(ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) |
+		(SUPPLY_AIN << ADC_CONFIG_PSEL_Pos) |
+		(ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos);
+	NRF_ADC->EVENTS_END = 0;
+	NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Enabled << ADC_ENABLE_ENABLE_Pos;
+
+	// 2.7 V leaves the most time before the brownout reset at 1.9 V
+	(void)sd_power_pof_threshold_set(NRF_POWER_THRESHOLD_V27);
+	(void)sd_power_pof_enable(1);
+
+	task = tick_register(on_tick, SUPPLY_SAMPLE_MS, 0);
+	pca9685_on_lit(on_lit);
+	NRF_ADC->TASKS_START = 1;
+}
+
+void supply_on_sys_evt(uint32_t sys_evt) {
+	if (sys_evt != NRF_EVT_POWER_FAILURE_WARNING) {
+		return;
+	}
+	if (pof_count < UINT16_MAX) {
+		pof_count++;
+	}
+	pof_hold = POF_HOLD_TICKS;
+	shed_set(true);
+	tick_wake(task);
+}
+
+uint16_t supply_mv(void) {
+	return last_mv;
+}
+
+bool supply_shed(void) {
+	return shed;
+}
+
+uint16_t supply_window(uint8_t * p_data) {
+	uint16_t mean = samples ? sum_mv / samples : 0;
+
+	p_data[0] = last_mv & 0xFF;
+	p_data[1] = last_mv >> 8;
+	p_data[2] = min_mv & 0xFF;
+	p_data[3] = min_mv >> 8;
+	p_data[4] = max_mv & 0xFF;
+	p_data[5] = max_mv >> 8;
+	p_data[6] = mean & 0xFF;
+	p_data[7] = mean >> 8;
+	p_data[8] = pof_count & 0xFF;
+	p_data[9] = pof_count >> 8;
+	p_data[10] = sag_count & 0xFF;
+	p_data[11] = sag_count >> 8;
+	p_data[12] = (last_mv >= SUPPLY_ABSENT_MV ? SUPPLY_FLAG_PRESENT : 0) |
+		(shed ? SUPPLY_FLAG_SHED : 0);
+
+	samples = 0;
+	sum_mv = 0;
+	return SUPPLY_LEN;
+}
@@ -0,0 +1,41 @@
+#ifndef _SUPPLY_H_
+#define _SUPPLY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// LED supply, sampled on the ADC through a divider, plus the chip's own
+// power-fail comparator on VDD. Either one failing sheds the LED load
+// and saves the output levels while there's still time.
+
+// How often the divider is sampled while any output is lit. Each sample
+// is started one tick and read the next, so the ADC is never waited on.
+#define SUPPLY_SAMPLE_MS 20
+// Below this the supply is sagging and the load is shed, it comes back
+// once the supply has recovered past the restore level for a whole
+// window. Readings under SUPPLY_ABSENT_MV mean no divider is fitted.
+#define SUPPLY_SHED_MV 20000
+#define SUPPLY_RESTORE_MV 22000
+#define SUPPLY_ABSENT_MV 3000
+
+// Supply characteristic: the last reading, the lowest, highest and mean
+// over the last window (mV, uint16 LE each), VDD power-fail warnings and
+// supply sags since boot (uint16 LE each, saturating), then flags
+// (uint8, SUPPLY_FLAG_*). A window is one supply_window() call.
+#define SUPPLY_LEN 13
+#define SUPPLY_FLAG_PRESENT (1 << 0) // Divider reads something
+#define SUPPLY_FLAG_SHED    (1 << 1) // LED load held off
+
+typedef void (*supply_shed_handler_t)(bool shed);
+
+// Called from the main context whenever shedding starts or ends
+void supply_init(supply_shed_handler_t handler);
+// From the SoftDevice system events, for the power-fail warning
+void supply_on_sys_evt(uint32_t sys_evt);
+
+uint16_t supply_mv(void);
+bool supply_shed(void);
+// Returns the length written, SUPPLY_LEN, and starts a new window
+uint16_t supply_window(uint8_t * p_data);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "app_util.h"
+#include "app_timer.h"
+#include "clock.h"
+#include "pool.h"
+#include "sync_apply.h"
+
+typedef struct {
+	uint32_t at_ms;
+	uint16_t len;
+	uint8_t records[SYNC_APPLY_MAX_LEN];
+} slot_t;
+
+STATIC_ASSERT(sizeof(slot_t) <= POOL_LARGE_SIZE);
+
+// Staged commands, each in a block of the large pool until it runs
+static slot_t * slots[SYNC_APPLY_SLOTS];
+static sync_apply_handler_t run_handler;
+static sync_apply_stats_t stats;
+static app_timer_id_t timer;
+
+static int32_t until(uint32_t at_ms) {
+	return (int32_t)(at_ms - clock_ms());
+}
+
+// Run whatever is due, then set the RTC compare for the next one.
+// Several slots due at once run in the order they were staged.
+static void service(void) {
+	slot_t * p_next = NULL;
+
+	app_timer_stop(timer);
+	for (uint8_t i = 0; i < SYNC_APPLY_SLOTS; i++) {
+		slot_t * p_slot = slots[i];
+		if (p_slot == NULL) {
+			continue;
+		}
+		if (until(p_slot->at_ms) <= 0) {
+			slots[i] = NULL;
+			run_handler(p_slot->records, p_slot->len);
+			pool_free(POOL_LARGE, p_slot);
+		} else if (p_next == NULL || (int32_t)(p_slot->at_ms - p_next->at_ms) < 0) {
+			p_next = p_slot;
+		}
+	}
+	if (p_next != NULL) {
+		uint32_t ticks = APP_TIMER_TICKS(until(p_next->at_ms), 0);
+		// app_timer won't take fewer than APP_TIMER_MIN_TIMEOUT_TICKS
+		app_timer_start(timer, MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
+	}
+}
+
+static void on_timer(void * p_context) {
+	service();
+}
+
+bool sync_apply_stage(uint32_t at_ms, uint8_t const * p_records, uint16_t len) {
+	int32_t ahead = until(at_ms);
+
+	if (ahead > SYNC_APPLY_MAX_AHEAD_MS || len > SYNC_APPLY_MAX_LEN) {
+		stats.rejected++;
+		return false;
+	}
+	if (ahead <= 0) {
+		stats.late++;
+		run_handler(p_records, len);
+		return true;
+	}
+	for (uint8_t i = 0; i < SYNC_APPLY_SLOTS; i++) {
+		if (slots[i] == NULL) {
+			slot_t * p_slot = pool_alloc(POOL_LARGE);
+			if (p_slot == NULL) {
+				break;
+			}
+			p_slot->at_ms = at_ms;
+			p_slot->len = len;
+			memcpy(p_slot->records, p_records, len);
+			slots[i] = p_slot;
+			stats.staged++;
+			service();
+			return true;
+		}
+	}
+	stats.rejected++;
+	return false;
+}
+
+void sync_apply_stats(sync_apply_stats_t * p_stats) {
+	*p_stats = stats;
+}
+
+void sync_apply_init(sync_apply_handler_t handler) {
+	run_handler = handler;
+	memset(slots, 0, sizeof(slots));
+	memset(&stats, 0, sizeof(stats));
+	app_timer_create(&timer, APP_TIMER_MODE_SINGLE_SHOT, on_timer);
+}
@@ -0,0 +1,33 @@
+#ifndef _SYNC_APPLY_H_
+#define _SYNC_APPLY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Commands held until a moment in the clock_ms() time base, so bricks
+// written one after another on their own connections all change at
+// once. The controller converts its apply time into each brick's base
+// from the sync characteristic (ble_lbs.h).
+
+// Each staged command takes a block of the large pool (pool.h)
+#define SYNC_APPLY_SLOTS 4
+#define SYNC_APPLY_MAX_LEN 64
+// Further ahead than this is taken as a stale offset and rejected
+#define SYNC_APPLY_MAX_AHEAD_MS 60000
+
+// Runs staged records when they come due
+typedef void (*sync_apply_handler_t)(uint8_t const * p_records, uint16_t len);
+
+typedef struct {
+	uint32_t staged;
+	uint32_t late;      // Due on arrival, run straight away
+	uint32_t rejected;  // Too far ahead, too long or no free slot
+} sync_apply_stats_t;
+
+void sync_apply_init(sync_apply_handler_t handler);
+
+// Hold records until at_ms. Records already due run before this returns.
+bool sync_apply_stage(uint32_t at_ms, uint8_t const * p_records, uint16_t len);
+void sync_apply_stats(sync_apply_stats_t * p_stats);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nordic_common.h"
+#include "cpu_stats.h"
+#include "tick.h"
+
+#define TICK_RTC APP_TIMER_TICKS(TICK_MS, 0)
+#define RTC_MASK 0x00FFFFFF
+#define MAX_SLEEP (TICK_MAX_SLEEP_MS / TICK_MS)
+#define HOUR_TICKS (3600000UL / TICK_MS)
+
+// Whole sleeps stay well inside the half counter app_timer takes
+STATIC_ASSERT((uint64_t)MAX_SLEEP * TICK_RTC < RTC_MASK / 2);
+
+typedef struct {
+	tick_handler_t handler;
+	uint32_t period; // Ticks
+	uint32_t phase;  // Ticks past a multiple of the period
+	uint32_t next;   // Tick count it is next due at
+	bool idle;
+} task_t;
+
+static app_timer_id_t timer;
+static bool started = false;
+static task_t tasks[TICK_MAX_TASKS];
+static uint8_t task_count;
+// Tick count as of the last wakeup, the RTC count it was due at, and
+// ticks on from it the timer is set for, 0 while handlers run
+static uint32_t now;
+static uint32_t base;
+static uint32_t armed;
+
+static volatile uint32_t wakeups;
+static volatile uint32_t hour_wakeups;
+static uint32_t last_hour_wakeups;
+static uint32_t hour_start;
+static bool hour_done = false;
+
+static uint32_t ticks(uint32_t ms) {
+	return (ms / TICK_MS) ? (ms / TICK_MS) : 1;
+}
+
+// The first tick after from that sits on the task's phase
+static uint32_t next_after(task_t const * p_task, uint32_t from) {
+	uint32_t next = from - from % p_task->period + p_task->phase;
+
+	if ((int32_t)(next - from) <= 0) {
+		next += p_task->period;
+	}
+	return next;
+}
+
+// The tick count now, between wakeups. Called with interrupts held off.
+static uint32_t current(void) {
+	uint32_t cnt;
+
+	if (!started) {
+		return now;
+	}
+	app_timer_cnt_get(&cnt);
+	return now + ((cnt - base) & RTC_MASK) / TICK_RTC;
+}
+
+// Set the timer for the earliest task due. Called with interrupts held
+// off.
+static void arm(void) {
+	uint32_t gap = MAX_SLEEP;
+	uint32_t cnt, timeout;
+
+	for (uint8_t i = 0; i < task_count; i++) {
+		if (!tasks[i].idle) {
+			int32_t d = (int32_t)(tasks[i].next - now);
+			gap = MIN(gap, (uint32_t)MAX(d, 1));
+		}
+	}
+	armed = gap;
+	app_timer_cnt_get(&cnt);
+	timeout = (base + gap * TICK_RTC - cnt) & RTC_MASK;
+	// Already past it, the sleeps after catch up
+	if (timeout > gap * TICK_RTC || timeout < APP_TIMER_MIN_TIMEOUT_TICKS) {
+		timeout = APP_TIMER_MIN_TIMEOUT_TICKS;
+	}
+	app_timer_start(timer, timeout, NULL);
+}
+
+// Bring the timer in if a task is now due before it. Called with
+// interrupts held off.
+static void rearm(task_t const * p_task) {
+	if (started && armed != 0 && !p_task->idle && (int32_t)(p_task->next - now) < (int32_t)armed) {
+		app_timer_stop(timer);
+		arm();
+	}
+}
+
+static void count_wakeup(void) {
+	wakeups++;
+	hour_wakeups++;
+}
+
+static void on_timer(void * p_context) {
+	cpu_mark_t mark = cpu_begin();
+
+	CRITICAL_REGION_ENTER();
+	now += armed;
+	base = (base + armed * TICK_RTC) & RTC_MASK;
+	armed = 0;
+	count_wakeup();
+	if (now - hour_start >= HOUR_TICKS) {
+		last_hour_wakeups = hour_wakeups;
+		hour_wakeups = 0;
+		hour_start = now;
+		hour_done = true;
+	}
+	CRITICAL_REGION_EXIT();
+
+	for (uint8_t i = 0; i < task_count; i++) {
+		task_t * p_task = &tasks[i];
+		bool due;
+
+		CRITICAL_REGION_ENTER();
+		due = !p_task->idle && (int32_t)(now - p_task->next) >= 0;
+		if (due) {
+			p_task->next = next_after(p_task, now);
+		}
+		CRITICAL_REGION_EXIT();
+		if (due) {
+			p_task->handler();
+		}
+	}
+
+	CRITICAL_REGION_ENTER();
+	arm();
+	CRITICAL_REGION_EXIT();
+	cpu_end(CPU_TIMER, mark);
+}
+
+void tick_init(void) {
+	app_timer_create(&timer, APP_TIMER_MODE_SINGLE_SHOT, on_timer);
+	CRITICAL_REGION_ENTER();
+	app_timer_cnt_get(&base);
+	started = true;
+	arm();
+	CRITICAL_REGION_EXIT();
+}
+
+uint8_t tick_register(tick_handler_t handler, uint32_t period_ms, uint32_t phase_ms) {
+	task_t * p_task;
+	uint8_t id;
+
+	if (task_count == TICK_MAX_TASKS) {
+		return TICK_INVALID;
+	}
+	p_task = &tasks[task_count];
+	p_task->handler = handler;
+	p_task->period = ticks(period_ms);
+	p_task->phase = (phase_ms / TICK_MS) % p_task->period;
+	p_task->idle = false;
+	CRITICAL_REGION_ENTER();
+	p_task->next = next_after(p_task, current());
+	id = task_count++;
+	rearm(p_task);
+	CRITICAL_REGION_EXIT();
+	return id;
+}
+
+void tick_restart(uint8_t id) {
+	if (id < task_count) {
+		CRITICAL_REGION_ENTER();
+		tasks[id].next = current() + tasks[id].period;
+		rearm(&tasks[id]);
+		CRITICAL_REGION_EXIT();
+	}
+}
+
+void tick_idle(uint8_t id) {
+	if (id < task_count) {
+		// The timer runs out as set, one wakeup at most for nothing
+		tasks[id].idle = true;
+	}
+}
+
+void tick_wake(uint8_t id) {
+	if (id < task_count && tasks[id].idle) {
+		CRITICAL_REGION_ENTER();
+		tasks[id].idle = false;
+		tasks[id].next = next_after(&tasks[id], current());
+		rearm(&tasks[id]);
+		CRITICAL_REGION_EXIT();
+	}
+}
+
+void tick_note_wakeup(void) {
+	CRITICAL_REGION_ENTER();
+	count_wakeup();
+	CRITICAL_REGION_EXIT();
+}
+
+uint32_t tick_wakeups_hour(void) {
+	uint32_t n, elapsed;
+
+	CRITICAL_REGION_ENTER();
+	n = hour_done ? last_hour_wakeups : hour_wakeups;
+	elapsed = current() - hour_start;
+	CRITICAL_REGION_EXIT();
+	if (hour_done) {
+		return n;
+	}
+	return elapsed ? (uint32_t)((uint64_t)n * HOUR_TICKS / elapsed) : 0;
+}
+
+uint32_t tick_wakeups(void) {
+	return wakeups;
+}
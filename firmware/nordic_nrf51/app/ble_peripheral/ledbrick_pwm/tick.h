@@ -0,0 +1,55 @@
+#ifndef _TICK_H_
+#define _TICK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Periodic work on one shared app_timer, so tasks due together take one
+// RTC wakeup and there's one timer in the queue instead of one each.
+// Handlers run in the main context, in registration order.
+//
+// The timer isn't left repeating every tick: it's set for the earliest
+// task due, so a task with a long period costs nothing in between, and
+// one with nothing to do (an engine with no effect running, a bus with
+// nothing queued) takes itself out with tick_idle() until whatever
+// gives it work calls tick_wake(). With every engine idle and the
+// outputs still, the CPU sleeps from one long period task to the next,
+// TICK_MAX_SLEEP_MS at the most. Sleeps are counted from where the last
+// was due, not from when it was handled, so a late handler doesn't push
+// the rest out.
+//
+// Fades and dither run on timers of their own, started only while they
+// move (fade.h) and counted here with tick_note_wakeup().
+
+#define TICK_MS 20
+#define TICK_MAX_TASKS 20 // main.c counts what its build registers against it
+#define TICK_INVALID 0xFF
+#define TICK_MAX_SLEEP_MS 60000
+
+typedef void (*tick_handler_t)(void);
+
+// After app_timer is up
+void tick_init(void);
+
+// Runs handler every period_ms (rounded down to ticks, at least one), on
+// the ticks where the count since boot is phase_ms past a multiple of
+// the period. Tasks sharing a period can be given different phases to
+// spread the work out. Returns a task id, or TICK_INVALID when full.
+uint8_t tick_register(tick_handler_t handler, uint32_t period_ms, uint32_t phase_ms);
+// Start the task's period over from now, for work that has to line up
+// with something other than boot (a clock set)
+void tick_restart(uint8_t id);
+// Leave the task out until tick_wake(), from its own handler or
+// anywhere else. Waking it puts it back on its next period tick, its
+// phase kept. Both take interrupt context.
+void tick_idle(uint8_t id);
+void tick_wake(uint8_t id);
+
+// Another timer's wakeup, for the count
+void tick_note_wakeup(void);
+// Wakeups in the last whole hour, or the first hour's so far scaled to
+// one, and since boot
+uint32_t tick_wakeups_hour(void);
+uint32_t tick_wakeups(void);
+
+#endif
@@ -0,0 +1,60 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util_platform.h"
+#include "clock.h"
+#include "trace.h"
+
+typedef enum {
+	TRACE_IDLE = 0,
+	TRACE_PENDING,  // Received, waiting on the commit
+	TRACE_DONE,     // Committed, waiting on trace_take()
+} trace_state_t;
+
+static volatile trace_state_t state;
+static uint8_t seq;
+static uint32_t received_ms;
+static uint32_t commit_ms;
+
+void trace_received(uint8_t write_seq) {
+	uint32_t now = clock_ms();
+
+	// Replacing any gone stale, a done one included if its event was lost
+	CRITICAL_REGION_ENTER();
+	if (state == TRACE_IDLE || now - received_ms > TRACE_MAX_MS) {
+		seq = write_seq;
+		received_ms = now;
+		state = TRACE_PENDING;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+bool trace_committed(void) {
+	uint32_t now;
+
+	if (state != TRACE_PENDING) {
+		return false;
+	}
+	now = clock_ms();
+	if (now - received_ms > TRACE_MAX_MS) {
+		state = TRACE_IDLE;
+		return false;
+	}
+	commit_ms = now;
+	state = TRACE_DONE;
+	return true;
+}
+
+bool trace_take(uint8_t * p_seq, uint32_t * p_received_ms, uint16_t * p_commit_ms) {
+	bool done;
+
+	CRITICAL_REGION_ENTER();
+	done = state == TRACE_DONE;
+	if (done) {
+		*p_seq = seq;
+		*p_received_ms = received_ms;
+		*p_commit_ms = (uint16_t)(commit_ms - received_ms);
+		state = TRACE_IDLE;
+	}
+	CRITICAL_REGION_EXIT();
+	return done;
+}
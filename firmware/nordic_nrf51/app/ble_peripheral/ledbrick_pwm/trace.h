@@ -0,0 +1,28 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Command latency tracing. The first command write to change the outputs
+// after the last trace went out is stamped, clock_ms(), as it arrives,
+// and again as the PCA9685 frame it made commits on every device. The
+// controller numbers and times its writes, so the sequence number and
+// the two stamps echoed in the ack (ble_lbs.h) split each trace into the
+// link, the brick and the whole. Writes arriving while one is traced go
+// out in the same or a later commit and aren't traced themselves.
+//
+// A trace that sees no commit in TRACE_MAX_MS, its write having changed
+// nothing, is dropped, so some later write's frame is never taken for it.
+#define TRACE_MAX_MS 1000
+
+// A write that changes the outputs has run
+void trace_received(uint8_t seq);
+// From the TWI interrupt, with every device's frame committed. True when
+// it completes a trace, for trace_take() in the main loop.
+bool trace_committed(void);
+// The completed trace, if there is one: the write, when it arrived and
+// ms from then to its commit
+bool trace_take(uint8_t * p_seq, uint32_t * p_received_ms, uint16_t * p_commit_ms);
+
+#endif
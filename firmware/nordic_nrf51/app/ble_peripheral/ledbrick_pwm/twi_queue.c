@@ -0,0 +1,418 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "nrf.h"
+#include "nrf_drv_twi.h"
+#include "nrf_delay.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "watchdog.h"
+#include "latency.h"
+#include "cpu_stats.h"
+#include "radio_idle.h"
+#include "dlog.h"
+#include "pool.h"
+#include "tick.h"
+#include "twi_queue.h"
+
+#define QUEUE_MASK (TWI_QUEUE_SIZE - 1)
+
+STATIC_ASSERT(sizeof(twi_job_t) <= POOL_SMALL_SIZE);
+
+static const nrf_drv_twi_t twi = NRF_DRV_TWI_INSTANCE(1);
+
+// Jobs in order, each in a block of the small pool until it completes
+static twi_job_t * jobs[TWI_QUEUE_SIZE];
+static volatile uint8_t head = 0; // Job currently on the bus
+static volatile uint8_t tail = 0; // Next free slot
+// Most jobs queued at once, the one on the bus included
+static uint8_t peak = 0;
+static volatile bool busy = false;
+static uint32_t job_started;
+static bool enabled = false;
+// The job at head is waiting on radio_idle.h, and a flush won't wait
+static volatile bool parked = false;
+static volatile bool flushing = false;
+
+static const nrf_twi_frequency_t speed_freq[] = {
+	NRF_TWI_FREQ_100K,
+	NRF_TWI_FREQ_250K,
+	NRF_TWI_FREQ_400K,
+};
+static const uint16_t speed_khz[] = { 100, 250, 400 };
+
+typedef struct {
+	twi_speed_t preferred;
+	twi_speed_t current;
+	uint8_t errors;
+} class_speed_t;
+
+static class_speed_t speeds[TWI_CLASS_COUNT] = {
+	[TWI_CLASS_CONFIG] = { TWI_QUEUE_SPEED_CONFIG, TWI_QUEUE_SPEED_CONFIG, 0 },
+	[TWI_CLASS_FRAME]  = { TWI_QUEUE_SPEED_FRAME,  TWI_QUEUE_SPEED_FRAME,  0 },
+	[TWI_CLASS_SENSOR] = { TWI_QUEUE_SPEED_SENSOR, TWI_QUEUE_SPEED_SENSOR, 0 },
+};
+static twi_speed_t bus_speed = TWI_SPEED_100K;
+static twi_class_stats_t stats[TWI_CLASS_COUNT];
+static twi_device_stats_t device_stats[TWI_QUEUE_DEVICES];
+static uint8_t devices_seen = 0;
+static uint32_t recoveries = 0;
+
+// Health: the job on the bus at the last tick, and what went wrong since
+static uint8_t tick_head;
+static bool tick_busy = false;
+static volatile bool lost = false;
+static volatile bool recovered = false;
+static twi_queue_resync_t resync;
+static uint16_t resync_backoff_ms = 0;
+static uint16_t resync_wait_ms = 0;
+static uint8_t health_task = TICK_INVALID;
+
+#define STALL_POLL_US 100
+
+static void job_finish(bool success);
+
+// Counts for address, NULL once the table is full of others. From the
+// TWI interrupt and thread mode both.
+static twi_device_stats_t * device_of(uint8_t address) {
+	for (uint8_t i = 0; i < devices_seen; i++) {
+		if (device_stats[i].address == address) {
+			return &device_stats[i];
+		}
+	}
+	if (devices_seen == TWI_QUEUE_DEVICES) {
+		return NULL;
+	}
+	device_stats[devices_seen].address = address;
+	return &device_stats[devices_seen++];
+}
+
+static void device_count(uint8_t address, uint32_t error_src, bool timeout) {
+	CRITICAL_REGION_ENTER();
+	twi_device_stats_t * p_dev = device_of(address);
+	if (p_dev != NULL) {
+		p_dev->address_nack += (error_src & NRF_TWI_ERROR_ADDRESS_NACK) != 0;
+		p_dev->data_nack += (error_src & NRF_TWI_ERROR_DATA_NACK) != 0;
+		p_dev->overrun += (error_src & NRF_TWI_ERROR_OVERRUN_NACK) != 0;
+		p_dev->timeout += timeout;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+// Nine clocks a byte, address bytes included
+static uint32_t job_us(twi_job_t const * p_job, twi_speed_t speed) {
+	uint32_t bytes = p_job->tx_len + (p_job->tx_len > 0) + p_job->rx_len + (p_job->rx_len > 0);
+
+	return bytes * 9 * 1000 / speed_khz[speed];
+}
+
+static void job_run(void) {
+	twi_job_t const * p_job = jobs[head & QUEUE_MASK];
+	twi_speed_t speed = speeds[p_job->xfer_class].current;
+	ret_code_t err_code;
+
+	job_started = latency_start();
+	if (!enabled) {
+		nrf_drv_twi_enable(&twi);
+		enabled = true;
+	}
+	// The bus is idle between jobs, so the clock can change here
+	if (speed != bus_speed) {
+		nrf_twi_frequency_set(twi.p_reg, speed_freq[speed]);
+		bus_speed = speed;
+	}
+
+	if (p_job->tx_len > 0) {
+		// Hold the bus for a repeated start if a read follows
+		err_code = nrf_drv_twi_tx(&twi, p_job->address, p_job->p_tx, p_job->tx_len,
+		                          p_job->rx_len > 0);
+	} else {
+		err_code = nrf_drv_twi_rx(&twi, p_job->address, p_job->p_rx, p_job->rx_len, false);
+	}
+
+	if (err_code != NRF_SUCCESS) {
+		job_finish(false);
+	}
+}
+
+static void job_start(void) {
+	twi_job_t const * p_job = jobs[head & QUEUE_MASK];
+	uint32_t us = job_us(p_job, speeds[p_job->xfer_class].current);
+
+	if (p_job->xfer_class == TWI_CLASS_FRAME && us >= TWI_QUEUE_RADIO_MIN_US &&
+	    !flushing && !radio_idle_fits(us)) {
+		// Still busy, so submits queue up behind it
+		parked = true;
+		return;
+	}
+	job_run();
+}
+
+void twi_queue_radio_idle(void) {
+	bool start;
+
+	CRITICAL_REGION_ENTER();
+	start = parked;
+	parked = false;
+	CRITICAL_REGION_EXIT();
+
+	// Straight after an event is as good as it gets
+	if (start) {
+		job_run();
+	}
+}
+
+static void speed_account(twi_class_t xfer_class, bool success) {
+	class_speed_t * p_speed = &speeds[xfer_class];
+
+	if (success) {
+		p_speed->errors = 0;
+	} else if (++p_speed->errors >= TWI_QUEUE_FALLBACK_ERRORS) {
+		p_speed->errors = 0;
+		if (p_speed->current > TWI_SPEED_100K) {
+			p_speed->current--;
+		}
+	}
+}
+
+static void job_finish(bool success) {
+	twi_job_t * p_block = jobs[head & QUEUE_MASK];
+	twi_job_t job = *p_block;
+	bool more;
+
+	pool_free(POOL_SMALL, p_block);
+
+	latency_record(LATENCY_TWI, job_started);
+	speed_account(job.xfer_class, success);
+	stats[job.xfer_class].jobs++;
+	stats[job.xfer_class].failed += !success;
+	if (!success) {
+		dlog(DLOG_TWI_FAILED, job.xfer_class, job.address);
+		lost = true;
+	}
+	stats[job.xfer_class].bytes += job.tx_len + (job.tx_len > 0) + job.rx_len + (job.rx_len > 0);
+	// Failed jobs count too, only a bus that stops completing is stuck
+	watchdog_feed(WATCHDOG_TWI);
+
+	CRITICAL_REGION_ENTER();
+	head++;
+	more = (head != tail);
+	busy = more;
+#if TWI_QUEUE_IDLE_DISABLE
+	// A submit from the callback enables it again in job_start()
+	if (!more) {
+		nrf_drv_twi_disable(&twi);
+		enabled = false;
+	}
+#endif
+	CRITICAL_REGION_EXIT();
+
+	if (job.callback) {
+		job.callback(&job, success);
+	}
+	if (more) {
+		job_start();
+	}
+}
+
+static void twi_handler(nrf_drv_twi_evt_t * p_event) {
+	twi_job_t const * p_job = jobs[head & QUEUE_MASK];
+	cpu_mark_t mark = cpu_begin();
+
+	switch (p_event->type) {
+	case NRF_DRV_TWI_TX_DONE:
+		if (p_job->rx_len > 0) {
+			if (nrf_drv_twi_rx(&twi, p_job->address, p_job->p_rx, p_job->rx_len, false) != NRF_SUCCESS) {
+				job_finish(false);
+			}
+		} else {
+			job_finish(true);
+		}
+		break;
+	case NRF_DRV_TWI_RX_DONE:
+		job_finish(true);
+		break;
+	case NRF_DRV_TWI_ERROR:
+		device_count(p_job->address, p_event->error_src, false);
+		job_finish(false);
+		break;
+	default:
+		job_finish(false);
+		break;
+	}
+	cpu_end(CPU_TWI, mark);
+}
+
+bool twi_queue_submit(twi_job_t const * p_job) {
+	twi_job_t * p_block = pool_alloc(POOL_SMALL);
+	bool start = false;
+	bool queued = false;
+
+	if (p_block == NULL) {
+		return false;
+	}
+	*p_block = *p_job;
+
+	CRITICAL_REGION_ENTER();
+	if ((uint8_t)(tail - head) < TWI_QUEUE_SIZE) {
+		jobs[tail & QUEUE_MASK] = p_block;
+		tail++;
+		queued = true;
+		if ((uint8_t)(tail - head) > peak) {
+			peak = tail - head;
+		}
+		if (!busy) {
+			busy = true;
+			start = true;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (!queued) {
+		pool_free(POOL_SMALL, p_block);
+	}
+	if (start) {
+		tick_wake(health_task);
+		job_start();
+	}
+	return queued;
+}
+
+bool twi_queue_idle(void) {
+	return !busy;
+}
+
+void twi_queue_set_speed(twi_class_t xfer_class, twi_speed_t speed) {
+	CRITICAL_REGION_ENTER();
+	speeds[xfer_class].preferred = speed;
+	speeds[xfer_class].current = speed;
+	speeds[xfer_class].errors = 0;
+	CRITICAL_REGION_EXIT();
+}
+
+twi_speed_t twi_queue_speed(twi_class_t xfer_class) {
+	return speeds[xfer_class].current;
+}
+
+void twi_queue_stats(twi_class_t xfer_class, twi_class_stats_t * p_stats) {
+	CRITICAL_REGION_ENTER();
+	*p_stats = stats[xfer_class];
+	CRITICAL_REGION_EXIT();
+}
+
+uint8_t twi_queue_peak(void) {
+	return peak;
+}
+
+bool twi_queue_device_stats(uint8_t index, twi_device_stats_t * p_stats) {
+	bool valid;
+
+	CRITICAL_REGION_ENTER();
+	valid = index < devices_seen;
+	if (valid) {
+		*p_stats = device_stats[index];
+	}
+	CRITICAL_REGION_EXIT();
+	return valid;
+}
+
+uint32_t twi_queue_recoveries(void) {
+	return recoveries;
+}
+
+bool twi_queue_flush(void) {
+	uint8_t last = head;
+	uint32_t waited = 0;
+
+	flushing = true;
+	twi_queue_radio_idle();
+	while (busy) {
+		// Completion happens in the TWI interrupt
+		nrf_delay_us(STALL_POLL_US);
+		if (head != last) {
+			last = head;
+			waited = 0;
+		} else if ((waited += STALL_POLL_US) >= TWI_QUEUE_STALL_US) {
+			twi_queue_recover();
+			flushing = false;
+			return false;
+		}
+	}
+	flushing = false;
+	return true;
+}
+
+static void driver_init(void) {
+	nrf_drv_twi_config_t config = NRF_DRV_TWI_DEFAULT_CONFIG(1);
+	config.frequency = speed_freq[bus_speed];
+
+	nrf_drv_twi_init(&twi, &config, twi_handler);
+#if !TWI_QUEUE_IDLE_DISABLE
+	nrf_drv_twi_enable(&twi);
+	enabled = true;
+#endif
+}
+
+void twi_queue_recover(void) {
+	nrf_drv_twi_uninit(&twi);
+	enabled = false;
+	parked = false;
+	recoveries++;
+	recovered = true;
+	tick_wake(health_task);
+	driver_init();
+	if (busy) {
+		device_count(jobs[head & QUEUE_MASK]->address, 0, true);
+		// Starts whatever was queued behind it
+		job_finish(false);
+	}
+}
+
+static void on_tick(void) {
+	// The same job a whole tick on, longer than any takes
+	bool stalled = busy && !parked && tick_busy && head == tick_head;
+	bool lost_now, recovered_now;
+
+	tick_head = head;
+	tick_busy = busy && !parked;
+	if (resync_wait_ms > 0) {
+		resync_wait_ms -= MIN(resync_wait_ms, TWI_QUEUE_HEALTH_MS);
+		return;
+	}
+	if (stalled) {
+		twi_queue_recover();
+	}
+
+	CRITICAL_REGION_ENTER();
+	lost_now = lost || recovered;
+	recovered_now = recovered;
+	lost = false;
+	recovered = false;
+	CRITICAL_REGION_EXIT();
+
+	if (!lost_now) {
+		resync_backoff_ms = 0;
+		// Nothing to watch until the next submit
+		CRITICAL_REGION_ENTER();
+		if (!busy && !lost && !recovered) {
+			tick_idle(health_task);
+		}
+		CRITICAL_REGION_EXIT();
+		return;
+	}
+	if (resync) {
+		resync(recovered_now);
+	}
+	// Checked again straight after, then further apart while it fails
+	resync_wait_ms = resync_backoff_ms;
+	resync_backoff_ms = MIN(MAX(resync_backoff_ms * 2, TWI_QUEUE_HEALTH_MS), TWI_QUEUE_RESYNC_MAX_MS);
+}
+
+void twi_queue_set_resync(twi_queue_resync_t handler) {
+	resync = handler;
+}
+
+void twi_queue_init(void) {
+	driver_init();
+	health_task = tick_register(on_tick, TWI_QUEUE_HEALTH_MS, 0);
+}
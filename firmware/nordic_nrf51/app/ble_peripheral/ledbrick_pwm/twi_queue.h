@@ -0,0 +1,139 @@
+#ifndef _TWI_QUEUE_H_
+#define _TWI_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of jobs that can be outstanding on the bus (power of two).
+// Each takes a block of the small pool (pool.h) while it waits.
+#define TWI_QUEUE_SIZE 16
+
+// Consecutive failures at one speed before a class drops to the next
+// slower one
+#define TWI_QUEUE_FALLBACK_ERRORS 3
+
+// Disable the peripheral whenever the queue drains and enable it again
+// for the next job
+#define TWI_QUEUE_IDLE_DISABLE 1
+
+// A flush gives up once no job has completed for this long. The longest
+// job, a full PCA9685 burst at 100 kHz, takes under 7 ms.
+#define TWI_QUEUE_STALL_US 20000
+
+// Bus health, checked on the shared tick (tick.h): a job still on the
+// bus a whole tick later has it hung, and it is recovered there and
+// then. After a recovery, or a job failing, the resync handler runs so
+// the drivers can put back what the bus lost, the outputs within a tick
+// or two of the bus coming back. Resyncs that keep failing back off, up
+// to TWI_QUEUE_RESYNC_MAX_MS apart.
+#define TWI_QUEUE_HEALTH_MS 20
+#define TWI_QUEUE_RESYNC_MAX_MS 1000
+
+// Devices given their own error counts, by address as first seen
+#define TWI_QUEUE_DEVICES 8
+
+// While connected, frame jobs longer than this on the wire wait for the
+// gap between radio events they fit in (radio_idle.h), so one isn't
+// stretched by the SoftDevice taking the CPU partway through. One too
+// long for any gap goes as the next event ends.
+#define TWI_QUEUE_RADIO_MIN_US 500
+
+// Transaction classes, each with its own bus speed. Jobs that don't set
+// a class run as TWI_CLASS_CONFIG.
+typedef enum {
+	TWI_CLASS_CONFIG = 0, // Init and rare register writes
+	TWI_CLASS_FRAME,      // LED frame flushes
+	TWI_CLASS_SENSOR,     // Sensor reads
+	TWI_CLASS_COUNT
+} twi_class_t;
+
+typedef enum {
+	TWI_SPEED_100K = 0,
+	TWI_SPEED_250K,
+	TWI_SPEED_400K
+} twi_speed_t;
+
+#define TWI_QUEUE_SPEED_CONFIG TWI_SPEED_100K
+#define TWI_QUEUE_SPEED_FRAME  TWI_SPEED_400K
+#define TWI_QUEUE_SPEED_SENSOR TWI_SPEED_400K
+
+typedef struct twi_job_s twi_job_t;
+
+typedef void (*twi_job_callback_t)(twi_job_t const * p_job, bool success);
+
+// A single bus transaction: an optional write phase followed by an
+// optional read phase (joined by a repeated start). The job itself is
+// copied into the queue, but the data buffers must stay valid until the
+// callback has run. Addresses are 7-bit.
+struct twi_job_s {
+	uint8_t address;
+	uint8_t const * p_tx;
+	uint8_t tx_len;
+	uint8_t * p_rx;
+	uint8_t rx_len;
+	twi_class_t xfer_class;
+	twi_job_callback_t callback;
+	void * p_context;
+};
+
+// Since boot, per class. Bytes are what went over the wire, address
+// bytes included.
+typedef struct {
+	uint32_t jobs;
+	uint32_t failed;
+	uint32_t bytes;
+} twi_class_stats_t;
+
+// Errors since boot for one address. The nRF51 TWI is the only master
+// on its bus, so there's no arbitration to lose: address and data NACKs,
+// receive overruns and the jobs that hung the bus are what go wrong.
+typedef struct {
+	uint8_t address;
+	uint16_t address_nack;
+	uint16_t data_nack;
+	uint16_t overrun;
+	uint16_t timeout;
+} twi_device_stats_t;
+
+// recovered is true after the bus was cleared and the peripheral
+// restarted, when a device may have missed anything, false after a job
+// failed on a bus that still runs
+typedef void (*twi_queue_resync_t)(bool recovered);
+
+// After tick_init()
+void twi_queue_init(void);
+void twi_queue_set_resync(twi_queue_resync_t handler);
+
+// Queue a job. Returns false if the queue is full or the pool is dry.
+bool twi_queue_submit(twi_job_t const * p_job);
+
+bool twi_queue_idle(void);
+
+// Set the preferred speed for a class. Takes effect from the next job of
+// that class and resets any fallback.
+void twi_queue_set_speed(twi_class_t xfer_class, twi_speed_t speed);
+// Speed a class is currently running at, after any fallback
+twi_speed_t twi_queue_speed(twi_class_t xfer_class);
+
+void twi_queue_stats(twi_class_t xfer_class, twi_class_stats_t * p_stats);
+// Most jobs queued at once since boot
+uint8_t twi_queue_peak(void);
+// Errors for the index'th device seen, false past the last
+bool twi_queue_device_stats(uint8_t index, twi_device_stats_t * p_stats);
+// Bus recoveries since boot
+uint32_t twi_queue_recoveries(void);
+
+// Start a job held for a radio gap, for radio_idle_init()
+void twi_queue_radio_idle(void);
+
+// Spin until every queued job has completed. Only for use from thread
+// mode (e.g. during init), never from an interrupt handler. Returns false
+// if the bus stalled, after recovering it with twi_queue_recover().
+bool twi_queue_flush(void);
+
+// Fail the job on the bus and restart the peripheral. Bringing the
+// driver back up clocks SCL until a slave holding SDA low lets go, the
+// same bus clear twi_master does. Thread mode only.
+void twi_queue_recover(void);
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_gap.h"
+#include "ble_hci.h"
+#include "nordic_common.h"
+#include "clock.h"
+#include "link_stats.h"
+#include "tx_power.h"
+
+// The nRF51's levels, lowest first
+static const int8_t levels[] = { -30, -20, -16, -12, -8, -4, 0, 4 };
+#define LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+static uint8_t level;
+static uint8_t level_default;
+// Lowest the brick goes to, raised by links lost
+static uint8_t level_floor = 0;
+static bool connected = false;
+static uint32_t stepped_at;
+static uint16_t changes;
+
+static bool set(uint8_t next) {
+	if (next == level || sd_ble_gap_tx_power_set(levels[next]) != NRF_SUCCESS) {
+		return false;
+	}
+	level = next;
+	stepped_at = clock_ms();
+	changes++;
+	return true;
+}
+
+// What the controller hears of the brick at a level, from what the
+// brick hears of it
+static int16_t heard(int8_t rssi, uint8_t at) {
+	return rssi + levels[at] - TX_POWER_PEER_DBM;
+}
+
+void tx_power_on_ble_evt(ble_evt_t * p_ble_evt) {
+	ble_gap_evt_t const * p_gap = &p_ble_evt->evt.gap_evt;
+
+	switch (p_ble_evt->header.evt_id) {
+	case BLE_GAP_EVT_CONNECTED:
+		connected = true;
+		stepped_at = clock_ms();
+		break;
+
+	case BLE_GAP_EVT_DISCONNECTED:
+		connected = false;
+		switch (p_gap->params.disconnected.reason) {
+		case BLE_HCI_CONNECTION_TIMEOUT:
+		case BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE:
+			// Went too far down, don't go there again
+			level_floor = MIN(MAX(level_floor, level + 1), level_default);
+			break;
+		default:
+			break;
+		}
+		(void)set(level_default);
+		break;
+
+	case BLE_GAP_EVT_RSSI_CHANGED:
+		if (connected && level + 1 < LEVELS &&
+		    heard(p_gap->params.rssi_changed.rssi, level) < TX_POWER_TARGET_DBM) {
+			(void)set(level + 1);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void tx_power_poll(void) {
+	int8_t rssi = link_stats_rssi_avg();
+
+	if (!connected || rssi == 0 || level <= level_floor ||
+	    clock_ms() - stepped_at < TX_POWER_DWELL_MS) {
+		return;
+	}
+	if (heard(rssi, level - 1) >= TX_POWER_TARGET_DBM + TX_POWER_HYSTERESIS_DB) {
+		(void)set(level - 1);
+	}
+}
+
+int8_t tx_power_dbm(void) {
+	return levels[level];
+}
+
+uint16_t tx_power_changes(void) {
+	return changes;
+}
+
+void tx_power_init(void) {
+	level_default = LEVELS - 1;
+	for (uint8_t i = 0; i < LEVELS; i++) {
+		if (levels[i] == TX_POWER_DEFAULT_DBM) {
+			level_default = i;
+			break;
+		}
+	}
+	level = level_default;
+	(void)sd_ble_gap_tx_power_set(levels[level]);
+}
@@ -0,0 +1,39 @@
+#ifndef _TX_POWER_H_
+#define _TX_POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+// Transmit power following the link: a brick near its controller steps
+// down the nRF51's levels while the controller would still hear it well,
+// saving current and keeping a dense rack of bricks off each other's
+// channels, and steps back up as the signal goes. Links are taken as
+// symmetric, the controller sending at TX_POWER_PEER_DBM, so what it
+// hears is the brick's RSSI (link_stats.h) plus the brick's power less
+// the controller's.
+//
+// Down one level a TX_POWER_DWELL_MS at most, while the average heard
+// would stay TX_POWER_HYSTERESIS_DB over TX_POWER_TARGET_DBM after the
+// step; up one straight away when the latest sample puts it under the
+// target. The power is global to the SoftDevice, so advertising goes
+// back to TX_POWER_DEFAULT_DBM at every disconnect. One lost to a
+// supervision timeout or MIC failure raises the lowest level the brick
+// goes to by one, for the rest of its uptime.
+#define TX_POWER_DEFAULT_DBM 0
+#define TX_POWER_PEER_DBM 0
+#define TX_POWER_TARGET_DBM (-70)
+#define TX_POWER_HYSTERESIS_DB 6
+#define TX_POWER_DWELL_MS 10000
+
+void tx_power_init(void);
+// After link_stats_on_ble_evt()
+void tx_power_on_ble_evt(ble_evt_t * p_ble_evt);
+// From the poll, steps down over a quiet link whose RSSI never moves
+void tx_power_poll(void);
+
+// Power now in dBm, and the changes since boot
+int8_t tx_power_dbm(void);
+uint16_t tx_power_changes(void);
+
+#endif
@@ -0,0 +1,34 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_util_platform.h"
+#include "nrf_drv_wdt.h"
+#include "watchdog.h"
+
+static nrf_drv_wdt_channel_id channels[WATCHDOG_COUNT];
+static bool running = false;
+
+static void on_timeout(void) {
+	// About two 32 kHz ticks until the reset, nothing useful fits
+}
+
+void watchdog_init(void) {
+	nrf_drv_wdt_config_t config = NRF_DRV_WDT_DEAFULT_CONFIG;
+
+	config.reload_value = WATCHDOG_TIMEOUT_MS;
+	if (nrf_drv_wdt_init(&config, on_timeout) != NRF_SUCCESS) {
+		return;
+	}
+	for (uint8_t i = 0; i < WATCHDOG_COUNT; i++) {
+		if (nrf_drv_wdt_channel_alloc(&channels[i]) != NRF_SUCCESS) {
+			return;
+		}
+	}
+	nrf_drv_wdt_enable();
+	running = true;
+}
+
+void watchdog_feed(watchdog_channel_t channel) {
+	if (running) {
+		nrf_drv_wdt_channel_feed(channels[channel]);
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+
+#include <stdint.h>
+
+// Hardware watchdog with one reload register per subsystem, the chip
+// resets unless every one of them has been fed within the timeout
+typedef enum {
+	WATCHDOG_RADIO = 0, // SoftDevice answering calls
+	WATCHDOG_TWI,       // Bus jobs completing
+	WATCHDOG_SENSORS,   // Temperature samples coming back
+	WATCHDOG_COUNT
+} watchdog_channel_t;
+
+// Every channel is fed at least once per poll interval (5 s), so this
+// allows a couple of missed polls before pulling the plug
+#define WATCHDOG_TIMEOUT_MS 15000
+
+void watchdog_init(void);
+// Safe from any context
+void watchdog_feed(watchdog_channel_t channel);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef LEDBRICK_FLASH_H
+#define LEDBRICK_FLASH_H
+
+// The flash the LEDBrick application keeps across updates, shared by its
+// pstorage_platform.h and the bootloader's dfu_types.h so a DFU bank can
+// never reach it. The bootloader has to be built with the same
+// HISTORY_FLASH_PAGES as the application.
+
+// nRF51 flash page, as PSTORAGE_FLASH_PAGE_SIZE reads it from the FICR,
+// for sizing records at compile time
+#define FLASH_PAGE_SIZE 1024
+
+// Pages the history log (history.h) also keeps its blocks in, 0 for RAM only
+#ifndef HISTORY_FLASH_PAGES
+#define HISTORY_FLASH_PAGES 0
+#endif
+
+// pstorage pages, besides its swap page: the journal (4), the device
+// manager, the schedule, scenes and auxiliary outputs (a page each), the
+// config store (2, kv.h), run hours (2, runhours.h) and any the history
+// log spills to
+#define LEDBRICK_PSTORAGE_PAGES (12 + HISTORY_FLASH_PAGES)
+
+#endif
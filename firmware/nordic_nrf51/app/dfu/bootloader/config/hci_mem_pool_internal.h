@@ -0,0 +1,37 @@
+/* Copyright (c) 2013 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+ 
+/** @file
+ *
+ * @defgroup memory_pool_internal Memory Pool Internal
+ * @{
+ * @ingroup memory_pool
+ *
+ * @brief Memory pool internal definitions
+ *
+ * Replaces the one in bootloader_dfu/ble_transport: every firmware packet holds an RX buffer
+ * until its flash write completes, so the queue bounds how far the link can run ahead of the
+ * flash. Twice the SDK default, so a burst from a wide packet receipt window doesn't run out of
+ * buffers while the SoftDevice fits the writes in between radio events.
+ */
+ 
+#ifndef MEM_POOL_INTERNAL_H__
+#define MEM_POOL_INTERNAL_H__
+
+#define TX_BUF_SIZE       4u    /**< TX buffer size in bytes. */
+#define RX_BUF_SIZE       32u   /**< RX buffer size in bytes. */
+
+#define RX_BUF_QUEUE_SIZE 16u   /**< RX buffer element size, a power of two. */
+
+#endif // MEM_POOL_INTERNAL_H__
+ 
+/** @} */
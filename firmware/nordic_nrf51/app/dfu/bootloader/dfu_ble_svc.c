@@ -0,0 +1,151 @@
+/* Copyright (c) 2014 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+#include "dfu_ble_svc.h"
+#include <string.h>
+#include "nrf_error.h"
+#include "crc16.h"
+
+/* The peer data sits at the top of RAM (NOINIT in the linker script), above the application's
+ * own retained RAM, so handing it over doesn't disturb what the application keeps. */
+#if defined ( __CC_ARM )
+static dfu_ble_peer_data_t m_peer_data __attribute__((section("NoInit"), zero_init));       /**< This variable should be placed in a non initialized RAM section in order to be valid upon soft reset from application into bootloader. */
+static uint16_t            m_peer_data_crc __attribute__((section("NoInit"), zero_init));   /**< CRC variable to ensure the integrity of the peer data provided. */
+#elif defined ( __GNUC__ )
+__attribute__((section(".noinit"))) static dfu_ble_peer_data_t m_peer_data;                  /**< This variable should be placed in a non initialized RAM section in order to be valid upon soft reset from application into bootloader. */
+__attribute__((section(".noinit"))) static uint16_t            m_peer_data_crc;              /**< CRC variable to ensure the integrity of the peer data provided. */
+#endif
+
+
+/**@brief Function for setting the peer data from application in bootloader before reset.
+ *
+ * @param[in] p_peer_data  Pointer to the peer data containing keys for the connection.
+ *
+ * @retval NRF_SUCCESS    The data was set succesfully.
+ * @retval NRF_ERROR_NULL If a null pointer was passed as argument.
+ */
+static uint32_t dfu_ble_peer_data_set(dfu_ble_peer_data_t * p_peer_data)
+{
+    if (p_peer_data == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    // The application may pass a copy that overlaps this one
+    if (p_peer_data != &m_peer_data)
+    {
+        memmove(&m_peer_data, p_peer_data, sizeof(m_peer_data));
+    }
+
+    m_peer_data_crc = crc16_compute((uint8_t *)&m_peer_data, sizeof(m_peer_data), NULL);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t dfu_ble_peer_data_get(dfu_ble_peer_data_t * p_peer_data)
+{
+    uint16_t crc;
+
+    if (p_peer_data == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    crc = crc16_compute((uint8_t *)&m_peer_data, sizeof(m_peer_data), NULL);
+    if (crc != m_peer_data_crc)
+    {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    *p_peer_data = m_peer_data;
+
+    // corrupt CRC to invalidate shared information.
+    m_peer_data_crc++;
+
+    return NRF_SUCCESS;
+}
+
+
+/**@brief   Function for the bootloader SVC handler.
+ *
+ * @details Called from SVC_Handler with the SVC number and the stacked arguments, the return
+ *          value goes back in the stacked r0.
+ *
+ * @param[in]     svc_num    SVC number of the call.
+ * @param[in,out] p_svc_args Stacked registers r0 - r3 of the caller.
+ */
+void C_SVC_Handler(uint8_t svc_num, uint32_t * p_svc_args)
+{
+    switch (svc_num)
+    {
+        case DFU_BLE_SVC_PEER_DATA_SET:
+            p_svc_args[0] = dfu_ble_peer_data_set((dfu_ble_peer_data_t *)p_svc_args[0]);
+            break;
+
+        default:
+            p_svc_args[0] = NRF_ERROR_SVC_HANDLER_MISSING;
+            break;
+    }
+}
+
+
+/**@brief   Function for handling the SVCs the MBR forwards for the bootloader's SVC numbers.
+ *
+ * @details Finds the stack the call was made on, then the SVC number from the svc instruction
+ *          itself, and passes both on to C_SVC_Handler.
+ */
+#if defined ( __CC_ARM )
+__asm void SVC_Handler(void)
+{
+EXC_RETURN_CMD_PSP  EQU 0xFFFFFFFD  ; EXC_RETURN using PSP for ARM Cortex. If Link register contains this value it indicates the PSP was used before the SVC, otherwise the MSP was used.
+
+    IMPORT C_SVC_Handler
+    LDR   R0, =EXC_RETURN_CMD_PSP   ; Load the EXC_RETURN into R0 to be able to compare against LR to determine stack pointer used.
+    CMP   R0, LR                    ; Compare the link register with R0. If equal then PSP was used, otherwise MSP was used before SVC.
+    BNE   UseMSP                    ; Branch to code fetching SVC arguments using MSP.
+    MRS   R1, PSP                   ; Move PSP into R1.
+    B     Call_C_SVC_Handler        ; Branch to call C_SVC_Handler below.
+UseMSP
+    MRS   R1, MSP                   ; MSP was used, therefore Move MSP into R1.
+Call_C_SVC_Handler
+    LDR   R0, [R1, #24]             ; The arguments for the SVC was stacked. R1 contains Stack Pointer, the values stacked before SVC are R0, R1, R2, R3, R12, LR, PC (Return address), xPSR.
+                                    ; R1 contains current SP so the PC of the stacked frame is at SP + 6 words (24 bytes). We load the PC into R0.
+    SUBS  R0, #2                    ; The PC before the SVC is in R0. We subtract 2 to get the address prior to the instruction executed where the SVC number is located.
+    LDRB  R0, [R0]                  ; SVC instruction low octet: Load the byte at the address before the PC to fetch the SVC number.
+    LDR   R2, =C_SVC_Handler        ; Load address of C implementation of SVC handler.
+    BX    R2                        ; Branch to C implementation of SVC handler. R0 is now the SVC number, R1 is the StackPointer where the arguments (R0-R3) of the original SVC are located.
+    ALIGN
+}
+#elif defined ( __GNUC__ )
+void __attribute__ (( naked )) SVC_Handler(void)
+{
+    const uint32_t exc_return = 0xFFFFFFFD;      // EXC_RETURN using PSP for ARM Cortex. If Link register contains this value it indicates the PSP was used before the SVC, otherwise the MSP was used.
+
+    __ASM volatile(
+        "cmp   lr, %0\t\n"                       // Compare Link register to EXC Return, if equal then PSP was used before SVC.
+        "bne   UseMSP\t\n"                       // If not equal then use MSP, else use PSP.
+        "mrs   r1, psp\t\n"                      // Set PSP as R1 for use in C_SVC_Handler.
+        "b     Call_C_SVC_Handler\t\n"
+        "UseMSP:  \t\n"
+        "mrs   r1, msp\t\n"                      // MSP was used before SVC, set MSP as R1.
+        "Call_C_SVC_Handler:  \t\n"
+        "ldr   r0, [r1, #24]\t\n"                // Fetch the stacked PC (moved after R0-R3, R12, LR) to R0.
+        "subs  r0, #2\t\n"                       // Move R0 back 2 bytes to point at the svc instruction.
+        "ldrb  r0, [r0]\t\n"                     // Fetch the svc number (lower byte) from the svc instruction.
+        "ldr   r2, =C_SVC_Handler\t\n"           // Load address of C implementation of SVC handler.
+        "bx    r2\t\n"                           // Branch to C implementation of SVC handler.
+        ".align\t\n"
+        :: "r" (exc_return)                      // Allow C_SVC_Handler to access exc_return variable.
+    );
+}
+#endif
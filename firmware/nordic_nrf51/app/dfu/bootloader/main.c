@@ -0,0 +1,307 @@
+/* Copyright (c) 2013 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is property of Nordic Semiconductor ASA.
+ * Terms and conditions of usage are described in detail in NORDIC
+ * SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT.
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRANTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+
+/** @file
+ *
+ * @defgroup ledbrick_bootloader main.c
+ * @{
+ * @ingroup ledbrick_dfu
+ * @brief Dual bank BLE bootloader for the LEDBrick.
+ *
+ * The application hands over here when the controller writes the start procedure to its DFU
+ * control point. The new image is received into bank 1 while bank 0 stays valid, and is only
+ * copied over bank 0 once it has been validated; a failed or abandoned transfer boots the old
+ * image again.
+ *
+ * The outputs are left alone: the PCA9685 holds the last levels the application wrote, and OE,
+ * the GPIOTE and the PPI channels of the thermal cutoff keep the configuration the application
+ * left them in. The application's watchdog keeps running through the jump, so it is fed here.
+ *
+ * Most resets, a brownout among them, take the fast path: with no update asked for and bank 0
+ * verified since it was written, the application is started before the SoftDevice, the timers or
+ * the scheduler are brought up, and without the CRC over the image. The first reset after an
+ * update, and any after a watchdog or lockup reset, check the CRC first and only then skip ahead.
+ * TIMER1 counts from reset and is left running, the application reads it as the bootloader phase
+ * of its boot trace.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "dfu_transport.h"
+#include "bootloader.h"
+#include "bootloader_util.h"
+#include "nordic_common.h"
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf51_bitfields.h"
+#include "app_error.h"
+#include "nrf_gpio.h"
+#include "ble.h"
+#include "ble_hci.h"
+#include "app_scheduler.h"
+#include "app_timer_appsh.h"
+#include "nrf_error.h"
+#include "boards.h"
+#include "softdevice_handler_appsh.h"
+#include "pstorage_platform.h"
+#include "nrf_mbr.h"
+
+#define IS_SRVC_CHANGED_CHARACT_PRESENT 1                                                       /**< Include the service_changed characteristic. For DFU this should normally be the case. */
+
+#define BOOTLOADER_BUTTON               BSP_BUTTON_2                                            /**< Held through a reset to enter SW update mode. */
+
+#define APP_TIMER_PRESCALER             0                                                       /**< Value of the RTC1 PRESCALER register. */
+#define APP_TIMER_MAX_TIMERS            4                                                       /**< Maximum number of simultaneously created timers: DFU timeout, connection parameters and the watchdog feed. */
+#define APP_TIMER_OP_QUEUE_SIZE         4                                                       /**< Size of timer operation queues. */
+
+#define WDT_FEED_INTERVAL               APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER)              /**< Well inside the application's WATCHDOG_TIMEOUT_MS. */
+
+#define SCHED_MAX_EVENT_DATA_SIZE       MAX(APP_TIMER_SCHED_EVT_SIZE, 0)                        /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE                20                                                      /**< Maximum number of events in the scheduler queue. */
+
+#define RESET_CHECK_MASK                (POWER_RESETREAS_DOG_Msk | POWER_RESETREAS_LOCKUP_Msk)  /**< Resets after which the image is checked again before the application runs, the application clears RESETREAS as it starts. */
+
+static app_timer_id_t                   m_wdt_timer_id;                                         /**< Feeds the watchdog while a transfer runs. */
+
+
+/**@brief Function for feeding every watchdog reload register the application enabled.
+ *
+ * @details The watchdog can't be stopped once the application has started it, and it isn't
+ *          reset by the jump into the bootloader. Without the watchdog running this does nothing.
+ */
+static void wdt_feed(void)
+{
+    if ((NRF_WDT->RUNSTATUS & WDT_RUNSTATUS_RUNSTATUS_Msk) == 0)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < sizeof(NRF_WDT->RR) / sizeof(NRF_WDT->RR[0]); i++)
+    {
+        if (NRF_WDT->RREN & (1UL << i))
+        {
+            NRF_WDT->RR[i] = WDT_RR_RR_Reload;
+        }
+    }
+}
+
+
+static void wdt_feed_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    wdt_feed();
+}
+
+
+/**@brief Function for starting TIMER1 counting microseconds, the same way as the application's
+ *        boot trace (boot_trace.c).
+ */
+static void boot_timer_start(void)
+{
+    NRF_TIMER1->MODE      = TIMER_MODE_MODE_Timer;
+    NRF_TIMER1->BITMODE   = TIMER_BITMODE_BITMODE_32Bit;
+    NRF_TIMER1->PRESCALER = 4;
+    NRF_TIMER1->TASKS_CLEAR = 1;
+    NRF_TIMER1->TASKS_START = 1;
+}
+
+
+/**@brief Function for initializing the button module.
+ */
+static void buttons_init(void)
+{
+    nrf_gpio_cfg_sense_input(BOOTLOADER_BUTTON,
+                             BUTTON_PULL,
+                             NRF_GPIO_PIN_SENSE_LOW);
+}
+
+
+/**@brief Function for dispatching a system event to interested modules.
+ *
+ * @param[in] event  System stack event.
+ */
+static void sys_evt_dispatch(uint32_t event)
+{
+    pstorage_sys_event_handler(event);
+}
+
+
+/**@brief Function for the timer module and the watchdog feed initialization.
+ */
+static void timers_init(void)
+{
+    uint32_t err_code;
+
+    // Initialize timer module, making it use the scheduler.
+    APP_TIMER_APPSH_INIT(APP_TIMER_PRESCALER, APP_TIMER_MAX_TIMERS, APP_TIMER_OP_QUEUE_SIZE, true);
+
+    err_code = app_timer_create(&m_wdt_timer_id, APP_TIMER_MODE_REPEATED, wdt_feed_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for initializing the BLE stack.
+ *
+ * @details Initializes the SoftDevice and the BLE event interrupt.
+ *
+ * @param[in] init_softdevice  true if SoftDevice should be initialized. The SoftDevice must only
+ *                             be initialized if a chip reset has occured. Soft reset from
+ *                             application must not reinitialize the SoftDevice.
+ */
+static void ble_stack_init(bool init_softdevice)
+{
+    uint32_t         err_code;
+    sd_mbr_command_t com = {SD_MBR_COMMAND_INIT_SD, };
+
+    if (init_softdevice)
+    {
+        err_code = sd_mbr_command(&com);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    err_code = sd_softdevice_vector_table_base_set(BOOTLOADER_REGION_START);
+    APP_ERROR_CHECK(err_code);
+
+    // The same clock source as the application, the LEDBrick has no 32 kHz crystal
+    SOFTDEVICE_HANDLER_APPSH_INIT(NRF_CLOCK_LFCLKSRC_RC_250_PPM_4000MS_CALIBRATION, true);
+
+    // Enable BLE stack
+    ble_enable_params_t ble_enable_params;
+    memset(&ble_enable_params, 0, sizeof(ble_enable_params));
+#ifdef S130
+    ble_enable_params.gatts_enable_params.attr_tab_size   = BLE_GATTS_ATTR_TAB_SIZE_DEFAULT;
+#endif
+    ble_enable_params.gatts_enable_params.service_changed = IS_SRVC_CHANGED_CHARACT_PRESENT;
+    err_code = sd_ble_enable(&ble_enable_params);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = softdevice_sys_evt_handler_set(sys_evt_dispatch);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for event scheduler initialization.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+}
+
+
+/**@brief Function for starting the application without a full boot where nothing needs one.
+ *
+ * @details Returns when an update is asked for by the button, a SoftDevice or bootloader update is
+ *          under way, or bank 0 fails its check, all of which need the full boot.
+ */
+static void fast_boot(void)
+{
+    if ((nrf_gpio_pin_read(BOOTLOADER_BUTTON) == 0) || bootloader_dfu_sd_in_progress())
+    {
+        return;
+    }
+
+    if (!bootloader_app_is_verified() || (NRF_POWER->RESETREAS & RESET_CHECK_MASK))
+    {
+        if (!bootloader_app_is_valid(DFU_BANK_0_REGION_START))
+        {
+            return;
+        }
+        bootloader_app_verified_set();
+    }
+
+    bootloader_app_start_direct(DFU_BANK_0_REGION_START);
+}
+
+
+/**@brief Function for bootloader main entry.
+ */
+int main(void)
+{
+    uint32_t err_code;
+    bool     dfu_start = false;
+    bool     app_reset = (NRF_POWER->GPREGRET == BOOTLOADER_DFU_START);
+
+    boot_timer_start();
+
+    // Straight away, the application may have fed it a while ago
+    wdt_feed();
+
+    if (app_reset)
+    {
+        NRF_POWER->GPREGRET = 0;
+    }
+
+    // This check ensures that the defined fields in the bootloader corresponds with actual
+    // setting in the chip.
+    APP_ERROR_CHECK_BOOL(*((uint32_t *)NRF_UICR_BOOT_START_ADDRESS) == BOOTLOADER_REGION_START);
+    APP_ERROR_CHECK_BOOL(NRF_FICR->CODEPAGESIZE == CODE_PAGE_SIZE);
+
+    buttons_init();
+
+    // Only after a chip reset, a reset from the application is asking for an update
+    if (!app_reset)
+    {
+        fast_boot();
+    }
+
+    // Initialize.
+    timers_init();
+
+    (void)bootloader_init();
+
+    if (bootloader_dfu_sd_in_progress())
+    {
+        err_code = bootloader_dfu_sd_update_continue();
+        APP_ERROR_CHECK(err_code);
+
+        ble_stack_init(!app_reset);
+        scheduler_init();
+
+        err_code = bootloader_dfu_sd_update_finalize();
+        APP_ERROR_CHECK(err_code);
+    }
+    else
+    {
+        // If stack is present then continue initialization of bootloader.
+        ble_stack_init(!app_reset);
+        scheduler_init();
+    }
+
+    dfu_start  = app_reset;
+    dfu_start |= ((nrf_gpio_pin_read(BOOTLOADER_BUTTON) == 0) ? true: false);
+
+    if (dfu_start || (!bootloader_app_is_valid(DFU_BANK_0_REGION_START)))
+    {
+        err_code = app_timer_start(m_wdt_timer_id, WDT_FEED_INTERVAL, NULL);
+        APP_ERROR_CHECK(err_code);
+
+        // Initiate an update of the firmware.
+        err_code = bootloader_dfu_start();
+        APP_ERROR_CHECK(err_code);
+
+        err_code = app_timer_stop(m_wdt_timer_id);
+        APP_ERROR_CHECK(err_code);
+        wdt_feed();
+    }
+
+    if (bootloader_app_is_valid(DFU_BANK_0_REGION_START) && !bootloader_dfu_sd_in_progress())
+    {
+        // Select a bank region to use as application region.
+        // @note: Only applications running from DFU_BANK_0_REGION_START is supported.
+        bootloader_app_start(DFU_BANK_0_REGION_START);
+    }
+
+    NVIC_SystemReset();
+}
+
+/**
+ * @}
+ */
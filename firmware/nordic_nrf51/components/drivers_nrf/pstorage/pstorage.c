@@ -211,6 +211,7 @@ typedef struct
 } cmd_queue_t;
 
 static cmd_queue_t             m_cmd_queue;                            /**< Flash operation request queue. */
+static uint8_t                 m_cmd_queue_peak;                       /**< Most operations the queue has held at once. */
 static pstorage_size_t         m_next_app_instance;                    /**< Points to the application module instance that can be allocated next. */
 static uint32_t                m_next_page_addr;                       /**< Points to the flash address that can be allocated to a module next. This is needed as blocks of a module that can span across flash pages. */
 static pstorage_state_t        m_state;                                /**< Main state tracking variable. */
@@ -647,6 +648,10 @@ static uint32_t cmd_queue_enqueue(uint8_t             opcode,
         m_cmd_queue.cmd[write_index].offset       = offset;
                
         m_cmd_queue.count++;
+        if (m_cmd_queue.count > m_cmd_queue_peak)
+        {
+            m_cmd_queue_peak = m_cmd_queue.count;
+        }
                                 
         if (m_state == STATE_IDLE)
         {
@@ -1497,6 +1502,12 @@ uint32_t pstorage_access_status_get(uint32_t * p_count)
     return NRF_SUCCESS;
 }
 
+
+uint32_t pstorage_access_peak_get(void)
+{
+    return m_cmd_queue_peak;
+}
+
 #ifdef PSTORAGE_RAW_MODE_ENABLE
 
 uint32_t pstorage_raw_register(pstorage_module_param_t * p_module_param,
@@ -293,6 +293,12 @@ uint32_t pstorage_clear(pstorage_handle_t * p_base_id, pstorage_size_t size);
  */
 uint32_t pstorage_access_status_get(uint32_t * p_count);
 
+/**@brief Function for getting the most operations ever pending with the module at once.
+ *
+ * @retval     Peak of the count pstorage_access_status_get() gives, since boot.
+ */
+uint32_t pstorage_access_peak_get(void);
+
 #ifdef PSTORAGE_RAW_MODE_ENABLE
 
 /**@brief Function for registering with the persistent storage interface.
@@ -20,6 +20,7 @@
 #include "nrf51.h"
 #include "app_error.h"
 #include "nrf_sdm.h"
+#include "nrf_mbr.h"
 #include "nordic_common.h"
 #include "crc16.h"
 #include "pstorage.h"
@@ -129,8 +130,61 @@ bool bootloader_app_is_valid(uint32_t app_addr)
 }
 
 
+bool bootloader_app_is_verified(void)
+{
+    const bootloader_settings_t * p_bootloader_settings;
+
+    if (*((uint32_t *)DFU_BANK_0_REGION_START) == EMPTY_FLASH_MASK)
+    {
+        return false;
+    }
+
+    bootloader_util_settings_get(&p_bootloader_settings);
+
+    return (p_bootloader_settings->bank_0 == BANK_VALID_APP) &&
+           (p_bootloader_settings->bank_0_verified == BANK_0_VERIFIED);
+}
+
+
+void bootloader_app_verified_set(void)
+{
+    const bootloader_settings_t * p_bootloader_settings;
+
+    bootloader_util_settings_get(&p_bootloader_settings);
+
+    // Only settings read straight from flash can be marked, and the word can only be programmed
+    // once between erases.
+    if (((uint32_t)p_bootloader_settings != BOOTLOADER_SETTINGS_ADDRESS) ||
+        (p_bootloader_settings->bank_0_verified != BANK_0_UNVERIFIED))
+    {
+        return;
+    }
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos);
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy)
+    {
+        // Do nothing.
+    }
+
+    *(volatile uint32_t *)&p_bootloader_settings->bank_0_verified = BANK_0_VERIFIED;
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy)
+    {
+        // Do nothing.
+    }
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy)
+    {
+        // Do nothing.
+    }
+}
+
+
 static void bootloader_settings_save(bootloader_settings_t * p_settings)
 {
+    // Whatever changed, bank 0 is checked again on the next reset.
+    p_settings->bank_0_verified = BANK_0_UNVERIFIED;
+
     uint32_t err_code = pstorage_clear(&m_bootsettings_handle, sizeof(bootloader_settings_t));
     APP_ERROR_CHECK(err_code);
 
@@ -314,6 +368,21 @@ void bootloader_app_start(uint32_t app_addr)
 }
 
 
+void bootloader_app_start_direct(uint32_t app_addr)
+{
+    sd_mbr_command_t com = {SD_MBR_COMMAND_INIT_SD, };
+
+    // Forwarding is only set up by the MBR once asked, the SoftDevice itself stays disabled.
+    uint32_t err_code = sd_mbr_command(&com);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = sd_softdevice_vector_table_base_set(CODE_REGION_1_START);
+    APP_ERROR_CHECK(err_code);
+
+    bootloader_util_app_start(CODE_REGION_1_START);
+}
+
+
 bool bootloader_dfu_sd_in_progress(void)
 {
     const bootloader_settings_t * p_bootloader_settings;
@@ -383,5 +452,6 @@ void bootloader_settings_get(bootloader_settings_t * const p_settings)
     p_settings->bl_image_size  = p_bootloader_settings->bl_image_size;
     p_settings->app_image_size = p_bootloader_settings->app_image_size;
     p_settings->sd_image_start = p_bootloader_settings->sd_image_start;
+    p_settings->bank_0_verified = p_bootloader_settings->bank_0_verified;
 }
 
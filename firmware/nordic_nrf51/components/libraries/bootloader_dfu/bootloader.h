@@ -57,6 +57,32 @@ uint32_t bootloader_dfu_start(void);
  */
 void bootloader_app_start(uint32_t app_addr);
 
+/**@brief Function for booting into the application straight after a chip reset.
+ *
+ * @details For the fast boot path, before the SoftDevice or any interrupt has been enabled: sets
+ *          up interrupt forwarding through the MBR and jumps, leaving the SoftDevice for the
+ *          application to enable.
+ *
+ * @param[in]  app_addr      Address to the region where the application is stored.
+ */
+void bootloader_app_start_direct(uint32_t app_addr);
+
+/**@brief Function for checking whether bank 0 passed its CRC check since it was last written.
+ *
+ * @details Reads the settings only, without the CRC computation of @ref bootloader_app_is_valid.
+ *
+ * @retval     true          If bank 0 holds a valid application that has been verified.
+ * @retval     false         If it has not been verified, or is not valid.
+ */
+bool bootloader_app_is_verified(void);
+
+/**@brief Function for marking bank 0 as verified, once @ref bootloader_app_is_valid passed.
+ *
+ * @details Programs the flag in the settings page through the NVMC directly, so it must run
+ *          while the SoftDevice is disabled. Storing the settings again clears it.
+ */
+void bootloader_app_verified_set(void);
+
 /**@brief Function for retrieving the bootloader settings.
  *
  * @param[out] p_settings    A copy of the current bootloader settings is returned in the structure
@@ -83,6 +83,9 @@ void bootloader_util_settings_get(const bootloader_settings_t ** pp_bootloader_s
         index                                   += sizeof(uint32_t);
         s_converted_boot_settings.sd_image_start = uint32_decode(&m_boot_settings[index]);;
 
+        // Older layouts never had the image verified, so it is checked on every reset
+        s_converted_boot_settings.bank_0_verified = BANK_0_UNVERIFIED;
+
         *pp_bootloader_settings = &s_converted_boot_settings;
     }
 }
@@ -29,6 +29,9 @@
 
 #define BOOTLOADER_SVC_APP_DATA_PTR_GET 0x02
 
+#define BANK_0_UNVERIFIED 0xFFFFFFFF /**< bank_0_verified as stored with the settings, left as erased so it can be programmed without an erase. */
+#define BANK_0_VERIFIED   0x46415354 /**< bank_0_verified once the image in bank 0 has passed its CRC check. */
+
 /**@brief DFU Bank state code, which indicates wether the bank contains: A valid image, invalid image, or an erased flash.
   */
 typedef enum
@@ -52,6 +55,7 @@ typedef struct
     uint32_t               bl_image_size;   /**< Size of Bootloader image in bank0 if bank_0 code is BANK_VALID_SD. */
     uint32_t               app_image_size;  /**< Size of Application image in bank0 if bank_0 code is BANK_VALID_SD. */
     uint32_t               sd_image_start;  /**< Location in flash where SoftDevice image is stored for SoftDevice update. */
+    uint32_t               bank_0_verified; /**< BANK_0_VERIFIED once bank 0 has been checked against bank_0_crc since the settings were last stored, so later resets skip the check. */
 } bootloader_settings_t;
 
 #endif // BOOTLOADER_TYPES_H__ 
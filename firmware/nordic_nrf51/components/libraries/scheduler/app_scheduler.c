@@ -34,6 +34,7 @@ static volatile uint8_t m_queue_start_index;    /**< Index of queue entry at the
 static volatile uint8_t m_queue_end_index;      /**< Index of queue entry at the end of the queue. */
 static uint16_t         m_queue_event_size;     /**< Maximum event size in queue. */
 static uint16_t         m_queue_size;           /**< Number of queue entries. */
+static uint16_t         m_max_queue_utilization; /**< Most entries the queue has held at once. */
 
 /**@brief Function for incrementing a queue index, and handle wrap-around.
  *
@@ -67,6 +68,22 @@ static __INLINE uint8_t app_sched_queue_empty()
 #define APP_SCHED_QUEUE_EMPTY() app_sched_queue_empty()
 
 
+/**@brief Function for noting the queue fill after an event went in. Called inside the critical
+ *        region of app_sched_event_put().
+ */
+static __INLINE void queue_utilization_check(void)
+{
+    uint16_t start = m_queue_start_index;
+    uint16_t end   = m_queue_end_index;
+    uint16_t used  = (end >= start) ? (end - start) : (m_queue_size + 1 - start + end);
+
+    if (used > m_max_queue_utilization)
+    {
+        m_max_queue_utilization = used;
+    }
+}
+
+
 uint32_t app_sched_init(uint16_t event_size, uint16_t queue_size, void * p_event_buffer)
 {
     uint16_t data_start_index = (queue_size + 1) * sizeof(event_header_t);
@@ -84,11 +101,18 @@ uint32_t app_sched_init(uint16_t event_size, uint16_t queue_size, void * p_event
     m_queue_start_index   = 0;
     m_queue_event_size    = event_size;
     m_queue_size          = queue_size;
+    m_max_queue_utilization = 0;
 
     return NRF_SUCCESS;
 }
 
 
+uint16_t app_sched_queue_utilization_get(void)
+{
+    return m_max_queue_utilization;
+}
+
+
 uint32_t app_sched_event_put(void                    * p_event_data,
                              uint16_t                  event_data_size,
                              app_sched_event_handler_t handler)
@@ -105,6 +129,7 @@ uint32_t app_sched_event_put(void                    * p_event_data,
         {
             event_index       = m_queue_end_index;
             m_queue_end_index = next_index(m_queue_end_index);
+            queue_utilization_check();
         }
 
         CRITICAL_REGION_EXIT();
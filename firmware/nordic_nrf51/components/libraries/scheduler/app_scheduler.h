@@ -132,6 +132,12 @@ uint32_t app_sched_event_put(void *                    p_event_data,
                              uint16_t                  event_size,
                              app_sched_event_handler_t handler);
 
+/**@brief Function for getting the maximum observed queue utilization.
+ *
+ * @return      Most events the queue has held at once since app_sched_init().
+ */
+uint16_t app_sched_queue_utilization_get(void);
+
 #ifdef APP_SCHEDULER_WITH_PAUSE
 /**@brief A function to pause the scheduler.
  *
@@ -138,6 +138,7 @@ static uint8_t                       m_ticks_elapsed_q_write_ind;
 static app_timer_evt_schedule_func_t m_evt_schedule_func;                       /**< Pointer to function for propagating timeout events to the scheduler. */
 static bool                          m_rtc1_running;                            /**< Boolean indicating if RTC1 is running. */
 static bool                          m_rtc1_reset;                              /**< Boolean indicating if RTC1 counter has been reset due to last timer removed from timer list during the timer list handling. */
+static uint8_t                       m_max_user_op_queue_utilization;           /**< Most operations any user's queue has held at once. */
  
 
 /**@brief Function for initializing the RTC1 counter.
@@ -779,7 +780,17 @@ static void timer_list_handler(void)
  */
 static void user_op_enque(timer_user_t * p_user, app_timer_id_t last_index)
 {
+    uint8_t first = p_user->first;
+    uint8_t used;
+
     p_user->last = last_index;
+
+    used = (last_index >= first) ? (last_index - first)
+                                 : (p_user->user_op_queue_size - first + last_index);
+    if (used > m_max_user_op_queue_utilization)
+    {
+        m_max_user_op_queue_utilization = used;
+    }
 }
 
 
@@ -1154,3 +1165,9 @@ uint32_t app_timer_cnt_diff_compute(uint32_t   ticks_to,
     return NRF_SUCCESS;
 }
 
+
+uint16_t app_timer_op_queue_utilization_get(void)
+{
+    return m_max_user_op_queue_utilization;
+}
+
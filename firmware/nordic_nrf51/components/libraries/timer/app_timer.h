@@ -262,6 +262,12 @@ uint32_t app_timer_cnt_diff_compute(uint32_t   ticks_to,
                                     uint32_t   ticks_from,
                                     uint32_t * p_ticks_diff);
 
+/**@brief Function for getting the maximum observed operation queue utilization.
+ *
+ * @return     Most operations any user's queue has held at once, since boot.
+ */
+uint16_t app_timer_op_queue_utilization_get(void);
+
 #endif // APP_TIMER_H__
 
 /** @} */